@@ -26,6 +26,8 @@
         'allocators_impl.h',
         'block.cc',
         'block.h',
+        'block_checksum.cc',
+        'block_checksum.h',
         'block_impl.h',
         'block_utils.cc',
         'block_utils.h',
@@ -33,6 +35,8 @@
         'circular_queue_impl.h',
         'constants.cc',
         'constants.h',
+        'crash_report_builder.cc',
+        'crash_report_builder.h',
         'crt_interceptors.cc',
         'crt_interceptors.h',
         'crt_interceptors_macros.h',
@@ -42,23 +46,34 @@
         'heap.h',
         'heap_checker.cc',
         'heap_checker.h',
+        'heap_checker_thread.cc',
+        'heap_checker_thread.h',
         'heap_manager.h',
         'heap_managers/block_heap_manager.cc',
         'heap_managers/block_heap_manager.h',
         'heap_managers/deferred_free_thread.cc',
         'heap_managers/deferred_free_thread.h',
+        'heap_managers/deferred_free_thread_pool.cc',
+        'heap_managers/deferred_free_thread_pool.h',
+        'heap_managers/magazine_cache.cc',
+        'heap_managers/magazine_cache.h',
         'heaps/internal_heap.cc',
         'heaps/internal_heap.h',
         'heaps/large_block_heap.cc',
         'heaps/large_block_heap.h',
         'heaps/simple_block_heap.cc',
         'heaps/simple_block_heap.h',
+        'heaps/size_class_block_heap.cc',
+        'heaps/size_class_block_heap.h',
         'heaps/win_heap.cc',
         'heaps/win_heap.h',
         'heaps/zebra_block_heap.cc',
         'heaps/zebra_block_heap.h',
         'iat_patcher.cc',
         'iat_patcher.h',
+        'lock_profiler.cc',
+        'lock_profiler.h',
+        'lock_profiler_impl.h',
         'logger.cc',
         'logger.h',
         'memory_interceptors.cc',
@@ -66,6 +81,9 @@
         'memory_interceptors_impl.h',
         'memory_interceptors_patcher.cc',
         'memory_interceptors_patcher.h',
+        'memory_pressure_monitor.cc',
+        'memory_pressure_monitor.h',
+        'memory_notifier.cc',
         'memory_notifier.h',
         'memory_notifiers/null_memory_notifier.h',
         'memory_notifiers/shadow_memory_notifier.cc',
@@ -99,11 +117,17 @@
         'scoped_page_protections.h',
         'shadow.cc',
         'shadow.h',
+        'shadow_fill.cc',
+        'shadow_fill.h',
         'shadow_impl.h',
         'shadow_marker.cc',
         'shadow_marker.h',
+        'shadow_scan.cc',
+        'shadow_scan.h',
         'stack_capture_cache.cc',
         'stack_capture_cache.h',
+        'statistics_publisher.cc',
+        'statistics_publisher.h',
         'system_interceptors.cc',
         'system_interceptors.h',
         'timed_try.h',
@@ -165,21 +189,51 @@
         '<(src)/testing/gtest.gyp:gtest',
       ],
     },
+    {
+      'target_name': 'syzyasan_shadow_fill_benchmark',
+      'type': 'executable',
+      'sources': [
+        'shadow_fill_benchmark.cc',
+      ],
+      'dependencies': [
+        'syzyasan_rtl_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+      ],
+    },
+    {
+      'target_name': 'syzyasan_shadow_tlb_benchmark',
+      'type': 'executable',
+      'sources': [
+        'shadow_tlb_benchmark.cc',
+      ],
+      'dependencies': [
+        'syzyasan_rtl_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+      ],
+    },
     {
       'target_name': 'syzyasan_rtl_unittests',
       'type': 'executable',
       'sources': [
         'allocators_unittest.cc',
+        'crash_report_builder_unittest.cc',
         'crt_interceptors_unittest.cc',
+        'block_checksum_unittest.cc',
         'block_unittest.cc',
         'block_utils_unittest.cc',
         'circular_queue_unittest.cc',
         'error_info_unittest.cc',
+        'heap_checker_thread_unittest.cc',
         'heap_checker_unittest.cc',
         'iat_patcher_unittest.cc',
+        'lock_profiler_unittest.cc',
         'logger_unittest.cc',
         'memory_interceptors_patcher_unittest.cc',
         'memory_interceptors_unittest.cc',
+        'memory_notifier_unittest.cc',
+        'memory_pressure_monitor_unittest.cc',
         'page_allocator_unittest.cc',
         'page_protection_helpers_unittest.cc',
         'registry_cache_unittest.cc',
@@ -188,19 +242,25 @@
         'rtl_utils_unittest.cc',
         'runtime_unittest.cc',
         'scoped_page_protections_unittest.cc',
+        'shadow_fill_unittest.cc',
         'shadow_marker_unittest.cc',
+        'shadow_scan_unittest.cc',
         'shadow_unittest.cc',
         'stack_capture_cache_unittest.cc',
+        'statistics_publisher_unittest.cc',
         'system_interceptors_unittest.cc',
         'timed_try_unittest.cc',
         'windows_heap_adapter_unittest.cc',
         'heaps/internal_heap_unittest.cc',
         'heaps/large_block_heap_unittest.cc',
         'heaps/simple_block_heap_unittest.cc',
+        'heaps/size_class_block_heap_unittest.cc',
         'heaps/win_heap_unittest.cc',
         'heaps/zebra_block_heap_unittest.cc',
         'heap_managers/block_heap_manager_unittest.cc',
+        'heap_managers/deferred_free_thread_pool_unittest.cc',
         'heap_managers/deferred_free_thread_unittest.cc',
+        'heap_managers/magazine_cache_unittest.cc',
         'memory_notifiers/shadow_memory_notifier_unittest.cc',
         'quarantines/sharded_quarantine_unittest.cc',
         'quarantines/size_limited_quarantine_unittest.cc',
@@ -14,10 +14,12 @@
 
 #include "syzygy/agent/asan/block.h"
 
+#include <emmintrin.h>
 #include <algorithm>
 
-#include "base/hash.h"
 #include "base/logging.h"
+#include "base/macros.h"
+#include "syzygy/agent/asan/block_checksum.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
@@ -30,6 +32,10 @@ namespace {
 
 using ::common::IsAligned;
 
+// Bodies smaller than this are flood-filled with a plain memset, as they are
+// about to be touched again by the checksum anyway.
+const size_t kNonTemporalFloodFillThreshold = 4096;
+
 // Declares a function that returns the maximum value representable by
 // the given bitfield.
 #define DECLARE_GET_MAX_BITFIELD_VALUE_FUNCTION(Type, FieldName)   \
@@ -289,6 +295,19 @@ bool BlockPlanLayout(uint32_t chunk_size,
   return true;
 }
 
+uint32_t GetAdaptiveRedzoneSize(uint32_t size) {
+  // The largest allocation size getting each redzone size, the redzone size
+  // doubling from one to the next.
+  static const uint32_t kMaxSizes[] = {
+      64 - 16, 128 - 32, 512 - 64, 4096 - 128, (1 << 14) - 256,
+      (1 << 15) - 512, (1 << 16) - 1024};
+
+  uint32_t redzone_size = 16;
+  for (size_t i = 0; i < arraysize(kMaxSizes) && size > kMaxSizes[i]; ++i)
+    redzone_size <<= 1;
+  return std::max<uint32_t>(redzone_size, sizeof(BlockTrailer));
+}
+
 void BlockInitialize(const BlockLayout& layout,
                      void* allocation,
                      BlockInfo* block_info) {
@@ -381,6 +400,26 @@ void ConvertBlockInfo(const BlockInfo& expanded, CompactBlockInfo* compact) {
                                                 expanded.trailer_padding_size);
 }
 
+void BlockGetBodyPages(const BlockInfo& block_info,
+                       uint8_t** pages,
+                       uint32_t* pages_size) {
+  DCHECK_NE(static_cast<uint8_t**>(nullptr), pages);
+  DCHECK_NE(static_cast<uint32_t*>(nullptr), pages_size);
+
+  uintptr_t body_start = reinterpret_cast<uintptr_t>(block_info.body);
+  uintptr_t body_end = body_start + block_info.body_size;
+  body_start = ::common::AlignUp(body_start, GetPageSize());
+  body_end = ::common::AlignDown(body_end, GetPageSize());
+  if (body_start >= body_end) {
+    *pages = nullptr;
+    *pages_size = 0;
+    return;
+  }
+
+  *pages = reinterpret_cast<uint8_t*>(body_start);
+  *pages_size = static_cast<uint32_t>(body_end - body_start);
+}
+
 bool BlockInfoFromMemory(const BlockHeader* header, BlockInfo* block_info) {
   DCHECK_NE(static_cast<BlockHeader*>(nullptr), header);
   DCHECK_NE(static_cast<BlockInfo*>(NULL), block_info);
@@ -406,14 +445,34 @@ BlockHeader* BlockGetHeaderFromBody(const BlockBody* body) {
 }
 
 uint32_t BlockCalculateChecksum(const BlockInfo& block_info) {
-  // It is much easier to calculate the checksum in place so this actually
-  // causes the block to be modified, but restores the original value.
-  uint32_t old_checksum = block_info.header->checksum;
-  block_info.header->checksum = 0;
-  BlockSetChecksum(block_info);
-  uint32_t new_checksum = block_info.header->checksum;
-  block_info.header->checksum = old_checksum;
-  return new_checksum;
+  // The checksum field doesn't contribute to the checksum, so checksum a
+  // copy of the header with the field cleared.
+  BlockHeader header = *block_info.header;
+  header.checksum = 0;
+
+  internal::Crc32cAccumulator checksum;
+  checksum.Update(&header, sizeof(header));
+  checksum.Update(block_info.header + 1,
+                  block_info.TotalHeaderSize() - sizeof(BlockHeader));
+  switch (static_cast<BlockState>(header.state)) {
+    case ALLOCATED_BLOCK:
+    case QUARANTINED_FLOODED_BLOCK: {
+      // Only checksum the header and trailer regions.
+      break;
+    }
+
+    // The checksum is the calculated in the same way in these two cases.
+    case QUARANTINED_BLOCK:
+    case FREED_BLOCK: {
+      checksum.Update(block_info.body, block_info.body_size);
+      break;
+    }
+  }
+  checksum.Update(block_info.trailer_padding, block_info.TotalTrailerSize());
+
+  uint32_t combined = CombineUInt32IntoBlockChecksum(checksum.checksum());
+  DCHECK_EQ(0u, combined >> kBlockHeaderChecksumBits);
+  return combined;
 }
 
 bool BlockChecksumIsValid(const BlockInfo& block_info) {
@@ -424,35 +483,31 @@ bool BlockChecksumIsValid(const BlockInfo& block_info) {
 }
 
 void BlockSetChecksum(const BlockInfo& block_info) {
-  block_info.header->checksum = 0;
+  block_info.header->checksum = BlockCalculateChecksum(block_info);
+}
 
-  uint32_t checksum = 0;
-  switch (static_cast<BlockState>(block_info.header->state)) {
-    case ALLOCATED_BLOCK:
-    case QUARANTINED_FLOODED_BLOCK: {
-      // Only checksum the header and trailer regions.
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.TotalHeaderSize());
-      checksum ^= base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.trailer_padding),
-          block_info.TotalTrailerSize());
-      break;
-    }
+void BlockFloodFillBody(const BlockInfo& block_info) {
+  uint8_t* begin = block_info.RawBody();
+  uint8_t* end = begin + block_info.body_size;
+  if (block_info.body_size < kNonTemporalFloodFillThreshold) {
+    ::memset(begin, kBlockFloodFillByte, block_info.body_size);
+    return;
+  }
 
-    // The checksum is the calculated in the same way in these two cases.
-    case QUARANTINED_BLOCK:
-    case FREED_BLOCK: {
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.block_size);
-      break;
-    }
+  // Fill the unaligned head and tail with regular stores, and stream the
+  // aligned middle.
+  uint8_t* aligned_begin = ::common::AlignUp(begin, sizeof(__m128i));
+  uint8_t* aligned_end = ::common::AlignDown(end, sizeof(__m128i));
+  ::memset(begin, kBlockFloodFillByte, aligned_begin - begin);
+  const __m128i fill = _mm_set1_epi8(static_cast<char>(kBlockFloodFillByte));
+  for (uint8_t* cursor = aligned_begin; cursor < aligned_end;
+       cursor += sizeof(__m128i)) {
+    _mm_stream_si128(reinterpret_cast<__m128i*>(cursor), fill);
   }
+  ::memset(aligned_end, kBlockFloodFillByte, end - aligned_end);
 
-  checksum = CombineUInt32IntoBlockChecksum(checksum);
-  DCHECK_EQ(0u, checksum >> kBlockHeaderChecksumBits);
-  block_info.header->checksum = checksum;
+  // Make the streamed stores visible before the block is published.
+  _mm_sfence();
 }
 
 bool BlockBodyIsFloodFilled(const BlockInfo& block_info) {
@@ -244,6 +244,9 @@ struct CompactBlockInfo {
     unsigned trailer_size : 15;
     // Indicates if the block is nested.
     unsigned is_nested : 1;
+    // Indicates if the body pages of the block are decommitted. This is only
+    // ever set for the blocks held by a quarantine.
+    unsigned is_body_decommitted : 1;
   };
 };
 #ifdef _WIN64
@@ -363,6 +366,17 @@ bool BlockPlanLayout(uint32_t chunk_size,
                      uint32_t min_right_redzone_size,
                      BlockLayout* layout);
 
+// Gets the minimum size of the right redzone of an allocation when redzones
+// scale with the allocation size. Like the size-class redzones of upstream
+// ASan, this doubles from 16 bytes for allocations of 48 bytes or less up to
+// 2048 bytes for allocations of 64KB or more, shrinking as the allocation
+// size approaches a power of two so that blocks don't spill into the next
+// one. The redzone is never smaller than the block trailer, so small
+// allocations only pay for their metadata.
+// @param size The size of the body of the allocation.
+// @returns the minimum right redzone size, including the trailer.
+uint32_t GetAdaptiveRedzoneSize(uint32_t size);
+
 // Given a fresh allocation and a block layout, lays out and initializes the
 // given block. Initializes everything except for the allocation stack and the
 // checksum. Initializes the block to the ALLOCATED_BLOCK state, setting
@@ -387,6 +401,16 @@ void BlockInitialize(const BlockLayout& layout,
 void ConvertBlockInfo(const CompactBlockInfo& compact, BlockInfo* expanded);
 void ConvertBlockInfo(const BlockInfo& expanded, CompactBlockInfo* compact);
 
+// Gets the pages that are entirely covered by the body of a block. These are
+// the pages of a quarantined block that may be decommitted.
+// @param block_info The block whose body pages are to be found.
+// @param pages Receives the first of the body pages.
+// @param pages_size Receives the size of the body pages, in bytes. This is
+//     zero if the body doesn't cover any entire page.
+void BlockGetBodyPages(const BlockInfo& block_info,
+                       uint8_t** pages,
+                       uint32_t* pages_size);
+
 // Given a pointer to a block examines memory and extracts the block layout.
 // This protects against invalid memory accesses that may occur as a result of
 // block corruption, or the block pages being protected; in case of error,
@@ -415,12 +439,13 @@ BlockHeader* BlockGetHeaderFromBody(const BlockBody* body);
 
 // @name Checksum related functions.
 // @{
-// Calculates the checksum for the given block. This causes the contents
-// of the block header to be modified temporarily while calculating the
-// checksum, and as such is not thread safe.
+// Calculates the checksum for the given block. This is a CRC32C of the
+// header, the trailer and, for quarantined and freed blocks, the body, folded
+// into kBlockHeaderChecksumBits bits. The checksum field of the header doesn't
+// contribute to it.
 // @param block_info The block to be checksummed.
 // @returns the calculated checksum.
-// @note The pages containing the block must be writable and readable.
+// @note The pages containing the block must be readable.
 uint32_t BlockCalculateChecksum(const BlockInfo& block_info);
 
 // Determines if the block checksum is valid.
@@ -435,6 +460,12 @@ bool BlockChecksumIsValid(const BlockInfo& block_info);
 void BlockSetChecksum(const BlockInfo& block_info);
 // @}
 
+// Flood-fills the body of a block with kBlockFloodFillByte. Large bodies are
+// written with non-temporal stores so that the fill doesn't evict the
+// application's data from the caches.
+// @param block_info The block to be filled.
+void BlockFloodFillBody(const BlockInfo& block_info);
+
 // Determines if the body of a block is a valid flood-filled body.
 // @param block_info The block to be checked.
 // @returns true if the body is appropriately flood-filled.
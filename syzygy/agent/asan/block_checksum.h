@@ -0,0 +1,80 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the CRC32C (Castagnoli) kernels used to checksum blocks. Blocks
+// are checksummed on every free and on every quarantine eviction, so a
+// hardware implementation using the SSE4.2 crc32 instruction is selected at
+// runtime when available, with a table driven fallback.
+
+#ifndef SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
+#define SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+// The signature of a CRC32C kernel.
+// @param crc The CRC register after the preceding data. This starts at ~0,
+//     and the CRC32C of the data is the complement of its final value.
+// @param data The data to checksum.
+// @param length The length of the data, in bytes.
+// @returns the CRC register after the given data.
+typedef uint32_t (*Crc32cFunction)(uint32_t crc,
+                                   const void* data,
+                                   size_t length);
+
+// The available kernels. The SSE4.2 variant must only be called if the CPU
+// supports it.
+uint32_t Crc32cScalar(uint32_t crc, const void* data, size_t length);
+uint32_t Crc32cSSE42(uint32_t crc, const void* data, size_t length);
+
+// @returns true if the SSE4.2 kernel may be used on this machine.
+bool CpuSupportsSSE42();
+
+// @returns the fastest kernel supported by this machine.
+Crc32cFunction GetCrc32cFunction();
+
+// Calculates the CRC32C of a sequence of memory ranges, as if they were
+// contiguous. This allows the parts of a block to be checksummed separately.
+class Crc32cAccumulator {
+ public:
+  // Uses the fastest kernel supported by this machine.
+  Crc32cAccumulator();
+
+  // @param function The kernel to use.
+  explicit Crc32cAccumulator(Crc32cFunction function);
+
+  // Adds a range of memory to the checksum.
+  // @param data The data to checksum.
+  // @param length The length of the data, in bytes.
+  void Update(const void* data, size_t length) {
+    crc_ = function_(crc_, data, length);
+  }
+
+  // @returns the CRC32C of the data added so far.
+  uint32_t checksum() const { return ~crc_; }
+
+ private:
+  Crc32cFunction function_;
+  uint32_t crc_;
+};
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
@@ -0,0 +1,99 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/block_checksum.h"
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+const char kCheckString[] = "123456789";
+// The standard CRC32C check value, for kCheckString.
+const uint32_t kCheckValue = 0xE3069283;
+
+const size_t kBufSize = 300;
+
+uint32_t Checksum(Crc32cFunction function, const void* data, size_t length) {
+  Crc32cAccumulator accumulator(function);
+  accumulator.Update(data, length);
+  return accumulator.checksum();
+}
+
+void FillBuffer(uint8_t* buf, size_t length) {
+  for (size_t i = 0; i < length; ++i)
+    buf[i] = static_cast<uint8_t>(i * 37 + 11);
+}
+
+}  // namespace
+
+TEST(BlockChecksumTest, CheckValue) {
+  EXPECT_EQ(kCheckValue,
+            Checksum(&Crc32cScalar, kCheckString, ::strlen(kCheckString)));
+  EXPECT_EQ(kCheckValue,
+            Checksum(GetCrc32cFunction(), kCheckString,
+                     ::strlen(kCheckString)));
+  if (CpuSupportsSSE42()) {
+    EXPECT_EQ(kCheckValue,
+              Checksum(&Crc32cSSE42, kCheckString, ::strlen(kCheckString)));
+  }
+}
+
+TEST(BlockChecksumTest, EmptyRange) {
+  EXPECT_EQ(0u, Checksum(&Crc32cScalar, nullptr, 0));
+  EXPECT_EQ(0u, Checksum(GetCrc32cFunction(), nullptr, 0));
+}
+
+TEST(BlockChecksumTest, SSE42MatchesScalar) {
+  if (!CpuSupportsSSE42())
+    return;
+
+  uint8_t buf[kBufSize];
+  FillBuffer(buf, kBufSize);
+
+  // Test all (mod 16) alignments, for all lengths.
+  for (size_t i = 0; i < 16; ++i) {
+    for (size_t length = 0; length + i <= kBufSize; ++length) {
+      ASSERT_EQ(Checksum(&Crc32cScalar, buf + i, length),
+                Checksum(&Crc32cSSE42, buf + i, length));
+    }
+  }
+}
+
+TEST(BlockChecksumTest, IncrementalMatchesWhole) {
+  uint8_t buf[kBufSize];
+  FillBuffer(buf, kBufSize);
+  uint32_t expected = Checksum(&Crc32cScalar, buf, kBufSize);
+
+  // Split the buffer in three parts, as a block is split in header, body and
+  // trailer.
+  for (size_t i = 0; i <= kBufSize; i += 7) {
+    for (size_t j = i; j <= kBufSize; j += 13) {
+      Crc32cAccumulator accumulator;
+      accumulator.Update(buf, i);
+      accumulator.Update(buf + i, j - i);
+      accumulator.Update(buf + j, kBufSize - j);
+      ASSERT_EQ(expected, accumulator.checksum());
+    }
+  }
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
@@ -14,6 +14,7 @@
 
 #include "syzygy/agent/asan/block.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <vector>
@@ -233,6 +234,27 @@ TEST_F(BlockTest, EndToEnd) {
   ASSERT_EQ(TRUE, ::VirtualFree(data, 0, MEM_RELEASE));
 }
 
+TEST_F(BlockTest, GetAdaptiveRedzoneSize) {
+  // Small allocations only get the trailer.
+  EXPECT_EQ(sizeof(BlockTrailer), GetAdaptiveRedzoneSize(0));
+  EXPECT_EQ(sizeof(BlockTrailer), GetAdaptiveRedzoneSize(16));
+  EXPECT_EQ(std::max<uint32_t>(32, sizeof(BlockTrailer)),
+            GetAdaptiveRedzoneSize(49));
+  EXPECT_EQ(64u, GetAdaptiveRedzoneSize(128));
+  EXPECT_EQ(128u, GetAdaptiveRedzoneSize(4000));
+  EXPECT_EQ(1024u, GetAdaptiveRedzoneSize(64000));
+  EXPECT_EQ(2048u, GetAdaptiveRedzoneSize(1 << 20));
+
+  // The redzone never shrinks as the allocation grows.
+  uint32_t previous_size = 0;
+  for (uint32_t size = 0; size < (1 << 17); size += 8) {
+    uint32_t redzone_size = GetAdaptiveRedzoneSize(size);
+    EXPECT_LE(previous_size, redzone_size);
+    EXPECT_EQ(0u, redzone_size % kShadowRatio);
+    previous_size = redzone_size;
+  }
+}
+
 TEST_F(BlockTest, GetHeaderFromBody) {
   // Plan two layouts, one with header padding and another without.
   BlockLayout layout1 = {};
@@ -725,6 +747,25 @@ TEST_F(BlockTest, BlockBodyIsFloodFilled) {
   EXPECT_TRUE(BlockBodyIsFloodFilled(dummy_info));
 }
 
+TEST_F(BlockTest, BlockFloodFillBody) {
+  // Covers both the memset and the non-temporal paths, with unaligned heads
+  // and tails. The guard bytes around the body must be left untouched.
+  static uint8_t buffer[3 * 4096] = {};
+  const size_t kSizes[] = {1, 13, 4096, 8 * 1024 + 5};
+  for (size_t size : kSizes) {
+    for (size_t offset = 1; offset < 16; offset += 7) {
+      ::memset(buffer, 0, sizeof(buffer));
+      BlockInfo info = {};
+      info.body = reinterpret_cast<BlockBody*>(buffer + offset);
+      info.body_size = size;
+      BlockFloodFillBody(info);
+      EXPECT_TRUE(BlockBodyIsFloodFilled(info));
+      EXPECT_EQ(0u, buffer[offset - 1]);
+      EXPECT_EQ(0u, buffer[offset + size]);
+    }
+  }
+}
+
 TEST_F(BlockTest, BlockDetermineMostLikelyState) {
   AsanLogger logger;
   Shadow shadow;
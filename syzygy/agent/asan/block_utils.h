@@ -24,11 +24,21 @@
 namespace agent {
 namespace asan {
 
-// A functor that retrieves the total size of an Asan allocation.
+// A functor that retrieves the total size of an Asan allocation. The
+// decommitted body pages of a quarantined block don't count, as they don't
+// use any memory.
 struct GetTotalBlockSizeFunctor {
   size_t operator()(const CompactBlockInfo& info) {
     DCHECK_NE(static_cast<BlockHeader*>(nullptr), info.header);
-    return info.block_size;
+    if (!info.is_body_decommitted)
+      return info.block_size;
+
+    BlockInfo expanded = {};
+    ConvertBlockInfo(info, &expanded);
+    uint8_t* pages = nullptr;
+    uint32_t pages_size = 0;
+    BlockGetBodyPages(expanded, &pages, &pages_size);
+    return info.block_size - pages_size;
   }
 };
 
@@ -0,0 +1,153 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/crash_report_builder.h"
+
+#include "base/logging.h"
+#include "syzygy/crashdata/crashdata.h"
+
+namespace agent {
+namespace asan {
+
+CrashReportBuilder::CrashReportBuilder(const Shadow* shadow)
+    : shadow_(shadow),
+      pending_error_info_(nullptr),
+      thread_abandoned_(false),
+      thread_succeeded_(false),
+      finished_error_info_(nullptr),
+      succeeded_(false),
+      work_event_(false, false),
+      done_event_(false, false),
+      enabled_(0) {
+  DCHECK_NE(static_cast<const Shadow*>(nullptr), shadow);
+}
+
+CrashReportBuilder::~CrashReportBuilder() {
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&enabled_));
+}
+
+bool CrashReportBuilder::StartThread() {
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&enabled_));
+  base::subtle::NoBarrier_Store(&enabled_, 1);
+  // Make sure the change to |enabled_| is not reordered.
+  base::subtle::MemoryBarrier();
+  if (!base::PlatformThread::Create(0, this, &thread_handle_)) {
+    base::subtle::NoBarrier_Store(&enabled_, 0);
+    return false;
+  }
+  return true;
+}
+
+void CrashReportBuilder::StopThread() {
+  if (!base::subtle::NoBarrier_Load(&enabled_))
+    return;
+  base::subtle::NoBarrier_Store(&enabled_, 0);
+  // Make sure the change to |enabled_| is not reordered.
+  base::subtle::MemoryBarrier();
+  work_event_.Signal();
+  base::PlatformThread::Join(thread_handle_);
+}
+
+void CrashReportBuilder::StartReport(const AsanErrorInfo* error_info) {
+  DCHECK_NE(static_cast<const AsanErrorInfo*>(nullptr), error_info);
+
+  finished_error_info_ = nullptr;
+
+  base::AutoLock lock(lock_);
+  if (!base::subtle::NoBarrier_Load(&enabled_) || thread_abandoned_ ||
+      pending_error_info_ != nullptr) {
+    return;
+  }
+  pending_error_info_ = error_info;
+  work_event_.Signal();
+}
+
+bool CrashReportBuilder::FinishReport(const AsanErrorInfo* error_info,
+                                      base::TimeDelta deadline) {
+  DCHECK_NE(static_cast<const AsanErrorInfo*>(nullptr), error_info);
+
+  if (finished_error_info_ == error_info)
+    return succeeded_;
+
+  bool is_pending = false;
+  {
+    base::AutoLock lock(lock_);
+    is_pending = pending_error_info_ == error_info;
+  }
+
+  if (is_pending) {
+    if (done_event_.TimedWait(deadline)) {
+      base::AutoLock lock(lock_);
+      pending_error_info_ = nullptr;
+      protobuf_.swap(thread_protobuf_);
+      memory_ranges_.swap(thread_memory_ranges_);
+      succeeded_ = thread_succeeded_;
+      finished_error_info_ = error_info;
+      return succeeded_;
+    }
+
+    LOG(ERROR) << "Timed out waiting for the crash report to be built.";
+    base::AutoLock lock(lock_);
+    thread_abandoned_ = true;
+  }
+
+  // Build the report on this thread, without touching the storage that the
+  // helper thread may still be using.
+  protobuf_.clear();
+  memory_ranges_.clear();
+  succeeded_ = BuildReport(*error_info, &protobuf_, &memory_ranges_);
+  finished_error_info_ = error_info;
+  return succeeded_;
+}
+
+bool CrashReportBuilder::thread_is_usable() const {
+  base::AutoLock lock(lock_);
+  return base::subtle::NoBarrier_Load(&enabled_) && !thread_abandoned_;
+}
+
+void CrashReportBuilder::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Crash Report Thread");
+  while (true) {
+    work_event_.Wait();
+    if (!base::subtle::NoBarrier_Load(&enabled_))
+      break;
+
+    const AsanErrorInfo* error_info = nullptr;
+    {
+      base::AutoLock lock(lock_);
+      error_info = pending_error_info_;
+    }
+    DCHECK_NE(static_cast<const AsanErrorInfo*>(nullptr), error_info);
+
+    thread_protobuf_.clear();
+    thread_memory_ranges_.clear();
+    thread_succeeded_ =
+        BuildReport(*error_info, &thread_protobuf_, &thread_memory_ranges_);
+    done_event_.Signal();
+  }
+}
+
+bool CrashReportBuilder::BuildReport(const AsanErrorInfo& error_info,
+                                     std::string* protobuf,
+                                     MemoryRanges* memory_ranges) const {
+  DCHECK_NE(static_cast<std::string*>(nullptr), protobuf);
+  DCHECK_NE(static_cast<MemoryRanges*>(nullptr), memory_ranges);
+
+  crashdata::Value value;
+  PopulateErrorInfo(shadow_, error_info, &value, memory_ranges);
+  return value.SerializeToString(protobuf);
+}
+
+}  // namespace asan
+}  // namespace agent
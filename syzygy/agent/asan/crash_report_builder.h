@@ -0,0 +1,140 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Declares CrashReportBuilder, which builds the crashdata protobuf and the
+// memory ranges of a crash report on a helper thread.
+
+#ifndef SYZYGY_AGENT_ASAN_CRASH_REPORT_BUILDER_H_
+#define SYZYGY_AGENT_ASAN_CRASH_REPORT_BUILDER_H_
+
+#include <string>
+
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+#include "syzygy/agent/asan/error_info.h"
+
+namespace agent {
+namespace asan {
+
+// Forward declarations.
+class Shadow;
+
+// Builds the crash report of an error: the serialized crashdata protobuf and
+// the ranges of memory to include in the minidump. The report can be built
+// on a helper thread while the thread processing the error logs it, which
+// shortens the time it takes to get to the minidump.
+//
+// The helper thread is started ahead of time, as threads can't be safely
+// created while processing an error. The reports are expected to be built
+// one at a time, as the runtime does under the page protection lock.
+class CrashReportBuilder : public base::PlatformThread::Delegate {
+ public:
+  // @param shadow The shadow memory to query.
+  explicit CrashReportBuilder(const Shadow* shadow);
+  ~CrashReportBuilder() override;
+
+  // Starts the helper thread. Must not be called if the thread has already
+  // been started.
+  // @returns true if successful, false if the thread failed to be launched.
+  //     The reports are then built by the thread processing the error.
+  bool StartThread();
+
+  // Stops the helper thread, if it was started, and waits until it exits.
+  void StopThread();
+
+  // Starts building the report of an error on the helper thread, if there is
+  // one and if it is available. This forgets about any previous report.
+  // @param error_info The error, which must remain valid and unchanged until
+  //     FinishReport is called for it.
+  void StartReport(const AsanErrorInfo* error_info);
+
+  // Finishes building the report of an error. This waits for the helper
+  // thread to build it, at most for @p deadline, and otherwise builds it on
+  // the calling thread. This returns right away if the report of
+  // @p error_info has already been finished.
+  // @param error_info The error.
+  // @param deadline The maximum time to wait for the helper thread. The
+  //     helper thread isn't used anymore once it missed a deadline.
+  // @returns true if the protobuf was built successfully.
+  bool FinishReport(const AsanErrorInfo* error_info, base::TimeDelta deadline);
+
+  // @name Accessors to the last finished report.
+  // @{
+  const std::string& protobuf() const { return protobuf_; }
+  const MemoryRanges& memory_ranges() const { return memory_ranges_; }
+  // @}
+
+  // @returns true if the helper thread is running and usable.
+  bool thread_is_usable() const;
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override;
+
+  // Builds the report of an error.
+  // @param error_info The error.
+  // @param protobuf Will receive the serialized protobuf.
+  // @param memory_ranges Will receive the memory ranges.
+  // @returns true on success, false otherwise.
+  bool BuildReport(const AsanErrorInfo& error_info,
+                   std::string* protobuf,
+                   MemoryRanges* memory_ranges) const;
+
+  // The shadow memory to query.
+  const Shadow* shadow_;
+
+  // Protects the fields below that are shared with the helper thread.
+  mutable base::Lock lock_;
+
+  // The error whose report is being built by the helper thread, or nullptr.
+  // Under lock_.
+  const AsanErrorInfo* pending_error_info_;
+
+  // Set when the helper thread missed a deadline. Its report may still be
+  // in progress, so it is never handed another one. This is only expected
+  // when the process is wedged on its way to crashing. Under lock_.
+  bool thread_abandoned_;
+
+  // The report built by the helper thread. This is only touched by the
+  // helper thread between the signals of |work_event_| and |done_event_|.
+  std::string thread_protobuf_;
+  MemoryRanges thread_memory_ranges_;
+  bool thread_succeeded_;
+
+  // The last finished report, and the error it belongs to.
+  const AsanErrorInfo* finished_error_info_;
+  std::string protobuf_;
+  MemoryRanges memory_ranges_;
+  bool succeeded_;
+
+  // Used to signal that a report is to be built, and that it has been.
+  base::WaitableEvent work_event_;
+  base::WaitableEvent done_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  // The thread loops while this is non-zero.
+  base::subtle::Atomic32 enabled_;
+
+  DISALLOW_COPY_AND_ASSIGN(CrashReportBuilder);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_CRASH_REPORT_BUILDER_H_
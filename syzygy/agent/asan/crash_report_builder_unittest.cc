@@ -0,0 +1,124 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/crash_report_builder.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/unittest_util.h"
+#include "syzygy/crashdata/crashdata.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+const base::TimeDelta kDeadline = base::TimeDelta::FromMinutes(1);
+
+class CrashReportBuilderTest : public testing::TestWithAsanRuntime {
+ public:
+  void SetUp() override {
+    testing::TestWithAsanRuntime::SetUp();
+
+    // The location needs to be at a consistent place in system memory so
+    // that the shadow memory contents don't vary between the reports.
+    error_info_ = {};
+    error_info_.location = reinterpret_cast<void*>(0x00001000);
+    error_info_.crash_stack_id = 1234;
+    error_info_.error_type = WILD_ACCESS;
+    error_info_.access_mode = ASAN_READ_ACCESS;
+    error_info_.access_size = 4;
+    ::common::SetDefaultAsanParameters(&error_info_.asan_parameters);
+
+    crashdata::Value value;
+    PopulateErrorInfo(runtime_->shadow(), error_info_, &value,
+                      &expected_memory_ranges_);
+    ASSERT_TRUE(value.SerializeToString(&expected_protobuf_));
+  }
+
+  void ExpectReport(const CrashReportBuilder& builder) {
+    EXPECT_EQ(expected_protobuf_, builder.protobuf());
+    EXPECT_EQ(expected_memory_ranges_, builder.memory_ranges());
+  }
+
+ protected:
+  AsanErrorInfo error_info_;
+  std::string expected_protobuf_;
+  MemoryRanges expected_memory_ranges_;
+};
+
+}  // namespace
+
+TEST_F(CrashReportBuilderTest, BuildsWithoutThread) {
+  CrashReportBuilder builder(runtime_->shadow());
+  EXPECT_FALSE(builder.thread_is_usable());
+
+  builder.StartReport(&error_info_);
+  EXPECT_TRUE(builder.FinishReport(&error_info_, kDeadline));
+  ExpectReport(builder);
+}
+
+TEST_F(CrashReportBuilderTest, BuildsOnThread) {
+  CrashReportBuilder builder(runtime_->shadow());
+  ASSERT_TRUE(builder.StartThread());
+  EXPECT_TRUE(builder.thread_is_usable());
+
+  builder.StartReport(&error_info_);
+  EXPECT_TRUE(builder.FinishReport(&error_info_, kDeadline));
+  ExpectReport(builder);
+
+  // The thread builds the following reports as well.
+  builder.StartReport(&error_info_);
+  EXPECT_TRUE(builder.FinishReport(&error_info_, kDeadline));
+  ExpectReport(builder);
+  EXPECT_TRUE(builder.thread_is_usable());
+
+  builder.StopThread();
+  EXPECT_FALSE(builder.thread_is_usable());
+}
+
+TEST_F(CrashReportBuilderTest, FinishesReportThatWasNotStarted) {
+  CrashReportBuilder builder(runtime_->shadow());
+  ASSERT_TRUE(builder.StartThread());
+
+  EXPECT_TRUE(builder.FinishReport(&error_info_, kDeadline));
+  ExpectReport(builder);
+
+  builder.StopThread();
+}
+
+TEST_F(CrashReportBuilderTest, ReusesFinishedReport) {
+  CrashReportBuilder builder(runtime_->shadow());
+  ASSERT_TRUE(builder.StartThread());
+
+  builder.StartReport(&error_info_);
+  EXPECT_TRUE(builder.FinishReport(&error_info_, kDeadline));
+
+  // Finishing the report again doesn't rebuild it, even if the error changed
+  // in the meantime.
+  error_info_.access_size = 8;
+  EXPECT_TRUE(builder.FinishReport(&error_info_, kDeadline));
+  ExpectReport(builder);
+
+  // Starting a new report forgets about the previous one.
+  builder.StartReport(&error_info_);
+  EXPECT_TRUE(builder.FinishReport(&error_info_, kDeadline));
+  EXPECT_NE(expected_protobuf_, builder.protobuf());
+
+  builder.StopThread();
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -24,11 +24,31 @@
 namespace {
 
 using agent::asan::Shadow;
-using agent::asan::TestMemoryRange;
 
 // The global shadow memory that is used by the CRT interceptors.
 Shadow* crt_interceptor_shadow_ = nullptr;
 
+// Checks that all the bytes of a range are accessible, and reports the first
+// one that isn't otherwise. The whole range is checked at once by the shadow
+// scanning kernels, and only a range that fails this check goes through the
+// precise (and slower) search for the faulty byte.
+// @param memory The beginning of the range.
+// @param size The size of the range, in bytes.
+// @param access_mode The kind of access made to the range.
+void CheckMemoryRange(const void* memory,
+                      size_t size,
+                      agent::asan::AccessMode access_mode) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), crt_interceptor_shadow_);
+  if (crt_interceptor_shadow_->IsRangeAccessible(memory, size))
+    return;
+
+  const void* location =
+      crt_interceptor_shadow_->FindFirstPoisonedByte(memory, size);
+  // A null location means that the range became accessible in the meantime.
+  if (location != nullptr)
+    ReportBadAccess(location, access_mode);
+}
+
 }  // namespace
 
 namespace agent {
@@ -48,40 +68,34 @@ extern "C" {
 void* __cdecl asan_memcpy(void* destination,
                           const void* source,
                           size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<const uint8_t*>(source), num,
-                  agent::asan::ASAN_READ_ACCESS);
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<uint8_t*>(destination), num,
-                  agent::asan::ASAN_WRITE_ACCESS);
+  if (crt_interceptor_shadow_ != nullptr && num != 0U) {
+    CheckMemoryRange(source, num, agent::asan::ASAN_READ_ACCESS);
+    CheckMemoryRange(destination, num, agent::asan::ASAN_WRITE_ACCESS);
+  }
   return ::memcpy(destination, source, num);
 }
 
 void* __cdecl asan_memmove(void* destination,
                            const void* source,
                            size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<const uint8_t*>(source), num,
-                  agent::asan::ASAN_READ_ACCESS);
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<uint8_t*>(destination), num,
-                  agent::asan::ASAN_WRITE_ACCESS);
+  if (crt_interceptor_shadow_ != nullptr && num != 0U) {
+    CheckMemoryRange(source, num, agent::asan::ASAN_READ_ACCESS);
+    CheckMemoryRange(destination, num, agent::asan::ASAN_WRITE_ACCESS);
+  }
   return ::memmove(destination, source, num);
 }
 
 void* __cdecl asan_memset(void* ptr, int value, size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<uint8_t*>(ptr), num,
-                  agent::asan::ASAN_WRITE_ACCESS);
+  if (crt_interceptor_shadow_ != nullptr && num != 0U)
+    CheckMemoryRange(ptr, num, agent::asan::ASAN_WRITE_ACCESS);
   return ::memset(ptr, value, num);
 }
 
 const void* __cdecl asan_memchr(const void* ptr,
                                 int value,
                                 size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<const uint8_t*>(ptr), num,
-                  agent::asan::ASAN_READ_ACCESS);
+  if (crt_interceptor_shadow_ != nullptr && num != 0U)
+    CheckMemoryRange(ptr, num, agent::asan::ASAN_READ_ACCESS);
   return ::memchr(ptr, value, num);
 }
 
@@ -184,6 +198,15 @@ const wchar_t* asan_wcschr(const wchar_t* str, wchar_t character) {
   if (!crt_interceptor_shadow_)
     return ::wcschr(str, character);
 
+  // Fast path: the whole string is accessible, so the CRT can be called
+  // directly. Only a string running into poisoned memory is walked character
+  // by character, as the character may be found before the bad access.
+  size_t size = 0;
+  if (crt_interceptor_shadow_->GetNullTerminatedArraySize<wchar_t>(str, 0U,
+                                                                    &size)) {
+    return ::wcschr(str, character);
+  }
+
   const wchar_t* s = str;
   while (crt_interceptor_shadow_->IsAccessible(s) && *s != character &&
          *s != NULL) {
@@ -241,9 +264,7 @@ char* __cdecl asan_strncpy(char* destination, const char* source, size_t num) {
     }
     // We can't use the GetNullTerminatedArraySize function here, as destination
     // might not be null terminated.
-    TestMemoryRange(crt_interceptor_shadow_,
-                    reinterpret_cast<const uint8_t*>(destination), num,
-                    agent::asan::ASAN_WRITE_ACCESS);
+    CheckMemoryRange(destination, num, agent::asan::ASAN_WRITE_ACCESS);
   }
   return ::strncpy(destination, source, num);
 }
@@ -267,9 +288,11 @@ char* __cdecl asan_strncat(char* destination, const char* source, size_t num) {
                       agent::asan::ASAN_WRITE_ACCESS);
     } else {
       // Test if we can append the source to the destination.
-      TestMemoryRange(crt_interceptor_shadow_,
-                      reinterpret_cast<const uint8_t*>(destination + dst_size),
-                      std::min(num, src_size), agent::asan::ASAN_WRITE_ACCESS);
+      size_t append_size = std::min(num, src_size);
+      if (append_size != 0U) {
+        CheckMemoryRange(destination + dst_size, append_size,
+                         agent::asan::ASAN_WRITE_ACCESS);
+      }
     }
   }
   return ::strncat(destination, source, num);
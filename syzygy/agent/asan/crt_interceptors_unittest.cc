@@ -136,6 +136,35 @@ TEST_F(CrtInterceptorsTest, AsanCheckMemcpy) {
   ResetLog();
 }
 
+TEST_F(CrtInterceptorsTest, AsanCheckWholeRange) {
+  // The ranges are checked in their entirety, not only at their ends.
+  const size_t kAllocSize = 64;
+  ScopedAsanAlloc<uint8_t> mem_src(this, kAllocSize);
+  ASSERT_TRUE(mem_src.get() != NULL);
+  ScopedAsanAlloc<uint8_t> mem_dst(this, kAllocSize);
+  ASSERT_TRUE(mem_dst.get() != NULL);
+  ::memset(mem_src.get(), 0, kAllocSize);
+
+  Shadow* shadow = GetActiveRuntimeFunction()->shadow();
+  shadow->Poison(mem_src.get() + 32, kShadowRatio, kUserRedzoneMarker);
+  shadow->Poison(mem_dst.get() + 16, kShadowRatio, kUserRedzoneMarker);
+
+  SetCallBackFunction(&AsanErrorCallback);
+  memcpyFunctionFailing(mem_dst.get() + 32, mem_src.get(), 32);
+  memcpyFunctionFailing(mem_dst.get(), mem_src.get() + 40, 24);
+  memmoveFunctionFailing(mem_dst.get(), mem_src.get() + 40, 24);
+  memsetFunctionFailing(mem_src.get(), 0xAA, kAllocSize);
+  memchrFunctionFailing(mem_src.get(), 0xAA, kAllocSize);
+  ResetLog();
+
+  // The accessible parts can still be used.
+  EXPECT_EQ(mem_dst.get() + 24,
+            memcpyFunction(mem_dst.get() + 24, mem_src.get() + 40, 24));
+
+  shadow->Unpoison(mem_src.get() + 32, kShadowRatio);
+  shadow->Unpoison(mem_dst.get() + 16, kShadowRatio);
+}
+
 TEST_F(CrtInterceptorsTest, DISABLED_AsanCheckStrcspn) {
   // TODO(sebmarchand): Reactivate this unittest once the implementation of
   //     this interceptor has been fixed.
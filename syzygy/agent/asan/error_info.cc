@@ -14,6 +14,7 @@
 
 #include "syzygy/agent/asan/error_info.h"
 
+#include <algorithm>
 #include <limits>
 #include <string>
 
@@ -22,6 +23,7 @@
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
+#include "syzygy/common/asan_shadow_excerpt.h"
 #include "syzygy/crashdata/crashdata.h"
 
 namespace agent {
@@ -29,7 +31,8 @@ namespace asan {
 
 namespace {
 
-// Copy a stack capture object into an array.
+// Copy a stack capture object into an array. Compact stack captures are
+// decoded.
 // @param stack_capture The stack capture that we want to copy.
 // @param dst Will receive the stack frames.
 // @param dst_size Will receive the number of frames that has been copied.
@@ -39,10 +42,9 @@ void CopyStackCaptureToArray(const common::StackCapture* stack_capture,
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
   DCHECK_NE(static_cast<void*>(nullptr), dst);
   DCHECK_NE(static_cast<uint8_t*>(nullptr), dst_size);
-  ::memcpy(dst,
-           stack_capture->frames(),
-           stack_capture->num_frames() * sizeof(void*));
-  *dst_size = static_cast<uint8_t>(stack_capture->num_frames());
+  size_t num_frames = stack_capture->CopyFrames(
+      reinterpret_cast<void**>(dst), stack_capture->num_frames());
+  *dst_size = static_cast<uint8_t>(num_frames);
 }
 
 // Get the information about an address relative to a block.
@@ -287,6 +289,8 @@ void ErrorInfoGetAsanBlockInfo(const Shadow* shadow,
     CopyStackCaptureToArray(block_info.header->alloc_stack,
                             asan_block_info->alloc_stack,
                             &asan_block_info->alloc_stack_size);
+    asan_block_info->alloc_stack_is_fingerprint =
+        block_info.header->alloc_stack->fingerprint();
   }
   if (block_info.header->state != ALLOCATED_BLOCK &&
       stack_cache->StackCapturePointerIsValid(
@@ -485,6 +489,10 @@ void PopulateBlockInfo(const Shadow* shadow,
                        block_info.alloc_stack_size,
                        crashdata::LeafGetStackTrace(
                            crashdata::DictAddLeaf("alloc-stack", dict)));
+    if (block_info.alloc_stack_is_fingerprint) {
+      crashdata::LeafSetUInt(
+          1, crashdata::DictAddLeaf("alloc-stack-is-fingerprint", dict));
+    }
   }
 
   // Set the free information if available.
@@ -616,6 +624,76 @@ void PopulateShadowMemoryBlob(const Shadow* shadow,
   }
 }
 
+// Run-length encodes the shadow bytes from @p index_min to @p index_max.
+void EncodeShadowExcerpt(const Shadow* shadow,
+                         uintptr_t index_min,
+                         uintptr_t index_max,
+                         common::ShadowExcerptEncoder* encoder) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  DCHECK_NE(static_cast<common::ShadowExcerptEncoder*>(nullptr), encoder);
+
+  const uint8_t* cursor = shadow->shadow() + index_min;
+  const uint8_t* end = shadow->shadow() + index_max;
+  if (!shadow->commit_on_demand()) {
+    encoder->AppendBytes(cursor, end - cursor);
+    encoder->Flush();
+    return;
+  }
+
+  // The uncommitted pages of a shadow committed on demand are all zero. They
+  // are encoded without being read, as reading them would commit them.
+  while (cursor < end) {
+    MEMORY_BASIC_INFORMATION memory_info = {};
+    if (::VirtualQuery(cursor, &memory_info, sizeof(memory_info)) == 0)
+      break;
+    const uint8_t* region_end =
+        static_cast<const uint8_t*>(memory_info.BaseAddress) +
+        memory_info.RegionSize;
+    if (region_end <= cursor || region_end > end)
+      region_end = end;
+
+    size_t length = region_end - cursor;
+    if (memory_info.State == MEM_COMMIT)
+      encoder->AppendBytes(cursor, length);
+    else
+      encoder->AppendRun(0, length);
+    cursor = region_end;
+  }
+  encoder->Flush();
+}
+
+void PopulateShadowExcerptBlob(const Shadow* shadow,
+                               const AsanErrorInfo& error_info,
+                               crashdata::Dictionary* dict) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  DCHECK_NE(static_cast<crashdata::Dictionary*>(nullptr), dict);
+
+  // Unlike the shadow-memory blob, the excerpt is encoded in the protobuf
+  // itself, so that it doesn't take a memory range of the minidump.
+  size_t excerpt_size = error_info.asan_parameters.shadow_excerpt_size;
+  if (excerpt_size == 0)
+    return;
+  excerpt_size = std::min(excerpt_size, common::kMaxShadowExcerptLength / 2);
+
+  // Wild accesses may be beyond the memory covered by the shadow.
+  uintptr_t index = reinterpret_cast<uintptr_t>(error_info.location);
+  index >>= kShadowRatioLog;
+  if (index >= shadow->length())
+    return;
+  uintptr_t index_min = index - std::min(index, excerpt_size);
+  uintptr_t index_max = index + std::min(shadow->length() - index,
+                                         excerpt_size);
+
+  crashdata::LeafSetUInt(index_min,
+                         crashdata::DictAddLeaf("shadow-excerpt-index", dict));
+  crashdata::Blob* blob = crashdata::LeafGetBlob(
+      crashdata::DictAddLeaf("shadow-excerpt", dict));
+  blob->mutable_address()->set_address(
+      CastAddress(shadow->shadow() + index_min));
+  common::ShadowExcerptEncoder encoder(blob->mutable_data());
+  EncodeShadowExcerpt(shadow, index_min, index_max, &encoder);
+}
+
 void PopulatePageBitsBlob(const Shadow* shadow,
                           const AsanErrorInfo& error_info,
                           crashdata::Dictionary* dict,
@@ -661,7 +739,7 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
 
   // Any new parameter added to the parameters structure should also be added
   // here.
-  static_assert(15 == ::common::kAsanParametersVersion,
+  static_assert(32 == ::common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   crashdata::Dictionary* param_dict = crashdata::DictAddDict("asan-parameters",
                                                              dict);
@@ -701,6 +779,63 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
   crashdata::LeafSetReal(
       error_info.asan_parameters.quarantine_flood_fill_rate,
       crashdata::DictAddLeaf("quarantine-flood-fill-rate", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_thread_local_magazines,
+      crashdata::DictAddLeaf("enable-thread-local-magazines", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_lazy_shadow_commit,
+      crashdata::DictAddLeaf("enable-lazy-shadow-commit", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.deferred_free_thread_count,
+      crashdata::DictAddLeaf("deferred-free-thread-count", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_size_class_block_heap,
+      crashdata::DictAddLeaf("enable-size-class-block-heap", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.large_block_heap_cache_size,
+      crashdata::DictAddLeaf("large-block-heap-cache-size", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.heap_checker_thread_count,
+      crashdata::DictAddLeaf("heap-checker-thread-count", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.incremental_heap_check_period,
+      crashdata::DictAddLeaf("incremental-heap-check-period", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.zebra_block_heap_max_size,
+      crashdata::DictAddLeaf("zebra-block-heap-max-size", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_compact_stack_captures,
+      crashdata::DictAddLeaf("enable-compact-stack-captures", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.allocation_stack_sampling_period,
+      crashdata::DictAddLeaf("allocation-stack-sampling-period", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_lock_profiling,
+      crashdata::DictAddLeaf("enable-lock-profiling", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.lock_profiling_log_period,
+      crashdata::DictAddLeaf("lock-profiling-log-period", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.statistics_section_period,
+      crashdata::DictAddLeaf("statistics-section-period", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_large_page_shadow,
+      crashdata::DictAddLeaf("enable-large-page-shadow", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_adaptive_guard_rate,
+      crashdata::DictAddLeaf("enable-adaptive-guard-rate", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.shadow_excerpt_size,
+      crashdata::DictAddLeaf("shadow-excerpt-size", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_memory_pressure_monitor,
+      crashdata::DictAddLeaf("enable-memory-pressure-monitor", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.quarantine_decommit_threshold,
+      crashdata::DictAddLeaf("quarantine-decommit-threshold", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.enable_adaptive_redzones,
+      crashdata::DictAddLeaf("enable-adaptive-redzones", param_dict));
 }
 
 }  // namespace
@@ -742,6 +877,7 @@ void PopulateErrorInfo(const Shadow* shadow,
                          crashdata::DictAddLeaf("access-size", dict));
 
   PopulateShadowMemoryBlob(shadow, error_info, dict, memory_ranges);
+  PopulateShadowExcerptBlob(shadow, error_info, dict);
   PopulatePageBitsBlob(shadow, error_info, dict, memory_ranges);
 
   // Send information about corruption.
@@ -137,6 +137,9 @@ struct AsanBlockInfo {
   // the block is still allocated.
   // TODO(chrisha): We actually keep track of this in ticks. Rename this?
   uint32_t milliseconds_since_free;
+  // Indicates if the allocation stack trace is only a fingerprint of the
+  // callers of the allocation, its full capture having been sampled out.
+  bool alloc_stack_is_fingerprint;
 };
 
 struct AsanCorruptBlockRange {
@@ -17,10 +17,13 @@
 #include <windows.h>
 
 #include <string>
+#include <vector>
 
 #include "base/strings/stringprintf.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/unittest_util.h"
+#include "syzygy/common/align.h"
+#include "syzygy/common/asan_shadow_excerpt.h"
 #include "syzygy/crashdata/json.h"
 
 namespace agent {
@@ -749,7 +752,26 @@ TEST_F(AsanErrorInfoTest, PopulateErrorInfo) {
       "    \"zebra-block-heap-size\": 16777216,\n"
       "    \"zebra-block-heap-quarantine-ratio\": 2.5000000000000000E-01,\n"
       "    \"large-allocation-threshold\": 20480,\n"
-      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01\n"
+      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01,\n"
+      "    \"enable-thread-local-magazines\": 0,\n"
+      "    \"enable-lazy-shadow-commit\": 0,\n"
+      "    \"deferred-free-thread-count\": 1,\n"
+      "    \"enable-size-class-block-heap\": 0,\n"
+      "    \"large-block-heap-cache-size\": 0,\n"
+      "    \"heap-checker-thread-count\": 1,\n"
+      "    \"incremental-heap-check-period\": 0,\n"
+      "    \"zebra-block-heap-max-size\": 0,\n"
+      "    \"enable-compact-stack-captures\": 0,\n"
+      "    \"allocation-stack-sampling-period\": 0,\n"
+      "    \"enable-lock-profiling\": 0,\n"
+      "    \"lock-profiling-log-period\": 60000,\n"
+      "    \"statistics-section-period\": 0,\n"
+      "    \"enable-large-page-shadow\": 0,\n"
+      "    \"enable-adaptive-guard-rate\": 0,\n"
+      "    \"shadow-excerpt-size\": 0,\n"
+      "    \"enable-memory-pressure-monitor\": 0,\n"
+      "    \"quarantine-decommit-threshold\": 0,\n"
+      "    \"enable-adaptive-redzones\": 0\n"
       "  }\n"
       "}";
   AsanErrorShadowMemory shadow_memory = {};
@@ -898,7 +920,26 @@ TEST_F(AsanErrorInfoTest, PopulateErrorInfoWithMemoryRanges) {
       "    \"zebra-block-heap-size\": 16777216,\n"
       "    \"zebra-block-heap-quarantine-ratio\": 2.5000000000000000E-01,\n"
       "    \"large-allocation-threshold\": 20480,\n"
-      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01\n"
+      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01,\n"
+      "    \"enable-thread-local-magazines\": 0,\n"
+      "    \"enable-lazy-shadow-commit\": 0,\n"
+      "    \"deferred-free-thread-count\": 1,\n"
+      "    \"enable-size-class-block-heap\": 0,\n"
+      "    \"large-block-heap-cache-size\": 0,\n"
+      "    \"heap-checker-thread-count\": 1,\n"
+      "    \"incremental-heap-check-period\": 0,\n"
+      "    \"zebra-block-heap-max-size\": 0,\n"
+      "    \"enable-compact-stack-captures\": 0,\n"
+      "    \"allocation-stack-sampling-period\": 0,\n"
+      "    \"enable-lock-profiling\": 0,\n"
+      "    \"lock-profiling-log-period\": 60000,\n"
+      "    \"statistics-section-period\": 0,\n"
+      "    \"enable-large-page-shadow\": 0,\n"
+      "    \"enable-adaptive-guard-rate\": 0,\n"
+      "    \"shadow-excerpt-size\": 0,\n"
+      "    \"enable-memory-pressure-monitor\": 0,\n"
+      "    \"quarantine-decommit-threshold\": 0,\n"
+      "    \"enable-adaptive-redzones\": 0\n"
       "  }\n"
       "}";
   AsanErrorShadowMemory shadow_memory = {};
@@ -930,6 +971,58 @@ TEST_F(AsanErrorInfoTest, PopulateErrorInfoWithMemoryRanges) {
   }
 }
 
+TEST_F(AsanErrorInfoTest, PopulateErrorInfoWithShadowExcerpt) {
+  const size_t kExcerptSize = 256;
+  Shadow* shadow = runtime_->shadow();
+
+  // Poison a range in the middle of the excerpt, so that it has a few runs.
+  std::vector<uint8_t> buffer(4 * kExcerptSize * kShadowRatio);
+  uint8_t* poisoned = reinterpret_cast<uint8_t*>(::common::AlignUp(
+      reinterpret_cast<uintptr_t>(&buffer[0]) + 2 * kExcerptSize * kShadowRatio,
+      kShadowRatio));
+  shadow->Poison(poisoned, 8 * kShadowRatio, kHeapLeftPaddingMarker);
+
+  AsanErrorInfo error_info = {};
+  error_info.location = poisoned;
+  error_info.error_type = HEAP_BUFFER_UNDERFLOW;
+  error_info.access_mode = ASAN_READ_ACCESS;
+  error_info.access_size = 4;
+  ::common::SetDefaultAsanParameters(&error_info.asan_parameters);
+  error_info.asan_parameters.shadow_excerpt_size = kExcerptSize;
+
+  crashdata::Value info;
+  PopulateErrorInfo(shadow, error_info, &info, nullptr);
+  shadow->Unpoison(poisoned, 8 * kShadowRatio);
+
+  uint64_t index = 0;
+  const crashdata::Blob* excerpt = nullptr;
+  for (const auto& kv : info.dictionary().values()) {
+    if (kv.key() == "shadow-excerpt-index")
+      index = kv.value().leaf().unsigned_integer();
+    else if (kv.key() == "shadow-excerpt")
+      excerpt = &kv.value().leaf().blob();
+  }
+  ASSERT_NE(static_cast<const crashdata::Blob*>(nullptr), excerpt);
+  EXPECT_EQ((reinterpret_cast<uintptr_t>(poisoned) >> kShadowRatioLog) -
+                kExcerptSize,
+            index);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(shadow->shadow() + index),
+            excerpt->address().address());
+
+  // The excerpt is much smaller than the shadow bytes it encodes.
+  EXPECT_GT(kExcerptSize, excerpt->data().size());
+
+  std::vector<uint8_t> decoded;
+  ASSERT_TRUE(::common::DecodeShadowExcerpt(excerpt->data(), &decoded));
+  ASSERT_EQ(2 * kExcerptSize, decoded.size());
+  for (size_t i = 0; i < decoded.size(); ++i) {
+    uint8_t expected = 0;
+    if (i >= kExcerptSize && i < kExcerptSize + 8)
+      expected = kHeapLeftPaddingMarker;
+    EXPECT_EQ(expected, decoded[i]);
+  }
+}
+
 TEST_F(AsanErrorInfoTest, CrashdataProtobufToErrorInfo) {
   AsanBlockInfo block_info = {};
   InitAsanBlockInfo(&block_info);
@@ -234,7 +234,7 @@ asan_check_1_byte_read_access_2gb PROC  ; Probe #0.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_0 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_0
   add esp, 4
   ; Restore original EDX.
@@ -311,7 +311,7 @@ asan_check_1_byte_write_access_2gb PROC  ; Probe #1.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_1 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_1
   add esp, 4
   ; Restore original EDX.
@@ -388,7 +388,7 @@ asan_check_2_byte_read_access_2gb PROC  ; Probe #2.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_2 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_2
   add esp, 4
   ; Restore original EDX.
@@ -465,7 +465,7 @@ asan_check_2_byte_write_access_2gb PROC  ; Probe #3.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_3 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_3
   add esp, 4
   ; Restore original EDX.
@@ -542,7 +542,7 @@ asan_check_4_byte_read_access_2gb PROC  ; Probe #4.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_4 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_4
   add esp, 4
   ; Restore original EDX.
@@ -619,7 +619,7 @@ asan_check_4_byte_write_access_2gb PROC  ; Probe #5.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_5 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_5
   add esp, 4
   ; Restore original EDX.
@@ -696,7 +696,7 @@ asan_check_8_byte_read_access_2gb PROC  ; Probe #6.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_6 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_6
   add esp, 4
   ; Restore original EDX.
@@ -773,7 +773,7 @@ asan_check_8_byte_write_access_2gb PROC  ; Probe #7.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_7 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_7
   add esp, 4
   ; Restore original EDX.
@@ -850,7 +850,7 @@ asan_check_10_byte_read_access_2gb PROC  ; Probe #8.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_8 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_8
   add esp, 4
   ; Restore original EDX.
@@ -927,7 +927,7 @@ asan_check_10_byte_write_access_2gb PROC  ; Probe #9.
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_9 LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_9
   add esp, 4
   ; Restore original EDX.
@@ -1000,12 +1000,17 @@ asan_check_16_byte_read_access_2gb PROC  ; Probe #10.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_10
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_10 LABEL NEAR
-  cmp dl, 0
+  test edx, edx
   jnz check_access_slow_10
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_10
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1015,11 +1020,29 @@ shadow_reference_10 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_10 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_10
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_11 LABEL NEAR
+  test edx, edx
+  jnz report_failure_10
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_12 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_10
   js report_failure_10
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_10
+check_access_tail_done_10 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1077,12 +1100,17 @@ asan_check_16_byte_write_access_2gb PROC  ; Probe #11.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_11
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_11 LABEL NEAR
-  cmp dl, 0
+shadow_reference_13 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_11
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_11
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1092,11 +1120,29 @@ shadow_reference_11 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_11 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_11
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_14 LABEL NEAR
+  test edx, edx
+  jnz report_failure_11
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_15 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_11
   js report_failure_11
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_11
+check_access_tail_done_11 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1154,12 +1200,17 @@ asan_check_32_byte_read_access_2gb PROC  ; Probe #12.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_12
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_12 LABEL NEAR
-  cmp dl, 0
+shadow_reference_16 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_12
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_12
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1169,11 +1220,29 @@ shadow_reference_12 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_12 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_12
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_17 LABEL NEAR
+  test edx, edx
+  jnz report_failure_12
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_18 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_12
   js report_failure_12
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_12
+check_access_tail_done_12 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1231,12 +1300,17 @@ asan_check_32_byte_write_access_2gb PROC  ; Probe #13.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_13
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_13 LABEL NEAR
-  cmp dl, 0
+shadow_reference_19 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_13
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_13
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1246,11 +1320,29 @@ shadow_reference_13 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_13 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_13
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_20 LABEL NEAR
+  test edx, edx
+  jnz report_failure_13
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_21 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_13
   js report_failure_13
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_13
+check_access_tail_done_13 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -1307,8 +1399,8 @@ asan_check_1_byte_read_access_no_flags_2gb PROC  ; Probe #14.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_14 LABEL NEAR
-  cmp dl, 0
+shadow_reference_22 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_14
   add esp, 4
   ; Restore original EDX.
@@ -1368,8 +1460,8 @@ asan_check_1_byte_write_access_no_flags_2gb PROC  ; Probe #15.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_15 LABEL NEAR
-  cmp dl, 0
+shadow_reference_23 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_15
   add esp, 4
   ; Restore original EDX.
@@ -1429,8 +1521,8 @@ asan_check_2_byte_read_access_no_flags_2gb PROC  ; Probe #16.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_16 LABEL NEAR
-  cmp dl, 0
+shadow_reference_24 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_16
   add esp, 4
   ; Restore original EDX.
@@ -1490,8 +1582,8 @@ asan_check_2_byte_write_access_no_flags_2gb PROC  ; Probe #17.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_17 LABEL NEAR
-  cmp dl, 0
+shadow_reference_25 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_17
   add esp, 4
   ; Restore original EDX.
@@ -1551,8 +1643,8 @@ asan_check_4_byte_read_access_no_flags_2gb PROC  ; Probe #18.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_18 LABEL NEAR
-  cmp dl, 0
+shadow_reference_26 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_18
   add esp, 4
   ; Restore original EDX.
@@ -1612,8 +1704,8 @@ asan_check_4_byte_write_access_no_flags_2gb PROC  ; Probe #19.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_19 LABEL NEAR
-  cmp dl, 0
+shadow_reference_27 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_19
   add esp, 4
   ; Restore original EDX.
@@ -1673,8 +1765,8 @@ asan_check_8_byte_read_access_no_flags_2gb PROC  ; Probe #20.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_20 LABEL NEAR
-  cmp dl, 0
+shadow_reference_28 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_20
   add esp, 4
   ; Restore original EDX.
@@ -1734,8 +1826,8 @@ asan_check_8_byte_write_access_no_flags_2gb PROC  ; Probe #21.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_21 LABEL NEAR
-  cmp dl, 0
+shadow_reference_29 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_21
   add esp, 4
   ; Restore original EDX.
@@ -1795,8 +1887,8 @@ asan_check_10_byte_read_access_no_flags_2gb PROC  ; Probe #22.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_22 LABEL NEAR
-  cmp dl, 0
+shadow_reference_30 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_22
   add esp, 4
   ; Restore original EDX.
@@ -1856,8 +1948,8 @@ asan_check_10_byte_write_access_no_flags_2gb PROC  ; Probe #23.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_23 LABEL NEAR
-  cmp dl, 0
+shadow_reference_31 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_23
   add esp, 4
   ; Restore original EDX.
@@ -1914,22 +2006,45 @@ asan_check_16_byte_read_access_no_flags_2gb PROC  ; Probe #24.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_24
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_24 LABEL NEAR
-  cmp dl, 0
+shadow_reference_32 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_24
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_24
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_24 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_24
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_33 LABEL NEAR
+  test edx, edx
+  jnz report_failure_24
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_34 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_24
   js report_failure_24
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_24
+check_access_tail_done_24 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -1975,22 +2090,45 @@ asan_check_16_byte_write_access_no_flags_2gb PROC  ; Probe #25.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_25
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_25 LABEL NEAR
-  cmp dl, 0
+shadow_reference_35 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_25
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_25
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_25 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_25
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_36 LABEL NEAR
+  test edx, edx
+  jnz report_failure_25
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_37 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_25
   js report_failure_25
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_25
+check_access_tail_done_25 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -2036,22 +2174,45 @@ asan_check_32_byte_read_access_no_flags_2gb PROC  ; Probe #26.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_26
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_26 LABEL NEAR
-  cmp dl, 0
+shadow_reference_38 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_26
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_26
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_26 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_26
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_39 LABEL NEAR
+  test edx, edx
+  jnz report_failure_26
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_40 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_26
   js report_failure_26
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_26
+check_access_tail_done_26 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -2097,22 +2258,45 @@ asan_check_32_byte_write_access_no_flags_2gb PROC  ; Probe #27.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_27
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_27 LABEL NEAR
-  cmp dl, 0
+shadow_reference_41 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_27
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_27
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_27 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_27
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_42 LABEL NEAR
+  test edx, edx
+  jnz report_failure_27
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_43 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_27
   js report_failure_27
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_27
+check_access_tail_done_27 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -2163,8 +2347,8 @@ asan_check_1_byte_read_access_4gb PROC  ; Probe #28.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_28 LABEL NEAR
-  cmp dl, 0
+shadow_reference_44 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_28
   add esp, 4
   ; Restore original EDX.
@@ -2238,8 +2422,8 @@ asan_check_1_byte_write_access_4gb PROC  ; Probe #29.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_29 LABEL NEAR
-  cmp dl, 0
+shadow_reference_45 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_29
   add esp, 4
   ; Restore original EDX.
@@ -2313,8 +2497,8 @@ asan_check_2_byte_read_access_4gb PROC  ; Probe #30.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_30 LABEL NEAR
-  cmp dl, 0
+shadow_reference_46 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_30
   add esp, 4
   ; Restore original EDX.
@@ -2388,8 +2572,8 @@ asan_check_2_byte_write_access_4gb PROC  ; Probe #31.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_31 LABEL NEAR
-  cmp dl, 0
+shadow_reference_47 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_31
   add esp, 4
   ; Restore original EDX.
@@ -2463,8 +2647,8 @@ asan_check_4_byte_read_access_4gb PROC  ; Probe #32.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_32 LABEL NEAR
-  cmp dl, 0
+shadow_reference_48 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_32
   add esp, 4
   ; Restore original EDX.
@@ -2538,8 +2722,8 @@ asan_check_4_byte_write_access_4gb PROC  ; Probe #33.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_33 LABEL NEAR
-  cmp dl, 0
+shadow_reference_49 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_33
   add esp, 4
   ; Restore original EDX.
@@ -2613,8 +2797,8 @@ asan_check_8_byte_read_access_4gb PROC  ; Probe #34.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_34 LABEL NEAR
-  cmp dl, 0
+shadow_reference_50 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_34
   add esp, 4
   ; Restore original EDX.
@@ -2688,8 +2872,8 @@ asan_check_8_byte_write_access_4gb PROC  ; Probe #35.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_35 LABEL NEAR
-  cmp dl, 0
+shadow_reference_51 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_35
   add esp, 4
   ; Restore original EDX.
@@ -2763,8 +2947,8 @@ asan_check_10_byte_read_access_4gb PROC  ; Probe #36.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_36 LABEL NEAR
-  cmp dl, 0
+shadow_reference_52 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_36
   add esp, 4
   ; Restore original EDX.
@@ -2838,8 +3022,8 @@ asan_check_10_byte_write_access_4gb PROC  ; Probe #37.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_37 LABEL NEAR
-  cmp dl, 0
+shadow_reference_53 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_37
   add esp, 4
   ; Restore original EDX.
@@ -2910,12 +3094,17 @@ asan_check_16_byte_read_access_4gb PROC  ; Probe #38.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_38 LABEL NEAR
-  cmp dl, 0
+shadow_reference_54 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_38
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_38
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -2925,11 +3114,29 @@ shadow_reference_38 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_38 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_38
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_55 LABEL NEAR
+  test edx, edx
+  jnz report_failure_38
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_56 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_38
   js report_failure_38
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_38
+check_access_tail_done_38 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -2985,12 +3192,17 @@ asan_check_16_byte_write_access_4gb PROC  ; Probe #39.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_39 LABEL NEAR
-  cmp dl, 0
+shadow_reference_57 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_39
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_39
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -3000,11 +3212,29 @@ shadow_reference_39 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_39 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_39
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_58 LABEL NEAR
+  test edx, edx
+  jnz report_failure_39
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_59 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_39
   js report_failure_39
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_39
+check_access_tail_done_39 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -3060,12 +3290,17 @@ asan_check_32_byte_read_access_4gb PROC  ; Probe #40.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_40 LABEL NEAR
-  cmp dl, 0
+shadow_reference_60 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_40
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_40
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -3075,11 +3310,29 @@ shadow_reference_40 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_40 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_40
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_61 LABEL NEAR
+  test edx, edx
+  jnz report_failure_40
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_62 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_40
   js report_failure_40
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_40
+check_access_tail_done_40 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -3135,12 +3388,17 @@ asan_check_32_byte_write_access_4gb PROC  ; Probe #41.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_41 LABEL NEAR
-  cmp dl, 0
+shadow_reference_63 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_41
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_41
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -3150,11 +3408,29 @@ shadow_reference_41 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_41 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_41
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_64 LABEL NEAR
+  test edx, edx
+  jnz report_failure_41
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_65 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_41
   js report_failure_41
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_41
+check_access_tail_done_41 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 8]
@@ -3209,8 +3485,8 @@ asan_check_1_byte_read_access_no_flags_4gb PROC  ; Probe #42.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_42 LABEL NEAR
-  cmp dl, 0
+shadow_reference_66 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_42
   add esp, 4
   ; Restore original EDX.
@@ -3268,8 +3544,8 @@ asan_check_1_byte_write_access_no_flags_4gb PROC  ; Probe #43.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_43 LABEL NEAR
-  cmp dl, 0
+shadow_reference_67 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_43
   add esp, 4
   ; Restore original EDX.
@@ -3327,8 +3603,8 @@ asan_check_2_byte_read_access_no_flags_4gb PROC  ; Probe #44.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_44 LABEL NEAR
-  cmp dl, 0
+shadow_reference_68 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_44
   add esp, 4
   ; Restore original EDX.
@@ -3386,8 +3662,8 @@ asan_check_2_byte_write_access_no_flags_4gb PROC  ; Probe #45.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_45 LABEL NEAR
-  cmp dl, 0
+shadow_reference_69 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_45
   add esp, 4
   ; Restore original EDX.
@@ -3445,8 +3721,8 @@ asan_check_4_byte_read_access_no_flags_4gb PROC  ; Probe #46.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_46 LABEL NEAR
-  cmp dl, 0
+shadow_reference_70 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_46
   add esp, 4
   ; Restore original EDX.
@@ -3504,8 +3780,8 @@ asan_check_4_byte_write_access_no_flags_4gb PROC  ; Probe #47.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_47 LABEL NEAR
-  cmp dl, 0
+shadow_reference_71 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_47
   add esp, 4
   ; Restore original EDX.
@@ -3563,8 +3839,8 @@ asan_check_8_byte_read_access_no_flags_4gb PROC  ; Probe #48.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_48 LABEL NEAR
-  cmp dl, 0
+shadow_reference_72 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_48
   add esp, 4
   ; Restore original EDX.
@@ -3622,8 +3898,8 @@ asan_check_8_byte_write_access_no_flags_4gb PROC  ; Probe #49.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_49 LABEL NEAR
-  cmp dl, 0
+shadow_reference_73 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_49
   add esp, 4
   ; Restore original EDX.
@@ -3681,8 +3957,8 @@ asan_check_10_byte_read_access_no_flags_4gb PROC  ; Probe #50.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_50 LABEL NEAR
-  cmp dl, 0
+shadow_reference_74 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_50
   add esp, 4
   ; Restore original EDX.
@@ -3740,8 +4016,8 @@ asan_check_10_byte_write_access_no_flags_4gb PROC  ; Probe #51.
   movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_51 LABEL NEAR
-  cmp dl, 0
+shadow_reference_75 LABEL NEAR
+  test dl, dl
   jnz check_access_slow_51
   add esp, 4
   ; Restore original EDX.
@@ -3796,22 +4072,45 @@ asan_check_16_byte_read_access_no_flags_4gb PROC  ; Probe #52.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_52 LABEL NEAR
-  cmp dl, 0
+shadow_reference_76 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_52
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_52
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_52 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_52
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_77 LABEL NEAR
+  test edx, edx
+  jnz report_failure_52
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_78 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_52
   js report_failure_52
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_52
+check_access_tail_done_52 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -3855,22 +4154,45 @@ asan_check_16_byte_write_access_no_flags_4gb PROC  ; Probe #53.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 1
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_53 LABEL NEAR
-  cmp dl, 0
+shadow_reference_79 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_53
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_53
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_53 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_53
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 2
+  movzx edx, WORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_80 LABEL NEAR
+  test edx, edx
+  jnz report_failure_53
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_81 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_53
   js report_failure_53
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_53
+check_access_tail_done_53 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -3914,22 +4236,45 @@ asan_check_32_byte_read_access_no_flags_4gb PROC  ; Probe #54.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_54 LABEL NEAR
-  cmp dl, 0
+shadow_reference_82 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_54
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_54
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_54 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_54
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_83 LABEL NEAR
+  test edx, edx
+  jnz report_failure_54
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_84 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_54
   js report_failure_54
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_54
+check_access_tail_done_54 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -3973,22 +4318,45 @@ asan_check_32_byte_write_access_no_flags_4gb PROC  ; Probe #55.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  sub edx, 3
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_55 LABEL NEAR
-  cmp dl, 0
+shadow_reference_85 LABEL NEAR
+  test edx, edx
   jnz check_access_slow_55
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_55
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_55 LABEL NEAR
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_55
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, 4
+  mov edx, DWORD PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_86 LABEL NEAR
+  test edx, edx
+  jnz report_failure_55
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_87 LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_55
   js report_failure_55
   mov dh, BYTE PTR[esp]
   and dh, 7
   cmp dh, dl
   jae report_failure_55
+check_access_tail_done_55 LABEL NEAR
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
@@ -5168,6 +5536,38 @@ asan_shadow_references LABEL FAR
   DWORD shadow_reference_53 - 4
   DWORD shadow_reference_54 - 4
   DWORD shadow_reference_55 - 4
+  DWORD shadow_reference_56 - 4
+  DWORD shadow_reference_57 - 4
+  DWORD shadow_reference_58 - 4
+  DWORD shadow_reference_59 - 4
+  DWORD shadow_reference_60 - 4
+  DWORD shadow_reference_61 - 4
+  DWORD shadow_reference_62 - 4
+  DWORD shadow_reference_63 - 4
+  DWORD shadow_reference_64 - 4
+  DWORD shadow_reference_65 - 4
+  DWORD shadow_reference_66 - 4
+  DWORD shadow_reference_67 - 4
+  DWORD shadow_reference_68 - 4
+  DWORD shadow_reference_69 - 4
+  DWORD shadow_reference_70 - 4
+  DWORD shadow_reference_71 - 4
+  DWORD shadow_reference_72 - 4
+  DWORD shadow_reference_73 - 4
+  DWORD shadow_reference_74 - 4
+  DWORD shadow_reference_75 - 4
+  DWORD shadow_reference_76 - 4
+  DWORD shadow_reference_77 - 4
+  DWORD shadow_reference_78 - 4
+  DWORD shadow_reference_79 - 4
+  DWORD shadow_reference_80 - 4
+  DWORD shadow_reference_81 - 4
+  DWORD shadow_reference_82 - 4
+  DWORD shadow_reference_83 - 4
+  DWORD shadow_reference_84 - 4
+  DWORD shadow_reference_85 - 4
+  DWORD shadow_reference_86 - 4
+  DWORD shadow_reference_87 - 4
   DWORD 0
 
 .rdata ENDS
@@ -292,9 +292,10 @@ _4GB_CHECK = """\
 # This does the following:
 #   - Saves the memory location in EDX for the slow path.
 #   - Does an address check if neccessary.
-#   - Checks for zero shadow for this memory location. We use the cmp
+#   - Checks for zero shadow for this memory location. We use the test
 #       instruction so it'll set the sign flag if the upper bit of the shadow
-#       value of this memory location is set to 1.
+#       value of this memory location is set to 1. It is shorter than the
+#       equivalent cmp with an immediate zero.
 #   - If the shadow byte is not equal to zero then it jumps to the slow path.
 #   - Otherwise it removes the memory location from the top of the stack.
 _FAST_PATH = """\
@@ -304,7 +305,7 @@ _FAST_PATH = """\
   ; This is a label to the previous shadow memory reference. It will be
   ; referenced by the table at the end of the 'asan_probes' procedure.
 shadow_reference_{shadow_index!s} LABEL NEAR
-  cmp dl, 0
+  test dl, dl
   jnz check_access_slow_{probe_index}
   add esp, 4"""
 
@@ -332,6 +333,68 @@ _SLOW_PATH = """\
   add esp, 4"""
 
 
+# The fast path of the wide (16 and 32-byte) accesses.
+#
+# Like for the other accesses, the memory location is the address of the last
+# byte of the access. An N-byte access then covers the N / 8 shadow bytes
+# ending at its shadow index, and if its last byte isn't the last one of its
+# shadow byte, the tail of the preceding one. This does the following:
+#   - Saves the memory location in EDX for the slow path.
+#   - Does an address check if neccessary.
+#   - Loads the N / 8 shadow bytes ending at the shadow index at once.
+#   - Jumps to the slow path if they aren't all zero, or if the access isn't
+#       8-byte aligned.
+#   - Otherwise it removes the memory location from the top of the stack.
+_WIDE_FAST_PATH = """\
+  push edx
+  {range_check}
+  sub edx, {shadow_back}
+  {shadow_load} edx, {shadow_ptr} PTR[edx + {shadow}]
+  ; This is a label to the previous shadow memory reference. It will be
+  ; referenced by the table at the end of the 'asan_probes' procedure.
+shadow_reference_{shadow_index!s} LABEL NEAR
+  test edx, edx
+  jnz check_access_slow_{probe_index}
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  jne check_access_slow_{probe_index}
+  add esp, 4"""
+
+
+# The slow path of the wide accesses.
+#
+# The memory location is expected to be on top of the stack. An aligned access
+# only gets here if one of its shadow bytes is non-zero. Otherwise the N / 8
+# shadow bytes preceding the last one must all be zero, and the last one must
+# be zero or not a redzone and greater than the offset of the last byte.
+_WIDE_SLOW_PATH = """\
+  mov dl, BYTE PTR[esp]
+  and dl, 7
+  cmp dl, 7
+  je report_failure_{probe_index}
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  sub edx, {shadow_count}
+  {shadow_load} edx, {shadow_ptr} PTR[edx + {shadow}]
+shadow_reference_{shadow_index!s} LABEL NEAR
+  test edx, edx
+  jnz report_failure_{probe_index}
+  mov edx, DWORD PTR[esp]
+  shr edx, 3
+  movzx edx, BYTE PTR[edx + {shadow}]
+shadow_reference_{shadow_index!s} LABEL NEAR
+  test dl, dl
+  jz check_access_tail_done_{probe_index}
+  js report_failure_{probe_index}
+  mov dh, BYTE PTR[esp]
+  and dh, 7
+  cmp dh, dl
+  jae report_failure_{probe_index}
+check_access_tail_done_{probe_index} LABEL NEAR
+  add esp, 4"""
+
+
 # The error path.
 #
 # It expects to have the previous value of EDX at [ESP + 4] and the address
@@ -375,6 +438,20 @@ _MACROS = {
 }
 
 
+# The macros that replace the ones above for the wide accesses.
+_WIDE_MACROS = {
+  "AsanFastPath": _WIDE_FAST_PATH,
+  "AsanSlowPath": _WIDE_SLOW_PATH,
+}
+
+
+# The wide access sizes, and how to load their shadow bytes at once.
+_WIDE_ACCESS_SHADOW_LOADS = {
+  16: ('movzx', 'WORD'),
+  32: ('mov', 'DWORD'),
+}
+
+
 # Generates the Asan check access functions.
 #
 # The name of the generated method will be
@@ -612,7 +689,18 @@ class MacroAssembler(string.Formatter):
   def get_value(self, key, args, kwargs):
     """Override to inject macro definitions."""
     if key in _MACROS:
-      macro = _MACROS[key].format(*args, **kwargs)
+      macro = _MACROS[key]
+      # The wide accesses check all of their shadow bytes natively.
+      access_size = kwargs.get('access_size')
+      if key in _WIDE_MACROS and access_size in _WIDE_ACCESS_SHADOW_LOADS:
+        (shadow_load, shadow_ptr) = _WIDE_ACCESS_SHADOW_LOADS[access_size]
+        kwargs = dict(kwargs,
+                      shadow_back=access_size / 8 - 1,
+                      shadow_count=access_size / 8,
+                      shadow_load=shadow_load,
+                      shadow_ptr=shadow_ptr)
+        macro = _WIDE_MACROS[key]
+      macro = macro.format(*args, **kwargs)
       # Trim leading whitespace to allow natural use of AsanXXX macros.
       macro = macro.lstrip()
       return macro
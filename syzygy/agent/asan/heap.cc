@@ -22,7 +22,8 @@ const char* kHeapTypes[kHeapTypeMax] = {
     "WinHeap",
     "DISABLED_CtMalloc",
     "LargeBlockHeap",
-    "ZebraBlockHeap" };
+    "ZebraBlockHeap",
+    "SizeClassBlockHeap" };
 
 }  // namespace asan
 }  // namespace agent
@@ -38,6 +38,7 @@ enum HeapType {
   kReserved, // Was kCtMalloc.
   kLargeBlockHeap,
   kZebraBlockHeap,
+  kSizeClassBlockHeap,
 
   // This must be last.
   kHeapTypeMax,
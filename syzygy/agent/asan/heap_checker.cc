@@ -14,18 +14,303 @@
 
 #include "syzygy/agent/asan/heap_checker.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "syzygy/agent/asan/constants.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
+#include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
 
+// Groups the consecutive corrupt blocks of a walk in ranges. The ranges are
+// stored either in a vector, or in a fixed size buffer that doesn't require
+// any allocation. The first and last blocks of the walk are remembered so
+// that the ranges of adjacent walks can be stitched together.
+class HeapChecker::RangeAccumulator {
+ public:
+  // Accumulates the ranges in a vector.
+  // @param corrupt_ranges The vector receiving the ranges.
+  explicit RangeAccumulator(CorruptRangesVector* corrupt_ranges)
+      : corrupt_ranges_(corrupt_ranges), buffer_(nullptr), capacity_(0) {
+    DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
+    Reset();
+  }
+
+  // Accumulates the ranges in a fixed size buffer.
+  // @param buffer The buffer receiving the ranges.
+  // @param capacity The number of ranges that fit in @p buffer.
+  RangeAccumulator(AsanCorruptBlockRange* buffer, size_t capacity)
+      : corrupt_ranges_(nullptr), buffer_(buffer), capacity_(capacity) {
+    DCHECK_NE(static_cast<AsanCorruptBlockRange*>(nullptr), buffer);
+    Reset();
+  }
+
+  // Forgets about the ranges accumulated so far.
+  void Reset() {
+    if (corrupt_ranges_ != nullptr)
+      corrupt_ranges_->clear();
+    range_count_ = 0;
+    overflowed_ = false;
+    has_blocks_ = false;
+    first_block_is_corrupt_ = false;
+    last_block_is_corrupt_ = false;
+  }
+
+  // Adds the next block of the walk.
+  // @param block_info The block.
+  // @param is_corrupt Whether or not the block is corrupt.
+  void AddBlock(const BlockInfo& block_info, bool is_corrupt) {
+    if (!has_blocks_) {
+      has_blocks_ = true;
+      first_block_is_corrupt_ = is_corrupt;
+    }
+
+    if (!is_corrupt) {
+      if (last_block_is_corrupt_)
+        FlushRange();
+      last_block_is_corrupt_ = false;
+      return;
+    }
+
+    // If the previous block isn't corrupt then this block is at the
+    // beginning of a corrupt range.
+    if (!last_block_is_corrupt_) {
+      current_range_.address = block_info.header;
+      current_range_.length = 0;
+      current_range_.block_count = 0;
+      current_range_.block_info = nullptr;
+      current_range_.block_info_count = 0;
+      last_block_is_corrupt_ = true;
+    }
+
+    current_range_.block_count++;
+    const uint8_t* current_block_end =
+        block_info.RawHeader() + block_info.block_size;
+    current_range_.length =
+        current_block_end -
+        reinterpret_cast<const uint8_t*>(current_range_.address);
+  }
+
+  // Terminates the walk. This must be called once all the blocks have been
+  // added.
+  void Finish() {
+    if (last_block_is_corrupt_)
+      FlushRange();
+  }
+
+  // Appends the accumulated ranges to those of the preceding walks, merging
+  // the ranges that span both walks. Must not be called if the accumulator
+  // overflowed.
+  // @param previous_last_block_is_corrupt Indicates whether the last block
+  //     of the preceding walks is corrupt. This is updated to describe the
+  //     last block of this walk.
+  // @param corrupt_ranges The ranges of the preceding walks.
+  void AppendTo(bool* previous_last_block_is_corrupt,
+                CorruptRangesVector* corrupt_ranges) const {
+    DCHECK_NE(static_cast<bool*>(nullptr), previous_last_block_is_corrupt);
+    DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
+    DCHECK(!overflowed_);
+
+    // An empty walk doesn't separate the ranges of its neighbours.
+    if (!has_blocks_)
+      return;
+
+    const AsanCorruptBlockRange* ranges =
+        corrupt_ranges_ != nullptr ? corrupt_ranges_->data() : buffer_;
+    size_t i = 0;
+    if (*previous_last_block_is_corrupt && first_block_is_corrupt_) {
+      DCHECK(!corrupt_ranges->empty());
+      DCHECK_LT(0u, range_count_);
+      AsanCorruptBlockRange* back = &corrupt_ranges->back();
+      back->block_count += ranges[0].block_count;
+      back->length = reinterpret_cast<const uint8_t*>(ranges[0].address) +
+                     ranges[0].length -
+                     reinterpret_cast<const uint8_t*>(back->address);
+      i = 1;
+    }
+    for (; i < range_count_; ++i)
+      corrupt_ranges->push_back(ranges[i]);
+
+    *previous_last_block_is_corrupt = last_block_is_corrupt_;
+  }
+
+  // @returns true if ranges had to be dropped for lack of space.
+  bool overflowed() const { return overflowed_; }
+
+ private:
+  // Stores the current range.
+  void FlushRange() {
+    if (corrupt_ranges_ != nullptr) {
+      corrupt_ranges_->push_back(current_range_);
+    } else if (range_count_ < capacity_) {
+      buffer_[range_count_] = current_range_;
+    } else {
+      overflowed_ = true;
+      return;
+    }
+    ++range_count_;
+  }
+
+  // The storage of the ranges. Exactly one of these is used.
+  CorruptRangesVector* corrupt_ranges_;
+  AsanCorruptBlockRange* buffer_;
+  size_t capacity_;
+
+  // The number of stored ranges.
+  size_t range_count_;
+
+  // Set when a range didn't fit in |buffer_|.
+  bool overflowed_;
+
+  // The state of the walk.
+  bool has_blocks_;
+  bool first_block_is_corrupt_;
+  bool last_block_is_corrupt_;
+
+  // The range being grown. Valid when |last_block_is_corrupt_| is true.
+  AsanCorruptBlockRange current_range_;
+
+  DISALLOW_COPY_AND_ASSIGN(RangeAccumulator);
+};
+
+// A thread walking slabs of memory on behalf of IsHeapCorrupt. It is started
+// ahead of time and waits to be handed a slab.
+class HeapChecker::WorkerThread : public base::PlatformThread::Delegate {
+ public:
+  // @param heap_checker The heap checker owning this thread.
+  explicit WorkerThread(HeapChecker* heap_checker)
+      : heap_checker_(heap_checker),
+        lower_bound_(nullptr),
+        upper_bound_(nullptr),
+        accumulator_(ranges_, kMaxCorruptRangesPerWorker),
+        work_event_(false, false),
+        done_event_(false, false),
+        enabled_(0) {
+    DCHECK_NE(static_cast<HeapChecker*>(nullptr), heap_checker);
+  }
+
+  ~WorkerThread() override {
+    DCHECK_EQ(0, base::subtle::NoBarrier_Load(&enabled_));
+  }
+
+  // Starts the thread.
+  // @returns true on success, false if the thread failed to be launched.
+  bool Start() {
+    base::subtle::NoBarrier_Store(&enabled_, 1);
+    // Make sure the change to |enabled_| is not reordered.
+    base::subtle::MemoryBarrier();
+    if (!base::PlatformThread::Create(0, this, &thread_handle_)) {
+      base::subtle::NoBarrier_Store(&enabled_, 0);
+      return false;
+    }
+    return true;
+  }
+
+  // Stops the thread and waits until it exits.
+  void Stop() {
+    base::subtle::NoBarrier_Store(&enabled_, 0);
+    // Make sure the change to |enabled_| is not reordered.
+    base::subtle::MemoryBarrier();
+    work_event_.Signal();
+    base::PlatformThread::Join(thread_handle_);
+  }
+
+  // Starts walking a slab. Wait must be called before starting another walk.
+  // @param lower_bound The lower bound of the slab (inclusive).
+  // @param upper_bound The upper bound of the slab (exclusive).
+  void WalkSlab(const uint8_t* lower_bound, const uint8_t* upper_bound) {
+    lower_bound_ = lower_bound;
+    upper_bound_ = upper_bound;
+    work_event_.Signal();
+  }
+
+  // Waits for the current walk to complete.
+  void Wait() { done_event_.Wait(); }
+
+  // @name Accessors to the last walk.
+  // @{
+  const uint8_t* lower_bound() const { return lower_bound_; }
+  const uint8_t* upper_bound() const { return upper_bound_; }
+  const RangeAccumulator& accumulator() const { return accumulator_; }
+  // @}
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override {
+    base::PlatformThread::SetName("SyzyASAN Heap Checker Thread");
+    while (true) {
+      work_event_.Wait();
+      if (!base::subtle::NoBarrier_Load(&enabled_))
+        break;
+      accumulator_.Reset();
+      heap_checker_->GetCorruptRangesInSlab(
+          lower_bound_, upper_bound_, kRemoveProtections, &accumulator_);
+      done_event_.Signal();
+    }
+  }
+
+  // The heap checker owning this thread.
+  HeapChecker* heap_checker_;
+
+  // The slab being walked.
+  const uint8_t* lower_bound_;
+  const uint8_t* upper_bound_;
+
+  // The ranges found in the slab. These are preallocated, as the heaps are
+  // locked while the heap is being checked.
+  AsanCorruptBlockRange ranges_[kMaxCorruptRangesPerWorker];
+  RangeAccumulator accumulator_;
+
+  // Used to signal that a slab is ready to be walked, and that it has been.
+  base::WaitableEvent work_event_;
+  base::WaitableEvent done_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  // The thread loops while this is non-zero.
+  base::subtle::Atomic32 enabled_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkerThread);
+};
+
 HeapChecker::HeapChecker(Shadow* shadow)
-    : shadow_(shadow) {
+    : shadow_(shadow),
+      next_slice_(
+          reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound)) {
   DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
 }
 
+HeapChecker::~HeapChecker() {
+  DCHECK(workers_.empty());
+}
+
+bool HeapChecker::StartWorkerThreads(size_t thread_count) {
+  DCHECK(workers_.empty());
+  for (size_t i = 0; i < thread_count; ++i) {
+    std::unique_ptr<WorkerThread> worker(new WorkerThread(this));
+    if (!worker->Start()) {
+      // Don't leave a partial pool running.
+      StopWorkerThreads();
+      return false;
+    }
+    workers_.push_back(std::move(worker));
+  }
+  return true;
+}
+
+void HeapChecker::StopWorkerThreads() {
+  for (auto& worker : workers_)
+    worker->Stop();
+  workers_.clear();
+}
+
 bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
   DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
 
@@ -33,71 +318,163 @@ bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
 
   // Grab the page protection lock. This prevents multiple heap checkers from
   // running simultaneously, and also prevents page protections from being
-  // modified from underneath us.
+  // modified from underneath us. The worker threads act on behalf of this
+  // thread and modify the page protections without acquiring it.
   ::common::AutoRecursiveLock scoped_lock(block_protect_lock);
 
   // Walk over all of the addressable memory to find the corrupt blocks.
   // Allow memory_size to overflow to 0 for 4GB 32-bit processes.
   // TODO(sebmarchand): Iterates over the heap slabs once we have switched to
   //     a new memory allocator.
-  GetCorruptRangesInSlab(
-      reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound),
-      reinterpret_cast<const uint8_t*>(shadow_->memory_size()),
-      corrupt_ranges);
+  const uint8_t* lower_bound =
+      reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound);
+  const uint8_t* upper_bound =
+      reinterpret_cast<const uint8_t*>(shadow_->memory_size());
+
+  if (workers_.empty()) {
+    RangeAccumulator accumulator(corrupt_ranges);
+    GetCorruptRangesInSlab(lower_bound, upper_bound, kRemoveProtections,
+                           &accumulator);
+    return !corrupt_ranges->empty();
+  }
+
+  // Split the memory in as many slabs as there are workers. The span is
+  // computed modulo the size of the address space, which handles an
+  // overflowed |upper_bound|.
+  size_t span = reinterpret_cast<size_t>(upper_bound) -
+                reinterpret_cast<size_t>(lower_bound);
+  size_t slab_size =
+      ::common::AlignUp(span / workers_.size() + 1, GetPageSize());
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    size_t slab_begin = std::min(i * slab_size, span);
+    size_t slab_end = std::min(slab_begin + slab_size, span);
+    workers_[i]->WalkSlab(lower_bound + slab_begin, lower_bound + slab_end);
+  }
+
+  // Collect the ranges in order, stitching together the ranges that span
+  // several slabs. A worker that ran out of space has its slab walked again
+  // by this thread.
+  bool last_block_is_corrupt = false;
+  for (auto& worker : workers_) {
+    worker->Wait();
+    if (!worker->accumulator().overflowed()) {
+      worker->accumulator().AppendTo(&last_block_is_corrupt, corrupt_ranges);
+      continue;
+    }
 
+    CorruptRangesVector slab_ranges;
+    RangeAccumulator accumulator(&slab_ranges);
+    GetCorruptRangesInSlab(worker->lower_bound(), worker->upper_bound(),
+                           kRemoveProtections, &accumulator);
+    accumulator.AppendTo(&last_block_is_corrupt, corrupt_ranges);
+  }
+
+  return !corrupt_ranges->empty();
+}
+
+bool HeapChecker::IsHeapSliceCorrupt(size_t slice_size,
+                                     CorruptRangesVector* corrupt_ranges) {
+  DCHECK_LT(0u, slice_size);
+  DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
+
+  ::common::AutoRecursiveLock scoped_lock(block_protect_lock);
+
+  // Clip the slice to the end of the memory, in which case the next slice
+  // wraps around to the beginning of it.
+  const uint8_t* lower_bound = next_slice_;
+  const uint8_t* upper_bound =
+      reinterpret_cast<const uint8_t*>(shadow_->memory_size());
+  size_t remaining = reinterpret_cast<size_t>(upper_bound) -
+                     reinterpret_cast<size_t>(lower_bound);
+  if (slice_size < remaining) {
+    upper_bound = lower_bound + slice_size;
+    next_slice_ = upper_bound;
+  } else {
+    next_slice_ = reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound);
+  }
+
+  RangeAccumulator accumulator(corrupt_ranges);
+  GetCorruptRangesInSlab(lower_bound, upper_bound, kRestoreProtections,
+                         &accumulator);
   return !corrupt_ranges->empty();
 }
 
 void HeapChecker::GetCorruptRangesInSlab(const uint8_t* lower_bound,
                                          const uint8_t* upper_bound,
-                                         CorruptRangesVector* corrupt_ranges) {
+                                         ProtectionMode mode,
+                                         RangeAccumulator* accumulator) {
   DCHECK_NE(static_cast<const uint8_t*>(nullptr), lower_bound);
   DCHECK(upper_bound == nullptr || lower_bound <= upper_bound);
-  DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
+  DCHECK_NE(static_cast<RangeAccumulator*>(nullptr), accumulator);
+
+  // The blocks straddling the beginning of the slab are reported by the walk
+  // of the preceding slab.
+  lower_bound = SkipStraddlingBlocks(lower_bound);
+  if (upper_bound != nullptr && lower_bound >= upper_bound) {
+    accumulator->Finish();
+    return;
+  }
 
   // An overflowed |upper_bound| is handled correctly by the ShadowWalker.
   ShadowWalker shadow_walker(shadow_, lower_bound, upper_bound);
 
-  AsanCorruptBlockRange* current_corrupt_range = nullptr;
-
   // Iterates over the blocks.
   BlockInfo block_info = {};
   while (shadow_walker.Next(&block_info)) {
-    // Remove the protections on this block so its checksum can be safely
-    // validated. We leave the protections permanently removed so that the
-    // minidump generation has free access to block contents.
-    BlockProtectNone(block_info, shadow_);
-
-    bool current_block_is_corrupt = IsBlockCorrupt(block_info);
-    // If the current block is corrupt and |current_corrupt_range| is nullptr
-    // then this means that the current block is at the beginning of a corrupt
-    // range.
-    if (current_block_is_corrupt && current_corrupt_range == nullptr) {
-      AsanCorruptBlockRange corrupt_range;
-      corrupt_range.address = block_info.header;
-      corrupt_range.length = 0;
-      corrupt_range.block_count = 0;
-      corrupt_range.block_info = nullptr;
-      corrupt_range.block_info_count = 0;
-      corrupt_ranges->push_back(corrupt_range);
-      current_corrupt_range = &corrupt_ranges->back();
-    } else if (!current_block_is_corrupt && current_corrupt_range != nullptr) {
-      current_corrupt_range = nullptr;
+    if (mode == kRemoveProtections) {
+      // Remove the protections on this block so its checksum can be safely
+      // validated. We leave the protections permanently removed so that the
+      // minidump generation has free access to block contents.
+      BlockProtectNoneUnlocked(block_info, shadow_);
+      accumulator->AddBlock(block_info, IsBlockCorrupt(block_info));
+      continue;
     }
 
-    if (current_block_is_corrupt) {
-      // If the current block is corrupt then we need to update the size of the
-      // current range.
-      DCHECK_NE(reinterpret_cast<AsanCorruptBlockRange*>(nullptr),
-                current_corrupt_range);
-      current_corrupt_range->block_count++;
-      const uint8_t* current_block_end =
-          block_info.RawHeader() + block_info.block_size;
-      current_corrupt_range->length =
-          current_block_end -
-          reinterpret_cast<const uint8_t*>(current_corrupt_range->address);
+    // Otherwise the protections are put back as they were found. The heap
+    // manager protects either the redzones or the whole block, and the
+    // middle pages are only protected in the latter case.
+    bool redzones_protected =
+        (block_info.left_redzone_pages_size > 0 &&
+         shadow_->PageIsProtected(block_info.left_redzone_pages)) ||
+        (block_info.right_redzone_pages_size > 0 &&
+         shadow_->PageIsProtected(block_info.right_redzone_pages));
+    size_t middle_pages_size = block_info.block_pages_size -
+                               block_info.left_redzone_pages_size -
+                               block_info.right_redzone_pages_size;
+    bool all_protected =
+        middle_pages_size > 0 &&
+        shadow_->PageIsProtected(block_info.block_pages +
+                                 block_info.left_redzone_pages_size);
+
+    // Checking the block commits its body again if it was decommitted.
+    bool body_decommitted = all_protected && BlockBodyIsDecommitted(block_info);
+
+    if (redzones_protected || all_protected)
+      BlockProtectNone(block_info, shadow_);
+    accumulator->AddBlock(block_info, IsBlockCorrupt(block_info));
+    if (all_protected) {
+      BlockProtectAll(block_info, shadow_);
+      if (body_decommitted)
+        BlockDecommitBody(block_info);
+    } else if (redzones_protected) {
+      BlockProtectRedzones(block_info, shadow_);
     }
   }
+
+  accumulator->Finish();
+}
+
+const uint8_t* HeapChecker::SkipStraddlingBlocks(const uint8_t* address) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), address);
+
+  // Blocks may be nested, so keep going until reaching an address that isn't
+  // covered by an enclosing block.
+  BlockInfo block_info = {};
+  while (shadow_->BlockInfoFromShadow(address, &block_info) &&
+         block_info.RawHeader() < address) {
+    address = block_info.RawHeader() + block_info.block_size;
+  }
+  return address;
 }
 
 }  // namespace asan
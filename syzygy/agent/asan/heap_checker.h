@@ -13,10 +13,21 @@
 // limitations under the License.
 //
 // Declares HeapChecker, a class that checks a heap for corruption.
+//
+// The address space can be split in as many ranges as there are worker
+// threads, which are then walked concurrently. The workers are started ahead
+// of time, as creating threads while handling a crash isn't safe, and they
+// don't make any allocation as the heaps are locked while the heap is being
+// checked.
+//
+// The heap can also be checked incrementally, a slice of the address space at
+// a time, which allows corruption to be found in the background instead of at
+// crash time.
 
 #ifndef SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 #define SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 
+#include <memory>
 #include <vector>
 
 #include "base/logging.h"
@@ -35,36 +46,97 @@ class HeapChecker {
  public:
   typedef std::vector<AsanCorruptBlockRange> CorruptRangesVector;
 
+  // The maximum number of corrupt ranges that a worker thread reports. A
+  // range of memory with more corrupt ranges than this is walked again by the
+  // calling thread.
+  static const size_t kMaxCorruptRangesPerWorker = 64;
+
   // Constructor.
   // @param shadow The shadow memory to query.
   explicit HeapChecker(Shadow* shadow);
 
+  // Destructor. The worker threads must have been stopped.
+  ~HeapChecker();
+
+  // Starts the worker threads used by IsHeapCorrupt. This must not be called
+  // while handling a crash.
+  // @param thread_count The number of worker threads to start.
+  // @returns true on success, false if a thread failed to be launched. In
+  //     that case no worker thread is left running.
+  bool StartWorkerThreads(size_t thread_count);
+
+  // Stops the worker threads, if any, and waits until they exit.
+  void StopWorkerThreads();
+
+  // @returns the number of worker threads.
+  size_t worker_thread_count() const { return workers_.size(); }
+
   // Checks if the heap is corrupt and returns the information about the
   // corrupt ranges. This permanently removes all page protections as it
-  // walks through memory.
+  // walks through memory. The walk is split among the worker threads, if
+  // any.
   // @param corrupt_ranges Will receive the information about the corrupt
   //     ranges.
   // @returns true if the heap is corrupt, false otherwise.
   bool IsHeapCorrupt(CorruptRangesVector* corrupt_ranges);
 
+  // Checks a slice of the heap for corruption. Successive calls walk
+  // successive slices of the address space, wrapping around at its end. The
+  // page protections of the blocks are restored once they are checked. The
+  // heaps should be locked while this runs.
+  // @param slice_size The number of bytes of address space to walk.
+  // @param corrupt_ranges Will receive the information about the corrupt
+  //     ranges found in the slice.
+  // @returns true if the slice is corrupt, false otherwise.
+  bool IsHeapSliceCorrupt(size_t slice_size,
+                          CorruptRangesVector* corrupt_ranges);
+
   // TODO(sebmarchand): Add a testing seam that controls the range of memory
   //     that is walked by HeapChecker to keep unittest times to something
   //     reasonable.
 
  private:
+  class RangeAccumulator;
+  class WorkerThread;
+
+  // The way page protections are handled while walking a slab.
+  enum ProtectionMode {
+    // The protections are permanently removed. The caller must hold
+    // block_protect_lock, possibly on behalf of the walking thread.
+    kRemoveProtections,
+    // The protections are restored after each block is checked.
+    kRestoreProtections,
+  };
+
   // Get the information about the corrupt ranges in a heap slab.
   // @param lower_bound The lower bound for this slab (inclusive).
   // @param upper_bound The upper bound for this slab (exclusive). An
   //     overflowed value of 0 indicates the end of all memory.
-  // @param corrupt_ranges Will receive the information about the corrupt ranges
+  // @param mode The way page protections are handled.
+  // @param accumulator Will receive the information about the corrupt ranges
   //     in this slab.
   void GetCorruptRangesInSlab(const uint8_t* lower_bound,
                               const uint8_t* upper_bound,
-                              CorruptRangesVector* corrupt_ranges);
+                              ProtectionMode mode,
+                              RangeAccumulator* accumulator);
+
+  // Moves an address past the blocks that straddle it. Blocks are reported by
+  // the walk of the slab holding their beginning, so this gives the first
+  // address of a slab that belongs to it.
+  // @param address The address to adjust.
+  // @returns the first address at or after @p address that isn't inside of a
+  //     block starting before it.
+  const uint8_t* SkipStraddlingBlocks(const uint8_t* address);
 
   // The shadow memory that will be analyzed.
   Shadow* shadow_;
 
+  // The worker threads used by IsHeapCorrupt.
+  std::vector<std::unique_ptr<WorkerThread>> workers_;
+
+  // The beginning of the next slice walked by IsHeapSliceCorrupt.
+  const uint8_t* next_slice_;
+
   DISALLOW_COPY_AND_ASSIGN(HeapChecker);
 };
 
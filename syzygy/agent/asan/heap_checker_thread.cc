@@ -0,0 +1,73 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_checker_thread.h"
+
+#include "syzygy/agent/asan/heap_manager.h"
+
+namespace agent {
+namespace asan {
+
+HeapCheckerThread::HeapCheckerThread(
+    Shadow* shadow,
+    HeapManagerInterface* heap_manager,
+    base::TimeDelta period,
+    const CorruptionCallback& corruption_callback)
+    : heap_checker_(shadow),
+      heap_manager_(heap_manager),
+      period_(period),
+      corruption_callback_(corruption_callback),
+      stop_event_(true, false) {
+  DCHECK_NE(static_cast<HeapManagerInterface*>(nullptr), heap_manager);
+  DCHECK(!corruption_callback_.is_null());
+}
+
+HeapCheckerThread::~HeapCheckerThread() {
+}
+
+bool HeapCheckerThread::Start() {
+  // This doesn't use a background priority as the thread holds the heap locks
+  // while it works.
+  return base::PlatformThread::Create(0, this, &thread_handle_);
+}
+
+void HeapCheckerThread::Stop() {
+  stop_event_.Signal();
+  base::PlatformThread::Join(thread_handle_);
+}
+
+bool HeapCheckerThread::CheckNextSlice() {
+  HeapChecker::CorruptRangesVector corrupt_ranges;
+  {
+    AutoHeapManagerLock lock(heap_manager_);
+    if (!heap_checker_.IsHeapSliceCorrupt(kSliceSize, &corrupt_ranges))
+      return false;
+  }
+
+  // The callback is invoked without holding the heap locks, as reporting the
+  // error checks the whole heap.
+  corruption_callback_.Run(corrupt_ranges);
+  return true;
+}
+
+void HeapCheckerThread::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Heap Checker Thread");
+  while (!stop_event_.TimedWait(period_)) {
+    if (CheckNextSlice())
+      break;
+  }
+}
+
+}  // namespace asan
+}  // namespace agent
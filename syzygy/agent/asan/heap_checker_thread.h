@@ -0,0 +1,106 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares HeapCheckerThread, a background thread that checks the heap for
+// corruption incrementally.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_CHECKER_THREAD_H_
+#define SYZYGY_AGENT_ASAN_HEAP_CHECKER_THREAD_H_
+
+#include "base/callback.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+#include "syzygy/agent/asan/heap_checker.h"
+
+namespace agent {
+namespace asan {
+
+// Forward declarations.
+class HeapManagerInterface;
+class Shadow;
+
+// A background thread that checks a bounded slice of the heap
+// every period, under the heap manager locks. This bounds the time for which
+// the application threads are held up, and finds corruption before it causes
+// a crash, when the offending code is more likely to be identifiable.
+//
+// Note that the thread must be cleanly shutdown by calling Stop before the
+// heap manager is cleaned up.
+class HeapCheckerThread : public base::PlatformThread::Delegate {
+ public:
+  typedef base::Callback<void(const HeapChecker::CorruptRangesVector&)>
+      CorruptionCallback;
+
+  // The number of bytes of address space that are checked every period.
+  static const size_t kSliceSize = 64 * 1024 * 1024;
+
+  // @param shadow The shadow memory to query.
+  // @param heap_manager The heap manager whose heaps are checked.
+  // @param period The time between two slices.
+  // @param corruption_callback Callback that is called by the thread with the
+  //     corrupt ranges when it finds corruption. The thread stops checking
+  //     the heap afterwards. This callback must be valid from the moment Start
+  //     is called and until Stop is called.
+  HeapCheckerThread(Shadow* shadow,
+                    HeapManagerInterface* heap_manager,
+                    base::TimeDelta period,
+                    const CorruptionCallback& corruption_callback);
+  ~HeapCheckerThread() override;
+
+  // Starts the thread. Must not be called if the thread has already been
+  // started.
+  // @returns true if successful, false if the thread failed to be launched.
+  bool Start();
+
+  // Stops the thread and waits until it exits cleanly. Must be called before
+  // the destruction of this object. Must not be called if the thread has not
+  // been started successfully.
+  void Stop();
+
+  // Checks the next slice of the heap, invoking the callback if it is
+  // corrupt. This is what the thread does every period, and is exposed for
+  // testing.
+  // @returns true if corruption was found, false otherwise.
+  bool CheckNextSlice();
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override;
+
+  // The heap checker keeping track of the slices.
+  HeapChecker heap_checker_;
+
+  // The heap manager whose heaps are checked.
+  HeapManagerInterface* heap_manager_;
+
+  // The time between two slices.
+  base::TimeDelta period_;
+
+  // The callback invoked when corruption is found.
+  CorruptionCallback corruption_callback_;
+
+  // Used to signal the thread to exit.
+  base::WaitableEvent stop_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeapCheckerThread);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_CHECKER_THREAD_H_
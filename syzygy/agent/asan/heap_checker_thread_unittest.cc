@@ -0,0 +1,107 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_checker_thread.h"
+
+#include "base/bind.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/heap_manager.h"
+#include "syzygy/agent/asan/runtime.h"
+#include "syzygy/agent/asan/unittest_util.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+using testing::FakeAsanBlock;
+
+// A mock heap manager to make sure that the heaps are locked while the heap is
+// being checked.
+class LenientMockHeapManager : public HeapManagerInterface {
+ public:
+  MOCK_METHOD0(CreateHeap, HeapId());
+  MOCK_METHOD1(DestroyHeap, bool(HeapId));
+  MOCK_METHOD2(Size, uint32_t(HeapId, const void*));
+  MOCK_METHOD2(Allocate, void*(HeapId, uint32_t));
+  MOCK_METHOD2(Free, bool(HeapId, void*));
+  MOCK_METHOD1(Lock, void(HeapId));
+  MOCK_METHOD1(Unlock, void(HeapId));
+  MOCK_METHOD0(BestEffortLockAll, void());
+  MOCK_METHOD0(UnlockAll, void());
+};
+
+typedef testing::StrictMock<LenientMockHeapManager> MockHeapManager;
+
+class HeapCheckerThreadTest : public testing::TestWithAsanRuntime {
+ public:
+  HeapCheckerThreadTest() : corruption_count_(0) {}
+
+  void OnCorruption(const HeapChecker::CorruptRangesVector& corrupt_ranges) {
+    ++corruption_count_;
+    corrupt_ranges_ = corrupt_ranges;
+  }
+
+ protected:
+  MockHeapManager mock_heap_manager_;
+  size_t corruption_count_;
+  HeapChecker::CorruptRangesVector corrupt_ranges_;
+};
+
+}  // namespace
+
+TEST_F(HeapCheckerThreadTest, StartAndStop) {
+  HeapCheckerThread thread(
+      runtime_->shadow(), &mock_heap_manager_,
+      base::TimeDelta::FromHours(1),
+      base::Bind(&HeapCheckerThreadTest::OnCorruption,
+                 base::Unretained(this)));
+  ASSERT_TRUE(thread.Start());
+  thread.Stop();
+  EXPECT_EQ(0u, corruption_count_);
+}
+
+TEST_F(HeapCheckerThreadTest, CheckNextSliceReportsCorruption) {
+  const size_t kAllocSize = 100;
+  FakeAsanBlock fake_block(
+      runtime_->shadow(), kShadowRatioLog, runtime_->stack_cache());
+  fake_block.InitializeBlock(kAllocSize);
+  fake_block.block_info.header->magic = ~fake_block.block_info.header->magic;
+
+  HeapCheckerThread thread(
+      runtime_->shadow(), &mock_heap_manager_,
+      base::TimeDelta::FromHours(1),
+      base::Bind(&HeapCheckerThreadTest::OnCorruption,
+                 base::Unretained(this)));
+
+  // Check the slices up to the one holding the block.
+  size_t slice_count =
+      (reinterpret_cast<size_t>(fake_block.block_info.header) -
+       Shadow::kAddressLowerBound) / HeapCheckerThread::kSliceSize + 1;
+  EXPECT_CALL(mock_heap_manager_, BestEffortLockAll()).Times(slice_count);
+  EXPECT_CALL(mock_heap_manager_, UnlockAll()).Times(slice_count);
+  for (size_t i = 0; i < slice_count - 1; ++i)
+    EXPECT_FALSE(thread.CheckNextSlice());
+  EXPECT_TRUE(thread.CheckNextSlice());
+
+  EXPECT_EQ(1u, corruption_count_);
+  ASSERT_EQ(1u, corrupt_ranges_.size());
+  EXPECT_EQ(fake_block.block_info.header, corrupt_ranges_[0].address);
+
+  fake_block.block_info.header->magic = ~fake_block.block_info.header->magic;
+}
+
+}  // namespace asan
+}  // namespace agent
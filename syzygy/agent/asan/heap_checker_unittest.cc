@@ -204,5 +204,107 @@ TEST_F(HeapCheckerTest, IsHeapCorrupt) {
   ::free(global_alloc);
 }
 
+TEST_F(HeapCheckerTest, IsHeapCorruptWithWorkerThreads) {
+  const size_t kAllocSize = 100;
+
+  BlockLayout block_layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, kAllocSize, 0, 0,
+                              &block_layout));
+
+  const size_t kNumberOfBlocks = 4;
+  size_t total_alloc_size = block_layout.block_size * kNumberOfBlocks;
+  uint8_t* global_alloc =
+      reinterpret_cast<uint8_t*>(::malloc(total_alloc_size));
+
+  BlockHeader* block_headers[kNumberOfBlocks];
+  for (size_t i = 0; i < kNumberOfBlocks; ++i) {
+    BlockInfo block_info = {};
+    BlockInitialize(block_layout, global_alloc + i * block_layout.block_size,
+                    &block_info);
+    runtime_->shadow()->PoisonAllocatedBlock(block_info);
+    BlockSetChecksum(block_info);
+    block_headers[i] = block_info.header;
+  }
+
+  HeapChecker heap_checker(runtime_->shadow());
+  ASSERT_TRUE(heap_checker.StartWorkerThreads(4));
+  EXPECT_EQ(4u, heap_checker.worker_thread_count());
+  HeapChecker::CorruptRangesVector corrupt_ranges;
+  EXPECT_FALSE(heap_checker.IsHeapCorrupt(&corrupt_ranges));
+
+  // Corrupt the header of the first two blocks and of the last one.
+  block_headers[0]->magic++;
+  block_headers[1]->magic++;
+  block_headers[kNumberOfBlocks - 1]->magic++;
+
+  // The workers should find the same ranges as a single threaded walk.
+  HeapChecker sequential_heap_checker(runtime_->shadow());
+  HeapChecker::CorruptRangesVector expected_ranges;
+  EXPECT_TRUE(sequential_heap_checker.IsHeapCorrupt(&expected_ranges));
+  EXPECT_TRUE(heap_checker.IsHeapCorrupt(&corrupt_ranges));
+  ASSERT_EQ(2, expected_ranges.size());
+  ASSERT_EQ(expected_ranges.size(), corrupt_ranges.size());
+  for (size_t i = 0; i < expected_ranges.size(); ++i) {
+    EXPECT_EQ(expected_ranges[i].address, corrupt_ranges[i].address);
+    EXPECT_EQ(expected_ranges[i].length, corrupt_ranges[i].length);
+    EXPECT_EQ(expected_ranges[i].block_count, corrupt_ranges[i].block_count);
+  }
+  EXPECT_EQ(block_headers[0], corrupt_ranges[0].address);
+  EXPECT_EQ(2, corrupt_ranges[0].block_count);
+  EXPECT_EQ(block_headers[kNumberOfBlocks - 1], corrupt_ranges[1].address);
+  EXPECT_EQ(1, corrupt_ranges[1].block_count);
+
+  heap_checker.StopWorkerThreads();
+  EXPECT_EQ(0u, heap_checker.worker_thread_count());
+
+  block_headers[0]->magic--;
+  block_headers[1]->magic--;
+  block_headers[kNumberOfBlocks - 1]->magic--;
+
+  runtime_->shadow()->Unpoison(global_alloc, total_alloc_size);
+  ::free(global_alloc);
+}
+
+TEST_F(HeapCheckerTest, IsHeapSliceCorrupt) {
+  // Use a block large enough to have page protections, which should be left
+  // in place by the slice checks.
+  FakeAsanBlock fake_block(
+      runtime_->shadow(), kShadowRatioLog, runtime_->stack_cache());
+  fake_block.InitializeBlock(2 * static_cast<uint32_t>(GetPageSize()));
+  base::RandBytes(fake_block.block_info.body, 2 * GetPageSize());
+  fake_block.MarkBlockAsQuarantined();
+  fake_block.block_info.header->magic = ~fake_block.block_info.header->magic;
+  BlockProtectAll(fake_block.block_info, runtime_->shadow());
+  ASSERT_TRUE(
+      runtime_->shadow()->PageIsProtected(fake_block.block_info.block_pages));
+
+  // Walk the memory in 4 slices. The corruption should be found by exactly
+  // one of them, and the walk should then wrap around.
+  const size_t kSliceSize =
+      (runtime_->shadow()->memory_size() - Shadow::kAddressLowerBound) / 4 + 1;
+  HeapChecker heap_checker(runtime_->shadow());
+  HeapChecker::CorruptRangesVector corrupt_ranges;
+  size_t corrupt_slice_count = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    if (!heap_checker.IsHeapSliceCorrupt(kSliceSize, &corrupt_ranges))
+      continue;
+    ++corrupt_slice_count;
+    ASSERT_EQ(1, corrupt_ranges.size());
+    EXPECT_EQ(fake_block.block_info.header, corrupt_ranges[0].address);
+    EXPECT_EQ(1, corrupt_ranges[0].block_count);
+  }
+  EXPECT_EQ(1u, corrupt_slice_count);
+  EXPECT_TRUE(
+      runtime_->shadow()->PageIsProtected(fake_block.block_info.block_pages));
+
+  // The next slice is the first one again.
+  EXPECT_EQ(fake_block.block_info.header < reinterpret_cast<BlockHeader*>(
+                Shadow::kAddressLowerBound + kSliceSize),
+            heap_checker.IsHeapSliceCorrupt(kSliceSize, &corrupt_ranges));
+
+  BlockProtectNone(fake_block.block_info, runtime_->shadow());
+  fake_block.block_info.header->magic = ~fake_block.block_info.header->magic;
+}
+
 }  // namespace asan
 }  // namespace agent
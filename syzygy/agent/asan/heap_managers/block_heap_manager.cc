@@ -19,6 +19,7 @@
 
 #include "base/bind.h"
 #include "base/rand_util.h"
+#include "syzygy/agent/asan/lock_profiler.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
@@ -26,6 +27,7 @@
 #include "syzygy/agent/asan/heaps/internal_heap.h"
 #include "syzygy/agent/asan/heaps/large_block_heap.h"
 #include "syzygy/agent/asan/heaps/simple_block_heap.h"
+#include "syzygy/agent/asan/heaps/size_class_block_heap.h"
 #include "syzygy/agent/asan/heaps/win_heap.h"
 #include "syzygy/agent/asan/heaps/zebra_block_heap.h"
 #include "syzygy/common/asan_parameters.h"
@@ -38,6 +40,7 @@ namespace {
 
 typedef HeapManagerInterface::HeapId HeapId;
 using heaps::LargeBlockHeap;
+using heaps::SizeClassBlockHeap;
 using heaps::ZebraBlockHeap;
 
 // For now, the overbudget size is always set to 20% of the size of the
@@ -45,6 +48,10 @@ using heaps::ZebraBlockHeap;
 // TODO(georgesak): allow this to be changed through the parameters.
 enum : uint32_t { kOverbudgetSizePercentage = 20 };
 
+// Mixed with the address of the entry of a heap to give its cookie. The
+// cookie of a heap isn't zero, as its entry is pointer aligned.
+const uintptr_t kHeapCookieMagic = 0xC0DEB10C;
+
 // Return the position of the most significant bit in a 32 bit unsigned value.
 size_t GetMSBIndex(size_t n) {
   // Algorithm taken from
@@ -97,8 +104,16 @@ BlockHeapManager::BlockHeapManager(Shadow* shadow,
       zebra_block_heap_(nullptr),
       zebra_block_heap_id_(0),
       large_block_heap_id_(0),
+      size_class_block_heap_id_(0),
       locked_heaps_(nullptr),
-      enable_page_protections_(true) {
+      enable_page_protections_(true),
+      live_blocks_(),
+      live_bytes_(),
+      adaptive_guard_epoch_(0),
+      adaptive_guard_allocations_(0),
+      adaptive_guard_guarded_(0),
+      adaptive_guard_site_budget_(kAdaptiveGuardInitialSiteBudget),
+      deferred_free_thread_count_(0) {
   DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
   DCHECK_NE(static_cast<StackCaptureCache*>(nullptr), stack_cache);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
@@ -119,7 +134,7 @@ void BlockHeapManager::Init() {
   DCHECK(!initialized_);
 
   {
-    base::AutoLock lock(lock_);
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
     InitInternalHeap();
 
     // Only create a registry cache if the registry is available. It is not
@@ -135,8 +150,9 @@ void BlockHeapManager::Init() {
   PropagateParameters();
 
   {
-    base::AutoLock lock(lock_);
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
     InitProcessHeap();
+    InitMagazineCacheIfNecessary();
     initialized_ = true;
   }
 }
@@ -151,11 +167,9 @@ HeapId BlockHeapManager::CreateHeap() {
   // Creates the heap.
   BlockHeapInterface* heap = new heaps::SimpleBlockHeap(underlying_heap);
 
-  base::AutoLock lock(lock_);
+  ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
   underlying_heaps_map_.insert(std::make_pair(heap, underlying_heap));
-  HeapMetadata metadata = { &shared_quarantine_, false };
-  auto result = heaps_.insert(std::make_pair(heap, metadata));
-  return GetHeapId(result);
+  return AddHeapUnlocked(heap, &shared_quarantine_);
 }
 
 bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
@@ -167,7 +181,7 @@ bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
   {
     // Move the heap from the active to the dying list. This prevents it from
     // being used while it's being torn down.
-    base::AutoLock lock(lock_);
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
     auto iter = heaps_.find(heap);
     iter->second.is_dying = true;
   }
@@ -180,9 +194,11 @@ bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
   // Free up any resources associated with the heap. This modifies block
   // heap manager internals, so must be called under a lock.
   {
-    base::AutoLock lock(lock_);
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
     DestroyHeapResourcesUnlocked(heap, quarantine);
-    heaps_.erase(heaps_.find(heap));
+    auto iter = heaps_.find(heap);
+    iter->second.cookie = 0;
+    heaps_.erase(iter);
   }
 
   return true;
@@ -192,24 +208,47 @@ void* BlockHeapManager::Allocate(HeapId heap_id, uint32_t bytes) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapId(heap_id, false));
 
-  // Some allocations can pass through without instrumentation.
-  if (parameters_.allocation_guard_rate < 1.0 &&
-      base::RandDouble() >= parameters_.allocation_guard_rate) {
+  // Some allocations can pass through without instrumentation. When the
+  // guard rate is adaptive this depends on the call site, which is known
+  // from the fingerprint of the stack.
+  common::StackCapture stack;
+  bool adaptive_guard_rate = parameters_.enable_adaptive_guard_rate &&
+                             parameters_.allocation_guard_rate < 1.0 &&
+                             allocation_sites_.get() != nullptr;
+  if (adaptive_guard_rate) {
+    stack.InitFingerprintFromStack();
+    if (!ShouldGuardAllocation(stack.absolute_stack_id()))
+      return DoUnguardedAllocation(GetHeapFromId(heap_id), shadow_, bytes);
+  } else if (parameters_.allocation_guard_rate < 1.0 &&
+             base::RandDouble() >= parameters_.allocation_guard_rate) {
     return DoUnguardedAllocation(GetHeapFromId(heap_id), shadow_, bytes);
   }
 
   // Capture the current stack. InitFromStack is inlined to preserve the
-  // greatest number of stack frames.
-  common::StackCapture stack;
-  stack.InitFromStack();
+  // greatest number of stack frames. When the allocation stacks are sampled
+  // only a fingerprint of the callers is kept for most of the allocations.
+  if (parameters_.allocation_stack_sampling_period == 0 ||
+      allocation_sites_.get() == nullptr) {
+    stack.InitFromStack();
+  } else {
+    if (!adaptive_guard_rate)
+      stack.InitFingerprintFromStack();
+    if (ShouldCaptureFullAllocationStack(stack))
+      stack.InitFromStack();
+  }
 
   // Build the set of heaps that will be used to satisfy the allocation. This
   // is a stack of heaps, and they will be tried in the reverse order they are
   // inserted.
 
   // We can always use the heap that was passed in.
-  HeapId heaps[3] = { heap_id, 0, 0 };
+  HeapId heaps[4] = { heap_id, 0, 0, 0 };
   size_t heap_count = 1;
+  if (MayUseSizeClassBlockHeap(bytes)) {
+    DCHECK_LT(heap_count, arraysize(heaps));
+    heaps[heap_count++] = size_class_block_heap_id_;
+  }
+
   if (MayUseLargeBlockHeap(bytes)) {
     DCHECK_LT(heap_count, arraysize(heaps));
     heaps[heap_count++] = large_block_heap_id_;
@@ -220,16 +259,20 @@ void* BlockHeapManager::Allocate(HeapId heap_id, uint32_t bytes) {
     heaps[heap_count++] = zebra_block_heap_id_;
   }
 
-  // Use the selected heaps to try to satisfy the allocation.
+  // Use the selected heaps to try to satisfy the allocation. Small process
+  // heap allocations are served from the magazine cache when possible.
   void* alloc = nullptr;
   BlockLayout block_layout = {};
-  for (int i = static_cast<int>(heap_count) - 1; i >= 0; --i) {
+  if (heap_count == 1 && heap_id == process_heap_id_ &&
+      parameters_.enable_thread_local_magazines &&
+      magazine_cache_.get() != nullptr) {
+    alloc = AllocateFromMagazineCache(bytes, &block_layout);
+  }
+  for (int i = static_cast<int>(heap_count) - 1;
+       alloc == nullptr && i >= 0; --i) {
     BlockHeapInterface* heap = GetHeapFromId(heaps[i]);
-    alloc = heap->AllocateBlock(
-        bytes,
-        0,
-        parameters_.trailer_padding_size + sizeof(BlockTrailer),
-        &block_layout);
+    alloc = heap->AllocateBlock(bytes, 0, GetMinRightRedzoneSize(bytes),
+                                &block_layout);
     if (alloc != nullptr) {
       heap_id = heaps[i];
       break;
@@ -254,6 +297,7 @@ void* BlockHeapManager::Allocate(HeapId heap_id, uint32_t bytes) {
   block.header->state = ALLOCATED_BLOCK;
 
   block.trailer->heap_id = heap_id;
+  UpdateLiveBlockStatistics(GetHeapFromId(heap_id), block.block_size, true);
 
   BlockSetChecksum(block);
   if (enable_page_protections_)
@@ -317,16 +361,37 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   block_info.trailer->free_ticks = ::GetTickCount();
   block_info.trailer->free_tid = ::GetCurrentThreadId();
 
+  // The body pages of a large block are decommitted while it is quarantined,
+  // so that it only keeps its header and trailer pages resident. This relies
+  // on the page protections to recommit the body before it is accessed.
+  uint8_t* body_pages = nullptr;
+  uint32_t body_pages_size = 0;
+  if (enable_page_protections_ &&
+      parameters_.quarantine_decommit_threshold > 0 &&
+      block_info.body_size >= parameters_.quarantine_decommit_threshold &&
+      GetHeapFromId(heap_id)->GetHeapType() == kLargeBlockHeap) {
+    BlockGetBodyPages(block_info, &body_pages, &body_pages_size);
+  }
+
   // Flip a coin and sometimes flood the block. When flooded, overwrites are
   // clearly visible; when not flooded, the original contents are left visible.
-  bool flood = parameters_.quarantine_flood_fill_rate > 0.0 &&
+  // A decommitted body reads back as zeros, so it isn't flooded, and its
+  // contents are zeroed before the checksum is taken.
+  bool flood = body_pages_size == 0 &&
+      parameters_.quarantine_flood_fill_rate > 0.0 &&
       base::RandDouble() <= parameters_.quarantine_flood_fill_rate;
-  if (flood) {
+  // The fill is left to the deferred free threads when they are running. This
+  // isn't possible with page protections, as the body gets protected below.
+  bool defer_flood =
+      flood && !enable_page_protections_ && IsDeferredFreeThreadRunning();
+  if (flood && !defer_flood) {
     block_info.header->state = QUARANTINED_FLOODED_BLOCK;
-    ::memset(block_info.body, kBlockFloodFillByte, block_info.body_size);
+    BlockFloodFillBody(block_info);
   } else {
     block_info.header->state = QUARANTINED_BLOCK;
   }
+  if (body_pages_size > 0)
+    ::memset(body_pages, 0, body_pages_size);
 
   // Update the block checksum.
   BlockSetChecksum(block_info);
@@ -334,24 +399,26 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   CompactBlockInfo compact = {};
   ConvertBlockInfo(block_info, &compact);
 
-  PushResult push_result = {};
-  {
-    BlockQuarantineInterface::AutoQuarantineLock quarantine_lock(
-        quarantine, compact);
-    push_result = quarantine->Push(compact);
-    if (!push_result.push_successful) {
-      TrimOrScheduleIfNecessary(push_result.trim_status, quarantine);
-      return FreePristineBlock(&block_info);
-    }
+  if (defer_flood)
+    SchedulePendingFloodFill(compact);
 
-    if (enable_page_protections_) {
-      // The recently pushed block can be popped out in TrimQuarantine if the
-      // quarantine size is 0, in that case TrimQuarantine takes care of
-      // properly unprotecting and freeing the block. If the protection is set
-      // blindly after TrimQuarantine we could end up protecting a free (not
-      // quarantined, not allocated) block.
-      BlockProtectAll(block_info, shadow_);
-    }
+  // Protect the block before pushing it. Once pushed it may be popped and
+  // freed by a concurrent trim at any time, and protecting it afterwards could
+  // end up protecting a free (not quarantined, not allocated) block. The
+  // freeing paths take care of removing the protections. This means that the
+  // quarantine lock doesn't need to be held while pushing, so that frees
+  // don't contend with trimming.
+  if (enable_page_protections_)
+    BlockProtectAll(block_info, shadow_);
+  if (body_pages_size > 0)
+    compact.is_body_decommitted = BlockDecommitBody(block_info);
+
+  PushResult push_result = quarantine->Push(compact);
+  if (!push_result.push_successful) {
+    if (defer_flood)
+      CancelPendingFloodFill(block_info.header);
+    TrimOrScheduleIfNecessary(push_result.trim_status, quarantine);
+    return FreePristineBlock(&block_info);
   }
 
   TrimOrScheduleIfNecessary(push_result.trim_status, quarantine);
@@ -384,7 +451,8 @@ uint32_t BlockHeapManager::Size(HeapId heap_id, const void* alloc) {
 void BlockHeapManager::Lock(HeapId heap_id) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapId(heap_id, false));
-  GetHeapFromId(heap_id)->Lock();
+  HeapInterface* heap = GetHeapFromId(heap_id);
+  LockProfiler::Acquire(kHeapLockSite, heap);
 }
 
 void BlockHeapManager::Unlock(HeapId heap_id) {
@@ -396,7 +464,7 @@ void BlockHeapManager::Unlock(HeapId heap_id) {
 void BlockHeapManager::BestEffortLockAll() {
   DCHECK(initialized_);
   static const base::TimeDelta kTryTime(base::TimeDelta::FromMilliseconds(50));
-  lock_.Acquire();
+  LockProfiler::Acquire(kHeapManagerLockSite, &lock_);
 
   // Create room to store the list of locked heaps. This must use the internal
   // heap as any other heap may be involved in a crash and locked right now.
@@ -432,7 +500,7 @@ void BlockHeapManager::UnlockAll() {
 void BlockHeapManager::set_parameters(
     const ::common::AsanParameters& parameters) {
   {
-    base::AutoLock lock(lock_);
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
     parameters_ = parameters;
   }
 
@@ -442,7 +510,13 @@ void BlockHeapManager::set_parameters(
 }
 
 void BlockHeapManager::TearDownHeapManager() {
-  base::AutoLock lock(lock_);
+  ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
+
+  // Return the cached allocations to the process heap before it is destroyed.
+  // The cache is detached first so that blocks freed while flushing the
+  // quarantines below go straight back to their heap.
+  std::unique_ptr<MagazineCache> magazine_cache(std::move(magazine_cache_));
+  magazine_cache.reset();
 
   // This would indicate that we have outstanding heap locks being
   // held. This shouldn't happen as |locked_heaps_| is only non-null
@@ -455,6 +529,7 @@ void BlockHeapManager::TearDownHeapManager() {
   for (; iter_heaps != heaps_.end(); ++iter_heaps) {
     DCHECK(!iter_heaps->second.is_dying);
     iter_heaps->second.is_dying = true;
+    iter_heaps->second.cookie = 0;
     DestroyHeapContents(iter_heaps->first, iter_heaps->second.quarantine);
     DestroyHeapResourcesUnlocked(iter_heaps->first,
                                  iter_heaps->second.quarantine);
@@ -469,6 +544,7 @@ void BlockHeapManager::TearDownHeapManager() {
   zebra_block_heap_ = nullptr;
   zebra_block_heap_id_ = 0;
   large_block_heap_id_ = 0;
+  size_class_block_heap_id_ = 0;
 
   // Free the allocation-filter flag (TLS).
   if (allocation_filter_flag_tls_ != TLS_OUT_OF_INDEXES) {
@@ -488,12 +564,27 @@ HeapId BlockHeapManager::GetHeapId(
   return GetHeapId(insert_result.first);
 }
 
+HeapId BlockHeapManager::AddHeapUnlocked(
+    BlockHeapInterface* heap, BlockQuarantineInterface* quarantine) {
+  HeapMetadata metadata = { quarantine, false, 0 };
+  auto result = heaps_.insert(std::make_pair(heap, metadata));
+  DCHECK(result.second);
+  result.first->second.cookie = GetHeapCookie(&(*result.first));
+  return GetHeapId(result);
+}
+
+uintptr_t BlockHeapManager::GetHeapCookie(const HeapQuarantinePair* hq) {
+  return reinterpret_cast<uintptr_t>(hq) ^ kHeapCookieMagic;
+}
+
 bool BlockHeapManager::IsValidHeapIdUnsafe(HeapId heap_id, bool allow_dying) {
   DCHECK(initialized_);
   HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
   if (!IsValidHeapIdUnsafeUnlockedImpl1(hq))
     return false;
-  base::AutoLock auto_lock(lock_);
+  if (HeapCookieIsValidUnsafe(hq, allow_dying))
+    return true;
+  ProfiledAutoLock auto_lock(kHeapManagerLockSite, &lock_);
   if (!IsValidHeapIdUnlockedImpl2(hq, allow_dying))
     return false;
   return true;
@@ -515,7 +606,9 @@ bool BlockHeapManager::IsValidHeapId(HeapId heap_id, bool allow_dying) {
   HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
   if (!IsValidHeapIdUnlockedImpl1(hq))
     return false;
-  base::AutoLock auto_lock(lock_);
+  if (HeapCookieIsValid(hq, allow_dying))
+    return true;
+  ProfiledAutoLock auto_lock(kHeapManagerLockSite, &lock_);
   if (!IsValidHeapIdUnlockedImpl2(hq, allow_dying))
     return false;
   return true;
@@ -568,6 +661,23 @@ bool BlockHeapManager::IsValidHeapIdUnlockedImpl2(HeapQuarantinePair* hq,
   return false;
 }
 
+bool BlockHeapManager::HeapCookieIsValidUnsafe(HeapQuarantinePair* hq,
+                                               bool allow_dying) {
+  if (hq->second.cookie != GetHeapCookie(hq))
+    return false;
+  return !hq->second.is_dying || allow_dying;
+}
+
+bool BlockHeapManager::HeapCookieIsValid(HeapQuarantinePair* hq,
+                                         bool allow_dying) {
+  // The cookie could be on an inaccessible page, past the start of the entry.
+  __try {
+    return HeapCookieIsValidUnsafe(hq, allow_dying);
+  } __except(EXCEPTION_EXECUTE_HANDLER) {
+    return false;
+  }
+}
+
 BlockHeapInterface* BlockHeapManager::GetHeapFromId(HeapId heap_id) {
   DCHECK_NE(reinterpret_cast<HeapId>(nullptr), heap_id);
   HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
@@ -598,16 +708,15 @@ void BlockHeapManager::PropagateParameters() {
 
   if (parameters_.enable_zebra_block_heap && zebra_block_heap_ == nullptr) {
     // Initialize the zebra heap only if it isn't already initialized.
-    // The zebra heap cannot be resized once created.
-    base::AutoLock lock(lock_);
-    zebra_block_heap_ = new ZebraBlockHeap(parameters_.zebra_block_heap_size,
-                                           memory_notifier_,
-                                           internal_heap_.get());
+    // The size limits of the zebra heap cannot be changed once created.
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
+    zebra_block_heap_ = new ZebraBlockHeap(
+        parameters_.zebra_block_heap_size,
+        parameters_.zebra_block_heap_max_size, memory_notifier_,
+        internal_heap_.get());
     // The zebra block heap is its own quarantine.
-    HeapMetadata heap_metadata = { zebra_block_heap_, false };
-    auto result = heaps_.insert(std::make_pair(zebra_block_heap_,
-                                               heap_metadata));
-    zebra_block_heap_id_ = GetHeapId(result);
+    zebra_block_heap_id_ =
+        AddHeapUnlocked(zebra_block_heap_, zebra_block_heap_);
   }
 
   if (zebra_block_heap_ != nullptr) {
@@ -619,12 +728,43 @@ void BlockHeapManager::PropagateParameters() {
 
   // Create the LargeBlockHeap if need be.
   if (parameters_.enable_large_block_heap && large_block_heap_id_ == 0) {
-    base::AutoLock lock(lock_);
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
     BlockHeapInterface* heap = new LargeBlockHeap(
         memory_notifier_, internal_heap_.get());
-    HeapMetadata metadata = { &shared_quarantine_, false };
-    auto result = heaps_.insert(std::make_pair(heap, metadata));
-    large_block_heap_id_ = GetHeapId(result);
+    large_block_heap_id_ = AddHeapUnlocked(heap, &shared_quarantine_);
+  }
+
+  if (large_block_heap_id_ != 0) {
+    LargeBlockHeap* heap = static_cast<LargeBlockHeap*>(
+        GetHeapFromId(large_block_heap_id_));
+    heap->SetCacheBudget(parameters_.large_block_heap_cache_size);
+  }
+
+  // Create the SizeClassBlockHeap if need be.
+  if (parameters_.enable_size_class_block_heap &&
+      size_class_block_heap_id_ == 0) {
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
+    BlockHeapInterface* heap = new SizeClassBlockHeap(
+        memory_notifier_, internal_heap_.get());
+    size_class_block_heap_id_ = AddHeapUnlocked(heap, &shared_quarantine_);
+  }
+
+  // Create the table of the allocation sites if the allocation stacks are
+  // sampled or the guard rate is adaptive. It is never released, as it is
+  // accessed without any lock.
+  if ((parameters_.allocation_stack_sampling_period > 0 ||
+       parameters_.enable_adaptive_guard_rate) &&
+      allocation_sites_.get() == nullptr) {
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
+    allocation_sites_.reset(new AllocationSite[kAllocationSiteCount]());
+  }
+
+  // Create the magazine cache if it was enabled after initialization. When
+  // initializing this is taken care of by Init, as the process heap doesn't
+  // exist yet.
+  if (initialized_) {
+    ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
+    InitMagazineCacheIfNecessary();
   }
 
   // TODO(chrisha|sebmarchand): Clean up existing blocks that exceed the
@@ -651,19 +791,22 @@ void BlockHeapManager::EnableDeferredFreeThread() {
 void BlockHeapManager::DisableDeferredFreeThread() {
   DCHECK(IsDeferredFreeThreadRunning());
 
-  // Reset |deferred_free_thread_| which disables the features. This is done
-  // before stopping the feature as to avoid locking |deferred_free_thread_old|
-  // while joining the thread, which can lead to a deadlock. The old value is
-  // preserved as it is needed to stop the thread.
-  std::unique_ptr<DeferredFreeThread> deferred_free_thread_old;
+  // Reset |deferred_free_threads_| which disables the features. This is done
+  // before stopping the feature as to avoid locking |deferred_free_threads_old|
+  // while joining the threads, which can lead to a deadlock. The old value is
+  // preserved as it is needed to stop the threads.
+  std::unique_ptr<DeferredFreeThreadPool> deferred_free_threads_old;
   {
     base::AutoLock lock(deferred_free_thread_lock_);
-    deferred_free_thread_old.swap(deferred_free_thread_);
+    deferred_free_threads_old.swap(deferred_free_threads_);
   }
 
-  // Stop the thread and wait for it to exit.
-  if (deferred_free_thread_old)
-    deferred_free_thread_old->Stop();
+  // Stop the threads and wait for them to exit.
+  if (deferred_free_threads_old)
+    deferred_free_threads_old->Stop();
+
+  // Complete the flood-fills left behind by the threads.
+  ProcessPendingFloodFills();
 
   // Set the overbudget size to 0 to remove the hysteresis.
   shared_quarantine_.SetOverbudgetSize(0);
@@ -671,7 +814,46 @@ void BlockHeapManager::DisableDeferredFreeThread() {
 
 bool BlockHeapManager::IsDeferredFreeThreadRunning() {
   base::AutoLock lock(deferred_free_thread_lock_);
-  return deferred_free_thread_ != nullptr;
+  return deferred_free_threads_ != nullptr;
+}
+
+void BlockHeapManager::GetStatistics(Statistics* statistics) {
+  DCHECK_NE(static_cast<Statistics*>(nullptr), statistics);
+
+  for (size_t i = 0; i < kHeapTypeMax; ++i) {
+    statistics->live_blocks[i] = std::max<LONG>(
+        0, ::InterlockedCompareExchange(&live_blocks_[i], 0, 0));
+    statistics->live_bytes[i] = std::max<LONGLONG>(
+        0, ::InterlockedCompareExchange64(&live_bytes_[i], 0, 0));
+  }
+
+  size_t quarantine_size = 0;
+  size_t quarantine_count = 0;
+  shared_quarantine_.GetSizeAndCount(&quarantine_size, &quarantine_count);
+  statistics->quarantine_size = quarantine_size;
+  statistics->quarantine_count = quarantine_count;
+  statistics->quarantine_color =
+      shared_quarantine_.GetQuarantineColor(quarantine_size);
+
+  // The deferred free threads trim the quarantine back to GREEN.
+  statistics->deferred_free_thread_count = 0;
+  statistics->deferred_free_backlog = 0;
+  if (IsDeferredFreeThreadRunning()) {
+    statistics->deferred_free_thread_count = deferred_free_thread_count_;
+    size_t green_size =
+        shared_quarantine_.GetMaxSizeForColor(TrimColor::GREEN);
+    if (quarantine_size > green_size)
+      statistics->deferred_free_backlog = quarantine_size - green_size;
+  }
+}
+
+bool BlockHeapManager::GetMagazineCacheStatistics(
+    MagazineCache::Statistics* statistics) {
+  DCHECK_NE(static_cast<MagazineCache::Statistics*>(nullptr), statistics);
+  if (magazine_cache_.get() == nullptr)
+    return false;
+  magazine_cache_->GetStatistics(statistics);
+  return true;
 }
 
 HeapType BlockHeapManager::GetHeapTypeUnlocked(HeapId heap_id) {
@@ -722,14 +904,14 @@ bool BlockHeapManager::DestroyHeapContents(
     BlockInfo expanded = {};
     ConvertBlockInfo(iter_block, &expanded);
 
-    BlockQuarantineInterface::AutoQuarantineLock quarantine_lock(quarantine,
-                                                                 iter_block);
-    if (quarantine->Push(iter_block).push_successful) {
-      if (enable_page_protections_) {
-        // Restore protection to quarantined block.
-        BlockProtectAll(expanded, shadow_);
-      }
-    } else {
+    // Restore protection to the block before it is back in the quarantine,
+    // see the comment in Free.
+    if (enable_page_protections_)
+      BlockProtectAll(expanded, shadow_);
+    if (iter_block.is_body_decommitted)
+      BlockDecommitBody(expanded);
+
+    if (!quarantine->Push(iter_block).push_successful) {
       // Avoid memory leak.
       FreeBlock(iter_block);
     }
@@ -805,6 +987,11 @@ bool BlockHeapManager::FreePotentiallyCorruptBlock(BlockInfo* block_info) {
   if (enable_page_protections_)
     BlockProtectNone(*block_info, shadow_);
 
+  // A block evicted before the deferred free threads got to flood-fill it is
+  // still a plain quarantined block, and is validated as such.
+  if (parameters_.quarantine_flood_fill_rate > 0.0)
+    CancelPendingFloodFill(block_info->header);
+
   if (block_info->header->magic != kBlockHeaderMagic ||
       !BlockChecksumIsValid(*block_info) ||
       !BlockBodyIsValid(*block_info)) {
@@ -857,6 +1044,7 @@ bool BlockHeapManager::FreePristineBlock(BlockInfo* block_info) {
   }
 
   block_info->header->state = FREED_BLOCK;
+  UpdateLiveBlockStatistics(heap, block_info->block_size, false);
 
   if ((heap->GetHeapFeatures() &
        HeapInterface::kHeapReportsReservations) != 0) {
@@ -866,6 +1054,18 @@ bool BlockHeapManager::FreePristineBlock(BlockInfo* block_info) {
   } else {
     shadow_->Unpoison(block_info->header, block_info->block_size);
   }
+
+  // Process heap blocks that exactly fill a size class are handed to the
+  // magazine cache rather than being returned to the heap.
+  if (heap == process_heap_ && magazine_cache_.get() != nullptr) {
+    size_t size_class = 0;
+    if (MagazineCache::GetSizeClass(block_info->block_size, &size_class) &&
+        MagazineCache::GetSizeClassBlockSize(size_class) ==
+            block_info->block_size) {
+      return magazine_cache_->Free(size_class, block_info->header);
+    }
+  }
+
   return heap->FreeBlock(*block_info);
 }
 
@@ -947,9 +1147,52 @@ void BlockHeapManager::InitProcessHeap() {
   process_heap_ = new heaps::SimpleBlockHeap(process_heap_underlying_heap_);
   underlying_heaps_map_.insert(std::make_pair(process_heap_,
                                               process_heap_underlying_heap_));
-  HeapMetadata heap_metadata = { &shared_quarantine_, false };
-  auto result = heaps_.insert(std::make_pair(process_heap_, heap_metadata));
-  process_heap_id_ = GetHeapId(result);
+  process_heap_id_ = AddHeapUnlocked(process_heap_, &shared_quarantine_);
+}
+
+void BlockHeapManager::InitMagazineCacheIfNecessary() {
+  if (!parameters_.enable_thread_local_magazines)
+    return;
+  if (magazine_cache_.get() != nullptr)
+    return;
+  DCHECK_NE(static_cast<BlockHeapInterface*>(nullptr), process_heap_);
+  magazine_cache_.reset(
+      new MagazineCache(process_heap_, internal_heap_.get()));
+}
+
+void* BlockHeapManager::AllocateFromMagazineCache(uint32_t bytes,
+                                                  BlockLayout* layout) {
+  DCHECK_NE(static_cast<MagazineCache*>(nullptr), magazine_cache_.get());
+  DCHECK_NE(static_cast<BlockLayout*>(nullptr), layout);
+
+  // Plan the layout exactly as SimpleBlockHeap::AllocateBlock would.
+  uint32_t min_right_redzone_size = GetMinRightRedzoneSize(bytes);
+  if (!BlockPlanLayout(kShadowRatio, kShadowRatio, bytes, 0,
+                       min_right_redzone_size, layout)) {
+    return nullptr;
+  }
+
+  size_t size_class = 0;
+  if (!MagazineCache::GetSizeClass(layout->block_size, &size_class))
+    return nullptr;
+
+  // Grow the right redzone so that the block exactly fills the size class.
+  // Both sizes are multiples of kShadowRatio so this is exact.
+  uint32_t class_block_size = MagazineCache::GetSizeClassBlockSize(size_class);
+  min_right_redzone_size += class_block_size - layout->block_size;
+  if (!BlockPlanLayout(kShadowRatio, kShadowRatio, bytes, 0,
+                       min_right_redzone_size, layout)) {
+    return nullptr;
+  }
+  DCHECK_EQ(class_block_size, layout->block_size);
+
+  return magazine_cache_->Allocate(size_class);
+}
+
+uint32_t BlockHeapManager::GetMinRightRedzoneSize(uint32_t bytes) const {
+  if (parameters_.enable_adaptive_redzones)
+    return GetAdaptiveRedzoneSize(bytes);
+  return parameters_.trailer_padding_size + sizeof(BlockTrailer);
 }
 
 bool BlockHeapManager::MayUseLargeBlockHeap(size_t bytes) const {
@@ -967,6 +1210,16 @@ bool BlockHeapManager::MayUseLargeBlockHeap(size_t bytes) const {
   return false;
 }
 
+bool BlockHeapManager::MayUseSizeClassBlockHeap(size_t bytes) const {
+  DCHECK(initialized_);
+  if (!parameters_.enable_size_class_block_heap)
+    return false;
+
+  // The redzones have to fit in the slot as well, but the heap simply fails
+  // the allocations that end up too big, in which case the next heap is used.
+  return bytes <= SizeClassBlockHeap::kMaxAllocationSize;
+}
+
 bool BlockHeapManager::MayUseZebraBlockHeap(size_t bytes) const {
   DCHECK(initialized_);
   if (!parameters_.enable_zebra_block_heap)
@@ -1025,49 +1278,257 @@ void BlockHeapManager::TrimOrScheduleIfNecessary(
     return;
   }
 
-  // Signal the deferred thread to wake up and/or trim synchronously, as needed.
-  if (trim_status & TrimStatusBits::ASYNC_TRIM_REQUIRED)
-    DeferredFreeThreadSignalWork();
+  // Signal the deferred threads to wake up and/or trim synchronously, as
+  // needed. Synchronous trimming is only requested in the BLACK zone, so the
+  // status tells how urgent the asynchronous trimming is.
+  if (trim_status & TrimStatusBits::ASYNC_TRIM_REQUIRED) {
+    DeferredFreeThreadSignalWork(
+        (trim_status & TrimStatusBits::SYNC_TRIM_REQUIRED) ? TrimColor::BLACK
+                                                           : TrimColor::RED);
+  }
   if (trim_status & TrimStatusBits::SYNC_TRIM_REQUIRED)
     TrimQuarantine(TrimColor::YELLOW, quarantine);
 }
 
-void BlockHeapManager::DeferredFreeThreadSignalWork() {
+void BlockHeapManager::DeferredFreeThreadSignalWork(TrimColor trim_color) {
   DCHECK(IsDeferredFreeThreadRunning());
   base::AutoLock lock(deferred_free_thread_lock_);
-  deferred_free_thread_->SignalWork();
+  deferred_free_threads_->SignalWork(trim_color);
 }
 
-void BlockHeapManager::DeferredFreeDoWork() {
-  DCHECK_EQ(GetDeferredFreeThreadId(), base::PlatformThread::CurrentId());
+void BlockHeapManager::DeferredFreeDoWork(size_t thread_index) {
+  DCHECK_EQ(GetDeferredFreeThreadId(thread_index),
+            base::PlatformThread::CurrentId());
+  DCHECK_LT(thread_index, deferred_free_thread_count_);
+
+  ProcessPendingFloodFills();
+
   // As of now, only the shared quarantine gets trimmed asynchronously. This
   // will bring it back in the GREEN color.
-  BlockQuarantineInterface* shared_quarantine = &shared_quarantine_;
-  TrimQuarantine(TrimColor::GREEN, shared_quarantine);
+  if (parameters_.quarantine_size == 0 || deferred_free_thread_count_ == 1) {
+    BlockQuarantineInterface* shared_quarantine = &shared_quarantine_;
+    TrimQuarantine(TrimColor::GREEN, shared_quarantine);
+    return;
+  }
+
+  // Start with the shards owned by this thread, which no other deferred free
+  // thread pops from. Fall back to all of the shards once they run dry.
+  bool own_shards = true;
+  CompactBlockInfo compact = {};
+  while (true) {
+    PopResult result =
+        own_shards ? shared_quarantine_.PopFromShards(
+                         thread_index, deferred_free_thread_count_, &compact)
+                   : shared_quarantine_.Pop(&compact);
+    if (!result.pop_successful) {
+      if (!own_shards)
+        break;
+      own_shards = false;
+      continue;
+    }
+    FreeBlock(compact);
+    if (result.trim_color <= TrimColor::GREEN)
+      break;
+  }
+}
+
+void BlockHeapManager::SchedulePendingFloodFill(
+    const CompactBlockInfo& compact) {
+  bool was_empty = false;
+  {
+    base::AutoLock lock(pending_flood_fill_lock_);
+    was_empty = pending_flood_fills_.empty();
+    pending_flood_fills_.push_back(compact);
+    pending_flood_fill_blocks_[compact.header] = false;
+  }
+
+  // The threads drain the whole queue once woken up, so they only need to be
+  // signaled for the first pending fill.
+  if (was_empty)
+    DeferredFreeThreadSignalWork(TrimColor::RED);
+}
+
+void BlockHeapManager::ProcessPendingFloodFills() {
+  while (true) {
+    CompactBlockInfo compact = {};
+    {
+      base::AutoLock lock(pending_flood_fill_lock_);
+      if (pending_flood_fills_.empty())
+        return;
+      compact = pending_flood_fills_.front();
+      pending_flood_fills_.pop_front();
+
+      // Skip the blocks that have already been evicted from the quarantine.
+      auto it = pending_flood_fill_blocks_.find(compact.header);
+      if (it == pending_flood_fill_blocks_.end())
+        continue;
+      it->second = true;
+    }
+
+    // A block that has been written to since it was freed keeps its state so
+    // that the use-after-free gets reported when it is evicted.
+    BlockInfo block_info = {};
+    ConvertBlockInfo(compact, &block_info);
+    if (BlockChecksumIsValid(block_info)) {
+      block_info.header->state = QUARANTINED_FLOODED_BLOCK;
+      BlockFloodFillBody(block_info);
+      BlockSetChecksum(block_info);
+    }
+
+    base::AutoLock lock(pending_flood_fill_lock_);
+    pending_flood_fill_blocks_.erase(compact.header);
+  }
+}
+
+void BlockHeapManager::CancelPendingFloodFill(const BlockHeader* header) {
+  while (true) {
+    {
+      base::AutoLock lock(pending_flood_fill_lock_);
+      auto it = pending_flood_fill_blocks_.find(header);
+      if (it == pending_flood_fill_blocks_.end())
+        return;
+      if (!it->second) {
+        pending_flood_fill_blocks_.erase(it);
+        return;
+      }
+    }
+    // The fill is in progress, wait for it to complete.
+    base::PlatformThread::YieldCurrentThread();
+  }
 }
 
-base::PlatformThreadId BlockHeapManager::GetDeferredFreeThreadId() {
+base::PlatformThreadId BlockHeapManager::GetDeferredFreeThreadId(
+    size_t thread_index) {
   DCHECK(IsDeferredFreeThreadRunning());
   base::AutoLock lock(deferred_free_thread_lock_);
-  return deferred_free_thread_->deferred_free_thread_id();
+  return deferred_free_threads_->deferred_free_thread_id(thread_index);
 }
 
 void BlockHeapManager::EnableDeferredFreeThreadWithCallback(
-    DeferredFreeThread::Callback deferred_free_callback) {
+    DeferredFreeThreadPool::Callback deferred_free_callback) {
   DCHECK(!IsDeferredFreeThreadRunning());
 
   shared_quarantine_.SetOverbudgetSize(
       shared_quarantine_.max_quarantine_size() * kOverbudgetSizePercentage /
       100);
 
-  // Create the thread and wait for it to start.
+  // There's no use in having more threads than quarantine shards.
+  size_t thread_count = parameters_.deferred_free_thread_count;
+  if (thread_count < 1)
+    thread_count = 1;
+  if (thread_count > ShardedBlockQuarantine::kShardingFactor)
+    thread_count = ShardedBlockQuarantine::kShardingFactor;
+
+  // Create the threads and wait for them to start. If this fails then the
+  // quarantine keeps being trimmed synchronously.
   base::AutoLock lock(deferred_free_thread_lock_);
-  deferred_free_thread_.reset(new DeferredFreeThread(deferred_free_callback));
-  deferred_free_thread_->Start();
+  deferred_free_thread_count_ = thread_count;
+  deferred_free_threads_.reset(
+      new DeferredFreeThreadPool(thread_count, deferred_free_callback));
+  if (!deferred_free_threads_->Start()) {
+    deferred_free_threads_.reset();
+    shared_quarantine_.SetOverbudgetSize(0);
+  }
+}
+
+bool BlockHeapManager::ShouldCaptureFullAllocationStack(
+    const common::StackCapture& fingerprint) {
+  DCHECK(fingerprint.fingerprint());
+  DCHECK_NE(static_cast<AllocationSite*>(nullptr), allocation_sites_.get());
+
+  uint32_t period = parameters_.allocation_stack_sampling_period;
+  common::StackCapture::StackId id = fingerprint.absolute_stack_id();
+  AllocationSite* site = &allocation_sites_[id % kAllocationSiteCount];
+
+  // A call site missing from the table hasn't been seen recently.
+  if (site->fingerprint_id != id) {
+    site->fingerprint_id = id;
+    site->countdown = period;
+    return true;
+  }
+
+  uint32_t countdown = site->countdown;
+  if (countdown > 1) {
+    site->countdown = countdown - 1;
+    return false;
+  }
+  site->countdown = period;
+  return true;
+}
+
+bool BlockHeapManager::ShouldGuardAllocation(
+    common::StackCapture::StackId fingerprint_id) {
+  DCHECK_NE(static_cast<AllocationSite*>(nullptr), allocation_sites_.get());
+
+  AllocationSite* site =
+      &allocation_sites_[fingerprint_id % kAllocationSiteCount];
+  uint32_t epoch = static_cast<uint32_t>(adaptive_guard_epoch_);
+
+  // A call site missing from the table hasn't been seen recently. Its stack
+  // is then captured in full, see ShouldCaptureFullAllocationStack.
+  if (site->fingerprint_id != fingerprint_id) {
+    site->fingerprint_id = fingerprint_id;
+    site->countdown = 0;
+    site->epoch = epoch;
+    site->allocations = 0;
+  } else if (site->epoch != epoch) {
+    site->epoch = epoch;
+    site->allocations = 0;
+  }
+  uint32_t allocations = ++site->allocations;
+
+  uint32_t budget = static_cast<uint32_t>(adaptive_guard_site_budget_);
+  bool guard = allocations <= budget ||
+               base::RandDouble() * allocations < budget;
+  if (guard)
+    ::InterlockedIncrement(&adaptive_guard_guarded_);
+  if (::InterlockedIncrement(&adaptive_guard_allocations_) ==
+      kAdaptiveGuardEpochLength) {
+    EndAdaptiveGuardEpoch();
+  }
+  return guard;
+}
+
+void BlockHeapManager::EndAdaptiveGuardEpoch() {
+  LONG guarded = ::InterlockedExchange(&adaptive_guard_guarded_, 0);
+  double target = parameters_.allocation_guard_rate * kAdaptiveGuardEpochLength;
+
+  // The number of guarded allocations grows slower than the budget, so it's
+  // scaled by at most a factor of two per epoch to converge without
+  // oscillating.
+  double scale = target / std::max<LONG>(guarded, 1);
+  scale = std::min(std::max(scale, 0.5), 2.0);
+  double budget = adaptive_guard_site_budget_ * scale;
+  budget = std::min<double>(std::max(budget, 1.0),
+                            kAdaptiveGuardMaxSiteBudget);
+  ::InterlockedExchange(&adaptive_guard_site_budget_,
+                        static_cast<LONG>(budget));
+
+  ::InterlockedExchange(&adaptive_guard_allocations_, 0);
+  ::InterlockedIncrement(&adaptive_guard_epoch_);
+}
+
+void BlockHeapManager::UpdateLiveBlockStatistics(BlockHeapInterface* heap,
+                                                 uint32_t block_size,
+                                                 bool allocated) {
+  DCHECK_NE(static_cast<BlockHeapInterface*>(nullptr), heap);
+  if (parameters_.statistics_section_period == 0)
+    return;
+
+  HeapType heap_type = heap->GetHeapType();
+  DCHECK_LT(heap_type, kHeapTypeMax);
+  if (allocated) {
+    ::InterlockedIncrement(&live_blocks_[heap_type]);
+    ::InterlockedExchangeAdd64(&live_bytes_[heap_type], block_size);
+  } else {
+    ::InterlockedDecrement(&live_blocks_[heap_type]);
+    ::InterlockedExchangeAdd64(&live_bytes_[heap_type],
+                               -static_cast<LONGLONG>(block_size));
+  }
 }
 
 HeapId BlockHeapManager::GetCorruptBlockHeapId(const BlockInfo* block_info) {
-  base::AutoLock lock(lock_);
+  ProfiledAutoLock lock(kHeapManagerLockSite, &lock_);
 
   // Check the heap specified in the trailer first.
   bool trailer_has_valid_heap_id = false;
@@ -19,6 +19,7 @@
 
 #include <windows.h>
 
+#include <deque>
 #include <memory>
 #include <unordered_map>
 #include <utility>
@@ -31,7 +32,8 @@
 #include "syzygy/agent/asan/quarantine.h"
 #include "syzygy/agent/asan/registry_cache.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
-#include "syzygy/agent/asan/heap_managers/deferred_free_thread.h"
+#include "syzygy/agent/asan/heap_managers/deferred_free_thread_pool.h"
+#include "syzygy/agent/asan/heap_managers/magazine_cache.h"
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
 #include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
 #include "syzygy/agent/common/stack_capture.h"
@@ -127,9 +129,10 @@ class BlockHeapManager : public HeapManagerInterface {
   //     share the same flag.
   void set_allocation_filter_flag(bool value);
 
-  // Enables the deferred free thread mechanism. Must not be called if the
-  // thread is already running. Typical usage is to enable the thread at startup
-  // and disable it at shutdown.
+  // Enables the deferred free thread mechanism. This starts a pool of
+  // |deferred_free_thread_count| threads, as configured in the parameters.
+  // Must not be called if the thread is already running. Typical usage is to
+  // enable the thread at startup and disable it at shutdown.
   void EnableDeferredFreeThread();
 
   // Disables the deferred free thread mechanism. Must be called before the
@@ -140,6 +143,35 @@ class BlockHeapManager : public HeapManagerInterface {
   // @returns true if the deferred thread is currently running.
   bool IsDeferredFreeThreadRunning();
 
+  // Statistics about the state of the heap manager.
+  struct Statistics {
+    // The number of live blocks and their total size, per heap type. These
+    // are only tracked while the runtime statistics are published, see
+    // AsanParameters::statistics_section_period.
+    uint64_t live_blocks[kHeapTypeMax];
+    uint64_t live_bytes[kHeapTypeMax];
+    // The size and the number of blocks of the shared quarantine.
+    uint64_t quarantine_size;
+    uint64_t quarantine_count;
+    // The color of the shared quarantine.
+    TrimColor quarantine_color;
+    // The number of deferred free threads, and the number of bytes they have
+    // left to trim from the shared quarantine.
+    uint64_t deferred_free_thread_count;
+    uint64_t deferred_free_backlog;
+  };
+
+  // Gets the statistics of the heap manager. This is thread-safe, but the
+  // fields are gathered individually so they may be slightly inconsistent
+  // with each other.
+  // @param statistics Will receive the statistics.
+  void GetStatistics(Statistics* statistics);
+
+  // Gets the statistics of the thread-local magazine cache.
+  // @param statistics Will receive the statistics.
+  // @returns true if the magazine cache is in use, false otherwise.
+  bool GetMagazineCacheStatistics(MagazineCache::Statistics* statistics);
+
  protected:
   // This allows the runtime access to our internals, necessary for crash
   // processing.
@@ -164,10 +196,13 @@ class BlockHeapManager : public HeapManagerInterface {
 
   // A map associating a block heap with a pair containing the quarantine it
   // will use and a bit indicating if it's dying. Many heaps may share a single
-  // quarantine.
+  // quarantine. The cookie is derived from the address of the heap's entry in
+  // the map, which is its ID, so that a heap ID can be validated without
+  // taking the lock. It's cleared before the entry is erased.
   struct HeapMetadata {
     BlockQuarantineInterface* quarantine;
     bool is_dying;
+    uintptr_t cookie;
   };
   using HeapQuarantineMap =
       std::unordered_map<BlockHeapInterface*, HeapMetadata>;
@@ -192,6 +227,18 @@ class BlockHeapManager : public HeapManagerInterface {
   HeapId GetHeapId(
       const std::pair<HeapQuarantineMap::iterator, bool>& insert_result) const;
 
+  // Adds a heap to heaps_, and sets its cookie.
+  // @param heap The heap to add.
+  // @param quarantine The quarantine used by @p heap.
+  // @returns the ID of the heap.
+  // @note lock_ must be held.
+  HeapId AddHeapUnlocked(BlockHeapInterface* heap,
+                         BlockQuarantineInterface* quarantine);
+
+  // @param hq The heap quarantine pair of a heap.
+  // @returns the cookie of the heap.
+  static uintptr_t GetHeapCookie(const HeapQuarantinePair* hq);
+
   // @name Heap validation. There are multiple ways to do this because of the
   //     need to do this during crash processing, when locks are already
   //     implicitly acquired. As such, the runtime has been made a friend of
@@ -215,6 +262,16 @@ class BlockHeapManager : public HeapManagerInterface {
   bool IsValidHeapIdUnsafeUnlockedImpl1(HeapQuarantinePair* hq);
   bool IsValidHeapIdUnlockedImpl1(HeapQuarantinePair* hq);
   bool IsValidHeapIdUnlockedImpl2(HeapQuarantinePair* hq, bool allow_dying);
+
+  // The lock-free fast path of the validation of a heap ID, which checks the
+  // cookie of the heap. A heap without a matching cookie is looked up in
+  // heaps_ under the lock, so that a wild ID is still rejected.
+  // @param hq The heap quarantine pair being queried.
+  // @param allow_dying If true then also consider heaps that are in the
+  //     process of dying. Otherwise, only consider live heaps.
+  // @returns true if @p hq is a heap with a valid cookie.
+  bool HeapCookieIsValidUnsafe(HeapQuarantinePair* hq, bool allow_dying);
+  bool HeapCookieIsValid(HeapQuarantinePair* hq, bool allow_dying);
   // @}
 
   // Given a heap ID, returns the underlying heap.
@@ -323,6 +380,19 @@ class BlockHeapManager : public HeapManagerInterface {
   //     false otherwise.
   bool MayUseLargeBlockHeap(size_t bytes) const;
 
+  // Gets the minimum size of the right redzone of an allocation, which
+  // depends on its size when the redzones are adaptive.
+  // @param bytes The allocation size.
+  // @returns the minimum right redzone size, including the trailer.
+  uint32_t GetMinRightRedzoneSize(uint32_t bytes) const;
+
+  // Determines if the size class block heap should be used for an allocation
+  // of the given size.
+  // @param bytes The allocation size.
+  // @returns true if the size class block heap should be used for this
+  //     allocation, false otherwise.
+  bool MayUseSizeClassBlockHeap(size_t bytes) const;
+
   // Determines if the zebra block heap should be used for an allocation of
   // the given size.
   // @param bytes The allocation size.
@@ -343,24 +413,94 @@ class BlockHeapManager : public HeapManagerInterface {
   void TrimOrScheduleIfNecessary(TrimStatus trim_status,
                                  BlockQuarantineInterface* quarantine);
 
-  // Used by TrimOrScheduleIfNecessary to signal the deferred free thread that
+  // Used by TrimOrScheduleIfNecessary to signal the deferred free threads that
   // the quarantine needs trimming (ie. asynchronous trimming).
-  void DeferredFreeThreadSignalWork();
-
-  // Invoked by the deferred free thread when it is signaled that the quarantine
-  // needs trimming.
-  void DeferredFreeDoWork();
+  // @param trim_color The color the quarantine has reached.
+  void DeferredFreeThreadSignalWork(TrimColor trim_color);
+
+  // Invoked by a deferred free thread when it is signaled that the quarantine
+  // needs trimming. Each thread first drains its own subset of the shards of
+  // the shared quarantine, then helps with the others if that wasn't enough.
+  // @param thread_index The index of the calling thread in the pool.
+  void DeferredFreeDoWork(size_t thread_index);
+
+  // Queues the flood-fill of a quarantined block for the deferred free
+  // threads. The block stays a plain QUARANTINED_BLOCK, whose checksum covers
+  // the body, until the fill happens. Must be called before the block is
+  // pushed into the quarantine.
+  // @param compact The block to be flood-filled.
+  void SchedulePendingFloodFill(const CompactBlockInfo& compact);
+
+  // Flood-fills all of the blocks queued by SchedulePendingFloodFill. Invoked
+  // by the deferred free threads, and when they are stopped.
+  void ProcessPendingFloodFills();
+
+  // Removes a block from the pending flood-fills before it is freed, waiting
+  // for its fill to complete if it is in progress.
+  // @param header The header of the block being freed.
+  void CancelPendingFloodFill(const BlockHeader* header);
 
   // Implementation of EnableDeferredFreeThread that takes the callback. Used
   // also by tests to override the callback.
   // @param deferred_free_callback The callback.
   void EnableDeferredFreeThreadWithCallback(
-      DeferredFreeThread::Callback deferred_free_callback);
+      DeferredFreeThreadPool::Callback deferred_free_callback);
 
-  // Returns the ID of the deferred free thread. Must not be called if the
-  // thread is not running.
+  // Returns the ID of a deferred free thread. Must not be called if the
+  // threads are not running.
+  // @param thread_index The index of the thread in the pool.
   // @returns the thread ID.
-  base::PlatformThreadId GetDeferredFreeThreadId();
+  base::PlatformThreadId GetDeferredFreeThreadId(size_t thread_index);
+
+  // Creates the magazine cache if it is enabled and not yet created. This must
+  // be called after InitProcessHeap.
+  void InitMagazineCacheIfNecessary();
+
+  // Tries to serve an allocation from the process heap via the magazine
+  // cache. The block is laid out so that it exactly fills its size class.
+  // @param bytes The size of the allocation.
+  // @param layout Will receive the layout of the block.
+  // @returns a pointer to the allocation, or nullptr if the allocation can't
+  //     be served by the magazine cache.
+  void* AllocateFromMagazineCache(uint32_t bytes, BlockLayout* layout);
+
+  // Decides if the full allocation stack should be captured for an allocation
+  // whose caller-address fingerprint is known. This captures the first
+  // allocation of the call sites that haven't been seen recently, and then one
+  // allocation per sampling period for each call site. This is racy, by
+  // design: the occasional lost update only changes which allocations are
+  // sampled.
+  // @param fingerprint The fingerprint of the stack of the allocation.
+  // @returns true if the full stack should be captured.
+  bool ShouldCaptureFullAllocationStack(
+      const common::StackCapture& fingerprint);
+
+  // Decides if an allocation should be guarded when the guard rate is
+  // adaptive. The first allocations of each call site in an epoch are all
+  // guarded, up to the per-site budget, and the following ones with a
+  // probability that drops with their number. The rarely allocating call
+  // sites are always guarded while the hottest ones mostly aren't. At the end
+  // of each epoch the budget is scaled so that the fraction of guarded
+  // allocations tends to allocation_guard_rate. This is racy in the same way
+  // as ShouldCaptureFullAllocationStack.
+  // @param fingerprint_id The absolute ID of the fingerprint of the stack of
+  //     the allocation.
+  // @returns true if the allocation should be guarded.
+  bool ShouldGuardAllocation(common::StackCapture::StackId fingerprint_id);
+
+  // Ends an epoch of the adaptive guard rate, and scales the per-site budget
+  // towards the target guard rate.
+  void EndAdaptiveGuardEpoch();
+
+  // Accounts for a block entering or leaving a heap in the live block
+  // statistics, if they are tracked.
+  // @param heap The heap owning the block.
+  // @param block_size The size of the block.
+  // @param allocated True if the block is being allocated, false if it is
+  //     being returned to the heap.
+  void UpdateLiveBlockStatistics(BlockHeapInterface* heap,
+                                 uint32_t block_size,
+                                 bool allocated);
 
   // Helper function for finding the heap ID associated with a corrupt block.
   // This is best effort, and can return 0 when no heap can be found with
@@ -423,9 +563,59 @@ class BlockHeapManager : public HeapManagerInterface {
   // The ID of the large block heap. Allows accessing it directly.
   HeapId large_block_heap_id_;
 
+  // The ID of the size class block heap. Allows accessing it directly.
+  HeapId size_class_block_heap_id_;
+
+  // The per-thread magazine cache that serves small allocations from the
+  // process heap. This is only created if enabled via the parameters.
+  std::unique_ptr<MagazineCache> magazine_cache_;
+
   // Stores the AllocationFilterFlag TLS slot.
   DWORD allocation_filter_flag_tls_;
 
+  // The number of slots in the table of the recently seen allocation sites.
+  static const size_t kAllocationSiteCount = 4096;
+
+  // Tracks the sampling of the allocation stacks and the guarding of the
+  // allocations of a call site.
+  struct AllocationSite {
+    // The absolute ID of the fingerprint of the call site.
+    common::StackCapture::StackId fingerprint_id;
+    // The number of allocations left before the next full stack capture.
+    uint32_t countdown;
+    // The adaptive guard epoch of |allocations|.
+    uint32_t epoch;
+    // The number of allocations of the call site during |epoch|.
+    uint32_t allocations;
+  };
+
+  // The direct-mapped table of the recently seen allocation sites, indexed by
+  // the fingerprint ID. This is only created if the allocation stacks are
+  // sampled or the guard rate is adaptive, and is accessed without any lock,
+  // see ShouldCaptureFullAllocationStack and ShouldGuardAllocation.
+  std::unique_ptr<AllocationSite[]> allocation_sites_;
+
+  // The number of allocations of an epoch of the adaptive guard rate.
+  static const uint32_t kAdaptiveGuardEpochLength = 64 * 1024;
+
+  // The bounds of the per-site budget of guarded allocations of an epoch.
+  static const uint32_t kAdaptiveGuardInitialSiteBudget = 64;
+  static const uint32_t kAdaptiveGuardMaxSiteBudget = kAdaptiveGuardEpochLength;
+
+  // The state of the adaptive guard rate: the current epoch, the numbers of
+  // allocations and of guarded allocations during it, and the per-site
+  // budget. These are updated with interlocked operations.
+  volatile LONG adaptive_guard_epoch_;
+  volatile LONG adaptive_guard_allocations_;
+  volatile LONG adaptive_guard_guarded_;
+  volatile LONG adaptive_guard_site_budget_;
+
+  // The number of live blocks and their total size, per heap type. These are
+  // updated with interlocked operations, and can transiently go negative if
+  // the tracking is enabled while there are live blocks.
+  volatile LONG live_blocks_[kHeapTypeMax];
+  volatile LONGLONG live_bytes_[kHeapTypeMax];
+
   // A list of all heaps whose locks were acquired by the last call to
   // BestEffortLockAll. This uses the internal heap, otherwise the default
   // allocator makes use of the process heap. The process heap may itself
@@ -443,11 +633,23 @@ class BlockHeapManager : public HeapManagerInterface {
   std::unique_ptr<RegistryCache> corrupt_block_registry_cache_;
 
  private:
-  // Background thread that takes care of trimming the quarantine
+  // Background threads that take care of trimming the quarantine
   // asynchronously.
   base::Lock deferred_free_thread_lock_;
   // Under deferred_free_thread_lock_.
-  std::unique_ptr<DeferredFreeThread> deferred_free_thread_;
+  std::unique_ptr<DeferredFreeThreadPool> deferred_free_threads_;
+  // The number of threads in |deferred_free_threads_|. This is set before the
+  // threads are started, and is read by them without a lock.
+  size_t deferred_free_thread_count_;
+
+  // The quarantined blocks waiting to be flood-filled by the deferred free
+  // threads, in the order in which they were freed.
+  base::Lock pending_flood_fill_lock_;
+  // Under pending_flood_fill_lock_.
+  std::deque<CompactBlockInfo> pending_flood_fills_;
+  // The headers of the blocks with a pending flood-fill, mapped to whether
+  // their fill is in progress. Under pending_flood_fill_lock_.
+  std::unordered_map<const BlockHeader*, bool> pending_flood_fill_blocks_;
 
   DISALLOW_COPY_AND_ASSIGN(BlockHeapManager);
 };
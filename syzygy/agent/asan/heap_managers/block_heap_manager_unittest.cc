@@ -38,6 +38,7 @@
 #include "syzygy/agent/asan/heaps/internal_heap.h"
 #include "syzygy/agent/asan/heaps/large_block_heap.h"
 #include "syzygy/agent/asan/heaps/simple_block_heap.h"
+#include "syzygy/agent/asan/heaps/size_class_block_heap.h"
 #include "syzygy/agent/asan/heaps/win_heap.h"
 #include "syzygy/agent/asan/heaps/zebra_block_heap.h"
 #include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
@@ -160,7 +161,7 @@ class TestZebraBlockHeap : public heaps::ZebraBlockHeap {
 
   // Constructor.
   explicit TestZebraBlockHeap(MemoryNotifierInterface* memory_notifier)
-      : ZebraBlockHeap(1024 * 1024, memory_notifier, &dummy_heap) {
+      : ZebraBlockHeap(1024 * 1024, 0, memory_notifier, &dummy_heap) {
     refuse_allocations_ = false;
     refuse_push_ = false;
   }
@@ -220,13 +221,21 @@ class TestBlockHeapManager : public BlockHeapManager {
   using BlockHeapManager::GetHeapFromId;
   using BlockHeapManager::GetHeapTypeUnlocked;
   using BlockHeapManager::GetQuarantineFromId;
+  using BlockHeapManager::HeapCookieIsValid;
   using BlockHeapManager::HeapMetadata;
   using BlockHeapManager::HeapQuarantineMap;
+  using BlockHeapManager::IsValidHeapId;
   using BlockHeapManager::IsValidHeapIdUnlocked;
   using BlockHeapManager::SetHeapErrorCallback;
   using BlockHeapManager::ShardedBlockQuarantine;
+  using BlockHeapManager::ShouldGuardAllocation;
   using BlockHeapManager::TrimQuarantine;
 
+  using BlockHeapManager::kAdaptiveGuardEpochLength;
+  using BlockHeapManager::kAdaptiveGuardInitialSiteBudget;
+
+  using BlockHeapManager::adaptive_guard_epoch_;
+  using BlockHeapManager::adaptive_guard_site_budget_;
   using BlockHeapManager::allocation_filter_flag_tls_;
   using BlockHeapManager::corrupt_block_registry_cache_;
   using BlockHeapManager::enable_page_protections_;
@@ -236,6 +245,7 @@ class TestBlockHeapManager : public BlockHeapManager {
   using BlockHeapManager::parameters_;
   using BlockHeapManager::shadow_;
   using BlockHeapManager::shared_quarantine_;
+  using BlockHeapManager::size_class_block_heap_id_;
   using BlockHeapManager::zebra_block_heap_;
   using BlockHeapManager::zebra_block_heap_id_;
 
@@ -283,9 +293,10 @@ class TestBlockHeapManager : public BlockHeapManager {
   // Wrapper around DeferredFreeDoWork that allows for synchronization around
   // the actual work (pause for start and signal finish).
   void DeferredFreeDoWorkWithSync(base::WaitableEvent* start_event,
-                                  base::WaitableEvent* end_event) {
+                                  base::WaitableEvent* end_event,
+                                  size_t thread_index) {
     start_event->Wait();
-    BlockHeapManager::DeferredFreeDoWork();
+    BlockHeapManager::DeferredFreeDoWork(thread_index);
     end_event->Signal();
   }
 
@@ -492,6 +503,13 @@ class BlockHeapManagerTest : public testing::TestWithAsanRuntime {
     CHECK_NE(0u, heap_manager_->large_block_heap_id_);
   }
 
+  void EnableSizeClassBlockHeap() {
+    ::common::AsanParameters params = heap_manager_->parameters();
+    params.enable_size_class_block_heap = true;
+    heap_manager_->set_parameters(params);
+    CHECK_NE(0u, heap_manager_->size_class_block_heap_id_);
+  }
+
   // Verifies that [alloc, alloc + size) is accessible, and that
   // [alloc - 1] and [alloc+size] are poisoned.
   void VerifyAllocAccess(void* alloc, uint32_t size) {
@@ -613,6 +631,44 @@ TEST_F(BlockHeapManagerTest, AllocAndFree) {
   EXPECT_TRUE(heap_manager_->DestroyHeap(heap_id));
 }
 
+TEST_F(BlockHeapManagerTest, AllocAndFreeWithMagazineCache) {
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.enable_thread_local_magazines = true;
+  params.quarantine_size = 0;
+  heap_manager_->set_parameters(params);
+
+  const uint32_t kAllocSize = 17;
+  HeapId heap_id = heap_manager_->process_heap();
+  void* alloc = heap_manager_->Allocate(heap_id, kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  EXPECT_EQ(kAllocSize, heap_manager_->Size(heap_id, alloc));
+  VerifyAllocAccess(alloc, kAllocSize);
+
+  // The block must exactly fill its size class and still be a valid block.
+  BlockInfo block_info = {};
+  EXPECT_TRUE(GetBlockInfo(runtime_->shadow(),
+                           reinterpret_cast<BlockBody*>(alloc), &block_info));
+  size_t size_class = 0;
+  EXPECT_TRUE(MagazineCache::GetSizeClass(block_info.block_size, &size_class));
+  EXPECT_EQ(MagazineCache::GetSizeClassBlockSize(size_class),
+            block_info.block_size);
+  EXPECT_TRUE(BlockChecksumIsValid(block_info));
+  EXPECT_EQ(heap_id, block_info.trailer->heap_id);
+
+  // With an empty quarantine the block goes straight back to the magazine, and
+  // the next allocation of the same size class reuses it.
+  EXPECT_TRUE(heap_manager_->Free(heap_id, alloc));
+  void* alloc2 = heap_manager_->Allocate(heap_id, kAllocSize);
+  EXPECT_EQ(alloc, alloc2);
+  EXPECT_TRUE(heap_manager_->Free(heap_id, alloc2));
+
+  MagazineCache::Statistics stats = {};
+  EXPECT_TRUE(heap_manager_->GetMagazineCacheStatistics(&stats));
+  EXPECT_EQ(2u, stats.hits + stats.misses);
+  EXPECT_LE(1u, stats.hits);
+  EXPECT_EQ(2u, stats.cached_frees);
+}
+
 TEST_F(BlockHeapManagerTest, AllocAndFreeLargeBlock) {
   TEST_ONLY_SUPPORTS_4G();
 
@@ -980,6 +1036,34 @@ TEST_F(BlockHeapManagerTest, BlockChecksumUpdatedWhenEnterQuarantine) {
   ASSERT_TRUE(heap.InQuarantine(mem));
 }
 
+TEST_F(BlockHeapManagerTest, AdaptiveRedzones) {
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.enable_adaptive_redzones = true;
+  parameters.trailer_padding_size = 64;
+  heap_manager_->set_parameters(parameters);
+  ScopedHeap heap(heap_manager_);
+
+  const uint32_t kAllocSizes[] = {1, 16, 48, 100, 1000, 10000};
+  for (uint32_t alloc_size : kAllocSizes) {
+    void* mem = heap.Allocate(alloc_size);
+    ASSERT_NE(static_cast<void*>(nullptr), mem);
+
+    // The block is still found from the shadow, and its right redzone
+    // scales with its size rather than following trailer_padding_size.
+    BlockInfo block_info = {};
+    EXPECT_TRUE(runtime_->shadow()->BlockInfoFromShadow(mem, &block_info));
+    EXPECT_EQ(mem, block_info.body);
+    EXPECT_EQ(alloc_size, block_info.body_size);
+    EXPECT_LE(GetAdaptiveRedzoneSize(alloc_size),
+              block_info.trailer_padding_size + sizeof(BlockTrailer));
+    if (alloc_size <= 48) {
+      EXPECT_GT(parameters.trailer_padding_size,
+                block_info.trailer_padding_size);
+    }
+    EXPECT_TRUE(heap.Free(mem));
+  }
+}
+
 static const size_t kChecksumRepeatCount = 10;
 
 TEST_F(BlockHeapManagerTest, CorruptAsEntersQuarantine) {
@@ -1584,6 +1668,166 @@ TEST_F(BlockHeapManagerTest, LargeBlockHeapNotUsedForSmallAllocations) {
   EXPECT_TRUE(heap.Free(alloc));
 }
 
+// Ensures that the SizeClassBlockHeap serves the small allocations, and only
+// those.
+TEST_F(BlockHeapManagerTest, SizeClassBlockHeapUsedForSmallAllocations) {
+  EnableSizeClassBlockHeap();
+  ScopedHeap heap(heap_manager_);
+
+  const uint32_t kSmallAllocSize = 0x100;
+  const uint32_t kLargeAllocSize =
+      heaps::SizeClassBlockHeap::kMaxAllocationSize + 1;
+  void* small_alloc = heap.Allocate(kSmallAllocSize);
+  EXPECT_NE(static_cast<void*>(nullptr), small_alloc);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(small_alloc, kSmallAllocSize));
+  void* large_alloc = heap.Allocate(kLargeAllocSize);
+  EXPECT_NE(static_cast<void*>(nullptr), large_alloc);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(large_alloc, kLargeAllocSize));
+
+  // Get the heap_ids from the block trailers.
+  BlockInfo small_block_info = {};
+  EXPECT_TRUE(runtime_->shadow()->BlockInfoFromShadow(small_alloc,
+                                                      &small_block_info));
+  BlockInfo large_block_info = {};
+  EXPECT_TRUE(runtime_->shadow()->BlockInfoFromShadow(large_alloc,
+                                                      &large_block_info));
+
+  {
+    ScopedBlockAccess small_block_access(small_block_info,
+                                         runtime_->shadow());
+    ScopedBlockAccess large_block_access(large_block_info,
+                                         runtime_->shadow());
+    EXPECT_EQ(heap_manager_->size_class_block_heap_id_,
+              small_block_info.trailer->heap_id);
+    EXPECT_EQ(heap.Id(), large_block_info.trailer->heap_id);
+  }
+
+  EXPECT_TRUE(heap.Free(small_alloc));
+  EXPECT_TRUE(heap.Free(large_alloc));
+}
+
+TEST_F(BlockHeapManagerTest, AllocationStackSampling) {
+  const uint32_t kSamplingPeriod = 4;
+  const size_t kAllocCount = 2 * kSamplingPeriod;
+  const size_t kNumFingerprintFrames =
+      common::StackCapture::kNumFingerprintFrames;
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.allocation_stack_sampling_period = kSamplingPeriod;
+  heap_manager_->set_parameters(params);
+  ScopedHeap heap(heap_manager_);
+
+  // All these allocations come from the same call site. The first one gets a
+  // full stack, and then one per sampling period.
+  std::vector<void*> allocs;
+  for (size_t i = 0; i < kAllocCount; ++i) {
+    allocs.push_back(heap.Allocate(10));
+    ASSERT_NE(static_cast<void*>(nullptr), allocs.back());
+  }
+
+  for (size_t i = 0; i < kAllocCount; ++i) {
+    BlockInfo block_info = {};
+    EXPECT_TRUE(runtime_->shadow()->BlockInfoFromShadow(allocs[i],
+                                                        &block_info));
+    ScopedBlockAccess block_access(block_info, runtime_->shadow());
+    const common::StackCapture* alloc_stack = block_info.header->alloc_stack;
+    ASSERT_NE(static_cast<const common::StackCapture*>(nullptr),
+              alloc_stack);
+    EXPECT_EQ(i % kSamplingPeriod != 0, alloc_stack->fingerprint());
+    if (alloc_stack->fingerprint())
+      EXPECT_GE(kNumFingerprintFrames, alloc_stack->num_frames());
+  }
+
+  for (void* alloc : allocs)
+    EXPECT_TRUE(heap.Free(alloc));
+}
+
+TEST_F(BlockHeapManagerTest, AdaptiveGuardRate) {
+  const size_t kAllocCount =
+      4 * TestBlockHeapManager::kAdaptiveGuardInitialSiteBudget;
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.allocation_guard_rate = 0.01f;
+  params.enable_adaptive_guard_rate = true;
+  heap_manager_->set_parameters(params);
+  ScopedHeap heap(heap_manager_);
+
+  // All these allocations come from the same call site. Its first ones are
+  // all guarded, and then fewer and fewer of them.
+  std::vector<void*> allocs;
+  size_t guarded_allocations = 0;
+  for (size_t i = 0; i < kAllocCount; ++i) {
+    void* alloc = heap.Allocate(10);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+    allocs.push_back(alloc);
+    BlockHeader* header = BlockGetHeaderFromBody(
+        reinterpret_cast<BlockBody*>(alloc));
+    if (i < TestBlockHeapManager::kAdaptiveGuardInitialSiteBudget)
+      EXPECT_NE(static_cast<BlockHeader*>(nullptr), header);
+    if (header != nullptr)
+      ++guarded_allocations;
+  }
+  EXPECT_LT(guarded_allocations, kAllocCount);
+
+  for (void* alloc : allocs)
+    EXPECT_TRUE(heap.Free(alloc));
+}
+
+TEST_F(BlockHeapManagerTest, AdaptiveGuardRateBudget) {
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.allocation_guard_rate = 0.001f;
+  params.enable_adaptive_guard_rate = true;
+  heap_manager_->set_parameters(params);
+
+  // An epoch of allocations from a single hot call site guards more of them
+  // than the target, so the budget shrinks.
+  const common::StackCapture::StackId kHotSite = 42;
+  LONG epoch = heap_manager_->adaptive_guard_epoch_;
+  for (size_t i = 0; i < TestBlockHeapManager::kAdaptiveGuardEpochLength; ++i)
+    heap_manager_->ShouldGuardAllocation(kHotSite);
+  EXPECT_EQ(epoch + 1, heap_manager_->adaptive_guard_epoch_);
+  EXPECT_GT(static_cast<LONG>(
+                TestBlockHeapManager::kAdaptiveGuardInitialSiteBudget),
+            heap_manager_->adaptive_guard_site_budget_);
+  EXPECT_LE(1, heap_manager_->adaptive_guard_site_budget_);
+
+  // The first allocation of a call site is always guarded.
+  EXPECT_TRUE(heap_manager_->ShouldGuardAllocation(kHotSite + 1));
+}
+
+TEST_F(BlockHeapManagerTest, GetStatistics) {
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.statistics_section_period = 1000;
+  params.quarantine_size = 1024 * 1024;
+  heap_manager_->set_parameters(params);
+  ScopedHeap heap(heap_manager_);
+
+  BlockHeapManager::Statistics statistics = {};
+  heap_manager_->GetStatistics(&statistics);
+  EXPECT_EQ(0u, statistics.live_blocks[kWinHeap]);
+  EXPECT_EQ(0u, statistics.quarantine_count);
+  EXPECT_EQ(0u, statistics.deferred_free_thread_count);
+
+  void* alloc = heap.Allocate(100);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  heap_manager_->GetStatistics(&statistics);
+  EXPECT_EQ(1u, statistics.live_blocks[kWinHeap]);
+  EXPECT_EQ(GetAllocSize(100), statistics.live_bytes[kWinHeap]);
+
+  // The block stays live while it is quarantined.
+  EXPECT_TRUE(heap.Free(alloc));
+  heap_manager_->GetStatistics(&statistics);
+  EXPECT_EQ(1u, statistics.live_blocks[kWinHeap]);
+  EXPECT_EQ(1u, statistics.quarantine_count);
+  EXPECT_EQ(GetAllocSize(100), statistics.quarantine_size);
+  EXPECT_EQ(TrimColor::GREEN, statistics.quarantine_color);
+  EXPECT_EQ(0u, statistics.deferred_free_backlog);
+
+  heap.FlushQuarantine();
+  heap_manager_->GetStatistics(&statistics);
+  EXPECT_EQ(0u, statistics.live_blocks[kWinHeap]);
+  EXPECT_EQ(0u, statistics.live_bytes[kWinHeap]);
+  EXPECT_EQ(0u, statistics.quarantine_count);
+}
+
 TEST_F(BlockHeapManagerTest, AllocationFilterFlag) {
   EXPECT_NE(TLS_OUT_OF_INDEXES, heap_manager_->allocation_filter_flag_tls_);
   heap_manager_->set_allocation_filter_flag(true);
@@ -1709,6 +1953,41 @@ TEST_F(BlockHeapManagerTest, IsValidHeapIdUnlocked) {
   }
 }
 
+TEST_F(BlockHeapManagerTest, IsValidHeapIdUsesCookie) {
+  TestBlockHeapManager::HeapId heap_id = heap_manager_->CreateHeap();
+  TestBlockHeapManager::HeapQuarantinePair* hq =
+      reinterpret_cast<TestBlockHeapManager::HeapQuarantinePair*>(heap_id);
+
+  // A live heap is validated by its cookie, without taking the lock.
+  EXPECT_TRUE(heap_manager_->HeapCookieIsValid(hq, false));
+  EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, false));
+
+  // A heap whose cookie doesn't match is still found in the heap map.
+  uintptr_t cookie = hq->second.cookie;
+  hq->second.cookie = 0;
+  EXPECT_FALSE(heap_manager_->HeapCookieIsValid(hq, false));
+  EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, false));
+  hq->second.cookie = cookie;
+
+  // A dying heap is only valid if dying heaps are allowed.
+  hq->second.is_dying = true;
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(heap_id, false));
+  EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, true));
+  hq->second.is_dying = false;
+
+  // A copy of the entry of a valid heap isn't valid, as the cookie depends
+  // on the address of the entry.
+  TestBlockHeapManager::HeapQuarantinePair copy(*hq);
+  EXPECT_FALSE(heap_manager_->HeapCookieIsValid(&copy, false));
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(
+      reinterpret_cast<TestBlockHeapManager::HeapId>(&copy), false));
+
+  // Wild heap IDs are rejected.
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(0xDEADBEEF, false));
+
+  EXPECT_TRUE(heap_manager_->DestroyHeap(heap_id));
+}
+
 TEST_F(BlockHeapManagerTest, GetHeapTypeUnlocked) {
   ASSERT_FALSE(heap_manager_->heaps_.empty());
   for (auto& hq_pair : heap_manager_->heaps_) {
@@ -1738,6 +2017,40 @@ TEST_F(BlockHeapManagerTest, EnableDeferredFreeThreadTest) {
   ASSERT_FALSE(heap_manager_->IsDeferredFreeThreadRunning());
 }
 
+TEST_F(BlockHeapManagerTest, DeferredFloodFill) {
+  // Large enough for the fill to use non-temporal stores.
+  const uint32_t kAllocSize = 8 * 1024 + 3;
+  ScopedHeap heap(heap_manager_);
+  heap_manager_->enable_page_protections_ = false;
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = GetAllocSize(kAllocSize) * 2;
+  parameters.quarantine_flood_fill_rate = 1.0f;
+  heap_manager_->set_parameters(parameters);
+
+  heap_manager_->EnableDeferredFreeThread();
+  ASSERT_TRUE(heap_manager_->IsDeferredFreeThreadRunning());
+
+  void* mem = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem);
+  ::memset(mem, 0, kAllocSize);
+  BlockHeader* header = BlockGetHeaderFromBody(
+      reinterpret_cast<BlockBody*>(mem));
+  ASSERT_TRUE(heap.Free(mem));
+
+  // Until it gets filled the block is a valid non-flooded quarantined block.
+  BlockInfo block_info = {};
+  EXPECT_TRUE(BlockInfoFromMemory(header, &block_info));
+  EXPECT_FALSE(IsBlockCorrupt(block_info));
+
+  // Stopping the threads completes the pending fills.
+  heap_manager_->DisableDeferredFreeThread();
+  EXPECT_EQ(QUARANTINED_FLOODED_BLOCK, static_cast<BlockState>(header->state));
+  EXPECT_TRUE(BlockBodyIsFloodFilled(block_info));
+  EXPECT_FALSE(IsBlockCorrupt(block_info));
+
+  heap.FlushQuarantine();
+}
+
 TEST_F(BlockHeapManagerTest, DeferredFreeThreadTest) {
   const uint32_t kAllocSize = 100;
   const uint32_t kTargetMaxYellow = 10;
@@ -1786,6 +2099,50 @@ TEST_F(BlockHeapManagerTest, DeferredFreeThreadTest) {
   EXPECT_FALSE(heap_manager_->IsDeferredFreeThreadRunning());
 }
 
+TEST_F(BlockHeapManagerTest, DeferredFreeThreadPoolTest) {
+  const uint32_t kAllocSize = 100;
+  const uint32_t kTargetMaxYellow = 10;
+  uint32_t real_alloc_size = GetAllocSize(kAllocSize);
+  ScopedHeap heap(heap_manager_);
+
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = real_alloc_size * kTargetMaxYellow;
+  parameters.deferred_free_thread_count = 4;
+  heap_manager_->set_parameters(parameters);
+
+  base::WaitableEvent deferred_free_callback_start(false, false);
+  base::WaitableEvent deferred_free_callback_end(false, false);
+  heap_manager_->EnableDeferredFreeWithSync(&deferred_free_callback_start,
+                                            &deferred_free_callback_end);
+  ASSERT_TRUE(heap_manager_->IsDeferredFreeThreadRunning());
+
+  size_t max_size_yellow =
+      heap_manager_->shared_quarantine_.GetMaxSizeForColorForTesting(YELLOW) /
+      real_alloc_size;
+  for (int i = 0; i < max_size_yellow + 1; i++) {
+    void* heap_mem = heap.Allocate(kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), heap_mem);
+    heap.Free(heap_mem);
+  }
+
+  size_t current_size = heap_manager_->shared_quarantine_.GetSizeForTesting();
+  ASSERT_EQ(RED,
+            heap_manager_->shared_quarantine_.GetQuarantineColor(current_size));
+
+  // Going into RED wakes up a single thread. It may find its own shards empty
+  // before the quarantine is back to GREEN, in which case it must help with
+  // the other shards.
+  deferred_free_callback_start.Signal();
+  deferred_free_callback_end.Wait();
+
+  current_size = heap_manager_->shared_quarantine_.GetSizeForTesting();
+  EXPECT_EQ(GREEN,
+            heap_manager_->shared_quarantine_.GetQuarantineColor(current_size));
+
+  heap_manager_->DisableDeferredFreeThread();
+  EXPECT_FALSE(heap_manager_->IsDeferredFreeThreadRunning());
+}
+
 namespace {
 
 // Helper function for extracting the two default heaps.
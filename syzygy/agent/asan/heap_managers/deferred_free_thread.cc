@@ -38,6 +38,7 @@ bool DeferredFreeThread::Start() {
   if (!base::PlatformThread::CreateWithPriority(
           0, this, &deferred_free_thread_handle_,
           base::ThreadPriority::BACKGROUND)) {
+    base::subtle::NoBarrier_Store(&enabled_, 0);
     return false;
   }
   ready_event_.Wait();
@@ -0,0 +1,84 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/deferred_free_thread_pool.h"
+
+#include <utility>
+
+#include "base/bind.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+DeferredFreeThreadPool::DeferredFreeThreadPool(size_t thread_count,
+                                               Callback deferred_free_callback)
+    : thread_count_(thread_count),
+      deferred_free_callback_(deferred_free_callback),
+      next_thread_(0) {
+  DCHECK_LT(0u, thread_count_);
+}
+
+DeferredFreeThreadPool::~DeferredFreeThreadPool() {
+  DCHECK(threads_.empty());
+}
+
+bool DeferredFreeThreadPool::Start() {
+  DCHECK(threads_.empty());
+  for (size_t i = 0; i < thread_count_; ++i) {
+    std::unique_ptr<DeferredFreeThread> thread(
+        new DeferredFreeThread(base::Bind(deferred_free_callback_, i)));
+    if (!thread->Start()) {
+      // Don't leave a partial pool running.
+      Stop();
+      return false;
+    }
+    threads_.push_back(std::move(thread));
+  }
+  return true;
+}
+
+void DeferredFreeThreadPool::Stop() {
+  for (auto& thread : threads_)
+    thread->Stop();
+  threads_.clear();
+}
+
+void DeferredFreeThreadPool::SignalWork(TrimColor trim_color) {
+  DCHECK_EQ(thread_count_, threads_.size());
+
+  // The application threads are trimming synchronously, so have every thread
+  // help bringing the quarantine back under control.
+  if (trim_color == TrimColor::BLACK) {
+    for (auto& thread : threads_)
+      thread->SignalWork();
+    return;
+  }
+
+  // Otherwise a single thread is enough. Turn through the threads so that
+  // they all get to drain their own shards.
+  uint32_t index = static_cast<uint32_t>(
+      base::subtle::NoBarrier_AtomicIncrement(&next_thread_, 1) - 1);
+  threads_[index % thread_count_]->SignalWork();
+}
+
+base::PlatformThreadId DeferredFreeThreadPool::deferred_free_thread_id(
+    size_t index) const {
+  DCHECK_LT(index, threads_.size());
+  return threads_[index]->deferred_free_thread_id();
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,97 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation of a pool of background threads that asynchronously trim the
+// quarantine.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_MANAGERS_DEFERRED_FREE_THREAD_POOL_H_
+#define SYZYGY_AGENT_ASAN_HEAP_MANAGERS_DEFERRED_FREE_THREAD_POOL_H_
+
+#include <memory>
+#include <vector>
+
+#include "base/callback.h"
+#include "syzygy/agent/asan/quarantine.h"
+#include "syzygy/agent/asan/heap_managers/deferred_free_thread.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+// A pool of deferred free threads. Each thread is identified by its index in
+// the pool, which is passed to the callback so that the threads can split the
+// work among themselves.
+//
+// The number of threads woken up depends on the urgency of the trimming: a
+// quarantine going into the RED zone wakes up a single thread, turning
+// through the threads in round-robin order, whereas a quarantine going into
+// the BLACK zone (where the application threads are also trimming it
+// synchronously) wakes up all of them.
+class DeferredFreeThreadPool {
+ public:
+  typedef base::Callback<void(size_t)> Callback;
+
+  // @param thread_count The number of threads in the pool. Must be at least 1.
+  // @param deferred_free_callback Callback that is called by the threads when
+  //     signaled, with the index of the calling thread. This callback must be
+  //     valid from the moment Start is called and until Stop is called.
+  DeferredFreeThreadPool(size_t thread_count, Callback deferred_free_callback);
+  ~DeferredFreeThreadPool();
+
+  // Starts the threads and waits until they are all ready to work. Must be
+  // called before use. Must not be called if the pool has already been
+  // started.
+  // @returns true if successful, false if a thread failed to be launched. In
+  //     that case no thread is left running.
+  bool Start();
+
+  // Stops the threads and waits until they all exit cleanly. Must be called
+  // before the destruction of this object and before the callback is no longer
+  // valid. Must not be called if the pool has not been started successfully.
+  void Stop();
+
+  // Signals to the pool that work is required, waking up a number of threads
+  // that depends on the color of the quarantine. It's ok to call this
+  // repeatedly.
+  // @param trim_color The color the quarantine has reached.
+  void SignalWork(TrimColor trim_color);
+
+  // @returns the number of threads in the pool.
+  size_t thread_count() const { return thread_count_; }
+
+  // @param index The index of a thread in the pool.
+  // @returns the ID of the given thread.
+  base::PlatformThreadId deferred_free_thread_id(size_t index) const;
+
+ private:
+  // The number of threads in the pool.
+  size_t thread_count_;
+
+  // Callback to the deferred free function, set by the constructor.
+  Callback deferred_free_callback_;
+
+  // The threads of the pool. Empty while the pool isn't started.
+  std::vector<std::unique_ptr<DeferredFreeThread>> threads_;
+
+  // The index of the next thread to wake up for non-urgent work.
+  base::subtle::Atomic32 next_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeferredFreeThreadPool);
+};
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_MANAGERS_DEFERRED_FREE_THREAD_POOL_H_
@@ -0,0 +1,100 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/deferred_free_thread_pool.h"
+
+#include <memory>
+
+#include "base/bind.h"
+#include "base/synchronization/waitable_event.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+namespace {
+
+const size_t kThreadCount = 3;
+
+class DeferredFreeThreadPoolTest : public testing::Test {
+ public:
+  DeferredFreeThreadPoolTest()
+      : nb_callbacks_(), callback_event_(false, false) {}
+
+  void SetUp() override {
+    pool_.reset(new DeferredFreeThreadPool(
+        kThreadCount, base::Bind(&DeferredFreeThreadPoolTest::Callback,
+                                 base::Unretained(this))));
+    ASSERT_TRUE(pool_->Start());
+  }
+
+  void TearDown() override {
+    pool_->Stop();
+    pool_.reset();
+  }
+
+  DeferredFreeThreadPool* pool() { return pool_.get(); }
+
+  size_t nb_callbacks(size_t index) {
+    base::AutoLock auto_lock(nb_callbacks_lock_);
+    return nb_callbacks_[index];
+  }
+
+  void Callback(size_t index) {
+    ASSERT_LT(index, kThreadCount);
+    EXPECT_EQ(pool_->deferred_free_thread_id(index),
+              base::PlatformThread::CurrentId());
+    base::AutoLock auto_lock(nb_callbacks_lock_);
+    ++nb_callbacks_[index];
+    callback_event_.Signal();
+  }
+
+  void WaitForCallback() { callback_event_.Wait(); }
+
+ private:
+  base::Lock nb_callbacks_lock_;
+  size_t nb_callbacks_[kThreadCount];
+  std::unique_ptr<DeferredFreeThreadPool> pool_;
+  base::WaitableEvent callback_event_;
+};
+
+}  // namespace
+
+TEST_F(DeferredFreeThreadPoolTest, RedWakesThreadsInTurn) {
+  EXPECT_EQ(kThreadCount, pool()->thread_count());
+
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    pool()->SignalWork(TrimColor::RED);
+    WaitForCallback();
+    for (size_t j = 0; j < kThreadCount; ++j)
+      EXPECT_EQ(j <= i ? 1u : 0u, nb_callbacks(j));
+  }
+}
+
+TEST_F(DeferredFreeThreadPoolTest, BlackWakesAllThreads) {
+  pool()->SignalWork(TrimColor::BLACK);
+
+  // The callback event is auto-reset, so several threads may signal it before
+  // it's waited on. Wait for each of the callbacks to be counted instead.
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    while (nb_callbacks(i) == 0)
+      base::PlatformThread::YieldCurrentThread();
+    EXPECT_EQ(1u, nb_callbacks(i));
+  }
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,199 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/magazine_cache.h"
+
+#include "syzygy/agent/asan/constants.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+MagazineCache::MagazineCache(BlockHeapInterface* heap,
+                             HeapInterface* internal_heap)
+    : heap_(heap),
+      internal_heap_(internal_heap),
+      magazines_(nullptr),
+      magazine_count_(0) {
+  DCHECK_NE(static_cast<BlockHeapInterface*>(nullptr), heap);
+  DCHECK_NE(static_cast<HeapInterface*>(nullptr), internal_heap);
+  magazine_tls_ = ::TlsAlloc();
+  CHECK_NE(TLS_OUT_OF_INDEXES, magazine_tls_);
+}
+
+MagazineCache::~MagazineCache() {
+  Flush();
+
+  base::AutoLock lock(lock_);
+  while (magazines_ != nullptr) {
+    Magazine* magazine = magazines_;
+    magazines_ = magazine->next;
+    internal_heap_->Free(magazine);
+  }
+  magazine_count_ = 0;
+
+  ::TlsFree(magazine_tls_);
+  magazine_tls_ = TLS_OUT_OF_INDEXES;
+}
+
+bool MagazineCache::GetSizeClass(uint32_t block_size, size_t* size_class) {
+  DCHECK_NE(static_cast<size_t*>(nullptr), size_class);
+  if (block_size > (1U << kMaxSizeClassLog))
+    return false;
+
+  size_t log = kMinSizeClassLog;
+  while ((1U << log) < block_size)
+    ++log;
+  *size_class = log - kMinSizeClassLog;
+  return true;
+}
+
+void* MagazineCache::Allocate(size_t size_class) {
+  DCHECK_GT(kSizeClassCount, size_class);
+
+  Magazine* magazine = GetThreadMagazine();
+  if (magazine == nullptr)
+    return heap_->Allocate(GetSizeClassBlockSize(size_class));
+
+  if (magazine->count[size_class] == 0) {
+    ++magazine->misses;
+    Refill(magazine, size_class);
+    // The heap failed to satisfy any allocation.
+    if (magazine->count[size_class] == 0)
+      return nullptr;
+  } else {
+    ++magazine->hits;
+  }
+
+  size_t index = --magazine->count[size_class];
+  void* alloc = magazine->entries[size_class][index];
+  magazine->entries[size_class][index] = nullptr;
+  return alloc;
+}
+
+bool MagazineCache::Free(size_t size_class, void* alloc) {
+  DCHECK_GT(kSizeClassCount, size_class);
+  DCHECK_NE(static_cast<void*>(nullptr), alloc);
+
+  Magazine* magazine = GetThreadMagazine();
+  if (magazine == nullptr)
+    return heap_->Free(alloc);
+
+  bool result = true;
+  if (magazine->count[size_class] == kMagazineCapacity)
+    result = Drain(magazine, size_class, kMagazineCapacity - kBatchSize);
+
+  DCHECK_GT(kMagazineCapacity, magazine->count[size_class]);
+  magazine->entries[size_class][magazine->count[size_class]++] = alloc;
+  ++magazine->cached_frees;
+  return result;
+}
+
+void MagazineCache::Flush() {
+  base::AutoLock lock(lock_);
+  for (Magazine* magazine = magazines_; magazine != nullptr;
+       magazine = magazine->next) {
+    for (size_t size_class = 0; size_class < kSizeClassCount; ++size_class)
+      Drain(magazine, size_class, 0);
+  }
+}
+
+void MagazineCache::GetStatistics(Statistics* statistics) {
+  DCHECK_NE(static_cast<Statistics*>(nullptr), statistics);
+  ::memset(statistics, 0, sizeof(*statistics));
+
+  base::AutoLock lock(lock_);
+  for (Magazine* magazine = magazines_; magazine != nullptr;
+       magazine = magazine->next) {
+    statistics->hits += magazine->hits;
+    statistics->misses += magazine->misses;
+    statistics->cached_frees += magazine->cached_frees;
+    statistics->refills += magazine->refills;
+    statistics->drains += magazine->drains;
+  }
+  statistics->magazines = magazine_count_;
+}
+
+MagazineCache::Magazine* MagazineCache::GetThreadMagazine() {
+  Magazine* magazine =
+      reinterpret_cast<Magazine*>(::TlsGetValue(magazine_tls_));
+  if (magazine != nullptr)
+    return magazine;
+
+  // This is the first time this thread uses the cache. This is the only
+  // operation that takes lock_ on the allocation path.
+  magazine = reinterpret_cast<Magazine*>(
+      internal_heap_->Allocate(sizeof(Magazine)));
+  if (magazine == nullptr)
+    return nullptr;
+  ::memset(magazine, 0, sizeof(*magazine));
+
+  {
+    base::AutoLock lock(lock_);
+    magazine->next = magazines_;
+    magazines_ = magazine;
+    ++magazine_count_;
+  }
+
+  ::TlsSetValue(magazine_tls_, magazine);
+  return magazine;
+}
+
+void MagazineCache::Refill(Magazine* magazine, size_t size_class) {
+  DCHECK_NE(static_cast<Magazine*>(nullptr), magazine);
+  DCHECK_GT(kSizeClassCount, size_class);
+  DCHECK_EQ(0u, magazine->count[size_class]);
+
+  uint32_t block_size = GetSizeClassBlockSize(size_class);
+  ++magazine->refills;
+
+  // Hold the heap lock for the whole batch so that it is acquired once rather
+  // than once per allocation.
+  heap_->Lock();
+  for (size_t i = 0; i < kBatchSize; ++i) {
+    void* alloc = heap_->Allocate(block_size);
+    if (alloc == nullptr)
+      break;
+    DCHECK(::common::IsAligned(alloc, kShadowRatio));
+    magazine->entries[size_class][magazine->count[size_class]++] = alloc;
+  }
+  heap_->Unlock();
+}
+
+bool MagazineCache::Drain(Magazine* magazine, size_t size_class, size_t keep) {
+  DCHECK_NE(static_cast<Magazine*>(nullptr), magazine);
+  DCHECK_GT(kSizeClassCount, size_class);
+
+  if (magazine->count[size_class] <= keep)
+    return true;
+
+  ++magazine->drains;
+
+  bool result = true;
+  heap_->Lock();
+  while (magazine->count[size_class] > keep) {
+    size_t index = --magazine->count[size_class];
+    if (!heap_->Free(magazine->entries[size_class][index]))
+      result = false;
+    magazine->entries[size_class][index] = nullptr;
+  }
+  heap_->Unlock();
+
+  return result;
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
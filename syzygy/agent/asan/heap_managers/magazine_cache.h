@@ -0,0 +1,183 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a thread-local magazine cache of raw block allocations. This sits
+// between the BlockHeapManager and a BlockHeapInterface, and amortizes the
+// cost of taking the heap lock by refilling and draining per-thread caches in
+// batches.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_MANAGERS_MAGAZINE_CACHE_H_
+#define SYZYGY_AGENT_ASAN_HEAP_MANAGERS_MAGAZINE_CACHE_H_
+
+#include <windows.h>
+
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/heap.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+// A cache of raw allocations, segregated by size class and kept per-thread.
+// Each thread owns a 'magazine' containing a small stack of allocations for
+// each size class. Allocations and frees are served from the magazine without
+// taking any lock; when a magazine runs empty it is refilled with a batch of
+// allocations made under a single acquisition of the heap lock, and when it
+// runs full half of it is drained back to the heap in the same manner.
+//
+// The cache only deals in raw allocations whose size is exactly that of a
+// size class. It is up to the caller to lay out blocks that exactly fill the
+// allocation (by growing the right redzone), so that all of the usual header,
+// redzone and trailer guarantees still hold. The underlying heap must be such
+// that a raw allocation may be returned to it via BlockHeapInterface::Free.
+//
+// Magazines are never destroyed while the cache is alive, even if their thread
+// exits. Flush must be called prior to destroying the underlying heap.
+class MagazineCache {
+ public:
+  // The log2 of the smallest and largest block sizes served by the cache.
+  static const size_t kMinSizeClassLog = 5;
+  static const size_t kMaxSizeClassLog = 12;
+  // The number of size classes. Size classes are powers of two.
+  static const size_t kSizeClassCount =
+      kMaxSizeClassLog - kMinSizeClassLog + 1;
+  // The number of allocations that may be cached per size class per thread.
+  static const size_t kMagazineCapacity = 32;
+  // The number of allocations that are moved to or from the heap at once.
+  static const size_t kBatchSize = kMagazineCapacity / 2;
+
+  // Statistics about the operation of the cache.
+  struct Statistics {
+    // The number of allocations served directly from a magazine.
+    uint64_t hits;
+    // The number of allocations that required a refill.
+    uint64_t misses;
+    // The number of frees that were absorbed by a magazine.
+    uint64_t cached_frees;
+    // The number of batch refills and drains performed against the heap.
+    uint64_t refills;
+    uint64_t drains;
+    // The number of magazines that have been created (one per thread).
+    uint64_t magazines;
+  };
+
+  // Constructor.
+  // @param heap The heap that backs the cache. Must outlive this object.
+  // @param internal_heap The heap used to allocate the magazines themselves.
+  //     Must outlive this object.
+  MagazineCache(BlockHeapInterface* heap, HeapInterface* internal_heap);
+
+  // Destructor. Flushes all magazines.
+  ~MagazineCache();
+
+  // Determines the size class that serves blocks of the given size.
+  // @param block_size The size of the block to be served.
+  // @param size_class Will receive the size class.
+  // @returns true if the block may be served by the cache, false otherwise.
+  static bool GetSizeClass(uint32_t block_size, size_t* size_class);
+
+  // @param size_class A size class.
+  // @returns the size of the raw allocations in the given size class.
+  static uint32_t GetSizeClassBlockSize(size_t size_class) {
+    DCHECK_GT(kSizeClassCount, size_class);
+    return 1U << (size_class + kMinSizeClassLog);
+  }
+
+  // Allocates a raw allocation of exactly GetSizeClassBlockSize(size_class)
+  // bytes from the calling thread's magazine.
+  // @param size_class The size class of the allocation.
+  // @returns a pointer to the allocation, or nullptr if the heap is out of
+  //     memory.
+  void* Allocate(size_t size_class);
+
+  // Returns a raw allocation to the calling thread's magazine.
+  // @param size_class The size class of the allocation.
+  // @param alloc The allocation to be returned. This must have been allocated
+  //     from the underlying heap with the size of the given size class.
+  // @returns true on success, false if the allocation was returned to the
+  //     heap and the heap failed to free it.
+  bool Free(size_t size_class, void* alloc);
+
+  // Returns the contents of all magazines to the underlying heap. This must
+  // not be called while other threads are using the cache.
+  void Flush();
+
+  // Gets the statistics of the cache. This is thread-safe, but the counters
+  // are updated without synchronization so the returned values are
+  // approximate while the cache is in use.
+  // @param statistics Will receive the statistics.
+  void GetStatistics(Statistics* statistics);
+
+  // @returns the heap backing this cache.
+  BlockHeapInterface* heap() const { return heap_; }
+
+ protected:
+  // The per-thread state. This is POD as it is allocated from the internal
+  // heap.
+  struct Magazine {
+    // The cached allocations for each size class, used as a stack.
+    void* entries[kSizeClassCount][kMagazineCapacity];
+    size_t count[kSizeClassCount];
+    // Counters for this magazine. These are only ever written by the owning
+    // thread.
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t cached_frees;
+    uint64_t refills;
+    uint64_t drains;
+    // Linked list of all magazines. Under lock_.
+    Magazine* next;
+  };
+
+  // @returns the magazine of the calling thread, creating it if necessary.
+  //     Returns nullptr if the magazine couldn't be allocated.
+  Magazine* GetThreadMagazine();
+
+  // Refills the given size class of a magazine with a batch of allocations.
+  // @param magazine The magazine to refill.
+  // @param size_class The size class to refill.
+  void Refill(Magazine* magazine, size_t size_class);
+
+  // Drains allocations from a size class of a magazine to the heap, until
+  // at most |keep| entries remain.
+  // @param magazine The magazine to drain.
+  // @param size_class The size class to drain.
+  // @param keep The number of entries to leave in the magazine.
+  // @returns true if all allocations were successfully freed.
+  bool Drain(Magazine* magazine, size_t size_class, size_t keep);
+
+  // The heap backing the cache.
+  BlockHeapInterface* heap_;
+
+  // The heap used to allocate the magazines.
+  HeapInterface* internal_heap_;
+
+  // The TLS slot holding the magazine of each thread.
+  DWORD magazine_tls_;
+
+  // Protects the list of magazines.
+  base::Lock lock_;
+  Magazine* magazines_;  // Under lock_.
+  size_t magazine_count_;  // Under lock_.
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MagazineCache);
+};
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_MANAGERS_MAGAZINE_CACHE_H_
\ No newline at end of file
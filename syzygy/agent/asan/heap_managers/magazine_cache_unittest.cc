@@ -0,0 +1,183 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/magazine_cache.h"
+
+#include <set>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/heaps/simple_block_heap.h"
+#include "syzygy/agent/asan/heaps/win_heap.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+namespace {
+
+// A block heap that counts the number of times it is locked.
+class CountingBlockHeap : public heaps::SimpleBlockHeap {
+ public:
+  explicit CountingBlockHeap(HeapInterface* heap)
+      : heaps::SimpleBlockHeap(heap), lock_count_(0) {}
+
+  void Lock() override {
+    heaps::SimpleBlockHeap::Lock();
+    ++lock_count_;
+  }
+
+  size_t lock_count() const { return lock_count_; }
+
+ private:
+  size_t lock_count_;
+};
+
+class MagazineCacheTest : public testing::Test {
+ public:
+  MagazineCacheTest() : block_heap_(&win_heap_) {}
+
+ protected:
+  heaps::WinHeap win_heap_;
+  heaps::WinHeap internal_heap_;
+  CountingBlockHeap block_heap_;
+};
+
+}  // namespace
+
+TEST_F(MagazineCacheTest, GetSizeClass) {
+  size_t size_class = 0;
+  EXPECT_TRUE(MagazineCache::GetSizeClass(1, &size_class));
+  EXPECT_EQ(0u, size_class);
+  EXPECT_TRUE(MagazineCache::GetSizeClass(32, &size_class));
+  EXPECT_EQ(0u, size_class);
+  EXPECT_TRUE(MagazineCache::GetSizeClass(33, &size_class));
+  EXPECT_EQ(1u, size_class);
+  EXPECT_TRUE(MagazineCache::GetSizeClass(4096, &size_class));
+  EXPECT_EQ(MagazineCache::kSizeClassCount - 1, size_class);
+  EXPECT_FALSE(MagazineCache::GetSizeClass(4097, &size_class));
+
+  for (size_t i = 0; i < MagazineCache::kSizeClassCount; ++i) {
+    uint32_t block_size = MagazineCache::GetSizeClassBlockSize(i);
+    EXPECT_TRUE(MagazineCache::GetSizeClass(block_size, &size_class));
+    EXPECT_EQ(i, size_class);
+  }
+}
+
+TEST_F(MagazineCacheTest, AllocateAndFreeAreBatched) {
+  MagazineCache cache(&block_heap_, &internal_heap_);
+
+  // The first allocation refills the magazine, and the following ones are
+  // served without touching the heap lock.
+  std::vector<void*> allocs;
+  for (size_t i = 0; i < MagazineCache::kBatchSize; ++i) {
+    void* alloc = cache.Allocate(2);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+    allocs.push_back(alloc);
+  }
+  EXPECT_EQ(1u, block_heap_.lock_count());
+
+  // All of the allocations must be distinct and usable.
+  std::set<void*> unique_allocs(allocs.begin(), allocs.end());
+  EXPECT_EQ(allocs.size(), unique_allocs.size());
+  for (void* alloc : allocs)
+    ::memset(alloc, 0xAB, MagazineCache::GetSizeClassBlockSize(2));
+
+  // Frees go back to the magazine without touching the heap.
+  for (void* alloc : allocs)
+    EXPECT_TRUE(cache.Free(2, alloc));
+  EXPECT_EQ(1u, block_heap_.lock_count());
+
+  // Reallocating them is served from the cache.
+  for (size_t i = 0; i < MagazineCache::kBatchSize; ++i)
+    allocs[i] = cache.Allocate(2);
+  EXPECT_EQ(1u, block_heap_.lock_count());
+  for (void* alloc : allocs)
+    EXPECT_TRUE(cache.Free(2, alloc));
+
+  MagazineCache::Statistics stats = {};
+  cache.GetStatistics(&stats);
+  EXPECT_EQ(2 * MagazineCache::kBatchSize - 1, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_EQ(2 * MagazineCache::kBatchSize, stats.cached_frees);
+  EXPECT_EQ(1u, stats.refills);
+  EXPECT_EQ(0u, stats.drains);
+  EXPECT_EQ(1u, stats.magazines);
+}
+
+TEST_F(MagazineCacheTest, FullMagazineIsDrained) {
+  MagazineCache cache(&block_heap_, &internal_heap_);
+  uint32_t block_size = MagazineCache::GetSizeClassBlockSize(0);
+
+  // Free more allocations than the magazine can hold.
+  for (size_t i = 0; i < MagazineCache::kMagazineCapacity + 1; ++i) {
+    void* alloc = block_heap_.Allocate(block_size);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+    EXPECT_TRUE(cache.Free(0, alloc));
+  }
+
+  MagazineCache::Statistics stats = {};
+  cache.GetStatistics(&stats);
+  EXPECT_EQ(1u, stats.drains);
+  EXPECT_EQ(1u, block_heap_.lock_count());
+
+  // Flushing returns everything to the heap.
+  cache.Flush();
+  cache.GetStatistics(&stats);
+  EXPECT_EQ(2u, stats.drains);
+}
+
+namespace {
+
+// Allocates and frees from a magazine cache on its own thread.
+class MagazineCacheThread : public base::SimpleThread {
+ public:
+  explicit MagazineCacheThread(MagazineCache* cache)
+      : base::SimpleThread("MagazineCacheThread"), cache_(cache) {}
+
+  void Run() override {
+    for (size_t i = 0; i < 1000; ++i) {
+      void* alloc = cache_->Allocate(i % MagazineCache::kSizeClassCount);
+      ASSERT_NE(static_cast<void*>(nullptr), alloc);
+      EXPECT_TRUE(cache_->Free(i % MagazineCache::kSizeClassCount, alloc));
+    }
+  }
+
+ private:
+  MagazineCache* cache_;
+};
+
+}  // namespace
+
+TEST_F(MagazineCacheTest, MagazinesArePerThread) {
+  MagazineCache cache(&block_heap_, &internal_heap_);
+
+  MagazineCacheThread thread1(&cache);
+  MagazineCacheThread thread2(&cache);
+  thread1.Start();
+  thread2.Start();
+  thread1.Join();
+  thread2.Join();
+
+  MagazineCache::Statistics stats = {};
+  cache.GetStatistics(&stats);
+  EXPECT_EQ(2u, stats.magazines);
+  EXPECT_EQ(2000u, stats.hits + stats.misses);
+  EXPECT_EQ(2000u, stats.cached_frees);
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
@@ -30,7 +30,12 @@ namespace heaps {
 LargeBlockHeap::LargeBlockHeap(MemoryNotifierInterface* memory_notifier,
                                HeapInterface* internal_heap)
     : allocs_(HeapAllocator<void*>(internal_heap)),
-      memory_notifier_(memory_notifier) {
+      region_cache_(std::less<size_t>(),
+                    HeapAllocator<std::pair<const size_t, void*>>(
+                        internal_heap)),
+      memory_notifier_(memory_notifier),
+      cache_budget_(0),
+      cache_statistics_() {
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
 }
 
@@ -42,8 +47,10 @@ LargeBlockHeap::~LargeBlockHeap() {
   // it means that there's a memory leak), but it's not always the case in
   // Chrome so we need to release all the resources that we've acquired.
   FreeAllAllocations();
+  TrimCache(0);
 
   CHECK(allocs_.empty());
+  CHECK(region_cache_.empty());
 }
 
 HeapType LargeBlockHeap::GetHeapType() const {
@@ -62,7 +69,22 @@ void* LargeBlockHeap::Allocate(uint32_t bytes) {
 
   // TODO(chrisha): Make this allocate with the OS allocation granularity.
   size = ::common::AlignUp(size, GetPageSize());
-  void* alloc = ::VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_READWRITE);
+
+  // Reuse a cached region if possible. Its pages only need to be committed
+  // again, which also zeroes them.
+  void* alloc = nullptr;
+  {
+    ::common::AutoRecursiveLock lock(lock_);
+    alloc = TakeCachedRegion(GetReservationSize(size));
+  }
+  if (alloc != nullptr &&
+      ::VirtualAlloc(alloc, size, MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+    ReleaseRegion(alloc, size);
+    alloc = nullptr;
+  }
+
+  if (alloc == nullptr)
+    alloc = ::VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_READWRITE);
   Allocation allocation = { alloc, bytes };
 
   if (alloc != nullptr) {
@@ -88,13 +110,16 @@ bool LargeBlockHeap::Free(void* alloc) {
     AllocationSet::iterator it = allocs_.find(allocation);
     if (it == allocs_.end())
       return false;
-    size = it->size;
+    size = ::common::AlignUp(std::max<size_t>(it->size, 1u), GetPageSize());
     allocs_.erase(it);
+
+    // Keep the region around for reuse if the cache has room for it. The heap
+    // manager already restored the reserved marker on the shadow memory.
+    if (CacheRegion(alloc, GetReservationSize(size)))
+      return true;
   }
 
-  // Notify the OS that this memory has been returned.
-  memory_notifier_->NotifyReturnedToOS(alloc, size);
-  ::VirtualFree(alloc, 0, MEM_RELEASE);
+  ReleaseRegion(alloc, size);
   return true;
 }
 
@@ -157,6 +182,80 @@ bool LargeBlockHeap::FreeBlock(const BlockInfo& block_info) {
   return Free(block_info.header);
 }
 
+void LargeBlockHeap::SetCacheBudget(size_t cache_budget) {
+  ::common::AutoRecursiveLock lock(lock_);
+  cache_budget_ = cache_budget;
+  TrimCache(cache_budget_);
+}
+
+void LargeBlockHeap::GetCacheStatistics(CacheStatistics* statistics) {
+  DCHECK_NE(static_cast<CacheStatistics*>(nullptr), statistics);
+  ::common::AutoRecursiveLock lock(lock_);
+  *statistics = cache_statistics_;
+}
+
+size_t LargeBlockHeap::GetReservationSize(size_t size) {
+  // VirtualAlloc reserves address space with the allocation granularity.
+  return ::common::AlignUp(size, GetAllocationGranularity());
+}
+
+void* LargeBlockHeap::TakeCachedRegion(size_t reservation_size) {
+  if (cache_budget_ == 0)
+    return nullptr;
+
+  RegionCache::iterator it = region_cache_.find(reservation_size);
+  if (it == region_cache_.end()) {
+    ++cache_statistics_.misses;
+    return nullptr;
+  }
+
+  void* region = it->second;
+  region_cache_.erase(it);
+  ++cache_statistics_.hits;
+  DCHECK_LT(0u, cache_statistics_.cached_regions);
+  --cache_statistics_.cached_regions;
+  DCHECK_LE(reservation_size, cache_statistics_.cached_bytes);
+  cache_statistics_.cached_bytes -= reservation_size;
+  return region;
+}
+
+bool LargeBlockHeap::CacheRegion(void* region, size_t reservation_size) {
+  if (reservation_size > cache_budget_)
+    return false;
+
+  // Make room for the region, evicting the largest regions first.
+  TrimCache(cache_budget_ - reservation_size);
+
+  // Decommitting the pages makes them inaccessible, and frees their memory.
+  // Decommitting the reserved but uncommitted tail of the region is fine.
+  if (!::VirtualFree(region, reservation_size, MEM_DECOMMIT))
+    return false;
+
+  region_cache_.insert(std::make_pair(reservation_size, region));
+  ++cache_statistics_.cached_regions;
+  cache_statistics_.cached_bytes += reservation_size;
+  return true;
+}
+
+void LargeBlockHeap::TrimCache(size_t budget) {
+  while (cache_statistics_.cached_bytes > budget) {
+    DCHECK(!region_cache_.empty());
+    RegionCache::iterator it = std::prev(region_cache_.end());
+    size_t reservation_size = it->first;
+    void* region = it->second;
+    region_cache_.erase(it);
+    --cache_statistics_.cached_regions;
+    cache_statistics_.cached_bytes -= reservation_size;
+    ReleaseRegion(region, reservation_size);
+  }
+}
+
+void LargeBlockHeap::ReleaseRegion(void* region, size_t size) {
+  // Notify the OS that this memory has been returned.
+  memory_notifier_->NotifyReturnedToOS(region, size);
+  ::VirtualFree(region, 0, MEM_RELEASE);
+}
+
 void LargeBlockHeap::FreeAllAllocations() {
   // Start by copying the blocks into a temporary vector as the call to |Free|
   // will remove them from |allocs_|.
@@ -23,10 +23,18 @@
 // then allocations being fed into the large block heap should be at least
 // 32KB in size. Ideally the large allocation heap should not be leaned on too
 // heavily as it can cause significant memory fragmentation.
+//
+// Freed regions can optionally be kept in a bounded cache, where their pages
+// are decommitted but their address space stays reserved. The next allocation
+// of a matching size then only has to commit pages again. Cached regions keep
+// the reserved marker in the shadow memory, like the rest of the memory owned
+// by a heap, and their page protection bits are clear: decommitted pages are
+// not accessible, and they are never read since they don't contain blocks.
 
 #ifndef SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 #define SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 
+#include <map>
 #include <unordered_set>
 
 #include "syzygy/agent/asan/allocators.h"
@@ -76,6 +84,29 @@ class LargeBlockHeap : public BlockHeapInterface {
   // @returns the number of active allocations in this heap.
   size_t size() const { return allocs_.size(); }
 
+  // Statistics about the cache of freed regions.
+  struct CacheStatistics {
+    // The number of allocations served from the cache.
+    size_t hits;
+    // The number of allocations that couldn't be served from the cache.
+    size_t misses;
+    // The number of regions in the cache, and the address space they take.
+    size_t cached_regions;
+    size_t cached_bytes;
+  };
+
+  // Sets the maximum amount of address space kept reserved by the cache of
+  // freed regions. Regions are evicted as needed to respect the new budget.
+  // @param cache_budget The budget, in bytes. 0 disables the cache.
+  void SetCacheBudget(size_t cache_budget);
+
+  // @returns the budget of the cache of freed regions, in bytes.
+  size_t cache_budget() const { return cache_budget_; }
+
+  // @param statistics Will receive the statistics about the cache of freed
+  //     regions.
+  void GetCacheStatistics(CacheStatistics* statistics);
+
  protected:
   // Information about an allocation made by this allocator.
   struct Allocation {
@@ -110,6 +141,44 @@ class LargeBlockHeap : public BlockHeapInterface {
       HeapAllocator<Allocation>> AllocationSet;
   AllocationSet allocs_;  // Under lock_.
 
+  // The freed regions kept reserved for reuse, indexed by the size of their
+  // reservation.
+  typedef std::multimap<
+      size_t,
+      void*,
+      std::less<size_t>,
+      HeapAllocator<std::pair<const size_t, void*>>> RegionCache;
+  RegionCache region_cache_;  // Under lock_.
+
+  // @param size The size of an allocation, in bytes.
+  // @returns the number of bytes of address space reserved for an allocation
+  //     of @p size bytes.
+  static size_t GetReservationSize(size_t size);
+
+  // Takes a region from the cache. Under lock_.
+  // @param reservation_size The size of the reservation to look for.
+  // @returns a cached region with the given reservation size, or nullptr if
+  //     there is none.
+  void* TakeCachedRegion(size_t reservation_size);
+
+  // Tries to put a region in the cache, after decommitting its pages. Under
+  // lock_.
+  // @param region The region to cache.
+  // @param reservation_size The size of its reservation.
+  // @returns true if the region was cached, false if it doesn't fit in the
+  //     budget.
+  bool CacheRegion(void* region, size_t reservation_size);
+
+  // Evicts cached regions until the cache fits in a given budget. Under
+  // lock_.
+  // @param budget The budget to respect.
+  void TrimCache(size_t budget);
+
+  // Returns a region to the OS.
+  // @param region The region to release.
+  // @param size The size of the region, in bytes.
+  void ReleaseRegion(void* region, size_t size);
+
   // Free all the allocations owned by this heap.
   void FreeAllAllocations();
 
@@ -119,6 +188,10 @@ class LargeBlockHeap : public BlockHeapInterface {
   // The memory notifier in use.
   MemoryNotifierInterface* memory_notifier_;
 
+  // The budget of the cache, and the statistics about it.
+  size_t cache_budget_;  // Under lock_.
+  CacheStatistics cache_statistics_;  // Under lock_.
+
  private:
   DISALLOW_COPY_AND_ASSIGN(LargeBlockHeap);
 };
@@ -16,6 +16,7 @@
 
 #include "syzygy/agent/asan/unittest_util.h"
 #include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
+#include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
@@ -179,6 +180,102 @@ TEST(LargeBlockHeapTest, DestructionWithOutstandingAllocationsSucceeds) {
   EXPECT_EQ(kAllocCount, h.size());
 }
 
+TEST(LargeBlockHeapTest, CacheIsDisabledByDefault) {
+  TestLargeBlockHeap h;
+  EXPECT_EQ(0u, h.cache_budget());
+
+  void* alloc = h.Allocate(100 * 1024);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  EXPECT_TRUE(h.Free(alloc));
+
+  LargeBlockHeap::CacheStatistics stats = {};
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(0u, stats.misses);
+  EXPECT_EQ(0u, stats.cached_regions);
+  EXPECT_EQ(0u, stats.cached_bytes);
+}
+
+TEST(LargeBlockHeapTest, CacheReusesRegions) {
+  const uint32_t kAllocSize = 100 * 1024;
+  const size_t kReservationSize =
+      ::common::AlignUp(kAllocSize, GetAllocationGranularity());
+  TestLargeBlockHeap h;
+  h.SetCacheBudget(1024 * 1024);
+
+  uint8_t* alloc = reinterpret_cast<uint8_t*>(h.Allocate(kAllocSize));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), alloc);
+  ::memset(alloc, 0xAB, kAllocSize);
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_FALSE(h.IsAllocated(alloc));
+
+  LargeBlockHeap::CacheStatistics stats = {};
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_EQ(1u, stats.cached_regions);
+  EXPECT_EQ(kReservationSize, stats.cached_bytes);
+
+  // An allocation with the same reservation size gets the region back, with
+  // its pages committed and zeroed again.
+  uint8_t* alloc2 = reinterpret_cast<uint8_t*>(h.Allocate(kAllocSize + 1));
+  EXPECT_EQ(alloc, alloc2);
+  EXPECT_TRUE(h.IsAllocated(alloc2));
+  EXPECT_EQ(0u, alloc2[0]);
+  EXPECT_EQ(0u, alloc2[kAllocSize]);
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_EQ(0u, stats.cached_regions);
+  EXPECT_EQ(0u, stats.cached_bytes);
+
+  // A different size misses.
+  void* alloc3 = h.Allocate(3 * kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc3);
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_EQ(2u, stats.misses);
+
+  EXPECT_TRUE(h.Free(alloc2));
+  EXPECT_TRUE(h.Free(alloc3));
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(2u, stats.cached_regions);
+}
+
+TEST(LargeBlockHeapTest, CacheRespectsBudget) {
+  const uint32_t kAllocSize = static_cast<uint32_t>(GetAllocationGranularity());
+  TestLargeBlockHeap h;
+  h.SetCacheBudget(2 * kAllocSize);
+
+  void* allocs[3] = {};
+  for (auto& alloc : allocs) {
+    alloc = h.Allocate(kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  }
+  void* large_alloc = h.Allocate(4 * kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), large_alloc);
+
+  for (auto& alloc : allocs)
+    EXPECT_TRUE(h.Free(alloc));
+  EXPECT_TRUE(h.Free(large_alloc));
+
+  // Only two regions fit, and the large one doesn't fit at all.
+  LargeBlockHeap::CacheStatistics stats = {};
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(2u, stats.cached_regions);
+  EXPECT_EQ(2u * kAllocSize, stats.cached_bytes);
+
+  // Shrinking the budget evicts regions.
+  h.SetCacheBudget(kAllocSize);
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(1u, stats.cached_regions);
+  EXPECT_EQ(kAllocSize, stats.cached_bytes);
+
+  h.SetCacheBudget(0);
+  h.GetCacheStatistics(&stats);
+  EXPECT_EQ(0u, stats.cached_regions);
+  EXPECT_EQ(0u, stats.cached_bytes);
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
@@ -0,0 +1,389 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heaps/size_class_block_heap.h"
+
+#include <windows.h>
+#include <intrin.h>
+
+#include <vector>
+
+#include "base/logging.h"
+#include "syzygy/agent/asan/memory_notifier.h"
+
+namespace agent {
+namespace asan {
+namespace heaps {
+
+namespace {
+
+// The size classes up to this size are stepped by kSmallSizeClassStep.
+const uint32_t kSmallSizeClassLimit = 128;
+const uint32_t kSmallSizeClassStep = 16;
+const size_t kSmallSizeClassCount = kSmallSizeClassLimit / kSmallSizeClassStep;
+
+// The log2 of kSmallSizeClassLimit.
+const uint32_t kSmallSizeClassLimitLog = 7;
+
+// The number of size classes in each power of two range above
+// kSmallSizeClassLimit.
+const uint32_t kSizeClassesPerPowerOfTwo = 4;
+
+// Returns the position of the most significant set bit in a non-zero value.
+inline uint32_t Log2Floor(uint32_t value) {
+  DCHECK_NE(0u, value);
+  unsigned long index = 0;
+  ::_BitScanReverse(&index, value);
+  return index;
+}
+
+// Returns the position of the first set bit in a non-zero mask.
+inline uint32_t FirstSetBit(uint32_t mask) {
+  DCHECK_NE(0u, mask);
+  unsigned long index = 0;
+  ::_BitScanForward(&index, mask);
+  return index;
+}
+
+}  // namespace
+
+SizeClassBlockHeap::SizeClassBlockHeap(
+    MemoryNotifierInterface* memory_notifier,
+    HeapInterface* internal_heap)
+    : slabs_(HeapAllocator<std::pair<const void* const, Slab*>>(
+          internal_heap)),
+      allocation_count_(0),
+      memory_notifier_(memory_notifier),
+      internal_heap_(internal_heap) {
+  DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
+  DCHECK_NE(static_cast<HeapInterface*>(nullptr), internal_heap);
+  static_assert(kMaxAllocationSize <= kSlabSize / 16,
+                "A slab must hold a reasonable number of slots.");
+  for (size_t i = 0; i < kSizeClassCount; ++i)
+    partial_slabs_[i] = nullptr;
+}
+
+SizeClassBlockHeap::~SizeClassBlockHeap() {
+  // No need to lock here, as concurrent access to an object under destruction
+  // is a programming error.
+
+  // As for the LargeBlockHeap, there may still be allocations left in the heap
+  // so release all the slabs that have been acquired.
+  FreeAllSlabs();
+
+  CHECK(slabs_.empty());
+}
+
+HeapType SizeClassBlockHeap::GetHeapType() const {
+  return kSizeClassBlockHeap;
+}
+
+uint32_t SizeClassBlockHeap::GetHeapFeatures() const {
+  return kHeapSupportsIsAllocated | kHeapSupportsGetAllocationSize |
+      kHeapGetAllocationSizeIsUpperBound | kHeapReportsReservations;
+}
+
+void* SizeClassBlockHeap::Allocate(uint32_t bytes) {
+  if (bytes > kMaxAllocationSize)
+    return nullptr;
+
+  size_t size_class = GetSizeClass(bytes);
+
+  ::common::AutoRecursiveLock lock(lock_);
+  Slab* slab = partial_slabs_[size_class];
+  if (slab == nullptr) {
+    slab = CreateSlab(size_class);
+    if (slab == nullptr)
+      return nullptr;
+  }
+  return AllocateFromSlab(slab);
+}
+
+bool SizeClassBlockHeap::Free(void* alloc) {
+  ::common::AutoRecursiveLock lock(lock_);
+
+  uint32_t slot = 0;
+  Slab* slab = LookupAllocation(alloc, &slot);
+  if (slab == nullptr)
+    return false;
+
+  slab->bitmap[slot / 32] &= ~(1u << (slot % 32));
+  if (slot / 32 < slab->first_free_word)
+    slab->first_free_word = slot / 32;
+  DCHECK_LT(0u, slab->allocated_count);
+  --slab->allocated_count;
+  DCHECK_LT(0u, allocation_count_);
+  --allocation_count_;
+
+  // A full slab becomes partial again.
+  if (!slab->in_partial_list)
+    LinkSlab(slab);
+
+  // Return the empty slabs to the OS, but keep the last slab of a size class
+  // around to avoid thrashing when a single block is repeatedly allocated and
+  // freed.
+  if (slab->allocated_count == 0 &&
+      (partial_slabs_[slab->size_class] != slab || slab->next != nullptr)) {
+    UnlinkSlab(slab);
+    ReleaseSlab(slab);
+  }
+
+  return true;
+}
+
+bool SizeClassBlockHeap::IsAllocated(const void* alloc) {
+  ::common::AutoRecursiveLock lock(lock_);
+  uint32_t slot = 0;
+  return LookupAllocation(alloc, &slot) != nullptr;
+}
+
+uint32_t SizeClassBlockHeap::GetAllocationSize(const void* alloc) {
+  ::common::AutoRecursiveLock lock(lock_);
+  uint32_t slot = 0;
+  Slab* slab = LookupAllocation(alloc, &slot);
+  if (slab == nullptr)
+    return kUnknownSize;
+  return slab->slot_size;
+}
+
+void SizeClassBlockHeap::Lock() {
+  lock_.Acquire();
+}
+
+void SizeClassBlockHeap::Unlock() {
+  lock_.Release();
+}
+
+bool SizeClassBlockHeap::TryLock() {
+  return lock_.Try();
+}
+
+void* SizeClassBlockHeap::AllocateBlock(uint32_t size,
+                                        uint32_t min_left_redzone_size,
+                                        uint32_t min_right_redzone_size,
+                                        BlockLayout* layout) {
+  DCHECK_NE(static_cast<BlockLayout*>(nullptr), layout);
+
+  if (!BlockPlanLayout(kShadowRatio, kShadowRatio, size, min_left_redzone_size,
+                       min_right_redzone_size, layout)) {
+    return nullptr;
+  }
+  if (layout->block_size > kMaxAllocationSize)
+    return nullptr;
+
+  // Grow the right redzone so that the block exactly fills its slot. Both
+  // sizes are multiples of kShadowRatio, and the right redzone requested is
+  // the one that was just planned, so this is exact.
+  uint32_t slot_size = GetSizeClassSize(GetSizeClass(layout->block_size));
+  uint32_t right_redzone_size = layout->trailer_padding_size +
+      layout->trailer_size + slot_size - layout->block_size;
+  if (!BlockPlanLayout(kShadowRatio, kShadowRatio, size, min_left_redzone_size,
+                       right_redzone_size, layout)) {
+    return nullptr;
+  }
+  DCHECK_EQ(slot_size, layout->block_size);
+
+  return Allocate(layout->block_size);
+}
+
+bool SizeClassBlockHeap::FreeBlock(const BlockInfo& block_info) {
+  DCHECK_NE(static_cast<BlockHeader*>(nullptr), block_info.header);
+  return Free(block_info.header);
+}
+
+size_t SizeClassBlockHeap::GetSizeClass(uint32_t size) {
+  DCHECK(size <= kMaxAllocationSize);
+
+  // Zero sized allocations still get a slot, so that they have distinct
+  // addresses.
+  if (size == 0)
+    size = 1;
+  if (size <= kSmallSizeClassLimit)
+    return (size + kSmallSizeClassStep - 1) / kSmallSizeClassStep - 1;
+
+  // Split the power of two range containing the size in equal steps.
+  uint32_t log = Log2Floor(size - 1);
+  uint32_t range_start = 1u << log;
+  uint32_t step = range_start / kSizeClassesPerPowerOfTwo;
+  uint32_t sub_class = (size - range_start + step - 1) / step;
+  DCHECK_LT(0u, sub_class);
+  DCHECK_GE(kSizeClassesPerPowerOfTwo, sub_class);
+  return kSmallSizeClassCount +
+      (log - kSmallSizeClassLimitLog) * kSizeClassesPerPowerOfTwo +
+      sub_class - 1;
+}
+
+uint32_t SizeClassBlockHeap::GetSizeClassSize(size_t size_class) {
+  DCHECK(size_class < kSizeClassCount);
+  if (size_class < kSmallSizeClassCount)
+    return static_cast<uint32_t>((size_class + 1) * kSmallSizeClassStep);
+
+  size_t index = size_class - kSmallSizeClassCount;
+  uint32_t range_start = kSmallSizeClassLimit <<
+      (index / kSizeClassesPerPowerOfTwo);
+  uint32_t step = range_start / kSizeClassesPerPowerOfTwo;
+  return range_start +
+      static_cast<uint32_t>(index % kSizeClassesPerPowerOfTwo + 1) * step;
+}
+
+size_t SizeClassBlockHeap::size() const {
+  ::common::AutoRecursiveLock lock(lock_);
+  return allocation_count_;
+}
+
+size_t SizeClassBlockHeap::slab_count() const {
+  ::common::AutoRecursiveLock lock(lock_);
+  return slabs_.size();
+}
+
+SizeClassBlockHeap::Slab* SizeClassBlockHeap::LookupAllocation(
+    const void* alloc, uint32_t* slot) const {
+  DCHECK_NE(static_cast<uint32_t*>(nullptr), slot);
+
+  uintptr_t address = reinterpret_cast<uintptr_t>(alloc);
+  const void* slab_address =
+      reinterpret_cast<const void*>(address & ~(uintptr_t(kSlabSize) - 1));
+  SlabMap::const_iterator it = slabs_.find(slab_address);
+  if (it == slabs_.end())
+    return nullptr;
+
+  Slab* slab = it->second;
+  uint32_t offset = static_cast<uint32_t>(address - uintptr_t(slab->address));
+  if (offset % slab->slot_size != 0)
+    return nullptr;
+  uint32_t index = offset / slab->slot_size;
+  if (index >= slab->bump_index)
+    return nullptr;
+  if ((slab->bitmap[index / 32] & (1u << (index % 32))) == 0)
+    return nullptr;
+
+  *slot = index;
+  return slab;
+}
+
+void* SizeClassBlockHeap::AllocateFromSlab(Slab* slab) {
+  DCHECK_NE(static_cast<Slab*>(nullptr), slab);
+  DCHECK_GT(slab->slot_count, slab->allocated_count);
+
+  uint32_t slot = 0;
+  if (slab->allocated_count == slab->bump_index) {
+    // There are no holes, carve a new slot.
+    slot = slab->bump_index++;
+  } else {
+    // Look for the first hole. There's necessarily one at or after the hint.
+    uint32_t word = slab->first_free_word;
+    while (slab->bitmap[word] == ~0u)
+      ++word;
+    slot = word * 32 + FirstSetBit(~slab->bitmap[word]);
+    DCHECK_GT(slab->bump_index, slot);
+    slab->first_free_word = word;
+  }
+  slab->bitmap[slot / 32] |= 1u << (slot % 32);
+  ++slab->allocated_count;
+  ++allocation_count_;
+
+  if (slab->allocated_count == slab->slot_count)
+    UnlinkSlab(slab);
+
+  return slab->address + slot * slab->slot_size;
+}
+
+SizeClassBlockHeap::Slab* SizeClassBlockHeap::CreateSlab(size_t size_class) {
+  DCHECK(size_class < kSizeClassCount);
+
+  void* address = ::VirtualAlloc(nullptr, kSlabSize, MEM_RESERVE | MEM_COMMIT,
+                                 PAGE_READWRITE);
+  if (address == nullptr)
+    return nullptr;
+  DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(address) % kSlabSize);
+
+  Slab* slab = reinterpret_cast<Slab*>(internal_heap_->Allocate(sizeof(Slab)));
+  if (slab == nullptr) {
+    ::VirtualFree(address, 0, MEM_RELEASE);
+    return nullptr;
+  }
+  ::memset(slab, 0, sizeof(*slab));
+  slab->address = reinterpret_cast<uint8_t*>(address);
+  slab->size_class = size_class;
+  slab->slot_size = GetSizeClassSize(size_class);
+  slab->slot_count = kSlabSize / slab->slot_size;
+  DCHECK_GE(kBitmapWordCount * 32, slab->slot_count);
+
+  bool inserted = slabs_.insert(std::make_pair(address, slab)).second;
+  DCHECK(inserted);
+  LinkSlab(slab);
+
+  memory_notifier_->NotifyFutureHeapUse(address, kSlabSize);
+  return slab;
+}
+
+void SizeClassBlockHeap::ReleaseSlab(Slab* slab) {
+  DCHECK_NE(static_cast<Slab*>(nullptr), slab);
+  DCHECK_EQ(0u, slab->allocated_count);
+  DCHECK(!slab->in_partial_list);
+
+  void* address = slab->address;
+  size_t erased = slabs_.erase(address);
+  DCHECK_EQ(1u, erased);
+  CHECK(internal_heap_->Free(slab));
+
+  memory_notifier_->NotifyReturnedToOS(address, kSlabSize);
+  ::VirtualFree(address, 0, MEM_RELEASE);
+}
+
+void SizeClassBlockHeap::LinkSlab(Slab* slab) {
+  DCHECK(!slab->in_partial_list);
+  Slab*& head = partial_slabs_[slab->size_class];
+  slab->prev = nullptr;
+  slab->next = head;
+  if (head != nullptr)
+    head->prev = slab;
+  head = slab;
+  slab->in_partial_list = true;
+}
+
+void SizeClassBlockHeap::UnlinkSlab(Slab* slab) {
+  DCHECK(slab->in_partial_list);
+  if (slab->prev != nullptr) {
+    slab->prev->next = slab->next;
+  } else {
+    DCHECK_EQ(slab, partial_slabs_[slab->size_class]);
+    partial_slabs_[slab->size_class] = slab->next;
+  }
+  if (slab->next != nullptr)
+    slab->next->prev = slab->prev;
+  slab->prev = nullptr;
+  slab->next = nullptr;
+  slab->in_partial_list = false;
+}
+
+void SizeClassBlockHeap::FreeAllSlabs() {
+  // Start by copying the slabs into a temporary vector as the call to
+  // |ReleaseSlab| will remove them from |slabs_|.
+  std::vector<Slab*> slabs_to_free;
+  for (const auto& entry : slabs_)
+    slabs_to_free.push_back(entry.second);
+  for (Slab* slab : slabs_to_free) {
+    allocation_count_ -= slab->allocated_count;
+    slab->allocated_count = 0;
+    if (slab->in_partial_list)
+      UnlinkSlab(slab);
+    ReleaseSlab(slab);
+  }
+  DCHECK_EQ(0u, allocation_count_);
+}
+
+}  // namespace heaps
+}  // namespace asan
+}  // namespace agent
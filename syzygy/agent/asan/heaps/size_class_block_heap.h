@@ -0,0 +1,196 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares SizeClassBlockHeap, a heap that serves small blocks from slabs of
+// memory grabbed directly from the OS. Each slab is dedicated to a single size
+// class and is carved into equally sized slots. Slots are handed out by bump
+// allocation first, and once a slab has been fully carved, its free slots are
+// found via a bitmap. This avoids the free-list management of the Windows
+// heaps, which scales badly with the allocation patterns of instrumented
+// processes.
+//
+// Slabs are aligned on their size, so the slab owning an address is found
+// by masking it, and the blocks living in a slab all sit at multiples of the
+// slot size from its beginning.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAPS_SIZE_CLASS_BLOCK_HEAP_H_
+#define SYZYGY_AGENT_ASAN_HEAPS_SIZE_CLASS_BLOCK_HEAP_H_
+
+#include <unordered_map>
+
+#include "syzygy/agent/asan/allocators.h"
+#include "syzygy/agent/asan/heap.h"
+#include "syzygy/common/recursive_lock.h"
+
+namespace agent {
+namespace asan {
+
+class MemoryNotifierInterface;
+
+namespace heaps {
+
+class SizeClassBlockHeap : public BlockHeapInterface {
+ public:
+  // The size of a slab. This is the allocation granularity of VirtualAlloc,
+  // which guarantees that the slabs are aligned on their size.
+  static const uint32_t kSlabSize = 64 * 1024;
+
+  // The largest allocation that this heap serves.
+  static const uint32_t kMaxAllocationSize = 4096;
+
+  // The number of size classes. The sizes up to 128 bytes are stepped by 16
+  // bytes, and each power of two range above that is split in 4 classes.
+  static const size_t kSizeClassCount = 28;
+
+  // Constructor.
+  // @param memory_notifier The memory notifier to use.
+  // @param internal_heap The heap to use for making internal allocations.
+  SizeClassBlockHeap(MemoryNotifierInterface* memory_notifier,
+                     HeapInterface* internal_heap);
+
+  // Virtual destructor.
+  virtual ~SizeClassBlockHeap();
+
+  // @name HeapInterface implementation.
+  // @{
+  virtual HeapType GetHeapType() const;
+  virtual uint32_t GetHeapFeatures() const;
+  virtual void* Allocate(uint32_t bytes);
+  virtual bool Free(void* alloc);
+  virtual bool IsAllocated(const void* alloc);
+  virtual uint32_t GetAllocationSize(const void* alloc);
+  virtual void Lock();
+  virtual void Unlock();
+  virtual bool TryLock();
+  // @}
+
+  // @name BlockHeapInterface implementation.
+  // @{
+  virtual void* AllocateBlock(uint32_t size,
+                              uint32_t min_left_redzone_size,
+                              uint32_t min_right_redzone_size,
+                              BlockLayout* layout);
+  virtual bool FreeBlock(const BlockInfo& block_info);
+  // @}
+
+  // Maps an allocation size to its size class.
+  // @param size The size of an allocation. Must be no greater than
+  //     kMaxAllocationSize.
+  // @returns the smallest size class able to hold @p size bytes.
+  static size_t GetSizeClass(uint32_t size);
+
+  // @param size_class A size class.
+  // @returns the size of the slots of @p size_class.
+  static uint32_t GetSizeClassSize(size_t size_class);
+
+  // @returns the number of active allocations in this heap.
+  size_t size() const;
+
+  // @returns the number of slabs owned by this heap.
+  size_t slab_count() const;
+
+ protected:
+  // The number of 32-bit words needed to track the slots of a slab of the
+  // smallest size class.
+  static const size_t kBitmapWordCount = kSlabSize / 16 / 32;
+
+  // Describes a slab. These live in the internal heap, so that the slabs only
+  // contain blocks.
+  struct Slab {
+    // The address of the slab.
+    uint8_t* address;
+    // The size class of the slab, and the resulting size and number of its
+    // slots.
+    size_t size_class;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    // The slots at and after this index have never been allocated.
+    uint32_t bump_index;
+    // The number of allocated slots.
+    uint32_t allocated_count;
+    // The index of the first bitmap word that may have a free slot below
+    // |bump_index|.
+    uint32_t first_free_word;
+    // Links in the list of the partially allocated slabs of the size class.
+    Slab* prev;
+    Slab* next;
+    bool in_partial_list;
+    // A set bit indicates that the matching slot is allocated.
+    uint32_t bitmap[kBitmapWordCount];
+  };
+
+  // Finds the slab and the slot holding an allocation. Under lock_.
+  // @param alloc The address of the allocation.
+  // @param slot Will receive the index of the slot of @p alloc.
+  // @returns the slab holding @p alloc, or nullptr if @p alloc is not the
+  //     beginning of an allocated slot of this heap.
+  Slab* LookupAllocation(const void* alloc, uint32_t* slot) const;
+
+  // Allocates a slot from a slab. Under lock_.
+  // @param slab The slab to allocate from. Must not be full.
+  // @returns the address of the slot.
+  void* AllocateFromSlab(Slab* slab);
+
+  // Creates a new slab for a size class, and links it in front of the
+  // partial list of the size class. Under lock_.
+  // @param size_class The size class of the slab.
+  // @returns the new slab, or nullptr on failure.
+  Slab* CreateSlab(size_t size_class);
+
+  // Returns a slab to the OS. Under lock_.
+  // @param slab The slab to release. Must not have any allocated slot.
+  void ReleaseSlab(Slab* slab);
+
+  // @name Partial list management. Under lock_.
+  // @{
+  void LinkSlab(Slab* slab);
+  void UnlinkSlab(Slab* slab);
+  // @}
+
+  // Frees all the slabs owned by this heap.
+  void FreeAllSlabs();
+
+  // The slabs owned by this heap, by address.
+  typedef std::unordered_map<const void*,
+                             Slab*,
+                             std::hash<const void*>,
+                             std::equal_to<const void*>,
+                             HeapAllocator<std::pair<const void* const, Slab*>>>
+      SlabMap;
+  SlabMap slabs_;  // Under lock_.
+
+  // The head of the list of partially allocated slabs, for each size class.
+  Slab* partial_slabs_[kSizeClassCount];  // Under lock_.
+
+  // The number of active allocations.
+  size_t allocation_count_;  // Under lock_.
+
+  // The global lock for this allocator.
+  mutable ::common::RecursiveLock lock_;
+
+  // The memory notifier in use.
+  MemoryNotifierInterface* memory_notifier_;
+
+  // The heap used for the slab descriptors.
+  HeapInterface* internal_heap_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SizeClassBlockHeap);
+};
+
+}  // namespace heaps
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAPS_SIZE_CLASS_BLOCK_HEAP_H_
@@ -0,0 +1,239 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heaps/size_class_block_heap.h"
+
+#include <set>
+#include <vector>
+
+#include "syzygy/agent/asan/unittest_util.h"
+#include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
+
+namespace agent {
+namespace asan {
+namespace heaps {
+
+namespace {
+
+testing::DummyHeap dummy_heap;
+agent::asan::memory_notifiers::NullMemoryNotifier dummy_notifier;
+
+// A SizeClassBlockHeap that uses a null memory notifier.
+class TestSizeClassBlockHeap : public SizeClassBlockHeap {
+ public:
+  using SizeClassBlockHeap::FreeAllSlabs;
+
+  TestSizeClassBlockHeap() : SizeClassBlockHeap(&dummy_notifier, &dummy_heap) {
+  }
+};
+
+}  // namespace
+
+TEST(SizeClassBlockHeapTest, GetHeapTypeIsValid) {
+  TestSizeClassBlockHeap h;
+  EXPECT_EQ(kSizeClassBlockHeap, h.GetHeapType());
+}
+
+TEST(SizeClassBlockHeapTest, FeaturesAreValid) {
+  TestSizeClassBlockHeap h;
+  EXPECT_EQ(HeapInterface::kHeapSupportsIsAllocated |
+                HeapInterface::kHeapSupportsGetAllocationSize |
+                HeapInterface::kHeapGetAllocationSizeIsUpperBound |
+                HeapInterface::kHeapReportsReservations,
+            h.GetHeapFeatures());
+}
+
+TEST(SizeClassBlockHeapTest, SizeClasses) {
+  const uint32_t kMaxAllocationSize = SizeClassBlockHeap::kMaxAllocationSize;
+  EXPECT_EQ(0u, SizeClassBlockHeap::GetSizeClass(0));
+  EXPECT_EQ(0u, SizeClassBlockHeap::GetSizeClass(16));
+  EXPECT_EQ(1u, SizeClassBlockHeap::GetSizeClass(17));
+  EXPECT_EQ(SizeClassBlockHeap::kSizeClassCount - 1,
+            SizeClassBlockHeap::GetSizeClass(kMaxAllocationSize));
+  EXPECT_EQ(kMaxAllocationSize,
+            SizeClassBlockHeap::GetSizeClassSize(
+                SizeClassBlockHeap::kSizeClassCount - 1));
+
+  // The size classes are increasing multiples of kShadowRatio, and each size
+  // maps to the smallest class that can hold it.
+  uint32_t previous_size = 0;
+  for (size_t i = 0; i < SizeClassBlockHeap::kSizeClassCount; ++i) {
+    uint32_t size = SizeClassBlockHeap::GetSizeClassSize(i);
+    EXPECT_LT(previous_size, size);
+    EXPECT_EQ(0u, size % kShadowRatio);
+    EXPECT_EQ(i, SizeClassBlockHeap::GetSizeClass(size));
+    EXPECT_EQ(i, SizeClassBlockHeap::GetSizeClass(previous_size + 1));
+    previous_size = size;
+  }
+}
+
+TEST(SizeClassBlockHeapTest, EndToEnd) {
+  TestSizeClassBlockHeap h;
+  EXPECT_EQ(0u, h.size());
+
+  BlockLayout layout = {};
+  BlockInfo block = {};
+
+  // Allocate and free a zero-sized allocation. This should succeed by
+  // definition.
+  void* alloc = h.AllocateBlock(0, 0, 0, &layout);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  EXPECT_EQ(1u, h.size());
+  BlockInitialize(layout, alloc, &block);
+  EXPECT_TRUE(h.FreeBlock(block));
+  EXPECT_EQ(0u, h.size());
+
+  // Make a bunch of different sized allocations. The blocks exactly fill
+  // their slots.
+  std::vector<BlockInfo> blocks;
+  for (uint32_t i = 1; i < 4000; i = i * 3 + 1) {
+    alloc = h.AllocateBlock(i, 0, 0, &layout);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(alloc) % kShadowRatio);
+    EXPECT_EQ(i, layout.body_size);
+    EXPECT_EQ(SizeClassBlockHeap::GetSizeClassSize(
+                  SizeClassBlockHeap::GetSizeClass(layout.block_size)),
+              layout.block_size);
+    EXPECT_EQ(layout.block_size, h.GetAllocationSize(alloc));
+    BlockInitialize(layout, alloc, &block);
+    blocks.push_back(block);
+  }
+  EXPECT_EQ(blocks.size(), h.size());
+
+  // Now free them.
+  for (const auto& block : blocks)
+    EXPECT_TRUE(h.FreeBlock(block));
+  EXPECT_EQ(0u, h.size());
+}
+
+TEST(SizeClassBlockHeapTest, AllocateBlockFailsForLargeAllocations) {
+  TestSizeClassBlockHeap h;
+  BlockLayout layout = {};
+  EXPECT_EQ(static_cast<void*>(nullptr),
+            h.AllocateBlock(SizeClassBlockHeap::kMaxAllocationSize, 0, 0,
+                            &layout));
+  EXPECT_EQ(static_cast<void*>(nullptr),
+            h.Allocate(SizeClassBlockHeap::kMaxAllocationSize + 1));
+  EXPECT_EQ(0u, h.slab_count());
+}
+
+TEST(SizeClassBlockHeapTest, ZeroSizedAllocationsHaveDistinctAddresses) {
+  TestSizeClassBlockHeap h;
+
+  void* a1 = h.Allocate(0);
+  EXPECT_NE(static_cast<void*>(nullptr), a1);
+  void* a2 = h.Allocate(0);
+  EXPECT_NE(static_cast<void*>(nullptr), a2);
+  EXPECT_NE(a1, a2);
+  EXPECT_TRUE(h.Free(a1));
+  EXPECT_TRUE(h.Free(a2));
+}
+
+TEST(SizeClassBlockHeapTest, FreedSlotsAreReused) {
+  TestSizeClassBlockHeap h;
+  const uint32_t kAllocSize = 100;
+  const size_t kSlotCount = SizeClassBlockHeap::kSlabSize /
+      SizeClassBlockHeap::GetSizeClassSize(
+          SizeClassBlockHeap::GetSizeClass(kAllocSize));
+
+  // Fill a slab.
+  std::vector<void*> allocs;
+  for (size_t i = 0; i < kSlotCount; ++i) {
+    allocs.push_back(h.Allocate(kAllocSize));
+    ASSERT_NE(static_cast<void*>(nullptr), allocs.back());
+  }
+  EXPECT_EQ(1u, h.slab_count());
+
+  // Punch holes in it, they should be handed back before a new slab is
+  // created.
+  std::set<void*> holes;
+  for (size_t i = 1; i < kSlotCount; i += 7) {
+    EXPECT_TRUE(h.Free(allocs[i]));
+    holes.insert(allocs[i]);
+  }
+  for (size_t i = 1; i < kSlotCount; i += 7) {
+    void* alloc = h.Allocate(kAllocSize);
+    EXPECT_EQ(1u, holes.erase(alloc));
+  }
+  EXPECT_TRUE(holes.empty());
+  EXPECT_EQ(1u, h.slab_count());
+
+  // The slab is full again.
+  void* alloc = h.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  EXPECT_EQ(2u, h.slab_count());
+
+  // Emptying a slab returns it to the OS, except for the last one.
+  for (void* a : allocs)
+    EXPECT_TRUE(h.Free(a));
+  EXPECT_EQ(1u, h.slab_count());
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(1u, h.slab_count());
+  EXPECT_EQ(0u, h.size());
+}
+
+TEST(SizeClassBlockHeapTest, IsAllocated) {
+  TestSizeClassBlockHeap h;
+
+  EXPECT_FALSE(h.IsAllocated(NULL));
+
+  void* a = h.Allocate(100);
+  EXPECT_TRUE(h.IsAllocated(a));
+  EXPECT_FALSE(h.IsAllocated(reinterpret_cast<uint8_t*>(a) - 1));
+  EXPECT_FALSE(h.IsAllocated(reinterpret_cast<uint8_t*>(a) + 1));
+
+  // The neighbouring slot isn't allocated.
+  EXPECT_FALSE(h.IsAllocated(reinterpret_cast<uint8_t*>(a) +
+                             h.GetAllocationSize(a)));
+
+  EXPECT_TRUE(h.Free(a));
+  EXPECT_FALSE(h.IsAllocated(a));
+  EXPECT_FALSE(h.Free(a));
+}
+
+TEST(SizeClassBlockHeapTest, GetAllocationSize) {
+  TestSizeClassBlockHeap h;
+
+  void* alloc = h.Allocate(67);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  EXPECT_EQ(SizeClassBlockHeap::GetSizeClassSize(
+                SizeClassBlockHeap::GetSizeClass(67)),
+            h.GetAllocationSize(alloc));
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(HeapInterface::kUnknownSize, h.GetAllocationSize(alloc));
+}
+
+TEST(SizeClassBlockHeapTest, Lock) {
+  TestSizeClassBlockHeap h;
+
+  h.Lock();
+  EXPECT_TRUE(h.TryLock());
+  h.Unlock();
+  h.Unlock();
+}
+
+TEST(SizeClassBlockHeapTest, FreeAllSlabs) {
+  const size_t kAllocCount = 10;
+  TestSizeClassBlockHeap h;
+  for (size_t i = 0; i < kAllocCount; ++i)
+    h.Allocate(static_cast<uint32_t>(42 * i));
+  EXPECT_EQ(kAllocCount, h.size());
+  h.FreeAllSlabs();
+  EXPECT_EQ(0U, h.size());
+  EXPECT_EQ(0U, h.slab_count());
+}
+
+}  // namespace heaps
+}  // namespace asan
+}  // namespace agent
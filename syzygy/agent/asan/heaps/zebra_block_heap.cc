@@ -31,36 +31,40 @@ const size_t ZebraBlockHeap::kMaximumBlockAllocationSize =
     GetPageSize() - sizeof(BlockHeader);
 
 ZebraBlockHeap::ZebraBlockHeap(size_t heap_size,
+                               size_t max_heap_size,
                                MemoryNotifierInterface* memory_notifier,
                                HeapInterface* internal_heap)
     : heap_address_(NULL),
-      // Makes the heap_size a multiple of kSlabSize to avoid incomplete slabs
-      // at the end of the reserved memory.
-      heap_size_(::common::AlignUp(heap_size, kSlabSize)),
-      slab_count_(heap_size_ / kSlabSize),
-      slab_info_(HeapAllocator<SlabInfo>(internal_heap)),
+      // Makes the region size a multiple of kSlabSize to avoid incomplete
+      // slabs at the end of the regions.
+      region_size_(::common::AlignUp(heap_size, kSlabSize)),
+      slabs_per_region_(region_size_ / kSlabSize),
+      max_region_count_(std::max<size_t>(
+          1, (max_heap_size + region_size_ - 1) / region_size_)),
+      heap_size_(0),
+      slab_count_(0),
       quarantine_ratio_(::common::kDefaultZebraBlockHeapQuarantineRatio),
-      free_slabs_(slab_count_,
-                  HeapAllocator<size_t>(internal_heap)),
-      quarantine_(slab_count_,
+      free_slabs_(slabs_per_region_ * max_region_count_,
                   HeapAllocator<size_t>(internal_heap)),
-      memory_notifier_(memory_notifier) {
+      region_info_(HeapAllocator<RegionInfo>(internal_heap)),
+      trim_queue_(max_region_count_, HeapAllocator<size_t>(internal_heap)),
+      quarantine_size_(0),
+      slab_info_(HeapAllocator<SlabInfo>(internal_heap)),
+      memory_notifier_(memory_notifier),
+      internal_heap_(internal_heap) {
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
 
-  // Allocate the chunk of memory directly from the OS.
+  // Reserve the address space of all the regions directly from the OS, and
+  // commit the first one.
   heap_address_ = static_cast<uint8_t*>(::VirtualAlloc(
-      NULL, heap_size_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+      NULL, region_size_ * max_region_count_, MEM_RESERVE, PAGE_READWRITE));
   CHECK_NE(static_cast<uint8_t*>(nullptr), heap_address_);
   DCHECK(::common::IsAligned(heap_address_, GetPageSize()));
-  memory_notifier_->NotifyFutureHeapUse(heap_address_, heap_size_);
 
-  // Initialize the metadata describing the state of our heap.
-  slab_info_.resize(slab_count_);
-  for (size_t i = 0; i < slab_count_; ++i) {
-    slab_info_[i].state = kFreeSlab;
-    ::memset(&slab_info_[i].info, 0, sizeof(slab_info_[i].info));
-    free_slabs_.push(i);
-  }
+  // The metadata is never reallocated, so that growing doesn't move it.
+  slab_info_.reserve(slabs_per_region_ * max_region_count_);
+  region_info_.reserve(max_region_count_);
+  CHECK(Grow());
 }
 
 ZebraBlockHeap::~ZebraBlockHeap() {
@@ -223,8 +227,11 @@ PushResult ZebraBlockHeap::Push(const CompactBlockInfo& info) {
     return result;
   }
 
-  quarantine_.push(slab_index);
+  size_t region_index = slab_index / slabs_per_region_;
+  region_info_[region_index].quarantine.push(slab_index);
+  ++quarantine_size_;
   slab_info_[slab_index].state = kQuarantinedSlab;
+  MaybeQueueRegionForTrimming(region_index);
   result.push_successful = true;
   result.trim_status |= TrimStatusBits::SYNC_TRIM_REQUIRED;
   return result;
@@ -233,37 +240,63 @@ PushResult ZebraBlockHeap::Push(const CompactBlockInfo& info) {
 PopResult ZebraBlockHeap::Pop(CompactBlockInfo* info) {
   ::common::AutoRecursiveLock lock(lock_);
   PopResult result = {false, TrimColor::GREEN};
-  if (QuarantineInvariantIsSatisfied())
-    return result;
 
-  size_t slab_index = quarantine_.front();
-  DCHECK_NE(kInvalidSlabIndex, slab_index);
-  quarantine_.pop();
+  // Find the oldest region that doesn't satisfy the invariant. The regions
+  // may have been brought back in line by a change of the ratio since they
+  // were queued.
+  while (!trim_queue_.empty()) {
+    size_t region_index = trim_queue_.front();
+    RegionInfo* region_info = &region_info_[region_index];
+    DCHECK(region_info->in_trim_queue);
+    if (RegionQuarantineInvariantIsSatisfied(region_index)) {
+      trim_queue_.pop();
+      region_info->in_trim_queue = false;
+      continue;
+    }
+
+    size_t slab_index = region_info->quarantine.front();
+    DCHECK_NE(kInvalidSlabIndex, slab_index);
+    region_info->quarantine.pop();
+    --quarantine_size_;
 
-  DCHECK_EQ(kQuarantinedSlab, slab_info_[slab_index].state);
-  slab_info_[slab_index].state = kAllocatedSlab;
-  *info = slab_info_[slab_index].info;
+    DCHECK_EQ(kQuarantinedSlab, slab_info_[slab_index].state);
+    slab_info_[slab_index].state = kAllocatedSlab;
+    *info = slab_info_[slab_index].info;
+
+    if (RegionQuarantineInvariantIsSatisfied(region_index)) {
+      trim_queue_.pop();
+      region_info->in_trim_queue = false;
+    }
+
+    result.pop_successful = true;
+    return result;
+  }
 
-  result.pop_successful = true;
   return result;
 }
 
 void ZebraBlockHeap::Empty(ObjectVector* infos) {
   ::common::AutoRecursiveLock lock(lock_);
-  while (!quarantine_.empty()) {
-    size_t slab_index = quarantine_.front();
-    DCHECK_NE(kInvalidSlabIndex, slab_index);
-    quarantine_.pop();
-
-    // Do not free the slab, only release it from the quarantine.
-    slab_info_[slab_index].state = kAllocatedSlab;
-    infos->push_back(slab_info_[slab_index].info);
+  for (auto& region_info : region_info_) {
+    while (!region_info.quarantine.empty()) {
+      size_t slab_index = region_info.quarantine.front();
+      DCHECK_NE(kInvalidSlabIndex, slab_index);
+      region_info.quarantine.pop();
+
+      // Do not free the slab, only release it from the quarantine.
+      slab_info_[slab_index].state = kAllocatedSlab;
+      infos->push_back(slab_info_[slab_index].info);
+    }
+    region_info.in_trim_queue = false;
   }
+  while (!trim_queue_.empty())
+    trim_queue_.pop();
+  quarantine_size_ = 0;
 }
 
 size_t ZebraBlockHeap::GetCountForTesting() {
   ::common::AutoRecursiveLock lock(lock_);
-  return quarantine_.size();
+  return quarantine_size_;
 }
 
 void ZebraBlockHeap::set_quarantine_ratio(float quarantine_ratio) {
@@ -271,6 +304,15 @@ void ZebraBlockHeap::set_quarantine_ratio(float quarantine_ratio) {
   DCHECK_GE(1, quarantine_ratio);
   ::common::AutoRecursiveLock lock(lock_);
   quarantine_ratio_ = quarantine_ratio;
+
+  // Lowering the ratio can break the invariant of regions.
+  for (size_t i = 0; i < region_info_.size(); ++i)
+    MaybeQueueRegionForTrimming(i);
+}
+
+size_t ZebraBlockHeap::region_count() const {
+  ::common::AutoRecursiveLock lock(lock_);
+  return region_info_.size();
 }
 
 ZebraBlockHeap::SlabInfo* ZebraBlockHeap::AllocateImpl(uint32_t bytes) {
@@ -279,7 +321,7 @@ ZebraBlockHeap::SlabInfo* ZebraBlockHeap::AllocateImpl(uint32_t bytes) {
     return NULL;
   ::common::AutoRecursiveLock lock(lock_);
 
-  if (free_slabs_.empty())
+  if (free_slabs_.empty() && !Grow())
     return NULL;
 
   size_t slab_index = free_slabs_.front();
@@ -305,11 +347,61 @@ ZebraBlockHeap::SlabInfo* ZebraBlockHeap::AllocateImpl(uint32_t bytes) {
 }
 
 bool ZebraBlockHeap::QuarantineInvariantIsSatisfied() {
-  return quarantine_.empty() ||
-         (quarantine_.size() / static_cast<float>(slab_count_) <=
+  ::common::AutoRecursiveLock lock(lock_);
+  for (size_t i = 0; i < region_info_.size(); ++i) {
+    if (!RegionQuarantineInvariantIsSatisfied(i))
+      return false;
+  }
+  return true;
+}
+
+bool ZebraBlockHeap::RegionQuarantineInvariantIsSatisfied(
+    size_t region_index) {
+  DCHECK_LT(region_index, region_info_.size());
+  const SlabIndexQueue& quarantine = region_info_[region_index].quarantine;
+  return quarantine.empty() ||
+         (quarantine.size() / static_cast<float>(slabs_per_region_) <=
              quarantine_ratio_);
 }
 
+void ZebraBlockHeap::MaybeQueueRegionForTrimming(size_t region_index) {
+  DCHECK_LT(region_index, region_info_.size());
+  RegionInfo* region_info = &region_info_[region_index];
+  if (region_info->in_trim_queue ||
+      RegionQuarantineInvariantIsSatisfied(region_index)) {
+    return;
+  }
+  CHECK(trim_queue_.push(region_index));
+  region_info->in_trim_queue = true;
+}
+
+bool ZebraBlockHeap::Grow() {
+  if (region_info_.size() == max_region_count_)
+    return false;
+
+  uint8_t* region_address = heap_address_ + heap_size_;
+  if (::VirtualAlloc(region_address, region_size_, MEM_COMMIT,
+                     PAGE_READWRITE) == nullptr) {
+    return false;
+  }
+  memory_notifier_->NotifyFutureHeapUse(region_address, region_size_);
+
+  // Initialize the metadata describing the state of the new slabs.
+  size_t first_slab = slab_count_;
+  slab_count_ += slabs_per_region_;
+  heap_size_ += region_size_;
+  slab_info_.resize(slab_count_);
+  for (size_t i = first_slab; i < slab_count_; ++i) {
+    slab_info_[i].state = kFreeSlab;
+    ::memset(&slab_info_[i].info, 0, sizeof(slab_info_[i].info));
+    free_slabs_.push(i);
+  }
+  region_info_.push_back(
+      RegionInfo(slabs_per_region_, HeapAllocator<size_t>(internal_heap_)));
+
+  return true;
+}
+
 uint8_t* ZebraBlockHeap::GetSlabAddress(size_t index) {
   if (index >= slab_count_)
     return NULL;
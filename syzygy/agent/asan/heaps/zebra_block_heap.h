@@ -67,6 +67,13 @@ namespace heaps {
 // |-header-|                |-body-|                            |-trailer-|
 //
 // Calling Free on a quarantined address is an invalid operation.
+//
+// The heap starts with a single region of slabs, and grows by committing more
+// regions when it runs out of free slabs, up to a maximum size. The address
+// space of all the regions is reserved up front so that the slab holding an
+// address is found with simple arithmetic. The quarantine ratio is enforced
+// for each region independently, so that a region filled with quarantined
+// blocks gets trimmed even though the heap as a whole has room to spare.
 class ZebraBlockHeap : public BlockHeapInterface,
                        public BlockQuarantineInterface {
  public:
@@ -82,11 +89,15 @@ class ZebraBlockHeap : public BlockHeapInterface,
   static const size_t kMaximumBlockAllocationSize;
 
   // Constructor.
-  // @param heap_size The amount of memory reserved by the heap in bytes.
+  // @param heap_size The amount of memory committed by the heap in bytes. This
+  //     is also the size of the regions added when the heap grows.
+  // @param max_heap_size The amount of memory the heap may grow to in bytes.
+  //     A value no greater than @p heap_size disables growth.
   // @param memory_notifier The MemoryNotifierInterface used to report
   //     allocation information.
   // @param internal_heap The heap to use for making internal allocations.
   ZebraBlockHeap(size_t heap_size,
+                 size_t max_heap_size,
                  MemoryNotifierInterface* memory_notifier,
                  HeapInterface* internal_heap);
 
@@ -138,6 +149,12 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // Set the ratio of the memory used by the quarantine.
   void set_quarantine_ratio(float quarantine_ratio);
 
+  // @returns the number of regions currently committed.
+  size_t region_count() const;
+
+  // @returns the maximum number of regions.
+  size_t max_region_count() const { return max_region_count_; }
+
  protected:
   // The set of possible states of the slabs.
   enum SlabState {
@@ -153,6 +170,20 @@ class ZebraBlockHeap : public BlockHeapInterface,
     CompactBlockInfo info;
   };
 
+  typedef CircularQueue<size_t, HeapAllocator<size_t>> SlabIndexQueue;
+
+  // Describes a region of slabs.
+  struct RegionInfo {
+    RegionInfo(size_t slab_count, const HeapAllocator<size_t>& alloc)
+        : quarantine(slab_count, alloc), in_trim_queue(false) {
+    }
+
+    // Holds the indices of the quarantined slabs of the region.
+    SlabIndexQueue quarantine;
+    // Indicates whether the region is in |trim_queue_|.
+    bool in_trim_queue;
+  };
+
   // Performs an allocation, and returns a pointer to the SlabInfo where the
   // allocation was made.
   SlabInfo* AllocateImpl(uint32_t bytes);
@@ -161,6 +192,20 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // @returns true if the quarantine invariant is satisfied, false otherwise.
   bool QuarantineInvariantIsSatisfied();
 
+  // Checks if the quarantine invariant is satisfied by a region. Under lock_.
+  // @param region_index The index of the region.
+  // @returns true if the quarantine invariant is satisfied, false otherwise.
+  bool RegionQuarantineInvariantIsSatisfied(size_t region_index);
+
+  // Queues a region for trimming if it doesn't satisfy the quarantine
+  // invariant. Under lock_.
+  // @param region_index The index of the region.
+  void MaybeQueueRegionForTrimming(size_t region_index);
+
+  // Commits a new region and makes its slabs available. Under lock_.
+  // @returns true on success, false if the heap can't grow anymore.
+  bool Grow();
+
   // Gives the 0-based index of the slab containing 'address'.
   // @param address address.
   // @returns The 0-based index of the slab containing 'address', or
@@ -175,25 +220,40 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // Defines an invalid slab index.
   static const size_t kInvalidSlabIndex = SIZE_MAX;
 
-  // Heap memory address.
+  // Heap memory address. This is the beginning of the reservation holding all
+  // the regions.
   uint8_t* heap_address_;
 
-  // The heap size in bytes.
+  // The size of a region in bytes, and the number of slabs it holds.
+  size_t region_size_;
+  size_t slabs_per_region_;
+
+  // The maximum number of regions.
+  size_t max_region_count_;
+
+  // The size of the committed regions in bytes. Under lock_.
   size_t heap_size_;
 
-  // The total number of slabs.
+  // The total number of slabs in the committed regions. Under lock_.
   size_t slab_count_;
 
   // The ratio [0 .. 1] of the memory used by the quarantine. Under lock_.
   float quarantine_ratio_;
 
-  typedef CircularQueue<size_t, HeapAllocator<size_t>> SlabIndexQueue;
-
   // Holds the indices of free slabs. Under lock_.
   SlabIndexQueue free_slabs_;
 
-  // Holds the indices of the quarantined slabs. Under lock_.
-  SlabIndexQueue quarantine_;
+  typedef std::vector<RegionInfo, HeapAllocator<RegionInfo>> RegionInfoVector;
+
+  // Holds the information related to the committed regions. Under lock_.
+  RegionInfoVector region_info_;
+
+  // Holds the indices of the regions that may not satisfy the quarantine
+  // invariant, in the order they got there. Under lock_.
+  SlabIndexQueue trim_queue_;
+
+  // The total number of quarantined slabs. Under lock_.
+  size_t quarantine_size_;
 
   typedef std::vector<SlabInfo,
                       HeapAllocator<SlabInfo>> SlabInfoVector;
@@ -205,8 +265,11 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // locking.
   MemoryNotifierInterface* memory_notifier_;
 
+  // The heap used for making internal allocations.
+  HeapInterface* internal_heap_;
+
   // The global lock for this allocator.
-  ::common::RecursiveLock lock_;
+  mutable ::common::RecursiveLock lock_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ZebraBlockHeap);
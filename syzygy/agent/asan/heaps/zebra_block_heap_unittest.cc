@@ -48,19 +48,28 @@ class TestZebraBlockHeap : public ZebraBlockHeap {
   using ZebraBlockHeap::QuarantineInvariantIsSatisfied;
   using ZebraBlockHeap::heap_address_;
   using ZebraBlockHeap::slab_count_;
+  using ZebraBlockHeap::slabs_per_region_;
 
   static const size_t kInitialHeapSize = 8 * (1 << 20);
 
   // Creates a test heap with 8 MB initial (and maximum) memory using the
   // default memory notifier.
   TestZebraBlockHeap() : ZebraBlockHeap(kInitialHeapSize,
+                                        0,
                                         &null_notifier,
                                         &dummy_heap) { }
 
   // Creates a test heap with 8 MB initial (and maximum) memory using a custom
   // memory notifier.
   explicit TestZebraBlockHeap(MemoryNotifierInterface* memory_notifier)
-      : ZebraBlockHeap(kInitialHeapSize, memory_notifier, &dummy_heap) { }
+      : ZebraBlockHeap(kInitialHeapSize, 0, memory_notifier, &dummy_heap) { }
+
+  // Creates a test heap with 8 MB initial memory, that can grow to @p
+  // max_heap_size.
+  TestZebraBlockHeap(size_t max_heap_size,
+                     MemoryNotifierInterface* memory_notifier)
+      : ZebraBlockHeap(kInitialHeapSize, max_heap_size, memory_notifier,
+                       &dummy_heap) { }
 
   // Allows to know if the heap can handle more allocations.
   // @returns true if the heap is full (no more allocations allowed),
@@ -464,6 +473,97 @@ TEST(ZebraBlockHeapTest, MemoryNotifierIsCalled) {
   h.Allocate(10);
 }
 
+TEST(ZebraBlockHeapTest, GrowsWhenFull) {
+  const size_t kRegionSize = TestZebraBlockHeap::kInitialHeapSize;
+  testing::MockMemoryNotifier mock_notifier;
+
+  // Should be called once per committed region, and once in the destructor.
+  EXPECT_CALL(mock_notifier, NotifyFutureHeapUse(NotNull(), kRegionSize))
+      .Times(2);
+  EXPECT_CALL(mock_notifier, NotifyReturnedToOS(NotNull(), 2 * kRegionSize))
+      .Times(1);
+
+  TestZebraBlockHeap h(2 * kRegionSize, &mock_notifier);
+  EXPECT_EQ(1u, h.region_count());
+  EXPECT_EQ(2u, h.max_region_count());
+
+  // Fill the first region, the next allocation adds a region.
+  std::vector<void*> allocs;
+  size_t slabs_per_region = h.slabs_per_region_;
+  for (size_t i = 0; i < slabs_per_region; ++i) {
+    allocs.push_back(h.Allocate(0xFF));
+    ASSERT_NE(static_cast<void*>(nullptr), allocs.back());
+  }
+  EXPECT_EQ(1u, h.region_count());
+  allocs.push_back(h.Allocate(0xFF));
+  ASSERT_NE(static_cast<void*>(nullptr), allocs.back());
+  EXPECT_EQ(2u, h.region_count());
+  EXPECT_EQ(2 * slabs_per_region, h.slab_count_);
+
+  // The new region is usable.
+  EXPECT_TRUE(h.IsAllocated(allocs.back()));
+  EXPECT_EQ(0xFFu, h.GetAllocationSize(allocs.back()));
+
+  // Fill the second region, the heap can't grow anymore.
+  for (size_t i = 1; i < slabs_per_region; ++i) {
+    allocs.push_back(h.Allocate(0xFF));
+    ASSERT_NE(static_cast<void*>(nullptr), allocs.back());
+  }
+  EXPECT_EQ(static_cast<void*>(nullptr), h.Allocate(0xFF));
+  EXPECT_EQ(2u, h.region_count());
+
+  for (void* alloc : allocs)
+    EXPECT_TRUE(h.Free(alloc));
+}
+
+TEST(ZebraBlockHeapTest, QuarantineRatioIsPerRegion) {
+  TestZebraBlockHeap h(2 * TestZebraBlockHeap::kInitialHeapSize,
+                       &null_notifier);
+  h.set_quarantine_ratio(0.5f);
+  size_t slabs_per_region = h.slabs_per_region_;
+
+  // Fill both regions.
+  std::vector<CompactBlockInfo> blocks;
+  for (size_t i = 0; i < 2 * slabs_per_region; ++i) {
+    BlockLayout layout = {};
+    BlockInfo block = {};
+    void* alloc = h.AllocateBlock(0xFF, 0, 0, &layout);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+    BlockInitialize(layout, alloc, &block);
+    CompactBlockInfo compact = {};
+    ConvertBlockInfo(block, &compact);
+    blocks.push_back(compact);
+  }
+  EXPECT_EQ(2u, h.region_count());
+
+  // Quarantine all the blocks of the first region. This represents a quarter
+  // of the heap, but the region itself is over its ratio.
+  for (size_t i = 0; i < slabs_per_region; ++i)
+    EXPECT_TRUE(h.Push(blocks[i]).push_successful);
+  EXPECT_FALSE(h.QuarantineInvariantIsSatisfied());
+
+  // Trimming pops the oldest blocks of the first region until it is back
+  // under its ratio.
+  CompactBlockInfo info = {};
+  size_t pop_count = 0;
+  while (h.Pop(&info).pop_successful) {
+    EXPECT_EQ(blocks[pop_count].header, info.header);
+    ++pop_count;
+  }
+  EXPECT_TRUE(h.QuarantineInvariantIsSatisfied());
+  EXPECT_EQ(slabs_per_region - slabs_per_region / 2, pop_count);
+  EXPECT_EQ(slabs_per_region / 2, h.GetCountForTesting());
+
+  // Lowering the ratio makes the first region trimmable again.
+  h.set_quarantine_ratio(0.0f);
+  EXPECT_FALSE(h.QuarantineInvariantIsSatisfied());
+  while (h.Pop(&info).pop_successful) {}
+  EXPECT_EQ(0u, h.GetCountForTesting());
+
+  for (const auto& block : blocks)
+    EXPECT_TRUE(h.Free(block.header));
+}
+
 TEST(ZebraBlockHeapTest, Lock) {
   TestZebraBlockHeap h;
 
@@ -14,19 +14,44 @@
 
 #include "syzygy/agent/asan/hot_patching_asan_runtime.h"
 
+#include <algorithm>
+
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/win/pe_image.h"
 #include "syzygy/agent/asan/logger.h"
+#include "syzygy/block_graph/hot_patching_metadata.h"
+#include "syzygy/common/align.h"
+#include "syzygy/common/asan_parameters.h"
+#include "syzygy/common/defs.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace agent {
 namespace asan {
 
-HotPatchingAsanRuntime::HotPatchingAsanRuntime() { }
+namespace {
+
+// The flag of SYZYGY_ASAN_OPTIONS that enables the lazy activation.
+const char kLazyHotPatchingFlag[] = "lazy_hot_patching";
+
+size_t GetPageSize() {
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  return system_info.dwPageSize;
+}
+
+}  // namespace
+
+HotPatchingAsanRuntime::HotPatchingAsanRuntime()
+    : lazy_activation_(false), guard_page_handler_(nullptr) {
+}
 
-HotPatchingAsanRuntime::~HotPatchingAsanRuntime() { }
+HotPatchingAsanRuntime::~HotPatchingAsanRuntime() {
+  if (guard_page_handler_ != nullptr)
+    ::RemoveVectoredExceptionHandler(guard_page_handler_);
+}
 
 bool HotPatchingAsanRuntime::HotPatch(HINSTANCE instance) {
   logger_->Write("HPSyzyAsan: Started hot patching. Module: " +
@@ -40,18 +65,105 @@ bool HotPatchingAsanRuntime::HotPatch(HINSTANCE instance) {
   }
   hot_patched_modules_.insert(instance);
 
-  // TODO(cseri): Do the hot patching.
-  logger_->Write("HPSyzyAsan: Hot patching not yet implemented.");
+  PreparedFunctions functions;
+  if (!PrepareModule(instance, &functions)) {
+    logger_->Write("HPSyzyAsan: No valid hot patching metadata, exiting.");
+    return false;
+  }
+  size_t function_count = functions.size();
+
+  base::AutoLock auto_lock(lock_);
+  PreparedFunctions& prepared = prepared_modules_[instance];
+  prepared.swap(functions);
+
+  if (lazy_activation_) {
+    if (guard_page_handler_ == nullptr) {
+      guard_page_handler_ =
+          ::AddVectoredExceptionHandler(TRUE, &GuardPageHandler);
+    }
+    // Fall back to activating everything if the pages can't be armed.
+    if (guard_page_handler_ != nullptr && ArmGuardPages(prepared)) {
+      logger_->Write("HPSyzyAsan: Prepared " + std::to_string(function_count) +
+                     " functions for lazy activation.");
+      return true;
+    }
+    logger_->Write("HPSyzyAsan: Unable to arm the guard pages.");
+  }
+
+  for (auto& function : prepared)
+    ActivateFunction(&function);
 
   return true;
 }
 
+bool HotPatchingAsanRuntime::ActivatePage(const void* address) {
+  const size_t page_size = GetPageSize();
+  const uint8_t* page_begin = ::common::AlignDown(
+      reinterpret_cast<const uint8_t*>(address), page_size);
+  const uint8_t* page_end = page_begin + page_size;
+
+  base::AutoLock auto_lock(lock_);
+  bool found = false;
+  for (auto& module : prepared_modules_) {
+    PreparedFunctions& functions = module.second;
+
+    // Find the first function ending after the beginning of the page. The
+    // functions don't overlap so their ends are sorted as well.
+    auto it = std::lower_bound(
+        functions.begin(), functions.end(), page_begin,
+        [](const PreparedFunction& function, const uint8_t* page_begin) {
+          return function.address + function.code_size <= page_begin;
+        });
+    for (; it != functions.end() && it->address < page_end; ++it) {
+      ActivateFunction(&(*it));
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+void HotPatchingAsanRuntime::OnModuleUnload(HINSTANCE instance) {
+  base::AutoLock auto_lock(lock_);
+  prepared_modules_.erase(instance);
+}
+
 void HotPatchingAsanRuntime::SetUp() {
   SetUpLogger();
 
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  std::string options;
+  if (env.get() != nullptr &&
+      env->GetVar(::common::kSyzyAsanOptionsEnvVar, &options)) {
+    // Prepends the flags with a dummy executable name to keep the
+    // base::CommandLine parser happy.
+    base::CommandLine cmd_line = base::CommandLine::FromString(
+        L"dummy.exe " + base::UTF8ToWide(options));
+    lazy_activation_ = cmd_line.HasSwitch(kLazyHotPatchingFlag);
+  }
+
   logger_->Write("HPSyzyAsan: Runtime loaded.");
 }
 
+size_t HotPatchingAsanRuntime::GetPreparedFunctionCount(HINSTANCE instance) {
+  base::AutoLock auto_lock(lock_);
+  auto it = prepared_modules_.find(instance);
+  if (it == prepared_modules_.end())
+    return 0;
+  return it->second.size();
+}
+
+size_t HotPatchingAsanRuntime::GetActivatedFunctionCount(HINSTANCE instance) {
+  base::AutoLock auto_lock(lock_);
+  auto it = prepared_modules_.find(instance);
+  if (it == prepared_modules_.end())
+    return 0;
+  return std::count_if(it->second.begin(), it->second.end(),
+                       [](const PreparedFunction& function) {
+                         return function.activated;
+                       });
+}
+
 void HotPatchingAsanRuntime::SetUpLogger() {
   // Setup variables we're going to use.
   std::unique_ptr<base::Environment> env(base::Environment::Create());
@@ -68,6 +180,107 @@ void HotPatchingAsanRuntime::SetUpLogger() {
   logger_.reset(client.release());
 }
 
+bool HotPatchingAsanRuntime::PrepareModule(HINSTANCE instance,
+                                           PreparedFunctions* functions) {
+  DCHECK_NE(static_cast<PreparedFunctions*>(nullptr), functions);
+
+  base::win::PEImage image(instance);
+  const IMAGE_SECTION_HEADER* section_header =
+      image.GetImageSectionHeaderByName(
+          ::common::kHotPatchingMetadataSectionName);
+  if (section_header == nullptr)
+    return false;
+
+  const uint8_t* image_base = reinterpret_cast<const uint8_t*>(instance);
+  const uint8_t* section = image_base + section_header->VirtualAddress;
+  size_t section_size = section_header->Misc.VirtualSize;
+
+  typedef block_graph::HotPatchingMetadataHeader Header;
+  typedef block_graph::HotPatchingBlockMetadata BlockMetadata;
+  if (section_size < sizeof(Header))
+    return false;
+  const Header* header = reinterpret_cast<const Header*>(section);
+  if (header->version != block_graph::kHotPatchingMetadataVersion ||
+      (section_size - sizeof(Header)) / sizeof(BlockMetadata) <
+          header->number_of_blocks) {
+    return false;
+  }
+
+  const BlockMetadata* blocks =
+      reinterpret_cast<const BlockMetadata*>(header + 1);
+  functions->clear();
+  functions->reserve(header->number_of_blocks);
+  for (size_t i = 0; i < header->number_of_blocks; ++i) {
+    PreparedFunction function = {image_base + blocks[i].relative_address,
+                                 blocks[i].code_size, false};
+    functions->push_back(function);
+  }
+  std::sort(functions->begin(), functions->end(),
+            [](const PreparedFunction& a, const PreparedFunction& b) {
+              return a.address < b.address;
+            });
+
+  return true;
+}
+
+bool HotPatchingAsanRuntime::ArmGuardPages(
+    const PreparedFunctions& functions) {
+  const size_t page_size = GetPageSize();
+
+  // The functions are sorted so the pages are visited in order, and each of
+  // them is armed only once.
+  const uint8_t* armed_end = nullptr;
+  for (const auto& function : functions) {
+    if (function.code_size == 0)
+      continue;
+    const uint8_t* page = ::common::AlignDown(function.address, page_size);
+    page = std::max(page, armed_end);
+    const uint8_t* end = function.address + function.code_size;
+
+    for (; page < end; page += page_size) {
+      MEMORY_BASIC_INFORMATION info = {};
+      if (::VirtualQuery(page, &info, sizeof(info)) != sizeof(info))
+        return false;
+      DWORD old_protection = 0;
+      if (!::VirtualProtect(const_cast<uint8_t*>(page), page_size,
+                            info.Protect | PAGE_GUARD, &old_protection)) {
+        return false;
+      }
+    }
+    armed_end = page;
+  }
+
+  return true;
+}
+
+void HotPatchingAsanRuntime::ActivateFunction(PreparedFunction* function) {
+  DCHECK_NE(static_cast<PreparedFunction*>(nullptr), function);
+  lock_.AssertAcquired();
+
+  if (function->activated)
+    return;
+  function->activated = true;
+
+  // TODO(cseri): Do the hot patching of |function|.
+}
+
+LONG WINAPI HotPatchingAsanRuntime::GuardPageHandler(
+    EXCEPTION_POINTERS* exception) {
+  const EXCEPTION_RECORD* record = exception->ExceptionRecord;
+  if (record->ExceptionCode != STATUS_GUARD_PAGE_VIOLATION ||
+      record->NumberParameters < 2) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  // The system has already removed the guard from the page. Activate its
+  // functions and resume the faulting instruction.
+  const void* address =
+      reinterpret_cast<const void*>(record->ExceptionInformation[1]);
+  if (!GetInstance()->ActivatePage(address))
+    return EXCEPTION_CONTINUE_SEARCH;
+  return EXCEPTION_CONTINUE_EXECUTION;
+}
+
 void WINAPI HotPatchingAsanRuntime::DllMainEntryHook(
     agent::EntryFrame* entry_frame,
     FuncAddr function) {
@@ -88,9 +301,10 @@ void WINAPI HotPatchingAsanRuntime::DllMainEntryHook(
       // Nothing to do here.
       break;
 
-    case DLL_PROCESS_DETACH:
-      // Nothing to do here.
+    case DLL_PROCESS_DETACH: {
+      HotPatchingAsanRuntime::GetInstance()->OnModuleUnload(instance);
       break;
+    }
 
     default:
       NOTREACHED();
@@ -17,6 +17,14 @@
 // A single instance of this class is created by the DllMain of module of
 // the hot patching Asan runtime library and can be accessed from anywhere
 // via |HotPatchingAsanRuntime::runtime()|.
+//
+// In the default mode every hot patchable function of a module is activated
+// as soon as the module is loaded. In the lazy mode, enabled with the
+// --lazy_hot_patching flag of SYZYGY_ASAN_OPTIONS, the functions are only
+// prepared when the module is loaded: the pages containing them are armed
+// with PAGE_GUARD and the functions of a page get activated the first time
+// the page is touched. This way the cost of the activation is only paid for
+// the code that actually runs.
 
 #ifndef SYZYGY_AGENT_ASAN_HOT_PATCHING_ASAN_RUNTIME_H_
 #define SYZYGY_AGENT_ASAN_HOT_PATCHING_ASAN_RUNTIME_H_
@@ -24,10 +32,13 @@
 #include <windows.h>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/memory/singleton.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/agent/common/entry_frame.h"
 
 namespace agent {
@@ -59,9 +70,36 @@ class HotPatchingAsanRuntime {
   //     loader lock.
   bool HotPatch(HINSTANCE instance);
 
+  // Activates the prepared functions overlapping the page that contains a
+  // given address. This is invoked by the guard page handler in the lazy mode.
+  // @param address The address that has been touched.
+  // @returns true if |address| belongs to a page of prepared functions, false
+  //     otherwise.
+  bool ActivatePage(const void* address);
+
+  // Forgets about the prepared functions of a module that is being unloaded.
+  // @param instance The handle to the module.
+  void OnModuleUnload(HINSTANCE instance);
+
   // Sets up the hot patching Asan runtime.
   void SetUp();
 
+  // @returns the number of functions prepared for activation in a module.
+  // @param instance The handle to the module.
+  size_t GetPreparedFunctionCount(HINSTANCE instance);
+
+  // @returns the number of functions that have been activated in a module.
+  // @param instance The handle to the module.
+  size_t GetActivatedFunctionCount(HINSTANCE instance);
+
+  // @name Accessors.
+  // @{
+  bool lazy_activation() const { return lazy_activation_; }
+  void set_lazy_activation(bool lazy_activation) {
+    lazy_activation_ = lazy_activation;
+  }
+  // @}
+
   // Gets the set of modules that have already been hot patched.
   // @returns a set containing the handles of the hot patched modules.
   const std::unordered_set<HMODULE>& hot_patched_modules() {
@@ -75,8 +113,37 @@ class HotPatchingAsanRuntime {
   }
 
  protected:
+  // Describes a hot patchable function of a module.
+  struct PreparedFunction {
+    const uint8_t* address;
+    size_t code_size;
+    bool activated;
+  };
+  // The prepared functions of a module, sorted by address.
+  typedef std::vector<PreparedFunction> PreparedFunctions;
+
   void SetUpLogger();
 
+  // Reads the hot patching metadata of a module and fills |functions| with
+  // the hot patchable functions it describes.
+  // @param instance The handle to the module.
+  // @param functions Receives the functions of the module.
+  // @returns true on success, false if the module has no valid metadata.
+  bool PrepareModule(HINSTANCE instance, PreparedFunctions* functions);
+
+  // Arms the pages containing the given functions with PAGE_GUARD.
+  // @param functions The functions to arm.
+  // @returns true on success, false otherwise.
+  bool ArmGuardPages(const PreparedFunctions& functions);
+
+  // Activates a single function. This is a no-op if it's already activated.
+  // @param function The function to activate.
+  // @note Must be called under |lock_|.
+  void ActivateFunction(PreparedFunction* function);
+
+  // The guard page handler used in the lazy mode.
+  static LONG WINAPI GuardPageHandler(EXCEPTION_POINTERS* exception);
+
   // The shared logger instance that will be used to report errors and runtime
   // information.
   std::unique_ptr<AsanLogger> logger_;
@@ -85,6 +152,19 @@ class HotPatchingAsanRuntime {
   // patch the same module twice.
   std::unordered_set<HMODULE> hot_patched_modules_;
 
+  // Indicates if the functions should only be activated on first use.
+  bool lazy_activation_;
+
+  // Protects the prepared functions, which are touched from the guard page
+  // handler on any thread.
+  base::Lock lock_;
+
+  // The prepared functions of the hot patched modules. Under |lock_|.
+  std::unordered_map<HMODULE, PreparedFunctions> prepared_modules_;
+
+  // The handle of the guard page handler, once installed.
+  PVOID guard_page_handler_;
+
  private:
   friend struct base::DefaultSingletonTraits<HotPatchingAsanRuntime>;
   friend class HotPatchingAsanRuntimeTest;
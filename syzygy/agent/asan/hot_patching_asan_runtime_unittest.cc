@@ -154,6 +154,13 @@ TEST_F(HotPatchingAsanRuntimeTest, TestRuntime) {
   // instrumented dll.
   ASSERT_EQ(1U, runtime_->hot_patched_modules().count(relink_helper.module_));
 
+  // All the functions get activated right away in the default mode.
+  size_t function_count =
+      runtime_->GetPreparedFunctionCount(relink_helper.module_);
+  EXPECT_LT(0U, function_count);
+  EXPECT_EQ(function_count,
+            runtime_->GetActivatedFunctionCount(relink_helper.module_));
+
   // The module is already hot patched, this is essentially a no-op.
   ASSERT_TRUE(runtime_->HotPatch(relink_helper.module_));
 
@@ -164,5 +171,37 @@ TEST_F(HotPatchingAsanRuntimeTest, TestRuntime) {
   relink_helper.TearDown();
 }
 
+#ifdef _COVERAGE_BUILD
+TEST_F(HotPatchingAsanRuntimeTest, DISABLED_TestLazyActivation) {
+#else
+TEST_F(HotPatchingAsanRuntimeTest, TestLazyActivation) {
+#endif
+  HotPatchingAsanRelinkHelper relink_helper;
+  relink_helper.SetUp();
+  relink_helper.InstrumentAndLoadTestDll();
+
+  runtime_->set_lazy_activation(true);
+  relink_helper.LoadTestDll(relink_helper.hp_test_dll_path_,
+                            &relink_helper.module_);
+  ASSERT_EQ(1U, runtime_->hot_patched_modules().count(relink_helper.module_));
+
+  // Only the pages that have been executed so far, e.g. the one of DllMain,
+  // have been activated.
+  size_t function_count =
+      runtime_->GetPreparedFunctionCount(relink_helper.module_);
+  size_t activated_count =
+      runtime_->GetActivatedFunctionCount(relink_helper.module_);
+  EXPECT_LT(0U, function_count);
+  EXPECT_LT(activated_count, function_count);
+
+  // Addresses outside of the prepared functions are not handled.
+  EXPECT_FALSE(runtime_->ActivatePage(&function_count));
+  EXPECT_EQ(activated_count,
+            runtime_->GetActivatedFunctionCount(relink_helper.module_));
+
+  runtime_->set_lazy_activation(false);
+  relink_helper.TearDown();
+}
+
 }  // namespace asan
 }  // namespace agent
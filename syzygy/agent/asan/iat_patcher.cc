@@ -69,36 +69,58 @@ class IATPatchWorker {
   }
 
  private:
+  // A thunk to patch, and the function to patch it with.
+  struct PendingPatch {
+    PIMAGE_THUNK_DATA iat;
+    FunctionPointer function;
+  };
+
   static bool VisitImport(const base::win::PEImage &image, LPCSTR module,
                           DWORD ordinal, LPCSTR name, DWORD hint,
                           PIMAGE_THUNK_DATA iat, PVOID cookie);
-  PatchResult OnImport(const char* name, PIMAGE_THUNK_DATA iat);
+  void OnImport(const char* name, PIMAGE_THUNK_DATA iat);
 
   ScopedPageProtections scoped_page_protections_;
   const IATPatchMap& patch_;
-  PatchResult result_;
+  std::vector<PendingPatch> pending_patches_;
 
   DISALLOW_COPY_AND_ASSIGN(IATPatchWorker);
 };
 
-IATPatchWorker::IATPatchWorker(const IATPatchMap& patch)
-    : patch_(patch), result_(PATCH_SUCCEEDED) {
+IATPatchWorker::IATPatchWorker(const IATPatchMap& patch) : patch_(patch) {
 }
 
 PatchResult IATPatchWorker::PatchImage(base::win::PEImage* image) {
   DCHECK_NE(static_cast<base::win::PEImage*>(nullptr), image);
 
+  // Collect all the thunks to patch first, so that the protections of their
+  // pages can be changed in a single sweep rather than once per thunk.
+  pending_patches_.clear();
+  image->EnumAllImports(&VisitImport, this);
+
   // This is actually '0', so ORing error conditions to it is just fine.
-  result_ = PATCH_SUCCEEDED;
+  PatchResult result = PATCH_SUCCEEDED;
 
-  // The IAT patching takes place during enumeration.
-  image->EnumAllImports(&VisitImport, this);
+  std::vector<void*> thunks;
+  thunks.reserve(pending_patches_.size());
+  for (const auto& pending_patch : pending_patches_)
+    thunks.push_back(pending_patch.iat);
+  if (!scoped_page_protections_.EnsureContainingPagesWritable(
+          thunks, sizeof(IMAGE_THUNK_DATA))) {
+    result |= PATCH_FAILED_UNPROTECT_FAILED;
+  } else {
+    for (const auto& pending_patch : pending_patches_) {
+      result |= UpdateImportThunk(pending_patch.iat, pending_patch.function);
+      if (result != PATCH_SUCCEEDED)
+        break;
+    }
+  }
 
   // Clean up whatever we soiled, success or failure be damned.
   if (!scoped_page_protections_.RestorePageProtections())
-    result_ |= PATCH_FAILED_REPROTECT_FAILED;
+    result |= PATCH_FAILED_REPROTECT_FAILED;
 
-  return result_;
+  return result;
 }
 
 bool IATPatchWorker::VisitImport(
@@ -108,28 +130,18 @@ bool IATPatchWorker::VisitImport(
     return true;
 
   IATPatchWorker* worker = reinterpret_cast<IATPatchWorker*>(cookie);
-  PatchResult result = worker->OnImport(name, iat);
-  if (result == PATCH_SUCCEEDED)
-    return true;
-
-  // Remember the reason for failure.
-  worker->result_ |= result;
-  return false;
+  worker->OnImport(name, iat);
+  return true;
 }
 
-PatchResult IATPatchWorker::OnImport(const char* name, PIMAGE_THUNK_DATA iat) {
+void IATPatchWorker::OnImport(const char* name, PIMAGE_THUNK_DATA iat) {
   auto it = patch_.find(name);
   // See whether this is a function we care about.
   if (it == patch_.end())
-    return PATCH_SUCCEEDED;
-
-  // Make the containing page writable.
-  if (!scoped_page_protections_.EnsureContainingPagesWritable(
-          iat, sizeof(IMAGE_THUNK_DATA))) {
-    return PATCH_FAILED_UNPROTECT_FAILED;
-  }
+    return;
 
-  return UpdateImportThunk(iat, it->second);
+  PendingPatch pending_patch = {iat, it->second};
+  pending_patches_.push_back(pending_patch);
 }
 
 }  // namespace
@@ -0,0 +1,158 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/lock_profiler.h"
+
+#include "base/strings/stringprintf.h"
+#include "syzygy/agent/asan/logger.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// The counters of a lock site. These live on their own cache line so that the
+// accounting of a site doesn't slow down the other ones.
+struct __declspec(align(64)) LockSiteCounters {
+  volatile LONGLONG acquisitions;
+  volatile LONGLONG contended_acquisitions;
+  volatile LONGLONG total_wait_us;
+  volatile LONGLONG max_wait_us;
+};
+
+LockSiteCounters lock_site_counters[kLockSiteCount] = {};
+
+const char* const kLockSiteNames[] = {
+    "HeapManager",
+    "Heap",
+    "QuarantineShard",
+    "KnownStacks",
+    "ReclaimedStacks",
+};
+static_assert(arraysize(kLockSiteNames) == kLockSiteCount,
+              "Every lock site must have a name.");
+
+}  // namespace
+
+base::subtle::Atomic32 LockProfiler::enabled_ = 0;
+
+void LockProfiler::SetEnabled(bool enabled) {
+  base::subtle::NoBarrier_Store(&enabled_, enabled ? 1 : 0);
+}
+
+void LockProfiler::GetStatistics(LockSite site,
+                                 LockSiteStatistics* statistics) {
+  DCHECK_LT(site, kLockSiteCount);
+  DCHECK_NE(static_cast<LockSiteStatistics*>(nullptr), statistics);
+
+  // The reads of 64-bit values aren't atomic on x86, so these go through
+  // interlocked operations.
+  LockSiteCounters& counters = lock_site_counters[site];
+  statistics->acquisitions =
+      ::InterlockedCompareExchange64(&counters.acquisitions, 0, 0);
+  statistics->contended_acquisitions =
+      ::InterlockedCompareExchange64(&counters.contended_acquisitions, 0, 0);
+  statistics->total_wait_us =
+      ::InterlockedCompareExchange64(&counters.total_wait_us, 0, 0);
+  statistics->max_wait_us =
+      ::InterlockedCompareExchange64(&counters.max_wait_us, 0, 0);
+}
+
+void LockProfiler::ResetStatistics() {
+  for (size_t i = 0; i < kLockSiteCount; ++i) {
+    LockSiteCounters& counters = lock_site_counters[i];
+    ::InterlockedExchange64(&counters.acquisitions, 0);
+    ::InterlockedExchange64(&counters.contended_acquisitions, 0);
+    ::InterlockedExchange64(&counters.total_wait_us, 0);
+    ::InterlockedExchange64(&counters.max_wait_us, 0);
+  }
+}
+
+const char* LockProfiler::GetLockSiteName(LockSite site) {
+  DCHECK_LT(site, kLockSiteCount);
+  return kLockSiteNames[site];
+}
+
+void LockProfiler::LogStatistics(AsanLogger* logger) {
+  DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
+
+  std::string message =
+      base::StringPrintf("PID=%d; Lock profile:", ::GetCurrentProcessId());
+  for (size_t i = 0; i < kLockSiteCount; ++i) {
+    LockSite site = static_cast<LockSite>(i);
+    LockSiteStatistics statistics = {};
+    GetStatistics(site, &statistics);
+    base::StringAppendF(
+        &message,
+        " %s: Acquisitions=%llu, Contended=%llu, Wait=%llu us, "
+        "MaxWait=%llu us;",
+        GetLockSiteName(site), statistics.acquisitions,
+        statistics.contended_acquisitions, statistics.total_wait_us,
+        statistics.max_wait_us);
+  }
+  logger->Write(message);
+}
+
+void LockProfiler::RecordAcquisition(LockSite site,
+                                     bool contended,
+                                     base::TimeDelta wait) {
+  DCHECK_LT(site, kLockSiteCount);
+  LockSiteCounters& counters = lock_site_counters[site];
+  ::InterlockedIncrement64(&counters.acquisitions);
+  if (!contended)
+    return;
+
+  LONGLONG wait_us = wait.InMicroseconds();
+  ::InterlockedIncrement64(&counters.contended_acquisitions);
+  ::InterlockedExchangeAdd64(&counters.total_wait_us, wait_us);
+
+  // Update the maximum, unless another thread beats us to a larger value.
+  LONGLONG max_wait_us =
+      ::InterlockedCompareExchange64(&counters.max_wait_us, 0, 0);
+  while (wait_us > max_wait_us) {
+    LONGLONG previous = ::InterlockedCompareExchange64(
+        &counters.max_wait_us, wait_us, max_wait_us);
+    if (previous == max_wait_us)
+      break;
+    max_wait_us = previous;
+  }
+}
+
+LockProfilerThread::LockProfilerThread(AsanLogger* logger,
+                                       base::TimeDelta period)
+    : logger_(logger), period_(period), stop_event_(true, false) {
+  DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
+}
+
+LockProfilerThread::~LockProfilerThread() {
+}
+
+bool LockProfilerThread::Start() {
+  return base::PlatformThread::CreateWithPriority(
+      0, this, &thread_handle_, base::ThreadPriority::BACKGROUND);
+}
+
+void LockProfilerThread::Stop() {
+  stop_event_.Signal();
+  base::PlatformThread::Join(thread_handle_);
+}
+
+void LockProfilerThread::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Lock Profiler Thread");
+  while (!stop_event_.TimedWait(period_))
+    LockProfiler::LogStatistics(logger_);
+}
+
+}  // namespace asan
+}  // namespace agent
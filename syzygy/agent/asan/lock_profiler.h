@@ -0,0 +1,181 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares LockProfiler, an opt-in profiler of the contention of the locks of
+// the runtime. The locks are grouped by site, and for each site the profiler
+// counts the acquisitions, the ones that had to wait, and the time spent
+// waiting. This is meant to find the lock to attack for a given workload.
+
+#ifndef SYZYGY_AGENT_ASAN_LOCK_PROFILER_H_
+#define SYZYGY_AGENT_ASAN_LOCK_PROFILER_H_
+
+#include <windows.h>
+
+#include "base/atomicops.h"
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+
+namespace agent {
+namespace asan {
+
+// Forward declaration.
+class AsanLogger;
+
+// The profiled lock sites. This is part of the interface of
+// asan_GetLockProfile, so new sites must be added at the end.
+enum LockSite {
+  // BlockHeapManager::lock_.
+  kHeapManagerLockSite,
+  // The heap locks taken via BlockHeapManager::Lock.
+  kHeapLockSite,
+  // The shard locks of the sharded quarantines.
+  kQuarantineShardLockSite,
+  // StackCaptureCache::known_stacks_locks_.
+  kKnownStacksLockSite,
+  // StackCaptureCache::reclaimed_locks_.
+  kReclaimedStacksLockSite,
+  kLockSiteCount,
+};
+
+// The contention statistics of a lock site. This is part of the interface of
+// asan_GetLockProfile, so new fields must be added at the end.
+struct LockSiteStatistics {
+  // The number of acquisitions of the locks of the site.
+  uint64_t acquisitions;
+  // The number of acquisitions that found the lock already held.
+  uint64_t contended_acquisitions;
+  // The total and the longest time spent waiting for the locks of the site,
+  // in microseconds.
+  uint64_t total_wait_us;
+  uint64_t max_wait_us;
+};
+
+class LockProfiler {
+ public:
+  // Enables or disables the profiling. This doesn't reset the statistics.
+  // @param enabled True to enable the profiling, false otherwise.
+  static void SetEnabled(bool enabled);
+
+  // @returns true if the profiling is enabled.
+  static bool enabled() {
+    return base::subtle::NoBarrier_Load(&enabled_) != 0;
+  }
+
+  // Acquires a lock, accounting for it if the profiling is enabled. The
+  // uncontended case is detected with a single TimedTry attempt, and only the
+  // contended acquisitions are timed.
+  // @tparam LockType The type of the lock. This supports the same locks as
+  //     TimedTry.
+  // @param site The site of the lock.
+  // @param lock The lock to acquire.
+  template <typename LockType>
+  static void Acquire(LockSite site, LockType* lock);
+
+  // Gets a snapshot of the statistics of a lock site. The fields are read
+  // individually, so they may be slightly inconsistent with each other.
+  // @param site The lock site.
+  // @param statistics Will receive the statistics of @p site.
+  static void GetStatistics(LockSite site, LockSiteStatistics* statistics);
+
+  // Resets the statistics of all the lock sites.
+  static void ResetStatistics();
+
+  // @param site A lock site.
+  // @returns the name of @p site.
+  static const char* GetLockSiteName(LockSite site);
+
+  // Writes the statistics of all the lock sites to a logger.
+  // @param logger The logger to use.
+  static void LogStatistics(AsanLogger* logger);
+
+ private:
+  // Accounts for the acquisition of a lock.
+  // @param site The site of the lock.
+  // @param contended True if the lock was already held.
+  // @param wait The time spent waiting for the lock.
+  static void RecordAcquisition(LockSite site,
+                                bool contended,
+                                base::TimeDelta wait);
+
+  // Indicates if the profiling is enabled.
+  static base::subtle::Atomic32 enabled_;
+};
+
+// A scoped lock that accounts for its acquisition with the LockProfiler.
+// @tparam LockType The type of the lock.
+template <typename LockType>
+class ScopedProfiledLock {
+ public:
+  // @param site The site of the lock.
+  // @param lock The lock to acquire.
+  ScopedProfiledLock(LockSite site, LockType* lock);
+  ~ScopedProfiledLock();
+
+ private:
+  LockType* lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedProfiledLock);
+};
+
+// The profiled equivalent of base::AutoLock.
+typedef ScopedProfiledLock<base::Lock> ProfiledAutoLock;
+
+// A background thread that periodically writes the lock profile to a logger.
+//
+// Note that the thread must be cleanly shutdown by calling Stop before the
+// logger is cleaned up.
+class LockProfilerThread : public base::PlatformThread::Delegate {
+ public:
+  // @param logger The logger to write the lock profile to.
+  // @param period The time between two writes.
+  LockProfilerThread(AsanLogger* logger, base::TimeDelta period);
+  ~LockProfilerThread() override;
+
+  // Starts the thread. Must not be called if the thread has already been
+  // started.
+  // @returns true if successful, false if the thread failed to be launched.
+  bool Start();
+
+  // Stops the thread and waits until it exits cleanly. Must be called before
+  // the destruction of this object. Must not be called if the thread has not
+  // been started successfully.
+  void Stop();
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override;
+
+  // The logger to write the lock profile to.
+  AsanLogger* logger_;
+
+  // The time between two writes.
+  base::TimeDelta period_;
+
+  // Used to signal the thread to exit.
+  base::WaitableEvent stop_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(LockProfilerThread);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#include "syzygy/agent/asan/lock_profiler_impl.h"
+
+#endif  // SYZYGY_AGENT_ASAN_LOCK_PROFILER_H_
@@ -0,0 +1,69 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation details for the templates of LockProfiler. This is not meant
+// to be included directly.
+
+#ifndef SYZYGY_AGENT_ASAN_LOCK_PROFILER_IMPL_H_
+#define SYZYGY_AGENT_ASAN_LOCK_PROFILER_IMPL_H_
+
+#ifndef SYZYGY_AGENT_ASAN_LOCK_PROFILER_H_
+#error Meant to be included from lock_profiler.h only.
+#endif
+
+#include "base/logging.h"
+#include "syzygy/agent/asan/timed_try.h"
+
+namespace agent {
+namespace asan {
+
+template <typename LockType>
+void LockProfiler::Acquire(LockSite site, LockType* lock) {
+  DCHECK_LT(site, kLockSiteCount);
+  DCHECK_NE(static_cast<LockType*>(nullptr), lock);
+
+  typename detail::SelectLockAdapter<LockType>::type adapter;
+  if (!enabled()) {
+    adapter.Acquire(lock);
+    return;
+  }
+
+  // A zero delay makes TimedTry attempt to grab the lock only once.
+  if (TimedTry(base::TimeDelta(), lock)) {
+    RecordAcquisition(site, false, base::TimeDelta());
+    return;
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  adapter.Acquire(lock);
+  RecordAcquisition(site, true, base::TimeTicks::Now() - start);
+}
+
+template <typename LockType>
+ScopedProfiledLock<LockType>::ScopedProfiledLock(LockSite site,
+                                                 LockType* lock)
+    : lock_(lock) {
+  LockProfiler::Acquire(site, lock_);
+}
+
+template <typename LockType>
+ScopedProfiledLock<LockType>::~ScopedProfiledLock() {
+  typename detail::SelectLockAdapter<LockType>::type adapter;
+  adapter.Release(lock_);
+}
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_LOCK_PROFILER_IMPL_H_
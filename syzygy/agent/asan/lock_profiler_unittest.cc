@@ -0,0 +1,168 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/lock_profiler.h"
+
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/logger.h"
+#include "syzygy/agent/asan/unittest_util.h"
+#include "syzygy/agent/asan/heaps/win_heap.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+class LockProfilerTest : public testing::TestWithAsanLogger {
+ public:
+  void SetUp() override {
+    testing::TestWithAsanLogger::SetUp();
+    LockProfiler::ResetStatistics();
+    LockProfiler::SetEnabled(true);
+  }
+
+  void TearDown() override {
+    LockProfiler::SetEnabled(false);
+    LockProfiler::ResetStatistics();
+    testing::TestWithAsanLogger::TearDown();
+  }
+};
+
+// Acquires a lock on another thread. The thread signals |ready| right before
+// trying to acquire the lock.
+class LockOnThread : public base::PlatformThread::Delegate {
+ public:
+  explicit LockOnThread(base::Lock* lock)
+      : lock_(lock), ready_(true, false) {}
+
+  void ThreadMain() override {
+    ready_.Signal();
+    ProfiledAutoLock lock(kHeapManagerLockSite, lock_);
+  }
+
+  base::WaitableEvent* ready() { return &ready_; }
+
+ private:
+  base::Lock* lock_;
+  base::WaitableEvent ready_;
+};
+
+}  // namespace
+
+TEST_F(LockProfilerTest, DisabledProfilingIsNotAccounted) {
+  LockProfiler::SetEnabled(false);
+  EXPECT_FALSE(LockProfiler::enabled());
+
+  base::Lock lock;
+  { ProfiledAutoLock auto_lock(kHeapManagerLockSite, &lock); }
+
+  LockSiteStatistics statistics = {};
+  LockProfiler::GetStatistics(kHeapManagerLockSite, &statistics);
+  EXPECT_EQ(0u, statistics.acquisitions);
+}
+
+TEST_F(LockProfilerTest, UncontendedAcquisitions) {
+  EXPECT_TRUE(LockProfiler::enabled());
+
+  base::Lock lock;
+  for (size_t i = 0; i < 3; ++i) {
+    ProfiledAutoLock auto_lock(kKnownStacksLockSite, &lock);
+    lock.AssertAcquired();
+  }
+  EXPECT_TRUE(lock.Try());
+  lock.Release();
+
+  LockSiteStatistics statistics = {};
+  LockProfiler::GetStatistics(kKnownStacksLockSite, &statistics);
+  EXPECT_EQ(3u, statistics.acquisitions);
+  EXPECT_EQ(0u, statistics.contended_acquisitions);
+  EXPECT_EQ(0u, statistics.total_wait_us);
+
+  // The other sites are untouched.
+  LockProfiler::GetStatistics(kReclaimedStacksLockSite, &statistics);
+  EXPECT_EQ(0u, statistics.acquisitions);
+}
+
+TEST_F(LockProfilerTest, ContendedAcquisition) {
+  base::Lock lock;
+  LockOnThread delegate(&lock);
+  base::PlatformThreadHandle handle;
+
+  lock.Acquire();
+  ASSERT_TRUE(base::PlatformThread::Create(0, &delegate, &handle));
+  delegate.ready()->Wait();
+  base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(20));
+  lock.Release();
+  base::PlatformThread::Join(handle);
+
+  LockSiteStatistics statistics = {};
+  LockProfiler::GetStatistics(kHeapManagerLockSite, &statistics);
+  EXPECT_EQ(1u, statistics.acquisitions);
+  EXPECT_EQ(1u, statistics.contended_acquisitions);
+  EXPECT_LT(0u, statistics.total_wait_us);
+  EXPECT_EQ(statistics.total_wait_us, statistics.max_wait_us);
+
+  LockProfiler::ResetStatistics();
+  LockProfiler::GetStatistics(kHeapManagerLockSite, &statistics);
+  EXPECT_EQ(0u, statistics.acquisitions);
+  EXPECT_EQ(0u, statistics.contended_acquisitions);
+  EXPECT_EQ(0u, statistics.total_wait_us);
+  EXPECT_EQ(0u, statistics.max_wait_us);
+}
+
+TEST_F(LockProfilerTest, HeapLocks) {
+  heaps::WinHeap heap;
+  LockProfiler::Acquire(kHeapLockSite, static_cast<HeapInterface*>(&heap));
+  heap.Unlock();
+
+  LockSiteStatistics statistics = {};
+  LockProfiler::GetStatistics(kHeapLockSite, &statistics);
+  EXPECT_EQ(1u, statistics.acquisitions);
+}
+
+TEST_F(LockProfilerTest, LockSiteNames) {
+  for (size_t i = 0; i < kLockSiteCount; ++i) {
+    const char* name = LockProfiler::GetLockSiteName(static_cast<LockSite>(i));
+    ASSERT_NE(static_cast<const char*>(nullptr), name);
+    EXPECT_LT(0u, ::strlen(name));
+  }
+}
+
+TEST_F(LockProfilerTest, LogStatistics) {
+  base::Lock lock;
+  { ProfiledAutoLock auto_lock(kQuarantineShardLockSite, &lock); }
+
+  AsanLogger logger;
+  logger.set_instance_id(instance_id());
+  logger.set_log_as_text(true);
+  logger.Init();
+  LockProfiler::LogStatistics(&logger);
+  logger.Stop();
+
+  EXPECT_TRUE(LogContains("Lock profile:"));
+  EXPECT_TRUE(LogContains("QuarantineShard: Acquisitions=1, Contended=0"));
+}
+
+TEST_F(LockProfilerTest, LockProfilerThread) {
+  AsanLogger logger;
+  LockProfilerThread thread(&logger, base::TimeDelta::FromMilliseconds(1));
+  ASSERT_TRUE(thread.Start());
+  base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(10));
+  thread.Stop();
+}
+
+}  // namespace asan
+}  // namespace agent
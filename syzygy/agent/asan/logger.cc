@@ -24,6 +24,7 @@
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/trace/protocol/logger_batch.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
 
 namespace agent {
@@ -67,7 +68,8 @@ void InitExecutionContext(const CONTEXT& rtl_context,
 
 }  // namespace
 
-AsanLogger::AsanLogger() : log_as_text_(true), minidump_on_failure_(false) {
+AsanLogger::AsanLogger()
+    : log_as_text_(true), minidump_on_failure_(false), batch_writes_(false) {
 }
 
 void AsanLogger::Init() {
@@ -94,6 +96,7 @@ void AsanLogger::Init() {
 }
 
 void AsanLogger::Stop() {
+  Flush();
   if (rpc_binding_.Get() != NULL) {
     ::common::rpc::InvokeRpc(&LoggerClient_Stop, rpc_binding_.Get());
   }
@@ -101,17 +104,23 @@ void AsanLogger::Stop() {
 
 void AsanLogger::Write(const std::string& message) {
   // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
-    ::common::rpc::InvokeRpc(
-        &LoggerClient_Write, rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()));
+  if (rpc_binding_.Get() == NULL)
+    return;
+  if (batch_writes_) {
+    AppendToBatch(message, NULL, 0);
+    return;
   }
+  ::common::rpc::InvokeRpc(
+      &LoggerClient_Write, rpc_binding_.Get(),
+      reinterpret_cast<const unsigned char*>(message.c_str()));
 }
 
 void AsanLogger::WriteWithContext(const std::string& message,
                                   const CONTEXT& context) {
-  // If we're bound to a logging endpoint, log the message there.
+  // If we're bound to a logging endpoint, log the message there. The
+  // buffered messages come first, to keep the log in order.
   if (rpc_binding_.Get() != NULL) {
+    Flush();
     ExecutionContext exec_context = {};
     InitExecutionContext(context, &exec_context);
     ::common::rpc::InvokeRpc(
@@ -124,12 +133,16 @@ void AsanLogger::WriteWithStackTrace(const std::string& message,
                                      const void * const * trace_data,
                                      uint32_t trace_length) {
   // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
-    ::common::rpc::InvokeRpc(
-        &LoggerClient_WriteWithTrace, rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()),
-        reinterpret_cast<const uintptr_t*>(trace_data), trace_length);
+  if (rpc_binding_.Get() == NULL)
+    return;
+  if (batch_writes_) {
+    AppendToBatch(message, trace_data, trace_length);
+    return;
   }
+  ::common::rpc::InvokeRpc(
+      &LoggerClient_WriteWithTrace, rpc_binding_.Get(),
+      reinterpret_cast<const unsigned char*>(message.c_str()),
+      reinterpret_cast<const uintptr_t*>(trace_data), trace_length);
 }
 
 void AsanLogger::SaveMinidumpWithProtobufAndMemoryRanges(
@@ -143,6 +156,9 @@ void AsanLogger::SaveMinidumpWithProtobufAndMemoryRanges(
   if (rpc_binding_.Get() == NULL)
     return;
 
+  // The buffered messages describe the error, and come before the minidump.
+  Flush();
+
   // Convert the memory ranges to arrays.
   std::vector<const void*> base_addresses;
   std::vector<size_t> range_lengths;
@@ -169,5 +185,54 @@ void AsanLogger::SaveMinidumpWithProtobufAndMemoryRanges(
       static_cast<uint32_t>(memory_ranges.size()));
 }
 
+void AsanLogger::Flush() {
+  base::AutoLock auto_lock(batch_lock_);
+  FlushLocked();
+}
+
+void AsanLogger::AppendToBatch(const std::string& message,
+                               const void* const* trace_data,
+                               uint32_t trace_length) {
+  base::AutoLock auto_lock(batch_lock_);
+  AppendLoggerBatchRecord(message, trace_data, trace_length, &batch_);
+  if (batch_.size() >= kMaxLoggerBatchSize)
+    FlushLocked();
+}
+
+void AsanLogger::FlushLocked() {
+  batch_lock_.AssertAcquired();
+  if (batch_.empty())
+    return;
+  if (rpc_binding_.Get() == NULL) {
+    batch_.clear();
+    return;
+  }
+
+  if (!::common::rpc::InvokeRpc(&LoggerClient_WriteBatch, rpc_binding_.Get(),
+                                reinterpret_cast<const byte*>(batch_.data()),
+                                static_cast<unsigned long>(batch_.size()))
+           .succeeded()) {
+    // An older logger doesn't know about batches: fall back to sending the
+    // messages one at a time, from now on.
+    batch_writes_ = false;
+    std::vector<LoggerBatchRecord> records;
+    CHECK(ParseLoggerBatch(batch_.data(), batch_.size(), &records));
+    for (const auto& record : records) {
+      std::string message = record.text.as_string();
+      if (record.trace.empty()) {
+        ::common::rpc::InvokeRpc(
+            &LoggerClient_Write, rpc_binding_.Get(),
+            reinterpret_cast<const unsigned char*>(message.c_str()));
+      } else {
+        ::common::rpc::InvokeRpc(
+            &LoggerClient_WriteWithTrace, rpc_binding_.Get(),
+            reinterpret_cast<const unsigned char*>(message.c_str()),
+            record.trace.data(), static_cast<uint32_t>(record.trace.size()));
+      }
+    }
+  }
+  batch_.clear();
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -16,8 +16,10 @@
 #define SYZYGY_AGENT_ASAN_LOGGER_H_
 
 #include <string>
+#include <vector>
 
 #include "base/logging.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/agent/asan/error_info.h"
 #include "syzygy/common/rpc/helpers.h"
 
@@ -47,10 +49,17 @@ class AsanLogger {
   bool minidump_on_failure() const { return minidump_on_failure_; }
   void set_minidump_on_failure(bool value) { minidump_on_failure_ = value; }
 
+  // Set whether to buffer the messages written without a context, and send
+  // them to the logger in batches rather than one RPC per message. The
+  // batches are flushed once large enough, before a message with a context
+  // or a minidump, and when the logger is stopped.
+  bool batch_writes() const { return batch_writes_; }
+  void set_batch_writes(bool value) { batch_writes_ = value; }
+
   // Initialize the logger.
   void Init();
 
-  // Stop the logger.
+  // Stop the logger, after flushing the buffered messages.
   void Stop();
 
   // Write a @p message to the logger.
@@ -79,7 +88,23 @@ class AsanLogger {
       const std::string& protobuf,
       const MemoryRanges& memory_ranges);
 
+  // Send the buffered messages to the logger. If the logger doesn't support
+  // batches, the messages are sent one at a time and batching is turned off.
+  void Flush();
+
  protected:
+  // Buffers a message, flushing the batch if it's full.
+  // @param message the message.
+  // @param trace_data the stack trace of the message, or NULL.
+  // @param trace_length the number of frames of @p trace_data.
+  void AppendToBatch(const std::string& message,
+                     const void* const* trace_data,
+                     uint32_t trace_length);
+
+  // Sends the buffered messages to the logger.
+  // @note batch_lock_ must be held.
+  void FlushLocked();
+
   // The RPC binding.
   ::common::rpc::ScopedRpcBinding rpc_binding_;
 
@@ -94,6 +119,14 @@ class AsanLogger {
   // Default: false.
   bool minidump_on_failure_;
 
+  // True if the messages written without a context are batched.
+  // Default: false.
+  bool batch_writes_;
+
+  // The buffered messages, encoded as in logger_batch.h. Under batch_lock_.
+  base::Lock batch_lock_;
+  std::vector<uint8_t> batch_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanLogger);
 };
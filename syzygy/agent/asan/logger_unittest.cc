@@ -24,6 +24,7 @@
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/macros.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
@@ -44,6 +45,7 @@ using testing::Return;
 
 class TestAsanLogger : public AsanLogger {
  public:
+  using AsanLogger::batch_;
   using AsanLogger::instance_id_;
   using AsanLogger::rpc_binding_;
 };
@@ -141,6 +143,59 @@ TEST_F(AsanLoggerTest, EndToEnd) {
   // TODO(rogerm): Inspect the contents of the minidump.
 }
 
+TEST_F(AsanLoggerTest, BatchedWrites) {
+  const std::string kMessage1("This is the first message\n");
+  const std::string kMessage2("This is the second message\n");
+  const std::string kMessage3("This is the third message\n");
+
+  {
+    // Setup a log file destination.
+    base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
+
+    // Start up the logging service.
+    trace::agent_logger::AgentLogger server;
+    trace::agent_logger::RpcLoggerInstanceManager instance_manager(&server);
+    server.set_instance_id(instance_id_);
+    server.set_destination(destination.get());
+    ASSERT_TRUE(server.Start());
+
+    // Use the AsanLogger client.
+    client_.set_instance_id(instance_id_);
+    client_.set_batch_writes(true);
+    client_.Init();
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+
+    // The messages are buffered until flushed.
+    client_.Write(kMessage1);
+    const void* trace[] = {
+        reinterpret_cast<const void*>(&::GetCurrentProcessId)};
+    client_.WriteWithStackTrace(kMessage2, trace, arraysize(trace));
+    EXPECT_FALSE(client_.batch_.empty());
+    client_.Flush();
+    EXPECT_TRUE(client_.batch_.empty());
+    EXPECT_TRUE(client_.batch_writes());
+
+    // Stopping the client flushes the messages left.
+    client_.Write(kMessage3);
+    EXPECT_FALSE(client_.batch_.empty());
+    client_.Stop();
+    EXPECT_TRUE(client_.batch_.empty());
+    ASSERT_TRUE(server.Join());
+  }
+
+  // Inspect the log file contents.
+  std::string content;
+  ASSERT_TRUE(base::ReadFileToString(temp_path_, &content));
+  size_t message1 = content.find(kMessage1);
+  size_t message2 = content.find(kMessage2);
+  size_t message3 = content.find(kMessage3);
+  ASSERT_NE(std::string::npos, message1);
+  ASSERT_NE(std::string::npos, message2);
+  ASSERT_NE(std::string::npos, message3);
+  EXPECT_LT(message1, message2);
+  EXPECT_LT(message2, message3);
+}
+
 TEST_F(AsanLoggerTest, Stop) {
   // Setup a log file destination.
   base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
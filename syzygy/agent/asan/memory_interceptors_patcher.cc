@@ -15,6 +15,7 @@
 #include "syzygy/agent/asan/memory_interceptors_patcher.h"
 
 #include <map>
+#include <vector>
 
 #include "base/win/pe_image.h"
 #include "syzygy/agent/asan/memory_interceptors.h"
@@ -193,7 +194,10 @@ bool PatchMemoryInterceptorShadowReferencesInternalImpl(
     return false;
   }
 
-  // Iterate over the shadow memory references and patch them.
+  // Iterate over the shadow memory references and validate them. They are
+  // all collected before patching anything, so that the protections of their
+  // pages can be changed in a single sweep.
+  std::vector<void*> shadow_refs;
   uint8_t** cursor = reinterpret_cast<uint8_t**>(const_cast<void**>(
       shadow_memory_references));
   for (; *cursor != nullptr; ++cursor) {
@@ -222,12 +226,16 @@ bool PatchMemoryInterceptorShadowReferencesInternalImpl(
       return false;
     }
 
-    // Update the shadow memory reference to point to the new shadow memory.
-    if (!scoped_page_protections->EnsureContainingPagesWritable(
-            shadow_ref, sizeof(*shadow_ref))) {
-      LOG(ERROR) << "Failed to make page writable.";
-      return false;
-    }
+    shadow_refs.push_back(const_cast<uint8_t**>(shadow_ref));
+  }
+
+  // Update the shadow memory references to point to the new shadow memory.
+  if (!scoped_page_protections->EnsureContainingPagesWritable(
+          shadow_refs, sizeof(uint8_t*))) {
+    LOG(ERROR) << "Failed to make pages writable.";
+    return false;
+  }
+  for (void* shadow_ref : shadow_refs) {
     if (!WritePointer(current_shadow_memory, new_shadow_memory,
                       reinterpret_cast<volatile void**>(shadow_ref))) {
       return false;
@@ -27,6 +27,7 @@ namespace {
 using testing::_;
 using testing::MemoryAccessorTester;
 using testing::Return;
+using testing::SyzyAsanMemoryAccessorTester;
 using testing::TestMemoryInterceptors;
 
 #ifndef _WIN64
@@ -334,6 +335,45 @@ TEST_F(MemoryInterceptorsTest, TestStringOverrunAccess) {
   TestStringOverrunAccess(string_intercept_functions);
 }
 
+TEST_F(MemoryInterceptorsTest, TestWideAccessHeadUnderrun) {
+  // The probes are given the address of the last byte of the access. The wide
+  // probes check all the shadow bytes of their access, so an access whose
+  // last byte is valid but whose head lies in the left redzone is caught,
+  // aligned or not.
+  for (const auto& fn : intercept_functions) {
+    if (fn.size <= 8)
+      continue;
+    FARPROC function = reinterpret_cast<FARPROC>(fn.function);
+
+    SyzyAsanMemoryAccessorTester tester;
+    tester.CheckAccessAndCompareContexts(function, src_ + fn.size);
+    tester.CheckAccessAndCompareContexts(function, src_ + kAllocSize - 1);
+    tester.CheckAccessAndCompareContexts(function, src_ + kAllocSize - 2);
+    ASSERT_FALSE(tester.memory_error_detected());
+
+    tester.AssertMemoryErrorIsDetected(
+        function, src_ + fn.size - 2,
+        MemoryAccessorTester::BadAccessKind::UNKNOWN_BAD_ACCESS);
+    ASSERT_TRUE(tester.memory_error_detected());
+  }
+
+  for (const auto& fn : intercept_functions_no_flags) {
+    if (fn.size <= 8)
+      continue;
+    FARPROC function = reinterpret_cast<FARPROC>(fn.function);
+
+    SyzyAsanMemoryAccessorTester tester(
+        SyzyAsanMemoryAccessorTester::IGNORE_FLAGS);
+    tester.CheckAccessAndCompareContexts(function, src_ + fn.size);
+    ASSERT_FALSE(tester.memory_error_detected());
+
+    tester.AssertMemoryErrorIsDetected(
+        function, src_ + fn.size - 9,
+        MemoryAccessorTester::BadAccessKind::UNKNOWN_BAD_ACCESS);
+    ASSERT_TRUE(tester.memory_error_detected());
+  }
+}
+
 TEST_F(MemoryInterceptorsTest, TestStringRedirectorsNoop) {
   EXPECT_CALL(*this, OnRedirectorInvocation(_))
       // Each function is tested twice, forwards and backwards.
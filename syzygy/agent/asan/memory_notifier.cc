@@ -0,0 +1,109 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/memory_notifier.h"
+
+#include "base/logging.h"
+
+namespace agent {
+namespace asan {
+
+void MemoryNotifierInterface::NotifyBatch(
+    const MemoryNotification* notifications, size_t count) {
+  DCHECK(notifications != nullptr || count == 0);
+  for (size_t i = 0; i < count; ++i) {
+    const MemoryNotification& notification = notifications[i];
+    switch (notification.type) {
+      case MemoryNotification::kInternalUse:
+        NotifyInternalUse(notification.address, notification.size);
+        break;
+      case MemoryNotification::kFutureHeapUse:
+        NotifyFutureHeapUse(notification.address, notification.size);
+        break;
+      case MemoryNotification::kReturnedToOS:
+        NotifyReturnedToOS(notification.address, notification.size);
+        break;
+      default:
+        NOTREACHED();
+        break;
+    }
+  }
+}
+
+MemoryNotificationBatch::MemoryNotificationBatch(
+    MemoryNotifierInterface* memory_notifier)
+    : memory_notifier_(memory_notifier), count_(0) {
+  DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
+}
+
+MemoryNotificationBatch::~MemoryNotificationBatch() {
+  Flush();
+}
+
+void MemoryNotificationBatch::NotifyInternalUse(const void* address,
+                                                size_t size) {
+  Add(MemoryNotification::kInternalUse, address, size);
+}
+
+void MemoryNotificationBatch::NotifyFutureHeapUse(const void* address,
+                                                  size_t size) {
+  Add(MemoryNotification::kFutureHeapUse, address, size);
+}
+
+void MemoryNotificationBatch::NotifyReturnedToOS(const void* address,
+                                                 size_t size) {
+  Add(MemoryNotification::kReturnedToOS, address, size);
+}
+
+void MemoryNotificationBatch::Flush() {
+  if (count_ == 0)
+    return;
+  memory_notifier_->NotifyBatch(notifications_, count_);
+  count_ = 0;
+}
+
+void MemoryNotificationBatch::Add(MemoryNotification::Type type,
+                                  const void* address,
+                                  size_t size) {
+  DCHECK_NE(static_cast<const void*>(nullptr), address);
+
+  // Coalesce with the previous notification if this directly extends it, in
+  // either direction.
+  if (count_ != 0) {
+    MemoryNotification& last = notifications_[count_ - 1];
+    const uint8_t* last_begin = reinterpret_cast<const uint8_t*>(last.address);
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(address);
+    if (last.type == type) {
+      if (last_begin + last.size == begin) {
+        last.size += size;
+        return;
+      }
+      if (begin + size == last_begin) {
+        last.address = address;
+        last.size += size;
+        return;
+      }
+    }
+  }
+
+  if (count_ == kCapacity)
+    Flush();
+  MemoryNotification& notification = notifications_[count_++];
+  notification.type = type;
+  notification.address = address;
+  notification.size = size;
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -21,9 +21,29 @@
 
 #include <memory>
 
+#include "base/macros.h"
+
 namespace agent {
 namespace asan {
 
+// Describes a single memory notification, for batched notifications.
+struct MemoryNotification {
+  // The kinds of notifications. These map to the notification functions of
+  // MemoryNotifierInterface.
+  enum Type {
+    kInternalUse,
+    kFutureHeapUse,
+    kReturnedToOS,
+  };
+
+  // The kind of notification.
+  Type type;
+  // The address of the memory range.
+  const void* address;
+  // The size of the memory range, in bytes.
+  size_t size;
+};
+
 // Declares a simple interface that is used by internal runtime components to
 // notify the runtime of their own memory use.
 class MemoryNotifierInterface {
@@ -48,6 +68,59 @@ class MemoryNotifierInterface {
   // @param address The address of the memory range.
   // @param size The size of the memory range, in bytes.
   virtual void NotifyReturnedToOS(const void* address, size_t size) = 0;
+
+  // Reports many ranges of memory at once. The notifications are processed
+  // in order. The default implementation simply dispatches each of them to
+  // the function above that corresponds to its type.
+  // @param notifications The notifications to report.
+  // @param count The number of notifications in @p notifications.
+  virtual void NotifyBatch(const MemoryNotification* notifications,
+                           size_t count);
+};
+
+// Accumulates memory notifications and reports them to a notifier in batches.
+// A notification that directly extends the previous one, with the same type,
+// is coalesced with it. The pending notifications are reported when the batch
+// is full, when Flush is called and when the batch is destroyed.
+class MemoryNotificationBatch {
+ public:
+  // The maximum number of notifications held before they are reported.
+  static const size_t kCapacity = 32;
+
+  // @param memory_notifier The notifier to report the notifications to.
+  explicit MemoryNotificationBatch(MemoryNotifierInterface* memory_notifier);
+
+  // Reports the pending notifications.
+  ~MemoryNotificationBatch();
+
+  // @name Batched equivalents of the MemoryNotifierInterface functions.
+  // @{
+  void NotifyInternalUse(const void* address, size_t size);
+  void NotifyFutureHeapUse(const void* address, size_t size);
+  void NotifyReturnedToOS(const void* address, size_t size);
+  // @}
+
+  // Reports the pending notifications to the notifier.
+  void Flush();
+
+  // @returns the number of pending notifications.
+  size_t size() const { return count_; }
+
+ private:
+  // Adds a notification, coalescing it with the previous one if possible.
+  // @param type The kind of notification.
+  // @param address The address of the memory range.
+  // @param size The size of the memory range, in bytes.
+  void Add(MemoryNotification::Type type, const void* address, size_t size);
+
+  // The notifier to report the notifications to.
+  MemoryNotifierInterface* memory_notifier_;
+
+  // The pending notifications.
+  MemoryNotification notifications_[kCapacity];
+  size_t count_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryNotificationBatch);
 };
 
 }  // namespace asan
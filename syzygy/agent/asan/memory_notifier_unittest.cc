@@ -0,0 +1,89 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/memory_notifier.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/unittest_util.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+using testing::MockMemoryNotifier;
+using ::testing::InSequence;
+
+uint8_t buffer[64 * 1024] = {};
+
+}  // namespace
+
+TEST(MemoryNotifierTest, DefaultNotifyBatchDispatches) {
+  MockMemoryNotifier mock_notifier;
+  MemoryNotification notifications[] = {
+      {MemoryNotification::kInternalUse, buffer, 16},
+      {MemoryNotification::kFutureHeapUse, buffer + 16, 32},
+      {MemoryNotification::kReturnedToOS, buffer + 48, 8},
+  };
+
+  InSequence in_sequence;
+  EXPECT_CALL(mock_notifier, NotifyInternalUse(buffer, 16));
+  EXPECT_CALL(mock_notifier, NotifyFutureHeapUse(buffer + 16, 32));
+  EXPECT_CALL(mock_notifier, NotifyReturnedToOS(buffer + 48, 8));
+  mock_notifier.NotifyBatch(notifications, arraysize(notifications));
+}
+
+TEST(MemoryNotificationBatchTest, CoalescesAdjacentRanges) {
+  MockMemoryNotifier mock_notifier;
+
+  InSequence in_sequence;
+  EXPECT_CALL(mock_notifier, NotifyInternalUse(buffer, 48));
+  EXPECT_CALL(mock_notifier, NotifyInternalUse(buffer + 64, 8));
+  EXPECT_CALL(mock_notifier, NotifyReturnedToOS(buffer + 72, 8));
+  EXPECT_CALL(mock_notifier, NotifyReturnedToOS(buffer + 256, 32));
+
+  MemoryNotificationBatch batch(&mock_notifier);
+  batch.NotifyInternalUse(buffer, 16);
+  batch.NotifyInternalUse(buffer + 16, 32);
+  EXPECT_EQ(1u, batch.size());
+  // Not adjacent.
+  batch.NotifyInternalUse(buffer + 64, 8);
+  // Adjacent, but of another type.
+  batch.NotifyReturnedToOS(buffer + 72, 8);
+  // Adjacent in reverse order.
+  batch.NotifyReturnedToOS(buffer + 272, 16);
+  batch.NotifyReturnedToOS(buffer + 256, 16);
+  EXPECT_EQ(4u, batch.size());
+  // The destructor flushes the batch.
+}
+
+TEST(MemoryNotificationBatchTest, FlushesWhenFull) {
+  MockMemoryNotifier mock_notifier;
+  EXPECT_CALL(mock_notifier, NotifyFutureHeapUse(testing::_, 8))
+      .Times(MemoryNotificationBatch::kCapacity + 1);
+
+  MemoryNotificationBatch batch(&mock_notifier);
+  for (size_t i = 0; i <= MemoryNotificationBatch::kCapacity; ++i)
+    batch.NotifyFutureHeapUse(buffer + i * 16, 8);
+  EXPECT_EQ(1u, batch.size());
+  batch.Flush();
+  EXPECT_EQ(0u, batch.size());
+
+  // Flushing an empty batch does nothing.
+  batch.Flush();
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
 
+#include <algorithm>
+
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/common/align.h"
 
@@ -57,6 +59,55 @@ void ShadowMemoryNotifier::NotifyReturnedToOS(
   shadow_->Unpoison(address, size);
 }
 
+void ShadowMemoryNotifier::NotifyBatch(
+    const MemoryNotification* notifications, size_t count) {
+  DCHECK(notifications != nullptr || count == 0);
+
+  // Coalesce the runs of notifications of the same type whose aligned ranges
+  // touch or overlap, so that the shadow is only written once per run.
+  size_t i = 0;
+  while (i < count) {
+    MemoryNotification::Type type = notifications[i].type;
+    const void* address = notifications[i].address;
+    size_t size = notifications[i].size;
+    DCHECK_NE(static_cast<void*>(nullptr), address);
+    AlignRange(&address, &size);
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(address);
+    const uint8_t* end = begin + size;
+
+    for (++i; i < count; ++i) {
+      if (notifications[i].type != type)
+        break;
+      const void* next_address = notifications[i].address;
+      size_t next_size = notifications[i].size;
+      DCHECK_NE(static_cast<void*>(nullptr), next_address);
+      AlignRange(&next_address, &next_size);
+      const uint8_t* next_begin = reinterpret_cast<const uint8_t*>(
+          next_address);
+      const uint8_t* next_end = next_begin + next_size;
+      if (next_begin > end || next_end < begin)
+        break;
+      begin = std::min(begin, next_begin);
+      end = std::max(end, next_end);
+    }
+
+    switch (type) {
+      case MemoryNotification::kInternalUse:
+        shadow_->Poison(begin, end - begin, kAsanMemoryMarker);
+        break;
+      case MemoryNotification::kFutureHeapUse:
+        shadow_->Poison(begin, end - begin, kAsanReservedMarker);
+        break;
+      case MemoryNotification::kReturnedToOS:
+        shadow_->Unpoison(begin, end - begin);
+        break;
+      default:
+        NOTREACHED();
+        break;
+    }
+  }
+}
+
 }  // namespace memory_notifiers
 }  // namespace asan
 }  // namespace agent
@@ -47,6 +47,8 @@ class ShadowMemoryNotifier : public MemoryNotifierInterface {
   virtual void NotifyInternalUse(const void* address, size_t size);
   virtual void NotifyFutureHeapUse(const void* address, size_t size);
   virtual void NotifyReturnedToOS(const void* address, size_t size);
+  virtual void NotifyBatch(const MemoryNotification* notifications,
+                           size_t count);
   // @}
 
  private:
@@ -77,6 +77,36 @@ TEST_F(ShadowMemoryNotifierTest, ShadowStateTransitionsWithNotification) {
   EXPECT_TRUE(shadow_.IsClean());
 }
 
+TEST_F(ShadowMemoryNotifierTest, NotifyBatch) {
+  const size_t kBufferSize = 1024;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[kBufferSize]);
+
+  // The first two notifications are coalesced, the third one isn't adjacent
+  // and the last one has another type.
+  MemoryNotification notifications[] = {
+      {MemoryNotification::kInternalUse, buffer.get(), 64},
+      {MemoryNotification::kInternalUse, buffer.get() + 64, 64},
+      {MemoryNotification::kInternalUse, buffer.get() + 256, 64},
+      {MemoryNotification::kFutureHeapUse, buffer.get() + 512, 64},
+  };
+  ShadowMemoryNotifier n(&shadow_);
+  n.NotifyBatch(notifications, arraysize(notifications));
+
+  for (size_t i = 0; i < kBufferSize; ++i) {
+    ShadowMarker expected = kHeapAddressableMarker;
+    if (i < 128 || (i >= 256 && i < 320))
+      expected = kAsanMemoryMarker;
+    else if (i >= 512 && i < 576)
+      expected = kAsanReservedMarker;
+    EXPECT_EQ(expected, shadow_.GetShadowMarkerForAddress(buffer.get() + i));
+  }
+
+  MemoryNotification returned = {MemoryNotification::kReturnedToOS,
+                                 buffer.get(), kBufferSize};
+  n.NotifyBatch(&returned, 1);
+  EXPECT_TRUE(shadow_.IsClean());
+}
+
 }  // namespace memory_notifiers
 }  // namespace asan
 }  // namespace agent
@@ -0,0 +1,155 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/memory_pressure_monitor.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+
+namespace agent {
+namespace asan {
+
+const size_t MemoryPressureMonitor::kLowMemoryQuarantineDivisor;
+const size_t MemoryPressureMonitor::kHighMemoryQuarantineMultiplier;
+const DWORD MemoryPressureMonitor::kPollPeriodMs;
+
+MemoryPressureMonitor::MemoryPressureMonitor(
+    const AvailabilityCallback& availability_callback)
+    : availability_callback_(availability_callback),
+      availability_(NORMAL_MEMORY_AVAILABLE),
+      stop_event_(true, false) {
+  DCHECK(!availability_callback_.is_null());
+}
+
+MemoryPressureMonitor::~MemoryPressureMonitor() {
+}
+
+bool MemoryPressureMonitor::Init() {
+  DCHECK(!low_memory_notification_.IsValid());
+
+  low_memory_notification_.Set(::CreateMemoryResourceNotification(
+      LowMemoryResourceNotification));
+  high_memory_notification_.Set(::CreateMemoryResourceNotification(
+      HighMemoryResourceNotification));
+  if (!low_memory_notification_.IsValid() ||
+      !high_memory_notification_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create the memory resource notifications: "
+               << ::common::LogWe(error);
+    low_memory_notification_.Close();
+    high_memory_notification_.Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool MemoryPressureMonitor::Start() {
+  DCHECK(low_memory_notification_.IsValid());
+  return base::PlatformThread::CreateWithPriority(
+      0, this, &thread_handle_, base::ThreadPriority::BACKGROUND);
+}
+
+void MemoryPressureMonitor::Stop() {
+  stop_event_.Signal();
+  base::PlatformThread::Join(thread_handle_);
+}
+
+MemoryPressureMonitor::MemoryAvailability
+MemoryPressureMonitor::QueryMemoryAvailability() const {
+  DCHECK(low_memory_notification_.IsValid());
+
+  // A failed query is taken as the notification not being signaled.
+  BOOL signaled = FALSE;
+  if (::QueryMemoryResourceNotification(low_memory_notification_.Get(),
+                                        &signaled) && signaled) {
+    return LOW_MEMORY_AVAILABLE;
+  }
+  signaled = FALSE;
+  if (::QueryMemoryResourceNotification(high_memory_notification_.Get(),
+                                        &signaled) && signaled) {
+    return HIGH_MEMORY_AVAILABLE;
+  }
+  return NORMAL_MEMORY_AVAILABLE;
+}
+
+void MemoryPressureMonitor::Update(MemoryAvailability availability) {
+  if (availability == availability_)
+    return;
+  availability_ = availability;
+  availability_callback_.Run(availability);
+}
+
+// static
+void MemoryPressureMonitor::AdjustParameters(
+    MemoryAvailability availability,
+    ::common::AsanParameters* parameters) {
+  DCHECK_NE(static_cast<::common::AsanParameters*>(nullptr), parameters);
+
+  switch (availability) {
+    case LOW_MEMORY_AVAILABLE: {
+      parameters->quarantine_size = static_cast<uint32_t>(
+          parameters->quarantine_size / kLowMemoryQuarantineDivisor);
+      parameters->zebra_block_heap_quarantine_ratio /=
+          static_cast<float>(kLowMemoryQuarantineDivisor);
+      break;
+    }
+
+    case HIGH_MEMORY_AVAILABLE: {
+      const uint32_t kMaxQuarantineSize = static_cast<uint32_t>(
+          std::numeric_limits<uint32_t>::max() /
+          kHighMemoryQuarantineMultiplier);
+      parameters->quarantine_size = static_cast<uint32_t>(
+          std::min(parameters->quarantine_size, kMaxQuarantineSize) *
+          kHighMemoryQuarantineMultiplier);
+      parameters->zebra_block_heap_quarantine_ratio = std::min(
+          1.0f, parameters->zebra_block_heap_quarantine_ratio *
+                    static_cast<float>(kHighMemoryQuarantineMultiplier));
+      break;
+    }
+
+    case NORMAL_MEMORY_AVAILABLE:
+      break;
+  }
+}
+
+void MemoryPressureMonitor::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Memory Pressure Monitor Thread");
+
+  // The notifications are level triggered, so the thread only waits on those
+  // that aren't signaled, and polls for the signaled one to be reset.
+  Update(QueryMemoryAvailability());
+  while (true) {
+    HANDLE handles[3] = {stop_event_.handle()};
+    DWORD handle_count = 1;
+    if (availability_ != LOW_MEMORY_AVAILABLE)
+      handles[handle_count++] = low_memory_notification_.Get();
+    if (availability_ != HIGH_MEMORY_AVAILABLE)
+      handles[handle_count++] = high_memory_notification_.Get();
+    DWORD timeout =
+        availability_ == NORMAL_MEMORY_AVAILABLE ? INFINITE : kPollPeriodMs;
+
+    DWORD ret = ::WaitForMultipleObjects(handle_count, handles, FALSE,
+                                         timeout);
+    if (ret == WAIT_OBJECT_0 || ret == WAIT_FAILED)
+      break;
+    Update(QueryMemoryAvailability());
+  }
+}
+
+}  // namespace asan
+}  // namespace agent
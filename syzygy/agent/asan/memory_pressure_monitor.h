@@ -0,0 +1,126 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares MemoryPressureMonitor, which listens to the memory resource
+// notifications of the system and adjusts the budgets of the quarantines to
+// the memory that is available. Under memory pressure the quarantines shrink,
+// so that the process isn't paged out as heavily, and when memory is abundant
+// they grow, so that more use-after-frees are detected.
+
+#ifndef SYZYGY_AGENT_ASAN_MEMORY_PRESSURE_MONITOR_H_
+#define SYZYGY_AGENT_ASAN_MEMORY_PRESSURE_MONITOR_H_
+
+#include <windows.h>
+
+#include "base/callback.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/asan_parameters.h"
+
+namespace agent {
+namespace asan {
+
+class MemoryPressureMonitor : public base::PlatformThread::Delegate {
+ public:
+  // The memory availability signaled by the system.
+  enum MemoryAvailability {
+    LOW_MEMORY_AVAILABLE,
+    NORMAL_MEMORY_AVAILABLE,
+    HIGH_MEMORY_AVAILABLE,
+  };
+
+  typedef base::Callback<void(MemoryAvailability)> AvailabilityCallback;
+
+  // The factor by which the quarantine budgets are scaled down when memory is
+  // low, and up when it is abundant.
+  static const size_t kLowMemoryQuarantineDivisor = 4;
+  static const size_t kHighMemoryQuarantineMultiplier = 2;
+
+  // The period at which the notifications are polled while one of them is
+  // signaled, in milliseconds. They stay signaled for as long as their
+  // condition holds, so they can't be waited on to learn that it ended.
+  static const DWORD kPollPeriodMs = 1000;
+
+  // @param availability_callback Callback that is called with the memory
+  //     availability whenever it changes. This is called on the thread of the
+  //     monitor, and must be valid from the moment Start is called and until
+  //     Stop is called.
+  explicit MemoryPressureMonitor(
+      const AvailabilityCallback& availability_callback);
+  ~MemoryPressureMonitor() override;
+
+  // Creates the memory resource notifications. Must be called before Start.
+  // @returns true on success, false otherwise.
+  bool Init();
+
+  // Starts the thread waiting on the notifications. Must not be called if the
+  // thread has already been started.
+  // @returns true if successful, false if the thread failed to be launched.
+  bool Start();
+
+  // Stops the thread and waits until it exits cleanly. Must be called before
+  // the destruction of this object. Must not be called if the thread has not
+  // been started successfully.
+  void Stop();
+
+  // Queries the memory resource notifications. Must not be called before
+  // Init has succeeded.
+  // @returns the current memory availability.
+  MemoryAvailability QueryMemoryAvailability() const;
+
+  // Records the memory availability, and invokes the callback if it
+  // changed. This is what the thread does upon a notification, and is
+  // exposed for testing.
+  // @param availability The current memory availability.
+  void Update(MemoryAvailability availability);
+
+  // Adjusts the quarantine and zebra block heap budgets of a set of
+  // parameters to the memory availability.
+  // @param availability The memory availability.
+  // @param parameters The configured parameters, whose budgets are adjusted
+  //     in place.
+  static void AdjustParameters(MemoryAvailability availability,
+                               ::common::AsanParameters* parameters);
+
+  // @returns the last memory availability recorded by Update.
+  MemoryAvailability availability() const { return availability_; }
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override;
+
+  // The callback notified of the changes of availability.
+  AvailabilityCallback availability_callback_;
+
+  // The memory resource notifications of the system.
+  base::win::ScopedHandle low_memory_notification_;
+  base::win::ScopedHandle high_memory_notification_;
+
+  // The last memory availability. Only accessed by the thread once started.
+  MemoryAvailability availability_;
+
+  // Used to signal the thread to exit.
+  base::WaitableEvent stop_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryPressureMonitor);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_MEMORY_PRESSURE_MONITOR_H_
@@ -0,0 +1,117 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/memory_pressure_monitor.h"
+
+#include "base/bind.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+class MemoryPressureMonitorTest : public testing::Test {
+ public:
+  MemoryPressureMonitorTest()
+      : callback_count_(0),
+        last_availability_(MemoryPressureMonitor::NORMAL_MEMORY_AVAILABLE) {}
+
+  void OnAvailabilityChange(
+      MemoryPressureMonitor::MemoryAvailability availability) {
+    ::InterlockedIncrement(&callback_count_);
+    last_availability_ = availability;
+  }
+
+  MemoryPressureMonitor::AvailabilityCallback GetCallback() {
+    return base::Bind(&MemoryPressureMonitorTest::OnAvailabilityChange,
+                      base::Unretained(this));
+  }
+
+ protected:
+  volatile LONG callback_count_;
+  MemoryPressureMonitor::MemoryAvailability last_availability_;
+};
+
+}  // namespace
+
+TEST_F(MemoryPressureMonitorTest, UpdateRunsCallbackOnChange) {
+  MemoryPressureMonitor monitor(GetCallback());
+  EXPECT_EQ(MemoryPressureMonitor::NORMAL_MEMORY_AVAILABLE,
+            monitor.availability());
+
+  monitor.Update(MemoryPressureMonitor::NORMAL_MEMORY_AVAILABLE);
+  EXPECT_EQ(0, callback_count_);
+
+  monitor.Update(MemoryPressureMonitor::LOW_MEMORY_AVAILABLE);
+  EXPECT_EQ(1, callback_count_);
+  EXPECT_EQ(MemoryPressureMonitor::LOW_MEMORY_AVAILABLE, last_availability_);
+  monitor.Update(MemoryPressureMonitor::LOW_MEMORY_AVAILABLE);
+  EXPECT_EQ(1, callback_count_);
+
+  monitor.Update(MemoryPressureMonitor::HIGH_MEMORY_AVAILABLE);
+  EXPECT_EQ(2, callback_count_);
+  EXPECT_EQ(MemoryPressureMonitor::HIGH_MEMORY_AVAILABLE, last_availability_);
+  EXPECT_EQ(MemoryPressureMonitor::HIGH_MEMORY_AVAILABLE,
+            monitor.availability());
+}
+
+TEST_F(MemoryPressureMonitorTest, AdjustParameters) {
+  ::common::AsanParameters configured = {};
+  ::common::SetDefaultAsanParameters(&configured);
+  configured.quarantine_size = 16 * 1024 * 1024;
+  configured.zebra_block_heap_quarantine_ratio = 0.4f;
+
+  ::common::AsanParameters parameters = configured;
+  MemoryPressureMonitor::AdjustParameters(
+      MemoryPressureMonitor::NORMAL_MEMORY_AVAILABLE, &parameters);
+  EXPECT_EQ(0, ::memcmp(&configured, &parameters, sizeof(parameters)));
+
+  MemoryPressureMonitor::AdjustParameters(
+      MemoryPressureMonitor::LOW_MEMORY_AVAILABLE, &parameters);
+  EXPECT_EQ(4u * 1024 * 1024, parameters.quarantine_size);
+  EXPECT_FLOAT_EQ(0.1f, parameters.zebra_block_heap_quarantine_ratio);
+
+  parameters = configured;
+  MemoryPressureMonitor::AdjustParameters(
+      MemoryPressureMonitor::HIGH_MEMORY_AVAILABLE, &parameters);
+  EXPECT_EQ(32u * 1024 * 1024, parameters.quarantine_size);
+  EXPECT_FLOAT_EQ(0.8f, parameters.zebra_block_heap_quarantine_ratio);
+
+  // The budgets saturate rather than overflow.
+  parameters.quarantine_size = 0xF0000000;
+  parameters.zebra_block_heap_quarantine_ratio = 0.9f;
+  MemoryPressureMonitor::AdjustParameters(
+      MemoryPressureMonitor::HIGH_MEMORY_AVAILABLE, &parameters);
+  EXPECT_LE(0xF0000000u, parameters.quarantine_size);
+  EXPECT_FLOAT_EQ(1.0f, parameters.zebra_block_heap_quarantine_ratio);
+}
+
+TEST_F(MemoryPressureMonitorTest, StartAndStop) {
+  MemoryPressureMonitor monitor(GetCallback());
+  ASSERT_TRUE(monitor.Init());
+  MemoryPressureMonitor::MemoryAvailability availability =
+      monitor.QueryMemoryAvailability();
+
+  ASSERT_TRUE(monitor.Start());
+  monitor.Stop();
+
+  // The thread records the availability of the system as it starts.
+  EXPECT_EQ(availability, monitor.availability());
+  if (availability != MemoryPressureMonitor::NORMAL_MEMORY_AVAILABLE)
+    EXPECT_LE(1, callback_count_);
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -22,10 +22,16 @@
 // use as much memory as the 'high waterline'. Thus, it is not suitable for
 // managing bursty objects. Rather, it should be used for pools that tend to
 // grow monotonically to a stable maximum size.
+//
+// Each thread can optionally be given a cache of freed objects. These are
+// handed back to the same thread without taking any of the shared locks, and
+// move to and from the shared free lists in batches.
 
 #ifndef SYZYGY_AGENT_ASAN_PAGE_ALLOCATOR_H_
 #define SYZYGY_AGENT_ASAN_PAGE_ALLOCATOR_H_
 
+#include <windows.h>
+
 #include "base/synchronization/lock.h"
 
 namespace agent {
@@ -58,10 +64,15 @@ template<size_t kObjectSize, size_t kPageSize> struct PageAllocatorPage;
 //     the allocation granularity. This ensures efficient memory use and
 //     minimal fragmentation.
 // @tparam kKeepStats If true, then statistics will be collected.
+// @tparam kThreadCacheCapacity The number of groups of objects of each size
+//     that a thread may keep in its cache. Groups move between the thread
+//     caches and the shared free lists in batches of half this size. If this
+//     is zero then there are no thread caches.
 template<size_t kObjectSize,
          size_t kMaxObjectCount,
          size_t kPageSize,
-         bool kKeepStats>
+         bool kKeepStats,
+         size_t kThreadCacheCapacity = 0>
 class PageAllocator {
  public:
   typedef detail::PageAllocatorPage<kObjectSize, kPageSize> Page;
@@ -165,6 +176,59 @@ class PageAllocator {
   void FreePush(Object* object, size_t count,
                 bool decr_alloc_groups, bool decr_alloc_objects);
 
+  // The cache of freed objects of a thread. These are created the first time a
+  // thread uses the allocator, and live as long as the allocator.
+  struct ThreadCache {
+    // A singly linked list of freed objects, one per size category, and the
+    // number of groups in each of them.
+    Object* free[kMaxObjectCount];
+    size_t count[kMaxObjectCount];
+    // Taken by the owning thread, so that the lists can be inspected by
+    // IsInFreeList. It is thus almost never contended.
+    base::Lock lock;
+    // The next cache in thread_caches_. Under thread_caches_lock_.
+    ThreadCache* next;
+  };
+
+  // The number of groups moved at once between a thread cache and the shared
+  // free lists.
+  static const size_t kThreadCacheBatchSize = (kThreadCacheCapacity + 1) / 2;
+
+  // Returns the cache of the calling thread, creating it if need be.
+  // @returns the cache, or nullptr if thread caches are disabled.
+  ThreadCache* GetThreadCache();
+
+  // Pops a group of objects from a thread cache. An empty cache is refilled
+  // with a batch from the shared free list.
+  // @param cache The cache of the calling thread.
+  // @param count The size class.
+  // @returns a pointer to the popped item, nullptr if there was none.
+  // @note Handles locking, so no free_lock_ should be already held.
+  Object* ThreadCachePop(ThreadCache* cache, size_t count);
+
+  // Pushes a group of objects to a thread cache. If the cache overflows then
+  // a batch of its groups is moved to the shared free list.
+  // @param cache The cache of the calling thread.
+  // @param object The objects to free.
+  // @param count The number of objects to free.
+  // @note Handles locking, so no free_lock_ should be already held.
+  void ThreadCachePush(ThreadCache* cache, Object* object, size_t count);
+
+  // Unlinks up to @p max_groups groups from the given free list, taking its
+  // lock once. This does not update the statistics.
+  // @param count The size class.
+  // @param max_groups The maximum number of groups to unlink.
+  // @param list Will receive the null terminated list of unlinked groups.
+  // @returns the number of unlinked groups.
+  size_t FreePopBatch(size_t count, size_t max_groups, Object** list);
+
+  // Links a list of groups to the given free list, taking its lock once.
+  // This does not update the statistics.
+  // @param head The first group of the list.
+  // @param tail The last group of the list.
+  // @param count The size class.
+  void FreePushBatch(Object* head, Object* tail, size_t count);
+
   // Reserves a new page of objects, modifying current_page_ and
   // current_object_. Any remaining unallocated objects are stuffed into the
   // appropriate freed list. There may be no more than kMaxObjectCount of them.
@@ -195,6 +259,14 @@ class PageAllocator {
   // The global lock for the allocator.
   base::Lock lock_;
 
+  // The TLS slot holding the cache of each thread, or TLS_OUT_OF_INDEXES if
+  // thread caches are disabled.
+  DWORD thread_cache_tls_;
+
+  // The thread caches. Under thread_caches_lock_.
+  ThreadCache* thread_caches_;
+  base::Lock thread_caches_lock_;
+
   // For keeping statistics. If kKeepStats == 0 this is an empty struct with
   // noop routines.
   detail::PageAllocatorStatisticsHelper<kKeepStats> stats_;
@@ -213,19 +285,24 @@ class PageAllocator {
 // @tparam kPageSize The amount of memory to be allocated at a time as
 //     the pool grows.
 // @tparam kKeepStats If true, then statistics will be collected.
+// @tparam kThreadCacheCapacity The number of groups of objects of each size
+//     that a thread may keep in its cache. If this is zero then there are no
+//     thread caches.
 template<typename ObjectType,
          size_t kMaxObjectCount,
          size_t kPageSize,
-         bool kKeepStats>
+         bool kKeepStats,
+         size_t kThreadCacheCapacity = 0>
 class TypedPageAllocator
     : public PageAllocator<sizeof(ObjectType),
                            kMaxObjectCount,
                            kPageSize,
-                           kKeepStats> {
+                           kKeepStats,
+                           kThreadCacheCapacity> {
  public:
   // The parent type for this class.
   typedef PageAllocator<sizeof(ObjectType), kMaxObjectCount, kPageSize,
-                        kKeepStats> Super;
+                        kKeepStats, kThreadCacheCapacity> Super;
 
   // Constructor.
   TypedPageAllocator() { }
@@ -269,6 +346,12 @@ struct PageAllocatorStatistics {
   size_t freed_groups;
   // The total number of objects living in free lists.
   size_t freed_objects;
+  // The number of thread caches.
+  size_t thread_cache_count;
+  // The number of groups of objects living in thread caches.
+  size_t cached_groups;
+  // The total number of objects living in thread caches.
+  size_t cached_objects;
 };
 
 }  // namespace asan
@@ -144,11 +144,13 @@ struct PageAllocatorPage {
 }  // namespace detail
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::
 PageAllocator()
     : page_count_(0), slab_(nullptr), slab_cursor_(nullptr), page_(nullptr),
-      object_(nullptr) {
+      object_(nullptr), thread_cache_tls_(TLS_OUT_OF_INDEXES),
+      thread_caches_(nullptr) {
   static_assert(kPageSize > kObjectSize,
                 "Page size should be bigger than the object size.");
   static_assert(kObjectSize >= sizeof(uintptr_t), "Object size is too small.");
@@ -159,12 +161,29 @@ PageAllocator()
 
   // Clear the freelists.
   ::memset(free_, 0, sizeof(free_));
+
+  // The thread caches are found via a TLS slot of their own.
+  if (kThreadCacheCapacity > 0) {
+    thread_cache_tls_ = ::TlsAlloc();
+    CHECK_NE(TLS_OUT_OF_INDEXES, thread_cache_tls_);
+  }
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::
 ~PageAllocator() {
+  // Release the thread caches. The objects they hold live in the pages, which
+  // are released below.
+  while (thread_caches_) {
+    ThreadCache* next = thread_caches_->next;
+    delete thread_caches_;
+    thread_caches_ = next;
+  }
+  if (thread_cache_tls_ != TLS_OUT_OF_INDEXES)
+    CHECK_EQ(TRUE, ::TlsFree(thread_cache_tls_));
+
   // Iterate over the pages and make not of the slab addresses. These will
   // be pages whose root address a multiple of the allocation granulairty.
   Page* page = page_;
@@ -193,8 +212,9 @@ PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-void* PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void* PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                    kThreadCacheCapacity>::
 Allocate(size_t count) {
   size_t received = 0;
   void* alloc = Allocate(count, &received);
@@ -214,8 +234,9 @@ Allocate(size_t count) {
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-void* PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void* PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                    kThreadCacheCapacity>::
 Allocate(size_t count, size_t* received) {
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
@@ -223,6 +244,17 @@ Allocate(size_t count, size_t* received) {
 
   void* object = nullptr;
 
+  // Look to the cache of the calling thread first. This only takes the shared
+  // locks when the cache needs to be refilled.
+  ThreadCache* cache = GetThreadCache();
+  if (cache != nullptr) {
+    object = ThreadCachePop(cache, count);
+    if (object != nullptr) {
+      *received = count;
+      return object;
+    }
+  }
+
   // Look to the lists of freed objects and try to use one of those. Use the
   // first one that's big enough, and stuff the leftover objects into another
   // freed list.
@@ -279,8 +311,9 @@ Allocate(size_t count, size_t* received) {
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
 Free(void* object, size_t count) {
   DCHECK_NE(static_cast<void*>(nullptr), object);
   DCHECK_LT(0u, count);
@@ -292,6 +325,13 @@ Free(void* object, size_t count) {
   DCHECK_EQ(1, AllocationStatus(object, count));
 #endif
 
+  // Keep the object in the cache of the calling thread if there's one.
+  ThreadCache* cache = GetThreadCache();
+  if (cache != nullptr) {
+    ThreadCachePush(cache, reinterpret_cast<Object*>(object), count);
+    return;
+  }
+
   // Add this object to the list of freed objects for this size class.
   // This is a simple allocation that is being returned so both allocated
   // groups and objects are decremented.
@@ -299,8 +339,9 @@ Free(void* object, size_t count) {
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
 GetStatistics(PageAllocatorStatistics* stats) {
   DCHECK_NE(static_cast<PageAllocatorStatistics*>(nullptr), stats);
 
@@ -310,8 +351,9 @@ GetStatistics(PageAllocatorStatistics* stats) {
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-int PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+int PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                  kThreadCacheCapacity>::
 AllocationStatus(const void* object, size_t count) {
   // If the memory was never allocated then it's under management.
   if (!WasOnceAllocated(object, count))
@@ -325,8 +367,9 @@ AllocationStatus(const void* object, size_t count) {
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
 WasOnceAllocated(const void* object, size_t count) {
   if (object == nullptr || count == 0)
     return false;
@@ -368,8 +411,9 @@ WasOnceAllocated(const void* object, size_t count) {
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
 IsInFreeList(const void* object, size_t count) {
   if (object == nullptr)
     return false;
@@ -399,15 +443,31 @@ IsInFreeList(const void* object, size_t count) {
     }
   }
 
+  // Walk the thread caches as well.
+  base::AutoLock caches_lock(thread_caches_lock_);
+  for (ThreadCache* cache = thread_caches_; cache; cache = cache->next) {
+    base::AutoLock lock(cache->lock);
+    for (size_t n = n_min; n <= n_max; ++n) {
+      Object* free = cache->free[n - 1];
+      while (free) {
+        if (free == object)
+          return true;
+        free = free->next_free;
+      }
+    }
+  }
+
   // The freed objects have been exhausted and no match was found.
   return false;
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
+         bool kKeepStats, size_t kThreadCacheCapacity>
 typename
-PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::Object*
-PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::Object*
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::
     FreePop(size_t count) {
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
@@ -431,8 +491,9 @@ PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
     FreePush(Object* object, size_t count,
              bool decr_alloc_groups, bool decr_alloc_objects) {
   DCHECK_NE(static_cast<void*>(nullptr), object);
@@ -457,8 +518,9 @@ void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
     AllocatePageLocked() {
   lock_.AssertAcquired();
 
@@ -515,10 +577,198 @@ bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
   return true;
 }
 
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
+         bool kKeepStats, size_t kThreadCacheCapacity>
+size_t PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                     kThreadCacheCapacity>::
+    FreePopBatch(size_t count, size_t max_groups, Object** list) {
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+  DCHECK_LT(0u, max_groups);
+  DCHECK_NE(static_cast<Object**>(nullptr), list);
+
+  Object* head = nullptr;
+  size_t groups = 0;
+  {
+    base::AutoLock lock(free_lock_[count - 1]);
+    head = free_[count - 1];
+    Object* tail = nullptr;
+    Object* object = head;
+    while (object != nullptr && groups < max_groups) {
+      tail = object;
+      object = object->next_free;
+      ++groups;
+    }
+    if (groups == 0)
+      return 0;
+    free_[count - 1] = object;
+    tail->next_free = nullptr;
+  }
+  *list = head;
+
+  return groups;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
+    FreePushBatch(Object* head, Object* tail, size_t count) {
+  DCHECK_NE(static_cast<Object*>(nullptr), head);
+  DCHECK_NE(static_cast<Object*>(nullptr), tail);
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  base::AutoLock lock(free_lock_[count - 1]);
+  tail->next_free = free_[count - 1];
+  free_[count - 1] = head;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
+         bool kKeepStats, size_t kThreadCacheCapacity>
+typename
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::ThreadCache*
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::
+    GetThreadCache() {
+  if (thread_cache_tls_ == TLS_OUT_OF_INDEXES)
+    return nullptr;
+
+  ThreadCache* cache =
+      reinterpret_cast<ThreadCache*>(::TlsGetValue(thread_cache_tls_));
+  if (cache != nullptr)
+    return cache;
+
+  // This is the first time that this thread uses the allocator, so give it a
+  // cache of its own.
+  cache = new ThreadCache();
+  ::memset(cache->free, 0, sizeof(cache->free));
+  ::memset(cache->count, 0, sizeof(cache->count));
+  {
+    base::AutoLock lock(thread_caches_lock_);
+    cache->next = thread_caches_;
+    thread_caches_ = cache;
+  }
+  ::TlsSetValue(thread_cache_tls_, cache);
+
+  // Update statistics.
+  stats_.Lock();
+  stats_.Increment<&PageAllocatorStatistics::thread_cache_count>(1);
+  stats_.Unlock();
+
+  return cache;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
+         bool kKeepStats, size_t kThreadCacheCapacity>
+typename
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::Object*
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+              kThreadCacheCapacity>::
+    ThreadCachePop(ThreadCache* cache, size_t count) {
+  DCHECK_NE(static_cast<ThreadCache*>(nullptr), cache);
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  base::AutoLock lock(cache->lock);
+
+  // Refill an empty cache with a batch of groups from the shared free list.
+  size_t refilled = 0;
+  if (cache->free[count - 1] == nullptr) {
+    refilled = FreePopBatch(count, kThreadCacheBatchSize,
+                            &cache->free[count - 1]);
+    if (refilled == 0)
+      return nullptr;
+    cache->count[count - 1] = refilled;
+  }
+
+  Object* object = cache->free[count - 1];
+  cache->free[count - 1] = object->next_free;
+  --cache->count[count - 1];
+  object->next_free = nullptr;
+
+  // Update statistics.
+  stats_.Lock();
+  if (refilled > 0) {
+    stats_.Decrement<&PageAllocatorStatistics::freed_groups>(refilled);
+    stats_.Decrement<&PageAllocatorStatistics::freed_objects>(
+        refilled * count);
+    stats_.Increment<&PageAllocatorStatistics::cached_groups>(refilled);
+    stats_.Increment<&PageAllocatorStatistics::cached_objects>(
+        refilled * count);
+  }
+  stats_.Decrement<&PageAllocatorStatistics::cached_groups>(1);
+  stats_.Decrement<&PageAllocatorStatistics::cached_objects>(count);
+  stats_.Increment<&PageAllocatorStatistics::allocated_groups>(1);
+  stats_.Increment<&PageAllocatorStatistics::allocated_objects>(count);
+  stats_.Unlock();
+
+  return object;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
+    ThreadCachePush(ThreadCache* cache, Object* object, size_t count) {
+  DCHECK_NE(static_cast<ThreadCache*>(nullptr), cache);
+  DCHECK_NE(static_cast<Object*>(nullptr), object);
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  base::AutoLock lock(cache->lock);
+
+  object->next_free = cache->free[count - 1];
+  cache->free[count - 1] = object;
+  ++cache->count[count - 1];
+
+  // Move a batch of groups to the shared free list when the cache overflows.
+  // The most recently freed groups stay in the cache, as they're the most
+  // likely to still be in the CPU caches.
+  size_t drained = 0;
+  if (cache->count[count - 1] > kThreadCacheCapacity) {
+    size_t kept = cache->count[count - 1] - kThreadCacheBatchSize;
+    DCHECK_LT(0u, kept);
+    Object* last_kept = nullptr;
+    Object* head = cache->free[count - 1];
+    for (size_t i = 0; i < kept; ++i) {
+      last_kept = head;
+      head = head->next_free;
+    }
+    Object* tail = head;
+    for (size_t i = 1; i < kThreadCacheBatchSize; ++i)
+      tail = tail->next_free;
+
+    last_kept->next_free = nullptr;
+    cache->count[count - 1] = kept;
+    drained = kThreadCacheBatchSize;
+    FreePushBatch(head, tail, count);
+  }
+
+  // Update statistics.
+  stats_.Lock();
+  stats_.Decrement<&PageAllocatorStatistics::allocated_groups>(1);
+  stats_.Decrement<&PageAllocatorStatistics::allocated_objects>(count);
+  stats_.Increment<&PageAllocatorStatistics::cached_groups>(1);
+  stats_.Increment<&PageAllocatorStatistics::cached_objects>(count);
+  if (drained > 0) {
+    stats_.Decrement<&PageAllocatorStatistics::cached_groups>(drained);
+    stats_.Decrement<&PageAllocatorStatistics::cached_objects>(
+        drained * count);
+    stats_.Increment<&PageAllocatorStatistics::freed_groups>(drained);
+    stats_.Increment<&PageAllocatorStatistics::freed_objects>(
+        drained * count);
+  }
+  stats_.Unlock();
+}
+
 template<typename ObjectType, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
+         bool kKeepStats, size_t kThreadCacheCapacity>
 ObjectType*
-TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats>::
+TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
     Allocate(size_t count) {
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
@@ -527,9 +777,10 @@ TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats>::
 }
 
 template<typename ObjectType, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
+         bool kKeepStats, size_t kThreadCacheCapacity>
 ObjectType*
-TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats>::
+TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats,
+                   kThreadCacheCapacity>::
     Allocate(size_t count, size_t* received) {
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
@@ -539,8 +790,9 @@ TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats>::
 }
 
 template<typename ObjectType, size_t kMaxObjectCount, size_t kPageSize,
-         bool kKeepStats>
-void TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats>::
+         bool kKeepStats, size_t kThreadCacheCapacity>
+void TypedPageAllocator<ObjectType, kMaxObjectCount, kPageSize, kKeepStats,
+                        kThreadCacheCapacity>::
     Free(ObjectType* object, size_t count) {
   DCHECK_NE(static_cast<ObjectType*>(nullptr), object);
   DCHECK_LT(0u, count);
@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/asan/page_allocator.h"
 
+#include <vector>
+
+#include "base/threading/platform_thread.h"
 #include "gtest/gtest.h"
 
 namespace agent {
@@ -23,12 +26,14 @@ namespace {
 
 template<size_t kObjectSize,
          size_t kMaxObjectCount,
-         size_t kPageSize>
+         size_t kPageSize,
+         size_t kThreadCacheCapacity = 0>
 class TestPageAllocator
-    : public PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, true> {
+    : public PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, true,
+                           kThreadCacheCapacity> {
  public:
-  typedef PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, true>
-      Super;
+  typedef PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, true,
+                        kThreadCacheCapacity> Super;
 
   void AllocatePage() {
     base::AutoLock lock(lock_);
@@ -86,6 +91,30 @@ class TestTypedPageAllocator
 typedef TestPageAllocator<16, 1, 4096> TestPageAllocator255;
 typedef TestPageAllocator<16, 10, 4096> TestPageAllocatorMulti255;
 
+// A page allocator whose threads cache up to 4 groups of each size.
+typedef TestPageAllocator<16, 2, 4096, 4> TestCachedPageAllocator;
+
+// Frees an allocation on a thread of its own.
+class FreeOnThread : public base::PlatformThread::Delegate {
+ public:
+  FreeOnThread(TestCachedPageAllocator* pa, void* alloc, size_t count)
+      : pa_(pa), alloc_(alloc), count_(count) {
+  }
+
+  void ThreadMain() override { pa_->Free(alloc_, count_); }
+
+  void Run() {
+    base::PlatformThreadHandle handle;
+    ASSERT_TRUE(base::PlatformThread::Create(0, this, &handle));
+    base::PlatformThread::Join(handle);
+  }
+
+ private:
+  TestCachedPageAllocator* pa_;
+  void* alloc_;
+  size_t count_;
+};
+
 }  // namespace
 
 TEST(PageAllocatorTest, Constructor) {
@@ -401,6 +430,99 @@ TEST(PageAllocatorTest, MultiSlabsPagesBiggerThanAllGranularity) {
     pa.Allocate(1);
 }
 
+TEST(PageAllocatorTest, ThreadCacheStatsTest) {
+  TestCachedPageAllocator pa;
+  EXPECT_EQ(0u, pa.stats().thread_cache_count);
+
+  std::vector<void*> allocs;
+  for (size_t i = 0; i < 10; ++i)
+    allocs.push_back(pa.Allocate(1));
+  EXPECT_EQ(1u, pa.stats().thread_cache_count);
+  EXPECT_EQ(10u, pa.stats().allocated_groups);
+
+  // The first frees stay in the cache.
+  for (size_t i = 0; i < 4; ++i)
+    pa.Free(allocs[i], 1);
+  EXPECT_EQ(6u, pa.stats().allocated_groups);
+  EXPECT_EQ(4u, pa.stats().cached_groups);
+  EXPECT_EQ(4u, pa.stats().cached_objects);
+  EXPECT_EQ(0u, pa.stats().freed_groups);
+  EXPECT_EQ(0u, pa.FreeObjects(1));
+  EXPECT_TRUE(pa.Freed(allocs[0], 1));
+  EXPECT_TRUE(pa.Allocated(allocs[4], 1));
+
+  // Overflowing the cache moves a batch of the oldest groups to the shared
+  // free list.
+  pa.Free(allocs[4], 1);
+  EXPECT_EQ(3u, pa.stats().cached_groups);
+  EXPECT_EQ(2u, pa.stats().freed_groups);
+  EXPECT_EQ(2u, pa.FreeObjects(1));
+  EXPECT_TRUE(pa.Freed(allocs[0], 1));
+  EXPECT_TRUE(pa.Freed(allocs[4], 1));
+
+  for (size_t i = 5; i < 10; ++i)
+    pa.Free(allocs[i], 1);
+  EXPECT_EQ(0u, pa.stats().allocated_groups);
+  EXPECT_EQ(4u, pa.stats().cached_groups);
+  EXPECT_EQ(6u, pa.stats().freed_groups);
+  EXPECT_EQ(6u, pa.FreeObjects(1));
+
+  // Allocations are served from the cache, most recently freed first.
+  EXPECT_EQ(allocs[9], pa.Allocate(1));
+  for (size_t i = 0; i < 3; ++i)
+    pa.Allocate(1);
+  EXPECT_EQ(0u, pa.stats().cached_groups);
+  EXPECT_EQ(6u, pa.stats().freed_groups);
+
+  // An empty cache is refilled with a batch from the shared free list.
+  pa.Allocate(1);
+  EXPECT_EQ(5u, pa.stats().allocated_groups);
+  EXPECT_EQ(1u, pa.stats().cached_groups);
+  EXPECT_EQ(4u, pa.stats().freed_groups);
+  EXPECT_EQ(4u, pa.FreeObjects(1));
+  EXPECT_EQ(1u, pa.stats().page_count);
+}
+
+TEST(PageAllocatorTest, ThreadCachesAreSizeClassed) {
+  TestCachedPageAllocator pa;
+
+  void* a1 = pa.Allocate(2);
+  void* a2 = pa.Allocate(1);
+  pa.Free(a1, 2);
+  EXPECT_EQ(1u, pa.stats().cached_groups);
+  EXPECT_EQ(2u, pa.stats().cached_objects);
+  EXPECT_TRUE(pa.Freed(a1, 2));
+  EXPECT_FALSE(pa.Freed(a1, 1));
+
+  // A single object isn't carved out of the cached pair.
+  void* a3 = pa.Allocate(1);
+  EXPECT_NE(a1, a3);
+  EXPECT_EQ(a1, pa.Allocate(2));
+  EXPECT_EQ(0u, pa.stats().cached_groups);
+
+  pa.Free(a2, 1);
+  pa.Free(a3, 1);
+}
+
+TEST(PageAllocatorTest, ThreadCachesArePerThread) {
+  TestCachedPageAllocator pa;
+
+  // Free an allocation on another thread. It lands in the cache of that
+  // thread, and is not handed back to this one.
+  void* a1 = pa.Allocate(1);
+  FreeOnThread free_on_thread(&pa, a1, 1);
+  free_on_thread.Run();
+  EXPECT_EQ(2u, pa.stats().thread_cache_count);
+  EXPECT_EQ(1u, pa.stats().cached_groups);
+  EXPECT_TRUE(pa.Freed(a1, 1));
+
+  void* a2 = pa.Allocate(1);
+  EXPECT_NE(a1, a2);
+  EXPECT_TRUE(pa.Freed(a1, 1));
+  pa.Free(a2, 1);
+  EXPECT_EQ(2u, pa.stats().cached_groups);
+}
+
 TEST(TypedPageAllocatorTest, SingleEndToEnd) {
   TypedPageAllocator<size_t, 1, 1000, true> pa;
   for (size_t i = 0; i < 1600; ++i) {
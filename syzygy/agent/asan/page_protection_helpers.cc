@@ -22,6 +22,34 @@ namespace asan {
 
 ::common::RecursiveLock block_protect_lock;
 
+namespace {
+
+// Set once a block has its body pages decommitted. Until then there is no
+// need to look for decommitted pages. Written under block_protect_lock.
+bool body_pages_decommitted = false;
+
+// Commits again the body pages of a block, if they are decommitted.
+void BlockRecommitBody(const BlockInfo& block_info) {
+  if (!body_pages_decommitted)
+    return;
+
+  uint8_t* pages = nullptr;
+  uint32_t pages_size = 0;
+  BlockGetBodyPages(block_info, &pages, &pages_size);
+  if (pages_size == 0)
+    return;
+
+  // The pages are decommitted all at once, so the first one tells.
+  MEMORY_BASIC_INFORMATION memory_info = {};
+  CHECK_NE(0u, ::VirtualQuery(pages, &memory_info, sizeof(memory_info)));
+  if (memory_info.State != MEM_RESERVE)
+    return;
+  CHECK_NE(static_cast<void*>(nullptr),
+           ::VirtualAlloc(pages, pages_size, MEM_COMMIT, PAGE_READWRITE));
+}
+
+}  // namespace
+
 bool GetBlockInfo(const Shadow* shadow,
                   const BlockBody* body,
                   CompactBlockInfo* block_info) {
@@ -65,7 +93,16 @@ void BlockProtectNone(const BlockInfo& block_info, Shadow* shadow) {
     return;
 
   ::common::AutoRecursiveLock lock(block_protect_lock);
+  BlockProtectNoneUnlocked(block_info, shadow);
+}
+
+void BlockProtectNoneUnlocked(const BlockInfo& block_info, Shadow* shadow) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  if (block_info.block_pages_size == 0)
+    return;
+
   DCHECK_NE(static_cast<uint8_t*>(nullptr), block_info.block_pages);
+  BlockRecommitBody(block_info);
   DWORD old_protection = 0;
   DWORD ret = ::VirtualProtect(block_info.block_pages,
                                block_info.block_pages_size,
@@ -160,5 +197,33 @@ void BlockProtectAuto(const BlockInfo& block_info, Shadow* shadow) {
   }
 }
 
+bool BlockDecommitBody(const BlockInfo& block_info) {
+  uint8_t* pages = nullptr;
+  uint32_t pages_size = 0;
+  BlockGetBodyPages(block_info, &pages, &pages_size);
+  if (pages_size == 0)
+    return false;
+
+  ::common::AutoRecursiveLock lock(block_protect_lock);
+  body_pages_decommitted = true;
+  return ::VirtualFree(pages, pages_size, MEM_DECOMMIT) != 0;
+}
+
+bool BlockBodyIsDecommitted(const BlockInfo& block_info) {
+  if (!body_pages_decommitted)
+    return false;
+
+  uint8_t* pages = nullptr;
+  uint32_t pages_size = 0;
+  BlockGetBodyPages(block_info, &pages, &pages_size);
+  if (pages_size == 0)
+    return false;
+
+  MEMORY_BASIC_INFORMATION memory_info = {};
+  if (::VirtualQuery(pages, &memory_info, sizeof(memory_info)) == 0)
+    return false;
+  return memory_info.State == MEM_RESERVE;
+}
+
 }  // namespace asan
 }  // namespace agent
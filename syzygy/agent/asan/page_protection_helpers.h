@@ -50,12 +50,21 @@ bool GetBlockInfo(const Shadow* shadow,
 
 // Unprotects all pages fully covered by the given block. All pages
 // intersecting but not fully covered by the block will be left in their
-// current state.
+// current state. Body pages decommitted by BlockDecommitBody are committed
+// again.
 // @param block_info The block whose protections are to be modified.
 // @param shadow The shadow to update.
 // @note Under block_protect_lock.
 void BlockProtectNone(const BlockInfo& block_info, Shadow* shadow);
 
+// Same as BlockProtectNone, but without acquiring block_protect_lock. This is
+// for threads working on behalf of a thread that holds it, such as the worker
+// threads of the heap checker. Concurrent callers must work on distinct
+// blocks.
+// @param block_info The block whose protections are to be modified.
+// @param shadow The shadow to update.
+void BlockProtectNoneUnlocked(const BlockInfo& block_info, Shadow* shadow);
+
 // Protects all entire pages that are spanned by the redzones of the
 // block. All pages intersecting the body of the block will be explicitly
 // unprotected. All pages not intersecting the body but only partially
@@ -81,6 +90,21 @@ void BlockProtectAll(const BlockInfo& block_info, Shadow* shadow);
 // @note Under block_protect_lock.
 void BlockProtectAuto(const BlockInfo& block_info, Shadow* shadow);
 
+// Decommits the pages entirely covered by the body of a block protected by
+// BlockProtectAll. The pages stay reserved and marked as protected in the
+// shadow, so an access to them is still reported. BlockProtectNone commits
+// them again, and they then read as zeros: their contents must be zeroed
+// before the checksum of the block is set, so that it still holds.
+// @param block_info The block whose body pages are to be decommitted.
+// @returns true if the body pages were decommitted, false if there are none
+//     or on failure.
+// @note Under block_protect_lock.
+bool BlockDecommitBody(const BlockInfo& block_info);
+
+// @param block_info The block to query.
+// @returns true if the body pages of the block are decommitted.
+bool BlockBodyIsDecommitted(const BlockInfo& block_info);
+
 }  // namespace asan
 }  // namespace agent
 
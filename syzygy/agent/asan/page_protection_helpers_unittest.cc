@@ -305,5 +305,56 @@ TEST_F(PageProtectionHelpersTest, BlockProtectAuto) {
   ASSERT_EQ(TRUE, ::VirtualFree(alloc, 0, MEM_RELEASE));
 }
 
+TEST_F(PageProtectionHelpersTest, BlockDecommitBody) {
+  BlockLayout layout = {};
+  const uint32_t kPageSize = static_cast<uint32_t>(GetPageSize());
+  EXPECT_TRUE(BlockPlanLayout(kPageSize, kPageSize, 4 * kPageSize, kPageSize,
+                              kPageSize, &layout));
+  void* alloc = ::VirtualAlloc(NULL, layout.block_size, MEM_COMMIT,
+                               PAGE_READWRITE);
+  ASSERT_TRUE(alloc != NULL);
+
+  BlockInfo block_info = {};
+  BlockInitialize(layout, alloc, &block_info);
+  uint8_t* pages = nullptr;
+  uint32_t pages_size = 0;
+  BlockGetBodyPages(block_info, &pages, &pages_size);
+  EXPECT_EQ(block_info.RawBody(), pages);
+  EXPECT_EQ(4 * kPageSize, pages_size);
+  ::memset(block_info.RawBody(), 0xAB, block_info.body_size);
+
+  block_info.header->state = QUARANTINED_BLOCK;
+  BlockProtectAll(block_info, &shadow_);
+  EXPECT_FALSE(BlockBodyIsDecommitted(block_info));
+  EXPECT_TRUE(BlockDecommitBody(block_info));
+  EXPECT_TRUE(BlockBodyIsDecommitted(block_info));
+  TestAccessUnderProtection(block_info, kProtectAll);
+
+  // Unprotecting the block commits its body again, as zeros.
+  BlockProtectNone(block_info, &shadow_);
+  EXPECT_FALSE(BlockBodyIsDecommitted(block_info));
+  TestAccessUnderProtection(block_info, kProtectNone);
+  for (uint32_t i = 0; i < pages_size; ++i)
+    EXPECT_EQ(0u, pages[i]);
+
+  ASSERT_EQ(TRUE, ::VirtualFree(alloc, 0, MEM_RELEASE));
+}
+
+TEST_F(PageProtectionHelpersTest, BlockDecommitBodyWithoutWholePages) {
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 100, 0, 0,
+                              &layout));
+  void* alloc = ::VirtualAlloc(NULL, layout.block_size, MEM_COMMIT,
+                               PAGE_READWRITE);
+  ASSERT_TRUE(alloc != NULL);
+
+  BlockInfo block_info = {};
+  BlockInitialize(layout, alloc, &block_info);
+  EXPECT_FALSE(BlockDecommitBody(block_info));
+  EXPECT_FALSE(BlockBodyIsDecommitted(block_info));
+
+  ASSERT_EQ(TRUE, ::VirtualFree(alloc, 0, MEM_RELEASE));
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -17,7 +17,10 @@
 #ifndef SYZYGY_AGENT_ASAN_QUARANTINES_SHARDED_QUARANTINE_H_
 #define SYZYGY_AGENT_ASAN_QUARANTINES_SHARDED_QUARANTINE_H_
 
+#include <windows.h>
+
 #include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/lock_profiler.h"
 #include "syzygy/agent/asan/page_allocator.h"
 #include "syzygy/agent/asan/quarantines/size_limited_quarantine.h"
 
@@ -26,8 +29,14 @@ namespace asan {
 namespace quarantines {
 
 // A simple sharded quarantine. This distributes objects among a configurable
-// number of shards using a lightweight threadsafe hashing mechanism. Each
-// shard has its own lock, greatly reducing lock contention for the quarantine.
+// number of shards using a lightweight threadsafe hashing mechanism.
+//
+// Each shard is a multi-producer single-consumer queue. Producers push objects
+// onto a lock-free inbox and never block. Consumers serialize on the lock of
+// the shard, and move the contents of the inbox to a FIFO list as it runs
+// dry. Thus pushes never contend with trimming, and consumers only contend
+// with each other. Holding the lock of a shard (see Lock) prevents objects
+// from being popped from it, but does not prevent pushes.
 //
 // @tparam ObjectType The type of object being stored in the cache.
 // @tparam SizeFunctorType A functor for extracting the size associated with
@@ -59,6 +68,21 @@ class ShardedQuarantine
   // Virtual destructor.
   virtual ~ShardedQuarantine() { }
 
+  // Pops an object from the subset of shards owned by a given consumer. The
+  // shards are partitioned among @p consumer_count consumers, consumer i
+  // owning the shards whose index is congruent to i modulo @p consumer_count.
+  // Consumers that stick to their own shards never contend with each other.
+  // This otherwise behaves like Pop, and fails if the shards of the consumer
+  // are all empty.
+  // @param consumer_index The index of the consumer.
+  // @param consumer_count The number of consumers. Must be in the range
+  //     [1, kShardingFactor].
+  // @param object Will receive the popped object.
+  // @returns the result of the pop.
+  PopResult PopFromShards(size_t consumer_index,
+                          size_t consumer_count,
+                          Object* object);
+
  protected:
   // @name SizeLimitedQuarantineImpl implementation.
   // @{
@@ -87,16 +111,35 @@ class ShardedQuarantine
   // number of pages, and to respect the system allocation granularity.
   typedef TypedPageAllocator<Node, 1, 32 * 1024, false> NodeCache;
 
-  // Linked lists containing quarantined objects. Each shard is under the
-  // corresponding locks_ entry. Objects are inserted at the tail, and
-  // removed from the head.
+  // Pops an object from the shards first_shard + k * shard_stride. The scan
+  // starts at a random one of these shards.
+  // @param first_shard The first shard of the subset.
+  // @param shard_stride The distance between consecutive shards of the subset.
+  // @param object Will receive the popped object.
+  // @returns true if an object was popped, false if the shards were empty.
+  bool PopFromShardsImpl(size_t first_shard,
+                         size_t shard_stride,
+                         Object* object);
+
+  // Moves the contents of the inbox of a shard to the tail of its FIFO list.
+  // @param shard The shard whose inbox is to be drained. The corresponding
+  //     lock must be held.
+  void DrainInboxLocked(size_t shard);
+
+  // Lock-free stacks of the objects pushed to each shard, most recent first.
+  // These are only modified via interlocked operations.
+  Node* volatile inboxes_[kShardingFactor];
+
+  // Linked lists containing quarantined objects that have been moved out of
+  // the inboxes. Each shard is under the corresponding locks_ entry. Objects
+  // are inserted at the tail, and removed from the head.
   Node* heads_[kShardingFactor];
   Node* tails_[kShardingFactor];
 
   // Storage for nodes, one per shard. Each is under its own internal lock.
   NodeCache node_caches_[kShardingFactor];
 
-  // Locks, one per linked list.
+  // Consumer locks, one per shard.
   base::Lock locks_[kShardingFactor];
 
   // The hash functor that will be used to assign objects to shards.
@@ -48,6 +48,7 @@ size_t ShardedQuarantineHash(size_t a) {
 template<typename OT, typename SFT, typename HFT, size_t SF>
 ShardedQuarantine<OT, SFT, HFT, SF>::ShardedQuarantine() {
   static_assert(kShardingFactor >= 1, "Invalid sharding factor.");
+  ::memset(const_cast<Node**>(inboxes_), 0, sizeof(inboxes_));
   ::memset(heads_, 0, sizeof(heads_));
   ::memset(tails_, 0, sizeof(tails_));
 }
@@ -57,6 +58,7 @@ ShardedQuarantine<OT, SFT, HFT, SF>::ShardedQuarantine(
     const HashFunctor& hash_functor)
     : hash_functor_(hash_functor) {
   static_assert(kShardingFactor >= 1, "Invalid sharding factor.");
+  ::memset(const_cast<Node**>(inboxes_), 0, sizeof(inboxes_));
   ::memset(heads_, 0, sizeof(heads_));
   ::memset(tails_, 0, sizeof(tails_));
 }
@@ -65,63 +67,52 @@ template<typename OT, typename SFT, typename HFT, size_t SF>
 bool ShardedQuarantine<OT, SFT, HFT, SF>::PushImpl(const Object& object) {
   size_t hash = hash_functor_(object);
   size_t shard = detail::ShardedQuarantineHash<kShardingFactor>(hash);
-  // Make sure the corresponding lock is held.
-  locks_[shard].AssertAcquired();
 
   Node* node = node_caches_[shard].Allocate(1);
   if (node == NULL)
     return false;
   node->object = object;
-  node->next = NULL;
 
-  // Append the node to the tail of this shard.
-  if (tails_[shard] != NULL) {
-    DCHECK_NE(static_cast<Node*>(NULL), heads_[shard]);
-    tails_[shard]->next = node;
-    tails_[shard] = node;
-  } else {
-    DCHECK_EQ(static_cast<Node*>(NULL), heads_[shard]);
-    heads_[shard] = node;
-    tails_[shard] = node;
+  // Push the node onto the inbox of this shard. Pushing onto a stack is
+  // immune to ABA, as the head is only ever replaced by the node being
+  // pushed, and the consumer takes the whole stack at once.
+  Node* head = inboxes_[shard];
+  while (true) {
+    node->next = head;
+    Node* previous_head =
+        static_cast<Node*>(::InterlockedCompareExchangePointer(
+            reinterpret_cast<PVOID volatile*>(&inboxes_[shard]), node, head));
+    if (previous_head == head)
+      break;
+    head = previous_head;
   }
 
   return true;
 }
 
 template<typename OT, typename SFT, typename HFT, size_t SF>
-bool ShardedQuarantine<OT, SFT, HFT, SF>::PopImpl(Object* object) {
+PopResult ShardedQuarantine<OT, SFT, HFT, SF>::PopFromShards(
+    size_t consumer_index,
+    size_t consumer_count,
+    Object* object) {
+  DCHECK_LT(0u, consumer_count);
+  DCHECK_GE(kShardingFactor, consumer_count);
+  DCHECK_LT(consumer_index, consumer_count);
   DCHECK_NE(static_cast<Object*>(NULL), object);
+  PopResult result = {false, TrimColor::GREEN};
 
-  // Extract a node from this shard. If the shard is empty then scan linearly
-  // until finding a non-empty one.
-  Node* node = NULL;
-  size_t shard = rand() % kShardingFactor;
-  size_t orig_shard = shard;
-  while (true) {
-    base::AutoLock lock(locks_[shard]);
-    node = heads_[shard];
-    if (node == NULL) {
-      shard = (shard + 1) % kShardingFactor;
+  if (!this->CanPop())
+    return result;
 
-      // If there's no non-empty shard then this means that another thread
-      // emptied out all the buckets while we were in this function.
-      if (shard == orig_shard)
-        return false;
-      continue;
-    }
+  if (!PopFromShardsImpl(consumer_index, consumer_count, object))
+    return result;
 
-    // We've found an element to evict so we can stop looking.
-    heads_[shard] = node->next;
-    if (heads_[shard] == NULL)
-      tails_[shard] = NULL;
-    break;
-  }
-  DCHECK_NE(static_cast<Node*>(NULL), node);
-
-  *object = node->object;
-  node_caches_[shard].Free(node, 1);
+  return this->AccountForPop(*object);
+}
 
-  return true;
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool ShardedQuarantine<OT, SFT, HFT, SF>::PopImpl(Object* object) {
+  return PopFromShardsImpl(0, 1, object);
 }
 
 template<typename OT, typename SFT, typename HFT, size_t SF>
@@ -130,7 +121,8 @@ void ShardedQuarantine<OT, SFT, HFT, SF>::EmptyImpl(ObjectVector* objects) {
 
   // Iterate over each shard and add the objects to the vector.
   for (size_t i = 0; i < kShardingFactor; ++i) {
-    base::AutoLock lock(locks_[i]);
+    ProfiledAutoLock lock(kQuarantineShardLockSite, &locks_[i]);
+    DrainInboxLocked(i);
 
     Node* node = heads_[i];
     while (node) {
@@ -146,6 +138,80 @@ void ShardedQuarantine<OT, SFT, HFT, SF>::EmptyImpl(ObjectVector* objects) {
   return;
 }
 
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool ShardedQuarantine<OT, SFT, HFT, SF>::PopFromShardsImpl(
+    size_t first_shard,
+    size_t shard_stride,
+    Object* object) {
+  DCHECK_LT(first_shard, kShardingFactor);
+  DCHECK_LT(0u, shard_stride);
+  DCHECK_NE(static_cast<Object*>(NULL), object);
+
+  // Extract a node from a random shard of the subset. If the shard is empty
+  // then scan linearly through the subset until finding a non-empty one.
+  size_t shard_count =
+      (kShardingFactor - first_shard + shard_stride - 1) / shard_stride;
+  size_t start = rand() % shard_count;
+  Node* node = NULL;
+  size_t shard = 0;
+  for (size_t i = 0; i < shard_count; ++i) {
+    shard = first_shard + ((start + i) % shard_count) * shard_stride;
+    ProfiledAutoLock lock(kQuarantineShardLockSite, &locks_[shard]);
+    if (heads_[shard] == NULL)
+      DrainInboxLocked(shard);
+    node = heads_[shard];
+    if (node == NULL)
+      continue;
+
+    // We've found an element to evict so we can stop looking.
+    heads_[shard] = node->next;
+    if (heads_[shard] == NULL)
+      tails_[shard] = NULL;
+    break;
+  }
+
+  // If there's no non-empty shard then this means that the subset is empty,
+  // or that another thread emptied it out while we were in this function.
+  if (node == NULL)
+    return false;
+
+  *object = node->object;
+  node_caches_[shard].Free(node, 1);
+
+  return true;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void ShardedQuarantine<OT, SFT, HFT, SF>::DrainInboxLocked(size_t shard) {
+  DCHECK_LT(shard, kShardingFactor);
+  locks_[shard].AssertAcquired();
+
+  Node* node = static_cast<Node*>(::InterlockedExchangePointer(
+      reinterpret_cast<PVOID volatile*>(&inboxes_[shard]), NULL));
+  if (node == NULL)
+    return;
+
+  // The inbox is in reverse order of insertion, so reverse it to preserve the
+  // FIFO order of the shard.
+  Node* first = NULL;
+  Node* last = node;
+  while (node != NULL) {
+    Node* next = node->next;
+    node->next = first;
+    first = node;
+    node = next;
+  }
+
+  if (tails_[shard] != NULL) {
+    DCHECK_NE(static_cast<Node*>(NULL), heads_[shard]);
+    tails_[shard]->next = first;
+  } else {
+    DCHECK_EQ(static_cast<Node*>(NULL), heads_[shard]);
+    heads_[shard] = first;
+  }
+  tails_[shard] = last;
+}
+
 template<typename OT, typename SFT, typename HFT, size_t SF>
 size_t ShardedQuarantine<OT, SFT, HFT, SF>::GetLockIdImpl(
     const Object& object) {
@@ -157,7 +223,7 @@ size_t ShardedQuarantine<OT, SFT, HFT, SF>::GetLockIdImpl(
 template<typename OT, typename SFT, typename HFT, size_t SF>
 void ShardedQuarantine<OT, SFT, HFT, SF>::LockImpl(size_t id) {
   DCHECK_LT(id, kShardingFactor);
-  locks_[id].Acquire();
+  LockProfiler::Acquire(kQuarantineShardLockSite, &locks_[id]);
 }
 
 template<typename OT, typename SFT, typename HFT, size_t SF>
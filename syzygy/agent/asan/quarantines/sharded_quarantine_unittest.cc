@@ -16,6 +16,7 @@
 
 #include <set>
 
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 
 namespace agent {
@@ -65,12 +66,11 @@ class TestShardedQuarantine
                             8> Super;
 
   size_t ShardCount(size_t shard) {
-    Super::Node* node = heads_[shard];
     size_t count = 0;
-    while (node) {
+    for (Super::Node* node = heads_[shard]; node; node = node->next)
+      ++count;
+    for (Super::Node* node = inboxes_[shard]; node; node = node->next)
       ++count;
-      node = node->next;
-    }
     return count;
   }
 
@@ -192,6 +192,113 @@ TEST(ShardedQuarantineTest, StressTest) {
   EXPECT_EQ(old_size, emptied_size);
 }
 
+namespace {
+
+// Pushes objects into a quarantine from its own thread.
+class PushingThread : public base::SimpleThread {
+ public:
+  PushingThread(TestShardedQuarantine* quarantine, size_t first_hash)
+      : base::SimpleThread("PushingThread"),
+        quarantine_(quarantine),
+        first_hash_(first_hash),
+        pushed_size_(0) {}
+
+  void Run() override {
+    for (size_t i = 0; i < kPushCount; ++i) {
+      DummyObject d(1 + i % 7);
+      d.hash = first_hash_ + i;
+      // Concurrent pushes don't require the quarantine lock.
+      EXPECT_TRUE(quarantine_->Push(d).push_successful);
+      pushed_size_ += d.size;
+    }
+  }
+
+  size_t pushed_size() const { return pushed_size_; }
+
+  static const size_t kPushCount = 20000;
+
+ private:
+  TestShardedQuarantine* quarantine_;
+  size_t first_hash_;
+  size_t pushed_size_;
+};
+
+}  // namespace
+
+TEST(ShardedQuarantineTest, ConcurrentPushAndPop) {
+  TestShardedQuarantine q;
+  q.set_max_object_size(TestShardedQuarantine::kUnboundedSize);
+  q.set_max_quarantine_size(1000);
+
+  PushingThread thread1(&q, 0);
+  PushingThread thread2(&q, PushingThread::kPushCount);
+  thread1.Start();
+  thread2.Start();
+
+  // Trim concurrently with the pushes, accounting for everything popped.
+  size_t popped_size = 0;
+  size_t popped_count = 0;
+  DummyObject popped;
+  for (size_t i = 0; i < PushingThread::kPushCount; ++i) {
+    while (q.Pop(&popped).pop_successful) {
+      popped_size += popped.size;
+      ++popped_count;
+    }
+  }
+
+  thread1.Join();
+  thread2.Join();
+
+  // The size accounting must be exact once all pushes are done.
+  size_t pushed_size = thread1.pushed_size() + thread2.pushed_size();
+  EXPECT_EQ(pushed_size - popped_size, q.GetSizeForTesting());
+  EXPECT_EQ(2 * PushingThread::kPushCount - popped_count,
+            q.GetCountForTesting());
+
+  TestShardedQuarantine::ObjectVector os;
+  q.Empty(&os);
+  EXPECT_EQ(2 * PushingThread::kPushCount, popped_count + os.size());
+  size_t emptied_size = 0;
+  for (const auto& o : os)
+    emptied_size += o.size;
+  EXPECT_EQ(pushed_size, popped_size + emptied_size);
+  EXPECT_EQ(0u, q.GetSizeForTesting());
+  EXPECT_EQ(0u, q.GetCountForTesting());
+}
+
+TEST(ShardedQuarantineTest, PopFromShards) {
+  const size_t kConsumerCount = 3;
+  TestShardedQuarantine q;
+  q.set_max_object_size(TestShardedQuarantine::kUnboundedSize);
+  q.set_max_quarantine_size(0);
+
+  DummyObject d(1);
+  for (size_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(q.Push(d).push_successful);
+    d.hash++;
+  }
+
+  for (size_t consumer = 0; consumer < kConsumerCount; ++consumer) {
+    // Each consumer only sees the objects of the shards that it owns.
+    size_t expected_count = 0;
+    for (size_t i = consumer; i < q.kShardingFactor; i += kConsumerCount)
+      expected_count += q.ShardCount(i);
+
+    size_t popped_count = 0;
+    DummyObject popped;
+    while (q.PopFromShards(consumer, kConsumerCount, &popped).pop_successful) {
+      // The lock ID of an object is its shard.
+      EXPECT_EQ(consumer, q.GetLockId(popped) % kConsumerCount);
+      ++popped_count;
+    }
+    EXPECT_EQ(expected_count, popped_count);
+    for (size_t i = consumer; i < q.kShardingFactor; i += kConsumerCount)
+      EXPECT_EQ(0u, q.ShardCount(i));
+  }
+
+  EXPECT_EQ(0u, q.GetCountForTesting());
+}
+
 TEST(ShardedQuarantineTest, LockUnlock) {
   TestShardedQuarantine q;
   DummyObject dummy;
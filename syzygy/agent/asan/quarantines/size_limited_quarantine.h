@@ -18,9 +18,11 @@
 #ifndef SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_LIMITED_QUARANTINE_H_
 #define SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_LIMITED_QUARANTINE_H_
 
+#include <algorithm>
 #include <utility>
 
 #include "base/atomicops.h"
+#include "base/logging.h"
 #include "base/synchronization/lock.h"
 #include "syzygy/agent/asan/quarantine.h"
 
@@ -199,6 +201,18 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
     return size_count_.size();
   }
 
+  // Gets a consistent snapshot of the size and of the number of objects of the
+  // quarantine. This can be stale as soon as it returns.
+  // @param size Will receive the size of the quarantine.
+  // @param count Will receive the number of objects in the quarantine.
+  void GetSizeAndCount(size_t* size, size_t* count) {
+    DCHECK_NE(static_cast<size_t*>(nullptr), size);
+    DCHECK_NE(static_cast<size_t*>(nullptr), count);
+    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
+    *size = std::max<SSIZE_T>(0, size_count_.size());
+    *count = std::max<SSIZE_T>(0, size_count_.count());
+  }
+
   // @returns the current overbudget size.
   size_t GetOverbudgetSizeForTesting() const { return overbudget_size_; }
 
@@ -218,10 +232,18 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
   // @returns the color of the quarantine.
   TrimColor GetQuarantineColor(size_t size) const;
 
+  // Returns the maximum size of a certain color. See note in implementation
+  // about the raciness of the function.
+  // @param color The color for which the size is queried.
+  // @returns the size.
+  size_t GetMaxSizeForColor(TrimColor color) const;
+
   // Returns the maximum size of a certain color. Used only in testing.
   // @param color The color for which the size is queried.
   // @returns the size.
-  size_t GetMaxSizeForColorForTesting(TrimColor color) const;
+  size_t GetMaxSizeForColorForTesting(TrimColor color) const {
+    return GetMaxSizeForColor(color);
+  }
 
   // @name QuarantineInterface implementation.
   // @note that GetCountForTest could be racing with a push/pop operation and
@@ -247,6 +269,19 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
   virtual void UnlockImpl(size_t id) = 0;
   // @}
 
+  // Implementation details of Pop, for use by derived classes that provide
+  // other ways of popping objects.
+  // @{
+  // @returns true if the quarantine is over its GREEN limit and objects
+  //     should be popped from it.
+  bool CanPop();
+  // Removes the contribution of a popped object from the size of the
+  // quarantine.
+  // @param object The object that was popped.
+  // @returns a successful pop result with the new color of the quarantine.
+  PopResult AccountForPop(const Object& object);
+  // @}
+
   // Parameters controlling the quarantine invariant.
   size_t max_object_size_;
   size_t max_quarantine_size_;
@@ -89,36 +89,43 @@ PopResult SizeLimitedQuarantineImpl<OT, SFT>::Pop(Object* object) {
   DCHECK_NE(static_cast<Object*>(NULL), object);
   PopResult result = {false, TrimColor::GREEN};
 
-  if (max_quarantine_size_ == kUnboundedSize)
+  if (!CanPop())
     return result;
 
-  {
-    // Never pop if already in GREEN as this is the lowest bound.
-    // Note that because GetQuarantineColor can return the wrong color (see note
-    // in its implementation), this verification might not always be correct
-    // which might cause either an over popping or an under popping. Either way,
-    // that is acceptable as the extra or missing pop operations are not harmful
-    // and the size will eventually get consistency.
-    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
-    if (GetQuarantineColor(size_count_.size()) == TrimColor::GREEN)
-      return result;
-  }
-
   if (!PopImpl(object))
     return result;
 
+  return AccountForPop(*object);
+}
+
+template<typename OT, typename SFT>
+bool SizeLimitedQuarantineImpl<OT, SFT>::CanPop() {
+  if (max_quarantine_size_ == kUnboundedSize)
+    return false;
+
+  // Never pop if already in GREEN as this is the lowest bound.
+  // Note that because GetQuarantineColor can return the wrong color (see note
+  // in its implementation), this verification might not always be correct
+  // which might cause either an over popping or an under popping. Either way,
+  // that is acceptable as the extra or missing pop operations are not harmful
+  // and the size will eventually get consistency.
+  ScopedQuarantineSizeCountLock size_count_lock(size_count_);
+  return GetQuarantineColor(size_count_.size()) != TrimColor::GREEN;
+}
+
+template<typename OT, typename SFT>
+PopResult SizeLimitedQuarantineImpl<OT, SFT>::AccountForPop(
+    const Object& object) {
   // Note that if a thread gets preempted here, the size/count will be wrong,
   // until the thread resumes.
-  size_t size = size_functor_(*object);
+  size_t size = size_functor_(object);
   ScopedQuarantineSizeCountLock size_count_lock(size_count_);
 
   size_t new_size = size_count_.Decrement(size, 1);
 
-  // Return success and the new quarantine color.
-  result.pop_successful = true;
-  // See note above about GetQuarantineColor potentially returning the wrong
-  // color.
-  result.trim_color = GetQuarantineColor(new_size);
+  // Return success and the new quarantine color. See note in CanPop about
+  // GetQuarantineColor potentially returning the wrong color.
+  PopResult result = {true, GetQuarantineColor(new_size)};
   return result;
 }
 
@@ -210,12 +217,12 @@ TrimColor SizeLimitedQuarantineImpl<OT, SFT>::GetQuarantineColor(
 }
 
 template <typename OT, typename SFT>
-size_t SizeLimitedQuarantineImpl<OT, SFT>::GetMaxSizeForColorForTesting(
+size_t SizeLimitedQuarantineImpl<OT, SFT>::GetMaxSizeForColor(
     TrimColor color) const {
   // Note that this is racy by design, to avoid contention. If
   // |overbudget_size_| is modified before the end of the function, the wrong
-  // size can be returned. Since this function is only used in testing, this is
-  // not an issue.
+  // size can be returned. This only happens when the quarantine is being
+  // reconfigured, so the callers simply get a stale value.
   if (color == TrimColor::BLACK || max_quarantine_size_ == kUnboundedSize)
     return kUnboundedSize;
 
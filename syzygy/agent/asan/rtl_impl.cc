@@ -14,6 +14,7 @@
 
 #include "syzygy/agent/asan/rtl_impl.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "base/bind.h"
@@ -22,6 +23,7 @@
 #include "base/debug/alias.h"
 #include "syzygy/agent/asan/block.h"
 #include "syzygy/agent/asan/heap_manager.h"
+#include "syzygy/agent/asan/lock_profiler.h"
 #include "syzygy/agent/asan/rtl_utils.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
@@ -35,6 +37,8 @@ namespace {
 using agent::asan::AsanErrorInfo;
 using agent::asan::AsanRuntime;
 using agent::asan::HeapManagerInterface;
+using agent::asan::LockProfiler;
+using agent::asan::LockSite;
 using agent::asan::Shadow;
 using agent::asan::WindowsHeapAdapter;
 using agent::asan::heap_managers::BlockHeapManager;
@@ -71,6 +75,44 @@ void TearDownRtl() {
 }  // namespace asan
 }  // namespace agent
 
+#ifndef _WIN64
+namespace {
+
+// Checks the range covered by the accesses of a counted loop, hoisted in front
+// of it by the instrumentation.
+// @param first The address of the first access.
+// @param last The address of the last access. A loop running once can see its
+//     last access land in front of its first one, only the first access is
+//     then checked.
+// @param size The size of each access.
+// @param access_mode The mode of the accesses.
+void CheckAccessRange(const uint8_t* first,
+                      const uint8_t* last,
+                      size_t size,
+                      agent::asan::AccessMode access_mode) {
+  if (last < first)
+    last = first;
+  const void* location = asan_runtime->shadow()->FindFirstPoisonedByte(
+      first, last - first + size);
+  if (location != nullptr)
+    agent::asan::ReportBadAccess(location, access_mode);
+}
+
+void __cdecl CheckReadAccessRange(const uint8_t* first,
+                                  const uint8_t* last,
+                                  size_t size) {
+  CheckAccessRange(first, last, size, agent::asan::ASAN_READ_ACCESS);
+}
+
+void __cdecl CheckWriteAccessRange(const uint8_t* first,
+                                   const uint8_t* last,
+                                   size_t size) {
+  CheckAccessRange(first, last, size, agent::asan::ASAN_WRITE_ACCESS);
+}
+
+}  // namespace
+#endif  // !defined _WIN64
+
 extern "C" {
 
 HANDLE WINAPI asan_GetProcessHeap() {
@@ -252,6 +294,41 @@ void __declspec(naked) asan_ClearAllocationFilterFlag() {
     ret
   }
 }
+
+// The range checks take the address of the first and the last access of the
+// loop and the size of the accesses on the stack, and preserve all the
+// registers and the flags.
+void __declspec(naked) asan_check_range_read_access() {
+  __asm {
+    pushad
+    pushfd
+    // Forward the parameters. Once the registers and the flags are saved the
+    // last one is at ESP + 48, and each push brings the previous one there.
+    push dword ptr[esp + 48]
+    push dword ptr[esp + 48]
+    push dword ptr[esp + 48]
+    call CheckReadAccessRange
+    add esp, 12
+    popfd
+    popad
+    ret 12
+  }
+}
+
+void __declspec(naked) asan_check_range_write_access() {
+  __asm {
+    pushad
+    pushfd
+    push dword ptr[esp + 48]
+    push dword ptr[esp + 48]
+    push dword ptr[esp + 48]
+    call CheckWriteAccessRange
+    add esp, 12
+    popfd
+    popad
+    ret 12
+  }
+}
 #endif  // !defined _WIN64
 
 int asan_CrashForException(EXCEPTION_POINTERS* exception) {
@@ -259,6 +336,15 @@ int asan_CrashForException(EXCEPTION_POINTERS* exception) {
   return agent::asan::AsanRuntime::CrashForException(exception);
 }
 
+size_t WINAPI asan_GetLockProfile(
+    agent::asan::LockSiteStatistics* statistics, size_t count) {
+  DCHECK(statistics != nullptr || count == 0);
+  size_t site_count = agent::asan::kLockSiteCount;
+  for (size_t i = 0; i < std::min(count, site_count); ++i)
+    LockProfiler::GetStatistics(static_cast<LockSite>(i), &statistics[i]);
+  return site_count;
+}
+
 void WINAPI asan_InitializeCrashReporter() {
   asan_runtime->InitializeCrashReporter();
 }
@@ -23,6 +23,7 @@ namespace asan {
 
 class AsanRuntime;
 struct AsanErrorInfo;
+struct LockSiteStatistics;
 
 // Initialize the Asan runtime library global variables.
 // @param runtime The Asan runtime manager.
@@ -113,6 +114,16 @@ void WINAPI asan_EnumExperiments(AsanExperimentCallback callback);
 
 int asan_CrashForException(EXCEPTION_POINTERS* exception);
 
+// Retrieves the lock contention profile of the runtime. This is only
+// populated if the lock profiling is enabled.
+// @param statistics The array receiving the statistics of the lock sites,
+//     indexed by agent::asan::LockSite.
+// @param count The number of entries of @p statistics.
+// @returns the number of lock sites of the runtime. Only the first
+//     min(@p count, returned value) entries of @p statistics are written.
+size_t WINAPI asan_GetLockProfile(
+    agent::asan::LockSiteStatistics* statistics, size_t count);
+
 // This functions allows manually initializing the crash reporter used by the
 // runtime.
 //
@@ -18,6 +18,7 @@
 
 #include "base/rand_util.h"
 #include "gtest/gtest.h"
+#include "syzygy/agent/asan/lock_profiler.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/unittest_util.h"
@@ -122,6 +123,25 @@ TEST_F(AsanRtlImplTest, LockUnlock) {
   ASSERT_TRUE(asan_HeapUnlock(heap_));
 }
 
+TEST_F(AsanRtlImplTest, GetLockProfile) {
+  LockProfiler::ResetStatistics();
+  LockProfiler::SetEnabled(true);
+  ASSERT_TRUE(asan_HeapLock(heap_));
+  ASSERT_TRUE(asan_HeapUnlock(heap_));
+  LockProfiler::SetEnabled(false);
+
+  // The entries past the lock sites of the runtime are left untouched.
+  const size_t kSiteCount = kLockSiteCount;
+  LockSiteStatistics statistics[kSiteCount + 1] = {};
+  EXPECT_EQ(kSiteCount,
+            asan_GetLockProfile(statistics, arraysize(statistics)));
+  EXPECT_EQ(1u, statistics[kHeapLockSite].acquisitions);
+  EXPECT_EQ(0u, statistics[kSiteCount].acquisitions);
+  EXPECT_EQ(kSiteCount, asan_GetLockProfile(nullptr, 0));
+
+  LockProfiler::ResetStatistics();
+}
+
 TEST_F(AsanRtlImplTest, Walk) {
   // Walk isn't supported by the current heap implementation.
   PROCESS_HEAP_ENTRY entry = {};
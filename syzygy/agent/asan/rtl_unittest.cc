@@ -703,6 +703,49 @@ TEST_F(AsanRtlTest, AllocationFilterFlag) {
   SetAllocationFilterFlagFunction();
   EXPECT_TRUE(runtime->allocation_filter_flag());
 }
+
+namespace {
+
+// Calls the range check @p check_range_fn on the accesses of @p size bytes
+// from @p first to @p last.
+void CheckAccessRange(FARPROC check_range_fn,
+                      const void* first,
+                      const void* last,
+                      size_t size) {
+  __asm {
+    push size
+    push last
+    push first
+    call check_range_fn
+  }
+}
+
+}  // namespace
+
+TEST_F(AsanRtlTest, AsanCheckRangeAccess) {
+  const char* function_names[] = {"asan_check_range_read_access",
+                                  "asan_check_range_write_access"};
+  for (const char* function_name : function_names) {
+    FARPROC check_range_fn = ::GetProcAddress(asan_rtl_, function_name);
+    ASSERT_NE(static_cast<FARPROC>(nullptr), check_range_fn);
+
+    ScopedAsanAlloc<uint8_t> mem(this, kAllocSize);
+    ASSERT_NE(static_cast<uint8_t*>(nullptr), mem.get());
+    uint8_t* mem_ptr = mem.get();
+
+    SyzyAsanMemoryAccessorTester tester;
+    tester.set_expected_error_type(HEAP_BUFFER_OVERFLOW);
+
+    // A loop over the whole allocation, and a loop running once.
+    CheckAccessRange(check_range_fn, mem_ptr, mem_ptr + kAllocSize - 4, 4);
+    CheckAccessRange(check_range_fn, mem_ptr + 4, mem_ptr, 4);
+    EXPECT_FALSE(tester.memory_error_detected());
+
+    // The last access overflows the allocation.
+    CheckAccessRange(check_range_fn, mem_ptr, mem_ptr + kAllocSize - 3, 4);
+    EXPECT_TRUE(tester.memory_error_detected());
+  }
+}
 #endif
 
 namespace {
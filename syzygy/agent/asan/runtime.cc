@@ -46,7 +46,6 @@
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
 #include "syzygy/agent/asan/reporters/breakpad_reporter.h"
 #include "syzygy/agent/asan/reporters/crashpad_reporter.h"
-#include "syzygy/crashdata/crashdata.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
@@ -183,20 +182,6 @@ void InitializeExceptionRecord(const AsanErrorInfo* error_info,
   pointers->ContextRecord = const_cast<CONTEXT*>(&error_info->context);
 }
 
-// Creates a serialized protobuf representing crash data. Also populates
-// |memory_ranges| with memory contents related to the crash.
-bool PopulateProtobufAndMemoryRanges(const AsanErrorInfo& error_info,
-                                     std::string* protobuf,
-                                     MemoryRanges* memory_ranges) {
-  DCHECK_NE(static_cast<std::string*>(nullptr), protobuf);
-  crashdata::Value value;
-  PopulateErrorInfo(AsanRuntime::runtime()->shadow(), error_info, &value,
-                    memory_ranges);
-  if (!value.SerializeToString(protobuf))
-    return false;
-  return true;
-}
-
 // Send a crash report for the given exception.
 void DumpAndCrashViaReporter(AsanErrorInfo* error_info,
                              EXCEPTION_POINTERS* exception_pointers) {
@@ -221,20 +206,18 @@ void DumpAndCrashViaReporter(AsanErrorInfo* error_info,
     }
   }
 
-  // These are in an outer scope so that they persist until the call to
-  // DumpAndCrash.
-  std::string protobuf;
-  MemoryRanges memory_ranges;
-
-  // Populate the protobuf and the memory regions if possible.
+  // Populate the protobuf and the memory regions if possible. The report
+  // was usually started by OnErrorImpl, and is owned by the builder so that
+  // it persists until the call to DumpAndCrash.
   static const uint32_t kExtraFeatures =
       ReporterInterface::FEATURE_MEMORY_RANGES |
       ReporterInterface::FEATURE_CUSTOM_STREAMS;
   if ((reporter->GetFeatures() & kExtraFeatures) != 0) {
-    MemoryRanges* memory_ranges_ptr = nullptr;
-    if (reporter->GetFeatures() & ReporterInterface::FEATURE_MEMORY_RANGES)
-      memory_ranges_ptr = &memory_ranges;
-    PopulateProtobufAndMemoryRanges(*error_info, &protobuf, &memory_ranges);
+    CrashReportBuilder* builder = runtime->crash_report_builder();
+    DCHECK_NE(static_cast<CrashReportBuilder*>(nullptr), builder);
+    builder->FinishReport(error_info, base::TimeDelta::FromMilliseconds(
+        AsanRuntime::kCrashReportDeadlineMs));
+    const std::string& protobuf = builder->protobuf();
 
     if (reporter->GetFeatures() & ReporterInterface::FEATURE_CUSTOM_STREAMS) {
       reporter->SetCustomStream(
@@ -243,10 +226,10 @@ void DumpAndCrashViaReporter(AsanErrorInfo* error_info,
           protobuf.size());
     }
 
-    // Due to the logic above |memory_ranges| will only be non-empty if
-    // the memory range feature is supported.
-    if (memory_ranges.size())
-      reporter->SetMemoryRanges(memory_ranges);
+    if ((reporter->GetFeatures() & ReporterInterface::FEATURE_MEMORY_RANGES) &&
+        !builder->memory_ranges().empty()) {
+      reporter->SetMemoryRanges(builder->memory_ranges());
+    }
   }
 
   // This function should not return.
@@ -374,9 +357,12 @@ size_t MaxSafeAllocaSize() {
     runtime_->logger_->Write(                                               \
         "SyzyASAN: Heap checker enabled, processing exception.");           \
     AutoHeapManagerLock lock((runtime)->heap_manager_.get());               \
-    HeapChecker heap_checker((runtime)->shadow());                          \
+    HeapChecker local_heap_checker((runtime)->shadow());                    \
+    HeapChecker* heap_checker = (runtime)->heap_checker_.get();             \
+    if (heap_checker == nullptr)                                            \
+      heap_checker = &local_heap_checker;                                   \
     HeapChecker::CorruptRangesVector corrupt_ranges;                        \
-    heap_checker.IsHeapCorrupt(&corrupt_ranges);                            \
+    heap_checker->IsHeapCorrupt(&corrupt_ranges);                           \
     size_t size = (runtime)->CalculateCorruptHeapInfoSize(corrupt_ranges);  \
     void* buffer = NULL;                                                    \
     if (size > 0) {                                                         \
@@ -474,14 +460,15 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
   DCHECK(!runtime_);
   runtime_ = this;
 
-  // Setup the shadow memory first. If this fails the dynamic runtime can
-  // safely disable the instrumentation.
-  if (!SetUpShadow())
+  // Parse any flags set via the environment variable. This logs failure for
+  // us. This is done first as the flags determine how the shadow memory is
+  // allocated.
+  if (!::common::ParseAsanParameters(flags_command_line, &params_))
     return false;
 
-  // Parse and propagate any flags set via the environment variable. This logs
-  // failure for us.
-  if (!::common::ParseAsanParameters(flags_command_line, &params_))
+  // Setup the shadow memory next. If this fails the dynamic runtime can
+  // safely disable the instrumentation.
+  if (!SetUpShadow())
     return false;
 
   // Initialize the command-line structures. This is needed so that
@@ -528,6 +515,14 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
   // parameters as some decisions can only be made once.
   heap_manager_->Init();
 
+  // Start the heap checking threads. This is done ahead of time as threads
+  // can't be safely created while processing an error.
+  SetUpHeapChecker();
+  SetUpCrashReportBuilder();
+  SetUpLockProfiler();
+  SetUpStatisticsPublisher();
+  SetUpMemoryPressureMonitor();
+
   // Set some early crash keys.
   SetEarlyCrashKeysIfPossible(this);
 
@@ -537,6 +532,16 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
 void AsanRuntime::TearDown() {
   base::AutoLock auto_lock(lock_);
 
+  // The heap checking threads must be stopped before the heap manager goes
+  // away, and the lock profiling one before the logger does. The statistics
+  // publishing thread uses both the heap manager and the stack cache, and the
+  // memory pressure monitor updates the heap manager.
+  TearDownHeapChecker();
+  TearDownCrashReportBuilder();
+  TearDownLockProfiler();
+  TearDownStatisticsPublisher();
+  TearDownMemoryPressureMonitor();
+
   // The WindowsHeapAdapter will only have been initialized if the heap manager
   // was successfully created and initialized.
   if (heap_manager_.get() != nullptr)
@@ -563,16 +568,22 @@ void AsanRuntime::OnErrorImpl(AsanErrorInfo* error_info) {
   error_info->asan_parameters = params_;
   error_info->feature_set = GetEnabledFeatureSet();
 
+  // The crash report is built on the helper thread while the error is
+  // logged, which formats the shadow memory and the stacks.
+  DCHECK_NE(static_cast<CrashReportBuilder*>(nullptr),
+            crash_report_builder_.get());
+  crash_report_builder_->StartReport(error_info);
+
   LogAsanErrorInfo(error_info);
 
   if (params_.minidump_on_failure) {
     DCHECK(logger_.get() != NULL);
-    std::string protobuf;
-    MemoryRanges memory_ranges;
-    PopulateProtobufAndMemoryRanges(*error_info, &protobuf, &memory_ranges);
+    crash_report_builder_->FinishReport(
+        error_info, base::TimeDelta::FromMilliseconds(kCrashReportDeadlineMs));
 
     logger_->SaveMinidumpWithProtobufAndMemoryRanges(
-        &error_info->context, error_info, protobuf, memory_ranges);
+        &error_info->context, error_info, crash_report_builder_->protobuf(),
+        crash_report_builder_->memory_ranges());
   }
 
   if (params_.exit_on_failure) {
@@ -605,8 +616,15 @@ void AsanRuntime::SetErrorCallBack(const AsanOnErrorCallBack& callback) {
 }
 
 bool AsanRuntime::SetUpShadow() {
-  // Dynamically allocate the shadow memory.
-  shadow_.reset(new Shadow());
+  // Dynamically allocate the shadow memory. When lazy commit is enabled the
+  // shadow is only reserved, and its pages are committed as they are first
+  // touched. Large pages are only used for a shadow committed up front.
+  Shadow::CommitMode commit_mode = Shadow::kCommitUpFront;
+  if (params_.enable_lazy_shadow_commit)
+    commit_mode = Shadow::kCommitOnDemand;
+  else if (params_.enable_large_page_shadow)
+    commit_mode = Shadow::kCommitLargePages;
+  shadow_.reset(new Shadow(Shadow::RequiredLength(), commit_mode));
 
   // If the allocation fails, then return false.
   if (shadow_->shadow() == nullptr)
@@ -687,6 +705,10 @@ bool AsanRuntime::SetUpLogger() {
       base::UTF8ToWide(trace::client::GetInstanceIdForThisModule()));
   client->Init();
 
+  // The statistics and the reports are written in many small messages, which
+  // are sent in batches rather than one RPC each.
+  client->set_batch_writes(true);
+
   // Register the client singleton instance.
   logger_.reset(client.release());
   memory_notifier_->NotifyInternalUse(logger_.get(), sizeof(*logger_.get()));
@@ -700,6 +722,7 @@ void AsanRuntime::TearDownLogger() {
 
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr),
             memory_notifier_.get());
+  logger_->Flush();
   memory_notifier_->NotifyReturnedToOS(logger_.get(), sizeof(*logger_.get()));
   logger_.reset();
 }
@@ -714,10 +737,27 @@ bool AsanRuntime::SetUpStackCache() {
   memory_notifier_->NotifyInternalUse(stack_cache_.get(),
                                       sizeof(*stack_cache_.get()));
 
+  // The stacks are otherwise captured by CaptureStackBackTrace on x64.
+  stack_unwinder_.reset(new common::StackUnwinder());
+  if (!stack_unwinder_->Init()) {
+    stack_unwinder_.reset();
+    return true;
+  }
+  memory_notifier_->NotifyInternalUse(stack_unwinder_.get(),
+                                      sizeof(*stack_unwinder_.get()));
+  common::SetStackUnwinder(stack_unwinder_.get());
+
   return true;
 }
 
 void AsanRuntime::TearDownStackCache() {
+  if (stack_unwinder_.get() != nullptr) {
+    common::SetStackUnwinder(nullptr);
+    memory_notifier_->NotifyReturnedToOS(stack_unwinder_.get(),
+                                         sizeof(*stack_unwinder_.get()));
+    stack_unwinder_.reset();
+  }
+
   if (stack_cache_.get() == nullptr)
     return;
 
@@ -760,6 +800,17 @@ void AsanRuntime::TearDownHeapManager() {
   DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger_.get());
   DCHECK_NE(static_cast<StackCaptureCache*>(nullptr), stack_cache_.get());
 
+  // Report the magazine cache statistics, if it was in use.
+  heap_managers::MagazineCache::Statistics magazine_stats = {};
+  if (heap_manager_->GetMagazineCacheStatistics(&magazine_stats)) {
+    logger_->Write(base::StringPrintf(
+        "PID=%d; Magazine cache hits=%llu; Misses=%llu; Cached frees=%llu; "
+        "Refills=%llu; Drains=%llu; Magazines=%llu",
+        ::GetCurrentProcessId(), magazine_stats.hits, magazine_stats.misses,
+        magazine_stats.cached_frees, magazine_stats.refills,
+        magazine_stats.drains, magazine_stats.magazines));
+  }
+
   // Tear down the heap manager before we destroy it and lose our pointer
   // to it. This is necessary because the heap manager can raise errors
   // while tearing down the heap, which will in turn call back into the
@@ -770,6 +821,211 @@ void AsanRuntime::TearDownHeapManager() {
   heap_manager_.reset();
 }
 
+void AsanRuntime::SetUpHeapChecker() {
+  DCHECK_NE(static_cast<heap_managers::BlockHeapManager*>(nullptr),
+            heap_manager_.get());
+  DCHECK_EQ(static_cast<HeapChecker*>(nullptr), heap_checker_.get());
+
+  heap_checker_.reset(new HeapChecker(shadow()));
+
+  // A single thread means that the heap is checked by the thread processing
+  // the error, without any help.
+  if (params_.check_heap_on_failure && params_.heap_checker_thread_count > 1 &&
+      !heap_checker_->StartWorkerThreads(params_.heap_checker_thread_count)) {
+    LOG(ERROR) << "Failed to start the heap checker worker threads.";
+  }
+
+  if (params_.incremental_heap_check_period == 0)
+    return;
+  heap_checker_thread_.reset(new HeapCheckerThread(
+      shadow(), heap_manager_.get(),
+      base::TimeDelta::FromMilliseconds(params_.incremental_heap_check_period),
+      base::Bind(&AsanRuntime::OnHeapCorruptionFound,
+                 base::Unretained(this))));
+  if (!heap_checker_thread_->Start()) {
+    LOG(ERROR) << "Failed to start the heap checker thread.";
+    heap_checker_thread_.reset();
+  }
+}
+
+void AsanRuntime::TearDownHeapChecker() {
+  if (heap_checker_thread_.get() != nullptr) {
+    heap_checker_thread_->Stop();
+    heap_checker_thread_.reset();
+  }
+  if (heap_checker_.get() != nullptr) {
+    heap_checker_->StopWorkerThreads();
+    heap_checker_.reset();
+  }
+}
+
+void AsanRuntime::SetUpCrashReportBuilder() {
+  DCHECK_EQ(static_cast<CrashReportBuilder*>(nullptr),
+            crash_report_builder_.get());
+
+  crash_report_builder_.reset(new CrashReportBuilder(shadow()));
+
+  // The report is only built for a minidump, either saved by the logger or
+  // made by the crash reporter.
+  if (!params_.minidump_on_failure && crash_reporter_.get() == nullptr &&
+      !params_.defer_crash_reporter_initialization) {
+    return;
+  }
+  if (!crash_report_builder_->StartThread())
+    LOG(ERROR) << "Failed to start the crash report thread.";
+}
+
+void AsanRuntime::TearDownCrashReportBuilder() {
+  if (crash_report_builder_.get() != nullptr) {
+    crash_report_builder_->StopThread();
+    crash_report_builder_.reset();
+  }
+}
+
+void AsanRuntime::SetUpLockProfiler() {
+  DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger_.get());
+  DCHECK_EQ(static_cast<LockProfilerThread*>(nullptr),
+            lock_profiler_thread_.get());
+
+  if (!params_.enable_lock_profiling || params_.lock_profiling_log_period == 0)
+    return;
+  lock_profiler_thread_.reset(new LockProfilerThread(
+      logger_.get(),
+      base::TimeDelta::FromMilliseconds(params_.lock_profiling_log_period)));
+  if (!lock_profiler_thread_->Start()) {
+    LOG(ERROR) << "Failed to start the lock profiler thread.";
+    lock_profiler_thread_.reset();
+  }
+}
+
+void AsanRuntime::SetUpStatisticsPublisher() {
+  DCHECK_EQ(static_cast<StatisticsPublisher*>(nullptr),
+            statistics_publisher_.get());
+
+  if (params_.statistics_section_period == 0)
+    return;
+  statistics_publisher_.reset(new StatisticsPublisher(
+      base::TimeDelta::FromMilliseconds(params_.statistics_section_period),
+      base::Bind(&AsanRuntime::GatherStatistics, base::Unretained(this))));
+  if (!statistics_publisher_->Init(StatisticsPublisher::GetSectionName(
+          ::GetCurrentProcessId()))) {
+    statistics_publisher_.reset();
+    return;
+  }
+  if (!statistics_publisher_->Start()) {
+    LOG(ERROR) << "Failed to start the statistics publisher thread.";
+    statistics_publisher_.reset();
+  }
+}
+
+void AsanRuntime::TearDownStatisticsPublisher() {
+  if (statistics_publisher_.get() != nullptr) {
+    statistics_publisher_->Stop();
+    statistics_publisher_.reset();
+  }
+}
+
+void AsanRuntime::SetUpMemoryPressureMonitor() {
+  DCHECK_EQ(static_cast<MemoryPressureMonitor*>(nullptr),
+            memory_pressure_monitor_.get());
+
+  if (!params_.enable_memory_pressure_monitor)
+    return;
+  memory_pressure_monitor_.reset(new MemoryPressureMonitor(
+      base::Bind(&AsanRuntime::OnMemoryAvailabilityChange,
+                 base::Unretained(this))));
+  if (!memory_pressure_monitor_->Init()) {
+    memory_pressure_monitor_.reset();
+    return;
+  }
+  if (!memory_pressure_monitor_->Start()) {
+    LOG(ERROR) << "Failed to start the memory pressure monitor thread.";
+    memory_pressure_monitor_.reset();
+  }
+}
+
+void AsanRuntime::TearDownMemoryPressureMonitor() {
+  if (memory_pressure_monitor_.get() != nullptr) {
+    memory_pressure_monitor_->Stop();
+    memory_pressure_monitor_.reset();
+  }
+}
+
+void AsanRuntime::OnMemoryAvailabilityChange(
+    MemoryPressureMonitor::MemoryAvailability availability) {
+  DCHECK_NE(static_cast<heap_managers::BlockHeapManager*>(nullptr),
+            heap_manager_.get());
+
+  // The budgets are always derived from the configured parameters, which
+  // are left untouched so that the crash reports show them. The heap manager
+  // applies the new budgets without blocking the allocating threads, and
+  // trims its quarantines if they shrank.
+  ::common::AsanParameters parameters = params_;
+  MemoryPressureMonitor::AdjustParameters(availability, &parameters);
+  heap_manager_->set_parameters(parameters);
+}
+
+void AsanRuntime::GatherStatistics(AsanRuntimeStatistics* statistics) {
+  DCHECK_NE(static_cast<AsanRuntimeStatistics*>(nullptr), statistics);
+  static_assert(kHeapTypeMax <= kStatisticsSectionHeapTypeCount,
+                "The statistics section can't describe all the heap types.");
+
+  if (heap_manager_.get() != nullptr) {
+    heap_managers::BlockHeapManager::Statistics heap_statistics = {};
+    heap_manager_->GetStatistics(&heap_statistics);
+    for (size_t i = 0; i < kHeapTypeMax; ++i) {
+      statistics->live_blocks[i] = heap_statistics.live_blocks[i];
+      statistics->live_bytes[i] = heap_statistics.live_bytes[i];
+    }
+    statistics->quarantine_size = heap_statistics.quarantine_size;
+    statistics->quarantine_count = heap_statistics.quarantine_count;
+    statistics->quarantine_color = heap_statistics.quarantine_color;
+    statistics->deferred_free_thread_count = static_cast<uint32_t>(
+        heap_statistics.deferred_free_thread_count);
+    statistics->deferred_free_backlog = heap_statistics.deferred_free_backlog;
+  }
+
+  if (stack_cache_.get() != nullptr) {
+    StackCaptureCache::Statistics stack_statistics = {};
+    stack_cache_->GetStatistics(&stack_statistics);
+    statistics->stack_cache_size = stack_statistics.size;
+    statistics->stack_cache_entries = stack_statistics.cached;
+  }
+}
+
+void AsanRuntime::TearDownLockProfiler() {
+  if (lock_profiler_thread_.get() != nullptr) {
+    lock_profiler_thread_->Stop();
+    lock_profiler_thread_.reset();
+  }
+}
+
+void AsanRuntime::OnHeapCorruptionFound(
+    const HeapChecker::CorruptRangesVector& corrupt_ranges) {
+  DCHECK(!corrupt_ranges.empty());
+
+  // Report the first corrupt block the way the heap manager reports the
+  // errors it detects. The block may have been freed since it was found, in
+  // which case the beginning of the range is reported.
+  BlockInfo block_info = {};
+  const void* location = corrupt_ranges.front().address;
+  if (shadow_->BlockInfoFromShadow(location, &block_info))
+    location = block_info.body;
+
+  AsanErrorInfo error_info = {};
+  ::RtlCaptureContext(&error_info.context);
+  error_info.access_mode = ASAN_UNKNOWN_ACCESS;
+  error_info.location = location;
+  error_info.error_type = CORRUPT_BLOCK;
+  ErrorInfoGetBadAccessInformation(shadow(), stack_cache_.get(), &error_info);
+  agent::common::StackCapture stack;
+  stack.InitFromStack();
+  error_info.crash_stack_id = stack.relative_stack_id();
+
+  // This checks the whole heap and fills in the corrupt ranges.
+  OnError(&error_info);
+}
+
 bool AsanRuntime::GetAsanFlagsEnvVar(std::wstring* env_var_wstr) {
   std::unique_ptr<base::Environment> env(base::Environment::Create());
   if (env.get() == NULL) {
@@ -792,21 +1048,24 @@ void AsanRuntime::PropagateParams() {
   // This function has to be kept in sync with the AsanParameters struct. These
   // checks will ensure that this is the case.
 #ifdef _WIN64
-  static_assert(sizeof(::common::AsanParameters) == 64,
+  static_assert(sizeof(::common::AsanParameters) == 104,
                 "Must propagate parameters.");
 #else
-  static_assert(sizeof(::common::AsanParameters) == 60,
+  static_assert(sizeof(::common::AsanParameters) == 100,
                 "Must propagate parameters.");
 #endif
-  static_assert(::common::kAsanParametersVersion == 15,
+  static_assert(::common::kAsanParametersVersion == 32,
                 "Must update parameters version.");
 
   // Push the configured parameter values to the appropriate endpoints.
+  LockProfiler::SetEnabled(params_.enable_lock_profiling != 0);
   heap_manager_->set_parameters(params_);
   StackCaptureCache::set_compression_reporting_period(params_.reporting_period);
   common::StackCapture::set_bottom_frames_to_skip(
       params_.bottom_frames_to_skip);
   stack_cache_->set_max_num_frames(params_.max_num_frames);
+  stack_cache_->set_compact_stack_captures(
+      params_.enable_compact_stack_captures != 0);
   // ignored_stack_ids is used locally by AsanRuntime.
   logger_->set_log_as_text(params_.log_as_text);
   // exit_on_failure is used locally by AsanRuntime.
@@ -928,7 +1187,12 @@ void AsanRuntime::LogAsanErrorInfo(AsanErrorInfo* error_info) {
                                    error_info->block_info.free_stack_size);
     }
     if (error_info->block_info.alloc_stack_size != NULL) {
-      logger_->WriteWithStackTrace("previously allocated here:\n",
+      const char* alloc_message = "previously allocated here:\n";
+      if (error_info->block_info.alloc_stack_is_fingerprint) {
+        alloc_message = "previously allocated here (sampled out, only the "
+                        "innermost callers were captured):\n";
+      }
+      logger_->WriteWithStackTrace(alloc_message,
                                    error_info->block_info.alloc_stack,
                                    error_info->block_info.alloc_stack_size);
     }
@@ -937,6 +1201,9 @@ void AsanRuntime::LogAsanErrorInfo(AsanErrorInfo* error_info) {
       shadow()->AppendShadowMemoryText(error_info->location, &shadow_text);
       logger_->Write(shadow_text);
     }
+
+    // The report must reach the log before the process goes down.
+    logger_->Flush();
   }
 
   // Print the base of the Windbg help message.
@@ -945,7 +1212,10 @@ void AsanRuntime::LogAsanErrorInfo(AsanErrorInfo* error_info) {
 
   // Print the Windbg information to display the allocation stack if present.
   if (error_info->block_info.alloc_stack_size != NULL) {
-    AsanDbgMessage(L"Allocation stack trace:");
+    if (error_info->block_info.alloc_stack_is_fingerprint)
+      AsanDbgMessage(L"Allocation stack trace (sampled out, partial):");
+    else
+      AsanDbgMessage(L"Allocation stack trace:");
     AsanDbgCmd(L"dps %p l%d", error_info->block_info.alloc_stack,
                error_info->block_info.alloc_stack_size);
   }
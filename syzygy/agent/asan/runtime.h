@@ -24,12 +24,18 @@
 #include "base/callback.h"
 #include "base/logging.h"
 #include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/crash_report_builder.h"
 #include "syzygy/agent/asan/error_info.h"
 #include "syzygy/agent/asan/heap_checker.h"
+#include "syzygy/agent/asan/heap_checker_thread.h"
+#include "syzygy/agent/asan/lock_profiler.h"
 #include "syzygy/agent/asan/memory_notifier.h"
+#include "syzygy/agent/asan/memory_pressure_monitor.h"
 #include "syzygy/agent/asan/reporter.h"
+#include "syzygy/agent/asan/statistics_publisher.h"
 #include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
 #include "syzygy/agent/common/stack_capture.h"
+#include "syzygy/agent/common/stack_unwinder.h"
 #include "syzygy/common/asan_parameters.h"
 
 namespace agent {
@@ -75,8 +81,16 @@ class AsanRuntime {
   Shadow* shadow() const { return shadow_.get(); }
   StackCaptureCache* stack_cache() const { return stack_cache_.get(); }
   ReporterInterface* crash_reporter() const { return crash_reporter_.get(); }
+  CrashReportBuilder* crash_report_builder() const {
+    return crash_report_builder_.get();
+  }
   // @}
 
+  // The maximum time that the thread processing an error waits for the
+  // crash report to be built by the helper thread, before building it
+  // itself.
+  static const int kCrashReportDeadlineMs = 5000;
+
   // Initialize asan runtime library.
   // @param flags_command_line The parameters string.
   // @returns true on success, false otherwise.
@@ -267,11 +281,11 @@ class AsanRuntime {
   // Tear down the logger.
   void TearDownLogger();
 
-  // Set up the stack cache.
+  // Set up the stack cache, and the unwinder capturing the stacks.
   // @returns true on success, false otherwise.
   bool SetUpStackCache();
 
-  // Tear down the stack cache.
+  // Tear down the stack cache and the unwinder.
   void TearDownStackCache();
 
   // Set up the heap manager.
@@ -281,6 +295,58 @@ class AsanRuntime {
   // Tear down the heap manager.
   void TearDownHeapManager();
 
+  // Set up the heap checker, starting its worker threads and the background
+  // heap checking thread as configured. Failing to start these threads isn't
+  // fatal.
+  void SetUpHeapChecker();
+
+  // Tear down the heap checker, stopping its threads.
+  void TearDownHeapChecker();
+
+  // Set up the crash report builder, starting its helper thread if the
+  // errors are reported with a minidump. Failing to start this thread isn't
+  // fatal.
+  void SetUpCrashReportBuilder();
+
+  // Tear down the crash report builder, stopping its thread.
+  void TearDownCrashReportBuilder();
+
+  // Set up the thread periodically logging the lock profile, if the lock
+  // profiling is enabled. Failing to start this thread isn't fatal.
+  void SetUpLockProfiler();
+
+  // Tear down the lock profiler, stopping its thread.
+  void TearDownLockProfiler();
+
+  // Set up the publication of the runtime statistics in a shared memory
+  // section, if enabled. Failing to do so isn't fatal.
+  void SetUpStatisticsPublisher();
+
+  // Tear down the statistics publisher, stopping its thread.
+  void TearDownStatisticsPublisher();
+
+  // Gathers the statistics published by the statistics publisher.
+  // @param statistics Will receive the statistics.
+  void GatherStatistics(AsanRuntimeStatistics* statistics);
+
+  // Set up the monitoring of the memory resource notifications, if enabled.
+  // Failing to do so isn't fatal.
+  void SetUpMemoryPressureMonitor();
+
+  // Tear down the memory pressure monitor, stopping its thread.
+  void TearDownMemoryPressureMonitor();
+
+  // Adjusts the budgets of the heap manager to the memory availability. This
+  // is called on the thread of the memory pressure monitor.
+  // @param availability The memory availability.
+  void OnMemoryAvailabilityChange(
+      MemoryPressureMonitor::MemoryAvailability availability);
+
+  // Reports the corruption found by the background heap checking thread.
+  // @param corrupt_ranges The corrupt ranges that were found.
+  void OnHeapCorruptionFound(
+      const HeapChecker::CorruptRangesVector& corrupt_ranges);
+
   // The unhandled exception filter registered by this runtime. This is used
   // to catch unhandled exceptions so we can augment them with information
   // about the corrupt heap.
@@ -318,6 +384,29 @@ class AsanRuntime {
   // The shared stack cache instance that will be used by all the heaps.
   std::unique_ptr<StackCaptureCache> stack_cache_;
 
+  // The unwinder capturing the stacks through the unwind tables of the
+  // modules on x64, if it could be initialized.
+  std::unique_ptr<common::StackUnwinder> stack_unwinder_;
+
+  // The heap checker used when processing an error, which owns the worker
+  // threads splitting the work.
+  std::unique_ptr<HeapChecker> heap_checker_;
+
+  // The thread checking the heap in the background, if enabled.
+  std::unique_ptr<HeapCheckerThread> heap_checker_thread_;
+
+  // Builds the crash reports, on a helper thread if possible.
+  std::unique_ptr<CrashReportBuilder> crash_report_builder_;
+
+  // The thread periodically logging the lock profile, if enabled.
+  std::unique_ptr<LockProfilerThread> lock_profiler_thread_;
+
+  // The publisher of the runtime statistics, if enabled.
+  std::unique_ptr<StatisticsPublisher> statistics_publisher_;
+
+  // The monitor of the memory resource notifications, if enabled.
+  std::unique_ptr<MemoryPressureMonitor> memory_pressure_monitor_;
+
   // The asan error callback functor.
   AsanOnErrorCallBack asan_error_callback_;
 
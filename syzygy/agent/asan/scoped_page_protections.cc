@@ -17,6 +17,9 @@
 
 #include "syzygy/agent/asan/scoped_page_protections.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "base/logging.h"
 #include "syzygy/agent/asan/constants.h"
 #include "syzygy/common/align.h"
@@ -36,10 +39,33 @@ bool ScopedPageProtections::EnsureContainingPagesWritable(void* addr,
   uint8_t* cursor = reinterpret_cast<uint8_t*>(addr);
   uint8_t* page_begin = common::AlignDown(cursor, GetPageSize());
   uint8_t* page_end = common::AlignUp(cursor + size, GetPageSize());
-  while (page_begin < page_end) {
-    if (!EnsurePageWritable(page_begin))
+  return EnsurePagesWritable(page_begin, page_end);
+}
+
+bool ScopedPageProtections::EnsureContainingPagesWritable(
+    const std::vector<void*>& addrs, size_t size) {
+  // Get the page ranges covering the addresses, in order.
+  using PageRange = std::pair<uint8_t*, uint8_t*>;
+  std::vector<PageRange> ranges;
+  ranges.reserve(addrs.size());
+  for (void* addr : addrs) {
+    uint8_t* cursor = reinterpret_cast<uint8_t*>(addr);
+    ranges.push_back(
+        std::make_pair(common::AlignDown(cursor, GetPageSize()),
+                       common::AlignUp(cursor + size, GetPageSize())));
+  }
+  std::sort(ranges.begin(), ranges.end());
+
+  // Merge the overlapping and adjacent ranges, and make each of them
+  // writable.
+  size_t i = 0;
+  while (i < ranges.size()) {
+    uint8_t* page_begin = ranges[i].first;
+    uint8_t* page_end = ranges[i].second;
+    for (++i; i < ranges.size() && ranges[i].first <= page_end; ++i)
+      page_end = std::max(page_end, ranges[i].second);
+    if (!EnsurePagesWritable(page_begin, page_end))
       return false;
-    page_begin += GetPageSize();
   }
 
   return true;
@@ -51,65 +77,99 @@ bool ScopedPageProtections::RestorePageProtections() {
   unprotected_pages_.swap(to_unprotect);
 
   // Best-effort restore the old page protections, and remember pages for
-  // which the effort failed.
+  // which the effort failed. The pages are sorted by address, so the runs of
+  // contiguous pages with the same original protection are restored at once.
   bool did_succeed = true;
-  for (const auto& unprotected_page : to_unprotect) {
+  auto run_begin = to_unprotect.begin();
+  while (run_begin != to_unprotect.end()) {
+    auto run_end = run_begin;
+    size_t page_count = 0;
+    do {
+      ++run_end;
+      ++page_count;
+    } while (run_end != to_unprotect.end() &&
+             run_end->second == run_begin->second &&
+             run_end->first == reinterpret_cast<uint8_t*>(run_begin->first) +
+                                   page_count * GetPageSize());
+
     DWORD old_prot = 0;
-    if (!::VirtualProtect(unprotected_page.first, GetPageSize(),
-                          unprotected_page.second, &old_prot)) {
+    ++protection_changes_;
+    if (!::VirtualProtect(run_begin->first, page_count * GetPageSize(),
+                          run_begin->second, &old_prot)) {
       DWORD error = ::GetLastError();
       LOG(ERROR) << "VirtualProtect failed: " << common::LogWe(error);
 
       // Pages that failed to be unprotected are reinserted into the set of
       // pages being tracked.
-      bool inserted = unprotected_pages_.insert(unprotected_page).second;
-      DCHECK(inserted);
+      unprotected_pages_.insert(run_begin, run_end);
 
       did_succeed = false;
     }
+
+    run_begin = run_end;
   }
 
   return did_succeed;
 }
 
-bool ScopedPageProtections::EnsurePageWritable(void* page) {
-  DCHECK(common::IsAligned(page, GetPageSize()));
+bool ScopedPageProtections::EnsurePagesWritable(uint8_t* begin,
+                                                uint8_t* end) {
+  DCHECK(common::IsAligned(begin, GetPageSize()));
+  DCHECK(common::IsAligned(end, GetPageSize()));
+
+  uint8_t* page = begin;
+  while (page < end) {
+    // Skip the pages we've already unprotected.
+    if (unprotected_pages_.find(page) != unprotected_pages_.end()) {
+      page += GetPageSize();
+      continue;
+    }
 
-  // Check whether we've already unprotected this page.
-  if (unprotected_pages_.find(page) != unprotected_pages_.end())
-    return true;
+    // We didn't unprotect this yet. The region returned by VirtualQuery has
+    // a uniform protection, so the pages that follow in it can be made
+    // writable along with this one.
+    MEMORY_BASIC_INFORMATION memory_info{};
+    if (!::VirtualQuery(page, &memory_info, sizeof(memory_info))) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "VirtualQuery failed: " << common::LogWe(error);
+      return false;
+    }
+    uint8_t* region_end = reinterpret_cast<uint8_t*>(memory_info.BaseAddress) +
+                          memory_info.RegionSize;
+    uint8_t* run_end = page + GetPageSize();
+    while (run_end < end && run_end < region_end &&
+           unprotected_pages_.find(run_end) == unprotected_pages_.end()) {
+      run_end += GetPageSize();
+    }
 
-  // We didn't unprotect this yet, make the page writable.
-  MEMORY_BASIC_INFORMATION memory_info{};
-  if (!::VirtualQuery(page, &memory_info, sizeof(memory_info))) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "VirtualQuery failed: " << common::LogWe(error);
-    return false;
-  }
+    // Preserve executable status while patching.
+    DWORD is_executable = (PAGE_EXECUTE | PAGE_EXECUTE_READ |
+                           PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY) &
+                          memory_info.Protect;
+    DWORD new_prot = PAGE_READWRITE;
+    if (is_executable)
+      new_prot = PAGE_EXECUTE_READWRITE;
 
-  // Preserve executable status while patching.
-  DWORD is_executable = (PAGE_EXECUTE | PAGE_EXECUTE_READ |
-                         PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY) &
-                        memory_info.Protect;
-  DWORD new_prot = PAGE_READWRITE;
-  if (is_executable)
-    new_prot = PAGE_EXECUTE_READWRITE;
-
-  DWORD old_prot = 0;
-  if (!::VirtualProtect(page, GetPageSize(), new_prot, &old_prot)) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "VirtualProtect failed: " << common::LogWe(error);
-    return false;
-  }
+    DWORD old_prot = 0;
+    ++protection_changes_;
+    if (!::VirtualProtect(page, run_end - page, new_prot, &old_prot)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "VirtualProtect failed: " << common::LogWe(error);
+      return false;
+    }
 
-  // Make a note that we modified this page, as well as its original settings.
-  bool inserted =
-      unprotected_pages_.insert(std::make_pair(page, old_prot)).second;
-  DCHECK(inserted);
+    // Make a note that we modified these pages, as well as their original
+    // settings.
+    for (; page < run_end; page += GetPageSize()) {
+      bool inserted =
+          unprotected_pages_.insert(std::make_pair(page, old_prot)).second;
+      DCHECK(inserted);
 
-  // Callback as a testing seam.
-  if (!on_unprotect_.is_null())
-    on_unprotect_.Run(page, old_prot);
+      // Callback as a testing seam.
+      if (!on_unprotect_.is_null())
+        on_unprotect_.Run(page, old_prot);
+    }
+  }
 
   return true;
 }
@@ -20,6 +20,7 @@
 
 #include <windows.h>
 #include <map>
+#include <vector>
 #include "base/callback.h"
 #include "base/macros.h"
 
@@ -38,7 +39,7 @@ class ScopedPageProtections {
   using OnUnprotectCallback = base::Callback<void(void* /* page */,
                                                   DWORD /* old_prot */)>;
 
-  ScopedPageProtections() {}
+  ScopedPageProtections() : protection_changes_(0) {}
   ~ScopedPageProtections();
 
   // Makes the page(s) containing @p size bytes starting at @p addr writable.
@@ -47,7 +48,19 @@ class ScopedPageProtections {
   // @returns true on success, false otherwise.
   bool EnsureContainingPagesWritable(void* addr, size_t size);
 
-  // Restores all page protections that have been modified. This is
+  // Makes the pages containing @p size bytes starting at each of @p addrs
+  // writable. The pages are sorted and deduplicated first, and each run of
+  // contiguous pages sharing the same protection is changed with a single
+  // VirtualProtect call. This is meant for patchers that know all the
+  // locations they are about to write ahead of time.
+  // @param addrs The addresses to be written.
+  // @param size The number of bytes to be written at each address.
+  // @returns true on success, false otherwise.
+  bool EnsureContainingPagesWritable(const std::vector<void*>& addrs,
+                                     size_t size);
+
+  // Restores all page protections that have been modified. Contiguous pages
+  // that had the same protection are restored together. This is
   // automatically invoked on destruction. Specifically remembers pages for
   // which restoring protections failed. Repeated calls to this function
   // will try again for those pages.
@@ -59,11 +72,17 @@ class ScopedPageProtections {
     on_unprotect_ = on_unprotect;
   }
 
+  // @returns the number of VirtualProtect calls made so far. This is exposed
+  //     for testing.
+  size_t protection_changes() const { return protection_changes_; }
+
  private:
   // Helper function for EnsureContainingPagesWritable.
-  // @pre page Points to the beginning of a page.
-  // @param page The address of the page to make writable.
-  bool EnsurePageWritable(void* page);
+  // @pre @p begin and @p end point to the beginning of a page.
+  // @param begin The address of the first page to make writable.
+  // @param end The address of the page following the last one to make
+  //     writable.
+  bool EnsurePagesWritable(uint8_t* begin, uint8_t* end);
 
   using UnprotectedPages = std::map<void*, DWORD>;
 
@@ -73,6 +92,9 @@ class ScopedPageProtections {
   // Optional callback.
   OnUnprotectCallback on_unprotect_;
 
+  // The number of VirtualProtect calls made so far.
+  size_t protection_changes_;
+
   DISALLOW_COPY_AND_ASSIGN(ScopedPageProtections);
 };
 
@@ -18,6 +18,8 @@
 #include "syzygy/agent/asan/scoped_page_protections.h"
 
 #include <cstdint>
+#include <vector>
+
 #include "base/logging.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/constants.h"
@@ -127,6 +129,50 @@ TEST_F(ScopedPageProtectionsTest, SpanMultiplePages) {
   EXPECT_EQ(PAGE_READONLY, GetProtection(2));
 }
 
+TEST_F(ScopedPageProtectionsTest, ContiguousPagesAreChangedTogether) {
+  ScopedPageProtections spp;
+  EXPECT_TRUE(
+      spp.EnsureContainingPagesWritable(BaseOfPage(0), 3 * GetPageSize()));
+  EXPECT_EQ(PAGE_READWRITE, GetProtection(0));
+  EXPECT_EQ(PAGE_READWRITE, GetProtection(1));
+  EXPECT_EQ(PAGE_READWRITE, GetProtection(2));
+  EXPECT_EQ(1u, spp.protection_changes());
+
+  EXPECT_TRUE(spp.RestorePageProtections());
+  EXPECT_EQ(PAGE_READONLY, GetProtection(0));
+  EXPECT_EQ(PAGE_READONLY, GetProtection(1));
+  EXPECT_EQ(PAGE_READONLY, GetProtection(2));
+  EXPECT_EQ(2u, spp.protection_changes());
+}
+
+TEST_F(ScopedPageProtectionsTest, BatchedAddresses) {
+  ScopedPageProtections spp;
+  SetProtection(1, PAGE_EXECUTE_READ);
+
+  // Many addresses, out of order and sharing pages.
+  std::vector<void*> addrs;
+  addrs.push_back(BaseOfPage(2) + 8);
+  addrs.push_back(BaseOfPage(0));
+  addrs.push_back(BaseOfPage(2) + 16);
+  addrs.push_back(BaseOfPage(1) + 100);
+  addrs.push_back(BaseOfPage(0) + 4);
+  EXPECT_TRUE(spp.EnsureContainingPagesWritable(addrs, sizeof(void*)));
+  EXPECT_EQ(PAGE_READWRITE, GetProtection(0));
+  EXPECT_EQ(PAGE_EXECUTE_READWRITE, GetProtection(1));
+  EXPECT_EQ(PAGE_READWRITE, GetProtection(2));
+  // One call per page, as their protections differ.
+  EXPECT_EQ(3u, spp.protection_changes());
+
+  // Already unprotected pages are skipped.
+  EXPECT_TRUE(spp.EnsureContainingPagesWritable(addrs, sizeof(void*)));
+  EXPECT_EQ(3u, spp.protection_changes());
+
+  EXPECT_TRUE(spp.RestorePageProtections());
+  EXPECT_EQ(PAGE_READONLY, GetProtection(0));
+  EXPECT_EQ(PAGE_EXECUTE_READ, GetProtection(1));
+  EXPECT_EQ(PAGE_READONLY, GetProtection(2));
+}
+
 TEST_F(ScopedPageProtectionsTest, RestoresProtectionsInDestructor) {
   // The fixture should guarantee this.
   ASSERT_EQ(PAGE_READONLY, GetProtection(0));
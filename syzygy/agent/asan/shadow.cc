@@ -19,6 +19,7 @@
 
 #include "base/strings/stringprintf.h"
 #include "base/win/pe_image.h"
+#include "syzygy/agent/asan/shadow_fill.h"
 #include "syzygy/common/align.h"
 
 namespace agent {
@@ -26,7 +27,6 @@ namespace asan {
 
 namespace {
 
-#ifdef _WIN64
 // A lock under which the shadow instance is modified.
 base::Lock shadow_instance_lock;
 
@@ -77,10 +77,52 @@ LONG NTAPI ShadowExceptionHandler(PEXCEPTION_POINTERS exception_pointers) {
       ? EXCEPTION_CONTINUE_EXECUTION
       : EXCEPTION_CONTINUE_SEARCH;
 }
-#endif  // defined _WIN64
+
+#ifdef _WIN64
+// Large address spaces are too big for the shadow to be committed up front.
+const Shadow::CommitMode kDefaultCommitMode = Shadow::kCommitOnDemand;
+#else
+const Shadow::CommitMode kDefaultCommitMode = Shadow::kCommitUpFront;
+#endif
 
 static const size_t kPageSize = GetPageSize();
 
+// Enables the SeLockMemoryPrivilege of the process, which is needed to
+// allocate large pages. The privilege must have been granted to the user.
+// @returns true on success.
+bool EnableLockMemoryPrivilege() {
+  HANDLE token = nullptr;
+  if (!::OpenProcessToken(::GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES,
+                          &token)) {
+    return false;
+  }
+  TOKEN_PRIVILEGES privileges = {};
+  privileges.PrivilegeCount = 1;
+  privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+  bool success = ::LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME,
+                                        &privileges.Privileges[0].Luid) &&
+                 ::AdjustTokenPrivileges(token, FALSE, &privileges, 0,
+                                         nullptr, nullptr) &&
+                 // This succeeds without enabling a privilege the user
+                 // doesn't hold.
+                 ::GetLastError() == ERROR_SUCCESS;
+  ::CloseHandle(token);
+  return success;
+}
+
+// Allocates and commits memory in large pages.
+// @param length The length of the memory, rounded up to a multiple of the
+//     large page size.
+// @returns the memory, or nullptr if large pages aren't available.
+void* AllocateLargePages(size_t length) {
+  size_t large_page_size = ::GetLargePageMinimum();
+  if (large_page_size == 0 || !EnableLockMemoryPrivilege())
+    return nullptr;
+  return ::VirtualAlloc(nullptr, ::common::AlignUp(length, large_page_size),
+                        MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                        PAGE_READWRITE);
+}
+
 // Converts an address to a page index and bit mask.
 inline void AddressToPageMask(const void* address,
                               size_t* index,
@@ -103,29 +145,58 @@ extern "C" {
 uint8_t asan_memory_interceptors_shadow_memory[1] = {};
 }
 
-Shadow::Shadow() : own_memory_(false), shadow_(nullptr), length_(0) {
-  Init(RequiredLength());
+Shadow::Shadow()
+    : own_memory_(false),
+      commit_on_demand_(false),
+      large_pages_(false),
+      self_poisoned_(false),
+      shadow_(nullptr),
+      length_(0),
+      exception_handler_(nullptr) {
+  Init(RequiredLength(), kDefaultCommitMode);
 }
 
 Shadow::Shadow(size_t length)
-    : own_memory_(false), shadow_(nullptr), length_(0) {
-  Init(length);
+    : own_memory_(false),
+      commit_on_demand_(false),
+      large_pages_(false),
+      self_poisoned_(false),
+      shadow_(nullptr),
+      length_(0),
+      exception_handler_(nullptr) {
+  Init(length, kDefaultCommitMode);
+}
+
+Shadow::Shadow(size_t length, CommitMode commit_mode)
+    : own_memory_(false),
+      commit_on_demand_(false),
+      large_pages_(false),
+      self_poisoned_(false),
+      shadow_(nullptr),
+      length_(0),
+      exception_handler_(nullptr) {
+  Init(length, commit_mode);
 }
 
 Shadow::Shadow(void* shadow, size_t length)
-    : own_memory_(false), shadow_(nullptr), length_(0) {
+    : own_memory_(false),
+      commit_on_demand_(kDefaultCommitMode == kCommitOnDemand),
+      large_pages_(false),
+      self_poisoned_(false),
+      shadow_(nullptr),
+      length_(0),
+      exception_handler_(nullptr) {
   Init(false, shadow, length);
 }
 
 Shadow::~Shadow() {
-#ifdef _WIN64
-  RemoveVectoredExceptionHandler(exception_handler_);
+  if (exception_handler_ != nullptr) {
+    ::RemoveVectoredExceptionHandler(exception_handler_);
+    exception_handler_ = nullptr;
 
-  {
     base::AutoLock lock(shadow_instance_lock);
     shadow_instance = nullptr;
   }
-#endif
   if (own_memory_)
     CHECK(::VirtualFree(shadow_, 0, MEM_RELEASE));
   CHECK(::VirtualFree(page_bits_, 0, MEM_RELEASE));
@@ -150,6 +221,8 @@ size_t Shadow::RequiredLength() {
 }
 
 void Shadow::SetUp() {
+  find_first_non_zero_byte_ = internal::GetFindFirstNonZeroByteFunction();
+
   // Poison the shadow object itself.
   const void* self = nullptr;
   size_t self_size = 0;
@@ -160,12 +233,20 @@ void Shadow::SetUp() {
 
   // Poison the first 64k of the memory as they're not addressable.
   Poison(0, kAddressLowerBound, kInvalidAddressMarker);
-#ifndef _WIN64
-  // Poison the shadow memory.
-  Poison(shadow_, length_, kAsanMemoryMarker);
-  // Poison the protection bits array.
-  Poison(page_bits_, page_bits_length_, kAsanMemoryMarker);
-#endif
+
+  // Poisoning the shadow of the shadow memory writes an eighth of it. When
+  // committing on demand this would commit a large part of it. When this
+  // object allocated the memory it consists of freshly committed zero pages
+  // and this would be the only thing touching them at startup, on the loader
+  // thread, so it is skipped as well. Only the arrays provided by the caller
+  // are poisoned.
+  self_poisoned_ = !commit_on_demand_ && !own_memory_;
+  if (self_poisoned_) {
+    // Poison the shadow memory.
+    Poison(shadow_, length_, kAsanMemoryMarker);
+    // Poison the protection bits array.
+    Poison(page_bits_, page_bits_length_, kAsanMemoryMarker);
+  }
 }
 
 void Shadow::TearDown() {
@@ -179,12 +260,13 @@ void Shadow::TearDown() {
 
   // Unpoison the first 64k of the memory.
   Unpoison(0, kAddressLowerBound);
-#ifndef _WIN64
-  // Unpoison the shadow memory.
-  Unpoison(shadow_, length_);
-  // Unpoison the protection bits array.
-  Unpoison(page_bits_, page_bits_length_);
-#endif
+  if (self_poisoned_) {
+    // Unpoison the shadow memory.
+    Unpoison(shadow_, length_);
+    // Unpoison the protection bits array.
+    Unpoison(page_bits_, page_bits_length_);
+    self_poisoned_ = false;
+  }
 }
 
 bool Shadow::IsClean() const {
@@ -232,8 +314,8 @@ bool Shadow::IsClean() const {
     next_cursor = std::min(next_cursor, shadow_ + length_);
     auto next_i = next_cursor - shadow_;
     for (; i < next_i; ++i) {
-      if ((i >= shadow_begin && i < shadow_end) ||
-          (i >= page_bits_begin && i < page_bits_end) ||
+      if ((self_poisoned_ && i >= shadow_begin && i < shadow_end) ||
+          (self_poisoned_ && i >= page_bits_begin && i < page_bits_end) ||
           (i >= this_begin && i < this_end)) {
         if (shadow_[i] != kAsanMemoryMarker)
           return false;
@@ -274,27 +356,38 @@ void Shadow::GetPointerAndSizeImpl(void const** self, size_t* size) const {
   *size = sizeof(*this);
 }
 
-void Shadow::Init(size_t length) {
+void Shadow::Init(size_t length, CommitMode commit_mode) {
   DCHECK_LT(0u, length);
 
-#ifndef _WIN64
+  commit_on_demand_ = kDefaultCommitMode == kCommitOnDemand ||
+      commit_mode == kCommitOnDemand;
+
   // The allocation may fail and it needs to be handled gracefully.
-  void* mem = ::VirtualAlloc(nullptr, length, MEM_COMMIT, PAGE_READWRITE);
-#else
-  void* mem = ::VirtualAlloc(nullptr, length, MEM_RESERVE, PAGE_NOACCESS);
-#endif
+  void* mem = nullptr;
+  if (commit_on_demand_) {
+    mem = ::VirtualAlloc(nullptr, length, MEM_RESERVE, PAGE_NOACCESS);
+  } else {
+    if (commit_mode == kCommitLargePages) {
+      mem = AllocateLargePages(length);
+      large_pages_ = mem != nullptr;
+    }
+    if (mem == nullptr)
+      mem = ::VirtualAlloc(nullptr, length, MEM_COMMIT, PAGE_READWRITE);
+  }
   Init(true, mem, length);
 }
 
 void Shadow::Init(bool own_memory, void* shadow, size_t length) {
-#ifdef _WIN64
-  {
-    base::AutoLock lock(shadow_instance_lock);
-    shadow_instance = this;
+  if (commit_on_demand_) {
+    {
+      base::AutoLock lock(shadow_instance_lock);
+      shadow_instance = this;
+    }
+    exception_handler_ =
+        ::AddVectoredExceptionHandler(TRUE, ShadowExceptionHandler);
   }
-  exception_handler_ =
-      ::AddVectoredExceptionHandler(TRUE, ShadowExceptionHandler);
-#endif
+
+  find_first_non_zero_byte_ = &internal::FindFirstNonZeroByteScalar;
 
   // Handle the case of a failed allocation.
   if (shadow == nullptr) {
@@ -316,25 +409,23 @@ void Shadow::Init(bool own_memory, void* shadow, size_t length) {
   DCHECK_EQ(0u, memory_size % kPageSize);
   size_t page_count = memory_size / kPageSize;
   page_bits_length_ = page_count / 8;
-#ifndef _WIN64
-  page_bits_ = static_cast<uint8_t*>(::VirtualAlloc(nullptr, page_bits_length_,
-                                                    MEM_COMMIT,
-                                                    PAGE_READWRITE));
-#else
-  page_bits_ = static_cast<uint8_t*>(::VirtualAlloc(nullptr, page_bits_length_,
-                                                    MEM_RESERVE,
-                                                    PAGE_NOACCESS));
-#endif
+  if (commit_on_demand_) {
+    page_bits_ = static_cast<uint8_t*>(::VirtualAlloc(
+        nullptr, page_bits_length_, MEM_RESERVE, PAGE_NOACCESS));
+  } else {
+    page_bits_ = static_cast<uint8_t*>(::VirtualAlloc(
+        nullptr, page_bits_length_, MEM_COMMIT, PAGE_READWRITE));
+  }
 }
 
 void Shadow::Reset() {
-#ifndef _WIN64
-  ::memset(shadow_, 0, length_);
-  ::memset(page_bits_, 0, page_bits_length_);
-#else
-  ::VirtualFree(shadow_, length_, MEM_DECOMMIT);
-  ::VirtualFree(page_bits_, page_bits_length_, MEM_DECOMMIT);
-#endif
+  if (commit_on_demand_) {
+    ::VirtualFree(shadow_, length_, MEM_DECOMMIT);
+    ::VirtualFree(page_bits_, page_bits_length_, MEM_DECOMMIT);
+  } else {
+    ::memset(shadow_, 0, length_);
+    ::memset(page_bits_, 0, page_bits_length_);
+  }
 
   SetShadowMemory(0, kShadowRatio * length_, kHeapAddressableMarker);
 }
@@ -352,7 +443,7 @@ void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
 
   size >>= kShadowRatioLog;
   DCHECK_GT(length_, index + size);
-  ::memset(shadow_ + index, shadow_val, size);
+  internal::FillShadow(shadow_ + index, shadow_ + index + size, shadow_val);
 }
 
 void Shadow::Unpoison(const void* addr, size_t size) {
@@ -365,7 +456,8 @@ void Shadow::Unpoison(const void* addr, size_t size) {
   index >>= kShadowRatioLog;
   size >>= kShadowRatioLog;
   DCHECK_GT(length_, index + size);
-  ::memset(shadow_ + index, kHeapAddressableMarker, size);
+  internal::FillShadow(shadow_ + index, shadow_ + index + size,
+                       kHeapAddressableMarker);
 
   if (remainder != 0)
     shadow_[index + size] = remainder;
@@ -381,54 +473,6 @@ static const uint32_t kFreedMarker32 =
 static const uint64_t kFreedMarker64 =
     (static_cast<const uint64_t>(kFreedMarker32) << 32) | kFreedMarker32;
 
-// Marks the given range of shadow bytes as freed, preserving left and right
-// redzone bytes.
-inline void MarkAsFreedImpl8(uint8_t* cursor, uint8_t* cursor_end) {
-  for (; cursor != cursor_end; ++cursor) {
-    // Preserve block beginnings/ends/redzones as they were originally.
-    // This is necessary to preserve information about nested blocks.
-    if (ShadowMarkerHelper::IsActiveLeftRedzone(*cursor) ||
-        ShadowMarkerHelper::IsActiveRightRedzone(*cursor)) {
-      continue;
-    }
-
-    // Anything else gets marked as freed.
-    *cursor = kHeapFreedMarker;
-  }
-}
-
-// Marks the given range of shadow bytes as freed, preserving left and right
-// redzone bytes. |cursor| and |cursor_end| must be 8-byte aligned.
-inline void MarkAsFreedImplAligned64(uint64_t* cursor, uint64_t* cursor_end) {
-  DCHECK(::common::IsAligned(cursor, sizeof(uint64_t)));
-  DCHECK(::common::IsAligned(cursor_end, sizeof(uint64_t)));
-
-  for (; cursor != cursor_end; ++cursor) {
-    // If the block of shadow memory is entirely green then mark as freed.
-    // Otherwise go check its contents byte by byte.
-    if (*cursor == 0) {
-      *cursor = kFreedMarker64;
-    } else {
-      MarkAsFreedImpl8(reinterpret_cast<uint8_t*>(cursor),
-                       reinterpret_cast<uint8_t*>(cursor + 1));
-    }
-  }
-}
-
-inline void MarkAsFreedImpl64(uint8_t* cursor, uint8_t* cursor_end) {
-  if (cursor_end - cursor >= 2 * sizeof(uint64_t)) {
-    uint8_t* cursor_aligned = ::common::AlignUp(cursor, sizeof(uint64_t));
-    uint8_t* cursor_end_aligned =
-        ::common::AlignDown(cursor_end, sizeof(uint64_t));
-    MarkAsFreedImpl8(cursor, cursor_aligned);
-    MarkAsFreedImplAligned64(reinterpret_cast<uint64_t*>(cursor_aligned),
-                             reinterpret_cast<uint64_t*>(cursor_end_aligned));
-    MarkAsFreedImpl8(cursor_end_aligned, cursor_end);
-  } else {
-    MarkAsFreedImpl8(cursor, cursor_end);
-  }
-}
-
 }  // namespace
 
 void Shadow::MarkAsFreed(const void* addr, size_t size) {
@@ -447,7 +491,7 @@ void Shadow::MarkAsFreed(const void* addr, size_t size) {
 
   // This isn't as simple as a memset because we need to preserve left and
   // right redzone padding bytes that may be found in the range.
-  MarkAsFreedImpl64(cursor, cursor_end);
+  internal::MarkShadowAsFreed(cursor, cursor_end);
 }
 
 bool Shadow::IsAccessible(const void* addr) const {
@@ -504,8 +548,10 @@ bool Shadow::IsRangeAccessible(const void* addr, size_t size) const {
 
   // Now run over the shadow bytes from start to end, which all need to be
   // zero.
-  if (!internal::IsZeroBufferImpl<uint64_t>(&shadow_[start], &shadow_[end]))
-      return false;
+  if (find_first_non_zero_byte_(&shadow_[start], &shadow_[end]) !=
+      &shadow_[end]) {
+    return false;
+  }
 
   // Finally test the end point if there's a tail offset.
   if (end_offs == 0U)
@@ -560,12 +606,14 @@ const void* Shadow::FindFirstPoisonedByte(const void* addr, size_t size) const {
   if (end > length_)
     return out_addr;
 
-  for (size_t curr = start; curr < end; ++curr, out_addr += kShadowRatio) {
-    shadow = shadow_[curr];
+  const uint8_t* cursor = find_first_non_zero_byte_(&shadow_[start],
+                                                     &shadow_[end]);
+  out_addr += (cursor - &shadow_[start]) * kShadowRatio;
+  if (cursor != &shadow_[end]) {
+    shadow = *cursor;
     if (ShadowMarkerHelper::IsRedzone(shadow))
       return out_addr;
-    if (shadow != 0)
-      return out_addr + shadow;
+    return out_addr + shadow;
   }
 
   // Finally test the end point if there's a tail offset.
@@ -674,17 +722,19 @@ void Shadow::PoisonAllocatedBlock(const BlockInfo& info) {
 
   // Poison the header and left padding.
   uint8_t* cursor = shadow_ + index;
-  ::memset(cursor, header_marker, 1);
-  ::memset(cursor + 1, kHeapLeftPaddingMarker, left_redzone_bytes - 1);
+  cursor[0] = header_marker;
+  internal::FillShadow(cursor + 1, cursor + left_redzone_bytes,
+                       kHeapLeftPaddingMarker);
   cursor += left_redzone_bytes;
-  ::memset(cursor, kHeapAddressableMarker, body_bytes);
+  internal::FillShadow(cursor, cursor + body_bytes, kHeapAddressableMarker);
   cursor += body_bytes;
 
   // Poison the right padding and the trailer.
   if (body_size_mod > 0)
     cursor[-1] = body_size_mod;
-  ::memset(cursor, kHeapRightPaddingMarker, right_redzone_bytes - 1);
-  ::memset(cursor + right_redzone_bytes - 1, trailer_marker, 1);
+  internal::FillShadow(cursor, cursor + right_redzone_bytes - 1,
+                       kHeapRightPaddingMarker);
+  cursor[right_redzone_bytes - 1] = trailer_marker;
 
   SetShadowMemory(info.header,
                   info.TotalHeaderSize(),
@@ -869,26 +919,26 @@ bool Shadow::ScanLeftForBracketingBlockStart(size_t cursor,
 
   size_t left = cursor;
 
-#ifdef _WIN64
-  // In 64-bit we don't commit the full shadow address space, so we need to
-  // skip over the uncommitted ranges.
+  // When committing on demand the full shadow address space isn't committed,
+  // so we need to skip over the uncommitted ranges.
   MEMORY_BASIC_INFORMATION memory_info = {};
-  SIZE_T ret =
-      ::VirtualQuery(&shadow_[left], &memory_info, sizeof(memory_info));
-  DCHECK_GT(ret, 0u);
-  if (memory_info.State != MEM_COMMIT)
-    return false;
-#endif
+  if (commit_on_demand_) {
+    SIZE_T ret =
+        ::VirtualQuery(&shadow_[left], &memory_info, sizeof(memory_info));
+    DCHECK_GT(ret, 0u);
+    if (memory_info.State != MEM_COMMIT)
+      return false;
+  }
 
   while (true) {
-#ifdef _WIN64
-    if (&shadow_[left] < static_cast<const uint8_t*>(memory_info.BaseAddress)) {
-      ret = ::VirtualQuery(&shadow_[left], &memory_info, sizeof(memory_info));
+    if (commit_on_demand_ &&
+        &shadow_[left] < static_cast<const uint8_t*>(memory_info.BaseAddress)) {
+      SIZE_T ret =
+          ::VirtualQuery(&shadow_[left], &memory_info, sizeof(memory_info));
       DCHECK_GT(ret, 0u);
       if (memory_info.State != MEM_COMMIT)
         return false;
     }
-#endif
     if (ShadowMarkerHelper::IsBlockStart(shadow_[left])) {
       *location = left;
       return true;
@@ -1091,45 +1141,45 @@ bool ShadowWalker::Next(BlockInfo* info) {
   auto shadow_upper_bound = shadow_->shadow() + upper_index_;
 
   while (shadow_cursor_ < shadow_upper_bound) {
-    // On 32-bit the shadow is always fully committed so there's no need to
-    // check the status of the memory regions in the shadow.
-#ifdef _WIN64
-    auto start_of_region =
-        static_cast<const uint8_t*>(memory_info_.BaseAddress);
-    auto end_of_region = start_of_region + memory_info_.RegionSize;
-    if (shadow_cursor_ >= end_of_region) {
-      // Skip uncommitted ranges of memory. This is possible when using a sparse
-      // shadow that maps its pages in on demand.
-      size_t ret = ::VirtualQuery(shadow_cursor_, &memory_info_,
-                                  sizeof(memory_info_));
-      DCHECK_GT(ret, 0u);
-      start_of_region = static_cast<const uint8_t*>(memory_info_.BaseAddress);
+    // A shadow that is committed up front has no need to check the status of
+    // the memory regions in the shadow.
+    auto end_of_region = shadow_upper_bound;
+    if (shadow_->commit_on_demand()) {
+      auto start_of_region =
+          static_cast<const uint8_t*>(memory_info_.BaseAddress);
       end_of_region = start_of_region + memory_info_.RegionSize;
-
-      // If the region isn't committed and readable memory then skip it.
-      if (memory_info_.State != MEM_COMMIT) {
-        // If the next region is beyond the part of the shadow being scanned
-        // then bail early (be careful to handle overflow here).
-        if (end_of_region > shadow_upper_bound || end_of_region == nullptr)
-          return false;
-
-        // Step to the beginning of the next region and try again.
-        shadow_cursor_ = end_of_region;
-        continue;
+      if (shadow_cursor_ >= end_of_region) {
+        // Skip uncommitted ranges of memory. This is possible when using a
+        // sparse shadow that maps its pages in on demand.
+        size_t ret = ::VirtualQuery(shadow_cursor_, &memory_info_,
+                                    sizeof(memory_info_));
+        DCHECK_GT(ret, 0u);
+        start_of_region =
+            static_cast<const uint8_t*>(memory_info_.BaseAddress);
+        end_of_region = start_of_region + memory_info_.RegionSize;
+
+        // If the region isn't committed and readable memory then skip it.
+        if (memory_info_.State != MEM_COMMIT) {
+          // If the next region is beyond the part of the shadow being scanned
+          // then bail early (be careful to handle overflow here).
+          if (end_of_region > shadow_upper_bound || end_of_region == nullptr)
+            return false;
+
+          // Step to the beginning of the next region and try again.
+          shadow_cursor_ = end_of_region;
+          continue;
+        }
       }
-    }
 
-    // Getting here then |start_of_region| and |end_of_region| are a part of
-    // the shadow that should be scanned. Calculate where to stop for this
-    // region, taking care to handle overflow.
-    if (!end_of_region) {
-      end_of_region = shadow_upper_bound;
-    } else {
-      end_of_region = std::min(shadow_upper_bound, end_of_region);
+      // Getting here then |start_of_region| and |end_of_region| are a part of
+      // the shadow that should be scanned. Calculate where to stop for this
+      // region, taking care to handle overflow.
+      if (!end_of_region) {
+        end_of_region = shadow_upper_bound;
+      } else {
+        end_of_region = std::min(shadow_upper_bound, end_of_region);
+      }
     }
-#else
-    auto end_of_region = shadow_upper_bound;
-#endif
 
     // Scan this committed portion of the shadow.
     while (shadow_cursor_ < end_of_region) {
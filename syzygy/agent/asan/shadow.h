@@ -68,6 +68,7 @@
 #include "syzygy/agent/asan/block.h"
 #include "syzygy/agent/asan/constants.h"
 #include "syzygy/agent/asan/shadow_marker.h"
+#include "syzygy/agent/asan/shadow_scan.h"
 
 namespace agent {
 namespace asan {
@@ -89,6 +90,21 @@ class Shadow {
   // shadow bytes will be reported in all.
   static const size_t kShadowContextLines = 4;
 
+  // The ways in which shadow memory allocated by this object can be backed.
+  enum CommitMode {
+    // The whole shadow is committed when it is allocated.
+    kCommitUpFront,
+    // The shadow is only reserved when it is allocated. Its pages are
+    // committed by a vectored exception handler the first time they are
+    // accessed. This is always the case for large address spaces.
+    kCommitOnDemand,
+    // The whole shadow is committed when it is allocated, in large pages,
+    // so that the instrumented accesses take fewer TLB entries. This needs
+    // the SeLockMemoryPrivilege, and falls back to kCommitUpFront without
+    // it.
+    kCommitLargePages,
+  };
+
   // Default constructor. Creates a shadow memory of the appropriate size
   // depending on the addressable memory for this process.
   // @note The allocation may fail, in which case 'shadow()' will return
@@ -102,6 +118,16 @@ class Shadow {
   //     nullptr. If this is true the object should not be used.
   explicit Shadow(size_t length);
 
+  // Shadow constructor. Allocates shadow memory internally.
+  // @param length The length of the shadow memory in bytes. This implicitly
+  //     encodes the maximum addressable address of the shadow.
+  // @param commit_mode How the shadow memory is to be backed. This is
+  //     ignored for large address spaces, where the shadow is always
+  //     committed on demand.
+  // @note The allocation may fail, in which case 'shadow()' will return
+  //     nullptr. If this is true the object should not be used.
+  Shadow(size_t length, CommitMode commit_mode);
+
   // Shadow constructor.
   // @param shadow The array to use for storing the shadow memory. The shadow
   //     memory allocation *must* be kShadowRatio byte aligned.
@@ -115,7 +141,8 @@ class Shadow {
   // @returns the length of the shadow memory required for the current process.
   static size_t RequiredLength();
 
-  // Set up the shadow memory.
+  // Set up the shadow memory. This also selects the fastest shadow scanning
+  // kernel supported by the CPU; until then a scalar kernel is used.
   void SetUp();
 
   // Tear down the shadow memory.
@@ -285,6 +312,16 @@ class Shadow {
   // Returns the length of the shadow array.
   size_t length() const { return length_; }
 
+  // @returns true if the pages of the shadow are committed on demand.
+  bool commit_on_demand() const { return commit_on_demand_; }
+
+  // @returns true if the shadow is backed by large pages.
+  bool large_pages() const { return large_pages_; }
+
+  // @returns true if the shadow of the shadow memory itself and of the page
+  //     bits array has been poisoned by SetUp.
+  bool self_poisoned() const { return self_poisoned_; }
+
   // Read only accessor of page protection bits.
   const uint8_t* page_bits() const { return page_bits_; }
 
@@ -293,7 +330,8 @@ class Shadow {
 
   // Determines if the shadow memory is clean. That is, it reflects the
   // state of shadow memory immediately after construction and a call to
-  // SetUp.
+  // SetUp. This takes into account whether SetUp poisoned the shadow of the
+  // shadow memory, see self_poisoned().
   // @returns true if the shadow memory is clean (as it would appear directly
   //     after an initialization), false otherwise.
   bool IsClean() const;
@@ -313,7 +351,7 @@ class Shadow {
   virtual void GetPointerAndSizeImpl(void const** self, size_t* size) const;
 
   // Initializes this shadow object.
-  void Init(size_t length);
+  void Init(size_t length, CommitMode commit_mode);
   void Init(bool own_memory, void* shadow, size_t length);
 
   // Reset the shadow memory.
@@ -350,17 +388,36 @@ class Shadow {
       const void* addr,
       CompactBlockInfo* info) const;
 
+  // The number of shadow bytes that GetNullTerminatedArraySize scans at once.
+  // This bounds the amount of shadow that is inspected for short arrays.
+  static const size_t kNullTerminatedArrayScanLength = 64;
+
   // If this is true then this shadow object owns the memory.
   bool own_memory_;
 
+  // If this is true then the shadow and the page bits are sparse arrays whose
+  // pages are committed on demand (see ShadowExceptionHandler in the .cc
+  // file).
+  bool commit_on_demand_;
+
+  // If this is true then the shadow memory is committed in large pages.
+  bool large_pages_;
+
+  // If this is true then SetUp has poisoned the part of the shadow that
+  // covers the shadow memory and the page bits arrays. See SetUp.
+  bool self_poisoned_;
+
   // The actual shadow that is being referred to. In case of large
-  // address spaces it's stored as a sparse array
-  // (see ShadowExceptionHandler in the .cc file).
+  // address spaces, or when committing on demand, it's stored as a sparse
+  // array.
   uint8_t* shadow_;
 
   // The length of the underlying shadow.
   size_t length_;
 
+  // The kernel used to scan runs of shadow memory for poisoned bytes.
+  internal::FindFirstNonZeroByteFunction find_first_non_zero_byte_;
+
   // A lock under which page protection bits are modified.
   base::Lock page_bits_lock_;
 
@@ -373,10 +430,9 @@ class Shadow {
   // The length of page_bits_. Under page_bits_lock_.
   size_t page_bits_length_;
 
-#ifdef _WIN64
   // The exception handler handle to be able to remove it on object destruction.
+  // This is only set when committing on demand.
   HANDLE exception_handler_;
-#endif
 };
 
 // A helper class to walk over the blocks contained in a given memory region.
@@ -0,0 +1,153 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_fill.h"
+
+#include <emmintrin.h>
+
+#include "base/logging.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+// Ranges shorter than this are written a byte at a time, as aligning the
+// cursor would cost more than it saves.
+const size_t kWideFillThreshold = 2 * sizeof(__m128i);
+
+const uint64_t kFreedMarker64 = 0x0101010101010101ULL * kHeapFreedMarker;
+
+inline void Store64(uint8_t* cursor, uint64_t value) {
+  DCHECK(::common::IsAligned(cursor, sizeof(uint64_t)));
+  *reinterpret_cast<uint64_t*>(cursor) = value;
+}
+
+// Marks the given range of shadow bytes as freed, preserving left and right
+// redzone bytes. |cursor| and |cursor_end| must be 8-byte aligned.
+inline void MarkAsFreedImplAligned64(uint64_t* cursor, uint64_t* cursor_end) {
+  DCHECK(::common::IsAligned(cursor, sizeof(uint64_t)));
+  DCHECK(::common::IsAligned(cursor_end, sizeof(uint64_t)));
+
+  for (; cursor != cursor_end; ++cursor) {
+    // If the block of shadow memory is entirely green then mark as freed.
+    // Otherwise go check its contents byte by byte.
+    if (*cursor == 0) {
+      *cursor = kFreedMarker64;
+    } else {
+      MarkShadowAsFreedBytewise(reinterpret_cast<uint8_t*>(cursor),
+                                reinterpret_cast<uint8_t*>(cursor + 1));
+    }
+  }
+}
+
+}  // namespace
+
+void FillShadowBytewise(uint8_t* begin, uint8_t* end, uint8_t marker) {
+  DCHECK_LE(begin, end);
+  for (uint8_t* cursor = begin; cursor != end; ++cursor)
+    *cursor = marker;
+}
+
+void FillShadow(uint8_t* begin, uint8_t* end, uint8_t marker) {
+  DCHECK_LE(begin, end);
+
+  if (static_cast<size_t>(end - begin) < kWideFillThreshold) {
+    FillShadowBytewise(begin, end, marker);
+    return;
+  }
+
+  // Bring the cursor to a 16-byte boundary with byte and 8-byte stores.
+  const uint64_t marker64 = 0x0101010101010101ULL * marker;
+  uint8_t* cursor = ::common::AlignUp(begin, sizeof(uint64_t));
+  FillShadowBytewise(begin, cursor, marker);
+  if (!::common::IsAligned(cursor, sizeof(__m128i))) {
+    Store64(cursor, marker64);
+    cursor += sizeof(uint64_t);
+  }
+
+  // Write the interior with aligned 16-byte stores, 32 bytes per iteration.
+  const __m128i marker128 = _mm_set1_epi8(static_cast<char>(marker));
+  uint8_t* end_aligned = ::common::AlignDown(end, sizeof(__m128i));
+  DCHECK_LE(cursor, end_aligned);
+  for (; static_cast<size_t>(end_aligned - cursor) >= 2 * sizeof(__m128i);
+       cursor += 2 * sizeof(__m128i)) {
+    _mm_store_si128(reinterpret_cast<__m128i*>(cursor), marker128);
+    _mm_store_si128(reinterpret_cast<__m128i*>(cursor) + 1, marker128);
+  }
+  if (cursor != end_aligned) {
+    _mm_store_si128(reinterpret_cast<__m128i*>(cursor), marker128);
+    cursor += sizeof(__m128i);
+  }
+
+  // Finish the tail with an 8-byte store and byte stores.
+  if (static_cast<size_t>(end - cursor) >= sizeof(uint64_t)) {
+    Store64(cursor, marker64);
+    cursor += sizeof(uint64_t);
+  }
+  FillShadowBytewise(cursor, end, marker);
+}
+
+void MarkShadowAsFreedBytewise(uint8_t* begin, uint8_t* end) {
+  DCHECK_LE(begin, end);
+  for (uint8_t* cursor = begin; cursor != end; ++cursor) {
+    // Preserve block beginnings/ends/redzones as they were originally.
+    // This is necessary to preserve information about nested blocks.
+    if (ShadowMarkerHelper::IsActiveLeftRedzone(*cursor) ||
+        ShadowMarkerHelper::IsActiveRightRedzone(*cursor)) {
+      continue;
+    }
+
+    // Anything else gets marked as freed.
+    *cursor = kHeapFreedMarker;
+  }
+}
+
+void MarkShadowAsFreed(uint8_t* begin, uint8_t* end) {
+  DCHECK_LE(begin, end);
+
+  if (static_cast<size_t>(end - begin) < kWideFillThreshold) {
+    MarkShadowAsFreedBytewise(begin, end);
+    return;
+  }
+
+  uint8_t* cursor = ::common::AlignUp(begin, sizeof(__m128i));
+  uint8_t* end_aligned = ::common::AlignDown(end, sizeof(__m128i));
+  MarkShadowAsFreedBytewise(begin, cursor);
+
+  // Runs of addressable shadow are overwritten 16 bytes at a time. Anything
+  // else may contain redzone markers of nested blocks, and is handled 8 bytes
+  // at a time so that the zero parts are still written wide.
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i freed128 = _mm_set1_epi8(static_cast<char>(kHeapFreedMarker));
+  for (; cursor != end_aligned; cursor += sizeof(__m128i)) {
+    __m128i* vector = reinterpret_cast<__m128i*>(cursor);
+    __m128i value = _mm_load_si128(vector);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(value, zero)) == 0xFFFF) {
+      _mm_store_si128(vector, freed128);
+    } else {
+      uint64_t* cursor64 = reinterpret_cast<uint64_t*>(cursor);
+      MarkAsFreedImplAligned64(cursor64, cursor64 + 2);
+    }
+  }
+
+  MarkShadowAsFreedBytewise(end_aligned, end);
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
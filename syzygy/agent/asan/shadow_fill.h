@@ -0,0 +1,48 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the routines used to write markers to ranges of shadow memory.
+// Every allocation and free goes through these, so the interior of a range is
+// written with aligned wide stores and only the unaligned edges are written a
+// byte at a time. Reference byte-wise implementations are provided for
+// testing and benchmarking.
+
+#ifndef SYZYGY_AGENT_ASAN_SHADOW_FILL_H_
+#define SYZYGY_AGENT_ASAN_SHADOW_FILL_H_
+
+#include <stdint.h>
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+// Fills the shadow bytes in [begin, end) with @p marker.
+// @param begin The first shadow byte to write.
+// @param end One past the last shadow byte to write.
+// @param marker The marker to write.
+void FillShadow(uint8_t* begin, uint8_t* end, uint8_t marker);
+void FillShadowBytewise(uint8_t* begin, uint8_t* end, uint8_t marker);
+
+// Marks the shadow bytes in [begin, end) as freed, preserving any active left
+// and right redzone markers so that nested blocks remain intact.
+// @param begin The first shadow byte to write.
+// @param end One past the last shadow byte to write.
+void MarkShadowAsFreed(uint8_t* begin, uint8_t* end);
+void MarkShadowAsFreedBytewise(uint8_t* begin, uint8_t* end);
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_SHADOW_FILL_H_
@@ -0,0 +1,103 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A micro-benchmark comparing the wide-store shadow fill routines with the
+// byte-wise loops, for the shadow of a range of block sizes. Prints the mean
+// number of cycles per call of each routine.
+
+#include <intrin.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+
+#include "syzygy/agent/asan/constants.h"
+#include "syzygy/agent/asan/shadow_fill.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+
+namespace {
+
+using agent::asan::internal::FillShadow;
+using agent::asan::internal::FillShadowBytewise;
+using agent::asan::internal::MarkShadowAsFreed;
+using agent::asan::internal::MarkShadowAsFreedBytewise;
+
+// The block sizes to benchmark. The shadow of a block is 1/kShadowRatio of
+// its size.
+const size_t kBlockSizes[] = {
+    64, 256, 1024, 4096, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+
+const size_t kMaxShadowSize = 1024 * 1024 / agent::asan::kShadowRatio;
+
+// The number of calls that are timed for each routine and block size.
+const size_t kIterations = 1000;
+
+// Offsets the start of the shadow range so that unaligned edges are
+// exercised, as they would be for blocks at arbitrary addresses.
+const size_t kShadowOffset = 3;
+
+void MemsetFill(uint8_t* begin, uint8_t* end, uint8_t marker) {
+  ::memset(begin, marker, end - begin);
+}
+
+typedef void (*FillFunction)(uint8_t* begin, uint8_t* end, uint8_t marker);
+typedef void (*MarkAsFreedFunction)(uint8_t* begin, uint8_t* end);
+
+double TimeFill(FillFunction fill, uint8_t* begin, size_t length) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < kIterations; ++i) {
+    uint64_t t0 = ::__rdtsc();
+    fill(begin, begin + length, agent::asan::kHeapLeftPaddingMarker);
+    uint64_t t1 = ::__rdtsc();
+    total += t1 - t0;
+  }
+  return static_cast<double>(total) / kIterations;
+}
+
+double TimeMarkAsFreed(MarkAsFreedFunction mark_as_freed,
+                       uint8_t* begin,
+                       size_t length) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < kIterations; ++i) {
+    // Reset the range to addressable memory, as it would be on a free.
+    ::memset(begin, agent::asan::kHeapAddressableMarker, length);
+    uint64_t t0 = ::__rdtsc();
+    mark_as_freed(begin, begin + length);
+    uint64_t t1 = ::__rdtsc();
+    total += t1 - t0;
+  }
+  return static_cast<double>(total) / kIterations;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::unique_ptr<uint8_t[]> buffer(
+      new uint8_t[kMaxShadowSize + kShadowOffset]);
+  uint8_t* shadow = buffer.get() + kShadowOffset;
+
+  ::printf("%10s %12s %12s %12s %12s %12s\n", "block", "bytewise",
+           "memset", "wide", "freed-byte", "freed-wide");
+  for (size_t block_size : kBlockSizes) {
+    size_t length = block_size / agent::asan::kShadowRatio;
+    ::printf("%10u %12.1f %12.1f %12.1f %12.1f %12.1f\n", block_size,
+             TimeFill(&FillShadowBytewise, shadow, length),
+             TimeFill(&MemsetFill, shadow, length),
+             TimeFill(&FillShadow, shadow, length),
+             TimeMarkAsFreed(&MarkShadowAsFreedBytewise, shadow, length),
+             TimeMarkAsFreed(&MarkShadowAsFreed, shadow, length));
+  }
+
+  return 0;
+}
@@ -0,0 +1,82 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_fill.h"
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+const size_t kBufSize = 160;
+const uint8_t kGuard = 0xCC;
+
+}  // namespace
+
+TEST(ShadowFillTest, FillShadow) {
+  ALIGNAS(16) uint8_t buf[kBufSize];
+  ALIGNAS(16) uint8_t expected[kBufSize];
+
+  // Test all (mod 16) head and tail alignments, for all lengths.
+  for (size_t i = 0; i < 16; ++i) {
+    for (size_t length = 0; length + i <= kBufSize; ++length) {
+      ::memset(buf, kGuard, kBufSize);
+      ::memset(expected, kGuard, kBufSize);
+
+      FillShadow(buf + i, buf + i + length, kHeapLeftPaddingMarker);
+      FillShadowBytewise(expected + i, expected + i + length,
+                         kHeapLeftPaddingMarker);
+      ASSERT_EQ(0, ::memcmp(expected, buf, kBufSize));
+    }
+  }
+}
+
+TEST(ShadowFillTest, MarkShadowAsFreed) {
+  ALIGNAS(16) uint8_t buf[kBufSize];
+  ALIGNAS(16) uint8_t expected[kBufSize];
+
+  // Build a shadow pattern with addressable runs interspersed with the
+  // redzones of nested blocks, which must be preserved.
+  uint8_t pattern[kBufSize] = {};
+  for (size_t i = 0; i < kBufSize; i += 37) {
+    pattern[i] = ShadowMarkerHelper::BuildBlockStart(true, 0);
+    if (i + 1 < kBufSize)
+      pattern[i + 1] = kHeapLeftPaddingMarker;
+    if (i + 20 < kBufSize)
+      pattern[i + 20] = kHeapRightPaddingMarker;
+    if (i + 21 < kBufSize)
+      pattern[i + 21] = 3;
+  }
+
+  for (size_t i = 0; i < 16; ++i) {
+    for (size_t length = 0; length + i <= kBufSize; ++length) {
+      ::memcpy(buf, pattern, kBufSize);
+      ::memcpy(expected, pattern, kBufSize);
+
+      MarkShadowAsFreed(buf + i, buf + i + length);
+      MarkShadowAsFreedBytewise(expected + i, expected + i + length);
+      ASSERT_EQ(0, ::memcmp(expected, buf, kBufSize));
+    }
+  }
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
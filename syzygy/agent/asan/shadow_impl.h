@@ -33,17 +33,37 @@ bool Shadow::GetNullTerminatedArraySize(const void* addr,
   if (index > length_)
     return false;
 
-  // Scan the input array 8 bytes at a time until we've found a NULL value or
-  // we've reached the end of an accessible memory block.
-  // TODO(sebmarchand): Look into doing this more efficiently.
-  while (true) {
-    uint8_t shadow = shadow_[index++];
+  // Scan the input array one run of accessible shadow at a time until we've
+  // found a NULL value or we've reached the end of an accessible memory
+  // block. Runs are bounded so that short arrays don't cause a large amount
+  // of shadow to be scanned.
+  while (index < length_) {
+    size_t run_length = length_ - index;
+    if (run_length > kNullTerminatedArrayScanLength)
+      run_length = kNullTerminatedArrayScanLength;
+    const uint8_t* run_begin = shadow_ + index;
+    const uint8_t* run_end = run_begin + run_length;
+    const uint8_t* cursor = find_first_non_zero_byte_(run_begin, run_end);
+
+    size_t count = (cursor - run_begin) * kShadowRatio / sizeof(type);
+    while (count-- > 0) {
+      (*size) += sizeof(type);
+      if (*size == max_size || *addr_value == 0)
+        return true;
+      addr_value++;
+    }
+
+    index = cursor - shadow_;
+    if (cursor == run_end)
+      continue;
+
+    // The run ends with a partially accessible or poisoned shadow byte.
+    uint8_t shadow = *cursor;
     if (ShadowMarkerHelper::IsRedzone(shadow))
       return false;
 
-    uint8_t max_index = shadow ? shadow : kShadowRatio;
-    DCHECK_EQ(0U, max_index % sizeof(type));
-    max_index /= sizeof(type);
+    DCHECK_EQ(0U, shadow % sizeof(type));
+    uint8_t max_index = shadow / sizeof(type);
     while (max_index-- > 0) {
       (*size) += sizeof(type);
       if (*size == max_size || *addr_value == 0)
@@ -51,9 +71,10 @@ bool Shadow::GetNullTerminatedArraySize(const void* addr,
       addr_value++;
     }
 
-    if (shadow != 0)
-      return false;
+    return false;
   }
+
+  return false;
 }
 
 namespace internal {
@@ -0,0 +1,163 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_scan.h"
+
+#include <immintrin.h>
+#include <intrin.h>
+
+#include "base/logging.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+// Finds the first non-zero byte in a range, one byte at a time.
+inline const uint8_t* FindFirstNonZeroByte8(const uint8_t* cursor,
+                                            const uint8_t* end) {
+  while (cursor != end && *cursor == 0)
+    ++cursor;
+  return cursor;
+}
+
+// Returns the position of the first set bit in a non-zero mask.
+inline size_t FirstSetBit(uint32_t mask) {
+  DCHECK_NE(0u, mask);
+  unsigned long index = 0;
+  ::_BitScanForward(&index, mask);
+  return index;
+}
+
+}  // namespace
+
+const uint8_t* FindFirstNonZeroByteScalar(const uint8_t* begin,
+                                          const uint8_t* end) {
+  DCHECK_LE(begin, end);
+
+  if (static_cast<size_t>(end - begin) < 2 * sizeof(uint64_t))
+    return FindFirstNonZeroByte8(begin, end);
+
+  // Scan the unaligned head, then 8 bytes at a time over the aligned
+  // interior, and finally locate the non-zero byte or scan the tail.
+  const uint8_t* cursor = ::common::AlignUp(begin, sizeof(uint64_t));
+  const uint8_t* head = FindFirstNonZeroByte8(begin, cursor);
+  if (head != cursor)
+    return head;
+
+  const uint8_t* end_aligned = ::common::AlignDown(end, sizeof(uint64_t));
+  while (cursor != end_aligned &&
+         *reinterpret_cast<const uint64_t*>(cursor) == 0) {
+    cursor += sizeof(uint64_t);
+  }
+
+  return FindFirstNonZeroByte8(cursor, end);
+}
+
+const uint8_t* FindFirstNonZeroByteSSE2(const uint8_t* begin,
+                                        const uint8_t* end) {
+  DCHECK_LE(begin, end);
+
+  const size_t kVectorSize = sizeof(__m128i);
+  const __m128i zero = _mm_setzero_si128();
+  const uint8_t* cursor = begin;
+
+  // Unaligned loads are used so that no bytes outside of the range are ever
+  // read. The shadow is sparsely committed on some platforms, so reading
+  // beyond the end of the range could fault.
+  while (static_cast<size_t>(end - cursor) >= kVectorSize) {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(value, zero));
+    if (mask != 0xFFFF)
+      return cursor + FirstSetBit(~mask & 0xFFFF);
+    cursor += kVectorSize;
+  }
+
+  return FindFirstNonZeroByte8(cursor, end);
+}
+
+const uint8_t* FindFirstNonZeroByteAVX2(const uint8_t* begin,
+                                        const uint8_t* end) {
+  DCHECK_LE(begin, end);
+
+  const size_t kVectorSize = sizeof(__m256i);
+  const __m256i zero = _mm256_setzero_si256();
+  const uint8_t* cursor = begin;
+  const uint8_t* result = nullptr;
+
+  while (static_cast<size_t>(end - cursor) >= kVectorSize) {
+    __m256i value = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(cursor));
+    uint32_t mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(value, zero)));
+    if (mask != 0xFFFFFFFF) {
+      result = cursor + FirstSetBit(~mask);
+      break;
+    }
+    cursor += kVectorSize;
+  }
+
+  // Avoid the AVX to SSE transition penalty in the caller.
+  _mm256_zeroupper();
+
+  if (result != nullptr)
+    return result;
+
+  // Finish off the remainder with at most one SSE2 iteration.
+  return FindFirstNonZeroByteSSE2(cursor, end);
+}
+
+bool CpuSupportsSSE2() {
+#ifdef _WIN64
+  // SSE2 is part of the x64 base instruction set.
+  return true;
+#else
+  int info[4] = {};
+  ::__cpuid(info, 1);
+  return (info[3] & (1 << 26)) != 0;
+#endif
+}
+
+bool CpuSupportsAVX2() {
+  int info[4] = {};
+  ::__cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // The CPU must support AVX and XSAVE, and the OS must have enabled saving
+  // of the XMM and YMM state.
+  ::__cpuid(info, 1);
+  const int kOsxsaveAndAvx = (1 << 27) | (1 << 28);
+  if ((info[2] & kOsxsaveAndAvx) != kOsxsaveAndAvx)
+    return false;
+  if ((::_xgetbv(0) & 0x6) != 0x6)
+    return false;
+
+  ::__cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+}
+
+FindFirstNonZeroByteFunction GetFindFirstNonZeroByteFunction() {
+  if (CpuSupportsAVX2())
+    return &FindFirstNonZeroByteAVX2;
+  if (CpuSupportsSSE2())
+    return &FindFirstNonZeroByteSSE2;
+  return &FindFirstNonZeroByteScalar;
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
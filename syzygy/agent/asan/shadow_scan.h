@@ -0,0 +1,58 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares kernels for scanning runs of shadow memory. These are used by the
+// range checks of the shadow, which are on the hot path of the CRT
+// interceptors. A scalar, an SSE2 and an AVX2 implementation are provided,
+// and the best one supported by the CPU is selected at runtime.
+
+#ifndef SYZYGY_AGENT_ASAN_SHADOW_SCAN_H_
+#define SYZYGY_AGENT_ASAN_SHADOW_SCAN_H_
+
+#include <stdint.h>
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+// The signature of a shadow scanning kernel.
+// @param begin The beginning of the range to scan.
+// @param end The end of the range to scan. No byte at or beyond this address
+//     is read.
+// @returns a pointer to the first non-zero byte in [begin, end), or @p end
+//     if all of the bytes in the range are zero.
+typedef const uint8_t* (*FindFirstNonZeroByteFunction)(const uint8_t* begin,
+                                                       const uint8_t* end);
+
+// The available kernels. The SSE2 and AVX2 variants must only be called if
+// the CPU (and for AVX2, the OS) supports the corresponding instruction set.
+const uint8_t* FindFirstNonZeroByteScalar(const uint8_t* begin,
+                                          const uint8_t* end);
+const uint8_t* FindFirstNonZeroByteSSE2(const uint8_t* begin,
+                                        const uint8_t* end);
+const uint8_t* FindFirstNonZeroByteAVX2(const uint8_t* begin,
+                                        const uint8_t* end);
+
+// @returns true if the SSE2 and AVX2 kernels may be used on this machine.
+bool CpuSupportsSSE2();
+bool CpuSupportsAVX2();
+
+// @returns the fastest kernel supported by this machine.
+FindFirstNonZeroByteFunction GetFindFirstNonZeroByteFunction();
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_SHADOW_SCAN_H_
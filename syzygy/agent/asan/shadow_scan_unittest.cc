@@ -0,0 +1,120 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_scan.h"
+
+#include <intrin.h>
+#include <string.h>
+
+#include "base/strings/stringprintf.h"
+#include "gtest/gtest.h"
+#include "syzygy/testing/metrics.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+// Checks a kernel against all head and tail alignments, and against a
+// non-zero byte at each position of the range.
+void TestKernel(FindFirstNonZeroByteFunction kernel) {
+  const size_t kBufSize = 192;
+  ALIGNAS(32) uint8_t buf[kBufSize] = {};
+  uint8_t* end = buf + kBufSize;
+
+  for (size_t i = 0; i < 32; ++i) {
+    for (size_t j = 0; j < 32; ++j) {
+      // Poison the bytes outside of the range to ensure they're never read as
+      // part of the result.
+      ::memset(buf, 0xCC, i);
+      ::memset(buf + i, 0, kBufSize - i - j);
+      ::memset(end - j, 0xCC, j);
+
+      ASSERT_EQ(end - j, kernel(buf + i, end - j));
+
+      for (size_t k = i; k < kBufSize - j; ++k) {
+        buf[k] = 1;
+        ASSERT_EQ(buf + k, kernel(buf + i, end - j));
+        // A second non-zero byte further along must not change the result.
+        if (k + 1 < kBufSize - j) {
+          buf[k + 1] = 0xF0;
+          ASSERT_EQ(buf + k, kernel(buf + i, end - j));
+          buf[k + 1] = 0;
+        }
+        buf[k] = 0;
+      }
+    }
+  }
+
+  // Empty and tiny ranges.
+  EXPECT_EQ(buf, kernel(buf, buf));
+  buf[0] = 0;
+  EXPECT_EQ(buf + 1, kernel(buf, buf + 1));
+}
+
+void KernelPerfTest(FindFirstNonZeroByteFunction kernel, const char* name) {
+  const size_t kBufSize = 10240;
+  ALIGNAS(32) uint8_t buf[kBufSize] = {};
+
+  uint64_t tnet = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    uint64_t t0 = ::__rdtsc();
+    ASSERT_EQ(buf + kBufSize, kernel(buf + i, buf + kBufSize));
+    uint64_t t1 = ::__rdtsc();
+    tnet += t1 - t0;
+  }
+
+  testing::EmitMetric(
+      base::StringPrintf("Syzygy.Asan.ShadowScan.FindFirstNonZeroByte.%s",
+                         name),
+      tnet);
+}
+
+}  // namespace
+
+TEST(ShadowScanTest, Scalar) {
+  TestKernel(&FindFirstNonZeroByteScalar);
+  KernelPerfTest(&FindFirstNonZeroByteScalar, "Scalar");
+}
+
+TEST(ShadowScanTest, SSE2) {
+  if (!CpuSupportsSSE2())
+    return;
+  TestKernel(&FindFirstNonZeroByteSSE2);
+  KernelPerfTest(&FindFirstNonZeroByteSSE2, "SSE2");
+}
+
+TEST(ShadowScanTest, AVX2) {
+  if (!CpuSupportsAVX2())
+    return;
+  TestKernel(&FindFirstNonZeroByteAVX2);
+  KernelPerfTest(&FindFirstNonZeroByteAVX2, "AVX2");
+}
+
+TEST(ShadowScanTest, GetFindFirstNonZeroByteFunction) {
+  FindFirstNonZeroByteFunction kernel = GetFindFirstNonZeroByteFunction();
+  ASSERT_NE(static_cast<FindFirstNonZeroByteFunction>(nullptr), kernel);
+  if (CpuSupportsAVX2()) {
+    EXPECT_EQ(&FindFirstNonZeroByteAVX2, kernel);
+  } else if (CpuSupportsSSE2()) {
+    EXPECT_EQ(&FindFirstNonZeroByteSSE2, kernel);
+  } else {
+    EXPECT_EQ(&FindFirstNonZeroByteScalar, kernel);
+  }
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
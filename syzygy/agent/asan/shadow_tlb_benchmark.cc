@@ -0,0 +1,105 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A micro-benchmark measuring the cost of the TLB misses of the instrumented
+// accesses. Each access checks the shadow of a random address of a large
+// buffer, as an ASan probe does, and then reads it, so that it touches both
+// an application page and a shadow page. The accesses are timed with a
+// shadow in small pages and with one in large pages. Prints the mean number
+// of cycles per access of each. Run it under a hardware counter profiler to
+// read the dTLB misses themselves. Large pages need the SeLockMemoryPrivilege
+// ("Lock pages in memory"), without which only small pages are measured.
+
+#include <intrin.h>
+#include <stdio.h>
+
+#include <memory>
+#include <vector>
+
+#include "syzygy/agent/asan/shadow.h"
+
+namespace {
+
+using agent::asan::Shadow;
+
+// The size of the buffer that is accessed. Its shadow spans many pages.
+const size_t kBufferSize = 256 * 1024 * 1024;
+
+// The number of timed accesses.
+const size_t kAccesses = 4 * 1024 * 1024;
+
+// Receives the sum of the bytes read, so that the reads aren't optimized
+// away.
+volatile uint32_t checksum = 0;
+
+// Generates the offsets of the accesses with a linear congruential generator,
+// outside of the timed loop.
+void GenerateOffsets(std::vector<uint32_t>* offsets) {
+  uint32_t state = 12345;
+  offsets->resize(kAccesses);
+  for (size_t i = 0; i < kAccesses; ++i) {
+    state = state * 1664525 + 1013904223;
+    (*offsets)[i] = state % kBufferSize;
+  }
+}
+
+// Times the accesses with a given shadow.
+// @param shadow The shadow to check.
+// @param buffer The buffer to access.
+// @param offsets The offsets of the accesses in @p buffer.
+// @returns the mean number of cycles per access.
+double TimeAccesses(const Shadow& shadow,
+                    const uint8_t* buffer,
+                    const std::vector<uint32_t>& offsets) {
+  uint32_t sum = 0;
+  uint64_t t0 = ::__rdtsc();
+  for (uint32_t offset : offsets) {
+    const uint8_t* addr = buffer + offset;
+    if (shadow.IsAccessible(addr))
+      sum += *addr;
+  }
+  uint64_t t1 = ::__rdtsc();
+  checksum += sum;
+  return static_cast<double>(t1 - t0) / offsets.size();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[kBufferSize]());
+  std::vector<uint32_t> offsets;
+  GenerateOffsets(&offsets);
+
+  ::printf("%12s %12s\n", "pages", "cycles");
+  const Shadow::CommitMode kModes[] = {Shadow::kCommitUpFront,
+                                       Shadow::kCommitLargePages};
+  for (Shadow::CommitMode mode : kModes) {
+    Shadow shadow(Shadow::RequiredLength(), mode);
+    if (shadow.shadow() == nullptr) {
+      ::printf("Failed to allocate the shadow.\n");
+      return 1;
+    }
+    if (mode == Shadow::kCommitLargePages && !shadow.large_pages()) {
+      ::printf("Large pages are unavailable.\n");
+      break;
+    }
+
+    // A first pass faults in the pages of the shadow and of the buffer.
+    TimeAccesses(shadow, buffer.get(), offsets);
+    ::printf("%12s %12.1f\n", shadow.large_pages() ? "large" : "small",
+             TimeAccesses(shadow, buffer.get(), offsets));
+  }
+
+  return 0;
+}
@@ -149,13 +149,15 @@ TEST_F(ShadowTest, SetUpAndTearDown) {
 
   test_shadow.SetUp();
 
-// For large address spaces, the shadow memory is too large to be poisoned.
+  // The shadow allocated by the object is left as fresh zero pages.
+  EXPECT_FALSE(test_shadow.self_poisoned());
+// For large address spaces, the shadow memory is too sparse to be scanned.
 #ifndef _WIN64
   intptr_t shadow_array_start = reinterpret_cast<intptr_t>(test_shadow.shadow_);
   size_t shadow_start = shadow_array_start >> 3;
   size_t shadow_end = shadow_start + (test_shadow.length() >> 3);
   for (size_t i = shadow_start; i < shadow_end; i += kLookupInterval)
-    ASSERT_EQ(kAsanMemoryMarker, test_shadow.shadow_[i]);
+    ASSERT_EQ(kHeapAddressableMarker, test_shadow.shadow_[i]);
 #endif
 
   for (size_t i = 0; i < non_addressable_memory_end; i += kLookupInterval)
@@ -163,14 +165,89 @@ TEST_F(ShadowTest, SetUpAndTearDown) {
 
   test_shadow.TearDown();
 
+  for (size_t i = 0; i < non_addressable_memory_end; i += kLookupInterval)
+    ASSERT_EQ(kHeapAddressableMarker, test_shadow.shadow_[i]);
+}
+
 // For large address spaces, the shadow memory is too large to be poisoned.
 #ifndef _WIN64
-  for (size_t i = shadow_start; i < shadow_end; i += kLookupInterval)
-    ASSERT_EQ(kHeapAddressableMarker, test_shadow.shadow_[i]);
+TEST_F(ShadowTest, SetUpPoisonsProvidedShadow) {
+  const size_t kLookupInterval = 25;
+
+  size_t length = Shadow::RequiredLength();
+  void* memory = ::VirtualAlloc(nullptr, length, MEM_COMMIT, PAGE_READWRITE);
+  ASSERT_NE(static_cast<void*>(nullptr), memory);
+  {
+    TestShadow shadow(memory, length);
+    shadow.SetUp();
+    EXPECT_TRUE(shadow.self_poisoned());
+
+    size_t shadow_start = reinterpret_cast<uintptr_t>(memory) >> 3;
+    size_t shadow_end = shadow_start + (length >> 3);
+    for (size_t i = shadow_start; i < shadow_end; i += kLookupInterval)
+      ASSERT_EQ(kAsanMemoryMarker, shadow.shadow_[i]);
+
+    shadow.TearDown();
+    EXPECT_FALSE(shadow.self_poisoned());
+    for (size_t i = shadow_start; i < shadow_end; i += kLookupInterval)
+      ASSERT_EQ(kHeapAddressableMarker, shadow.shadow_[i]);
+  }
+  EXPECT_TRUE(::VirtualFree(memory, 0, MEM_RELEASE));
+}
 #endif
 
-  for (size_t i = 0; i < non_addressable_memory_end; i += kLookupInterval)
-    ASSERT_EQ(kHeapAddressableMarker, test_shadow.shadow_[i]);
+TEST_F(ShadowTest, CommitOnDemand) {
+  Shadow shadow(Shadow::RequiredLength(), Shadow::kCommitOnDemand);
+  ASSERT_NE(static_cast<const uint8_t*>(nullptr), shadow.shadow());
+  EXPECT_TRUE(shadow.commit_on_demand());
+  shadow.SetUp();
+
+  // Pick a range of memory whose shadow lies on its own shadow page.
+  const size_t kPageSize = GetPageSize();
+  const uint8_t* addr = reinterpret_cast<const uint8_t*>(
+      ::common::AlignUp(Shadow::kAddressLowerBound + 1024 * 1024,
+                        kPageSize * kShadowRatio));
+  const uint8_t* addr_shadow = shadow.GetShadowMemoryForAddress(addr);
+
+  // The shadow for this range has not been committed yet.
+  MEMORY_BASIC_INFORMATION info = {};
+  ASSERT_NE(0u, ::VirtualQuery(addr_shadow, &info, sizeof(info)));
+  EXPECT_NE(static_cast<DWORD>(MEM_COMMIT), info.State);
+
+  // Poisoning the range commits its shadow.
+  shadow.Poison(addr, kShadowRatio, kAsanReservedMarker);
+  ASSERT_NE(0u, ::VirtualQuery(addr_shadow, &info, sizeof(info)));
+  EXPECT_EQ(static_cast<DWORD>(MEM_COMMIT), info.State);
+  EXPECT_FALSE(shadow.IsAccessible(addr));
+  shadow.Unpoison(addr, kShadowRatio);
+
+  shadow.TearDown();
+}
+
+TEST_F(ShadowTest, CommitLargePages) {
+  Shadow shadow(Shadow::RequiredLength(), Shadow::kCommitLargePages);
+  ASSERT_NE(static_cast<const uint8_t*>(nullptr), shadow.shadow());
+  shadow.SetUp();
+
+  // Large pages need a privilege that the tests usually don't hold, in which
+  // case the shadow falls back to small pages. It works the same either way.
+  if (!shadow.commit_on_demand()) {
+    MEMORY_BASIC_INFORMATION info = {};
+    ASSERT_NE(0u, ::VirtualQuery(shadow.shadow(), &info, sizeof(info)));
+    EXPECT_EQ(static_cast<DWORD>(MEM_COMMIT), info.State);
+  } else {
+    EXPECT_FALSE(shadow.large_pages());
+  }
+
+  const uint8_t* addr = reinterpret_cast<const uint8_t*>(
+      ::common::AlignUp(Shadow::kAddressLowerBound + 1024 * 1024,
+                        kShadowRatio));
+  shadow.Poison(addr, kShadowRatio, kAsanReservedMarker);
+  EXPECT_FALSE(shadow.IsAccessible(addr));
+  shadow.Unpoison(addr, kShadowRatio);
+  EXPECT_TRUE(shadow.IsAccessible(addr));
+
+  shadow.TearDown();
 }
 
 namespace {
@@ -335,6 +412,51 @@ TEST_F(ShadowTest, FindFirstPoisonedByte) {
   test_shadow.Unpoison(aligned_test_array, aligned_array_length);
 }
 
+TEST_F(ShadowTest, LargeRangeChecks) {
+  // SetUp selects the vectorized scanning kernel, if available.
+  test_shadow.SetUp();
+
+  const size_t kBufferSize = 16 * 1024;
+  std::unique_ptr<uint8_t[]> buffer(
+      new uint8_t[kBufferSize + 2 * kShadowRatio]);
+  uint8_t* array = ::common::AlignUp(buffer.get(), kShadowRatio);
+  ::memset(array, 0xAA, kBufferSize);
+  test_shadow.Unpoison(array, kBufferSize);
+  test_shadow.Poison(array + kBufferSize, kShadowRatio, kAsanReservedMarker);
+
+  EXPECT_TRUE(test_shadow.IsRangeAccessible(array, kBufferSize));
+  EXPECT_TRUE(test_shadow.IsRangeAccessible(array + 3, kBufferSize - 5));
+  EXPECT_EQ(nullptr, test_shadow.FindFirstPoisonedByte(array, kBufferSize));
+
+  // Poison a single group of bytes at various positions in the buffer.
+  for (size_t offset = 0; offset < kBufferSize; offset += 1000 * kShadowRatio) {
+    test_shadow.Poison(array + offset, kShadowRatio, kAsanReservedMarker);
+    EXPECT_FALSE(test_shadow.IsRangeAccessible(array, kBufferSize));
+    EXPECT_EQ(array + offset,
+              test_shadow.FindFirstPoisonedByte(array, kBufferSize));
+    if (offset > 0) {
+      EXPECT_TRUE(test_shadow.IsRangeAccessible(array, offset));
+      EXPECT_EQ(nullptr, test_shadow.FindFirstPoisonedByte(array, offset));
+    }
+    test_shadow.Unpoison(array + offset, kShadowRatio);
+  }
+
+  // A long string spanning many scan runs.
+  size_t size = 0;
+  array[kBufferSize - 10] = 0;
+  EXPECT_TRUE(test_shadow.GetNullTerminatedArraySize<uint8_t>(
+      array, 0U, &size));
+  EXPECT_EQ(kBufferSize - 9, size);
+  array[kBufferSize - 10] = 0xAA;
+  EXPECT_FALSE(test_shadow.GetNullTerminatedArraySize<uint8_t>(
+      array, 0U, &size));
+
+  EXPECT_EQ(kBufferSize, size);
+
+  test_shadow.Unpoison(array + kBufferSize, kShadowRatio);
+  test_shadow.TearDown();
+}
+
 TEST_F(ShadowTest, MarkAsFreed) {
   BlockLayout l0 = {}, l1 = {};
   EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 16, 30, 30, &l1));
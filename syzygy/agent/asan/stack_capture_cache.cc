@@ -19,6 +19,7 @@
 #include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/agent/asan/lock_profiler.h"
 #include "syzygy/agent/asan/logger.h"
 #include "syzygy/agent/asan/memory_notifier.h"
 #include "syzygy/agent/common/stack_capture.h"
@@ -32,16 +33,34 @@ namespace {
 static base::LazyInstance<common::StackCapture> g_empty_stack_capture =
     LAZY_INSTANCE_INITIALIZER;
 
+class PrivateStackCapture : public common::StackCapture {
+ public:
+  // Expose the actual number of frames. We use this to make reclaimed
+  // stack captures look invalid when they're in a free list.
+  using common::StackCapture::num_frames_;
+  // Expose the storage of the frames, which is opaque for compact stack
+  // captures.
+  using common::StackCapture::frames_;
+};
+
 // Gives us access to the first frame of a stack capture as link-list pointer.
 common::StackCapture** GetFirstFrameAsLink(
     common::StackCapture* stack_capture) {
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
+  DCHECK_LT(0u, stack_capture->max_num_frames());
   common::StackCapture** link = reinterpret_cast<common::StackCapture**>(
-      const_cast<void**>(stack_capture->frames()));
+      reinterpret_cast<PrivateStackCapture*>(stack_capture)->frames_);
   DCHECK_NE(static_cast<common::StackCapture**>(nullptr), link);
   return link;
 }
 
+// @returns the number of frame pointers physically used by a stack capture.
+size_t GetStoredFrames(const common::StackCapture* stack_capture) {
+  if (stack_capture->compact())
+    return stack_capture->max_num_frames();
+  return stack_capture->num_frames();
+}
+
 }  // namespace
 
 size_t StackCaptureCache::compression_reporting_period_ =
@@ -110,11 +129,17 @@ StackCaptureCache::StackCaptureCache(
     : logger_(logger),
       memory_notifier_(memory_notifier),
       max_num_frames_(common::StackCapture::kMaxNumFrames),
+      compact_stack_captures_(false),
+      known_stacks_index_(nullptr),
       current_page_(nullptr) {
   DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
 
-  AllocateCachePage();
+  // The index and the first page are reported to the notifier together.
+  MemoryNotificationBatch notifications(memory_notifier_);
+  AllocateKnownStacksIndex(&notifications);
+  AllocateCachePage(&notifications);
+  notifications.Flush();
 
   ::memset(&statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
@@ -127,6 +152,8 @@ StackCaptureCache::StackCaptureCache(
     : logger_(logger),
       memory_notifier_(memory_notifier),
       max_num_frames_(0),
+      compact_stack_captures_(false),
+      known_stacks_index_(nullptr),
       current_page_(nullptr) {
   DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
@@ -134,25 +161,47 @@ StackCaptureCache::StackCaptureCache(
   max_num_frames_ = static_cast<uint8_t>(
       std::min(max_num_frames, common::StackCapture::kMaxNumFrames));
 
-  AllocateCachePage();
+  // The index and the first page are reported to the notifier together.
+  MemoryNotificationBatch notifications(memory_notifier_);
+  AllocateKnownStacksIndex(&notifications);
+  AllocateCachePage(&notifications);
+  notifications.Flush();
   ::memset(&statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
   statistics_.size = sizeof(CachePage);
 }
 
 StackCaptureCache::~StackCaptureCache() {
+  // Report the pages and the index as returned to the OS in a single batch,
+  // which coalesces the ones that were allocated contiguously. This is done
+  // before freeing them, so that the notifications can't race with another
+  // use of the same addresses.
+  size_t index_size = sizeof(KnownStackIndexEntry) * kKnownStacksIndexSize;
+  {
+    MemoryNotificationBatch notifications(memory_notifier_);
+    for (CachePage* page = current_page_; page != nullptr;
+         page = page->next_page_) {
+      notifications.NotifyReturnedToOS(page, sizeof(*page));
+    }
+    if (known_stacks_index_ != nullptr)
+      notifications.NotifyReturnedToOS(known_stacks_index_, index_size);
+  }
+
   // Clean up the linked list of cache pages.
   while (current_page_ != nullptr) {
     CachePage* page = current_page_;
     current_page_ = page->next_page_;
     page->next_page_ = nullptr;
 
-    memory_notifier_->NotifyReturnedToOS(page, sizeof(*page));
-
     // This should have been allocated by VirtuaAlloc, so should be aligned.
     DCHECK(::common::IsAligned(page, GetPageSize()));
     CHECK_EQ(TRUE, ::VirtualFree(page, 0, MEM_RELEASE));
   }
+
+  if (known_stacks_index_ != nullptr) {
+    CHECK_EQ(TRUE, ::VirtualFree(known_stacks_index_, 0, MEM_RELEASE));
+    known_stacks_index_ = nullptr;
+  }
 }
 
 void StackCaptureCache::Init() {
@@ -177,11 +226,17 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
   common::StackCapture* stack_trace = nullptr;
   bool saturated = false;
 
-  {
+  // The common case is for the stack to already be known, in which case it is
+  // found and referenced without taking any lock.
+  stack_trace = TryReferenceKnownStack(absolute_stack_id, &saturated);
+  if (stack_trace != nullptr) {
+    already_cached = true;
+  } else {
     size_t known_stack_shard = absolute_stack_id % kKnownStacksSharding;
     // Get or insert the current stack trace while under the lock for this
     // bucket.
-    base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
+    ProfiledAutoLock auto_lock(kKnownStacksLockSite,
+                               &known_stacks_locks_[known_stack_shard]);
 
     // Check if the stack capture is already in the cache map.
     StackMap::iterator result =
@@ -190,9 +245,28 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
     // If this capture has not already been cached then we have to initialize
     // the data.
     if (result == known_stacks_[known_stack_shard].end()) {
-      stack_trace = GetStackCapture(num_frames);
-      DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
-      stack_trace->InitFromExistingStack(stack_capture);
+      // Compact stack captures are only used when they're actually smaller.
+      uint8_t encoded_frames[common::StackCapture::kMaxEncodedSize];
+      size_t encoded_size = 0;
+      if (compact_stack_captures_ && !stack_capture.fingerprint()) {
+        encoded_size = common::StackCapture::EncodeFrames(
+            frames, num_frames, encoded_frames);
+        if (encoded_size >= num_frames * sizeof(void*))
+          encoded_size = 0;
+      }
+
+      if (encoded_size != 0) {
+        size_t encoded_num_frames =
+            (encoded_size + sizeof(void*) - 1) / sizeof(void*);
+        stack_trace = GetStackCapture(encoded_num_frames);
+        DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
+        stack_trace->InitFromEncodedFrames(encoded_frames, encoded_size,
+                                           num_frames, absolute_stack_id);
+      } else {
+        stack_trace = GetStackCapture(num_frames);
+        DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
+        stack_trace->InitFromExistingStack(stack_capture);
+      }
       auto result = known_stacks_[known_stack_shard].insert(
           std::make_pair(absolute_stack_id, stack_trace));
       DCHECK(result.second);
@@ -208,6 +282,19 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
     } else {
       saturated = true;
     }
+
+    // Publish newly cached stacks to the lock-free index. This is done after
+    // the reference is taken so that lock-free lookups never see it
+    // unreferenced.
+    if (!already_cached) {
+      KnownStackIndexEntry* entry =
+          FindKnownStackIndexEntry(absolute_stack_id, true);
+      if (entry != nullptr) {
+        ::InterlockedExchangePointer(
+            reinterpret_cast<void* volatile*>(&entry->stack_capture),
+            stack_trace);
+      }
+    }
   }
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
 
@@ -225,7 +312,7 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
       }
     } else {
       ++statistics_.cached;
-      statistics_.frames_alive += num_frames;
+      statistics_.frames_alive += GetStoredFrames(stack_trace);
       ++statistics_.allocated;
     }
     if (!saturated && stack_trace->RefCountIsSaturated()) {
@@ -257,28 +344,10 @@ void StackCaptureCache::ReleaseStackTrace(
     return;
   }
 
-  size_t known_stack_shard =
-      stack_capture->absolute_stack_id() % kKnownStacksSharding;
-  bool add_to_reclaimed_list = false;
-  common::StackCapture* stack = nullptr;
-  {
-    base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
-
-    // We own the stack so its fine to remove the const. We double check this
-    // is the case in debug builds with the DCHECK.
-    stack = const_cast<common::StackCapture*>(stack_capture);
-
-    stack->RemoveRef();
-
-    if (stack->HasNoRefs()) {
-      add_to_reclaimed_list = true;
-      // Remove this from the known stacks as we're going to reclaim it and
-      // overwrite part of its data as we insert into the reclaimed_ list.
-      size_t num_erased = known_stacks_[known_stack_shard].erase(
-          stack_capture->absolute_stack_id());
-      DCHECK_EQ(num_erased, 1u);
-    }
-  }
+  // We own the stack so its fine to remove the const.
+  common::StackCapture* stack =
+      const_cast<common::StackCapture*>(stack_capture);
+  bool add_to_reclaimed_list = RemoveReference(stack);
 
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
@@ -290,7 +359,7 @@ void StackCaptureCache::ReleaseStackTrace(
       --statistics_.cached;
       ++statistics_.unreferenced;
       // The frames in this stack capture are no longer alive.
-      statistics_.frames_alive -= stack->num_frames();
+      statistics_.frames_alive -= GetStoredFrames(stack);
     }
   }
 
@@ -301,6 +370,128 @@ void StackCaptureCache::ReleaseStackTrace(
     AddStackCaptureToReclaimedList(stack);
 }
 
+bool StackCaptureCache::RemoveReference(common::StackCapture* stack) {
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack);
+
+  // Dropping a reference that isn't the last one requires no lock, as the
+  // stack stays in the cache.
+  if (stack->TryRemoveRefIfNotLast())
+    return false;
+
+  size_t known_stack_shard = stack->absolute_stack_id() % kKnownStacksSharding;
+  ProfiledAutoLock auto_lock(kKnownStacksLockSite,
+                             &known_stacks_locks_[known_stack_shard]);
+
+  stack->RemoveRef();
+  if (!stack->HasNoRefs())
+    return false;
+
+  // Unpublish the stack from the lock-free index. Lock-free lookups that
+  // already read the pointer will fail to reference it as it has no
+  // references.
+  KnownStackIndexEntry* entry =
+      FindKnownStackIndexEntry(stack->absolute_stack_id(), false);
+  if (entry != nullptr && entry->stack_capture == stack) {
+    ::InterlockedExchangePointer(
+        reinterpret_cast<void* volatile*>(&entry->stack_capture), nullptr);
+  }
+
+  // Remove this from the known stacks as we're going to reclaim it and
+  // overwrite part of its data as we insert into the reclaimed_ list.
+  size_t num_erased =
+      known_stacks_[known_stack_shard].erase(stack->absolute_stack_id());
+  DCHECK_EQ(num_erased, 1u);
+  return true;
+}
+
+void StackCaptureCache::AllocateKnownStacksIndex(
+    MemoryNotificationBatch* notifications) {
+  DCHECK_NE(static_cast<MemoryNotificationBatch*>(nullptr), notifications);
+  DCHECK_EQ(static_cast<KnownStackIndexEntry*>(nullptr), known_stacks_index_);
+  size_t index_size = sizeof(KnownStackIndexEntry) * kKnownStacksIndexSize;
+  void* index = ::VirtualAlloc(nullptr, index_size, MEM_COMMIT,
+                               PAGE_READWRITE);
+  CHECK_NE(static_cast<void*>(nullptr), index);
+
+  // VirtualAlloc returns zeroed memory, which corresponds to empty entries.
+  known_stacks_index_ = reinterpret_cast<KnownStackIndexEntry*>(index);
+  notifications->NotifyInternalUse(index, index_size);
+}
+
+StackCaptureCache::KnownStackIndexEntry*
+StackCaptureCache::FindKnownStackIndexEntry(StackId stack_id, bool claim) {
+  DCHECK_NE(static_cast<KnownStackIndexEntry*>(nullptr), known_stacks_index_);
+
+  // Zero is used to mark empty entries so can't be indexed.
+  if (stack_id == 0)
+    return nullptr;
+
+  // Stack IDs are hashes, but are mixed further so that IDs differing only in
+  // their high bits don't collide.
+  uint32_t hash = static_cast<uint32_t>(stack_id) * 2654435761U;
+  size_t index = hash >> (32 - kKnownStacksIndexBits);
+  LONG key = static_cast<LONG>(stack_id);
+
+  for (size_t probe = 0; probe < kKnownStacksIndexMaxProbes; ++probe) {
+    KnownStackIndexEntry* entry =
+        known_stacks_index_ + ((index + probe) & (kKnownStacksIndexSize - 1));
+    LONG entry_key = entry->stack_id;
+    if (entry_key == key)
+      return entry;
+    if (entry_key != 0)
+      continue;
+
+    // Keys are claimed in probe order and never released, so an empty entry
+    // means that the stack ID isn't present.
+    if (!claim)
+      return nullptr;
+    entry_key = ::InterlockedCompareExchange(&entry->stack_id, key, 0);
+    if (entry_key == 0 || entry_key == key)
+      return entry;
+
+    // Another stack ID claimed this entry first, keep probing.
+  }
+
+  return nullptr;
+}
+
+common::StackCapture* StackCaptureCache::TryReferenceKnownStack(
+    StackId stack_id, bool* saturated) {
+  DCHECK_NE(static_cast<bool*>(nullptr), saturated);
+
+  KnownStackIndexEntry* entry = FindKnownStackIndexEntry(stack_id, false);
+  if (entry == nullptr)
+    return nullptr;
+  common::StackCapture* stack = entry->stack_capture;
+  if (stack == nullptr)
+    return nullptr;
+
+  *saturated = stack->RefCountIsSaturated();
+  if (!stack->TryAddRefIfReferenced())
+    return nullptr;
+
+  // The stack capture may have been reclaimed and reused for a different stack
+  // between reading the pointer and referencing it. Stack captures are never
+  // returned to the OS so this is memory safe, but the reference must be
+  // dropped and the lookup done under lock.
+  if (stack->absolute_stack_id() != stack_id ||
+      entry->stack_capture != stack) {
+    if (RemoveReference(stack)) {
+      if (compression_reporting_period_ != 0) {
+        base::AutoLock stats_lock(stats_lock_);
+        --statistics_.cached;
+        ++statistics_.unreferenced;
+        statistics_.frames_alive -= GetStoredFrames(stack);
+      }
+      AddStackCaptureToReclaimedList(stack);
+    }
+    *saturated = false;
+    return nullptr;
+  }
+
+  return stack;
+}
+
 bool StackCaptureCache::StackCapturePointerIsValid(
     const common::StackCapture* stack_capture) {
   // All stack captures must have pointer alignment at least.
@@ -323,7 +514,9 @@ bool StackCaptureCache::StackCapturePointerIsValid(
     if (stack_capture_addr >= page->data() &&
         stack_capture_addr + kMinSize <= page_end &&
         stack_capture_addr + stack_capture->Size() <= page_end &&
-        stack_capture->num_frames() <= stack_capture->max_num_frames() &&
+        (stack_capture->compact() ||
+         stack_capture->num_frames() <= stack_capture->max_num_frames()) &&
+        stack_capture->num_frames() <= common::StackCapture::kMaxNumFrames &&
         stack_capture->max_num_frames() <=
             common::StackCapture::kMaxNumFrames) {
       return true;
@@ -343,16 +536,19 @@ void StackCaptureCache::RemoveObserver(Observer* obs) {
 
 void StackCaptureCache::LogStatistics()  {
   Statistics statistics = {};
-
-  {
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(&statistics);
-  }
-
+  GetStatistics(&statistics);
   LogStatisticsImpl(statistics);
 }
 
-void StackCaptureCache::AllocateCachePage() {
+void StackCaptureCache::GetStatistics(Statistics* statistics) {
+  DCHECK_NE(static_cast<Statistics*>(nullptr), statistics);
+  base::AutoLock auto_lock(stats_lock_);
+  GetStatisticsUnlocked(statistics);
+}
+
+void StackCaptureCache::AllocateCachePage(
+    MemoryNotificationBatch* notifications) {
+  DCHECK_NE(static_cast<MemoryNotificationBatch*>(nullptr), notifications);
   static_assert(sizeof(CachePage) % (64 * 1024) == 0,
                 "kCachePageSize should be a multiple of the system allocation "
                 "granularity.");
@@ -363,7 +559,7 @@ void StackCaptureCache::AllocateCachePage() {
 
   // Use a placement new and notify the shadow memory.
   current_page_ = CachePage::CreateInPlace(new_page, current_page_);
-  memory_notifier_->NotifyInternalUse(new_page, sizeof(CachePage));
+  notifications->NotifyInternalUse(new_page, sizeof(CachePage));
 }
 
 void StackCaptureCache::GetStatisticsUnlocked(Statistics* statistics) const {
@@ -415,7 +611,7 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
   // First look to the reclaimed stacks and try to use one of those. We'll use
   // the first one that's big enough.
   for (size_t n = num_frames; n <= max_num_frames_; ++n) {
-    base::AutoLock lock(reclaimed_locks_[n]);
+    ProfiledAutoLock lock(kReclaimedStacksLockSite, &reclaimed_locks_[n]);
     if (reclaimed_[n] != nullptr) {
       common::StackCapture* reclaimed_stack_capture = reclaimed_[n];
       common::StackCapture** link =
@@ -464,7 +660,8 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
 
     // Allocate a new page (that links to the current page) and use it to
     // allocate a new stack capture.
-    AllocateCachePage();
+    MemoryNotificationBatch notifications(memory_notifier_);
+    AllocateCachePage(&notifications);
     CHECK_NE(static_cast<CachePage*>(nullptr), current_page_);
     statistics_.size += sizeof(CachePage);
     stack_capture = current_page_->GetNextStackCapture(num_frames);
@@ -485,17 +682,6 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
   return stack_capture;
 }
 
-namespace {
-
-class PrivateStackCapture : public common::StackCapture {
- public:
-  // Expose the actual number of frames. We use this to make reclaimed
-  // stack captures look invalid when they're in a free list.
-  using common::StackCapture::num_frames_;
-};
-
-}
-
 void StackCaptureCache::AddStackCaptureToReclaimedList(
     common::StackCapture* stack_capture) {
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
@@ -507,7 +693,9 @@ void StackCaptureCache::AddStackCaptureToReclaimedList(
       UINT8_MAX;
 
   {
-    base::AutoLock lock(reclaimed_locks_[stack_capture->max_num_frames()]);
+    ProfiledAutoLock lock(
+        kReclaimedStacksLockSite,
+        &reclaimed_locks_[stack_capture->max_num_frames()]);
 
     common::StackCapture** link = GetFirstFrameAsLink(stack_capture);
     size_t num_frames = stack_capture->max_num_frames();
@@ -15,6 +15,8 @@
 #ifndef SYZYGY_AGENT_ASAN_STACK_CAPTURE_CACHE_H_
 #define SYZYGY_AGENT_ASAN_STACK_CAPTURE_CACHE_H_
 
+#include <windows.h>
+
 #include <unordered_map>
 
 #include "base/observer_list.h"
@@ -76,6 +78,18 @@ class StackCaptureCache {
     max_num_frames_ = max_num_frames;
   }
 
+  // @returns true if new stack captures are stored in the compact encoding.
+  bool compact_stack_captures() const { return compact_stack_captures_; }
+
+  // Sets whether new stack captures are stored in the compact encoding. Their
+  // frames are then only decoded when they are inspected, which is usually
+  // when reporting an error. Stack captures whose encoding isn't smaller than
+  // their frames are stored as is.
+  // @param compact_stack_captures True to use the compact encoding.
+  void set_compact_stack_captures(bool compact_stack_captures) {
+    compact_stack_captures_ = compact_stack_captures;
+  }
+
   // @returns the default compression reporting period value.
   static size_t GetDefaultCompressionReportingPeriod() {
     return ::common::kDefaultReportingPeriod;
@@ -110,30 +124,6 @@ class StackCaptureCache {
   // safe.
   void LogStatistics();
 
-  // Checks if a StackCapture pointer seems to be valid. This only ensure that
-  // it point into a CachePage.
-  // @param stack_capture The pointer that we want to check.
-  // @returns true if the pointer is valid, false otherwise.
-  bool StackCapturePointerIsValid(const common::StackCapture* stack_capture);
-
-  // Observer that is notified when a new stack is saved.
-  class Observer {
-   public:
-    virtual void OnNewStack(common::StackCapture* new_stack) = 0;
-  };
-  // Adds an observer for this class. An observer should not be added more
-  // than once. The caller retains the ownership of the observer object.
-  // @param obs the observer to add.
-  void AddObserver(Observer* obs);
-  // Removes an observer.
-  // @param obs the observer to remove.
-  void RemoveObserver(Observer* obs);
-
- protected:
-  // The container type in which we store the cached stacks. This enforces
-  // uniqueness based on their hash value, nothing more.
-  typedef std::unordered_map<StackId, common::StackCapture*> StackMap;
-
   // Used for shuttling around statistics about this cache.
   struct Statistics {
     // The total number of stacks currently in the cache.
@@ -171,6 +161,7 @@ class StackCaptureCache {
     uint64_t frames_stored;
     // The total number of frames that are physically stored across all active
     // stack captures. This does not double count multiply-referenced captures.
+    // Compact stack captures count the frame pointers used by their encoding.
     uint64_t frames_alive;
     // The total number of frames in unreferenced stack captures. This is used
     // to figure out how much of our cache is actually dead.
@@ -178,8 +169,38 @@ class StackCaptureCache {
     // @}
   };
 
+  // Gets the current cache statistics. This method is thread safe.
+  // @param statistics Will be populated with current cache statistics.
+  void GetStatistics(Statistics* statistics);
+
+  // Checks if a StackCapture pointer seems to be valid. This only ensure that
+  // it point into a CachePage.
+  // @param stack_capture The pointer that we want to check.
+  // @returns true if the pointer is valid, false otherwise.
+  bool StackCapturePointerIsValid(const common::StackCapture* stack_capture);
+
+  // Observer that is notified when a new stack is saved.
+  class Observer {
+   public:
+    virtual void OnNewStack(common::StackCapture* new_stack) = 0;
+  };
+  // Adds an observer for this class. An observer should not be added more
+  // than once. The caller retains the ownership of the observer object.
+  // @param obs the observer to add.
+  void AddObserver(Observer* obs);
+  // Removes an observer.
+  // @param obs the observer to remove.
+  void RemoveObserver(Observer* obs);
+
+ protected:
+  // The container type in which we store the cached stacks. This enforces
+  // uniqueness based on their hash value, nothing more.
+  typedef std::unordered_map<StackId, common::StackCapture*> StackMap;
+
   // Allocates a CachePage.
-  void AllocateCachePage();
+  // @param notifications The batch to which the memory notification of the
+  //     page is added.
+  void AllocateCachePage(MemoryNotificationBatch* notifications);
 
   // Gets the current cache statistics. This must be called under lock_.
   // @param statistics Will be populated with current cache statistics.
@@ -200,9 +221,55 @@ class StackCaptureCache {
   // @param stack_capture The stack capture to be linked into reclaimed_.
   void AddStackCaptureToReclaimedList(common::StackCapture* stack_capture);
 
+  // An entry in the lock-free index of known stacks. The stack ID is claimed
+  // once with a CAS and is never released, so a stack ID always maps to the
+  // same entry. The stack capture pointer is published and cleared under the
+  // known_stacks_locks_ shard of the stack ID, but may be read without a lock.
+  struct KnownStackIndexEntry {
+    volatile LONG stack_id;
+    common::StackCapture* volatile stack_capture;
+  };
+
+  // Allocates the known stacks index.
+  // @param notifications The batch to which the memory notification of the
+  //     index is added.
+  void AllocateKnownStacksIndex(MemoryNotificationBatch* notifications);
+
+  // Finds the entry of the known stacks index associated with a stack ID.
+  // This is lock-free.
+  // @param stack_id The ID of the stack.
+  // @param claim If true then an empty entry will be claimed for the stack ID
+  //     if it isn't already present.
+  // @returns a pointer to the entry, or nullptr if the stack ID isn't present
+  //     and couldn't be claimed (or |claim| is false).
+  KnownStackIndexEntry* FindKnownStackIndexEntry(StackId stack_id, bool claim);
+
+  // Looks up a stack in the known stacks index and references it, without
+  // taking any lock. This only succeeds if the stack is already referenced.
+  // @param stack_id The ID of the stack to look up.
+  // @param saturated Will be set to true if the reference count of the stack
+  //     was already saturated.
+  // @returns a pointer to the referenced stack capture, or nullptr if the
+  //     stack must be looked up under lock.
+  common::StackCapture* TryReferenceKnownStack(StackId stack_id,
+                                               bool* saturated);
+
+  // Removes a reference to a stack, reclaiming it if this is the last
+  // reference. This does not update the statistics.
+  // @param stack The stack capture to dereference.
+  // @returns true if the stack capture was reclaimed, false otherwise.
+  bool RemoveReference(common::StackCapture* stack);
+
   // The default number of known stacks sets that we keep.
   static const size_t kKnownStacksSharding = 16;
 
+  // The size of the lock-free known stacks index, and the maximum number of
+  // entries probed for any given stack ID. Stacks that don't fit in the index
+  // are only found via the known_stacks_ maps.
+  static const size_t kKnownStacksIndexBits = 16;
+  static const size_t kKnownStacksIndexSize = 1 << kKnownStacksIndexBits;
+  static const size_t kKnownStacksIndexMaxProbes = 16;
+
   // The number of allocations between reports of the stack trace cache
   // compression ratio. Zero (0) means do not report. Values like 1 million
   // seem to be pretty good with Chrome.
@@ -221,9 +288,17 @@ class StackCaptureCache {
   // doesn't really make sense to do so.
   size_t max_num_frames_;
 
+  // Indicates if new stack captures are stored in the compact encoding.
+  bool compact_stack_captures_;
+
   // The maps of known stacks. Accessed under known_stacks_locks_.
   StackMap known_stacks_[kKnownStacksSharding];
 
+  // The lock-free index of known stacks. This allows the stacks that are
+  // already known to be referenced without taking any lock. This is allocated
+  // with VirtualAlloc and contains kKnownStacksIndexSize entries.
+  KnownStackIndexEntry* known_stacks_index_;
+
   // A lock protecting access to current_page_.
   base::Lock current_page_lock_;
 
@@ -15,6 +15,9 @@
 #include "syzygy/agent/asan/stack_capture_cache.h"
 
 #include <memory>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/logger.h"
 #include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
@@ -43,16 +46,12 @@ class TestStackCaptureCache : public StackCaptureCache {
       : StackCaptureCache(logger, &null_memory_notifier, max_num_frames) {
   }
 
-  using StackCaptureCache::Statistics;
+  CachePage* current_page() { return current_page_; }
 
-  void GetStatistics(Statistics* s) {
-    DCHECK(s != NULL);
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(s);
+  base::Lock& known_stacks_lock(StackId stack_id) {
+    return known_stacks_locks_[stack_id % kKnownStacksSharding];
   }
 
-  CachePage* current_page() { return current_page_; }
-
  private:
   using StackCaptureCache::current_page_;
 };
@@ -144,6 +143,53 @@ TEST_F(StackCaptureCacheTest, SaveStackTrace) {
   EXPECT_EQ(capture.num_frames(), s3->max_num_frames());
 }
 
+TEST_F(StackCaptureCacheTest, CompactStackCaptures) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  EXPECT_FALSE(cache.compact_stack_captures());
+  cache.set_compact_stack_captures(true);
+  EXPECT_TRUE(cache.compact_stack_captures());
+
+  // Frames that are close to each other in a module compress well.
+  uint8_t* module = reinterpret_cast<uint8_t*>(0x20000000);
+  StackCapture::AddFalseModule("foo.dll", module, 0x100000);
+  void* frames[StackCapture::kMaxNumFrames] = {};
+  for (size_t i = 0; i < arraysize(frames); ++i)
+    frames[i] = module + 0x8 + i * 0x10;
+  StackCapture capture;
+  capture.InitFromBuffer(frames, arraysize(frames));
+
+  const StackCapture* s1 = cache.SaveStackTrace(capture);
+  ASSERT_TRUE(s1 != NULL);
+  EXPECT_TRUE(s1->compact());
+  EXPECT_EQ(capture.num_frames(), s1->num_frames());
+  EXPECT_GT(s1->num_frames(), s1->max_num_frames());
+  EXPECT_EQ(capture.absolute_stack_id(), s1->absolute_stack_id());
+  EXPECT_TRUE(cache.StackCapturePointerIsValid(s1));
+
+  // The frames are decoded on demand.
+  void* decoded[StackCapture::kMaxNumFrames] = {};
+  EXPECT_EQ(arraysize(frames), s1->CopyFrames(decoded, arraysize(decoded)));
+  for (size_t i = 0; i < arraysize(frames); ++i)
+    EXPECT_EQ(frames[i], decoded[i]);
+
+  // Saving the same stack gives back the compact stack capture.
+  EXPECT_EQ(s1, cache.SaveStackTrace(capture));
+  cache.ReleaseStackTrace(s1);
+  cache.ReleaseStackTrace(s1);
+
+  // New stacks are stored as is once the compact encoding is disabled.
+  cache.set_compact_stack_captures(false);
+  capture.InitFromBuffer(frames, arraysize(frames) - 1);
+  const StackCapture* s2 = cache.SaveStackTrace(capture);
+  ASSERT_TRUE(s2 != NULL);
+  EXPECT_FALSE(s2->compact());
+  EXPECT_EQ(capture.num_frames(), s2->num_frames());
+  cache.ReleaseStackTrace(s2);
+
+  StackCapture::ClearFalseModules();
+}
+
 TEST_F(StackCaptureCacheTest, RestrictedStackTraces) {
   AsanLogger logger;
   TestStackCaptureCache cache(&logger, 20);
@@ -436,5 +482,101 @@ TEST_F(StackCaptureCacheTest, EmptyStackCapture) {
   cache.ReleaseStackTrace(saved_stack2);
 }
 
+namespace {
+
+// Repeatedly saves and releases a small set of stacks.
+class SaveAndReleaseThread : public base::SimpleThread {
+ public:
+  SaveAndReleaseThread(StackCaptureCache* cache, size_t stack_count)
+      : base::SimpleThread("SaveAndReleaseThread"),
+        cache_(cache),
+        stack_count_(stack_count) {}
+
+  void Run() override {
+    static const size_t kIterations = 1000;
+    void* frames[4] = {};
+    std::vector<const StackCapture*> saved;
+    for (size_t i = 0; i < kIterations; ++i) {
+      frames[0] = reinterpret_cast<void*>(i % stack_count_ + 1);
+      StackCapture stack;
+      stack.InitFromBuffer(frames, arraysize(frames));
+      const StackCapture* s = cache_->SaveStackTrace(stack);
+      ASSERT_NE(static_cast<const StackCapture*>(nullptr), s);
+      EXPECT_EQ(stack.absolute_stack_id(), s->absolute_stack_id());
+      saved.push_back(s);
+
+      // Keep a few references alive so that both the lock-free and the locked
+      // paths are exercised.
+      if (saved.size() > 3) {
+        cache_->ReleaseStackTrace(saved.front());
+        saved.erase(saved.begin());
+      }
+    }
+    for (const StackCapture* s : saved)
+      cache_->ReleaseStackTrace(s);
+  }
+
+ private:
+  StackCaptureCache* cache_;
+  size_t stack_count_;
+};
+
+}  // namespace
+
+TEST_F(StackCaptureCacheTest, ConcurrentSaveAndRelease) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_compression_reporting_period(0);
+
+  static const size_t kThreadCount = 8;
+  std::vector<std::unique_ptr<SaveAndReleaseThread>> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.push_back(std::unique_ptr<SaveAndReleaseThread>(
+        new SaveAndReleaseThread(&cache, 5)));
+  }
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  // All references have been released, so a new save must find an
+  // unreferenced cache and hand out a freshly referenced stack.
+  void* frames[4] = { reinterpret_cast<void*>(1) };
+  StackCapture stack;
+  stack.InitFromBuffer(frames, arraysize(frames));
+  const StackCapture* s = cache.SaveStackTrace(stack);
+  ASSERT_NE(static_cast<const StackCapture*>(nullptr), s);
+  EXPECT_EQ(1u, s->ref_count());
+  cache.ReleaseStackTrace(s);
+}
+
+TEST_F(StackCaptureCacheTest, KnownStackIsSharedWithoutLock) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+
+  StackCapture stack;
+  stack.InitFromStack();
+  const StackCapture* s1 = cache.SaveStackTrace(stack);
+  ASSERT_NE(static_cast<const StackCapture*>(nullptr), s1);
+
+  // Hold the shard lock of this stack; a lookup of an already referenced stack
+  // must still succeed as it doesn't need it.
+  const StackCapture* s2 = nullptr;
+  {
+    base::AutoLock lock(cache.known_stacks_lock(stack.absolute_stack_id()));
+    s2 = cache.SaveStackTrace(stack);
+  }
+  EXPECT_EQ(s1, s2);
+  EXPECT_EQ(2u, s1->ref_count());
+
+  // Releasing a reference that isn't the last also needs no lock.
+  {
+    base::AutoLock lock(cache.known_stacks_lock(stack.absolute_stack_id()));
+    cache.ReleaseStackTrace(s2);
+  }
+  EXPECT_EQ(1u, s1->ref_count());
+  cache.ReleaseStackTrace(s1);
+}
+
 }  // namespace asan
 }  // namespace agent
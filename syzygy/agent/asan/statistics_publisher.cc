@@ -0,0 +1,157 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/statistics_publisher.h"
+
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/common/com_utils.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// The number of attempts made by ReadStatistics to get a consistent copy.
+const size_t kMaxReadAttempts = 100;
+
+}  // namespace
+
+StatisticsPublisher::StatisticsPublisher(
+    base::TimeDelta period,
+    const StatisticsCallback& statistics_callback)
+    : period_(period),
+      statistics_callback_(statistics_callback),
+      section_(nullptr),
+      stop_event_(true, false) {
+  DCHECK(!statistics_callback_.is_null());
+}
+
+StatisticsPublisher::~StatisticsPublisher() {
+  if (section_ != nullptr)
+    ::UnmapViewOfFile(section_);
+}
+
+// static
+base::string16 StatisticsPublisher::GetSectionName(uint32_t process_id) {
+  return base::StringPrintf(L"Local\\SyzyASAN-Statistics-%u", process_id);
+}
+
+bool StatisticsPublisher::Init(const base::string16& name) {
+  DCHECK_EQ(static_cast<AsanStatisticsSection*>(nullptr), section_);
+
+  mapping_.Set(::CreateFileMapping(INVALID_HANDLE_VALUE, nullptr,
+                                   PAGE_READWRITE, 0,
+                                   sizeof(AsanStatisticsSection),
+                                   name.c_str()));
+  if (!mapping_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create the statistics section: "
+               << ::common::LogWe(error);
+    return false;
+  }
+
+  section_ = reinterpret_cast<AsanStatisticsSection*>(::MapViewOfFile(
+      mapping_.Get(), FILE_MAP_WRITE, 0, 0, sizeof(AsanStatisticsSection)));
+  if (section_ == nullptr) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map the statistics section: "
+               << ::common::LogWe(error);
+    mapping_.Close();
+    return false;
+  }
+
+  // The header is written last, so that readers don't trust a section that
+  // is still being initialized.
+  ::memset(section_, 0, sizeof(*section_));
+  section_->header.size = sizeof(AsanStatisticsSection);
+  section_->header.process_id = ::GetCurrentProcessId();
+  section_->header.update_period_ms =
+      static_cast<uint32_t>(period_.InMilliseconds());
+  section_->header.version = kStatisticsSectionVersion;
+  base::subtle::MemoryBarrier();
+  section_->header.magic = kStatisticsSectionMagic;
+  return true;
+}
+
+bool StatisticsPublisher::Start() {
+  DCHECK_NE(static_cast<AsanStatisticsSection*>(nullptr), section_);
+  return base::PlatformThread::CreateWithPriority(
+      0, this, &thread_handle_, base::ThreadPriority::BACKGROUND);
+}
+
+void StatisticsPublisher::Stop() {
+  stop_event_.Signal();
+  base::PlatformThread::Join(thread_handle_);
+}
+
+void StatisticsPublisher::Publish() {
+  DCHECK_NE(static_cast<AsanStatisticsSection*>(nullptr), section_);
+
+  // Gather the statistics before entering the sequence lock, to keep the
+  // window in which the readers have to retry short.
+  AsanRuntimeStatistics statistics = {};
+  statistics_callback_.Run(&statistics);
+  FILETIME now = {};
+  ::GetSystemTimeAsFileTime(&now);
+
+  AsanStatisticsSectionHeader* header = &section_->header;
+  base::subtle::Atomic32 sequence =
+      base::subtle::NoBarrier_Load(&header->sequence);
+  DCHECK_EQ(0, sequence % 2);
+  base::subtle::NoBarrier_Store(&header->sequence, sequence + 1);
+  base::subtle::MemoryBarrier();
+  section_->statistics = statistics;
+  header->update_time =
+      (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+  base::subtle::Release_Store(&header->sequence, sequence + 2);
+}
+
+// static
+bool StatisticsPublisher::ReadStatistics(const AsanStatisticsSection* section,
+                                         AsanRuntimeStatistics* statistics) {
+  DCHECK_NE(static_cast<const AsanStatisticsSection*>(nullptr), section);
+  DCHECK_NE(static_cast<AsanRuntimeStatistics*>(nullptr), statistics);
+
+  if (section->header.magic != kStatisticsSectionMagic ||
+      section->header.version != kStatisticsSectionVersion ||
+      section->header.size < sizeof(AsanStatisticsSection)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < kMaxReadAttempts; ++i) {
+    base::subtle::Atomic32 sequence =
+        base::subtle::Acquire_Load(&section->header.sequence);
+    if (sequence % 2 != 0) {
+      ::SwitchToThread();
+      continue;
+    }
+    *statistics = section->statistics;
+    base::subtle::MemoryBarrier();
+    if (base::subtle::NoBarrier_Load(&section->header.sequence) == sequence)
+      return true;
+  }
+
+  return false;
+}
+
+void StatisticsPublisher::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Statistics Publisher Thread");
+  do {
+    Publish();
+  } while (!stop_event_.TimedWait(period_));
+}
+
+}  // namespace asan
+}  // namespace agent
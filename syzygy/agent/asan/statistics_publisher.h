@@ -0,0 +1,176 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares StatisticsPublisher, which periodically publishes the statistics of
+// the runtime in a named shared memory section. External tools can then sample
+// these statistics by simply mapping the section of a process, without any
+// RPC or logging.
+//
+// The section is named after the ID of the process (see GetSectionName) and
+// has a fixed layout (see AsanStatisticsSection). Its updates are protected by
+// a sequence lock: the sequence number is odd while an update is in progress,
+// and readers must retry if it was odd or changed while they were copying the
+// statistics (see ReadStatistics).
+
+#ifndef SYZYGY_AGENT_ASAN_STATISTICS_PUBLISHER_H_
+#define SYZYGY_AGENT_ASAN_STATISTICS_PUBLISHER_H_
+
+#include <windows.h>
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/strings/string16.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+#include "base/win/scoped_handle.h"
+
+namespace agent {
+namespace asan {
+
+// The maximum number of heap types in the statistics section. This is fixed
+// so that the layout of the section doesn't depend on the runtime version.
+static const size_t kStatisticsSectionHeapTypeCount = 8;
+
+// The statistics of the runtime published in the section. This is a fixed
+// layout read by external tools: new fields must be added at the end, and
+// kStatisticsSectionVersion must be incremented.
+struct AsanRuntimeStatistics {
+  // The number of live blocks and their total size, in bytes, indexed by
+  // HeapType.
+  uint64_t live_blocks[kStatisticsSectionHeapTypeCount];
+  uint64_t live_bytes[kStatisticsSectionHeapTypeCount];
+  // The size, in bytes, and the number of blocks of the shared quarantine.
+  uint64_t quarantine_size;
+  uint64_t quarantine_count;
+  // The trim color of the shared quarantine.
+  uint32_t quarantine_color;
+  // The number of deferred free threads.
+  uint32_t deferred_free_thread_count;
+  // The number of bytes the deferred free threads have left to trim.
+  uint64_t deferred_free_backlog;
+  // The size of the stack cache, in bytes, and the number of stacks it
+  // holds.
+  uint64_t stack_cache_size;
+  uint64_t stack_cache_entries;
+};
+static_assert(sizeof(AsanRuntimeStatistics) == 176,
+              "The statistics section layout must not change.");
+
+// The header of the statistics section.
+struct AsanStatisticsSectionHeader {
+  // Set to kStatisticsSectionMagic.
+  uint32_t magic;
+  // Set to kStatisticsSectionVersion.
+  uint32_t version;
+  // The size of the whole section, in bytes.
+  uint32_t size;
+  // The ID of the process publishing the statistics.
+  uint32_t process_id;
+  // The period at which the statistics are updated, in milliseconds.
+  uint32_t update_period_ms;
+  // The sequence lock protecting the statistics. This is odd while they are
+  // being updated.
+  base::subtle::Atomic32 sequence;
+  // The time of the last update, as a FILETIME.
+  uint64_t update_time;
+};
+static_assert(sizeof(AsanStatisticsSectionHeader) == 32,
+              "The statistics section layout must not change.");
+
+// The layout of the statistics section.
+struct AsanStatisticsSection {
+  AsanStatisticsSectionHeader header;
+  AsanRuntimeStatistics statistics;
+};
+
+// Identifies the statistics section.
+static const uint32_t kStatisticsSectionMagic = 0x54534153;  // 'SAST'.
+
+// The version of the layout of the statistics section.
+static const uint32_t kStatisticsSectionVersion = 1;
+
+class StatisticsPublisher : public base::PlatformThread::Delegate {
+ public:
+  typedef base::Callback<void(AsanRuntimeStatistics*)> StatisticsCallback;
+
+  // @param period The time between two updates of the section.
+  // @param statistics_callback Callback that is called to gather the
+  //     statistics to publish. This callback must be valid from the moment
+  //     Start is called and until Stop is called.
+  StatisticsPublisher(base::TimeDelta period,
+                      const StatisticsCallback& statistics_callback);
+  ~StatisticsPublisher() override;
+
+  // @param process_id The ID of a process.
+  // @returns the name of the statistics section of @p process_id.
+  static base::string16 GetSectionName(uint32_t process_id);
+
+  // Creates and maps the statistics section. Must be called before Start.
+  // @param name The name of the section.
+  // @returns true on success, false otherwise.
+  bool Init(const base::string16& name);
+
+  // Starts the thread updating the section. Must not be called if the thread
+  // has already been started.
+  // @returns true if successful, false if the thread failed to be launched.
+  bool Start();
+
+  // Stops the thread and waits until it exits cleanly. Must be called before
+  // the destruction of this object. Must not be called if the thread has not
+  // been started successfully.
+  void Stop();
+
+  // Gathers the statistics and publishes them. This is what the thread does
+  // every period, and is exposed for testing.
+  void Publish();
+
+  // Reads a consistent copy of the statistics of a section.
+  // @param section The mapped statistics section.
+  // @param statistics Will receive the statistics.
+  // @returns true on success, false if the section is invalid or if it kept
+  //     being updated while being read.
+  static bool ReadStatistics(const AsanStatisticsSection* section,
+                             AsanRuntimeStatistics* statistics);
+
+  // @returns the mapped section, or nullptr if Init hasn't succeeded.
+  const AsanStatisticsSection* section() const { return section_; }
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override;
+
+  // The time between two updates.
+  base::TimeDelta period_;
+
+  // The callback gathering the statistics.
+  StatisticsCallback statistics_callback_;
+
+  // The file mapping of the section, and its view.
+  base::win::ScopedHandle mapping_;
+  AsanStatisticsSection* section_;
+
+  // Used to signal the thread to exit.
+  base::WaitableEvent stop_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(StatisticsPublisher);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_STATISTICS_PUBLISHER_H_
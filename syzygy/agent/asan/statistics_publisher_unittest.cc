@@ -0,0 +1,149 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/statistics_publisher.h"
+
+#include "base/bind.h"
+#include "base/strings/stringprintf.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+class StatisticsPublisherTest : public testing::Test {
+ public:
+  StatisticsPublisherTest() : callback_count_(0) {}
+
+  void GatherStatistics(AsanRuntimeStatistics* statistics) {
+    ::InterlockedIncrement(&callback_count_);
+    statistics->live_blocks[0] = 42;
+    statistics->live_bytes[0] = 4200;
+    statistics->quarantine_size = 1024;
+    statistics->stack_cache_entries = 7;
+  }
+
+  StatisticsPublisher::StatisticsCallback GetCallback() {
+    return base::Bind(&StatisticsPublisherTest::GatherStatistics,
+                      base::Unretained(this));
+  }
+
+  // Returns a section name that is unique to this test.
+  base::string16 GetTestSectionName() {
+    return base::StringPrintf(L"Local\\SyzyASAN-Statistics-Test-%u",
+                              ::GetCurrentProcessId());
+  }
+
+ protected:
+  volatile LONG callback_count_;
+};
+
+}  // namespace
+
+TEST_F(StatisticsPublisherTest, GetSectionName) {
+  EXPECT_EQ(L"Local\\SyzyASAN-Statistics-1234",
+            StatisticsPublisher::GetSectionName(1234));
+}
+
+TEST_F(StatisticsPublisherTest, InitAndPublish) {
+  StatisticsPublisher publisher(base::TimeDelta::FromMilliseconds(25),
+                                GetCallback());
+  EXPECT_EQ(static_cast<const AsanStatisticsSection*>(nullptr),
+            publisher.section());
+  ASSERT_TRUE(publisher.Init(GetTestSectionName()));
+  const AsanStatisticsSection* section = publisher.section();
+  ASSERT_NE(static_cast<const AsanStatisticsSection*>(nullptr), section);
+
+  EXPECT_EQ(kStatisticsSectionMagic, section->header.magic);
+  EXPECT_EQ(kStatisticsSectionVersion, section->header.version);
+  EXPECT_EQ(sizeof(AsanStatisticsSection), section->header.size);
+  EXPECT_EQ(::GetCurrentProcessId(), section->header.process_id);
+  EXPECT_EQ(25u, section->header.update_period_ms);
+  EXPECT_EQ(0, section->header.sequence);
+  EXPECT_EQ(0u, section->header.update_time);
+
+  publisher.Publish();
+  EXPECT_EQ(1, callback_count_);
+  EXPECT_EQ(2, section->header.sequence);
+  EXPECT_NE(0u, section->header.update_time);
+
+  AsanRuntimeStatistics statistics = {};
+  EXPECT_TRUE(StatisticsPublisher::ReadStatistics(section, &statistics));
+  EXPECT_EQ(42u, statistics.live_blocks[0]);
+  EXPECT_EQ(4200u, statistics.live_bytes[0]);
+  EXPECT_EQ(1024u, statistics.quarantine_size);
+  EXPECT_EQ(7u, statistics.stack_cache_entries);
+  EXPECT_EQ(0u, statistics.live_blocks[1]);
+}
+
+TEST_F(StatisticsPublisherTest, SectionIsVisibleFromAnotherMapping) {
+  StatisticsPublisher publisher(base::TimeDelta::FromMilliseconds(25),
+                                GetCallback());
+  ASSERT_TRUE(publisher.Init(GetTestSectionName()));
+  publisher.Publish();
+
+  // Map the section by name, as an external tool would.
+  base::win::ScopedHandle mapping(::OpenFileMapping(
+      FILE_MAP_READ, FALSE, GetTestSectionName().c_str()));
+  ASSERT_TRUE(mapping.IsValid());
+  const AsanStatisticsSection* section =
+      reinterpret_cast<const AsanStatisticsSection*>(::MapViewOfFile(
+          mapping.Get(), FILE_MAP_READ, 0, 0, sizeof(AsanStatisticsSection)));
+  ASSERT_NE(static_cast<const AsanStatisticsSection*>(nullptr), section);
+
+  AsanRuntimeStatistics statistics = {};
+  EXPECT_TRUE(StatisticsPublisher::ReadStatistics(section, &statistics));
+  EXPECT_EQ(42u, statistics.live_blocks[0]);
+
+  ::UnmapViewOfFile(section);
+}
+
+TEST_F(StatisticsPublisherTest, ReadStatisticsRejectsInvalidSections) {
+  AsanStatisticsSection section = {};
+  AsanRuntimeStatistics statistics = {};
+  EXPECT_FALSE(StatisticsPublisher::ReadStatistics(&section, &statistics));
+
+  section.header.magic = kStatisticsSectionMagic;
+  section.header.version = kStatisticsSectionVersion + 1;
+  section.header.size = sizeof(section);
+  EXPECT_FALSE(StatisticsPublisher::ReadStatistics(&section, &statistics));
+
+  // A section that is stuck in an update can't be read.
+  section.header.version = kStatisticsSectionVersion;
+  section.header.sequence = 1;
+  EXPECT_FALSE(StatisticsPublisher::ReadStatistics(&section, &statistics));
+
+  section.header.sequence = 4;
+  EXPECT_TRUE(StatisticsPublisher::ReadStatistics(&section, &statistics));
+}
+
+TEST_F(StatisticsPublisherTest, StartAndStop) {
+  StatisticsPublisher publisher(base::TimeDelta::FromMilliseconds(1),
+                                GetCallback());
+  ASSERT_TRUE(publisher.Init(GetTestSectionName()));
+  ASSERT_TRUE(publisher.Start());
+  base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(10));
+  publisher.Stop();
+
+  // The thread publishes as soon as it starts.
+  EXPECT_LT(0, callback_count_);
+  AsanRuntimeStatistics statistics = {};
+  EXPECT_TRUE(
+      StatisticsPublisher::ReadStatistics(publisher.section(), &statistics));
+  EXPECT_EQ(7u, statistics.stack_cache_entries);
+}
+
+}  // namespace asan
+}  // namespace agent
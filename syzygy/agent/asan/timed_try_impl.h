@@ -31,7 +31,7 @@ namespace asan {
 
 namespace detail {
 
-// A simple adapter for base::Lock-like locks (Try and Release).
+// A simple adapter for base::Lock-like locks (Try, Acquire and Release).
 template<typename LockType>
 struct BaseLockAdapter {
   bool Try(LockType* lock) {
@@ -39,6 +39,11 @@ struct BaseLockAdapter {
     return lock->Try();
   }
 
+  void Acquire(LockType* lock) {
+    DCHECK_NE(static_cast<LockType*>(NULL), lock);
+    lock->Acquire();
+  }
+
   void Release(LockType* lock) {
     DCHECK_NE(static_cast<LockType*>(NULL), lock);
     lock->Release();
@@ -52,6 +57,11 @@ struct HeapInterfaceAdapter {
     return heap->TryLock();
   }
 
+  void Acquire(HeapInterface* heap) {
+    DCHECK_NE(static_cast<HeapInterface*>(NULL), heap);
+    heap->Lock();
+  }
+
   void Release(HeapInterface* heap) {
     DCHECK_NE(static_cast<HeapInterface*>(NULL), heap);
     heap->Unlock();
@@ -59,7 +69,7 @@ struct HeapInterfaceAdapter {
 };
 
 // A lock adapter selector. By default selects BaseLockAdapter, and expects
-// the lock to implement 'Try' and 'Release'.
+// the lock to implement 'Try', 'Acquire' and 'Release'.
 template<typename LockType>
 struct SelectLockAdapter {
   typedef BaseLockAdapter<LockType> type;
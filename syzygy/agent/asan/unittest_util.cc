@@ -842,9 +842,10 @@ void TestMemoryInterceptors::TestValidAccess(
   for (size_t i = 0; i < num_fns; ++i) {
     const InterceptFunction& fn = fns[i];
 
+    // The probes are given the address of the last byte of the access.
     SyzyAsanMemoryAccessorTester tester;
     tester.CheckAccessAndCompareContexts(
-        reinterpret_cast<FARPROC>(fn.function), src_);
+        reinterpret_cast<FARPROC>(fn.function), src_ + fn.size - 1);
 
     ASSERT_FALSE(tester.memory_error_detected());
   }
@@ -858,7 +859,7 @@ void TestMemoryInterceptors::TestValidAccessIgnoreFlags(
     SyzyAsanMemoryAccessorTester tester(
         SyzyAsanMemoryAccessorTester::IGNORE_FLAGS);
     tester.CheckAccessAndCompareContexts(
-        reinterpret_cast<FARPROC>(fn.function), src_);
+        reinterpret_cast<FARPROC>(fn.function), src_ + fn.size - 1);
 
     ASSERT_FALSE(tester.memory_error_detected());
   }
@@ -899,10 +900,6 @@ void TestMemoryInterceptors::TestUnderrunAccess(
   for (size_t i = 0; i < num_fns; ++i) {
     const InterceptFunction& fn = fns[i];
 
-    // TODO(someone): the 32 byte access checker does not fire on 32 byte
-    //     underrun. I guess the checkers test a single shadow byte at most
-    //     whereas it'd be more correct for access checkers to test as many
-    //     shadow bytes as is appropriate for the range of memory they touch.
     SyzyAsanMemoryAccessorTester tester;
     tester.AssertMemoryErrorIsDetected(
         reinterpret_cast<FARPROC>(fn.function),
@@ -918,10 +915,6 @@ void TestMemoryInterceptors::TestUnderrunAccessIgnoreFlags(
   for (size_t i = 0; i < num_fns; ++i) {
     const InterceptFunction& fn = fns[i];
 
-    // TODO(someone): the 32 byte access checker does not fire on 32 byte
-    //     underrun. I guess the checkers test a single shadow byte at most
-    //     whereas it'd be more correct for access checkers to test as many
-    //     shadow bytes as is appropriate for the range of memory they touch.
     SyzyAsanMemoryAccessorTester tester(
         SyzyAsanMemoryAccessorTester::IGNORE_FLAGS);
     tester.AssertMemoryErrorIsDetected(
@@ -65,6 +65,14 @@
 //      mode, under a non-standard execution (crash, force exit, ...) pending
 //      events may be lost.
 //
+//    When SYZYGY_BASIC_BLOCK_ENTRY_SNAPSHOT_PERIOD_MS is set, each thread
+//    instead counts in private counters, without locking. A background
+//    thread merges them periodically into the module table, using the
+//    counts accumulated since its last merge, then writes the table as a
+//    snapshot and clears it. This gives time-sliced profiles of long running
+//    processes. The counts of a thread since the last merge may be lost under
+//    a non-standard execution, as in the buffered mode.
+//
 //    The agent keeps a ThreadState for each running thread. The thread state
 //    is accessible through a TLS mechanism and contains information needed by
 //    the hook (pointer to trace segment, buffer, lock, ...).
@@ -80,14 +88,23 @@
 //      this mechanism must be used in a controlled environment.
 
 #include "syzygy/agent/basic_block_entry/basic_block_entry.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
 #include <memory>
+#include <string>
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/lazy_instance.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "syzygy/agent/basic_block_entry/counter_merge.h"
 #include "syzygy/agent/common/agent.h"
 #include "syzygy/agent/common/process_utils.h"
 #include "syzygy/agent/common/scoped_last_error_keeper.h"
@@ -267,16 +284,19 @@ const uint32_t kUserApplicationSlot = 0x700;
 const uint32_t kNumSlots = 4U;
 const uint32_t kInvalidBasicBlockId = ~0U;
 
-// The indexed_frequency_data for the bbentry instrumentation mode has 1 column.
-struct BBEntryFrequency {
-  uint32_t frequency;
-};
-
-// The indexed_frequency_data for the branch instrumentation mode has 3 columns.
-struct BranchFrequency {
-  uint32_t frequency;
-  uint32_t branch_taken;
-  uint32_t mispredicted;
+// The environment variable holding the period of the frequency snapshots, in
+// milliseconds.
+const char kSnapshotPeriodEnvVar[] =
+    "SYZYGY_BASIC_BLOCK_ENTRY_SNAPSHOT_PERIOD_MS";
+
+// The columns of the indexed_frequency_data. The bbentry instrumentation mode
+// has only the frequency column, and the branch instrumentation mode has the
+// 3 of them. The counters are either 32-bit or 8-bit, as given by the
+// frequency_size of the module, and both saturate.
+enum FrequencyColumn {
+  kFrequencyColumn,
+  kBranchTakenColumn,
+  kMispredictedColumn,
 };
 
 // An entry in the basic block id buffer.
@@ -296,6 +316,40 @@ inline uint32_t IncrementAndSaturate(uint32_t value) {
   return value;
 }
 
+// Holds a lock, if there is one, for the duration of a scope.
+class ScopedOptionalLock {
+ public:
+  explicit ScopedOptionalLock(base::Lock* lock) : lock_(lock) {
+    if (lock_ != NULL)
+      lock_->Acquire();
+  }
+  ~ScopedOptionalLock() {
+    if (lock_ != NULL)
+      lock_->Release();
+  }
+
+ private:
+  base::Lock* lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedOptionalLock);
+};
+
+// Returns the frequency record whose table is @p module_data->frequency_data.
+TraceIndexedFrequencyData* GetTraceData(
+    const IndexedFrequencyData* module_data) {
+  DCHECK(module_data != NULL);
+  return reinterpret_cast<TraceIndexedFrequencyData*>(
+      static_cast<uint8_t*>(module_data->frequency_data) -
+      offsetof(TraceIndexedFrequencyData, frequency_data));
+}
+
+// Returns the size in bytes of the frequency table of @p module_data.
+size_t GetFrequencyDataSize(const IndexedFrequencyData* module_data) {
+  DCHECK(module_data != NULL);
+  return module_data->num_entries * module_data->frequency_size *
+         module_data->num_columns;
+}
+
 // Get the address of the module containing @p addr. We do this by querying
 // for the allocation that contains @p addr. This must lie within the
 // instrumented module, and be part of the single allocation in which the
@@ -332,10 +386,11 @@ bool DatatypeVersionIsValid(uint32_t data_type,
                             uint32_t num_columns) {
   // We can only handle this if it looks right.
   const size_t kIntSize = sizeof(int);
+  bool valid_frequency_size = frequency_size == kIntSize || frequency_size == 1;
   if (data_type == IndexedFrequencyData::BRANCH) {
     if (agent_id != ::common::kBasicBlockEntryAgentId ||
         version != ::common::kBranchFrequencyDataVersion ||
-        frequency_size != kIntSize ||
+        !valid_frequency_size ||
         num_columns != 3U) {
       LOG(ERROR) << "Unexpected values in the branch data structures.";
       return false;
@@ -343,7 +398,7 @@ bool DatatypeVersionIsValid(uint32_t data_type,
   } else if (data_type == IndexedFrequencyData::BASIC_BLOCK_ENTRY) {
     if (agent_id != ::common::kBasicBlockEntryAgentId ||
         version != ::common::kBasicBlockFrequencyDataVersion ||
-        frequency_size != kIntSize ||
+        !valid_frequency_size ||
         num_columns != 1U) {
       LOG(ERROR) << "Unexpected values in the basic block data structures.";
       return false;
@@ -438,18 +493,30 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Reset the most recent basic block executed.
   void reset_last_basic_block_id();
 
-  // Return the lock associated with 'trace_data_' for atomic update.
+  // Return the lock associated with 'trace_data_' for atomic update, or NULL if
+  // this thread counts in private counters.
   base::Lock* trace_lock() { return trace_lock_; }
 
-  // For a given basic block id, returns the corresponding BBEntryFrequency.
-  // @param basic_block_id the basic block index.
-  // @returns the bbentry frequency entry for a given basic block id.
-  BBEntryFrequency& GetBBEntryFrequency(uint32_t basic_block_id);
+  // Switch the counting to private counters, merged by @p agent.
+  // @param agent the agent merging the counters.
+  void UsePrivateCounters(BasicBlockEntry* agent);
+
+  // Stop reporting to the agent merging the private counters, which is being
+  // torn down.
+  void DetachFromAgent() { agent_ = NULL; }
 
-  // For a given basic block id, returns the corresponding BranchFrequency.
+  // Merge the private counts accumulated since the last merge into the
+  // module table. The agent lock must be held.
+  void MergePrivateCounters();
+
+  // Saturation increment a counter of a basic block, of the width given by
+  // the frequency size of the module.
   // @param basic_block_id the basic block index.
-  // @returns the branch frequency entry for a given basic block id.
-  BranchFrequency& GetBranchFrequency(uint32_t basic_block_id);
+  // @param column the column of the counter.
+  void IncrementCounter(uint32_t basic_block_id, FrequencyColumn column);
+
+  // @returns the module information of this thread state.
+  const IndexedFrequencyData* module_data() const { return module_data_; }
 
   // Retrieve the indexed_frequency_data specific fields for this agent.
   // @returns a pointer to the specific fields.
@@ -484,6 +551,15 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // The last basic block id executed.
   uint32_t last_basic_block_id_;
 
+  // The agent merging the private counters, or NULL if this thread counts in
+  // the module table.
+  BasicBlockEntry* agent_;
+
+  // The private counters, written by this thread only, and their values at
+  // the last merge, written by the merging thread under the agent lock.
+  std::vector<uint32_t> private_counters_;
+  std::vector<uint32_t> merged_counters_;  // Under the agent lock.
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadState);
 };
@@ -495,12 +571,15 @@ BasicBlockEntry::ThreadState::ThreadState(IndexedFrequencyData* module_data,
       module_data_(module_data),
       trace_lock_(lock),
       basic_block_id_buffer_offset_(0),
-      last_basic_block_id_(kInvalidBasicBlockId) {
+      last_basic_block_id_(kInvalidBasicBlockId),
+      agent_(NULL) {
 }
 
 BasicBlockEntry::ThreadState::~ThreadState() {
   if (!basic_block_id_buffer_.empty())
     Flush();
+  if (agent_ != NULL)
+    agent_->ReleasePrivateCounters(this);
 
   uint32_t slot = GetBasicBlockData()->fs_slot;
   if (slot != 0) {
@@ -519,26 +598,56 @@ void BasicBlockEntry::ThreadState::AllocatePredictorCache() {
   predictor_data_.resize(kPredictorCacheSize);
 }
 
+void BasicBlockEntry::ThreadState::UsePrivateCounters(
+    BasicBlockEntry* agent) {
+  DCHECK(agent != NULL);
+  DCHECK(agent_ == NULL);
+  DCHECK(private_counters_.empty());
+
+  // The 8-bit counters are kept in the same 32-bit aligned storage.
+  size_t num_counters =
+      (GetFrequencyDataSize(module_data_) + sizeof(uint32_t) - 1) /
+      sizeof(uint32_t);
+  DCHECK_LT(0U, num_counters);
+  private_counters_.resize(num_counters, 0);
+  merged_counters_.resize(num_counters, 0);
+  frequency_data_ = &private_counters_[0];
+  trace_lock_ = NULL;
+  agent_ = agent;
+}
+
+void BasicBlockEntry::ThreadState::MergePrivateCounters() {
+  DCHECK(agent_ != NULL);
+  size_t data_size = GetFrequencyDataSize(module_data_);
+  if (module_data_->frequency_size == 1) {
+    MergeCounters(reinterpret_cast<const uint8_t*>(&private_counters_[0]),
+                  reinterpret_cast<uint8_t*>(&merged_counters_[0]),
+                  static_cast<uint8_t*>(module_data_->frequency_data),
+                  data_size);
+    return;
+  }
+  MergeCounters(&private_counters_[0], &merged_counters_[0],
+                static_cast<uint32_t*>(module_data_->frequency_data),
+                data_size / sizeof(uint32_t));
+}
+
 void BasicBlockEntry::ThreadState::reset_last_basic_block_id() {
   last_basic_block_id_ = kInvalidBasicBlockId;
 }
 
-BBEntryFrequency& BasicBlockEntry::ThreadState::GetBBEntryFrequency(
-    uint32_t basic_block_id) {
+inline void BasicBlockEntry::ThreadState::IncrementCounter(
+    uint32_t basic_block_id, FrequencyColumn column) {
   DCHECK(frequency_data_ != NULL);
-  BBEntryFrequency* frequencies =
-      reinterpret_cast<BBEntryFrequency*>(frequency_data_);
-  BBEntryFrequency& entry = frequencies[basic_block_id];
-  return entry;
-}
+  DCHECK_LT(static_cast<uint32_t>(column), module_data_->num_columns);
 
-BranchFrequency& BasicBlockEntry::ThreadState::GetBranchFrequency(
-    uint32_t basic_block_id) {
-  DCHECK(frequency_data_ != NULL);
-  BranchFrequency* frequencies =
-      reinterpret_cast<BranchFrequency*>(frequency_data_);
-  BranchFrequency& entry = frequencies[basic_block_id];
-  return entry;
+  size_t offset = basic_block_id * module_data_->num_columns + column;
+  if (module_data_->frequency_size == 1) {
+    uint8_t& counter = reinterpret_cast<uint8_t*>(frequency_data_)[offset];
+    if (counter != 0xFF)
+      ++counter;
+    return;
+  }
+  frequency_data_[offset] = IncrementAndSaturate(frequency_data_[offset]);
 }
 
 inline void BasicBlockEntry::ThreadState::Increment(uint32_t basic_block_id) {
@@ -546,9 +655,7 @@ inline void BasicBlockEntry::ThreadState::Increment(uint32_t basic_block_id) {
   DCHECK(module_data_ != NULL);
   DCHECK_LT(basic_block_id, module_data_->num_entries);
 
-  // Retrieve information for the basic block.
-  BBEntryFrequency& entry = GetBBEntryFrequency(basic_block_id);
-  entry.frequency = IncrementAndSaturate(entry.frequency);
+  IncrementCounter(basic_block_id, kFrequencyColumn);
 }
 
 void BasicBlockEntry::ThreadState::Enter(uint32_t basic_block_id,
@@ -557,26 +664,17 @@ void BasicBlockEntry::ThreadState::Enter(uint32_t basic_block_id,
   DCHECK(module_data_ != NULL);
   DCHECK_LT(basic_block_id, module_data_->num_entries);
 
-  // Retrieve information for the current basic block.
-  BranchFrequency& current = GetBranchFrequency(basic_block_id);
-
   // Count the execution of this basic block.
-  if (current.frequency != kInvalidBasicBlockId)
-    current.frequency = IncrementAndSaturate(current.frequency);
+  IncrementCounter(basic_block_id, kFrequencyColumn);
 
   // Check if entering from a jump or something else (call).
   if (last_basic_block_id == kInvalidBasicBlockId)
     return;
 
-  // Retrieve information for the previous basic block.
-  BranchFrequency& previous = GetBranchFrequency(last_basic_block_id);
-
   // If last jump was taken, count the branch taken in the previous basic block.
   bool taken = (basic_block_id != last_basic_block_id + 1);
-  if (taken) {
-    if (previous.branch_taken != kInvalidBasicBlockId)
-      previous.branch_taken = IncrementAndSaturate(previous.branch_taken);
-  }
+  if (taken)
+    IncrementCounter(last_basic_block_id, kBranchTakenColumn);
 
   // Simulate the branch predictor.
   // see: http://en.wikipedia.org/wiki/Branch_predictor
@@ -593,12 +691,12 @@ void BasicBlockEntry::ThreadState::Enter(uint32_t basic_block_id,
     uint8_t& state = predictor_data_[offset];
     if (taken) {
       if (state < 2)
-        previous.mispredicted = IncrementAndSaturate(previous.mispredicted);
+        IncrementCounter(last_basic_block_id, kMispredictedColumn);
       if (state < 3)
         ++state;
     } else {
       if (state > 1)
-        previous.mispredicted = IncrementAndSaturate(previous.mispredicted);
+        IncrementCounter(last_basic_block_id, kMispredictedColumn);
       if (state != 0)
         --state;
     }
@@ -640,6 +738,49 @@ void BasicBlockEntry::ThreadState::Flush() {
   basic_block_id_buffer_offset_ = 0;
 }
 
+// A background thread that periodically takes the frequency snapshots.
+class BasicBlockEntry::SnapshotThread : public base::PlatformThread::Delegate {
+ public:
+  // @param agent the agent whose frequency data is snapshotted.
+  explicit SnapshotThread(BasicBlockEntry* agent)
+      : agent_(agent), stop_event_(true, false) {
+    DCHECK(agent != NULL);
+  }
+
+  // Starts the thread.
+  // @returns true if successful, false if the thread failed to be launched.
+  bool Start() {
+    return base::PlatformThread::CreateWithPriority(
+        0, this, &thread_handle_, base::ThreadPriority::BACKGROUND);
+  }
+
+  // Stops the thread and waits until it exits. Must only be called if the
+  // thread was started.
+  void Stop() {
+    stop_event_.Signal();
+    base::PlatformThread::Join(thread_handle_);
+  }
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override {
+    base::PlatformThread::SetName("SyzyBBEntry Snapshot Thread");
+    while (!stop_event_.TimedWait(agent_->snapshot_period_))
+      agent_->TakeFrequencySnapshots();
+  }
+
+  // The agent whose frequency data is snapshotted.
+  BasicBlockEntry* agent_;
+
+  // Used to signal the thread to exit.
+  base::WaitableEvent stop_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotThread);
+};
+
 BasicBlockEntry* BasicBlockEntry::Instance() {
   return static_bbentry_instance.Pointer();
 }
@@ -647,9 +788,33 @@ BasicBlockEntry* BasicBlockEntry::Instance() {
 BasicBlockEntry::BasicBlockEntry() : registered_slots_() {
   // Create a session.
   trace::client::InitializeRpcSession(&session_, &segment_);
+
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  std::string period_string;
+  unsigned int period_ms = 0;
+  if (env->GetVar(kSnapshotPeriodEnvVar, &period_string)) {
+    if (!base::StringToUint(period_string, &period_ms)) {
+      LOG(ERROR) << "Invalid " << kSnapshotPeriodEnvVar << ": "
+                 << period_string << ".";
+      period_ms = 0;
+    }
+  }
+  snapshot_period_ = base::TimeDelta::FromMilliseconds(period_ms);
 }
 
 BasicBlockEntry::~BasicBlockEntry() {
+  if (snapshot_thread_.get() != NULL)
+    snapshot_thread_->Stop();
+
+  // The thread states still alive are destroyed later by the thread state
+  // manager, so their last counts are merged now.
+  base::AutoLock scoped_lock(lock_);
+  std::set<ThreadState*>::iterator it = private_counter_states_.begin();
+  for (; it != private_counter_states_.end(); ++it) {
+    (*it)->MergePrivateCounters();
+    (*it)->DetachFromAgent();
+  }
+  private_counter_states_.clear();
 }
 
 bool BasicBlockEntry::InitializeFrequencyData(IndexedFrequencyData* data) {
@@ -665,8 +830,7 @@ bool BasicBlockEntry::InitializeFrequencyData(IndexedFrequencyData* data) {
   // Determine the size of the basic block frequency table.
   DCHECK_LT(0U, data->frequency_size);
   DCHECK_LT(0U, data->num_columns);
-  size_t data_size = data->num_entries * data->frequency_size *
-      data->num_columns;
+  size_t data_size = GetFrequencyDataSize(data);
 
   // Determine the size of the basic block frequency record.
   size_t record_size = sizeof(TraceIndexedFrequencyData) + data_size - 1;
@@ -766,9 +930,84 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
   // Allocate buffer to which basic block id are pushed before being committed.
   state->AllocateBasicBlockIdBuffer();
 
+  // Count in private counters if the frequency data is snapshotted.
+  if (!snapshot_period_.is_zero())
+    AllocatePrivateCounters(state);
+
   return state;
 }
 
+void BasicBlockEntry::AllocatePrivateCounters(ThreadState* state) {
+  DCHECK(state != NULL);
+
+  // Only the modules that were initialized for tracing are snapshotted.
+  base::AutoLock scoped_lock(lock_);
+  if (std::find(snapshot_modules_.begin(), snapshot_modules_.end(),
+                state->module_data()) == snapshot_modules_.end()) {
+    return;
+  }
+  state->UsePrivateCounters(this);
+  private_counter_states_.insert(state);
+}
+
+void BasicBlockEntry::ReleasePrivateCounters(ThreadState* state) {
+  DCHECK(state != NULL);
+
+  base::AutoLock scoped_lock(lock_);
+  state->MergePrivateCounters();
+  private_counter_states_.erase(state);
+}
+
+void BasicBlockEntry::TakeFrequencySnapshots() {
+  std::vector<IndexedFrequencyData*> modules;
+  {
+    base::AutoLock scoped_lock(lock_);
+    modules = snapshot_modules_;
+  }
+
+  for (size_t i = 0; i < modules.size(); ++i) {
+    IndexedFrequencyData* module_data = modules[i];
+    size_t data_size = GetFrequencyDataSize(module_data);
+    size_t record_size = sizeof(TraceIndexedFrequencyData) + data_size - 1;
+
+    // The buffer is allocated outside of the lock, as this is a round trip
+    // to the call trace service.
+    TraceFileSegment snapshot_segment;
+    if (!session_.AllocateBuffer(sizeof(RecordPrefix) + record_size,
+                                 &snapshot_segment) ||
+        !snapshot_segment.CanAllocate(record_size)) {
+      LOG(ERROR) << "Failed to allocate a frequency snapshot segment.";
+      return;
+    }
+
+    {
+      base::AutoLock scoped_lock(lock_);
+      std::set<ThreadState*>::iterator it = private_counter_states_.begin();
+      for (; it != private_counter_states_.end(); ++it) {
+        if ((*it)->module_data() == module_data)
+          (*it)->MergePrivateCounters();
+      }
+
+      // An idle module doesn't need a snapshot.
+      const uint8_t* table =
+          static_cast<const uint8_t*>(module_data->frequency_data);
+      if (std::find_if(table, table + data_size,
+                       [](uint8_t byte) { return byte != 0; }) !=
+          table + data_size) {
+        const TraceIndexedFrequencyData* trace_data = GetTraceData(module_data);
+        void* snapshot = snapshot_segment.AllocateTraceRecordImpl(
+            TRACE_INDEXED_FREQUENCY, record_size);
+        DCHECK(snapshot != NULL);
+        ::memcpy(snapshot, trace_data, record_size);
+        ::memset(module_data->frequency_data, 0, data_size);
+      }
+    }
+
+    if (!session_.ReturnBuffer(&snapshot_segment))
+      LOG(ERROR) << "Failed to return a frequency snapshot segment.";
+  }
+}
+
 inline BasicBlockEntry::ThreadState* BasicBlockEntry::GetThreadState(
     IndexedFrequencyData* module_data) {
   DCHECK(module_data != NULL);
@@ -804,7 +1043,7 @@ void WINAPI BasicBlockEntry::IncrementIndexedFreqDataHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  base::AutoLock scoped_lock(*state->trace_lock());
+  ScopedOptionalLock scoped_lock(state->trace_lock());
   state->Increment(entry_frame->index);
 }
 
@@ -820,7 +1059,7 @@ void WINAPI BasicBlockEntry::BranchEnterHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  base::AutoLock scoped_lock(*state->trace_lock());
+  ScopedOptionalLock scoped_lock(state->trace_lock());
   uint32_t last_basic_block_id = state->last_basic_block_id();
   state->Enter(entry_frame->index, last_basic_block_id);
   state->reset_last_basic_block_id();
@@ -839,7 +1078,7 @@ void WINAPI BasicBlockEntry::BranchEnterBufferedHook(
   }
 
   if (state->Push(entry_frame->index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
+    ScopedOptionalLock scoped_lock(state->trace_lock());
     state->Flush();
   }
   state->reset_last_basic_block_id();
@@ -869,7 +1108,7 @@ void __fastcall BasicBlockEntry::BranchEnterHookSlot(uint32_t index) {
   if (state == NULL)
     return;
 
-  base::AutoLock scoped_lock(*state->trace_lock());
+  ScopedOptionalLock scoped_lock(state->trace_lock());
   uint32_t last_basic_block_id = state->last_basic_block_id();
   state->Enter(index, last_basic_block_id);
   state->reset_last_basic_block_id();
@@ -882,7 +1121,7 @@ void __fastcall BasicBlockEntry::BranchEnterBufferedHookSlot(uint32_t index) {
     return;
 
   if (state->Push(index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
+    ScopedOptionalLock scoped_lock(state->trace_lock());
     state->Flush();
   }
   state->reset_last_basic_block_id();
@@ -1033,6 +1272,18 @@ void BasicBlockEntry::OnProcessAttach(IndexedFrequencyData* module_data) {
 
   RegisterModule(module_data);
 
+  if (!snapshot_period_.is_zero() && module_data->num_entries != 0) {
+    base::AutoLock scoped_lock(lock_);
+    snapshot_modules_.push_back(module_data);
+    if (snapshot_thread_.get() == NULL) {
+      snapshot_thread_.reset(new SnapshotThread(this));
+      if (!snapshot_thread_->Start()) {
+        LOG(ERROR) << "Failed to start the frequency snapshot thread.";
+        snapshot_thread_.reset();
+      }
+    }
+  }
+
   LOG(INFO) << "BBEntry client initialized.";
 }
 
@@ -17,6 +17,17 @@
     'chromium_code': 1,
   },
   'targets': [
+    {
+      'target_name': 'basic_block_entry_lib',
+      'type': 'static_library',
+      'sources': [
+        'counter_merge.cc',
+        'counter_merge.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+      ],
+    },
     {
       'target_name': 'basic_block_entry_client',
       'type': 'loadable_module',
@@ -28,6 +39,7 @@
         'basic_block_entry.rc',
       ],
       'dependencies': [
+        'basic_block_entry_lib',
         '<(src)/syzygy/agent/common/common.gyp:agent_common_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/core/core.gyp:core_lib',
@@ -41,10 +53,12 @@
       'type': 'executable',
       'sources': [
         'basic_block_entry_unittest.cc',
+        'counter_merge_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
         'basic_block_entry_client',
+        'basic_block_entry_lib',
         '<(src)/base/base.gyp:base',
         '<(src)/base/base.gyp:test_support_base',
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
@@ -26,9 +26,12 @@
 
 #include <windows.h>
 #include <winnt.h>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include "base/lazy_instance.h"
+#include "base/time/time.h"
 #include "base/win/pe_image.h"
 #include "syzygy/agent/common/thread_state.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -118,6 +121,10 @@ class BasicBlockEntry {
   class ThreadState;
   friend class ThreadState;
 
+  // The background thread taking the frequency snapshots.
+  class SnapshotThread;
+  friend class SnapshotThread;
+
   // Make sure the LazyInstance can be created.
   friend struct base::DefaultLazyInstanceTraits<BasicBlockEntry>;
 
@@ -150,6 +157,23 @@ class BasicBlockEntry {
   // be called if the local thread state has not already been created.
   ThreadState* CreateThreadState(IndexedFrequencyData* module_data);
 
+  // Gives @p state private counters, if its module is snapshotted. Its thread
+  // increments them without locking, and they are merged periodically into
+  // the module table.
+  // @param state the thread state of the calling thread.
+  void AllocatePrivateCounters(ThreadState* state);
+
+  // Merges the private counters of @p state a last time, and stops merging
+  // them. This is called when the thread state is destroyed.
+  // @param state the thread state being destroyed.
+  void ReleasePrivateCounters(ThreadState* state);
+
+  // Merges the private counters of the threads into the module tables, then
+  // writes the tables as TRACE_INDEXED_FREQUENCY snapshots and clears them.
+  // The frequency data of a module is thus the sum of its snapshots and of
+  // the table flushed at tear-down, which is how the grinders read it.
+  void TakeFrequencySnapshots();
+
   // Returns the local thread state for the current thread. If the thread state
   // is unavailable, this function returns NULL.
   static ThreadState* GetThreadState(IndexedFrequencyData* module_data);
@@ -176,6 +200,20 @@ class BasicBlockEntry {
 
   // Global lock to avoid concurrent segment_ update.
   base::Lock lock_;
+
+  // The period of the frequency snapshots, read from kSnapshotPeriodEnvVar.
+  // When it is zero, the threads count directly in the module tables under
+  // lock_, and no snapshot is taken.
+  base::TimeDelta snapshot_period_;
+
+  // The modules whose frequency data is snapshotted.
+  std::vector<IndexedFrequencyData*> snapshot_modules_;  // Under lock_.
+
+  // The thread states counting in private counters.
+  std::set<ThreadState*> private_counter_states_;  // Under lock_.
+
+  // The thread taking the snapshots, started with the first module.
+  std::unique_ptr<SnapshotThread> snapshot_thread_;
 };
 
 }  // namespace basic_block_entry
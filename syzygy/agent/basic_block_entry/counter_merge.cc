@@ -0,0 +1,102 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/basic_block_entry/counter_merge.h"
+
+#include <emmintrin.h>
+
+#include "base/logging.h"
+
+namespace agent {
+namespace basic_block_entry {
+
+namespace {
+
+// Adds two 32-bit values, saturating at 0xFFFFFFFF.
+inline uint32_t AddAndSaturate(uint32_t value, uint32_t delta) {
+  uint32_t sum = value + delta;
+  if (sum < value)
+    return ~0U;
+  return sum;
+}
+
+}  // namespace
+
+void MergeCounters(const uint32_t* counters,
+                   uint32_t* merged,
+                   uint32_t* total,
+                   size_t num_counters) {
+  DCHECK(counters != NULL || num_counters == 0);
+  DCHECK(merged != NULL || num_counters == 0);
+  DCHECK(total != NULL || num_counters == 0);
+
+  // SSE2 has no unsigned comparison, so the overflows are detected by
+  // comparing values with their sign bits flipped.
+  const __m128i sign_bits = _mm_set1_epi32(0x80000000);
+  size_t i = 0;
+  for (; i + 4 <= num_counters; i += 4) {
+    __m128i current =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + i));
+    __m128i previous =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(merged + i));
+    __m128i value = _mm_loadu_si128(reinterpret_cast<__m128i*>(total + i));
+    __m128i delta = _mm_sub_epi32(current, previous);
+    __m128i sum = _mm_add_epi32(value, delta);
+    __m128i overflow = _mm_cmpgt_epi32(_mm_xor_si128(value, sign_bits),
+                                       _mm_xor_si128(sum, sign_bits));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(total + i),
+                     _mm_or_si128(sum, overflow));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(merged + i), current);
+  }
+
+  for (; i < num_counters; ++i) {
+    uint32_t current = *static_cast<const volatile uint32_t*>(counters + i);
+    total[i] = AddAndSaturate(total[i], current - merged[i]);
+    merged[i] = current;
+  }
+}
+
+void MergeCounters(const uint8_t* counters,
+                   uint8_t* merged,
+                   uint8_t* total,
+                   size_t num_counters) {
+  DCHECK(counters != NULL || num_counters == 0);
+  DCHECK(merged != NULL || num_counters == 0);
+  DCHECK(total != NULL || num_counters == 0);
+
+  // The counters are monotonic, so the deltas never wrap and a saturating
+  // unsigned add is all that's needed.
+  size_t i = 0;
+  for (; i + 16 <= num_counters; i += 16) {
+    __m128i current =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + i));
+    __m128i previous =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(merged + i));
+    __m128i value = _mm_loadu_si128(reinterpret_cast<__m128i*>(total + i));
+    __m128i delta = _mm_sub_epi8(current, previous);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(total + i),
+                     _mm_adds_epu8(value, delta));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(merged + i), current);
+  }
+
+  for (; i < num_counters; ++i) {
+    uint8_t current = *static_cast<const volatile uint8_t*>(counters + i);
+    uint32_t sum = total[i] + static_cast<uint8_t>(current - merged[i]);
+    total[i] = static_cast<uint8_t>(sum > 0xFF ? 0xFF : sum);
+    merged[i] = current;
+  }
+}
+
+}  // namespace basic_block_entry
+}  // namespace agent
@@ -0,0 +1,56 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the merge of per-thread frequency counters into a module total.
+// Each thread counts in a private array that only it writes, so that it
+// needs neither a lock nor atomic operations. A merger periodically folds
+// the counts accumulated since its last visit into the total, remembering
+// the values it has already merged.
+
+#ifndef SYZYGY_AGENT_BASIC_BLOCK_ENTRY_COUNTER_MERGE_H_
+#define SYZYGY_AGENT_BASIC_BLOCK_ENTRY_COUNTER_MERGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace agent {
+namespace basic_block_entry {
+
+// Adds the counts accumulated in @p counters since the last merge to
+// @p total, saturating at 0xFFFFFFFF. The counters may be incremented
+// concurrently by their thread: each of them is read once, and the
+// increments that are missed are picked up by the next merge. This uses
+// SSE2 for groups of 4 counters.
+// @param counters the private counters of a thread. They must be
+//     monotonic, which saturating increments are.
+// @param merged the values of @p counters at the last merge, updated with
+//     the values that were merged.
+// @param total the total receiving the counts.
+// @param num_counters the number of elements of the three arrays.
+void MergeCounters(const uint32_t* counters,
+                   uint32_t* merged,
+                   uint32_t* total,
+                   size_t num_counters);
+
+// The same merge for 8-bit counters, saturating at 0xFF. This uses SSE2 for
+// groups of 16 counters.
+void MergeCounters(const uint8_t* counters,
+                   uint8_t* merged,
+                   uint8_t* total,
+                   size_t num_counters);
+
+}  // namespace basic_block_entry
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_BASIC_BLOCK_ENTRY_COUNTER_MERGE_H_
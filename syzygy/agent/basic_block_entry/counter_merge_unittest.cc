@@ -0,0 +1,112 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/basic_block_entry/counter_merge.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace basic_block_entry {
+
+TEST(CounterMergeTest, MergesCountsSinceLastMerge) {
+  // An odd size exercises both the vector and the scalar loops.
+  const size_t kNumCounters = 11;
+  std::vector<uint32_t> counters(kNumCounters, 0);
+  std::vector<uint32_t> merged(kNumCounters, 0);
+  std::vector<uint32_t> total(kNumCounters, 0);
+
+  for (size_t i = 0; i < kNumCounters; ++i)
+    counters[i] = static_cast<uint32_t>(i);
+  MergeCounters(&counters[0], &merged[0], &total[0], kNumCounters);
+  EXPECT_EQ(counters, merged);
+  EXPECT_EQ(counters, total);
+
+  // Only the new counts are added by the next merge.
+  for (size_t i = 0; i < kNumCounters; ++i)
+    counters[i] += 2;
+  MergeCounters(&counters[0], &merged[0], &total[0], kNumCounters);
+  EXPECT_EQ(counters, merged);
+  for (size_t i = 0; i < kNumCounters; ++i)
+    EXPECT_EQ(i + 2, total[i]);
+
+  // A total that was emitted and cleared only receives the new counts.
+  total.assign(kNumCounters, 0);
+  for (size_t i = 0; i < kNumCounters; ++i)
+    counters[i] += 3;
+  MergeCounters(&counters[0], &merged[0], &total[0], kNumCounters);
+  for (size_t i = 0; i < kNumCounters; ++i)
+    EXPECT_EQ(3u, total[i]);
+}
+
+TEST(CounterMergeTest, Saturates) {
+  const size_t kNumCounters = 6;
+  std::vector<uint32_t> counters(kNumCounters, 10);
+  std::vector<uint32_t> merged(kNumCounters, 0);
+  std::vector<uint32_t> total(kNumCounters, ~0U - 5);
+  total[1] = 7;
+  total[5] = 7;
+
+  MergeCounters(&counters[0], &merged[0], &total[0], kNumCounters);
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    if (i == 1 || i == 5) {
+      EXPECT_EQ(17u, total[i]);
+    } else {
+      EXPECT_EQ(~0U, total[i]);
+    }
+  }
+}
+
+TEST(CounterMergeTest, Saturates8Bit) {
+  // 19 counters exercise both the vector and the scalar loops.
+  const size_t kNumCounters = 19;
+  std::vector<uint8_t> counters(kNumCounters, 10);
+  std::vector<uint8_t> merged(kNumCounters, 0);
+  std::vector<uint8_t> total(kNumCounters, 0xFF - 5);
+  total[1] = 7;
+  total[18] = 7;
+
+  MergeCounters(&counters[0], &merged[0], &total[0], kNumCounters);
+  EXPECT_EQ(counters, merged);
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    if (i == 1 || i == 18) {
+      EXPECT_EQ(17u, total[i]);
+    } else {
+      EXPECT_EQ(0xFFu, total[i]);
+    }
+  }
+
+  // Only the new counts are added by the next merge.
+  total.assign(kNumCounters, 0);
+  for (size_t i = 0; i < kNumCounters; ++i)
+    counters[i] += 2;
+  MergeCounters(&counters[0], &merged[0], &total[0], kNumCounters);
+  for (size_t i = 0; i < kNumCounters; ++i)
+    EXPECT_EQ(2u, total[i]);
+}
+
+TEST(CounterMergeTest, Unaligned) {
+  std::vector<uint32_t> counters(9, 1);
+  std::vector<uint32_t> merged(9, 0);
+  std::vector<uint32_t> total(9, 0);
+
+  MergeCounters(&counters[1], &merged[1], &total[1], 8);
+  EXPECT_EQ(0u, total[0]);
+  for (size_t i = 1; i < 9; ++i)
+    EXPECT_EQ(1u, total[i]);
+}
+
+}  // namespace basic_block_entry
+}  // namespace agent
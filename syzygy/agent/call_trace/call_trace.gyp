@@ -33,6 +33,7 @@
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
         '<(src)/syzygy/trace/client/client.gyp:rpc_client_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
         '<(src)/syzygy/version/version.gyp:syzygy_version',
        ],
      },
@@ -36,6 +36,7 @@
 #include "syzygy/common/path_util.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/protocol/compact_record.h"
 
 using agent::client::Client;
 using agent::common::ScopedLastErrorKeeper;
@@ -178,6 +179,13 @@ class Client::ThreadLocalData {
   // Allocates a new enter event.
   TraceEnterEventData* AllocateEnterEvent();
 
+  // Appends an enter event to the current compact batch record, starting a
+  // new record if need be.
+  // @param retaddr the return address of the call.
+  // @param function the function called.
+  // @returns true on success, false otherwise.
+  bool LogCompactEnterEvent(RetAddr retaddr, FuncAddr function);
+
   // Flushes the current trace file segment.
   bool FlushSegment();
 
@@ -191,6 +199,12 @@ class Client::ThreadLocalData {
   // The current batch record we're extending, if any.
   // This will point into the associated trace file segment's buffer.
   TraceBatchEnterData* batch;
+
+  // The current compact batch record we're extending, if any, and the state
+  // of its encoding. This will point into the associated trace file
+  // segment's buffer.
+  TraceCompactBatchEnterData* compact_batch;
+  CompactBatchEnterState compact_state;
 };
 
 Client::Client() {
@@ -361,7 +375,12 @@ void Client::LogEvent_FunctionEntry(EntryFrame *entry_frame,
   //     the accuracy of the time for batch entry events. Do this before adding
   //     this event to the buffer in order to guarantee precision.
 
-  // Capture the basic call info and timestamp.
+  // Capture the basic call info and timestamp, compactly if the call trace
+  // service asks for it.
+  if (session_.IsEnabled(TRACE_FLAG_COMPACT_RECORDS)) {
+    data->LogCompactEnterEvent(entry_frame->retaddr, function);
+    return;
+  }
   TraceEnterEventData* enter = data->AllocateEnterEvent();
   if (enter != NULL) {
     enter->retaddr = entry_frame->retaddr;
@@ -401,7 +420,9 @@ void Client::FreeThreadData() {
     FreeThreadData(data);
 }
 
-Client::ThreadLocalData::ThreadLocalData(Client* c) : client(c), batch(NULL) {
+Client::ThreadLocalData::ThreadLocalData(Client* c)
+    : client(c), batch(NULL), compact_batch(NULL) {
+  ::memset(&compact_state, 0, sizeof(compact_state));
 }
 
 TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
@@ -451,10 +472,54 @@ TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
   return &batch->calls[0];
 }
 
+bool Client::ThreadLocalData::LogCompactEnterEvent(RetAddr retaddr,
+                                                   FuncAddr function) {
+  // Do we have a compact batch record that we can grow? It must still end
+  // the segment. The call is encoded before being copied to the segment, and
+  // the enclosures are only grown once it is written, so the record is
+  // self-consistent at all times.
+  if (compact_batch != NULL) {
+    RecordPrefix* prefix = trace::client::GetRecordPrefix(compact_batch);
+    uint8_t call[kMaxCompactCallSize];
+    CompactBatchEnterState state = compact_state;
+    size_t call_size = EncodeCompactCall(function, retaddr, &state, call);
+    if (compact_batch->data + prefix->size == segment.write_ptr &&
+        segment.CanAllocateRaw(call_size)) {
+      ::memcpy(segment.write_ptr, call, call_size);
+      segment.write_ptr += call_size;
+      segment.header->segment_length += call_size;
+      prefix->size += call_size;
+      compact_state = state;
+      return true;
+    }
+  }
+
+  // Do we need to scarf a new buffer?
+  const size_t kMaxRecordSize = kMaxVarintSize + kMaxCompactCallSize;
+  if (!segment.CanAllocate(kMaxRecordSize)) {
+    if (!client->session_.ExchangeBuffer(&segment))
+      return false;
+  }
+
+  // Start a new record with the call. The record is cleared on allocation, so
+  // it decodes to no call until the call is written.
+  uint8_t record[kMaxRecordSize];
+  uint32_t thread_id = segment.header->thread_id;
+  size_t record_size = EncodeCompactBatchEnterStart(thread_id, thread_id,
+                                                    &compact_state, record);
+  record_size += EncodeCompactCall(function, retaddr, &compact_state,
+                                   record + record_size);
+  compact_batch = segment.AllocateTraceRecord<TraceCompactBatchEnterData>(
+      record_size);
+  ::memcpy(compact_batch->data, record, record_size);
+  return true;
+}
+
 bool Client::ThreadLocalData::FlushSegment() {
   DCHECK(IsInitialized());
 
   batch = NULL;
+  compact_batch = NULL;
   return client->session_.ExchangeBuffer(&segment);
 }
 
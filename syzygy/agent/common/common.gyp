@@ -35,6 +35,8 @@
         'scoped_last_error_keeper.h',
         'stack_capture.cc',
         'stack_capture.h',
+        'stack_unwinder.cc',
+        'stack_unwinder.h',
         'stack_walker.cc',
         'stack_walker.h',
         'thread_state.cc',
@@ -47,6 +49,18 @@
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
       ],
     },
+    {
+      'target_name': 'agent_common_stack_unwinder_benchmark',
+      'type': 'executable',
+      'sources': [
+        'stack_unwinder_benchmark.cc',
+      ],
+      'dependencies': [
+        'agent_common_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+      ],
+    },
     {
       'target_name': 'agent_common_unittests',
       'type': 'executable',
@@ -56,6 +70,7 @@
         'hot_patcher_unittest.cc',
         'process_utils_unittest.cc',
         'stack_capture_unittest.cc',
+        'stack_unwinder_unittest.cc',
         'stack_walker_unittest.cc',
         'thread_state_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
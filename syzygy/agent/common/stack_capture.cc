@@ -14,9 +14,14 @@
 
 #include "syzygy/agent/common/stack_capture.h"
 
+#include <intrin.h>
+
 #include <algorithm>
 
+#include "base/atomicops.h"
+#include "base/lazy_instance.h"
 #include "base/logging.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/agent/common/stack_walker.h"
 #include "syzygy/core/address_space.h"
 
@@ -44,18 +49,77 @@ size_t StackCapture::GetMaxNumFrames(size_t bytes) {
   return bytes;
 }
 
+namespace {
+
+// Atomically replaces the value of a reference count if it is still equal to
+// |old_value|.
+// @param ref_count The reference count to update.
+// @param old_value The expected current value.
+// @param new_value The value to store.
+// @returns true if the value was replaced, false otherwise.
+bool CompareAndSwapRefCount(StackCapture::RefCount* ref_count,
+                            StackCapture::RefCount old_value,
+                            StackCapture::RefCount new_value) {
+  static_assert(sizeof(StackCapture::RefCount) == sizeof(short),
+                "Invalid reference count size.");
+  short old_short = static_cast<short>(old_value);
+  return _InterlockedCompareExchange16(
+             reinterpret_cast<volatile short*>(ref_count),
+             static_cast<short>(new_value), old_short) == old_short;
+}
+
+// @returns the current value of a reference count that may be concurrently
+//     modified.
+StackCapture::RefCount ReadRefCount(const StackCapture::RefCount* ref_count) {
+  return *reinterpret_cast<const volatile StackCapture::RefCount*>(ref_count);
+}
+
+}  // namespace
+
 void StackCapture::AddRef() {
-  if (RefCountIsSaturated())
-    return;
-  DCHECK_GT(kMaxRefCount, ref_count_);
-  ++ref_count_;
+  while (true) {
+    RefCount ref_count = ReadRefCount(&ref_count_);
+    if (ref_count == kMaxRefCount)
+      return;
+    if (CompareAndSwapRefCount(&ref_count_, ref_count, ref_count + 1))
+      return;
+  }
 }
 
 void StackCapture::RemoveRef() {
-  DCHECK_LT(0u, ref_count_);
-  if (RefCountIsSaturated())
-    return;
-  --ref_count_;
+  while (true) {
+    RefCount ref_count = ReadRefCount(&ref_count_);
+    DCHECK_LT(0u, ref_count);
+    if (ref_count == kMaxRefCount)
+      return;
+    if (CompareAndSwapRefCount(&ref_count_, ref_count, ref_count - 1))
+      return;
+  }
+}
+
+bool StackCapture::TryAddRefIfReferenced() {
+  while (true) {
+    RefCount ref_count = ReadRefCount(&ref_count_);
+    if (ref_count == 0)
+      return false;
+    if (ref_count == kMaxRefCount)
+      return true;
+    if (CompareAndSwapRefCount(&ref_count_, ref_count, ref_count + 1))
+      return true;
+  }
+}
+
+bool StackCapture::TryRemoveRefIfNotLast() {
+  while (true) {
+    RefCount ref_count = ReadRefCount(&ref_count_);
+    DCHECK_LT(0u, ref_count);
+    if (ref_count == kMaxRefCount)
+      return true;
+    if (ref_count == 1)
+      return false;
+    if (CompareAndSwapRefCount(&ref_count_, ref_count, ref_count - 1))
+      return true;
+  }
 }
 
 StackId StackCapture::relative_stack_id() const {
@@ -80,19 +144,23 @@ void StackCapture::InitFromBuffer(const void* const* frames,
       std::min<uint8_t>(static_cast<uint8_t>(num_frames), max_num_frames_);
 
   ::memcpy(frames_, frames, num_frames_ * sizeof(*frames_));
+  compact_ = false;
+  fingerprint_ = false;
 
   ComputeAbsoluteStackId();
 }
 
 void StackCapture::InitFromExistingStack(const StackCapture& stack_capture) {
-  DCHECK(stack_capture.frames() != NULL);
+  DCHECK(stack_capture.compact() || stack_capture.frames() != NULL);
   DCHECK_LT(0U, stack_capture.num_frames());
 
   // Determine how many frames we can actually store.
   num_frames_ = std::min<uint8_t>(
       static_cast<uint8_t>(stack_capture.num_frames()), max_num_frames_);
 
-  ::memcpy(frames_, stack_capture.frames(), num_frames_ * sizeof(*frames_));
+  stack_capture.CopyFrames(frames_, num_frames_);
+  compact_ = false;
+  fingerprint_ = stack_capture.fingerprint_;
 
   // If the number of frames differs, we recalculate the stack ID.
   if (num_frames_ == stack_capture.num_frames())
@@ -107,6 +175,8 @@ void StackCapture::InitFromExistingStack(const StackCapture& stack_capture) {
 void __declspec(noinline) StackCapture::InitFromStack() {
   num_frames_ = static_cast<uint8_t>(agent::common::WalkStack(
       1, max_num_frames_, frames_, &absolute_stack_id_));
+  compact_ = false;
+  fingerprint_ = false;
 
   if (bottom_frames_to_skip_) {
     num_frames_ -=
@@ -114,6 +184,16 @@ void __declspec(noinline) StackCapture::InitFromStack() {
     ComputeAbsoluteStackId();
   }
 }
+
+void __declspec(noinline) StackCapture::InitFingerprintFromStack() {
+  size_t max_num_frames =
+      std::min<size_t>(max_num_frames_, kNumFingerprintFrames);
+  num_frames_ = static_cast<uint8_t>(agent::common::WalkStack(
+      1, max_num_frames, frames_, &absolute_stack_id_));
+  compact_ = false;
+  fingerprint_ = true;
+  absolute_stack_id_ = ~absolute_stack_id_;
+}
 #pragma optimize("", on)
 
 namespace {
@@ -149,8 +229,248 @@ HMODULE GetModuleFromAddress(void* address) {
   return instance;
 }
 
+// Returns the address range of the module containing the given address.
+// Returns false if no module is found. If false modules have been injected via
+// the testing seam, will first check those.
+bool GetModuleRangeFromAddress(void* address,
+                               uintptr_t* module_base,
+                               uintptr_t* module_size) {
+  DCHECK_NE(static_cast<uintptr_t*>(nullptr), module_base);
+  DCHECK_NE(static_cast<uintptr_t*>(nullptr), module_size);
+
+  // Try the false module space first.
+  if (!false_module_space.empty()) {
+    FalseModuleSpace::Range range(reinterpret_cast<uintptr_t>(address), 1);
+    auto it = false_module_space.FindContaining(range);
+    if (it != false_module_space.end()) {
+      *module_base = it->first.start();
+      *module_size = it->first.size();
+      return true;
+    }
+  }
+
+  HMODULE module = GetModuleFromAddress(address);
+  if (module == nullptr)
+    return false;
+
+  // The size of a loaded module is found in its headers.
+  const IMAGE_DOS_HEADER* dos_header =
+      reinterpret_cast<const IMAGE_DOS_HEADER*>(module);
+  const IMAGE_NT_HEADERS* nt_headers =
+      reinterpret_cast<const IMAGE_NT_HEADERS*>(
+          reinterpret_cast<const uint8_t*>(module) + dos_header->e_lfanew);
+  *module_base = reinterpret_cast<uintptr_t>(module);
+  *module_size = nt_headers->OptionalHeader.SizeOfImage;
+  return true;
+}
+
+// The process-wide table of the module address ranges referred to by compact
+// stack captures. Index 0 of the encoding refers to no module at all, and
+// index i > 0 to entry i - 1 of the table. Entries are appended under |lock|
+// and never modified nor removed, so they can be read without a lock once
+// published via |count|. A module that is unloaded thus keeps its entry, which
+// is harmless as frames are decoded relative to the stored base address.
+struct CompactModuleTable {
+  static const size_t kMaxModules = 255;
+
+  CompactModuleTable() : count(0) {}
+
+  base::Lock lock;
+  base::subtle::Atomic32 count;
+  uintptr_t bases[kMaxModules];
+  uintptr_t sizes[kMaxModules];
+};
+
+base::LazyInstance<CompactModuleTable>::Leaky compact_module_table =
+    LAZY_INSTANCE_INITIALIZER;
+
+// @returns the base address of the module with the given index in the compact
+//     encoding.
+uintptr_t GetCompactModuleBase(size_t module) {
+  if (module == 0)
+    return 0;
+  CompactModuleTable* table = compact_module_table.Pointer();
+  DCHECK_GE(static_cast<size_t>(base::subtle::Acquire_Load(&table->count)),
+            module);
+  return table->bases[module - 1];
+}
+
+// Finds the index of the module containing the given address in the compact
+// encoding, adding it to the table if need be.
+// @param address The address to look up.
+// @param hint The index of a module that likely contains @p address.
+// @returns the index of the module, or 0 if the address isn't in a module or
+//     if the table is full.
+size_t FindCompactModule(uintptr_t address, size_t hint) {
+  CompactModuleTable* table = compact_module_table.Pointer();
+  size_t count = base::subtle::Acquire_Load(&table->count);
+
+  // Consecutive frames usually lie in the same module.
+  if (hint != 0 && address - table->bases[hint - 1] < table->sizes[hint - 1])
+    return hint;
+  for (size_t i = 0; i < count; ++i) {
+    if (address - table->bases[i] < table->sizes[i])
+      return i + 1;
+  }
+
+  // This is a module we haven't seen yet, so ask the OS.
+  uintptr_t module_base = 0;
+  uintptr_t module_size = 0;
+  if (!GetModuleRangeFromAddress(reinterpret_cast<void*>(address),
+                                 &module_base, &module_size)) {
+    return 0;
+  }
+
+  base::AutoLock lock(table->lock);
+
+  // Another thread may have added this module in the meantime.
+  count = table->count;
+  for (size_t i = 0; i < count; ++i) {
+    if (table->bases[i] == module_base && table->sizes[i] == module_size)
+      return i + 1;
+  }
+  if (count == CompactModuleTable::kMaxModules)
+    return 0;
+
+  table->bases[count] = module_base;
+  table->sizes[count] = module_size;
+  base::subtle::Release_Store(&table->count,
+                              static_cast<base::subtle::Atomic32>(count + 1));
+  return count + 1;
+}
+
+// Writes a variable length unsigned integer.
+// @param value The value to write.
+// @param cursor The position to write at.
+// @returns the position following the written value.
+uint8_t* WriteVarint(uint64_t value, uint8_t* cursor) {
+  while (value >= 0x80) {
+    *cursor++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *cursor++ = static_cast<uint8_t>(value);
+  return cursor;
+}
+
+// Reads a variable length unsigned integer written by WriteVarint.
+// @param cursor The position to read from.
+// @param value Will receive the value.
+// @returns the position following the read value.
+const uint8_t* ReadVarint(const uint8_t* cursor, uint64_t* value) {
+  *value = 0;
+  size_t shift = 0;
+  while (*cursor & 0x80) {
+    *value |= static_cast<uint64_t>(*cursor++ & 0x7F) << shift;
+    shift += 7;
+  }
+  *value |= static_cast<uint64_t>(*cursor++) << shift;
+  return cursor;
+}
+
 }  // namespace
 
+size_t StackCapture::CopyFrames(void** frames, size_t max_num_frames) const {
+  DCHECK_NE(static_cast<void**>(nullptr), frames);
+
+  size_t num_frames = std::min<size_t>(num_frames_, max_num_frames);
+  if (compact_) {
+    DecodeFrames(reinterpret_cast<const uint8_t*>(frames_), num_frames,
+                 frames);
+  } else {
+    ::memcpy(frames, frames_, num_frames * sizeof(*frames_));
+  }
+  return num_frames;
+}
+
+void StackCapture::InitFromEncodedFrames(const uint8_t* data,
+                                         size_t size,
+                                         size_t num_frames,
+                                         StackId absolute_stack_id) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), data);
+  DCHECK_LE(size, max_num_frames_ * sizeof(*frames_));
+  DCHECK_LT(0U, num_frames);
+  DCHECK_GE(kMaxNumFrames, num_frames);
+
+  ::memcpy(frames_, data, size);
+  num_frames_ = static_cast<uint8_t>(num_frames);
+  compact_ = true;
+  fingerprint_ = false;
+  absolute_stack_id_ = absolute_stack_id;
+  relative_stack_id_ = 0;
+}
+
+// static
+size_t StackCapture::EncodeFrames(const void* const* frames,
+                                  size_t num_frames,
+                                  uint8_t* buffer) {
+  DCHECK_NE(static_cast<const void* const*>(nullptr), frames);
+  DCHECK_GE(kMaxNumFrames, num_frames);
+  DCHECK_NE(static_cast<uint8_t*>(nullptr), buffer);
+
+  // Each frame is encoded as a tag holding the zigzag encoded delta between
+  // its offset in its module and the one of the previous frame, and a bit
+  // indicating that the module differs from the one of the previous frame.
+  // In that case the tag is followed by the index of the module, and the delta
+  // is relative to the beginning of the module. Frames outside of any module
+  // are relative to address 0. User-mode addresses are small enough for the
+  // tag to fit in 64 bits.
+  uint8_t* cursor = buffer;
+  size_t module = 0;
+  uintptr_t module_base = 0;
+  uint64_t previous_offset = 0;
+  for (size_t i = 0; i < num_frames; ++i) {
+    uintptr_t frame = reinterpret_cast<uintptr_t>(frames[i]);
+    size_t frame_module = FindCompactModule(frame, module);
+    bool switched = frame_module != module;
+    if (switched) {
+      module = frame_module;
+      module_base = GetCompactModuleBase(module);
+      previous_offset = 0;
+    }
+
+    uint64_t offset = frame - module_base;
+    int64_t delta = static_cast<int64_t>(offset - previous_offset);
+    uint64_t zigzag = (static_cast<uint64_t>(delta) << 1) ^
+                      static_cast<uint64_t>(delta >> 63);
+    cursor = WriteVarint((zigzag << 1) | (switched ? 1 : 0), cursor);
+    if (switched)
+      cursor = WriteVarint(module, cursor);
+    previous_offset = offset;
+  }
+
+  size_t size = cursor - buffer;
+  DCHECK_GE(kMaxEncodedSize, size);
+  return size;
+}
+
+// static
+void StackCapture::DecodeFrames(const uint8_t* data,
+                                size_t num_frames,
+                                void** frames) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), data);
+  DCHECK_NE(static_cast<void**>(nullptr), frames);
+
+  uintptr_t module_base = 0;
+  uint64_t previous_offset = 0;
+  for (size_t i = 0; i < num_frames; ++i) {
+    uint64_t tag = 0;
+    data = ReadVarint(data, &tag);
+    if (tag & 1) {
+      uint64_t module = 0;
+      data = ReadVarint(data, &module);
+      module_base = GetCompactModuleBase(static_cast<size_t>(module));
+      previous_offset = 0;
+    }
+
+    uint64_t zigzag = tag >> 1;
+    uint64_t delta = (zigzag >> 1) ^ (0 - (zigzag & 1));
+    uint64_t offset = previous_offset + delta;
+    frames[i] = reinterpret_cast<void*>(
+        module_base + static_cast<uintptr_t>(offset));
+    previous_offset = offset;
+  }
+}
+
 void StackCapture::AddFalseModule(
     const char* name, void* address, size_t length) {
   FalseModuleSpace::Range range(reinterpret_cast<uintptr_t>(address),
@@ -178,17 +498,26 @@ void StackCapture::ComputeRelativeStackId() const {
   DCHECK(asan_handle != NULL);
   DCHECK(!relative_stack_id_);
 
+  // Compact stack captures are decoded on demand.
+  const void* const* frames = frames_;
+  void* decoded_frames[kMaxNumFrames];
+  if (compact_) {
+    DecodeFrames(reinterpret_cast<const uint8_t*>(frames_), num_frames_,
+                 decoded_frames);
+    frames = decoded_frames;
+  }
+
   relative_stack_id_ = StartStackId();
   for (size_t i = 0; i < num_frames_; ++i) {
     // NULL stack frames may be returned from ::CaptureStackBackTrace.
     // This has been observed on Windows 8.
-    if (frames_[i] == nullptr)
+    if (frames[i] == nullptr)
       continue;
 
     // Entirely skip frames that lie inside this module. This allows the
     // relative stack ID to be stable across different versions of the RTL
     // even if stack depth/layout changes.
-    HMODULE module = GetModuleFromAddress(frames_[i]);
+    HMODULE module = GetModuleFromAddress(const_cast<void*>(frames[i]));
     if (module == asan_handle)
       continue;
 
@@ -198,7 +527,7 @@ void StackCapture::ComputeRelativeStackId() const {
     if (module != nullptr) {
       // For frames that fall within a module, consider their relative address
       // in the module.
-      frame = reinterpret_cast<uintptr_t>(frames_[i]) -
+      frame = reinterpret_cast<uintptr_t>(frames[i]) -
               reinterpret_cast<uintptr_t>(module);
     }
 
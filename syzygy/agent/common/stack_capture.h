@@ -14,6 +14,13 @@
 //
 // Declares a utility class for getting and storing quick and dirty stack
 // captures.
+//
+// A stack capture can also hold its frames in a compact encoding, which is
+// meant for long-lived captures that are seldom inspected. Each frame is then
+// stored as a variable length delta from the previous frame of the same
+// module, and the module is only identified when it differs from the one of
+// the previous frame. Modules are identified by their index in a process-wide
+// append-only table of module address ranges.
 
 #ifndef SYZYGY_AGENT_COMMON_STACK_CAPTURE_H_
 #define SYZYGY_AGENT_COMMON_STACK_CAPTURE_H_
@@ -42,19 +49,31 @@ class StackCapture {
 
   using StackId = ::common::AsanStackId;
 
+  // The maximum number of bytes used by the compact encoding of a frame, and
+  // the size of a buffer able to hold any compact encoding of frames.
+  static const size_t kMaxEncodedFrameSize = 12;
+  static const size_t kMaxEncodedSize = kMaxNumFrames * kMaxEncodedFrameSize;
+
+  // The number of frames in a caller-address fingerprint.
+  static const size_t kNumFingerprintFrames = 4;
+
   StackCapture()
       : ref_count_(0),
         absolute_stack_id_(0),
         relative_stack_id_(0),
         num_frames_(0),
-        max_num_frames_(kMaxNumFrames) {}
+        max_num_frames_(kMaxNumFrames),
+        compact_(false),
+        fingerprint_(false) {}
 
   explicit StackCapture(size_t max_num_frames)
       : ref_count_(0),
         absolute_stack_id_(0),
         relative_stack_id_(0),
         num_frames_(0),
-        max_num_frames_(0) {
+        max_num_frames_(0),
+        compact_(false),
+        fingerprint_(false) {
     DCHECK_LT(0u, max_num_frames);
     DCHECK_GE(kMaxNumFrames, max_num_frames);
     max_num_frames_ = static_cast<uint8_t>(max_num_frames);
@@ -83,12 +102,27 @@ class StackCapture {
   // @returns true if this stack trace capture contains valid frame pointers.
   bool IsValid() const { return num_frames_ != 0; }
 
-  // Increments the reference count of this stack capture.
+  // Increments the reference count of this stack capture. This is atomic with
+  // respect to the other reference counting functions.
   void AddRef();
 
-  // Decrements the reference count of this stack capture.
+  // Decrements the reference count of this stack capture. This is atomic with
+  // respect to the other reference counting functions.
   void RemoveRef();
 
+  // Increments the reference count of this stack capture, but only if it
+  // currently has at least one reference. This is used by lock-free lookups
+  // so that they never resurrect a stack capture that is being reclaimed.
+  // @returns true if a reference was added or the reference count is
+  //     saturated, false if the stack capture has no references.
+  bool TryAddRefIfReferenced();
+
+  // Decrements the reference count of this stack capture, but only if this
+  // isn't the last reference.
+  // @returns true if a reference was removed or the reference count is
+  //     saturated, false if this is the last reference.
+  bool TryRemoveRefIfNotLast();
+
   // @returns true if the reference count is saturated, false otherwise. A
   //     saturated reference count means that further calls to AddRef and
   //     RemoveRef will be nops, and HasNoRefs will always return false.
@@ -110,15 +144,30 @@ class StackCapture {
   size_t num_frames() const { return num_frames_; }
 
   // @returns the maximum number of valid frame pointers in this stack trace
-  //     capture.
+  //     capture. For a compact stack capture this is the size of its storage,
+  //     in frame pointers, and may be less than num_frames().
   size_t max_num_frames() const { return max_num_frames_; }
 
+  // @returns true if the frames of this stack capture are stored in the
+  //     compact encoding.
+  bool compact() const { return compact_; }
+
+  // @returns true if this stack capture only holds a caller-address
+  //     fingerprint rather than the full stack. See InitFingerprintFromStack.
+  bool fingerprint() const { return fingerprint_; }
+
   // @returns a pointer to the stack frames array, or NULL if the array has a
-  //     size of 0.
+  //     size of 0 or if the frames are stored in the compact encoding.
   const void* const* frames() const {
-    return max_num_frames_ != 0 ? frames_ : NULL;
+    return max_num_frames_ != 0 && !compact_ ? frames_ : NULL;
   }
 
+  // Copies the frames of this stack capture, decoding them if need be.
+  // @param frames The buffer that will receive the frames.
+  // @param max_num_frames The number of frames that @p frames can hold.
+  // @returns the number of frames that were copied.
+  size_t CopyFrames(void** frames, size_t max_num_frames) const;
+
   // Set the number of bottom frames to skip per stack trace. This is needed to
   // be able to improve the stack cache compression in Chrome's unittests where
   // the bottom of the stack traces is different for each test case.
@@ -142,11 +191,41 @@ class StackCapture {
   // @param stack_capture The existing stack trace that will be copied.
   void InitFromExistingStack(const StackCapture& stack_capture);
 
+  // Initializes a compact stack trace from frames encoded by EncodeFrames.
+  // @param data The encoded frames.
+  // @param size The size of the encoded frames, in bytes. This must fit in
+  //     max_num_frames() frame pointers.
+  // @param num_frames The number of encoded frames.
+  // @param absolute_stack_id The absolute ID of the encoded stack.
+  void InitFromEncodedFrames(const uint8_t* data,
+                             size_t size,
+                             size_t num_frames,
+                             StackId absolute_stack_id);
+
+  // Encodes frames in the compact encoding.
+  // @param frames The frames to encode.
+  // @param num_frames The number of frames to encode. Must be no greater than
+  //     kMaxNumFrames.
+  // @param buffer The buffer that will receive the encoded frames. Must be at
+  //     least kMaxEncodedSize bytes.
+  // @returns the size of the encoded frames, in bytes.
+  static size_t EncodeFrames(const void* const* frames,
+                             size_t num_frames,
+                             uint8_t* buffer);
+
   // Initializes a stack trace from the actual stack. Does not report the
   // frame created by 'InitFromStack' itself. This function must not be inlined
   // as it assumes that the call to it generates a full stack frame.
   void __declspec(noinline) InitFromStack();
 
+  // Initializes a caller-address fingerprint from the actual stack. This only
+  // walks the kNumFingerprintFrames innermost frames, which is much cheaper
+  // than a full stack walk, and doesn't skip any bottom frames. Fingerprints
+  // never share their absolute ID with a full stack capture of the same
+  // frames. This function must not be inlined for the same reasons as
+  // InitFromStack.
+  void __declspec(noinline) InitFingerprintFromStack();
+
   // @name Testing seams.
   // @{
   // Allows injecting false modules for use in computing the relative stack ID.
@@ -195,6 +274,13 @@ class StackCapture {
   // count and never be removed from the stack cache.
   RefCount ref_count_;
 
+  // Indicates if frames_ holds the compact encoding of the frames rather than
+  // the frame pointers.
+  bool compact_;
+
+  // Indicates if this stack capture only holds a caller-address fingerprint.
+  bool fingerprint_;
+
   // The array or frame pointers comprising this stack trace capture.
   // This is a runtime dynamic array whose actual length is max_num_frames_, but
   // we use the maximum length here so that other users of StackCapture can
@@ -202,6 +288,14 @@ class StackCapture {
   // NOTE: This must be the last member of the class.
   void* frames_[kMaxNumFrames];
 
+  // Decodes compact frames.
+  // @param data The encoded frames.
+  // @param num_frames The number of frames to decode.
+  // @param frames Will receive the @p num_frames decoded frames.
+  static void DecodeFrames(const uint8_t* data,
+                           size_t num_frames,
+                           void** frames);
+
   // Computes a simple hash of a given stack trace, referred to as the absolute
   // stack id and sets the value in |absolute_stack_id_|.
   void ComputeAbsoluteStackId();
@@ -96,6 +96,31 @@ TEST_F(StackCaptureTest, InitFromStack) {
   EXPECT_EQ(StackCapture::kMaxNumFrames, capture.max_num_frames());
 }
 
+TEST_F(StackCaptureTest, InitFingerprintFromStack) {
+  const size_t kNumFingerprintFrames = StackCapture::kNumFingerprintFrames;
+  StackCapture capture;
+  capture.InitFingerprintFromStack();
+  EXPECT_TRUE(capture.IsValid());
+  EXPECT_TRUE(capture.fingerprint());
+  EXPECT_LT(0u, capture.num_frames());
+  EXPECT_GE(kNumFingerprintFrames, capture.num_frames());
+
+  // A full capture of the same frames has a different ID.
+  StackCapture full_capture;
+  full_capture.InitFromBuffer(capture.frames(), capture.num_frames());
+  EXPECT_FALSE(full_capture.fingerprint());
+  EXPECT_NE(capture.absolute_stack_id(), full_capture.absolute_stack_id());
+
+  // Copies remain fingerprints.
+  StackCapture copy;
+  copy.InitFromExistingStack(capture);
+  EXPECT_TRUE(copy.fingerprint());
+  EXPECT_EQ(capture.absolute_stack_id(), copy.absolute_stack_id());
+
+  capture.InitFromStack();
+  EXPECT_FALSE(capture.fingerprint());
+}
+
 TEST_F(StackCaptureTest, InitFromExistingStack) {
   StackCapture capture;
   capture.InitFromStack();
@@ -109,6 +134,88 @@ TEST_F(StackCaptureTest, InitFromExistingStack) {
     EXPECT_EQ(capture.frames()[i], copy.frames()[i]);
 }
 
+TEST_F(StackCaptureTest, CompactEncoding) {
+  StackCapture::set_bottom_frames_to_skip(0);
+  StackCapture capture;
+  capture.InitFromStack();
+  ASSERT_LT(0u, capture.num_frames());
+
+  // Mix in frames that don't lie in any module.
+  void* frames[StackCapture::kMaxNumFrames] = {};
+  size_t num_frames = capture.CopyFrames(frames, arraysize(frames));
+  EXPECT_EQ(capture.num_frames(), num_frames);
+  if (num_frames < arraysize(frames))
+    frames[num_frames++] = nullptr;
+  if (num_frames < arraysize(frames))
+    frames[num_frames++] = reinterpret_cast<void*>(0x1000);
+
+  uint8_t buffer[StackCapture::kMaxEncodedSize] = {};
+  size_t size = StackCapture::EncodeFrames(frames, num_frames, buffer);
+  EXPECT_LT(0u, size);
+
+  size_t max_num_frames = (size + sizeof(void*) - 1) / sizeof(void*);
+  StackCapture compact(max_num_frames);
+  compact.InitFromEncodedFrames(buffer, size, num_frames,
+                                capture.absolute_stack_id());
+  EXPECT_TRUE(compact.IsValid());
+  EXPECT_TRUE(compact.compact());
+  EXPECT_TRUE(compact.frames() == NULL);
+  EXPECT_EQ(num_frames, compact.num_frames());
+  EXPECT_EQ(capture.absolute_stack_id(), compact.absolute_stack_id());
+
+  // The frames are decoded on demand.
+  void* decoded[StackCapture::kMaxNumFrames] = {};
+  EXPECT_EQ(num_frames, compact.CopyFrames(decoded, arraysize(decoded)));
+  for (size_t i = 0; i < num_frames; ++i)
+    EXPECT_EQ(frames[i], decoded[i]);
+  EXPECT_EQ(2u, compact.CopyFrames(decoded, 2));
+
+  // Copying a compact stack capture decodes it.
+  StackCapture copy;
+  copy.InitFromExistingStack(compact);
+  EXPECT_FALSE(copy.compact());
+  EXPECT_EQ(num_frames, copy.num_frames());
+  for (size_t i = 0; i < num_frames; ++i)
+    EXPECT_EQ(frames[i], copy.frames()[i]);
+}
+
+TEST_F(StackCaptureTest, CompactEncodingSize) {
+  // Frames that are close to each other in a module take a byte each, with
+  // the index of the module following the first one.
+  uint8_t* module = reinterpret_cast<uint8_t*>(0x10000000);
+  StackCapture::AddFalseModule("foo.dll", module, 0x100000);
+  void* frames[StackCapture::kMaxNumFrames] = {};
+  for (size_t i = 0; i < arraysize(frames); ++i)
+    frames[i] = module + 0x8 + i * 0x10;
+
+  uint8_t buffer[StackCapture::kMaxEncodedSize] = {};
+  size_t size = StackCapture::EncodeFrames(frames, arraysize(frames), buffer);
+  EXPECT_EQ(arraysize(frames) + 1, size);
+
+  void* decoded[StackCapture::kMaxNumFrames] = {};
+  StackCapture compact((size + sizeof(void*) - 1) / sizeof(void*));
+  compact.InitFromEncodedFrames(buffer, size, arraysize(frames), 42);
+  EXPECT_EQ(arraysize(frames), compact.CopyFrames(decoded, arraysize(decoded)));
+  for (size_t i = 0; i < arraysize(frames); ++i)
+    EXPECT_EQ(frames[i], decoded[i]);
+
+  StackCapture::ClearFalseModules();
+}
+
+TEST_F(StackCaptureTest, CompactRelativeStackId) {
+  StackCapture::set_bottom_frames_to_skip(0);
+  StackCapture capture;
+  capture.InitFromStack();
+
+  uint8_t buffer[StackCapture::kMaxEncodedSize] = {};
+  size_t size = StackCapture::EncodeFrames(capture.frames(),
+                                           capture.num_frames(), buffer);
+  StackCapture compact;
+  compact.InitFromEncodedFrames(buffer, size, capture.num_frames(),
+                                capture.absolute_stack_id());
+  EXPECT_EQ(capture.relative_stack_id(), compact.relative_stack_id());
+}
+
 TEST_F(StackCaptureTest, RestrictedFrameCount) {
   StackCapture::set_bottom_frames_to_skip(0);
   // Restrict this to a stack depth that is smaller than the stack depth of
@@ -148,5 +255,35 @@ TEST_F(StackCaptureTest, RelativeStackId) {
   EXPECT_EQ(123456U, test_stack_capture.relative_stack_id());
 }
 
+TEST_F(StackCaptureTest, ConditionalRefCounting) {
+  StackCapture capture;
+  EXPECT_TRUE(capture.HasNoRefs());
+
+  // An unreferenced capture can't be referenced conditionally.
+  EXPECT_FALSE(capture.TryAddRefIfReferenced());
+  EXPECT_TRUE(capture.HasNoRefs());
+
+  capture.AddRef();
+  EXPECT_TRUE(capture.TryAddRefIfReferenced());
+  EXPECT_EQ(2u, capture.ref_count());
+
+  EXPECT_TRUE(capture.TryRemoveRefIfNotLast());
+  EXPECT_EQ(1u, capture.ref_count());
+
+  // The last reference can't be removed conditionally.
+  EXPECT_FALSE(capture.TryRemoveRefIfNotLast());
+  EXPECT_EQ(1u, capture.ref_count());
+  capture.RemoveRef();
+  EXPECT_TRUE(capture.HasNoRefs());
+
+  // Saturated reference counts are sticky.
+  for (size_t i = 0; i < StackCapture::kMaxRefCount; ++i)
+    capture.AddRef();
+  EXPECT_TRUE(capture.RefCountIsSaturated());
+  EXPECT_TRUE(capture.TryAddRefIfReferenced());
+  EXPECT_TRUE(capture.TryRemoveRefIfNotLast());
+  EXPECT_TRUE(capture.RefCountIsSaturated());
+}
+
 }  // namespace common
 }  // namespace agent
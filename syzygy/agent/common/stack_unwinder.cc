@@ -0,0 +1,255 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/stack_unwinder.h"
+
+#include <intrin.h>
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/win/pe_image.h"
+#include "syzygy/agent/common/stack_capture.h"
+#include "syzygy/common/process_utils.h"
+
+namespace agent {
+namespace common {
+
+#ifdef _WIN64
+
+namespace {
+
+// Orders addresses and function entries by the starts of the functions.
+bool IsBeforeFunction(uint32_t rva, const RUNTIME_FUNCTION& function) {
+  return rva < function.BeginAddress;
+}
+
+// Advances @p context by a frame.
+// @param unwinder the unwinder looking up the function entries.
+// @param context the context of a frame, whose stack pointer has been
+//     checked to be in the stack.
+void UnwindFrame(const StackUnwinder* unwinder, CONTEXT* context) {
+  uintptr_t image_base = 0;
+  const RUNTIME_FUNCTION* function =
+      unwinder->LookupFunctionEntry(context->Rip, &image_base);
+
+  // A leaf function has no unwind information, and leaves its return address
+  // at the top of the stack.
+  if (function == nullptr) {
+    context->Rip = *reinterpret_cast<const DWORD64*>(context->Rsp);
+    context->Rsp += sizeof(DWORD64);
+    return;
+  }
+
+  void* handler_data = nullptr;
+  DWORD64 establisher_frame = 0;
+  ::RtlVirtualUnwind(UNW_FLAG_NHANDLER, image_base, context->Rip,
+                     const_cast<RUNTIME_FUNCTION*>(function), context,
+                     &handler_data, &establisher_frame, nullptr);
+}
+
+}  // namespace
+
+#endif  // _WIN64
+
+StackUnwinder::StackUnwinder() : cycle_budget_(kDefaultCycleBudget) {
+}
+
+StackUnwinder::~StackUnwinder() {
+  dll_watcher_.Reset();
+}
+
+bool StackUnwinder::Init() {
+#ifdef _WIN64
+  // The watcher is set up first so that no module is missed. A module that
+  // loads in between is indexed twice, which is harmless.
+  if (!dll_watcher_.Init(base::Bind(&StackUnwinder::OnDllEvent,
+                                    base::Unretained(this)))) {
+    return false;
+  }
+
+  ::common::ModuleVector modules;
+  if (!::common::GetCurrentProcessModules(&modules))
+    return false;
+  for (HMODULE module : modules)
+    AddModule(module);
+#endif  // _WIN64
+
+  // There are no unwind tables to index on x86, whose frames are walked
+  // through their frame pointers.
+  return true;
+}
+
+#ifdef _WIN64
+
+size_t __declspec(noinline) StackUnwinder::Unwind(
+    uint32_t bottom_frames_to_skip,
+    uint32_t max_frame_count,
+    void** frames,
+    StackId* absolute_stack_id) {
+  DCHECK_NE(static_cast<void**>(nullptr), frames);
+  DCHECK_NE(static_cast<StackId*>(nullptr), absolute_stack_id);
+
+  uint64_t deadline = ::__rdtsc() + cycle_budget_;
+  *absolute_stack_id = StackCapture::StartStackId();
+
+  // The stack limit moves down as the stack grows, so the bounds are read
+  // from the TIB of the thread, which is where the system keeps them, rather
+  // than being cached.
+  NT_TIB* tib = reinterpret_cast<NT_TIB*>(NtCurrentTeb());
+  DWORD64 stack_bottom = reinterpret_cast<DWORD64>(tib->StackLimit);
+  DWORD64 stack_top = reinterpret_cast<DWORD64>(tib->StackBase);
+
+  CONTEXT context = {};
+  ::RtlCaptureContext(&context);
+
+  // The first frame unwound is our own, which returns to our caller.
+  size_t frames_to_skip = bottom_frames_to_skip;
+  size_t num_frames = 0;
+  while (num_frames < max_frame_count) {
+    // The stack pointer must be in the stack, and move up with each frame,
+    // so that a damaged stack can't make the walk loop or fault.
+    DWORD64 rsp = context.Rsp;
+    if (rsp < stack_bottom || rsp > stack_top - sizeof(DWORD64))
+      break;
+    UnwindFrame(this, &context);
+    if (context.Rip == 0 || context.Rsp <= rsp)
+      break;
+
+    if (frames_to_skip != 0) {
+      --frames_to_skip;
+    } else {
+      void* frame = reinterpret_cast<void*>(context.Rip);
+      frames[num_frames] = frame;
+      ++num_frames;
+      *absolute_stack_id =
+          StackCapture::UpdateStackId(*absolute_stack_id, frame);
+    }
+
+    // Reading the time stamp counter is cheap next to unwinding a frame.
+    if (::__rdtsc() > deadline)
+      break;
+  }
+
+  *absolute_stack_id =
+      StackCapture::FinalizeStackId(*absolute_stack_id, num_frames);
+  return num_frames;
+}
+
+void StackUnwinder::AddModule(HMODULE module) {
+  DCHECK_NE(static_cast<HMODULE>(nullptr), module);
+
+  base::win::PEImage image(module);
+  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
+  ModuleTable table = {};
+  table.end = reinterpret_cast<uintptr_t>(module) +
+              nt_headers->OptionalHeader.SizeOfImage;
+  table.functions = reinterpret_cast<const RUNTIME_FUNCTION*>(
+      image.GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_EXCEPTION));
+  table.num_functions =
+      image.GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_EXCEPTION) /
+      sizeof(RUNTIME_FUNCTION);
+  if (table.functions == nullptr)
+    table.num_functions = 0;
+
+  base::AutoLock lock(lock_);
+  modules_[reinterpret_cast<uintptr_t>(module)] = table;
+}
+
+void StackUnwinder::RemoveModule(HMODULE module) {
+  base::AutoLock lock(lock_);
+  modules_.erase(reinterpret_cast<uintptr_t>(module));
+}
+
+const RUNTIME_FUNCTION* StackUnwinder::LookupFunctionEntry(
+    uintptr_t pc,
+    uintptr_t* image_base) const {
+  DCHECK_NE(static_cast<uintptr_t*>(nullptr), image_base);
+
+  {
+    base::AutoLock lock(lock_);
+    ModuleTableMap::const_iterator module = modules_.upper_bound(pc);
+    if (module != modules_.begin()) {
+      --module;
+      if (pc < module->second.end) {
+        // The function entries of a module are sorted by their start.
+        const ModuleTable& table = module->second;
+        uint32_t rva = static_cast<uint32_t>(pc - module->first);
+        const RUNTIME_FUNCTION* end = table.functions + table.num_functions;
+        const RUNTIME_FUNCTION* function = std::upper_bound(
+            table.functions, end, rva, &IsBeforeFunction);
+        *image_base = module->first;
+        if (function == table.functions)
+          return nullptr;
+        --function;
+        if (rva >= function->EndAddress)
+          return nullptr;
+        return function;
+      }
+    }
+  }
+
+  // The code isn't in a module, and may have registered its tables with
+  // RtlAddFunctionTable.
+  DWORD64 base = 0;
+  const RUNTIME_FUNCTION* function =
+      ::RtlLookupFunctionEntry(pc, &base, nullptr);
+  *image_base = static_cast<uintptr_t>(base);
+  return function;
+}
+
+#else  // _WIN64
+
+size_t __declspec(noinline) StackUnwinder::Unwind(
+    uint32_t bottom_frames_to_skip,
+    uint32_t max_frame_count,
+    void** frames,
+    StackId* absolute_stack_id) {
+  // Walking a frame through its frame pointer takes a few cycles, so the
+  // walk is bounded by the number of frames rather than by the budget.
+  return WalkStack(bottom_frames_to_skip + 1, max_frame_count, frames,
+                   absolute_stack_id);
+}
+
+void StackUnwinder::AddModule(HMODULE module) {
+}
+
+void StackUnwinder::RemoveModule(HMODULE module) {
+}
+
+#endif  // _WIN64
+
+size_t StackUnwinder::num_modules() const {
+  base::AutoLock lock(lock_);
+  return modules_.size();
+}
+
+void StackUnwinder::OnDllEvent(DllNotificationWatcher::EventType type,
+                               HMODULE module,
+                               size_t module_size,
+                               const base::StringPiece16& dll_path,
+                               const base::StringPiece16& dll_base_name) {
+  switch (type) {
+    case DllNotificationWatcher::kDllLoaded:
+      AddModule(module);
+      break;
+
+    case DllNotificationWatcher::kDllUnloaded:
+      RemoveModule(module);
+      break;
+  }
+}
+
+}  // namespace common
+}  // namespace agent
@@ -0,0 +1,133 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares StackUnwinder, a stack walker for the agents that is cheaper than
+// RtlCaptureStackBackTrace. On x64 it unwinds the frames through the unwind
+// tables of the modules, which it indexes as they load rather than looking
+// them up for every frame of every capture. On x86 the frames are walked
+// through their frame pointers, by WalkStack.
+//
+// A capture stops after a budget of cycles, so that a deep or damaged stack
+// doesn't stall the heap call that is being traced. The frames walked so far
+// are kept, and the stack ID of a truncated capture is computed from them.
+
+#ifndef SYZYGY_AGENT_COMMON_STACK_UNWINDER_H_
+#define SYZYGY_AGENT_COMMON_STACK_UNWINDER_H_
+
+#include <windows.h>
+#include <stdint.h>
+#include <map>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/common/dll_notifications.h"
+#include "syzygy/agent/common/stack_walker.h"
+
+namespace agent {
+namespace common {
+
+class StackUnwinder {
+ public:
+  // The default maximum number of cycles spent on a capture.
+  static const uint64_t kDefaultCycleBudget = 100000;
+
+  StackUnwinder();
+  ~StackUnwinder();
+
+  // Indexes the unwind tables of the loaded modules, and of the modules that
+  // are loaded afterwards.
+  // @returns true on success.
+  bool Init();
+
+  // Walks the current stack. Does not consider its own stack frame.
+  // @param bottom_frames_to_skip The number of frames to skip from the bottom
+  //     of the stack.
+  // @param max_frame_count The maximum number of frames that can be written
+  //     to @p frames.
+  // @param frames The array to be populated with the computed frames.
+  // @param absolute_stack_id Pointer to the stack ID that will be calculated
+  //     as we are walking the stack.
+  // @returns the number of frames successfully walked and stored in
+  //     @p frames.
+  size_t __declspec(noinline) Unwind(uint32_t bottom_frames_to_skip,
+                                     uint32_t max_frame_count,
+                                     void** frames,
+                                     StackId* absolute_stack_id);
+
+  // @name Accessors and mutators.
+  // @{
+  uint64_t cycle_budget() const { return cycle_budget_; }
+  void set_cycle_budget(uint64_t cycle_budget) {
+    cycle_budget_ = cycle_budget;
+  }
+  // @}
+
+  // Indexes the unwind table of a module. This is a no-op on x86.
+  // @param module the module.
+  void AddModule(HMODULE module);
+
+  // Drops the unwind table of a module, which is being unloaded.
+  // @param module the module.
+  void RemoveModule(HMODULE module);
+
+  // @returns the number of indexed modules.
+  size_t num_modules() const;
+
+#ifdef _WIN64
+  // Looks up the unwind information of a function, in the indexed modules
+  // and then through RtlLookupFunctionEntry for the code that isn't in one.
+  // @param pc an address in the function.
+  // @param image_base receives the base of the module of the function.
+  // @returns the function entry, or nullptr for a leaf function.
+  const RUNTIME_FUNCTION* LookupFunctionEntry(uintptr_t pc,
+                                              uintptr_t* image_base) const;
+#endif
+
+ protected:
+  // The unwind table of a module.
+  struct ModuleTable {
+    uintptr_t end;
+    const RUNTIME_FUNCTION* functions;
+    size_t num_functions;
+  };
+  // The indexed modules, by base address.
+  typedef std::map<uintptr_t, ModuleTable> ModuleTableMap;
+
+  // Keeps the module tables up to date.
+  void OnDllEvent(DllNotificationWatcher::EventType type,
+                  HMODULE module,
+                  size_t module_size,
+                  const base::StringPiece16& dll_path,
+                  const base::StringPiece16& dll_base_name);
+
+  // The maximum number of cycles spent on a capture.
+  uint64_t cycle_budget_;
+
+  // Protects the module tables. This is only held to look up a function, so
+  // that concurrent captures only contend briefly.
+  mutable base::Lock lock_;
+  ModuleTableMap modules_;  // Under lock_.
+
+  // Notifies us of the modules being loaded and unloaded.
+  DllNotificationWatcher dll_watcher_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StackUnwinder);
+};
+
+}  // namespace common
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_COMMON_STACK_UNWINDER_H_
@@ -0,0 +1,121 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A micro-benchmark comparing the ways the agents capture a stack: the
+// frame pointer walk of WalkStack, CaptureStackBackTrace, and StackUnwinder.
+// The captures are made at the bottom of a range of recursion depths. Prints
+// the mean number of cycles per capture of each.
+
+#include <windows.h>
+#include <intrin.h>
+#include <stdio.h>
+
+#include "syzygy/agent/common/stack_unwinder.h"
+#include "syzygy/agent/common/stack_walker.h"
+
+namespace {
+
+using agent::common::StackId;
+using agent::common::StackUnwinder;
+
+// The recursion depths at which the stacks are captured.
+const size_t kDepths[] = {1, 4, 16, 64};
+
+// The maximum number of frames of a capture, that of a StackCapture.
+const size_t kMaxFrames = 62;
+
+// The number of captures that are timed for each way and depth.
+const size_t kIterations = 10000;
+
+enum CaptureType {
+  kWalkStack,
+  kCaptureStackBackTrace,
+  kStackUnwinder,
+};
+
+// The cycles per capture, and the number of frames captured, at the bottom
+// of a recursion.
+struct Timing {
+  double cycles;
+  size_t num_frames;
+};
+
+void Capture(CaptureType type, StackUnwinder* unwinder, Timing* timing) {
+  void* frames[kMaxFrames];
+  StackId stack_id = 0;
+  uint64_t total = 0;
+  size_t num_frames = 0;
+  for (size_t i = 0; i < kIterations; ++i) {
+    uint64_t t0 = ::__rdtsc();
+    switch (type) {
+      case kWalkStack:
+        num_frames = agent::common::WalkStack(0, kMaxFrames, frames,
+                                              &stack_id);
+        break;
+      case kCaptureStackBackTrace:
+        num_frames = ::CaptureStackBackTrace(
+            0, kMaxFrames, frames, reinterpret_cast<PDWORD>(&stack_id));
+        break;
+      case kStackUnwinder:
+        num_frames = unwinder->Unwind(0, kMaxFrames, frames, &stack_id);
+        break;
+    }
+    uint64_t t1 = ::__rdtsc();
+    total += t1 - t0;
+  }
+  timing->cycles = static_cast<double>(total) / kIterations;
+  timing->num_frames = num_frames;
+}
+
+// Recurses to @p depth frames before capturing. This isn't inlined, so that
+// each level is a frame.
+void __declspec(noinline) Recurse(size_t depth,
+                                  CaptureType type,
+                                  StackUnwinder* unwinder,
+                                  Timing* timing) {
+  if (depth == 0) {
+    Capture(type, unwinder, timing);
+    return;
+  }
+  Recurse(depth - 1, type, unwinder, timing);
+
+  // Keeps the call from being turned into a jump.
+  _ReadWriteBarrier();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  StackUnwinder unwinder;
+  if (!unwinder.Init()) {
+    ::printf("Failed to initialize the stack unwinder.\n");
+    return 1;
+  }
+
+  // WalkStack is timed on its own path, without the unwinder installed.
+  ::printf("%8s %8s %14s %14s %14s\n", "depth", "frames", "walk-stack",
+           "backtrace", "unwinder");
+  for (size_t depth : kDepths) {
+    Timing walk_stack = {};
+    Timing backtrace = {};
+    Timing unwind = {};
+    Recurse(depth, kWalkStack, &unwinder, &walk_stack);
+    Recurse(depth, kCaptureStackBackTrace, &unwinder, &backtrace);
+    Recurse(depth, kStackUnwinder, &unwinder, &unwind);
+    ::printf("%8u %8u %14.1f %14.1f %14.1f\n", depth, unwind.num_frames,
+             walk_stack.cycles, backtrace.cycles, unwind.cycles);
+  }
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/stack_unwinder.h"
+
+#include <windows.h>
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+const size_t kMaxFrames = 62;
+
+class StackUnwinderTest : public testing::Test {
+ public:
+  StackUnwinderTest() {
+    ::memset(frames_, 0, sizeof(frames_));
+    ::memset(frames2_, 0, sizeof(frames2_));
+  }
+
+  void TearDown() override {
+    SetStackUnwinder(nullptr);
+  }
+
+ protected:
+  void* frames_[kMaxFrames];
+  void* frames2_[kMaxFrames];
+  StackUnwinder unwinder_;
+};
+
+}  // namespace
+
+TEST_F(StackUnwinderTest, CompareToCaptureStackBackTrace) {
+  ASSERT_TRUE(unwinder_.Init());
+
+  // Skip the top frame (in this function) as the calls to Unwind and
+  // CaptureStackBackTrace don't have the same return address.
+  uint32_t num_frames =
+      ::CaptureStackBackTrace(1, kMaxFrames, frames_, nullptr);
+
+  while (num_frames > 0) {
+    StackId stack_id = 0;
+    size_t num_frames2 = unwinder_.Unwind(1, num_frames, frames_, &stack_id);
+    size_t exp_frames2 =
+        ::CaptureStackBackTrace(1, num_frames, frames2_, nullptr);
+    EXPECT_EQ(num_frames, num_frames2);
+    EXPECT_EQ(exp_frames2, num_frames2);
+    EXPECT_EQ(0, ::memcmp(frames_, frames2_, num_frames * sizeof(*frames_)));
+
+    --num_frames;
+  }
+}
+
+TEST_F(StackUnwinderTest, WalkStackUsesUnwinder) {
+  ASSERT_TRUE(unwinder_.Init());
+  SetStackUnwinder(&unwinder_);
+
+  StackId stack_id = 0;
+  size_t num_frames = WalkStack(0, kMaxFrames, frames_, &stack_id);
+  StackId stack_id2 = 0;
+  size_t num_frames2 = unwinder_.Unwind(0, kMaxFrames, frames2_, &stack_id2);
+  EXPECT_LT(0u, num_frames);
+  EXPECT_EQ(num_frames, num_frames2);
+
+  // Only the frames in this function differ.
+  EXPECT_EQ(0, ::memcmp(frames_ + 1, frames2_ + 1,
+                        (num_frames - 1) * sizeof(*frames_)));
+}
+
+#ifdef _WIN64
+
+TEST_F(StackUnwinderTest, IndexesModules) {
+  EXPECT_EQ(0u, unwinder_.num_modules());
+  ASSERT_TRUE(unwinder_.Init());
+  EXPECT_LT(0u, unwinder_.num_modules());
+
+  // The function entries agree with those of the system.
+  uintptr_t pc = reinterpret_cast<uintptr_t>(&::CaptureStackBackTrace);
+  uintptr_t image_base = 0;
+  const RUNTIME_FUNCTION* function =
+      unwinder_.LookupFunctionEntry(pc, &image_base);
+  DWORD64 expected_image_base = 0;
+  const RUNTIME_FUNCTION* expected_function =
+      ::RtlLookupFunctionEntry(pc, &expected_image_base, nullptr);
+  EXPECT_EQ(expected_function, function);
+  EXPECT_EQ(expected_image_base, image_base);
+
+  // The system tables are used for the modules that aren't indexed.
+  size_t num_modules = unwinder_.num_modules();
+  unwinder_.RemoveModule(reinterpret_cast<HMODULE>(expected_image_base));
+  EXPECT_EQ(num_modules - 1, unwinder_.num_modules());
+  EXPECT_EQ(expected_function, unwinder_.LookupFunctionEntry(pc, &image_base));
+  EXPECT_EQ(expected_image_base, image_base);
+}
+
+TEST_F(StackUnwinderTest, StopsAtCycleBudget) {
+  ASSERT_TRUE(unwinder_.Init());
+
+  // The first capture runs out of budget, and the second of frames. Both
+  // are made from the same call site.
+  size_t num_frames[2] = {};
+  StackId stack_ids[2] = {};
+  for (size_t i = 0; i < 2; ++i) {
+    unwinder_.set_cycle_budget(i == 0 ? 0 : StackUnwinder::kDefaultCycleBudget);
+    num_frames[i] = unwinder_.Unwind(0, i == 0 ? kMaxFrames : 1, frames_,
+                                     &stack_ids[i]);
+  }
+  EXPECT_EQ(1u, num_frames[0]);
+  EXPECT_EQ(1u, num_frames[1]);
+
+  // The ID of the truncated capture is that of the frames walked.
+  EXPECT_EQ(stack_ids[1], stack_ids[0]);
+}
+
+#endif  // _WIN64
+
+}  // namespace common
+}  // namespace agent
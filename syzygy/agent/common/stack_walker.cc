@@ -20,6 +20,8 @@
 #include "base/logging.h"
 #include "syzygy/agent/common/stack_capture.h"
 #include "syzygy/common/align.h"
+#else
+#include "syzygy/agent/common/stack_unwinder.h"
 #endif
 
 namespace agent {
@@ -185,19 +187,36 @@ size_t WalkStackImpl(const void* current_ebp,
   return num_frames;
 }
 
+void SetStackUnwinder(StackUnwinder* unwinder) {
+}
+
 #else
 
+namespace {
+
+StackUnwinder* stack_unwinder = nullptr;
+
+}  // namespace
+
 size_t __declspec(noinline) WalkStack(uint32_t bottom_frames_to_skip,
                                       uint32_t max_frame_count,
                                       void** frames,
                                       StackId* absolute_stack_id) {
   // Skip one more frame for call of this function
+  if (stack_unwinder != nullptr) {
+    return stack_unwinder->Unwind(bottom_frames_to_skip + 1, max_frame_count,
+                                  frames, absolute_stack_id);
+  }
   return CaptureStackBackTrace(bottom_frames_to_skip + 1,
                                max_frame_count,
                                frames,
                                reinterpret_cast<PDWORD>(absolute_stack_id));
 }
 
+void SetStackUnwinder(StackUnwinder* unwinder) {
+  stack_unwinder = unwinder;
+}
+
 #endif  // !defined _WIN64
 
 }  // namespace common
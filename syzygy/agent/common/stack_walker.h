@@ -73,6 +73,8 @@ namespace common {
 
 using StackId = ::common::AsanStackId;
 
+class StackUnwinder;
+
 // Heuristically walks the current stack. Does not consider its own stack
 // frame. Frames are expected to have a standard layout with the top of the
 // frame being a saved frame pointer, and the bottom of a frame being a return
@@ -90,6 +92,13 @@ size_t WalkStack(uint32_t bottom_frames_to_skip,
                  void** frames,
                  StackId* absolute_stack_id);
 
+// Sets the unwinder used by WalkStack on x64, in place of
+// CaptureStackBackTrace. This is ignored on x86, where WalkStack walks the
+// frame pointers.
+// @param unwinder the unwinder, which must outlive its use. May be nullptr
+//     to go back to CaptureStackBackTrace.
+void SetStackUnwinder(StackUnwinder* unwinder);
+
 #ifndef _WIN64
 // Implementation of WalkStack, with explicitly provided @p current_ebp,
 // @p stack_bottom and @p stack_top. Exposed for much easier unittesting.
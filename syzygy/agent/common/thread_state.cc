@@ -21,16 +21,22 @@ namespace common {
 
 ThreadStateBase::ThreadStateBase()
     : thread_handle_(
-        ::OpenThread(SYNCHRONIZE, FALSE, ::GetCurrentThreadId())) {
+        ::OpenThread(SYNCHRONIZE, FALSE, ::GetCurrentThreadId())),
+      next_registered_(NULL),
+      next_marked_(NULL),
+      marked_for_death_(0) {
   DCHECK(thread_handle_.IsValid());
   InitializeListHead(&entry_);
 }
 
 ThreadStateBase::~ThreadStateBase() {
   DCHECK(IsListEmpty(&entry_));
+  DCHECK(next_registered_ == NULL);
+  DCHECK(next_marked_ == NULL);
 }
 
-ThreadStateManager::ThreadStateManager() {
+ThreadStateManager::ThreadStateManager()
+    : registered_items_(NULL), marked_items_(NULL), num_marked_items_(0) {
   InitializeListHead(&active_items_);
   InitializeListHead(&death_row_items_);
 }
@@ -40,7 +46,8 @@ ThreadStateManager::~ThreadStateManager() {
   // racy as hell if other threads are active, but it's the caller's
   // responsibility to ensure that's not the case.
 
-  // Attempt an orderly deletion of items of the death row.
+  // Attempt an orderly deletion of items of the death row. This also moves
+  // the pending items into the lists.
   Scavenge();
 
   // Note that we don't hold lock_ for these operations, as the destructor
@@ -71,42 +78,43 @@ ThreadStateManager::~ThreadStateManager() {
 void ThreadStateManager::Register(ThreadStateBase* item) {
   DCHECK(item != NULL);
   DCHECK(IsListEmpty(&item->entry_));
-  base::AutoLock auto_lock(lock_);
-  InsertTailList(&active_items_, &item->entry_);
+  PushItem(&registered_items_, &ThreadStateBase::next_registered_, item);
 }
 
 void ThreadStateManager::Unregister(ThreadStateBase* item) {
   DCHECK(item != NULL);
   base::AutoLock auto_lock(lock_);
+
+  // The item may still be pending, and must be in a list to be removed.
+  DrainPendingItemsUnlocked();
   RemoveEntryList(&item->entry_);
   InitializeListHead(&item->entry_);
+  item->marked_for_death_ = 0;
 }
 
 void ThreadStateManager::MarkForDeath(ThreadStateBase* item) {
   DCHECK(item != NULL);
 
-  {
-    base::AutoLock auto_lock(lock_);
+  // An item can only be on a stack once, so an item that is marked again
+  // stays where it is: on the stack, or on death row.
+  if (::InterlockedExchange(&item->marked_for_death_, 1) == 0)
+    PushItem(&marked_items_, &ThreadStateBase::next_marked_, item);
 
-    // Make sure the item we're marking is on the active or death row lists.
-    DCHECK(IsNodeOnList(&active_items_, &item->entry_) ||
-           IsNodeOnList(&death_row_items_, &item->entry_));
-
-    // Pull it out of the list it's on, this'll preserve it over the scavenge
-    // below, in the unlikely case that the item is being marked from another
-    // thread than it's own.
-    RemoveEntryList(&item->entry_);
-  }
-
-  // Use this opportunity to scavenge existing thread states on death row.
-  Scavenge();
+  // Use this opportunity to scavenge existing thread states on death row,
+  // once per batch of items marked for death. This is skipped if another
+  // thread holds the lock, as that thread will get to it.
+  if (::InterlockedIncrement(&num_marked_items_) < kScavengeBatchSize)
+    return;
+  if (!lock_.Try())
+    return;
 
-  // Mark item for death, for later scavenging.
-  {
-    base::AutoLock auto_lock(lock_);
+  LIST_ENTRY dead_items;
+  InitializeListHead(&dead_items);
+  ScavengeUnlocked(&dead_items);
+  lock_.Release();
 
-    InsertHeadList(&death_row_items_, &item->entry_);
-  }
+  // We can delete any dead items we found outside of the lock.
+  DeleteItems(&dead_items);
 }
 
 bool ThreadStateManager::Scavenge() {
@@ -118,15 +126,7 @@ bool ThreadStateManager::Scavenge() {
   // Acquire the lock when interacting with the internal data.
   {
     base::AutoLock auto_lock(lock_);
-
-    // Put all of the death row items belonging
-    // to dead threads into dead_items.
-    GatherDeadItemsUnlocked(&dead_items);
-
-    // Return whether or not the thread state manager is no longer holding
-    // any items.
-    has_more_items =
-        !IsListEmpty(&active_items_) || !IsListEmpty(&death_row_items_);
+    has_more_items = ScavengeUnlocked(&dead_items);
   }
 
   // We can delete any dead items we found outside of the lock.
@@ -136,6 +136,78 @@ bool ThreadStateManager::Scavenge() {
   return has_more_items;
 }
 
+bool ThreadStateManager::ScavengeUnlocked(LIST_ENTRY* dead_items) {
+  DCHECK(dead_items != NULL);
+  lock_.AssertAcquired();
+
+  DrainPendingItemsUnlocked();
+  ::InterlockedExchange(&num_marked_items_, 0);
+
+  // Put all of the death row items belonging
+  // to dead threads into dead_items.
+  GatherDeadItemsUnlocked(dead_items);
+
+  // Return whether or not the thread state manager is no longer holding
+  // any items.
+  return !IsListEmpty(&active_items_) || !IsListEmpty(&death_row_items_);
+}
+
+void ThreadStateManager::DrainPendingItemsUnlocked() {
+  lock_.AssertAcquired();
+
+  // The marked items are taken first: an item is registered before it is
+  // marked, so each of them is then either already in a list or among the
+  // registered items taken next.
+  ThreadStateBase* marked_items = TakeItems(&marked_items_);
+  ThreadStateBase* registered_items = TakeItems(&registered_items_);
+
+  while (registered_items != NULL) {
+    ThreadStateBase* item = registered_items;
+    registered_items = item->next_registered_;
+    item->next_registered_ = NULL;
+    InsertTailList(&active_items_, &item->entry_);
+  }
+
+  while (marked_items != NULL) {
+    ThreadStateBase* item = marked_items;
+    marked_items = item->next_marked_;
+    item->next_marked_ = NULL;
+
+    // Make sure the item we're marking is on the active or death row lists.
+    DCHECK(IsNodeOnList(&active_items_, &item->entry_) ||
+           IsNodeOnList(&death_row_items_, &item->entry_));
+    RemoveEntryList(&item->entry_);
+    InsertHeadList(&death_row_items_, &item->entry_);
+  }
+}
+
+void ThreadStateManager::PushItem(ThreadStateBase* volatile* stack,
+                                  ThreadStateBase* ThreadStateBase::*next,
+                                  ThreadStateBase* item) {
+  DCHECK(stack != NULL);
+  DCHECK(item != NULL);
+
+  // The stacks are only ever emptied as a whole, so the top can't be popped
+  // and pushed back between our read and our exchange.
+  ThreadStateBase* top = *stack;
+  while (true) {
+    item->*next = top;
+    ThreadStateBase* previous_top = static_cast<ThreadStateBase*>(
+        ::InterlockedCompareExchangePointer(
+            reinterpret_cast<void* volatile*>(stack), item, top));
+    if (previous_top == top)
+      return;
+    top = previous_top;
+  }
+}
+
+ThreadStateBase* ThreadStateManager::TakeItems(
+    ThreadStateBase* volatile* stack) {
+  DCHECK(stack != NULL);
+  return static_cast<ThreadStateBase*>(::InterlockedExchangePointer(
+      reinterpret_cast<void* volatile*>(stack), NULL));
+}
+
 void ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
   DCHECK(dead_items != NULL);
   DCHECK(IsListEmpty(dead_items));
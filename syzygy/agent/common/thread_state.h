@@ -15,6 +15,12 @@
 // Defines the ThreadStateBase and ThreadStateManager classes, which assists in
 // tracking and properly scavenging thread local resources owned by an agent
 // DLL as threads attach and detach from instrumented modules.
+//
+// Threads register and are marked for death without taking a lock: the items
+// are pushed on lock-free stacks, which are only ever emptied as a whole, and
+// are moved into the manager's lists by whichever thread next takes its lock.
+// Death row is scavenged once per batch of items marked for death, and only
+// if the lock is free, so that thread churn doesn't serialize the threads.
 
 #ifndef SYZYGY_AGENT_COMMON_THREAD_STATE_H_
 #define SYZYGY_AGENT_COMMON_THREAD_STATE_H_
@@ -48,6 +54,14 @@ class ThreadStateBase {
   // The entry linking us into the manager's active_items_ or death_row_ lists.
   LIST_ENTRY entry_;
 
+  // The links of the manager's stacks of items that were registered, or
+  // marked for death, since it last updated its lists.
+  ThreadStateBase* next_registered_;
+  ThreadStateBase* next_marked_;
+
+  // Non-zero once we've been pushed on the stack of items marked for death.
+  volatile LONG marked_for_death_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadStateBase);
 };
@@ -74,11 +88,36 @@ class ThreadStateManager {
   void MarkForDeath(ThreadStateBase* item);
 
  protected:
+  // The number of items marked for death between scavenges of death row.
+  static const LONG kScavengeBatchSize = 16;
+
   // A helper method which gathers up any dead items from the death row list.
   // @returns true iff there are any items still being managed by this
   //     ThreadStateManager instance upon this functions return.
   bool Scavenge();
 
+  // The part of Scavenge that is done under lock_.
+  // @param dead_items receives the items to delete once lock_ is released.
+  // @returns true iff there are any items still being managed.
+  bool ScavengeUnlocked(LIST_ENTRY* dead_items);
+
+  // Moves the items registered and marked for death since the last call into
+  // the active and death row lists. This must be called under lock_.
+  void DrainPendingItemsUnlocked();
+
+  // Pushes @p item on a lock-free stack.
+  // @param stack the top of the stack.
+  // @param next the link of the stack in @p item.
+  // @param item the item to push.
+  static void PushItem(ThreadStateBase* volatile* stack,
+                       ThreadStateBase* ThreadStateBase::*next,
+                       ThreadStateBase* item);
+
+  // Empties a lock-free stack.
+  // @param stack the top of the stack.
+  // @returns the items of the stack, most recently pushed first.
+  static ThreadStateBase* TakeItems(ThreadStateBase* volatile* stack);
+
   // Gathers all items which have been marked for death whose owning threads
   // have terminated into @p dead_items. These items can subsequently be
   // deleted using the Delete() method.
@@ -101,6 +140,14 @@ class ThreadStateManager {
   // death. Accessed under lock_.
   LIST_ENTRY death_row_items_;
 
+  // The stacks of the items registered and marked for death since the lists
+  // were last updated. These are pushed on without holding lock_.
+  ThreadStateBase* volatile registered_items_;
+  ThreadStateBase* volatile marked_items_;
+
+  // The number of items marked for death since death row was scavenged.
+  volatile LONG num_marked_items_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadStateManager);
 };
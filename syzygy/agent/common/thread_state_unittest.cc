@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/common/thread_state.h"
 
+#include <memory>
+#include <vector>
+
 #include "base/atomic_ref_count.h"
 #include "base/bind.h"
 #include "base/synchronization/waitable_event.h"
@@ -47,10 +50,12 @@ class TestThreadStateManager : public ThreadStateManager {
   // Expose protected members for unit-testing.
   using ThreadStateManager::Scavenge;
   using ThreadStateManager::IsThreadDead;
+  using ThreadStateManager::kScavengeBatchSize;
 
   // Returns true if the there are no active thread state items being managed.
   bool HasActiveItems() {
     base::AutoLock auto_lock(lock_);
+    DrainPendingItemsUnlocked();
     return !IsListEmpty(&active_items_);
   }
 
@@ -59,18 +64,21 @@ class TestThreadStateManager : public ThreadStateManager {
   // are items ready to be scavenged.
   bool HasDeathRowItems() {
     base::AutoLock auto_lock(lock_);
+    DrainPendingItemsUnlocked();
     return !IsListEmpty(&death_row_items_);
   }
 
   // Returns true iff @p item is in the active items list.
   bool IsActive(const TestThreadState* item) {
     base::AutoLock auto_lock(lock_);
+    DrainPendingItemsUnlocked();
     return ListContains(&active_items_, item);
   }
 
   // Returns true iff @p items is in the death_row list.
   bool IsOnDeathRow(const TestThreadState* item) {
     base::AutoLock auto_lock(lock_);
+    DrainPendingItemsUnlocked();
     return ListContains(&death_row_items_, item);
   }
 
@@ -130,6 +138,14 @@ class ThreadStateTest : public testing::Test {
                    state));
   }
 
+  // Creates a thread state object on the current thread, registers it and
+  // marks it for death.
+  void RegisterAndMarkForDeath() {
+    TestThreadState* thread_state = new TestThreadState(&thread_states_);
+    manager_->Register(thread_state);
+    manager_->MarkForDeath(thread_state);
+  }
+
   // Marks a thread state object for death on the worker thread.
   void MarkThreadStateForDeath(ThreadStateBase* state) {
     CallOnWorkerThread(
@@ -236,6 +252,29 @@ TEST_F(ThreadStateTest, LifeCycle) {
   EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
 }
 
+TEST_F(ThreadStateTest, ManyThreads) {
+  // Each thread registers a thread state and marks it for death, which
+  // scavenges death row as the batches fill up.
+  const size_t kNumThreads = 4 * TestThreadStateManager::kScavengeBatchSize;
+  std::vector<std::unique_ptr<base::Thread>> threads;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    threads.push_back(std::unique_ptr<base::Thread>(new base::Thread("test")));
+    ASSERT_TRUE(threads.back()->Start());
+  }
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    threads[i]->message_loop()->PostTask(
+        FROM_HERE, base::Bind(&ThreadStateTest::RegisterAndMarkForDeath,
+                              base::Unretained(this)));
+  }
+
+  // Once the threads are gone, all of their thread states are deleted.
+  for (size_t i = 0; i < kNumThreads; ++i)
+    threads[i]->Stop();
+  EXPECT_FALSE(manager_->HasActiveItems());
+  EXPECT_FALSE(manager_->Scavenge());
+  EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
+}
+
 TEST_F(ThreadStateTest, DeletesAllThreadStatesOnDestruction) {
   TestThreadState* thread_state = NULL;
   ASSERT_NO_FATAL_FAILURE(CreateThreadState(&thread_state));
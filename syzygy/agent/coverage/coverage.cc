@@ -130,6 +130,7 @@ Coverage::Coverage() {
 }
 
 Coverage::~Coverage() {
+  MergeStaticBuffers();
 }
 
 void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
@@ -260,6 +261,14 @@ bool Coverage::InitializeCoverageData(void* module_base,
   trace_coverage_data->num_columns = 1;
   trace_coverage_data->num_entries = coverage_data->num_entries;
 
+  // Remember the static buffer, as it is written to directly by the direct
+  // probes.
+  StaticBuffer static_buffer = {
+      reinterpret_cast<const uint8_t*>(coverage_data->frequency_data),
+      trace_coverage_data->frequency_data,
+      coverage_data->num_entries};
+  static_buffers_.push_back(static_buffer);
+
   // Hook up the newly allocated buffer to the call-trace instrumentation.
   coverage_data->frequency_data =
       trace_coverage_data->frequency_data;
@@ -267,5 +276,13 @@ bool Coverage::InitializeCoverageData(void* module_base,
   return true;
 }
 
+void Coverage::MergeStaticBuffers() {
+  for (const StaticBuffer& static_buffer : static_buffers_) {
+    for (size_t i = 0; i < static_buffer.size; ++i)
+      static_buffer.trace_data[i] |= static_buffer.static_data[i];
+  }
+  static_buffers_.clear();
+}
+
 }  // namespace coverage
 }  // namespace agent
@@ -61,10 +61,24 @@ class Coverage {
   Coverage();
   ~Coverage();
 
+  // The static frequency data buffer of an instrumented module, and the trace
+  // buffer its frequency data pointer was redirected to.
+  struct StaticBuffer {
+    const uint8_t* static_data;
+    uint8_t* trace_data;
+    size_t size;
+  };
+
   // Initializes the given coverage data element.
   bool InitializeCoverageData(void* module_base,
                               ::common::IndexedFrequencyData* coverage_data);
 
+  // Merges the static buffers into their trace buffers. The direct probes of
+  // the coverage instrumentation store to the static buffer rather than
+  // through the frequency data pointer. This is called on tear-down, while
+  // the instrumented modules are still mapped.
+  void MergeStaticBuffers();
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
@@ -72,6 +86,10 @@ class Coverage {
   // goes to specially allocated segments that we don't explicitly keep track
   // of, but rather that we let live until the client gets torn down.
   trace::client::TraceFileSegment segment_;
+
+  // The static buffers of the modules whose coverage data has been
+  // initialized.
+  std::vector<StaticBuffer> static_buffers_;
 };
 
 }  // namespace coverage
@@ -195,6 +195,11 @@ void VisitBlock(size_t i) {
   static_cast<uint8_t*>(coverage_data.frequency_data)[i] = 1;
 }
 
+void VisitBlockDirectly(size_t i) {
+  EXPECT_GT(kBasicBlockCount, i);
+  bb_seen_array[i] = 1;
+}
+
 }  // namespace
 
 TEST_F(CoverageClientTest, NoServerNoCrash) {
@@ -261,5 +266,42 @@ TEST_F(CoverageClientTest, VisitOneBB) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(CoverageClientTest, VisitBBsDirectly) {
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  EXPECT_TRUE(DllMainThunk(self, DLL_PROCESS_ATTACH, NULL));
+
+  // Mix the stores through the redirected pointer and the stores to the
+  // static buffer, as done by the direct probes.
+  VisitBlock(0);
+  VisitBlockDirectly(1);
+
+  // Unload the DLL and stop the service. This merges the static buffer.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  const uint8_t kExpectedCoverageData[kBasicBlockCount] = {1, 1};
+
+  // Set up expectations for what should be in the trace.
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(
+      _,
+      process_id,
+      thread_id,
+      CoverageDataMatches(self, kBasicBlockCount, kExpectedCoverageData)));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
 }  // namespace coverage
 }  // namespace agent
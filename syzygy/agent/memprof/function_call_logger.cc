@@ -111,5 +111,29 @@ bool FunctionCallLogger::FlushSegment(TraceFileSegment* segment) {
   return session_->ExchangeBuffer(segment);
 }
 
+uint64_t FunctionCallLogger::GetTimestamp() {
+  if (!serialize_timestamps_)
+    return ::trace::common::GetTsc();
+
+  base::AutoLock lock(lock_);
+  return call_counter_++;
+}
+
+CompactDetailedCallState* FunctionCallLogger::GetCompactCallState(
+    TraceFileSegment* segment) {
+  DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+
+  // A segment that was exchanged since the last call is a fresh one, which
+  // interns its own values. The segment is only ever written by its thread,
+  // so the state is not used under the lock.
+  base::AutoLock lock(lock_);
+  SegmentState& state = segment_states_[segment];
+  if (state.segment_serial != segment->segment_serial) {
+    state.segment_serial = segment->segment_serial;
+    ::memset(&state.compact_call_state, 0, sizeof(state.compact_call_state));
+  }
+  return &state.compact_call_state;
+}
+
 }  // namespace memprof
 }  // namespace agent
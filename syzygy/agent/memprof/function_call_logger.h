@@ -18,10 +18,12 @@
 #ifndef SYZYGY_AGENT_MEMPROF_FUNCTION_CALL_LOGGER_H_
 #define SYZYGY_AGENT_MEMPROF_FUNCTION_CALL_LOGGER_H_
 
+#include <map>
 #include <set>
 
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/trace/client/rpc_session.h"
+#include "syzygy/trace/protocol/compact_record.h"
 
 namespace agent {
 namespace memprof {
@@ -55,6 +57,9 @@ class FunctionCallLogger {
   uint32_t GetStackTraceId(TraceFileSegment* segment);
 
   // Emits a detailed function call event with a variable number of arguments.
+  // If the call-trace service asks for compact records, this interns the
+  // stack trace ID and the arguments in a dictionary of the segment, so that
+  // repeated heaps, flags and sizes take a byte each.
   // @tparam ArgTypeN The type of the optional Nth argument.
   // @param function_id The ID of the function that was called.
   // @param stack_trace_id The ID of the stack trace where the function was
@@ -97,9 +102,31 @@ class FunctionCallLogger {
   uint32_t serial() const { return serial_; }
 
  protected:
+  // The encoding state of the compact detailed function calls of a segment.
+  struct SegmentState {
+    // The serial number of the segment the state is for.
+    uint32_t segment_serial;
+    CompactDetailedCallState compact_call_state;
+  };
+
+  // The largest compact detailed function call record that is encoded.
+  // Calls with larger arguments are emitted as plain records.
+  static const size_t kMaxCompactCallSize = 256;
+
   // Flushes the provided segment, and gets a new one.
   bool FlushSegment(TraceFileSegment* segment);
 
+  // @returns the timestamp of a function call, which is either the TSC or a
+  //     serial number, depending on serialize_timestamps_.
+  uint64_t GetTimestamp();
+
+  // Gets the encoding state of the compact detailed function calls of a
+  // segment. The state starts over with each new segment.
+  // @param segment the segment being written to.
+  // @returns the encoding state, which is only used by the thread writing
+  //     to @p segment.
+  CompactDetailedCallState* GetCompactCallState(TraceFileSegment* segment);
+
   // The stack-trace tracking mode. Default to kTrackingNone.
   StackTraceTracking stack_trace_tracking_;
 
@@ -126,6 +153,12 @@ class FunctionCallLogger {
   typedef std::set<uint32_t> StackIdSet;
   StackIdSet emitted_stack_ids_;  // Under lock_.
 
+  // The encoding states of the segments that compact records are written to.
+  // Segments are owned by their thread, so there is one of these per thread
+  // that has emitted a compact record.
+  typedef std::map<const TraceFileSegment*, SegmentState> SegmentStateMap;
+  SegmentStateMap segment_states_;  // Under lock_.
+
   // A unique serial number generated at construction time. For unittesting.
   uint32_t serial_;
 
@@ -146,6 +179,11 @@ struct FunctionCallLogger::ArgumentSerializer {
   void serialize(ArgType argument, uint8_t* buffer) {
     ::memcpy(buffer, &argument, sizeof(ArgType));
   }
+  size_t serialize_compact(ArgType argument,
+                           CompactDetailedCallState* state,
+                           uint8_t* buffer) {
+    return EncodeCompactArgument(&argument, sizeof(ArgType), state, buffer);
+  }
 };
 
 // A no-op serializer for unused arguments.
@@ -155,6 +193,11 @@ template<> struct FunctionCallLogger::ArgumentSerializer<
     return 0;
   }
   void serialize(NoArgument argument, uint8_t* buffer) { return; }
+  size_t serialize_compact(NoArgument argument,
+                           CompactDetailedCallState* state,
+                           uint8_t* buffer) {
+    return 0;
+  }
 };
 
 // Implementation off the detailed function call logger. Populates a
@@ -204,6 +247,43 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
   args_count += arg_size5 > 0 ? 1 : 0;
   args_size += arg_size5;
 
+  if (session_->IsEnabled(TRACE_FLAG_COMPACT_RECORDS)) {
+    size_t max_size = kMaxCompactDetailedCallStartSize +
+        args_count * GetMaxCompactArgumentSize(0) + args_size;
+    if (max_size <= kMaxCompactCallSize) {
+      // The segment is flushed ahead of encoding the call, as the call refers
+      // to the values interned by the segment holding it.
+      if (!segment->CanAllocate(max_size) && !FlushSegment(segment))
+        return;
+      DCHECK(segment->CanAllocate(max_size));
+
+      CompactDetailedCallState* state = GetCompactCallState(segment);
+      uint8_t buffer[kMaxCompactCallSize];
+      size_t size = EncodeCompactDetailedCallStart(
+          GetTimestamp(), function_id, stack_trace_id, args_count, state,
+          buffer);
+      size += ArgumentSerializer<ArgType0>().serialize_compact(
+          arg0, state, buffer + size);
+      size += ArgumentSerializer<ArgType1>().serialize_compact(
+          arg1, state, buffer + size);
+      size += ArgumentSerializer<ArgType2>().serialize_compact(
+          arg2, state, buffer + size);
+      size += ArgumentSerializer<ArgType3>().serialize_compact(
+          arg3, state, buffer + size);
+      size += ArgumentSerializer<ArgType4>().serialize_compact(
+          arg4, state, buffer + size);
+      size += ArgumentSerializer<ArgType5>().serialize_compact(
+          arg5, state, buffer + size);
+      DCHECK_LE(size, max_size);
+
+      TraceCompactDetailedFunctionCall* data =
+          segment->AllocateTraceRecord<TraceCompactDetailedFunctionCall>(
+              size);
+      ::memcpy(data->data, buffer, size);
+      return;
+    }
+  }
+
   if (args_size > 0)
     args_size += (args_count + 1) * sizeof(uint32_t);
   size_t data_size = FIELD_OFFSET(TraceDetailedFunctionCall, argument_data) +
@@ -218,14 +298,7 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
   data->function_id = function_id;
   data->stack_trace_id = stack_trace_id;
   data->argument_data_size = args_size;
-
-  if (serialize_timestamps_) {
-    base::AutoLock lock(lock_);
-    data->timestamp = call_counter_;
-    ++call_counter_;
-  } else {
-    data->timestamp = ::trace::common::GetTsc();
-  }
+  data->timestamp = GetTimestamp();
 
   if (args_size == 0)
     return;
@@ -54,11 +54,9 @@ class TestRpcSession : public trace::client::RpcSession {
     segment->buffer_info.buffer_size = min_size;
     segment->buffer_info.shared_memory_handle = 0;
     segment->end_ptr = segment->base_ptr + min_size;
-    segment->header = reinterpret_cast<TraceFileSegmentHeader*>(
-        segment->base_ptr);
-    segment->write_ptr = reinterpret_cast<uint8_t*>(segment->header + 1);
-    segment->header->thread_id = ::GetCurrentThreadId();
-    segment->header->segment_length = 0;
+    segment->header = nullptr;
+    segment->write_ptr = segment->base_ptr;
+    segment->WriteSegmentHeader(nullptr);
     return true;
   }
 
@@ -92,6 +90,8 @@ class TestRpcSession : public trace::client::RpcSession {
     return;
   }
 
+  void set_flags(unsigned long flags) { flags_ = flags; }
+
  private:
   // All generated buffers are kept around so that the contents of flushed
   // buffers can be inspected.
@@ -109,6 +109,7 @@ class TestFunctionCallLogger : public FunctionCallLogger {
     test_session_.AllocateBuffer(&test_segment_);
   }
 
+  using FunctionCallLogger::FlushSegment;
   using FunctionCallLogger::function_id_map_;
   using FunctionCallLogger::emitted_stack_ids_;
 
@@ -137,6 +138,23 @@ void TestEmitDetailedFunctionCall(TestFunctionCallLogger* fcl) {
   EMIT_DETAILED_FUNCTION_CALL(fcl, &fcl->test_segment_, fcl);
 }
 
+void TestEmitDetailedHeapFunctionCall(TestFunctionCallLogger* fcl,
+                                      HANDLE heap,
+                                      SIZE_T size) {
+  ASSERT_NE(static_cast<TestFunctionCallLogger*>(nullptr), fcl);
+  EMIT_DETAILED_FUNCTION_CALL(fcl, &fcl->test_segment_, heap, size);
+}
+
+// Decodes the compact detailed function call recorded by @p info.
+void DecodeCompactCall(const TestFunctionCallLogger::AllocationInfo& info,
+                       CompactDetailedCallState* state,
+                       std::vector<uint8_t>* call) {
+  ASSERT_EQ(TraceCompactDetailedFunctionCall::kTypeId, info.record_type);
+  ASSERT_TRUE(DecodeCompactDetailedFunctionCall(
+      reinterpret_cast<const uint8_t*>(info.record), info.record_size, state,
+      call));
+}
+
 }  // namespace
 
 TEST(FunctionCallLoggerTest, TraceFunctionNameTableEntry) {
@@ -316,5 +334,51 @@ TEST(FunctionCallLoggerTest, TraceDetailedFunctionCallSerializeTimestamps) {
   }
 }
 
+TEST(FunctionCallLoggerTest, TraceCompactDetailedFunctionCall) {
+  TestFunctionCallLogger fcl;
+  fcl.test_session_.set_flags(TRACE_FLAG_COMPACT_RECORDS);
+  fcl.set_stack_trace_tracking(kTrackingTrack);
+  fcl.set_serialize_timestamps(true);
+
+  // The calls are made from the same stack.
+  HANDLE heap = reinterpret_cast<HANDLE>(0x00A00000);
+  for (size_t i = 0; i < 3; ++i) {
+    if (i == 2)
+      ASSERT_TRUE(fcl.FlushSegment(&fcl.test_segment_));
+    TestEmitDetailedHeapFunctionCall(&fcl, heap, 16);
+  }
+  // 1 name, 3 calls.
+  ASSERT_EQ(4u, fcl.allocation_infos.size());
+
+  // The second call refers to the stack and the arguments of the first.
+  CompactDetailedCallState state = {};
+  std::vector<uint8_t> call;
+  ASSERT_NO_FATAL_FAILURE(
+      DecodeCompactCall(fcl.allocation_infos[1], &state, &call));
+  ASSERT_NO_FATAL_FAILURE(
+      DecodeCompactCall(fcl.allocation_infos[2], &state, &call));
+  EXPECT_GT(fcl.allocation_infos[1].record_size,
+            fcl.allocation_infos[2].record_size);
+  EXPECT_EQ(6u, fcl.allocation_infos[2].record_size);
+
+  const TraceDetailedFunctionCall* data =
+      reinterpret_cast<const TraceDetailedFunctionCall*>(&call[0]);
+  EXPECT_EQ(0u, data->function_id);
+  EXPECT_NE(0u, data->stack_trace_id);
+  EXPECT_EQ(1u, data->timestamp);
+  const uint32_t kExpectedArguments[] = {
+      2, sizeof(heap), sizeof(SIZE_T), reinterpret_cast<uint32_t>(heap), 16};
+  ASSERT_EQ(sizeof(kExpectedArguments), data->argument_data_size);
+  EXPECT_EQ(0, ::memcmp(kExpectedArguments, data->argument_data,
+                        sizeof(kExpectedArguments)));
+
+  // The new segment interns its own values, and decodes on its own.
+  EXPECT_LT(fcl.allocation_infos[2].record_size,
+            fcl.allocation_infos[3].record_size);
+  CompactDetailedCallState new_state = {};
+  ASSERT_NO_FATAL_FAILURE(
+      DecodeCompactCall(fcl.allocation_infos[3], &new_state, &call));
+}
+
 }  // namespace memprof
 }  // namespace agent
@@ -14,7 +14,8 @@
 //
 // Implementations of the Asan heap interceptors. These functions are
 // instrumented and log detailed function call information to the call-trace
-// service.
+// service. If allocations are sampled, only the sampled allocations and the
+// calls on their blocks are logged, along with the calls on whole heaps.
 
 #include <windows.h>
 
@@ -54,6 +55,39 @@ struct ConditionalScopedLock {
 };
 base::Lock ConditionalScopedLock::conditional_lock_;
 
+namespace {
+
+using agent::memprof::HeapSampler;
+
+// @returns the heap sampler, or nullptr if allocations aren't sampled.
+HeapSampler* GetHeapSampler() {
+  return agent::memprof::memory_profiler->heap_sampler();
+}
+
+// @returns true if a call on @p block is to be logged.
+bool IsBlockLogged(LPCVOID block) {
+  HeapSampler* sampler = GetHeapSampler();
+  return sampler == nullptr || block == nullptr || sampler->IsSampled(block);
+}
+
+// Logs the reallocation of an unsampled block to a sampled one as the
+// allocation of the sampled block, which is all that a replay of the trace
+// knows of it.
+void EmitSampledReAllocAsAlloc(HANDLE heap,
+                               DWORD flags,
+                               SIZE_T bytes,
+                               LPVOID ret) {
+  static uint32_t logger_serial = UINT32_MAX;
+  static uint32_t function_id = UINT32_MAX;
+  EmitDetailedFunctionCallHelper(
+      &agent::memprof::memory_profiler->function_call_logger(),
+      agent::memprof::memory_profiler->GetOrAllocateThreadState()->segment(),
+      &logger_serial, &function_id, "asan_HeapAlloc", heap, flags, bytes,
+      ret);
+}
+
+}  // namespace
+
 extern "C" {
 
 HANDLE WINAPI asan_GetProcessHeap() {
@@ -77,6 +111,8 @@ BOOL WINAPI asan_HeapDestroy(HANDLE heap) {
   // This ensures that all heap access is synchronous if 'serialize_timestamps'
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
+  if (GetHeapSampler() != nullptr)
+    GetHeapSampler()->RemoveHeap(heap);
   BOOL ret = ::HeapDestroy(heap);
   EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, ret);
   return ret;
@@ -89,7 +125,10 @@ LPVOID WINAPI asan_HeapAlloc(HANDLE heap,
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   LPVOID ret = ::HeapAlloc(heap, flags, bytes);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, bytes, ret);
+  if (agent::memprof::memory_profiler->SampleAllocation(heap, ret, bytes)) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, bytes, ret);
+    agent::memprof::memory_profiler->MaybeEmitHeapSummaries();
+  }
   return ret;
 }
 
@@ -100,14 +139,47 @@ LPVOID WINAPI asan_HeapReAlloc(HANDLE heap,
   // This ensures that all heap access is synchronous if 'serialize_timestamps'
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
+  HeapSampler* sampler = GetHeapSampler();
+  if (sampler == nullptr) {
+    LPVOID ret = ::HeapReAlloc(heap, flags, mem, bytes);
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, bytes, ret);
+    return ret;
+  }
+
+  // A sampled block stays sampled wherever it is moved. It isn't tracked
+  // while it is being reallocated, as its address may be reused as soon as
+  // it is freed.
+  size_t sampled_bytes = 0;
+  bool sampled = sampler->RemoveBlock(mem, &sampled_bytes);
   LPVOID ret = ::HeapReAlloc(heap, flags, mem, bytes);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, bytes, ret);
+  if (sampled) {
+    if (ret != nullptr) {
+      sampler->AddBlock(heap, ret, bytes);
+    } else {
+      sampler->AddBlock(heap, mem, sampled_bytes);
+    }
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, bytes, ret);
+  } else if (agent::memprof::memory_profiler->SampleAllocation(heap, ret,
+                                                               bytes)) {
+    EmitSampledReAllocAsAlloc(heap, flags, bytes, ret);
+  } else {
+    return ret;
+  }
+  agent::memprof::memory_profiler->MaybeEmitHeapSummaries();
   return ret;
 }
 
 BOOL WINAPI asan_HeapFree(HANDLE heap,
                           DWORD flags,
                           LPVOID mem) {
+  // A sampled block isn't tracked past this point, as its address may be
+  // reused as soon as it is freed.
+  HeapSampler* sampler = GetHeapSampler();
+  if (sampler != nullptr && !sampler->RemoveBlock(mem, nullptr)) {
+    ConditionalScopedLock conditional_scoped_lock;
+    return ::HeapFree(heap, flags, mem);
+  }
+
   // Calculate a hash value of the contents if necessary.
   uint32_t hash = 0;
   if (mem != nullptr &&
@@ -121,6 +193,8 @@ BOOL WINAPI asan_HeapFree(HANDLE heap,
   ConditionalScopedLock conditional_scoped_lock;
   BOOL ret = ::HeapFree(heap, flags, mem);
   EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret, hash);
+  if (sampler != nullptr)
+    agent::memprof::memory_profiler->MaybeEmitHeapSummaries();
   return ret;
 }
 
@@ -131,7 +205,9 @@ SIZE_T WINAPI asan_HeapSize(HANDLE heap,
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   SIZE_T ret = ::HeapSize(heap, flags, mem);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  if (IsBlockLogged(mem)) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  }
   return ret;
 }
 
@@ -142,7 +218,9 @@ BOOL WINAPI asan_HeapValidate(HANDLE heap,
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   BOOL ret = ::HeapValidate(heap, flags, mem);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  if (IsBlockLogged(mem)) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  }
   return ret;
 }
 
@@ -0,0 +1,153 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/heap_sampler.h"
+
+#include <math.h>
+
+#include "base/logging.h"
+
+namespace agent {
+namespace memprof {
+
+HeapSampler::ThreadSampler::ThreadSampler(uint32_t seed)
+    : bytes_until_sample_(-1), random_state_(seed) {
+  // A xorshift generator never leaves the zero state.
+  if (random_state_ == 0)
+    random_state_ = 1;
+}
+
+bool HeapSampler::ThreadSampler::SampleAllocation(size_t bytes,
+                                                  uint32_t sample_interval) {
+  DCHECK_NE(0u, sample_interval);
+
+  if (bytes_until_sample_ < 0)
+    bytes_until_sample_ = NextInterval(sample_interval);
+  if (static_cast<int64_t>(bytes) < bytes_until_sample_) {
+    bytes_until_sample_ -= bytes;
+    return false;
+  }
+
+  // The next interval is counted from the end of the sampled allocation, so
+  // that a large allocation is sampled once.
+  bytes_until_sample_ = NextInterval(sample_interval);
+  return true;
+}
+
+int64_t HeapSampler::ThreadSampler::NextInterval(uint32_t sample_interval) {
+  random_state_ ^= random_state_ << 13;
+  random_state_ ^= random_state_ >> 17;
+  random_state_ ^= random_state_ << 5;
+
+  // A uniform value in (0, 1] gives an exponentially distributed interval.
+  double uniform = (static_cast<double>(random_state_) + 1.0) / 4294967296.0;
+  double interval = -::log(uniform) * sample_interval;
+  if (interval < 1.0)
+    return 1;
+  return static_cast<int64_t>(interval);
+}
+
+HeapSampler::HeapSampler(uint32_t sample_interval)
+    : sample_interval_(sample_interval) {
+  DCHECK_NE(0u, sample_interval);
+}
+
+void HeapSampler::AddBlock(HANDLE heap, const void* block, size_t bytes) {
+  DCHECK_NE(static_cast<const void*>(nullptr), block);
+
+  BlockInfo info = {heap, bytes};
+  base::AutoLock lock(lock_);
+  bool inserted = blocks_.insert(std::make_pair(block, info)).second;
+  DCHECK(inserted);
+  UpdateSummary(info, true);
+}
+
+bool HeapSampler::RemoveBlock(const void* block, size_t* bytes) {
+  if (block == nullptr)
+    return false;
+
+  base::AutoLock lock(lock_);
+  BlockMap::iterator it = blocks_.find(block);
+  if (it == blocks_.end())
+    return false;
+  if (bytes != nullptr)
+    *bytes = it->second.bytes;
+  UpdateSummary(it->second, false);
+  blocks_.erase(it);
+  return true;
+}
+
+bool HeapSampler::IsSampled(const void* block) const {
+  if (block == nullptr)
+    return false;
+
+  base::AutoLock lock(lock_);
+  return blocks_.find(block) != blocks_.end();
+}
+
+void HeapSampler::RemoveHeap(HANDLE heap) {
+  base::AutoLock lock(lock_);
+  if (summaries_.erase(heap) == 0)
+    return;
+
+  BlockMap::iterator it = blocks_.begin();
+  while (it != blocks_.end()) {
+    if (it->second.heap == heap) {
+      it = blocks_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void HeapSampler::GetHeapSummaries(HeapSummaries* summaries) const {
+  DCHECK_NE(static_cast<HeapSummaries*>(nullptr), summaries);
+
+  base::AutoLock lock(lock_);
+  *summaries = summaries_;
+}
+
+uint64_t HeapSampler::EstimateBytes(size_t bytes) const {
+  if (bytes == 0)
+    return 0;
+
+  // A block of |bytes| is sampled with the probability
+  // 1 - exp(-bytes / sample_interval).
+  double probability =
+      1.0 - ::exp(-static_cast<double>(bytes) / sample_interval_);
+  return static_cast<uint64_t>(bytes / probability);
+}
+
+void HeapSampler::UpdateSummary(const BlockInfo& info, bool add) {
+  lock_.AssertAcquired();
+
+  HeapSummary& summary = summaries_[info.heap];
+  uint64_t estimated_bytes = EstimateBytes(info.bytes);
+  if (add) {
+    ++summary.blocks;
+    summary.bytes += info.bytes;
+    summary.estimated_bytes += estimated_bytes;
+    return;
+  }
+
+  DCHECK_LT(0u, summary.blocks);
+  --summary.blocks;
+  summary.bytes -= info.bytes;
+  summary.estimated_bytes -= estimated_bytes;
+  if (summary.blocks == 0)
+    summaries_.erase(info.heap);
+}
+
+}  // namespace memprof
+}  // namespace agent
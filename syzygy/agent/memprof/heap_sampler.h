@@ -0,0 +1,151 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the HeapSampler class, which samples heap allocations by bytes in
+// the style of the tcmalloc heap profiler. The intervals between the sampled
+// bytes are exponentially distributed with a mean of |sample_interval|, so
+// that every allocated byte is equally likely to be sampled, and that an
+// allocation of |size| bytes is sampled with the probability
+// 1 - exp(-size / sample_interval). This keeps the trace of a real-world
+// run small while still describing where the memory goes.
+//
+// The sampled blocks are tracked until they are freed, so that the calls on
+// them are logged too. A replay of the trace then sees every sampled block
+// being allocated, used and freed, as it does for a trace of all the calls.
+
+#ifndef SYZYGY_AGENT_MEMPROF_HEAP_SAMPLER_H_
+#define SYZYGY_AGENT_MEMPROF_HEAP_SAMPLER_H_
+
+#include <windows.h>
+#include <stdint.h>
+#include <map>
+#include <unordered_map>
+
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+
+namespace agent {
+namespace memprof {
+
+class HeapSampler {
+ public:
+  // Decides which allocations of a thread are sampled. This is only used by
+  // its thread, so it needs no synchronization.
+  class ThreadSampler {
+   public:
+    // @param seed the seed of the random intervals between samples.
+    explicit ThreadSampler(uint32_t seed);
+
+    // Counts the bytes of an allocation.
+    // @param bytes the size of the allocation.
+    // @param sample_interval the mean interval between samples, in bytes.
+    // @returns true if the allocation holds a sampled byte.
+    bool SampleAllocation(size_t bytes, uint32_t sample_interval);
+
+   private:
+    // @returns the next random interval, in bytes, which is at least 1.
+    int64_t NextInterval(uint32_t sample_interval);
+
+    // The number of bytes left before the next sampled byte. This is
+    // negative until the first interval is drawn.
+    int64_t bytes_until_sample_;
+
+    // The state of the xorshift generator of the intervals.
+    uint32_t random_state_;
+
+    DISALLOW_COPY_AND_ASSIGN(ThreadSampler);
+  };
+
+  // The totals of the live sampled blocks of a heap.
+  struct HeapSummary {
+    // The number of sampled blocks.
+    uint32_t blocks;
+    // The size of the sampled blocks.
+    uint64_t bytes;
+    // The estimated size of all the blocks of the heap. Each sampled block
+    // is weighed by the inverse of its probability of being sampled.
+    uint64_t estimated_bytes;
+  };
+  typedef std::map<HANDLE, HeapSummary> HeapSummaries;
+
+  // @param sample_interval the mean interval between samples, in bytes. This
+  //     must not be zero.
+  explicit HeapSampler(uint32_t sample_interval);
+
+  // Tracks a sampled block.
+  // @param heap the heap of the block.
+  // @param block the block, which must not already be tracked.
+  // @param bytes the size of the block.
+  void AddBlock(HANDLE heap, const void* block, size_t bytes);
+
+  // Stops tracking a block. This must be done before the block is freed, as
+  // another thread may allocate a block at the same address right after.
+  // @param block the block.
+  // @param bytes receives the size of the block, if it was sampled. May be
+  //     nullptr.
+  // @returns true if the block was sampled.
+  bool RemoveBlock(const void* block, size_t* bytes);
+
+  // @param block a block.
+  // @returns true if @p block is a sampled block.
+  bool IsSampled(const void* block) const;
+
+  // Stops tracking the blocks of a heap, which is being destroyed.
+  // @param heap the heap.
+  void RemoveHeap(HANDLE heap);
+
+  // Gets the totals of the live sampled blocks of each heap that has some.
+  // @param summaries receives the totals.
+  void GetHeapSummaries(HeapSummaries* summaries) const;
+
+  // @returns the mean interval between samples, in bytes.
+  uint32_t sample_interval() const { return sample_interval_; }
+
+ protected:
+  // A tracked block.
+  struct BlockInfo {
+    HANDLE heap;
+    size_t bytes;
+  };
+
+  // @param bytes the size of a sampled block.
+  // @returns the estimated number of bytes that the sampled block stands for.
+  uint64_t EstimateBytes(size_t bytes) const;
+
+  // Updates the summary of a heap with a block.
+  // @param info the block being added or removed.
+  // @param add true if the block is added, false if it is removed.
+  void UpdateSummary(const BlockInfo& info, bool add);
+
+  // The mean interval between samples.
+  const uint32_t sample_interval_;
+
+  // Protects the tracked blocks.
+  mutable base::Lock lock_;
+
+  // The sampled blocks that are alive.
+  typedef std::unordered_map<const void*, BlockInfo> BlockMap;
+  BlockMap blocks_;  // Under lock_.
+
+  // The totals of the sampled blocks of each heap.
+  HeapSummaries summaries_;  // Under lock_.
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HeapSampler);
+};
+
+}  // namespace memprof
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_MEMPROF_HEAP_SAMPLER_H_
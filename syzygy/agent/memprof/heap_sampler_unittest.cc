@@ -0,0 +1,131 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/heap_sampler.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace memprof {
+
+namespace {
+
+const uint32_t kSampleInterval = 1024;
+
+class TestHeapSampler : public HeapSampler {
+ public:
+  using HeapSampler::EstimateBytes;
+
+  TestHeapSampler() : HeapSampler(kSampleInterval) {}
+};
+
+HANDLE TestHeap(uintptr_t value) {
+  return reinterpret_cast<HANDLE>(value);
+}
+
+const void* TestBlock(uintptr_t value) {
+  return reinterpret_cast<const void*>(value);
+}
+
+}  // namespace
+
+TEST(HeapSamplerTest, ThreadSamplerRate) {
+  HeapSampler::ThreadSampler sampler(42);
+  const size_t kNumAllocations = 100000;
+  const size_t kAllocationSize = 64;
+  size_t num_sampled = 0;
+  for (size_t i = 0; i < kNumAllocations; ++i) {
+    if (sampler.SampleAllocation(kAllocationSize, kSampleInterval))
+      ++num_sampled;
+  }
+
+  // About one allocation is sampled every kSampleInterval bytes.
+  size_t expected = kNumAllocations * kAllocationSize / kSampleInterval;
+  EXPECT_LT(expected * 9 / 10, num_sampled);
+  EXPECT_GT(expected * 11 / 10, num_sampled);
+}
+
+TEST(HeapSamplerTest, ThreadSamplerSamplesLargeAllocations) {
+  HeapSampler::ThreadSampler sampler(42);
+  for (size_t i = 0; i < 100; ++i)
+    EXPECT_TRUE(sampler.SampleAllocation(100 * kSampleInterval,
+                                         kSampleInterval));
+}
+
+TEST(HeapSamplerTest, AddAndRemoveBlocks) {
+  TestHeapSampler sampler;
+  EXPECT_FALSE(sampler.IsSampled(TestBlock(0x1000)));
+  EXPECT_FALSE(sampler.IsSampled(nullptr));
+
+  sampler.AddBlock(TestHeap(1), TestBlock(0x1000), 16);
+  EXPECT_TRUE(sampler.IsSampled(TestBlock(0x1000)));
+  EXPECT_FALSE(sampler.IsSampled(TestBlock(0x2000)));
+
+  size_t bytes = 0;
+  EXPECT_FALSE(sampler.RemoveBlock(TestBlock(0x2000), &bytes));
+  EXPECT_FALSE(sampler.RemoveBlock(nullptr, &bytes));
+  EXPECT_TRUE(sampler.RemoveBlock(TestBlock(0x1000), &bytes));
+  EXPECT_EQ(16u, bytes);
+  EXPECT_FALSE(sampler.IsSampled(TestBlock(0x1000)));
+  EXPECT_FALSE(sampler.RemoveBlock(TestBlock(0x1000), nullptr));
+}
+
+TEST(HeapSamplerTest, RemoveHeap) {
+  TestHeapSampler sampler;
+  sampler.AddBlock(TestHeap(1), TestBlock(0x1000), 16);
+  sampler.AddBlock(TestHeap(1), TestBlock(0x2000), 32);
+  sampler.AddBlock(TestHeap(2), TestBlock(0x3000), 64);
+
+  sampler.RemoveHeap(TestHeap(1));
+  EXPECT_FALSE(sampler.IsSampled(TestBlock(0x1000)));
+  EXPECT_FALSE(sampler.IsSampled(TestBlock(0x2000)));
+  EXPECT_TRUE(sampler.IsSampled(TestBlock(0x3000)));
+
+  HeapSampler::HeapSummaries summaries;
+  sampler.GetHeapSummaries(&summaries);
+  EXPECT_EQ(1u, summaries.size());
+  EXPECT_EQ(1u, summaries.count(TestHeap(2)));
+}
+
+TEST(HeapSamplerTest, HeapSummaries) {
+  TestHeapSampler sampler;
+  sampler.AddBlock(TestHeap(1), TestBlock(0x1000), 16);
+  sampler.AddBlock(TestHeap(1), TestBlock(0x2000), 100 * kSampleInterval);
+  sampler.AddBlock(TestHeap(2), TestBlock(0x3000), 64);
+
+  HeapSampler::HeapSummaries summaries;
+  sampler.GetHeapSummaries(&summaries);
+  ASSERT_EQ(2u, summaries.size());
+  const HeapSampler::HeapSummary& summary = summaries[TestHeap(1)];
+  EXPECT_EQ(2u, summary.blocks);
+  EXPECT_EQ(16u + 100 * kSampleInterval, summary.bytes);
+  EXPECT_EQ(sampler.EstimateBytes(16) +
+                sampler.EstimateBytes(100 * kSampleInterval),
+            summary.estimated_bytes);
+
+  // A small block stands for many more, while a large one is always
+  // sampled and stands for itself.
+  EXPECT_LT(16u * kSampleInterval / 32, sampler.EstimateBytes(16));
+  EXPECT_EQ(100u * kSampleInterval,
+            sampler.EstimateBytes(100 * kSampleInterval));
+
+  // A heap is dropped from the summaries with its last block.
+  EXPECT_TRUE(sampler.RemoveBlock(TestBlock(0x3000), nullptr));
+  sampler.GetHeapSummaries(&summaries);
+  EXPECT_EQ(1u, summaries.size());
+  EXPECT_EQ(0u, summaries.count(TestHeap(2)));
+}
+
+}  // namespace memprof
+}  // namespace agent
@@ -16,21 +16,32 @@
 
 #include "base/bind.h"
 #include "syzygy/agent/common/process_utils.h"
+#include "syzygy/agent/common/stack_walker.h"
 #include "syzygy/common/process_utils.h"
+#include "syzygy/trace/common/clock.h"
 
 namespace agent {
 namespace memprof {
 
 MemoryProfiler::MemoryProfiler()
-    : function_call_logger_(&session_) {
+    : function_call_logger_(&session_), last_heap_summary_time_(0) {
   SetDefaultParameters(&parameters_);
 }
 
+MemoryProfiler::~MemoryProfiler() {
+  agent::common::SetStackUnwinder(nullptr);
+}
+
 bool MemoryProfiler::Init() {
   // We don't care if parameter parsing fails at runtime; such parameters will
   // simply be ignored.
   ParseParametersFromEnv(&parameters_);
   PropagateParameters();
+  if (parameters_.sample_interval != 0) {
+    heap_sampler_.reset(new HeapSampler(parameters_.sample_interval));
+    last_heap_summary_time_ =
+        static_cast<base::subtle::Atomic32>(::GetTickCount());
+  }
   ThreadState* state = GetOrAllocateThreadState();
   if (!trace::client::InitializeRpcSession(
           &session_, state->segment())) {
@@ -72,6 +83,12 @@ bool MemoryProfiler::Init() {
   dll_watcher_.Init(base::Bind(&MemoryProfiler::OnDllEvent,
                                base::Unretained(this)));
 
+  // The stacks are otherwise captured by CaptureStackBackTrace on x64.
+  if (parameters_.stack_trace_tracking != kTrackingNone &&
+      stack_unwinder_.Init()) {
+    agent::common::SetStackUnwinder(&stack_unwinder_);
+  }
+
   // Log all modules that are already loaded when we are. Further modules
   // will be logged as they load and unload via the DllNotification
   // mechanism.
@@ -92,6 +109,47 @@ MemoryProfiler::ThreadState* MemoryProfiler::GetThreadState() {
   return tls_.Get();
 }
 
+bool MemoryProfiler::SampleAllocation(HANDLE heap,
+                                      const void* block,
+                                      size_t bytes) {
+  if (heap_sampler_.get() == nullptr)
+    return true;
+  if (block == nullptr)
+    return false;
+
+  ThreadState* state = GetOrAllocateThreadState();
+  if (!state->thread_sampler()->SampleAllocation(
+          bytes, heap_sampler_->sample_interval())) {
+    return false;
+  }
+  heap_sampler_->AddBlock(heap, block, bytes);
+  return true;
+}
+
+void MemoryProfiler::MaybeEmitHeapSummaries() {
+  if (heap_sampler_.get() == nullptr || parameters_.heap_summary_period == 0)
+    return;
+
+  // The thread that moves the time of the last summaries forward is the one
+  // that emits them. The tick count wraps, which the unsigned difference
+  // handles.
+  base::subtle::Atomic32 last =
+      base::subtle::NoBarrier_Load(&last_heap_summary_time_);
+  DWORD now = ::GetTickCount();
+  if (now - static_cast<DWORD>(last) < parameters_.heap_summary_period)
+    return;
+  if (base::subtle::NoBarrier_CompareAndSwap(
+          &last_heap_summary_time_, last,
+          static_cast<base::subtle::Atomic32>(now)) != last) {
+    return;
+  }
+
+  HeapSampler::HeapSummaries summaries;
+  heap_sampler_->GetHeapSummaries(&summaries);
+  for (const auto& summary : summaries)
+    EmitHeapSummary(summary.first, summary.second);
+}
+
 void MemoryProfiler::PropagateParameters() {
   function_call_logger_.set_stack_trace_tracking(
       parameters_.stack_trace_tracking);
@@ -143,6 +201,14 @@ void MemoryProfiler::LogModule(HMODULE module) {
   agent::common::LogModule(module, &session_, state->segment());
 }
 
+void MemoryProfiler::EmitHeapSummary(HANDLE heap,
+                                     const HeapSampler::HeapSummary& summary) {
+  EMIT_DETAILED_FUNCTION_CALL(&function_call_logger_,
+                              GetOrAllocateThreadState()->segment(), heap,
+                              summary.blocks, summary.bytes,
+                              summary.estimated_bytes);
+}
+
 void MemoryProfiler::OnDllEvent(
     agent::common::DllNotificationWatcher::EventType type,
     HMODULE module,
@@ -166,7 +232,9 @@ void MemoryProfiler::OnDllEvent(
 }
 
 MemoryProfiler::ThreadState::ThreadState(MemoryProfiler* parent)
-    : parent_(parent) {
+    : parent_(parent),
+      thread_sampler_(::GetCurrentThreadId() ^
+                      static_cast<uint32_t>(::trace::common::GetTsc())) {
   DCHECK_NE(static_cast<MemoryProfiler*>(nullptr), parent);
 }
 
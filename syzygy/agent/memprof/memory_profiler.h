@@ -20,11 +20,16 @@
 #ifndef SYZYGY_AGENT_MEMPROF_MEMORY_PROFILER_H_
 #define SYZYGY_AGENT_MEMPROF_MEMORY_PROFILER_H_
 
+#include <memory>
+
+#include "base/atomicops.h"
 #include "base/threading/thread_local.h"
 #include "syzygy/agent/common/agent.h"
 #include "syzygy/agent/common/dll_notifications.h"
+#include "syzygy/agent/common/stack_unwinder.h"
 #include "syzygy/agent/common/thread_state.h"
 #include "syzygy/agent/memprof/function_call_logger.h"
+#include "syzygy/agent/memprof/heap_sampler.h"
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/common/logging.h"
 #include "syzygy/trace/client/rpc_session.h"
@@ -35,6 +40,7 @@ namespace memprof {
 class MemoryProfiler {
  public:
   MemoryProfiler();
+  ~MemoryProfiler();
 
   // Initializes this memory profiler.
   // @returns true for success, false otherwise.
@@ -60,6 +66,22 @@ class MemoryProfiler {
   // @returns the current parameters.
   const Parameters& parameters() const { return parameters_; }
 
+  // @returns the heap sampler, or nullptr if allocations aren't sampled.
+  HeapSampler* heap_sampler() { return heap_sampler_.get(); }
+
+  // Decides if an allocation of the current thread is sampled, and tracks
+  // the allocated block if it is.
+  // @param heap the heap of the allocation.
+  // @param block the allocated block. Failed allocations aren't sampled.
+  // @param bytes the size of the allocation.
+  // @returns true if the allocation is to be logged, which is always the case
+  //     if allocations aren't sampled.
+  bool SampleAllocation(HANDLE heap, const void* block, size_t bytes);
+
+  // Emits the summaries of the sampled blocks of each heap, if they are
+  // enabled and their period has elapsed since they were last emitted.
+  void MaybeEmitHeapSummaries();
+
  protected:
   friend class ThreadState;
 
@@ -77,6 +99,13 @@ class MemoryProfiler {
   // Logs @p module, using the current thread's segment.
   void LogModule(HMODULE module);
 
+  // Emits the summary of the sampled blocks of a heap, as a detailed call to
+  // this function with the heap, the number and the size of the sampled
+  // blocks, and the estimated size of all of the blocks.
+  // @param heap the heap.
+  // @param summary the summary of the sampled blocks of @p heap.
+  void EmitHeapSummary(HANDLE heap, const HeapSampler::HeapSummary& summary);
+
   // Sink for DLL load/unload event notifications.
   void OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
                   HMODULE module,
@@ -100,9 +129,19 @@ class MemoryProfiler {
   // The parameters that we use. These are parsed from the environment.
   Parameters parameters_;
 
+  // The sampler of the heap allocations, if they are sampled.
+  std::unique_ptr<HeapSampler> heap_sampler_;
+
+  // The tick count at which the heap summaries were last emitted.
+  base::subtle::Atomic32 last_heap_summary_time_;
+
   // To keep track of modules added after initialization.
   agent::common::DllNotificationWatcher dll_watcher_;
 
+  // Captures the stack traces of the calls, through the unwind tables of the
+  // modules on x64.
+  agent::common::StackUnwinder stack_unwinder_;
+
   // Contains the set of modules we've seen and logged.
   typedef base::hash_set<HMODULE> ModuleSet;
   ModuleSet logged_modules_;  // Under lock_.
@@ -131,6 +170,11 @@ class MemoryProfiler::ThreadState : public agent::common::ThreadStateBase {
     return &segment_;
   }
 
+  // @returns the sampler of the allocations of this thread.
+  HeapSampler::ThreadSampler* thread_sampler() {
+    return &thread_sampler_;
+  }
+
  protected:
   friend class MemoryProfiler;
 
@@ -140,6 +184,9 @@ class MemoryProfiler::ThreadState : public agent::common::ThreadStateBase {
   // The active trace file segment where events are written.
   trace::client::TraceFileSegment segment_;
 
+  // Samples the allocations of this thread, if allocations are sampled.
+  HeapSampler::ThreadSampler thread_sampler_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadState);
 };
@@ -39,6 +39,8 @@
         'asan_compatibility.cc',
         'crt_interceptors.cc',
         'heap_interceptors.cc',
+        'heap_sampler.cc',
+        'heap_sampler.h',
         'function_call_logger.cc',
         'function_call_logger.h',
         'memory_interceptors.cc',
@@ -119,6 +121,7 @@
       'type': 'executable',
       'sources': [
         'function_call_logger_unittest.cc',
+        'heap_sampler_unittest.cc',
         'memprof_unittest.cc',
         'parameters_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
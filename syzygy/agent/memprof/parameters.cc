@@ -17,6 +17,7 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
 
 namespace agent {
@@ -36,17 +37,23 @@ const char kParametersEnvVar[] = "SYZYGY_MEMPROF_OPTIONS";
 StackTraceTracking kDefaultStackTraceTracking = kTrackingNone;
 bool kDefaultSerializeTimestamps = false;
 bool kDefaultHashContentsAtFree = false;
+uint32_t kDefaultSampleInterval = 0;
+uint32_t kDefaultHeapSummaryPeriod = 0;
 
 // Parameter names for parsing.
 const char kParamStackTraceTracking[] = "stack-trace-tracking";
 const char kParamSerializeTimestamps[] = "serialize-timestamps";
 const char kParamHashContentsAtFree[] = "hash-contents-at-free";
+const char kParamSampleInterval[] = "sample-interval";
+const char kParamHeapSummaryPeriod[] = "heap-summary-period";
 
 void SetDefaultParameters(Parameters* parameters) {
   DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
   parameters->stack_trace_tracking = kDefaultStackTraceTracking;
   parameters->serialize_timestamps = false;
   parameters->hash_contents_at_free = false;
+  parameters->sample_interval = kDefaultSampleInterval;
+  parameters->heap_summary_period = kDefaultHeapSummaryPeriod;
 }
 
 bool ParseParameters(const base::StringPiece& param_string,
@@ -86,6 +93,23 @@ bool ParseParameters(const base::StringPiece& param_string,
   if (cmd_line.HasSwitch(kParamHashContentsAtFree))
     parameters->hash_contents_at_free = true;
 
+  // Parse the sampling parameters.
+  const char* kUintParams[] = {kParamSampleInterval, kParamHeapSummaryPeriod};
+  uint32_t* kUintValues[] = {&parameters->sample_interval,
+                             &parameters->heap_summary_period};
+  for (size_t i = 0; i < arraysize(kUintParams); ++i) {
+    if (!cmd_line.HasSwitch(kUintParams[i]))
+      continue;
+    value = cmd_line.GetSwitchValueASCII(kUintParams[i]);
+    unsigned int parsed = 0;
+    if (!base::StringToUint(value, &parsed)) {
+      LOG(ERROR) << "Invalid value for --" << kUintParams[i] << ": " << value;
+      success = false;
+      continue;
+    }
+    *kUintValues[i] = parsed;
+  }
+
   return success;
 }
 
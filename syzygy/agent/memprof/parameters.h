@@ -18,6 +18,8 @@
 #ifndef SYZYGY_AGENT_MEMPROF_PARAMETERS_H_
 #define SYZYGY_AGENT_MEMPROF_PARAMETERS_H_
 
+#include <stdint.h>
+
 #include "base/strings/string_piece.h"
 #include "syzygy/common/assertions.h"
 
@@ -49,6 +51,13 @@ struct Parameters {
   // the hash value stored as an additional parameter to the heap free
   // function.
   bool hash_contents_at_free;
+  // If this is not zero then allocations are sampled, one every
+  // |sample_interval| bytes on average, and only the sampled allocations and
+  // the calls to their blocks are logged.
+  uint32_t sample_interval;
+  // If this is not zero and allocations are sampled then the sampled blocks
+  // of each heap are summarized every |heap_summary_period| milliseconds.
+  uint32_t heap_summary_period;
 };
 
 // The environment variable that is used for extracting parameters.
@@ -61,11 +70,15 @@ extern const char* kStackTraceTrackingValues[];
 extern StackTraceTracking kDefaultStackTraceTracking;
 extern bool kDefaultSerializeTimestamps;
 extern bool kDefaultHashContentsAtFree;
+extern uint32_t kDefaultSampleInterval;
+extern uint32_t kDefaultHeapSummaryPeriod;
 
 // Parameter names for parsing.
 extern const char kParamStackTraceTracking[];
 extern const char kParamSerializeTimestamps[];
 extern const char kParamHashContentsAtFree[];
+extern const char kParamSampleInterval[];
+extern const char kParamHeapSummaryPeriod[];
 
 // Initializes a Parameters struct with default values.
 // @param parameters The Parameters struct to be initialized.
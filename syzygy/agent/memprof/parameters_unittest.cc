@@ -26,6 +26,8 @@ TEST(ParametersTest, SetDefaults) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultSampleInterval, p.sample_interval);
+  EXPECT_EQ(kDefaultHeapSummaryPeriod, p.heap_summary_period);
 }
 
 TEST(ParametersTest, ParseInvalidStackTraceTracking) {
@@ -43,6 +45,8 @@ TEST(ParametersTest, ParseMinimalCommandLine) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultSampleInterval, p.sample_interval);
+  EXPECT_EQ(kDefaultHeapSummaryPeriod, p.heap_summary_period);
 }
 
 TEST(ParametersTest, ParseMaximalCommandLine) {
@@ -50,11 +54,22 @@ TEST(ParametersTest, ParseMaximalCommandLine) {
   SetDefaultParameters(&p);
   std::string str("--stack-trace-tracking=emit "
                   "--serialize-timestamps "
-                  "--hash-contents-at-free");
+                  "--hash-contents-at-free "
+                  "--sample-interval=524288 "
+                  "--heap-summary-period=1000");
   EXPECT_TRUE(ParseParameters(str, &p));
   EXPECT_EQ(kTrackingEmit, p.stack_trace_tracking);
   EXPECT_TRUE(p.serialize_timestamps);
   EXPECT_TRUE(p.hash_contents_at_free);
+  EXPECT_EQ(524288u, p.sample_interval);
+  EXPECT_EQ(1000u, p.heap_summary_period);
+}
+
+TEST(ParametersTest, ParseInvalidSampleInterval) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParameters("--sample-interval=foo", &p));
+  EXPECT_FALSE(ParseParameters("--heap-summary-period=-1", &p));
 }
 
 TEST(ParametersTest, ParseNoEnvironment) {
@@ -68,6 +83,8 @@ TEST(ParametersTest, ParseNoEnvironment) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultSampleInterval, p.sample_interval);
+  EXPECT_EQ(kDefaultHeapSummaryPeriod, p.heap_summary_period);
 }
 
 TEST(ParametersTest, ParseEmptyEnvironment) {
@@ -81,6 +98,8 @@ TEST(ParametersTest, ParseEmptyEnvironment) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultSampleInterval, p.sample_interval);
+  EXPECT_EQ(kDefaultHeapSummaryPeriod, p.heap_summary_period);
 }
 
 TEST(ParametersTest, ParseInvalidEnvironment) {
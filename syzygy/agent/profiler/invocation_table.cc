@@ -0,0 +1,80 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/invocation_table.h"
+
+#include <malloc.h>
+#include <new>
+
+#include "base/logging.h"
+
+namespace agent {
+namespace profiler {
+
+namespace {
+
+const size_t kCacheLineSize = 64;
+
+static_assert(kCacheLineSize % sizeof(InvocationTable::Entry) == 0,
+              "Invocation table entries must not straddle cache lines.");
+
+}  // namespace
+
+InvocationTable::InvocationTable() : entries_(NULL), size_(0) {
+  void* memory = ::_aligned_malloc(kCapacity * sizeof(Entry), kCacheLineSize);
+  CHECK(memory != NULL);
+
+  entries_ = reinterpret_cast<Entry*>(memory);
+  for (size_t i = 0; i < kCapacity; ++i)
+    new (&entries_[i]) Entry();
+}
+
+InvocationTable::~InvocationTable() {
+  for (size_t i = 0; i < kCapacity; ++i)
+    entries_[i].~Entry();
+  ::_aligned_free(entries_);
+}
+
+InvocationTable::Entry* InvocationTable::FindOrAdd(RetAddr caller,
+                                                   FuncAddr function) {
+  DCHECK(function != NULL);
+
+  for (size_t i = Hash(caller, function);; i = (i + 1) & (kCapacity - 1)) {
+    Entry* entry = &entries_[i];
+    if (entry->function == function && entry->caller == caller)
+      return entry;
+    if (entry->function == NULL) {
+      if (full())
+        return NULL;
+      entry->caller = caller;
+      entry->function = function;
+      ++size_;
+      return entry;
+    }
+  }
+}
+
+void InvocationTable::Clear() {
+  if (size_ == 0)
+    return;
+
+  for (size_t i = 0; i < kCapacity; ++i) {
+    if (entries_[i].function != NULL)
+      entries_[i] = Entry();
+  }
+  size_ = 0;
+}
+
+}  // namespace profiler
+}  // namespace agent
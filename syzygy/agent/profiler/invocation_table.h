@@ -0,0 +1,129 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the per-thread table through which the profiler tallies the
+// invocations of a function from a call site into their InvocationInfo in
+// the trace buffer. The table is on the path of every function exit, so it
+// is a fixed-capacity open-addressing table: a lookup hashes the call site
+// and function and probes successive entries, which share cache lines, and
+// never allocates.
+
+#ifndef SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
+#define SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
+
+#include <stdint.h>
+
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/agent/profiler/symbol_map.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace agent {
+namespace profiler {
+
+class InvocationTable {
+ public:
+  // An entry of the table. An entry is empty when its function is NULL.
+  // Entries are a power of two in size and the table is cache line aligned,
+  // so that no entry straddles two cache lines.
+  struct __declspec(align(32)) Entry {
+    RetAddr caller;
+    FuncAddr function;
+
+    // Points to the trace buffer entry for the invocation. This is NULL for
+    // an entry that was added but not yet populated.
+    InvocationInfo* info;
+
+    // This invocation entry's caller's dynamic symbol, if any, and its last
+    // observed move count.
+    scoped_refptr<SymbolMap::Symbol> caller_symbol;
+    int32_t caller_move_count;
+
+    // This invocation entry's callee's dynamic symbol, if any, and its last
+    // observed move count.
+    scoped_refptr<SymbolMap::Symbol> function_symbol;
+    int32_t function_move_count;
+  };
+
+  // The number of entries of the table, which is a power of two.
+  static const size_t kCapacity = 2048;
+
+  // The number of entries the table holds before it is full. Keeping a
+  // quarter of the entries empty bounds the length of the probes.
+  static const size_t kMaxSize = kCapacity / 4 * 3;
+
+  InvocationTable();
+  ~InvocationTable();
+
+  // Finds the entry of an invocation.
+  // @param caller the call site of the invocation.
+  // @param function the function invoked.
+  // @returns the entry, or NULL if there's none.
+  Entry* Find(RetAddr caller, FuncAddr function) {
+    DCHECK(function != NULL);
+    for (size_t i = Hash(caller, function);; i = (i + 1) & (kCapacity - 1)) {
+      Entry* entry = &entries_[i];
+      if (entry->function == function && entry->caller == caller)
+        return entry;
+      if (entry->function == NULL)
+        return NULL;
+    }
+  }
+
+  // Finds the entry of an invocation, adding an empty one if there's none.
+  // @param caller the call site of the invocation.
+  // @param function the function invoked.
+  // @returns the entry, whose info is NULL if it was added, or NULL if the
+  //     invocation has no entry and the table is full.
+  Entry* FindOrAdd(RetAddr caller, FuncAddr function);
+
+  // Removes all entries, releasing their symbols.
+  void Clear();
+
+  // @returns the number of entries in the table.
+  size_t size() const { return size_; }
+
+  // @returns true if no entry can be added.
+  bool full() const { return size_ >= kMaxSize; }
+
+ protected:
+  // @returns the index of the first entry probed for an invocation.
+  static size_t Hash(RetAddr caller, FuncAddr function) {
+    // Call sites and functions are both code addresses, often close to one
+    // another, so they are mixed before picking the high bits of a
+    // multiplicative hash.
+    uint32_t caller_bits =
+        static_cast<uint32_t>(reinterpret_cast<uintptr_t>(caller));
+    uint32_t function_bits =
+        static_cast<uint32_t>(reinterpret_cast<uintptr_t>(function) >> 4);
+    uint32_t key = caller_bits ^ (function_bits * 0x85EBCA6Bu);
+    return static_cast<size_t>((key * 0x9E3779B1u) >> (32 - kCapacityBits));
+  }
+
+  static const size_t kCapacityBits = 11;
+  static_assert((1u << kCapacityBits) == kCapacity,
+                "The capacity must be a power of two.");
+
+  // The entries, in cache line aligned memory.
+  Entry* entries_;
+  size_t size_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InvocationTable);
+};
+
+}  // namespace profiler
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
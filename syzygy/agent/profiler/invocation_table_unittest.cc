@@ -0,0 +1,101 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/invocation_table.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace profiler {
+
+namespace {
+
+RetAddr ToCaller(uintptr_t address) {
+  return reinterpret_cast<RetAddr>(address);
+}
+
+FuncAddr ToFunction(uintptr_t address) {
+  return reinterpret_cast<FuncAddr>(address);
+}
+
+}  // namespace
+
+TEST(InvocationTableTest, FindOrAdd) {
+  InvocationTable table;
+  EXPECT_EQ(0u, table.size());
+  EXPECT_TRUE(table.Find(ToCaller(0x1000), ToFunction(0x2000)) == NULL);
+
+  InvocationTable::Entry* entry =
+      table.FindOrAdd(ToCaller(0x1000), ToFunction(0x2000));
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(ToCaller(0x1000), entry->caller);
+  EXPECT_EQ(ToFunction(0x2000), entry->function);
+  EXPECT_TRUE(entry->info == NULL);
+  EXPECT_EQ(1u, table.size());
+
+  // Entries don't straddle cache lines.
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(entry) % 32);
+
+  EXPECT_EQ(entry, table.Find(ToCaller(0x1000), ToFunction(0x2000)));
+  EXPECT_EQ(entry, table.FindOrAdd(ToCaller(0x1000), ToFunction(0x2000)));
+  EXPECT_EQ(1u, table.size());
+
+  // The same function from another call site is another invocation.
+  EXPECT_TRUE(table.Find(ToCaller(0x1004), ToFunction(0x2000)) == NULL);
+  EXPECT_NE(entry, table.FindOrAdd(ToCaller(0x1004), ToFunction(0x2000)));
+  EXPECT_EQ(2u, table.size());
+}
+
+TEST(InvocationTableTest, FillAndClear) {
+  InvocationTable table;
+
+  // Nearby call sites and functions collide in their low bits, and are all
+  // found again.
+  for (size_t i = 0; i < InvocationTable::kMaxSize; ++i) {
+    ASSERT_TRUE(table.FindOrAdd(ToCaller(0x1000 + i),
+                                ToFunction(0x2000 + i * 16)) != NULL);
+  }
+  EXPECT_TRUE(table.full());
+  for (size_t i = 0; i < InvocationTable::kMaxSize; ++i) {
+    ASSERT_TRUE(table.Find(ToCaller(0x1000 + i),
+                           ToFunction(0x2000 + i * 16)) != NULL);
+  }
+
+  // A full table finds its entries but doesn't add any.
+  EXPECT_TRUE(table.FindOrAdd(ToCaller(0x1000), ToFunction(0x2000)) != NULL);
+  EXPECT_TRUE(table.FindOrAdd(ToCaller(0x1000), ToFunction(0x1000)) == NULL);
+
+  table.Clear();
+  EXPECT_EQ(0u, table.size());
+  EXPECT_FALSE(table.full());
+  EXPECT_TRUE(table.Find(ToCaller(0x1000), ToFunction(0x2000)) == NULL);
+}
+
+TEST(InvocationTableTest, ClearReleasesSymbols) {
+  scoped_refptr<SymbolMap::Symbol> symbol(
+      new SymbolMap::Symbol("foo", ToFunction(0x2000)));
+
+  InvocationTable table;
+  InvocationTable::Entry* entry =
+      table.FindOrAdd(ToCaller(0x1000), ToFunction(0x2000));
+  ASSERT_TRUE(entry != NULL);
+  entry->function_symbol = symbol;
+  EXPECT_FALSE(symbol->HasOneRef());
+
+  table.Clear();
+  EXPECT_TRUE(symbol->HasOneRef());
+}
+
+}  // namespace profiler
+}  // namespace agent
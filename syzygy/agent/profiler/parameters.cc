@@ -0,0 +1,112 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/parameters.h"
+
+#include <memory>
+#include <string>
+
+#include "base/command_line.h"
+#include "base/environment.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+
+namespace agent {
+namespace profiler {
+
+namespace {
+
+// Parses the value of the switch @p name of @p cmd_line, if present.
+bool ParseUint32Switch(const base::CommandLine& cmd_line,
+                       const char* name,
+                       uint32_t* value) {
+  DCHECK_NE(static_cast<uint32_t*>(nullptr), value);
+
+  if (!cmd_line.HasSwitch(name))
+    return true;
+
+  std::string str = cmd_line.GetSwitchValueASCII(name);
+  unsigned parsed = 0;
+  if (!base::StringToUint(str, &parsed)) {
+    LOG(ERROR) << "Invalid value for --" << name << ": " << str;
+    return false;
+  }
+
+  *value = parsed;
+  return true;
+}
+
+}  // namespace
+
+// The environment variable that is used for extracting parameters.
+const char kParametersEnvVar[] = "SYZYGY_PROFILER_OPTIONS";
+
+// Default parameter values.
+const uint32_t kDefaultSamplingThreshold = 0;
+const uint32_t kDefaultSamplingWindowMs = 100;
+
+// Parameter names for parsing.
+const char kParamSamplingThreshold[] = "sampling-threshold";
+const char kParamSamplingWindowMs[] = "sampling-window-ms";
+
+void SetDefaultParameters(Parameters* parameters) {
+  DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
+  parameters->sampling_threshold = kDefaultSamplingThreshold;
+  parameters->sampling_window_ms = kDefaultSamplingWindowMs;
+}
+
+bool ParseParameters(const base::StringPiece& param_string,
+                     Parameters* parameters) {
+  DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
+
+  // Prepends the flags with a dummy executable name to keep the
+  // base::CommandLine parser happy.
+  std::wstring str = base::UTF8ToWide(param_string);
+  str.insert(0, L" ");
+  str.insert(0, L"dummy.exe");
+  base::CommandLine cmd_line = base::CommandLine::FromString(str);
+
+  bool success = true;
+  if (!ParseUint32Switch(cmd_line, kParamSamplingThreshold,
+                         &parameters->sampling_threshold)) {
+    success = false;
+  }
+  if (!ParseUint32Switch(cmd_line, kParamSamplingWindowMs,
+                         &parameters->sampling_window_ms)) {
+    success = false;
+  }
+  if (parameters->sampling_window_ms == 0) {
+    LOG(ERROR) << "--" << kParamSamplingWindowMs << " must not be zero.";
+    success = false;
+  }
+
+  return success;
+}
+
+bool ParseParametersFromEnv(Parameters* parameters) {
+  DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
+
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  DCHECK_NE(static_cast<base::Environment*>(nullptr), env.get());
+
+  std::string value;
+  if (!env->GetVar(kParametersEnvVar, &value))
+    return true;
+
+  return ParseParameters(value, parameters);
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -0,0 +1,87 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/parameters.h"
+
+#include <memory>
+
+#include "base/environment.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace profiler {
+
+TEST(ParametersTest, SetDefaults) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_EQ(kDefaultSamplingThreshold, p.sampling_threshold);
+  EXPECT_EQ(kDefaultSamplingWindowMs, p.sampling_window_ms);
+}
+
+TEST(ParametersTest, ParseMinimalCommandLine) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParameters("", &p));
+  EXPECT_EQ(kDefaultSamplingThreshold, p.sampling_threshold);
+  EXPECT_EQ(kDefaultSamplingWindowMs, p.sampling_window_ms);
+}
+
+TEST(ParametersTest, ParseMaximalCommandLine) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParameters("--sampling-threshold=1000 "
+                              "--sampling-window-ms=50",
+                              &p));
+  EXPECT_EQ(1000u, p.sampling_threshold);
+  EXPECT_EQ(50u, p.sampling_window_ms);
+}
+
+TEST(ParametersTest, ParseInvalidValues) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParameters("--sampling-threshold=foo", &p));
+  EXPECT_FALSE(ParseParameters("--sampling-threshold=-1", &p));
+
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParameters("--sampling-window-ms=0", &p));
+}
+
+TEST(ParametersTest, ParseNoEnvironment) {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_NE(nullptr, env.get());
+  env->UnSetVar(kParametersEnvVar);
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParametersFromEnv(&p));
+  EXPECT_EQ(kDefaultSamplingThreshold, p.sampling_threshold);
+  EXPECT_EQ(kDefaultSamplingWindowMs, p.sampling_window_ms);
+}
+
+TEST(ParametersTest, ParseValidEnvironment) {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_NE(nullptr, env.get());
+  env->SetVar(kParametersEnvVar, "--sampling-threshold=10");
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParametersFromEnv(&p));
+  EXPECT_EQ(10u, p.sampling_threshold);
+  EXPECT_EQ(kDefaultSamplingWindowMs, p.sampling_window_ms);
+
+  env->UnSetVar(kParametersEnvVar);
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -17,6 +17,7 @@
 
 #include <windows.h>
 #include <algorithm>
+#include <limits>
 #include <memory>
 
 #include "base/at_exit.h"
@@ -32,53 +33,21 @@
 #include "syzygy/agent/common/dlist.h"
 #include "syzygy/agent/common/process_utils.h"
 #include "syzygy/agent/common/scoped_last_error_keeper.h"
+#include "syzygy/agent/profiler/invocation_table.h"
 #include "syzygy/agent/profiler/return_thunk_factory.h"
 #include "syzygy/common/logging.h"
 #include "syzygy/common/process_utils.h"
 #include "syzygy/trace/client/client_utils.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace {
 
 using agent::common::ScopedLastErrorKeeper;
 
-typedef std::pair<RetAddr, FuncAddr> InvocationKey;
-
-class HashInvocationKey {
- public:
-  static const size_t bucket_size = 4;
-  static const size_t min_buckets = 8;
-
-  size_t operator()(const InvocationKey& key) const {
-    return reinterpret_cast<size_t>(key.first) ^
-        reinterpret_cast<size_t>(key.second);
-  }
-
-  bool operator()(const InvocationKey& a, const InvocationKey& b) const {
-    return a < b;
-  }
-};
-
+using agent::profiler::InvocationTable;
 using agent::profiler::SymbolMap;
 
-struct InvocationValue {
-  // This invocation entry's caller's dynamic symbol, if any.
-  scoped_refptr<SymbolMap::Symbol> caller_symbol;
-  // The last observed move count for caller_symbol.
-  int32_t caller_move_count;
-
-  // This invocation entry's callee's dynamic symbol, if any.
-  scoped_refptr<SymbolMap::Symbol> function_symbol;
-  // The last observed move count for function_symbol.
-  int32_t function_move_count;
-
-  // Points to the trace buffer entry for the respective function.
-  InvocationInfo* info;
-};
-
-typedef std::unordered_map<InvocationKey, InvocationValue, HashInvocationKey>
-    InvocationMap;
-
 // The information on how to set the thread name comes from
 // a MSDN article: http://msdn2.microsoft.com/en-us/library/xcb2z8hs.aspx
 const DWORD kVCThreadNameException = 0x406D1388;
@@ -200,6 +169,23 @@ extern "C" void __declspec(naked) _indirect_penter_dllmain() {
   }
 }
 
+// An empty function, the baseline of the calibration of the hooks.
+extern "C" void __declspec(naked) _profiler_calibration_function() {
+  __asm {
+    ret
+  }
+}
+
+// The empty function, instrumented as the instrumenter does it: the function
+// address is pushed before jumping to the entry hook, which returns to it.
+extern "C" void __declspec(naked)
+_profiler_instrumented_calibration_function() {
+  __asm {
+    push _profiler_calibration_function
+    jmp _indirect_penter
+  }
+}
+
 // On entry, pc_location should point to a location on our own stack.
 extern "C" uintptr_t __cdecl ResolveReturnAddressLocation(
     uintptr_t pc_location) {
@@ -306,6 +292,10 @@ class Profiler::ThreadState
   // Logs @p symbol into the trace.
   void LogSymbol(SymbolMap::Symbol* symbol);
 
+  // Measures the overhead of the hooks on this thread, and on the CPU it runs
+  // on, and logs it into the trace. This is done once per thread.
+  void Calibrate();
+
   // Processes a single function entry.
   void OnFunctionEntry(EntryFrame* entry_frame,
                        FuncAddr function,
@@ -325,6 +315,9 @@ class Profiler::ThreadState
   // Function exit hook.
   void OnFunctionExit(const ThunkData* data, uint64_t cycles_exit);
 
+  // Logs the calls that were counted but not profiled since the last time.
+  void LogSkippedCalls();
+
   trace::client::TraceFileSegment* segment() { return &segment_; }
 
  private:
@@ -332,7 +325,13 @@ class Profiler::ThreadState
 
   void RecordInvocation(RetAddr caller, FuncAddr function, uint64_t cycles);
 
+  // Throttles the profiling of @p function when sampling.
+  // @returns true if this call to @p function should be profiled, false if
+  //     it's only counted.
+  bool ShouldProfileCall(FuncAddr function, uint64_t cycles);
+
   void UpdateOverhead(uint64_t entry_cycles);
+  void LogCalibration(const TraceProfilerCalibration& calibration);
   InvocationInfo* AllocateInvocationInfo();
   void ClearCache();
   bool FlushSegment();
@@ -346,8 +345,33 @@ class Profiler::ThreadState
   // measures time exclusive of profiling overhead.
   uint64_t cycles_overhead_;
 
+  // True once the hooks have been calibrated on this thread.
+  bool is_calibrated_;
+
+  // While calibrating, the invocations aren't recorded. The cycles of the
+  // last one are stashed instead.
+  bool calibrating_;
+  uint64_t calibration_cycles_;
+
+  // The sampling state of a function on this thread.
+  struct FunctionSampling {
+    // The cycle count at the start of the function's sampling window.
+    uint64_t window_start;
+    // The calls of the function profiled in its sampling window.
+    uint32_t window_calls;
+    // The calls of the function skipped since they were last logged.
+    uint32_t skipped_calls;
+  };
+  typedef base::hash_map<FuncAddr, FunctionSampling> FunctionSamplingMap;
+  FunctionSamplingMap sampling_;
+
+  // The cycle count when the skipped calls were last logged, and whether
+  // calls were skipped since.
+  uint64_t skipped_calls_logged_;
+  bool has_skipped_calls_;
+
   // The invocations we've recorded in our buffer.
-  InvocationMap invocations_;
+  InvocationTable invocations_;
 
   // The trace file segment we're recording to.
   trace::client::TraceFileSegment segment_;
@@ -360,8 +384,14 @@ class Profiler::ThreadState
 };
 
 Profiler::ThreadState::ThreadState(Profiler* profiler)
-    : profiler_(profiler),
+    : ReturnThunkFactoryImpl<Profiler::ThreadState>(&profiler->thunk_pages_),
+      profiler_(profiler),
       cycles_overhead_(0LL),
+      is_calibrated_(false),
+      calibrating_(false),
+      calibration_cycles_(0),
+      skipped_calls_logged_(0),
+      has_skipped_calls_(false),
       batch_(NULL) {
   Initialize();
 }
@@ -370,8 +400,10 @@ Profiler::ThreadState::~ThreadState() {
   ClearCache();
 
   // If we have an outstanding buffer, let's deallocate it now.
-  if (segment_.write_ptr != NULL)
+  if (segment_.write_ptr != NULL) {
+    LogSkippedCalls();
     profiler_->session_.ReturnBuffer(&segment_);
+  }
 
   Uninitialize();
 }
@@ -454,12 +486,58 @@ void Profiler::ThreadState::LogSymbol(SymbolMap::Symbol* symbol) {
                 symbol->name().data(), symbol->name().size() + 1);
 }
 
+void Profiler::ThreadState::Calibrate() {
+  if (is_calibrated_ || !profiler_->session_.IsTracing())
+    return;
+  is_calibrated_ = true;
+
+  // The calibration may run within a hook, whose overhead already covers it.
+  uint64_t cycles_overhead = cycles_overhead_;
+
+  // The minimum of many measurements discards those disturbed by interrupts
+  // and cache misses.
+  const size_t kIterations = 1000;
+  uint64_t invocation_cycles = std::numeric_limits<uint64_t>::max();
+  uint64_t caller_cycles = std::numeric_limits<uint64_t>::max();
+  uint64_t baseline_cycles = std::numeric_limits<uint64_t>::max();
+  calibrating_ = true;
+  for (size_t i = 0; i < kIterations; ++i) {
+    uint64_t overhead_before = cycles_overhead_;
+    uint64_t t0 = __rdtsc();
+    _profiler_instrumented_calibration_function();
+    uint64_t t1 = __rdtsc();
+    // The caller sees the cycles of the call that the hooks don't account
+    // for in their overhead.
+    caller_cycles = std::min(caller_cycles,
+                             t1 - t0 - (cycles_overhead_ - overhead_before));
+    invocation_cycles = std::min(invocation_cycles, calibration_cycles_);
+
+    t0 = __rdtsc();
+    _profiler_calibration_function();
+    t1 = __rdtsc();
+    baseline_cycles = std::min(baseline_cycles, t1 - t0);
+  }
+  calibrating_ = false;
+  cycles_overhead_ = cycles_overhead;
+
+  TraceProfilerCalibration calibration = {};
+  calibration.invocation_cycles = invocation_cycles;
+  if (caller_cycles > baseline_cycles)
+    calibration.caller_cycles = caller_cycles - baseline_cycles;
+  LogCalibration(calibration);
+}
+
 void Profiler::ThreadState::OnFunctionEntry(EntryFrame* entry_frame,
                                             FuncAddr function,
                                             uint64_t cycles) {
   if (profiler_->session_.IsDisabled())
     return;
 
+  if (!ShouldProfileCall(function, cycles)) {
+    UpdateOverhead(cycles);
+    return;
+  }
+
   // Record the details of the entry.
   // Note that on tail-recursion and tail-call elimination, the caller recorded
   // here will be a thunk. We cater for this case on exit as best we can.
@@ -474,6 +552,83 @@ void Profiler::ThreadState::OnFunctionEntry(EntryFrame* entry_frame,
   UpdateOverhead(cycles);
 }
 
+bool Profiler::ThreadState::ShouldProfileCall(FuncAddr function,
+                                              uint64_t cycles) {
+  uint32_t threshold = profiler_->parameters_.sampling_threshold;
+  if (threshold == 0)
+    return true;
+
+  // The skipped calls are logged once per window, so that the trace shows
+  // where they happened.
+  uint64_t window_cycles = profiler_->sampling_window_cycles_;
+  if (has_skipped_calls_ && cycles - skipped_calls_logged_ >= window_cycles) {
+    LogSkippedCalls();
+    skipped_calls_logged_ = cycles;
+  }
+
+  FunctionSampling& sampling = sampling_[function];
+  if (cycles - sampling.window_start >= window_cycles) {
+    sampling.window_start = cycles;
+    sampling.window_calls = 0;
+  }
+
+  if (sampling.window_calls < threshold) {
+    ++sampling.window_calls;
+    return true;
+  }
+
+  ++sampling.skipped_calls;
+  has_skipped_calls_ = true;
+  return false;
+}
+
+void Profiler::ThreadState::LogSkippedCalls() {
+  if (!has_skipped_calls_)
+    return;
+  has_skipped_calls_ = false;
+
+  const size_t kMaxFunctionsPerRecord = 128;
+  FunctionSamplingMap::iterator it = sampling_.begin();
+  while (it != sampling_.end()) {
+    TraceSkippedCalls functions[kMaxFunctionsPerRecord];
+    uint32_t num_functions = 0;
+    for (; it != sampling_.end() && num_functions < kMaxFunctionsPerRecord;
+         ++it) {
+      if (it->second.skipped_calls == 0)
+        continue;
+      functions[num_functions].function = it->first;
+      functions[num_functions].num_calls = it->second.skipped_calls;
+      ++num_functions;
+      it->second.skipped_calls = 0;
+    }
+    if (num_functions == 0)
+      return;
+
+    size_t record_size = FIELD_OFFSET(TraceProfilerSampling, functions) +
+                         num_functions * sizeof(functions[0]);
+    if (!segment_.CanAllocate(record_size) && !FlushSegment()) {
+      // Failed to allocate the sampling record, the skipped calls are lost.
+      return;
+    }
+
+    DCHECK(segment_.CanAllocate(record_size));
+    batch_ = NULL;
+
+    TraceProfilerSampling* sampling_event =
+        reinterpret_cast<TraceProfilerSampling*>(
+            segment_.AllocateTraceRecordImpl(TRACE_PROFILER_SAMPLING,
+                                             record_size));
+    DCHECK(sampling_event != NULL);
+    sampling_event->sampling_threshold =
+        profiler_->parameters_.sampling_threshold;
+    sampling_event->sampling_window_ms =
+        profiler_->parameters_.sampling_window_ms;
+    sampling_event->num_functions = num_functions;
+    ::memcpy(sampling_event->functions, functions,
+             num_functions * sizeof(functions[0]));
+  }
+}
+
 void Profiler::ThreadState::OnV8FunctionEntry(FuncAddr function,
                                               RetAddr* return_address_location,
                                               uint64_t cycles) {
@@ -513,7 +668,9 @@ void Profiler::ThreadState::OnFunctionExit(const ThunkData* data,
   // TODO(siggi): Move this into RecordInvocation, as we can elide the lookup
   //     on a cache hit.
   Thunk* ret_thunk = CastToThunk(data->caller);
-  if (ret_thunk == NULL) {
+  if (calibrating_) {
+    calibration_cycles_ = cycles_executed;
+  } else if (ret_thunk == NULL) {
     RecordInvocation(data->caller, data->function, cycles_executed);
   } else {
     ThunkData* ret_data = DataFromThunk(ret_thunk);
@@ -535,35 +692,30 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
                                              FuncAddr function,
                                              uint64_t duration_cycles) {
   // See whether we've already recorded an entry for this function.
-  InvocationKey key(caller, function);
-  InvocationMap::iterator it = invocations_.find(key);
-  if (it != invocations_.end()) {
+  InvocationTable::Entry* entry = invocations_.Find(caller, function);
+  if (entry != NULL && entry->info != NULL) {
     // Yup, we already have an entry, validate it.
-    InvocationValue& value = it->second;
-
-    if ((value.caller_symbol == NULL ||
-         value.caller_symbol->move_count() == value.caller_move_count) &&
-        (value.function_symbol == NULL ||
-         value.function_symbol->move_count() == value.function_move_count)) {
+    if ((entry->caller_symbol == NULL ||
+         entry->caller_symbol->move_count() == entry->caller_move_count) &&
+        (entry->function_symbol == NULL ||
+         entry->function_symbol->move_count() ==
+             entry->function_move_count)) {
       // The entry is still good, tally the new data.
-      ++(value.info->num_calls);
-      value.info->cycles_sum += duration_cycles;
-      if (duration_cycles < value.info->cycles_min) {
-        value.info->cycles_min = duration_cycles;
-      } else if (duration_cycles > value.info->cycles_max) {
-        value.info->cycles_max = duration_cycles;
+      ++(entry->info->num_calls);
+      entry->info->cycles_sum += duration_cycles;
+      if (duration_cycles < entry->info->cycles_min) {
+        entry->info->cycles_min = duration_cycles;
+      } else if (duration_cycles > entry->info->cycles_max) {
+        entry->info->cycles_max = duration_cycles;
       }
 
       // Early out on success.
       return;
-    } else {
-      // The entry is not valid any more, discard it.
-      DCHECK(value.caller_symbol != NULL || value.function_symbol != NULL);
-
-      invocations_.erase(it);
     }
+
+    // The entry is not valid any more, it's repopulated below.
+    DCHECK(entry->caller_symbol != NULL || entry->function_symbol != NULL);
   }
-  DCHECK(invocations_.find(key) == invocations_.end());
 
   // We don't have an entry, allocate a new one for this invocation.
   // The code below may touch last error.
@@ -593,19 +745,29 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
 
   InvocationInfo* info = AllocateInvocationInfo();
   if (info != NULL) {
-    InvocationValue& value = invocations_[key];
-    value.info = info;
-    value.caller_symbol = caller_symbol;
+    // The allocation may have flushed the segment, and with it the table, so
+    // the entry is looked up again. When the table overflows its entries are
+    // dropped, and the invocations they tally start afresh in new entries of
+    // the batch.
+    entry = invocations_.FindOrAdd(caller, function);
+    if (entry == NULL) {
+      invocations_.Clear();
+      entry = invocations_.FindOrAdd(caller, function);
+    }
+    DCHECK(entry != NULL);
+
+    entry->info = info;
+    entry->caller_symbol = caller_symbol;
     if (caller_symbol != NULL)
-      value.caller_move_count = caller_symbol->move_count();
+      entry->caller_move_count = caller_symbol->move_count();
     else
-      value.caller_move_count = 0;
+      entry->caller_move_count = 0;
 
-    value.function_symbol = function_symbol;
+    entry->function_symbol = function_symbol;
     if (function_symbol != NULL)
-      value.function_move_count = function_symbol->move_count();
+      entry->function_move_count = function_symbol->move_count();
     else
-      value.function_move_count = 0;
+      entry->function_move_count = 0;
 
     if (function_symbol == NULL) {
       // We're not in a dynamic function, record the (conventional) function.
@@ -645,6 +807,22 @@ void Profiler::ThreadState::UpdateOverhead(uint64_t entry_cycles) {
   cycles_overhead_ += (__rdtsc() - entry_cycles);
 }
 
+void Profiler::ThreadState::LogCalibration(
+    const TraceProfilerCalibration& calibration) {
+  if (!segment_.CanAllocate(sizeof(calibration)) && !FlushSegment()) {
+    // Failed to allocate the calibration record.
+    return;
+  }
+
+  DCHECK(segment_.CanAllocate(sizeof(calibration)));
+  batch_ = NULL;
+
+  TraceProfilerCalibration* calibration_event =
+      segment_.AllocateTraceRecord<TraceProfilerCalibration>();
+  DCHECK(calibration_event != NULL);
+  *calibration_event = calibration;
+}
+
 InvocationInfo* Profiler::ThreadState::AllocateInvocationInfo() {
   // This is kind of self-evident for the moment, as an invocation info batch
   // contains at least one invocation info as currently declared.
@@ -687,7 +865,7 @@ bool Profiler::ThreadState::FlushSegment() {
 
 void Profiler::ThreadState::ClearCache() {
   batch_ = NULL;
-  invocations_.clear();
+  invocations_.Clear();
 }
 
 void Profiler::OnThreadDetach() {
@@ -832,7 +1010,24 @@ void Profiler::OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
   }
 }
 
-Profiler::Profiler() : handler_registration_(NULL) {
+Profiler::Profiler()
+    : sampling_window_cycles_(0), handler_registration_(NULL) {
+  SetDefaultParameters(&parameters_);
+  if (!ParseParametersFromEnv(&parameters_))
+    LOG(ERROR) << "Failed to parse " << kParametersEnvVar << ".";
+
+  if (parameters_.sampling_threshold != 0) {
+    // The sampling windows are timed with the cycle counter.
+    trace::common::TimerInfo tsc_info = {};
+    trace::common::GetTscTimerInfo(&tsc_info);
+    sampling_window_cycles_ =
+        tsc_info.frequency * parameters_.sampling_window_ms / 1000;
+    if (sampling_window_cycles_ == 0) {
+      LOG(ERROR) << "Unknown cycle counter frequency, not sampling.";
+      parameters_.sampling_threshold = 0;
+    }
+  }
+
   // Create our RPC session and allocate our initial trace segment on creation,
   // aka at load time.
   ThreadState* data = CreateFirstThreadStateAndSession();
@@ -866,6 +1061,8 @@ Profiler::ThreadState* Profiler::CreateFirstThreadStateAndSession() {
 
   // Create the session (and allocate the first segment).
   trace::client::InitializeRpcSession(&session_, data->segment());
+  if (data->segment()->write_ptr != NULL)
+    data->Calibrate();
 
   return data;
 }
@@ -874,6 +1071,9 @@ Profiler::ThreadState* Profiler::GetOrAllocateThreadState() {
   Profiler::ThreadState* data = GetOrAllocateThreadStateImpl();
   if (!data->segment()->write_ptr && session_.IsTracing()) {
     session_.AllocateBuffer(data->segment());
+    // The hooks are calibrated once the thread has a buffer to log to.
+    if (data->segment()->write_ptr != NULL)
+      data->Calibrate();
   }
   return data;
 }
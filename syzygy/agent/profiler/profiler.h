@@ -33,6 +33,8 @@
 #include "syzygy/agent/common/dll_notifications.h"
 #include "syzygy/agent/common/entry_frame.h"
 #include "syzygy/agent/common/thread_state.h"
+#include "syzygy/agent/profiler/parameters.h"
+#include "syzygy/agent/profiler/return_thunk_factory.h"
 #include "syzygy/agent/profiler/symbol_map.h"
 #include "syzygy/trace/client/rpc_session.h"
 
@@ -142,13 +144,20 @@ class Profiler {
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
+  // The runtime parameters, read from the environment at startup.
+  Parameters parameters_;
+
+  // The length of a sampling window, in cycles.
+  uint64_t sampling_window_cycles_;
+
   // Protects pages_ and logged_modules_.
   base::Lock lock_;
 
   // The dynamic symbol map.
   SymbolMap symbol_map_;
 
-  // Contains the thunk pages in lexical order.
+  // Contains the thunk pages in lexical order. Pooled pages are never
+  // removed, so this only grows with the most pages in use at a time.
   typedef std::vector<const void*> PageVector;
   PageVector pages_;  // Under lock_.
 
@@ -156,6 +165,10 @@ class Profiler {
   typedef base::hash_set<HMODULE> ModuleSet;
   ModuleSet logged_modules_;  // Under lock_.
 
+  // The thunk pages of the threads, recycled from the threads that exit to
+  // those that start. This outlives the ThreadState instances.
+  ReturnThunkFactoryBase::PagePool thunk_pages_;
+
   // A helper to manage the life-cycle of the ThreadState instances allocated
   // by this agent.
   agent::common::ThreadStateManager thread_state_manager_;
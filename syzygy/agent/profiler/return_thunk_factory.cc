@@ -21,8 +21,44 @@
 namespace agent {
 namespace profiler {
 
-ReturnThunkFactoryBase::ReturnThunkFactoryBase(ThunkMainFunc main_func)
+ReturnThunkFactoryBase::PagePool::PagePool() : main_func_(NULL) {
+  ::InitializeSListHead(&free_pages_);
+}
+
+ReturnThunkFactoryBase::PagePool::~PagePool() {
+  // Pages still used by factories are leaked, but the pool outlives them.
+  Page* page = NULL;
+  while ((page = Pop()) != NULL) {
+    ThunkData* data = DataFromThunk(&page->thunks[0]);
+    delete [] data;
+    ::VirtualFree(page, 0, MEM_RELEASE);
+  }
+}
+
+size_t ReturnThunkFactoryBase::PagePool::num_free_pages() {
+  return ::QueryDepthSList(&free_pages_);
+}
+
+ReturnThunkFactoryBase::Page* ReturnThunkFactoryBase::PagePool::Pop() {
+  // The list entry leads the page.
+  return reinterpret_cast<Page*>(::InterlockedPopEntrySList(&free_pages_));
+}
+
+void ReturnThunkFactoryBase::PagePool::Push(Page* page,
+                                            ThunkMainFunc main_func) {
+  DCHECK(page != NULL);
+  DCHECK(main_func_ == NULL || main_func_ == main_func)
+      << "Pooling pages of factories with different thunk main functions.";
+
+  main_func_ = main_func;
+  page->factory = NULL;
+  ::InterlockedPushEntrySList(&free_pages_, &page->pool_entry);
+}
+
+ReturnThunkFactoryBase::ReturnThunkFactoryBase(ThunkMainFunc main_func,
+                                               PagePool* pool)
     : main_func_(main_func),
+      pool_(pool),
       first_free_thunk_(NULL) {
   DCHECK(main_func_ != NULL);
 }
@@ -48,6 +84,11 @@ void ReturnThunkFactoryBase::Uninitialize() {
     Page* page_to_free = current_page;
     current_page = current_page->next_page;
 
+    if (pool_ != NULL) {
+      pool_->Push(page_to_free, main_func_);
+      continue;
+    }
+
     // Notify our subclasses of the release.
     // We do this before freeing the memory to make sure we don't
     // open a race where a new thread could sneak a stack into
@@ -104,6 +145,25 @@ void ReturnThunkFactoryBase::AddPage() {
   Page* previous_page = PageFromThunk(first_free_thunk_);
   DCHECK(previous_page == NULL || previous_page->next_page == NULL);
 
+  // A pooled page has its thunks already, their data only needs to point
+  // back to us.
+  if (pool_ != NULL) {
+    Page* pooled_page = pool_->Pop();
+    if (pooled_page != NULL) {
+      pooled_page->previous_page = previous_page;
+      pooled_page->next_page = NULL;
+      pooled_page->factory = this;
+      if (previous_page)
+        previous_page->next_page = pooled_page;
+
+      for (size_t i = 0; i < kNumThunksPerPage; ++i)
+        DataFromThunk(&pooled_page->thunks[i])->self = this;
+
+      first_free_thunk_ = &pooled_page->thunks[0];
+      return;
+    }
+  }
+
   // TODO(joi): This may be consuming 64K of memory, in which case it would
   // be more efficient to reserve a larger block at a time if we think we
   // normally need more than 4K of thunks.
@@ -25,7 +25,9 @@ namespace profiler {
 // packed as tight as possible into whole pages of memory.  All pages
 // are freed on destruction, but currently-unused pages are not freed
 // in between times, on the assumption that the call stack will grow
-// as deep again as it has before.
+// as deep again as it has before. Factories that share a PagePool instead
+// return their pages to the pool on destruction, for the next factory to
+// reuse.
 //
 // This class is currently somewhat specific to profiling, as it
 // calls rdtsc in the return hook and stores data needed for profiling,
@@ -34,6 +36,7 @@ class ReturnThunkFactoryBase {
  public:
   struct Thunk;
   struct ThunkData;
+  class PagePool;
 
   // Provides a pointer to the thunk data associated with a thunk that,
   // when called, will invoke OnFunctionExit and then return
@@ -84,7 +87,10 @@ class ReturnThunkFactoryBase {
   // Thunk function type.
   typedef void (*ThunkMainFunc)();
 
-  explicit ReturnThunkFactoryBase(ThunkMainFunc main_func);
+  // @param main_func the thunk main function of the factory.
+  // @param pool the pool the factory takes its pages from and returns them
+  //     to, or NULL to allocate and free its own pages.
+  ReturnThunkFactoryBase(ThunkMainFunc main_func, PagePool* pool);
   ~ReturnThunkFactoryBase();
 
   // Must be called after construction of this class to
@@ -98,18 +104,24 @@ class ReturnThunkFactoryBase {
 
   // @name To be implemented by subclasses.
   // @{
-  // Invoked after the factory has allocated a new page of thunks.
+  // Invoked after the factory has allocated a new page of thunks. A page
+  // taken from a pool is only new the first time.
   // @param page the page of thunks, @p page is 4K and aligned on a
   //    4K boundary.
   virtual void OnPageAdded(const void* page) = 0;
 
-  // Invoked before the factory deallocates a page of thunks.
+  // Invoked before the factory deallocates a page of thunks. Pages returned
+  // to a pool aren't deallocated, and stay thunk pages until the pool is
+  // destroyed.
   // @param page the page of thunks, @p page is 4K in size and aligned on a
   //    4K boundary.
   virtual void OnPageRemoved(const void* page) = 0;
   // @}
 
   struct Page {
+    // Links the page into the free list of a pool. This must come first, as
+    // the entries of an interlocked list must be aligned.
+    SLIST_ENTRY pool_entry;
     Page* previous_page;
     Page* next_page;
     ReturnThunkFactoryBase* factory;
@@ -128,6 +140,9 @@ class ReturnThunkFactoryBase {
   // The thunk main function we delegate to.
   ThunkMainFunc main_func_;
 
+  // The pool we take our pages from, if any.
+  PagePool* pool_;
+
   // At all times, this points to the memory area we can use the next time
   // we need a thunk.
   //
@@ -143,6 +158,43 @@ class ReturnThunkFactoryBase {
   DISALLOW_COPY_AND_ASSIGN(ReturnThunkFactoryBase);
 };
 
+// A process-wide pool of thunk pages, which recycles the pages of the
+// factories that are destroyed, e.g. with their threads, to those that are
+// created later. Pages are pushed and popped without locking. A page keeps
+// its thunks and their data in the pool, so it's reused without being
+// initialized again, and stays a thunk page until the pool is destroyed. This
+// keeps lookups of thunk pages across threads valid while the pool lives.
+//
+// The factories sharing a pool must have the same thunk main function, and
+// the pool must outlive them.
+class ReturnThunkFactoryBase::PagePool {
+ public:
+  PagePool();
+  ~PagePool();
+
+  // @returns the number of pages free in the pool.
+  size_t num_free_pages();
+
+ private:
+  friend class ReturnThunkFactoryBase;
+
+  // Takes a free page from the pool.
+  // @returns the page, or NULL if the pool has no free page.
+  Page* Pop();
+
+  // Returns @p page to the pool.
+  // @param main_func the thunk main function of the page.
+  void Push(Page* page, ThunkMainFunc main_func);
+
+  // The free pages.
+  SLIST_HEADER free_pages_;
+
+  // The thunk main function of the pages, set by the first page pushed.
+  ThunkMainFunc main_func_;
+
+  DISALLOW_COPY_AND_ASSIGN(PagePool);
+};
+
 // The ImplClass must derive from the return factory base, and implement
 // a member function with the following signature:
 // void OnFunctionExit(const ThunkData* data, uint64_t cycles);
@@ -150,7 +202,13 @@ template <typename ImplClass> class ReturnThunkFactoryImpl
     : public ReturnThunkFactoryBase {
  public:
   ReturnThunkFactoryImpl()
-      : ReturnThunkFactoryBase(thunk_main_asm) {
+      : ReturnThunkFactoryBase(thunk_main_asm, NULL) {
+  }
+
+  // @param pool the pool to take pages from, shared with factories of the
+  //     same ImplClass only.
+  explicit ReturnThunkFactoryImpl(PagePool* pool)
+      : ReturnThunkFactoryBase(thunk_main_asm, pool) {
   }
 
  protected:
@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/profiler/return_thunk_factory.h"
 
+#include <memory>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -31,6 +33,9 @@ class TestFactory : public ReturnThunkFactoryImpl<TestFactory> {
  public:
   TestFactory() : ReturnThunkFactoryImpl<TestFactory>() {
   }
+  explicit TestFactory(PagePool* pool)
+      : ReturnThunkFactoryImpl<TestFactory>(pool) {
+  }
   ~TestFactory() {
     Uninitialize();
   }
@@ -243,6 +248,43 @@ TEST_F(ReturnThunkTest, CastToThunk) {
   ASSERT_EQ(NULL, factory_->CastToThunk(reinterpret_cast<RetAddr>(0x10)));
 }
 
+TEST_F(ReturnThunkTest, PooledPagesAreRecycled) {
+  ReturnThunkFactoryBase::PagePool pool;
+  std::unique_ptr<StrictMock<TestFactory>> first_factory(
+      new StrictMock<TestFactory>(&pool));
+
+  // The pages are new to the pool for the first factory.
+  EXPECT_CALL(*first_factory, OnPageAdded(_)).Times(2);
+  first_factory->Initialize();
+  ReturnThunkFactoryBase::ThunkData* first_thunk =
+      first_factory->MakeThunk(NULL);
+  for (size_t i = 0; i < TestFactory::kNumThunksPerPage; ++i)
+    first_factory->MakeThunk(NULL);
+
+  // The pages are returned to the pool rather than removed.
+  first_factory.reset();
+  EXPECT_EQ(2u, pool.num_free_pages());
+
+  // The next factory takes them up without being notified, and owns their
+  // thunks.
+  StrictMock<TestFactory> second_factory(&pool);
+  second_factory.Initialize();
+  EXPECT_EQ(1u, pool.num_free_pages());
+  ReturnThunkFactoryBase::ThunkData* data = second_factory.MakeThunk(NULL);
+  EXPECT_TRUE(data->self == &second_factory);
+
+  for (size_t i = 0; i < TestFactory::kNumThunksPerPage; ++i)
+    second_factory.MakeThunk(NULL);
+  EXPECT_EQ(0u, pool.num_free_pages());
+  EXPECT_TRUE(first_thunk->self == &second_factory);
+  EXPECT_TRUE(second_factory.CastToThunk(
+      static_cast<RetAddr>(first_thunk->thunk)) != NULL);
+
+  // Returning via a recycled thunk reaches the factory that owns it.
+  EXPECT_CALL(second_factory, OnFunctionExit(data, _));
+  TestFactory::ThunkMain(data, 0LL);
+}
+
 TEST_F(ReturnThunkTest, ReturnPreservesRegisters) {
   EXPECT_CALL(*factory_, OnFunctionExit(_, _));
 
@@ -14,15 +14,37 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include <algorithm>
+#include <memory>
+
+#include "base/logging.h"
+
 namespace agent {
 namespace profiler {
 
 base::subtle::Atomic32 SymbolMap::Symbol::next_symbol_id_ = 0;
 
+const size_t SymbolMap::kShardCount;
+const size_t SymbolMap::kShardRangeSizeLog;
+
+static_assert(SymbolMap::kShardCount <= 64,
+              "The shards must fit in a 64-bit mask.");
+
 SymbolMap::SymbolMap() {
+  for (size_t i = 0; i < kShardCount; ++i) {
+    shards_[i].snapshot = 0;
+    shards_[i].readers = 0;
+  }
 }
 
 SymbolMap::~SymbolMap() {
+  for (size_t i = 0; i < kShardCount; ++i) {
+    Shard* shard = &shards_[i];
+    DCHECK_EQ(0, shard->readers);
+    delete reinterpret_cast<Snapshot*>(shard->snapshot);
+    for (size_t j = 0; j < shard->retired.size(); ++j)
+      delete shard->retired[j];
+  }
 }
 
 void SymbolMap::AddSymbol(const void* start_addr,
@@ -36,11 +58,14 @@ void SymbolMap::AddSymbol(const void* start_addr,
     return;
 
   Range range(reinterpret_cast<const uint8_t*>(start_addr), length);
-  RetireRangeUnlocked(range);
+  SnapshotEntries removed;
+  RetireRangeUnlocked(range, &removed);
 
-  bool inserted = addr_space_.Insert(
-      Range(reinterpret_cast<const uint8_t*>(start_addr), length), symbol);
+  bool inserted = addr_space_.Insert(range, symbol);
   DCHECK(inserted);
+
+  SnapshotEntry added = {range.start(), range.end(), symbol};
+  PublishUnlocked(removed, SnapshotEntries(1, added));
 }
 
 void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
@@ -56,6 +81,9 @@ void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
     return;
 
   scoped_refptr<Symbol> symbol = found->second;
+  SnapshotEntries removed;
+  SnapshotEntry moved = {found->first.start(), found->first.end(), symbol};
+  removed.push_back(moved);
 
   // Note the fact that it's been moved.
   symbol->Move(new_addr);
@@ -63,38 +91,153 @@ void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
   size_t length = found->first.size();
   addr_space_.Remove(found);
 
-  RetireRangeUnlocked(
-      Range(reinterpret_cast<const uint8_t*>(new_addr), length));
+  Range range(reinterpret_cast<const uint8_t*>(new_addr), length);
+  RetireRangeUnlocked(range, &removed);
 
-  bool inserted = addr_space_.Insert(
-      Range(reinterpret_cast<const uint8_t*>(new_addr), length), symbol);
+  bool inserted = addr_space_.Insert(range, symbol);
   DCHECK(inserted);
+
+  SnapshotEntry added = {range.start(), range.end(), symbol};
+  PublishUnlocked(removed, SnapshotEntries(1, added));
 }
 
 scoped_refptr<SymbolMap::Symbol> SymbolMap::FindSymbol(const void* addr) {
-  base::AutoLock hold(lock_);
+  const uint8_t* address = reinterpret_cast<const uint8_t*>(addr);
+  Shard* shard = &shards_[GetShardIndex(address)];
 
-  SymbolAddressSpace::RangeMapIter found = addr_space_.FindFirstIntersection(
-      Range(reinterpret_cast<const uint8_t*>(addr), 1));
-
-  if (found == addr_space_.end())
+  // Most of the shards have no symbols at all. This is checked without
+  // counting as a reader, as no snapshot is read.
+  if (base::subtle::Acquire_Load(&shard->snapshot) == 0)
     return NULL;
 
-  return found->second;
+  // The count is incremented before the snapshot is loaded, so that a writer
+  // that sees no readers after replacing the snapshot knows that no lookup
+  // holds the one it replaced.
+  base::subtle::Barrier_AtomicIncrement(&shard->readers, 1);
+  const Snapshot* snapshot = reinterpret_cast<const Snapshot*>(
+      base::subtle::Acquire_Load(&shard->snapshot));
+
+  scoped_refptr<Symbol> symbol;
+  if (snapshot != NULL) {
+    SnapshotEntry key = {address, address, NULL};
+    SnapshotEntries::const_iterator it = std::upper_bound(
+        snapshot->entries.begin(), snapshot->entries.end(), key);
+    if (it != snapshot->entries.begin()) {
+      --it;
+      if (address < it->end)
+        symbol = it->symbol;
+    }
+  }
+
+  base::subtle::Barrier_AtomicIncrement(&shard->readers, -1);
+  return symbol;
+}
+
+// static
+uint64_t SymbolMap::GetShardMask(const uint8_t* start, const uint8_t* end) {
+  DCHECK_LT(start, end);
+
+  uintptr_t first = reinterpret_cast<uintptr_t>(start) >> kShardRangeSizeLog;
+  uintptr_t last = (reinterpret_cast<uintptr_t>(end) - 1) >>
+                   kShardRangeSizeLog;
+  if (last - first >= kShardCount - 1)
+    return ~0ULL >> (64 - kShardCount);
+
+  uint64_t mask = 0;
+  for (uintptr_t i = first; i <= last; ++i)
+    mask |= 1ULL << (i % kShardCount);
+  return mask;
 }
 
-void SymbolMap::RetireRangeUnlocked(const Range& range) {
+void SymbolMap::RetireRangeUnlocked(const Range& range,
+                                    SnapshotEntries* removed) {
   lock_.AssertAcquired();
+  DCHECK(removed != NULL);
 
   SymbolAddressSpace::RangeMapIterPair found =
       addr_space_.FindIntersecting(range);
   SymbolAddressSpace::iterator it = found.first;
-  for (; it != found.second; ++it)
-    found.first->second->Invalidate();
+  for (; it != found.second; ++it) {
+    it->second->Invalidate();
+    SnapshotEntry entry = {it->first.start(), it->first.end(), it->second};
+    removed->push_back(entry);
+  }
 
   addr_space_.Remove(found);
 }
 
+void SymbolMap::PublishUnlocked(const SnapshotEntries& removed,
+                                const SnapshotEntries& added) {
+  lock_.AssertAcquired();
+
+  uint64_t mask = 0;
+  for (size_t i = 0; i < removed.size(); ++i)
+    mask |= GetShardMask(removed[i].start, removed[i].end);
+  for (size_t i = 0; i < added.size(); ++i)
+    mask |= GetShardMask(added[i].start, added[i].end);
+
+  for (size_t i = 0; i < kShardCount; ++i) {
+    uint64_t shard_bit = 1ULL << i;
+    if ((mask & shard_bit) == 0)
+      continue;
+
+    // Copy the current snapshot of the shard, without the removed symbols,
+    // and with the added ones that intersect it.
+    Shard* shard = &shards_[i];
+    Snapshot* old_snapshot = reinterpret_cast<Snapshot*>(
+        base::subtle::NoBarrier_Load(&shard->snapshot));
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    if (old_snapshot != NULL) {
+      snapshot->entries.reserve(old_snapshot->entries.size() + added.size());
+      for (size_t j = 0; j < old_snapshot->entries.size(); ++j) {
+        const SnapshotEntry& entry = old_snapshot->entries[j];
+        bool is_removed = false;
+        for (size_t k = 0; k < removed.size() && !is_removed; ++k) {
+          is_removed = removed[k].start == entry.start &&
+                       removed[k].symbol == entry.symbol;
+        }
+        if (!is_removed)
+          snapshot->entries.push_back(entry);
+      }
+    }
+    for (size_t j = 0; j < added.size(); ++j) {
+      if ((GetShardMask(added[j].start, added[j].end) & shard_bit) != 0)
+        snapshot->entries.push_back(added[j]);
+    }
+    std::sort(snapshot->entries.begin(), snapshot->entries.end());
+
+    Snapshot* new_snapshot = NULL;
+    if (!snapshot->entries.empty())
+      new_snapshot = snapshot.release();
+    base::subtle::Release_Store(
+        &shard->snapshot, reinterpret_cast<base::subtle::AtomicWord>(
+                              new_snapshot));
+    if (old_snapshot != NULL)
+      shard->retired.push_back(old_snapshot);
+    ReclaimUnlocked(shard);
+  }
+}
+
+void SymbolMap::ReclaimUnlocked(Shard* shard) {
+  lock_.AssertAcquired();
+  DCHECK(shard != NULL);
+
+  if (shard->retired.empty())
+    return;
+
+  // The snapshot was replaced before the readers are counted. A lookup that
+  // isn't counted yet will load the new snapshot, so none of the retired ones
+  // is in use if there are no readers. Otherwise they are freed by a later
+  // change of the shard.
+  base::subtle::MemoryBarrier();
+  if (base::subtle::NoBarrier_Load(&shard->readers) != 0)
+    return;
+
+  for (size_t i = 0; i < shard->retired.size(); ++i)
+    delete shard->retired[i];
+  shard->retired.clear();
+}
+
 SymbolMap::Symbol::Symbol(const base::StringPiece& name, const void* address)
     : name_(name.begin(), name.end()),
       move_count_(0),
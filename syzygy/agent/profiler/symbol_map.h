@@ -15,8 +15,9 @@
 #ifndef SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 #define SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 
-#include "base/atomicops.h"
+#include <vector>
 
+#include "base/atomicops.h"
 #include "base/memory/ref_counted.h"
 #include "base/strings/string_piece.h"
 #include "base/synchronization/lock.h"
@@ -29,10 +30,22 @@ namespace profiler {
 // resolving addresses of dynamically generated, garbage collected code, to
 // names in a profiler. This is geared to allow entry/exit processing in a
 // profiler to execute as quickly as possible.
+//
+// The symbols are added and moved under a lock, but are found without one.
+// The address space is split into shards, each of which publishes an
+// immutable snapshot of the symbols it covers. A change to the symbols
+// copies the snapshots of the shards it touches, and publishes the copies.
+// The replaced snapshots are retired, and freed once no lookup is reading
+// their shard.
 class SymbolMap {
  public:
   class Symbol;
 
+  // The number of shards, and the log of the size of the address ranges that
+  // are interleaved across them.
+  static const size_t kShardCount = 64;
+  static const size_t kShardRangeSizeLog = 16;
+
   SymbolMap();
   ~SymbolMap();
 
@@ -52,6 +65,8 @@ class SymbolMap {
   // Find the symbol covering @p addr, if any.
   // @param addr an address to query.
   // @returns the symbol covering @p addr, if any, or NULL otherwise.
+  // @note This doesn't take the lock, and may run concurrently with
+  //     AddSymbol and MoveSymbol.
   scoped_refptr<Symbol> FindSymbol(const void* addr);
 
  protected:
@@ -59,12 +74,63 @@ class SymbolMap {
       SymbolAddressSpace;
   typedef SymbolAddressSpace::Range Range;
 
+  // A symbol of a snapshot.
+  struct SnapshotEntry {
+    bool operator<(const SnapshotEntry& other) const {
+      return start < other.start;
+    }
+
+    const uint8_t* start;
+    const uint8_t* end;
+    scoped_refptr<Symbol> symbol;
+  };
+  typedef std::vector<SnapshotEntry> SnapshotEntries;
+
+  // An immutable snapshot of the symbols intersecting the address ranges of
+  // a shard, sorted by address.
+  struct Snapshot {
+    SnapshotEntries entries;
+  };
+
+  struct Shard {
+    // The published Snapshot, or NULL if the shard has no symbols.
+    base::subtle::AtomicWord snapshot;
+    // The number of lookups reading the snapshot of the shard.
+    base::subtle::Atomic32 readers;
+    // The snapshots replaced while lookups may have been reading them.
+    // Under lock_.
+    std::vector<Snapshot*> retired;
+  };
+
+  // @returns the index of the shard covering @p addr.
+  static size_t GetShardIndex(const uint8_t* addr) {
+    return (reinterpret_cast<uintptr_t>(addr) >> kShardRangeSizeLog) %
+           kShardCount;
+  }
+
+  // @returns the mask of the shards covering [@p start, @p end).
+  static uint64_t GetShardMask(const uint8_t* start, const uint8_t* end);
+
   // Retire any symbols overlapping @p range.
-  void RetireRangeUnlocked(const Range& range);
+  // @param removed receives the symbols removed from the address space.
+  void RetireRangeUnlocked(const Range& range, SnapshotEntries* removed);
+
+  // Publishes new snapshots for the shards touched by a change of the
+  // symbols.
+  // @param removed the symbols removed from the address space.
+  // @param added the symbols added to the address space.
+  void PublishUnlocked(const SnapshotEntries& removed,
+                       const SnapshotEntries& added);
+
+  // Frees the retired snapshots of @p shard if no lookup is reading it.
+  void ReclaimUnlocked(Shard* shard);
 
   base::Lock lock_;
   SymbolAddressSpace addr_space_;  // Under lock_.
 
+  // The shards of the snapshots read by FindSymbol.
+  Shard shards_[kShardCount];
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SymbolMap);
 };
@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -24,8 +27,10 @@ namespace {
 
 class TestingSymbolMap : public SymbolMap {
  public:
-  // Expose the address space for testing.
+  // Expose the address space and the shards for testing.
   using SymbolMap::addr_space_;
+  using SymbolMap::shards_;
+  typedef SymbolMap::Snapshot Snapshot;
   typedef SymbolMap::SymbolAddressSpace SymbolAddressSpace;
 };
 
@@ -38,6 +43,27 @@ class SymbolMapTest : public testing::Test {
   TestingSymbolMap symbol_map_;
 };
 
+// Adds and moves symbols until it is stopped.
+class SymbolChurner : public base::PlatformThread::Delegate {
+ public:
+  explicit SymbolChurner(SymbolMap* symbol_map)
+      : symbol_map_(symbol_map), stop_(true, false) {}
+
+  void ThreadMain() override {
+    for (size_t i = 0; !stop_.IsSignaled(); ++i) {
+      intptr_t address = 0x100000 + (i % 512) * 0x100;
+      symbol_map_->AddSymbol(ToPtr(address), 0x80, "foo");
+      symbol_map_->MoveSymbol(ToPtr(address), ToPtr(address + 0x40));
+    }
+  }
+
+  void Stop() { stop_.Signal(); }
+
+ private:
+  SymbolMap* symbol_map_;
+  base::WaitableEvent stop_;
+};
+
 }  // namespace
 
 TEST_F(SymbolMapTest, AddSymbol) {
@@ -175,5 +201,59 @@ TEST_F(SymbolMapTest, SymbolLifeCycle) {
   EXPECT_EQ(ToPtr(NULL), symbol->address());
 }
 
+TEST_F(SymbolMapTest, SymbolSpanningShards) {
+  // Insert a symbol straddling the address ranges of two shards.
+  const uint8_t* const kBoundary = ToPtr(1 << SymbolMap::kShardRangeSizeLog);
+  symbol_map_.AddSymbol(kBoundary - 0x10, 0x20, "foo");
+
+  scoped_refptr<SymbolMap::Symbol> symbol =
+      symbol_map_.FindSymbol(kBoundary - 0x10);
+  ASSERT_TRUE(symbol != NULL);
+  EXPECT_EQ(symbol, symbol_map_.FindSymbol(kBoundary + 0xF));
+  EXPECT_TRUE(symbol_map_.FindSymbol(kBoundary + 0x10) == NULL);
+
+  // Moving it away removes it from both shards.
+  symbol_map_.MoveSymbol(kBoundary - 0x10, ToPtr(0x1000));
+  EXPECT_TRUE(symbol_map_.FindSymbol(kBoundary - 0x10) == NULL);
+  EXPECT_TRUE(symbol_map_.FindSymbol(kBoundary + 0xF) == NULL);
+  EXPECT_EQ(symbol, symbol_map_.FindSymbol(ToPtr(0x1010)));
+}
+
+TEST_F(SymbolMapTest, RetiredSnapshotsAreFreed) {
+  for (size_t i = 0; i < 100; ++i) {
+    symbol_map_.AddSymbol(ToPtr(0x1000 + i * 0x10), 0x10,
+                          base::StringPrintf("foo%d", static_cast<int>(i)));
+  }
+
+  // Without concurrent lookups, the replaced snapshots are freed right away.
+  for (size_t i = 0; i < SymbolMap::kShardCount; ++i)
+    EXPECT_TRUE(symbol_map_.shards_[i].retired.empty());
+
+  // The snapshot holds all the symbols of the shard.
+  const TestingSymbolMap::Snapshot* snapshot =
+      reinterpret_cast<const TestingSymbolMap::Snapshot*>(
+          symbol_map_.shards_[0].snapshot);
+  ASSERT_TRUE(snapshot != NULL);
+  EXPECT_EQ(100u, snapshot->entries.size());
+}
+
+TEST_F(SymbolMapTest, ConcurrentFindSymbol) {
+  SymbolChurner churner(&symbol_map_);
+  base::PlatformThreadHandle handle;
+  ASSERT_TRUE(base::PlatformThread::Create(0, &churner, &handle));
+
+  // The lookups see each symbol either at its original address or at its
+  // new one, but never a torn or freed one.
+  for (size_t i = 0; i < 100000; ++i) {
+    scoped_refptr<SymbolMap::Symbol> symbol =
+        symbol_map_.FindSymbol(ToPtr(0x100000 + (i % 0x20000)));
+    if (symbol != NULL)
+      EXPECT_EQ("foo", symbol->name());
+  }
+
+  churner.Stop();
+  base::PlatformThread::Join(handle);
+}
+
 }  // namespace profiler
 }  // namespace agent
@@ -93,17 +93,6 @@ bool ParseArFileHeader(const ArFileHeader& header,
   return true;
 }
 
-template<typename Object>
-bool ReadObject(FILE* file, Object* object) {
-  DCHECK_NE(reinterpret_cast<FILE*>(NULL), file);
-  DCHECK_NE(reinterpret_cast<Object*>(NULL), object);
-  if (::fread(object, sizeof(Object), 1, file) != 1) {
-    LOG(ERROR) << "Failed to read from archive.";
-    return false;
-  }
-  return true;
-}
-
 bool ParseSecondarySymbolTable(size_t file_size,
                                const uint8_t* data,
                                size_t length,
@@ -210,21 +199,19 @@ bool ArReader::Init(const base::FilePath& ar_path) {
   DCHECK(path_.empty());
 
   path_ = ar_path;
-  file_.reset(base::OpenFile(path_, "rb"));
-  if (file_.get() == NULL) {
-    LOG(ERROR) << "Failed to open file for reading: " << path_.value();
-    return false;
-  }
-
-  if (!base::GetFileSize(path_, reinterpret_cast<int64_t*>(&length_))) {
-    LOG(ERROR) << "Unable to get the archive file size.";
+  if (!file_.Initialize(path_)) {
+    LOG(ERROR) << "Failed to map file for reading: " << path_.value();
     return false;
   }
+  length_ = file_.length();
 
   // Parse the global header.
-  ArGlobalHeader global_header = {};
-  if (!ReadObject(file_.get(), &global_header))
+  if (length_ < sizeof(ArGlobalHeader)) {
+    LOG(ERROR) << "Archive file global header is truncated.";
     return false;
+  }
+  const ArGlobalHeader& global_header =
+      *reinterpret_cast<const ArGlobalHeader*>(file_.data());
   if (::memcmp(global_header.magic,
                kArGlobalMagic,
                sizeof(kArGlobalMagic)) != 0) {
@@ -319,16 +306,7 @@ bool ArReader::SeekIndex(size_t index) {
   if (index >= offsets_.size())
     return false;
 
-  size_t offset = offsets_[index];
-  if (offset_ == offset)
-    return true;
-
-  if (::fseek(file_.get(), offset, SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to archive file " << index
-               << " at offset " << offset << ".";
-    return false;
-  }
-  offset_ = offset;
+  offset_ = offsets_[index];
   index_ = index;
 
   return true;
@@ -355,14 +333,9 @@ bool ArReader::ExtractNext(ParsedArFileHeader* header,
     }
   }
 
-  // Seek to the beginning of the next archive file if we're not already there.
-  if (offset_ != offsets_[index_]) {
-    if (::fseek(file_.get(), offsets_[index_], SEEK_SET) != 0) {
-      LOG(ERROR) << "Failed to seek to file " << index_ << ".";
-      return false;
-    }
-    offset_ = offsets_[index_];
-  }
+  // Move to the beginning of the next archive file if we're not already
+  // there.
+  offset_ = offsets_[index_];
   DCHECK_LT(offset_, length_);
 
   if (!ReadNextFile(header, data))
@@ -386,11 +359,7 @@ bool ArReader::Extract(size_t index,
   if (index >= offsets_.size())
     return false;
 
-  // Seek to the file in question.
-  if (::fseek(file_.get(), offsets_[index], SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to file " << index << ".";
-    return false;
-  }
+  // Move to the file in question.
   offset_ = offsets_[index];
   index_ = index;
 
@@ -400,48 +369,80 @@ bool ArReader::Extract(size_t index,
   return true;
 }
 
+bool ArReader::ExtractView(size_t index,
+                           ParsedArFileHeader* header,
+                           const uint8_t** data) const {
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+  DCHECK_NE(reinterpret_cast<const uint8_t**>(NULL), data);
+
+  if (index >= offsets_.size())
+    return false;
+
+  uint64_t next_offset = 0;
+  if (!ReadFileAt(offsets_[index], header, data, &next_offset))
+    return false;
+
+  // Store the actual filename in the header.
+  std::string filename;
+  if (!TranslateFilename(header->name, &filename))
+    return false;
+  header->name = filename;
+
+  return true;
+}
+
 bool ArReader::ReadNextFile(ParsedArFileHeader* header,
                             DataBuffer* data) {
   DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
 
-  // Read and parse the file header.
-  ArFileHeader raw_header = {};
-  if (!ReadObject(file_.get(), &raw_header))
+  const uint8_t* contents = NULL;
+  if (!ReadFileAt(offset_, header, &contents, &offset_))
     return false;
-  if (!ParseArFileHeader(raw_header, header))
-    return false;
-  offset_ += sizeof(raw_header);
 
-  uint64_t aligned_size = common::AlignUp64(header->size, kArFileAlignment);
-  uint64_t seek_size = aligned_size;
+  // Copy the actual file contents if necessary.
+  if (data != NULL)
+    data->assign(contents, contents + header->size);
 
-  // Read the actual file contents if necessary.
-  if (data != NULL) {
-    seek_size = aligned_size - header->size;
-    data->resize(header->size);
-    if (::fread(data->data(), 1, header->size, file_.get()) !=
-            header->size) {
-      LOG(ERROR) << "Failed to read file \"" << header->name
-                 << "\" at offset " << offset_ << " of archive \""
-                 << path_.value() << "\".";
-      return false;
-    }
-    offset_ += header->size;
-  }
+  return true;
+}
+
+bool ArReader::ReadFileAt(uint64_t offset,
+                          ParsedArFileHeader* header,
+                          const uint8_t** data,
+                          uint64_t* next_offset) const {
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+  DCHECK_NE(reinterpret_cast<const uint8_t**>(NULL), data);
+  DCHECK_NE(reinterpret_cast<uint64_t*>(NULL), next_offset);
 
-  // Seek to the beginning of the next file.
-  if (seek_size > 0 && ::fseek(file_.get(), seek_size, SEEK_CUR) != 0) {
-    LOG(ERROR) << "Failed to seek to next file at offset " << offset_
+  // Parse the file header.
+  if (offset > length_ || length_ - offset < sizeof(ArFileHeader)) {
+    LOG(ERROR) << "Failed to read file header at offset " << offset
                << " of archive \"" << path_.value() << "\".";
     return false;
   }
-  offset_ += seek_size;
+  const ArFileHeader& raw_header =
+      *reinterpret_cast<const ArFileHeader*>(file_.data() + offset);
+  if (!ParseArFileHeader(raw_header, header))
+    return false;
+  offset += sizeof(raw_header);
+
+  if (header->size > length_ - offset) {
+    LOG(ERROR) << "Failed to read file \"" << header->name
+               << "\" at offset " << offset << " of archive \""
+               << path_.value() << "\".";
+    return false;
+  }
+  *data = file_.data() + offset;
+
+  // The following file starts at the next aligned offset. That of the last
+  // file may be past the end of the archive, if its padding is missing.
+  *next_offset = offset + common::AlignUp64(header->size, kArFileAlignment);
 
   return true;
 }
 
 bool ArReader::TranslateFilename(const std::string& internal_name,
-                                 std::string* full_name) {
+                                 std::string* full_name) const {
   DCHECK_NE(reinterpret_cast<std::string*>(NULL), full_name);
 
   if (internal_name.empty()) {
@@ -472,7 +473,7 @@ bool ArReader::TranslateFilename(const std::string& internal_name,
     return false;
   }
 
-  const char* data = reinterpret_cast<char*>(filenames_.data());
+  const char* data = reinterpret_cast<const char*>(filenames_.data());
   size_t filename_length = ::strnlen(data + filename_offset,
                                      filenames_.size() - filename_offset);
   *full_name = std::string(data + filename_offset, filename_length);
@@ -83,13 +83,15 @@
 #include <vector>
 
 #include "base/files/file_path.h"
-#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "syzygy/ar/ar_common.h"
 
 namespace ar {
 
 // Class for extracting files from archive files. This currently does not
-// expose the parsed symbol information in any meaningful way.
+// expose the parsed symbol information in any meaningful way. The archive is
+// mapped into memory once, so that its members may be handed out as views of
+// the mapping rather than copies.
 class ArReader {
  public:
   // Stores the offsets of each file object, by their index.
@@ -165,19 +167,44 @@ class ArReader {
                ParsedArFileHeader* header,
                DataBuffer* data);
 
+  // Gets a view of the specified file, without copying its contents. This
+  // neither uses nor moves the cursor, so it may be called concurrently from
+  // several threads.
+  // @param index The index of the file to be viewed.
+  // @param header The header to be populated.
+  // @param data Receives a pointer to the @p header.size bytes of the
+  //     contents of the file. These remain valid for the lifetime of the
+  //     reader.
+  // @returns true on success, false otherwise.
+  bool ExtractView(size_t index,
+                   ParsedArFileHeader* header,
+                   const uint8_t** data) const;
+
  protected:
   // Reads the next file from the archive, advancing the cursor. Returns true
   // on success, false otherwise. Does not translate the internal name to an
   // external filename. Doesn't update 'index_'.
   bool ReadNextFile(ParsedArFileHeader* header, DataBuffer* data);
 
+  // Reads the file at the given offset of the archive. Does not translate
+  // the internal name to an external filename.
+  // @param offset The offset of the header of the file.
+  // @param header The header to be populated.
+  // @param data Receives a pointer to the contents of the file.
+  // @param next_offset Receives the offset of the following file.
+  // @returns true on success, false otherwise.
+  bool ReadFileAt(uint64_t offset,
+                  ParsedArFileHeader* header,
+                  const uint8_t** data,
+                  uint64_t* next_offset) const;
+
   // Translates an archive internal filename to the full extended filename.
   bool TranslateFilename(const std::string& internal_name,
-                         std::string* full_name);
+                         std::string* full_name) const;
 
-  // The file that is being read.
+  // The file that is being read, and its mapping.
   base::FilePath path_;
-  base::ScopedFILE file_;
+  base::MemoryMappedFile file_;
 
   // Data regarding the archive.
   uint64_t length_;
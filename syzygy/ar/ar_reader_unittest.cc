@@ -172,3 +172,29 @@ TEST_F(ArReaderTest, EmptyFiles) {
 }
 
 }  // namespace ar
+
+TEST_F(ArReaderTest, ExtractView) {
+  ArReader reader;
+  EXPECT_TRUE(reader.Init(lib_path_));
+
+  for (size_t i = 0; i < reader.offsets().size(); ++i) {
+    ParsedArFileHeader header;
+    DataBuffer data;
+    EXPECT_TRUE(reader.ExtractNext(&header, &data));
+
+    // The view has the same header and contents as the copy.
+    ParsedArFileHeader view_header;
+    const uint8_t* view = NULL;
+    EXPECT_TRUE(reader.ExtractView(i, &view_header, &view));
+    EXPECT_EQ(header.name, view_header.name);
+    EXPECT_EQ(header.size, view_header.size);
+    EXPECT_EQ(DataBuffer(view, view + view_header.size), data);
+  }
+
+  // Views don't move the cursor.
+  EXPECT_FALSE(reader.HasNext());
+
+  ParsedArFileHeader header;
+  const uint8_t* view = NULL;
+  EXPECT_FALSE(reader.ExtractView(reader.offsets().size(), &header, &view));
+}
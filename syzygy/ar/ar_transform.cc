@@ -14,11 +14,15 @@
 
 #include "syzygy/ar/ar_transform.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "base/bind.h"
 #include "base/logging.h"
 #include "base/files/file_util.h"
-#include "base/memory/scoped_vector.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/ar/ar_reader.h"
 #include "syzygy/ar/ar_writer.h"
 
@@ -41,6 +45,63 @@ struct FileDeleter {
 
 }  // namespace
 
+class ArTransform::FileTransform
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param reader The initialized reader of the input archive.
+  // @param index The index of the file to transform.
+  // @param callback The callback transforming the file.
+  FileTransform(const ArReader* reader,
+                size_t index,
+                const TransformFileCallback& callback)
+      : reader_(reader),
+        index_(index),
+        callback_(callback),
+        remove_(false),
+        succeeded_(false) {
+    DCHECK_NE(reinterpret_cast<const ArReader*>(NULL), reader_);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    // The contents are copied out of the mapping of the archive, as the
+    // callback transforms them in place.
+    const uint8_t* data = NULL;
+    if (!reader_->ExtractView(index_, &header_, &data))
+      return;
+    contents_.assign(data, data + header_.size);
+
+    LOG(INFO) << "Processing file " << (index_ + 1) << " of "
+              << reader_->offsets().size() << ": " << header_.name;
+
+    succeeded_ = callback_.Run(&header_, &contents_, &remove_);
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const ParsedArFileHeader& header() const { return header_; }
+  const DataBuffer& contents() const { return contents_; }
+  bool remove() const { return remove_; }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ private:
+  const ArReader* reader_;
+  size_t index_;
+  TransformFileCallback callback_;
+
+  // The transformed file.
+  ParsedArFileHeader header_;
+  DataBuffer contents_;
+  bool remove_;
+
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileTransform);
+};
+
 bool ArTransform::Transform() {
   DCHECK(!input_archive_.empty());
   DCHECK(!output_archive_.empty());
@@ -51,40 +112,51 @@ bool ArTransform::Transform() {
     return false;
   LOG(INFO) << "Read " << reader.symbols().size() << " symbols.";
 
-  // This collection of buffers must outlive the ArWriter below.
-  ScopedVector<DataBuffer> buffers;
-
-  // Iterate over the files in the archive.
-  ArWriter writer;
-  for (size_t i = 0; i < reader.offsets().size(); ++i) {
-    // Extract the next file.
-    ParsedArFileHeader header;
-    std::unique_ptr<DataBuffer> buffer(new DataBuffer());
-    if (!reader.ExtractNext(&header, buffer.get()))
-      return false;
-
-    LOG(INFO) << "Processing file " << (i + 1) << " of "
-              << reader.offsets().size() << ": " << header.name;
-
-    // Apply the transform to this file.
-    bool remove = false;
-    if (!callback_.Run(&header, buffer.get(), &remove))
-      return false;
-
-    if (remove)
-      continue;
-
-    // Add the transformed file to the output archive.
-    if (!writer.AddFile(header.name, header.timestamp, header.mode,
-                        buffer.get())) {
-      return false;
+  // The transformed files are streamed to the output archive, so that only
+  // those being transformed are held in memory.
+  ArStreamWriter writer;
+  if (!writer.Init(output_archive_))
+    return false;
+
+  // The files are transformed in batches of one per thread. The files of a
+  // batch are added to the output archive once they've all been transformed,
+  // in the order of the input archive.
+  size_t file_count = reader.offsets().size();
+  for (size_t begin = 0; begin < file_count; begin += num_threads_) {
+    size_t end = std::min(begin + num_threads_, file_count);
+    std::vector<std::unique_ptr<FileTransform>> files;
+    for (size_t i = begin; i < end; ++i)
+      files.push_back(std::unique_ptr<FileTransform>(
+          new FileTransform(&reader, i, callback_)));
+
+    if (files.size() > 1) {
+      base::DelegateSimpleThreadPool pool("ArTransform",
+                                          static_cast<int>(files.size()));
+      for (size_t i = 0; i < files.size(); ++i)
+        pool.AddWork(files[i].get());
+      pool.Start();
+      pool.JoinAll();
+    } else {
+      files[0]->Run();
     }
 
-    // Save the buffer so we keep it around until the writer has finished.
-    buffers.push_back(buffer.release());
+    for (size_t i = 0; i < files.size(); ++i) {
+      const FileTransform& file = *files[i];
+      if (!file.succeeded())
+        return false;
+
+      if (file.remove())
+        continue;
+
+      const ParsedArFileHeader& header = file.header();
+      if (!writer.AddFile(header.name, header.timestamp, header.mode,
+                          file.contents())) {
+        return false;
+      }
+    }
   }
 
-  if (!writer.Write(output_archive_))
+  if (!writer.Close())
     return false;
   LOG(INFO) << "Wrote " << writer.symbols().size() << " symbols.";
 
@@ -109,20 +181,25 @@ OnDiskArTransformAdapter::~OnDiskArTransformAdapter() {
 bool OnDiskArTransformAdapter::Transform(ParsedArFileHeader* header,
                                          DataBuffer* contents,
                                          bool* remove) {
-  if (temp_dir_.empty()) {
-    if (!base::CreateNewTempDirectory(L"OnDiskArTransformAdapter",
-                                           &temp_dir_)) {
-      LOG(ERROR) << "Unable to create temporary directory.";
-      return false;
+  // Create input and output file names.
+  base::FilePath input_path;
+  base::FilePath output_path;
+  {
+    base::AutoLock auto_lock(lock_);
+    if (temp_dir_.empty()) {
+      if (!base::CreateNewTempDirectory(L"OnDiskArTransformAdapter",
+                                             &temp_dir_)) {
+        LOG(ERROR) << "Unable to create temporary directory.";
+        return false;
+      }
     }
-  }
 
-  // Create input and output file names.
-  base::FilePath input_path = temp_dir_.Append(
-      base::StringPrintf(L"input-%04d.obj", index_));
-  base::FilePath output_path = temp_dir_.Append(
-      base::StringPrintf(L"output-%04d.obj", index_));
-  ++index_;
+    input_path = temp_dir_.Append(
+        base::StringPrintf(L"input-%04d.obj", index_));
+    output_path = temp_dir_.Append(
+        base::StringPrintf(L"output-%04d.obj", index_));
+    ++index_;
+  }
 
   // Set up deleters for these files.
   FileDeleter input_deleter(input_path);
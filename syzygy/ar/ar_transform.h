@@ -22,6 +22,7 @@
 #include "base/callback.h"
 #include "base/logging.h"
 #include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/ar/ar_common.h"
 
 namespace ar {
@@ -44,7 +45,7 @@ class ArTransform {
       TransformFileCallback;
 
   // Constructor.
-  ArTransform() { }
+  ArTransform() : num_threads_(1) { }
 
   // Applies the transform. The transform must already have been configured.
   // @returns true on success, false otherwise.
@@ -72,6 +73,16 @@ class ArTransform {
     DCHECK(!callback.is_null());
     callback_ = callback;
   }
+
+  // Sets the number of threads transforming the files. With more than one,
+  // the callback is invoked concurrently for different files, and must be
+  // thread safe. The transformed files are added to the output archive in
+  // their original order either way. Defaults to 1.
+  // @param num_threads The number of threads, which is not zero.
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0u, num_threads);
+    num_threads_ = num_threads;
+  }
   // @}
 
   // @name Accessors.
@@ -84,18 +95,26 @@ class ArTransform {
 
   // @returns the callback.
   TransformFileCallback callback() const { return callback_; }
+
+  // @returns the number of threads transforming the files.
+  size_t num_threads() const { return num_threads_; }
   // @}
 
  private:
+  // Transforms a single file of the archive.
+  class FileTransform;
+
   base::FilePath input_archive_;
   base::FilePath output_archive_;
   TransformFileCallback callback_;
+  size_t num_threads_;
 
   DISALLOW_COPY_AND_ASSIGN(ArTransform);
 };
 
 // A callback adapter that allows transforms to modify the files
-// on disk rather than in memory. This is not thread safe.
+// on disk rather than in memory. The adapter can be used by a transform with
+// several threads, as long as the inner callback is thread safe.
 class OnDiskArTransformAdapter {
  public:
   typedef ArTransform::TransformFileCallback TransformFileCallback;
@@ -143,7 +162,9 @@ class OnDiskArTransformAdapter {
   TransformFileOnDiskCallback inner_callback_;
   TransformFileCallback outer_callback_;
 
-  // Temporary directory where files are produced.
+  // Temporary directory where files are produced, and the index of the next
+  // pair of files in it. Both are protected by lock_.
+  base::Lock lock_;
   base::FilePath temp_dir_;
   size_t index_;
 };
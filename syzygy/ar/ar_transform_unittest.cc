@@ -15,6 +15,7 @@
 #include "syzygy/ar/ar_transform.h"
 
 #include "base/bind.h"
+#include "base/synchronization/lock.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/ar/ar_reader.h"
@@ -39,7 +40,8 @@ class LenientArTransformTest : public testing::Test {
         on_disk_callback_(base::Bind(
             &LenientArTransformTest::OnDiskCallback,
             base::Unretained(this))),
-        on_disk_adapter_(on_disk_callback_) {
+        on_disk_adapter_(on_disk_callback_),
+        file_count_(0) {
   }
 
   virtual void SetUp() override {
@@ -86,6 +88,18 @@ class LenientArTransformTest : public testing::Test {
     return true;
   }
 
+  // A thread safe identity transform, counting the files it sees.
+  bool OnDiskCallbackCountAndCopyFile(const base::FilePath& input_path,
+                                      const base::FilePath& output_path,
+                                      ParsedArFileHeader* header,
+                                      bool* remove) {
+    {
+      base::AutoLock auto_lock(lock_);
+      ++file_count_;
+    }
+    return base::CopyFile(input_path, output_path);
+  }
+
   base::FilePath input_archive_;
   base::FilePath output_archive_;
   base::FilePath temp_dir_;
@@ -93,6 +107,9 @@ class LenientArTransformTest : public testing::Test {
   ArTransform::TransformFileCallback in_memory_callback_;
   OnDiskArTransformAdapter::TransformFileOnDiskCallback on_disk_callback_;
   OnDiskArTransformAdapter on_disk_adapter_;
+
+  base::Lock lock_;
+  size_t file_count_;
 };
 typedef testing::StrictMock<LenientArTransformTest> ArTransformTest;
 
@@ -202,4 +219,36 @@ TEST_F(ArTransformTest, TransformIdentityOnDiskEraseFile) {
   EXPECT_EQ(testing::kArchiveFileCount - 1, reader.offsets().size());
 }
 
+TEST_F(ArTransformTest, TransformIdentityOnDiskInParallel) {
+  // The mock isn't used from the worker threads.
+  OnDiskArTransformAdapter on_disk_adapter(base::Bind(
+      &ArTransformTest::OnDiskCallbackCountAndCopyFile,
+      base::Unretained(this)));
+  ArTransform tx;
+  tx.set_input_archive(input_archive_);
+  tx.set_output_archive(output_archive_);
+  tx.set_callback(on_disk_adapter.outer_callback());
+  tx.set_num_threads(4);
+
+  EXPECT_TRUE(tx.Transform());
+  EXPECT_EQ(testing::kArchiveFileCount, file_count_);
+
+  // The files are written in their original order.
+  ArReader input;
+  ArReader output;
+  ASSERT_TRUE(input.Init(input_archive_));
+  ASSERT_TRUE(output.Init(output_archive_));
+  ASSERT_EQ(input.offsets().size(), output.offsets().size());
+  for (size_t i = 0; i < input.offsets().size(); ++i) {
+    ParsedArFileHeader input_header;
+    ParsedArFileHeader output_header;
+    DataBuffer input_data;
+    DataBuffer output_data;
+    EXPECT_TRUE(input.ExtractNext(&input_header, &input_data));
+    EXPECT_TRUE(output.ExtractNext(&output_header, &output_data));
+    EXPECT_EQ(input_header.name, output_header.name);
+    EXPECT_EQ(input_data, output_data);
+  }
+}
+
 }  // namespace ar
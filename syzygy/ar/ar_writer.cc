@@ -149,14 +149,14 @@ bool UpdateSymbolTable(uint32_t file_index,
 // using those classes is a little overkill for our purposes.
 bool ExtractSymbolsCoff(uint32_t file_index,
                         const ParsedArFileHeader& header,
-                        const DataBuffer& file_contents,
+                        const uint8_t* contents,
+                        size_t contents_size,
                         SymbolIndexMap* symbols,
                         SymbolIndexMap* weak_symbols) {
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), symbols);
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), weak_symbols);
 
-  common::BinaryBufferReader reader(file_contents.data(),
-                                    file_contents.size());
+  common::BinaryBufferReader reader(contents, contents_size);
   const IMAGE_FILE_HEADER* file_header = NULL;
   if (!reader.Read(&file_header))
     return false;
@@ -202,15 +202,14 @@ bool ExtractSymbolsCoff(uint32_t file_index,
       const char* s = NULL;
       size_t max_len = 0;
       if (symbol->N.Name.Short == 0) {
-        if (symbol->N.Name.Long >= file_contents.size()) {
+        if (symbol->N.Name.Long >= contents_size) {
           LOG(ERROR) << "Invalid symbol name pointer in object file: "
                      << header.name;
           return false;
         }
         size_t offset = string_table_offset + symbol->N.Name.Long;
-        s = reinterpret_cast<const char*>(file_contents.data()) +
-            offset;
-        max_len = file_contents.size() - offset;
+        s = reinterpret_cast<const char*>(contents) + offset;
+        max_len = contents_size - offset;
       } else {
         s = reinterpret_cast<const char*>(symbol->N.ShortName);
         max_len = sizeof(symbol->N.ShortName);
@@ -237,14 +236,14 @@ bool ExtractSymbolsCoff(uint32_t file_index,
 // |symbols|. Returns true on success, false otherwise.
 bool ExtractSymbolsImportDef(uint32_t file_index,
                              const ParsedArFileHeader& header,
-                             const DataBuffer& file_contents,
+                             const uint8_t* contents,
+                             size_t contents_size,
                              SymbolIndexMap* symbols,
                              SymbolIndexMap* weak_symbols) {
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), symbols);
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), weak_symbols);
 
-  common::BinaryBufferReader reader(file_contents.data(),
-                                    file_contents.size());
+  common::BinaryBufferReader reader(contents, contents_size);
   const IMPORT_OBJECT_HEADER* import = NULL;
   if (!reader.Read(&import))
     return false;
@@ -275,12 +274,12 @@ bool ExtractSymbolsImportDef(uint32_t file_index,
 // type, then this does nothing.
 bool ExtractSymbols(uint32_t file_index,
                     const ParsedArFileHeader& header,
-                    const DataBuffer& file_contents,
+                    const uint8_t* contents,
+                    size_t contents_size,
                     SymbolIndexMap* symbols,
                     SymbolIndexMap* weak_symbols) {
   core::FileType file_type = core::kUnknownFileType;
-  if (!core::GuessFileType(file_contents.data(), file_contents.size(),
-                           &file_type)) {
+  if (!core::GuessFileType(contents, contents_size, &file_type)) {
     LOG(ERROR) << "Unable to determine file type: " << header.name;
     return false;
   }
@@ -288,16 +287,16 @@ bool ExtractSymbols(uint32_t file_index,
   switch (file_type) {
     case core::kCoffFileType:
     case core::kCoff64FileType: {
-      if (!ExtractSymbolsCoff(file_index, header, file_contents, symbols,
-                              weak_symbols)) {
+      if (!ExtractSymbolsCoff(file_index, header, contents, contents_size,
+                              symbols, weak_symbols)) {
         return false;
       }
       break;
     }
 
     case core::kImportDefinitionFileType: {
-      if (!ExtractSymbolsImportDef(file_index, header, file_contents, symbols,
-                                   weak_symbols)) {
+      if (!ExtractSymbolsImportDef(file_index, header, contents,
+                                   contents_size, symbols, weak_symbols)) {
         return false;
       }
       break;
@@ -377,7 +376,8 @@ bool PopulateArFileHeader(const ParsedArFileHeader& parsed_header,
 
 // Writes the given file to an archive, prepended by its header.
 bool WriteFile(const ArFileHeader& header,
-               const DataBuffer& contents,
+               const uint8_t* contents,
+               size_t contents_size,
                FILE* file) {
   DCHECK_NE(reinterpret_cast<FILE*>(NULL), file);
 
@@ -388,8 +388,7 @@ bool WriteFile(const ArFileHeader& header,
   }
 
   // Write the contents.
-  if (::fwrite(contents.data(), 1, contents.size(), file) !=
-               contents.size()) {
+  if (::fwrite(contents, 1, contents_size, file) != contents_size) {
     LOG(ERROR) << "Failed to write file contents.";
     return false;
   }
@@ -397,6 +396,12 @@ bool WriteFile(const ArFileHeader& header,
   return true;
 }
 
+bool WriteFile(const ArFileHeader& header,
+               const DataBuffer& contents,
+               FILE* file) {
+  return WriteFile(header, contents.data(), contents.size(), file);
+}
+
 // Writes a primary symbol table using the legacy symbol table format.
 bool WritePrimarySymbolTable(const base::Time& timestamp,
                              const SymbolIndexMap& symbols,
@@ -519,6 +524,90 @@ uint32_t AlignAndGetPosition(FILE* file) {
   return aligned_pos;
 }
 
+// Translates the name of a file to the name used in its raw header. A name
+// too long for the header is appended to the extended name table |names|,
+// and referred to by its offset in it.
+void TranslateFilename(ParsedArFileHeader* header, DataBuffer* names) {
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+  DCHECK_NE(reinterpret_cast<DataBuffer*>(NULL), names);
+
+  if (header->name.size() >= sizeof(ArFileHeader().name)) {
+    // Copy the extended filename to the name table, with a terminating
+    // null.
+    size_t offset = names->size();
+    names->resize(offset + header->name.size() + 1);
+    ::memcpy(names->data() + offset, header->name.data(),
+             header->name.size() + 1);
+
+    // Name the file with a reference to the name table.
+    header->name = base::StringPrintf("/%d", offset);
+  } else {
+    // Simply append a trailing '/' to the name.
+    header->name += "/";
+  }
+}
+
+// Writes the global header and the symbol and name tables that start an
+// archive. The symbol tables are written with the given file offsets. They
+// have the same size whatever the offsets, so they can be rewritten in place
+// once the actual offsets are known.
+bool WriteArchiveTables(const base::Time& timestamp,
+                        const SymbolIndexMap& symbols,
+                        const FileOffsets& offsets,
+                        const DataBuffer& names,
+                        FILE* file,
+                        uint32_t* symbols1_pos,
+                        uint32_t* symbols2_pos) {
+  DCHECK_NE(reinterpret_cast<FILE*>(NULL), file);
+  DCHECK_NE(reinterpret_cast<uint32_t*>(NULL), symbols1_pos);
+  DCHECK_NE(reinterpret_cast<uint32_t*>(NULL), symbols2_pos);
+
+  if (::fwrite(kArGlobalMagic, sizeof(kArGlobalMagic), 1, file) != 1) {
+    LOG(ERROR) << "Failed to write global archive header.";
+    return false;
+  }
+
+  *symbols1_pos = AlignAndGetPosition(file);
+  if (!WritePrimarySymbolTable(timestamp, symbols, offsets, file))
+    return false;
+  *symbols2_pos = AlignAndGetPosition(file);
+  if (!WriteSecondarySymbolTable(timestamp, symbols, offsets, file))
+    return false;
+
+  // Write the name table.
+  AlignAndGetPosition(file);
+  if (!WriteNameTable(timestamp, names, file))
+    return false;
+
+  return true;
+}
+
+// Rewrites the symbol tables written by WriteArchiveTables with the actual
+// file offsets.
+bool RewriteSymbolTables(const base::Time& timestamp,
+                         const SymbolIndexMap& symbols,
+                         const FileOffsets& offsets,
+                         uint32_t symbols1_pos,
+                         uint32_t symbols2_pos,
+                         FILE* file) {
+  DCHECK_NE(reinterpret_cast<FILE*>(NULL), file);
+
+  if (::fseek(file, symbols1_pos, SEEK_SET) != 0) {
+    LOG(ERROR) << "Failed to seek to primary symbol stream.";
+    return false;
+  }
+  if (!WritePrimarySymbolTable(timestamp, symbols, offsets, file))
+    return false;
+  if (::fseek(file, symbols2_pos, SEEK_SET) != 0) {
+    LOG(ERROR) << "Failed to seek to secondary symbol stream.";
+    return false;
+  }
+  if (!WriteSecondarySymbolTable(timestamp, symbols, offsets, file))
+    return false;
+
+  return true;
+}
+
 }  // namespace
 
 ArWriter::ArWriter() {
@@ -554,8 +643,8 @@ bool ArWriter::AddFile(const base::StringPiece& filename,
   // symbol tables so as not to corrupt them if the operation fails.
   SymbolIndexMap symbols = symbols_;
   SymbolIndexMap weak_symbols = weak_symbols_;
-  if (!ExtractSymbols(files_.size(), header, *contents, &symbols,
-                      &weak_symbols)) {
+  if (!ExtractSymbols(files_.size(), header, contents->data(),
+                      contents->size(), &symbols, &weak_symbols)) {
     return false;
   }
 
@@ -612,26 +701,10 @@ bool ArWriter::Write(const base::FilePath& path) {
   for (size_t i = 0; i < files_.size(); ++i) {
     // Grab a copy of the header because we are going to modify it.
     ParsedArFileHeader header = files_[i].first;
-    ArFileHeader& raw_header = raw_headers[i];
-
-    // Translate the filename.
-    if (header.name.size() >= sizeof(raw_header.name)) {
-      // Copy the extended filename to the name table, with a terminating
-      // null.
-      size_t offset = names.size();
-      names.resize(offset + header.name.size() + 1);
-      ::memcpy(names.data() + offset, header.name.data(),
-               header.name.size() + 1);
-
-      // Name the file with a reference to the name table.
-      header.name = base::StringPrintf("/%d", offset);
-    } else {
-      // Simply append a trailing '/' to the name.
-      header.name += "/";
-    }
+    TranslateFilename(&header, &names);
 
     // Fill in the raw file header.
-    if (!PopulateArFileHeader(header, &raw_header))
+    if (!PopulateArFileHeader(header, &raw_headers[i]))
       return false;
   }
 
@@ -641,27 +714,18 @@ bool ArWriter::Write(const base::FilePath& path) {
     LOG(ERROR) << "Unable to open file for writing: " << path.value();
     return false;
   }
-  if (::fwrite(kArGlobalMagic, sizeof(kArGlobalMagic), 1, file.get()) != 1) {
-    LOG(ERROR) << "Failed to write global archive header.";
-    return false;
-  }
 
   // Write the symbol tables. We initially use a set of dummy offsets, and
   // reach back and write the actual offsets once we've laid out the object
   // files.
   FileOffsets offsets(files_.size());
   base::Time timestamp = base::Time::Now();
-  uint32_t symbols1_pos = AlignAndGetPosition(file.get());
-  if (!WritePrimarySymbolTable(timestamp, symbols_, offsets, file.get()))
-    return false;
-  uint32_t symbols2_pos = AlignAndGetPosition(file.get());
-  if (!WriteSecondarySymbolTable(timestamp, symbols_, offsets, file.get()))
-    return false;
-
-  // Write the name table.
-  AlignAndGetPosition(file.get());
-  if (!WriteNameTable(timestamp, names, file.get()))
+  uint32_t symbols1_pos = 0;
+  uint32_t symbols2_pos = 0;
+  if (!WriteArchiveTables(timestamp, symbols_, offsets, names, file.get(),
+                          &symbols1_pos, &symbols2_pos)) {
     return false;
+  }
 
   // Write the files, keeping track of their offsets.
   for (size_t i = 0; i < files_.size(); ++i) {
@@ -674,18 +738,169 @@ bool ArWriter::Write(const base::FilePath& path) {
   }
 
   // Rewrite the symbol streams using the actual file offsets this time around.
-  if (::fseek(file.get(), symbols1_pos, SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to primary symbol stream.";
+  if (!RewriteSymbolTables(timestamp, symbols_, offsets, symbols1_pos,
+                           symbols2_pos, file.get())) {
     return false;
   }
-  if (!WritePrimarySymbolTable(timestamp, symbols_, offsets, file.get()))
+
+  return true;
+}
+
+ArStreamWriter::ArStreamWriter() {
+}
+
+ArStreamWriter::~ArStreamWriter() {
+  spool_.reset();
+  if (!spool_path_.empty() && !base::DeleteFile(spool_path_, false))
+    LOG(WARNING) << "Unable to delete file: " << spool_path_.value();
+}
+
+bool ArStreamWriter::Init(const base::FilePath& path) {
+  DCHECK(path_.empty());
+  DCHECK(!path.empty());
+
+  path_ = path;
+  spool_.reset(base::CreateAndOpenTemporaryFileInDir(path_.DirName(),
+                                                     &spool_path_));
+  if (spool_.get() == NULL) {
+    LOG(ERROR) << "Unable to create a temporary file next to: "
+               << path_.value();
     return false;
-  if (::fseek(file.get(), symbols2_pos, SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to secondary symbol stream.";
+  }
+
+  return true;
+}
+
+bool ArStreamWriter::AddFile(const base::StringPiece& filename,
+                             const base::Time& timestamp,
+                             uint32_t mode,
+                             const uint8_t* contents,
+                             size_t contents_size) {
+  DCHECK_NE(reinterpret_cast<const uint8_t*>(NULL), contents);
+
+  if (spool_.get() == NULL) {
+    LOG(ERROR) << "Archive writer is not open, adding: " << filename;
+    return false;
+  }
+
+  if (contents_size == 0) {
+    LOG(ERROR) << "Unable to add empty file to archive: " << filename;
+    return false;
+  }
+
+  // Build the file header.
+  ParsedArFileHeader header;
+  header.name = filename.as_string();
+  header.timestamp = timestamp;
+  header.mode = mode;
+  header.size = contents_size;
+
+  // Try to parse the symbols from the file. We keep a copy of the
+  // symbol tables so as not to corrupt them if the operation fails.
+  SymbolIndexMap symbols = symbols_;
+  SymbolIndexMap weak_symbols = weak_symbols_;
+  if (!ExtractSymbols(offsets_.size(), header, contents, contents_size,
+                      &symbols, &weak_symbols)) {
+    return false;
+  }
+
+  // Translate the name. The name table is truncated back to its original
+  // size if the file can't be added.
+  size_t names_size = names_.size();
+  TranslateFilename(&header, &names_);
+  ArFileHeader raw_header;
+  if (!PopulateArFileHeader(header, &raw_header)) {
+    names_.resize(names_size);
+    return false;
+  }
+
+  // Write the file to the spool. Its offset is relative to the start of the
+  // spool, which is aligned in the archive. A failed write leaves the spool
+  // in an unknown state, so no more files may be added after one.
+  uint32_t offset = AlignAndGetPosition(spool_.get());
+  if (!WriteFile(raw_header, contents, contents_size, spool_.get())) {
+    names_.resize(names_size);
+    spool_.reset();
+    return false;
+  }
+
+  // If all goes well then commit the file to the archive.
+  std::swap(symbols_, symbols);
+  std::swap(weak_symbols_, weak_symbols);
+  offsets_.push_back(offset);
+  return true;
+}
+
+bool ArStreamWriter::AddFile(const base::StringPiece& filename,
+                             const base::Time& timestamp,
+                             uint32_t mode,
+                             const DataBuffer& contents) {
+  if (contents.empty()) {
+    LOG(ERROR) << "Unable to add empty file to archive: " << filename;
+    return false;
+  }
+  return AddFile(filename, timestamp, mode, contents.data(),
+                 contents.size());
+}
+
+bool ArStreamWriter::Close() {
+  if (spool_.get() == NULL) {
+    LOG(ERROR) << "Archive writer is not open: " << path_.value();
+    return false;
+  }
+
+  if (offsets_.empty()) {
+    LOG(ERROR) << "Unable to write an empty archive.";
+    return false;
+  }
+
+  if (::fflush(spool_.get()) != 0 ||
+      ::fseek(spool_.get(), 0, SEEK_SET) != 0) {
+    LOG(ERROR) << "Failed to rewind temporary file: " << spool_path_.value();
     return false;
   }
-  if (!WriteSecondarySymbolTable(timestamp, symbols_, offsets, file.get()))
+
+  base::ScopedFILE file(base::OpenFile(path_, "w+b"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for writing: " << path_.value();
     return false;
+  }
+
+  // Write the symbol tables with dummy offsets, then the files. The files
+  // follow the name table at an aligned offset.
+  FileOffsets offsets(offsets_.size());
+  base::Time timestamp = base::Time::Now();
+  uint32_t symbols1_pos = 0;
+  uint32_t symbols2_pos = 0;
+  if (!WriteArchiveTables(timestamp, symbols_, offsets, names_, file.get(),
+                          &symbols1_pos, &symbols2_pos)) {
+    return false;
+  }
+  uint32_t files_pos = AlignAndGetPosition(file.get());
+
+  // Copy the spooled files in chunks.
+  const size_t kChunkSize = 1024 * 1024;
+  std::unique_ptr<uint8_t[]> chunk(new uint8_t[kChunkSize]);
+  while (true) {
+    size_t read = ::fread(chunk.get(), 1, kChunkSize, spool_.get());
+    if (read > 0 && ::fwrite(chunk.get(), 1, read, file.get()) != read) {
+      LOG(ERROR) << "Failed to write files to archive: " << path_.value();
+      return false;
+    }
+    if (read < kChunkSize)
+      break;
+  }
+  if (::ferror(spool_.get())) {
+    LOG(ERROR) << "Failed to read temporary file: " << spool_path_.value();
+    return false;
+  }
+
+  for (size_t i = 0; i < offsets_.size(); ++i)
+    offsets[i] = files_pos + offsets_[i];
+  if (!RewriteSymbolTables(timestamp, symbols_, offsets, symbols1_pos,
+                           symbols2_pos, file.get())) {
+    return false;
+  }
 
   return true;
 }
@@ -21,6 +21,7 @@
 #include <set>
 
 #include "base/files/file_path.h"
+#include "base/files/file_util.h"
 #include "base/memory/scoped_vector.h"
 #include "syzygy/ar/ar_common.h"
 
@@ -90,6 +91,78 @@ class ArWriter {
   DISALLOW_COPY_AND_ASSIGN(ArWriter);
 };
 
+// Class for writing an archive of COFF object files without keeping their
+// contents in memory. The files are written to a temporary file next to the
+// archive as they are added, and only their symbols and names are kept. When
+// the writer is closed, the archive is written with its symbol and name
+// tables up front, followed by the files copied from the temporary file.
+// Symbols are exported with the same rules as ArWriter.
+class ArStreamWriter {
+ public:
+  ArStreamWriter();
+  ~ArStreamWriter();
+
+  // Prepares to write an archive. The archive itself is only written by
+  // Close.
+  // @param path The path of the archive file to be written. Its directory
+  //     receives the temporary file.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& path);
+
+  // @returns the number of files added to the archive.
+  size_t file_count() const { return offsets_.size(); }
+
+  // @returns the current set of exported symbols.
+  const SymbolIndexMap& symbols() const { return symbols_; }
+
+  // Writes the given object file to the archive. The contents need not
+  // outlive the call. A file that fails to be parsed isn't added, but no more
+  // files may be added after a failure to write one.
+  // @param filename The filename that will be associated with the content.
+  // @param timestamp The timestamp to be associated with the file.
+  // @param mode The mode to be associated with the file. In the same format
+  //     as ST_MODE from _wstat.
+  // @param contents The contents of the file.
+  // @param contents_size The size of @p contents.
+  // @returns true on success, false otherwise.
+  bool AddFile(const base::StringPiece& filename,
+               const base::Time& timestamp,
+               uint32_t mode,
+               const uint8_t* contents,
+               size_t contents_size);
+  bool AddFile(const base::StringPiece& filename,
+               const base::Time& timestamp,
+               uint32_t mode,
+               const DataBuffer& contents);
+
+  // Writes the archive from the files added so far.
+  // @returns true on success, false otherwise.
+  bool Close();
+
+ protected:
+  typedef std::vector<uint32_t> FileOffsets;
+
+  // The path of the archive.
+  base::FilePath path_;
+
+  // The temporary file to which the files are written, with their headers.
+  base::FilePath spool_path_;
+  base::ScopedFILE spool_;
+
+  // The offsets of the files in the temporary file.
+  FileOffsets offsets_;
+
+  // The extended name table.
+  DataBuffer names_;
+
+  // The exported symbols, and the weak symbols among them. See ArWriter.
+  SymbolIndexMap symbols_;
+  SymbolIndexMap weak_symbols_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ArStreamWriter);
+};
+
 }  // namespace ar
 
 #endif  // SYZYGY_AR_AR_WRITER_H_
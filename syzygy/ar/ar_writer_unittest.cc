@@ -14,6 +14,7 @@
 
 #include "syzygy/ar/ar_writer.h"
 
+#include "base/files/file_enumerator.h"
 #include "base/files/file_util.h"
 #include "base/memory/scoped_vector.h"
 #include "gmock/gmock.h"
@@ -222,4 +223,61 @@ TEST_F(ArWriterTest, TestArWriterRoundTripRepeatedFileNames) {
   EXPECT_THAT(reader2.symbols(), testing::ContainerEq(reader1.symbols()));
 }
 
+TEST_F(ArWriterTest, StreamWriterEmptyArchiveFails) {
+  ArStreamWriter writer;
+  ASSERT_TRUE(writer.Init(lib_path_));
+
+  DataBuffer contents;
+  EXPECT_FALSE(writer.AddFile("foo.obj", base::Time::Now(), 0, contents));
+  EXPECT_EQ(0u, writer.file_count());
+  EXPECT_FALSE(writer.Close());
+  EXPECT_FALSE(base::PathExists(lib_path_));
+}
+
+TEST_F(ArWriterTest, StreamWriterRoundTrip) {
+  base::FilePath lib1 = testing::GetSrcRelativePath(
+      testing::kDuplicatesArchiveFile);
+  ArReader reader1;
+  ASSERT_TRUE(reader1.Init(lib1));
+
+  // Each file's contents are discarded as soon as it has been added.
+  {
+    ArStreamWriter writer;
+    ASSERT_TRUE(writer.Init(lib_path_));
+    while (reader1.HasNext()) {
+      ParsedArFileHeader header;
+      DataBuffer contents;
+      ASSERT_TRUE(reader1.ExtractNext(&header, &contents));
+      EXPECT_TRUE(writer.AddFile(header.name, header.timestamp, header.mode,
+                                 contents));
+    }
+    EXPECT_EQ(reader1.offsets().size(), writer.file_count());
+    EXPECT_THAT(writer.symbols(), testing::ContainerEq(reader1.symbols()));
+    EXPECT_TRUE(writer.Close());
+  }
+
+  // The temporary file is gone, leaving only the archive.
+  base::FileEnumerator enumerator(temp_dir_, false,
+                                  base::FileEnumerator::FILES);
+  EXPECT_EQ(lib_path_, enumerator.Next());
+  EXPECT_TRUE(enumerator.Next().empty());
+
+  // The archive has the same files and symbols as the original.
+  ArReader reader2;
+  ASSERT_TRUE(reader2.Init(lib_path_));
+  EXPECT_THAT(reader2.symbols(), testing::ContainerEq(reader1.symbols()));
+  ASSERT_EQ(reader1.offsets().size(), reader2.offsets().size());
+  ASSERT_TRUE(reader1.SeekIndex(0));
+  while (reader1.HasNext()) {
+    ParsedArFileHeader header1;
+    ParsedArFileHeader header2;
+    DataBuffer contents1;
+    DataBuffer contents2;
+    ASSERT_TRUE(reader1.ExtractNext(&header1, &contents1));
+    ASSERT_TRUE(reader2.ExtractNext(&header2, &contents2));
+    EXPECT_EQ(header1.name, header2.name);
+    EXPECT_EQ(contents1, contents2);
+  }
+}
+
 }  // namespace ar
@@ -0,0 +1,408 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/backdrops/heap_allocators.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/strings/utf_string_conversions.h"
+#include "syzygy/agent/asan/runtime.h"
+#include "syzygy/agent/asan/windows_heap_adapter.h"
+#include "syzygy/agent/asan/heaps/size_class_block_heap.h"
+#include "syzygy/agent/asan/heaps/win_heap.h"
+#include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
+
+namespace bard {
+namespace backdrops {
+
+namespace {
+
+using agent::asan::WindowsHeapAdapter;
+using agent::asan::heaps::SizeClassBlockHeap;
+using agent::asan::heaps::WinHeap;
+using agent::asan::memory_notifiers::NullMemoryNotifier;
+
+// The alignment of the addresses handed out by the null allocator.
+const uintptr_t kNullAllocationAlignment = 16;
+
+// The first address handed out by the null allocator. This is above the
+// first 64KB, which the system never maps.
+const uintptr_t kNullFirstAddress = 0x10000;
+
+// The header of the allocations of a SizeClassHeapAllocator. It keeps the
+// allocations aligned on 16 bytes, as those of the Windows heap on 64-bit.
+struct SizeClassHeader {
+  // The size requested for the allocation.
+  SIZE_T size;
+  // True if the allocation lives in the size class heap.
+  bool is_small;
+};
+const size_t kSizeClassHeaderSize = 16;
+static_assert(sizeof(SizeClassHeader) <= kSizeClassHeaderSize,
+              "The size class header is too large.");
+
+SizeClassHeader* GetSizeClassHeader(LPCVOID mem) {
+  return reinterpret_cast<SizeClassHeader*>(
+      reinterpret_cast<uintptr_t>(mem) - kSizeClassHeaderSize);
+}
+
+// Looks up a heap function exported by a runtime.
+template <typename FunctionPtr>
+bool GetHeapFunction(HMODULE module, const char* name, FunctionPtr* function) {
+  *function = reinterpret_cast<FunctionPtr>(::GetProcAddress(module, name));
+  if (*function == nullptr) {
+    LOG(ERROR) << "The runtime doesn't export " << name << ".";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+void BindHeapAllocator(HeapAllocatorInterface* allocator,
+                       HeapBackdrop* backdrop) {
+  DCHECK_NE(static_cast<HeapAllocatorInterface*>(nullptr), allocator);
+  DCHECK_NE(static_cast<HeapBackdrop*>(nullptr), backdrop);
+
+  auto unretained = base::Unretained(allocator);
+  backdrop->set_heap_alloc(
+      base::Bind(&HeapAllocatorInterface::HeapAlloc, unretained));
+  backdrop->set_heap_create(
+      base::Bind(&HeapAllocatorInterface::HeapCreate, unretained));
+  backdrop->set_heap_destroy(
+      base::Bind(&HeapAllocatorInterface::HeapDestroy, unretained));
+  backdrop->set_heap_free(
+      base::Bind(&HeapAllocatorInterface::HeapFree, unretained));
+  backdrop->set_heap_realloc(
+      base::Bind(&HeapAllocatorInterface::HeapReAlloc, unretained));
+  backdrop->set_heap_set_information(
+      base::Bind(&HeapAllocatorInterface::HeapSetInformation, unretained));
+  backdrop->set_heap_size(
+      base::Bind(&HeapAllocatorInterface::HeapSize, unretained));
+}
+
+std::unique_ptr<HeapAllocatorInterface> CreateHeapAllocator(
+    const std::string& name) {
+  if (name == "system")
+    return std::unique_ptr<HeapAllocatorInterface>(new SystemHeapAllocator());
+  if (name == "null")
+    return std::unique_ptr<HeapAllocatorInterface>(new NullHeapAllocator());
+  if (name == "size-class") {
+    return std::unique_ptr<HeapAllocatorInterface>(
+        new SizeClassHeapAllocator());
+  }
+
+  if (name == "block-heap-manager") {
+    std::wstring flags;
+    agent::asan::AsanRuntime::GetAsanFlagsEnvVar(&flags);
+    std::unique_ptr<BlockHeapManagerAllocator> allocator(
+        new BlockHeapManagerAllocator());
+    if (!allocator->Init(flags))
+      return nullptr;
+    return std::move(allocator);
+  }
+
+  // The runtime stays loaded until the process exits, as the heaps it hands
+  // out may outlive the allocator.
+  HMODULE module = ::LoadLibrary(base::UTF8ToWide(name).c_str());
+  if (module == nullptr) {
+    LOG(ERROR) << "Failed to load the runtime \"" << name << "\".";
+    return nullptr;
+  }
+  std::unique_ptr<SystemHeapAllocator> allocator(new SystemHeapAllocator());
+  if (!allocator->InitFromRuntime(module))
+    return nullptr;
+  return std::move(allocator);
+}
+
+SystemHeapAllocator::SystemHeapAllocator()
+    : heap_create_(&::HeapCreate),
+      heap_destroy_(&::HeapDestroy),
+      heap_alloc_(&::HeapAlloc),
+      heap_free_(&::HeapFree),
+      heap_realloc_(&::HeapReAlloc),
+      heap_set_information_(&::HeapSetInformation),
+      heap_size_(&::HeapSize) {
+}
+
+bool SystemHeapAllocator::InitFromRuntime(HMODULE module) {
+  DCHECK_NE(static_cast<HMODULE>(nullptr), module);
+  return GetHeapFunction(module, "asan_HeapCreate", &heap_create_) &&
+         GetHeapFunction(module, "asan_HeapDestroy", &heap_destroy_) &&
+         GetHeapFunction(module, "asan_HeapAlloc", &heap_alloc_) &&
+         GetHeapFunction(module, "asan_HeapFree", &heap_free_) &&
+         GetHeapFunction(module, "asan_HeapReAlloc", &heap_realloc_) &&
+         GetHeapFunction(module, "asan_HeapSetInformation",
+                         &heap_set_information_) &&
+         GetHeapFunction(module, "asan_HeapSize", &heap_size_);
+}
+
+HANDLE SystemHeapAllocator::HeapCreate(DWORD options,
+                                       SIZE_T initial_size,
+                                       SIZE_T maximum_size) {
+  return heap_create_(options, initial_size, maximum_size);
+}
+
+BOOL SystemHeapAllocator::HeapDestroy(HANDLE heap) {
+  return heap_destroy_(heap);
+}
+
+LPVOID SystemHeapAllocator::HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) {
+  return heap_alloc_(heap, flags, bytes);
+}
+
+BOOL SystemHeapAllocator::HeapFree(HANDLE heap, DWORD flags, LPVOID mem) {
+  return heap_free_(heap, flags, mem);
+}
+
+LPVOID SystemHeapAllocator::HeapReAlloc(HANDLE heap,
+                                        DWORD flags,
+                                        LPVOID mem,
+                                        SIZE_T bytes) {
+  return heap_realloc_(heap, flags, mem, bytes);
+}
+
+BOOL SystemHeapAllocator::HeapSetInformation(HANDLE heap,
+                                             HEAP_INFORMATION_CLASS info_class,
+                                             PVOID info,
+                                             SIZE_T info_length) {
+  return heap_set_information_(heap, info_class, info, info_length);
+}
+
+SIZE_T SystemHeapAllocator::HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) {
+  return heap_size_(heap, flags, mem);
+}
+
+NullHeapAllocator::NullHeapAllocator()
+    : next_address_(kNullFirstAddress) {
+}
+
+HANDLE NullHeapAllocator::HeapCreate(DWORD options,
+                                     SIZE_T initial_size,
+                                     SIZE_T maximum_size) {
+  return GetNextAddress();
+}
+
+BOOL NullHeapAllocator::HeapDestroy(HANDLE heap) {
+  // The sizes of the allocations left in the heap are kept, as they aren't
+  // tracked per heap.
+  return TRUE;
+}
+
+LPVOID NullHeapAllocator::HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) {
+  LPVOID mem = GetNextAddress();
+  Shard* shard = GetShard(mem);
+  base::AutoLock auto_lock(shard->lock);
+  shard->sizes[mem] = bytes;
+  return mem;
+}
+
+BOOL NullHeapAllocator::HeapFree(HANDLE heap, DWORD flags, LPVOID mem) {
+  if (mem == nullptr)
+    return TRUE;
+  Shard* shard = GetShard(mem);
+  base::AutoLock auto_lock(shard->lock);
+  return shard->sizes.erase(mem) != 0;
+}
+
+LPVOID NullHeapAllocator::HeapReAlloc(HANDLE heap,
+                                      DWORD flags,
+                                      LPVOID mem,
+                                      SIZE_T bytes) {
+  if (!HeapFree(heap, flags, mem))
+    return nullptr;
+  return HeapAlloc(heap, flags, bytes);
+}
+
+BOOL NullHeapAllocator::HeapSetInformation(HANDLE heap,
+                                           HEAP_INFORMATION_CLASS info_class,
+                                           PVOID info,
+                                           SIZE_T info_length) {
+  return TRUE;
+}
+
+SIZE_T NullHeapAllocator::HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) {
+  Shard* shard = GetShard(mem);
+  base::AutoLock auto_lock(shard->lock);
+  auto it = shard->sizes.find(mem);
+  if (it == shard->sizes.end())
+    return static_cast<SIZE_T>(-1);
+  return it->second;
+}
+
+NullHeapAllocator::Shard* NullHeapAllocator::GetShard(LPCVOID mem) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(mem);
+  return &shards_[(address / kNullAllocationAlignment) % kShardCount];
+}
+
+LPVOID NullHeapAllocator::GetNextAddress() {
+  base::subtle::AtomicWord address = base::subtle::NoBarrier_AtomicIncrement(
+      &next_address_, kNullAllocationAlignment);
+  return reinterpret_cast<LPVOID>(address);
+}
+
+struct SizeClassHeapAllocator::Heap {
+  Heap() : small_heap(&memory_notifier, &internal_heap) {}
+
+  NullMemoryNotifier memory_notifier;
+  WinHeap internal_heap;
+  SizeClassBlockHeap small_heap;
+  WinHeap large_heap;
+};
+
+HANDLE SizeClassHeapAllocator::HeapCreate(DWORD options,
+                                          SIZE_T initial_size,
+                                          SIZE_T maximum_size) {
+  return reinterpret_cast<HANDLE>(new Heap());
+}
+
+BOOL SizeClassHeapAllocator::HeapDestroy(HANDLE heap) {
+  delete reinterpret_cast<Heap*>(heap);
+  return TRUE;
+}
+
+LPVOID SizeClassHeapAllocator::HeapAlloc(HANDLE heap,
+                                         DWORD flags,
+                                         SIZE_T bytes) {
+  Heap* size_class_heap = reinterpret_cast<Heap*>(heap);
+  if (bytes > UINT32_MAX - kSizeClassHeaderSize)
+    return nullptr;
+
+  uint32_t size = static_cast<uint32_t>(bytes + kSizeClassHeaderSize);
+  bool is_small = size <= SizeClassBlockHeap::kMaxAllocationSize;
+  void* alloc = nullptr;
+  if (is_small)
+    alloc = size_class_heap->small_heap.Allocate(size);
+  else
+    alloc = size_class_heap->large_heap.Allocate(size);
+  if (alloc == nullptr)
+    return nullptr;
+
+  SizeClassHeader* header = reinterpret_cast<SizeClassHeader*>(alloc);
+  header->size = bytes;
+  header->is_small = is_small;
+  LPVOID mem = reinterpret_cast<uint8_t*>(alloc) + kSizeClassHeaderSize;
+  if (flags & HEAP_ZERO_MEMORY)
+    ::memset(mem, 0, bytes);
+  return mem;
+}
+
+BOOL SizeClassHeapAllocator::HeapFree(HANDLE heap, DWORD flags, LPVOID mem) {
+  if (mem == nullptr)
+    return TRUE;
+
+  Heap* size_class_heap = reinterpret_cast<Heap*>(heap);
+  SizeClassHeader* header = GetSizeClassHeader(mem);
+  if (header->is_small)
+    return size_class_heap->small_heap.Free(header);
+  return size_class_heap->large_heap.Free(header);
+}
+
+LPVOID SizeClassHeapAllocator::HeapReAlloc(HANDLE heap,
+                                           DWORD flags,
+                                           LPVOID mem,
+                                           SIZE_T bytes) {
+  LPVOID new_mem = HeapAlloc(heap, flags, bytes);
+  if (new_mem == nullptr || mem == nullptr)
+    return new_mem;
+
+  ::memcpy(new_mem, mem, std::min(bytes, GetSizeClassHeader(mem)->size));
+  HeapFree(heap, flags, mem);
+  return new_mem;
+}
+
+BOOL SizeClassHeapAllocator::HeapSetInformation(
+    HANDLE heap,
+    HEAP_INFORMATION_CLASS info_class,
+    PVOID info,
+    SIZE_T info_length) {
+  return TRUE;
+}
+
+SIZE_T SizeClassHeapAllocator::HeapSize(HANDLE heap,
+                                        DWORD flags,
+                                        LPCVOID mem) {
+  return GetSizeClassHeader(mem)->size;
+}
+
+BlockHeapManagerAllocator::BlockHeapManagerAllocator() {
+}
+
+BlockHeapManagerAllocator::~BlockHeapManagerAllocator() {
+  if (runtime_.get() != nullptr)
+    runtime_->TearDown();
+}
+
+bool BlockHeapManagerAllocator::Init(const std::wstring& flags) {
+  DCHECK(runtime_.get() == nullptr);
+  runtime_.reset(new agent::asan::AsanRuntime());
+  if (!runtime_->SetUp(flags)) {
+    LOG(ERROR) << "Failed to set up the SyzyASan runtime.";
+    runtime_.reset();
+    return false;
+  }
+  return true;
+}
+
+HANDLE BlockHeapManagerAllocator::HeapCreate(DWORD options,
+                                             SIZE_T initial_size,
+                                             SIZE_T maximum_size) {
+  return WindowsHeapAdapter::HeapCreate(options, initial_size, maximum_size);
+}
+
+BOOL BlockHeapManagerAllocator::HeapDestroy(HANDLE heap) {
+  return WindowsHeapAdapter::HeapDestroy(heap);
+}
+
+LPVOID BlockHeapManagerAllocator::HeapAlloc(HANDLE heap,
+                                            DWORD flags,
+                                            SIZE_T bytes) {
+  return WindowsHeapAdapter::HeapAlloc(heap, flags, bytes);
+}
+
+BOOL BlockHeapManagerAllocator::HeapFree(HANDLE heap,
+                                         DWORD flags,
+                                         LPVOID mem) {
+  return WindowsHeapAdapter::HeapFree(heap, flags, mem);
+}
+
+LPVOID BlockHeapManagerAllocator::HeapReAlloc(HANDLE heap,
+                                              DWORD flags,
+                                              LPVOID mem,
+                                              SIZE_T bytes) {
+  return WindowsHeapAdapter::HeapReAlloc(heap, flags, mem, bytes);
+}
+
+BOOL BlockHeapManagerAllocator::HeapSetInformation(
+    HANDLE heap,
+    HEAP_INFORMATION_CLASS info_class,
+    PVOID info,
+    SIZE_T info_length) {
+  return WindowsHeapAdapter::HeapSetInformation(heap, info_class, info,
+                                                info_length);
+}
+
+SIZE_T BlockHeapManagerAllocator::HeapSize(HANDLE heap,
+                                           DWORD flags,
+                                           LPCVOID mem) {
+  return WindowsHeapAdapter::HeapSize(heap, flags, mem);
+}
+
+}  // namespace backdrops
+}  // namespace bard
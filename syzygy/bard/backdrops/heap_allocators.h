@@ -0,0 +1,270 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the heap implementations that a HeapBackdrop can play heap events
+// back against, so that the same story compares them head-to-head. Each is
+// exposed through the Windows heap API, and is selected by name:
+//
+//   - system: the Windows heap.
+//   - null: hands out addresses without memory behind them, as a baseline
+//     of the cost of the playback itself.
+//   - size-class: the SyzyASan SizeClassBlockHeap, without redzones.
+//   - block-heap-manager: the SyzyASan BlockHeapManager of an in-process
+//     runtime, configured through the SYZYGY_ASAN_OPTIONS variable.
+//   - the path of a runtime exporting the asan_Heap* functions, such as
+//     syzyasan_rtl.dll.
+
+#ifndef SYZYGY_BARD_BACKDROPS_HEAP_ALLOCATORS_H_
+#define SYZYGY_BARD_BACKDROPS_HEAP_ALLOCATORS_H_
+
+#include <windows.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "base/atomicops.h"
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/bard/backdrops/heap_backdrop.h"
+
+namespace agent {
+namespace asan {
+class AsanRuntime;
+}  // namespace asan
+}  // namespace agent
+
+namespace bard {
+namespace backdrops {
+
+// Interface of a heap implementation, with the semantics of the Windows heap
+// API. Implementations are thread safe.
+class HeapAllocatorInterface {
+ public:
+  virtual ~HeapAllocatorInterface() {}
+
+  // @name Heap API functions.
+  // @{
+  virtual HANDLE HeapCreate(DWORD options,
+                            SIZE_T initial_size,
+                            SIZE_T maximum_size) = 0;
+  virtual BOOL HeapDestroy(HANDLE heap) = 0;
+  virtual LPVOID HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) = 0;
+  virtual BOOL HeapFree(HANDLE heap, DWORD flags, LPVOID mem) = 0;
+  virtual LPVOID HeapReAlloc(HANDLE heap,
+                             DWORD flags,
+                             LPVOID mem,
+                             SIZE_T bytes) = 0;
+  virtual BOOL HeapSetInformation(HANDLE heap,
+                                  HEAP_INFORMATION_CLASS info_class,
+                                  PVOID info,
+                                  SIZE_T info_length) = 0;
+  virtual SIZE_T HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) = 0;
+  // @}
+};
+
+// Points the heap API callbacks of a backdrop at an allocator.
+// @param allocator the allocator, which must outlive the playback.
+// @param backdrop the backdrop to configure.
+void BindHeapAllocator(HeapAllocatorInterface* allocator,
+                       HeapBackdrop* backdrop);
+
+// Creates an allocator by name, as described at the top of this file.
+// @param name the name of the allocator.
+// @returns the allocator, or nullptr on failure.
+std::unique_ptr<HeapAllocatorInterface> CreateHeapAllocator(
+    const std::string& name);
+
+// The Windows heap, or the heap functions exported by a runtime.
+class SystemHeapAllocator : public HeapAllocatorInterface {
+ public:
+  // @name Signatures of the heap functions.
+  // @{
+  typedef HANDLE(WINAPI* HeapCreatePtr)(DWORD, SIZE_T, SIZE_T);
+  typedef BOOL(WINAPI* HeapDestroyPtr)(HANDLE);
+  typedef LPVOID(WINAPI* HeapAllocPtr)(HANDLE, DWORD, SIZE_T);
+  typedef BOOL(WINAPI* HeapFreePtr)(HANDLE, DWORD, LPVOID);
+  typedef LPVOID(WINAPI* HeapReAllocPtr)(HANDLE, DWORD, LPVOID, SIZE_T);
+  typedef BOOL(WINAPI* HeapSetInformationPtr)(HANDLE,
+                                              HEAP_INFORMATION_CLASS,
+                                              PVOID,
+                                              SIZE_T);
+  typedef SIZE_T(WINAPI* HeapSizePtr)(HANDLE, DWORD, LPCVOID);
+  // @}
+
+  // Constructs an allocator using the Windows heap.
+  SystemHeapAllocator();
+  ~SystemHeapAllocator() override {}
+
+  // Points this allocator at the heap functions of a runtime.
+  // @param module the runtime, which must stay loaded.
+  // @returns true on success, false if a function is missing.
+  bool InitFromRuntime(HMODULE module);
+
+  // @name HeapAllocatorInterface implementation.
+  // @{
+  HANDLE HeapCreate(DWORD options,
+                    SIZE_T initial_size,
+                    SIZE_T maximum_size) override;
+  BOOL HeapDestroy(HANDLE heap) override;
+  LPVOID HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) override;
+  BOOL HeapFree(HANDLE heap, DWORD flags, LPVOID mem) override;
+  LPVOID HeapReAlloc(HANDLE heap,
+                     DWORD flags,
+                     LPVOID mem,
+                     SIZE_T bytes) override;
+  BOOL HeapSetInformation(HANDLE heap,
+                          HEAP_INFORMATION_CLASS info_class,
+                          PVOID info,
+                          SIZE_T info_length) override;
+  SIZE_T HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) override;
+  // @}
+
+ private:
+  HeapCreatePtr heap_create_;
+  HeapDestroyPtr heap_destroy_;
+  HeapAllocPtr heap_alloc_;
+  HeapFreePtr heap_free_;
+  HeapReAllocPtr heap_realloc_;
+  HeapSetInformationPtr heap_set_information_;
+  HeapSizePtr heap_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(SystemHeapAllocator);
+};
+
+// An allocator that hands out unique addresses without any memory behind
+// them. Only the sizes of the allocations are kept, for HeapSize.
+class NullHeapAllocator : public HeapAllocatorInterface {
+ public:
+  NullHeapAllocator();
+  ~NullHeapAllocator() override {}
+
+  // @name HeapAllocatorInterface implementation.
+  // @{
+  HANDLE HeapCreate(DWORD options,
+                    SIZE_T initial_size,
+                    SIZE_T maximum_size) override;
+  BOOL HeapDestroy(HANDLE heap) override;
+  LPVOID HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) override;
+  BOOL HeapFree(HANDLE heap, DWORD flags, LPVOID mem) override;
+  LPVOID HeapReAlloc(HANDLE heap,
+                     DWORD flags,
+                     LPVOID mem,
+                     SIZE_T bytes) override;
+  BOOL HeapSetInformation(HANDLE heap,
+                          HEAP_INFORMATION_CLASS info_class,
+                          PVOID info,
+                          SIZE_T info_length) override;
+  SIZE_T HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) override;
+  // @}
+
+ private:
+  // The number of shards of the sizes, each with its own lock so that the
+  // plot lines rarely wait on each other.
+  static const size_t kShardCount = 64;
+
+  // A shard of the sizes of the allocations.
+  struct Shard {
+    base::Lock lock;
+    std::unordered_map<LPCVOID, SIZE_T> sizes;
+  };
+
+  // @returns the shard holding the size of @p mem.
+  Shard* GetShard(LPCVOID mem);
+
+  // @returns a new unique address.
+  LPVOID GetNextAddress();
+
+  base::subtle::AtomicWord next_address_;
+  Shard shards_[kShardCount];
+
+  DISALLOW_COPY_AND_ASSIGN(NullHeapAllocator);
+};
+
+// An allocator serving the allocations of each heap from a SyzyASan
+// SizeClassBlockHeap, and those too large for it from a Windows heap. Each
+// allocation is preceded by a header recording its size.
+class SizeClassHeapAllocator : public HeapAllocatorInterface {
+ public:
+  SizeClassHeapAllocator() {}
+  ~SizeClassHeapAllocator() override {}
+
+  // @name HeapAllocatorInterface implementation.
+  // @{
+  HANDLE HeapCreate(DWORD options,
+                    SIZE_T initial_size,
+                    SIZE_T maximum_size) override;
+  BOOL HeapDestroy(HANDLE heap) override;
+  LPVOID HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) override;
+  BOOL HeapFree(HANDLE heap, DWORD flags, LPVOID mem) override;
+  LPVOID HeapReAlloc(HANDLE heap,
+                     DWORD flags,
+                     LPVOID mem,
+                     SIZE_T bytes) override;
+  BOOL HeapSetInformation(HANDLE heap,
+                          HEAP_INFORMATION_CLASS info_class,
+                          PVOID info,
+                          SIZE_T info_length) override;
+  SIZE_T HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) override;
+  // @}
+
+ private:
+  // A heap created by this allocator, defined in the implementation.
+  struct Heap;
+
+  DISALLOW_COPY_AND_ASSIGN(SizeClassHeapAllocator);
+};
+
+// An allocator forwarding to the BlockHeapManager of a SyzyASan runtime set
+// up in this process. Only one may exist at a time, as the runtime is a
+// singleton.
+class BlockHeapManagerAllocator : public HeapAllocatorInterface {
+ public:
+  BlockHeapManagerAllocator();
+  ~BlockHeapManagerAllocator() override;
+
+  // Sets up the runtime.
+  // @param flags the runtime flags, as in SYZYGY_ASAN_OPTIONS.
+  // @returns true on success, false otherwise.
+  bool Init(const std::wstring& flags);
+
+  // @name HeapAllocatorInterface implementation.
+  // @{
+  HANDLE HeapCreate(DWORD options,
+                    SIZE_T initial_size,
+                    SIZE_T maximum_size) override;
+  BOOL HeapDestroy(HANDLE heap) override;
+  LPVOID HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) override;
+  BOOL HeapFree(HANDLE heap, DWORD flags, LPVOID mem) override;
+  LPVOID HeapReAlloc(HANDLE heap,
+                     DWORD flags,
+                     LPVOID mem,
+                     SIZE_T bytes) override;
+  BOOL HeapSetInformation(HANDLE heap,
+                          HEAP_INFORMATION_CLASS info_class,
+                          PVOID info,
+                          SIZE_T info_length) override;
+  SIZE_T HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) override;
+  // @}
+
+ private:
+  std::unique_ptr<agent::asan::AsanRuntime> runtime_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockHeapManagerAllocator);
+};
+
+}  // namespace backdrops
+}  // namespace bard
+
+#endif  // SYZYGY_BARD_BACKDROPS_HEAP_ALLOCATORS_H_
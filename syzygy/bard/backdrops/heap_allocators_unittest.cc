@@ -0,0 +1,117 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/backdrops/heap_allocators.h"
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+namespace bard {
+namespace backdrops {
+
+namespace {
+
+// Exercises the allocations of a heap of @p allocator.
+void TestAllocations(HeapAllocatorInterface* allocator) {
+  HANDLE heap = allocator->HeapCreate(0, 0, 0);
+  ASSERT_NE(static_cast<HANDLE>(nullptr), heap);
+
+  LPVOID alloc1 = allocator->HeapAlloc(heap, 0, 10);
+  LPVOID alloc2 = allocator->HeapAlloc(heap, 0, 100000);
+  ASSERT_NE(static_cast<LPVOID>(nullptr), alloc1);
+  ASSERT_NE(static_cast<LPVOID>(nullptr), alloc2);
+  EXPECT_NE(alloc1, alloc2);
+  EXPECT_EQ(10u, allocator->HeapSize(heap, 0, alloc1));
+  EXPECT_EQ(100000u, allocator->HeapSize(heap, 0, alloc2));
+
+  LPVOID alloc3 = allocator->HeapReAlloc(heap, 0, alloc1, 20);
+  ASSERT_NE(static_cast<LPVOID>(nullptr), alloc3);
+  EXPECT_EQ(20u, allocator->HeapSize(heap, 0, alloc3));
+
+  EXPECT_TRUE(allocator->HeapFree(heap, 0, alloc2));
+  EXPECT_TRUE(allocator->HeapFree(heap, 0, alloc3));
+  EXPECT_TRUE(allocator->HeapDestroy(heap));
+}
+
+}  // namespace
+
+TEST(HeapAllocatorsTest, SystemHeapAllocator) {
+  SystemHeapAllocator allocator;
+  TestAllocations(&allocator);
+}
+
+TEST(HeapAllocatorsTest, NullHeapAllocator) {
+  NullHeapAllocator allocator;
+  TestAllocations(&allocator);
+
+  // An address is only freed once.
+  HANDLE heap = allocator.HeapCreate(0, 0, 0);
+  LPVOID alloc = allocator.HeapAlloc(heap, 0, 8);
+  EXPECT_TRUE(allocator.HeapFree(heap, 0, alloc));
+  EXPECT_FALSE(allocator.HeapFree(heap, 0, alloc));
+  EXPECT_TRUE(allocator.HeapDestroy(heap));
+}
+
+TEST(HeapAllocatorsTest, SizeClassHeapAllocator) {
+  SizeClassHeapAllocator allocator;
+  TestAllocations(&allocator);
+
+  HANDLE heap = allocator.HeapCreate(0, 0, 0);
+  ASSERT_NE(static_cast<HANDLE>(nullptr), heap);
+
+  // The allocations honor HEAP_ZERO_MEMORY, and keep their contents when
+  // reallocated.
+  uint8_t* alloc = reinterpret_cast<uint8_t*>(
+      allocator.HeapAlloc(heap, HEAP_ZERO_MEMORY, 64));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), alloc);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(alloc) % 16);
+  for (size_t i = 0; i < 64; ++i)
+    EXPECT_EQ(0u, alloc[i]);
+  ::memset(alloc, 0xAB, 64);
+  uint8_t* realloc = reinterpret_cast<uint8_t*>(
+      allocator.HeapReAlloc(heap, 0, alloc, 10000));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), realloc);
+  for (size_t i = 0; i < 64; ++i)
+    EXPECT_EQ(0xABu, realloc[i]);
+
+  // Destroying the heap releases the allocations left in it.
+  EXPECT_TRUE(allocator.HeapDestroy(heap));
+}
+
+TEST(HeapAllocatorsTest, CreateHeapAllocator) {
+  EXPECT_TRUE(CreateHeapAllocator("system").get());
+  EXPECT_TRUE(CreateHeapAllocator("null").get());
+  EXPECT_TRUE(CreateHeapAllocator("size-class").get());
+  EXPECT_FALSE(CreateHeapAllocator("no_such_runtime.dll").get());
+
+  // A module that doesn't export the heap functions isn't a runtime.
+  EXPECT_FALSE(CreateHeapAllocator("kernel32.dll").get());
+}
+
+TEST(HeapAllocatorsTest, BindHeapAllocator) {
+  NullHeapAllocator allocator;
+  HeapBackdrop backdrop;
+  BindHeapAllocator(&allocator, &backdrop);
+
+  HANDLE heap = backdrop.HeapCreate(0, 0, 0);
+  LPVOID alloc = backdrop.HeapAlloc(heap, 0, 42);
+  EXPECT_EQ(42u, allocator.HeapSize(heap, 0, alloc));
+  EXPECT_EQ(42u, backdrop.HeapSize(heap, 0, alloc));
+  EXPECT_TRUE(backdrop.HeapFree(heap, 0, alloc));
+  EXPECT_TRUE(backdrop.HeapDestroy(heap));
+}
+
+}  // namespace backdrops
+}  // namespace bard
@@ -71,6 +71,7 @@ void HeapBackdrop::UpdateStats(EventType type, uint64_t time) {
   auto stats = total_stats_.insert(std::make_pair(type, struct Stats())).first;
   stats->second.calls++;
   stats->second.time += time;
+  stats->second.latencies.Add(time);
 }
 
 bool HeapBackdrop::TearDown() {
@@ -25,6 +25,7 @@
 #include "base/callback.h"
 #include "base/synchronization/lock.h"
 #include "syzygy/bard/event.h"
+#include "syzygy/bard/latency_histogram.h"
 #include "syzygy/bard/trace_live_map.h"
 
 namespace bard {
@@ -54,11 +55,12 @@ class HeapBackdrop {
   // @}
 
   // The following struct holds the statistics generated by a specific
-  // function call: the sum of the time it takes to run and the number
-  // of times it was called.
+  // function call: the sum of the time it takes to run, the number
+  // of times it was called and the distribution of the times of the calls.
   struct Stats {
     uint64_t time;
     uint64_t calls;
+    LatencyHistogram latencies;
   };
   using StatsMap = std::map<EventType, Stats>;
 
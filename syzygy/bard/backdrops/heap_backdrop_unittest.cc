@@ -51,6 +51,12 @@ TEST(HeapBackdropTest, StatsTest) {
   backdrop.UpdateStats(kFuncType2, 72);
   EXPECT_EQ(3, func2->second.calls);
   EXPECT_EQ(166 + 72, func2->second.time);
+
+  // Each call is also recorded in the latency histogram.
+  EXPECT_EQ(4u, func1->second.latencies.count());
+  EXPECT_EQ(100u, func1->second.latencies.max());
+  EXPECT_EQ(3u, func2->second.latencies.count());
+  EXPECT_EQ(166u, func2->second.latencies.max());
 }
 
 TEST(HeapBackdropTest, SetProcessHeap) {
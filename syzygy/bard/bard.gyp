@@ -23,12 +23,16 @@
       'sources': [
         'event.cc',
         'event.h',
+        'latency_histogram.cc',
+        'latency_histogram.h',
         'raw_argument_converter.cc',
         'raw_argument_converter.h',
         'story.cc',
         'story.h',
         'trace_live_map.h',
         'trace_live_map_impl.h',
+        'backdrops/heap_allocators.cc',
+        'backdrops/heap_allocators.h',
         'backdrops/heap_backdrop.cc',
         'backdrops/heap_backdrop.h',
         'events/heap_alloc_event.cc',
@@ -54,9 +58,25 @@
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/syzygy/agent/asan/asan.gyp:syzyasan_rtl',
+        '<(src)/syzygy/agent/asan/asan.gyp:syzyasan_rtl_lib',
         '<(src)/syzygy/core/core.gyp:core_lib',
       ],
     },
+    {
+      'target_name': 'bard_story_benchmark',
+      'type': 'executable',
+      'sources': [
+        'story_benchmark.cc',
+      ],
+      'dependencies': [
+        'bard_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+      ],
+      'libraries': [
+        'psapi.lib',
+      ],
+    },
     {
       'target_name': 'bard_unittest_utils',
       'type': 'static_library',
@@ -74,9 +94,11 @@
       'type': 'executable',
       'sources': [
         'event_unittest.cc',
+        'latency_histogram_unittest.cc',
         'raw_argument_converter_unittest.cc',
         'story_unittest.cc',
         'trace_live_map_unittest.cc',
+        'backdrops/heap_allocators_unittest.cc',
         'backdrops/heap_backdrop_unittest.cc',
         'events/heap_alloc_event_unittest.cc',
         'events/heap_create_event_unittest.cc',
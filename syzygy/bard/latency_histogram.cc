@@ -0,0 +1,100 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/latency_histogram.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "base/logging.h"
+
+namespace bard {
+
+namespace {
+
+// @returns the index of the most significant bit set in @p value, which is
+//     not zero.
+size_t GetMostSignificantBit(uint64_t value) {
+  DCHECK_NE(0u, value);
+  size_t bit = 0;
+  while (value >>= 1)
+    ++bit;
+  return bit;
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : count_(0), max_(0) {
+  ::memset(counts_, 0, sizeof(counts_));
+}
+
+void LatencyHistogram::Add(uint64_t latency) {
+  ++counts_[GetBucket(latency)];
+  ++count_;
+  max_ = std::max(max_, latency);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kBucketCount; ++i)
+    counts_[i] += other.counts_[i];
+  count_ += other.count_;
+  max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+  DCHECK_LE(0.0, percentile);
+  DCHECK_GE(100.0, percentile);
+
+  if (count_ == 0)
+    return 0;
+
+  // The rank of the latency sought, counting from one.
+  uint64_t rank = static_cast<uint64_t>(
+      std::ceil(percentile / 100.0 * static_cast<double>(count_)));
+  rank = std::min(std::max<uint64_t>(rank, 1), count_);
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    seen += counts_[i];
+    if (seen >= rank)
+      return std::min(GetBucketUpperBound(i), max_);
+  }
+
+  NOTREACHED();
+  return max_;
+}
+
+size_t LatencyHistogram::GetBucket(uint64_t latency) {
+  if (latency < kSubBuckets)
+    return static_cast<size_t>(latency);
+
+  size_t shift = GetMostSignificantBit(latency) - kSubBucketBits;
+  size_t sub_bucket = static_cast<size_t>(latency >> shift) & (kSubBuckets - 1);
+  return ((shift + 1) << kSubBucketBits) + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+  DCHECK_GT(kBucketCount, bucket);
+  if (bucket < kSubBuckets)
+    return bucket;
+
+  size_t shift = (bucket >> kSubBucketBits) - 1;
+  uint64_t sub_bucket = bucket & (kSubBuckets - 1);
+  uint64_t lower_bound = (kSubBuckets + sub_bucket) << shift;
+  return lower_bound + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+}  // namespace bard
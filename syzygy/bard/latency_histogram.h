@@ -0,0 +1,80 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares LatencyHistogram, a fixed size histogram of event latencies from
+// which percentiles are estimated. The buckets are log-linear: each power of
+// two range is split in kSubBuckets equal buckets, so that an estimate is
+// within 1 / kSubBuckets of the actual value whatever its magnitude.
+
+#ifndef SYZYGY_BARD_LATENCY_HISTOGRAM_H_
+#define SYZYGY_BARD_LATENCY_HISTOGRAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace bard {
+
+// A histogram of latencies, each of which is a number of cycles.
+class LatencyHistogram {
+ public:
+  // The number of bits of a latency that select its bucket within its power
+  // of two range.
+  static const size_t kSubBucketBits = 3;
+  static const size_t kSubBuckets = 1 << kSubBucketBits;
+
+  // The number of buckets. The latencies below kSubBuckets each have their
+  // own bucket, followed by kSubBuckets buckets for each power of two above.
+  static const size_t kBucketCount =
+      (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+  LatencyHistogram();
+
+  // Adds a latency to this histogram.
+  // @param latency the latency to add.
+  void Add(uint64_t latency);
+
+  // Adds the latencies of another histogram to this one.
+  // @param other the histogram to merge in.
+  void Merge(const LatencyHistogram& other);
+
+  // Estimates a percentile of the latencies.
+  // @param percentile the percentile, between 0 and 100.
+  // @returns the upper bound of the bucket holding the latency below which
+  //     lie @p percentile percent of the latencies, or zero if the histogram
+  //     is empty.
+  uint64_t GetPercentile(double percentile) const;
+
+  // @name Accessors.
+  // @{
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  // @}
+
+  // @param latency a latency.
+  // @returns the index of the bucket holding @p latency.
+  static size_t GetBucket(uint64_t latency);
+
+  // @param bucket the index of a bucket.
+  // @returns the largest latency held by @p bucket.
+  static uint64_t GetBucketUpperBound(size_t bucket);
+
+ private:
+  uint64_t counts_[kBucketCount];
+  uint64_t count_;
+  uint64_t max_;
+};
+
+}  // namespace bard
+
+#endif  // SYZYGY_BARD_LATENCY_HISTOGRAM_H_
@@ -0,0 +1,83 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/latency_histogram.h"
+
+#include "gtest/gtest.h"
+
+namespace bard {
+
+TEST(LatencyHistogramTest, Buckets) {
+  // Small latencies have their own buckets.
+  for (uint64_t i = 0; i < LatencyHistogram::kSubBuckets; ++i) {
+    EXPECT_EQ(i, LatencyHistogram::GetBucket(i));
+    EXPECT_EQ(i, LatencyHistogram::GetBucketUpperBound(i));
+  }
+
+  // The buckets are contiguous, and each holds the latencies up to its upper
+  // bound.
+  for (size_t i = 1; i < LatencyHistogram::kBucketCount; ++i) {
+    uint64_t lower_bound = LatencyHistogram::GetBucketUpperBound(i - 1) + 1;
+    uint64_t upper_bound = LatencyHistogram::GetBucketUpperBound(i);
+    EXPECT_LE(lower_bound, upper_bound);
+    EXPECT_EQ(i, LatencyHistogram::GetBucket(lower_bound));
+    EXPECT_EQ(i, LatencyHistogram::GetBucket(upper_bound));
+  }
+
+  const uint64_t kMaxLatency = ~static_cast<uint64_t>(0);
+  EXPECT_EQ(LatencyHistogram::kBucketCount - 1,
+            LatencyHistogram::GetBucket(kMaxLatency));
+  EXPECT_EQ(kMaxLatency, LatencyHistogram::GetBucketUpperBound(
+                             LatencyHistogram::kBucketCount - 1));
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(0u, histogram.GetPercentile(50));
+
+  for (uint64_t i = 1; i <= 100; ++i)
+    histogram.Add(i);
+  EXPECT_EQ(100u, histogram.count());
+  EXPECT_EQ(100u, histogram.max());
+
+  // The estimates are the upper bounds of the buckets, 48..51 and 96..103.
+  EXPECT_EQ(1u, histogram.GetPercentile(0));
+  EXPECT_EQ(51u, histogram.GetPercentile(50));
+  EXPECT_EQ(100u, histogram.GetPercentile(99));
+  EXPECT_EQ(100u, histogram.GetPercentile(100));
+
+  // A single slow event shows in the tail only, and the 99th percentile is
+  // no longer clamped by the maximum.
+  histogram.Add(100000);
+  EXPECT_EQ(51u, histogram.GetPercentile(50));
+  EXPECT_EQ(103u, histogram.GetPercentile(99));
+  EXPECT_EQ(100000u, histogram.GetPercentile(100));
+}
+
+TEST(LatencyHistogramTest, Merge) {
+  LatencyHistogram histogram1;
+  LatencyHistogram histogram2;
+  histogram1.Add(3);
+  histogram2.Add(5);
+  histogram2.Add(1000);
+
+  histogram1.Merge(histogram2);
+  EXPECT_EQ(3u, histogram1.count());
+  EXPECT_EQ(1000u, histogram1.max());
+  EXPECT_EQ(5u, histogram1.GetPercentile(50));
+  EXPECT_EQ(1000u, histogram1.GetPercentile(100));
+}
+
+}  // namespace bard
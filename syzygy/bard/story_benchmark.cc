@@ -0,0 +1,380 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A benchmark of heap implementations against the allocation traces of real
+// processes, as written by the MemReplayGrinder. Each of the stories of the
+// file is played back as fast as possible, a thread per plot line, against a
+// HeapBackdrop bound to each of the heaps being compared. Prints the
+// throughput of the playback, the peak working set of the process and the
+// distribution of the latencies of each heap function.
+
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/command_line.h"
+#include "base/logging.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+#include "syzygy/bard/story.h"
+#include "syzygy/bard/backdrops/heap_allocators.h"
+#include "syzygy/bard/backdrops/heap_backdrop.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
+
+namespace {
+
+using bard::EventInterface;
+using bard::LatencyHistogram;
+using bard::Story;
+using bard::backdrops::HeapAllocatorInterface;
+using bard::backdrops::HeapBackdrop;
+
+const char kUsage[] =
+    "Usage: bard_story_benchmark [options] STORY_FILE\n"
+    "\n"
+    "Plays back the stories of STORY_FILE, as written by the mem_replay\n"
+    "grinder, against each of the given heap implementations.\n"
+    "\n"
+    "Options:\n"
+    "  --heaps=HEAP,...     The heaps to benchmark, where HEAP is one of\n"
+    "                         system: the Windows heap.\n"
+    "                         null: no memory at all, as a baseline of the\n"
+    "                           cost of the playback.\n"
+    "                         size-class: the SyzyASan size class heap.\n"
+    "                         block-heap-manager: the SyzyASan heap manager,\n"
+    "                           configured by SYZYGY_ASAN_OPTIONS.\n"
+    "                         the path of a runtime exporting the asan_Heap*\n"
+    "                           functions, such as syzyasan_rtl.dll.\n"
+    "                       (default system)\n"
+    "  --iterations=N       The number of times each heap plays back the\n"
+    "                       stories (default 1).\n"
+    "\n";
+
+// The period at which the working set is sampled during playback.
+const int kWorkingSetSamplingPeriodMs = 10;
+
+// The story of a process, along with the heaps that existed when it started.
+struct ProcessStory {
+  std::vector<uintptr_t> existing_heaps;
+  Story story;
+};
+
+using ProcessStories = std::vector<std::unique_ptr<ProcessStory>>;
+
+// Samples the working set of this process while a heap plays back its
+// stories, to report their peak. The peak maintained by the system can't be
+// reset, so it would hide the peaks of all but the first heap.
+class WorkingSetSampler : public base::PlatformThread::Delegate {
+ public:
+  WorkingSetSampler() : stop_(true, false), peak_working_set_(0) {}
+  ~WorkingSetSampler() override {}
+
+  // Starts and stops the sampling.
+  void Start() {
+    stop_.Reset();
+    peak_working_set_ = 0;
+    CHECK(base::PlatformThread::Create(0, this, &handle_));
+  }
+  void Stop() {
+    stop_.Signal();
+    base::PlatformThread::Join(handle_);
+  }
+
+  // @returns the peak working set since the sampling started, in bytes.
+  size_t peak_working_set() const { return peak_working_set_; }
+
+  // Implementation of PlatformThread::Delegate.
+  void ThreadMain() override {
+    base::TimeDelta period =
+        base::TimeDelta::FromMilliseconds(kWorkingSetSamplingPeriodMs);
+    do {
+      Sample();
+    } while (!stop_.TimedWait(period));
+    Sample();
+  }
+
+ private:
+  void Sample() {
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                               sizeof(counters))) {
+      peak_working_set_ = std::max(peak_working_set_,
+                                   counters.WorkingSetSize);
+    }
+  }
+
+  base::WaitableEvent stop_;
+  base::PlatformThreadHandle handle_;
+  size_t peak_working_set_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetSampler);
+};
+
+// @returns the name of the heap function played by events of type @p type.
+const char* GetEventName(EventInterface::EventType type) {
+  switch (type) {
+    case EventInterface::kHeapAllocEvent:
+      return "HeapAlloc";
+    case EventInterface::kHeapCreateEvent:
+      return "HeapCreate";
+    case EventInterface::kHeapDestroyEvent:
+      return "HeapDestroy";
+    case EventInterface::kHeapFreeEvent:
+      return "HeapFree";
+    case EventInterface::kHeapReAllocEvent:
+      return "HeapReAlloc";
+    case EventInterface::kHeapSetInformationEvent:
+      return "HeapSetInformation";
+    case EventInterface::kHeapSizeEvent:
+      return "HeapSize";
+    default:
+      return "Unknown";
+  }
+}
+
+// Loads the stories of a file written by the MemReplayGrinder. This is done
+// anew for each playback, as the linked events stay signaled once played.
+// @param path the path of the file.
+// @param stories receives the stories.
+// @returns true on success, false otherwise.
+bool LoadStories(const base::FilePath& path, ProcessStories* stories) {
+  DCHECK_NE(static_cast<ProcessStories*>(nullptr), stories);
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (!file.get()) {
+    LOG(ERROR) << "Failed to open \"" << path.value() << "\".";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::ZInStream zin_stream(&in_stream);
+  core::NativeBinaryInArchive in_archive(&zin_stream);
+  if (!zin_stream.Init())
+    return false;
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  if (!in_archive.Load(&magic) || !in_archive.Load(&version) ||
+      magic != Story::kBardMagic || version != Story::kBardVersion) {
+    LOG(ERROR) << "\"" << path.value() << "\" is not a story file.";
+    return false;
+  }
+
+  size_t story_count = 0;
+  if (!in_archive.Load(&story_count))
+    return false;
+  stories->clear();
+  for (size_t i = 0; i < story_count; ++i) {
+    std::unique_ptr<ProcessStory> story(new ProcessStory());
+    size_t heap_count = 0;
+    if (!in_archive.Load(&heap_count))
+      return false;
+    story->existing_heaps.resize(heap_count);
+    for (size_t j = 0; j < heap_count; ++j) {
+      if (!in_archive.Load(&story->existing_heaps[j]))
+        return false;
+    }
+    if (!story->story.Load(&in_archive)) {
+      LOG(ERROR) << "Failed to load story " << i << ".";
+      return false;
+    }
+    stories->push_back(std::move(story));
+  }
+
+  return true;
+}
+
+// Plays back a story against a heap.
+// @param allocator the heap to play back against.
+// @param story the story to play back.
+// @param stats the statistics of the calls, updated with those of the story.
+// @returns true on success, false otherwise.
+bool PlayStory(HeapAllocatorInterface* allocator,
+               ProcessStory* story,
+               HeapBackdrop::StatsMap* stats) {
+  DCHECK_NE(static_cast<HeapAllocatorInterface*>(nullptr), allocator);
+  DCHECK_NE(static_cast<ProcessStory*>(nullptr), story);
+  DCHECK_NE(static_cast<HeapBackdrop::StatsMap*>(nullptr), stats);
+
+  HeapBackdrop backdrop;
+  bard::backdrops::BindHeapAllocator(allocator, &backdrop);
+
+  // The heaps that existed at startup, including the process heap, are
+  // played back as heaps of the implementation being benchmarked, so that
+  // all of the allocations go to it. TearDown destroys them along with the
+  // heaps created by the story.
+  for (uintptr_t trace_heap : story->existing_heaps) {
+    HANDLE live_heap = backdrop.HeapCreate(0, 0, 0);
+    if (live_heap == nullptr ||
+        !backdrop.heap_map().AddMapping(reinterpret_cast<HANDLE>(trace_heap),
+                                        live_heap)) {
+      LOG(ERROR) << "Failed to set up the existing heaps.";
+      return false;
+    }
+  }
+
+  bool success = story->story.Play(&backdrop);
+  if (!success)
+    LOG(ERROR) << "The playback of a story failed.";
+  if (!backdrop.TearDown())
+    success = false;
+
+  for (const auto& type_stats : backdrop.total_stats()) {
+    HeapBackdrop::Stats& total =
+        stats->insert(std::make_pair(type_stats.first, HeapBackdrop::Stats()))
+            .first->second;
+    total.time += type_stats.second.time;
+    total.calls += type_stats.second.calls;
+    total.latencies.Merge(type_stats.second.latencies);
+  }
+
+  return success;
+}
+
+// Benchmarks a heap and prints its results.
+// @param name the name of the heap to benchmark.
+// @param path the path of the story file.
+// @param iterations the number of times to play back the stories.
+// @returns true on success, false otherwise.
+bool RunHeapBenchmark(const std::string& name,
+                      const base::FilePath& path,
+                      size_t iterations) {
+  std::unique_ptr<HeapAllocatorInterface> allocator(
+      bard::backdrops::CreateHeapAllocator(name));
+  if (!allocator.get())
+    return false;
+
+  HeapBackdrop::StatsMap stats;
+  base::TimeDelta elapsed;
+  size_t peak_working_set = 0;
+
+  for (size_t i = 0; i < iterations; ++i) {
+    ProcessStories stories;
+    if (!LoadStories(path, &stories))
+      return false;
+
+    WorkingSetSampler sampler;
+    sampler.Start();
+    base::TimeTicks start = base::TimeTicks::Now();
+    bool success = true;
+    for (auto& story : stories) {
+      if (!PlayStory(allocator.get(), story.get(), &stats)) {
+        success = false;
+        break;
+      }
+    }
+    elapsed += base::TimeTicks::Now() - start;
+    sampler.Stop();
+    if (!success)
+      return false;
+    peak_working_set = std::max(peak_working_set, sampler.peak_working_set());
+  }
+
+  LatencyHistogram all_latencies;
+  uint64_t event_count = 0;
+  for (const auto& type_stats : stats) {
+    all_latencies.Merge(type_stats.second.latencies);
+    event_count += type_stats.second.calls;
+  }
+
+  double seconds = elapsed.InSecondsF();
+  ::printf("Heap: %s\n", name.c_str());
+  ::printf("  Events: %llu in %.3f s, %.0f events/s\n", event_count, seconds,
+           seconds > 0 ? event_count / seconds : 0.0);
+  ::printf("  Peak working set: %llu KB\n",
+           static_cast<uint64_t>(peak_working_set / 1024));
+  ::printf("  %-20s %12s %12s %12s %12s\n", "Function (cycles)", "Calls",
+           "p50", "p99", "Max");
+  for (const auto& type_stats : stats) {
+    const LatencyHistogram& latencies = type_stats.second.latencies;
+    ::printf("  %-20s %12llu %12llu %12llu %12llu\n",
+             GetEventName(type_stats.first), type_stats.second.calls,
+             latencies.GetPercentile(50), latencies.GetPercentile(99),
+             latencies.max());
+  }
+  ::printf("  %-20s %12llu %12llu %12llu %12llu\n", "All", event_count,
+           all_latencies.GetPercentile(50), all_latencies.GetPercentile(99),
+           all_latencies.max());
+
+  return true;
+}
+
+bool RunBenchmark(const base::CommandLine* cmd_line) {
+  DCHECK_NE(static_cast<const base::CommandLine*>(nullptr), cmd_line);
+
+  if (cmd_line->GetArgs().size() != 1) {
+    ::fprintf(stderr, "%s", kUsage);
+    return false;
+  }
+  base::FilePath path(cmd_line->GetArgs()[0]);
+
+  size_t iterations = 1;
+  std::string iterations_str(cmd_line->GetSwitchValueASCII("iterations"));
+  if (!iterations_str.empty() &&
+      (!base::StringToSizeT(iterations_str, &iterations) || iterations == 0)) {
+    LOG(ERROR) << "Invalid --iterations value: " << iterations_str;
+    return false;
+  }
+
+  std::string heaps_str(cmd_line->GetSwitchValueASCII("heaps"));
+  if (heaps_str.empty())
+    heaps_str = "system";
+  // The heaps are set up one at a time, as the SyzyASan runtime can only be
+  // set up once at a time in a process.
+  for (const std::string& name :
+       base::SplitString(heaps_str, ",", base::TRIM_WHITESPACE,
+                         base::SPLIT_WANT_NONEMPTY)) {
+    if (!RunHeapBenchmark(name, path, iterations))
+      return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit_manager;
+  base::CommandLine::Init(argc, argv);
+
+  logging::LoggingSettings settings;
+  settings.logging_dest = logging::LOG_TO_SYSTEM_DEBUG_LOG;
+  settings.lock_log = logging::DONT_LOCK_LOG_FILE;
+  settings.delete_old = logging::APPEND_TO_OLD_LOG_FILE;
+  if (!logging::InitLogging(settings))
+    return 1;
+
+  base::CommandLine* cmd_line = base::CommandLine::ForCurrentProcess();
+  CHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    ::fprintf(stderr, "%s", kUsage);
+    return 1;
+  }
+
+  return RunBenchmark(cmd_line) ? 0 : 1;
+}
@@ -17,9 +17,12 @@
 #ifndef SYZYGY_BARD_TRACE_LIVE_MAP_H_
 #define SYZYGY_BARD_TRACE_LIVE_MAP_H_
 
+#include <windows.h>
+
 #include <map>
+#include <unordered_map>
 
-#include "base/synchronization/lock.h"
+#include "base/macros.h"
 
 namespace bard {
 
@@ -27,12 +30,20 @@ namespace bard {
 // from trace file pointers to live pointers, since the addresses for the
 // live ones are not the same.
 // This class is thread safe for simultaneous access accross multiple threads.
-// @tparam T The type of object that the class is mapping.
+// Each direction of the map is split in shards by the hash of the keys, each
+// shard with its own lock, so that the plot lines of a playback rarely wait
+// on each other. Lookups only take the lock of their shard shared, as every
+// event of a heap looks up the same handle.
+// @tparam T The type of object that the class is mapping, which is a pointer.
 template <typename T>
 class TraceLiveMap {
  public:
   using Map = std::map<T, T>;
 
+  TraceLiveMap() {}
+
+  // Adds a mapping. The two directions are added one after the other, so a
+  // concurrent lookup may find one before the other.
   bool AddMapping(T trace, T live);
   bool RemoveMapping(T trace, T live);
 
@@ -43,19 +54,41 @@ class TraceLiveMap {
   void Clear();
 
   // @returns true iff this map is empty.
-  bool Empty() const { return trace_live_.empty() && live_trace_.empty(); }
+  bool Empty() const;
 
-  // @name Simple accessors.
+  // @name Snapshots of the mappings.
   // @{
-  const Map& trace_live() const { return trace_live_; }
-  const Map& live_trace() const { return live_trace_; }
+  Map trace_live() const { return ToMap(trace_live_); }
+  Map live_trace() const { return ToMap(live_trace_); }
   // @}
 
  private:
-  Map trace_live_;
-  Map live_trace_;
+  // The number of shards of each direction of the map.
+  static const size_t kShardCount = 64;
+
+  // A shard of one direction of the map.
+  struct Shard {
+    Shard() { ::InitializeSRWLock(&lock); }
+
+    mutable SRWLOCK lock;
+    std::unordered_map<T, T> map;
+  };
+
+  // @returns the shard holding @p key among @p shards.
+  static Shard* GetShard(T key, Shard* shards);
+
+  // @name Accesses to a shard, under its lock.
+  // @{
+  static bool Insert(T key, T value, Shard* shards);
+  static bool Find(T key, Shard* shards, T* value);
+  static void Erase(T key, Shard* shards);
+  static Map ToMap(const Shard* shards);
+  // @}
+
+  Shard trace_live_[kShardCount];
+  Shard live_trace_[kShardCount];
 
-  base::Lock lock_;
+  DISALLOW_COPY_AND_ASSIGN(TraceLiveMap);
 };
 
 }  // namespace bard
@@ -25,20 +25,14 @@ bool TraceLiveMap<T>::AddMapping(T trace, T live) {
   if (trace == nullptr && live == nullptr)
     return true;
 
-  base::AutoLock auto_lock(lock_);
-
-  auto insert_trace_live = trace_live_.insert(std::make_pair(trace, live));
-
-  if (!insert_trace_live.second) {
+  if (!Insert(trace, live, trace_live_)) {
     LOG(ERROR) << "Trace argument was previously added: " << trace;
     return false;
   }
 
-  auto insert_live_trace = live_trace_.insert(std::make_pair(live, trace));
-
-  if (!insert_live_trace.second) {
+  if (!Insert(live, trace, live_trace_)) {
     LOG(ERROR) << "Live argument was previously added: " << live;
-    trace_live_.erase(insert_trace_live.first);
+    Erase(trace, trace_live_);
     return false;
   }
 
@@ -51,23 +45,19 @@ bool TraceLiveMap<T>::RemoveMapping(T trace, T live) {
   if (trace == nullptr && live == nullptr)
     return true;
 
-  base::AutoLock auto_lock(lock_);
-
-  auto find_trace_live = trace_live_.find(trace);
-  auto find_live_trace = live_trace_.find(live);
-
-  if (find_trace_live == trace_live_.end()) {
+  T found = nullptr;
+  if (!Find(trace, trace_live_, &found)) {
     LOG(ERROR) << "Trace was not previously added:" << trace;
     return false;
   }
 
-  if (find_live_trace == live_trace_.end()) {
+  if (!Find(live, live_trace_, &found)) {
     LOG(ERROR) << "Live was not previously added: " << live;
     return false;
   }
 
-  trace_live_.erase(find_trace_live);
-  live_trace_.erase(find_live_trace);
+  Erase(trace, trace_live_);
+  Erase(live, live_trace_);
   return true;
 }
 
@@ -79,15 +69,11 @@ bool TraceLiveMap<T>::GetLiveFromTrace(T trace, T* live) {
     return true;
   }
 
-  base::AutoLock auto_lock(lock_);
-
-  auto live_it = trace_live_.find(trace);
-  if (live_it == trace_live_.end()) {
+  if (!Find(trace, trace_live_, live)) {
     LOG(ERROR) << "Trace argument was not previously added: " << trace;
     return false;
   }
 
-  *live = live_it->second;
   return true;
 }
 
@@ -99,22 +85,80 @@ bool TraceLiveMap<T>::GetTraceFromLive(T live, T* trace) {
     return true;
   }
 
-  base::AutoLock auto_lock(lock_);
-
-  auto trace_it = live_trace_.find(live);
-  if (trace_it == live_trace_.end()) {
+  if (!Find(live, live_trace_, trace)) {
     LOG(ERROR) << "Live argument was not previously added: " << live;
     return false;
   }
 
-  *trace = trace_it->second;
   return true;
 }
 
 template <typename T>
 void TraceLiveMap<T>::Clear() {
-  trace_live_.clear();
-  live_trace_.clear();
+  for (size_t i = 0; i < kShardCount; ++i) {
+    trace_live_[i].map.clear();
+    live_trace_[i].map.clear();
+  }
+}
+
+template <typename T>
+bool TraceLiveMap<T>::Empty() const {
+  for (size_t i = 0; i < kShardCount; ++i) {
+    if (!trace_live_[i].map.empty() || !live_trace_[i].map.empty())
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+typename TraceLiveMap<T>::Shard* TraceLiveMap<T>::GetShard(T key,
+                                                           Shard* shards) {
+  // The low bits of allocations are mostly alignment, and heaps are even more
+  // aligned, so the higher bits are folded in.
+  uintptr_t value = reinterpret_cast<uintptr_t>(key);
+  value = (value >> 4) ^ (value >> 12) ^ (value >> 20);
+  return &shards[value % kShardCount];
+}
+
+template <typename T>
+bool TraceLiveMap<T>::Insert(T key, T value, Shard* shards) {
+  Shard* shard = GetShard(key, shards);
+  ::AcquireSRWLockExclusive(&shard->lock);
+  bool inserted = shard->map.insert(std::make_pair(key, value)).second;
+  ::ReleaseSRWLockExclusive(&shard->lock);
+  return inserted;
+}
+
+template <typename T>
+bool TraceLiveMap<T>::Find(T key, Shard* shards, T* value) {
+  DCHECK_NE(static_cast<T*>(nullptr), value);
+  Shard* shard = GetShard(key, shards);
+  ::AcquireSRWLockShared(&shard->lock);
+  auto it = shard->map.find(key);
+  bool found = it != shard->map.end();
+  if (found)
+    *value = it->second;
+  ::ReleaseSRWLockShared(&shard->lock);
+  return found;
+}
+
+template <typename T>
+void TraceLiveMap<T>::Erase(T key, Shard* shards) {
+  Shard* shard = GetShard(key, shards);
+  ::AcquireSRWLockExclusive(&shard->lock);
+  shard->map.erase(key);
+  ::ReleaseSRWLockExclusive(&shard->lock);
+}
+
+template <typename T>
+typename TraceLiveMap<T>::Map TraceLiveMap<T>::ToMap(const Shard* shards) {
+  Map map;
+  for (size_t i = 0; i < kShardCount; ++i) {
+    ::AcquireSRWLockShared(&shards[i].lock);
+    map.insert(shards[i].map.begin(), shards[i].map.end());
+    ::ReleaseSRWLockShared(&shards[i].lock);
+  }
+  return map;
 }
 
 }  // namespace bard
@@ -14,11 +14,68 @@
 
 #include "syzygy/bard/trace_live_map.h"
 
+#include <memory>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 #include "syzygy/bard/unittest_util.h"
 
 namespace bard {
 
+namespace {
+
+// Adds, looks up and removes mappings of its own, along with looking up a
+// mapping shared by all the threads.
+class MappingDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kMappingCount = 1000;
+
+  MappingDelegate(TraceLiveMap<void*>* trace_live_map, uintptr_t id)
+      : trace_live_map_(trace_live_map), id_(id), failed_(false) {}
+
+  void Run() override {
+    for (size_t i = 0; i < kMappingCount; ++i) {
+      void* trace = GetTrace(i);
+      void* live = GetLive(i);
+      void* answer = nullptr;
+      if (!trace_live_map_->AddMapping(trace, live) ||
+          !trace_live_map_->GetLiveFromTrace(trace, &answer) ||
+          answer != live ||
+          !trace_live_map_->GetTraceFromLive(kSharedLive, &answer) ||
+          answer != kSharedTrace) {
+        failed_ = true;
+      }
+    }
+    for (size_t i = 0; i < kMappingCount; ++i) {
+      if (!trace_live_map_->RemoveMapping(GetTrace(i), GetLive(i)))
+        failed_ = true;
+    }
+  }
+
+  bool failed() const { return failed_; }
+
+  static void* const kSharedTrace;
+  static void* const kSharedLive;
+
+ private:
+  void* GetTrace(size_t i) const {
+    return reinterpret_cast<void*>(((id_ << 20) | i) << 4);
+  }
+  void* GetLive(size_t i) const {
+    return reinterpret_cast<void*>(((id_ << 20) | i) << 3 | 1);
+  }
+
+  TraceLiveMap<void*>* trace_live_map_;
+  uintptr_t id_;
+  bool failed_;
+};
+
+void* const MappingDelegate::kSharedTrace = reinterpret_cast<void*>(0x10000);
+void* const MappingDelegate::kSharedLive = reinterpret_cast<void*>(0x20000);
+
+}  // namespace
+
 TEST(TraceLiveMapTest, TestMapping) {
   TraceLiveMap<void*> trace_live_map;
   EXPECT_TRUE(trace_live_map.Empty());
@@ -45,4 +102,33 @@ TEST(TraceLiveMapTest, TestMapping) {
   testing::CheckTraceLiveMapNotContain(trace_live_map, trace, live);
 }
 
+TEST(TraceLiveMapTest, ConcurrentMappings) {
+  const size_t kThreadCount = 8;
+  TraceLiveMap<void*> trace_live_map;
+  EXPECT_TRUE(trace_live_map.AddMapping(MappingDelegate::kSharedTrace,
+                                        MappingDelegate::kSharedLive));
+
+  std::vector<std::unique_ptr<MappingDelegate>> delegates;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    delegates.push_back(std::unique_ptr<MappingDelegate>(
+        new MappingDelegate(&trace_live_map, i + 1)));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(delegates.back().get(), "Mapping")));
+  }
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  for (const auto& delegate : delegates)
+    EXPECT_FALSE(delegate->failed());
+
+  // Only the shared mapping is left.
+  TraceLiveMap<void*>::Map trace_live = trace_live_map.trace_live();
+  ASSERT_EQ(1u, trace_live.size());
+  EXPECT_EQ(MappingDelegate::kSharedLive, trace_live.begin()->second);
+  EXPECT_EQ(1u, trace_live_map.live_trace().size());
+}
+
 }  // namespace bard
@@ -62,10 +62,12 @@
 
 #include "syzygy/block_graph/analysis/control_flow_analysis.h"
 
+#include <algorithm>
 #include <list>
 #include <set>
 #include <sstream>
 #include <stack>
+#include <utility>
 
 namespace block_graph {
 namespace analysis {
@@ -75,6 +77,7 @@ typedef block_graph::analysis::ControlFlowAnalysis::StructuralNode
     StructuralNode;
 typedef block_graph::BasicBlockSubGraph::BasicBlock BasicBlock;
 typedef block_graph::BasicBlockSubGraph::BasicCodeBlock BasicCodeBlock;
+typedef block_graph::BasicBlockSubGraph::BasicDataBlock BasicDataBlock;
 typedef block_graph::BasicBlockSubGraph::BasicBlock::Successors Successors;
 typedef block_graph::BasicBlockSubGraph::BBCollection BBCollection;
 typedef block_graph::BasicBlockSubGraph::BlockDescriptionList
@@ -85,6 +88,58 @@ typedef std::map<const BasicCodeBlock*, StructuralTree> BasicBlocksRemap;
 typedef std::list<StructuralTree*> StructuralTreeList;
 typedef std::map<StructuralTree*, StructuralTreeList> AbstractLinks;
 
+// Denotes the absence of a node in the Lengauer-Tarjan algorithm.
+const size_t kNoNode = static_cast<size_t>(-1);
+
+// The EVAL function of the Lengauer-Tarjan algorithm, with path compression.
+// @param node The node to evaluate.
+// @param semis The semi-dominators of the nodes.
+// @param ancestors The ancestors of the nodes in the forest of the nodes
+//     processed so far, compressed by the evaluation.
+// @param labels The nodes of minimal semi-dominator on the paths to the roots
+//     of that forest, updated by the evaluation.
+// @returns the node of minimal semi-dominator on the path from @p node to
+//     the root of its tree.
+size_t EvalNode(size_t node,
+                const std::vector<size_t>& semis,
+                std::vector<size_t>* ancestors,
+                std::vector<size_t>* labels) {
+  DCHECK_NE(reinterpret_cast<std::vector<size_t>*>(NULL), ancestors);
+  DCHECK_NE(reinterpret_cast<std::vector<size_t>*>(NULL), labels);
+
+  if ((*ancestors)[node] == kNoNode)
+    return node;
+
+  // Find the path to the child of the root, then compress it from the top.
+  std::vector<size_t> path(1, node);
+  while ((*ancestors)[(*ancestors)[path.back()]] != kNoNode)
+    path.push_back((*ancestors)[path.back()]);
+  for (size_t i = path.size() - 1; i > 0; --i) {
+    size_t current = path[i - 1];
+    size_t ancestor = (*ancestors)[current];
+    if (semis[(*labels)[ancestor]] < semis[(*labels)[current]])
+      (*labels)[current] = (*labels)[ancestor];
+    (*ancestors)[current] = (*ancestors)[ancestor];
+  }
+
+  return (*labels)[node];
+}
+
+// Gets the code basic blocks that are the targets of the references of
+// @p references.
+void AddReferencedCodeBlocks(
+    const BasicBlock::BasicBlockReferenceMap& references,
+    std::set<const BasicCodeBlock*>* code_blocks) {
+  DCHECK_NE(reinterpret_cast<std::set<const BasicCodeBlock*>*>(NULL),
+            code_blocks);
+  BasicBlock::BasicBlockReferenceMap::const_iterator ref = references.begin();
+  for (; ref != references.end(); ++ref) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(ref->second.basic_block());
+    if (bb != NULL)
+      code_blocks->insert(bb);
+  }
+}
+
 void AddLink(StructuralTree* from,
              StructuralTree* to,
              AbstractLinks* forward_list,
@@ -850,5 +905,345 @@ void ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(
   }
 }
 
+// The analyses cached on a subgraph.
+class ControlFlowAnalysis::CachedAnalysis
+    : public BasicBlockSubGraph::CachedAnalysis {
+ public:
+  explicit CachedAnalysis(const BasicBlockSubGraph* subgraph)
+      : dominators(subgraph), loops(dominators) {
+  }
+
+  const DominatorTree dominators;
+  const LoopForest loops;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CachedAnalysis);
+};
+
+const size_t ControlFlowAnalysis::DominatorTree::kRootNode;
+
+const ControlFlowAnalysis::DominatorTree&
+ControlFlowAnalysis::GetDominatorTree(BasicBlockSubGraph* subgraph) {
+  return GetCachedAnalysis(subgraph).dominators;
+}
+
+const ControlFlowAnalysis::LoopForest& ControlFlowAnalysis::GetLoopForest(
+    BasicBlockSubGraph* subgraph) {
+  return GetCachedAnalysis(subgraph).loops;
+}
+
+const ControlFlowAnalysis::CachedAnalysis&
+ControlFlowAnalysis::GetCachedAnalysis(BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+
+  // The cached analysis of a subgraph is only ever set here.
+  if (subgraph->cached_analysis() == NULL) {
+    subgraph->set_cached_analysis(
+        std::unique_ptr<BasicBlockSubGraph::CachedAnalysis>(
+            new CachedAnalysis(subgraph)));
+  }
+  return *static_cast<const CachedAnalysis*>(subgraph->cached_analysis());
+}
+
+ControlFlowAnalysis::DominatorTree::DominatorTree(
+    const BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<const BasicBlockSubGraph*>(NULL), subgraph);
+
+  // Find the entries of the subgraph: the first basic blocks of the blocks,
+  // the basic blocks that are referred to rather than only branched to, and
+  // those without predecessors.
+  std::set<const BasicCodeBlock*> entries;
+  const BlockDescriptionList& descriptions = subgraph->block_descriptions();
+  BlockDescriptionList::const_iterator description = descriptions.begin();
+  for (; description != descriptions.end(); ++description) {
+    if (description->basic_block_order.empty())
+      continue;
+    const BasicCodeBlock* bb =
+        BasicCodeBlock::Cast(description->basic_block_order.front());
+    if (bb != NULL)
+      entries.insert(bb);
+  }
+  std::set<const BasicCodeBlock*> has_predecessors;
+  std::vector<const BasicCodeBlock*> code_blocks;
+  const BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::const_iterator it = basic_blocks.begin();
+  for (; it != basic_blocks.end(); ++it) {
+    const BasicDataBlock* data = BasicDataBlock::Cast(*it);
+    if (data != NULL)
+      AddReferencedCodeBlocks(data->references(), &entries);
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb == NULL)
+      continue;
+    code_blocks.push_back(bb);
+    if (!bb->referrers().empty())
+      entries.insert(bb);
+    BasicBlock::Instructions::const_iterator instr =
+        bb->instructions().begin();
+    for (; instr != bb->instructions().end(); ++instr)
+      AddReferencedCodeBlocks(instr->references(), &entries);
+    Successors::const_iterator succ = bb->successors().begin();
+    for (; succ != bb->successors().end(); ++succ) {
+      const BasicCodeBlock* next =
+          BasicCodeBlock::Cast(succ->reference().basic_block());
+      if (next != NULL)
+        has_predecessors.insert(next);
+    }
+  }
+  for (size_t i = 0; i < code_blocks.size(); ++i) {
+    if (has_predecessors.find(code_blocks[i]) == has_predecessors.end())
+      entries.insert(code_blocks[i]);
+  }
+
+  // Number the nodes in depth first pre-order from the virtual root, whose
+  // children are the entries. The basic blocks that are still unvisited then
+  // are only reachable from cycles, and are treated as entries too.
+  std::vector<const BasicCodeBlock*> roots;
+  for (size_t i = 0; i < code_blocks.size(); ++i) {
+    if (entries.find(code_blocks[i]) != entries.end())
+      roots.push_back(code_blocks[i]);
+  }
+  roots.insert(roots.end(), code_blocks.begin(), code_blocks.end());
+
+  basic_blocks_.push_back(NULL);
+  std::vector<size_t> parents(1, kNoNode);
+  std::vector<std::vector<const BasicCodeBlock*>> successors(1);
+  std::vector<size_t> entry_nodes;
+  for (size_t i = 0; i < roots.size(); ++i) {
+    if (nodes_.find(roots[i]) != nodes_.end())
+      continue;
+
+    std::stack<std::pair<size_t, size_t>> working;
+    const BasicCodeBlock* bb = roots[i];
+    size_t parent = kRootNode;
+    size_t next_successor = 0;
+    while (true) {
+      if (bb != NULL) {
+        // Add a node for the basic block.
+        size_t node = basic_blocks_.size();
+        nodes_[bb] = node;
+        basic_blocks_.push_back(bb);
+        parents.push_back(parent);
+        successors.push_back(std::vector<const BasicCodeBlock*>());
+        Successors::const_iterator succ = bb->successors().begin();
+        for (; succ != bb->successors().end(); ++succ) {
+          const BasicCodeBlock* next =
+              BasicCodeBlock::Cast(succ->reference().basic_block());
+          if (next != NULL)
+            successors.back().push_back(next);
+        }
+        if (parent == kRootNode)
+          entry_nodes.push_back(node);
+        working.push(std::make_pair(node, 0));
+      }
+      if (working.empty())
+        break;
+
+      // Visit the next unvisited successor of the node on top of the stack.
+      bb = NULL;
+      parent = working.top().first;
+      next_successor = working.top().second;
+      while (next_successor < successors[parent].size()) {
+        const BasicCodeBlock* next = successors[parent][next_successor++];
+        if (nodes_.find(next) == nodes_.end()) {
+          bb = next;
+          break;
+        }
+      }
+      working.top().second = next_successor;
+      if (bb == NULL)
+        working.pop();
+    }
+  }
+
+  size_t count = basic_blocks_.size();
+  predecessors_.resize(count);
+  for (size_t node = 1; node < count; ++node) {
+    for (size_t i = 0; i < successors[node].size(); ++i)
+      predecessors_[nodes_[successors[node][i]]].push_back(node);
+  }
+  for (size_t i = 0; i < entry_nodes.size(); ++i)
+    predecessors_[entry_nodes[i]].push_back(kRootNode);
+
+  // Compute the immediate dominators. As the nodes are numbered in
+  // pre-order, a semi-dominator is the node of the same number.
+  std::vector<size_t> semis(count);
+  std::vector<size_t> labels(count);
+  std::vector<size_t> ancestors(count, kNoNode);
+  std::vector<std::vector<size_t>> buckets(count);
+  idoms_.assign(count, kRootNode);
+  for (size_t node = 0; node < count; ++node) {
+    semis[node] = node;
+    labels[node] = node;
+  }
+  for (size_t node = count - 1; node > 0; --node) {
+    const std::vector<size_t>& predecessors = predecessors_[node];
+    for (size_t i = 0; i < predecessors.size(); ++i) {
+      size_t eval = EvalNode(predecessors[i], semis, &ancestors, &labels);
+      if (semis[eval] < semis[node])
+        semis[node] = semis[eval];
+    }
+    buckets[semis[node]].push_back(node);
+
+    size_t parent = parents[node];
+    ancestors[node] = parent;
+    std::vector<size_t>& bucket = buckets[parent];
+    for (size_t i = 0; i < bucket.size(); ++i) {
+      size_t eval = EvalNode(bucket[i], semis, &ancestors, &labels);
+      idoms_[bucket[i]] = semis[eval] < semis[bucket[i]] ? eval : parent;
+    }
+    bucket.clear();
+  }
+  for (size_t node = 1; node < count; ++node) {
+    if (idoms_[node] != semis[node])
+      idoms_[node] = idoms_[idoms_[node]];
+  }
+
+  // Number the nodes in a depth first visit of the dominator tree, so that
+  // the dominance of two nodes is checked in constant time.
+  std::vector<std::vector<size_t>> children(count);
+  for (size_t node = 1; node < count; ++node)
+    children[idoms_[node]].push_back(node);
+  pre_order_.resize(count);
+  post_order_.resize(count);
+  size_t pre_order = 0;
+  size_t post_order = 0;
+  std::stack<std::pair<size_t, size_t>> working;
+  pre_order_[kRootNode] = pre_order++;
+  working.push(std::make_pair(kRootNode, 0));
+  while (!working.empty()) {
+    size_t node = working.top().first;
+    size_t next_child = working.top().second;
+    if (next_child == children[node].size()) {
+      post_order_[node] = post_order++;
+      working.pop();
+      continue;
+    }
+    ++working.top().second;
+    size_t child = children[node][next_child];
+    pre_order_[child] = pre_order++;
+    working.push(std::make_pair(child, 0));
+  }
+}
+
+const BasicCodeBlock*
+ControlFlowAnalysis::DominatorTree::GetImmediateDominator(
+    const BasicCodeBlock* bb) const {
+  size_t node = GetNode(bb);
+  if (node == kRootNode)
+    return NULL;
+  return basic_blocks_[idoms_[node]];
+}
+
+bool ControlFlowAnalysis::DominatorTree::Dominates(
+    const BasicCodeBlock* dominator,
+    const BasicCodeBlock* bb) const {
+  size_t dominator_node = GetNode(dominator);
+  size_t node = GetNode(bb);
+  if (dominator_node == kRootNode || node == kRootNode)
+    return false;
+  return NodeDominates(dominator_node, node);
+}
+
+size_t ControlFlowAnalysis::DominatorTree::GetNode(
+    const BasicCodeBlock* bb) const {
+  std::map<const BasicCodeBlock*, size_t>::const_iterator look =
+      nodes_.find(bb);
+  if (look == nodes_.end())
+    return kRootNode;
+  return look->second;
+}
+
+ControlFlowAnalysis::LoopForest::LoopForest(const DominatorTree& dominators) {
+  const size_t count = dominators.basic_blocks_.size();
+  std::vector<Loop*> innermost(count, NULL);
+
+  // The headers are visited in decreasing pre-order, so that the loops nested
+  // in a loop are found before it: the header of a loop dominates their
+  // headers, and comes before them in pre-order.
+  for (size_t header = count - 1; header > 0; --header) {
+    // The back edges to the header come from the nodes it dominates.
+    std::vector<size_t> working;
+    const std::vector<size_t>& predecessors =
+        dominators.predecessors_[header];
+    for (size_t i = 0; i < predecessors.size(); ++i) {
+      if (predecessors[i] != DominatorTree::kRootNode &&
+          dominators.NodeDominates(header, predecessors[i])) {
+        working.push_back(predecessors[i]);
+      }
+    }
+    if (working.empty())
+      continue;
+
+    // Walk the control flow graph backward from the sources of the back
+    // edges up to the header. A node that is already in a loop stands for
+    // the outermost loop holding it, which becomes nested in this one.
+    std::unique_ptr<Loop> loop(new Loop(dominators.basic_blocks_[header]));
+    innermost[header] = loop.get();
+    while (!working.empty()) {
+      size_t node = working.back();
+      working.pop_back();
+      Loop* inner = innermost[node];
+      if (inner == NULL) {
+        innermost[node] = loop.get();
+      } else {
+        while (inner->parent_ != NULL)
+          inner = inner->parent_;
+        if (inner == loop.get())
+          continue;
+        inner->parent_ = loop.get();
+        loop->children_.push_back(inner);
+        node = dominators.GetNode(inner->header_);
+      }
+
+      const std::vector<size_t>& node_predecessors =
+          dominators.predecessors_[node];
+      for (size_t i = 0; i < node_predecessors.size(); ++i) {
+        if (node_predecessors[i] != DominatorTree::kRootNode &&
+            dominators.NodeDominates(header, node_predecessors[i])) {
+          working.push_back(node_predecessors[i]);
+        }
+      }
+    }
+    owned_loops_.push_back(std::move(loop));
+  }
+
+  // List the loops from the outermost, and their basic blocks.
+  std::reverse(owned_loops_.begin(), owned_loops_.end());
+  for (size_t i = 0; i < owned_loops_.size(); ++i) {
+    Loop* loop = owned_loops_[i].get();
+    loop->depth_ = loop->parent_ == NULL ? 1 : loop->parent_->depth_ + 1;
+    loop->basic_blocks_.push_back(loop->header_);
+    loops_.push_back(loop);
+  }
+  for (size_t node = 1; node < count; ++node) {
+    if (innermost[node] == NULL)
+      continue;
+    const BasicCodeBlock* bb = dominators.basic_blocks_[node];
+    innermost_loops_[bb] = innermost[node];
+    for (Loop* loop = innermost[node]; loop != NULL; loop = loop->parent_) {
+      if (loop->header_ != bb)
+        loop->basic_blocks_.push_back(bb);
+    }
+  }
+}
+
+const ControlFlowAnalysis::Loop*
+ControlFlowAnalysis::LoopForest::GetInnermostLoopOf(
+    const BasicCodeBlock* bb) const {
+  std::map<const BasicCodeBlock*, const Loop*>::const_iterator look =
+      innermost_loops_.find(bb);
+  if (look == innermost_loops_.end())
+    return NULL;
+  return look->second;
+}
+
+size_t ControlFlowAnalysis::LoopForest::GetLoopDepth(
+    const BasicCodeBlock* bb) const {
+  const Loop* loop = GetInnermostLoopOf(bb);
+  if (loop == NULL)
+    return 0;
+  return loop->depth();
+}
+
 }  // namespace analysis
 }  // namespace block_graph
@@ -17,6 +17,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_ANALYSIS_CONTROL_FLOW_ANALYSIS_H_
 #define SYZYGY_BLOCK_GRAPH_ANALYSIS_CONTROL_FLOW_ANALYSIS_H_
 
+#include <map>
+#include <memory>
 #include <vector>
 
 #include "syzygy/block_graph/basic_block.h"
@@ -98,6 +100,35 @@ namespace analysis {
 //      / \------/            IfThenElse  \
 //   (n5)                      /  |  \     \
 //                            n1  n2  n3   n4
+//
+// Dominance and Loops
+// ----------------------------
+// A basic block dominates another when every path from an entry of the
+// subgraph to the other goes through it. The entries are the first basic
+// blocks of the block descriptions, the basic blocks referred to from outside
+// of their successors, and those without predecessors. The dominator tree is
+// built with the Lengauer-Tarjan algorithm.
+//
+// A natural loop is made of the targets of the back edges to a header, which
+// dominates them, and of the basic blocks that reach them without going
+// through the header. The loops of a subgraph form a forest, in which the
+// loops nested in another are its children.
+//
+// See: "A Fast Algorithm for Finding Dominators in a Flowgraph", by Thomas
+//       Lengauer and Robert Endre Tarjan.
+//
+// Both are computed on first use and cached on the subgraph, so that the
+// transforms applied to it in turn share them.
+//
+// Example:
+//
+//  const ControlFlowAnalysis::LoopForest& loops =
+//      ControlFlowAnalysis::GetLoopForest(subgraph);
+//  const ControlFlowAnalysis::Loop* loop = loops.GetInnermostLoopOf(bb);
+//  if (loop != NULL) {
+//    // The checks of bb that don't depend on the loop may be hoisted before
+//    // loop->header().
+//  }
 
 class ControlFlowAnalysis {
  public:
@@ -108,6 +139,9 @@ class ControlFlowAnalysis {
   // Forward declaration.
   class StructuralNode;
   typedef std::unique_ptr<StructuralNode> StructuralTree;
+  class DominatorTree;
+  class Loop;
+  class LoopForest;
 
   // Constructor.
   ControlFlowAnalysis() { }
@@ -126,10 +160,135 @@ class ControlFlowAnalysis {
       const BBCollection& basic_blocks,
       BasicBlockOrdering* order);
 
+  // @name Cached analyses.
+  // Get the dominator tree or the loop forest of a subgraph, computing both
+  // if they are not cached on it yet.
+  // @param subgraph SubGraph to analyze, which caches the analyses.
+  // @returns the analysis, which is valid until the cached analysis of
+  //     @p subgraph is invalidated.
+  // @{
+  static const DominatorTree& GetDominatorTree(BasicBlockSubGraph* subgraph);
+  static const LoopForest& GetLoopForest(BasicBlockSubGraph* subgraph);
+  // @}
+
  private:
+  class CachedAnalysis;
+
+  // @returns the analyses cached on @p subgraph, computing them if needed.
+  static const CachedAnalysis& GetCachedAnalysis(BasicBlockSubGraph* subgraph);
+
   DISALLOW_COPY_AND_ASSIGN(ControlFlowAnalysis);
 };
 
+// The dominator tree of the code basic blocks of a subgraph.
+class ControlFlowAnalysis::DominatorTree {
+ public:
+  // Builds the dominator tree.
+  // @param subgraph SubGraph to analyze.
+  explicit DominatorTree(const BasicBlockSubGraph* subgraph);
+
+  // @param bb A code basic block of the subgraph.
+  // @returns the immediate dominator of @p bb, or NULL if @p bb is an entry of
+  //     the subgraph or isn't one of its code basic blocks.
+  const BasicCodeBlock* GetImmediateDominator(const BasicCodeBlock* bb) const;
+
+  // Checks if a basic block dominates another, in constant time. A basic
+  // block dominates itself.
+  // @param dominator The dominating basic block.
+  // @param bb The dominated basic block.
+  // @returns true if @p dominator dominates @p bb, false otherwise.
+  bool Dominates(const BasicCodeBlock* dominator,
+                 const BasicCodeBlock* bb) const;
+
+ private:
+  friend class LoopForest;
+
+  // The nodes are numbered in the depth first pre-order of the control flow
+  // graph, the virtual root of the entries being node 0.
+  static const size_t kRootNode = 0;
+
+  // @returns the node of @p bb, or kRootNode if it isn't in the tree.
+  size_t GetNode(const BasicCodeBlock* bb) const;
+
+  // @returns true if the node @p dominator dominates the node @p node.
+  bool NodeDominates(size_t dominator, size_t node) const {
+    return pre_order_[dominator] <= pre_order_[node] &&
+           post_order_[node] <= post_order_[dominator];
+  }
+
+  std::map<const BasicCodeBlock*, size_t> nodes_;
+  // The basic block of each node, and the predecessors of each node in the
+  // control flow graph.
+  std::vector<const BasicCodeBlock*> basic_blocks_;
+  std::vector<std::vector<size_t>> predecessors_;
+  // The immediate dominator of each node.
+  std::vector<size_t> idoms_;
+  // The numbering of the nodes in a depth first visit of the dominator tree.
+  std::vector<size_t> pre_order_;
+  std::vector<size_t> post_order_;
+
+  DISALLOW_COPY_AND_ASSIGN(DominatorTree);
+};
+
+// A natural loop of a subgraph.
+class ControlFlowAnalysis::Loop {
+ public:
+  // @name Accessors.
+  // @{
+  // @returns the header of the loop, which dominates all of its basic blocks.
+  const BasicCodeBlock* header() const { return header_; }
+  // @returns the innermost loop holding this one, or NULL.
+  const Loop* parent() const { return parent_; }
+  // @returns the loops directly nested in this one.
+  const std::vector<const Loop*>& children() const { return children_; }
+  // @returns the basic blocks of the loop, including those of the nested
+  //     loops, the header being first.
+  const BasicBlockOrdering& basic_blocks() const { return basic_blocks_; }
+  // @returns the nesting depth of the loop, which is 1 for an outermost loop.
+  size_t depth() const { return depth_; }
+  // @}
+
+ private:
+  friend class LoopForest;
+
+  explicit Loop(const BasicCodeBlock* header)
+      : header_(header), parent_(NULL), depth_(0) {}
+
+  const BasicCodeBlock* header_;
+  Loop* parent_;
+  std::vector<const Loop*> children_;
+  BasicBlockOrdering basic_blocks_;
+  size_t depth_;
+
+  DISALLOW_COPY_AND_ASSIGN(Loop);
+};
+
+// The natural loops of a subgraph.
+class ControlFlowAnalysis::LoopForest {
+ public:
+  // Finds the natural loops.
+  // @param dominators The dominator tree of the subgraph.
+  explicit LoopForest(const DominatorTree& dominators);
+
+  // @returns all the loops, each loop preceding the loops nested in it.
+  const std::vector<const Loop*>& loops() const { return loops_; }
+
+  // @param bb A code basic block of the subgraph.
+  // @returns the innermost loop holding @p bb, or NULL.
+  const Loop* GetInnermostLoopOf(const BasicCodeBlock* bb) const;
+
+  // @param bb A code basic block of the subgraph.
+  // @returns the number of loops holding @p bb.
+  size_t GetLoopDepth(const BasicCodeBlock* bb) const;
+
+ private:
+  std::vector<std::unique_ptr<Loop>> owned_loops_;
+  std::vector<const Loop*> loops_;
+  std::map<const BasicCodeBlock*, const Loop*> innermost_loops_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoopForest);
+};
+
 // StructuralNode is the building block of the StructuralTree produced by the
 // control-flow analysis. The structural tree recursively divides the
 // control-flow graph into regions with a single entry node and a single exit
@@ -587,6 +587,108 @@ TEST_F(ControlFlowAnalysisTest, IrreductibleStructure) {
   ASSERT_FALSE(BuildStructuralTree(head));
 }
 
+TEST_F(ControlFlowAnalysisTest, DominatorTree) {
+  BasicCodeBlock* if1 = subgraph_.AddBasicCodeBlock("if1");
+  BasicCodeBlock* true1 = subgraph_.AddBasicCodeBlock("true1");
+  BasicCodeBlock* false1 = subgraph_.AddBasicCodeBlock("false1");
+  BasicCodeBlock* end1 = subgraph_.AddBasicCodeBlock("end1");
+
+  MakeIf(if1, true1, false1);
+  Connect(true1, end1);
+  Connect(false1, end1);
+
+  const ControlFlowAnalysis::DominatorTree& dominators =
+      ControlFlowAnalysis::GetDominatorTree(&subgraph_);
+  EXPECT_EQ(NULL, dominators.GetImmediateDominator(if1));
+  EXPECT_EQ(if1, dominators.GetImmediateDominator(true1));
+  EXPECT_EQ(if1, dominators.GetImmediateDominator(false1));
+  EXPECT_EQ(if1, dominators.GetImmediateDominator(end1));
+
+  EXPECT_TRUE(dominators.Dominates(if1, end1));
+  EXPECT_TRUE(dominators.Dominates(end1, end1));
+  EXPECT_FALSE(dominators.Dominates(true1, end1));
+  EXPECT_FALSE(dominators.Dominates(end1, if1));
+}
+
+TEST_F(ControlFlowAnalysisTest, NestedLoops) {
+  BasicCodeBlock* head = subgraph_.AddBasicCodeBlock("head");
+  BasicCodeBlock* loop1 = subgraph_.AddBasicCodeBlock("loop1");
+  BasicCodeBlock* loop2 = subgraph_.AddBasicCodeBlock("loop2");
+  BasicCodeBlock* end = subgraph_.AddBasicCodeBlock("end");
+
+  Connect(head, loop1);
+  MakeIf(loop1, loop2, end);
+  MakeIf(loop2, loop2, loop1);
+
+  const ControlFlowAnalysis::LoopForest& loops =
+      ControlFlowAnalysis::GetLoopForest(&subgraph_);
+  ASSERT_EQ(2U, loops.loops().size());
+
+  const ControlFlowAnalysis::Loop* outer = loops.loops()[0];
+  const ControlFlowAnalysis::Loop* inner = loops.loops()[1];
+  EXPECT_EQ(loop1, outer->header());
+  EXPECT_EQ(NULL, outer->parent());
+  EXPECT_EQ(1U, outer->depth());
+  EXPECT_THAT(outer->children(), ElementsAre(inner));
+  EXPECT_THAT(outer->basic_blocks(), ElementsAre(loop1, loop2));
+
+  EXPECT_EQ(loop2, inner->header());
+  EXPECT_EQ(outer, inner->parent());
+  EXPECT_EQ(2U, inner->depth());
+  EXPECT_THAT(inner->basic_blocks(), ElementsAre(loop2));
+
+  EXPECT_EQ(NULL, loops.GetInnermostLoopOf(head));
+  EXPECT_EQ(outer, loops.GetInnermostLoopOf(loop1));
+  EXPECT_EQ(inner, loops.GetInnermostLoopOf(loop2));
+  EXPECT_EQ(0U, loops.GetLoopDepth(end));
+  EXPECT_EQ(2U, loops.GetLoopDepth(loop2));
+}
+
+TEST_F(ControlFlowAnalysisTest, IrreducibleLoop) {
+  BasicCodeBlock* head = subgraph_.AddBasicCodeBlock("head");
+  BasicCodeBlock* body1 = subgraph_.AddBasicCodeBlock("body1");
+  BasicCodeBlock* body2 = subgraph_.AddBasicCodeBlock("body2");
+
+  MakeIf(head, body1, body2);
+  Connect(body1, body2);
+  Connect(body2, body1);
+
+  // Neither basic block of the cycle dominates the other, so that it isn't
+  // a natural loop.
+  const ControlFlowAnalysis::DominatorTree& dominators =
+      ControlFlowAnalysis::GetDominatorTree(&subgraph_);
+  EXPECT_EQ(head, dominators.GetImmediateDominator(body1));
+  EXPECT_EQ(head, dominators.GetImmediateDominator(body2));
+  EXPECT_TRUE(ControlFlowAnalysis::GetLoopForest(&subgraph_).loops().empty());
+}
+
+TEST_F(ControlFlowAnalysisTest, CachedAnalysis) {
+  BasicCodeBlock* loop = subgraph_.AddBasicCodeBlock("loop");
+  BasicCodeBlock* end = subgraph_.AddBasicCodeBlock("end");
+  MakeIf(loop, loop, end);
+
+  // The analyses are computed once, and shared.
+  EXPECT_EQ(NULL, subgraph_.cached_analysis());
+  const ControlFlowAnalysis::DominatorTree* dominators =
+      &ControlFlowAnalysis::GetDominatorTree(&subgraph_);
+  EXPECT_NE(static_cast<BasicBlockSubGraph::CachedAnalysis*>(NULL),
+            subgraph_.cached_analysis());
+  EXPECT_EQ(dominators, &ControlFlowAnalysis::GetDominatorTree(&subgraph_));
+  EXPECT_EQ(1U, ControlFlowAnalysis::GetLoopForest(&subgraph_).loops().size());
+
+  // Adding a basic block discards them.
+  BasicCodeBlock* head = subgraph_.AddBasicCodeBlock("head");
+  EXPECT_EQ(NULL, subgraph_.cached_analysis());
+  Connect(head, loop);
+  EXPECT_EQ(head,
+            ControlFlowAnalysis::GetDominatorTree(&subgraph_)
+                .GetImmediateDominator(loop));
+
+  // So does an explicit invalidation.
+  subgraph_.InvalidateCachedAnalysis();
+  EXPECT_EQ(NULL, subgraph_.cached_analysis());
+}
+
 }  // namespace
 
 }  // namespace analysis
@@ -14,6 +14,7 @@
 
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 
+#include <deque>
 #include <set>
 #include <stack>
 #include <vector>
@@ -39,6 +40,30 @@ typedef LivenessAnalysis::State State;
 typedef LivenessAnalysis::State::RegisterMask RegisterMask;
 typedef LivenessAnalysis::State::FlagsMask FlagsMask;
 
+// The liveness information of a basic block during a global analysis.
+struct BasicBlockSummary {
+  // A successor, with the registers used by its implicit instruction.
+  struct Edge {
+    size_t successor;
+    State uses;
+  };
+
+  BasicBlockSummary() : all_live_at_exit(false), queued(false) {}
+
+  // The effect of the instructions of the basic block.
+  State kill;
+  State gen;
+  // The successors and predecessors, as indices in the post-order.
+  std::vector<Edge> successors;
+  std::vector<size_t> predecessors;
+  // True if all registers are alive at the exit, whatever the successors.
+  bool all_live_at_exit;
+  // The registers alive at the entry.
+  State live_in;
+  // True while the basic block is in the worklist.
+  bool queued;
+};
+
 }  // namespace
 
 State::State()
@@ -129,75 +154,110 @@ void LivenessAnalysis::PropagateBackward(const Instruction& instr,
                                          State* state) {
   DCHECK(state != NULL);
 
-  // Skip 'nop' instructions. It's better to skip them (i.e. mov %eax, %eax).
-  if (instr.IsNop())
-    return;
-
-  // Remove 'defs' from current state.
-  State defs;
-  if (StateHelper::GetDefsOf(instr, &defs))
-    StateHelper::Subtract(defs, state);
-
-  if (instr.IsCall() || instr.IsReturn()) {
-    // TODO(etienneb): Can we verify the calling convention? If so we can do
-    // better than SetAll here.
-    StateHelper::SetAll(state);
-  } else if (instr.IsBranch() ||
-             instr.IsInterrupt() ||
-             instr.IsControlFlow()) {
-    // Don't mess with these instructions.
-    StateHelper::SetAll(state);
-  }
-
-  // Add 'uses' of instruction to current state, or assume all alive when 'uses'
-  // information is not available.
-  State uses;
-  if (StateHelper::GetUsesOf(instr, &uses)) {
-    StateHelper::Union(uses, state);
-  } else {
-    StateHelper::SetAll(state);
-  }
+  State kill;
+  State gen;
+  StateHelper::GetTransferOf(instr, &kill, &gen);
+  StateHelper::Subtract(kill, state);
+  StateHelper::Union(gen, state);
 }
 
 void LivenessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   DCHECK(subgraph != NULL);
   DCHECK(live_in_.empty());
 
-  // Produce a post-order basic blocks ordering.
+  // Produce a post-order basic blocks ordering. Liveness flows backward, so
+  // this visits the successors of a basic block before it.
   const BBCollection& basic_blocks = subgraph->basic_blocks();
   std::vector<const BasicCodeBlock*> order;
   ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(basic_blocks, &order);
 
-  // Initialize liveness information of each basic block (empty set).
-  BasicBlockOrdering::const_iterator fw_iter = order.begin();
-  for (; fw_iter != order.end(); ++fw_iter)
-    StateHelper::Clear(&live_in_[*fw_iter]);
+  std::map<const BasicBlock*, size_t> indices;
+  for (size_t i = 0; i < order.size(); ++i)
+    indices[order[i]] = i;
+
+  // Summarize each basic block, so that its instructions are decoded once
+  // rather than on each visit of the fix-point iteration.
+  std::vector<BasicBlockSummary> summaries(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    const BasicCodeBlock* bb = order[i];
+    BasicBlockSummary& summary = summaries[i];
+    StateHelper::Clear(&summary.live_in);
+
+    // The effect of the instructions, from the last to the first.
+    StateHelper::Clear(&summary.kill);
+    StateHelper::Clear(&summary.gen);
+    const Instructions& instructions = bb->instructions();
+    Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
+    for (; instr_iter != instructions.rend(); ++instr_iter) {
+      State kill;
+      State gen;
+      StateHelper::GetTransferOf(*instr_iter, &kill, &gen);
+      StateHelper::PrependTransfer(kill, gen, &summary.kill, &summary.gen);
+    }
+
+    // As in GetStateAtExitOf, all registers are alive at the exit of a basic
+    // block without successors, or with one outside of the analysis.
+    const Successors& successors = bb->successors();
+    summary.all_live_at_exit = successors.empty();
+    Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      std::map<const BasicBlock*, size_t>::const_iterator look =
+          indices.find(succ->reference().basic_block());
+      if (look == indices.end()) {
+        summary.all_live_at_exit = true;
+        break;
+      }
+      BasicBlockSummary::Edge edge = {look->second, State()};
+      if (!StateHelper::GetUsesOf(*succ, &edge.uses))
+        StateHelper::SetAll(&edge.uses);
+      summary.successors.push_back(edge);
+      summaries[look->second].predecessors.push_back(i);
+    }
+  }
 
   // Propagate liveness information until stable (fix-point). Each set may only
-  // grow, thus we have a halting condition.
-  bool changed = true;
-  while (changed) {
-    changed = false;
-
-    BasicBlockOrdering::const_iterator  bb_iter = order.begin();
-    for (; bb_iter != order.end(); ++bb_iter) {
-      const BasicCodeBlock* bb = *bb_iter;
-
-      // Merge current liveness information with every successor information.
-      State state;
-      GetStateAtExitOf(bb, &state);
-
-      // Propagate liveness information backward until the basic block entry.
-      const Instructions& instructions = bb->instructions();
-      Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
-      for (; instr_iter != instructions.rend(); ++instr_iter)
-        PropagateBackward(*instr_iter, &state);
-
-      // Commit liveness information to the global state.
-      if (StateHelper::Union(state, &live_in_[bb]))
-        changed = true;
+  // grow, thus we have a halting condition. Only the predecessors of a basic
+  // block whose state grew are visited again.
+  std::deque<size_t> worklist;
+  for (size_t i = 0; i < summaries.size(); ++i) {
+    worklist.push_back(i);
+    summaries[i].queued = true;
+  }
+  while (!worklist.empty()) {
+    size_t index = worklist.front();
+    worklist.pop_front();
+    BasicBlockSummary& summary = summaries[index];
+    summary.queued = false;
+
+    // Merge the liveness information of every successor.
+    State state;
+    if (!summary.all_live_at_exit) {
+      StateHelper::Clear(&state);
+      for (size_t i = 0; i < summary.successors.size(); ++i) {
+        const BasicBlockSummary::Edge& edge = summary.successors[i];
+        StateHelper::Union(summaries[edge.successor].live_in, &state);
+        StateHelper::Union(edge.uses, &state);
+      }
+    }
+
+    // Propagate it backward until the basic block entry.
+    StateHelper::Subtract(summary.kill, &state);
+    StateHelper::Union(summary.gen, &state);
+
+    if (!StateHelper::Union(state, &summary.live_in))
+      continue;
+    for (size_t i = 0; i < summary.predecessors.size(); ++i) {
+      BasicBlockSummary& predecessor = summaries[summary.predecessors[i]];
+      if (!predecessor.queued) {
+        predecessor.queued = true;
+        worklist.push_back(summary.predecessors[i]);
+      }
     }
   }
+
+  // Commit liveness information to the global state.
+  for (size_t i = 0; i < order.size(); ++i)
+    StateHelper::Copy(summaries[i].live_in, &live_in_[order[i]]);
 }
 
 RegisterMask LivenessAnalysis::StateHelper::RegisterToRegisterMask(
@@ -336,6 +396,54 @@ void LivenessAnalysis::StateHelper::Subtract(const State& src, State* state) {
   state->registers_ &= ~(src.registers_);
 }
 
+void LivenessAnalysis::StateHelper::GetTransferOf(const Instruction& instr,
+                                                  State* kill,
+                                                  State* gen) {
+  DCHECK(kill != NULL);
+  DCHECK(gen != NULL);
+
+  Clear(kill);
+  Clear(gen);
+
+  // Skip 'nop' instructions. It's better to skip them (i.e. mov %eax, %eax).
+  if (instr.IsNop())
+    return;
+
+  if (instr.IsCall() || instr.IsReturn() || instr.IsBranch() ||
+      instr.IsInterrupt() || instr.IsControlFlow()) {
+    // TODO(etienneb): Can we verify the calling convention? If so we can do
+    // better than SetAll here. Don't mess with the other instructions.
+    SetAll(kill);
+    SetAll(gen);
+    return;
+  }
+
+  // Remove 'defs' from current state.
+  State defs;
+  if (GetDefsOf(instr, &defs))
+    Copy(defs, kill);
+
+  // Add 'uses' of instruction to current state, or assume all alive when 'uses'
+  // information is not available.
+  if (!GetUsesOf(instr, gen)) {
+    SetAll(kill);
+    SetAll(gen);
+  }
+}
+
+void LivenessAnalysis::StateHelper::PrependTransfer(const State& instr_kill,
+                                                    const State& instr_gen,
+                                                    State* kill,
+                                                    State* gen) {
+  DCHECK(kill != NULL);
+  DCHECK(gen != NULL);
+
+  // ((state - kill) | gen) - instr_kill) | instr_gen.
+  Union(instr_kill, kill);
+  Subtract(instr_kill, gen);
+  Union(instr_gen, gen);
+}
+
 void LivenessAnalysis::StateHelper::StateDefOperand(
     const _Operand& operand, State* state) {
   DCHECK(state != NULL);
@@ -176,6 +176,24 @@ class LivenessAnalysis::StateHelper {
   // @param state On success, receives registers used by the instruction.
   // @returns true if we are able to analyze this successor, false otherwise.
   static bool GetUsesOf(const Successor& successor, State* state);
+
+  // Get the effect of the backward execution of an instruction, which maps
+  // a state to (state - kill) | gen.
+  // @param instr Instruction to analyze.
+  // @param kill Receives the registers the instruction makes dead.
+  // @param gen Receives the registers the instruction makes live.
+  static void GetTransferOf(const Instruction& instr, State* kill, State* gen);
+
+  // Prepend the effect of an instruction to that of the instructions after
+  // it, so that @p kill and @p gen summarize all of them.
+  // @param instr_kill The registers the instruction makes dead.
+  // @param instr_gen The registers the instruction makes live.
+  // @param kill The registers made dead by the instructions after it.
+  // @param gen The registers made live by the instructions after it.
+  static void PrependTransfer(const State& instr_kill,
+                              const State& instr_gen,
+                              State* kill,
+                              State* gen);
 };
 
 }  // namespace analysis
@@ -1609,6 +1609,49 @@ TEST_F(LivenessAnalysisTest, GetStateAtExitOfWithNull) {
   EXPECT_TRUE(are_arithmetic_flags_live());
 }
 
+TEST_F(LivenessAnalysisTest, PrependTransfer) {
+  asm_.mov(assm::eax, assm::ebx);
+  asm_.mov(assm::ebx, Immediate(0));
+  asm_.add(assm::ecx, assm::edx);
+
+  // Summarize the instructions, from the last to the first.
+  State kill;
+  State gen;
+  StateHelper::Clear(&kill);
+  StateHelper::Clear(&gen);
+  Instructions::reverse_iterator iter = instructions_.rbegin();
+  for (; iter != instructions_.rend(); ++iter) {
+    State instr_kill;
+    State instr_gen;
+    StateHelper::GetTransferOf(*iter, &instr_kill, &instr_gen);
+    StateHelper::PrependTransfer(instr_kill, instr_gen, &kill, &gen);
+  }
+
+  // The summary has the effect of the instructions one by one.
+  StateHelper::Subtract(kill, &state_);
+  StateHelper::Union(gen, &state_);
+  State expected;
+  for (iter = instructions_.rbegin(); iter != instructions_.rend(); ++iter)
+    LivenessAnalysis::PropagateBackward(*iter, &expected);
+
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_TRUE(is_live(assm::ecx));
+  EXPECT_TRUE(is_live(assm::edx));
+  EXPECT_FALSE(are_arithmetic_flags_live());
+  EXPECT_EQ(expected.IsLive(assm::eax), is_live(assm::eax));
+  EXPECT_EQ(expected.IsLive(assm::ebx), is_live(assm::ebx));
+  EXPECT_EQ(expected.AreArithmeticFlagsLive(), are_arithmetic_flags_live());
+
+  // A control flow instruction makes all registers alive.
+  asm_.ret();
+  StateHelper::GetTransferOf(instructions_.back(), &kill, &gen);
+  StateHelper::Clear(&state_);
+  StateHelper::Union(gen, &state_);
+  EXPECT_TRUE(is_live(assm::eax));
+  EXPECT_TRUE(are_arithmetic_flags_live());
+}
+
 TEST_F(LivenessAnalysisTest, LivenessAnalysisOverControlFlow) {
   BasicBlockSubGraph subgraph;
 
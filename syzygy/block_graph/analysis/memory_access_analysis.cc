@@ -14,6 +14,8 @@
 
 #include "syzygy/block_graph/analysis/memory_access_analysis.h"
 
+#include <algorithm>
+#include <map>
 #include <queue>
 #include <set>
 #include <vector>
@@ -36,6 +38,48 @@ using block_graph::Operand;
 typedef assm::RegisterId RegisterId;
 typedef block_graph::BasicBlockSubGraph::BasicBlock BasicBlock;
 typedef block_graph::BasicBlockSubGraph::BasicBlock::Instructions Instructions;
+typedef std::map<int32_t, size_t> AccessMap;
+
+// Inserts the basic blocks referred to by @p refs in @p referenced.
+void AddReferencedBasicBlocks(const BasicBlock::BasicBlockReferenceMap& refs,
+                              std::set<const BasicBlock*>* referenced) {
+  DCHECK_NE(static_cast<std::set<const BasicBlock*>*>(nullptr), referenced);
+  for (const auto& ref : refs) {
+    if (ref.second.basic_block() != nullptr)
+      referenced->insert(ref.second.basic_block());
+  }
+}
+
+// Returns the basic blocks of @p subgraph that may be entered by other means
+// than by following the successors of another basic block: the ones that are
+// referred to by an external block, by an instruction or by a data basic
+// block (e.g. a case table).
+std::set<const BasicBlock*> GetAddressTakenBasicBlocks(
+    const BasicBlockSubGraph* subgraph) {
+  std::set<const BasicBlock*> address_taken;
+  for (const BasicBlock* bb : subgraph->basic_blocks()) {
+    if (!bb->referrers().empty())
+      address_taken.insert(bb);
+
+    const BasicCodeBlock* bb_code = BasicCodeBlock::Cast(bb);
+    if (bb_code != nullptr) {
+      for (const Instruction& instr : bb_code->instructions())
+        AddReferencedBasicBlocks(instr.references(), &address_taken);
+      continue;
+    }
+
+    const BasicDataBlock* bb_data = BasicDataBlock::Cast(bb);
+    if (bb_data != nullptr)
+      AddReferencedBasicBlocks(bb_data->references(), &address_taken);
+  }
+  return address_taken;
+}
+
+// Returns the size in bytes of the memory access done through @p op, or 0 if
+// it's unknown.
+size_t GetAccessSize(const _Operand& op) {
+  return op.size / 8;
+}
 
 }  // namespace
 
@@ -100,21 +144,26 @@ bool MemoryAccessAnalysis::Intersect(const block_graph::BasicBlock* bb,
   bool changed = false;
   // Subtract non redundant memory accesses.
   for (size_t r = 0; r < assm::kRegister32Count; ++r) {
-    const std::set<int32_t>& from = state.active_memory_accesses_[r];
-    std::set<int32_t>& to = bbentry_state->second.active_memory_accesses_[r];
+    const AccessMap& from = state.active_memory_accesses_[r];
+    AccessMap& to = bbentry_state->second.active_memory_accesses_[r];
 
-    // In-place intersection. Remove unknown accesses of the destination set.
-    std::set<int32_t>::iterator it1 = to.begin();
-    std::set<int32_t>::const_iterator it2 = from.begin();
+    // In-place intersection. Remove unknown accesses of the destination set,
+    // and only keep the size accessed on every path for the others.
+    AccessMap::iterator it1 = to.begin();
+    AccessMap::const_iterator it2 = from.begin();
     while (it1 != to.end()) {
-      if (it2 == from.end() || *it1 < *it2) {
-        std::set<int32_t>::iterator old = it1;
+      if (it2 == from.end() || it1->first < it2->first) {
+        AccessMap::iterator old = it1;
         ++it1;
         to.erase(old);
         changed = true;
-      } else if (*it2 < *it1) {
+      } else if (it2->first < it1->first) {
         ++it2;
-      } else {  // *it1 == *it2
+      } else {  // it1->first == it2->first
+        if (it2->second < it1->second) {
+          it1->second = it2->second;
+          changed = true;
+        }
         ++it1;
         ++it2;
       }
@@ -130,6 +179,8 @@ bool MemoryAccessAnalysis::Intersect(const block_graph::BasicBlock* bb,
 // the control flow and re-insert each modified basic block into the work-list.
 // When the end of a basic block is reached, the algorithm performs the
 // intersection of the current state with all its successors.
+// The basic blocks that can be entered from elsewhere than their predecessors
+// in the subgraph are seeded with an empty state, like the entry points.
 void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   DCHECK(subgraph != NULL);
 
@@ -139,6 +190,8 @@ void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   states_.clear();
 
   // Find initial basic blocks (entry-points), add them to working queue.
+  std::set<const BasicBlock*> entry_points =
+      GetAddressTakenBasicBlocks(subgraph);
   const BasicBlockSubGraph::BlockDescriptionList& descriptions =
       subgraph->block_descriptions();
   BasicBlockSubGraph::BlockDescriptionList::const_iterator descr_iter =
@@ -146,13 +199,14 @@ void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   for (; descr_iter != descriptions.end(); ++descr_iter) {
     const BasicBlockSubGraph::BasicBlockOrdering& original_order =
         descr_iter->basic_block_order;
-    if (original_order.empty())
-      continue;
-    const BasicBlock* head = original_order.front();
-    if (marked.insert(head).second) {
-      working.push(original_order.front());
+    if (!original_order.empty())
+      entry_points.insert(original_order.front());
+  }
+  for (const BasicBlock* entry_point : entry_points) {
+    if (marked.insert(entry_point).second) {
+      working.push(entry_point);
       State empty;
-      Intersect(head, empty);
+      Intersect(entry_point, empty);
     }
   }
 
@@ -164,12 +218,10 @@ void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
     working.pop();
     marked.erase(bb);
 
+    // Data basic blocks aren't executed, there's nothing to propagate.
     const BasicCodeBlock* bb_code = BasicCodeBlock::Cast(bb);
-    if (bb_code == NULL) {
-      // Invalidate all.
-      states_.clear();
-      return;
-    }
+    if (bb_code == NULL)
+      continue;
 
     State state;
     GetStateAtEntryOf(bb, &state);
@@ -187,12 +239,11 @@ void MemoryAccessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
     const BasicBlock::Successors& successors = bb_code->successors();
     BasicBlock::Successors::const_iterator succ = successors.begin();
     for (; succ != successors.end(); ++succ) {
+      // Successors outside of the subgraph (e.g. tail calls) don't have a
+      // state to update.
       BasicBlock* basic_block = succ->reference().basic_block();
-      if (basic_block == NULL) {
-        // Invalidate all.
-        states_.clear();
-        return;
-      }
+      if (basic_block == NULL)
+        continue;
 
       // Intersect current state with successor 'basic_block'.
       bool changed = Intersect(basic_block, state);
@@ -249,8 +300,13 @@ bool MemoryAccessAnalysis::State::HasNonRedundantAccess(
         if (instr.FindOperandReference(op_id, &reference))
           return true;
 
-        const std::set<int32_t>& accesses = active_memory_accesses_[base_reg];
-        if (accesses.find(repr.disp) == accesses.end())
+        // The access is redundant if at least as many bytes were accessed at
+        // the same location.
+        size_t size = GetAccessSize(op);
+        const AccessMap& accesses = active_memory_accesses_[base_reg];
+        AccessMap::const_iterator access =
+            accesses.find(static_cast<int32_t>(repr.disp));
+        if (size == 0 || access == accesses.end() || access->second < size)
           return true;
       }
       break;
@@ -291,7 +347,13 @@ void MemoryAccessAnalysis::State::Execute(const Instruction& instr) {
     if (instr.FindOperandReference(op_id, &reference))
       continue;
 
-    active_memory_accesses_[base_reg].insert(repr.disp);
+    size_t size = GetAccessSize(op);
+    if (size == 0)
+      continue;
+
+    size_t& accessed = active_memory_accesses_[base_reg][
+        static_cast<int32_t>(repr.disp)];
+    accessed = std::max(accessed, size);
   }
 }
 
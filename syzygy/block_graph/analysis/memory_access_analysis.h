@@ -30,6 +30,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_ANALYSIS_MEMORY_ACCESS_ANALYSIS_H_
 #define SYZYGY_BLOCK_GRAPH_ANALYSIS_MEMORY_ACCESS_ANALYSIS_H_
 
+#include <map>
+
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
@@ -147,7 +149,8 @@ class MemoryAccessAnalysis {
 // This class contains the memory access information at a given program point.
 // The implementation only supports memory access through a single base register
 // (e.g. [eax] or [esi+12]). For each general purpose register (eax, ebx, ecx,
-// edx, esi, edi, esp, ebp) we keep a set of offsets accessed via the base.
+// edx, esi, edi, esp, ebp) we keep the offsets accessed via the base, along
+// with the number of bytes accessed at each of them.
 class MemoryAccessAnalysis::State {
  public:
   // On creation, a state is assumed to be empty.
@@ -172,8 +175,9 @@ class MemoryAccessAnalysis::State {
   void State::Execute(const Instruction& instr);
 
   // Contains active memory accesses. For each 32-bit base register, we keep a
-  // set of distances (displacements) done via the base register.
-  std::set<int32_t> active_memory_accesses_[assm::kRegister32Count];
+  // map of the distances (displacements) accessed via the base register to the
+  // largest access size at this distance.
+  std::map<int32_t, size_t> active_memory_accesses_[assm::kRegister32Count];
 
   friend class MemoryAccessAnalysis;
 };
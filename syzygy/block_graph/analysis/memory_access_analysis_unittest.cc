@@ -43,6 +43,8 @@ const uint8_t kWriteWithScale[] = {0x01, 0x4C, 0x58, 0x2A};
 const uint8_t kWriteDispl[] = {0x01, 0x0D, 0x80, 0x1E, 0xF2, 0x00};
 // _asm add [eax + 42], ecx
 const uint8_t kWriteEax42[] = {0x01, 0x48, 0x2A};
+// _asm mov cl, [eax + 42]
+const uint8_t kReadByteEax42[] = {0x8A, 0x48, 0x2A};
 // _asm lea ecx, [eax]
 const uint8_t kLeaEax[] = {0x8D, 0x08};
 // _asm lea ecx, [eax + 42]
@@ -138,7 +140,7 @@ bool TestMemoryAccessAnalysisState::IsEmpty() const {
 
 bool TestMemoryAccessAnalysisState::Contains(const assm::Register32& reg,
                                              int32_t displ) const {
-  const std::set<int32_t>& offsets =
+  const std::map<int32_t, size_t>& offsets =
       active_memory_accesses_[reg.id() - assm::kRegister32Min];
   return offsets.find(displ) != offsets.end();
 }
@@ -278,6 +280,22 @@ TEST(MemoryAccessAnalysisStateTest, HasNonRedundantAccess) {
   EXPECT_FALSE(redundant_write2);
 }
 
+TEST(MemoryAccessAnalysisStateTest, HasNonRedundantAccessSize) {
+  TestMemoryAccessAnalysisState state;
+
+  // A byte read of [eax + 42] doesn't cover a dword read at the same place.
+  state.Execute(kReadByteEax42);
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadByteEax42));
+  EXPECT_TRUE(state.HasNonRedundantAccess(kReadEax42));
+
+  // The dword read covers both of them.
+  state.Execute(kReadEax42);
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadEax42));
+  state.Execute(kReadByteEax42);
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadEax42));
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadByteEax42));
+}
+
 TEST(MemoryAccessAnalysisStateTest, HasNonRedundantAccessOperandKind) {
   TestMemoryAccessAnalysisState state;
 
@@ -526,5 +544,108 @@ TEST_F(MemoryAccessAnalysisTest, AnalyzeWithData) {
   EXPECT_TRUE(state_.IsEmpty());
 }
 
+TEST_F(MemoryAccessAnalysisTest, IntersectSizes) {
+  // The intersection keeps the size accessed on both paths.
+  TestMemoryAccessAnalysisState state1;
+  state1.Execute(kReadEax42);
+  Intersect(bb_, state1);
+
+  TestMemoryAccessAnalysisState state2;
+  state2.Execute(kReadByteEax42);
+  EXPECT_TRUE(Intersect(bb_, state2));
+
+  GetStateAtEntryOf(bb_, &state_);
+  EXPECT_FALSE(state_.HasNonRedundantAccess(kReadByteEax42));
+  EXPECT_TRUE(state_.HasNonRedundantAccess(kReadEax42));
+}
+
+TEST_F(MemoryAccessAnalysisTest, AnalyzeLoop) {
+  BlockGraph block_graph;
+  BlockGraph::Block* external =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 10, "external");
+  BasicBlockSubGraph subgraph;
+
+  BlockDescription* block = subgraph.AddBlockDescription(
+      "b1", "b1.obj", BlockGraph::CODE_BLOCK, 7, 2, 42);
+
+  BasicCodeBlock* bb_head = subgraph.AddBasicCodeBlock("head");
+  BasicCodeBlock* bb_loop = subgraph.AddBasicCodeBlock("loop");
+  BasicCodeBlock* bb_exit = subgraph.AddBasicCodeBlock("exit");
+
+  block->basic_block_order.push_back(bb_head);
+  block->basic_block_order.push_back(bb_loop);
+  block->basic_block_order.push_back(bb_exit);
+
+  AddSuccessorBetween(Successor::kConditionTrue, bb_head, bb_loop);
+  AddSuccessorBetween(Successor::kConditionEqual, bb_loop, bb_loop);
+  AddSuccessorBetween(Successor::kConditionNotEqual, bb_loop, bb_exit);
+
+  // The exit block tail-calls a function outside of the subgraph.
+  bb_exit->successors().push_back(
+      Successor(Successor::kConditionTrue,
+                BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                    BlockGraph::Reference::kMaximumSize,
+                                    external, 0, 0),
+                0));
+
+  BasicBlockAssembler asm_head(bb_head->instructions().end(),
+                               &bb_head->instructions());
+  asm_head.mov(assm::ecx,
+               Operand(assm::eax, Displacement(1, assm::kSize32Bit)));
+
+  BasicBlockAssembler asm_loop(bb_loop->instructions().end(),
+                               &bb_loop->instructions());
+  asm_loop.mov(assm::ecx,
+               Operand(assm::eax, Displacement(1, assm::kSize32Bit)));
+  asm_loop.mov(assm::edx,
+               Operand(assm::eax, Displacement(2, assm::kSize32Bit)));
+
+  // Analyze the flow graph.
+  memory_access_.Analyze(&subgraph);
+
+  // The accesses done before the loop are available on every iteration, the
+  // ones done in the loop only at its exit.
+  GetStateAtEntryOf(bb_loop, &state_);
+  EXPECT_TRUE(state_.Contains(assm::eax, 1));
+  EXPECT_FALSE(state_.Contains(assm::eax, 2));
+
+  GetStateAtEntryOf(bb_exit, &state_);
+  EXPECT_TRUE(state_.Contains(assm::eax, 1));
+  EXPECT_TRUE(state_.Contains(assm::eax, 2));
+}
+
+TEST_F(MemoryAccessAnalysisTest, AnalyzeWithCaseTable) {
+  BasicBlockSubGraph subgraph;
+  const uint8_t raw_data[] = {0, 0, 0, 0};
+
+  BlockDescription* block = subgraph.AddBlockDescription(
+      "b1", "b1.obj", BlockGraph::CODE_BLOCK, 7, 2, 42);
+
+  BasicCodeBlock* bb_head = subgraph.AddBasicCodeBlock("head");
+  BasicCodeBlock* bb_case = subgraph.AddBasicCodeBlock("case");
+  BasicDataBlock* table =
+      subgraph.AddBasicDataBlock("table", sizeof(raw_data), &raw_data[0]);
+  table->references()[0] = BasicBlockReference(
+      BlockGraph::ABSOLUTE_REF, sizeof(raw_data), bb_case);
+
+  block->basic_block_order.push_back(bb_head);
+  block->basic_block_order.push_back(bb_case);
+  block->basic_block_order.push_back(table);
+
+  AddSuccessorBetween(Successor::kConditionTrue, bb_head, bb_case);
+
+  BasicBlockAssembler asm_head(bb_head->instructions().end(),
+                               &bb_head->instructions());
+  asm_head.mov(assm::ecx,
+               Operand(assm::eax, Displacement(1, assm::kSize32Bit)));
+
+  // Analyze the flow graph.
+  memory_access_.Analyze(&subgraph);
+
+  // The case can be reached through the table, nothing is known at its entry.
+  GetStateAtEntryOf(bb_case, &state_);
+  EXPECT_TRUE(state_.IsEmpty());
+}
+
 }  // namespace analysis
 }  // namespace block_graph
@@ -14,6 +14,8 @@
 //
 #include "syzygy/block_graph/basic_block_assembler.h"
 
+#include <utility>
+
 namespace block_graph {
 
 namespace {
@@ -173,9 +175,56 @@ BasicBlockAssembler::Operand Operand(
   return BasicBlockAssembler::Operand(index, scale, displ);
 }
 
+const size_t BasicBlockAssembler::InstructionCache::kMaxInstructions;
+
+BasicBlockAssembler::InstructionCache::InstructionCache() : hits_(0) {
+}
+
+bool BasicBlockAssembler::InstructionCache::Decode(const uint8_t* bytes,
+                                                   uint32_t num_bytes,
+                                                   Instruction* instruction) {
+  DCHECK(bytes != NULL);
+  DCHECK(instruction != NULL);
+
+  std::string key(reinterpret_cast<const char*>(bytes), num_bytes);
+  {
+    base::AutoLock auto_lock(lock_);
+    std::map<std::string, Instruction>::const_iterator it =
+        instructions_.find(key);
+    if (it != instructions_.end()) {
+      ++hits_;
+      *instruction = it->second;
+      return true;
+    }
+  }
+
+  // The decoding is done outside of the lock, a concurrent decoding of the
+  // same bytes only inserts the same instruction.
+  if (!Instruction::FromBuffer(bytes, num_bytes, instruction))
+    return false;
+
+  // The instruction must use all of the bytes for its copies to be exact.
+  if (instruction->size() != num_bytes)
+    return true;
+  base::AutoLock auto_lock(lock_);
+  if (instructions_.size() < kMaxInstructions)
+    instructions_.insert(std::make_pair(key, *instruction));
+  return true;
+}
+
+size_t BasicBlockAssembler::InstructionCache::size() const {
+  base::AutoLock auto_lock(lock_);
+  return instructions_.size();
+}
+
+size_t BasicBlockAssembler::InstructionCache::hits() const {
+  base::AutoLock auto_lock(lock_);
+  return hits_;
+}
+
 BasicBlockAssembler::BasicBlockSerializer::BasicBlockSerializer(
     const Instructions::iterator& where, Instructions* list)
-        : where_(where), list_(list) {
+        : where_(where), list_(list), cache_(NULL) {
   DCHECK(list != NULL);
 }
 
@@ -186,7 +235,10 @@ void BasicBlockAssembler::BasicBlockSerializer::AppendInstruction(
     const ReferenceInfo* refs,
     size_t num_refs) {
   Instruction instruction;
-  CHECK(Instruction::FromBuffer(bytes, num_bytes, &instruction));
+  if (cache_ != NULL)
+    CHECK(cache_->Decode(bytes, num_bytes, &instruction));
+  else
+    CHECK(Instruction::FromBuffer(bytes, num_bytes, &instruction));
   instruction.set_source_range(source_range_);
 
   Instructions::iterator it = list_->insert(where_, instruction);
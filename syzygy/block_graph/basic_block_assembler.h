@@ -17,6 +17,10 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_ASSEMBLER_H_
 #define SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_ASSEMBLER_H_
 
+#include <map>
+#include <string>
+
+#include "base/synchronization/lock.h"
 #include "syzygy/assm/assembler_base.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -129,6 +133,45 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
   typedef assm::Register32 Register32;
   typedef assm::ConditionCode ConditionCode;
 
+  // A cache of the instructions decoded by the assemblers sharing it, keyed by
+  // their encoding. Instrumenters emit the same hook calls, register spills
+  // and counter updates into every basic block, and each of those is then
+  // decoded once and copied thereafter, with only its references and source
+  // range filled in anew. Instructions whose operands vary, such as a basic
+  // block ID, are decoded as usual once the cache is full. A cache may be
+  // shared by assemblers running on different threads.
+  class InstructionCache {
+   public:
+    // The maximum number of instructions held by a cache.
+    static const size_t kMaxInstructions = 4096;
+
+    InstructionCache();
+
+    // Decodes an instruction, or copies an earlier decoding of the same bytes.
+    // @param bytes the encoding of the instruction.
+    // @param num_bytes the size of @p bytes.
+    // @param instruction receives the decoded instruction, which has no
+    //     references, source range or label.
+    // @returns false if @p bytes don't decode.
+    bool Decode(const uint8_t* bytes,
+                uint32_t num_bytes,
+                Instruction* instruction);
+
+    // @returns the number of instructions held by the cache.
+    size_t size() const;
+
+    // @returns the number of instructions copied rather than decoded.
+    size_t hits() const;
+
+   private:
+    // Protects the members below.
+    mutable base::Lock lock_;
+    std::map<std::string, Instruction> instructions_;
+    size_t hits_;
+
+    DISALLOW_COPY_AND_ASSIGN(InstructionCache);
+  };
+
   // Constructs a basic block assembler that inserts new instructions
   // into @p *list at @p where.
   BasicBlockAssembler(const Instructions::iterator& where,
@@ -151,6 +194,14 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
     serializer_.set_source_range(source_range);
   }
 
+  // Sets the cache through which the created instructions are decoded. By
+  // default each of them is decoded on its own.
+  // @param cache the cache to use, which must outlive the assembler. May be
+  //     NULL.
+  void set_instruction_cache(InstructionCache* cache) {
+    serializer_.set_instruction_cache(cache);
+  }
+
   // @name Call instructions.
   // @{
   void call(const Immediate& dst);
@@ -191,6 +242,7 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
     void set_source_range(const SourceRange& source_range) {
       source_range_ = source_range;
     }
+    void set_instruction_cache(InstructionCache* cache) { cache_ = cache; }
 
     // Pushes back a reference type to be associated with a untyped reference.
     // @param type The type of the reference.
@@ -203,6 +255,9 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
 
     // Source range set to instructions appended by this serializer.
     SourceRange source_range_;
+
+    // The cache decoding the appended instructions, if any.
+    InstructionCache* cache_;
   };
 
   BasicBlockSerializer serializer_;
@@ -810,4 +810,32 @@ TEST_F(BasicBlockAssemblerTest, SetMultipleSourceRange) {
   ASSERT_EQ(instructions_.back().source_range(), range2);
 }
 
+TEST_F(BasicBlockAssemblerTest, InstructionCache) {
+  BasicBlockAssembler::InstructionCache cache;
+  asm_.set_instruction_cache(&cache);
+
+  // The same call is decoded once, and each copy gets its own reference.
+  asm_.call(Operand(Displacement(test_block_, 4)));
+  asm_.call(Operand(Displacement(test_block_, 4)));
+  EXPECT_EQ(1u, cache.size());
+  EXPECT_EQ(1u, cache.hits());
+  ASSERT_EQ(2u, instructions_.size());
+  const Instruction& first = instructions_.front();
+  const Instruction& second = instructions_.back();
+  EXPECT_EQ(first.size(), second.size());
+  EXPECT_EQ(0, ::memcmp(first.data(), second.data(), first.size()));
+  EXPECT_EQ(first.references(), second.references());
+  EXPECT_EQ(1u, second.references().size());
+  instructions_.clear();
+
+  // An instruction differing by an operand is decoded on its own.
+  asm_.push(Immediate(1U, assm::kSize32Bit));
+  asm_.push(Immediate(2U, assm::kSize32Bit));
+  EXPECT_EQ(3u, cache.size());
+  EXPECT_EQ(1u, cache.hits());
+  ASSERT_EQ(2u, instructions_.size());
+  EXPECT_NE(instructions_.front().representation().imm.dword,
+            instructions_.back().representation().imm.dword);
+}
+
 }  // namespace block_graph
@@ -21,6 +21,7 @@
 
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -125,6 +126,36 @@ bool SplitInstructionListAt(Offset offset,
   return true;
 }
 
+// Decomposes a block into a batch result, on a worker thread.
+class DecomposeBlockTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param block The block to decompose.
+  // @param result Receives the outcome of the decomposition.
+  DecomposeBlockTask(const BlockGraph::Block* block,
+                     BasicBlockDecomposer::BatchResult* result)
+      : block_(block), result_(result) {
+    DCHECK_NE(static_cast<const BlockGraph::Block*>(nullptr), block);
+    DCHECK_NE(static_cast<BasicBlockDecomposer::BatchResult*>(nullptr),
+              result);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    BasicBlockDecomposer decomposer(block_, &result_->subgraph);
+    result_->decomposed = decomposer.Decompose();
+    result_->contains_unsupported_instructions =
+        decomposer.contains_unsupported_instructions();
+  }
+  // @}
+
+ private:
+  const BlockGraph::Block* block_;
+  BasicBlockDecomposer::BatchResult* result_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecomposeBlockTask);
+};
+
 }  // namespace
 
 BasicBlockDecomposer::BasicBlockDecomposer(const BlockGraph::Block* block,
@@ -146,6 +177,43 @@ BasicBlockDecomposer::BasicBlockDecomposer(const BlockGraph::Block* block,
   }
 }
 
+void BasicBlockDecomposer::DecomposeBlocks(const ConstBlockVector& blocks,
+                                           size_t num_threads,
+                                           BatchResults* results) {
+  DCHECK_NE(static_cast<BatchResults*>(nullptr), results);
+
+  results->clear();
+  if (blocks.empty())
+    return;
+
+  ScopedVector<DecomposeBlockTask> tasks;
+  tasks.reserve(blocks.size());
+  results->reserve(blocks.size());
+  for (const BlockGraph::Block* block : blocks) {
+    results->push_back(new BatchResult());
+    tasks.push_back(new DecomposeBlockTask(block, results->back()));
+  }
+
+  if (num_threads <= 1) {
+    for (DecomposeBlockTask* task : tasks)
+      task->Run();
+    return;
+  }
+
+  // The name accessors of a block intern the empty string in the string table
+  // of the block-graph when the block has no name. Intern it before starting
+  // the workers so that they only ever read the string table.
+  blocks.front()->compiland_name();
+
+  base::DelegateSimpleThreadPool pool(
+      "BasicBlockDecomposer",
+      static_cast<int>(std::min(num_threads, tasks.size())));
+  pool.Start();
+  for (DecomposeBlockTask* task : tasks)
+    pool.AddWork(task);
+  pool.JoinAll();
+}
+
 bool BasicBlockDecomposer::Decompose() {
   DCHECK(subgraph_->basic_blocks().empty());
   DCHECK(subgraph_->block_descriptions().empty());
@@ -26,8 +26,10 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
 #include "base/callback.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
@@ -72,6 +74,23 @@ class BasicBlockDecomposer {
   typedef block_graph::BlockGraph BlockGraph;
   typedef BlockGraph::Offset Offset;
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef std::vector<const BlockGraph::Block*> ConstBlockVector;
+
+  // The outcome of the decomposition of one block by DecomposeBlocks.
+  struct BatchResult {
+    BatchResult()
+        : decomposed(false), contains_unsupported_instructions(false) {
+    }
+
+    // The decomposition of the block. This is only meaningful if decomposed
+    // is true.
+    BasicBlockSubGraph subgraph;
+    // The value returned by Decompose for the block.
+    bool decomposed;
+    // The value of contains_unsupported_instructions for the block.
+    bool contains_unsupported_instructions;
+  };
+  typedef ScopedVector<BatchResult> BatchResults;
 
   // Initialize the BasicBlockDecomposer instance.
   // @param block The block to be decomposed
@@ -101,6 +120,19 @@ class BasicBlockDecomposer {
     return contains_unsupported_instructions_;
   }
 
+  // Decomposes a batch of code blocks on a pool of threads, each block into
+  // its own subgraph. The decomposition of a block only reads the block and
+  // writes its own subgraph, so the results are the same as those of a serial
+  // decomposition of the blocks.
+  // @param blocks The code blocks to decompose. They, and the block-graph
+  //     they belong to, must not be modified until this returns.
+  // @param num_threads The number of worker threads. The blocks are
+  //     decomposed on the calling thread if this is at most 1.
+  // @param results Receives one result per block, in the order of @p blocks.
+  static void DecomposeBlocks(const ConstBlockVector& blocks,
+                              size_t num_threads,
+                              BatchResults* results);
+
  protected:
   typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
   typedef core::AddressSpace<Offset, size_t, BasicBlock*> BBAddressSpace;
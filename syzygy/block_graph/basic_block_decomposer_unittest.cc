@@ -514,6 +514,52 @@ TEST_F(BasicBlockDecomposerTest, ContainsJECXZ) {
   EXPECT_TRUE(bbd.contains_unsupported_instructions());
 }
 
+TEST_F(BasicBlockDecomposerTest, DecomposeBlocks) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  BlockGraph::Block* jecxz = block_graph_.AddBlock(
+      BlockGraph::CODE_BLOCK, 4, "jecxz");
+  ASSERT_TRUE(jecxz != NULL);
+  jecxz->set_section(text_section_->id());
+  const uint8_t kAssembly[] = {0xE3, 0x01, 0x49, 0xC3};
+  jecxz->CopyData(arraysize(kAssembly), kAssembly);
+  jecxz->SetReference(1,
+      BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF, 1, jecxz, 3, 3));
+
+  BasicBlockSubGraph expected;
+  BasicBlockDecomposer bbd(assembly_func_, &expected);
+  ASSERT_TRUE(bbd.Decompose());
+
+  BasicBlockDecomposer::ConstBlockVector blocks;
+  blocks.push_back(assembly_func_);
+  blocks.push_back(jecxz);
+  blocks.push_back(assembly_func_);
+
+  // The results are the same, and in the same order, with and without
+  // worker threads.
+  for (size_t num_threads : {1, 4}) {
+    BasicBlockDecomposer::BatchResults results;
+    BasicBlockDecomposer::DecomposeBlocks(blocks, num_threads, &results);
+    ASSERT_EQ(blocks.size(), results.size());
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      const BasicBlockDecomposer::BatchResult* result = results[i];
+      EXPECT_EQ(blocks[i], result->subgraph.original_block());
+      if (blocks[i] == jecxz) {
+        EXPECT_FALSE(result->decomposed);
+        EXPECT_TRUE(result->contains_unsupported_instructions);
+        continue;
+      }
+
+      EXPECT_TRUE(result->decomposed);
+      EXPECT_FALSE(result->contains_unsupported_instructions);
+      EXPECT_EQ(expected.basic_blocks().size(),
+                result->subgraph.basic_blocks().size());
+      EXPECT_EQ(expected.block_descriptions().size(),
+                result->subgraph.block_descriptions().size());
+    }
+  }
+}
+
 TEST_F(BasicBlockDecomposerTest, ContainsCRC32) {
   const uint8_t kAssembly[] = {
       /*
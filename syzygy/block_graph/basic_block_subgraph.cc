@@ -57,6 +57,7 @@ BasicBlockSubGraph::BlockDescription* BasicBlockSubGraph::AddBlockDescription(
     SectionId section,
     Size alignment,
     BlockAttributes attributes) {
+  cached_analysis_.reset();
   block_descriptions_.push_back(BlockDescription());
   BlockDescription* desc = &block_descriptions_.back();
   desc->name.assign(name.begin(), name.end());
@@ -73,6 +74,7 @@ block_graph::BasicCodeBlock* BasicBlockSubGraph::AddBasicCodeBlock(
     const base::StringPiece& name) {
   DCHECK(!name.empty());
 
+  cached_analysis_.reset();
   BlockId id = next_block_id_++;
   std::unique_ptr<BasicCodeBlock> new_code_block(
       new BasicCodeBlock(this, name, id));
@@ -88,6 +90,7 @@ block_graph::BasicDataBlock* BasicBlockSubGraph::AddBasicDataBlock(
     const uint8_t* data) {
   DCHECK(!name.empty());
 
+  cached_analysis_.reset();
   BlockId id = next_block_id_++;
   std::unique_ptr<BasicDataBlock> new_data_block(
       new BasicDataBlock(this, name, id, data, size));
@@ -98,6 +101,7 @@ block_graph::BasicDataBlock* BasicBlockSubGraph::AddBasicDataBlock(
 }
 
 block_graph::BasicEndBlock* BasicBlockSubGraph::AddBasicEndBlock() {
+  cached_analysis_.reset();
   BlockId id = next_block_id_++;
   std::unique_ptr<BasicEndBlock> new_end_block(new BasicEndBlock(this, id));
   bool inserted = basic_blocks_.insert(new_end_block.get()).second;
@@ -109,6 +113,7 @@ block_graph::BasicEndBlock* BasicBlockSubGraph::AddBasicEndBlock() {
 void BasicBlockSubGraph::Remove(BasicBlock* bb) {
   DCHECK(basic_blocks_.find(bb) != basic_blocks_.end());
 
+  cached_analysis_.reset();
   basic_blocks_.erase(bb);
 }
 
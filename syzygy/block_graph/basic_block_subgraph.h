@@ -18,8 +18,10 @@
 #define SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_SUBGRAPH_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <utility>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -70,6 +72,16 @@ class BasicBlockSubGraph {
   typedef std::set<BasicBlock*, BasicBlockIdLess> BBCollection;
   typedef std::map<const BasicBlock*, bool> ReachabilityMap;
 
+  // An analysis of the control flow of the sub-graph, cached on it so that
+  // the transforms applied to it in turn may share it. It is discarded when
+  // a basic block or a block description is added or removed through the
+  // sub-graph. A change to the successors of existing basic blocks must be
+  // followed by a call to InvalidateCachedAnalysis.
+  class CachedAnalysis {
+   public:
+    virtual ~CachedAnalysis() {}
+  };
+
   // Initialize a basic block sub-graph.
   BasicBlockSubGraph();
   // Releases all resources.
@@ -87,6 +99,10 @@ class BasicBlockSubGraph {
     return block_descriptions_;
   }
   BlockDescriptionList& block_descriptions() { return block_descriptions_; }
+  CachedAnalysis* cached_analysis() const { return cached_analysis_.get(); }
+  void set_cached_analysis(std::unique_ptr<CachedAnalysis> analysis) {
+    cached_analysis_ = std::move(analysis);
+  }
   // @}
 
   // Initializes and returns a new block description.
@@ -134,6 +150,10 @@ class BasicBlockSubGraph {
   // @pre @p bb must be in the graph.
   void Remove(BasicBlock* bb);
 
+  // Discards the cached analysis, after a change to the control flow that
+  // the sub-graph can't see.
+  void InvalidateCachedAnalysis() { cached_analysis_.reset(); }
+
   // Returns true if the basic-block composition is valid. This tests the
   // for following conditions.
   // 1. Each basic-block is used in at most one BlockDescription.
@@ -178,6 +198,9 @@ class BasicBlockSubGraph {
   // Our block ID allocator.
   BlockId next_block_id_;
 
+  // The cached analysis of the control flow, if any.
+  std::unique_ptr<CachedAnalysis> cached_analysis_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BasicBlockSubGraph);
 };
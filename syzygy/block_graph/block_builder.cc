@@ -22,9 +22,11 @@
 
 #include <limits>
 #include <map>
+#include <set>
 #include <utility>
 #include <vector>
 
+#include "base/memory/scoped_vector.h"
 #include "syzygy/assm/assembler.h"
 #include "syzygy/assm/buffer_serializer.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -139,6 +141,15 @@ class MergeContext {
   // @param subgraph The subgraph.
   void TransferReferrers(const BasicBlockSubGraph* subgraph) const;
 
+  // Transfers the references to the original block that the block graph
+  // currently holds, rather than those recorded in the subgraph when it was
+  // decomposed, to the newly generated block or blocks.
+  // @param skipped_blocks The blocks whose references are left alone.
+  // @returns true on success, false if a reference doesn't refer to an
+  //     original basic block.
+  bool TransferCurrentReferrers(
+      const std::set<const Block*>& skipped_blocks) const;
+
   // A clean-up function to remove the original block from which @p subgraph
   // is derived (if any) from the block graph. This must only be performed
   // after having updated the block graph with the new blocks and transferred
@@ -176,6 +187,9 @@ class MergeContext {
     // Stores the block that basic_block will be manifested in.
     Block* block;
 
+    // The position of basic_block in the ordering of block.
+    size_t layout_index;
+
     // Current start offset for basic_block in block.
     Offset start_offset;
 
@@ -194,6 +208,17 @@ class MergeContext {
   typedef std::map<const BasicBlock*, BasicBlockLayoutInfo>
       BasicBlockLayoutInfoMap;
 
+  // A successor that branches to a basic block of the same block, and that
+  // may be manifested short.
+  struct BranchLayoutInfo {
+    // The position of the basic block of the successor in the ordering.
+    size_t source_index;
+    // The index of the successor in the layout info of its basic block.
+    size_t successor_index;
+    // The position of the destination basic block in the ordering.
+    size_t destination_index;
+  };
+
   // Update the new block with the source range for the bytes in the
   // range [new_offset, new_offset + new_size).
   // @param source_range The source range (if any) to assign.
@@ -248,7 +273,9 @@ class MergeContext {
 
   // Generates a layout for @p order. This layout will arrange each basic block
   // in the ordering back-to-back with minimal reach encodings on each
-  // successor, while respecting basic block alignments.
+  // successor, while respecting basic block alignments. The successors start
+  // out short and only those that don't reach their destination are relaxed,
+  // which takes a pass or two over the ordering.
   // @param order The basic block ordering to process.
   bool GenerateBlockLayout(const BasicBlockOrdering& order);
 
@@ -275,15 +302,6 @@ class MergeContext {
   // Returns the maximal successor size for @p condition.
   static Size GetLongSuccessorSize(Successor::Condition condition);
 
-  // Computes and returns the required successor size for @p successor.
-  // @param info The layout info for the basic block.
-  // @param start_offset Offset from the start of @p info.basic_block to
-  //     the first byte of the successor.
-  // @param successor The successor to size.
-  Size ComputeRequiredSuccessorSize(const BasicBlockLayoutInfo& info,
-                                    Offset start_offset,
-                                    const SuccessorLayoutInfo& successor);
-
   // Finds the layout info for a given basic block.
   // @param bb The basic block whose layout info is desired.
   BasicBlockLayoutInfo& FindLayoutInfo(const BasicBlock* bb);
@@ -354,6 +372,60 @@ void MergeContext::TransferReferrers(const BasicBlockSubGraph* subgraph) const {
     UpdateReferrers(it->second.basic_block);
 }
 
+bool MergeContext::TransferCurrentReferrers(
+    const std::set<const Block*>& skipped_blocks) const {
+  if (original_block_ == NULL)
+    return true;
+
+  // Index the new locations of the original basic blocks by their offsets in
+  // the original block.
+  typedef std::map<Offset, const BasicBlockLayoutInfo*> LocationMap;
+  LocationMap locations;
+  BasicBlockLayoutInfoMap::const_iterator it = layout_info_.begin();
+  for (; it != layout_info_.end(); ++it) {
+    Offset offset = it->second.basic_block->offset();
+    if (offset != BasicBlock::kNoOffset)
+      locations[offset] = &it->second;
+  }
+
+  // The referrers are copied, as updating the references changes them.
+  Block::ReferrerSet referrers = original_block_->referrers();
+  Block::ReferrerSet::const_iterator referrer = referrers.begin();
+  for (; referrer != referrers.end(); ++referrer) {
+    Block* referring_block = referrer->first;
+    if (skipped_blocks.find(referring_block) != skipped_blocks.end())
+      continue;
+
+    BlockGraph::Reference old_ref;
+    bool found = referring_block->GetReference(referrer->second, &old_ref);
+    DCHECK(found);
+    DCHECK_EQ(original_block_, old_ref.referenced());
+
+    LocationMap::const_iterator location = locations.find(old_ref.base());
+    if (location == locations.end()) {
+      LOG(ERROR) << "Reference from \"" << referring_block->name()
+                 << "\" does not refer to a basic block of \""
+                 << original_block_->name() << "\".";
+      return false;
+    }
+
+    // The base of the reference is directed to the corresponding BB's start
+    // address in the new block.
+    const BasicBlockLayoutInfo& info = *location->second;
+    BlockGraph::Reference new_ref(
+        old_ref.type(),
+        old_ref.size(),
+        info.block,
+        info.start_offset + old_ref.offset() - old_ref.base(),
+        info.start_offset);
+
+    bool is_new = referring_block->SetReference(referrer->second, new_ref);
+    DCHECK(!is_new);
+  }
+
+  return true;
+}
+
 void MergeContext::CopySourceRange(const SourceRange& source_range,
                                    Offset new_offset,
                                    Size new_size,
@@ -590,8 +662,9 @@ bool MergeContext::CopyData(const BasicDataBlock* data_block,
 bool MergeContext::InitializeBlockLayout(const BasicBlockOrdering& order,
                                          Block* new_block) {
   // Populate the initial layout info.
+  size_t layout_index = 0;
   BasicBlockOrderingConstIter it = order.begin();
-  for (; it != order.end(); ++it) {
+  for (; it != order.end(); ++it, ++layout_index) {
     const BasicBlock* bb = *it;
 
     // Propagate BB alignment to the parent block.
@@ -604,6 +677,7 @@ bool MergeContext::InitializeBlockLayout(const BasicBlockOrdering& order,
     BasicBlockLayoutInfo& info = layout_info_[bb];
     info.basic_block = bb;
     info.block = new_block;
+    info.layout_index = layout_index;
     info.start_offset = 0;
     info.basic_block_size = kInvalidSize;
 
@@ -735,78 +809,113 @@ bool MergeContext::InitializeBlockLayout(const BasicBlockOrdering& order,
 }
 
 bool MergeContext::GenerateBlockLayout(const BasicBlockOrdering& order) {
+  DCHECK(!order.empty());
+
+  // Gather the layout info of the ordering once, so that the passes below
+  // don't look it up. Every manifested successor is then sized optimistically:
+  // those that branch within the block start out short, and the others are
+  // long for good.
+  std::vector<BasicBlockLayoutInfo*> layout;
+  std::vector<BranchLayoutInfo> branches;
+  layout.reserve(order.size());
   BasicBlockOrderingConstIter it = order.begin();
+  for (; it != order.end(); ++it) {
+    BasicBlockLayoutInfo& info = FindLayoutInfo(*it);
+    DCHECK_EQ(layout.size(), info.layout_index);
+    DCHECK(layout.empty() || layout.front()->block == info.block);
+    layout.push_back(&info);
 
-  // Loop over the layout, expanding successors until stable.
-  while (true) {
-    bool expanded_successor = false;
+    for (size_t i = 0; i < arraysize(info.successors); ++i) {
+      SuccessorLayoutInfo& successor = info.successors[i];
+
+      // Skip over unused and elided successors.
+      if (successor.condition == Successor::kInvalidCondition)
+        continue;
+
+      successor.size = GetLongSuccessorSize(successor.condition);
+      const BasicBlockReference& ref = successor.reference;
+      if (ref.referred_type() != BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK)
+        continue;
+      DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), ref.basic_block());
+      const BasicBlockLayoutInfo& dest = FindLayoutInfo(ref.basic_block());
+      if (dest.block != info.block)
+        continue;
+
+      successor.size = GetShortSuccessorSize(successor.condition);
+      BranchLayoutInfo branch = {info.layout_index, i, dest.layout_index};
+      branches.push_back(branch);
+    }
+  }
 
+  // The growth of the layout before each basic block, within a pass.
+  std::vector<Offset> deltas(layout.size(), 0);
+
+  // Loop over the layout, relaxing successors until stable. A successor only
+  // ever grows from short to long, so this terminates.
+  while (true) {
     // Update the start offset for each of the BBs, respecting the BB alignment
     // constraints.
-    it = order.begin();
     Offset next_block_start = 0;
-    Block* new_block = NULL;
-    for (; it != order.end(); ++it) {
-      BasicBlockLayoutInfo& info = FindLayoutInfo(*it);
+    for (size_t i = 0; i < layout.size(); ++i) {
+      BasicBlockLayoutInfo& info = *layout[i];
       next_block_start = common::AlignUp(next_block_start,
                                          info.basic_block->alignment());
       info.start_offset = next_block_start;
-
-      if (new_block == NULL)
-        new_block = info.block;
-      DCHECK(new_block == info.block);
-
       next_block_start += info.basic_block_size +
                           info.successors[0].size +
                           info.successors[1].size;
     }
 
-    // See whether there's a need to expand the successor sizes.
-    it = order.begin();
-    for (; it != order.end(); ++it) {
-      const BasicBlock* bb = *it;
-      BasicBlockLayoutInfo& info = FindLayoutInfo(bb);
-
-      // Compute the start offset for this block's first successor.
-      Offset start_offset = info.start_offset + info.basic_block_size;
-      for (size_t i = 0; i < arraysize(info.successors); ++i) {
-        SuccessorLayoutInfo& successor = info.successors[i];
-
-        // Exit the loop if this (and possibly the subsequent) successor
-        // is un-manifested.
-        if (successor.condition == Successor::kInvalidCondition &&
-            successor.successor == NULL) {
-          break;
-        }
-
-        // Skip over elided successors.
-        DCHECK_NE(reinterpret_cast<Successor*>(NULL), successor.successor);
-        if (successor.condition == Successor::kInvalidCondition)
-          continue;
-
-        // Compute the new size and update the start offset for the next
-        // successor (if any).
-        Size new_size =
-            ComputeRequiredSuccessorSize(info, start_offset, successor);
-        start_offset += new_size;
-
-        // Keep the biggest offset used by this jump. A jump may temporarily
-        // appear shorter when the start offset of this basic block has moved
-        // but the offset of the target basic block still needs to be updated
-        // within this iteration.
-        new_size = std::max(successor.size, new_size);
-
-        // Check whether we're expanding this successor.
-        if (new_size != successor.size) {
-          successor.size = new_size;
-          expanded_successor = true;
-        }
+    // Relax the short successors that are out of reach. The start offsets
+    // aren't updated as the successors grow, rather the growth before each
+    // basic block is accumulated in deltas, so that a successor pushed out of
+    // reach by another is relaxed in the same pass. This ignores the padding
+    // that alignment may absorb, which the next pass corrects.
+    bool expanded_successor = false;
+    Offset growth = 0;
+    size_t next_delta = 0;
+    for (size_t i = 0; i < branches.size(); ++i) {
+      const BranchLayoutInfo& branch = branches[i];
+      for (; next_delta <= branch.source_index; ++next_delta)
+        deltas[next_delta] = growth;
+
+      BasicBlockLayoutInfo& info = *layout[branch.source_index];
+      SuccessorLayoutInfo& successor = info.successors[branch.successor_index];
+      Size short_size = GetShortSuccessorSize(successor.condition);
+      if (successor.size != short_size)
+        continue;
+
+      // Compute the start offset of the successor.
+      Offset start_offset = info.start_offset + deltas[branch.source_index] +
+                            info.basic_block_size;
+      if (branch.successor_index != 0)
+        start_offset += info.successors[0].size;
+
+      // A destination that's further down the ordering has grown by at least
+      // as much as this successor's basic block.
+      const BasicBlockLayoutInfo& dest = *layout[branch.destination_index];
+      Offset dest_offset = dest.start_offset;
+      if (branch.destination_index <= branch.source_index)
+        dest_offset += deltas[branch.destination_index];
+      else
+        dest_offset += growth;
+
+      // Are we in-bounds for a short reference?
+      Offset destination_offset = dest_offset - (start_offset + short_size);
+      if (destination_offset <= std::numeric_limits<int8_t>::max() &&
+          destination_offset >= std::numeric_limits<int8_t>::min()) {
+        continue;
       }
+
+      successor.size = GetLongSuccessorSize(successor.condition);
+      growth += successor.size - short_size;
+      expanded_successor = true;
     }
 
     if (!expanded_successor) {
       // We've achieved a stable layout and we know that next_block_start
       // is the size of the new block, so resize it and allocate the data now.
+      Block* new_block = layout.front()->block;
       new_block->set_size(next_block_start);
       new_block->AllocateData(next_block_start);
 
@@ -1088,42 +1197,6 @@ Size MergeContext::GetLongSuccessorSize(Successor::Condition condition) {
   }
 }
 
-Size MergeContext::ComputeRequiredSuccessorSize(
-    const BasicBlockLayoutInfo& info,
-    Offset start_offset,
-    const SuccessorLayoutInfo& successor) {
-  switch (successor.reference.referred_type()) {
-    case BasicBlockReference::REFERRED_TYPE_BLOCK:
-      return GetLongSuccessorSize(successor.condition);
-
-    case BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK: {
-      Size short_size = GetShortSuccessorSize(successor.condition);
-      const BasicBlock* dest_bb = successor.reference.basic_block();
-      DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), dest_bb);
-      const BasicBlockLayoutInfo& dest = FindLayoutInfo(dest_bb);
-
-      // If the destination is within the same destination block,
-      // let's see if we can use a short reach here.
-      if (info.block == dest.block) {
-        Offset destination_offset =
-            dest.start_offset - (start_offset + short_size);
-
-        // Are we in-bounds for a short reference?
-        if (destination_offset <= std::numeric_limits<int8_t>::max() &&
-            destination_offset >= std::numeric_limits<int8_t>::min()) {
-          return short_size;
-        }
-      }
-
-      return GetLongSuccessorSize(successor.condition);
-    }
-
-    default:
-      NOTREACHED() << "Impossible Successor reference type.";
-      return 0;
-  }
-}
-
 MergeContext::BasicBlockLayoutInfo& MergeContext::FindLayoutInfo(
     const BasicBlock* bb) {
   BasicBlockLayoutInfoMap::iterator it = layout_info_.find(bb);
@@ -1205,4 +1278,50 @@ bool BlockBuilder::Merge(BasicBlockSubGraph* subgraph) {
   return true;
 }
 
+bool BlockBuilder::Merge(const std::vector<BasicBlockSubGraph*>& subgraphs) {
+  for (BasicBlockSubGraph* subgraph : subgraphs) {
+    DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+    if (!EndBlocksAreWellPlaced(subgraph))
+      return false;
+  }
+
+  // Generate the new blocks of every subgraph. Their references to the
+  // original blocks of the other subgraphs are transferred below, with the
+  // other references held by the block graph.
+  ScopedVector<MergeContext> contexts;
+  contexts.reserve(subgraphs.size());
+  std::set<const Block*> original_blocks;
+  for (BasicBlockSubGraph* subgraph : subgraphs) {
+    contexts.push_back(new MergeContext(block_graph_,
+                                        subgraph->original_block(),
+                                        &tag_info_map_));
+    if (!contexts.back()->GenerateBlocks(*subgraph))
+      return false;
+    if (subgraph->original_block() != NULL) {
+      bool inserted = original_blocks.insert(subgraph->original_block()).second;
+      DCHECK(inserted);
+    }
+  }
+
+  for (MergeContext* context : contexts) {
+    if (!context->TransferCurrentReferrers(original_blocks))
+      return false;
+  }
+
+  // The original blocks may refer to each other, so they are all disconnected
+  // before any of them is removed.
+  for (const Block* original_block : original_blocks)
+    const_cast<Block*>(original_block)->RemoveAllReferences();
+  for (size_t i = 0; i < subgraphs.size(); ++i) {
+    contexts[i]->RemoveOriginalBlock(subgraphs[i]);
+
+    // Track the newly created blocks.
+    new_blocks_.insert(new_blocks_.end(),
+                       contexts[i]->new_blocks().begin(),
+                       contexts[i]->new_blocks().end());
+  }
+
+  return true;
+}
+
 }  // namespace block_graph
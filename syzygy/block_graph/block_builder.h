@@ -17,6 +17,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_BUILDER_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_BUILDER_H_
 
+#include <vector>
+
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/tags.h"
@@ -35,6 +37,16 @@ class BlockBuilder {
   // @returns true on success, false otherwise.
   bool Merge(BasicBlockSubGraph* subgraph);
 
+  // Merge several subgraphs into the block graph. This has the effect of
+  // merging each of them in turn, but the subgraphs may all have been derived
+  // from the block graph before any of them is merged: all the new blocks are
+  // created before the references to the original blocks, including those of
+  // the new blocks, are transferred to them.
+  // @param subgraphs The subgraphs to be merged. They must be derived from
+  //     distinct original blocks.
+  // @returns true on success, false otherwise.
+  bool Merge(const std::vector<BasicBlockSubGraph*>& subgraphs);
+
   // @returns the set of new blocks created upon merging in one or more
   //     subgraphs.
   const BlockVector& new_blocks() const { return new_blocks_; }
@@ -585,6 +585,39 @@ TEST_F(BlockBuilderTest, OutofReachJmpLayout) {
   EXPECT_EQ(expected_refs, new_block->references());
 }
 
+TEST_F(BlockBuilderTest, CascadingRelaxationLayout) {
+  // 60 + 70 + 2 = 132, the BB1->BB4 branch is out of reach. Relaxing it puts
+  // BB1 at -(62 + 6 + 60 + 2) = -130 from the BB2->BB1 jump, which must then
+  // be relaxed as well.
+  Block* new_block = CreateLayout(62, 60, 70, 1, false);
+  ASSERT_TRUE(new_block != NULL);
+
+  size_t expected_size = 62 +
+                         assm::kLongBranchSize +
+                         60 +
+                         assm::kLongJumpSize +
+                         70 +
+                         1;
+  EXPECT_EQ(expected_size, new_block->size());
+  Block::ReferenceMap expected_refs;
+  expected_refs.insert(
+      std::make_pair(62 + assm::kLongBranchOpcodeSize,
+                     Reference(BlockGraph::PC_RELATIVE_REF,
+                               4,
+                               new_block,
+                               expected_size - 1,
+                               expected_size - 1)));
+  size_t succ_location = 62 +
+                         assm::kLongBranchSize +
+                         60 +
+                         assm::kLongJumpOpcodeSize;
+  expected_refs.insert(
+      std::make_pair(succ_location,
+                     Reference(BlockGraph::PC_RELATIVE_REF,
+                               4, new_block, 0, 0)));
+  EXPECT_EQ(expected_refs, new_block->references());
+}
+
 TEST_F(BlockBuilderTest, MergeAssemblesSourceRangesCorrectly) {
   ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
   ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
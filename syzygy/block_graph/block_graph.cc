@@ -16,8 +16,10 @@
 
 #include <limits>
 
+#include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
 
 // Pretty prints a BlockInfo to an ostream. This has to be outside of any
 // namespaces so that operator<< is found properly.
@@ -70,44 +72,24 @@ static_assert(arraysize(kBlockType) == BlockGraph::BLOCK_TYPE_MAX,
               "Block type not in sync.");
 
 // Shift all items in an offset -> item map by 'distance', provided the initial
-// item offset was >= @p offset.
-template<typename ItemType>
+// item offset was >= @p offset. This works with any sorted map, whether or not
+// it invalidates its iterators on insertion.
+template<typename ItemMap>
 void ShiftOffsetItemMap(BlockGraph::Offset offset,
                         BlockGraph::Offset distance,
-                        std::map<BlockGraph::Offset, ItemType>* items) {
+                        ItemMap* items) {
   DCHECK_GE(offset, 0);
   DCHECK_NE(distance, 0);
   DCHECK(items != NULL);
 
-  typedef std::map<BlockGraph::Offset, ItemType> ItemMap;
-
-  // Get iterators to all of the items that need changing.
-  std::vector<ItemMap::iterator> item_its;
-  ItemMap::iterator item_it = items->lower_bound(offset);
-  while (item_it != items->end()) {
-    item_its.push_back(item_it);
-    ++item_it;
-  }
-
-  // Get the direction and bounds of the iteration. We need to walk through
-  // the iterators in a different order depending on if we're shifting left
-  // or right. This is to ensure that earlier shifts don't land on the values
-  // of later unshifted offsets.
-  SSIZE_T start = 0;
-  SSIZE_T stop = item_its.size();
-  int step = 1;
-  if (distance > 0) {
-    start = stop - 1;
-    stop = -1;
-    step = -1;
-  }
-
-  for (SSIZE_T i = start; i != stop; i += step) {
-    item_it = item_its[i];
-    items->insert(std::make_pair(item_it->first + distance,
-                                 item_it->second));
-    items->erase(item_it);
-  }
+  // Take out all of the items that need changing, then put them back at their
+  // new offsets. Callers guarantee that the destination offsets are free.
+  typename ItemMap::iterator first = items->lower_bound(offset);
+  std::vector<std::pair<BlockGraph::Offset, typename ItemMap::mapped_type>>
+      moved_items(first, items->end());
+  items->erase(first, items->end());
+  for (const auto& item : moved_items)
+    items->insert(std::make_pair(item.first + distance, item.second));
 }
 
 void ShiftReferences(BlockGraph::Block* block,
@@ -205,6 +187,25 @@ const char* BlockAttributeToString(BlockGraph::BlockAttributeEnum attr) {
   }
 }
 
+// The names of the labels of all the block graphs. Labels are copied in and
+// out of blocks and may outlive them, so their names are interned for the
+// lifetime of the process rather than in the string table of a block graph.
+// The same symbol names come up over and over, and a label is then only a
+// pointer and its attributes.
+struct LabelNameTable {
+  base::Lock lock;
+  core::StringTable names;
+};
+
+base::LazyInstance<LabelNameTable>::Leaky label_name_table =
+    LAZY_INSTANCE_INITIALIZER;
+
+const std::string& InternLabelName(const base::StringPiece& name) {
+  LabelNameTable* table = label_name_table.Pointer();
+  base::AutoLock auto_lock(table->lock);
+  return table->names.InternString(name);
+}
+
 }  // namespace
 
 const char* BlockGraph::ImageFormatToString(ImageFormat format) {
@@ -353,13 +354,10 @@ BlockGraph::Block* BlockGraph::CopyBlock(Block* block,
 
   // If block data exist, copy them.
   if (block->data() != nullptr) {
-    // If |block| owns data then duplicate; otherwise just add reference.
-    if (block->owns_data()) {
-      uint8_t* data = new_block->CopyData(block->data_size(), block->data());
-      CHECK(data != nullptr);
-    } else {
-      new_block->SetData(block->data(), block->data_size());
-    }
+    // If |block| owns data then share it until either block writes to it;
+    // otherwise just add reference.
+    new_block->SetData(block->data(), block->data_size());
+    new_block->data_buffer_ = block->data_buffer_;
   }
 
   // Copy self-references and external references.
@@ -530,6 +528,31 @@ bool BlockGraph::AddressSpace::InsertBlock(RelativeAddress addr, Block* block) {
   return InsertImpl(addr, block);
 }
 
+bool BlockGraph::AddressSpace::InsertBlocks(const BlockAddressVector& blocks) {
+  block_addresses_.reserve(block_addresses_.size() + blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    RelativeAddress addr = blocks[i].first;
+    Block* block = blocks[i].second;
+    DCHECK(block != NULL);
+
+    // Try appending the block before falling back to a full insertion.
+    if (block->size() > 0) {
+      Range range(addr, block->size());
+      if (!address_space_.Push(range, block) &&
+          !address_space_.Insert(range, block)) {
+        return false;
+      }
+    }
+
+    bool inserted =
+        block_addresses_.insert(std::make_pair(block, addr)).second;
+    DCHECK(inserted);
+    block->set_addr(addr);
+  }
+
+  return true;
+}
+
 BlockGraph::Block* BlockGraph::AddressSpace::GetBlockByAddress(
     RelativeAddress addr) const {
   return GetContainingBlock(addr, 1);
@@ -795,9 +818,20 @@ bool BlockGraph::Section::Load(core::InArchive* in_archive) {
       in_archive->Load(&characteristics_);
 }
 
+BlockGraph::Label::Label(const base::StringPiece& name,
+                         LabelAttributes attributes)
+    : name_(&InternLabelName(name)), attributes_(attributes) {
+}
+
+const std::string& BlockGraph::Label::name() const {
+  if (name_ == NULL)
+    return InternLabelName("");
+  return *name_;
+}
+
 std::string BlockGraph::Label::ToString() const {
   return base::StringPrintf("%s (%s)",
-                            name_.c_str(),
+                            name().c_str(),
                             LabelAttributesToString(attributes_).c_str());
 }
 
@@ -879,7 +913,6 @@ BlockGraph::Block::Block(BlockGraph* block_graph)
       block_graph_(block_graph),
       section_(kInvalidSectionId),
       attributes_(0U),
-      owns_data_(false),
       data_(NULL),
       data_size_(0U) {
   DCHECK(block_graph != NULL);
@@ -902,7 +935,6 @@ BlockGraph::Block::Block(BlockId id,
       block_graph_(block_graph),
       section_(kInvalidSectionId),
       attributes_(0U),
-      owns_data_(false),
       data_(NULL),
       data_size_(0U) {
   DCHECK(block_graph != NULL);
@@ -911,8 +943,6 @@ BlockGraph::Block::Block(BlockId id,
 
 BlockGraph::Block::~Block() {
   DCHECK(block_graph_ != NULL);
-  if (owns_data_)
-    delete [] data_;
 }
 
 void BlockGraph::Block::set_name(const base::StringPiece& name) {
@@ -940,20 +970,11 @@ uint8_t* BlockGraph::Block::AllocateRawData(size_t data_size) {
   DCHECK_GT(data_size, 0u);
   DCHECK_LE(data_size, size_);
 
-  uint8_t* new_data = new uint8_t[data_size];
-  if (!new_data)
-    return NULL;
-
-  if (owns_data()) {
-    DCHECK(data_ != NULL);
-    delete [] data_;
-  }
-
-  data_ = new_data;
+  data_buffer_ = new DataBuffer(data_size);
+  data_ = data_buffer_->data();
   data_size_ = data_size;
-  owns_data_ = true;
 
-  return new_data;
+  return data_buffer_->data();
 }
 
 void BlockGraph::Block::InsertData(Offset offset,
@@ -1086,10 +1107,7 @@ void BlockGraph::Block::SetData(const uint8_t* data, size_t data_size) {
          (data_size != 0 && data != NULL));
   DCHECK(data_size <= size_);
 
-  if (owns_data_)
-    delete [] data_;
-
-  owns_data_ = false;
+  data_buffer_ = NULL;
   data_ = data;
   data_size_ = data_size;
 }
@@ -1116,34 +1134,38 @@ const uint8_t* BlockGraph::Block::ResizeData(size_t new_size) {
   if (new_size == data_size_)
     return data_;
 
-  if (!owns_data() && new_size < data_size_) {
-    // Not in our ownership and shrinking. We only need to adjust our length.
-    data_size_ = new_size;
-  } else {
-    // Either our own data, or it's growing (or both).
-    uint8_t* new_data = NULL;
-
-    // If the new size is non-zero we need to reallocate.
-    if (new_size > 0) {
-      new_data = new uint8_t[new_size];
-      CHECK(new_data);
-
-      // Copy the (head of the) old data.
-      memcpy(new_data, data_, std::min(data_size_, new_size));
-      if (new_size > data_size_) {
-        // Zero the tail.
-        memset(new_data + data_size_, 0, new_size - data_size_);
-      }
-    }
+  if (new_size == 0) {
+    // Release the data.
+    data_buffer_ = NULL;
+    data_ = NULL;
+    data_size_ = 0;
+    return data_;
+  }
 
-    if (owns_data())
-      delete [] data_;
+  if (new_size < data_size_) {
+    // Shrinking. Whether or not the data is ours, we only need to adjust our
+    // length.
+    data_size_ = new_size;
+    return data_;
+  }
 
-    owns_data_ = true;
-    data_ = new_data;
+  // Growing into the room of our own buffer only needs to zero the tail.
+  if (owns_data() && !shares_data() && new_size <= data_buffer_->size()) {
+    ::memset(data_buffer_->data() + data_size_, 0, new_size - data_size_);
     data_size_ = new_size;
+    return data_;
   }
 
+  // Otherwise, copy the old data to a new buffer and zero the tail.
+  scoped_refptr<DataBuffer> new_buffer(new DataBuffer(new_size));
+  if (data_size_ != 0)
+    ::memcpy(new_buffer->data(), data_, data_size_);
+  ::memset(new_buffer->data() + data_size_, 0, new_size - data_size_);
+
+  data_buffer_ = new_buffer;
+  data_ = data_buffer_->data();
+  data_size_ = new_size;
+
   return data_;
 }
 
@@ -1151,18 +1173,16 @@ uint8_t* BlockGraph::Block::GetMutableData() {
   DCHECK_NE(0U, data_size_);
   DCHECK(data_ != NULL);
 
-  // Make a copy if we don't already own the data.
-  if (!owns_data()) {
-    uint8_t* new_data = new uint8_t[data_size_];
-    if (new_data == NULL)
-      return NULL;
-    memcpy(new_data, data_, data_size_);
-    data_ = new_data;
-    owns_data_ = true;
+  // Make a copy if we don't already own the data, or share it.
+  if (!owns_data() || shares_data()) {
+    scoped_refptr<DataBuffer> new_buffer(new DataBuffer(data_size_));
+    ::memcpy(new_buffer->data(), data_, data_size_);
+    data_buffer_ = new_buffer;
+    data_ = data_buffer_->data();
   }
-  DCHECK(owns_data_);
+  DCHECK(owns_data());
 
-  return const_cast<uint8_t*>(data_);
+  return data_buffer_->data();
 }
 
 bool BlockGraph::Block::HasExternalReferrers() const {
@@ -1244,6 +1264,36 @@ bool BlockGraph::Block::SetReference(Offset offset, const Reference& ref) {
   return inserted;
 }
 
+void BlockGraph::Block::InsertReferences(
+    const std::vector<std::pair<Offset, Reference>>& references) {
+  // Each reference goes right before the reference that follows the one
+  // inserted before it, which is the end of the map while building it.
+  ReferenceMap::iterator hint = references_.end();
+  for (size_t i = 0; i < references.size(); ++i) {
+    Offset offset = references[i].first;
+    const Reference& ref = references[i].second;
+    DCHECK(ref.referenced() != NULL);
+    DCHECK(ref.IsValid());
+    DCHECK(i == 0 || references[i - 1].first < offset);
+    DCHECK(references_.find(offset) == references_.end());
+
+    if (hint != references_.begin()) {
+      ReferenceMap::iterator previous = hint;
+      --previous;
+      if (previous->first > offset)
+        hint = references_.lower_bound(offset);
+    }
+    if (hint != references_.end() && hint->first < offset)
+      hint = references_.lower_bound(offset);
+
+    hint = references_.insert(hint, std::make_pair(offset, ref));
+    ++hint;
+
+    // Record the back-reference.
+    ref.referenced()->referrers_.insert(std::make_pair(this, offset));
+  }
+}
+
 bool BlockGraph::Block::GetReference(Offset offset,
                                      Reference* reference) const {
   DCHECK(reference != NULL);
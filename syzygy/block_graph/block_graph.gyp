@@ -33,6 +33,8 @@
         'block_builder.h',
         'block_graph.cc',
         'block_graph.h',
+        'block_graph_diff.cc',
+        'block_graph_diff.h',
         'block_graph_serializer.cc',
         'block_graph_serializer.h',
         'block_hash.cc',
@@ -46,6 +48,8 @@
         'hot_patching_metadata.h',
         'iterate.cc',
         'iterate.h',
+        'mapped_block_graph.cc',
+        'mapped_block_graph.h',
         'ordered_block_graph.cc',
         'ordered_block_graph.h',
         'ordered_block_graph_internal.h',
@@ -94,11 +98,13 @@
         'block_graph_serializer_unittest.cc',
         'block_builder_unittest.cc',
         'block_graph_unittest.cc',
+        'block_graph_diff_unittest.cc',
         'block_hash_unittest.cc',
         'block_util_unittest.cc',
         'filter_util_unittest.cc',
         'filterable_unittest.cc',
         'iterate_unittest.cc',
+        'mapped_block_graph_unittest.cc',
         'ordered_block_graph_unittest.cc',
         'orderer_unittest.cc',
         'transform_unittest.cc',
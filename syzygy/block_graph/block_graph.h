@@ -25,22 +25,26 @@
 #define SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "base/files/file_util.h"
+#include "base/memory/ref_counted.h"
 #include "base/strings/string_piece.h"
 #include "syzygy/common/align.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/flat_map.h"
 #include "syzygy/core/string_table.h"
 
 namespace block_graph {
 
-// Forward declaration.
+// Forward declarations.
 class BlockGraphSerializer;
+class MappedBlockGraph;
 
 // NOTE: When adding attributes be sure to update any uses of them in
 //       block_graph.cc, for example in MergeIntersectingBlocks.
@@ -357,6 +361,8 @@ class BlockGraph {
  private:
   // Give BlockGraphSerializer access to our innards for serialization.
   friend BlockGraphSerializer;
+  // Give MappedBlockGraph access to our innards for serialization.
+  friend MappedBlockGraph;
 
   // Removes a block by the iterator to it. The iterator must be valid.
   bool RemoveBlockByIterator(BlockMap::iterator it);
@@ -480,13 +486,11 @@ struct BlockGraph::Section {
 class BlockGraph::Label {
  public:
   // Default constructor.
-  Label() : attributes_(0) {
+  Label() : name_(NULL), attributes_(0) {
   }
 
   // Full constructor.
-  Label(const base::StringPiece& name, LabelAttributes attributes)
-      : name_(name.begin(), name.end()), attributes_(attributes) {
-  }
+  Label(const base::StringPiece& name, LabelAttributes attributes);
 
   // Copy construction.
   Label(const Label& other)
@@ -495,7 +499,7 @@ class BlockGraph::Label {
 
   // @name Accessors.
   // @{
-  const std::string& name() const { return name_; }
+  const std::string& name() const;
   // @}
 
   // A helper function for logging and debugging.
@@ -503,7 +507,8 @@ class BlockGraph::Label {
 
   // Equality comparator for unittesting.
   bool operator==(const Label& other) const {
-    return name_ == other.name_ && attributes_ == other.attributes_;
+    // The names are interned, so the same name is the same string.
+    return &name() == &other.name() && attributes_ == other.attributes_;
   }
 
   // The label attributes are a bitmask. You can set them wholesale,
@@ -532,8 +537,10 @@ class BlockGraph::Label {
   static bool AreValidAttributes(LabelAttributes attributes);
 
  private:
-  // The name by which this label is known.
-  std::string name_;
+  // The name by which this label is known, interned in a table shared by
+  // all labels. This is NULL for a default constructed label, whose name is
+  // empty.
+  const std::string* name_;
 
   // The disposition of the bytes found at this label.
   LabelAttributes attributes_;
@@ -584,8 +591,9 @@ class BlockGraph::Block {
   // while others (of type DATA_LABEL) represent the start of embedded data
   // within the block. Note that, while possible, it is NOT guaranteed that
   // all basic blocks are marked with a label. Basic block decomposition should
-  // disassemble from the code labels to discover all basic blocks.
-  typedef std::map<Offset, Label> LabelMap;
+  // disassemble from the code labels to discover all basic blocks. Blocks
+  // rarely have more than a handful of labels, they are kept in a flat map.
+  typedef core::FlatMap<Offset, Label> LabelMap;
 
   ~Block();
 
@@ -672,9 +680,16 @@ class BlockGraph::Block {
   }
 
   // This is true iff data_ is in the ownership of the block.
-  // Iff true, the block will delete [] data_ on destruction or when
+  // Iff true, the block holds a reference to a buffer holding data_, which
+  // it may share with its copies, and releases it on destruction or when
   // data is overwritten.
-  bool owns_data() const { return owns_data_; }
+  bool owns_data() const { return data_buffer_.get() != NULL; }
+
+  // This is true iff the block owns its data and shares it with other blocks.
+  // Shared data is copied before it's written to, by either block.
+  bool shares_data() const {
+    return data_buffer_.get() != NULL && !data_buffer_->HasOneRef();
+  }
 
   // Makes room for the given amount of data at the given offset. This is
   // special in that it will patch up any labels, source ranges and referrers
@@ -737,11 +752,16 @@ class BlockGraph::Block {
   uint8_t* CopyData(size_t data_size, const void* data);
 
   // Resizes data to new_size by truncating or zero-extending the current data.
+  // Truncating doesn't reallocate the data, and neither does zero-extending
+  // into the room left by an earlier truncation of data that isn't shared.
   // @pre new_size <= size().
   const uint8_t* ResizeData(size_t new_size);
 
   // Returns a mutable copy of the block's data. If the block doesn't own
-  // the data on entry, it'll be copied and the copy returned to the caller.
+  // the data on entry, or shares it with another block, it'll be copied and
+  // the copy returned to the caller.
+  // @note The returned pointer must not be written through once the data is
+  //     shared, e.g. by BlockGraph::CopyBlock.
   uint8_t* GetMutableData();
 
   // The data bytes the block refers to.
@@ -768,6 +788,14 @@ class BlockGraph::Block {
   // @returns true iff this inserts a new reference.
   bool SetReference(Offset offset, const Reference& ref);
 
+  // Inserts new references in bulk. This is much cheaper than calling
+  // SetReference for each of them when building the references of a block,
+  // as they are inserted in order rather than each looked up.
+  // @param references the references to insert, sorted by offset. There must
+  //     be no reference at any of their offsets already.
+  void InsertReferences(
+      const std::vector<std::pair<Offset, Reference>>& references);
+
   // Retrieve the reference at @p offset if one exists.
   // @param reference on success returns the reference @p offset.
   // @returns true iff there was a reference at @p offset.
@@ -838,6 +866,8 @@ class BlockGraph::Block {
   friend class BlockGraph;
   // Give BlockGraphSerializer access to our innards for serialization.
   friend class BlockGraphSerializer;
+  // Give MappedBlockGraph access to our innards for serialization.
+  friend class MappedBlockGraph;
 
   // Full constructor.
   // @note This is protected so that blocks may only be created via the
@@ -851,6 +881,26 @@ class BlockGraph::Block {
   // This constructor is used by serialization.
   explicit Block(BlockGraph* block_graph);
 
+  // A reference counted data buffer, owned by the blocks that share it.
+  class DataBuffer : public base::RefCountedThreadSafe<DataBuffer> {
+   public:
+    explicit DataBuffer(size_t size)
+        : data_(new uint8_t[size]), size_(size) {
+    }
+
+    uint8_t* data() const { return data_.get(); }
+    size_t size() const { return size_; }
+
+   private:
+    friend class base::RefCountedThreadSafe<DataBuffer>;
+    ~DataBuffer() {}
+
+    std::unique_ptr<uint8_t[]> data_;
+    size_t size_;
+
+    DISALLOW_COPY_AND_ASSIGN(DataBuffer);
+  };
+
   // Allocates and returns a new data buffer of the given size. The returned
   // data buffer will not have been initialized in any way.
   uint8_t* AllocateRawData(size_t size);
@@ -877,9 +927,9 @@ class BlockGraph::Block {
   SourceRanges source_ranges_;
   LabelMap labels_;
 
-  // True iff data_ is ours to deallocate with delete [].
-  // If this is false, data_ must be guaranteed to outlive the block.
-  bool owns_data_;
+  // The buffer holding data_, iff data_ is ours. If this is NULL, data_ must
+  // be guaranteed to outlive the block.
+  scoped_refptr<DataBuffer> data_buffer_;
   // A pointer to the code or data we represent.
   const uint8_t* data_;
   // Size of the above.
@@ -912,6 +962,7 @@ class BlockGraph::AddressSpace {
   typedef AddressSpaceImpl::RangeMapIterPair RangeMapIterPair;
   typedef AddressSpaceImpl::RangeMapConstIterPair RangeMapConstIterPair;
   typedef std::unordered_map<const Block*, RelativeAddress> BlockAddressMap;
+  typedef std::vector<std::pair<RelativeAddress, Block*>> BlockAddressVector;
 
   // Constructs a new empty address space.
   // @p start to @p start + @p size on @p graph.
@@ -947,6 +998,16 @@ class BlockGraph::AddressSpace {
   //     an existing block.
   bool InsertBlock(RelativeAddress addr, Block* block);
 
+  // Inserts existing blocks at the given addresses. Blocks that lie beyond
+  // all of the blocks already in the address space are appended in amortized
+  // constant time, so that an address space built in increasing address order
+  // takes a single pass.
+  // @param blocks the blocks to insert, with their addresses. These should be
+  //     sorted by address for the insertion to take linear time.
+  // @returns true on success, or false if one of @p blocks would overlap an
+  //     existing block. In that case the blocks preceding it are inserted.
+  bool InsertBlocks(const BlockAddressVector& blocks);
+
   // Returns a pointer to the block containing address, or NULL
   // if no block contains address.
   Block* GetBlockByAddress(RelativeAddress addr) const;
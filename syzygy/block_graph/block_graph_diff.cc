@@ -0,0 +1,163 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/block_graph_diff.h"
+
+#include <set>
+#include <string>
+#include <tuple>
+
+#include "syzygy/block_graph/block_hash.h"
+
+namespace block_graph {
+
+namespace {
+
+typedef BlockGraph::Block Block;
+typedef std::map<const Block*, const Block*> BlockMap;
+
+// The properties of a block that must be equal for it to be unchanged, its
+// reference targets aside.
+struct BlockKey {
+  BlockKey(const BlockGraph& block_graph, const Block* block)
+      : type(block->type()),
+        name(block->name()),
+        attributes(block->attributes()),
+        hash(block, BlockHash::FAST_HASH) {
+    const BlockGraph::Section* section =
+        block_graph.GetSectionById(block->section());
+    if (section != NULL)
+      section_name = section->name();
+  }
+
+  bool operator<(const BlockKey& other) const {
+    return std::tie(type, name, attributes, section_name, hash) <
+        std::tie(other.type, other.name, other.attributes, other.section_name,
+                 other.hash);
+  }
+
+  BlockGraph::BlockType type;
+  std::string name;
+  BlockGraph::BlockAttributes attributes;
+  std::string section_name;
+  BlockHash hash;
+};
+
+// @returns true if the references of @p block refer to the candidate
+//     counterparts of the blocks referred to by the references of
+//     @p base_block.
+bool ReferencesMatch(const Block* block,
+                     const Block* base_block,
+                     const BlockMap& candidates) {
+  const Block::ReferenceMap& references = block->references();
+  const Block::ReferenceMap& base_references = base_block->references();
+  if (references.size() != base_references.size())
+    return false;
+
+  Block::ReferenceMap::const_iterator ref = references.begin();
+  Block::ReferenceMap::const_iterator base_ref = base_references.begin();
+  for (; ref != references.end(); ++ref, ++base_ref) {
+    if (ref->first != base_ref->first ||
+        ref->second.type() != base_ref->second.type() ||
+        ref->second.size() != base_ref->second.size() ||
+        ref->second.offset() != base_ref->second.offset() ||
+        ref->second.base() != base_ref->second.base()) {
+      return false;
+    }
+
+    BlockMap::const_iterator target =
+        candidates.find(ref->second.referenced());
+    if (target == candidates.end() ||
+        target->second != base_ref->second.referenced()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace
+
+void BlockGraphDiff::Compute(const BlockGraph& base,
+                             const BlockGraph& current) {
+  unchanged_blocks_.clear();
+  changed_blocks_.clear();
+  removed_blocks_.clear();
+
+  // Index the blocks of the base block-graph. They are visited in decreasing
+  // id order so that popping from the back of each list matches the blocks
+  // that share a key in increasing id order.
+  typedef std::map<BlockKey, std::vector<const Block*>> BlockIndex;
+  BlockIndex base_index;
+  BlockGraph::BlockMap::const_reverse_iterator base_it =
+      base.blocks().rbegin();
+  for (; base_it != base.blocks().rend(); ++base_it) {
+    const Block* block = &base_it->second;
+    base_index[BlockKey(base, block)].push_back(block);
+  }
+
+  // Pair the blocks that are equal byte-wise.
+  BlockMap candidates;
+  std::vector<const Block*> worklist;
+  BlockGraph::BlockMap::const_iterator it = current.blocks().begin();
+  for (; it != current.blocks().end(); ++it) {
+    const Block* block = &it->second;
+    BlockIndex::iterator base_blocks =
+        base_index.find(BlockKey(current, block));
+    if (base_blocks == base_index.end() || base_blocks->second.empty())
+      continue;
+    candidates[block] = base_blocks->second.back();
+    base_blocks->second.pop_back();
+    worklist.push_back(block);
+  }
+
+  // Drop the pairs whose references disagree. Dropping a pair may invalidate
+  // the pairs of the blocks that refer to it, so these are checked again.
+  while (!worklist.empty()) {
+    const Block* block = worklist.back();
+    worklist.pop_back();
+
+    BlockMap::iterator candidate = candidates.find(block);
+    if (candidate == candidates.end())
+      continue;
+    if (ReferencesMatch(block, candidate->second, candidates))
+      continue;
+
+    candidates.erase(candidate);
+    Block::ReferrerSet::const_iterator referrer = block->referrers().begin();
+    for (; referrer != block->referrers().end(); ++referrer)
+      worklist.push_back(referrer->first);
+  }
+
+  // Gather the results.
+  std::set<BlockId> matched_base_blocks;
+  for (it = current.blocks().begin(); it != current.blocks().end(); ++it) {
+    BlockMap::const_iterator candidate = candidates.find(&it->second);
+    if (candidate == candidates.end()) {
+      changed_blocks_.push_back(it->first);
+      continue;
+    }
+    unchanged_blocks_[it->first] = candidate->second->id();
+    matched_base_blocks.insert(candidate->second->id());
+  }
+  BlockGraph::BlockMap::const_iterator base_block = base.blocks().begin();
+  for (; base_block != base.blocks().end(); ++base_block) {
+    if (matched_base_blocks.find(base_block->first) ==
+        matched_base_blocks.end()) {
+      removed_blocks_.push_back(base_block->first);
+    }
+  }
+}
+
+}  // namespace block_graph
@@ -0,0 +1,82 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares BlockGraphDiff, which finds the blocks of a block-graph that are
+// unchanged with respect to a base block-graph, typically the decomposition
+// of a previous build of the same image. This is what an incremental relink
+// uses to tell the blocks whose transformed output may be reused from those
+// that must be transformed again.
+//
+// A block is unchanged if the base block-graph has a block with the same
+// type, name, attributes, section name and BlockHash, and if each of its
+// references refers to the unchanged counterpart of the block referenced by
+// the matching reference of the base block, with the same offset and base.
+// The latter condition is what BlockHash leaves out: a block whose code calls
+// a function that changed is itself unchanged byte-wise, but it no longer
+// refers to the same code.
+
+#ifndef SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_DIFF_H_
+#define SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_DIFF_H_
+
+#include <map>
+#include <vector>
+
+#include "syzygy/block_graph/block_graph.h"
+
+namespace block_graph {
+
+class BlockGraphDiff {
+ public:
+  typedef BlockGraph::BlockId BlockId;
+  typedef std::map<BlockId, BlockId> BlockIdMap;
+  typedef std::vector<BlockId> BlockIds;
+
+  BlockGraphDiff() { }
+
+  // Diffs a block-graph against a base block-graph, replacing the results of
+  // any previous diff.
+  // @param base The base block-graph.
+  // @param current The block-graph to compare with @p base.
+  void Compute(const BlockGraph& base, const BlockGraph& current);
+
+  // @returns the unchanged blocks, as a map from the ids of blocks of the
+  //     current block-graph to the ids of their counterparts in the base
+  //     block-graph.
+  const BlockIdMap& unchanged_blocks() const { return unchanged_blocks_; }
+
+  // @returns the ids of the blocks of the current block-graph that are new
+  //     or changed, in increasing order.
+  const BlockIds& changed_blocks() const { return changed_blocks_; }
+
+  // @returns the ids of the blocks of the base block-graph that have no
+  //     unchanged counterpart in the current block-graph, in increasing order.
+  const BlockIds& removed_blocks() const { return removed_blocks_; }
+
+  // @param block_id The id of a block of the current block-graph.
+  // @returns true if the block is unchanged.
+  bool IsUnchanged(BlockId block_id) const {
+    return unchanged_blocks_.find(block_id) != unchanged_blocks_.end();
+  }
+
+ private:
+  BlockIdMap unchanged_blocks_;
+  BlockIds changed_blocks_;
+  BlockIds removed_blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockGraphDiff);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_DIFF_H_
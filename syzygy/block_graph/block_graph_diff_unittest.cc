@@ -0,0 +1,128 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/block_graph_diff.h"
+
+#include "gtest/gtest.h"
+
+namespace block_graph {
+
+namespace {
+
+const size_t kBlockSize = 0x10;
+
+// Builds a block-graph made of a function "main" calling "helper", and of
+// a data block "table" referring to "main".
+void BuildBlockGraph(uint8_t helper_value, BlockGraph* block_graph) {
+  BlockGraph::Section* text = block_graph->AddSection(".text", 0);
+  BlockGraph::Section* data = block_graph->AddSection(".data", 0);
+
+  BlockGraph::Block* main =
+      block_graph->AddBlock(BlockGraph::CODE_BLOCK, kBlockSize, "main");
+  BlockGraph::Block* helper =
+      block_graph->AddBlock(BlockGraph::CODE_BLOCK, kBlockSize, "helper");
+  BlockGraph::Block* table =
+      block_graph->AddBlock(BlockGraph::DATA_BLOCK, kBlockSize, "table");
+  main->set_section(text->id());
+  helper->set_section(text->id());
+  table->set_section(data->id());
+
+  ::memset(main->AllocateData(kBlockSize), 0xCC, kBlockSize);
+  ::memset(helper->AllocateData(kBlockSize), helper_value, kBlockSize);
+  ::memset(table->AllocateData(kBlockSize), 0, kBlockSize);
+
+  ASSERT_TRUE(main->SetReference(
+      1, BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF, 4, helper, 0, 0)));
+  ASSERT_TRUE(table->SetReference(
+      0, BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, main, 0, 0)));
+}
+
+}  // namespace
+
+TEST(BlockGraphDiffTest, IdenticalBlockGraphs) {
+  BlockGraph base;
+  BlockGraph current;
+  ASSERT_NO_FATAL_FAILURE(BuildBlockGraph(0x90, &base));
+  ASSERT_NO_FATAL_FAILURE(BuildBlockGraph(0x90, &current));
+
+  BlockGraphDiff diff;
+  diff.Compute(base, current);
+  EXPECT_EQ(3u, diff.unchanged_blocks().size());
+  EXPECT_TRUE(diff.changed_blocks().empty());
+  EXPECT_TRUE(diff.removed_blocks().empty());
+
+  for (const auto& entry : current.blocks()) {
+    EXPECT_TRUE(diff.IsUnchanged(entry.first));
+    const BlockGraph::Block* base_block =
+        base.GetBlockById(diff.unchanged_blocks().at(entry.first));
+    ASSERT_NE(static_cast<const BlockGraph::Block*>(nullptr), base_block);
+    EXPECT_EQ(entry.second.name(), base_block->name());
+  }
+}
+
+TEST(BlockGraphDiffTest, ChangesPropagateToReferrers) {
+  BlockGraph base;
+  BlockGraph current;
+  ASSERT_NO_FATAL_FAILURE(BuildBlockGraph(0x90, &base));
+  ASSERT_NO_FATAL_FAILURE(BuildBlockGraph(0xC3, &current));
+
+  // Add a block that only refers to itself and a block that is unreferenced.
+  BlockGraph::Block* loop =
+      current.AddBlock(BlockGraph::CODE_BLOCK, kBlockSize, "loop");
+  ASSERT_TRUE(loop->SetReference(
+      1, BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF, 4, loop, 0, 0)));
+  BlockGraph::Block* base_loop =
+      base.AddBlock(BlockGraph::CODE_BLOCK, kBlockSize, "loop");
+  ASSERT_TRUE(base_loop->SetReference(
+      1, BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF, 4, base_loop, 0,
+                               0)));
+  base.AddBlock(BlockGraph::DATA_BLOCK, kBlockSize, "removed");
+
+  BlockGraphDiff diff;
+  diff.Compute(base, current);
+
+  // The data of "helper" changed: "main" calls it, and "table" refers to
+  // "main", so all three are changed. "loop" is unchanged.
+  ASSERT_EQ(1u, diff.unchanged_blocks().size());
+  EXPECT_TRUE(diff.IsUnchanged(loop->id()));
+  EXPECT_EQ(base_loop->id(), diff.unchanged_blocks().at(loop->id()));
+  EXPECT_EQ(3u, diff.changed_blocks().size());
+  EXPECT_EQ(4u, diff.removed_blocks().size());
+}
+
+TEST(BlockGraphDiffTest, ReferenceTargetOffsetChange) {
+  BlockGraph base;
+  BlockGraph current;
+  ASSERT_NO_FATAL_FAILURE(BuildBlockGraph(0x90, &base));
+  ASSERT_NO_FATAL_FAILURE(BuildBlockGraph(0x90, &current));
+
+  // Make "table" refer to a different offset of "main".
+  BlockGraph::Block* table = current.GetBlockById(3);
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), table);
+  ASSERT_EQ("table", table->name());
+  BlockGraph::Block* main = current.GetBlockById(1);
+  ASSERT_FALSE(table->SetReference(
+      0, BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, main, 4, 4)));
+
+  BlockGraphDiff diff;
+  diff.Compute(base, current);
+  EXPECT_EQ(2u, diff.unchanged_blocks().size());
+  EXPECT_FALSE(diff.IsUnchanged(table->id()));
+  ASSERT_EQ(1u, diff.changed_blocks().size());
+  EXPECT_EQ(table->id(), diff.changed_blocks()[0]);
+  ASSERT_EQ(1u, diff.removed_blocks().size());
+  EXPECT_EQ(3u, diff.removed_blocks()[0]);
+}
+
+}  // namespace block_graph
@@ -31,49 +31,14 @@ using core::OutArchive;
 // Version 3: Added image_format_ block-graph property.
 // Version 4: Deprecated old decomposer attributes.
 // Version 5: Added new Block attributes: padding_before and alignment_offset.
-static const uint32_t kSerializedBlockGraphVersion = 5;
+// Version 6: Saved block and label names once, in a string table.
+static const uint32_t kSerializedBlockGraphVersion = 6;
 
 // Some constants for use in dealing with backwards compatibility.
 static const uint32_t kMinSupportedSerializedBlockGraphVersion = 2;
 static const uint32_t kImageFormatPropertyBlockGraphVersion = 3;
 static const uint32_t kPaddingBeforePropertyBlockGraphVersion = 5;
-
-// Potentially saves a string, depending on whether or not OMIT_STRINGS is
-// enabled.
-bool MaybeSaveString(const BlockGraphSerializer& bgs,
-                     const std::string& value,
-                     OutArchive* out_archive) {
-  DCHECK(out_archive != NULL);
-
-  if (bgs.has_attributes(BlockGraphSerializer::OMIT_STRINGS))
-    return true;
-
-  if (!out_archive->Save(value)) {
-    LOG(ERROR) << "Unable to save string \"" << value << "\".";
-    return false;
-  }
-
-  return true;
-}
-
-// Potentially loads a string, depending on whether or not OMIT_STRINGS is
-// enabled.
-bool MaybeLoadString(const BlockGraphSerializer& bgs,
-                     std::string* value,
-                     InArchive* in_archive) {
-  DCHECK(value != NULL);
-  DCHECK(in_archive != NULL);
-
-  if (bgs.has_attributes(BlockGraphSerializer::OMIT_STRINGS))
-    return true;
-
-  if (!in_archive->Load(value)) {
-    LOG(ERROR) << "Unable to load string.";
-    return false;
-  }
-
-  return true;
-}
+static const uint32_t kStringTableBlockGraphVersion = 6;
 
 bool ValidAttributes(uint32_t attributes, uint32_t attributes_max) {
   return (attributes & ~(attributes_max - 1)) == 0;
@@ -94,14 +59,18 @@ bool BlockGraphSerializer::Save(const BlockGraph& block_graph,
     return false;
   }
 
-  // TODO(etienneb): We should serialize the string table in the block graph,
-  //    and encode string ids instead of the raw strings.
-
   // This function takes care of outputting a meaningful log message on
   // failure.
   if (!SaveBlockGraphProperties(block_graph, out_archive))
     return false;
 
+  // Save the names of the blocks and of the labels ahead of the blocks, which
+  // then refer to them by index.
+  if (!SaveStringTable(block_graph, out_archive)) {
+    LOG(ERROR) << "Unable to save string table.";
+    return false;
+  }
+
   // Save the blocks, except for their references. We do that in a second pass
   // so that when loading the referenced blocks will exist.
   if (!SaveBlocks(block_graph, out_archive)) {
@@ -115,6 +84,7 @@ bool BlockGraphSerializer::Save(const BlockGraph& block_graph,
     return false;
   }
 
+  string_ids_.clear();
   return true;
 }
 
@@ -157,6 +127,11 @@ bool BlockGraphSerializer::Load(BlockGraph* block_graph,
   if (!LoadBlockGraphProperties(version, block_graph, in_archive))
     return false;
 
+  if (!LoadStringTable(version, block_graph, in_archive)) {
+    LOG(ERROR) << "Unable to load string table.";
+    return false;
+  }
+
   // Load the blocks, except for their references.
   if (!LoadBlocks(version, block_graph, in_archive)) {
     LOG(ERROR) << "Unable to load blocks.";
@@ -169,6 +144,7 @@ bool BlockGraphSerializer::Load(BlockGraph* block_graph,
     return false;
   }
 
+  strings_.clear();
   return true;
 }
 
@@ -226,6 +202,126 @@ bool BlockGraphSerializer::LoadBlockGraphProperties(
   return true;
 }
 
+bool BlockGraphSerializer::SaveStringTable(const BlockGraph& block_graph,
+                                           OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  string_ids_.clear();
+  if (has_attributes(BlockGraphSerializer::OMIT_STRINGS))
+    return true;
+
+  // Number the distinct names in the order the blocks refer to them.
+  std::vector<const std::string*> strings;
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks_.begin();
+  for (; it != block_graph.blocks_.end(); ++it) {
+    const BlockGraph::Block& block = it->second;
+    AddString(block.name(), &strings);
+    AddString(block.compiland_name(), &strings);
+    if (has_attributes(BlockGraphSerializer::OMIT_LABELS))
+      continue;
+    BlockGraph::Block::LabelMap::const_iterator label_iter =
+        block.labels().begin();
+    for (; label_iter != block.labels().end(); ++label_iter)
+      AddString(label_iter->second.name(), &strings);
+  }
+
+  if (!SaveUint32(static_cast<uint32_t>(strings.size()), out_archive))
+    return false;
+  for (size_t i = 0; i < strings.size(); ++i) {
+    if (!out_archive->Save(*strings[i])) {
+      LOG(ERROR) << "Unable to save string \"" << *strings[i] << "\".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::LoadStringTable(uint32_t version,
+                                           BlockGraph* block_graph,
+                                           InArchive* in_archive) {
+  DCHECK(block_graph != NULL);
+  DCHECK(in_archive != NULL);
+
+  strings_.clear();
+  if (version < kStringTableBlockGraphVersion ||
+      has_attributes(BlockGraphSerializer::OMIT_STRINGS)) {
+    return true;
+  }
+
+  uint32_t count = 0;
+  if (!LoadUint32(&count, in_archive))
+    return false;
+
+  // The strings are interned as they are read, as most of them are the names
+  // of blocks.
+  strings_.reserve(count);
+  std::string value;
+  for (size_t i = 0; i < count; ++i) {
+    if (!in_archive->Load(&value)) {
+      LOG(ERROR) << "Unable to load string " << i << " of " << count << ".";
+      return false;
+    }
+    strings_.push_back(&block_graph->string_table().InternString(value));
+  }
+
+  return true;
+}
+
+void BlockGraphSerializer::AddString(
+    const std::string& value,
+    std::vector<const std::string*>* strings) const {
+  DCHECK(strings != NULL);
+  uint32_t id = static_cast<uint32_t>(strings->size());
+  if (string_ids_.insert(std::make_pair(base::StringPiece(value), id)).second)
+    strings->push_back(&value);
+}
+
+bool BlockGraphSerializer::MaybeSaveString(const std::string& value,
+                                           OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  if (has_attributes(BlockGraphSerializer::OMIT_STRINGS))
+    return true;
+
+  StringIdMap::const_iterator it = string_ids_.find(value);
+  DCHECK(it != string_ids_.end());
+  if (!SaveUint32(it->second, out_archive)) {
+    LOG(ERROR) << "Unable to save string \"" << value << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::MaybeLoadString(uint32_t version,
+                                           std::string* value,
+                                           InArchive* in_archive) const {
+  DCHECK(value != NULL);
+  DCHECK(in_archive != NULL);
+
+  if (has_attributes(BlockGraphSerializer::OMIT_STRINGS))
+    return true;
+
+  // Older versions save the strings in place.
+  if (version < kStringTableBlockGraphVersion) {
+    if (!in_archive->Load(value)) {
+      LOG(ERROR) << "Unable to load string.";
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t id = 0;
+  if (!LoadUint32(&id, in_archive) || id >= strings_.size()) {
+    LOG(ERROR) << "Unable to load string.";
+    return false;
+  }
+  *value = *strings_[id];
+
+  return true;
+}
+
 bool BlockGraphSerializer::SaveBlocks(const BlockGraph& block_graph,
                                       OutArchive* out_archive) const {
   DCHECK(out_archive != NULL);
@@ -285,7 +381,7 @@ bool BlockGraphSerializer::LoadBlocks(uint32_t version,
     block->id_ = id;
 
     if (!LoadBlockProperties(version, block, in_archive) ||
-        !LoadBlockLabels(block, in_archive) ||
+        !LoadBlockLabels(version, block, in_archive) ||
         !LoadBlockData(block, in_archive)) {
       LOG(ERROR) << "Unable to load block " << i << " of " << count
                  << " with id " << id << ".";
@@ -347,8 +443,8 @@ bool BlockGraphSerializer::SaveBlockProperties(const BlockGraph::Block& block,
       !out_archive->Save(block.addr()) ||
       !SaveInt32(static_cast<uint32_t>(block.section()), out_archive) ||
       !out_archive->Save(block.attributes()) ||
-      !MaybeSaveString(*this, block.name(), out_archive) ||
-      !MaybeSaveString(*this, block.compiland_name(), out_archive)) {
+      !MaybeSaveString(block.name(), out_archive) ||
+      !MaybeSaveString(block.compiland_name(), out_archive)) {
     LOG(ERROR) << "Unable to save properties for block with id "
                << block.id() << ".";
     return false;
@@ -397,8 +493,8 @@ bool BlockGraphSerializer::LoadBlockPropertiesImpl(
       !in_archive->Load(&block->addr_) ||
       !LoadInt32(reinterpret_cast<int32_t*>(&section), in_archive) ||
       !in_archive->Load(&attributes) ||
-      !MaybeLoadString(*this, &name, in_archive) ||
-      !MaybeLoadString(*this, &compiland_name, in_archive)) {
+      !MaybeLoadString(version, &name, in_archive) ||
+      !MaybeLoadString(version, &compiland_name, in_archive)) {
     return false;
   }
 
@@ -462,7 +558,7 @@ bool BlockGraphSerializer::SaveBlockLabels(const BlockGraph::Block& block,
     uint16_t attributes = static_cast<uint16_t>(label.attributes());
 
     if (!SaveInt32(offset, out_archive) || !out_archive->Save(attributes) ||
-        !MaybeSaveString(*this, label.name(), out_archive)) {
+        !MaybeSaveString(label.name(), out_archive)) {
       LOG(ERROR) << "Unable to save label at offset "
                  << label_iter->first << " of block with id "
                  << block.id() << ".";
@@ -473,7 +569,8 @@ bool BlockGraphSerializer::SaveBlockLabels(const BlockGraph::Block& block,
   return true;
 }
 
-bool BlockGraphSerializer::LoadBlockLabels(BlockGraph::Block* block,
+bool BlockGraphSerializer::LoadBlockLabels(uint32_t version,
+                                           BlockGraph::Block* block,
                                            InArchive* in_archive) const {
   DCHECK(block != NULL);
   DCHECK(in_archive != NULL);
@@ -496,7 +593,7 @@ bool BlockGraphSerializer::LoadBlockLabels(BlockGraph::Block* block,
     std::string name;
 
     if (!LoadInt32(&offset, in_archive) || !(in_archive->Load(&attributes)) ||
-        !MaybeLoadString(*this, &name, in_archive)) {
+        !MaybeLoadString(version, &name, in_archive)) {
       LOG(ERROR) << "Unable to load label " << i << " of " << label_count
                  << " for block with id " << block->id() << ".";
       return false;
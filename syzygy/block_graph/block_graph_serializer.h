@@ -17,9 +17,15 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_SERIALIZER_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_SERIALIZER_H_
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "base/callback.h"
+#include "base/strings/string_piece.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address.h"
+#include "syzygy/core/string_table.h"
 
 namespace block_graph {
 
@@ -211,6 +217,12 @@ class BlockGraphSerializer {
                                 BlockGraph* block_graph,
                                 InArchive* in_archive) const;
 
+  bool SaveStringTable(const BlockGraph& block_graph,
+                       OutArchive* out_archive) const;
+  bool LoadStringTable(uint32_t version,
+                       BlockGraph* block_graph,
+                       InArchive* in_archive);
+
   bool SaveBlocks(const BlockGraph& block_graph, OutArchive* out_archive) const;
   bool LoadBlocks(uint32_t version,
                   BlockGraph* block_graph,
@@ -229,7 +241,9 @@ class BlockGraphSerializer {
 
   bool SaveBlockLabels(const BlockGraph::Block& block,
                        OutArchive* out_archive) const;
-  bool LoadBlockLabels(BlockGraph::Block* block, InArchive* in_archive) const;
+  bool LoadBlockLabels(uint32_t version,
+                       BlockGraph::Block* block,
+                       InArchive* in_archive) const;
 
   bool SaveBlockData(const BlockGraph::Block& block,
                      OutArchive* out_archive) const;
@@ -257,6 +271,17 @@ class BlockGraphSerializer {
   bool LoadInt32(int32_t* value, InArchive* in_archive) const;
   // @}
 
+  // @{
+  // Utility functions for saving and loading the names of blocks and labels,
+  // as indices into the string table. Nothing is saved or loaded if
+  // OMIT_STRINGS is enabled.
+  bool MaybeSaveString(const std::string& value,
+                       OutArchive* out_archive) const;
+  bool MaybeLoadString(uint32_t version,
+                       std::string* value,
+                       InArchive* in_archive) const;
+  // @}
+
   // The mode in which the serializer is operating for block data.
   DataMode data_mode_;
   // Controls the specifics of how the serialization is performed.
@@ -266,6 +291,18 @@ class BlockGraphSerializer {
   std::unique_ptr<SaveBlockDataCallback> save_block_data_callback_;
   std::unique_ptr<LoadBlockDataCallback> load_block_data_callback_;
 
+  typedef std::unordered_map<base::StringPiece,
+                             uint32_t,
+                             core::StringPieceHash> StringIdMap;
+
+  // The indices of the names in the string table, while saving. The keys
+  // refer to the names of the block-graph being saved.
+  mutable StringIdMap string_ids_;
+
+  // The names of the string table, interned in the block-graph being loaded,
+  // while loading.
+  std::vector<const std::string*> strings_;
+
  private:
   // A helper function that implements loading of block properties. The
   // separation to two functions avoids duplication of logging on each
@@ -273,6 +310,12 @@ class BlockGraphSerializer {
   bool LoadBlockPropertiesImpl(uint32_t version,
                                BlockGraph::Block* block,
                                InArchive* in_archive) const;
+
+  // Adds a name to the string table being saved, unless it is already there.
+  // @param value the name to add.
+  // @param strings receives the name, if it is new.
+  void AddString(const std::string& value,
+                 std::vector<const std::string*>* strings) const;
 };
 
 }  // namespace block_graph
@@ -14,6 +14,8 @@
 
 #include "syzygy/block_graph/block_graph_serializer.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/unittest_util.h"
@@ -543,6 +545,27 @@ TEST_F(BlockGraphSerializerTest, RoundTripAllData) {
       eNoBlockDataCallbacks, 0));
 }
 
+TEST_F(BlockGraphSerializerTest, SavesNamesOnce) {
+  InitBlockGraph();
+  InitOutArchive();
+  s_.set_data_mode(BlockGraphSerializer::OUTPUT_ALL_DATA);
+  ASSERT_TRUE(s_.Save(bg_, oa_.get()));
+
+  // Three blocks are from the same compiland, whose name is saved once.
+  const char kCompilandName[] = "d.o";
+  std::vector<uint8_t>::const_iterator it = v_.begin();
+  size_t count = 0;
+  while (true) {
+    it = std::search(it, v_.cend(), kCompilandName,
+                     kCompilandName + sizeof(kCompilandName) - 1);
+    if (it == v_.end())
+      break;
+    ++count;
+    ++it;
+  }
+  EXPECT_EQ(1u, count);
+}
+
 // TODO(chrisha): Do a heck of a lot more testing of protected member functions.
 
 }  // namespace block_graph
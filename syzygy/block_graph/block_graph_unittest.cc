@@ -306,6 +306,22 @@ TEST_F(BlockTest, ResizeData) {
   ASSERT_EQ(0, memcmp(data + sizeof(kTestData), kZeros, sizeof(kZeros)));
 }
 
+TEST_F(BlockTest, ResizeDataInPlace) {
+  uint8_t* data = block_->CopyData(sizeof(kTestData), kTestData);
+
+  // Shrinking then growing our own data reuses its buffer, and zeroes the
+  // bytes that were truncated.
+  ASSERT_EQ(data, block_->ResizeData(sizeof(kTestData) / 2));
+  ASSERT_EQ(data, block_->ResizeData(sizeof(kTestData)));
+  ASSERT_EQ(0, memcmp(data, kTestData, sizeof(kTestData) / 2));
+  static const uint8_t kZeros[sizeof(kTestData) - sizeof(kTestData) / 2] = {};
+  ASSERT_EQ(0, memcmp(data + sizeof(kTestData) / 2, kZeros, sizeof(kZeros)));
+
+  // Releasing the data releases the buffer.
+  ASSERT_EQ(NULL, block_->ResizeData(0));
+  ASSERT_FALSE(block_->owns_data());
+}
+
 TEST_F(BlockTest, GetMutableData) {
   // Set the block's data.
   block_->SetData(kTestData, sizeof(kTestData));
@@ -984,6 +1000,17 @@ TEST(BlockGraphTest, CopyBlock) {
   EXPECT_TRUE(b2copy->owns_data());
   EXPECT_EQ(b2->data_size(), b2copy->data_size());
 
+  // Expect the data to be shared until either block writes to it.
+  EXPECT_TRUE(b2->shares_data());
+  EXPECT_TRUE(b2copy->shares_data());
+  EXPECT_EQ(b2->data(), b2copy->data());
+  uint8_t* b2copy_data = b2copy->GetMutableData();
+  EXPECT_NE(b2->data(), b2copy_data);
+  EXPECT_FALSE(b2->shares_data());
+  EXPECT_FALSE(b2copy->shares_data());
+  b2copy_data[0] = 0xCC;
+  EXPECT_EQ(0u, b2->data()[0]);
+
   // Expect that we copied references 2->2 and 2->3, but not 1->2.
   EXPECT_EQ(1u, b1->references().size());
   EXPECT_EQ(2u, b2->referrers().size());
@@ -1083,6 +1110,39 @@ TEST(BlockGraphTest, RemoveBlock) {
   EXPECT_EQ(2u, image.blocks().size());
 }
 
+TEST(BlockGraphTest, InsertReferences) {
+  BlockGraph image;
+  BlockGraph::Block* b1 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x40, "b1");
+  BlockGraph::Block* b2 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x40, "b2");
+
+  // References inserted in bulk go around the existing ones.
+  BlockGraph::Reference r1(BlockGraph::ABSOLUTE_REF, 4, b2, 0, 0);
+  BlockGraph::Reference r2(BlockGraph::RELATIVE_REF, 4, b2, 8, 8);
+  ASSERT_TRUE(b1->SetReference(8, r1));
+  ASSERT_TRUE(b1->SetReference(20, r1));
+
+  std::vector<std::pair<BlockGraph::Offset, BlockGraph::Reference>> refs;
+  refs.push_back(std::make_pair(0, r2));
+  refs.push_back(std::make_pair(4, r2));
+  refs.push_back(std::make_pair(12, r2));
+  refs.push_back(std::make_pair(32, r2));
+  b1->InsertReferences(refs);
+
+  BlockGraph::Block::ReferenceMap expected;
+  expected.insert(std::make_pair(0, r2));
+  expected.insert(std::make_pair(4, r2));
+  expected.insert(std::make_pair(8, r1));
+  expected.insert(std::make_pair(12, r2));
+  expected.insert(std::make_pair(20, r1));
+  expected.insert(std::make_pair(32, r2));
+  EXPECT_THAT(b1->references(), testing::ContainerEq(expected));
+
+  BlockGraph::Block::ReferrerSet expected_referrers;
+  for (auto& ref : expected)
+    expected_referrers.insert(std::make_pair(b1, ref.first));
+  EXPECT_THAT(b2->referrers(), testing::ContainerEq(expected_referrers));
+}
+
 TEST(BlockGraphTest, References) {
   BlockGraph image;
 
@@ -1448,6 +1508,48 @@ TEST(BlockGraphAddressSpaceTest, InsertBlock) {
   EXPECT_EQ(0x2000, block1->addr().value());
 }
 
+TEST(BlockGraphAddressSpaceTest, InsertBlocks) {
+  BlockGraph image;
+  BlockGraph::AddressSpace address_space(&image);
+
+  BlockGraph::Block* block1 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+  BlockGraph::Block* block2 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0, "code");
+  BlockGraph::Block* block3 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+  BlockGraph::Block* block4 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+  BlockGraph::Block* block5 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+
+  // Blocks in increasing address order, followed by one that falls in a gap.
+  BlockGraph::AddressSpace::BlockAddressVector blocks;
+  blocks.push_back(std::make_pair(RelativeAddress(0x1000), block1));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1010), block2));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1010), block3));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1040), block4));
+  blocks.push_back(std::make_pair(RelativeAddress(0x1020), block5));
+  ASSERT_TRUE(address_space.InsertBlocks(blocks));
+  EXPECT_EQ(5u, address_space.size());
+  EXPECT_EQ(4u, address_space.address_space_impl().size());
+
+  RelativeAddress addr;
+  EXPECT_TRUE(address_space.GetAddressOf(block2, &addr));
+  EXPECT_EQ(0x1010, addr.value());
+  EXPECT_EQ(0x1010, block3->addr().value());
+  EXPECT_EQ(0x1020, block5->addr().value());
+  EXPECT_EQ(block5, address_space.GetBlockByAddress(RelativeAddress(0x1025)));
+
+  // An overlapping block is rejected.
+  BlockGraph::Block* block6 =
+      image.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "code");
+  blocks.clear();
+  blocks.push_back(std::make_pair(RelativeAddress(0x1048), block6));
+  EXPECT_FALSE(address_space.InsertBlocks(blocks));
+  EXPECT_FALSE(address_space.ContainsBlock(block6));
+}
+
 TEST(BlockGraphAddressSpaceTest, GetBlockByAddress) {
   BlockGraph image;
   BlockGraph::AddressSpace address_space(&image);
@@ -14,35 +14,153 @@
 
 #include "syzygy/block_graph/block_hash.h"
 
+#include <algorithm>
+
 namespace block_graph {
 
+namespace {
+
 using base::MD5Context;
 using base::MD5Final;
 using base::MD5Init;
 using base::MD5Update;
 using base::StringPiece;
 
-void BlockHash::Hash(const BlockGraph::Block* block) {
-  DCHECK(block != NULL);
+// Feeds the content of blocks to MD5.
+class MD5Hasher {
+ public:
+  MD5Hasher() { MD5Init(&context_); }
+
+  void Update(const void* data, size_t size) {
+    MD5Update(&context_,
+              StringPiece(reinterpret_cast<const char*>(data), size));
+  }
+
+  void Final(base::MD5Digest* digest) { MD5Final(digest, &context_); }
+
+ private:
+  MD5Context context_;
+};
+
+// A wide streaming hash in the style of xxHash32. The input is consumed in
+// stripes of 32 bytes by 8 independent accumulators, so that the multiplies
+// of consecutive words don't depend on each other. The 128-bit digest is made
+// of 4 differently mixed foldings of the accumulators.
+class FastHasher {
+ public:
+  FastHasher() : buffered_(0), length_(0) {
+    for (size_t i = 0; i < kLaneCount; ++i)
+      lanes_[i] = kPrime1 + kPrime5 * static_cast<uint32_t>(i + 1);
+  }
+
+  void Update(const void* data, size_t size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    length_ += size;
+
+    // Complete a buffered stripe.
+    if (buffered_ != 0) {
+      size_t count = std::min(kStripeSize - buffered_, size);
+      ::memcpy(buffer_ + buffered_, bytes, count);
+      buffered_ += count;
+      bytes += count;
+      size -= count;
+      if (buffered_ < kStripeSize)
+        return;
+      ConsumeStripe(buffer_);
+      buffered_ = 0;
+    }
+
+    for (; size >= kStripeSize; bytes += kStripeSize, size -= kStripeSize)
+      ConsumeStripe(bytes);
+
+    ::memcpy(buffer_, bytes, size);
+    buffered_ = size;
+  }
+
+  void Final(base::MD5Digest* digest) {
+    uint32_t acc = static_cast<uint32_t>(length_) ^
+        (static_cast<uint32_t>(length_ >> 32) * kPrime3);
+    for (size_t i = 0; i < kLaneCount; ++i)
+      acc += Rotl(lanes_[i], static_cast<int>(1 + 3 * i));
+
+    // Mix in the tail of the input.
+    size_t i = 0;
+    for (; i + sizeof(uint32_t) <= buffered_; i += sizeof(uint32_t)) {
+      acc += ReadWord(buffer_ + i) * kPrime3;
+      acc = Rotl(acc, 17) * kPrime4;
+    }
+    for (; i < buffered_; ++i) {
+      acc += buffer_[i] * kPrime5;
+      acc = Rotl(acc, 11) * kPrime1;
+    }
+
+    uint32_t words[4] = {};
+    static_assert(sizeof(words) == sizeof(digest->a), "Unexpected size.");
+    for (size_t j = 0; j < arraysize(words); ++j) {
+      words[j] = Avalanche(
+          acc ^ Avalanche(lanes_[j] + Rotl(lanes_[j + 4], 16) +
+                          kPrime5 * static_cast<uint32_t>(j)));
+    }
+    ::memcpy(digest->a, words, sizeof(words));
+  }
+
+ private:
+  static const size_t kLaneCount = 8;
+  static const size_t kStripeSize = kLaneCount * sizeof(uint32_t);
 
-  MD5Context md5_context;
-  MD5Init(&md5_context);
+  static const uint32_t kPrime1 = 2654435761U;
+  static const uint32_t kPrime2 = 2246822519U;
+  static const uint32_t kPrime3 = 3266489917U;
+  static const uint32_t kPrime4 = 668265263U;
+  static const uint32_t kPrime5 = 374761393U;
+
+  static uint32_t Rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+  }
+
+  static uint32_t ReadWord(const uint8_t* bytes) {
+    uint32_t word = 0;
+    ::memcpy(&word, bytes, sizeof(word));
+    return word;
+  }
+
+  static uint32_t Avalanche(uint32_t value) {
+    value ^= value >> 15;
+    value *= kPrime2;
+    value ^= value >> 13;
+    value *= kPrime3;
+    value ^= value >> 16;
+    return value;
+  }
+
+  void ConsumeStripe(const uint8_t* stripe) {
+    for (size_t i = 0; i < kLaneCount; ++i) {
+      lanes_[i] += ReadWord(stripe + i * sizeof(uint32_t)) * kPrime2;
+      lanes_[i] = Rotl(lanes_[i], 13) * kPrime1;
+    }
+  }
+
+  uint32_t lanes_[kLaneCount];
+  uint8_t buffer_[kStripeSize];
+  size_t buffered_;
+  uint64_t length_;
+};
+
+// Feeds the content of @p block to @p hasher, as described in BlockHash::Hash.
+template <typename Hasher>
+void HashBlock(const BlockGraph::Block* block, Hasher* hasher) {
+  DCHECK(block != NULL);
+  DCHECK(hasher != NULL);
 
   // Hash the block properties: type, size, data_size, reference count.
   BlockGraph::BlockType type = block->type();
   BlockGraph::Size size = block->size();
   BlockGraph::Size data_size = block->data_size();
   size_t reference_count = block->references().size();
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&type), sizeof(type)));
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&size), sizeof(size)));
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&data_size),
-                  sizeof(data_size)));
-  MD5Update(&md5_context,
-      StringPiece(reinterpret_cast<const char*>(&reference_count),
-                        sizeof(data_size)));
+  hasher->Update(&type, sizeof(type));
+  hasher->Update(&size, sizeof(size));
+  hasher->Update(&data_size, sizeof(data_size));
+  hasher->Update(&reference_count, sizeof(data_size));
 
   // Hash the references in order of increasing source offset.
   BlockGraph::Block::ReferenceMap::const_iterator ref =
@@ -56,12 +174,9 @@ void BlockHash::Hash(const BlockGraph::Block* block) {
     BlockGraph::Offset offset = ref->first;
     BlockGraph::ReferenceType type = ref->second.type();
     BlockGraph::Size size = ref->second.size();
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(&offset), sizeof(offset)));
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(&type), sizeof(type)));
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(&size), sizeof(size)));
+    hasher->Update(&offset, sizeof(offset));
+    hasher->Update(&type, sizeof(type));
+    hasher->Update(&size, sizeof(size));
   }
 
   // Hash the data, skipping locations of references.
@@ -77,9 +192,7 @@ void BlockHash::Hash(const BlockGraph::Block* block) {
       if (ref_offset < data_end)
         data_end = ref_offset;
 
-      MD5Update(&md5_context,
-          StringPiece(reinterpret_cast<const char*>(
-              block->data() + data_index), data_end - data_index));
+      hasher->Update(block->data() + data_index, data_end - data_index);
     }
 
     // Skip past this reference.
@@ -88,9 +201,8 @@ void BlockHash::Hash(const BlockGraph::Block* block) {
 
   // Hash any data after the last reference.
   if (data_index < block->data_size()) {
-    MD5Update(&md5_context,
-        StringPiece(reinterpret_cast<const char*>(
-            block->data() + data_index), block->data_size() - data_index));
+    hasher->Update(block->data() + data_index,
+                   block->data_size() - data_index);
     data_index = block->data_size();
   }
 
@@ -101,12 +213,33 @@ void BlockHash::Hash(const BlockGraph::Block* block) {
     size_t bytes = block->size() - data_index;
     if (bytes > sizeof(kZeros))
       bytes = sizeof(kZeros);
-    MD5Update(&md5_context, StringPiece(kZeros, bytes));
+    hasher->Update(kZeros, bytes);
     data_index += bytes;
   }
+}
 
-  // Finalize the hash.
-  MD5Final(&md5_digest, &md5_context);
+}  // namespace
+
+void BlockHash::Hash(const BlockGraph::Block* block, HashType hash_type) {
+  DCHECK(block != NULL);
+
+  type = hash_type;
+  switch (hash_type) {
+    case MD5_HASH: {
+      MD5Hasher hasher;
+      HashBlock(block, &hasher);
+      hasher.Final(&md5_digest);
+      break;
+    }
+    case FAST_HASH: {
+      FastHasher hasher;
+      HashBlock(block, &hasher);
+      hasher.Final(&md5_digest);
+      break;
+    }
+    default:
+      NOTREACHED();
+  }
 }
 
 }  // namespace block_graph
@@ -23,21 +23,40 @@ namespace block_graph {
 
 using block_graph::BlockGraph;
 
-// Represents a hash of the content of a block. Internally we store an 128-bit
-// MD5 digest, but this endows it with comparison operators. We explicitly
+// Represents a hash of the content of a block. Internally we store a 128-bit
+// digest, but this endows it with comparison operators. We explicitly
 // provide copy and assignment operators to make this STL container compatible.
 struct BlockHash : public common::Comparable<BlockHash> {
  public:
-  BlockHash() {
+  // The functions that may be used to hash a block.
+  enum HashType {
+    // An MD5 digest. This is the default, and the only hash whose values are
+    // stable across versions of the toolchain.
+    MD5_HASH,
+    // A wide non-cryptographic hash, several times faster than MD5. Its
+    // values may change between versions of the toolchain, so it is meant
+    // for comparing blocks within a process.
+    FAST_HASH,
+  };
+
+  BlockHash() : type(MD5_HASH) {
   }
 
   // Constructor from Block.
   explicit BlockHash(const BlockGraph::Block* block) {
-    Hash(block);
+    Hash(block, MD5_HASH);
+  }
+
+  // Constructor from Block, with a given hash function.
+  BlockHash(const BlockGraph::Block* block, HashType hash_type) {
+    Hash(block, hash_type);
   }
 
-  // General comparison function, required by Comparable.
+  // General comparison function, required by Comparable. Hashes of different
+  // types are never equal.
   int Compare(const BlockHash& other) const {
+    if (type != other.type)
+      return type < other.type ? -1 : 1;
     return memcmp(&md5_digest, &other.md5_digest, sizeof(md5_digest));
   }
 
@@ -46,8 +65,15 @@ struct BlockHash : public common::Comparable<BlockHash> {
   //     Block properties: type, size, data_size, reference count
   //     References (increasing source offset): source offset, type, size
   //     Data (skipping references)
-  void Hash(const BlockGraph::Block* block);
+  // @param block The block to be hashed.
+  // @param hash_type The hash function to use. Defaults to MD5_HASH.
+  void Hash(const BlockGraph::Block* block) { Hash(block, MD5_HASH); }
+  void Hash(const BlockGraph::Block* block, HashType hash_type);
 
+  // The hash function that produced the digest.
+  HashType type;
+  // The digest. Despite its name, this holds the digest of either hash
+  // function.
   base::MD5Digest md5_digest;
 };
 
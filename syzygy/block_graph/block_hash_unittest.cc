@@ -100,4 +100,48 @@ TEST(BlockHash, HashAndCompare) {
   EXPECT_NE(0, code_block_1_hash.Compare(BlockHash(test_block)));
 }
 
+TEST(BlockHash, FastHashAndCompare) {
+  BlockGraph block_graph;
+  const size_t kBlockSize = 0x50;
+  const size_t kReferenceOffset = 0x21;
+
+  BlockGraph::Block* block_1 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, kBlockSize, "block 1");
+  BlockGraph::Block* block_2 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, kBlockSize, "block 2");
+  BlockGraph::Block* blocks[] = { block_1, block_2 };
+  for (BlockGraph::Block* block : blocks) {
+    uint8_t* data = block->ResizeData(kBlockSize - 3);
+    ASSERT_NE(reinterpret_cast<uint8_t*>(NULL), data);
+    for (size_t i = 0; i < block->data_size(); ++i)
+      data[i] = static_cast<uint8_t>(i * 13);
+    EXPECT_TRUE(block->SetReference(kReferenceOffset,
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, block_2, 0, 0)));
+  }
+
+  BlockHash hash_1(block_1, BlockHash::FAST_HASH);
+  EXPECT_EQ(BlockHash::FAST_HASH, hash_1.type);
+  EXPECT_EQ(0, hash_1.Compare(BlockHash(block_2, BlockHash::FAST_HASH)));
+
+  // The hashes of different functions never compare equal.
+  EXPECT_NE(0, hash_1.Compare(BlockHash(block_1)));
+
+  // The data under a reference is ignored.
+  block_2->GetMutableData()[kReferenceOffset + 1] ^= 0xFF;
+  EXPECT_EQ(0, hash_1.Compare(BlockHash(block_2, BlockHash::FAST_HASH)));
+
+  // Any other byte isn't.
+  for (size_t i = 0; i < block_2->data_size(); ++i) {
+    if (i >= kReferenceOffset && i < kReferenceOffset + 4)
+      continue;
+    block_2->GetMutableData()[i] ^= 0x01;
+    EXPECT_NE(0, hash_1.Compare(BlockHash(block_2, BlockHash::FAST_HASH)));
+    block_2->GetMutableData()[i] ^= 0x01;
+  }
+
+  // Nor is the size of the block.
+  block_2->set_size(kBlockSize + 1);
+  EXPECT_NE(0, hash_1.Compare(BlockHash(block_2, BlockHash::FAST_HASH)));
+}
+
 }  // namespace block_graph
@@ -16,7 +16,47 @@
 
 namespace block_graph {
 
+namespace {
+
+// Determines if the given range is unmarked, using the page map of the filter
+// if there is one.
+bool IsUnmarked(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
+                const RelativeAddressFilter::Range& range) {
+  if (page_map == NULL || page_map->empty())
+    return filter.IsUnmarked(range);
+  return page_map->IsUnmarked(filter, range);
+}
+
+}  // namespace
+
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const BlockGraph::Block* block) {
+  return IsFiltered(filter, NULL, block);
+}
+
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const BasicBlock* basic_block) {
+  return IsFiltered(filter, NULL, basic_block);
+}
+
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const BasicCodeBlock* basic_block) {
+  return IsFiltered(filter, NULL, basic_block);
+}
+
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const BasicDataBlock* basic_block) {
+  return IsFiltered(filter, NULL, basic_block);
+}
+
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const Instruction& instruction) {
+  return IsFiltered(filter, NULL, instruction);
+}
+
 bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
                 const BlockGraph::Block* block) {
   DCHECK(block != NULL);
 
@@ -27,7 +67,7 @@ bool IsFiltered(const RelativeAddressFilter& filter,
   for (; it != block->source_ranges().range_pairs().end(); ++it) {
     // If a block is *not* unmarked, then it's at least partially marked.
     // Which to us means it is filtered.
-    if (!filter.IsUnmarked(it->second))
+    if (!IsUnmarked(filter, page_map, it->second))
       return true;
   }
 
@@ -35,19 +75,20 @@ bool IsFiltered(const RelativeAddressFilter& filter,
 }
 
 bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
                 const BasicBlock* basic_block) {
   DCHECK(basic_block != NULL);
 
   if (basic_block->type() == BasicBlock::BASIC_DATA_BLOCK) {
     const BasicDataBlock* basic_data_block = BasicDataBlock::Cast(basic_block);
     DCHECK(basic_data_block != NULL);
-    if (!IsFiltered(filter, basic_data_block))
+    if (!IsFiltered(filter, page_map, basic_data_block))
       return false;
   } else {
     DCHECK_EQ(BasicBlock::BASIC_CODE_BLOCK, basic_block->type());
     const BasicCodeBlock* basic_code_block = BasicCodeBlock::Cast(basic_block);
     DCHECK(basic_code_block != NULL);
-    if (!IsFiltered(filter, basic_code_block))
+    if (!IsFiltered(filter, page_map, basic_code_block))
       return false;
   }
 
@@ -55,6 +96,7 @@ bool IsFiltered(const RelativeAddressFilter& filter,
 }
 
 bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
                 const BasicCodeBlock* basic_block) {
   DCHECK(basic_block != NULL);
 
@@ -63,7 +105,7 @@ bool IsFiltered(const RelativeAddressFilter& filter,
   BasicBlock::Instructions::const_iterator it =
       basic_block->instructions().begin();
   for (; it != basic_block->instructions().end(); ++it) {
-    if (!filter.IsUnmarked(it->source_range()))
+    if (!IsUnmarked(filter, page_map, it->source_range()))
       return true;
   }
 
@@ -71,18 +113,20 @@ bool IsFiltered(const RelativeAddressFilter& filter,
 }
 
 bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
                 const BasicDataBlock* basic_block) {
   DCHECK(basic_block != NULL);
 
-  if (filter.IsUnmarked(basic_block->source_range()))
+  if (IsUnmarked(filter, page_map, basic_block->source_range()))
     return false;
 
   return true;
 }
 
 bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
                 const Instruction& instruction) {
-  if (filter.IsUnmarked(instruction.source_range()))
+  if (IsUnmarked(filter, page_map, instruction.source_range()))
     return false;
 
   return true;
@@ -22,11 +22,14 @@
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address_filter.h"
+#include "syzygy/core/address_filter_page_map.h"
 
 namespace block_graph {
 
 typedef core::AddressFilter<core::RelativeAddress, size_t>
     RelativeAddressFilter;
+typedef core::AddressFilterPageMap<core::RelativeAddress, size_t>
+    RelativeAddressFilterPageMap;
 
 // Determines if the given @p block is filtered. A block is filtered if any of
 // it's source data is marked in the filter.
@@ -56,6 +59,29 @@ bool IsFiltered(const RelativeAddressFilter& filter,
 bool IsFiltered(const RelativeAddressFilter& filter,
                 const block_graph::Instruction& instruction);
 
+// Versions of the above that consult a page map of the filter first, so that
+// only the ranges lying on partially marked pages are looked up in the
+// filter itself.
+// @param filter The filter to be checked.
+// @param page_map The page map of @p filter. May be NULL, in which case the
+//     filter is checked directly.
+// @returns true if the object is filtered, false otherwise.
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
+                const block_graph::BlockGraph::Block* block);
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
+                const block_graph::BasicBlock* basic_block);
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
+                const block_graph::BasicCodeBlock* basic_block);
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
+                const block_graph::BasicDataBlock* basic_block);
+bool IsFiltered(const RelativeAddressFilter& filter,
+                const RelativeAddressFilterPageMap* page_map,
+                const block_graph::Instruction& instruction);
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_FILTER_UTIL_H_
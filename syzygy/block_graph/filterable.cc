@@ -20,14 +20,14 @@ bool Filterable::IsFiltered(const block_graph::BlockGraph::Block* block) const {
   DCHECK(block != NULL);
   if (filter_ == NULL)
     return false;
-  return block_graph::IsFiltered(*filter_, block);
+  return block_graph::IsFiltered(*filter_, filter_page_map_, block);
 }
 
 bool Filterable::IsFiltered(const block_graph::BasicBlock* basic_block) const {
   DCHECK(basic_block != NULL);
   if (filter_ == NULL)
     return false;
-  return block_graph::IsFiltered(*filter_, basic_block);
+  return block_graph::IsFiltered(*filter_, filter_page_map_, basic_block);
 }
 
 bool Filterable::IsFiltered(
@@ -35,7 +35,7 @@ bool Filterable::IsFiltered(
   DCHECK(basic_block != NULL);
   if (filter_ == NULL)
     return false;
-  return block_graph::IsFiltered(*filter_, basic_block);
+  return block_graph::IsFiltered(*filter_, filter_page_map_, basic_block);
 }
 
 bool Filterable::IsFiltered(
@@ -43,13 +43,13 @@ bool Filterable::IsFiltered(
   DCHECK(basic_block != NULL);
   if (filter_ == NULL)
     return false;
-  return block_graph::IsFiltered(*filter_, basic_block);
+  return block_graph::IsFiltered(*filter_, filter_page_map_, basic_block);
 }
 
 bool Filterable::IsFiltered(const block_graph::Instruction& instruction) const {
   if (filter_ == NULL)
     return false;
-  return block_graph::IsFiltered(*filter_, instruction);
+  return block_graph::IsFiltered(*filter_, filter_page_map_, instruction);
 }
 
 }  // namespace block_graph
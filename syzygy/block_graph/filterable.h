@@ -24,18 +24,34 @@ namespace block_graph {
 
 class Filterable {
  public:
-  Filterable() : filter_(NULL) { }
-  explicit Filterable(const RelativeAddressFilter* filter) : filter_(filter) { }
+  Filterable() : filter_(NULL), filter_page_map_(NULL) { }
+  explicit Filterable(const RelativeAddressFilter* filter)
+      : filter_(filter), filter_page_map_(NULL) { }
 
-  // Sets the filter to be used by this object.
+  // Sets the filter to be used by this object. This forgets the page map of
+  // the previous filter.
   // @param filter The filter to use. May be NULL.
   void set_filter(const RelativeAddressFilter* filter) {
     filter_ = filter;
+    filter_page_map_ = NULL;
   }
 
   // Returns the filter currently used by this object.
   const RelativeAddressFilter* filter() const { return filter_; }
 
+  // Sets the page map of the filter, which speeds up the lookups in the
+  // filter. The map must be kept up to date with the filter.
+  // @param filter_page_map The page map to use. May be NULL.
+  void set_filter_page_map(
+      const RelativeAddressFilterPageMap* filter_page_map) {
+    filter_page_map_ = filter_page_map;
+  }
+
+  // Returns the page map of the filter currently used by this object.
+  const RelativeAddressFilterPageMap* filter_page_map() const {
+    return filter_page_map_;
+  }
+
   // Determines if the given object is filtered.
   // @param basic_block The basic block to be checked.
   // @returns true if the object filtered, false otherwise.
@@ -48,6 +64,7 @@ class Filterable {
 
  private:
   const RelativeAddressFilter* filter_;
+  const RelativeAddressFilterPageMap* filter_page_map_;
 
   DISALLOW_COPY_AND_ASSIGN(Filterable);
 };
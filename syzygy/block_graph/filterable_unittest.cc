@@ -47,6 +47,15 @@ TEST(FilterableTest, Accessors)  {
 
   f.set_filter(NULL);
   EXPECT_TRUE(f.filter() == NULL);
+
+  RelativeAddressFilterPageMap page_map;
+  f.set_filter(&raf);
+  f.set_filter_page_map(&page_map);
+  EXPECT_EQ(&page_map, f.filter_page_map());
+
+  // Changing the filter forgets the page map.
+  f.set_filter(&raf);
+  EXPECT_TRUE(f.filter_page_map() == NULL);
 }
 
 TEST(FilterableTest, IsFiltered) {
@@ -114,6 +123,34 @@ TEST(FilterableTest, IsFiltered) {
   EXPECT_TRUE(f.IsFiltered(code_bb_ptr));
   EXPECT_TRUE(f.IsFiltered(data_bb_ptr));
   EXPECT_TRUE(f.IsFiltered(inst));
+
+  // The results are the same when looking up the filter through a page map
+  // whose pages are partially marked.
+  RelativeAddressFilterPageMap page_map;
+  page_map.Init(raf, 16);
+  f.set_filter_page_map(&page_map);
+  EXPECT_TRUE(f.IsFiltered(block));
+  EXPECT_TRUE(f.IsFiltered(code_bb));
+  EXPECT_TRUE(f.IsFiltered(data_bb));
+  EXPECT_TRUE(f.IsFiltered(inst));
+
+  // And through a page map whose pages are marked as a whole.
+  raf.Mark(Range(RelativeAddress(0), 100));
+  page_map.Init(raf, 16);
+  EXPECT_EQ("1111111", page_map.pages());
+  EXPECT_TRUE(f.IsFiltered(block));
+  EXPECT_TRUE(f.IsFiltered(code_bb));
+  EXPECT_TRUE(f.IsFiltered(data_bb));
+  EXPECT_TRUE(f.IsFiltered(inst));
+
+  // Nothing is filtered once the filter and its page map are cleared.
+  raf.Clear();
+  page_map.Init(raf, 16);
+  EXPECT_EQ("0000000", page_map.pages());
+  EXPECT_FALSE(f.IsFiltered(block));
+  EXPECT_FALSE(f.IsFiltered(code_bb));
+  EXPECT_FALSE(f.IsFiltered(data_bb));
+  EXPECT_FALSE(f.IsFiltered(inst));
 }
 
 }  // namespace block_graph
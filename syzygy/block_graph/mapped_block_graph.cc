@@ -0,0 +1,538 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/mapped_block_graph.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/files/file_util.h"
+
+namespace block_graph {
+
+namespace {
+
+typedef BlockGraph::Block Block;
+
+// A string in the string pool.
+struct StringRecord {
+  uint32_t offset;
+  uint32_t size;
+};
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t attributes;
+  uint32_t image_format;
+  uint32_t next_section_id;
+  uint32_t next_block_id;
+  uint32_t section_count;
+  uint32_t block_count;
+  uint32_t source_range_count;
+  uint32_t label_count;
+  uint32_t reference_count;
+  uint32_t strings_size;
+  uint32_t data_size;
+};
+
+struct SectionRecord {
+  uint32_t id;
+  uint32_t characteristics;
+  StringRecord name;
+};
+
+struct BlockRecord {
+  uint32_t id;
+  uint32_t type;
+  uint32_t size;
+  uint32_t alignment;
+  int32_t alignment_offset;
+  uint32_t padding_before;
+  uint32_t addr;
+  uint32_t section;
+  uint32_t attributes;
+  StringRecord name;
+  StringRecord compiland_name;
+  // The data of the block, in the data pool.
+  uint32_t data_offset;
+  uint32_t data_size;
+  // The slices of the block in the source range, label and reference arrays.
+  uint32_t first_source_range;
+  uint32_t source_range_count;
+  uint32_t first_label;
+  uint32_t label_count;
+  uint32_t first_reference;
+  uint32_t reference_count;
+};
+
+struct SourceRangeRecord {
+  int32_t data_start;
+  uint32_t data_size;
+  uint32_t source_start;
+  uint32_t source_size;
+};
+
+struct LabelRecord {
+  int32_t offset;
+  uint32_t attributes;
+  StringRecord name;
+};
+
+struct ReferenceRecord {
+  int32_t source_offset;
+  uint8_t type;
+  uint8_t size;
+  uint16_t reserved;
+  // The index of the referenced block in the block array. This is resolved
+  // without a lookup when loading.
+  uint32_t referenced;
+  int32_t offset;
+  int32_t base;
+};
+
+// The records are read in place, they must keep their alignment.
+static_assert(sizeof(Header) % sizeof(uint32_t) == 0, "Misaligned header.");
+static_assert(sizeof(SectionRecord) % sizeof(uint32_t) == 0,
+              "Misaligned section record.");
+static_assert(sizeof(BlockRecord) % sizeof(uint32_t) == 0,
+              "Misaligned block record.");
+static_assert(sizeof(SourceRangeRecord) % sizeof(uint32_t) == 0,
+              "Misaligned source range record.");
+static_assert(sizeof(LabelRecord) % sizeof(uint32_t) == 0,
+              "Misaligned label record.");
+static_assert(sizeof(ReferenceRecord) % sizeof(uint32_t) == 0,
+              "Misaligned reference record.");
+
+bool ValidAttributes(uint32_t attributes, uint32_t attributes_max) {
+  return (attributes & ~(attributes_max - 1)) == 0;
+}
+
+// Accumulates the strings of a block-graph in a pool.
+class StringPool {
+ public:
+  StringRecord Add(const base::StringPiece& value) {
+    StringRecord record = { static_cast<uint32_t>(pool_.size()),
+                            static_cast<uint32_t>(value.size()) };
+    value.AppendToString(&pool_);
+    return record;
+  }
+
+  // @returns the contents of the pool, padded to a multiple of 4 bytes so
+  //     that the data pool that follows it stays aligned.
+  const std::string& Finalize() {
+    pool_.resize((pool_.size() + 3) & ~3, '\0');
+    return pool_;
+  }
+
+ private:
+  std::string pool_;
+};
+
+// Writes @p count elements of @p values to @p file.
+template <typename T>
+bool WriteArray(const T* values, size_t count, FILE* file) {
+  if (count == 0)
+    return true;
+  return ::fwrite(values, sizeof(T), count, file) == count;
+}
+
+// Gets the array of @p count records of type T at @p offset in the mapped
+// file, and advances @p offset past it.
+// @returns NULL if the array doesn't fit in the file.
+template <typename T>
+const T* GetArray(const uint8_t* data,
+                  size_t length,
+                  uint32_t count,
+                  uint64_t* offset) {
+  uint64_t end = *offset + static_cast<uint64_t>(count) * sizeof(T);
+  if (end > length)
+    return NULL;
+  const T* array = reinterpret_cast<const T*>(data + *offset);
+  *offset = end;
+  return array;
+}
+
+// Gets a string from the string pool.
+bool GetString(const char* strings,
+               uint32_t strings_size,
+               const StringRecord& record,
+               base::StringPiece* value) {
+  if (record.offset > strings_size ||
+      record.size > strings_size - record.offset) {
+    return false;
+  }
+  *value = base::StringPiece(strings + record.offset, record.size);
+  return true;
+}
+
+// Checks that the slice [@p first, @p first + @p count) fits in an array of
+// @p array_count elements.
+bool ValidSlice(uint32_t first, uint32_t count, uint32_t array_count) {
+  return first <= array_count && count <= array_count - first;
+}
+
+}  // namespace
+
+const uint32_t MappedBlockGraph::kMagic = 'GBZS';
+const uint32_t MappedBlockGraph::kVersion = 1;
+
+bool MappedBlockGraph::Save(const BlockGraph& block_graph,
+                            Attributes attributes,
+                            const base::FilePath& path) {
+  bool save_strings = (attributes & BlockGraphSerializer::OMIT_STRINGS) == 0;
+  bool save_labels = (attributes & BlockGraphSerializer::OMIT_LABELS) == 0;
+
+  // Assign the indices of the blocks, for the references to use.
+  std::map<const Block*, uint32_t> block_indices;
+  for (const auto& entry : block_graph.blocks_) {
+    uint32_t index = static_cast<uint32_t>(block_indices.size());
+    block_indices.insert(std::make_pair(&entry.second, index));
+  }
+
+  // The names of the sections are required, they are always saved.
+  StringPool strings;
+  std::vector<SectionRecord> sections;
+  for (const auto& entry : block_graph.sections_) {
+    const BlockGraph::Section& section = entry.second;
+    SectionRecord record = {};
+    record.id = static_cast<uint32_t>(section.id());
+    record.characteristics = section.characteristics();
+    record.name = strings.Add(section.name());
+    sections.push_back(record);
+  }
+
+  std::vector<BlockRecord> blocks;
+  std::vector<SourceRangeRecord> source_ranges;
+  std::vector<LabelRecord> labels;
+  std::vector<ReferenceRecord> references;
+  uint32_t data_size = 0;
+  for (const auto& entry : block_graph.blocks_) {
+    const Block& block = entry.second;
+    BlockRecord record = {};
+    record.id = static_cast<uint32_t>(block.id());
+    record.type = block.type();
+    record.size = static_cast<uint32_t>(block.size());
+    record.alignment = static_cast<uint32_t>(block.alignment());
+    record.alignment_offset = block.alignment_offset();
+    record.padding_before = static_cast<uint32_t>(block.padding_before());
+    record.addr = block.addr().value();
+    record.section = static_cast<uint32_t>(block.section());
+    record.attributes = block.attributes();
+    if (save_strings) {
+      record.name = strings.Add(block.name());
+      record.compiland_name = strings.Add(block.compiland_name());
+    }
+    record.data_offset = data_size;
+    record.data_size = static_cast<uint32_t>(block.data_size());
+    data_size += record.data_size;
+
+    record.first_source_range = static_cast<uint32_t>(source_ranges.size());
+    for (const auto& range_pair : block.source_ranges().range_pairs()) {
+      SourceRangeRecord source_range = {};
+      source_range.data_start = static_cast<int32_t>(range_pair.first.start());
+      source_range.data_size = static_cast<uint32_t>(range_pair.first.size());
+      source_range.source_start = range_pair.second.start().value();
+      source_range.source_size =
+          static_cast<uint32_t>(range_pair.second.size());
+      source_ranges.push_back(source_range);
+    }
+    record.source_range_count =
+        static_cast<uint32_t>(source_ranges.size()) - record.first_source_range;
+
+    record.first_label = static_cast<uint32_t>(labels.size());
+    if (save_labels) {
+      for (const auto& label_entry : block.labels()) {
+        LabelRecord label = {};
+        label.offset = static_cast<int32_t>(label_entry.first);
+        label.attributes = label_entry.second.attributes();
+        if (save_strings)
+          label.name = strings.Add(label_entry.second.name());
+        labels.push_back(label);
+      }
+    }
+    record.label_count =
+        static_cast<uint32_t>(labels.size()) - record.first_label;
+
+    record.first_reference = static_cast<uint32_t>(references.size());
+    for (const auto& ref_entry : block.references()) {
+      const BlockGraph::Reference& ref = ref_entry.second;
+      ReferenceRecord reference = {};
+      reference.source_offset = static_cast<int32_t>(ref_entry.first);
+      reference.type = static_cast<uint8_t>(ref.type());
+      reference.size = static_cast<uint8_t>(ref.size());
+      reference.referenced = block_indices[ref.referenced()];
+      reference.offset = static_cast<int32_t>(ref.offset());
+      reference.base = static_cast<int32_t>(ref.base());
+      references.push_back(reference);
+    }
+    record.reference_count =
+        static_cast<uint32_t>(references.size()) - record.first_reference;
+
+    blocks.push_back(record);
+  }
+
+  const std::string& string_pool = strings.Finalize();
+
+  Header header = {};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.attributes = attributes;
+  header.image_format = block_graph.image_format_;
+  header.next_section_id = static_cast<uint32_t>(block_graph.next_section_id_);
+  header.next_block_id = static_cast<uint32_t>(block_graph.next_block_id_);
+  header.section_count = static_cast<uint32_t>(sections.size());
+  header.block_count = static_cast<uint32_t>(blocks.size());
+  header.source_range_count = static_cast<uint32_t>(source_ranges.size());
+  header.label_count = static_cast<uint32_t>(labels.size());
+  header.reference_count = static_cast<uint32_t>(references.size());
+  header.strings_size = static_cast<uint32_t>(string_pool.size());
+  header.data_size = data_size;
+
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for writing: " << path.value();
+    return false;
+  }
+
+  bool result = WriteArray(&header, 1, file.get()) &&
+      WriteArray(sections.data(), sections.size(), file.get()) &&
+      WriteArray(blocks.data(), blocks.size(), file.get()) &&
+      WriteArray(source_ranges.data(), source_ranges.size(), file.get()) &&
+      WriteArray(labels.data(), labels.size(), file.get()) &&
+      WriteArray(references.data(), references.size(), file.get()) &&
+      WriteArray(string_pool.data(), string_pool.size(), file.get());
+  for (const auto& entry : block_graph.blocks_) {
+    if (!result)
+      break;
+    const Block& block = entry.second;
+    result = WriteArray(block.data(), block.data_size(), file.get());
+  }
+
+  if (!result) {
+    LOG(ERROR) << "Unable to write mapped block-graph: " << path.value();
+    return false;
+  }
+
+  return true;
+}
+
+bool MappedBlockGraph::Load(const base::FilePath& path,
+                            BlockGraph* block_graph) {
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+  DCHECK(!file_.IsValid());
+
+  if (!file_.Initialize(path)) {
+    LOG(ERROR) << "Unable to map file: " << path.value();
+    return false;
+  }
+
+  if (!LoadImpl(file_.data(), file_.length(), block_graph)) {
+    LOG(ERROR) << "Unable to load mapped block-graph: " << path.value();
+    return false;
+  }
+
+  return true;
+}
+
+bool MappedBlockGraph::LoadImpl(const uint8_t* data,
+                                size_t length,
+                                BlockGraph* block_graph) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), data);
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+
+  // The block graph should be empty.
+  DCHECK_EQ(0u, block_graph->next_section_id_);
+  DCHECK_EQ(0u, block_graph->sections_.size());
+  DCHECK_EQ(0u, block_graph->next_block_id_);
+  DCHECK_EQ(0u, block_graph->blocks_.size());
+
+  uint64_t offset = 0;
+  const Header* header = GetArray<Header>(data, length, 1, &offset);
+  if (header == NULL || header->magic != kMagic) {
+    LOG(ERROR) << "Not a mapped block-graph.";
+    return false;
+  }
+  if (header->version != kVersion) {
+    LOG(ERROR) << "Unable to load mapped block-graph with version "
+               << header->version << ".";
+    return false;
+  }
+  if (!ValidAttributes(header->attributes,
+                       BlockGraphSerializer::ATTRIBUTES_MAX) ||
+      header->image_format >= BlockGraph::IMAGE_FORMAT_MAX) {
+    LOG(ERROR) << "Invalid attributes and/or image format.";
+    return false;
+  }
+
+  const SectionRecord* sections = GetArray<SectionRecord>(
+      data, length, header->section_count, &offset);
+  const BlockRecord* blocks = GetArray<BlockRecord>(
+      data, length, header->block_count, &offset);
+  const SourceRangeRecord* source_ranges = GetArray<SourceRangeRecord>(
+      data, length, header->source_range_count, &offset);
+  const LabelRecord* labels = GetArray<LabelRecord>(
+      data, length, header->label_count, &offset);
+  const ReferenceRecord* references = GetArray<ReferenceRecord>(
+      data, length, header->reference_count, &offset);
+  const char* strings = GetArray<char>(
+      data, length, header->strings_size, &offset);
+  const uint8_t* block_data = GetArray<uint8_t>(
+      data, length, header->data_size, &offset);
+  if (sections == NULL || blocks == NULL || source_ranges == NULL ||
+      labels == NULL || references == NULL || strings == NULL ||
+      block_data == NULL) {
+    LOG(ERROR) << "Truncated mapped block-graph.";
+    return false;
+  }
+
+  attributes_ = header->attributes;
+  block_graph->image_format_ =
+      static_cast<BlockGraph::ImageFormat>(header->image_format);
+  block_graph->next_section_id_ = header->next_section_id;
+  block_graph->next_block_id_ = header->next_block_id;
+
+  for (uint32_t i = 0; i < header->section_count; ++i) {
+    const SectionRecord& record = sections[i];
+    base::StringPiece name;
+    if (record.id == BlockGraph::kInvalidSectionId ||
+        !GetString(strings, header->strings_size, record.name, &name) ||
+        name.empty()) {
+      LOG(ERROR) << "Invalid section " << i << ".";
+      return false;
+    }
+    if (!block_graph->sections_.insert(std::make_pair(
+            record.id, BlockGraph::Section(record.id, name,
+                                           record.characteristics))).second) {
+      LOG(ERROR) << "Duplicate section with id " << record.id << ".";
+      return false;
+    }
+  }
+
+  // The records are sorted by id, each block is inserted at the end of the
+  // block map.
+  std::vector<Block*> block_pointers;
+  block_pointers.reserve(header->block_count);
+  for (uint32_t i = 0; i < header->block_count; ++i) {
+    const BlockRecord& record = blocks[i];
+    base::StringPiece name;
+    base::StringPiece compiland_name;
+    if ((i > 0 && record.id <= blocks[i - 1].id) ||
+        record.type >= BlockGraph::BLOCK_TYPE_MAX ||
+        !ValidAttributes(record.attributes,
+                         BlockGraph::BLOCK_ATTRIBUTES_MAX) ||
+        record.data_size > record.size ||
+        !ValidSlice(record.data_offset, record.data_size,
+                    header->data_size) ||
+        !ValidSlice(record.first_source_range, record.source_range_count,
+                    header->source_range_count) ||
+        !ValidSlice(record.first_label, record.label_count,
+                    header->label_count) ||
+        !ValidSlice(record.first_reference, record.reference_count,
+                    header->reference_count) ||
+        !GetString(strings, header->strings_size, record.name, &name) ||
+        !GetString(strings, header->strings_size, record.compiland_name,
+                   &compiland_name)) {
+      LOG(ERROR) << "Invalid block " << i << " with id " << record.id << ".";
+      return false;
+    }
+
+    BlockGraph::BlockMap::iterator it = block_graph->blocks_.insert(
+        block_graph->blocks_.end(),
+        std::make_pair(record.id, Block(block_graph)));
+    Block* block = &it->second;
+    block->id_ = record.id;
+    block->type_ = static_cast<BlockGraph::BlockType>(record.type);
+    block->size_ = record.size;
+    block->alignment_ = record.alignment;
+    block->alignment_offset_ = record.alignment_offset;
+    block->padding_before_ = record.padding_before;
+    block->addr_ = core::RelativeAddress(record.addr);
+    block->section_ = record.section;
+    block->attributes_ = record.attributes;
+    block->set_name(name);
+    block->set_compiland_name(compiland_name);
+
+    // The data stays in the mapped file.
+    if (record.data_size != 0)
+      block->SetData(block_data + record.data_offset, record.data_size);
+
+    for (uint32_t j = 0; j < record.source_range_count; ++j) {
+      const SourceRangeRecord& source_range =
+          source_ranges[record.first_source_range + j];
+      if (!block->source_ranges_.Push(
+              Block::DataRange(source_range.data_start,
+                               source_range.data_size),
+              Block::SourceRange(
+                  core::RelativeAddress(source_range.source_start),
+                  source_range.source_size))) {
+        LOG(ERROR) << "Invalid source range for block with id " << record.id
+                   << ".";
+        return false;
+      }
+    }
+
+    for (uint32_t j = 0; j < record.label_count; ++j) {
+      const LabelRecord& label = labels[record.first_label + j];
+      base::StringPiece label_name;
+      if (!ValidAttributes(label.attributes,
+                           BlockGraph::LABEL_ATTRIBUTES_MAX) ||
+          !GetString(strings, header->strings_size, label.name,
+                     &label_name) ||
+          !block->SetLabel(label.offset, label_name,
+                           static_cast<BlockGraph::LabelAttributes>(
+                               label.attributes))) {
+        LOG(ERROR) << "Invalid label at offset " << label.offset
+                   << " of block with id " << record.id << ".";
+        return false;
+      }
+    }
+
+    block_pointers.push_back(block);
+  }
+
+  // Wire up the references once all the blocks exist.
+  for (uint32_t i = 0; i < header->block_count; ++i) {
+    const BlockRecord& record = blocks[i];
+    Block* block = block_pointers[i];
+    for (uint32_t j = 0; j < record.reference_count; ++j) {
+      const ReferenceRecord& reference =
+          references[record.first_reference + j];
+      if (reference.type >= BlockGraph::REFERENCE_TYPE_MAX ||
+          reference.size > BlockGraph::Reference::kMaximumSize ||
+          reference.referenced >= header->block_count) {
+        LOG(ERROR) << "Invalid reference at offset " << reference.source_offset
+                   << " of block with id " << record.id << ".";
+        return false;
+      }
+
+      BlockGraph::Reference ref(
+          static_cast<BlockGraph::ReferenceType>(reference.type),
+          reference.size, block_pointers[reference.referenced],
+          reference.offset, reference.base);
+      if (!block->SetReference(reference.source_offset, ref)) {
+        LOG(ERROR) << "Unable to create block reference at offset "
+                   << reference.source_offset << " of block with id "
+                   << record.id << ".";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+}  // namespace block_graph
@@ -0,0 +1,100 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares MappedBlockGraph, which saves a block-graph in a flat file
+// format meant to be memory-mapped, and loads it back without copying the
+// block data. Unlike the stream format of BlockGraphSerializer, where every
+// value is variable-length encoded and every byte of block data is copied to
+// the heap, the mapped format is made of fixed-size records:
+//
+//   Header
+//   SectionRecord[section_count]
+//   BlockRecord[block_count], sorted by block id.
+//   SourceRangeRecord[source_range_count], grouped by block.
+//   LabelRecord[label_count], grouped by block and sorted by offset.
+//   ReferenceRecord[reference_count], grouped by block and sorted by offset.
+//   The string pool, holding the names of the sections, blocks and labels.
+//   The data pool, holding the data of the blocks.
+//
+// Each block record refers to its slices of the other arrays by index, and to
+// its name and its data by offset in the pools. Loading is a single pass over
+// the records, and the data of the blocks refers to the mapped file in place.
+// Blocks that are modified after loading make a copy of their data, as they
+// do for the data they refer to in a PE file.
+
+#ifndef SYZYGY_BLOCK_GRAPH_MAPPED_BLOCK_GRAPH_H_
+#define SYZYGY_BLOCK_GRAPH_MAPPED_BLOCK_GRAPH_H_
+
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/block_graph_serializer.h"
+
+namespace block_graph {
+
+class MappedBlockGraph {
+ public:
+  typedef BlockGraphSerializer::Attributes Attributes;
+
+  // The magic value at the start of a mapped block-graph file.
+  static const uint32_t kMagic;
+  // This needs to be incremented any time a change is made to the format.
+  static const uint32_t kVersion;
+
+  MappedBlockGraph() : attributes_(0) { }
+
+  // Saves a block-graph in the mapped format.
+  // @param block_graph The block-graph to be saved.
+  // @param attributes The BlockGraphSerializer attributes controlling what is
+  //     saved. OMIT_STRINGS omits the names of the blocks and of the labels,
+  //     and OMIT_LABELS omits the labels.
+  // @param path The path of the file to be written.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  static bool Save(const BlockGraph& block_graph,
+                   Attributes attributes,
+                   const base::FilePath& path);
+
+  // Maps a file written by Save and loads the block-graph it holds. The data
+  // of the blocks refers to the mapped file, which stays mapped as long as
+  // this object lives: @p block_graph must not outlive it. This may only be
+  // called once.
+  // @param path The path of the file to be loaded.
+  // @param block_graph The block-graph to be populated. It must be empty.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool Load(const base::FilePath& path, BlockGraph* block_graph);
+
+  // @returns the attributes used when the loaded file was saved.
+  Attributes attributes() const { return attributes_; }
+
+ private:
+  // Loads the block-graph from mapped memory.
+  // @param data The mapped file.
+  // @param length The size of the mapped file.
+  // @param block_graph The block-graph to be populated.
+  // @returns true on success, false otherwise.
+  bool LoadImpl(const uint8_t* data, size_t length, BlockGraph* block_graph);
+
+  // The mapping of the loaded file.
+  base::MemoryMappedFile file_;
+  // The attributes of the loaded file.
+  Attributes attributes_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedBlockGraph);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_MAPPED_BLOCK_GRAPH_H_
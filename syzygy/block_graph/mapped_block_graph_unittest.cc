@@ -0,0 +1,129 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/mapped_block_graph.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/unittest_util.h"
+
+namespace block_graph {
+
+namespace {
+
+class MappedBlockGraphTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.path().Append(L"block_graph.bg");
+
+    ASSERT_TRUE(testing::GenerateTestBlockGraph(&block_graph_));
+    block_graph_.set_image_format(BlockGraph::PE_IMAGE);
+    BlockGraph::Block* b1 = block_graph_.GetBlockById(1);
+    ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), b1);
+    b1->set_compiland_name("b1.obj");
+    b1->set_alignment(16);
+    b1->set_alignment_offset(-4);
+    b1->set_padding_before(2);
+    b1->source_ranges().Push(BlockGraph::Block::DataRange(0, 0x20),
+        BlockGraph::Block::SourceRange(core::RelativeAddress(0x1000), 0x20));
+  }
+
+  // Saves the test block-graph with @p attributes, loads it back and checks
+  // that both are equal.
+  void SaveAndLoad(MappedBlockGraph::Attributes attributes) {
+    ASSERT_TRUE(MappedBlockGraph::Save(block_graph_, attributes, path_));
+
+    ASSERT_TRUE(mapped_.Load(path_, &loaded_));
+    EXPECT_EQ(attributes, mapped_.attributes());
+
+    BlockGraphSerializer serializer;
+    serializer.add_attributes(attributes);
+    EXPECT_TRUE(testing::BlockGraphsEqual(block_graph_, loaded_, serializer));
+    EXPECT_EQ(block_graph_.next_block_id(), loaded_.next_block_id());
+    EXPECT_EQ(block_graph_.image_format(), loaded_.image_format());
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+  BlockGraph block_graph_;
+
+  // The mapping of the loaded block-graph must outlive it.
+  MappedBlockGraph mapped_;
+  BlockGraph loaded_;
+};
+
+}  // namespace
+
+TEST_F(MappedBlockGraphTest, SaveAndLoad) {
+  ASSERT_NO_FATAL_FAILURE(SaveAndLoad(0));
+
+  // The data of the blocks refers to the mapped file.
+  const BlockGraph::Block* b1 = loaded_.GetBlockById(1);
+  ASSERT_NE(static_cast<const BlockGraph::Block*>(nullptr), b1);
+  EXPECT_FALSE(b1->owns_data());
+  EXPECT_EQ("b1", b1->name());
+  EXPECT_EQ("b1.obj", b1->compiland_name());
+  EXPECT_EQ(1u, b1->labels().size());
+
+  // Modifying a block makes a copy of its data.
+  BlockGraph::Block* b1_mutable = loaded_.GetBlockById(1);
+  b1_mutable->GetMutableData()[0] = 0xCC;
+  EXPECT_TRUE(b1_mutable->owns_data());
+}
+
+TEST_F(MappedBlockGraphTest, SaveAndLoadOmitStrings) {
+  ASSERT_NO_FATAL_FAILURE(SaveAndLoad(BlockGraphSerializer::OMIT_STRINGS));
+
+  const BlockGraph::Block* b1 = loaded_.GetBlockById(1);
+  ASSERT_NE(static_cast<const BlockGraph::Block*>(nullptr), b1);
+  EXPECT_TRUE(b1->name().empty());
+  EXPECT_TRUE(b1->compiland_name().empty());
+
+  // The sections keep their names.
+  EXPECT_EQ(block_graph_.sections(), loaded_.sections());
+}
+
+TEST_F(MappedBlockGraphTest, SaveAndLoadOmitLabels) {
+  ASSERT_NO_FATAL_FAILURE(SaveAndLoad(BlockGraphSerializer::OMIT_LABELS));
+
+  for (const auto& entry : loaded_.blocks())
+    EXPECT_TRUE(entry.second.labels().empty());
+}
+
+TEST_F(MappedBlockGraphTest, LoadFailsOnInvalidFile) {
+  static const char kJunk[] = "not a mapped block-graph";
+  ASSERT_EQ(static_cast<int>(sizeof(kJunk)),
+            base::WriteFile(path_, kJunk, sizeof(kJunk)));
+  EXPECT_FALSE(mapped_.Load(path_, &loaded_));
+  EXPECT_TRUE(loaded_.blocks().empty());
+}
+
+TEST_F(MappedBlockGraphTest, LoadFailsOnTruncatedFile) {
+  ASSERT_TRUE(MappedBlockGraph::Save(block_graph_, 0, path_));
+  int64_t size = 0;
+  ASSERT_TRUE(base::GetFileSize(path_, &size));
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path_, &contents));
+  contents.resize(static_cast<size_t>(size) - 1);
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            base::WriteFile(path_, contents.data(), contents.size()));
+
+  EXPECT_FALSE(mapped_.Load(path_, &loaded_));
+  EXPECT_TRUE(loaded_.blocks().empty());
+}
+
+}  // namespace block_graph
@@ -36,19 +36,6 @@ struct OrderedBlockGraph::CompareSectionInfo {
   }
 };
 
-// This is used for sorting and searching through the block index.
-struct OrderedBlockGraph::CompareBlockInfo {
-  bool operator()(const BlockInfo& b1, const BlockInfo& b2) const {
-    return *b1.it < *b2.it;
-  }
-  bool operator()(const BlockInfo& b1, const Block* b2) const {
-    return *b1.it < b2;
-  }
-  bool operator()(const Block* b1, const BlockInfo& b2) const {
-    return b1 < *b2.it;
-  }
-};
-
 OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
     : block_graph_(block_graph) {
   DCHECK(block_graph != NULL);
@@ -85,14 +72,20 @@ OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
 
   // Iterate through the blocks and place them into the appropriate BlockLists.
   // Each sections BlockList will contain the blocks in the order of their
-  // block graph ID.
-  block_infos_.resize(block_graph_->blocks().size());
+  // block graph ID. The block map is ordered by ID, so its last block has the
+  // largest one.
+  if (!block_graph_->blocks().empty()) {
+    BlockInfo empty_info = {};
+    block_infos_.resize(block_graph_->blocks().rbegin()->first + 1,
+                        empty_info);
+  }
   BlockGraph::BlockMap::iterator block_it =
       block_graph_->blocks_mutable().begin();
   BlockGraph::BlockMap::iterator block_end =
       block_graph_->blocks_mutable().end();
-  for (size_t i = 0; block_it != block_end; ++block_it, ++i) {
-    DCHECK_LT(i, block_infos_.size());
+  for (; block_it != block_end; ++block_it) {
+    DCHECK_EQ(block_it->first, block_it->second.id());
+    DCHECK_LT(block_it->first, block_infos_.size());
     // Get the SectionInfo for the section containing the block.
     BlockGraph::SectionId section_id = block_it->second.section();
     const Section* section = block_graph_->GetSectionById(section_id);
@@ -102,13 +95,11 @@ OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
     Block* block = &block_it->second;
 
     OrderedSection* ordered_section = &section_info->ordered_section;
-    block_infos_[i].ordered_section = ordered_section;
-    block_infos_[i].it = ordered_section->ordered_blocks_.insert(
+    BlockInfo& block_info = block_infos_[block_it->first];
+    block_info.ordered_section = ordered_section;
+    block_info.it = ordered_section->ordered_blocks_.insert(
         ordered_section->ordered_blocks_.end(), block);
   }
-
-  // Sort the BlockInfos so that we can use GetBlockInfo.
-  std::sort(block_infos_.begin(), block_infos_.end(), CompareBlockInfo());
 }
 
 const OrderedBlockGraph::OrderedSection& OrderedBlockGraph::ordered_section(
@@ -269,6 +260,61 @@ void OrderedBlockGraph::PlaceAtTail(const Section* section,
   DCHECK_EQ(*(block_info->it), block);
 }
 
+void OrderedBlockGraph::PlaceAtHead(const Section* section,
+                                    const BlockVector& blocks) {
+  SectionInfo* section_info = GetSectionInfo(section);
+  DCHECK(section_info != NULL);
+
+  BlockList& ordered_blocks(section_info->ordered_section.ordered_blocks_);
+
+  // The blocks are spliced in turn before what was the head of the section,
+  // so that they end up at its head in the given order.
+  BlockList::iterator pos = ordered_blocks.begin();
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    Block* block = blocks[i];
+    DCHECK(block != NULL);
+    BlockInfo* block_info = GetBlockInfo(block);
+    DCHECK(block_info != NULL);
+
+    // Already in place? Move on to the next position.
+    if (block_info->ordered_section == &section_info->ordered_section &&
+        block_info->it == pos) {
+      ++pos;
+      continue;
+    }
+
+    ordered_blocks.splice(pos,
+                          block_info->ordered_section->ordered_blocks_,
+                          block_info->it);
+    --(block_info->it = pos);
+    block_info->ordered_section = &section_info->ordered_section;
+    block->set_section(section_info->id());
+    DCHECK_EQ(*(block_info->it), block);
+  }
+}
+
+void OrderedBlockGraph::PlaceAtTail(const Section* section,
+                                    const BlockVector& blocks) {
+  SectionInfo* section_info = GetSectionInfo(section);
+  DCHECK(section_info != NULL);
+
+  BlockList& ordered_blocks(section_info->ordered_section.ordered_blocks_);
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    Block* block = blocks[i];
+    DCHECK(block != NULL);
+    BlockInfo* block_info = GetBlockInfo(block);
+    DCHECK(block_info != NULL);
+
+    ordered_blocks.splice(ordered_blocks.end(),
+                          block_info->ordered_section->ordered_blocks_,
+                          block_info->it);
+    --(block_info->it = ordered_blocks.end());
+    block_info->ordered_section = &section_info->ordered_section;
+    block->set_section(section_info->id());
+    DCHECK_EQ(*(block_info->it), block);
+  }
+}
+
 void OrderedBlockGraph::PlaceBefore(const BlockGraph::Block* anchored_block,
                                     BlockGraph::Block* moved_block) {
   DCHECK(anchored_block != NULL);
@@ -352,14 +398,12 @@ OrderedBlockGraph::SectionInfo* OrderedBlockGraph::GetSectionInfo(
 
 const OrderedBlockGraph::BlockInfo* OrderedBlockGraph::GetBlockInfo(
     const Block* block) const {
-  std::vector<BlockInfo>::const_iterator it =
-      std::lower_bound(block_infos_.begin(),
-                       block_infos_.end(),
-                       block,
-                       CompareBlockInfo());
-  DCHECK(it != block_infos_.end());
-  DCHECK_EQ(block, *(it->it));
-  return &(*it);
+  DCHECK(block != NULL);
+  DCHECK_LT(block->id(), block_infos_.size());
+  const BlockInfo* block_info = &block_infos_[block->id()];
+  DCHECK(block_info->ordered_section != NULL);
+  DCHECK_EQ(block, *(block_info->it));
+  return block_info;
 }
 
 OrderedBlockGraph::BlockInfo* OrderedBlockGraph::GetBlockInfo(
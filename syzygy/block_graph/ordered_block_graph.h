@@ -78,6 +78,7 @@ class OrderedBlockGraph {
   // For convenience.
   typedef BlockGraph::Block Block;
   typedef BlockGraph::Section Section;
+  typedef std::vector<Block*> BlockVector;
 
   // The type of the ordered list of blocks that is maintained for each section.
   typedef std::list<Block*> BlockList;
@@ -182,6 +183,24 @@ class OrderedBlockGraph {
   // @param block the block to be moved.
   void PlaceAtTail(const Section* section, Block* block);
 
+  // Moves the given blocks to the head of the given section, in the order in
+  // which they are given. This is equivalent to calling PlaceAtHead on each
+  // of the blocks in reverse order, but splices them in a single pass.
+  //
+  // @param section the section into which the blocks should be placed. May be
+  //     NULL, indicating that the blocks lie outside of all known sections.
+  // @param blocks the blocks to be moved. Each block may appear only once.
+  void PlaceAtHead(const Section* section, const BlockVector& blocks);
+
+  // Moves the given blocks to the tail of the given section, in the order in
+  // which they are given. This is equivalent to calling PlaceAtTail on each
+  // of the blocks in order.
+  //
+  // @param section the section into which the blocks should be placed. May be
+  //     NULL, indicating that the blocks lie outside of all known sections.
+  // @param blocks the blocks to be moved. Each block may appear only once.
+  void PlaceAtTail(const Section* section, const BlockVector& blocks);
+
   // Moves @p moved_block so that it lies immediately before @p anchored_block.
   // If @p moved_block does not belong to the same section it will have its
   // section attribute updated.
@@ -216,7 +235,6 @@ class OrderedBlockGraph {
   struct SectionInfo;
   struct BlockInfo;
   struct CompareSectionInfo;
-  struct CompareBlockInfo;
 
   // @{
   // @returns the SectionInfo representing the given Section*.
@@ -244,9 +262,9 @@ class OrderedBlockGraph {
   std::vector<SectionInfo> section_infos_;
   // Stores a full set of iterators pointing to all of the blocks in the various
   // OrderedSection BlockLists. This is allocated once and reused. The entries
-  // are sorted based on the block pointers referred to by the iterators. In
-  // this way we can do a fast lookup from Block* to the BlockList containing
-  // it, as well as the iterator to it.
+  // are indexed by block ID, so that mapping from a Block* to the BlockList
+  // containing it, and to the iterator to it, takes constant time. The entries
+  // of IDs that have no block have a NULL ordered section.
   std::vector<BlockInfo> block_infos_;
 
   DISALLOW_COPY_AND_ASSIGN(OrderedBlockGraph);
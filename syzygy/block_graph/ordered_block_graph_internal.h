@@ -121,45 +121,15 @@ void OrderedBlockGraph::Sort(const Section* section,
   SectionInfo* section_info = GetSectionInfo(section);
   DCHECK(section_info != NULL);
 
-  // Build an index which can be used to find the BlockInfo index from a
-  // Block*.
-  typedef std::vector<std::pair<Block*, size_t>> ReverseIndex;
-  ReverseIndex rindex;
   BlockList& blocks(section_info->ordered_section.ordered_blocks_);
-  rindex.reserve(blocks.size());
-  BlockList::iterator it = blocks.begin();
-  for (; it != blocks.end(); ++it) {
-    Block* block = *it;
-    DCHECK(block != NULL);
-
-    BlockInfo* block_info = GetBlockInfo(block);
-    DCHECK(block_info != NULL);
-
-    size_t index = block_info - &block_infos_[0];
-    rindex.push_back(std::make_pair(block, index));
-  }
-  // Sort this based on Block*, which std::pair does for us by default.
-  std::sort(rindex.begin(), rindex.end());
-
   typedef internal::BlockListSortAdapter<BlockCompareFunctor> Adapter;
   internal::SortList(Adapter(block_compare_functor),
-                     rindex.size(),
+                     blocks.size(),
                      &blocks);
 
-  // Rebuild the block index using the index to find the affected BlockInfo
-  // entries.
-  for (it = blocks.begin(); it != blocks.end(); ++it) {
-    Block* block = *it;
-    DCHECK(block != NULL);
-
-    ReverseIndex::const_iterator rindex_it = std::lower_bound(
-        rindex.begin(), rindex.end(),
-        std::make_pair(block, static_cast<size_t>(0)));
-    DCHECK(rindex_it != rindex.end());
-    DCHECK_EQ(rindex_it->first, block);
-
-    block_infos_[rindex_it->second].it = it;
-  }
+  // SortList only splices within the list, which leaves the iterators held by
+  // the block index valid.
+  DCHECK(blocks.empty() || GetBlockInfo(blocks.front())->it == blocks.begin());
 }
 
 }  // namespace block_graph
@@ -353,6 +353,63 @@ TEST_F(OrderedBlockGraphTest, BlockPlaceAtTailDifferentSection) {
   EXPECT_TRUE(ordered.IndicesAreValid());
 }
 
+TEST_F(OrderedBlockGraphTest, BlockVectorPlaceAtHead) {
+  InitBlockGraph(2, 4, 0);
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 2, 3, 4);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 5, 6, 7, 8);
+
+  // The head of the section, a block further down, and a block of another
+  // section.
+  OrderedBlockGraph::BlockVector blocks;
+  blocks.push_back(block_graph_.GetBlockById(1));
+  blocks.push_back(block_graph_.GetBlockById(4));
+  blocks.push_back(block_graph_.GetBlockById(6));
+  ordered.PlaceAtHead(block_graph_.GetSectionById(0), blocks);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 4, 6, 2, 3);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 5, 7, 8);
+  EXPECT_EQ(0, block_graph_.GetBlockById(6)->section());
+  EXPECT_TRUE(ordered.IndicesAreValid());
+
+  // Blocks already in place stay there.
+  ordered.PlaceAtHead(block_graph_.GetSectionById(0), blocks);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 4, 6, 2, 3);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+
+  ordered.PlaceAtHead(block_graph_.GetSectionById(1),
+                      OrderedBlockGraph::BlockVector());
+  EXPECT_SECTION_CONTAINS(ordered, 1, 5, 7, 8);
+}
+
+TEST_F(OrderedBlockGraphTest, BlockVectorPlaceAtTail) {
+  InitBlockGraph(2, 3, 1);
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 2, 3);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 5, 6);
+
+  OrderedBlockGraph::BlockVector blocks;
+  blocks.push_back(block_graph_.GetBlockById(7));
+  blocks.push_back(block_graph_.GetBlockById(1));
+  blocks.push_back(block_graph_.GetBlockById(5));
+  ordered.PlaceAtTail(block_graph_.GetSectionById(0), blocks);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 2, 3, 7, 1, 5);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 6);
+  EXPECT_SECTION_CONTAINS(ordered, BlockGraph::kInvalidSectionId);
+  EXPECT_EQ(0, block_graph_.GetBlockById(7)->section());
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
+TEST_F(OrderedBlockGraphTest, BlockIndexSkipsRemovedIds) {
+  InitBlockGraph(1, 3, 0);
+  ASSERT_TRUE(block_graph_.RemoveBlockById(2));
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 3);
+  ordered.PlaceAtHead(block_graph_.GetSectionById(0),
+                      block_graph_.GetBlockById(3));
+  EXPECT_SECTION_CONTAINS(ordered, 0, 3, 1);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
 TEST_F(OrderedBlockGraphTest, BlockPlaceBeforeDifferentSection) {
   InitBlockGraph(2, 1, 0);
   TestOrderedBlockGraph ordered(&block_graph_);
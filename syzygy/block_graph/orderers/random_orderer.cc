@@ -72,8 +72,7 @@ void RandomOrderer::ShuffleBlocks(
                      section->ordered_blocks().end());
   std::random_shuffle(blocks.begin(), blocks.end(), rng_);
 
-  for (size_t i = 0; i < blocks.size(); ++i)
-    obg->PlaceAtTail(section->section(), blocks[i]);
+  obg->PlaceAtTail(section->section(), blocks);
 }
 
 }  // namespace orderers
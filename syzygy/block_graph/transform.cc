@@ -14,12 +14,67 @@
 
 #include "syzygy/block_graph/transform.h"
 
+#include <algorithm>
+
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 
 namespace block_graph {
 
+namespace {
+
+typedef std::vector<BasicBlockSubGraphTransformInterface*>
+    BasicBlockSubGraphTransforms;
+
+// Applies a series of basic-block transforms to a subgraph. This is run on a
+// worker thread when the transforms are thread-safe.
+class TransformSubGraphTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param transforms The transforms to apply.
+  // @param policy The policy object restricting how the transforms are
+  //     applied.
+  // @param block_graph The block graph of which @p subgraph is a part.
+  // @param subgraph The subgraph to transform.
+  TransformSubGraphTask(const BasicBlockSubGraphTransforms* transforms,
+                        const TransformPolicyInterface* policy,
+                        BlockGraph* block_graph,
+                        BasicBlockSubGraph* subgraph)
+      : transforms_(transforms), policy_(policy), block_graph_(block_graph),
+        subgraph_(subgraph), succeeded_(false) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    for (BasicBlockSubGraphTransformInterface* transform : *transforms_) {
+      DCHECK(transform != NULL);
+      if (!transform->TransformBasicBlockSubGraph(policy_, block_graph_,
+                                                  subgraph_)) {
+        return;
+      }
+    }
+    succeeded_ = true;
+  }
+  // @}
+
+  // @returns true if all the transforms succeeded.
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  const BasicBlockSubGraphTransforms* transforms_;
+  const TransformPolicyInterface* policy_;
+  BlockGraph* block_graph_;
+  BasicBlockSubGraph* subgraph_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(TransformSubGraphTask);
+};
+
+}  // namespace
+
 bool ApplyImageLayoutTransform(
     ImageLayoutTransformInterface* transform,
     const TransformPolicyInterface* policy,
@@ -232,4 +287,82 @@ bool ApplyBasicBlockSubGraphTransforms(
   return true;
 }
 
+bool ApplyBasicBlockSubGraphTransformsToBlocks(
+    const std::vector<BasicBlockSubGraphTransformInterface*>& transforms,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    const BlockVector& blocks,
+    size_t num_threads,
+    BlockVector* new_blocks) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  for (BlockGraph::Block* block : blocks) {
+    DCHECK(block != NULL);
+    DCHECK_EQ(BlockGraph::CODE_BLOCK, block->type());
+    DCHECK(policy->BlockIsSafeToBasicBlockDecompose(block));
+  }
+
+  // Phase one: decompose the blocks to basic blocks and call the transforms.
+  BasicBlockDecomposer::BatchResults results;
+  BasicBlockDecomposer::DecomposeBlocks(
+      ConstBlockVector(blocks.begin(), blocks.end()), num_threads, &results);
+  DCHECK_EQ(blocks.size(), results.size());
+
+  std::vector<BasicBlockSubGraph*> subgraphs;
+  ScopedVector<TransformSubGraphTask> tasks;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    BasicBlockDecomposer::BatchResult* result = results[i];
+    if (!result->decomposed) {
+      // As in ApplyBasicBlockSubGraphTransform, mark blocks with unsupported
+      // instructions so that they won't be processed again.
+      if (result->contains_unsupported_instructions) {
+        VLOG(1) << "Block contains unsupported instruction(s): "
+                << BlockInfo(blocks[i]);
+        blocks[i]->set_attribute(BlockGraph::UNSUPPORTED_INSTRUCTIONS);
+        continue;
+      }
+      return false;
+    }
+
+    subgraphs.push_back(&result->subgraph);
+    tasks.push_back(new TransformSubGraphTask(&transforms, policy,
+                                              block_graph, &result->subgraph));
+  }
+
+  bool thread_safe = std::all_of(
+      transforms.begin(), transforms.end(),
+      [](const BasicBlockSubGraphTransformInterface* transform) {
+        return transform->IsThreadSafe();
+      });
+  if (num_threads > 1 && thread_safe && tasks.size() > 1) {
+    base::DelegateSimpleThreadPool pool(
+        "TransformSubGraph",
+        static_cast<int>(std::min(num_threads, tasks.size())));
+    pool.Start();
+    for (TransformSubGraphTask* task : tasks)
+      pool.AddWork(task);
+    pool.JoinAll();
+  } else {
+    for (TransformSubGraphTask* task : tasks)
+      task->Run();
+  }
+
+  for (const TransformSubGraphTask* task : tasks) {
+    if (!task->succeeded())
+      return false;
+  }
+
+  // Phase two: update the block-graph post transform.
+  BlockBuilder builder(block_graph);
+  if (!builder.Merge(subgraphs))
+    return false;
+
+  if (new_blocks != NULL) {
+    new_blocks->assign(builder.new_blocks().begin(),
+                       builder.new_blocks().end());
+  }
+
+  return true;
+}
+
 }  // namespace block_graph
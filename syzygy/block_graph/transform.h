@@ -98,6 +98,14 @@ class BasicBlockSubGraphTransformInterface {
       const TransformPolicyInterface* policy,
       BlockGraph* block_graph,
       BasicBlockSubGraph* basic_block_subgraph) = 0;
+
+  // Indicates whether this transform may be applied to several subgraphs
+  // concurrently. Such a transform must not modify the block graph, nor any
+  // state that it shares between subgraphs, and must not query the policy
+  // object about blocks as policies may cache their answers.
+  //
+  // @returns true if TransformBasicBlockSubGraph may be called concurrently.
+  virtual bool IsThreadSafe() const { return false; }
 };
 
 // Applies the provided BasicBlockSubGraphTransform to a single block. Takes
@@ -140,6 +148,33 @@ bool ApplyBasicBlockSubGraphTransforms(
     BlockGraph::Block* block,
     BlockVector* new_blocks);
 
+// Applies a series of BasicBlockSubGraphTransforms to a set of blocks, in two
+// phases. The blocks are first basic-block decomposed and transformed, using
+// up to @p num_threads threads, then the resulting subgraphs are merged into
+// the block graph on the calling thread. The transforms are only called
+// concurrently if they are all thread-safe; otherwise only the decomposition
+// is. As with ApplyBasicBlockSubGraphTransform, a block that contains
+// unsupported instructions is marked as such and left untransformed.
+//
+// @param transforms the series of transforms to apply.
+// @param policy The policy object restricting how the transform is applied.
+// @param block_graph the block graph containing the blocks to be transformed.
+// @param blocks the blocks to be transformed. They must be distinct.
+// @param num_threads the maximum number of threads to use. Everything is done
+//     on the calling thread if this is at most 1.
+// @param new_blocks On success, any newly created blocks will be returned
+//     here. Note that this parameter may be NULL if you are not interested
+//     in retrieving the set of new blocks.
+// @pre blocks must be code blocks that are safe to basic-block decompose.
+// @returns true on success, false otherwise.
+bool ApplyBasicBlockSubGraphTransformsToBlocks(
+    const std::vector<BasicBlockSubGraphTransformInterface*>& transforms,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    const BlockVector& blocks,
+    size_t num_threads,
+    BlockVector* new_blocks);
+
 // An ImageLayoutTransformInterface is a pure virtual base class defining the
 // PE image layout transform API
 class ImageLayoutTransformInterface {
@@ -161,6 +161,23 @@ class MockBasicBlockSubGraphTransform :
                     BasicBlockSubGraph*));
 };
 
+// A transform that leaves subgraphs alone and may be applied concurrently.
+class ThreadSafeBasicBlockSubGraphTransform :
+    public BasicBlockSubGraphTransformInterface {
+ public:
+  virtual const char* name() const {
+    return "ThreadSafeBasicBlockSubGraphTransform";
+  }
+
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph) {
+    return basic_block_subgraph->original_block() != NULL;
+  }
+
+  virtual bool IsThreadSafe() const { return true; }
+};
 
 class ApplyImageLayoutTransformTest : public testing::Test {
 public:
@@ -335,6 +352,81 @@ TEST_F(ApplyBasicBlockSubGraphTransformTest, VectorTransformSucceeds) {
                                                 &new_blocks));
 }
 
+TEST_F(ApplyBasicBlockSubGraphTransformTest, BlockTransformsSucceed) {
+  // Add two functions calling each other, so that each subgraph refers to the
+  // original block of the other.
+  static const uint8_t kCallBytes[] = {0xE8, 0x00, 0x00, 0x00, 0x00, 0xC3};
+  BlockGraph::Block* caller = block_graph_.AddBlock(
+      BlockGraph::CODE_BLOCK, sizeof(kCallBytes), "Caller");
+  BlockGraph::Block* callee = block_graph_.AddBlock(
+      BlockGraph::CODE_BLOCK, sizeof(kCallBytes), "Callee");
+  BlockGraph::Block* call_blocks[] = { caller, callee };
+  for (BlockGraph::Block* block : call_blocks) {
+    block->SetData(kCallBytes, sizeof(kCallBytes));
+    ASSERT_TRUE(block->SetLabel(
+        0, BlockGraph::Label(block->name(), BlockGraph::CODE_LABEL)));
+  }
+  ASSERT_TRUE(caller->SetReference(1, BlockGraph::Reference(
+      BlockGraph::PC_RELATIVE_REF, 4, callee, 0, 0)));
+  ASSERT_TRUE(callee->SetReference(1, BlockGraph::Reference(
+      BlockGraph::PC_RELATIVE_REF, 4, caller, 0, 0)));
+
+  ThreadSafeBasicBlockSubGraphTransform transform;
+  std::vector<BasicBlockSubGraphTransformInterface*> transforms;
+  transforms.push_back(&transform);
+  transforms.push_back(&transform);
+
+  BlockVector blocks;
+  blocks.push_back(code_block_);
+  blocks.push_back(caller);
+  blocks.push_back(callee);
+  BlockVector new_blocks;
+  EXPECT_TRUE(ApplyBasicBlockSubGraphTransformsToBlocks(
+      transforms, &policy_, &block_graph_, blocks, 4, &new_blocks));
+
+  // The code blocks have been replaced.
+  EXPECT_EQ(4U, block_graph_.blocks().size());
+  ASSERT_EQ(3U, new_blocks.size());
+  code_block_ = NULL;
+  EXPECT_EQ("Code", new_blocks[0]->name());
+  const BlockGraph::Block* new_caller = new_blocks[1];
+  const BlockGraph::Block* new_callee = new_blocks[2];
+  EXPECT_EQ("Caller", new_caller->name());
+  EXPECT_EQ("Callee", new_callee->name());
+
+  // The references between them, and from the data block, refer to the new
+  // blocks.
+  BlockGraph::Reference ref;
+  EXPECT_TRUE(data_block_->GetReference(kOffsetOfReferenceToCode, &ref));
+  EXPECT_EQ(new_blocks[0], ref.referenced());
+  EXPECT_TRUE(new_caller->GetReference(1, &ref));
+  EXPECT_EQ(new_callee, ref.referenced());
+  EXPECT_EQ(0, ref.offset());
+  EXPECT_TRUE(new_callee->GetReference(1, &ref));
+  EXPECT_EQ(new_caller, ref.referenced());
+  EXPECT_EQ(1U, new_caller->referrers().size());
+  EXPECT_EQ(1U, new_callee->referrers().size());
+}
+
+TEST_F(ApplyBasicBlockSubGraphTransformTest, BlockTransformsFail) {
+  BlockGraph::BlockId code_block_id = code_block_->id();
+
+  MockBasicBlockSubGraphTransform transform;
+  EXPECT_CALL(transform, TransformBasicBlockSubGraph(_, _, _)).Times(1).
+      WillOnce(Return(false));
+  std::vector<BasicBlockSubGraphTransformInterface*> transforms;
+  transforms.push_back(&transform);
+
+  BlockVector blocks;
+  blocks.push_back(code_block_);
+  EXPECT_FALSE(ApplyBasicBlockSubGraphTransformsToBlocks(
+      transforms, &policy_, &block_graph_, blocks, 4, NULL));
+
+  // The original block graph should be unchanged.
+  EXPECT_EQ(2U, block_graph_.blocks().size());
+  EXPECT_EQ(code_block_, block_graph_.GetBlockById(code_block_id));
+}
+
 TEST_F(ApplyImageLayoutTransformTest, NormalTransformSucceeds) {
   MockImageLayoutTransform transform;
   EXPECT_CALL(transform, TransformImageLayout(_, _, _)).Times(1).
@@ -47,6 +47,12 @@ bool ChainedBasicBlockTransforms::OnBlock(
   if (!policy->BlockIsSafeToBasicBlockDecompose(block))
     return true;
 
+  // Defer the transforms when they are applied to all blocks at once.
+  if (num_threads_ > 1) {
+    pending_blocks_.push_back(block);
+    return true;
+  }
+
   // Apply the series of basic block transforms to this block.
   if (!ApplyBasicBlockSubGraphTransforms(
            transforms_, policy, block_graph, block, NULL)) {
@@ -56,5 +62,21 @@ bool ChainedBasicBlockTransforms::OnBlock(
   return true;
 }
 
+bool ChainedBasicBlockTransforms::PostBlockGraphIteration(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  DCHECK_NE(reinterpret_cast<TransformPolicyInterface*>(NULL), policy);
+  DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), block_graph);
+
+  if (pending_blocks_.empty())
+    return true;
+
+  BlockVector blocks;
+  blocks.swap(pending_blocks_);
+  return ApplyBasicBlockSubGraphTransformsToBlocks(
+      transforms_, policy, block_graph, blocks, num_threads_, NULL);
+}
+
 }  // namespace transforms
 }  // namespace block_graph
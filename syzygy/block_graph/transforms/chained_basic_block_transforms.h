@@ -45,19 +45,31 @@ class ChainedBasicBlockTransforms
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
 
   // Constructor.
-  ChainedBasicBlockTransforms() {}
+  ChainedBasicBlockTransforms() : num_threads_(1) {}
 
   // @name IterativeTransformImpl implementation.
   // @{
   bool OnBlock(const TransformPolicyInterface* policy,
                BlockGraph* block_graph,
                BlockGraph::Block* block);
+  bool PostBlockGraphIteration(const TransformPolicyInterface* policy,
+                               BlockGraph* block_graph,
+                               BlockGraph::Block* header_block);
   // @}
 
   // @param transform a transform to be applied.
   // @returns true on success, or false otherwise.
   bool AppendTransform(BasicBlockSubGraphTransformInterface* transform);
 
+  // The number of threads used to decompose and transform blocks. When this
+  // is greater than 1, the blocks are all decomposed and transformed before
+  // any of them is rebuilt, with ApplyBasicBlockSubGraphTransformsToBlocks.
+  // Defaults to 1, which transforms the blocks one after another.
+  // @{
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) { num_threads_ = num_threads; }
+  // @}
+
   // The transform name.
   static const char kTransformName[];
 
@@ -65,6 +77,13 @@ class ChainedBasicBlockTransforms
   // Transforms to be applied, in order.
   std::vector<BasicBlockSubGraphTransformInterface*> transforms_;
 
+  // The number of threads used to decompose and transform blocks.
+  size_t num_threads_;
+
+  // The blocks to be transformed after the iteration, when using more than
+  // one thread.
+  BlockVector pending_blocks_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ChainedBasicBlockTransforms);
 };
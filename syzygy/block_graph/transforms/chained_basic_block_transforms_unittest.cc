@@ -162,6 +162,24 @@ TEST_F(ChainedBasicBlockTransformsTest, SingleTransforms) {
   EXPECT_EQ(2U, blocks.size());
 }
 
+TEST_F(ChainedBasicBlockTransformsTest, SingleTransformsWithThreads) {
+  std::set<std::string> blocks;
+  InsertOrRemoveBasicBlockTransform insert(&blocks, true);
+
+  TestChainedBasicBlockTransforms chains;
+  EXPECT_EQ(1U, chains.num_threads());
+  chains.set_num_threads(4);
+  EXPECT_EQ(4U, chains.num_threads());
+  chains.AppendTransform(&insert);
+  EXPECT_TRUE(Relink(&chains));
+
+  // The code blocks were transformed and rebuilt.
+  EXPECT_EQ(2U, blocks.size());
+  EXPECT_TRUE(blocks.find("c1") != blocks.end());
+  EXPECT_TRUE(blocks.find("c2") != blocks.end());
+  EXPECT_EQ(3U, block_graph_.blocks().size());
+}
+
 TEST_F(ChainedBasicBlockTransformsTest, FullTransforms) {
   std::set<std::string> blocks;
   InsertOrRemoveBasicBlockTransform insert(&blocks, true);
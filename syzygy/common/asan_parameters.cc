@@ -169,6 +169,25 @@ const bool kDefaultEnableZebraBlockHeap = false;
 const bool kDefaultEnableAllocationFilter = false;
 const float kDefaultQuarantineFloodFillRate = 0.5f;
 const bool kDefaultPreventDuplicateCorruptionCrashes = false;
+const bool kDefaultEnableThreadLocalMagazines = false;
+const bool kDefaultEnableLazyShadowCommit = false;
+const uint32_t kDefaultDeferredFreeThreadCount = 1;
+const bool kDefaultEnableSizeClassBlockHeap = false;
+const uint32_t kDefaultLargeBlockHeapCacheSize = 0;
+const uint32_t kDefaultHeapCheckerThreadCount = 1;
+const uint32_t kDefaultIncrementalHeapCheckPeriod = 0;
+const uint32_t kDefaultZebraBlockHeapMaxSize = 0;
+const bool kDefaultEnableCompactStackCaptures = false;
+const uint32_t kDefaultAllocationStackSamplingPeriod = 0;
+const bool kDefaultEnableLockProfiling = false;
+const uint32_t kDefaultLockProfilingLogPeriod = 60000;
+const uint32_t kDefaultStatisticsSectionPeriod = 0;
+const bool kDefaultEnableLargePageShadow = false;
+const bool kDefaultEnableAdaptiveGuardRate = false;
+const uint32_t kDefaultShadowExcerptSize = 0;
+const bool kDefaultEnableMemoryPressureMonitor = false;
+const uint32_t kDefaultQuarantineDecommitThreshold = 0;
+const bool kDefaultEnableAdaptiveRedzones = false;
 
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap = true;
@@ -219,6 +238,27 @@ const char kParamEnableAllocationFilter[] = "enable_allocation_filter";
 const char kParamQuarantineFloodFillRate[] = "quarantine_flood_fill_rate";
 const char kParamPreventDuplicateCorruptionCrashes[] =
     "prevent_duplicate_corruption_crashes";
+const char kParamThreadLocalMagazines[] = "thread_local_magazines";
+const char kParamLazyShadowCommit[] = "lazy_shadow_commit";
+const char kParamDeferredFreeThreadCount[] = "deferred_free_thread_count";
+const char kParamSizeClassBlockHeap[] = "size_class_block_heap";
+const char kParamLargeBlockHeapCacheSize[] = "large_block_heap_cache_size";
+const char kParamHeapCheckerThreadCount[] = "heap_checker_thread_count";
+const char kParamIncrementalHeapCheckPeriod[] = "incremental_heap_check_period";
+const char kParamZebraBlockHeapMaxSize[] = "zebra_block_heap_max_size";
+const char kParamCompactStackCaptures[] = "compact_stack_captures";
+const char kParamAllocationStackSamplingPeriod[] =
+    "allocation_stack_sampling_period";
+const char kParamEnableLockProfiling[] = "lock_profiling";
+const char kParamLockProfilingLogPeriod[] = "lock_profiling_log_period";
+const char kParamStatisticsSectionPeriod[] = "statistics_section_period";
+const char kParamLargePageShadow[] = "large_page_shadow";
+const char kParamAdaptiveGuardRate[] = "adaptive_guard_rate";
+const char kParamShadowExcerptSize[] = "shadow_excerpt_size";
+const char kParamMemoryPressureMonitor[] = "memory_pressure_monitor";
+const char kParamQuarantineDecommitThreshold[] =
+    "quarantine_decommit_threshold";
+const char kParamAdaptiveRedzones[] = "adaptive_redzones";
 
 // String names of LargeBlockHeap parameters.
 const char kParamDisableLargeBlockHeap[] = "disable_large_block_heap";
@@ -308,13 +348,50 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->report_invalid_accesses = kDefaultReportInvalidAccesses;
   asan_parameters->defer_crash_reporter_initialization =
       kDefaultDeferCrashReporterInitialization;
+  asan_parameters->enable_thread_local_magazines =
+      kDefaultEnableThreadLocalMagazines;
+  asan_parameters->enable_lazy_shadow_commit =
+      kDefaultEnableLazyShadowCommit;
+  asan_parameters->deferred_free_thread_count =
+      kDefaultDeferredFreeThreadCount;
+  asan_parameters->enable_size_class_block_heap =
+      kDefaultEnableSizeClassBlockHeap;
+  asan_parameters->large_block_heap_cache_size =
+      kDefaultLargeBlockHeapCacheSize;
+  asan_parameters->heap_checker_thread_count =
+      kDefaultHeapCheckerThreadCount;
+  asan_parameters->incremental_heap_check_period =
+      kDefaultIncrementalHeapCheckPeriod;
+  asan_parameters->zebra_block_heap_max_size =
+      kDefaultZebraBlockHeapMaxSize;
+  asan_parameters->enable_compact_stack_captures =
+      kDefaultEnableCompactStackCaptures;
+  asan_parameters->allocation_stack_sampling_period =
+      kDefaultAllocationStackSamplingPeriod;
+  asan_parameters->enable_lock_profiling =
+      kDefaultEnableLockProfiling;
+  asan_parameters->lock_profiling_log_period =
+      kDefaultLockProfilingLogPeriod;
+  asan_parameters->statistics_section_period =
+      kDefaultStatisticsSectionPeriod;
+  asan_parameters->enable_large_page_shadow =
+      kDefaultEnableLargePageShadow;
+  asan_parameters->enable_adaptive_guard_rate =
+      kDefaultEnableAdaptiveGuardRate;
+  asan_parameters->shadow_excerpt_size = kDefaultShadowExcerptSize;
+  asan_parameters->enable_memory_pressure_monitor =
+      kDefaultEnableMemoryPressureMonitor;
+  asan_parameters->quarantine_decommit_threshold =
+      kDefaultQuarantineDecommitThreshold;
+  asan_parameters->enable_adaptive_redzones = kDefaultEnableAdaptiveRedzones;
 }
 
 bool InflateAsanParameters(const AsanParameters* pod_params,
                            InflatedAsanParameters* inflated_params) {
   // This must be kept up to date with AsanParameters as it evolves.
   static const size_t kSizeOfAsanParametersByVersion[] = {
-      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60, 60};
+      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60, 60, 60, 60,
+      64, 64, 68, 76, 80, 80, 84, 88, 92, 92, 92, 96, 96, 100, 100};
   static_assert(
       arraysize(kSizeOfAsanParametersByVersion) == kAsanParametersVersion + 1,
       "Size of parameters version out of date.");
@@ -494,6 +571,76 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     return false;
   }
 
+  // Parse the deferred free thread count.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamDeferredFreeThreadCount,
+          &asan_parameters->deferred_free_thread_count) == kFlagError) {
+    return false;
+  }
+
+  // Parse the large block heap cache size.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamLargeBlockHeapCacheSize,
+          &asan_parameters->large_block_heap_cache_size) == kFlagError) {
+    return false;
+  }
+
+  // Parse the heap checker thread count.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamHeapCheckerThreadCount,
+          &asan_parameters->heap_checker_thread_count) == kFlagError) {
+    return false;
+  }
+
+  // Parse the incremental heap check period.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamIncrementalHeapCheckPeriod,
+          &asan_parameters->incremental_heap_check_period) == kFlagError) {
+    return false;
+  }
+
+  // Parse the zebra block heap max size.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamZebraBlockHeapMaxSize,
+          &asan_parameters->zebra_block_heap_max_size) == kFlagError) {
+    return false;
+  }
+
+  // Parse the allocation stack sampling period.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamAllocationStackSamplingPeriod,
+          &asan_parameters->allocation_stack_sampling_period) == kFlagError) {
+    return false;
+  }
+
+  // Parse the lock profiling log period.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamLockProfilingLogPeriod,
+          &asan_parameters->lock_profiling_log_period) == kFlagError) {
+    return false;
+  }
+
+  // Parse the statistics section period.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamStatisticsSectionPeriod,
+          &asan_parameters->statistics_section_period) == kFlagError) {
+    return false;
+  }
+
+  // Parse the size of the shadow excerpt.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamShadowExcerptSize,
+          &asan_parameters->shadow_excerpt_size) == kFlagError) {
+    return false;
+  }
+
+  // Parse the threshold of the decommitting of quarantined blocks.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamQuarantineDecommitThreshold,
+          &asan_parameters->quarantine_decommit_threshold) == kFlagError) {
+    return false;
+  }
+
   // Parse the other (boolean) flags.
   // TODO(chrisha): Transition these all to new style flags.
   if (cmd_line.HasSwitch(kParamMiniDumpOnFailure))
@@ -527,7 +674,25 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
   bool value = false;
   if (ParseBooleanFlag(kParamFeatureRandomization, cmd_line, &value))
     asan_parameters->feature_randomization = value;
-
+  if (ParseBooleanFlag(kParamThreadLocalMagazines, cmd_line, &value))
+    asan_parameters->enable_thread_local_magazines = value;
+
+  if (ParseBooleanFlag(kParamLazyShadowCommit, cmd_line, &value))
+    asan_parameters->enable_lazy_shadow_commit = value;
+  if (ParseBooleanFlag(kParamSizeClassBlockHeap, cmd_line, &value))
+    asan_parameters->enable_size_class_block_heap = value;
+  if (ParseBooleanFlag(kParamCompactStackCaptures, cmd_line, &value))
+    asan_parameters->enable_compact_stack_captures = value;
+  if (ParseBooleanFlag(kParamEnableLockProfiling, cmd_line, &value))
+    asan_parameters->enable_lock_profiling = value;
+  if (ParseBooleanFlag(kParamLargePageShadow, cmd_line, &value))
+    asan_parameters->enable_large_page_shadow = value;
+  if (ParseBooleanFlag(kParamAdaptiveGuardRate, cmd_line, &value))
+    asan_parameters->enable_adaptive_guard_rate = value;
+  if (ParseBooleanFlag(kParamMemoryPressureMonitor, cmd_line, &value))
+    asan_parameters->enable_memory_pressure_monitor = value;
+  if (ParseBooleanFlag(kParamAdaptiveRedzones, cmd_line, &value))
+    asan_parameters->enable_adaptive_redzones = value;
   return true;
 }
 
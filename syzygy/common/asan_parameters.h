@@ -36,7 +36,7 @@ namespace common {
 // the StackCaptureCache.
 typedef uint32_t AsanStackId;
 
-static const size_t kAsanParametersReserved1Bits = 19;
+static const size_t kAsanParametersReserved1Bits = 10;
 
 // This data structure is injected into an instrumented image in a read-only
 // section. It is initialized by the instrumenter, and will be looked up at
@@ -119,6 +119,36 @@ struct AsanParameters {
       // Runtime: Defer the crash reporter initialization, the client has to
       // manually call the crash reporter initialization function.
       unsigned defer_crash_reporter_initialization : 1;
+      // BlockHeapManager: Indicates if small allocations from the process heap
+      // should be served from per-thread magazine caches.
+      unsigned enable_thread_local_magazines : 1;
+      // Runtime: Indicates if the shadow memory should only be reserved up
+      // front, with its pages committed on demand.
+      unsigned enable_lazy_shadow_commit : 1;
+      // If true then small allocations are served from a heap of
+      // size-segregated slabs.
+      unsigned enable_size_class_block_heap : 1;
+      // StackCaptureCache: If true then the frames of the cached stack
+      // captures are stored in a compact module-relative encoding.
+      unsigned enable_compact_stack_captures : 1;
+      // Runtime: If true then the contention of the locks of the runtime is
+      // profiled, see LockProfiler.
+      unsigned enable_lock_profiling : 1;
+      // Runtime: If true then the shadow memory is committed up front in
+      // large pages, when the process holds the SeLockMemoryPrivilege.
+      unsigned enable_large_page_shadow : 1;
+      // BlockHeapManager: If true then the allocations are guarded with a
+      // per call site probability, favoring the rarely allocating sites,
+      // such that allocation_guard_rate of them are guarded overall.
+      unsigned enable_adaptive_guard_rate : 1;
+      // Runtime: If true then the quarantine and the zebra block heap
+      // quarantine budgets are adjusted to the memory resource notifications
+      // of the system, see MemoryPressureMonitor.
+      unsigned enable_memory_pressure_monitor : 1;
+      // BlockHeapManager: If true then the right redzone of an allocation
+      // scales with its size, rather than being trailer_padding_size bytes
+      // for all of them. See GetAdaptiveRedzoneSize.
+      unsigned enable_adaptive_redzones : 1;
 
       // Add new flags here!
 
@@ -148,27 +178,77 @@ struct AsanParameters {
   // 0.0 corresponds to this being disabled entirely.
   float quarantine_flood_fill_rate;
 
+  // BlockHeapManager: The number of deferred free threads that trim the
+  // shared quarantine in the background, once enabled. Each thread drains its
+  // own subset of the quarantine shards.
+  uint32_t deferred_free_thread_count;
+
+  // LargeBlockHeap: The maximum number of bytes of address space that the
+  // LargeBlockHeap keeps reserved for reuse once its allocations are freed.
+  // 0 disables the cache.
+  uint32_t large_block_heap_cache_size;
+
+  // The number of threads used to check the heap for corruption when an
+  // error occurs.
+  uint32_t heap_checker_thread_count;
+
+  // The period, in milliseconds, at which a background thread checks a
+  // slice of the heap for corruption. Zero disables incremental checking.
+  uint32_t incremental_heap_check_period;
+
+  // ZebraBlockHeap: The size up to which the ZebraBlockHeap grows when it
+  // is full. Values no greater than zebra_block_heap_size disable growth.
+  uint32_t zebra_block_heap_max_size;
+
+  // BlockHeapManager: If non-zero then the full allocation stack is only
+  // captured for new allocation sites, and for one in this many allocations of
+  // the known ones. The other allocations only record a fingerprint of their
+  // callers. The free stacks are always captured in full.
+  uint32_t allocation_stack_sampling_period;
+
+  // Runtime: The period at which the lock profile is logged, in
+  // milliseconds, when the lock profiling is enabled. Zero disables the
+  // periodic logging.
+  uint32_t lock_profiling_log_period;
+
+  // Runtime: The period at which the runtime statistics are published in a
+  // named shared memory section, in milliseconds. Zero disables the
+  // statistics section.
+  uint32_t statistics_section_period;
+
+  // ErrorInfo: The number of shadow bytes on each side of the faulting access
+  // that are run-length encoded in the crash reports, such that the shadow
+  // state around the error can be analyzed offline. Zero disables the shadow
+  // excerpt.
+  uint32_t shadow_excerpt_size;
+
+  // BlockHeapManager: The minimum body size of the quarantined blocks of the
+  // LargeBlockHeap whose body pages are decommitted while they are in the
+  // quarantine. This only applies when page protections are enabled. Zero
+  // disables the decommitting of quarantined blocks.
+  uint32_t quarantine_decommit_threshold;
+
   // Add new parameters here!
 
   // When laid out in memory the ignored_stack_ids are present here as a NULL
   // terminated vector.
 };
 #ifndef _WIN64
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 60);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 100);
 #else
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 64);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 104);
 #endif
 
 // The current version of the Asan parameters structure. This must be updated
 // if any changes are made to the above structure! This is defined in the header
 // file to allow compile time assertions against this version number.
-const uint32_t kAsanParametersVersion = 15;
+const uint32_t kAsanParametersVersion = 32;
 
 // If the number of free bits in the parameters struct changes, then the
 // version has to change as well. This is simply here to make sure that
 // everything changes in lockstep.
-static_assert(kAsanParametersReserved1Bits == 19 &&
-                  kAsanParametersVersion == 15,
+static_assert(kAsanParametersReserved1Bits == 10 &&
+                  kAsanParametersVersion == 32,
               "Version must change if reserved bits changes.");
 
 // The name of the section that will be injected into an instrumented image,
@@ -252,6 +332,25 @@ extern const bool kDefaultEnableZebraBlockHeap;
 extern const bool kDefaultEnableAllocationFilter;
 extern const float kDefaultQuarantineFloodFillRate;
 extern const bool kDefaultPreventDuplicateCorruptionCrashes;
+extern const bool kDefaultEnableThreadLocalMagazines;
+extern const bool kDefaultEnableLazyShadowCommit;
+extern const uint32_t kDefaultDeferredFreeThreadCount;
+extern const bool kDefaultEnableSizeClassBlockHeap;
+extern const uint32_t kDefaultLargeBlockHeapCacheSize;
+extern const uint32_t kDefaultHeapCheckerThreadCount;
+extern const uint32_t kDefaultIncrementalHeapCheckPeriod;
+extern const uint32_t kDefaultZebraBlockHeapMaxSize;
+extern const bool kDefaultEnableCompactStackCaptures;
+extern const uint32_t kDefaultAllocationStackSamplingPeriod;
+extern const bool kDefaultEnableLockProfiling;
+extern const uint32_t kDefaultLockProfilingLogPeriod;
+extern const uint32_t kDefaultStatisticsSectionPeriod;
+extern const bool kDefaultEnableLargePageShadow;
+extern const bool kDefaultEnableAdaptiveGuardRate;
+extern const uint32_t kDefaultShadowExcerptSize;
+extern const bool kDefaultEnableMemoryPressureMonitor;
+extern const uint32_t kDefaultQuarantineDecommitThreshold;
+extern const bool kDefaultEnableAdaptiveRedzones;
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap;
 extern const size_t kDefaultLargeAllocationThreshold;
@@ -292,6 +391,25 @@ extern const char kParamEnableZebraBlockHeap[];
 extern const char kParamEnableAllocationFilter[];
 extern const char kParamQuarantineFloodFillRate[];
 extern const char kParamPreventDuplicateCorruptionCrashes[];
+extern const char kParamThreadLocalMagazines[];
+extern const char kParamLazyShadowCommit[];
+extern const char kParamDeferredFreeThreadCount[];
+extern const char kParamSizeClassBlockHeap[];
+extern const char kParamLargeBlockHeapCacheSize[];
+extern const char kParamHeapCheckerThreadCount[];
+extern const char kParamIncrementalHeapCheckPeriod[];
+extern const char kParamZebraBlockHeapMaxSize[];
+extern const char kParamCompactStackCaptures[];
+extern const char kParamAllocationStackSamplingPeriod[];
+extern const char kParamEnableLockProfiling[];
+extern const char kParamLockProfilingLogPeriod[];
+extern const char kParamStatisticsSectionPeriod[];
+extern const char kParamLargePageShadow[];
+extern const char kParamAdaptiveGuardRate[];
+extern const char kParamShadowExcerptSize[];
+extern const char kParamMemoryPressureMonitor[];
+extern const char kParamQuarantineDecommitThreshold[];
+extern const char kParamAdaptiveRedzones[];
 // String names of LargeBlockHeap parameters.
 extern const char kParamDisableLargeBlockHeap[];
 extern const char kParamLargeAllocationThreshold[];
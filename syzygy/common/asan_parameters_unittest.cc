@@ -98,6 +98,43 @@ TEST(AsanParametersTest, SetDefaultAsanParameters) {
             static_cast<bool>(aparams.report_invalid_accesses));
   EXPECT_EQ(kDefaultDeferCrashReporterInitialization,
             static_cast<bool>(aparams.defer_crash_reporter_initialization));
+  EXPECT_EQ(kDefaultEnableThreadLocalMagazines,
+            static_cast<bool>(aparams.enable_thread_local_magazines));
+  EXPECT_EQ(kDefaultEnableLazyShadowCommit,
+            static_cast<bool>(aparams.enable_lazy_shadow_commit));
+  EXPECT_EQ(kDefaultDeferredFreeThreadCount,
+            aparams.deferred_free_thread_count);
+  EXPECT_EQ(kDefaultEnableSizeClassBlockHeap,
+            static_cast<bool>(aparams.enable_size_class_block_heap));
+  EXPECT_EQ(kDefaultLargeBlockHeapCacheSize,
+            aparams.large_block_heap_cache_size);
+  EXPECT_EQ(kDefaultHeapCheckerThreadCount,
+            aparams.heap_checker_thread_count);
+  EXPECT_EQ(kDefaultIncrementalHeapCheckPeriod,
+            aparams.incremental_heap_check_period);
+  EXPECT_EQ(kDefaultZebraBlockHeapMaxSize,
+            aparams.zebra_block_heap_max_size);
+  EXPECT_EQ(kDefaultEnableCompactStackCaptures,
+            static_cast<bool>(aparams.enable_compact_stack_captures));
+  EXPECT_EQ(kDefaultAllocationStackSamplingPeriod,
+            aparams.allocation_stack_sampling_period);
+  EXPECT_EQ(kDefaultEnableLockProfiling,
+            static_cast<bool>(aparams.enable_lock_profiling));
+  EXPECT_EQ(kDefaultLockProfilingLogPeriod,
+            aparams.lock_profiling_log_period);
+  EXPECT_EQ(kDefaultStatisticsSectionPeriod,
+            aparams.statistics_section_period);
+  EXPECT_EQ(kDefaultEnableLargePageShadow,
+            static_cast<bool>(aparams.enable_large_page_shadow));
+  EXPECT_EQ(kDefaultEnableAdaptiveGuardRate,
+            static_cast<bool>(aparams.enable_adaptive_guard_rate));
+  EXPECT_EQ(kDefaultShadowExcerptSize, aparams.shadow_excerpt_size);
+  EXPECT_EQ(kDefaultEnableMemoryPressureMonitor,
+            static_cast<bool>(aparams.enable_memory_pressure_monitor));
+  EXPECT_EQ(kDefaultQuarantineDecommitThreshold,
+            aparams.quarantine_decommit_threshold);
+  EXPECT_EQ(kDefaultEnableAdaptiveRedzones,
+            static_cast<bool>(aparams.enable_adaptive_redzones));
 }
 
 TEST(AsanParametersTest, InflateAsanParametersStackIdsPastEnd) {
@@ -255,6 +292,43 @@ TEST(AsanParametersTest, ParseAsanParametersMinimal) {
             static_cast<bool>(iparams.report_invalid_accesses));
   EXPECT_EQ(kDefaultDeferCrashReporterInitialization,
             static_cast<bool>(iparams.defer_crash_reporter_initialization));
+  EXPECT_EQ(kDefaultEnableThreadLocalMagazines,
+            static_cast<bool>(iparams.enable_thread_local_magazines));
+  EXPECT_EQ(kDefaultEnableLazyShadowCommit,
+            static_cast<bool>(iparams.enable_lazy_shadow_commit));
+  EXPECT_EQ(kDefaultDeferredFreeThreadCount,
+            iparams.deferred_free_thread_count);
+  EXPECT_EQ(kDefaultEnableSizeClassBlockHeap,
+            static_cast<bool>(iparams.enable_size_class_block_heap));
+  EXPECT_EQ(kDefaultLargeBlockHeapCacheSize,
+            iparams.large_block_heap_cache_size);
+  EXPECT_EQ(kDefaultHeapCheckerThreadCount,
+            iparams.heap_checker_thread_count);
+  EXPECT_EQ(kDefaultIncrementalHeapCheckPeriod,
+            iparams.incremental_heap_check_period);
+  EXPECT_EQ(kDefaultZebraBlockHeapMaxSize,
+            iparams.zebra_block_heap_max_size);
+  EXPECT_EQ(kDefaultEnableCompactStackCaptures,
+            static_cast<bool>(iparams.enable_compact_stack_captures));
+  EXPECT_EQ(kDefaultAllocationStackSamplingPeriod,
+            iparams.allocation_stack_sampling_period);
+  EXPECT_EQ(kDefaultEnableLockProfiling,
+            static_cast<bool>(iparams.enable_lock_profiling));
+  EXPECT_EQ(kDefaultLockProfilingLogPeriod,
+            iparams.lock_profiling_log_period);
+  EXPECT_EQ(kDefaultStatisticsSectionPeriod,
+            iparams.statistics_section_period);
+  EXPECT_EQ(kDefaultEnableLargePageShadow,
+            static_cast<bool>(iparams.enable_large_page_shadow));
+  EXPECT_EQ(kDefaultEnableAdaptiveGuardRate,
+            static_cast<bool>(iparams.enable_adaptive_guard_rate));
+  EXPECT_EQ(kDefaultShadowExcerptSize, iparams.shadow_excerpt_size);
+  EXPECT_EQ(kDefaultEnableMemoryPressureMonitor,
+            static_cast<bool>(iparams.enable_memory_pressure_monitor));
+  EXPECT_EQ(kDefaultQuarantineDecommitThreshold,
+            iparams.quarantine_decommit_threshold);
+  EXPECT_EQ(kDefaultEnableAdaptiveRedzones,
+            static_cast<bool>(iparams.enable_adaptive_redzones));
 }
 
 TEST(AsanParametersTest, ParseAsanParametersMaximal) {
@@ -283,7 +357,26 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
       L"--enable_feature_randomization "
       L"--prevent_duplicate_corruption_crashes "
       L"--report_invalid_accesses "
-      L"--defer_crash_reporter_initialization";
+      L"--defer_crash_reporter_initialization "
+      L"--enable_thread_local_magazines "
+      L"--enable_lazy_shadow_commit "
+      L"--deferred_free_thread_count=4 "
+      L"--enable_size_class_block_heap "
+      L"--large_block_heap_cache_size=4194304 "
+      L"--heap_checker_thread_count=4 "
+      L"--incremental_heap_check_period=250 "
+      L"--zebra_block_heap_max_size=67108864 "
+      L"--enable_compact_stack_captures "
+      L"--allocation_stack_sampling_period=16 "
+      L"--enable_lock_profiling "
+      L"--lock_profiling_log_period=1000 "
+      L"--statistics_section_period=1000 "
+      L"--enable_large_page_shadow "
+      L"--enable_adaptive_guard_rate "
+      L"--shadow_excerpt_size=2048 "
+      L"--enable_memory_pressure_monitor "
+      L"--quarantine_decommit_threshold=1048576 "
+      L"--enable_adaptive_redzones";
 
   InflatedAsanParameters iparams;
   SetDefaultAsanParameters(&iparams);
@@ -320,6 +413,25 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
   EXPECT_EQ(true, static_cast<bool>(iparams.report_invalid_accesses));
   EXPECT_EQ(true,
             static_cast<bool>(iparams.defer_crash_reporter_initialization));
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_thread_local_magazines));
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_lazy_shadow_commit));
+  EXPECT_EQ(4, iparams.deferred_free_thread_count);
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_size_class_block_heap));
+  EXPECT_EQ(4194304, iparams.large_block_heap_cache_size);
+  EXPECT_EQ(4, iparams.heap_checker_thread_count);
+  EXPECT_EQ(250, iparams.incremental_heap_check_period);
+  EXPECT_EQ(67108864, iparams.zebra_block_heap_max_size);
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_compact_stack_captures));
+  EXPECT_EQ(16, iparams.allocation_stack_sampling_period);
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_lock_profiling));
+  EXPECT_EQ(1000, iparams.lock_profiling_log_period);
+  EXPECT_EQ(1000, iparams.statistics_section_period);
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_large_page_shadow));
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_adaptive_guard_rate));
+  EXPECT_EQ(2048, iparams.shadow_excerpt_size);
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_memory_pressure_monitor));
+  EXPECT_EQ(1048576, iparams.quarantine_decommit_threshold);
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_adaptive_redzones));
 }
 
 }  // namespace common
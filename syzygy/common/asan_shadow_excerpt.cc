@@ -0,0 +1,92 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/asan_shadow_excerpt.h"
+
+#include "base/logging.h"
+
+namespace common {
+
+ShadowExcerptEncoder::ShadowExcerptEncoder(std::string* encoded)
+    : encoded_(encoded), run_value_(0), run_length_(0) {
+  DCHECK_NE(static_cast<std::string*>(nullptr), encoded);
+}
+
+void ShadowExcerptEncoder::AppendRun(uint8_t value, size_t count) {
+  if (count == 0)
+    return;
+  if (run_length_ != 0 && value != run_value_)
+    Flush();
+  run_value_ = value;
+  run_length_ += count;
+}
+
+void ShadowExcerptEncoder::AppendBytes(const uint8_t* shadow, size_t length) {
+  DCHECK(shadow != nullptr || length == 0);
+
+  const uint8_t* end = shadow + length;
+  while (shadow < end) {
+    const uint8_t* run_end = shadow + 1;
+    while (run_end < end && *run_end == *shadow)
+      ++run_end;
+    AppendRun(*shadow, run_end - shadow);
+    shadow = run_end;
+  }
+}
+
+void ShadowExcerptEncoder::Flush() {
+  if (run_length_ == 0)
+    return;
+
+  encoded_->push_back(static_cast<char>(run_value_));
+  uint64_t count = run_length_;
+  while (count >= 0x80) {
+    encoded_->push_back(static_cast<char>((count & 0x7F) | 0x80));
+    count >>= 7;
+  }
+  encoded_->push_back(static_cast<char>(count));
+  run_length_ = 0;
+}
+
+bool DecodeShadowExcerpt(const base::StringPiece& encoded,
+                         std::vector<uint8_t>* shadow) {
+  DCHECK_NE(static_cast<std::vector<uint8_t>*>(nullptr), shadow);
+
+  shadow->clear();
+  const uint8_t* cursor = reinterpret_cast<const uint8_t*>(encoded.data());
+  const uint8_t* end = cursor + encoded.size();
+  while (cursor < end) {
+    uint8_t value = *cursor++;
+
+    // The count of a run is at most kMaxShadowExcerptLength, which takes
+    // fewer than 32 bits.
+    uint64_t count = 0;
+    for (size_t shift = 0;; shift += 7) {
+      if (cursor == end || shift >= 32)
+        return false;
+      uint8_t byte = *cursor++;
+      count |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+        break;
+    }
+
+    if (count == 0 || count > kMaxShadowExcerptLength - shadow->size())
+      return false;
+    shadow->insert(shadow->end(), static_cast<size_t>(count), value);
+  }
+
+  return true;
+}
+
+}  // namespace common
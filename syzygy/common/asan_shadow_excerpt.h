@@ -0,0 +1,84 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the run-length encoding of the excerpts of the SyzyASan shadow
+// memory that are included in crash reports, for them to be decoded offline.
+//
+// An excerpt is a sequence of runs, each a shadow byte value followed by the
+// number of times it repeats, as a varint of seven bits per byte from the
+// least significant, the high bit marking the bytes that are followed by
+// another. The shadow is mostly long runs of accessible memory and of block
+// redzones, so an excerpt of many kilobytes usually takes a few hundred bytes.
+
+#ifndef SYZYGY_COMMON_ASAN_SHADOW_EXCERPT_H_
+#define SYZYGY_COMMON_ASAN_SHADOW_EXCERPT_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+
+namespace common {
+
+// The maximum number of shadow bytes that an excerpt decodes to, so that a
+// malformed excerpt can't exhaust the memory of the tool decoding it.
+const size_t kMaxShadowExcerptLength = 1024 * 1024;
+
+// Encodes an excerpt of the shadow memory, merging the consecutive runs of a
+// same value.
+class ShadowExcerptEncoder {
+ public:
+  // @param encoded receives the encoding. It is appended to, and must outlive
+  //     this object.
+  explicit ShadowExcerptEncoder(std::string* encoded);
+
+  // Appends a run of shadow bytes of a same value. This is used for the parts
+  // of the shadow that are known without being read, such as its uncommitted
+  // pages, which are all zero.
+  // @param value the value of the shadow bytes.
+  // @param count the number of shadow bytes.
+  void AppendRun(uint8_t value, size_t count);
+
+  // Appends shadow bytes.
+  // @param shadow the shadow bytes.
+  // @param length the number of shadow bytes.
+  void AppendBytes(const uint8_t* shadow, size_t length);
+
+  // Writes the pending run to the encoding. This must be called once all the
+  // shadow bytes have been appended.
+  void Flush();
+
+ private:
+  std::string* encoded_;
+
+  // The run being accumulated.
+  uint8_t run_value_;
+  size_t run_length_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShadowExcerptEncoder);
+};
+
+// Decodes an excerpt of the shadow memory.
+// @param encoded the encoded excerpt.
+// @param shadow receives the shadow bytes of the excerpt.
+// @returns false if the excerpt is malformed, or decodes to more than
+//     kMaxShadowExcerptLength bytes.
+bool DecodeShadowExcerpt(const base::StringPiece& encoded,
+                         std::vector<uint8_t>* shadow);
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_ASAN_SHADOW_EXCERPT_H_
@@ -0,0 +1,91 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/asan_shadow_excerpt.h"
+
+#include "gtest/gtest.h"
+
+namespace common {
+
+TEST(AsanShadowExcerptTest, RoundTrip) {
+  std::vector<uint8_t> shadow(4096, 0);
+  for (size_t i = 1000; i < 1010; ++i)
+    shadow[i] = 0xFA;
+  shadow[1010] = 0x04;
+  for (size_t i = 1011; i < 1020; ++i)
+    shadow[i] = 0xFB;
+
+  std::string encoded;
+  ShadowExcerptEncoder encoder(&encoded);
+  encoder.AppendBytes(&shadow[0], shadow.size());
+  encoder.Flush();
+
+  // Five runs, the long runs of zeros taking a two byte count.
+  EXPECT_EQ(2u * 5 + 2, encoded.size());
+
+  std::vector<uint8_t> decoded;
+  EXPECT_TRUE(DecodeShadowExcerpt(encoded, &decoded));
+  EXPECT_EQ(shadow, decoded);
+}
+
+TEST(AsanShadowExcerptTest, MergesRuns) {
+  const uint8_t kShadow[] = {0, 0, 0xF1, 0xF1};
+
+  std::string encoded;
+  ShadowExcerptEncoder encoder(&encoded);
+  encoder.AppendRun(0, 100);
+  encoder.AppendBytes(kShadow, sizeof(kShadow));
+  encoder.AppendRun(0xF1, 0);
+  encoder.AppendRun(0xF1, 2);
+  encoder.Flush();
+
+  const char kExpected[] = {0, 102, static_cast<char>(0xF1), 4};
+  EXPECT_EQ(std::string(kExpected, sizeof(kExpected)), encoded);
+
+  std::vector<uint8_t> decoded;
+  EXPECT_TRUE(DecodeShadowExcerpt(encoded, &decoded));
+  EXPECT_EQ(106u, decoded.size());
+}
+
+TEST(AsanShadowExcerptTest, DecodeEmpty) {
+  std::vector<uint8_t> decoded(1, 0);
+  EXPECT_TRUE(DecodeShadowExcerpt(base::StringPiece(), &decoded));
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST(AsanShadowExcerptTest, DecodeFailsOnMalformedExcerpt) {
+  std::vector<uint8_t> decoded;
+
+  // A truncated count.
+  const char kTruncated[] = {0, static_cast<char>(0x80)};
+  EXPECT_FALSE(DecodeShadowExcerpt(
+      base::StringPiece(kTruncated, sizeof(kTruncated)), &decoded));
+
+  // A missing count.
+  EXPECT_FALSE(DecodeShadowExcerpt(base::StringPiece("\xFA", 1), &decoded));
+
+  // An empty run.
+  const char kEmptyRun[] = {0, 0};
+  EXPECT_FALSE(DecodeShadowExcerpt(
+      base::StringPiece(kEmptyRun, sizeof(kEmptyRun)), &decoded));
+
+  // A run longer than an excerpt may be.
+  std::string encoded;
+  ShadowExcerptEncoder encoder(&encoded);
+  encoder.AppendRun(0, kMaxShadowExcerptLength + 1);
+  encoder.Flush();
+  EXPECT_FALSE(DecodeShadowExcerpt(encoded, &decoded));
+}
+
+}  // namespace common
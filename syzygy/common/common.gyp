@@ -26,6 +26,8 @@
         'align_impl.h',
         'asan_parameters.cc',
         'asan_parameters.h',
+        'asan_shadow_excerpt.cc',
+        'asan_shadow_excerpt.h',
         'assertions.h',
         'binary_stream.cc',
         'binary_stream.h',
@@ -76,6 +78,7 @@
       'sources': [
         'align_unittest.cc',
         'asan_parameters_unittest.cc',
+        'asan_shadow_excerpt_unittest.cc',
         'binary_stream_unittest.cc',
         'buffer_parser_unittest.cc',
         'buffer_writer_unittest.cc',
@@ -0,0 +1,103 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares AddressFilterPageMap, a page granular summary of an AddressFilter.
+// Each page of the extent of the filter is either entirely unmarked, entirely
+// marked or partially marked. Checking a range that spans a handful of pages
+// then takes constant time, and only looks the range up in the filter when
+// it lies on partially marked pages. The map holds a byte per page, and is a
+// snapshot: it must be rebuilt when the filter changes.
+
+#ifndef SYZYGY_CORE_ADDRESS_FILTER_PAGE_MAP_H_
+#define SYZYGY_CORE_ADDRESS_FILTER_PAGE_MAP_H_
+
+#include <string>
+
+#include "syzygy/core/address_filter.h"
+
+namespace core {
+
+template<typename AddressType, typename SizeType>
+class AddressFilterPageMap {
+ public:
+  typedef AddressFilter<AddressType, SizeType> Filter;
+  typedef typename Filter::Range Range;
+
+  // The states of the pages. These are printable so that the states of the
+  // pages can be serialized as a string.
+  enum PageState : char {
+    kUnmarkedPage = '0',
+    kMarkedPage = '1',
+    kPartiallyMarkedPage = '2',
+  };
+
+  // The default size of the pages, which is that of the pages of an image.
+  static const SizeType kDefaultPageSize = 4096;
+
+  // Builds an empty map, which summarizes no filter.
+  AddressFilterPageMap() : page_size_(0) { }
+
+  // Builds the map of a filter.
+  // @param filter The filter to summarize.
+  // @param page_size The size of the pages of the map, which is not zero.
+  void Init(const Filter& filter, SizeType page_size);
+
+  // Restores the map of a filter from the states of its pages.
+  // @param filter The filter summarized by the map.
+  // @param page_size The size of the pages of the map.
+  // @param pages The states of the pages, one PageState per page of the
+  //     extent of @p filter.
+  // @returns true on success, false if the states are not consistent with
+  //     the extent of the filter.
+  bool Init(const Filter& filter,
+            SizeType page_size,
+            const std::string& pages);
+
+  // Determines if the given address range is not marked at all.
+  // @param filter The filter summarized by the map.
+  // @param range The address range to check.
+  // @returns false if any locations in the range are marked, or true if
+  //     they are all unmarked.
+  bool IsUnmarked(const Filter& filter, const Range& range) const;
+
+  // @name Accessors.
+  // @{
+  SizeType page_size() const { return page_size_; }
+  const std::string& pages() const { return pages_; }
+  bool empty() const { return page_size_ == 0; }
+  // @}
+
+ private:
+  // @returns the index of the page holding @p address, which lies in the
+  //     extent of the map.
+  size_t GetPageIndex(const AddressType& address) const {
+    return static_cast<size_t>(address - extent_.start()) / page_size_;
+  }
+
+  // The extent of the summarized filter.
+  Range extent_;
+
+  // The size of the pages.
+  SizeType page_size_;
+
+  // The states of the pages, one PageState per page.
+  std::string pages_;
+};
+
+}  // namespace core
+
+// Bring in the implementation.
+#include "syzygy/core/address_filter_page_map_impl.h"
+
+#endif  // SYZYGY_CORE_ADDRESS_FILTER_PAGE_MAP_H_
@@ -0,0 +1,103 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation details of core::AddressFilterPageMap. This is only meant to
+// be included directly from syzygy/core/address_filter_page_map.h.
+
+#ifndef SYZYGY_CORE_ADDRESS_FILTER_PAGE_MAP_IMPL_H_
+#define SYZYGY_CORE_ADDRESS_FILTER_PAGE_MAP_IMPL_H_
+
+namespace core {
+
+template<typename AddressType, typename SizeType>
+void AddressFilterPageMap<AddressType, SizeType>::Init(const Filter& filter,
+                                                       SizeType page_size) {
+  DCHECK_LT(0u, page_size);
+
+  extent_ = filter.extent();
+  page_size_ = page_size;
+  size_t num_pages = (extent_.size() + page_size - 1) / page_size;
+  pages_.assign(num_pages, kUnmarkedPage);
+
+  // A page is only marked if a single range covers it, as the contiguous
+  // ranges of the filter are merged.
+  typename Filter::RangeSet::const_iterator it =
+      filter.marked_ranges().begin();
+  for (; it != filter.marked_ranges().end(); ++it) {
+    DCHECK(extent_.Contains(*it));
+    size_t last_page = GetPageIndex(it->end() - 1);
+    for (size_t i = GetPageIndex(it->start()); i <= last_page; ++i) {
+      AddressType page_start = extent_.start() + i * page_size_;
+      AddressType page_end = page_start + page_size_;
+      if (extent_.end() < page_end)
+        page_end = extent_.end();
+      if (it->start() <= page_start && page_end <= it->end())
+        pages_[i] = kMarkedPage;
+      else
+        pages_[i] = kPartiallyMarkedPage;
+    }
+  }
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterPageMap<AddressType, SizeType>::Init(
+    const Filter& filter,
+    SizeType page_size,
+    const std::string& pages) {
+  if (page_size == 0 ||
+      pages.size() != (filter.extent().size() + page_size - 1) / page_size) {
+    return false;
+  }
+  for (size_t i = 0; i < pages.size(); ++i) {
+    if (pages[i] != kUnmarkedPage && pages[i] != kMarkedPage &&
+        pages[i] != kPartiallyMarkedPage) {
+      return false;
+    }
+  }
+
+  extent_ = filter.extent();
+  page_size_ = page_size;
+  pages_ = pages;
+  return true;
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterPageMap<AddressType, SizeType>::IsUnmarked(
+    const Filter& filter,
+    const Range& range) const {
+  DCHECK(!empty());
+  DCHECK(filter.extent() == extent_);
+
+  // Anything that falls outside of the extent is by definition not marked.
+  Range r;
+  if (!internal::Intersect(extent_, range, &r))
+    return true;
+
+  bool partially_marked = false;
+  size_t last_page = GetPageIndex(r.end() - 1);
+  for (size_t i = GetPageIndex(r.start()); i <= last_page; ++i) {
+    if (pages_[i] == kMarkedPage)
+      return false;
+    if (pages_[i] == kPartiallyMarkedPage)
+      partially_marked = true;
+  }
+
+  if (!partially_marked)
+    return true;
+  return filter.IsUnmarked(r);
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_ADDRESS_FILTER_PAGE_MAP_IMPL_H_
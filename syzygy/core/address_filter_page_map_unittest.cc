@@ -0,0 +1,91 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/address_filter_page_map.h"
+
+#include "base/macros.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/address.h"
+
+namespace core {
+
+namespace {
+
+typedef AddressFilter<AbsoluteAddress, size_t> TestAddressFilter;
+typedef AddressFilterPageMap<AbsoluteAddress, size_t> TestPageMap;
+typedef TestAddressFilter::Range Range;
+
+// Builds a filter over [0, 1050) which, with pages of 100 bytes, has the
+// pages 0 and 9 partially marked and the pages 1 to 3 marked. The last page
+// is clipped to the end of the extent, and is entirely marked.
+void InitFilter(TestAddressFilter* filter) {
+  *filter = TestAddressFilter(Range(AbsoluteAddress(0), 1050));
+  filter->Mark(Range(AbsoluteAddress(50), 350));
+  filter->Mark(Range(AbsoluteAddress(910), 20));
+  filter->Mark(Range(AbsoluteAddress(1000), 50));
+}
+
+}  // namespace
+
+TEST(AddressFilterPageMapTest, DefaultConstructor) {
+  TestPageMap page_map;
+  EXPECT_TRUE(page_map.empty());
+  EXPECT_EQ(0u, page_map.page_size());
+  EXPECT_TRUE(page_map.pages().empty());
+}
+
+TEST(AddressFilterPageMapTest, Init) {
+  TestAddressFilter filter;
+  InitFilter(&filter);
+
+  TestPageMap page_map;
+  page_map.Init(filter, 100);
+  EXPECT_FALSE(page_map.empty());
+  EXPECT_EQ(100u, page_map.page_size());
+  EXPECT_EQ("21110000021", page_map.pages());
+}
+
+TEST(AddressFilterPageMapTest, InitFromPages) {
+  TestAddressFilter filter;
+  InitFilter(&filter);
+
+  TestPageMap page_map;
+  EXPECT_FALSE(page_map.Init(filter, 0, ""));
+  EXPECT_FALSE(page_map.Init(filter, 100, "2111000002"));
+  EXPECT_FALSE(page_map.Init(filter, 100, "21110000023"));
+  EXPECT_TRUE(page_map.empty());
+
+  EXPECT_TRUE(page_map.Init(filter, 100, "21110000021"));
+  EXPECT_EQ(100u, page_map.page_size());
+  EXPECT_EQ("21110000021", page_map.pages());
+}
+
+TEST(AddressFilterPageMapTest, IsUnmarkedMatchesFilter) {
+  TestAddressFilter filter;
+  InitFilter(&filter);
+  TestPageMap page_map;
+  page_map.Init(filter, 100);
+
+  // Check every range of a few sizes, including ones overflowing the extent.
+  const size_t kSizes[] = {1, 2, 10, 60, 150, 1000};
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    for (size_t start = 0; start < 1100; ++start) {
+      Range range(AbsoluteAddress(start), kSizes[i]);
+      EXPECT_EQ(filter.IsUnmarked(range), page_map.IsUnmarked(filter, range))
+          << "Range at " << start << " of size " << kSizes[i] << ".";
+    }
+  }
+}
+
+}  // namespace core
@@ -32,20 +32,30 @@
 #include "base/logging.h"
 #include "syzygy/core/address_range.h"
 #include "syzygy/core/address_space_internal.h"
+#include "syzygy/core/flat_map.h"
 #include "syzygy/core/serialization.h"
 
 namespace core {
 
 // An address space is a mapping from a set of non-overlapping address ranges
 // (AddressSpace::Range), each of non-zero size, to an ItemType.
-template <typename AddressType, typename SizeType, typename ItemType>
+//
+// The ranges are stored in a RangeMapType, a sorted associative container of
+// Range to ItemType. By default this is a std::map, whose iterators remain
+// valid across insertions and removals. See FlatAddressSpace for an address
+// space stored in a core::FlatMap.
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType =
+              std::map<AddressRange<AddressType, SizeType>, ItemType>>
 class AddressSpace {
  public:
   // Typedef we use for convenience throughout.
   typedef AddressRange<AddressType, SizeType> Range;
-  typedef std::map<Range, ItemType> RangeMap;
-  typedef typename std::map<Range, ItemType>::iterator RangeMapIter;
-  typedef typename std::map<Range, ItemType>::const_iterator RangeMapConstIter;
+  typedef RangeMapType RangeMap;
+  typedef typename RangeMap::iterator RangeMapIter;
+  typedef typename RangeMap::const_iterator RangeMapConstIter;
   typedef std::pair<RangeMapConstIter, RangeMapConstIter> RangeMapConstIterPair;
   typedef std::pair<RangeMapIter, RangeMapIter> RangeMapIterPair;
 
@@ -69,6 +79,20 @@ class AddressSpace {
               const ItemType& item,
               typename RangeMap::iterator* ret_it = NULL);
 
+  // Pushes @p range mapping to @p item to the tail end of the address space.
+  //
+  // This is amortized O(1) and is simpler than Insert if the address space is
+  // being built in increasing address order. This will fail if @p range does
+  // not lie entirely beyond all existing ranges.
+  //
+  // @param range the range to insert.
+  // @param item the item to associate with @p range.
+  // @param ret_it on success, returns an iterator to the inserted item.
+  // @returns true iff @p range inserted.
+  bool Push(const Range& range,
+            const ItemType& item,
+            typename RangeMap::iterator* ret_it = NULL);
+
   // Insert @p range mapping to @p item or return the existing item exactly
   // matching @p range.
   //
@@ -191,6 +215,17 @@ class AddressSpace {
   RangeMap ranges_;
 };
 
+// An address space stored in a core::FlatMap. Its ranges are contiguous in
+// memory, which makes lookups and iteration cheaper and uses a fraction of the
+// memory of a std::map. However, insertions and removals are linear in the
+// number of ranges, except for insertions at the end, and they invalidate all
+// iterators. This suits address spaces that are mostly built in address order
+// and then queried.
+template <typename AddressType, typename SizeType, typename ItemType>
+using FlatAddressSpace = AddressSpace<
+    AddressType, SizeType, ItemType,
+    FlatMap<AddressRange<AddressType, SizeType>, ItemType>>;
+
 // An AddressRangeMap is used for keeping track of data in one address space
 // that has some relationship with data in another address space. Mappings are
 // stored as pairs of addresses, one from the 'source' address-space and one
@@ -385,12 +420,18 @@ class AddressRangeMap {
   RangePairs range_pairs_;
 };
 
-template <typename AddressType, typename SizeType, typename ItemType>
-AddressSpace<AddressType, SizeType, ItemType>::AddressSpace() {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::AddressSpace() {
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Insert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -412,8 +453,35 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Push(
+    const Range& range,
+    const ItemType& item,
+    typename RangeMap::iterator* ret_it) {
+  // We can't insert empty ranges.
+  if (range.IsEmpty())
+    return false;
+
+  // The range must start at or beyond the end of the last range.
+  if (!ranges_.empty() && range.start() < ranges_.rbegin()->first.end())
+    return false;
+
+  RangeMap::iterator it =
+      ranges_.insert(ranges_.end(), std::make_pair(range, item));
+  if (ret_it != NULL)
+    *ret_it = it;
+
+  return true;
+}
+
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindOrInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -439,8 +507,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::SubsumeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -495,8 +566,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+void AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::MergeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -540,8 +614,12 @@ void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
   return;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    Remove(const Range& range) {
   // We can't remove empty ranges.
   if (range.IsEmpty())
     return false;
@@ -554,17 +632,25 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
-    const Range& range) const {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapConstIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    FindFirstIntersection(const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindFirstIntersection(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
-    const Range& range) {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    FindFirstIntersection(const Range& range) {
   // Empty items do not exist in the address-space.
   if (range.IsEmpty())
     return ranges_.end();
@@ -593,16 +679,24 @@ AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapConstIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapConstIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindIntersecting(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) {
   // Empty ranges find nothing.
   if (range.IsEmpty())
@@ -630,24 +724,33 @@ AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
   return std::make_pair(begin, end);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Intersects(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Intersects(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   return (its.first != its.second);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
-    const Range& range) const {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    ContainsExactly(const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
     return false;
   return its.first->first == range;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Contains(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -655,9 +758,13 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
   return its.first->first.Contains(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapConstIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) const {
   // If there is a containing range, it must be the first intersection.
   RangeMap::const_iterator it(FindFirstIntersection(range));
@@ -667,9 +774,13 @@ AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) {
   // If there is a containing range, it must be the first intersection.
   RangeMap::iterator it(FindFirstIntersection(range));
@@ -17,6 +17,7 @@
 #include <limits>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/core/random_number_generator.h"
 #include "syzygy/core/unittest_util.h"
 
 namespace core {
@@ -40,6 +41,7 @@ std::ostream& operator<<(std::ostream& os,
 
 typedef AddressSpace<const uint8_t*, size_t, void*> PointerAddressSpace;
 typedef AddressSpace<size_t, size_t, void*> IntegerAddressSpace;
+typedef FlatAddressSpace<size_t, size_t, void*> FlatIntegerAddressSpace;
 
 TEST(AddressSpaceTest, Create) {
   PointerAddressSpace pointer_space;
@@ -65,6 +67,36 @@ TEST(AddressSpaceTest, Insert) {
   EXPECT_FALSE(address_space.Insert(IntegerAddressSpace::Range(10, 0), item));
 }
 
+TEST(AddressSpaceTest, Push) {
+  IntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  // Ranges at increasing addresses, adjacent or not, should be pushed.
+  IntegerAddressSpace::RangeMapIter it;
+  EXPECT_TRUE(address_space.Push(IntegerAddressSpace::Range(100, 10), item));
+  EXPECT_TRUE(address_space.Push(IntegerAddressSpace::Range(110, 5), item,
+                                 &it));
+  EXPECT_EQ(IntegerAddressSpace::Range(110, 5), it->first);
+  EXPECT_TRUE(address_space.Push(IntegerAddressSpace::Range(120, 10), item));
+
+  // Overlapping ranges, or ranges before the last one, should be rejected,
+  // even where Insert would accept them.
+  EXPECT_FALSE(address_space.Push(IntegerAddressSpace::Range(125, 10), item));
+  EXPECT_FALSE(address_space.Push(IntegerAddressSpace::Range(115, 5), item));
+
+  // Empty ranges should be rejected.
+  EXPECT_FALSE(address_space.Push(IntegerAddressSpace::Range(200, 0), item));
+
+  EXPECT_EQ(3u, address_space.size());
+
+  // Flat address spaces support pushing as well.
+  FlatIntegerAddressSpace flat_space;
+  EXPECT_TRUE(flat_space.Push(FlatIntegerAddressSpace::Range(100, 10), item));
+  EXPECT_TRUE(flat_space.Push(FlatIntegerAddressSpace::Range(110, 5), item));
+  EXPECT_FALSE(flat_space.Push(FlatIntegerAddressSpace::Range(105, 5), item));
+  EXPECT_EQ(2u, flat_space.size());
+}
+
 TEST(AddressSpaceTest, FindOrInsert) {
   IntegerAddressSpace address_space;
   void* item = "Something to point at";
@@ -396,6 +428,71 @@ TEST(AddressSpaceTest, FindIntersecting) {
   EXPECT_TRUE(it_pair.first == address_space.ranges().end());
 }
 
+TEST(AddressSpaceTest, FlatInsert) {
+  FlatIntegerAddressSpace address_space;
+  typedef FlatIntegerAddressSpace::Range Range;
+  void* item = "Something to point at";
+
+  // Insertions in and out of order should work.
+  EXPECT_TRUE(address_space.Insert(Range(110, 5), item));
+  EXPECT_TRUE(address_space.Insert(Range(120, 10), item));
+  EXPECT_TRUE(address_space.Insert(Range(100, 10), item));
+
+  // Overlapping insertions should be rejected.
+  EXPECT_FALSE(address_space.Insert(Range(95, 10), item));
+  EXPECT_FALSE(address_space.Insert(Range(105, 5), item));
+
+  // The ranges are kept sorted.
+  ASSERT_EQ(3u, address_space.size());
+  FlatIntegerAddressSpace::RangeMapConstIter it = address_space.begin();
+  EXPECT_EQ(Range(100, 10), it->first);
+  EXPECT_EQ(Range(110, 5), (++it)->first);
+  EXPECT_EQ(Range(120, 10), (++it)->first);
+
+  EXPECT_TRUE(address_space.Contains(Range(112, 2)));
+  EXPECT_TRUE(address_space.FindContaining(Range(116, 2)) ==
+              address_space.end());
+}
+
+TEST(AddressSpaceTest, FlatAddressSpaceMatchesAddressSpace) {
+  typedef AddressSpace<size_t, size_t, size_t> MapSpace;
+  typedef FlatAddressSpace<size_t, size_t, size_t> FlatSpace;
+  MapSpace map_space;
+  FlatSpace flat_space;
+
+  // Apply the same random operations to both backends.
+  RandomNumberGenerator random(42);
+  for (size_t i = 0; i < 5000; ++i) {
+    MapSpace::Range range(random(1000), random(20) + 1);
+    switch (random(4)) {
+      case 0:
+        EXPECT_EQ(map_space.Insert(range, i), flat_space.Insert(range, i));
+        break;
+      case 1:
+        EXPECT_EQ(map_space.SubsumeInsert(range, i),
+                  flat_space.SubsumeInsert(range, i));
+        break;
+      case 2:
+        map_space.MergeInsert(range, i);
+        flat_space.MergeInsert(range, i);
+        break;
+      default:
+        EXPECT_EQ(map_space.Remove(range), flat_space.Remove(range));
+        break;
+    }
+    EXPECT_EQ(map_space.Intersects(range), flat_space.Intersects(range));
+    EXPECT_EQ(map_space.Contains(range), flat_space.Contains(range));
+  }
+
+  ASSERT_EQ(map_space.size(), flat_space.size());
+  FlatSpace::RangeMapConstIter flat_it = flat_space.begin();
+  for (const auto& entry : map_space) {
+    EXPECT_EQ(entry.first, flat_it->first);
+    EXPECT_EQ(entry.second, flat_it->second);
+    ++flat_it;
+  }
+}
+
 TEST(AddressRangeMapTest, IsSimple) {
   IntegerRangeMap map;
   EXPECT_FALSE(map.IsSimple());
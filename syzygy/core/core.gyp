@@ -25,6 +25,8 @@
         'address.h',
         'address_filter.h',
         'address_filter_impl.h',
+        'address_filter_page_map.h',
+        'address_filter_page_map_impl.h',
         'address_range.cc',
         'address_range.h',
         'address_space.cc',
@@ -36,6 +38,7 @@
         'disassembler_util.h',
         'file_util.cc',
         'file_util.h',
+        'flat_map.h',
         'json_file_writer.cc',
         'json_file_writer.h',
         'random_number_generator.cc',
@@ -58,6 +61,17 @@
         '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
     },
+    {
+      'target_name': 'core_json_file_writer_benchmark',
+      'type': 'executable',
+      'sources': [
+        'json_file_writer_benchmark.cc',
+      ],
+      'dependencies': [
+        'core_lib',
+        '<(src)/base/base.gyp:base',
+      ],
+    },
     {
       'target_name': 'core_unittest_utils',
       'type': 'static_library',
@@ -78,6 +92,7 @@
       'sources': [
         'address_unittest.cc',
         'address_filter_unittest.cc',
+        'address_filter_page_map_unittest.cc',
         'address_space_unittest.cc',
         'address_range_unittest.cc',
         'disassembler_test_code.asm',
@@ -86,6 +101,7 @@
         'disassembler_util_unittest_vex_utils.cc',
         'disassembler_util_unittest_vex_utils.h',
         'file_util_unittest.cc',
+        'flat_map_unittest.cc',
         'json_file_writer_unittest.cc',
         'section_offset_address_unittest.cc',
         'serialization_unittest.cc',
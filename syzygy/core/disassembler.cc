@@ -29,7 +29,8 @@ Disassembler::Disassembler(const uint8_t* code,
       code_size_(code_size),
       code_addr_(code_addr),
       on_instruction_(on_instruction),
-      disassembled_bytes_(0) {
+      disassembled_bytes_(0),
+      decode_all_instructions_(true) {
 }
 
 Disassembler::Disassembler(const uint8_t* code,
@@ -41,7 +42,8 @@ Disassembler::Disassembler(const uint8_t* code,
       code_size_(code_size),
       code_addr_(code_addr),
       on_instruction_(on_instruction),
-      disassembled_bytes_(0) {
+      disassembled_bytes_(0),
+      decode_all_instructions_(true) {
   AddressSet::const_iterator it = entry_points.begin();
   for (; it != entry_points.end(); ++it)
     Unvisited(*it);
@@ -115,7 +117,22 @@ Disassembler::WalkResult Disassembler::Walk() {
       bool conditional_branch_handled = false;
 
       unsigned int decoded = 0;
-      _DecodeResult result = DistormDecompose(&code, &inst, 1, &decoded);
+      _DecodeResult result = DECRES_SUCCESS;
+      size_t size = 0;
+      bool accesses_memory = false;
+      if (!decode_all_instructions_ &&
+          DecodeInstructionLength(code.code, code.codeLen, &size,
+                                  &accesses_memory) &&
+          !accesses_memory) {
+        // The instruction doesn't affect the control flow, only its size is
+        // needed to carry on.
+        ::memset(&inst, 0, sizeof(inst));
+        inst.addr = addr.value();
+        inst.size = static_cast<uint8_t>(size);
+        decoded = 1;
+      } else {
+        result = DistormDecompose(&code, &inst, 1, &decoded);
+      }
 
       if (decoded == 0) {
         LOG(ERROR) << "Unable to decode instruction at " << addr << ".";
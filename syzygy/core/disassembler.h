@@ -114,8 +114,19 @@ class Disassembler {
   const AddressSet& unvisited() const { return unvisited_; }
   const VisitedSpace& visited() const { return visited_; }
   size_t disassembled_bytes() const { return disassembled_bytes_; }
+  bool decode_all_instructions() const { return decode_all_instructions_; }
   // @}
 
+  // By default every instruction is fully decoded. Clearing this only fully
+  // decodes the instructions that may affect the control flow or that access
+  // memory, the others have their length decoded by a much cheaper table
+  // lookup. The instructions passed to the callbacks for the latter only have
+  // a valid address and size, their opcode is I_UNDEFINED.
+  // @param decode_all_instructions true to fully decode every instruction.
+  void set_decode_all_instructions(bool decode_all_instructions) {
+    decode_all_instructions_ = decode_all_instructions;
+  }
+
  protected:
   // Called every time a basic instruction is hit.
   // @param addr is the address of the branch instruction itself.
@@ -184,6 +195,9 @@ class Disassembler {
 
   // Number of bytes disassembled to this point during walk.
   size_t disassembled_bytes_;
+
+  // Whether every instruction is fully decoded.
+  bool decode_all_instructions_;
 };
 
 }  // namespace core
@@ -161,6 +161,29 @@ TEST_F(DisassemblerTest, DisassembleFull) {
       disasm.disassembled_bytes());
 }
 
+TEST_F(DisassemblerTest, DisassembleFullWithoutDecodingAllInstructions) {
+  Disassembler disasm(PointerTo(&assembly_func),
+                      PointerTo(&assembly_func_end) - PointerTo(&assembly_func),
+                      AddressOf(&assembly_func),
+                      on_instruction_);
+  EXPECT_TRUE(disasm.decode_all_instructions());
+  disasm.set_decode_all_instructions(false);
+  EXPECT_FALSE(disasm.decode_all_instructions());
+  ASSERT_TRUE(disasm.Unvisited(AddressOf(&assembly_func)));
+  ASSERT_TRUE(disasm.Unvisited(AddressOf(&internal_label)));
+
+  // The walk is the same as with full decoding, and the calls are still
+  // fully decoded.
+  EXPECT_CALL(*this, OnInstruction(_, _)).Times(7).
+      WillRepeatedly(Invoke(this,
+                             &DisassemblerTest::RecordFunctionEncounter));
+
+  ASSERT_EQ(Disassembler::kWalkSuccess, disasm.Walk());
+  ASSERT_EQ(PointerTo(&assembly_func_end) - PointerTo(&assembly_func),
+      disasm.disassembled_bytes());
+  EXPECT_EQ(4u, functions_.size());
+}
+
 TEST_F(DisassemblerTest, EncounterFunctions) {
   Disassembler disasm(PointerTo(&assembly_func),
                       PointerTo(&assembly_func_end) - PointerTo(&assembly_func),
@@ -457,6 +457,192 @@ bool HandleBadDecode(_CodeInfo* ci,
   return true;
 }
 
+// The traits of an opcode, as used by DecodeInstructionLength.
+enum OpcodeTraits : uint16_t {
+  // The opcode is followed by a Mod R/M operand.
+  kHasModRM = 1 << 0,
+  // The opcode is followed by an 8-bit immediate.
+  kHasImm8 = 1 << 1,
+  // The opcode is followed by an immediate of the operand size: 16 bits with
+  // an operand-size prefix, 32 bits otherwise.
+  kHasImmZ = 1 << 2,
+  // The opcode is followed by a 16-bit immediate.
+  kHasImm16 = 1 << 3,
+  // The opcode is followed by a 32-bit absolute memory offset.
+  kHasMemoryOffset = 1 << 4,
+  // The instruction implicitly accesses memory, e.g. a string instruction.
+  kImplicitMemoryAccess = 1 << 5,
+  // The register form of the Mod R/M operand is invalid.
+  kMemoryOnly = 1 << 6,
+  // The reg field of the Mod R/M byte extends the opcode, and only some of
+  // its values are handled. See IsHandledOpcodeExtension.
+  kOpcodeExtension = 1 << 7,
+  // The byte is a handled prefix: the operand-size prefix or the FS and GS
+  // segment overrides. The other prefixes are rare in compiled code, except
+  // for branch hints and the prefixes of string and SIMD instructions, and
+  // distorm handles their redundant or invalid combinations in ways that
+  // aren't worth mimicking.
+  kPrefix = 1 << 8,
+  // The byte is the escape to the two-byte opcodes.
+  kTwoByteEscape = 1 << 9,
+  // The operand-size prefix selects another instruction, as for most SIMD
+  // instructions. This combination isn't handled.
+  kPrefixSelectsOpcode = 1 << 10,
+  // The instruction isn't handled: it affects the control flow, it's invalid,
+  // rare or it has an encoding that isn't worth handling here.
+  kFullDecode = 1 << 11,
+};
+
+// Short names for the entries of the opcode tables.
+const uint16_t k0 = 0;
+const uint16_t kF = kFullDecode;
+const uint16_t kP = kPrefix;
+const uint16_t kX = kTwoByteEscape;
+const uint16_t kM = kHasModRM;
+const uint16_t kMm = kHasModRM | kMemoryOnly;
+const uint16_t kMB = kHasModRM | kHasImm8;
+const uint16_t kMZ = kHasModRM | kHasImmZ;
+const uint16_t kV = kHasModRM | kPrefixSelectsOpcode;
+const uint16_t kVm = kHasModRM | kMemoryOnly | kPrefixSelectsOpcode;
+const uint16_t kVB = kHasModRM | kHasImm8 | kPrefixSelectsOpcode;
+const uint16_t kG = kHasModRM | kOpcodeExtension;
+const uint16_t kGm = kHasModRM | kOpcodeExtension | kMemoryOnly;
+const uint16_t kGB = kHasModRM | kOpcodeExtension | kHasImm8;
+const uint16_t kGZ = kHasModRM | kOpcodeExtension | kHasImmZ;
+const uint16_t kB = kHasImm8;
+const uint16_t kZ = kHasImmZ;
+const uint16_t kE = kHasImm16 | kHasImm8;
+const uint16_t kO = kHasMemoryOffset;
+const uint16_t kS = kImplicitMemoryAccess;
+
+// The traits of the one-byte opcodes.
+const uint16_t kOneByteOpcodeTraits[256] = {
+    kM, kM, kM, kM, kB, kZ, k0, k0,  // 0x00
+    kM, kM, kM, kM, kB, kZ, k0, kX,  // 0x08
+    kM, kM, kM, kM, kB, kZ, k0, k0,  // 0x10
+    kM, kM, kM, kM, kB, kZ, k0, k0,  // 0x18
+    kM, kM, kM, kM, kB, kZ, kF, k0,  // 0x20
+    kM, kM, kM, kM, kB, kZ, kF, k0,  // 0x28
+    kM, kM, kM, kM, kB, kZ, kF, k0,  // 0x30
+    kM, kM, kM, kM, kB, kZ, kF, k0,  // 0x38
+    k0, k0, k0, k0, k0, k0, k0, k0,  // 0x40
+    k0, k0, k0, k0, k0, k0, k0, k0,  // 0x48
+    k0, k0, k0, k0, k0, k0, k0, k0,  // 0x50
+    k0, k0, k0, k0, k0, k0, k0, k0,  // 0x58
+    k0, k0, kF, kF, kP, kP, kP, kF,  // 0x60
+    kZ, kMZ, kB, kMB, kF, kF, kF, kF,  // 0x68
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x70
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x78
+    kMB, kMZ, kMB, kMB, kM, kM, kM, kM,  // 0x80
+    kM, kM, kM, kM, kF, kMm, kF, kG,  // 0x88
+    k0, k0, k0, k0, k0, k0, k0, k0,  // 0x90
+    k0, k0, kF, kF, k0, k0, k0, k0,  // 0x98
+    kO, kO, kO, kO, kS, kS, kS, kS,  // 0xA0
+    kB, kZ, kS, kS, kS, kS, kS, kS,  // 0xA8
+    kB, kB, kB, kB, kB, kB, kB, kB,  // 0xB0
+    kZ, kZ, kZ, kZ, kZ, kZ, kZ, kZ,  // 0xB8
+    kGB, kGB, kF, kF, kF, kF, kGB, kGZ,  // 0xC0
+    kE, k0, kF, kF, kF, kF, kF, kF,  // 0xC8
+    kG, kG, kG, kG, kB, kB, kF, kS,  // 0xD0
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0xD8
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0xE0
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0xE8
+    kF, kF, kF, kF, kF, k0, kG, kG,  // 0xF0
+    k0, k0, k0, k0, k0, k0, kG, kG,  // 0xF8
+};
+
+// The traits of the two-byte opcodes, following a 0x0F escape byte.
+const uint16_t kTwoByteOpcodeTraits[256] = {
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x00
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x08
+    kV, kV, kV, kVm, kV, kV, kV, kVm,  // 0x10
+    kGm, kF, kF, kF, kF, kF, kF, kG,  // 0x18
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x20
+    kV, kV, kV, kVm, kV, kV, kV, kV,  // 0x28
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x30
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x38
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x40
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x48
+    kF, kV, kV, kV, kV, kV, kV, kV,  // 0x50
+    kV, kV, kV, kV, kV, kV, kV, kV,  // 0x58
+    kV, kV, kV, kV, kV, kV, kV, kV,  // 0x60
+    kV, kV, kV, kV, kF, kF, kV, kV,  // 0x68
+    kVB, kF, kF, kF, kV, kV, kV, kF,  // 0x70
+    kF, kF, kF, kF, kF, kF, kV, kV,  // 0x78
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x80
+    kF, kF, kF, kF, kF, kF, kF, kF,  // 0x88
+    kM, kM, kM, kM, kM, kM, kM, kM,  // 0x90
+    kM, kM, kM, kM, kM, kM, kM, kM,  // 0x98
+    k0, k0, k0, kM, kMB, kM, kF, kF,  // 0xA0
+    k0, k0, kF, kM, kMB, kM, kF, kM,  // 0xA8
+    kM, kM, kMm, kM, kMm, kMm, kM, kM,  // 0xB0
+    kF, kF, kGB, kM, kM, kM, kM, kM,  // 0xB8
+    kM, kM, kVB, kF, kVB, kF, kVB, kF,  // 0xC0
+    k0, k0, k0, k0, k0, k0, k0, k0,  // 0xC8
+    kF, kV, kV, kV, kV, kV, kF, kF,  // 0xD0
+    kV, kV, kV, kV, kV, kV, kV, kV,  // 0xD8
+    kV, kV, kV, kV, kV, kV, kF, kVm,  // 0xE0
+    kV, kV, kV, kV, kV, kV, kV, kV,  // 0xE8
+    kF, kV, kV, kV, kV, kV, kV, kF,  // 0xF0
+    kV, kV, kV, kV, kV, kV, kV, kF,  // 0xF8
+};
+
+// The maximum number of prefixes handled by DecodeInstructionLength.
+const size_t kMaxHandledPrefixes = 2;
+
+// Checks if the fast decoder handles an opcode extension. This adjusts the
+// traits of the opcodes whose immediate depends on the extension.
+// @param two_byte true if @p opcode is a two-byte opcode.
+// @param opcode The last byte of the opcode.
+// @param reg The reg field of the Mod R/M byte.
+// @param traits The traits of the opcode.
+// @returns true if the extension is handled, false otherwise.
+bool IsHandledOpcodeExtension(bool two_byte,
+                              uint8_t opcode,
+                              uint8_t reg,
+                              uint16_t* traits) {
+  DCHECK_NE(static_cast<uint16_t*>(nullptr), traits);
+  if (two_byte) {
+    switch (opcode) {
+      case 0x18: return reg <= 3;  // PREFETCH*.
+      case 0x1F: return reg == 0;  // NOP r/m.
+      case 0xBA: return reg >= 4;  // BT, BTS, BTR, BTC r/m, imm8.
+    }
+    NOTREACHED();
+    return false;
+  }
+
+  switch (opcode) {
+    case 0x8F:  // POP r/m.
+    case 0xC6:  // MOV r/m8, imm8.
+    case 0xC7:  // MOV r/m, imm.
+      return reg == 0;
+
+    // The shifts and rotations, where /6 is an undocumented alias of SHL.
+    case 0xC0:
+    case 0xC1:
+    case 0xD0:
+    case 0xD1:
+    case 0xD2:
+    case 0xD3:
+      return reg != 6;
+
+    // TEST r/m, imm is /0, /1 is an undocumented alias of it.
+    case 0xF6:
+    case 0xF7:
+      if (reg == 1)
+        return false;
+      if (reg == 0)
+        *traits |= opcode == 0xF6 ? kHasImm8 : kHasImmZ;
+      return true;
+
+    case 0xFE: return reg <= 1;  // INC, DEC r/m8.
+    case 0xFF: return reg <= 1 || reg == 6;  // INC, DEC, PUSH r/m.
+  }
+  NOTREACHED();
+  return false;
+}
+
 }  // namespace
 
 _DecodeResult DistormDecompose(_CodeInfo* ci,
@@ -549,6 +735,103 @@ bool DecodeOneInstruction(const uint8_t* buffer,
   return true;
 }
 
+bool DecodeInstructionLength(const uint8_t* buffer,
+                             size_t length,
+                             size_t* size,
+                             bool* accesses_memory) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), buffer);
+  DCHECK_NE(static_cast<size_t*>(nullptr), size);
+  DCHECK_NE(static_cast<bool*>(nullptr), accesses_memory);
+
+  // Skip the prefixes. The only one that affects the length of the handled
+  // instructions is the operand-size prefix.
+  size_t offset = 0;
+  bool operand_size_prefix = false;
+  uint16_t traits = 0;
+  while (true) {
+    if (offset == length)
+      return false;
+    traits = kOneByteOpcodeTraits[buffer[offset]];
+    if ((traits & kPrefix) == 0)
+      break;
+    // Repeated prefixes aren't handled.
+    if (offset == kMaxHandledPrefixes ||
+        (offset > 0 && buffer[offset] == buffer[0])) {
+      return false;
+    }
+    if (buffer[offset] == 0x66)
+      operand_size_prefix = true;
+    ++offset;
+  }
+
+  uint8_t opcode = buffer[offset++];
+  bool two_byte = false;
+  if (traits & kTwoByteEscape) {
+    if (offset == length)
+      return false;
+    two_byte = true;
+    opcode = buffer[offset++];
+    traits = kTwoByteOpcodeTraits[opcode];
+  }
+  if (traits & kFullDecode)
+    return false;
+  if ((traits & kPrefixSelectsOpcode) != 0 && operand_size_prefix)
+    return false;
+
+  bool memory = (traits & kImplicitMemoryAccess) != 0;
+  if (traits & kHasModRM) {
+    if (offset == length)
+      return false;
+    ModRMByte modrm(buffer[offset++]);
+    if (modrm.mod == 0b11) {
+      if (traits & kMemoryOnly)
+        return false;
+    } else {
+      memory = true;
+    }
+    if ((traits & kOpcodeExtension) != 0 &&
+        !IsHandledOpcodeExtension(two_byte, opcode, modrm.reg_or_opcode,
+                                  &traits)) {
+      return false;
+    }
+
+    // Account for the SIB byte and the displacement.
+    if (modrm.mod != 0b11 && modrm.r_m == 0b100) {
+      if (offset == length)
+        return false;
+      const uint8_t kSIBBaseMask = 0b111;
+      if (modrm.mod == 0b00 && (buffer[offset] & kSIBBaseMask) == 0b101)
+        offset += 4;
+      ++offset;
+    }
+    if (modrm.mod == 0b00 && modrm.r_m == 0b101)
+      offset += 4;
+    else if (modrm.mod == 0b01)
+      offset += 1;
+    else if (modrm.mod == 0b10)
+      offset += 4;
+  }
+
+  if (traits & kHasImm8)
+    offset += 1;
+  if (traits & kHasImmZ)
+    offset += operand_size_prefix ? 2 : 4;
+  if (traits & kHasImm16)
+    offset += 2;
+  if (traits & kHasMemoryOffset) {
+    offset += 4;
+    memory = true;
+  }
+
+  const size_t kMaxInstructionSize = 15;
+  if (offset > length || offset > kMaxInstructionSize)
+    return false;
+
+  *size = offset;
+  *accesses_memory = memory;
+  return true;
+}
+
 bool InstructionToString(
     const _DInst& instruction,
     const uint8_t* data,
@@ -62,6 +62,22 @@ bool DecodeOneInstruction(const uint8_t* buffer,
                           size_t length,
                           _DInst* instruction);
 
+// Decodes the length of exactly one instruction with a table of the common
+// opcodes, without decoding its operands. This is much cheaper than a full
+// decode, and only handles instructions that don't affect the control flow.
+// @param buffer the buffer containing the data to decode.
+// @param length the length of the buffer.
+// @param size receives the size of the instruction.
+// @param accesses_memory receives true if the instruction has a memory
+//     operand, explicit or implicit, false otherwise.
+// @returns true if the instruction was decoded, false if it needs a full
+//     decode: it may affect the control flow, be invalid, truncated or simply
+//     not be handled by the table.
+bool DecodeInstructionLength(const uint8_t* buffer,
+                             size_t length,
+                             size_t* size,
+                             bool* accesses_memory);
+
 // Dump text representation of exactly one instruction to a std::string.
 // @param instruction the instruction to dump.
 // @param data points to the raw byte sequences.
@@ -145,6 +145,92 @@ TEST(DisassemblerUtilTest, DistormWrapperVxorpsPasses) {
   EXPECT_TRUE(DecodeOneInstruction(kVxorps, sizeof(kVxorps), &inst));
 }
 
+TEST(DisassemblerUtilTest, DecodeInstructionLength) {
+  // mov eax, dword ptr [esp+8]
+  const uint8_t kMovMem[] = {0x8B, 0x44, 0x24, 0x08};
+  // mov ax, 0x1234
+  const uint8_t kMovImm16[] = {0x66, 0xB8, 0x34, 0x12};
+  // add ecx, 0x12345678
+  const uint8_t kAddImm32[] = {0x81, 0xC1, 0x78, 0x56, 0x34, 0x12};
+  // mov eax, dword ptr fs:[0]
+  const uint8_t kMovFs[] = {0x64, 0xA1, 0x00, 0x00, 0x00, 0x00};
+
+  size_t size = 0;
+  bool accesses_memory = false;
+  EXPECT_TRUE(DecodeInstructionLength(kMovMem, sizeof(kMovMem), &size,
+                                      &accesses_memory));
+  EXPECT_EQ(sizeof(kMovMem), size);
+  EXPECT_TRUE(accesses_memory);
+
+  EXPECT_TRUE(DecodeInstructionLength(kMovImm16, sizeof(kMovImm16), &size,
+                                      &accesses_memory));
+  EXPECT_EQ(sizeof(kMovImm16), size);
+  EXPECT_FALSE(accesses_memory);
+
+  EXPECT_TRUE(DecodeInstructionLength(kAddImm32, sizeof(kAddImm32), &size,
+                                      &accesses_memory));
+  EXPECT_EQ(sizeof(kAddImm32), size);
+  EXPECT_FALSE(accesses_memory);
+
+  EXPECT_TRUE(DecodeInstructionLength(kMovFs, sizeof(kMovFs), &size,
+                                      &accesses_memory));
+  EXPECT_EQ(sizeof(kMovFs), size);
+  EXPECT_TRUE(accesses_memory);
+
+  // Control flow and truncated instructions aren't handled.
+  EXPECT_FALSE(DecodeInstructionLength(kJe, sizeof(kJe), &size,
+                                       &accesses_memory));
+  EXPECT_FALSE(DecodeInstructionLength(kAddImm32, sizeof(kAddImm32) - 1,
+                                       &size, &accesses_memory));
+  EXPECT_FALSE(DecodeInstructionLength(kJmp, sizeof(kJmp), &size,
+                                       &accesses_memory));
+  EXPECT_FALSE(DecodeInstructionLength(kCall, sizeof(kCall), &size,
+                                       &accesses_memory));
+  EXPECT_FALSE(DecodeInstructionLength(kRet, sizeof(kRet), &size,
+                                       &accesses_memory));
+}
+
+TEST(DisassemblerUtilTest, DecodeInstructionLengthMatchesDistorm) {
+  // Every instruction handled by the table must be decoded by distorm to an
+  // instruction of the same size that doesn't affect the control flow.
+  const uint8_t kPrefixes[] = {0x00, 0x66, 0x64};
+  const uint8_t kSIBs[] = {0x00, 0x25, 0x64};
+  for (uint8_t prefix : kPrefixes) {
+    for (size_t opcode_size = 1; opcode_size <= 2; ++opcode_size) {
+      for (size_t opcode = 0; opcode <= 0xFF; ++opcode) {
+        for (size_t modrm = 0; modrm <= 0xFF; ++modrm) {
+          for (uint8_t sib : kSIBs) {
+            uint8_t buffer[16] = {};
+            size_t length = 0;
+            if (prefix != 0)
+              buffer[length++] = prefix;
+            if (opcode_size == 2)
+              buffer[length++] = 0x0F;
+            buffer[length++] = static_cast<uint8_t>(opcode);
+            buffer[length++] = static_cast<uint8_t>(modrm);
+            buffer[length++] = sib;
+            for (uint8_t value = 0x11; length < sizeof(buffer); ++value)
+              buffer[length++] = value;
+
+            size_t size = 0;
+            bool accesses_memory = false;
+            if (!DecodeInstructionLength(buffer, sizeof(buffer), &size,
+                                         &accesses_memory)) {
+              continue;
+            }
+
+            _DInst inst = {};
+            ASSERT_TRUE(DecodeOneInstruction(buffer, size, &inst))
+                << "Opcode " << std::hex << opcode << " Mod R/M " << modrm;
+            EXPECT_EQ(size, inst.size);
+            EXPECT_EQ(FC_NONE, META_GET_FC(inst.meta));
+          }
+        }
+      }
+    }
+  }
+}
+
 TEST(DisassemblerUtilTest, InstructionToString) {
   _DInst inst = {};
   inst = DecodeBuffer(kNop1, sizeof(kNop1));
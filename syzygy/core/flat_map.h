@@ -0,0 +1,189 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatMap, an associative container that keeps its elements sorted
+// in a single vector. It offers the subset of the interface of std::map that
+// the block-graph uses, and is meant for the many small maps of a block-graph:
+// a std::map allocates a tree node per element, where a FlatMap makes a
+// single allocation and keeps its elements contiguous.
+//
+// The trade-offs with respect to std::map are:
+//   - insertions and removals are linear in the size of the map, except for
+//     insertions at the end which are amortized constant;
+//   - insertions and removals invalidate all iterators;
+//   - the keys of the elements are not const, and must not be modified
+//     through an iterator.
+
+#ifndef SYZYGY_CORE_FLAT_MAP_H_
+#define SYZYGY_CORE_FLAT_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace core {
+
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class FlatMap {
+ public:
+  typedef Key key_type;
+  typedef Value mapped_type;
+  typedef std::pair<Key, Value> value_type;
+  typedef Compare key_compare;
+  typedef std::vector<value_type> container_type;
+  typedef typename container_type::size_type size_type;
+  typedef typename container_type::iterator iterator;
+  typedef typename container_type::const_iterator const_iterator;
+  typedef typename container_type::reverse_iterator reverse_iterator;
+  typedef typename container_type::const_reverse_iterator
+      const_reverse_iterator;
+
+  FlatMap() { }
+
+  // Builds a map from a range of elements. As with std::map, only the first
+  // element with a given key is kept.
+  template <typename InputIterator>
+  FlatMap(InputIterator first, InputIterator last) {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  // @name Iteration.
+  // @{
+  iterator begin() { return values_.begin(); }
+  const_iterator begin() const { return values_.begin(); }
+  iterator end() { return values_.end(); }
+  const_iterator end() const { return values_.end(); }
+  reverse_iterator rbegin() { return values_.rbegin(); }
+  const_reverse_iterator rbegin() const { return values_.rbegin(); }
+  reverse_iterator rend() { return values_.rend(); }
+  const_reverse_iterator rend() const { return values_.rend(); }
+  // @}
+
+  // @name Capacity.
+  // @{
+  bool empty() const { return values_.empty(); }
+  size_type size() const { return values_.size(); }
+  void reserve(size_type size) { values_.reserve(size); }
+  // @}
+
+  // @name Lookup.
+  // @{
+  iterator lower_bound(const Key& key) {
+    return std::lower_bound(values_.begin(), values_.end(), key, KeyLess());
+  }
+  const_iterator lower_bound(const Key& key) const {
+    return std::lower_bound(values_.begin(), values_.end(), key, KeyLess());
+  }
+  iterator upper_bound(const Key& key) {
+    return std::upper_bound(values_.begin(), values_.end(), key, KeyLess());
+  }
+  const_iterator upper_bound(const Key& key) const {
+    return std::upper_bound(values_.begin(), values_.end(), key, KeyLess());
+  }
+  iterator find(const Key& key) {
+    iterator it = lower_bound(key);
+    if (it == values_.end() || Compare()(key, it->first))
+      return values_.end();
+    return it;
+  }
+  const_iterator find(const Key& key) const {
+    const_iterator it = lower_bound(key);
+    if (it == values_.end() || Compare()(key, it->first))
+      return values_.end();
+    return it;
+  }
+  size_type count(const Key& key) const {
+    return find(key) == values_.end() ? 0 : 1;
+  }
+  // @note Unlike std::map, this CHECKs that @p key is in the map.
+  Value& at(const Key& key) {
+    iterator it = find(key);
+    CHECK(it != values_.end());
+    return it->second;
+  }
+  const Value& at(const Key& key) const {
+    const_iterator it = find(key);
+    CHECK(it != values_.end());
+    return it->second;
+  }
+  // @}
+
+  // @name Modifiers.
+  // @{
+  std::pair<iterator, bool> insert(const value_type& value) {
+    // Elements are typically inserted in order, make that case cheap.
+    if (values_.empty() || Compare()(values_.back().first, value.first)) {
+      values_.push_back(value);
+      return std::make_pair(values_.end() - 1, true);
+    }
+    iterator it = lower_bound(value.first);
+    if (it != values_.end() && !Compare()(value.first, it->first))
+      return std::make_pair(it, false);
+    return std::make_pair(values_.insert(it, value), true);
+  }
+  // @note As with std::map, @p hint is where @p value would be inserted.
+  //     Inserting at the end is constant time either way, so it is ignored.
+  iterator insert(const_iterator hint, const value_type& value) {
+    return insert(value).first;
+  }
+  Value& operator[](const Key& key) {
+    return insert(value_type(key, Value())).first->second;
+  }
+  iterator erase(const_iterator it) { return values_.erase(it); }
+  iterator erase(const_iterator first, const_iterator last) {
+    return values_.erase(first, last);
+  }
+  size_type erase(const Key& key) {
+    iterator it = find(key);
+    if (it == values_.end())
+      return 0;
+    values_.erase(it);
+    return 1;
+  }
+  void clear() { values_.clear(); }
+  void swap(FlatMap& other) { values_.swap(other.values_); }
+  // @}
+
+  // @name Comparison.
+  // @{
+  bool operator==(const FlatMap& other) const {
+    return values_ == other.values_;
+  }
+  bool operator!=(const FlatMap& other) const {
+    return values_ != other.values_;
+  }
+  // @}
+
+ private:
+  // Compares the elements of the map with keys.
+  struct KeyLess {
+    bool operator()(const value_type& value, const Key& key) const {
+      return Compare()(value.first, key);
+    }
+    bool operator()(const Key& key, const value_type& value) const {
+      return Compare()(key, value.first);
+    }
+  };
+
+  // The elements of the map, sorted by key.
+  container_type values_;
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_FLAT_MAP_H_
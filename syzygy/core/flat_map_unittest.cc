@@ -0,0 +1,122 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/flat_map.h"
+
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+typedef FlatMap<int, std::string> TestMap;
+
+}  // namespace
+
+TEST(FlatMapTest, DefaultConstructor) {
+  TestMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0u, map.size());
+  EXPECT_TRUE(map.begin() == map.end());
+  EXPECT_TRUE(map.find(0) == map.end());
+  EXPECT_EQ(0u, map.count(0));
+}
+
+TEST(FlatMapTest, InsertKeepsElementsSorted) {
+  TestMap map;
+  EXPECT_TRUE(map.insert(std::make_pair(4, "four")).second);
+  EXPECT_TRUE(map.insert(std::make_pair(8, "eight")).second);
+  EXPECT_TRUE(map.insert(std::make_pair(1, "one")).second);
+  EXPECT_TRUE(map.insert(std::make_pair(6, "six")).second);
+
+  // Inserting an existing key fails and keeps the original value.
+  std::pair<TestMap::iterator, bool> result =
+      map.insert(std::make_pair(6, "other"));
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(6, result.first->first);
+  EXPECT_EQ("six", result.first->second);
+
+  ASSERT_EQ(4u, map.size());
+  int previous = 0;
+  for (const auto& entry : map) {
+    EXPECT_LT(previous, entry.first);
+    previous = entry.first;
+  }
+  EXPECT_EQ(8, map.rbegin()->first);
+}
+
+TEST(FlatMapTest, Lookup) {
+  TestMap map;
+  map[1] = "one";
+  map[4] = "four";
+  map[8] = "eight";
+
+  EXPECT_EQ(1u, map.count(4));
+  EXPECT_EQ(0u, map.count(5));
+  EXPECT_EQ("four", map.find(4)->second);
+  EXPECT_TRUE(map.find(5) == map.end());
+  EXPECT_EQ("eight", map.at(8));
+
+  EXPECT_EQ(4, map.lower_bound(4)->first);
+  EXPECT_EQ(8, map.upper_bound(4)->first);
+  EXPECT_EQ(4, map.lower_bound(2)->first);
+  EXPECT_TRUE(map.lower_bound(9) == map.end());
+}
+
+TEST(FlatMapTest, Erase) {
+  TestMap map;
+  map[1] = "one";
+  map[4] = "four";
+  map[8] = "eight";
+
+  EXPECT_EQ(0u, map.erase(5));
+  EXPECT_EQ(1u, map.erase(4));
+  EXPECT_EQ(2u, map.size());
+  EXPECT_TRUE(map.find(4) == map.end());
+
+  TestMap::iterator it = map.erase(map.begin());
+  ASSERT_TRUE(it != map.end());
+  EXPECT_EQ(8, it->first);
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(FlatMapTest, MatchesStdMap) {
+  std::map<int, int> expected;
+  FlatMap<int, int> map;
+  for (int i = 0; i < 100; ++i) {
+    int key = (i * 37) % 61;
+    EXPECT_EQ(expected.insert(std::make_pair(key, i)).second,
+              map.insert(std::make_pair(key, i)).second);
+  }
+
+  FlatMap<int, int> copy(expected.begin(), expected.end());
+  EXPECT_TRUE(map == copy);
+  ASSERT_EQ(expected.size(), map.size());
+  auto it = map.begin();
+  for (const auto& entry : expected) {
+    EXPECT_EQ(entry.first, it->first);
+    EXPECT_EQ(entry.second, it->second);
+    ++it;
+  }
+
+  copy.erase(0);
+  EXPECT_TRUE(map != copy);
+}
+
+}  // namespace core
@@ -25,6 +25,7 @@
 #include "base/values.h"
 #include "base/json/json_writer.h"
 #include "base/json/string_escape.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 
 namespace core {
@@ -39,6 +40,7 @@ static const char kNull[] = "null";
 static const char kTrue[] = "true";
 static const char kFalse[] = "false";
 static const char kCommentPrefix[] = "//";
+static const char kHexDigits[] = "0123456789ABCDEF";
 
 static const char* kStructureOpenings[] = { "[", "{", NULL };
 static const char* kStructureClosings[] = { "]", "}", NULL };
@@ -56,8 +58,9 @@ struct JSONFileWriter::Helper {
     if (!json_file_writer->AlignForValueOrKey())
       return false;
 
-    std::string formatted_key = base::GetQuotedJSONString(key.as_string());
-    if (!json_file_writer->Printf("%s:", formatted_key.c_str()))
+    // The key is escaped straight into the output buffer.
+    base::EscapeJSONString(key, true, &json_file_writer->buffer_);
+    if (!json_file_writer->PutChar(':'))
       return false;
 
     // If we're pretty printing, then also output a space between the key and
@@ -84,10 +87,16 @@ struct JSONFileWriter::Helper {
     if (!(json_file_writer->*print_function)(value))
       return false;
     json_file_writer->FlushValue(true);
+
+    // Write out the stream as soon as it is finished.
+    if (json_file_writer->finished_ && !json_file_writer->FlushBuffer())
+      return false;
     return true;
   }
 };
 
+const size_t JSONFileWriter::kBufferSize = 256 * 1024;
+
 JSONFileWriter::JSONFileWriter(FILE* file, bool pretty_print)
     : file_(file),
       pretty_print_(pretty_print),
@@ -99,6 +108,7 @@ JSONFileWriter::JSONFileWriter(FILE* file, bool pretty_print)
 
 JSONFileWriter::~JSONFileWriter() {
   Flush();
+  FlushBuffer();
 }
 
 bool JSONFileWriter::OutputComment(const base::StringPiece& comment) {
@@ -113,12 +123,10 @@ bool JSONFileWriter::OutputComment(const base::StringPiece& comment) {
 
   // Trailing comments can be written directly.
   if (finished_) {
-    if (!OutputNewline() || !Printf("%s", kCommentPrefix))
+    if (!OutputNewline() || !Write(kCommentPrefix))
       return false;
-    if (comment.length() > 0 &&
-        !Printf(" %.*s", comment.length(), comment.data())) {
+    if (comment.length() > 0 && (!PutChar(' ') || !Write(comment)))
       return false;
-    }
     return true;
   }
 
@@ -181,11 +189,31 @@ bool JSONFileWriter::OutputTrailingComment(const base::StringPiece16& comment) {
 }
 
 bool JSONFileWriter::PrintBoolean(bool value) {
-  return Printf("%s", value ? kTrue : kFalse);
+  return Write(value ? kTrue : kFalse);
 }
 
 bool JSONFileWriter::PrintInteger(int value) {
-  return Printf("%d", value);
+  // The digits are produced from the least significant, on the magnitude of
+  // the value so that the most negative value works.
+  char buffer[16];
+  char* end = buffer + sizeof(buffer);
+  char* digits = end;
+  uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) :
+                                   static_cast<uint32_t>(value);
+  do {
+    *--digits = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0)
+    *--digits = '-';
+  return Write(base::StringPiece(digits, end - digits));
+}
+
+bool JSONFileWriter::PrintHexUint32(uint32_t value) {
+  char buffer[] = "\"0x00000000\"";
+  for (size_t i = 0; i < 8; ++i)
+    buffer[10 - i] = kHexDigits[(value >> (4 * i)) & 0xF];
+  return Write(base::StringPiece(buffer, arraysize(buffer) - 1));
 }
 
 bool JSONFileWriter::PrintDouble(double value) {
@@ -194,11 +222,14 @@ bool JSONFileWriter::PrintDouble(double value) {
 }
 
 bool JSONFileWriter::PrintString(const base::StringPiece& value) {
-  return Printf("%s", base::GetQuotedJSONString(value.as_string()).c_str());
+  // The string is escaped straight into the output buffer.
+  base::EscapeJSONString(value, true, &buffer_);
+  at_col_zero_ = false;
+  return MaybeFlushBuffer();
 }
 
 bool JSONFileWriter::PrintNull(int value_unused) {
-  return Printf("%s", kNull);
+  return Write(kNull);
 }
 
 bool JSONFileWriter::PrintValue(const Value* value) {
@@ -221,7 +252,7 @@ bool JSONFileWriter::PrintValue(const Value* value) {
     case Value::TYPE_BINARY: {
       std::string str;
       base::JSONWriter::Write(*value, &str);
-      return Printf("%s", str.c_str());
+      return Write(str);
     }
 
     default: {
@@ -232,20 +263,45 @@ bool JSONFileWriter::PrintValue(const Value* value) {
 }
 
 bool JSONFileWriter::Printf(const char* format, ...) {
+  size_t size = buffer_.size();
   va_list args;
   va_start(args, format);
-  int chars_written = vfprintf(file_, format, args);
+  base::StringAppendV(&buffer_, format, args);
   va_end(args);
-  if (chars_written > 0)
+  if (buffer_.size() > size)
     at_col_zero_ = false;
-  return chars_written >= 0;
+  return MaybeFlushBuffer();
 }
 
 bool JSONFileWriter::PutChar(char c) {
-  if (fputc(c, file_) != c)
-    return false;
+  buffer_.push_back(c);
   at_col_zero_ = false;
-  return true;
+  return MaybeFlushBuffer();
+}
+
+bool JSONFileWriter::Write(const base::StringPiece& data) {
+  if (data.empty())
+    return true;
+  buffer_.append(data.data(), data.size());
+  at_col_zero_ = false;
+  return MaybeFlushBuffer();
+}
+
+bool JSONFileWriter::MaybeFlushBuffer() {
+  // Once the stream is finished only comments may follow, and they go out
+  // right away so that the file always holds the whole stream.
+  if (buffer_.size() < kBufferSize && !finished_)
+    return true;
+  return FlushBuffer();
+}
+
+bool JSONFileWriter::FlushBuffer() {
+  if (buffer_.empty())
+    return true;
+  size_t size = buffer_.size();
+  size_t written = fwrite(buffer_.data(), 1, size, file_);
+  buffer_.clear();
+  return written == size;
 }
 
 bool JSONFileWriter::OpenList() {
@@ -287,7 +343,7 @@ bool JSONFileWriter::Flush() {
       return false;
   }
 
-  return true;
+  return FlushBuffer();
 }
 
 bool JSONFileWriter::OutputBoolean(bool value) {
@@ -300,6 +356,11 @@ bool JSONFileWriter::OutputInteger(int value) {
       value, &JSONFileWriter::PrintInteger, this);
 }
 
+bool JSONFileWriter::OutputHexUint32(uint32_t value) {
+  return Helper::OutputValue(
+      value, &JSONFileWriter::PrintHexUint32, this);
+}
+
 bool JSONFileWriter::OutputDouble(double value) {
   return Helper::OutputValue(
       value, &JSONFileWriter::PrintDouble, this);
@@ -332,11 +393,8 @@ bool JSONFileWriter::OutputIndent() {
   if (!pretty_print_)
     return true;
 
-  // We bypass Printf and manually update at_col_zero_ here for efficiency.
-  if (indent_depth_ > 0)
-    at_col_zero_ = false;
   for (size_t i = 0; i < indent_depth_; ++i) {
-    if (fprintf(file_, "%s", kIndent) < 0)
+    if (!Write(kIndent))
       return false;
   }
   return true;
@@ -346,8 +404,8 @@ bool JSONFileWriter::OutputNewline() {
   if (!pretty_print_ || at_col_zero_)
     return true;
 
-  // Bypass Printf and manually at_col_zero_ for efficiency.
-  if (fprintf(file_, "%s", kNewline) < 0)
+  // Write sets at_col_zero_ to false, so it is reset afterwards.
+  if (!Write(kNewline))
     return false;
   at_col_zero_ = true;
 
@@ -369,12 +427,11 @@ bool JSONFileWriter::OutputComments() {
       return false;
 
     // Output the comment prefix.
-    if (!Printf("%s", kCommentPrefix))
+    if (!Write(kCommentPrefix))
       return false;
 
     // Output the comment if there's any content.
-    if (!comments_[i].empty() &&
-        !Printf(" %s", comments_[i].c_str()))
+    if (!comments_[i].empty() && (!PutChar(' ') || !Write(comments_[i])))
       return false;
 
     if (!OutputNewline())
@@ -473,7 +530,7 @@ bool JSONFileWriter::OpenStructure(StructureType type) {
 
   if (!ReadyForValue() ||
       !AlignForValueOrKey() ||
-      !Printf("%s", kStructureOpenings[type])) {
+      !Write(kStructureOpenings[type])) {
     return false;
   }
 
@@ -503,13 +560,15 @@ bool JSONFileWriter::CloseStructure(StructureType type) {
   if (pretty_print_ && !OutputIndent())
     return false;
 
-  if (!Printf("%s", kStructureClosings[type])) {
+  if (!Write(kStructureClosings[type])) {
     return false;
   }
 
   // If this closed the last open structure, then the JSON file is finished.
-  if (stack_.empty())
+  if (stack_.empty()) {
     finished_ = true;
+    return FlushBuffer();
+  }
 
   return true;
 }
@@ -14,11 +14,14 @@
 //
 // JSONFileWriter is a lightweight class for writing JSON formatted output
 // directly to file rather than via a base::Value intermediate and then
-// std::string intermediate representation.
+// std::string intermediate representation. The output is gathered in a buffer
+// which is written to file in large chunks, and whenever the JSON stream is
+// finished.
 #ifndef SYZYGY_CORE_JSON_FILE_WRITER_H_
 #define SYZYGY_CORE_JSON_FILE_WRITER_H_
 
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #include "base/strings/string_piece.h"
@@ -71,13 +74,17 @@ class JSONFileWriter {
   bool OutputKey(const base::StringPiece& key);
   bool OutputKey(const base::StringPiece16& key);
 
-  // Closes off the JSON stream, terminating any open data structures.
+  // Closes off the JSON stream, terminating any open data structures, and
+  // writes the buffered output to file.
   // Returns true on success, false on failure.
   bool Flush();
 
   // For outputting simple values.
   bool OutputBoolean(bool value);
   bool OutputInteger(int value);
+  // Outputs a string holding the hex representation of |value|, as
+  // "0x0000BEEF".
+  bool OutputHexUint32(uint32_t value);
   bool OutputDouble(double value);
   bool OutputString(const base::StringPiece& value);
   bool OutputString(const base::StringPiece16& value);
@@ -120,16 +127,24 @@ class JSONFileWriter {
   // implementation of the various Output* functions.
   bool PrintBoolean(bool value);
   bool PrintInteger(int value);
+  bool PrintHexUint32(uint32_t value);
   bool PrintDouble(double value);
   bool PrintString(const base::StringPiece& value);
   bool PrintNull(int value_unused);
   bool PrintValue(const base::Value* value);
 
-  // The following group of functions act as pass-through for fprintf and fputc,
-  // but update internal state. No newline characters should be written using
-  // this mechanism. All newlines should be written using OutputNewline.
+  // The following group of functions append to the output buffer, and update
+  // internal state. No newline characters should be written using this
+  // mechanism. All newlines should be written using OutputNewline.
   bool Printf(const char* format, ...);
   bool PutChar(char c);
+  bool Write(const base::StringPiece& data);
+
+  // Writes the output buffer to file if it is full, or if the stream is
+  // finished.
+  bool MaybeFlushBuffer();
+  // Writes the output buffer to file.
+  bool FlushBuffer();
 
   // Some state determination functions.
   bool FirstEntry() const;
@@ -147,8 +162,13 @@ class JSONFileWriter {
 
   static void CompileAsserts();
 
+  // The size at which the output buffer is written to file.
+  static const size_t kBufferSize;
+
   // The file that is being written to.
   FILE* file_;
+  // The output that has yet to be written to file.
+  std::string buffer_;
   // Indicates whether or not we are pretty printing.
   bool pretty_print_;
   // This is set when the stream writer is finished. That is, a single value
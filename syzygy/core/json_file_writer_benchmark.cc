@@ -0,0 +1,123 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A benchmark of the throughput of JSONFileWriter. Writes a list of records,
+// like those of the reorder and simulate outputs, until the output reaches a
+// given size, both compact and pretty-printed. Prints the throughput of each.
+//
+// Usage: core_json_file_writer_benchmark [<output size in MB>]
+// The output size defaults to 1024 MB.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_file.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace {
+
+// The default size of the output.
+const size_t kDefaultOutputMegabytes = 1024;
+
+// The number of records written between checks of the size of the output.
+const size_t kRecordsPerCheck = 4096;
+
+// Writes a record with a few fields of each kind.
+bool WriteRecord(size_t index,
+                 const std::string& name,
+                 core::JSONFileWriter* json) {
+  if (!json->OpenDict() ||
+      !json->OutputKey("address") ||
+      !json->OutputHexUint32(static_cast<uint32_t>(index * 16)) ||
+      !json->OutputKey("size") ||
+      !json->OutputInteger(static_cast<int>(index % 4096)) ||
+      !json->OutputKey("name") ||
+      !json->OutputString(name) ||
+      !json->OutputKey("pages") ||
+      !json->OpenList()) {
+    return false;
+  }
+  for (int i = 0; i < 8; ++i) {
+    if (!json->OutputInteger(static_cast<int>(index) - i))
+      return false;
+  }
+  return json->CloseList() && json->CloseDict();
+}
+
+// Writes records to |path| until it reaches |size| bytes, and prints the
+// throughput.
+bool Benchmark(const base::FilePath& path, int64_t size, bool pretty_print) {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    ::printf("Failed to open %ls.\n", path.value().c_str());
+    return false;
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  {
+    core::JSONFileWriter json(file.get(), pretty_print);
+    if (!json.OpenList())
+      return false;
+    size_t index = 0;
+    while (::_ftelli64(file.get()) < size) {
+      for (size_t i = 0; i < kRecordsPerCheck; ++i, ++index) {
+        std::string name = base::StringPrintf(
+            "function_%u", static_cast<unsigned int>(index));
+        if (!WriteRecord(index, name, &json)) {
+          ::printf("Failed to write a record.\n");
+          return false;
+        }
+      }
+    }
+    if (!json.Flush())
+      return false;
+  }
+  if (::fflush(file.get()) != 0)
+    return false;
+  double seconds = (base::TimeTicks::Now() - start).InSecondsF();
+
+  double megabytes = static_cast<double>(::_ftelli64(file.get())) /
+                     (1024 * 1024);
+  ::printf("%-8s %10.1f MB %8.2f s %10.1f MB/s\n",
+           pretty_print ? "pretty" : "compact", megabytes, seconds,
+           megabytes / seconds);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t megabytes = kDefaultOutputMegabytes;
+  if (argc > 1) {
+    megabytes = static_cast<size_t>(::atoi(argv[1]));
+    if (megabytes == 0) {
+      ::printf("Usage: %s [<output size in MB>]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  base::FilePath path;
+  if (!base::CreateTemporaryFile(&path)) {
+    ::printf("Failed to create a temporary file.\n");
+    return 1;
+  }
+
+  int64_t size = static_cast<int64_t>(megabytes) * 1024 * 1024;
+  bool success = Benchmark(path, size, false) && Benchmark(path, size, true);
+  base::DeleteFile(path, false);
+  return success ? 0 : 1;
+}
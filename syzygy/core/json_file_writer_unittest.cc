@@ -14,6 +14,8 @@
 
 #include "syzygy/core/json_file_writer.h"
 
+#include <limits.h>
+
 #include "base/logging.h"
 #include "base/files/file_util.h"
 #include "base/files/scoped_temp_dir.h"
@@ -346,6 +348,58 @@ TEST_F(JSONFileWriterTest, OutputInteger) {
   ASSERT_EQ("11", s);
 }
 
+TEST_F(JSONFileWriterTest, OutputNegativeIntegers) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputInteger(0));
+  EXPECT_TRUE(json_file.OutputInteger(-7));
+  EXPECT_TRUE(json_file.OutputInteger(INT_MAX));
+  EXPECT_TRUE(json_file.OutputInteger(INT_MIN));
+  EXPECT_TRUE(json_file.CloseList());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("[0,-7,2147483647,-2147483648]", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputHexUint32) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputHexUint32(0));
+  EXPECT_TRUE(json_file.OutputHexUint32(0xBEEF));
+  EXPECT_TRUE(json_file.OutputHexUint32(0xFEDCBA98));
+  EXPECT_TRUE(json_file.CloseList());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("[\"0x00000000\",\"0x0000BEEF\",\"0xFEDCBA98\"]", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputIsBuffered) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputInteger(42));
+
+  // Nothing reaches the file while the stream is short and unfinished.
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  EXPECT_TRUE(s.empty());
+
+  // A long stream is written out as it goes.
+  const std::string kValue(1000, 'x');
+  for (size_t i = 0; i < 1000; ++i)
+    EXPECT_TRUE(json_file.OutputString(kValue));
+  ASSERT_TRUE(FileContents(&s));
+  EXPECT_LT(100000u, s.size());
+
+  // And all of it once it is finished.
+  EXPECT_TRUE(json_file.CloseList());
+  ASSERT_TRUE(FileContents(&s));
+  EXPECT_EQ(4u + 1000 * (kValue.size() + 3), s.size());
+  EXPECT_EQ("[42,\"xx", s.substr(0, 7));
+  EXPECT_EQ("xx\"]", s.substr(s.size() - 4));
+}
+
 TEST_F(JSONFileWriterTest, OutputDouble) {
   TestJSONFileWriter json_file(file(), false);
   ASSERT_TRUE(json_file.FirstEntry());
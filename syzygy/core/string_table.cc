@@ -15,11 +15,31 @@
 
 #include "syzygy/core/string_table.h"
 
+#include <utility>
+
 namespace core {
 
+size_t StringPieceHash::operator()(
+    const base::StringPiece& str) const {
+  // FNV-1a, which is cheap and spreads symbol names that share long
+  // prefixes well.
+  size_t hash = 2166136261U;
+  for (size_t i = 0; i < str.size(); ++i) {
+    hash ^= static_cast<uint8_t>(str[i]);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
 const std::string& StringTable::InternString(const base::StringPiece& str) {
-  std::string value(str.data(), str.size());
-  return *(string_table_.insert(value).first);
+  StringIndex::const_iterator it = index_.find(str);
+  if (it != index_.end())
+    return *it->second;
+
+  string_table_.push_back(str.as_string());
+  const std::string& value = string_table_.back();
+  index_.insert(std::make_pair(base::StringPiece(value), &value));
+  return value;
 }
 
 }  // namespace core
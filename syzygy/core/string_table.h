@@ -14,7 +14,9 @@
 //
 // A StringTable is responsible of string allocation and string sharing.
 // Pointers to interned strings are valid until the destruction of the
-// StringTable.
+// StringTable. The strings are allocated in chunks rather than one tree
+// node at a time, and are looked up by hash, so that interning a string that
+// is already in the table doesn't allocate.
 //
 // Example use is as follows:
 //
@@ -28,13 +30,21 @@
 #define SYZYGY_CORE_STRING_TABLE_H_
 
 #include <stdint.h>
-#include <set>
+#include <deque>
 #include <string>
+#include <unordered_map>
 
+#include "base/macros.h"
 #include "base/strings/string_piece.h"
 
 namespace core {
 
+// A hash function for strings, for the containers that are keyed by
+// StringPiece.
+struct StringPieceHash {
+  size_t operator()(const base::StringPiece& str) const;
+};
+
 class StringTable {
  public:
   // Default constructor.
@@ -48,8 +58,19 @@ class StringTable {
   // @returns a canonical representation for this string.
   const std::string& InternString(const base::StringPiece& str);
 
+  // @returns the number of distinct strings in the pool.
+  size_t size() const { return string_table_.size(); }
+
  protected:
-  std::set<std::string> string_table_;
+  // The index of the pool, keyed by the contents of the strings it holds.
+  typedef std::unordered_map<base::StringPiece,
+                             const std::string*,
+                             StringPieceHash> StringIndex;
+
+  // The pool of strings. A deque never moves its elements as it grows, so
+  // the strings stay where they are for the lifetime of the table.
+  std::deque<std::string> string_table_;
+  StringIndex index_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(StringTable);
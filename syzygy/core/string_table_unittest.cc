@@ -52,6 +52,22 @@ TEST(StringTableTest, InternString) {
   EXPECT_TRUE(str1.c_str() == str3.c_str());
   EXPECT_TRUE(str1.c_str() == str4.c_str());
   EXPECT_FALSE(str1.c_str() == str5.c_str());
+  EXPECT_EQ(3U, strtab.size());
+}
+
+TEST(StringTableTest, InternedStringsDontMove) {
+  StringTable strtab;
+  const std::string& empty = strtab.InternString("");
+  const std::string& first = strtab.InternString("first");
+
+  // Grow the pool well past a chunk of its storage.
+  for (size_t i = 0; i < 10000; ++i)
+    strtab.InternString(std::string(i % 64 + 1, 'a' + i % 26));
+
+  EXPECT_EQ(&empty, &strtab.InternString(""));
+  EXPECT_EQ(&first, &strtab.InternString("first"));
+  EXPECT_EQ("first", first);
+  EXPECT_EQ(std::string(), empty);
 }
 
 }  // namespace core
@@ -17,6 +17,8 @@
 // We use standard dependencies only, as we don't want to introduce a
 // dependency on base into the backend crash processing code.
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -27,6 +29,73 @@ namespace {
 
 const size_t kIndentSize = 2;
 
+// The size of the chunks in which output is written to a stream.
+const size_t kStreamChunkSize = 64 * 1024;
+
+// The number of bytes of blob data that are encoded at once. This is a
+// multiple of 3 so that base64 chunks can be concatenated without padding.
+const size_t kBlobChunkSize = 3 * 256;
+
+const char kHexDigits[] = "0123456789ABCDEF";
+const char kBase64Digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Accumulates the JSON output as it is produced. The output is either
+// appended to a string, or buffered and written to a stream in chunks, in
+// which case the document as a whole is never held in memory.
+class JsonOutput {
+ public:
+  JsonOutput(BlobEncoding blob_encoding, std::string* output)
+      : blob_encoding_(blob_encoding), buffer_(output), stream_(nullptr) {
+    assert(output != nullptr);
+  }
+
+  JsonOutput(BlobEncoding blob_encoding, std::ostream* stream)
+      : blob_encoding_(blob_encoding), buffer_(&stream_buffer_),
+        stream_(stream) {
+    assert(stream != nullptr);
+    stream_buffer_.reserve(kStreamChunkSize);
+  }
+
+  BlobEncoding blob_encoding() const { return blob_encoding_; }
+
+  void push_back(char c) {
+    buffer_->push_back(c);
+    MaybeFlush();
+  }
+
+  void append(const char* s, size_t length) {
+    buffer_->append(s, length);
+    MaybeFlush();
+  }
+
+  void append(const char* s) { append(s, ::strlen(s)); }
+  void append(const std::string& s) { append(s.data(), s.size()); }
+
+  // Writes the buffered output to the stream, if any.
+  // @returns true on success, false if the stream is in a bad state.
+  bool Flush() {
+    if (stream_ == nullptr)
+      return true;
+    if (!stream_buffer_.empty()) {
+      stream_->write(stream_buffer_.data(), stream_buffer_.size());
+      stream_buffer_.clear();
+    }
+    return stream_->good();
+  }
+
+ private:
+  void MaybeFlush() {
+    if (stream_ != nullptr && stream_buffer_.size() >= kStreamChunkSize)
+      Flush();
+  }
+
+  BlobEncoding blob_encoding_;
+  std::string* buffer_;
+  std::string stream_buffer_;
+  std::ostream* stream_;
+};
+
 void IncreaseIndent(std::string* indent) {
   if (!indent)
     return;
@@ -39,56 +108,119 @@ void DecreaseIndent(std::string* indent) {
   indent->resize(indent->size() - kIndentSize);
 }
 
-void EmitIndent(std::string* indent, std::string* output) {
+void EmitIndent(std::string* indent, JsonOutput* output) {
   assert(output != nullptr);
   if (!indent)
     return;
   output->append(*indent);
 }
 
-void EmitHexValue8(unsigned char value, std::string* output) {
+// Emits a quoted, 0x prefixed hex value of at least |min_digits| digits. This
+// is formatted by hand as it is by far the most frequently emitted value.
+void EmitHexValue(google::protobuf::uint64 value,
+                  size_t min_digits,
+                  JsonOutput* output) {
+  assert(min_digits <= 2 * sizeof(value));
   assert(output != nullptr);
+  char buffer[4 + 2 * sizeof(value)];
+  char* end = buffer + sizeof(buffer);
+  char* begin = end;
+  *--begin = '"';
+  size_t digits = 0;
+  do {
+    *--begin = kHexDigits[value & 0xF];
+    value >>= 4;
+    ++digits;
+  } while (value != 0 || digits < min_digits);
+  *--begin = 'x';
+  *--begin = '0';
+  *--begin = '"';
+  output->append(begin, end - begin);
+}
+
+void EmitHexValue8(unsigned char value, JsonOutput* output) {
+  EmitHexValue(value, 2, output);
+}
+
+void EmitHexValue32(google::protobuf::uint64 value, JsonOutput* output) {
+  EmitHexValue(value, 8, output);
+}
+
+// Emits binary data as a quoted string of hex digits, 2 per byte.
+void EmitHexString(const std::string& data, JsonOutput* output) {
+  assert(output != nullptr);
+  char buffer[2 * kBlobChunkSize];
   output->push_back('"');
-  std::ostringstream oss;
-  oss << "0x" << std::hex << std::setfill('0') << std::setw(2)
-      << std::uppercase << static_cast<unsigned int>(value);
-  output->append(oss.str());
+  for (size_t i = 0; i < data.size(); i += kBlobChunkSize) {
+    size_t length = std::min(kBlobChunkSize, data.size() - i);
+    for (size_t j = 0; j < length; ++j) {
+      unsigned char byte = static_cast<unsigned char>(data[i + j]);
+      buffer[2 * j] = kHexDigits[byte >> 4];
+      buffer[2 * j + 1] = kHexDigits[byte & 0xF];
+    }
+    output->append(buffer, 2 * length);
+  }
   output->push_back('"');
 }
 
-void EmitHexValue32(google::protobuf::uint64 value, std::string* output) {
+// Emits binary data as a quoted base64 string.
+void EmitBase64String(const std::string& data, JsonOutput* output) {
   assert(output != nullptr);
+  char buffer[kBlobChunkSize / 3 * 4];
   output->push_back('"');
-  std::ostringstream oss;
-  oss << "0x" << std::hex << std::setfill('0') << std::setw(8)
-      << std::uppercase << value;
-  output->append(oss.str());
+  for (size_t i = 0; i < data.size(); i += kBlobChunkSize) {
+    size_t length = std::min(kBlobChunkSize, data.size() - i);
+    const unsigned char* bytes =
+        reinterpret_cast<const unsigned char*>(data.data() + i);
+    char* out = buffer;
+    size_t j = 0;
+    for (; j + 3 <= length; j += 3) {
+      unsigned int triple = (bytes[j] << 16) | (bytes[j + 1] << 8) |
+                            bytes[j + 2];
+      *out++ = kBase64Digits[(triple >> 18) & 0x3F];
+      *out++ = kBase64Digits[(triple >> 12) & 0x3F];
+      *out++ = kBase64Digits[(triple >> 6) & 0x3F];
+      *out++ = kBase64Digits[triple & 0x3F];
+    }
+
+    // Only the last chunk may have a partial triple, as the chunk size is a
+    // multiple of 3.
+    if (j < length) {
+      unsigned int triple = bytes[j] << 16;
+      if (j + 1 < length)
+        triple |= bytes[j + 1] << 8;
+      *out++ = kBase64Digits[(triple >> 18) & 0x3F];
+      *out++ = kBase64Digits[(triple >> 12) & 0x3F];
+      *out++ = j + 1 < length ? kBase64Digits[(triple >> 6) & 0x3F] : '=';
+      *out++ = '=';
+    }
+    output->append(buffer, out - buffer);
+  }
   output->push_back('"');
 }
 
 template <typename IntType>
-void EmitDecValue(IntType value, std::string* output) {
+void EmitDecValue(IntType value, JsonOutput* output) {
   assert(output != nullptr);
   std::ostringstream oss;
   oss << std::dec << std::setw(0) << value;
   output->append(oss.str());
 }
 
-void EmitDouble(double value, std::string* output) {
+void EmitDouble(double value, JsonOutput* output) {
   assert(output != nullptr);
   std::ostringstream oss;
   oss << std::scientific << std::setprecision(16) << std::uppercase << value;
   output->append(oss.str());
 }
 
-void EmitNull(std::string* output) {
+void EmitNull(JsonOutput* output) {
   assert(output != nullptr);
   output->append("null");
 }
 
-void EmitString(const std::string& s, std::string* output) {
+void EmitString(const std::string& s, JsonOutput* output) {
   assert(output != nullptr);
-  output->reserve(output->size() + 2 + s.size());
   output->push_back('"');
   for (size_t i = 0; i < s.size(); ++i) {
     if (s[i] == '"') {
@@ -111,7 +243,7 @@ bool EmitJsonList(char open_bracket,
                   size_t item_count,
                   YieldFunctor& yield,
                   std::string* indent,
-                  std::string* output) {
+                  JsonOutput* output) {
   assert(items_per_line > 0);
   assert(output != nullptr);
 
@@ -155,7 +287,7 @@ bool EmitJsonList(char open_bracket,
 // for the value.
 void EmitDictKey(const std::string& key,
                  std::string* indent,
-                 std::string* output) {
+                 JsonOutput* output) {
   assert(output != nullptr);
   EmitString(key, output);
   output->push_back(':');
@@ -165,9 +297,9 @@ void EmitDictKey(const std::string& key,
 
 // Forward declaration of this, as it's the common container type for other
 // values.
-bool ToJson(const Value* value, std::string* indent, std::string* output);
+bool ToJson(const Value* value, std::string* indent, JsonOutput* output);
 
-bool ToJson(const Address* address, std::string* indent, std::string* output) {
+bool ToJson(const Address* address, std::string* indent, JsonOutput* output) {
   assert(address != nullptr);
   assert(output != nullptr);
   EmitHexValue32(address->address(), output);
@@ -180,7 +312,7 @@ struct StackTraceYieldFunctor {
     assert(stack_trace != nullptr);
   }
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  bool operator()(size_t index, std::string* indent, JsonOutput* output) {
     assert(output != nullptr);
     assert(index <= std::numeric_limits<int>::max());
     EmitHexValue32(stack_trace_->frames().Get(static_cast<int>(index)), output);
@@ -192,7 +324,7 @@ struct StackTraceYieldFunctor {
 
 bool ToJson(const StackTrace* stack_trace,
             std::string* indent,
-            std::string* output) {
+            JsonOutput* output) {
   assert(stack_trace != nullptr);
   assert(output != nullptr);
   StackTraceYieldFunctor yield(stack_trace);
@@ -210,7 +342,7 @@ struct BlobDataYieldFunctor {
     assert(blob != nullptr);
   }
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  bool operator()(size_t index, std::string* indent, JsonOutput* output) {
     EmitHexValue8(static_cast<unsigned char>(blob_->data()[index]), output);
     return true;
   }
@@ -218,23 +350,41 @@ struct BlobDataYieldFunctor {
   const Blob* blob_;
 };
 
-// A functor for emitting the contents of a blob as a dictionary.
+// A functor for emitting the contents of a blob as a dictionary. The
+// "encoding" field is only emitted if the data is encoded as a string.
 struct BlobYieldFunctor {
-  explicit BlobYieldFunctor(const Blob* blob)
-      : blob_(blob), need_comma_(false) {
+  enum Field {
+    TYPE_FIELD,
+    ADDRESS_FIELD,
+    SIZE_FIELD,
+    ENCODING_FIELD,
+    DATA_FIELD,
+    FIELD_COUNT,
+  };
+
+  BlobYieldFunctor(const Blob* blob, BlobEncoding blob_encoding)
+      : blob_(blob), blob_encoding_(blob_encoding) {
     assert(blob != nullptr);
   }
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  // @returns the number of fields that are emitted.
+  size_t field_count() const {
+    return blob_encoding_ == BLOB_ENCODING_BYTE_LIST ? FIELD_COUNT - 1
+                                                     : FIELD_COUNT;
+  }
+
+  bool operator()(size_t index, std::string* indent, JsonOutput* output) {
     assert(output != nullptr);
+    if (blob_encoding_ == BLOB_ENCODING_BYTE_LIST && index >= ENCODING_FIELD)
+      ++index;
     switch (index) {
-      case 0: {
+      case TYPE_FIELD: {
         // Emit a blob descriptor.
         EmitDictKey("type", indent, output);
         EmitString("blob", output);
         return true;
       }
-      case 1: {
+      case ADDRESS_FIELD: {
         EmitDictKey("address", indent, output);
         if (blob_->has_address()) {
           if (!ToJson(&blob_->address(), indent, output))
@@ -244,7 +394,7 @@ struct BlobYieldFunctor {
         }
         return true;
       }
-      case 2: {
+      case SIZE_FIELD: {
         EmitDictKey("size", indent, output);
         if (blob_->has_size()) {
           EmitDecValue(blob_->size(), output);
@@ -253,18 +403,34 @@ struct BlobYieldFunctor {
         }
         return true;
       }
-      case 3: {
+      case ENCODING_FIELD: {
+        EmitDictKey("encoding", indent, output);
+        EmitString(blob_encoding_ == BLOB_ENCODING_HEX ? "hex" : "base64",
+                   output);
+        return true;
+      }
+      case DATA_FIELD: {
         EmitDictKey("data", indent, output);
-        if (blob_->has_data()) {
-          BlobDataYieldFunctor yield(blob_);
-          if (!EmitJsonList('[', ']', 8, blob_->data().size(), yield,
-                            indent, output)) {
-            return false;
-          }
-        } else {
+        if (!blob_->has_data()) {
           EmitNull(output);
+          return true;
         }
-        return true;
+        switch (blob_encoding_) {
+          case BLOB_ENCODING_BYTE_LIST: {
+            BlobDataYieldFunctor yield(blob_);
+            return EmitJsonList('[', ']', 8, blob_->data().size(), yield,
+                                indent, output);
+          }
+          case BLOB_ENCODING_HEX: {
+            EmitHexString(blob_->data(), output);
+            return true;
+          }
+          case BLOB_ENCODING_BASE64: {
+            EmitBase64String(blob_->data(), output);
+            return true;
+          }
+        }
+        break;
       }
       default: break;
     }
@@ -275,20 +441,20 @@ struct BlobYieldFunctor {
   }
 
   const Blob* blob_;
-  bool need_comma_;
+  BlobEncoding blob_encoding_;
 };
 
-bool ToJson(const Blob* blob, std::string* indent, std::string* output) {
+bool ToJson(const Blob* blob, std::string* indent, JsonOutput* output) {
   assert(blob != nullptr);
   assert(output != nullptr);
-  BlobYieldFunctor yield(blob);
-  // 1 element per line, 4 elements total.
-  if (!EmitJsonList('{', '}', 1, 4, yield, indent, output))
+  BlobYieldFunctor yield(blob, output->blob_encoding());
+  // 1 element per line.
+  if (!EmitJsonList('{', '}', 1, yield.field_count(), yield, indent, output))
     return false;
   return true;
 }
 
-bool ToJson(const Leaf* leaf, std::string* indent, std::string* output) {
+bool ToJson(const Leaf* leaf, std::string* indent, JsonOutput* output) {
   assert(leaf != nullptr);
   assert(output != nullptr);
 
@@ -361,7 +527,7 @@ bool ToJson(const Leaf* leaf, std::string* indent, std::string* output) {
 struct ValueListYieldFunctor {
   explicit ValueListYieldFunctor(const ValueList* list) : list_(list) {}
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  bool operator()(size_t index, std::string* indent, JsonOutput* output) {
     assert(output != nullptr);
     assert(index <= std::numeric_limits<int>::max());
     if (!ToJson(&list_->values().Get(static_cast<int>(index)), indent, output))
@@ -372,7 +538,7 @@ struct ValueListYieldFunctor {
   const ValueList* list_;
 };
 
-bool ToJson(const ValueList* list, std::string* indent, std::string* output) {
+bool ToJson(const ValueList* list, std::string* indent, JsonOutput* output) {
   assert(list != nullptr);
   assert(output != nullptr);
   ValueListYieldFunctor yield(list);
@@ -382,7 +548,7 @@ bool ToJson(const ValueList* list, std::string* indent, std::string* output) {
 }
 
 bool ToJson(
-    const KeyValue* key_value, std::string* indent, std::string* output) {
+    const KeyValue* key_value, std::string* indent, JsonOutput* output) {
   assert(key_value != nullptr);
   assert(output != nullptr);
   if (!key_value->has_key())
@@ -401,7 +567,7 @@ struct DictYieldFunctor {
 
   bool operator()(size_t index,
                   std::string* indent,
-                  std::string* output) {
+                  JsonOutput* output) {
     assert(output != nullptr);
     assert(index <= std::numeric_limits<int>::max());
     if (!ToJson(&dict_->values().Get(static_cast<int>(index)), indent, output))
@@ -412,7 +578,7 @@ struct DictYieldFunctor {
   const Dictionary* dict_;
 };
 
-bool ToJson(const Dictionary* dict, std::string* indent, std::string* output) {
+bool ToJson(const Dictionary* dict, std::string* indent, JsonOutput* output) {
   assert(dict != nullptr);
   assert(output != nullptr);
   DictYieldFunctor yield(dict);
@@ -421,7 +587,7 @@ bool ToJson(const Dictionary* dict, std::string* indent, std::string* output) {
   return true;
 }
 
-bool ToJson(const Value* value, std::string* indent, std::string* output) {
+bool ToJson(const Value* value, std::string* indent, JsonOutput* output) {
   assert(value != nullptr);
   assert(output != nullptr);
   if (!value->has_type())
@@ -461,9 +627,7 @@ bool ToJson(const Value* value, std::string* indent, std::string* output) {
   return false;
 }
 
-}  // namespace
-
-bool ToJson(bool pretty_print, const Value* value, std::string* output) {
+bool ToJson(bool pretty_print, const Value* value, JsonOutput* output) {
   assert(value != nullptr);
   assert(output != nullptr);
   std::string* indent = nullptr;
@@ -472,11 +636,29 @@ bool ToJson(bool pretty_print, const Value* value, std::string* output) {
     indent_content = "\n";
     indent = &indent_content;
   }
+  if (!ToJson(value, indent, output))
+    return false;
+  return output->Flush();
+}
+
+}  // namespace
+
+bool ToJson(bool pretty_print, const Value* value, std::string* output) {
+  return ToJson(pretty_print, BLOB_ENCODING_BYTE_LIST, value, output);
+}
+
+bool ToJson(bool pretty_print,
+            BlobEncoding blob_encoding,
+            const Value* value,
+            std::string* output) {
+  assert(value != nullptr);
+  assert(output != nullptr);
 
   // Produce the output to a temp variable, as partial output may be produced
   // in case of error.
   std::string temp;
-  if (!ToJson(value, indent, &temp))
+  JsonOutput temp_output(blob_encoding, &temp);
+  if (!ToJson(pretty_print, value, &temp_output))
     return false;
 
   // Place the output in the desired string as efficiently as possible.
@@ -489,4 +671,14 @@ bool ToJson(bool pretty_print, const Value* value, std::string* output) {
   return true;
 }
 
+bool ToJson(bool pretty_print,
+            BlobEncoding blob_encoding,
+            const Value* value,
+            std::ostream* output) {
+  assert(value != nullptr);
+  assert(output != nullptr);
+  JsonOutput stream_output(blob_encoding, output);
+  return ToJson(pretty_print, value, &stream_output);
+}
+
 }  // namespace crashdata
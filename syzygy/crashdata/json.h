@@ -18,18 +18,59 @@
 #ifndef SYZYGY_CRASHDATA_JSON_H_
 #define SYZYGY_CRASHDATA_JSON_H_
 
+#include <iosfwd>
+#include <string>
+
 #include "syzygy/crashdata/crashdata.h"
 
 namespace crashdata {
 
+// The encodings of the data of blobs.
+enum BlobEncoding {
+  // A list of hex formatted bytes, "0xAB". This is the most readable but also
+  // by far the most verbose encoding.
+  BLOB_ENCODING_BYTE_LIST,
+  // A string of hex digits, 2 per byte.
+  BLOB_ENCODING_HEX,
+  // A base64 string.
+  BLOB_ENCODING_BASE64,
+};
+
 // Converts the provided crashdata protobuf to an equivalent JSON
-// representation.
+// representation. Blob data is emitted as a list of bytes.
 // @param pretty_print If true the resulting JSON will be pretty-printed.
 // @param value A value object containing crash metadata.
 // @param output The destination buffer.
 // @returns true on success, false otherwise.
 bool ToJson(bool pretty_print, const Value* value, std::string* output);
 
+// Converts the provided crashdata protobuf to an equivalent JSON
+// representation.
+// @param pretty_print If true the resulting JSON will be pretty-printed.
+// @param blob_encoding The encoding of blob data. Blobs whose data is encoded
+//     as a string carry an additional "encoding" field.
+// @param value A value object containing crash metadata.
+// @param output The destination buffer. Left unchanged on failure.
+// @returns true on success, false otherwise.
+bool ToJson(bool pretty_print,
+            BlobEncoding blob_encoding,
+            const Value* value,
+            std::string* output);
+
+// Converts the provided crashdata protobuf to JSON, writing it to a stream as
+// the protobuf is walked. The output is written in fixed-size chunks, and the
+// JSON representation is never held in memory as a whole.
+// @param pretty_print If true the resulting JSON will be pretty-printed.
+// @param blob_encoding The encoding of blob data.
+// @param value A value object containing crash metadata.
+// @param output The destination stream.
+// @returns true on success, false otherwise. Partial output may have been
+//     written to the stream on failure.
+bool ToJson(bool pretty_print,
+            BlobEncoding blob_encoding,
+            const Value* value,
+            std::ostream* output);
+
 }  // namespace crashdata
 
 #endif  // SYZYGY_CRASHDATA_JSON_H_
@@ -14,18 +14,36 @@
 
 #include "syzygy/crashdata/json.h"
 
+#include <sstream>
+
 #include "gtest/gtest.h"
 
 namespace crashdata {
 
 namespace {
 
+void TestConversion(bool pretty_print,
+                    BlobEncoding blob_encoding,
+                    const Value& value,
+                    const char* expected_json) {
+  std::string json;
+  EXPECT_TRUE(ToJson(pretty_print, blob_encoding, &value, &json));
+  EXPECT_EQ(json, expected_json);
+
+  // The streamed output is identical.
+  std::ostringstream stream;
+  EXPECT_TRUE(ToJson(pretty_print, blob_encoding, &value, &stream));
+  EXPECT_EQ(stream.str(), expected_json);
+}
+
 void TestConversion(bool pretty_print,
                     const Value& value,
                     const char* expected_json) {
   std::string json;
   EXPECT_TRUE(ToJson(pretty_print, &value, &json));
   EXPECT_EQ(json, expected_json);
+
+  TestConversion(pretty_print, BLOB_ENCODING_BYTE_LIST, value, expected_json);
 }
 
 }  // namespace
@@ -178,6 +196,91 @@ TEST(CrashDataJsonTest, ValueLeafBlob) {
   TestConversion(false, value, kExpectedCompact);
 }
 
+TEST(CrashDataJsonTest, ValueLeafBlobHex) {
+  Value value;
+  Blob* blob = LeafGetBlob(ValueGetLeaf(&value));
+  blob->set_size(4);
+  blob->mutable_data()->append("\xDE\xAD\xBE\xEF");
+
+  const char kExpectedPretty[] =
+      "{\n"
+      "  \"type\": \"blob\",\n"
+      "  \"address\": null,\n"
+      "  \"size\": 4,\n"
+      "  \"encoding\": \"hex\",\n"
+      "  \"data\": \"DEADBEEF\"\n"
+      "}";
+  TestConversion(true, BLOB_ENCODING_HEX, value, kExpectedPretty);
+
+  const char kExpectedCompact[] =
+      "{\"type\":\"blob\",\"address\":null,\"size\":4,"
+      "\"encoding\":\"hex\",\"data\":\"DEADBEEF\"}";
+  TestConversion(false, BLOB_ENCODING_HEX, value, kExpectedCompact);
+}
+
+TEST(CrashDataJsonTest, ValueLeafBlobBase64) {
+  static const struct {
+    const char* data;
+    const char* base64;
+  } kTestCases[] = {
+    { "", "" },
+    { "f", "Zg==" },
+    { "fo", "Zm8=" },
+    { "foo", "Zm9v" },
+    { "foob", "Zm9vYg==" },
+    { "fooba", "Zm9vYmE=" },
+    { "foobar", "Zm9vYmFy" },
+  };
+
+  for (const auto& test_case : kTestCases) {
+    Value value;
+    Blob* blob = LeafGetBlob(ValueGetLeaf(&value));
+    blob->mutable_data()->append(test_case.data);
+
+    std::string expected =
+        "{\"type\":\"blob\",\"address\":null,\"size\":null,"
+        "\"encoding\":\"base64\",\"data\":\"";
+    expected += test_case.base64;
+    expected += "\"}";
+    TestConversion(false, BLOB_ENCODING_BASE64, value, expected.c_str());
+  }
+}
+
+TEST(CrashDataJsonTest, LargeBlobIsChunked) {
+  // The data spans several encoding chunks and the output several stream
+  // chunks.
+  Value value;
+  Blob* blob = LeafGetBlob(ValueGetLeaf(&value));
+  std::string* data = blob->mutable_data();
+  for (size_t i = 0; i < 100000; ++i)
+    data->push_back(static_cast<char>(i % 251));
+
+  std::string hex;
+  EXPECT_TRUE(ToJson(false, BLOB_ENCODING_HEX, &value, &hex));
+  std::ostringstream stream;
+  EXPECT_TRUE(ToJson(false, BLOB_ENCODING_HEX, &value, &stream));
+  EXPECT_EQ(hex, stream.str());
+
+  const char kHexDigits[] = "0123456789ABCDEF";
+  std::string expected_hex;
+  for (char c : *data) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    expected_hex.push_back(kHexDigits[byte >> 4]);
+    expected_hex.push_back(kHexDigits[byte & 0xF]);
+  }
+  EXPECT_NE(std::string::npos, hex.find("\"" + expected_hex + "\""));
+
+  // Base64 output is 4 characters per 3 bytes, and 100000 bytes leave a
+  // single byte in the last triple.
+  std::string base64;
+  EXPECT_TRUE(ToJson(false, BLOB_ENCODING_BASE64, &value, &base64));
+  size_t begin = base64.find("\"data\":\"") + 8;
+  size_t end = base64.find('"', begin);
+  ASSERT_NE(std::string::npos, end);
+  EXPECT_EQ((data->size() + 2) / 3 * 4, end - begin);
+  EXPECT_EQ("==", base64.substr(end - 2, 2));
+}
+
 TEST(CrashDataJsonTest, ValueList) {
   Value value;
   ValueList* list = ValueGetValueList(&value);
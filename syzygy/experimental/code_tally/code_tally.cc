@@ -19,23 +19,37 @@
 
 #include "syzygy/experimental/code_tally/code_tally.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <utility>
 
 #include "base/bind.h"
 #include "base/logging.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
-#include "base/win/pe_image.h"
-#include "base/win/scoped_bstr.h"
-#include "base/win/scoped_com_initializer.h"
-#include "syzygy/common/com_utils.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/common/binary_stream.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/core/json_file_writer.h"
-#include "syzygy/pe/dia_util.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_stream_reader.h"
+#include "syzygy/pdb/pdb_symbol_record.h"
+#include "syzygy/pe/cvinfo_ext.h"
 #include "syzygy/pe/find.h"
 
 namespace {
 
+namespace cci = Microsoft_Cci_Pdb;
+
+// The line numbers the compiler gives to code that doesn't belong to any
+// source line.
+const size_t kHiddenLine = 0xFEEFEE;
+const size_t kAlwaysStepIntoLine = 0xF00F00;
+
 // Output the details of the executable.
 bool WriteExecutableDict(const pe::PEFile::Signature& image_signature,
                          FileVersionInfo* image_version_info,
@@ -74,8 +88,9 @@ bool WriteExecutableDict(const pe::PEFile::Signature& image_signature,
   return true;
 }
 
-bool GetImageSignature(const base::FilePath& image_name,
-                       pe::PEFile::Signature* image_signature) {
+bool ReadImage(const base::FilePath& image_name,
+               pe::PEFile::Signature* image_signature,
+               std::vector<size_t>* section_rvas) {
   pe::PEFile image_file;
   if (!image_file.Init(image_name)) {
     LOG(ERROR) << "Unable to read image file '" << image_name.value() << "'.";
@@ -84,13 +99,85 @@ bool GetImageSignature(const base::FilePath& image_name,
   }
   image_file.GetSignature(image_signature);
 
+  section_rvas->clear();
+  size_t num_sections = image_file.nt_headers()->FileHeader.NumberOfSections;
+  for (size_t i = 0; i < num_sections; ++i)
+    section_rvas->push_back(image_file.section_header(i)->VirtualAddress);
+
+  return true;
+}
+
+// Reads a DEBUG_S_FILECHKSMS chunk of the lines of a compiland.
+// @param names The name table of the PDB file.
+// @param start The offset of the chunk in @p stream.
+// @param length The length of the chunk.
+// @param stream The module stream of the compiland.
+// @param file_names Receives the file name of each checksum, by its offset
+//     in the chunk.
+// @returns true on success, false otherwise.
+bool ReadFileChecksums(const pdb::OffsetStringMap& names,
+                       size_t start,
+                       size_t length,
+                       pdb::PdbStream* stream,
+                       std::map<size_t, const std::string*>* file_names) {
+  DCHECK(stream != NULL);
+  DCHECK(file_names != NULL);
+
+  pdb::PdbStreamReaderWithPosition reader(start, length, stream);
+  common::BinaryStreamParser parser(&reader);
+  while (!reader.AtEnd()) {
+    size_t pos = reader.Position();
+    cci::CV_FileCheckSum checksum = {};
+    if (!parser.Read(&checksum)) {
+      LOG(ERROR) << "Unable to read file checksum.";
+      return false;
+    }
+
+    pdb::OffsetStringMap::const_iterator it(names.find(checksum.name));
+    if (it == names.end()) {
+      LOG(ERROR) << "File checksum refers to a file missing from the name "
+                 << "table.";
+      return false;
+    }
+    (*file_names)[pos] = &it->second;
+
+    // Skip the checksum and align.
+    if (!reader.Consume(checksum.len) || !parser.AlignTo(4)) {
+      LOG(ERROR) << "Unable to seek past file checksum.";
+      return false;
+    }
+  }
+
   return true;
 }
 
 }  // namespace
 
+// Reads a compiland on a worker thread.
+class CodeTally::CompilandWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  CompilandWorker(const CodeTally* tally, CompilandInfo* compiland)
+      : tally_(tally), compiland_(compiland) {
+    DCHECK(tally != NULL);
+    DCHECK(compiland != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    compiland_->succeeded = tally_->ReadCompiland(compiland_);
+  }
+  // @}
+
+ private:
+  const CodeTally* tally_;
+  CompilandInfo* compiland_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompilandWorker);
+};
+
 CodeTally::CodeTally(const base::FilePath& image_file)
-    : image_file_(image_file) {
+    : image_file_(image_file), num_threads_(1) {
 }
 
 bool CodeTally::TallyLines(const base::FilePath& pdb_file) {
@@ -119,33 +206,45 @@ bool CodeTally::TallyLines(const base::FilePath& pdb_file) {
     return false;
   }
 
-  if (!GetImageSignature(image_file_, &image_signature_))
+  if (!ReadImage(image_file_, &image_signature_, &section_rvas_))
     return false;
 
-  base::win::ScopedComPtr<IDiaDataSource> data_source;
-  if (!pe::CreateDiaSource(data_source.Receive()))
+  CompilandInfoVector compilands;
+  if (!ReadCompilands(found_pdb, &compilands))
     return false;
 
-  HRESULT hr = data_source->loadDataFromPdb(found_pdb.value().c_str());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Unable to load PDB: " << common::LogHr(hr);
-    return false;
+  // On the first pass, we simply crawl the source lines of all compilands
+  // and update the share counts for each referenced byte.
+  for (const auto& compiland : compilands) {
+    for (const auto& line : compiland->lines)
+      UseRange(line.rva, line.length);
   }
 
-  hr = data_source->openSession(session_.Receive());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Unable to open session: " << common::LogHr(hr);
-    return false;
-  }
+  // On the second pass we know the share count for each byte in the
+  // executable, so we can calculate accurate code contributions by line.
+  std::map<const std::string*, SourceFileInfo*> source_files;
+  for (const auto& compiland : compilands) {
+    ObjectFileInfo* object_file =
+        FindOrCreateObjectFileInfo(compiland->name.c_str());
 
-  pe::CompilandVisitor visitor(session_.get());
-  if (!visitor.VisitAllCompilands(base::Bind(&CodeTally::OnCompilandPassOne,
-                                        base::Unretained(this)))) {
-    return false;
-  }
-  if (!visitor.VisitAllCompilands(base::Bind(&CodeTally::OnCompilandPassTwo,
-                                              base::Unretained(this)))) {
-    return false;
+    for (const auto& function : compiland->functions) {
+      if (!OnFunction(object_file, function.name, function.rva,
+                      function.length)) {
+        return false;
+      }
+    }
+
+    for (const auto& line : compiland->lines) {
+      SourceFileInfo*& source_file = source_files[line.source_file];
+      if (source_file == NULL) {
+        source_file = FindOrCreateSourceFileInfo(
+            base::UTF8ToWide(*line.source_file).c_str());
+      }
+      if (!OnLinePassTwo(object_file, source_file, line.rva, line.length,
+                         line.line)) {
+        return false;
+      }
+    }
   }
 
   return true;
@@ -340,102 +439,291 @@ double CodeTally::CalculateByteContribution(size_t start, size_t len) {
   return sum;
 }
 
-bool CodeTally::OnCompilandPassOne(IDiaSymbol* compiland) {
-  DCHECK(pe::IsSymTag(compiland, SymTagCompiland));
+bool CodeTally::ReadCompilands(const base::FilePath& pdb_file,
+                               CompilandInfoVector* compilands) {
+  DCHECK(compilands != NULL);
+
+  // The PDB file is mapped, so that the module streams can be read
+  // concurrently, each from its own pages of the mapping.
+  pdb::PdbReader reader;
+  pdb::PdbFile pdb;
+  if (!reader.ReadMapped(pdb_file, &pdb)) {
+    LOG(ERROR) << "Unable to read PDB file '" << pdb_file.value() << "'.";
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> names_stream;
+  if (!pdb::LoadNamedStreamFromPdbFile("/names", &pdb, &names_stream) ||
+      names_stream.get() == NULL ||
+      !pdb::ReadStringTable(names_stream.get(), "Name table", 0,
+                            names_stream->length(), &names_)) {
+    LOG(ERROR) << "Unable to read the name table.";
+    return false;
+  }
 
-  base::win::ScopedBstr compiland_name;
+  pdb::DbiStream dbi_stream;
+  scoped_refptr<pdb::PdbStream> stream = pdb.GetStream(pdb::kDbiStream);
+  if (stream.get() == NULL || !dbi_stream.Read(stream.get())) {
+    LOG(ERROR) << "Unable to read the DBI stream.";
+    return false;
+  }
 
-  // On the first pass, we simply crawl the source lines in this compiland
-  // and update the share counts for each referenced byte.
-  pe::LineVisitor visitor(session_.get(), compiland);
-  return visitor.VisitLines(
-      base::Bind(&CodeTally::OnLinePassOne, base::Unretained(this)));
+  std::vector<std::unique_ptr<CompilandWorker>> workers;
+  for (const auto& module : dbi_stream.modules()) {
+    const pdb::DbiModuleInfoBase& module_info = module.module_info_base();
+    if (module_info.stream == -1)
+      continue;
+
+    std::unique_ptr<CompilandInfo> compiland(new CompilandInfo());
+    compiland->name = base::UTF8ToWide(module.module_name());
+    compiland->stream = pdb.GetStream(module_info.stream);
+    compiland->symbol_bytes = module_info.symbol_bytes;
+    compiland->lines_bytes = module_info.lines_bytes;
+    if (compiland->stream.get() == NULL ||
+        compiland->stream->length() <
+            compiland->symbol_bytes + compiland->lines_bytes) {
+      LOG(ERROR) << "Invalid module stream for compiland '"
+                 << module.module_name() << "'.";
+      return false;
+    }
+
+    workers.push_back(std::unique_ptr<CompilandWorker>(
+        new CompilandWorker(this, compiland.get())));
+    compilands->push_back(std::move(compiland));
+  }
+
+  size_t num_threads = std::min(num_threads_, workers.size());
+  if (num_threads <= 1) {
+    for (const auto& worker : workers)
+      worker->Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("CodeTally",
+                                        static_cast<int>(num_threads));
+    for (const auto& worker : workers)
+      pool.AddWork(worker.get());
+    pool.Start();
+    pool.JoinAll();
+  }
+
+  // The streams share the reference counted mapping of the PDB file, so they
+  // are released here rather than on the worker threads.
+  bool succeeded = true;
+  for (const auto& compiland : *compilands) {
+    compiland->stream = NULL;
+    if (!compiland->succeeded)
+      succeeded = false;
+  }
+
+  return succeeded;
 }
 
-bool CodeTally::OnCompilandPassTwo(IDiaSymbol* compiland) {
+bool CodeTally::ReadCompiland(CompilandInfo* compiland) const {
   DCHECK(compiland != NULL);
+  DCHECK(compiland->stream.get() != NULL);
 
-  base::win::ScopedBstr compiland_name;
-  ObjectFileInfo* object_file =
-      FindOrCreateObjectFileInfo(common::ToString(compiland_name));
-
-  pe::ChildVisitor function_visitor(compiland, SymTagFunction);
-  if (!function_visitor.VisitChildren(
-          base::Bind(&CodeTally::OnFunction,
-                     base::Unretained(this),
-                     object_file))) {
+  if (!pdb::VisitSymbols(base::Bind(&CodeTally::OnSymbol,
+                                    base::Unretained(this),
+                                    compiland),
+                         0, compiland->symbol_bytes, true,
+                         compiland->stream.get())) {
+    LOG(ERROR) << "Unable to read the symbols of compiland '"
+               << compiland->name << "'.";
     return false;
   }
 
-  // On the second pass we know the share count for each byte in the executable,
-  // so we can calculate accurate code contributions by line.
-  pe::LineVisitor line_visitor(session_.get(), compiland);
+  if (compiland->lines_bytes == 0)
+    return true;
+
+  // The line information is arranged as a back-to-back run of {type, len}
+  // prefixed chunks. The line chunks refer to the file checksum chunk by
+  // offset, so the chunks are located before being read.
+  pdb::PdbStreamReaderWithPosition reader(
+      compiland->symbol_bytes, compiland->lines_bytes,
+      compiland->stream.get());
+  common::BinaryStreamParser parser(&reader);
+  FileNameMap file_names;
+  std::vector<std::pair<size_t, size_t>> line_chunks;
+  while (!reader.AtEnd()) {
+    uint32_t line_info_type = 0;
+    uint32_t length = 0;
+    if (!parser.Read(&line_info_type) || !parser.Read(&length)) {
+      LOG(ERROR) << "Unable to read line info signature.";
+      return false;
+    }
+
+    size_t start = compiland->symbol_bytes + reader.Position();
+    if (!reader.Consume(length)) {
+      LOG(ERROR) << "Unable to seek past line info chunk.";
+      return false;
+    }
+
+    if (line_info_type == cci::DEBUG_S_FILECHKSMS) {
+      if (!ReadFileChecksums(names_, start, length, compiland->stream.get(),
+                             &file_names)) {
+        return false;
+      }
+    } else if (line_info_type == cci::DEBUG_S_LINES) {
+      line_chunks.push_back(std::make_pair(start, length));
+    }
+  }
+
+  for (const auto& line_chunk : line_chunks) {
+    if (!ReadLineChunk(file_names, line_chunk.first, line_chunk.second,
+                       compiland)) {
+      return false;
+    }
+  }
 
-  return line_visitor.VisitLines(
-      base::Bind(&CodeTally::OnLinePassTwo,
-                 base::Unretained(this),
-                 object_file));
+  return true;
 }
 
-bool CodeTally::OnLinePassOne(IDiaLineNumber* line_number) {
-  DCHECK(line_number != NULL);
+bool CodeTally::OnSymbol(CompilandInfo* compiland,
+                         uint16_t symbol_length,
+                         uint16_t symbol_type,
+                         common::BinaryStreamReader* symbol_reader) const {
+  DCHECK(compiland != NULL);
+  DCHECK(symbol_reader != NULL);
+
+  switch (symbol_type) {
+    case cci::S_GPROC32:
+    case cci::S_LPROC32:
+    case cci::S_GPROC32_VS2013:
+    case cci::S_LPROC32_VS2013:
+      break;
+    default:
+      return true;
+  }
 
-  DWORD rva = 0;
-  HRESULT hr = line_number->get_relativeVirtualAddress(&rva);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get line number RVA: " << common::LogHr(hr);
+  // Note the zero-terminated name field is the trailing field of the
+  // symbol.
+  common::BinaryStreamParser parser(symbol_reader);
+  cci::ProcSym32 proc = {};
+  std::string name;
+  if (!parser.ReadBytes(offsetof(cci::ProcSym32, name), &proc) ||
+      !parser.ReadString(&name)) {
+    LOG(ERROR) << "Unable to read function symbol.";
     return false;
   }
-  DWORD length = 0;
-  hr = line_number->get_length(&length);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get line number length: " << common::LogHr(hr);
+
+  CompilandInfo::Function function = { base::UTF8ToWide(name), 0, proc.len };
+  if (!GetRva(proc.seg, proc.off, &function.rva)) {
+    LOG(ERROR) << "Function '" << name << "' is outside of the image.";
     return false;
   }
-
-  // Account for the code usage.
-  UseRange(rva, length);
+  compiland->functions.push_back(function);
 
   return true;
 }
 
-bool CodeTally::OnFunction(ObjectFileInfo* object_file, IDiaSymbol* function) {
-  DCHECK(object_file != NULL);
-  DCHECK(function != NULL);
+bool CodeTally::ReadLineChunk(const FileNameMap& file_names,
+                              size_t start,
+                              size_t length,
+                              CompilandInfo* compiland) const {
+  DCHECK(compiland != NULL);
 
-  DWORD rva = 0;
-  HRESULT hr = function->get_relativeVirtualAddress(&rva);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get function RVA: " << common::LogHr(hr);
+  pdb::PdbStreamReaderWithPosition reader(start, length,
+                                          compiland->stream.get());
+  common::BinaryStreamParser parser(&reader);
+  cci::CV_LineSection line_section = {};
+  if (!parser.Read(&line_section)) {
+    LOG(ERROR) << "Unable to read line section.";
     return false;
   }
 
-  ULONGLONG length = 0;
-  hr = function->get_length(&length);
-  if (hr != S_OK || length > MAXINT) {
-    LOG(ERROR) << "Failed to get function length: " << common::LogHr(hr);
+  size_t section_rva = 0;
+  if (!GetRva(line_section.sec, line_section.off, &section_rva)) {
+    LOG(ERROR) << "Line section is outside of the image.";
     return false;
   }
 
-  base::win::ScopedBstr name;
-  hr = function->get_name(name.Receive());
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get function name: " << common::LogHr(hr);
-    return false;
+  // The lines are recorded with their offset in the line section, and their
+  // length is known once all of them are read.
+  std::vector<CompilandInfo::Line>& lines = compiland->lines;
+  size_t first_line = lines.size();
+  while (!reader.AtEnd()) {
+    cci::CV_SourceFile source_file = {};
+    if (!parser.Read(&source_file)) {
+      LOG(ERROR) << "Unable to read source info.";
+      return false;
+    }
+
+    FileNameMap::const_iterator it(file_names.find(source_file.index));
+    if (it == file_names.end()) {
+      LOG(ERROR) << "Unable to find an index in the list of filenames used by "
+                 << "this module.";
+      return false;
+    }
+
+    std::vector<cci::CV_Line> source_lines;
+    if (source_file.count != 0 &&
+        !parser.ReadMultiple(source_file.count, &source_lines)) {
+      LOG(ERROR) << "Unable to read line records.";
+      return false;
+    }
+
+    if ((line_section.flags & cci::CV_LINES_HAVE_COLUMNS) != 0 &&
+        !reader.Consume(source_file.count * sizeof(cci::CV_Column))) {
+      LOG(ERROR) << "Unable to seek past column records.";
+      return false;
+    }
+
+    for (const auto& source_line : source_lines) {
+      CompilandInfo::Line line = { source_line.offset, 0,
+                                   source_line.flags & cci::linenumStart,
+                                   it->second };
+      lines.push_back(line);
+    }
   }
 
-  FunctionRange range(rva, static_cast<size_t>(length));
-  if (!object_file->functions.Insert(range,
-                                     FunctionInfo(common::ToString(name)))) {
+  // Each line extends to the next one, and the last one to the end of the
+  // line section. The hidden lines are only kept to delimit the others.
+  std::stable_sort(
+      lines.begin() + first_line, lines.end(),
+      [](const CompilandInfo::Line& line1, const CompilandInfo::Line& line2) {
+        return line1.rva < line2.rva;
+      });
+  size_t num_lines = first_line;
+  for (size_t i = first_line; i < lines.size(); ++i) {
+    CompilandInfo::Line line = lines[i];
+    size_t end = i + 1 < lines.size() ? lines[i + 1].rva : line_section.cod;
+    if (line.line == kHiddenLine || line.line == kAlwaysStepIntoLine ||
+        end < line.rva) {
+      continue;
+    }
+    line.length = end - line.rva;
+    line.rva += section_rva;
+    lines[num_lines++] = line;
+  }
+  lines.resize(num_lines);
+
+  return true;
+}
+
+bool CodeTally::GetRva(size_t section, size_t offset, size_t* rva) const {
+  DCHECK(rva != NULL);
+
+  if (section == 0 || section > section_rvas_.size())
+    return false;
+  *rva = section_rvas_[section - 1] + offset;
+
+  return true;
+}
+
+bool CodeTally::OnFunction(ObjectFileInfo* object_file,
+                           const std::wstring& name,
+                           size_t rva,
+                           size_t length) {
+  DCHECK(object_file != NULL);
+
+  FunctionRange range(rva, length);
+  if (!object_file->functions.Insert(range, FunctionInfo(name.c_str()))) {
     FunctionInfoAddressSpace::iterator it =
         object_file->functions.FindContaining(range);
     if (it == object_file->functions.end()) {
-      LOG(ERROR) << "Overlapping function info for '"
-                 << common::ToString(name) << "'";
+      LOG(ERROR) << "Overlapping function info for '" << name << "'";
       return false;
     } else if (it->first != range) {
-      LOG(ERROR) << "Function '"
-                 << common::ToString(name) << "' partially overlaps function '"
+      LOG(ERROR) << "Function '" << name << "' partially overlaps function '"
                  << it->second.name << "' in object file '"
                  << object_file->file_name << "'";
       return false;
@@ -448,8 +736,7 @@ bool CodeTally::OnFunction(ObjectFileInfo* object_file, IDiaSymbol* function) {
       //    maintain a per-function size, keep all the function names around
       //    and report the contribution for each distinct function as 1/Nth of
       //    the total sum of contributions.
-      LOG(INFO) << "Overlapping functions '"
-                << common::ToString(name) << "' and '"
+      LOG(INFO) << "Overlapping functions '" << name << "' and '"
                 << it->second.name << "' in object file '"
                 << object_file->file_name << "'";
     }
@@ -459,45 +746,12 @@ bool CodeTally::OnFunction(ObjectFileInfo* object_file, IDiaSymbol* function) {
 }
 
 bool CodeTally::OnLinePassTwo(ObjectFileInfo* object_file,
-                              IDiaLineNumber* line_number) {
+                              SourceFileInfo* source_file,
+                              size_t rva,
+                              size_t length,
+                              size_t line) {
   DCHECK(object_file != NULL);
-  DCHECK(line_number != NULL);
-
-  DWORD rva = 0;
-  HRESULT hr = line_number->get_relativeVirtualAddress(&rva);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get RVA for line: " << common::LogHr(hr);
-    return false;
-  }
-
-  DWORD length = 0;
-  hr = line_number->get_length(&length);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get length for line: " << common::LogHr(hr);
-    return false;
-  }
-
-  base::win::ScopedComPtr<IDiaSourceFile> source_file;
-  hr = line_number->get_sourceFile(source_file.Receive());
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get source file for line: " << common::LogHr(hr);
-    return false;
-  }
-
-  base::win::ScopedBstr source_name;
-  hr = source_file->get_fileName(source_name.Receive());
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get source file name for line: "
-               << common::LogHr(hr);
-    return false;
-  }
-
-  DWORD line = 0;
-  hr = line_number->get_lineNumber(&line);
-  if (hr != S_OK) {
-    LOG(ERROR) << "Failed to get line number: " << common::LogHr(hr);
-    return false;
-  }
+  DCHECK(source_file != NULL);
 
   FunctionRange line_range(rva, length ? length : 1);
   FunctionInfoAddressSpace::iterator it =
@@ -505,16 +759,13 @@ bool CodeTally::OnLinePassTwo(ObjectFileInfo* object_file,
   if (it == object_file->functions.end()) {
     LOG(ERROR) << "Line info outside function in object file '"
                << object_file->file_name << "' source file '"
-               << common::ToString(source_name) << "' at line: " << line;
+               << source_file->file_name << "' at line: " << line;
     return true;
   }
 
   FunctionInfo::LineData line_data = {};
 
-  line_data.source_file =
-      FindOrCreateSourceFileInfo(common::ToString(source_name));
-  DCHECK(line_data.source_file != NULL);
-
+  line_data.source_file = source_file;
   line_data.offset = rva - it->first.start();
   line_data.line = line;
   line_data.code_bytes = CalculateByteContribution(rva, length);
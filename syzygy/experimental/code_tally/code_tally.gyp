@@ -37,7 +37,7 @@
         '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/core/core.gyp:core_lib',
-        '<(src)/syzygy/pe/pe.gyp:dia_sdk',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/pe.gyp:test_dll',
       ],
@@ -18,19 +18,24 @@
 #ifndef SYZYGY_EXPERIMENTAL_CODE_TALLY_CODE_TALLY_H_
 #define SYZYGY_EXPERIMENTAL_CODE_TALLY_CODE_TALLY_H_
 
-#include <dia2.h>
 #include <cstdio>
 #include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
-#include "base/callback.h"
 #include "base/file_version_info.h"
 #include "base/files/file_path.h"
-#include "base/win/scoped_comptr.h"
+#include "base/memory/ref_counted.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/pdb/pdb_stream.h"
+#include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/pe_file.h"
 
 // Fwd.
+namespace common {
+class BinaryStreamReader;
+}  // namespace common
 namespace core {
 class JSONFileWriter;
 }  // namespace core
@@ -113,6 +118,12 @@ class JSONFileWriter;
 //   source line contribution.
 // - On the second pass we know how often each code byte is shared, and so
 //   we can accrue the correct tally.
+//
+// The symbols and the line information of the compilands are read straight
+// from the module streams of the PDB file. As this is the bulk of the work
+// for a large image, the compilands are read concurrently on a pool of
+// worker threads, each compiland being read on a single thread. The two
+// passes over the lines are then made over the data read.
 class CodeTally {
  public:
   // Creates a code tally instance for the given image file.
@@ -122,15 +133,26 @@ class CodeTally {
   // down to function, source line per object file.
   bool TallyLines(const base::FilePath& pdb_file);
 
+  // Sets the number of threads the compilands are read on. Defaults to one.
+  // @param num_threads The number of threads, must be non-zero.
+  void set_num_threads(size_t num_threads) { num_threads_ = num_threads; }
+
   // Generates a JSON file from the internal state.
   bool GenerateJsonOutput(core::JSONFileWriter* writer);
 
  private:
+  class CompilandWorker;
+  struct CompilandInfo;
   struct LineInfo;
   struct FunctionInfo;
   struct ObjectFileInfo;
   struct SourceFileInfo;
 
+  typedef std::vector<std::unique_ptr<CompilandInfo>> CompilandInfoVector;
+  // Maps from the offset of a file checksum in the lines of a compiland to
+  // the name of its file.
+  typedef std::map<size_t, const std::string*> FileNameMap;
+
   typedef std::map<std::wstring, SourceFileInfo> SourceFileInfoMap;
   typedef std::map<std::wstring, ObjectFileInfo> ObjectFileInfoMap;
 
@@ -141,27 +163,61 @@ class CodeTally {
   SourceFileInfo* FindOrCreateSourceFileInfo(const wchar_t* source_file);
   ObjectFileInfo* FindOrCreateObjectFileInfo(const wchar_t* object_file);
 
+  // Reads the compilands of a PDB file, on num_threads_ threads.
+  // @param pdb_file The PDB file to read.
+  // @param compilands Receives the compilands read.
+  // @returns true on success, false otherwise.
+  bool ReadCompilands(const base::FilePath& pdb_file,
+                      CompilandInfoVector* compilands);
+
+  // Reads the functions and the lines of a compiland from its module stream.
+  // This is called on the worker threads, and only touches @p compiland.
+  // @param compiland The compiland to read.
+  // @returns true on success, false otherwise.
+  bool ReadCompiland(CompilandInfo* compiland) const;
+
+  // Symbol visitor callback recording the functions of a compiland.
+  bool OnSymbol(CompilandInfo* compiland,
+                uint16_t symbol_length,
+                uint16_t symbol_type,
+                common::BinaryStreamReader* symbol_reader) const;
+
+  // Reads a DEBUG_S_LINES chunk of the lines of a compiland.
+  // @param file_names The file names of the compiland.
+  // @param start The offset of the chunk in the module stream.
+  // @param length The length of the chunk.
+  // @param compiland The compiland receiving the lines.
+  // @returns true on success, false otherwise.
+  bool ReadLineChunk(const FileNameMap& file_names,
+                     size_t start,
+                     size_t length,
+                     CompilandInfo* compiland) const;
+
+  // Translates a section offset to a relative address in the image.
+  // @param section The one-based index of the section.
+  // @param offset The offset in the section.
+  // @param rva Receives the relative address.
+  // @returns true on success, false if @p section isn't in the image.
+  bool GetRva(size_t section, size_t offset, size_t* rva) const;
+
   // Increases the use count for bytes [start, start + len) by one.
   void UseRange(size_t start, size_t len);
 
   // Sums up the total code contribution by the bytes in [start, start + len).
   double CalculateByteContribution(size_t start, size_t len);
 
-  // Callbacks for compiland enumeration.
-  bool OnCompilandPassOne(IDiaSymbol* compiland);
-  bool OnCompilandPassTwo(IDiaSymbol* compiland);
-
-  // Callback for line enumeration.
-  // First pass only updates all use counts.
-  bool OnLinePassOne(IDiaLineNumber* line_number);
-
-  // Callback for Function enumeration.
-  bool OnFunction(ObjectFileInfo* object_file, IDiaSymbol* function);
+  // Adds a function of a compiland to its object file.
+  bool OnFunction(ObjectFileInfo* object_file, const std::wstring& name,
+                  size_t rva, size_t length);
 
   // The second pass can accurately tally code contribution as
   // the first pass has calculated the sharing (use) count of
   // each byte in the binary.
-  bool OnLinePassTwo(ObjectFileInfo* object_file, IDiaLineNumber* line_number);
+  bool OnLinePassTwo(ObjectFileInfo* object_file,
+                     SourceFileInfo* source_file,
+                     size_t rva,
+                     size_t length,
+                     size_t line);
 
   // The image file we work on.
   base::FilePath image_file_;
@@ -174,8 +230,14 @@ class CodeTally {
   // TallyLines.
   std::unique_ptr<FileVersionInfo> image_file_version_;
 
-  // The DIA session this instance works with.
-  base::win::ScopedComPtr<IDiaSession> session_;
+  // The relative address of each section of image_file_.
+  std::vector<size_t> section_rvas_;
+
+  // The name table of the PDB file, by offset.
+  pdb::OffsetStringMap names_;
+
+  // The number of threads the compilands are read on.
+  size_t num_threads_;
 
   // Maps from object file name to ObjectFileInfo.
   ObjectFileInfoMap object_files_;
@@ -190,6 +252,43 @@ class CodeTally {
   DISALLOW_COPY_AND_ASSIGN(CodeTally);
 };
 
+// Data read from the module stream of a compiland.
+struct CodeTally::CompilandInfo {
+  CompilandInfo() : symbol_bytes(0), lines_bytes(0), succeeded(false) {
+  }
+
+  // This compiland's name.
+  std::wstring name;
+
+  // The module stream of this compiland, and the size of the symbols and of
+  // the lines in it. The stream is released once the compiland is read.
+  scoped_refptr<pdb::PdbStream> stream;
+  size_t symbol_bytes;
+  size_t lines_bytes;
+
+  // A function of this compiland.
+  struct Function {
+    std::wstring name;
+    size_t rva;
+    size_t length;
+  };
+
+  // A line of this compiland.
+  struct Line {
+    size_t rva;
+    size_t length;
+    size_t line;
+    // Points into CodeTally::names_.
+    const std::string* source_file;
+  };
+
+  std::vector<Function> functions;
+  std::vector<Line> lines;
+
+  // True if this compiland was read successfully.
+  bool succeeded;
+};
+
 // Data maintained per source line during tally.
 struct CodeTally::LineInfo {
   // The number of times we encountered this line.
@@ -17,7 +17,9 @@
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
+#include "base/sys_info.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/pe/pe_file.h"
 
@@ -41,6 +43,9 @@ const char kUsageFormatStr[] =
     "      Optionally provide the location of the PDB symbol file for the\n"
     "      given image file. If not provided, the tool will attempt to find\n"
     "      the symbol file by searching the symbol path.\n"
+    "  --num-threads=<count>\n"
+    "      The number of threads the compilands are read on. Defaults to the\n"
+    "      number of processors.\n"
     "  --output-file=<output file>\n"
     "      Optionally provide the name or path to the output file. If not\n"
     "      provided, output will be to standard out.\n"
@@ -82,6 +87,17 @@ bool CodeTallyApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   // Check the pretty print flag.
   pretty_print_ = cmd_line->HasSwitch("pretty-print");
 
+  num_threads_ = base::SysInfo::NumberOfProcessors();
+  if (cmd_line->HasSwitch("num-threads")) {
+    std::string num_threads = cmd_line->GetSwitchValueASCII("num-threads");
+    if (!base::StringToSizeT(num_threads, &num_threads_) ||
+        num_threads_ == 0) {
+      PrintUsage(cmd_line->GetProgram(),
+                 "Invalid value for '--num-threads' parameter!");
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -108,6 +124,7 @@ int CodeTallyApp::Run() {
 
   // Do the tally.
   CodeTally tally(input_image_);
+  tally.set_num_threads(num_threads_);
   if (!tally.TallyLines(input_pdb_))
     return 1;
 
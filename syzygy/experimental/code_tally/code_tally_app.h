@@ -34,7 +34,10 @@ class CodeTallyApp : public application::AppImplBase {
  public:
   // @name Implementation of the AppImplBase interface.
   // @{
-  CodeTallyApp() : application::AppImplBase("CodeTally"), pretty_print_(false) {
+  CodeTallyApp()
+      : application::AppImplBase("CodeTally"),
+        pretty_print_(false),
+        num_threads_(1) {
   }
 
   bool ParseCommandLine(const base::CommandLine* command_line);
@@ -56,6 +59,7 @@ class CodeTallyApp : public application::AppImplBase {
   base::FilePath input_pdb_;
   base::FilePath output_file_;
   bool pretty_print_;
+  size_t num_threads_;
   // @}
 
  private:
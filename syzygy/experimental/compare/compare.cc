@@ -67,13 +67,22 @@
 // made the cut. In this case, a match will be made based on identical code
 // content. This situation is handled regardless of the feature that is
 // given priority.
+//
+// Indexing a feature is the expensive part on large images. The metadata of
+// the blocks is computed on a pool of worker threads. The blocks are then
+// sorted by a cheap key, such as their hash, and the runs of blocks with equal
+// keys are sorted by the full comparison of the feature on the workers, which
+// only ever compares the contents of blocks whose hashes collide.
 
 #include "syzygy/experimental/compare/compare.h"
 
 #include <algorithm>
+#include <memory>
 
 #include "base/logging.h"
 #include "base/md5.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/block_hash.h"
 #include "syzygy/common/comparable.h"
 #include "syzygy/experimental/compare/block_compare.h"
@@ -87,6 +96,27 @@ namespace {
 
 const size_t kInvalidIndex = SIZE_MAX;
 
+// The minimum number of blocks handed to each worker thread when indexing a
+// feature.
+const size_t kMinBlocksPerThread = 1024;
+
+// Runs |delegates| on a pool of as many worker threads, or on this thread if
+// there is a single one.
+void RunDelegates(
+    const std::vector<base::DelegateSimpleThread::Delegate*>& delegates) {
+  if (delegates.size() == 1) {
+    delegates[0]->Run();
+    return;
+  }
+
+  base::DelegateSimpleThreadPool pool("CompareFeatureIndex",
+                                      static_cast<int>(delegates.size()));
+  for (size_t i = 0; i < delegates.size(); ++i)
+    pool.AddWork(delegates[i]);
+  pool.Start();
+  pool.JoinAll();
+}
+
 // Features are properties of blocks that are used to match up blocks between
 // block graphs. If there exists exactly one block in each graph with the same
 // value for the given feature, the blocks are assumed to be the same. We
@@ -144,6 +174,14 @@ class BlockFeature {
   virtual int Compare(const BlockMetadata& metadata0,
                       const BlockMetadata& metadata1) const = 0;
 
+  // Compares the keys of two blocks, returning their relative sort order
+  // (-1, 0, 1). Keys are cheap to compare, and blocks with different keys
+  // compare the same way in Compare. By default the key is the whole feature.
+  virtual int CompareKeys(const BlockMetadata& metadata0,
+                          const BlockMetadata& metadata1) const {
+    return Compare(metadata0, metadata1);
+  }
+
   // Returns the id associated with this feature.
   size_t id() const { return id_; }
 
@@ -294,8 +332,8 @@ class FeatureIndex {
   }
 
   // Populates block_infos_ and block_metadata_ with the blocks from the
-  // given BlockGraph.
-  bool AddBlocks(const BlockFeature& block_feature,
+  // given BlockGraph. Their metadata is initialized by InitMetadata.
+  void AddBlocks(const BlockFeature& block_feature,
                  size_t block_graph_index,
                  const BlockGraph& block_graph) {
     DCHECK(block_graph_index == 0 || block_graph_index == 1);
@@ -317,20 +355,32 @@ class FeatureIndex {
             std::make_pair(block, metadata)).first;
       }
 
-      // Initialize any metadata for this feature.
-      if (!block_feature.InitMetadata(&metadata_it->second))
-        return false;
-
       // Add this block to block_infos_.
       BlockInfo block_info(&metadata_it->second,
                            block_graph_index,
                            block_feature.id());
       block_infos_.push_back(block_info);
     }
-
-    return true;
   }
 
+  // Initializes the metadata of the blocks for this feature, on a pool of
+  // worker threads.
+  // @param block_feature The feature being indexed.
+  // @param num_threads The number of worker threads.
+  // @returns true on success, false otherwise.
+  bool InitMetadata(const BlockFeature& block_feature, size_t num_threads);
+
+  // Sorts block_infos_ by the given feature, and marks the blocks that start
+  // a new feature bucket. The runs of blocks with equal keys are sorted on a
+  // pool of worker threads.
+  // @param block_feature The feature being indexed.
+  // @param num_threads The number of worker threads.
+  // @param starts_bucket Receives 1 for each block of block_infos_ that
+  //     starts a feature bucket, 0 otherwise.
+  void SortBlocks(const BlockFeature& block_feature,
+                  size_t num_threads,
+                  std::vector<uint8_t>* starts_bucket);
+
   // Maps the given block, returning its feature bucket.
   size_t MapBlock(const BlockGraph::Block* block,
                   size_t block_graph_index) {
@@ -386,20 +436,106 @@ class FeatureIndex {
   };
   std::vector<BlockInfo> block_infos_;
 
-  // This is used as a sort functor for BlockInfos.
+  // This is used as a sort functor for BlockInfos, by the keys of their
+  // feature or by the full feature.
   class BlockInfoSortFunctor {
    public:
-    explicit BlockInfoSortFunctor(const BlockFeature& block_feature)
-        : block_feature(block_feature) {
+    BlockInfoSortFunctor(const BlockFeature& block_feature, bool keys_only)
+        : block_feature(block_feature), keys_only(keys_only) {
     }
 
     bool operator()(const BlockInfo& block_info0,
                     const BlockInfo& block_info1) {
+      if (keys_only) {
+        return block_feature.CompareKeys(*block_info0.metadata,
+                                         *block_info1.metadata) < 0;
+      }
       return block_feature.Compare(*block_info0.metadata,
                                    *block_info1.metadata) < 0;
     }
    private:
     const BlockFeature& block_feature;
+    bool keys_only;
+  };
+
+  // Initializes the metadata of a chunk of block_infos_ on a worker thread.
+  class MetadataInitializer : public base::DelegateSimpleThread::Delegate {
+   public:
+    MetadataInitializer(const BlockFeature& block_feature,
+                        BlockInfo* begin,
+                        BlockInfo* end)
+        : block_feature_(block_feature),
+          begin_(begin),
+          end_(end),
+          succeeded_(true) {
+    }
+
+    void Run() override {
+      for (BlockInfo* it = begin_; it != end_; ++it) {
+        if (!block_feature_.InitMetadata(it->metadata))
+          succeeded_ = false;
+      }
+    }
+
+    bool succeeded() const { return succeeded_; }
+
+   private:
+    const BlockFeature& block_feature_;
+    BlockInfo* begin_;
+    BlockInfo* end_;
+    bool succeeded_;
+
+    DISALLOW_COPY_AND_ASSIGN(MetadataInitializer);
+  };
+
+  // Sorts the runs of blocks with equal keys of a chunk of block_infos_ by
+  // the full feature on a worker thread, and marks the blocks that start a
+  // new feature bucket within each run. The chunk starts and ends on a run
+  // boundary, which is already marked.
+  class BucketSorter : public base::DelegateSimpleThread::Delegate {
+   public:
+    BucketSorter(const BlockFeature& block_feature,
+                 BlockInfo* block_infos,
+                 size_t begin,
+                 size_t end,
+                 std::vector<uint8_t>* starts_bucket)
+        : block_feature_(block_feature),
+          block_infos_(block_infos),
+          begin_(begin),
+          end_(end),
+          starts_bucket_(starts_bucket) {
+    }
+
+    void Run() override {
+      size_t run_start = begin_;
+      while (run_start < end_) {
+        size_t run_end = run_start + 1;
+        while (run_end < end_ && (*starts_bucket_)[run_end] == 0)
+          ++run_end;
+
+        if (run_end - run_start > 1) {
+          std::sort(block_infos_ + run_start, block_infos_ + run_end,
+                    BlockInfoSortFunctor(block_feature_, false));
+          for (size_t i = run_start + 1; i < run_end; ++i) {
+            if (block_feature_.Compare(*block_infos_[i - 1].metadata,
+                                       *block_infos_[i].metadata) != 0) {
+              (*starts_bucket_)[i] = 1;
+            }
+          }
+        }
+
+        run_start = run_end;
+      }
+    }
+
+   private:
+    const BlockFeature& block_feature_;
+    BlockInfo* block_infos_;
+    size_t begin_;
+    size_t end_;
+    std::vector<uint8_t>* starts_bucket_;
+
+    DISALLOW_COPY_AND_ASSIGN(BucketSorter);
   };
 
   // This stores information regarding the per unique feature in the index.
@@ -444,16 +580,17 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
   // Add the blocks to block_infos_, and initialize metadata.
   block_infos_.reserve(block_graph0.blocks().size() +
       block_graph1.blocks().size());
-  if (!AddBlocks(block_feature, 0, block_graph0))
-    return;
-  if (!AddBlocks(block_feature, 1, block_graph1))
+  AddBlocks(block_feature, 0, block_graph0);
+  AddBlocks(block_feature, 1, block_graph1);
+  size_t num_threads = std::max(static_cast<size_t>(1), std::min(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      block_infos_.size() / kMinBlocksPerThread));
+  if (!InitMetadata(block_feature, num_threads))
     return;
 
   // Sort block_infos_.
-  BlockInfoSortFunctor block_info_sort(block_feature);
-  std::sort(block_infos_.begin(),
-            block_infos_.end(),
-            block_info_sort);
+  std::vector<uint8_t> starts_bucket;
+  SortBlocks(block_feature, num_threads, &starts_bucket);
 
   // Assign unique feature IDs, and build out the FeatureInfo array.
   // Simultaneously, fill out BlockMetadata::feature_index.
@@ -463,9 +600,7 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
   feature_infos_.resize(1);
   size_t i = 1;
   for (; i < block_infos_.size(); ++i) {
-    int c = block_feature.Compare(*block_infos_[i - 1].metadata,
-                                  *block_infos_[i].metadata);
-    if (c != 0) {
+    if (starts_bucket[i] != 0) {
       feature_infos_.back().end = i;
 
       FeatureInfo feature_info;
@@ -501,6 +636,64 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
 #endif
 }
 
+bool FeatureIndex::InitMetadata(const BlockFeature& block_feature,
+                                size_t num_threads) {
+  DCHECK_LT(0U, num_threads);
+
+  std::vector<std::unique_ptr<MetadataInitializer>> initializers;
+  std::vector<base::DelegateSimpleThread::Delegate*> delegates;
+  BlockInfo* block_infos = block_infos_.data();
+  for (size_t i = 0; i < num_threads; ++i) {
+    size_t begin = block_infos_.size() * i / num_threads;
+    size_t end = block_infos_.size() * (i + 1) / num_threads;
+    initializers.push_back(std::unique_ptr<MetadataInitializer>(
+        new MetadataInitializer(block_feature, block_infos + begin,
+                                block_infos + end)));
+    delegates.push_back(initializers.back().get());
+  }
+  RunDelegates(delegates);
+
+  for (const auto& initializer : initializers) {
+    if (!initializer->succeeded())
+      return false;
+  }
+  return true;
+}
+
+void FeatureIndex::SortBlocks(const BlockFeature& block_feature,
+                              size_t num_threads,
+                              std::vector<uint8_t>* starts_bucket) {
+  DCHECK_LT(0U, num_threads);
+  DCHECK(starts_bucket != NULL);
+
+  // Sort by the keys, and mark the runs of equal keys.
+  std::sort(block_infos_.begin(), block_infos_.end(),
+            BlockInfoSortFunctor(block_feature, true));
+  starts_bucket->assign(block_infos_.size(), 0);
+  for (size_t i = 1; i < block_infos_.size(); ++i) {
+    if (block_feature.CompareKeys(*block_infos_[i - 1].metadata,
+                                  *block_infos_[i].metadata) != 0) {
+      (*starts_bucket)[i] = 1;
+    }
+  }
+
+  // Split the blocks into chunks of whole runs, and sort the runs.
+  std::vector<std::unique_ptr<BucketSorter>> sorters;
+  std::vector<base::DelegateSimpleThread::Delegate*> delegates;
+  size_t begin = 0;
+  for (size_t i = 0; i < num_threads && begin < block_infos_.size(); ++i) {
+    size_t end = std::max(begin, block_infos_.size() * (i + 1) / num_threads);
+    while (end < block_infos_.size() && (*starts_bucket)[end] == 0)
+      ++end;
+    sorters.push_back(std::unique_ptr<BucketSorter>(new BucketSorter(
+        block_feature, block_infos_.data(), begin, end, starts_bucket)));
+    delegates.push_back(sorters.back().get());
+    begin = end;
+  }
+  if (!delegates.empty())
+    RunDelegates(delegates);
+}
+
 class BlockHashFeature : public BlockFeature {
  public:
   BlockHashFeature() : BlockFeature(kHashFeature) {
@@ -508,7 +701,8 @@ class BlockHashFeature : public BlockFeature {
 
   virtual bool InitMetadata(BlockMetadata* metadata) const {
     DCHECK(metadata != NULL);
-    metadata->block_hash.Hash(metadata->block);
+    metadata->block_hash.Hash(metadata->block,
+                              block_graph::BlockHash::FAST_HASH);
     return true;
   }
 
@@ -520,6 +714,11 @@ class BlockHashFeature : public BlockFeature {
 
     return BlockCompare(metadata0.block, metadata1.block);
   }
+
+  virtual int CompareKeys(const BlockMetadata& metadata0,
+                          const BlockMetadata& metadata1) const {
+    return metadata0.block_hash.Compare(metadata1.block_hash);
+  }
 };
 
 class BlockNameFeature : public BlockFeature {
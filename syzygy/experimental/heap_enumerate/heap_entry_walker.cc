@@ -18,6 +18,9 @@
 
 #include "syzygy/experimental/heap_enumerate/heap_entry_walker.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace {
 
 // XORs a memory range into another memory range.
@@ -42,8 +45,117 @@ bool GetNamedValueUnsigned(const refinery::TypedData& data,
   return true;
 }
 
+// Reads the value of an unsigned field at @p addr from @p reader.
+template <typename Reader>
+bool ReadFieldUnsigned(Reader* reader,
+                       refinery::Address addr,
+                       const FieldLayout& field,
+                       uint64_t* value) {
+  DCHECK(reader);
+  DCHECK(value);
+  if (field.size == 0 || field.size > sizeof(*value))
+    return false;
+
+  *value = 0;
+  return reader->GetAll(
+      refinery::AddressRange(addr + field.offset,
+                             static_cast<refinery::Size>(field.size)),
+      value);
+}
+
 }  // namespace
 
+BulkReader::BulkReader() : bit_source_(nullptr) {
+}
+
+void BulkReader::Initialize(refinery::BitSource* bit_source,
+                            const refinery::AddressRange& range) {
+  DCHECK(bit_source);
+  bit_source_ = bit_source;
+  range_ = range;
+  window_ = refinery::AddressRange();
+}
+
+bool BulkReader::GetAll(const refinery::AddressRange& range, void* data_ptr) {
+  DCHECK(bit_source_);
+  DCHECK(range.IsValid());
+  DCHECK(data_ptr);
+
+  if (!window_.Contains(range) && range_.Contains(range))
+    Fill(range.start());
+
+  if (window_.Contains(range)) {
+    ::memcpy(data_ptr, &data_.at(range.start() - window_.start()),
+             range.size());
+    return true;
+  }
+
+  // The range is unreadable, or outside of the range of the reader.
+  return bit_source_->GetAll(range, data_ptr);
+}
+
+void BulkReader::Fill(refinery::Address start) {
+  DCHECK_LT(start, range_.end());
+
+  refinery::Address end = std::min(start + kWindowSize, range_.end());
+  refinery::Size size = static_cast<refinery::Size>(end - start);
+  data_.resize(size);
+
+  size_t data_cnt = 0;
+  if (bit_source_->GetFrom(refinery::AddressRange(start, size), &data_cnt,
+                           &data_.at(0))) {
+    window_ = refinery::AddressRange(start,
+                                     static_cast<refinery::Size>(data_cnt));
+    return;
+  }
+
+  // Part of the window is unreadable, read it a page at a time up to the
+  // first unreadable page.
+  const refinery::Address kPageMask = kPageSize - 1;
+  refinery::Address readable_end = start;
+  while (readable_end < end) {
+    refinery::Address page_end =
+        std::min((readable_end & ~kPageMask) + kPageSize, end);
+    refinery::AddressRange page(
+        readable_end, static_cast<refinery::Size>(page_end - readable_end));
+    if (!bit_source_->GetAll(page, &data_.at(readable_end - start)))
+      break;
+    readable_end = page_end;
+  }
+  window_ = refinery::AddressRange(
+      start, static_cast<refinery::Size>(readable_end - start));
+}
+
+bool FieldLayout::Initialize(refinery::UserDefinedTypePtr type,
+                             base::StringPiece16 field_name) {
+  DCHECK(type);
+  const refinery::UserDefinedType::Fields& fields = type->fields();
+  for (size_t i = 0; i < fields.size(); ++i) {
+    refinery::MemberFieldPtr member;
+    if (!fields[i]->CastTo(&member) || member->name() != field_name)
+      continue;
+
+    refinery::TypePtr field_type = type->GetFieldType(i);
+    if (!field_type)
+      return false;
+    offset = member->offset();
+    size = field_type->size();
+    return true;
+  }
+
+  return false;
+}
+
+bool LFHBinLayout::Initialize(
+    refinery::UserDefinedTypePtr heap_userdata_header_type,
+    refinery::UserDefinedTypePtr heap_subsegment_type,
+    refinery::UserDefinedTypePtr heap_entry_type) {
+  this->heap_userdata_header_type = heap_userdata_header_type;
+  return subsegment.Initialize(heap_userdata_header_type, L"SubSegment") &&
+         block_size.Initialize(heap_subsegment_type, L"BlockSize") &&
+         subsegment_code.Initialize(heap_entry_type, L"SubSegmentCode");
+}
+
 HeapEntryWalker::HeapEntryWalker() : heap_bit_source_(nullptr) {
 }
 
@@ -101,6 +213,7 @@ bool SegmentEntryWalker::Initialize(refinery::BitSource* bit_source,
   // _HEAP_UCR_DESCRIPTOR structures.
   segment_range_ = refinery::AddressRange(
       segment.addr(), refinery::Address(last_valid_entry) - segment.addr());
+  reader_.Initialize(heap_bit_source_, segment_range_);
 
   return true;
 }
@@ -114,7 +227,7 @@ bool SegmentEntryWalker::GetDecodedEntry(HeapEntry* entry) {
     return false;
 
   // Get the raw entry.
-  if (!heap_bit_source_->GetAll(curr_entry_.GetRange(), &tmp))
+  if (!reader_.GetAll(curr_entry_.GetRange(), &tmp))
     return false;
 
   // Unencode it.
@@ -148,7 +261,7 @@ LFHBinWalker::LFHBinWalker() : entry_byte_size_(0), heap_(0) {
 bool LFHBinWalker::Initialize(
     refinery::Address heap,
     refinery::BitSource* bit_source,
-    refinery::UserDefinedTypePtr heap_userdata_header_type,
+    const LFHBinLayout& layout,
     SegmentEntryWalker* walker) {
   DCHECK(bit_source);
   DCHECK(walker);
@@ -166,28 +279,30 @@ bool LFHBinWalker::Initialize(
 
   bin_range_ = refinery::AddressRange(entry_range.start(),
                                       entry.size * entry_range.size());
+  reader_.Initialize(heap_bit_source_, bin_range_);
 
   // The bin is comprised of a _HEAP_USERDATA_HEADER, followed by a
   // concatenation of heap entries.
-  if (!walker->curr_entry().OffsetAndCast(1, heap_userdata_header_type,
+  if (!walker->curr_entry().OffsetAndCast(1, layout.heap_userdata_header_type,
                                           &heap_userdata_header_)) {
     return false;
   }
 
-  // Dereference the heap subsegment. This contains the size, entry count
-  // and other information on this bin.
-  refinery::TypedData subsegment;
-  refinery::TypedData heap_subsegment;
-  if (!heap_userdata_header_.GetNamedField(L"SubSegment", &subsegment) ||
-      !subsegment.Dereference(&heap_subsegment)) {
+  // Read the heap subsegment pointer. The subsegment contains the size, entry
+  // count and other information on this bin.
+  uint64_t heap_subsegment = 0;
+  if (!ReadFieldUnsigned(&reader_, heap_userdata_header_.addr(),
+                         layout.subsegment, &heap_subsegment)) {
     return false;
   }
 
   // TODO(siggi): The UserBlocks pointer should point back to the
   //     _HEAP_USERDATA_HEADER in the bin - validate this.
   uint64_t block_size = 0;
-  if (!GetNamedValueUnsigned(heap_subsegment, L"BlockSize", &block_size))
+  if (!ReadFieldUnsigned(heap_bit_source_, heap_subsegment, layout.block_size,
+                         &block_size)) {
     return false;
+  }
 
   // Compute the entry byte size.
   entry_byte_size_ = block_size * walker->curr_entry().type()->size();
@@ -199,8 +314,10 @@ bool LFHBinWalker::Initialize(
 
   // Get the obfuscated subsegment pointer from the first entry in the bin.
   uint64_t subsegment_code = 0;
-  if (!GetNamedValueUnsigned(curr_entry_, L"SubSegmentCode", &subsegment_code))
+  if (!ReadFieldUnsigned(&reader_, curr_entry_.addr(), layout.subsegment_code,
+                         &subsegment_code)) {
     return false;
+  }
 
   // The subsegment_code is
   // XOR(LFHKey, subsegment_code, self addr >> 3, heap_subsegment).
@@ -208,7 +325,7 @@ bool LFHBinWalker::Initialize(
   lfh_key_ = subsegment_code;
   lfh_key_ ^= heap_;
   lfh_key_ ^= (curr_entry_.addr() >> 3);
-  lfh_key_ ^= heap_subsegment.addr();
+  lfh_key_ ^= heap_subsegment;
 
   return true;
 }
@@ -220,7 +337,7 @@ bool LFHBinWalker::GetDecodedEntry(LFHEntry* entry) {
   if (sizeof(tmp) != curr_entry_.type()->size())
     return false;
 
-  if (!curr_entry_.bit_source()->GetAll(curr_entry_.GetRange(), &tmp))
+  if (!reader_.GetAll(curr_entry_.GetRange(), &tmp))
     return false;
 
   // XOR the LFHKey, self address and heap in to de-obfuscate the subseg field.
@@ -19,6 +19,10 @@
 #ifndef SYZYGY_EXPERIMENTAL_HEAP_ENUMERATE_HEAP_ENTRY_WALKER_H_
 #define SYZYGY_EXPERIMENTAL_HEAP_ENUMERATE_HEAP_ENTRY_WALKER_H_
 
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
 #include "syzygy/refinery/core/bit_source.h"
 #include "syzygy/refinery/types/type.h"
 #include "syzygy/refinery/types/typed_data.h"
@@ -35,6 +39,78 @@ enum HeapEntryFlags {
   HEAP_ENTRY_SETTABLE_FLAG3 = 0x80,
 };
 
+// Reads a range of memory through a bit source a window at a time, so that
+// walking the entries of a range doesn't take a read of the bit source per
+// entry. A window that overlaps unreadable memory, such as an uncommitted
+// range of a heap segment, is trimmed to its readable head.
+class BulkReader {
+ public:
+  BulkReader();
+
+  // Initialize the reader to read @p range from @p bit_source.
+  void Initialize(refinery::BitSource* bit_source,
+                  const refinery::AddressRange& range);
+
+  // Retrieves all bytes from a range, from the current window if possible.
+  // Ranges outside of the range of the reader are read from the bit source.
+  // @param range the requested range.
+  // @param data_ptr a buffer of size at least that of @p range.
+  // @returns true iff the full contents of @p range are available.
+  bool GetAll(const refinery::AddressRange& range, void* data_ptr);
+
+  // The size of the windows read.
+  static const size_t kWindowSize = 256 * 1024;
+  // The granularity at which a window is trimmed.
+  static const size_t kPageSize = 4096;
+
+ private:
+  // Reads the window starting at @p start.
+  void Fill(refinery::Address start);
+
+  refinery::BitSource* bit_source_;
+  // The range to read.
+  refinery::AddressRange range_;
+  // The range held in data_, possibly empty.
+  refinery::AddressRange window_;
+  std::vector<uint8_t> data_;
+
+  DISALLOW_COPY_AND_ASSIGN(BulkReader);
+};
+
+// The location of a field in a type.
+struct FieldLayout {
+  FieldLayout() : offset(0), size(0) {}
+
+  // Looks up a member field of a type by name.
+  // @param type the type containing the field.
+  // @param field_name the name of the field.
+  // @returns true iff @p type has a member field named @p field_name.
+  bool Initialize(refinery::UserDefinedTypePtr type,
+                  base::StringPiece16 field_name);
+
+  size_t offset;
+  size_t size;
+};
+
+// The layout of the fields the LFH bin walker reads for each bin. These are
+// looked up once per heap, rather than by name for every bin.
+struct LFHBinLayout {
+  // Looks up the layout of the fields.
+  // @returns true iff all fields are found.
+  bool Initialize(refinery::UserDefinedTypePtr heap_userdata_header_type,
+                  refinery::UserDefinedTypePtr heap_subsegment_type,
+                  refinery::UserDefinedTypePtr heap_entry_type);
+
+  // The type heading each bin.
+  refinery::UserDefinedTypePtr heap_userdata_header_type;
+  // _HEAP_USERDATA_HEADER::SubSegment.
+  FieldLayout subsegment;
+  // _HEAP_SUBSEGMENT::BlockSize.
+  FieldLayout block_size;
+  // _HEAP_ENTRY::SubSegmentCode.
+  FieldLayout subsegment_code;
+};
+
 // A base class for the segment and LFH entry walkers.
 class HeapEntryWalker {
  public:
@@ -100,6 +176,9 @@ class SegmentEntryWalker : public HeapEntryWalker {
   // The encoding for entries in this range.
   std::vector<uint8_t> encoding_;
 
+  // Reads the entries of the segment in bulk.
+  BulkReader reader_;
+
   DISALLOW_COPY_AND_ASSIGN(SegmentEntryWalker);
 };
 
@@ -117,9 +196,11 @@ class LFHBinWalker : public HeapEntryWalker {
 
   LFHBinWalker();
 
+  // Initialize the walker to walk the bin at the current entry of @p walker.
+  // The bin is read in bulk, and its entries are decoded from memory.
   bool Initialize(refinery::Address heap,
                   refinery::BitSource* bit_source,
-                  refinery::UserDefinedTypePtr heap_user_data_header_type,
+                  const LFHBinLayout& layout,
                   SegmentEntryWalker* walker);
 
   bool GetDecodedEntry(LFHEntry* entry);
@@ -146,6 +227,9 @@ class LFHBinWalker : public HeapEntryWalker {
   // The heap this bin is associated with, as provided by Initialize.
   refinery::Address heap_;
 
+  // Reads the bin in bulk.
+  BulkReader reader_;
+
   DISALLOW_COPY_AND_ASSIGN(LFHBinWalker);
 };
 
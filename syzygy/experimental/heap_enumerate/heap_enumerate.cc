@@ -137,9 +137,7 @@ class HeapEnumerate::HeapEnumerator {
   // Accessor to the heap.
   const TypedData& heap() const { return heap_; }
 
-  UserDefinedTypePtr heap_userdata_header_type() const {
-    return heap_userdata_header_type_;
-  }
+  const LFHBinLayout& lfh_bin_layout() const { return lfh_bin_layout_; }
   BitSource* bit_source() const {
     return const_cast<testing::SelfBitSource*>(&bit_source_);
   }
@@ -186,6 +184,12 @@ class HeapEnumerate::HeapEnumerator {
 
   // Each LFH bin starts with one of these.
   UserDefinedTypePtr heap_userdata_header_type_;
+
+  // Each LFH bin is described by one of these.
+  UserDefinedTypePtr heap_subsegment_type_;
+
+  // The layout of the fields read for each LFH bin.
+  LFHBinLayout lfh_bin_layout_;
 };
 
 HeapEnumerate::HeapEnumerator::HeapEnumerator() {
@@ -208,6 +212,8 @@ bool HeapEnumerate::HeapEnumerator::Initialize(HANDLE heap,
   wanted_udts.insert(std::make_pair(L"_LFH_HEAP", &lfh_heap_type_));
   wanted_udts.insert(
       std::make_pair(L"_HEAP_USERDATA_HEADER", &heap_userdata_header_type_));
+  wanted_udts.insert(
+      std::make_pair(L"_HEAP_SUBSEGMENT", &heap_subsegment_type_));
 
   for (auto type : *repo) {
     auto it = wanted_udts.find(type->GetName());
@@ -237,6 +243,12 @@ bool HeapEnumerate::HeapEnumerator::Initialize(HANDLE heap,
     return false;
   }
 
+  if (!lfh_bin_layout_.Initialize(heap_userdata_header_type_,
+                                  heap_subsegment_type_, heap_entry_type_)) {
+    LOG(ERROR) << "Unexpected layout of the LFH types.";
+    return false;
+  }
+
   heap_ = TypedData(&bit_source_, heap_type_, reinterpret_cast<Address>(heap));
 
   return true;
@@ -498,7 +510,7 @@ void HeapEnumerate::EnumSegment(const HeapEnumerator& enumerator,
       LFHBinWalker bin_walker;
       if (bin_walker.Initialize(
               enumerator.heap().addr(), enumerator.bit_source(),
-              enumerator.heap_userdata_header_type(), segment_walker)) {
+              enumerator.lfh_bin_layout(), segment_walker)) {
         EnumLFHBin(enumerator, &bin_walker);
       } else {
         fprintf(output_, "LFHBinWalker::Initialize failed\n");
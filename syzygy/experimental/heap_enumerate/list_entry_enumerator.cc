@@ -16,16 +16,20 @@
 
 namespace {
 
-bool GetMemberFieldOffset(refinery::UserDefinedTypePtr record_type,
+bool GetMemberField(refinery::UserDefinedTypePtr record_type,
                     base::StringPiece16 field_name,
+                    size_t* field_no,
                     size_t* field_offset) {
+  DCHECK(field_no);
   DCHECK(field_offset);
-  for (auto f : record_type->fields()) {
+  const refinery::UserDefinedType::Fields& fields = record_type->fields();
+  for (size_t i = 0; i < fields.size(); ++i) {
     refinery::MemberFieldPtr member;
-    if (!f->CastTo(&member))
+    if (!fields[i]->CastTo(&member))
       continue;
 
     if (member->name() == field_name) {
+      *field_no = i;
       *field_offset = member->offset();
       return true;
     }
@@ -33,10 +37,22 @@ bool GetMemberFieldOffset(refinery::UserDefinedTypePtr record_type,
   return false;
 }
 
+// Retrieves the index of the Flink field of a _LIST_ENTRY type.
+bool GetFlinkField(refinery::TypePtr list_entry_type, size_t* field_no) {
+  DCHECK(field_no);
+  refinery::UserDefinedTypePtr list_entry_udt;
+  size_t field_offset = 0;
+  return list_entry_type && list_entry_type->CastTo(&list_entry_udt) &&
+         GetMemberField(list_entry_udt, L"Flink", field_no, &field_offset);
+}
+
 }  // namespace
 
 ListEntryEnumerator::ListEntryEnumerator()
-    : list_head_(0), list_entry_offset_(0) {
+    : list_head_(0),
+      list_entry_offset_(0),
+      list_entry_field_(0),
+      flink_field_(0) {
 }
 
 bool ListEntryEnumerator::Initialize(const refinery::TypedData& list_head,
@@ -47,10 +63,20 @@ bool ListEntryEnumerator::Initialize(const refinery::TypedData& list_head,
   if (!list_head.GetNamedField(L"Flink", &flink) || !flink.IsPointerType())
     return false;
 
-  if (!GetMemberFieldOffset(record_type, list_entry_name, &list_entry_offset_))
+  if (!GetMemberField(record_type, list_entry_name, &list_entry_field_,
+                      &list_entry_offset_)) {
+    return false;
+  }
+
+  // The head and the entries of the list are expected to share their layout.
+  size_t record_flink_field = 0;
+  if (!GetFlinkField(list_head.type(), &flink_field_) ||
+      !GetFlinkField(record_type->GetFieldType(list_entry_field_),
+                     &record_flink_field) ||
+      record_flink_field != flink_field_) {
     return false;
+  }
   record_type_ = record_type;
-  list_entry_name.CopyToString(&list_entry_name_);
   list_head_ = list_head.addr();
   current_list_entry_ = list_head;
 
@@ -59,7 +85,7 @@ bool ListEntryEnumerator::Initialize(const refinery::TypedData& list_head,
 
 bool ListEntryEnumerator::Next() {
   refinery::TypedData flink;
-  if (!current_list_entry_.GetNamedField(L"Flink", &flink))
+  if (!current_list_entry_.GetField(flink_field_, &flink))
     return false;
 
   refinery::Address flink_addr = 0;
@@ -75,7 +101,7 @@ bool ListEntryEnumerator::Next() {
                                  record_type_,
                                  flink_addr - list_entry_offset_);
 
-  if (!next_entry.GetNamedField(list_entry_name_, &current_list_entry_))
+  if (!next_entry.GetField(list_entry_field_, &current_list_entry_))
     return false;
   current_record_ = next_entry;
 
@@ -45,12 +45,15 @@ class ListEntryEnumerator {
  private:
   // Address of the list head.
   refinery::Address list_head_;
-  // The offset of the the field named @p list_entry_name_ in @p record_type_.
+  // The offset of the the list entry field we're walking in @p record_type_.
   // Used to locate the start of the containing record, similar to
   // the CONTAINING_RECORD macro.
   size_t list_entry_offset_;
-  // The name of the list entry field we're walking.
-  base::string16 list_entry_name_;
+  // The index of the list entry field we're walking in @p record_type_, and
+  // the index of the Flink field in the list entries. These are looked up
+  // once, rather than by name for every entry.
+  size_t list_entry_field_;
+  size_t flink_field_;
   // The type of the record.
   refinery::UserDefinedTypePtr record_type_;
   // The current list entry. After Initialize this is the list head, after that
@@ -19,18 +19,43 @@
 
 namespace pdb {
 
-bool WriteSymbolRecords(const SymbolVector& symbols,
-                        SymbolOffsets* symbol_offsets,
-                        WritablePdbStream* stream) {
+size_t GetSymbolRecordOffsets(const SymbolVector& symbols,
+                              SymbolOffsets* symbol_offsets) {
   DCHECK_NE(static_cast<SymbolOffsets*>(NULL), symbol_offsets);
   DCHECK(symbol_offsets->empty());
-  DCHECK_NE(static_cast<WritablePdbStream*>(NULL), stream);
 
+  size_t offset = 0;
+  symbol_offsets->reserve(symbols.size());
   for (SymbolVector::const_iterator it = symbols.begin();
        it != symbols.end();
        ++it) {
-    symbol_offsets->push_back(stream->pos());
-    if (!(*it)->Write(stream))
+    symbol_offsets->push_back(static_cast<uint32_t>(offset));
+    offset += (*it)->GetSize();
+  }
+
+  return offset;
+}
+
+bool WriteSymbolRecords(const SymbolVector& symbols,
+                        const SymbolOffsets& symbol_offsets,
+                        WritablePdbStream* stream) {
+  DCHECK_EQ(symbols.size(), symbol_offsets.size());
+  DCHECK_NE(static_cast<WritablePdbStream*>(NULL), stream);
+
+  // Grow the stream to its final size at once.
+  size_t size = symbols.empty() ? 0 : symbol_offsets.back() +
+                                          symbols.back()->GetSize();
+  size_t start_pos = stream->pos();
+  if (!stream->Consume(size))
+    return false;
+  stream->set_pos(start_pos);
+
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    if (stream->pos() != start_pos + symbol_offsets[i]) {
+      LOG(ERROR) << "Symbol record " << i << " isn't at its computed offset.";
+      return false;
+    }
+    if (!symbols[i]->Write(stream))
       return false;
   }
 
@@ -26,14 +26,24 @@ namespace pdb {
 
 typedef std::vector<uint32_t> SymbolOffsets;
 
-// Writes a PDB symbol record stream.
+// Computes the layout of a PDB symbol record stream, without writing it. This
+// lets the streams that refer to the symbol records be written independently
+// of it.
+// @param symbols the symbols to lay out.
+// @param symbol_offsets receives the offsets at which the symbols are written
+//     by WriteSymbolRecords.
+// @returns the size of the symbol record stream.
+size_t GetSymbolRecordOffsets(const SymbolVector& symbols,
+                              SymbolOffsets* symbol_offsets);
+
+// Writes a PDB symbol record stream. The stream is allocated up front.
 // @param symbols the symbols to write.
-// @param symbol_offsets the offsets at which the symbols have been written
-//     in |stream|.
+// @param symbol_offsets the offsets at which the symbols are written in
+//     |stream|, as computed by GetSymbolRecordOffsets.
 // @param stream the stream in which to write.
 // @returns true in case of success, false otherwise.
 bool WriteSymbolRecords(const SymbolVector& symbols,
-                        SymbolOffsets* symbol_offsets,
+                        const SymbolOffsets& symbol_offsets,
                         WritablePdbStream* stream);
 
 }  // namespace pdb
@@ -0,0 +1,74 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Unit tests for the GetSymbolRecordOffsets and WriteSymbolRecords functions.
+
+#include "syzygy/experimental/pdb_writer/pdb_symbol_record_writer.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/experimental/pdb_writer/symbols/image_symbol.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_data.h"
+
+namespace pdb {
+
+TEST(PdbSymbolRecordWriterTest, WritesAtComputedOffsets) {
+  SymbolVector symbols;
+  symbols.push_back(std::unique_ptr<Symbol>(new symbols::ImageSymbol(
+      Microsoft_Cci_Pdb::S_PUB32, core::SectionOffsetAddress(5, 184),
+      Microsoft_Cci_Pdb::T_SEGMENT, "__imp____crtTerminateProcess")));
+  symbols.push_back(std::unique_ptr<Symbol>(new symbols::ImageSymbol(
+      Microsoft_Cci_Pdb::S_PUB32, core::SectionOffsetAddress(5, 220),
+      Microsoft_Cci_Pdb::T_SEGMENT, "__imp___initterm_e")));
+  symbols.push_back(std::unique_ptr<Symbol>(new symbols::ImageSymbol(
+      Microsoft_Cci_Pdb::S_LDATA32, core::SectionOffsetAddress(5, 320),
+      Microsoft_Cci_Pdb::T_SEGMENT, "__imp___NotPublic")));
+
+  // The records are padded to a multiple of 4 bytes.
+  SymbolOffsets symbol_offsets;
+  EXPECT_EQ(112U, GetSymbolRecordOffsets(symbols, &symbol_offsets));
+  ASSERT_EQ(3U, symbol_offsets.size());
+  EXPECT_EQ(0U, symbol_offsets[0]);
+  EXPECT_EQ(44U, symbol_offsets[1]);
+  EXPECT_EQ(80U, symbol_offsets[2]);
+
+  scoped_refptr<PdbByteStream> reader(new PdbByteStream());
+  scoped_refptr<WritablePdbStream> writer(reader->GetWritableStream());
+  ASSERT_TRUE(WriteSymbolRecords(symbols, symbol_offsets, writer.get()));
+  EXPECT_EQ(112U, reader->length());
+  EXPECT_EQ(112U, writer->pos());
+
+  // Each record starts at its computed offset, with its padded length.
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    SymbolRecordHeader header = {};
+    ASSERT_TRUE(reader->ReadBytesAt(symbol_offsets[i], sizeof(header),
+                                    &header));
+    EXPECT_EQ(static_cast<uint16_t>(symbols[i]->GetType()), header.type);
+    EXPECT_EQ(symbols[i]->GetSize(), header.length + sizeof(header.length));
+  }
+}
+
+TEST(PdbSymbolRecordWriterTest, NoSymbols) {
+  SymbolVector symbols;
+  SymbolOffsets symbol_offsets;
+  EXPECT_EQ(0U, GetSymbolRecordOffsets(symbols, &symbol_offsets));
+  EXPECT_TRUE(symbol_offsets.empty());
+
+  scoped_refptr<PdbByteStream> reader(new PdbByteStream());
+  scoped_refptr<WritablePdbStream> writer(reader->GetWritableStream());
+  EXPECT_TRUE(WriteSymbolRecords(symbols, symbol_offsets, writer.get()));
+  EXPECT_EQ(0U, reader->length());
+}
+
+}  // namespace pdb
@@ -55,6 +55,7 @@
       'sources': [
         'pdb_public_stream_writer_unittest.cc',
         'pdb_string_table_writer_unittest.cc',
+        'pdb_symbol_record_writer_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
@@ -14,7 +14,14 @@
 
 #include "syzygy/experimental/pdb_writer/simple_pdb_builder.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "base/bind.h"
 #include "base/logging.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/experimental/pdb_writer/pdb_debug_info_stream_writer.h"
 #include "syzygy/experimental/pdb_writer/pdb_header_stream_writer.h"
 #include "syzygy/experimental/pdb_writer/pdb_public_stream_writer.h"
@@ -41,6 +48,47 @@ const size_t kSectionHeaderStreamIndex = kNamesStreamIndex + 1;
 const size_t kSymbolRecordStreamIndex = kSectionHeaderStreamIndex + 1;
 const size_t kPublicStreamIndex = kSymbolRecordStreamIndex + 1;
 
+// Writes a stream of the PDB, possibly on a worker thread.
+class StreamWriter : public base::DelegateSimpleThread::Delegate {
+ public:
+  // Writes the contents of a stream. Returns true on success.
+  typedef base::Callback<bool(WritablePdbStream*)> WriteCallback;
+
+  // @param index the index of the stream in the PDB.
+  // @param write_callback writes the contents of the stream.
+  StreamWriter(size_t index, const WriteCallback& write_callback)
+      : index_(index),
+        write_callback_(write_callback),
+        stream_(new PdbByteStream),
+        writable_stream_(stream_->GetWritableStream()),
+        succeeded_(false) {}
+
+  // base::DelegateSimpleThread::Delegate implementation.
+  void Run() override {
+    succeeded_ = write_callback_.Run(writable_stream_.get());
+  }
+
+  // @name Accessors.
+  // @{
+  size_t index() const { return index_; }
+  PdbStream* stream() const { return stream_.get(); }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ private:
+  size_t index_;
+  WriteCallback write_callback_;
+
+  // The stream, and its writable side. Both are created and released on the
+  // thread of the builder, as their reference counts aren't thread-safe.
+  scoped_refptr<PdbStream> stream_;
+  scoped_refptr<WritablePdbStream> writable_stream_;
+
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamWriter);
+};
+
 }  // namespace
 
 bool BuildSimplePdb(const pe::PEFile& pe_file,
@@ -52,62 +100,69 @@ bool BuildSimplePdb(const pe::PEFile& pe_file,
   // The stream can be empty without invalidating the PDB.
   pdb_file->SetStream(kPdbOldDirectoryStream, NULL);
 
-  // Build the header stream.
   pe::PdbInfo pdb_info;
   if (!pdb_info.Init(pe_file))
     return false;
 
-  scoped_refptr<PdbStream> header_stream(new PdbByteStream);
-  if (!WriteHeaderStream(pdb_info, kNamesStreamIndex,
-                         header_stream->GetWritableStream().get())) {
-    return false;
-  }
-  pdb_file->SetStream(kPdbHeaderInfoStream, header_stream.get());
-
-  // Build the Type Info stream.
-  scoped_refptr<PdbStream> type_info_stream(new PdbByteStream);
-  if (!WriteEmptyTypeInfoStream(type_info_stream->GetWritableStream().get()))
-    return false;
-  pdb_file->SetStream(kTpiStream, type_info_stream.get());
-
-  // Build the Debug Info stream.
-  scoped_refptr<PdbStream> debug_info_stream(new PdbByteStream);
-  if (!WriteDebugInfoStream(pdb_info.pdb_age(), kSymbolRecordStreamIndex,
-                            kPublicStreamIndex, kSectionHeaderStreamIndex,
-                            debug_info_stream->GetWritableStream().get())) {
-    return false;
-  }
-  pdb_file->SetStream(kDbiStream, debug_info_stream.get());
-
-  // Build an empty Name Table stream.
-  scoped_refptr<PdbStream> names_stream(new PdbByteStream);
-  WriteStringTable(StringTable(), names_stream->GetWritableStream().get());
-  pdb_file->SetStream(kNamesStreamIndex, names_stream.get());
-
-  // Build the Section Header stream.
-  scoped_refptr<PdbStream> section_header_stream(new PdbByteStream);
-  if (!WriteSectionHeaderStream(
-          pe_file, section_header_stream->GetWritableStream().get())) {
-    return false;
-  }
-  pdb_file->SetStream(kSectionHeaderStreamIndex, section_header_stream.get());
-
-  // Build the Symbol Record stream.
-  scoped_refptr<PdbStream> symbol_record_stream(new PdbByteStream);
+  // Lay out the Symbol Record stream first, so that the Public stream, which
+  // refers to the records, can be written alongside it.
   SymbolOffsets symbol_offsets;
-  if (!WriteSymbolRecords(symbols, &symbol_offsets,
-                          symbol_record_stream->GetWritableStream().get())) {
-    return false;
+  GetSymbolRecordOffsets(symbols, &symbol_offsets);
+
+  StringTable names;
+  std::vector<std::unique_ptr<StreamWriter>> writers;
+  writers.push_back(std::unique_ptr<StreamWriter>(new StreamWriter(
+      kPdbHeaderInfoStream,
+      base::Bind(&WriteHeaderStream, base::ConstRef(pdb_info),
+                 kNamesStreamIndex))));
+  writers.push_back(std::unique_ptr<StreamWriter>(
+      new StreamWriter(kTpiStream, base::Bind(&WriteEmptyTypeInfoStream))));
+  writers.push_back(std::unique_ptr<StreamWriter>(new StreamWriter(
+      kDbiStream,
+      base::Bind(&WriteDebugInfoStream, pdb_info.pdb_age(),
+                 static_cast<int16_t>(kSymbolRecordStreamIndex),
+                 static_cast<int16_t>(kPublicStreamIndex),
+                 static_cast<int16_t>(kSectionHeaderStreamIndex)))));
+  // The Name Table stream is empty.
+  writers.push_back(std::unique_ptr<StreamWriter>(new StreamWriter(
+      kNamesStreamIndex,
+      base::Bind(&WriteStringTable, base::ConstRef(names)))));
+  writers.push_back(std::unique_ptr<StreamWriter>(new StreamWriter(
+      kSectionHeaderStreamIndex,
+      base::Bind(&WriteSectionHeaderStream, base::ConstRef(pe_file)))));
+  writers.push_back(std::unique_ptr<StreamWriter>(new StreamWriter(
+      kSymbolRecordStreamIndex,
+      base::Bind(&WriteSymbolRecords, base::ConstRef(symbols),
+                 base::ConstRef(symbol_offsets)))));
+  writers.push_back(std::unique_ptr<StreamWriter>(new StreamWriter(
+      kPublicStreamIndex,
+      base::Bind(&WritePublicStream, base::ConstRef(symbols),
+                 base::ConstRef(symbol_offsets)))));
+
+  // The streams are independent, and are written concurrently. Each writer
+  // only touches its own stream.
+  size_t num_threads = std::min(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      writers.size());
+  if (num_threads <= 1) {
+    for (const auto& writer : writers)
+      writer->Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("PdbStreamWriter",
+                                        static_cast<int>(num_threads));
+    for (const auto& writer : writers)
+      pool.AddWork(writer.get());
+    pool.Start();
+    pool.JoinAll();
   }
-  pdb_file->SetStream(kSymbolRecordStreamIndex, symbol_record_stream.get());
 
-  // Build the Public stream.
-  scoped_refptr<PdbStream> public_stream(new PdbByteStream);
-  if (!WritePublicStream(symbols, symbol_offsets,
-                         public_stream->GetWritableStream().get())) {
-    return false;
+  for (const auto& writer : writers) {
+    if (!writer->succeeded()) {
+      LOG(ERROR) << "Failed to write stream " << writer->index() << ".";
+      return false;
+    }
+    pdb_file->SetStream(writer->index(), writer->stream());
   }
-  pdb_file->SetStream(kPublicStreamIndex, public_stream.get());
 
   return true;
 }
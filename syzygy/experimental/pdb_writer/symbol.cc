@@ -15,11 +15,17 @@
 #include "syzygy/experimental/pdb_writer/symbol.h"
 
 #include "base/logging.h"
+#include "syzygy/common/align.h"
 #include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_stream.h"
 
 namespace pdb {
 
+size_t SymbolBaseImpl::GetSize() const {
+  return common::AlignUp(sizeof(SymbolRecordHeader) + GetPayloadSize(),
+                         sizeof(SymbolRecordHeader));
+}
+
 bool SymbolBaseImpl::Write(WritablePdbStream* stream) const {
   DCHECK(stream);
 
@@ -35,7 +41,7 @@ bool SymbolBaseImpl::Write(WritablePdbStream* stream) const {
   // Write the payload of the symbol record.
   if (!WritePayload(stream))
     return false;
-  DCHECK_EQ(stream->pos(), stream->length());
+  DCHECK_EQ(start_pos + sizeof(header) + GetPayloadSize(), stream->pos());
 
   // Add padding.
   if (!stream->Align(sizeof(SymbolRecordHeader)))
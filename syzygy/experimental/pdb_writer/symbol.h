@@ -36,6 +36,9 @@ class Symbol {
   // @returns the symbol type.
   virtual Microsoft_Cci_Pdb::SYM GetType() const = 0;
 
+  // @returns the number of bytes written by Write(), padding included.
+  virtual size_t GetSize() const = 0;
+
   // Writes the symbol to |stream| at the current position.
   // @param stream symbol record stream in which to write the symbol.
   // @returns true in case of success, false otherwise.
@@ -50,10 +53,14 @@ class SymbolBaseImpl : public Symbol {
  public:
   // @name Symbol functions.
   // @{
+  virtual size_t GetSize() const override;
   virtual bool Write(WritablePdbStream* stream) const override;
   // @}
 
  private:
+  // @returns the number of bytes written by WritePayload().
+  virtual size_t GetPayloadSize() const = 0;
+
   // Writes the payload specific to a symbol type. It is expected that the
   // stream position is after the written symbol when the function returns.
   // @param stream symbol record stream in which to write the symbol.
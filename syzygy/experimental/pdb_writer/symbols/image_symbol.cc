@@ -42,6 +42,11 @@ ImageSymbol::ImageSymbol(cci::SYM type,
          type == cci::S_GMANDATA);
 }
 
+size_t ImageSymbol::GetPayloadSize() const {
+  // The name is written with its terminating zero.
+  return kDatasSym32StructSize + name_.size() + 1;
+}
+
 bool ImageSymbol::WritePayload(WritablePdbStream* stream) const {
   DCHECK(stream);
 
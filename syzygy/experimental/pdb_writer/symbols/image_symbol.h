@@ -52,6 +52,7 @@ class ImageSymbol : public TypedSymbolImpl {
  private:
   // @name SymbolBaseImpl functions.
   // @{
+  virtual size_t GetPayloadSize() const override;
   virtual bool WritePayload(WritablePdbStream* stream) const override;
   // @}
 
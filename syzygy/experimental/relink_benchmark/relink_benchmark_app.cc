@@ -0,0 +1,309 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks the decomposition and the relinks of a corpus of images.
+
+#include "syzygy/experimental/relink_benchmark/relink_benchmark_app.h"
+
+#include <memory>
+
+#include "base/files/file_util.h"
+#include "base/strings/string_split.h"
+#include "base/strings/utf_string_conversions.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/instrument/transforms/basic_block_entry_hook_transform.h"
+#include "syzygy/instrument/transforms/coverage_transform.h"
+#include "syzygy/instrument/transforms/entry_thunk_transform.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/pe/pe_relinker.h"
+#include "syzygy/pe/pe_transform_policy.h"
+
+namespace experimental {
+
+namespace {
+
+typedef block_graph::BlockGraphTransformInterface BlockGraphTransform;
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options] IMAGE_FILE [IMAGE_FILE ...]\n"
+    "\n"
+    "  A tool that decomposes and relinks each of the given images, and\n"
+    "  reports the time and the memory taken by each phase as JSON.\n"
+    "\n"
+    "Required parameters:\n"
+    "  --output-dir=DIR     The directory to which the relinked images are\n"
+    "                       written, in a subdirectory per transform.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --json=PATH          The path to which the JSON output should be\n"
+    "                       written. Defaults to the standard output.\n"
+    "  --transforms=LIST    A comma separated list of the transforms with\n"
+    "                       which each image is relinked, among 'none',\n"
+    "                       'calltrace', 'coverage' and 'bbentry'. Defaults\n"
+    "                       to all of them.\n";
+
+// The transforms with which the images may be relinked.
+const char kNoTransform[] = "none";
+const char kCallTraceTransform[] = "calltrace";
+const char kCoverageTransform[] = "coverage";
+const char kBasicBlockEntryTransform[] = "bbentry";
+
+const char* const kTransforms[] = {
+    kNoTransform,
+    kCallTraceTransform,
+    kCoverageTransform,
+    kBasicBlockEntryTransform,
+};
+
+// @param name the name of a transform.
+// @returns the transform, or NULL for kNoTransform.
+std::unique_ptr<BlockGraphTransform> CreateTransform(const std::string& name) {
+  std::unique_ptr<BlockGraphTransform> transform;
+  if (name == kCallTraceTransform)
+    transform.reset(new instrument::transforms::EntryThunkTransform());
+  else if (name == kCoverageTransform)
+    transform.reset(
+        new instrument::transforms::CoverageInstrumentationTransform());
+  else if (name == kBasicBlockEntryTransform)
+    transform.reset(new instrument::transforms::BasicBlockEntryHookTransform());
+  else
+    DCHECK_EQ(std::string(kNoTransform), name);
+  return transform;
+}
+
+bool IsKnownTransform(const std::string& name) {
+  for (size_t i = 0; i < arraysize(kTransforms); ++i) {
+    if (name == kTransforms[i])
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+RelinkBenchmarkApp::RelinkBenchmarkApp()
+    : application::AppImplBase("Relink Benchmark") {
+}
+
+void RelinkBenchmarkApp::PrintUsage(const base::FilePath& program,
+                                    const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool RelinkBenchmarkApp::ParseCommandLine(const base::CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  base::CommandLine::StringVector args = cmd_line->GetArgs();
+  if (args.empty()) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify at least one image!");
+    return false;
+  }
+  for (size_t i = 0; i < args.size(); ++i)
+    image_paths_.push_back(base::MakeAbsoluteFilePath(base::FilePath(args[i])));
+
+  output_dir_ = cmd_line->GetSwitchValuePath("output-dir");
+  if (output_dir_.empty()) {
+    PrintUsage(cmd_line->GetProgram(),
+               "Must specify '--output-dir' parameter!");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("transforms")) {
+    transforms_ = base::SplitString(
+        cmd_line->GetSwitchValueASCII("transforms"), ",",
+        base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+    for (size_t i = 0; i < transforms_.size(); ++i) {
+      if (!IsKnownTransform(transforms_[i])) {
+        PrintUsage(cmd_line->GetProgram(),
+                   "Unknown transform: " + transforms_[i]);
+        return false;
+      }
+    }
+  } else {
+    transforms_.assign(kTransforms, kTransforms + arraysize(kTransforms));
+  }
+
+  json_path_ = cmd_line->GetSwitchValuePath("json");
+
+  return true;
+}
+
+int RelinkBenchmarkApp::Run() {
+  DCHECK(!image_paths_.empty());
+
+  base::ScopedFILE json_output;
+  FILE* json = out();
+  if (!json_path_.empty()) {
+    json_output.reset(base::OpenFile(json_path_, "wb"));
+    if (json_output.get() == NULL) {
+      LOG(ERROR) << "Unable to open \"" << json_path_.value() << "\".";
+      return 1;
+    }
+    json = json_output.get();
+  }
+
+  core::JSONFileWriter json_file(json, true);
+  if (!json_file.OpenDict() || !json_file.OutputKey("images") ||
+      !json_file.OpenList()) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < image_paths_.size(); ++i) {
+    const base::FilePath& image_path = image_paths_[i];
+    LOG(INFO) << "Processing \"" << image_path.value() << "\".";
+
+    if (!json_file.OpenDict() || !json_file.OutputKey("image") ||
+        !json_file.OutputString(image_path.value()) ||
+        !json_file.OutputKey("runs") || !json_file.OpenList()) {
+      return 1;
+    }
+
+    pe::RelinkProfiler decompose_profiler;
+    if (!BenchmarkDecomposition(image_path, &decompose_profiler) ||
+        !WriteRun("decompose", decompose_profiler, &json_file)) {
+      return 1;
+    }
+
+    for (size_t j = 0; j < transforms_.size(); ++j) {
+      pe::RelinkProfiler relink_profiler;
+      if (!BenchmarkRelink(image_path, transforms_[j], &relink_profiler) ||
+          !WriteRun("relink:" + transforms_[j], relink_profiler,
+                    &json_file)) {
+        return 1;
+      }
+    }
+
+    if (!json_file.CloseList() || !json_file.CloseDict())
+      return 1;
+  }
+
+  if (!json_file.CloseList() || !json_file.CloseDict() || !json_file.Flush()) {
+    LOG(ERROR) << "Failed to write the results.";
+    return 1;
+  }
+
+  return 0;
+}
+
+bool RelinkBenchmarkApp::BenchmarkDecomposition(
+    const base::FilePath& image_path, pe::RelinkProfiler* profiler) {
+  DCHECK_NE(static_cast<pe::RelinkProfiler*>(NULL), profiler);
+
+  pe::PEFile pe_file;
+  if (!pe_file.Init(image_path))
+    return false;
+
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  {
+    pe::RelinkProfiler::ScopedPhase phase(profiler, "decompose");
+    pe::Decomposer decomposer(pe_file);
+    if (!decomposer.Decompose(&image_layout)) {
+      LOG(ERROR) << "Unable to decompose \"" << image_path.value() << "\".";
+      return false;
+    }
+  }
+
+  // The subgraphs are discarded as they are built, as a transform would do,
+  // so that the phase measures the decomposer rather than the subgraphs.
+  pe::RelinkProfiler::ScopedPhase phase(profiler, "basic_block_decompose");
+  pe::PETransformPolicy policy;
+  size_t num_decomposed = 0;
+  block_graph::BlockGraph::BlockMap::const_iterator it =
+      block_graph.blocks().begin();
+  for (; it != block_graph.blocks().end(); ++it) {
+    const block_graph::BlockGraph::Block* block = &it->second;
+    if (!policy.BlockIsSafeToBasicBlockDecompose(block))
+      continue;
+    block_graph::BasicBlockSubGraph subgraph;
+    block_graph::BasicBlockDecomposer decomposer(block, &subgraph);
+    if (!decomposer.Decompose()) {
+      LOG(ERROR) << "Unable to basic-block decompose \"" << block->name()
+                 << "\".";
+      return false;
+    }
+    ++num_decomposed;
+  }
+  LOG(INFO) << "Basic-block decomposed " << num_decomposed << " of "
+            << block_graph.blocks().size() << " blocks.";
+
+  return true;
+}
+
+bool RelinkBenchmarkApp::BenchmarkRelink(const base::FilePath& image_path,
+                                         const std::string& transform,
+                                         pe::RelinkProfiler* profiler) {
+  DCHECK_NE(static_cast<pe::RelinkProfiler*>(NULL), profiler);
+
+  base::FilePath output_dir = output_dir_.AppendASCII(transform);
+  if (!base::CreateDirectory(output_dir)) {
+    LOG(ERROR) << "Unable to create \"" << output_dir.value() << "\".";
+    return false;
+  }
+
+  std::unique_ptr<BlockGraphTransform> block_graph_transform(
+      CreateTransform(transform));
+
+  pe::PETransformPolicy policy;
+  pe::PERelinker relinker(&policy);
+  relinker.set_input_path(image_path);
+  relinker.set_output_path(output_dir.Append(image_path.BaseName()));
+  relinker.set_allow_overwrite(true);
+  if (!relinker.Init())
+    return false;
+  if (block_graph_transform.get() != NULL &&
+      !relinker.AppendTransform(block_graph_transform.get())) {
+    return false;
+  }
+  if (!relinker.Relink()) {
+    LOG(ERROR) << "Unable to relink \"" << image_path.value() << "\" with the "
+               << transform << " transform.";
+    return false;
+  }
+
+  const pe::RelinkProfiler::Phases& phases = relinker.profiler().phases();
+  for (size_t i = 0; i < phases.size(); ++i)
+    profiler->AddPhase(phases[i]);
+
+  return true;
+}
+
+bool RelinkBenchmarkApp::WriteRun(const base::StringPiece& name,
+                                  const pe::RelinkProfiler& profiler,
+                                  core::JSONFileWriter* json_file) {
+  DCHECK_NE(static_cast<core::JSONFileWriter*>(NULL), json_file);
+
+  return json_file->OpenDict() &&
+         json_file->OutputKey("name") &&
+         json_file->OutputString(name) &&
+         json_file->OutputKey("profile") &&
+         profiler.WriteJson(json_file) &&
+         json_file->CloseDict();
+}
+
+}  // namespace experimental
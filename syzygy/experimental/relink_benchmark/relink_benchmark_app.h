@@ -0,0 +1,118 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A command line application that benchmarks the phases of the toolchain over
+// a corpus of images: decomposition, basic-block decomposition, and relinks
+// of each image with each of a set of transforms, which cover the transforms
+// themselves, layout and writing. The cost of each phase is recorded by a
+// pe::RelinkProfiler, and the results are written as JSON:
+//
+//   {
+//     "images": [
+//       {
+//         "image": "C:\\src\\out\\Release\\test_dll.dll",
+//         "runs": [
+//           {
+//             "name": "decompose",
+//             "profile": { "phases": [ ... ] }
+//           },
+//           {
+//             "name": "relink:coverage",
+//             "profile": { "phases": [ ... ] }
+//           },
+//           ...
+//         ]
+//       },
+//       ...
+//     ]
+//   }
+//
+// The runs and the phases of each run always come in the same order, so that
+// the results of two builds can be compared phase by phase.
+
+#ifndef SYZYGY_EXPERIMENTAL_RELINK_BENCHMARK_RELINK_BENCHMARK_APP_H_
+#define SYZYGY_EXPERIMENTAL_RELINK_BENCHMARK_RELINK_BENCHMARK_APP_H_
+
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "syzygy/application/application.h"
+#include "syzygy/core/json_file_writer.h"
+#include "syzygy/pe/relink_profiler.h"
+
+namespace experimental {
+
+// This class implements the relink_benchmark command-line utility.
+//
+// See the description given in RelinkBenchmarkApp:::PrintUsage() for
+// information about running this utility.
+class RelinkBenchmarkApp : public application::AppImplBase {
+ public:
+  RelinkBenchmarkApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const base::CommandLine* command_line);
+
+  int Run();
+  // @}
+
+ protected:
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Decomposes an image, then basic-block decomposes each of its blocks that
+  // is safe to decompose.
+  // @param image_path the image to decompose.
+  // @param profiler receives the cost of the two phases.
+  // @returns true on success, false otherwise.
+  bool BenchmarkDecomposition(const base::FilePath& image_path,
+                              pe::RelinkProfiler* profiler);
+
+  // Relinks an image with a transform.
+  // @param image_path the image to relink.
+  // @param transform the name of the transform to apply.
+  // @param profiler receives the cost of the phases of the relink.
+  // @returns true on success, false otherwise.
+  bool BenchmarkRelink(const base::FilePath& image_path,
+                       const std::string& transform,
+                       pe::RelinkProfiler* profiler);
+
+  // Writes a run of the benchmark to the results.
+  // @param name the name of the run.
+  // @param profiler the cost of the phases of the run.
+  // @param json_file the JSON stream to write to.
+  // @returns true on success, false otherwise.
+  static bool WriteRun(const base::StringPiece& name,
+                       const pe::RelinkProfiler& profiler,
+                       core::JSONFileWriter* json_file);
+
+  // @name Command-line options.
+  // @{
+  std::vector<base::FilePath> image_paths_;
+  std::vector<std::string> transforms_;
+  base::FilePath output_dir_;
+  base::FilePath json_path_;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RelinkBenchmarkApp);
+};
+
+}  // namespace experimental
+
+#endif  // SYZYGY_EXPERIMENTAL_RELINK_BENCHMARK_RELINK_BENCHMARK_APP_H_
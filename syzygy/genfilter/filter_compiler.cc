@@ -14,13 +14,17 @@
 
 #include "syzygy/genfilter/filter_compiler.h"
 
+#include <ctype.h>
 #include <stdio.h>
+#include <algorithm>
+#include <memory>
 
 #include "base/bind.h"
 #include "base/files/file_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_com_initializer.h"
 #include "syzygy/common/com_utils.h"
@@ -38,6 +42,14 @@ const char* kRuleTypeStrings[] = { kFunction, kPublicSymbol };
 static_assert(arraysize(kRuleTypeStrings) == FilterCompiler::kRuleTypeCount,
               "Rule type string out of sync.");
 
+// The number of symbols matched by a unit of work.
+const size_t kSymbolBatchSize = 4096;
+
+// The characters of a regex that aren't literals, and those quantifying the
+// character before them.
+const char kRegexMetaCharacters[] = ".[]()*+?{}|^$\\";
+const char kRegexQuantifiers[] = "*+?{";
+
 // Read a newline terminated line from a file. The newline is part of the
 // returned string.
 bool ReadLine(FILE* file, std::string* line) {
@@ -72,6 +84,55 @@ void TrimComment(std::string* s) {
 
 }  // namespace
 
+// Matches a batch of symbols against the rules of a type. The matches are
+// recorded rather than applied, so that batches can be matched concurrently.
+class FilterCompiler::SymbolBatchMatcher
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  typedef std::vector<std::pair<Rule*, Range>> Matches;
+
+  // @param compiler The compiler holding the rules.
+  // @param rule_type The type of the rules to match the symbols against.
+  // @param begin The first symbol of the batch.
+  // @param end The end of the batch.
+  SymbolBatchMatcher(const FilterCompiler* compiler,
+                     RuleType rule_type,
+                     const Symbol* begin,
+                     const Symbol* end)
+      : compiler_(compiler), rule_type_(rule_type), begin_(begin), end_(end) {
+    DCHECK(compiler != NULL);
+    DCHECK(begin != NULL);
+    DCHECK(end != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    RulePointers rules;
+    for (const Symbol* symbol = begin_; symbol != end_; ++symbol) {
+      compiler_->GetCandidateRules(rule_type_, symbol->name, &rules);
+      for (size_t i = 0; i < rules.size(); ++i) {
+        if (rules[i]->regex.FullMatch(symbol->name))
+          matches_.push_back(std::make_pair(rules[i], symbol->range));
+      }
+    }
+  }
+  // @}
+
+  // @returns the rules matched by the symbols of the batch, along with the
+  //     ranges of these symbols.
+  const Matches& matches() const { return matches_; }
+
+ private:
+  const FilterCompiler* compiler_;
+  RuleType rule_type_;
+  const Symbol* begin_;
+  const Symbol* end_;
+  Matches matches_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolBatchMatcher);
+};
+
 bool FilterCompiler::Init(const base::FilePath& image_path) {
   return Init(image_path, base::FilePath());
 }
@@ -217,6 +278,39 @@ bool FilterCompiler::Compile(ImageFilter* filter) {
   return true;
 }
 
+std::string FilterCompiler::GetLiteralPrefix(
+    const base::StringPiece& regex) {
+  const base::StringPiece meta_characters(kRegexMetaCharacters);
+  const base::StringPiece quantifiers(kRegexQuantifiers);
+
+  // Any branch of an alternation may match.
+  if (regex.find('|') != base::StringPiece::npos)
+    return std::string();
+
+  std::string prefix;
+  size_t i = 0;
+  while (i < regex.size()) {
+    char c = regex[i++];
+    if (c == '\\') {
+      // An escaped character other than a letter or a digit is a literal.
+      if (i == regex.size() || ::isalnum(static_cast<uint8_t>(regex[i])))
+        break;
+      c = regex[i++];
+    } else if (meta_characters.find(c) != base::StringPiece::npos) {
+      break;
+    }
+
+    // A quantified character may not be there.
+    if (i < regex.size() &&
+        quantifiers.find(regex[i]) != base::StringPiece::npos) {
+      break;
+    }
+    prefix.push_back(c);
+  }
+
+  return prefix;
+}
+
 bool FilterCompiler::AddRule(ModificationType modification_type,
                              RuleType rule_type,
                              const base::StringPiece& description,
@@ -242,6 +336,12 @@ bool FilterCompiler::AddRule(ModificationType modification_type,
   // Update the vectors of rules by type.
   rules_by_type_[rule_type].push_back(rule_ptr);
 
+  // Index the rule by its literal prefix.
+  std::string prefix = GetLiteralPrefix(description);
+  RuleIndex& rule_index = rule_indices_[rule_type];
+  rule_index.rules_by_prefix[prefix].push_back(rule_ptr);
+  rule_index.prefix_lengths.insert(prefix.size());
+
   return true;
 }
 
@@ -287,9 +387,71 @@ bool FilterCompiler::CrawlSymbols() {
     }
   }
 
+  MatchSymbols();
+
   return true;
 }
 
+void FilterCompiler::MatchSymbols() {
+  std::vector<std::unique_ptr<SymbolBatchMatcher>> batches;
+  for (size_t type = 0; type < kRuleTypeCount; ++type) {
+    const Symbols& symbols = symbols_by_type_[type];
+    for (size_t i = 0; i < symbols.size(); i += kSymbolBatchSize) {
+      size_t end = std::min(i + kSymbolBatchSize, symbols.size());
+      batches.push_back(std::unique_ptr<SymbolBatchMatcher>(
+          new SymbolBatchMatcher(this, static_cast<RuleType>(type),
+                                 symbols.data() + i, symbols.data() + end)));
+    }
+  }
+
+  size_t num_threads = std::min(num_threads_, batches.size());
+  if (num_threads > 1) {
+    base::DelegateSimpleThreadPool pool("FilterCompiler",
+                                        static_cast<int>(num_threads));
+    for (size_t i = 0; i < batches.size(); ++i)
+      pool.AddWork(batches[i].get());
+    pool.Start();
+    pool.JoinAll();
+  } else {
+    for (size_t i = 0; i < batches.size(); ++i)
+      batches[i]->Run();
+  }
+
+  // The ranges of the rules are only updated once all the batches are
+  // matched, as they aren't thread safe.
+  for (size_t i = 0; i < batches.size(); ++i) {
+    const SymbolBatchMatcher::Matches& matches = batches[i]->matches();
+    for (size_t j = 0; j < matches.size(); ++j)
+      matches[j].first->ranges.Mark(matches[j].second);
+  }
+
+  for (size_t type = 0; type < kRuleTypeCount; ++type)
+    Symbols().swap(symbols_by_type_[type]);
+}
+
+void FilterCompiler::GetCandidateRules(RuleType rule_type,
+                                       const std::string& name,
+                                       RulePointers* rules) const {
+  DCHECK_LE(0, rule_type);
+  DCHECK_GT(kRuleTypeCount, rule_type);
+  DCHECK(rules != NULL);
+
+  rules->clear();
+  const RuleIndex& rule_index = rule_indices_[rule_type];
+  std::set<size_t>::const_iterator length_it =
+      rule_index.prefix_lengths.begin();
+  for (; length_it != rule_index.prefix_lengths.end() &&
+             *length_it <= name.size();
+       ++length_it) {
+    std::map<std::string, RulePointers>::const_iterator prefix_it =
+        rule_index.rules_by_prefix.find(name.substr(0, *length_it));
+    if (prefix_it != rule_index.rules_by_prefix.end()) {
+      rules->insert(rules->end(), prefix_it->second.begin(),
+                    prefix_it->second.end());
+    }
+  }
+}
+
 bool FilterCompiler::FillFilter(ImageFilter* filter) {
   DCHECK(filter != NULL);
 
@@ -335,20 +497,21 @@ bool FilterCompiler::OnCompiland(IDiaSymbol* compiland) {
 
 bool FilterCompiler::OnFunction(IDiaSymbol* function) {
   DCHECK(function != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kFunctionRule], function))
+  if (!CollectSymbol(kFunctionRule, function))
     return false;
   return true;
 }
 
 bool FilterCompiler::OnPublicSymbol(IDiaSymbol* public_symbol) {
   DCHECK(public_symbol != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kPublicSymbolRule], public_symbol))
+  if (!CollectSymbol(kPublicSymbolRule, public_symbol))
     return false;
   return true;
 }
 
-bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
-                                            IDiaSymbol* symbol) {
+bool FilterCompiler::CollectSymbol(RuleType rule_type, IDiaSymbol* symbol) {
+  DCHECK_LE(0, rule_type);
+  DCHECK_GT(kRuleTypeCount, rule_type);
   DCHECK(symbol != NULL);
 
   // Get the symbol properties.
@@ -372,13 +535,9 @@ bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
     return false;
   }
 
-  // Look for any matching rules and update the associated image ranges.
-  RulePointers::const_iterator it = rules.begin();
-  for (; it != rules.end(); ++it) {
-    Rule* rule = *it;
-    if (rule->regex.FullMatch(name))
-      rule->ranges.Mark(Range(RelativeAddress(rva), length));
-  }
+  // The symbol is matched against the rules once the crawl is done.
+  Symbol collected = {name, Range(RelativeAddress(rva), length)};
+  symbols_by_type_[rule_type].push_back(collected);
 
   return true;
 }
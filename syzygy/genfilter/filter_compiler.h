@@ -34,12 +34,20 @@
 //                  name.
 //
 // Comments may be specified using the '#' character.
+//
+// The rules of each type are indexed by the literal prefix of their regex, so
+// that a symbol is only matched against the rules that may match its name.
+// The symbols are collected in a single crawl of the PDB, then matched in
+// batches that may be spread over several threads.
 
 #ifndef SYZYGY_GENFILTER_FILTER_COMPILER_H_
 #define SYZYGY_GENFILTER_FILTER_COMPILER_H_
 
 #include <dia2.h>
 #include <map>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/pe/image_filter.h"
@@ -71,14 +79,22 @@ class FilterCompiler {
   };
 
   // Constructor.
-  FilterCompiler() { }
+  FilterCompiler() : num_threads_(1) { }
 
   // @name Accessors.
   // @{
   const base::FilePath& image_path() const { return image_path_; }
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  size_t num_threads() const { return num_threads_; }
   // @}
 
+  // Sets the number of threads matching the symbols against the rules.
+  // @param num_threads The number of threads, which must be at least 1.
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0u, num_threads);
+    num_threads_ = num_threads;
+  }
+
   // Initializes this filter generator. Logs verbosely on failure.
   // @param image_path The path to the image for which a filter is being
   //     generated.
@@ -113,13 +129,36 @@ class FilterCompiler {
   bool Compile(ImageFilter* filter);
 
  protected:
-  // Forward declaration.
+  // Forward declarations.
   struct Rule;
+  class SymbolBatchMatcher;
 
   typedef pcrecpp::RE RE;
   typedef std::map<size_t, Rule> RuleMap;
   typedef std::vector<Rule*> RulePointers;
 
+  // The rules of a type, keyed by the literal prefix of their regex. The
+  // lengths of the prefixes are kept so that the prefixes of a name can be
+  // looked up directly.
+  struct RuleIndex {
+    std::map<std::string, RulePointers> rules_by_prefix;
+    std::set<size_t> prefix_lengths;
+  };
+
+  // A symbol collected while crawling the PDB.
+  struct Symbol {
+    std::string name;
+    Range range;
+  };
+  typedef std::vector<Symbol> Symbols;
+
+  // Returns the literal prefix of all the names fully matched by a regex.
+  // This is conservative, and is empty when the regex starts with anything
+  // but a literal or alternates between several patterns.
+  // @param regex The regex pattern.
+  // @returns the literal prefix of the pattern.
+  static std::string GetLiteralPrefix(const base::StringPiece& regex);
+
   // Adds a rule with explicit source information to this filter compiler.
   // @param modification_type The way the filter is modified upon successful
   //     matching of this rule.
@@ -135,10 +174,22 @@ class FilterCompiler {
                const base::StringPiece& source_info);
 
   // Crawls the symbols matching rules. Delegates to the various symbol
-  // visitors.
+  // visitors, then to MatchSymbols.
   // @returns true on success, false otherwise.
   bool CrawlSymbols();
 
+  // Matches the symbols collected by the crawl against the rules, updating
+  // the ranges of the matched rules.
+  void MatchSymbols();
+
+  // Looks up the rules whose literal prefix is a prefix of a name.
+  // @param rule_type The type of the rules to look up.
+  // @param name The name of a symbol.
+  // @param rules Receives the rules that may match @p name.
+  void GetCandidateRules(RuleType rule_type,
+                         const std::string& name,
+                         RulePointers* rules) const;
+
   // Fills in the filter using cached symbol match data in the rules.
   // @param filter The filter to be filled in.
   bool FillFilter(ImageFilter* filter);
@@ -150,11 +201,11 @@ class FilterCompiler {
   bool OnPublicSymbol(IDiaSymbol* public_symbol);
   // @}
 
-  // Matches a symbol by name against rules in the given vector. Called by
-  // OnPublicSymbol and OnFunction.
-  // @param rules The vector of rules to be inspected for a symbol match.
+  // Collects a symbol to be matched by name against the rules of the given
+  // type. Called by OnPublicSymbol and OnFunction.
+  // @param rule_type The type of the rules to match the symbol against.
   // @param symbol The symbol to inspect.
-  bool MatchRulesBySymbolName(const RulePointers& rules, IDiaSymbol* symbol);
+  bool CollectSymbol(RuleType rule_type, IDiaSymbol* symbol);
 
   base::FilePath image_path_;
   base::FilePath pdb_path_;
@@ -168,6 +219,16 @@ class FilterCompiler {
   // symbols
   RulePointers rules_by_type_[kRuleTypeCount];
 
+  // The rules by type, indexed by their literal prefixes.
+  RuleIndex rule_indices_[kRuleTypeCount];
+
+  // The symbols collected while crawling, by the type of rule they are to be
+  // matched against.
+  Symbols symbols_by_type_[kRuleTypeCount];
+
+  // The number of threads matching the symbols.
+  size_t num_threads_;
+
   DISALLOW_COPY_AND_ASSIGN(FilterCompiler);
 };
 
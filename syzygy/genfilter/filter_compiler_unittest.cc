@@ -30,6 +30,8 @@ class TestFilterCompiler : public FilterCompiler {
   using FilterCompiler::RuleMap;
   using FilterCompiler::RulePointers;
 
+  using FilterCompiler::GetCandidateRules;
+  using FilterCompiler::GetLiteralPrefix;
   using FilterCompiler::rule_map_;
   using FilterCompiler::rules_by_type_;
 
@@ -95,6 +97,7 @@ TEST_F(FilterCompilerTest, Constructor) {
   TestFilterCompiler fc;
   EXPECT_TRUE(fc.image_path().empty());
   EXPECT_TRUE(fc.pdb_path().empty());
+  EXPECT_EQ(1u, fc.num_threads());
   EXPECT_TRUE(fc.rule_map_.empty());
   for (size_t i = 0; i < arraysize(fc.rules_by_type_); ++i) {
     EXPECT_TRUE(fc.rules_by_type_[i].empty());
@@ -172,6 +175,40 @@ TEST_F(FilterCompilerTest, AddRule) {
   EXPECT_EQ(1u, fc.rules_by_type_[FilterCompiler::kPublicSymbolRule].size());
 }
 
+TEST_F(FilterCompilerTest, GetLiteralPrefix) {
+  EXPECT_EQ("DllMain", TestFilterCompiler::GetLiteralPrefix("DllMain"));
+  EXPECT_EQ("foo::", TestFilterCompiler::GetLiteralPrefix("foo::.*"));
+  EXPECT_EQ("?function1",
+            TestFilterCompiler::GetLiteralPrefix("\\?function1.*"));
+  EXPECT_EQ("fo", TestFilterCompiler::GetLiteralPrefix("foo?bar"));
+  EXPECT_EQ("foo", TestFilterCompiler::GetLiteralPrefix("foo\\d+"));
+  EXPECT_EQ("", TestFilterCompiler::GetLiteralPrefix("foo|bar"));
+  EXPECT_EQ("", TestFilterCompiler::GetLiteralPrefix("(?i)foo"));
+  EXPECT_EQ("", TestFilterCompiler::GetLiteralPrefix("[fb]oo"));
+}
+
+TEST_F(FilterCompilerTest, GetCandidateRules) {
+  TestFilterCompiler fc;
+  ASSERT_TRUE(fc.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kFunctionRule, "foo::.*"));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kFunctionRule, "foo::bar"));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kFunctionRule, ".*bar"));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kPublicSymbolRule, "foo::bar"));
+
+  TestFilterCompiler::RulePointers rules;
+  fc.GetCandidateRules(FilterCompiler::kFunctionRule, "foo::bar", &rules);
+  EXPECT_EQ(3u, rules.size());
+  fc.GetCandidateRules(FilterCompiler::kFunctionRule, "foo::baz", &rules);
+  EXPECT_EQ(2u, rules.size());
+  fc.GetCandidateRules(FilterCompiler::kFunctionRule, "qux::bar", &rules);
+  ASSERT_EQ(1u, rules.size());
+  EXPECT_EQ(2u, rules[0]->index);
+}
+
 TEST_F(FilterCompilerTest, ParseFilterDescriptionFileMissingFile) {
   DisableLogging();
 
@@ -252,4 +289,31 @@ TEST_F(FilterCompilerTest, Compile) {
   EXPECT_LT(0u, filter.filter.size());
 }
 
+TEST_F(FilterCompilerTest, CompileInParallel) {
+  ASSERT_NO_FATAL_FAILURE(CreateFilterDescriptionFile());
+
+  TestFilterCompiler fc1;
+  ASSERT_TRUE(fc1.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc1.ParseFilterDescriptionFile(filter_txt_));
+  pe::ImageFilter filter1;
+  EXPECT_TRUE(fc1.Compile(&filter1));
+
+  TestFilterCompiler fc2;
+  fc2.set_num_threads(4);
+  ASSERT_TRUE(fc2.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc2.ParseFilterDescriptionFile(filter_txt_));
+  ASSERT_TRUE(fc2.AddRule(FilterCompiler::kAddToFilter,
+                          FilterCompiler::kFunctionRule, ".*"));
+  ASSERT_TRUE(fc2.AddRule(FilterCompiler::kSubtractFromFilter,
+                          FilterCompiler::kFunctionRule, ".*"));
+  pe::ImageFilter filter2;
+  EXPECT_TRUE(fc2.Compile(&filter2));
+
+  // The rules match the same symbols on several threads, alongside rules
+  // that match every function.
+  EXPECT_EQ(fc1.rule(0).ranges, fc2.rule(0).ranges);
+  EXPECT_EQ(fc1.rule(2).ranges, fc2.rule(2).ranges);
+  EXPECT_LT(0u, fc2.rule(3).ranges.size());
+}
+
 }  // namespace genfilter
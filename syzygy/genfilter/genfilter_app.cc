@@ -15,6 +15,7 @@
 #include "syzygy/genfilter/genfilter_app.h"
 
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/genfilter/filter_compiler.h"
@@ -65,7 +66,10 @@ const char kUsageFormatStr[] =
     "    The path of the module for which the filter is being generated.\n"
     "  --input-pdb=<path>                                          [OPTIONAL]\n"
     "    The path of the PDB corresponding to the input module. If not\n"
-    "    specified this will be searched for.\n";
+    "    specified this will be searched for.\n"
+    "  --match-threads=<count>                                     [OPTIONAL]\n"
+    "    The number of threads matching the symbols of the PDB against the\n"
+    "    rules. Defaults to 1.\n";
 
 // Applies the given action to a set of filters. Assumes that all of the filters
 // are already verified as belonging to the same module.
@@ -157,6 +161,16 @@ bool GenFilterApp::ParseCommandLine(const base::CommandLine* command_line) {
       return false;
     }
     input_pdb_ = command_line->GetSwitchValuePath("input-pdb");
+
+    if (command_line->HasSwitch("match-threads")) {
+      if (!base::StringToSizeT(
+              command_line->GetSwitchValueASCII("match-threads"),
+              &match_threads_) ||
+          match_threads_ == 0) {
+        PrintUsage(command_line, "Invalid value for '--match-threads'.");
+        return false;
+      }
+    }
   } else if (base::LowerCaseEqualsASCII(action, "intersect")) {
     action_ = kIntersect;
     min_inputs = 2;
@@ -230,6 +244,7 @@ void GenFilterApp::PrintUsage(const base::CommandLine* command_line,
 
 bool GenFilterApp::RunCompileAction() {
   FilterCompiler filter_compiler;
+  filter_compiler.set_num_threads(match_threads_);
 
   if (!filter_compiler.Init(input_image_, input_pdb_))
     return false;
@@ -43,7 +43,8 @@ class GenFilterApp : public application::AppImplBase {
       : application::AppImplBase("GenFilterApp"),
         action_(kCompile),
         pretty_print_(false),
-        overwrite_(false) {
+        overwrite_(false),
+        match_threads_(1) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -72,6 +73,7 @@ class GenFilterApp : public application::AppImplBase {
   std::vector<base::FilePath> inputs_;
   bool overwrite_;
   bool pretty_print_;
+  size_t match_threads_;
 };
 
 }  // namespace genfilter
@@ -34,6 +34,7 @@ class TestGenFilterApp : public GenFilterApp {
   using GenFilterApp::inputs_;
   using GenFilterApp::pretty_print_;
   using GenFilterApp::overwrite_;
+  using GenFilterApp::match_threads_;
 };
 
 class GenFilterAppTest : public testing::PELibUnitTest {
@@ -197,6 +198,7 @@ TEST_F(GenFilterAppTest, ParseCommandLineMinimal) {
   EXPECT_EQ(1u, impl_.inputs_.size());
   EXPECT_FALSE(impl_.overwrite_);
   EXPECT_FALSE(impl_.pretty_print_);
+  EXPECT_EQ(1u, impl_.match_threads_);
 }
 
 TEST_F(GenFilterAppTest, ParseCommandLineFull) {
@@ -212,6 +214,7 @@ TEST_F(GenFilterAppTest, ParseCommandLineFull) {
   cmd_line_.AppendSwitchPath("output-file", output_file_);
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("pretty-print");
+  cmd_line_.AppendSwitchASCII("match-threads", "4");
   ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
   EXPECT_EQ(GenFilterApp::kCompile, impl_.action_);
   EXPECT_EQ(test_dll_, impl_.input_image_);
@@ -220,6 +223,18 @@ TEST_F(GenFilterAppTest, ParseCommandLineFull) {
   EXPECT_EQ(2u, impl_.inputs_.size());
   EXPECT_TRUE(impl_.overwrite_);
   EXPECT_TRUE(impl_.pretty_print_);
+  EXPECT_EQ(4u, impl_.match_threads_);
+}
+
+TEST_F(GenFilterAppTest, ParseCommandLineFailsInvalidMatchThreads) {
+  base::FilePath foo_txt;
+  ASSERT_NO_FATAL_FAILURE(MakeFile(L"foo.txt", &foo_txt));
+
+  cmd_line_.AppendArgPath(foo_txt);
+  cmd_line_.AppendSwitchASCII("action", "compile");
+  cmd_line_.AppendSwitchPath("input-image", test_dll_);
+  cmd_line_.AppendSwitchASCII("match-threads", "0");
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
 }
 
 TEST_F(GenFilterAppTest, ParseCommandLineInvertFailsWithMultipleInputs) {
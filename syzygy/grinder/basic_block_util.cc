@@ -17,8 +17,10 @@
 
 #include "syzygy/grinder/basic_block_util.h"
 
+#include <emmintrin.h>
 #include <algorithm>
 #include <functional>
+#include <limits>
 
 #include "syzygy/common/binary_stream.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -89,14 +91,16 @@ bool FindIndexedFrequencyInfo(
 
 bool LoadBranchStatisticsFromFile(const base::FilePath& file,
                                   const pe::PEFile::Signature& signature,
-                                  IndexedFrequencyMap* frequencies) {
+                                  IndexedFrequencyMap* frequencies,
+                                  uint8_t* frequency_size) {
   DCHECK(!file.empty());
   DCHECK_NE(reinterpret_cast<IndexedFrequencyMap*>(NULL), frequencies);
+  DCHECK_NE(reinterpret_cast<uint8_t*>(NULL), frequency_size);
 
-  // Load profile information from JSON file.
+  // Load profile information from a JSON or binary file.
   ModuleIndexedFrequencyMap module_entry_count_map;
   IndexedFrequencyDataSerializer serializer;
-  if (!serializer.LoadFromJson(file, &module_entry_count_map)) {
+  if (!serializer.Load(file, &module_entry_count_map)) {
     LOG(ERROR) << "Failed to load profile information.";
     return false;
   }
@@ -116,9 +120,12 @@ bool LoadBranchStatisticsFromFile(const base::FilePath& file,
   // Validate that the data is in the expected format.
   DCHECK_EQ(3U, branch_statistics->num_columns);
   DCHECK_EQ(common::IndexedFrequencyData::BRANCH, branch_statistics->data_type);
-  DCHECK_EQ(4U, branch_statistics->frequency_size);
+  // The counts of 8-bit counters are sums of values saturated at 255, which
+  // are used as they are.
+  DCHECK(IsValidFrequencySize(branch_statistics->frequency_size));
 
   *frequencies = branch_statistics->frequency_map;
+  *frequency_size = branch_statistics->frequency_size;
   return true;
 }
 
@@ -256,5 +263,53 @@ uint32_t GetFrequency(const TraceIndexedFrequencyData* data,
   return 0;
 }
 
+void AddCounts(const uint32_t* counts, size_t num_counts, uint32_t* totals) {
+  DCHECK(counts != NULL || num_counts == 0);
+  DCHECK(totals != NULL || num_counts == 0);
+
+  // A sum overflowed if it is less than either of its terms. SSE2 only
+  // compares signed integers, so the terms are compared with their sign bits
+  // flipped, and the sums that overflowed are saturated by OR-ing them with
+  // the comparison mask.
+  const __m128i sign = _mm_set1_epi32(0x80000000);
+  size_t i = 0;
+  for (; i + 4 <= num_counts; i += 4) {
+    __m128i* total = reinterpret_cast<__m128i*>(totals + i);
+    __m128i a = _mm_loadu_si128(total);
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i));
+    __m128i sum = _mm_add_epi32(a, b);
+    __m128i overflow = _mm_cmpgt_epi32(_mm_xor_si128(a, sign),
+                                       _mm_xor_si128(sum, sign));
+    _mm_storeu_si128(total, _mm_or_si128(sum, overflow));
+  }
+
+  for (; i < num_counts; ++i) {
+    totals[i] += std::min(counts[i],
+                          std::numeric_limits<uint32_t>::max() - totals[i]);
+  }
+}
+
+void AddFrequencies(const TraceIndexedFrequencyData* data,
+                    size_t column,
+                    uint32_t* totals) {
+  DCHECK(data != NULL);
+  DCHECK(IsValidFrequencySize(data->frequency_size));
+  DCHECK_LT(column, data->num_columns);
+  DCHECK(totals != NULL);
+
+  // Single column 32-bit frequencies are already an array of counts.
+  if (data->frequency_size == sizeof(uint32_t) && data->num_columns == 1) {
+    AddCounts(reinterpret_cast<const uint32_t*>(data->frequency_data),
+              data->num_entries, totals);
+    return;
+  }
+
+  for (size_t bb_id = 0; bb_id < data->num_entries; ++bb_id) {
+    uint32_t frequency = GetFrequency(data, bb_id, column);
+    totals[bb_id] += std::min(
+        frequency, std::numeric_limits<uint32_t>::max() - totals[bb_id]);
+  }
+}
+
 }  // namespace basic_block_util
 }  // namespace grinder
@@ -101,10 +101,13 @@ bool FindIndexedFrequencyInfo(
 // @param file the file containing branching information.
 // @param signature the signature of the module to retrieve.
 // @param frequencies receives the module branch frequencies.
+// @param frequency_size receives the size in bytes of the counters that
+//     gathered @p frequencies.
 // @returns true on success, false otherwise.
 bool LoadBranchStatisticsFromFile(const base::FilePath& file,
                                   const pe::PEFile::Signature& signature,
-                                  IndexedFrequencyMap* frequencies);
+                                  IndexedFrequencyMap* frequencies,
+                                  uint8_t* frequency_size);
 
 // A helper function to populate @p bb_ranges from the PDB file given by
 // @p pdb_path.
@@ -132,6 +135,22 @@ uint32_t GetFrequency(const TraceIndexedFrequencyData* data,
                       size_t bb_id,
                       size_t column);
 
+// Adds an array of counts to another, element by element, using saturation
+// arithmetic. This processes several counts per instruction.
+// @param counts the counts to add.
+// @param num_counts the number of elements of @p counts and @p totals.
+// @param totals the counts to add to.
+void AddCounts(const uint32_t* counts, size_t num_counts, uint32_t* totals);
+
+// Adds a column of the frequencies contained in @p data to an array of
+// counts indexed by basic-block, using saturation arithmetic.
+// @param data the frequency data.
+// @param column the column to add.
+// @param totals the counts to add to, of @p data->num_entries elements.
+void AddFrequencies(const TraceIndexedFrequencyData* data,
+                    size_t column,
+                    uint32_t* totals);
+
 }  // namespace basic_block_util
 }  // namespace grinder
 
@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/basic_block_util.h"
 
+#include <limits>
+
 #include "base/files/scoped_temp_dir.h"
 #include "base/win/scoped_com_initializer.h"
 #include "gmock/gmock.h"
@@ -182,16 +184,19 @@ TEST(GrinderBasicBlockUtilTest, LoadBranchStatisticsFromFileFailed) {
 
   // Validate non existing file is reported.
   IndexedFrequencyMap frequencies;
+  uint8_t frequency_size = 0;
   base::FilePath invalid_path(L"this_file_doesnt_exists");
   EXPECT_FALSE(
-      LoadBranchStatisticsFromFile(invalid_path, signature, &frequencies));
+      LoadBranchStatisticsFromFile(invalid_path, signature, &frequencies,
+                                   &frequency_size));
 
   // Validate invalid file format is reported.
   base::FilePath empty_file;
   ASSERT_TRUE(
       base::CreateTemporaryFileInDir(temp_dir.path(), &empty_file));
   EXPECT_FALSE(
-      LoadBranchStatisticsFromFile(empty_file, signature, &frequencies));
+      LoadBranchStatisticsFromFile(empty_file, signature, &frequencies,
+                                   &frequency_size));
 
   // Serialize to a file without any module.
   base::FilePath temp_file;
@@ -202,7 +207,8 @@ TEST(GrinderBasicBlockUtilTest, LoadBranchStatisticsFromFileFailed) {
 
   // Expect to not find the module with the current signature.
   EXPECT_FALSE(
-      LoadBranchStatisticsFromFile(temp_file, signature, &frequencies));
+      LoadBranchStatisticsFromFile(temp_file, signature, &frequencies,
+                                   &frequency_size));
 }
 
 TEST(GrinderBasicBlockUtilTest, LoadBranchStatisticsFromFile) {
@@ -232,8 +238,11 @@ TEST(GrinderBasicBlockUtilTest, LoadBranchStatisticsFromFile) {
 
   // Expect to find the module with the current signature.
   IndexedFrequencyMap frequencies;
+  uint8_t frequency_size = 0;
   EXPECT_TRUE(
-      LoadBranchStatisticsFromFile(temp_file, signature, &frequencies));
+      LoadBranchStatisticsFromFile(temp_file, signature, &frequencies,
+                                   &frequency_size));
+  EXPECT_EQ(4U, frequency_size);
 }
 
 TEST(GrinderBasicBlockUtilTest, LoadBasicBlockRanges) {
@@ -354,5 +363,59 @@ TEST(GrinderBasicBlockUtilTest, GetFrequencyWithColumns) {
   EXPECT_EQ(0x77665544, GetFrequency(data, 0x0, 1));
 }
 
+TEST(GrinderBasicBlockUtilTest, AddCounts) {
+  // An odd number of counts exercises both the vector and the scalar loops.
+  const uint32_t kMax = std::numeric_limits<uint32_t>::max();
+  const uint32_t kCounts[] = {0, 1, 2, kMax, 0x80000000, 7, kMax};
+  uint32_t totals[] = {5, 0, kMax - 1, 1, 0x80000000, 0x7FFFFFFF, 0};
+  const uint32_t kExpected[] = {5, 1, kMax, kMax, kMax, 0x80000006, kMax};
+
+  AddCounts(kCounts, arraysize(kCounts), totals);
+  for (size_t i = 0; i < arraysize(kExpected); ++i)
+    EXPECT_EQ(kExpected[i], totals[i]);
+}
+
+TEST(GrinderBasicBlockUtilTest, AddFrequencies) {
+  static const uint8_t kData[] = {
+      0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00};
+
+  uint8_t buffer[sizeof(TraceIndexedFrequencyData) + sizeof(kData) - 1] = {};
+  TraceIndexedFrequencyData* data =
+      reinterpret_cast<TraceIndexedFrequencyData*>(buffer);
+  ::memcpy(data->frequency_data, kData, sizeof(kData));
+  data->data_type = common::IndexedFrequencyData::COVERAGE;
+
+  // Single column 4-byte frequency data.
+  data->num_columns = 1;
+  data->frequency_size = 4;
+  data->num_entries = 3;
+  uint32_t totals[6] = {10, 20, 30};
+  AddFrequencies(data, 0, totals);
+  EXPECT_EQ(11u, totals[0]);
+  EXPECT_EQ(22u, totals[1]);
+  EXPECT_EQ(33u, totals[2]);
+
+  // 2-byte frequency data with 2 columns.
+  data->num_columns = 2;
+  data->frequency_size = 2;
+  data->num_entries = 3;
+  AddFrequencies(data, 0, totals);
+  EXPECT_EQ(12u, totals[0]);
+  EXPECT_EQ(24u, totals[1]);
+  EXPECT_EQ(36u, totals[2]);
+
+  // 1-byte frequency data.
+  data->num_columns = 1;
+  data->frequency_size = 1;
+  data->num_entries = 6;
+  AddFrequencies(data, 0, totals);
+  EXPECT_EQ(13u, totals[0]);
+  EXPECT_EQ(24u, totals[1]);
+  EXPECT_EQ(36u, totals[2]);
+  EXPECT_EQ(0u, totals[3]);
+  EXPECT_EQ(2u, totals[4]);
+  EXPECT_EQ(0u, totals[5]);
+}
+
 }  // namespace basic_block_util
 }  // namespace grinder
@@ -0,0 +1,63 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/flame_graph_writer.h"
+
+#include "base/logging.h"
+
+namespace grinder {
+
+FlameGraphWriter::FlameGraphWriter(FILE* file) : file_(file) {
+  DCHECK(file != NULL);
+}
+
+void FlameGraphWriter::AppendFrame(const base::StringPiece& frame,
+                                   std::string* stack) {
+  DCHECK(stack != NULL);
+
+  if (!stack->empty())
+    stack->push_back(';');
+
+  // A frame can't hold the frame separator, nor the line separator. Spaces
+  // are fine, as the value is split off at the last one.
+  for (size_t i = 0; i < frame.size(); ++i) {
+    char c = frame[i];
+    if (c == ';')
+      c = ':';
+    else if (c == '\n' || c == '\r')
+      c = ' ';
+    stack->push_back(c);
+  }
+
+  if (frame.empty())
+    stack->append("[unknown]");
+}
+
+bool FlameGraphWriter::WriteStack(const base::StringPiece& stack,
+                                  uint64_t value) {
+  DCHECK(!stack.empty());
+
+  if (value == 0)
+    return true;
+
+  if (::fwrite(stack.data(), 1, stack.size(), file_) != stack.size() ||
+      ::fprintf(file_, " %llu\n", value) <= 0) {
+    LOG(ERROR) << "Failed to write flame graph stack.";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace grinder
@@ -0,0 +1,62 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a writer of flame graphs in the collapsed stack format, which is
+// read by flamegraph.pl, speedscope and most other flame graph viewers. Each
+// line of the format is a stack of semicolon separated frames, outermost
+// first, followed by a space and the value of the innermost frame:
+//
+//   main;RunLoop;Paint 1200
+//
+// The value of a frame is the sum of the values of the stacks it leads, so
+// stacks are written one at a time and nothing is held in memory.
+
+#ifndef SYZYGY_GRINDER_FLAME_GRAPH_WRITER_H_
+#define SYZYGY_GRINDER_FLAME_GRAPH_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+
+namespace grinder {
+
+class FlameGraphWriter {
+ public:
+  // @param file the file the stacks are written to.
+  explicit FlameGraphWriter(FILE* file);
+
+  // Appends a frame to a stack. The separators of the collapsed stack format
+  // are replaced in the name of the frame.
+  // @param frame the name of the frame.
+  // @param stack the stack to be appended to.
+  static void AppendFrame(const base::StringPiece& frame, std::string* stack);
+
+  // Writes a stack. Stacks with no value are skipped.
+  // @param stack the stack, as built by AppendFrame.
+  // @param value the value of the innermost frame of @p stack.
+  // @returns true on success, false on failure to write.
+  bool WriteStack(const base::StringPiece& stack, uint64_t value);
+
+ private:
+  FILE* file_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlameGraphWriter);
+};
+
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_FLAME_GRAPH_WRITER_H_
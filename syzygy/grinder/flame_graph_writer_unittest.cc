@@ -0,0 +1,54 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/flame_graph_writer.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace grinder {
+
+TEST(FlameGraphWriterTest, AppendFrame) {
+  std::string stack;
+  FlameGraphWriter::AppendFrame("main", &stack);
+  EXPECT_EQ("main", stack);
+  FlameGraphWriter::AppendFrame("operator; ()", &stack);
+  EXPECT_EQ("main;operator: ()", stack);
+  FlameGraphWriter::AppendFrame("a\nb", &stack);
+  EXPECT_EQ("main;operator: ();a b", stack);
+  FlameGraphWriter::AppendFrame("", &stack);
+  EXPECT_EQ("main;operator: ();a b;[unknown]", stack);
+}
+
+TEST(FlameGraphWriterTest, WriteStack) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().Append(L"stacks.txt");
+
+  {
+    base::ScopedFILE file(base::OpenFile(path, "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    FlameGraphWriter writer(file.get());
+    EXPECT_TRUE(writer.WriteStack("main", 10));
+    EXPECT_TRUE(writer.WriteStack("main;Skipped", 0));
+    EXPECT_TRUE(writer.WriteStack("main;Foo", 0x100000000ULL));
+  }
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  EXPECT_EQ("main 10\nmain;Foo 4294967296\n", contents);
+}
+
+}  // namespace grinder
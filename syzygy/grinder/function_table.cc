@@ -0,0 +1,344 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/function_table.h"
+
+#include <algorithm>
+#include <map>
+
+#include "base/files/file_util.h"
+#include "base/win/scoped_bstr.h"
+#include "base/win/scoped_comptr.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/core/serialization.h"
+
+namespace grinder {
+
+namespace {
+
+using base::win::ScopedBstr;
+using base::win::ScopedComPtr;
+
+typedef std::map<DWORD, uint32_t> SourceFileIndexMap;
+
+// Orders functions and lines by address.
+template<typename T>
+bool RvaLess(const T& a, const T& b) {
+  return a.rva < b.rva;
+}
+
+template<typename T>
+bool RvaEqual(const T& a, const T& b) {
+  return a.rva == b.rva;
+}
+
+// Returns true if @p line ends at or before @p rva. A zero-length line is
+// treated as covering its single address.
+bool LineEndsBefore(const FunctionTable::Line& line, uint32_t rva) {
+  return line.rva + std::max(line.length, 1U) <= rva;
+}
+
+// Reads the symbols with @p sym_tag that are children of @p global, sorted
+// by address. Only the first of the symbols sharing an address is kept.
+bool LoadFunctions(IDiaSymbol* global,
+                   enum SymTagEnum sym_tag,
+                   FunctionTable::Functions* functions) {
+  DCHECK(global != NULL);
+  DCHECK(functions != NULL);
+
+  ScopedComPtr<IDiaEnumSymbols> enum_symbols;
+  HRESULT hr = global->findChildren(sym_tag, NULL, nsNone,
+                                    enum_symbols.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in findChildren: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  LONG count = 0;
+  hr = enum_symbols->get_Count(&count);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_Count: " << common::LogHr(hr) << ".";
+    return false;
+  }
+  functions->reserve(count);
+
+  while (true) {
+    ScopedComPtr<IDiaSymbol> symbol;
+    ULONG fetched = 0;
+    hr = enum_symbols->Next(1, symbol.Receive(), &fetched);
+    if (hr != S_OK || fetched != 1)
+      break;
+
+    // Symbols without an address, such as imports, can't be looked up.
+    DWORD rva = 0;
+    if (symbol->get_relativeVirtualAddress(&rva) != S_OK || rva == 0)
+      continue;
+
+    ULONGLONG length = 0;
+    hr = symbol->get_length(&length);
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failure in get_length: " << common::LogHr(hr) << ".";
+      return false;
+    }
+
+    ScopedBstr name;
+    hr = symbol->get_name(name.Receive());
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failure in get_name: " << common::LogHr(hr) << ".";
+      return false;
+    }
+
+    FunctionTable::Function function;
+    function.rva = rva;
+    function.length = static_cast<uint32_t>(length);
+    function.name = common::ToString(name);
+    functions->push_back(function);
+  }
+
+  // COMDAT folding leaves several symbols at one address.
+  std::stable_sort(functions->begin(), functions->end(),
+                   RvaLess<FunctionTable::Function>);
+  functions->erase(std::unique(functions->begin(), functions->end(),
+                               RvaEqual<FunctionTable::Function>),
+                   functions->end());
+
+  return true;
+}
+
+// Gets the index of the name of the source file of @p line_number in
+// @p file_names, adding it if it's the first line of its file.
+bool GetFileIndex(IDiaLineNumber* line_number,
+                  SourceFileIndexMap* file_indices,
+                  FunctionTable::FileNames* file_names,
+                  uint32_t* file_index) {
+  DCHECK(line_number != NULL);
+  DCHECK(file_indices != NULL);
+  DCHECK(file_names != NULL);
+  DCHECK(file_index != NULL);
+
+  DWORD source_file_id = 0;
+  HRESULT hr = line_number->get_sourceFileId(&source_file_id);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_sourceFileId: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  SourceFileIndexMap::const_iterator it = file_indices->find(source_file_id);
+  if (it != file_indices->end()) {
+    *file_index = it->second;
+    return true;
+  }
+
+  ScopedComPtr<IDiaSourceFile> source_file;
+  hr = line_number->get_sourceFile(source_file.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_sourceFile: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  ScopedBstr file_name;
+  hr = source_file->get_fileName(file_name.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_fileName: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  *file_index = static_cast<uint32_t>(file_names->size());
+  file_names->push_back(common::ToString(file_name));
+  file_indices->insert(std::make_pair(source_file_id, *file_index));
+  return true;
+}
+
+// Reads the lines of the first @p length bytes of the module of @p session,
+// sorted by address.
+bool LoadLines(IDiaSession* session,
+               uint32_t length,
+               FunctionTable::Lines* lines,
+               FunctionTable::FileNames* file_names) {
+  DCHECK(session != NULL);
+  DCHECK(lines != NULL);
+  DCHECK(file_names != NULL);
+
+  ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
+  HRESULT hr = session->findLinesByRVA(0, length, enum_lines.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in findLinesByRVA: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  LONG count = 0;
+  hr = enum_lines->get_Count(&count);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_Count: " << common::LogHr(hr) << ".";
+    return false;
+  }
+  lines->reserve(count);
+
+  // Successive lines mostly come from the same file, which is looked up once.
+  SourceFileIndexMap file_indices;
+  while (true) {
+    ScopedComPtr<IDiaLineNumber> line_number;
+    ULONG fetched = 0;
+    hr = enum_lines->Next(1, line_number.Receive(), &fetched);
+    if (hr != S_OK || fetched != 1)
+      break;
+
+    DWORD rva = 0;
+    DWORD line_length = 0;
+    DWORD line_number_value = 0;
+    if (FAILED(line_number->get_relativeVirtualAddress(&rva)) ||
+        FAILED(line_number->get_length(&line_length)) ||
+        FAILED(line_number->get_lineNumber(&line_number_value))) {
+      LOG(ERROR) << "Failed to get line number properties.";
+      return false;
+    }
+
+    FunctionTable::Line line;
+    line.rva = rva;
+    line.length = line_length;
+    line.line_number = line_number_value;
+    if (!GetFileIndex(line_number.get(), &file_indices, file_names,
+                      &line.file_index)) {
+      return false;
+    }
+    lines->push_back(line);
+  }
+
+  // The lines are usually enumerated in order, but this isn't guaranteed.
+  std::stable_sort(lines->begin(), lines->end(), RvaLess<FunctionTable::Line>);
+
+  return true;
+}
+
+}  // namespace
+
+const uint32_t FunctionTable::kVersion = 1;
+
+bool FunctionTable::Init(IDiaSession* session) {
+  DCHECK(session != NULL);
+
+  functions_.clear();
+  public_symbols_.clear();
+  lines_.clear();
+  file_names_.clear();
+
+  ScopedComPtr<IDiaSymbol> global;
+  HRESULT hr = session->get_globalScope(global.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_globalScope: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  if (!LoadFunctions(global.get(), SymTagFunction, &functions_) ||
+      !LoadFunctions(global.get(), SymTagPublicSymbol, &public_symbols_)) {
+    return false;
+  }
+
+  // Only the lines of the functions are ever looked up.
+  uint32_t end = 0;
+  for (size_t i = 0; i < functions_.size(); ++i)
+    end = std::max(end, functions_[i].rva + functions_[i].length);
+  if (end != 0 && !LoadLines(session, end, &lines_, &file_names_))
+    return false;
+
+  return true;
+}
+
+const FunctionTable::Function* FunctionTable::FindFunction(
+    uint32_t rva) const {
+  Function key;
+  key.rva = rva;
+
+  // Find the last private function starting at or before the address.
+  Functions::const_iterator it = std::upper_bound(
+      functions_.begin(), functions_.end(), key, RvaLess<Function>);
+  if (it != functions_.begin()) {
+    --it;
+    if (rva < it->rva + it->length)
+      return &(*it);
+  }
+
+  // Fall back to the closest public symbol.
+  it = std::upper_bound(public_symbols_.begin(), public_symbols_.end(), key,
+                        RvaLess<Function>);
+  if (it == public_symbols_.begin())
+    return NULL;
+  --it;
+  return &(*it);
+}
+
+const FunctionTable::Line* FunctionTable::FindLine(uint32_t rva,
+                                                   uint32_t length) const {
+  DCHECK_NE(0U, length);
+
+  // The lines don't overlap, so they are also sorted by their end.
+  Lines::const_iterator it = std::lower_bound(
+      lines_.begin(), lines_.end(), rva, LineEndsBefore);
+  if (it == lines_.end() || it->rva >= rva + length)
+    return NULL;
+  return &(*it);
+}
+
+const std::wstring& FunctionTable::GetFileName(const Line& line) const {
+  DCHECK_LT(line.file_index, file_names_.size());
+  return file_names_[line.file_index];
+}
+
+bool FunctionTable::SaveToFile(const base::FilePath& path) const {
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(path.DirName(), &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in: "
+               << path.DirName().value();
+    return false;
+  }
+
+  bool saved = false;
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() != NULL) {
+      core::FileOutStream out_stream(file.get());
+      core::NativeBinaryOutArchive out_archive(&out_stream);
+      saved = Save(&out_archive) && out_archive.Flush();
+    }
+  }
+
+  base::File::Error error = base::File::FILE_OK;
+  if (!saved || !base::ReplaceFile(temp_path, path, &error)) {
+    LOG(ERROR) << "Unable to write function table: " << path.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
+bool FunctionTable::LoadFromFile(const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  if (!Load(&in_archive)) {
+    functions_.clear();
+    public_symbols_.clear();
+    lines_.clear();
+    file_names_.clear();
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace grinder
@@ -0,0 +1,188 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FunctionTable, the function and line information of a module as
+// extracted from its PDB in a single pass. Resolving an address of the module
+// to its function or line is then a binary search rather than a DIA query.
+
+#ifndef SYZYGY_GRINDER_FUNCTION_TABLE_H_
+#define SYZYGY_GRINDER_FUNCTION_TABLE_H_
+
+#include <dia2.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+
+namespace grinder {
+
+// Holds the functions, the public symbols and the lines of a module, each
+// sorted by RVA. The table is not modified once loaded, so it may be shared
+// by any number of threads.
+class FunctionTable {
+ public:
+  struct Function;  // Forward declaration.
+  struct Line;  // Forward declaration.
+  typedef std::vector<Function> Functions;
+  typedef std::vector<Line> Lines;
+  typedef std::vector<std::wstring> FileNames;
+
+  // Initializes this table with the symbols of a module.
+  // @param session the DIA session of the module.
+  // @returns true on success, false otherwise.
+  bool Init(IDiaSession* session);
+
+  // Finds the function containing an address.
+  // @param rva the address to look up.
+  // @returns the private function containing @p rva or, failing that, the
+  //     closest public symbol at or preceding @p rva. Returns NULL if there
+  //     is neither.
+  const Function* FindFunction(uint32_t rva) const;
+
+  // Finds the first line overlapping an address range.
+  // @param rva the start of the address range.
+  // @param length the length of the address range, which is not zero.
+  // @returns the first line overlapping the range, or NULL if there is none.
+  const Line* FindLine(uint32_t rva, uint32_t length) const;
+
+  // @param line a line of this table.
+  // @returns the name of the source file of @p line.
+  const std::wstring& GetFileName(const Line& line) const;
+
+  // Saves this table to a file, which is written to a temporary file that is
+  // then moved in place, so that concurrent readers never see a partially
+  // written table.
+  // @param path the path of the file.
+  // @returns true on success, false otherwise.
+  bool SaveToFile(const base::FilePath& path) const;
+
+  // Loads this table from a file written by SaveToFile.
+  // @param path the path of the file.
+  // @returns true on success, false if the file doesn't exist, was written
+  //     by another version, or is corrupt.
+  bool LoadFromFile(const base::FilePath& path);
+
+  // @name Serialization functions.
+  // @{
+  template<class OutArchive> bool Save(OutArchive* out_archive) const;
+  template<class InArchive> bool Load(InArchive* in_archive);
+  // @}
+
+  // @name Accessors.
+  // @{
+  const Functions& functions() const { return functions_; }
+  const Functions& public_symbols() const { return public_symbols_; }
+  const Lines& lines() const { return lines_; }
+  const FileNames& file_names() const { return file_names_; }
+  // @}
+
+  // The version of the serialized tables.
+  static const uint32_t kVersion;
+
+ protected:
+  // The private functions, sorted by RVA.
+  Functions functions_;
+
+  // The public symbols, sorted by RVA. These stand in for the functions
+  // without private symbols.
+  Functions public_symbols_;
+
+  // The lines, sorted by RVA.
+  Lines lines_;
+
+  // The names of the source files of the lines.
+  FileNames file_names_;
+};
+
+// Describes a function, or a public symbol, of a module.
+struct FunctionTable::Function {
+  Function() : rva(0), length(0) {
+  }
+
+  // The address of the function.
+  uint32_t rva;
+  // The length of the function, which is zero for most public symbols.
+  uint32_t length;
+  // The name of the function.
+  std::wstring name;
+
+  // @name Serialization functions.
+  // @{
+  template<class OutArchive> bool Save(OutArchive* out_archive) const {
+    return out_archive->Save(rva) && out_archive->Save(length) &&
+           out_archive->Save(name);
+  }
+  template<class InArchive> bool Load(InArchive* in_archive) {
+    return in_archive->Load(&rva) && in_archive->Load(&length) &&
+           in_archive->Load(&name);
+  }
+  // @}
+};
+
+// Describes a line of source code of a module.
+struct FunctionTable::Line {
+  Line() : rva(0), length(0), line_number(0), file_index(0) {
+  }
+
+  // The address of the code of the line.
+  uint32_t rva;
+  // The length of the code of the line, which may be zero.
+  uint32_t length;
+  // The line number in the source file.
+  uint32_t line_number;
+  // The index of the name of the source file in file_names().
+  uint32_t file_index;
+
+  // @name Serialization functions.
+  // @{
+  template<class OutArchive> bool Save(OutArchive* out_archive) const {
+    return out_archive->Save(rva) && out_archive->Save(length) &&
+           out_archive->Save(line_number) && out_archive->Save(file_index);
+  }
+  template<class InArchive> bool Load(InArchive* in_archive) {
+    return in_archive->Load(&rva) && in_archive->Load(&length) &&
+           in_archive->Load(&line_number) && in_archive->Load(&file_index);
+  }
+  // @}
+};
+
+template<class OutArchive>
+bool FunctionTable::Save(OutArchive* out_archive) const {
+  return out_archive->Save(kVersion) && out_archive->Save(functions_) &&
+         out_archive->Save(public_symbols_) && out_archive->Save(lines_) &&
+         out_archive->Save(file_names_);
+}
+
+template<class InArchive>
+bool FunctionTable::Load(InArchive* in_archive) {
+  uint32_t version = 0;
+  if (!in_archive->Load(&version) || version != kVersion)
+    return false;
+  if (!in_archive->Load(&functions_) || !in_archive->Load(&public_symbols_) ||
+      !in_archive->Load(&lines_) || !in_archive->Load(&file_names_)) {
+    return false;
+  }
+
+  // The lines must refer to the file names that were loaded.
+  for (size_t i = 0; i < lines_.size(); ++i) {
+    if (lines_[i].file_index >= file_names_.size())
+      return false;
+  }
+  return true;
+}
+
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_FUNCTION_TABLE_H_
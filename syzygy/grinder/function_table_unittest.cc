@@ -0,0 +1,212 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/function_table.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/win/scoped_com_initializer.h"
+#include "base/win/scoped_comptr.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/dia_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace grinder {
+
+namespace {
+
+class TestFunctionTable : public FunctionTable {
+ public:
+  using FunctionTable::functions_;
+  using FunctionTable::public_symbols_;
+  using FunctionTable::lines_;
+  using FunctionTable::file_names_;
+
+  void AddFunction(uint32_t rva, uint32_t length, const wchar_t* name) {
+    Function function;
+    function.rva = rva;
+    function.length = length;
+    function.name = name;
+    functions_.push_back(function);
+  }
+
+  void AddPublicSymbol(uint32_t rva, const wchar_t* name) {
+    Function function;
+    function.rva = rva;
+    function.name = name;
+    public_symbols_.push_back(function);
+  }
+
+  void AddLine(uint32_t rva, uint32_t length, uint32_t line_number) {
+    Line line;
+    line.rva = rva;
+    line.length = length;
+    line.line_number = line_number;
+    line.file_index = 0;
+    lines_.push_back(line);
+  }
+
+  // Initializes a table of two functions, with a gap between them covered
+  // by a public symbol.
+  void InitTestTable() {
+    file_names_.push_back(L"foo.cc");
+    AddFunction(0x1000, 0x20, L"Foo");
+    AddFunction(0x1040, 0x10, L"Bar");
+    AddPublicSymbol(0x1000, L"_Foo");
+    AddPublicSymbol(0x1020, L"_Baz");
+    AddLine(0x1000, 0x8, 10);
+    AddLine(0x1008, 0x0, 11);
+    AddLine(0x1008, 0x18, 12);
+    AddLine(0x1040, 0x10, 20);
+  }
+};
+
+class FunctionTableTest : public testing::Test {
+ public:
+  virtual void SetUp() override {
+    testing::Test::SetUp();
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  }
+
+  // Ensures that COM is initialized for tests in this fixture.
+  base::win::ScopedCOMInitializer com_initializer_;
+
+  base::ScopedTempDir temp_dir_;
+};
+
+}  // namespace
+
+TEST_F(FunctionTableTest, FindFunction) {
+  TestFunctionTable table;
+  table.InitTestTable();
+
+  EXPECT_EQ(NULL, table.FindFunction(0x0FFF));
+
+  const FunctionTable::Function* function = table.FindFunction(0x1000);
+  ASSERT_TRUE(function != NULL);
+  EXPECT_EQ(L"Foo", function->name);
+  function = table.FindFunction(0x101F);
+  ASSERT_TRUE(function != NULL);
+  EXPECT_EQ(L"Foo", function->name);
+
+  // Addresses outside of the private functions fall back to the closest
+  // public symbol.
+  function = table.FindFunction(0x1030);
+  ASSERT_TRUE(function != NULL);
+  EXPECT_EQ(L"_Baz", function->name);
+
+  function = table.FindFunction(0x1048);
+  ASSERT_TRUE(function != NULL);
+  EXPECT_EQ(L"Bar", function->name);
+  function = table.FindFunction(0x2000);
+  ASSERT_TRUE(function != NULL);
+  EXPECT_EQ(L"_Baz", function->name);
+}
+
+TEST_F(FunctionTableTest, FindLine) {
+  TestFunctionTable table;
+  table.InitTestTable();
+
+  const FunctionTable::Line* line = table.FindLine(0x1000, 0x20);
+  ASSERT_TRUE(line != NULL);
+  EXPECT_EQ(10u, line->line_number);
+  EXPECT_EQ(L"foo.cc", table.GetFileName(*line));
+
+  // A zero-length line is found at its address.
+  line = table.FindLine(0x1008, 0x20);
+  ASSERT_TRUE(line != NULL);
+  EXPECT_EQ(11u, line->line_number);
+
+  line = table.FindLine(0x1010, 0x10);
+  ASSERT_TRUE(line != NULL);
+  EXPECT_EQ(12u, line->line_number);
+
+  // The first line following the start of the range is found.
+  line = table.FindLine(0x1020, 0x30);
+  ASSERT_TRUE(line != NULL);
+  EXPECT_EQ(20u, line->line_number);
+
+  EXPECT_EQ(NULL, table.FindLine(0x1020, 0x20));
+  EXPECT_EQ(NULL, table.FindLine(0x1050, 0x10));
+}
+
+TEST_F(FunctionTableTest, SaveAndLoad) {
+  TestFunctionTable table;
+  table.InitTestTable();
+
+  base::FilePath path = temp_dir_.path().Append(L"table.functions");
+  ASSERT_TRUE(table.SaveToFile(path));
+
+  FunctionTable loaded;
+  ASSERT_TRUE(loaded.LoadFromFile(path));
+  ASSERT_EQ(table.functions().size(), loaded.functions().size());
+  ASSERT_EQ(table.public_symbols().size(), loaded.public_symbols().size());
+  ASSERT_EQ(table.lines().size(), loaded.lines().size());
+  EXPECT_EQ(table.file_names(), loaded.file_names());
+
+  const FunctionTable::Function* function = loaded.FindFunction(0x1048);
+  ASSERT_TRUE(function != NULL);
+  EXPECT_EQ(L"Bar", function->name);
+  const FunctionTable::Line* line = loaded.FindLine(0x1040, 0x10);
+  ASSERT_TRUE(line != NULL);
+  EXPECT_EQ(20u, line->line_number);
+}
+
+TEST_F(FunctionTableTest, LoadFailsOnOtherVersion) {
+  base::FilePath path = temp_dir_.path().Append(L"table.functions");
+  {
+    base::ScopedFILE file(base::OpenFile(path, "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    core::FileOutStream out_stream(file.get());
+    core::NativeBinaryOutArchive out_archive(&out_stream);
+    ASSERT_TRUE(out_archive.Save(FunctionTable::kVersion + 1));
+    ASSERT_TRUE(out_archive.Flush());
+  }
+
+  FunctionTable table;
+  EXPECT_FALSE(table.LoadFromFile(path));
+  EXPECT_FALSE(table.LoadFromFile(temp_dir_.path().Append(L"missing")));
+  EXPECT_TRUE(table.functions().empty());
+}
+
+TEST_F(FunctionTableTest, InitFromPdb) {
+  base::win::ScopedComPtr<IDiaDataSource> source;
+  ASSERT_TRUE(pe::CreateDiaSource(source.Receive()));
+  base::win::ScopedComPtr<IDiaSession> session;
+  ASSERT_TRUE(pe::CreateDiaSession(
+      testing::GetExeTestDataRelativePath(testing::kTestDllPdbName),
+      source.get(), session.Receive()));
+
+  FunctionTable table;
+  ASSERT_TRUE(table.Init(session.get()));
+  ASSERT_FALSE(table.functions().empty());
+  EXPECT_FALSE(table.public_symbols().empty());
+  EXPECT_FALSE(table.lines().empty());
+
+  // The functions are sorted, and each resolves to itself.
+  for (size_t i = 0; i < table.functions().size(); ++i) {
+    const FunctionTable::Function& function = table.functions()[i];
+    if (i != 0)
+      EXPECT_LT(table.functions()[i - 1].rva, function.rva);
+    if (function.length == 0)
+      continue;
+    EXPECT_EQ(&function, table.FindFunction(function.rva));
+    EXPECT_EQ(&function,
+              table.FindFunction(function.rva + function.length - 1));
+  }
+}
+
+}  // namespace grinder
@@ -29,6 +29,10 @@
         'coverage_data.h',
         'find.cc',
         'find.h',
+        'flame_graph_writer.cc',
+        'flame_graph_writer.h',
+        'function_table.cc',
+        'function_table.h',
         'grinder_app.cc',
         'grinder_app.h',
         'grinder_util.cc',
@@ -68,6 +72,8 @@
         'cache_grind_writer_unittest.cc',
         'coverage_data_unittest.cc',
         'find_unittest.cc',
+        'flame_graph_writer_unittest.cc',
+        'function_table_unittest.cc',
         'grinder_app_unittest.cc',
         'grinder_util_unittest.cc',
         'indexed_frequency_data_serializer_unittest.cc',
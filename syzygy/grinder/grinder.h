@@ -19,6 +19,7 @@
 #define SYZYGY_GRINDER_GRINDER_H_
 
 #include "base/command_line.h"
+#include "base/logging.h"
 #include "syzygy/trace/parse/parser.h"
 
 namespace grinder {
@@ -43,6 +44,24 @@ class GrinderInterface : public trace::parser::ParseEventHandlerImpl {
   //     handler.
   virtual void SetParser(Parser* parser) = 0;
 
+  // Indicates whether the parse results of several grinders can be merged,
+  // so that trace files can be ground in parallel. This is the case when the
+  // results don't depend on the order of the trace files.
+  // @returns true if Merge is supported, false otherwise.
+  virtual bool CanMerge() const { return false; }
+
+  // Merges the parse results of another grinder of the same type, set up
+  // from the same command-line, into this one. This will only be called
+  // when CanMerge returns true, after all parse events have been handled by
+  // both grinders and prior to Grind.
+  // @param partition the grinder whose results are merged.
+  // @returns true on success, false otherwise.
+  // @note The implementation should log on failure.
+  virtual bool Merge(const GrinderInterface& partition) {
+    NOTREACHED() << "This grinder can't merge results.";
+    return false;
+  }
+
   // Performs any computation/aggregation/summarization that needs to be done
   // after having parsed trace files. This will only be called after a
   // successful call to ParseCommandLine and after all parse events have been
@@ -14,10 +14,15 @@
 
 #include "syzygy/grinder/grinder_app.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 #include "syzygy/grinder/grinders/mem_replay_grinder.h"
@@ -60,11 +65,37 @@ const char kUsageFormatStr[] =
     "Optional parameters\n"
     "  --output-file=<output file>\n"
     "    The location of output file. If not specified, output is to stdout.\n"
+    "  --num-threads=<count>\n"
+    "    The number of worker threads on which trace files are read and\n"
+    "    decompressed ahead of being ground. Trace events are still ground\n"
+    "    in order on a single thread. Defaults to 0, which reads the trace\n"
+    "    files one at a time.\n"
+    "  --num-grinders=<count>\n"
+    "    The number of grinders that each parse a share of the trace files on\n"
+    "    their own thread, their results being merged before the output is\n"
+    "    produced. Only the 'bbentry', 'branch', 'coverage' and 'sample'\n"
+    "    modes support this. Defaults to 1.\n"
+    "bbentry and branch mode optional parameters\n"
+    "  --output-format=<output format>\n"
+    "    Output format must be one of 'json' or 'binary', the latter being\n"
+    "    a compact format that is much faster to load for large modules.\n"
+    "    The tools reading the output detect its format. Defaults to 'json'\n"
+    "    if not explicitly specified.\n"
+    "  --pretty-print\n"
+    "    Pretty prints the JSON output.\n"
     "coverage mode optional parameters\n"
     "  --output-format=<output format>\n"
     "    Output format must be one of 'lcov' or 'cachegrind'. Defaults to\n"
     "    'lcov' if not explicitly specified.\n"
     "profile mode optional parameters\n"
+    "  --function-table-cache-dir=<dir>\n"
+    "    A directory where the function tables extracted from the symbols\n"
+    "    of the modules are kept, so that later runs load them rather than\n"
+    "    query the symbols again.\n"
+    "  --output-format=<output format>\n"
+    "    Output format must be one of 'cachegrind' or 'flamegraph', the\n"
+    "    latter being the collapsed stacks read by flame graph viewers.\n"
+    "    Defaults to 'cachegrind' if not explicitly specified.\n"
     "  --thread-parts\n"
     "    Aggregate and output separate parts for each thread seen in the\n"
     "    trace files.\n"
@@ -80,12 +111,92 @@ const char kUsageFormatStr[] =
     "    will be reported for all modules encountered in the trace files.\n"
     "    This must be specified for 'basic-block' aggregation modes, as\n"
     "    only one module may be processed at a time in this mode.\n"
+    "  --output-format=<output format>\n"
+    "    Output format must be one of 'csv' or 'flamegraph', the latter\n"
+    "    being the collapsed stacks of the module, compiland, function and\n"
+    "    basic block, down to the aggregation level, with the heat in\n"
+    "    microseconds. Not supported by 'line' aggregation. Defaults to\n"
+    "    'csv' if not explicitly specified.\n"
     "\n";
 
+// Parses a share of the trace files into a grinder, on a worker thread.
+class GrindWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param grinder the grinder to feed the parse events to.
+  // @param begin the first of the trace files to parse.
+  // @param end the end of the trace files to parse.
+  // @param num_decode_threads the number of decode threads of the parser.
+  GrindWorker(GrinderInterface* grinder,
+              std::vector<base::FilePath>::const_iterator begin,
+              std::vector<base::FilePath>::const_iterator end,
+              size_t num_decode_threads)
+      : grinder_(grinder),
+        trace_files_(begin, end),
+        num_decode_threads_(num_decode_threads),
+        succeeded_(false) {
+    DCHECK(grinder_ != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    // The grinders read PDBs through DIA, which needs COM on this thread.
+    base::win::ScopedCOMInitializer com_initializer;
+
+    trace::parser::Parser parser;
+    parser.set_num_decode_threads(num_decode_threads_);
+    grinder_->SetParser(&parser);
+    if (!parser.Init(grinder_))
+      return;
+
+    for (size_t i = 0; i < trace_files_.size(); ++i) {
+      if (!parser.OpenTraceFile(trace_files_[i])) {
+        LOG(ERROR) << "Unable to open trace file \'"
+                   << trace_files_[i].value() << "'";
+        return;
+      }
+    }
+
+    succeeded_ = parser.Consume();
+  }
+  // @}
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  GrinderInterface* grinder_;
+  std::vector<base::FilePath> trace_files_;
+  size_t num_decode_threads_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(GrindWorker);
+};
+
 }  // namespace
 
 GrinderApp::GrinderApp()
-    : application::AppImplBase("Grinder"), mode_() {
+    : application::AppImplBase("Grinder"),
+      num_threads_(0),
+      num_grinders_(1),
+      mode_() {
+}
+
+GrinderInterface* GrinderApp::CreateGrinder(Mode mode) {
+  switch (mode) {
+    case kBasicBlockEntry:
+    case kIndexedFrequencyData:
+      return new grinders::IndexedFrequencyDataGrinder();
+    case kCoverage:
+      return new grinders::CoverageGrinder();
+    case kMemReplay:
+      return new grinders::MemReplayGrinder();
+    case kProfile:
+      return new grinders::ProfileGrinder();
+    case kSample:
+      return new grinders::SampleGrinder();
+  }
+  NOTREACHED() << "Unknown mode.";
+  return NULL;
 }
 
 void GrinderApp::PrintUsage(const base::FilePath& program,
@@ -126,27 +237,22 @@ bool GrinderApp::ParseCommandLine(const base::CommandLine* command_line) {
   std::string mode = command_line->GetSwitchValueASCII("mode");
   if (base::LowerCaseEqualsASCII(mode, "bbentry")) {
     mode_ = kBasicBlockEntry;
-    grinder_.reset(new grinders::IndexedFrequencyDataGrinder());
   } else if (base::LowerCaseEqualsASCII(mode, "branch")) {
     mode_ = kIndexedFrequencyData;
-    grinder_.reset(new grinders::IndexedFrequencyDataGrinder());
   } else if (base::LowerCaseEqualsASCII(mode, "coverage")) {
     mode_ = kCoverage;
-    grinder_.reset(new grinders::CoverageGrinder());
   } else if (base::LowerCaseEqualsASCII(mode, "memreplay")) {
-    mode = kMemReplay;
-    grinder_.reset(new grinders::MemReplayGrinder());
+    mode_ = kMemReplay;
   } else if (base::LowerCaseEqualsASCII(mode, "profile")) {
     mode_ = kProfile;
-    grinder_.reset(new grinders::ProfileGrinder());
   } else if (base::LowerCaseEqualsASCII(mode, "sample")) {
     mode_ = kSample;
-    grinder_.reset(new grinders::SampleGrinder());
   } else {
     PrintUsage(command_line->GetProgram(),
                base::StringPrintf("Unknown mode: %s.", mode.c_str()));
     return false;
   }
+  grinder_.reset(CreateGrinder(mode_));
   DCHECK(grinder_.get() != NULL);
 
   // Parse the command-line for the grinder.
@@ -159,23 +265,113 @@ bool GrinderApp::ParseCommandLine(const base::CommandLine* command_line) {
 
   output_file_ = command_line->GetSwitchValuePath("output-file");
 
+  if (command_line->HasSwitch("num-threads")) {
+    std::string num_threads = command_line->GetSwitchValueASCII("num-threads");
+    if (!base::StringToSizeT(num_threads, &num_threads_)) {
+      PrintUsage(command_line->GetProgram(),
+                 base::StringPrintf("Invalid number of threads: %s.",
+                                    num_threads.c_str()));
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch("num-grinders")) {
+    std::string num_grinders =
+        command_line->GetSwitchValueASCII("num-grinders");
+    if (!base::StringToSizeT(num_grinders, &num_grinders_) ||
+        num_grinders_ == 0) {
+      PrintUsage(command_line->GetProgram(),
+                 base::StringPrintf("Invalid number of grinders: %s.",
+                                    num_grinders.c_str()));
+      return false;
+    }
+  }
+
+  // Set up the grinders that parse in parallel with the main one. There's no
+  // point in having more of them than there are trace files.
+  partitions_.clear();
+  if (num_grinders_ > 1) {
+    if (!grinder_->CanMerge()) {
+      LOG(WARNING) << "The " << mode << " mode can't grind in parallel, "
+                   << "ignoring --num-grinders.";
+    } else {
+      size_t num_partitions =
+          std::min(num_grinders_, trace_files_.size()) - 1;
+      for (size_t i = 0; i < num_partitions; ++i) {
+        std::unique_ptr<GrinderInterface> partition(CreateGrinder(mode_));
+        if (!partition->ParseCommandLine(command_line))
+          return false;
+        partitions_.push_back(std::move(partition));
+      }
+    }
+  }
+
+  return true;
+}
+
+bool GrinderApp::ParseInParallel() {
+  DCHECK(!partitions_.empty());
+
+  std::vector<GrinderInterface*> grinders;
+  grinders.push_back(grinder_.get());
+  for (size_t i = 0; i < partitions_.size(); ++i)
+    grinders.push_back(partitions_[i].get());
+
+  // Give each grinder a contiguous share of the trace files, so that the
+  // results are merged in the order of the trace files.
+  std::vector<std::unique_ptr<GrindWorker>> workers;
+  size_t begin = 0;
+  for (size_t i = 0; i < grinders.size(); ++i) {
+    size_t end = trace_files_.size() * (i + 1) / grinders.size();
+    DCHECK_LT(begin, end);
+    workers.push_back(std::unique_ptr<GrindWorker>(new GrindWorker(
+        grinders[i], trace_files_.begin() + begin, trace_files_.begin() + end,
+        num_threads_)));
+    begin = end;
+  }
+
+  base::DelegateSimpleThreadPool pool("Grinder",
+                                      static_cast<int>(workers.size()));
+  for (size_t i = 0; i < workers.size(); ++i)
+    pool.AddWork(workers[i].get());
+  pool.Start();
+  pool.JoinAll();
+
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (!workers[i]->succeeded())
+      return false;
+  }
+
+  LOG(INFO) << "Merging the results of " << grinders.size() << " grinders.";
+  for (size_t i = 0; i < partitions_.size(); ++i) {
+    if (!grinder_->Merge(*partitions_[i]))
+      return false;
+  }
+
+  // The merged grinders are no longer needed.
+  partitions_.clear();
+
   return true;
 }
 
 int GrinderApp::Run() {
   DCHECK(grinder_.get() != NULL);
 
+  // When grinding in parallel, each worker sets up its own parser.
   trace::parser::Parser parser;
-  grinder_->SetParser(&parser);
-  if (!parser.Init(grinder_.get()))
-    return 1;
-
-  // Open the input files.
-  for (size_t i = 0; i < trace_files_.size(); ++i) {
-    if (!parser.OpenTraceFile(trace_files_[i])) {
-      LOG(ERROR) << "Unable to open trace file \'"
-                 << trace_files_[i].value() << "'";
+  if (partitions_.empty()) {
+    parser.set_num_decode_threads(num_threads_);
+    grinder_->SetParser(&parser);
+    if (!parser.Init(grinder_.get()))
       return 1;
+
+    // Open the input files.
+    for (size_t i = 0; i < trace_files_.size(); ++i) {
+      if (!parser.OpenTraceFile(trace_files_[i])) {
+        LOG(ERROR) << "Unable to open trace file \'"
+                   << trace_files_[i].value() << "'";
+        return 1;
+      }
     }
   }
 
@@ -195,7 +391,12 @@ int GrinderApp::Run() {
   }
 
   LOG(INFO) << "Parsing trace files.";
-  if (!parser.Consume()) {
+  bool parsed = false;
+  if (partitions_.empty())
+    parsed = parser.Consume();
+  else
+    parsed = ParseInParallel();
+  if (!parsed) {
     LOG(ERROR) << "Error parsing trace files.";
     return 1;
   }
@@ -220,7 +421,9 @@ int GrinderApp::Run() {
 }
 
 void GrinderApp::TearDown() {
-  // Release the grinder so it has a chance to clean up before COM goes away.
+  // Release the grinders so they have a chance to clean up before COM goes
+  // away.
+  partitions_.clear();
   grinder_.reset();
 }
 
@@ -14,6 +14,9 @@
 #ifndef SYZYGY_GRINDER_GRINDER_APP_H_
 #define SYZYGY_GRINDER_GRINDER_APP_H_
 
+#include <memory>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/application/application.h"
 #include "syzygy/grinder/grinder.h"
@@ -50,10 +53,27 @@ class GrinderApp : public application::AppImplBase {
   // @}
 
  protected:
+  // Creates the grinder for a processing mode.
+  // @param mode the processing mode.
+  // @returns the new grinder.
+  static GrinderInterface* CreateGrinder(Mode mode);
+
+  // Parses the trace files into grinder_ and partitions_ in parallel, each
+  // taking a contiguous share of them, and merges the results into grinder_.
+  // @returns true on success, false otherwise.
+  bool ParseInParallel();
+
   std::vector<base::FilePath> trace_files_;
   base::FilePath output_file_;
+  size_t num_threads_;
+  size_t num_grinders_;
   Mode mode_;
   std::unique_ptr<GrinderInterface> grinder_;
+
+  // The additional grinders that parse trace files in parallel with grinder_,
+  // and whose results are merged into it. This is empty unless the grinder
+  // can merge results and more than one grinder was requested.
+  std::vector<std::unique_ptr<GrinderInterface>> partitions_;
 };
 
 }  // namespace grinder
@@ -31,6 +31,9 @@ class TestGrinderApp : public GrinderApp {
   // Expose for testing.
   using GrinderApp::trace_files_;
   using GrinderApp::output_file_;
+  using GrinderApp::num_threads_;
+  using GrinderApp::num_grinders_;
+  using GrinderApp::partitions_;
 };
 
 class GrinderAppTest : public testing::PELibUnitTest {
@@ -122,6 +125,64 @@ TEST_F(GrinderAppTest, ParseCommandLineOutputFile) {
   ASSERT_EQ(L"output.txt", impl_.output_file_.value());
 }
 
+TEST_F(GrinderAppTest, ParseCommandLineNumThreads) {
+  ASSERT_EQ(0u, impl_.num_threads_);
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("num-threads", "3");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(3u, impl_.num_threads_);
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineFailsWithInvalidNumThreads) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("num-threads", "many");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineNumGrinders) {
+  ASSERT_EQ(1u, impl_.num_grinders_);
+  cmd_line_.AppendSwitchASCII("mode", "coverage");
+  cmd_line_.AppendSwitchASCII("num-grinders", "8");
+  for (size_t i = 0; i < arraysize(testing::kCoverageTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kCoverageTraceFiles[i]));
+  }
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(8u, impl_.num_grinders_);
+
+  // There's one grinder per trace file at most.
+  EXPECT_EQ(arraysize(testing::kCoverageTraceFiles) - 1,
+            impl_.partitions_.size());
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineNumGrindersIgnoredWithoutMerge) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("num-grinders", "2");
+  for (size_t i = 0; i < arraysize(testing::kProfileTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kProfileTraceFiles[i]));
+  }
+
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(impl_.partitions_.empty());
+}
+
+TEST_F(GrinderAppTest, ParseCommandLineFailsWithInvalidNumGrinders) {
+  cmd_line_.AppendSwitchASCII("mode", "coverage");
+  cmd_line_.AppendSwitchASCII("num-grinders", "0");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kCoverageTraceFiles[0]));
+
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(GrinderAppTest, BasicBlockEntryEndToEnd) {
   cmd_line_.AppendSwitchASCII("mode", "bbentry");
   cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
@@ -176,6 +237,25 @@ TEST_F(GrinderAppTest, ProfileEndToEnd) {
   EXPECT_TRUE(base::PathExists(output_file));
 }
 
+TEST_F(GrinderAppTest, ProfileEndToEndWithThreads) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("num-threads", "2");
+  for (size_t i = 0; i < arraysize(testing::kProfileTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kProfileTraceFiles[i]));
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+
+  EXPECT_EQ(0, app_.Run());
+
+  // Verify that the output file was created.
+  EXPECT_TRUE(base::PathExists(output_file));
+}
+
 TEST_F(GrinderAppTest, CoverageEndToEnd) {
   cmd_line_.AppendSwitchASCII("mode", "coverage");
   cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
@@ -195,6 +275,25 @@ TEST_F(GrinderAppTest, CoverageEndToEnd) {
   EXPECT_TRUE(base::PathExists(output_file));
 }
 
+TEST_F(GrinderAppTest, CoverageEndToEndInParallel) {
+  cmd_line_.AppendSwitchASCII("mode", "coverage");
+  cmd_line_.AppendSwitchASCII("num-grinders", "2");
+  for (size_t i = 0; i < arraysize(testing::kCoverageTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kCoverageTraceFiles[i]));
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+
+  EXPECT_EQ(0, app_.Run());
+
+  // Verify that the output file was created.
+  EXPECT_TRUE(base::PathExists(output_file));
+}
+
 TEST_F(GrinderAppTest, SampleEndToEnd) {
   base::FilePath trace_file = temp_dir_.Append(L"sampler.bin");
   ASSERT_NO_FATAL_FAILURE(testing::WriteDummySamplerTraceFile(trace_file));
@@ -28,9 +28,10 @@ namespace grinders {
 
 namespace {
 
+using basic_block_util::AddCounts;
+using basic_block_util::AddFrequencies;
 using basic_block_util::ModuleInformation;
 using basic_block_util::RelativeAddressRange;
-using basic_block_util::GetFrequency;
 using basic_block_util::LoadPdbInfo;
 using basic_block_util::IsValidFrequencySize;
 using basic_block_util::PdbInfo;
@@ -73,17 +74,61 @@ void CoverageGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool CoverageGrinder::Merge(const GrinderInterface& partition) {
+  const CoverageGrinder& other =
+      static_cast<const CoverageGrinder&>(partition);
+  if (other.event_handler_errored_)
+    event_handler_errored_ = true;
+
+  VisitCountsMap::const_iterator it = other.visit_counts_.begin();
+  for (; it != other.visit_counts_.end(); ++it) {
+    uint32_t* counts = NULL;
+    if (!FindOrCreateVisitCounts(it->first, it->second.size(), &counts)) {
+      event_handler_errored_ = true;
+      continue;
+    }
+    AddCounts(it->second.data(), it->second.size(), counts);
+  }
+
+  return true;
+}
+
 bool CoverageGrinder::Grind() {
   if (event_handler_errored_) {
     LOG(WARNING) << "Failed to handle all basic block frequency data events, "
                  << "coverage results will be partial.";
   }
 
-  if (pdb_info_cache_.empty()) {
+  if (visit_counts_.empty()) {
     LOG(ERROR) << "No coverage data was encountered.";
     return false;
   }
 
+  // Attribute the visits of each module to its source lines.
+  VisitCountsMap::const_iterator counts_it = visit_counts_.begin();
+  for (; counts_it != visit_counts_.end(); ++counts_it) {
+    PdbInfoMap::iterator pdb_it = pdb_info_cache_.find(counts_it->first);
+    DCHECK(pdb_it != pdb_info_cache_.end());
+    PdbInfo& pdb_info = pdb_it->second;
+    const VisitCounts& counts = counts_it->second;
+    DCHECK_EQ(pdb_info.bb_ranges.size(), counts.size());
+
+    for (size_t bb_index = 0; bb_index < counts.size(); ++bb_index) {
+      if (counts[bb_index] == 0)
+        continue;
+
+      // Mark this basic-block as visited.
+      const RelativeAddressRange& bb_range = pdb_info.bb_ranges[bb_index];
+      if (!pdb_info.line_info.Visit(bb_range.start(),
+                                    bb_range.size(),
+                                    counts[bb_index])) {
+        LOG(ERROR) << "Failed to visit BB at " << bb_range << ".";
+        return false;
+      }
+    }
+  }
+  visit_counts_.clear();
+
   PdbInfoMap::const_iterator it = pdb_info_cache_.begin();
   for (; it != pdb_info_cache_.end(); ++it) {
     if (!coverage_data_.Add(it->second.line_info)) {
@@ -160,41 +205,44 @@ void CoverageGrinder::OnIndexedFrequency(
   //     expected? This isn't strictly necessary but would add another level of
   //     safety checking.
 
-  // Get the PDB info. This loads the line information and the basic-block
-  // ranges if not already done, otherwise it returns the cached version.
-  PdbInfo* pdb_info = NULL;
-  if (!LoadPdbInfo(&pdb_info_cache_, *module_info, &pdb_info)) {
+  uint32_t* counts = NULL;
+  if (!FindOrCreateVisitCounts(*module_info, data->num_entries, &counts)) {
     event_handler_errored_ = true;
     return;
   }
 
-  DCHECK(pdb_info != NULL);
+  // Add up the visits of the basic-blocks. They are attributed to lines once
+  // all the trace files have been parsed.
+  AddFrequencies(data, 0, counts);
+}
+
+bool CoverageGrinder::FindOrCreateVisitCounts(
+    const ModuleInformation& module_info,
+    size_t num_counts,
+    uint32_t** counts) {
+  DCHECK(counts != NULL);
+
+  VisitCountsMap::iterator it = visit_counts_.find(module_info);
+  if (it == visit_counts_.end()) {
+    // Get the PDB info. This loads the line information and the basic-block
+    // ranges if not already done, otherwise it returns the cached version.
+    PdbInfo* pdb_info = NULL;
+    if (!LoadPdbInfo(&pdb_info_cache_, module_info, &pdb_info))
+      return false;
+    DCHECK(pdb_info != NULL);
+
+    it = visit_counts_.insert(std::make_pair(
+        module_info, VisitCounts(pdb_info->bb_ranges.size(), 0))).first;
+  }
 
   // Sanity check the contents.
-  if (data->num_entries != pdb_info->bb_ranges.size()) {
+  if (num_counts != it->second.size()) {
     LOG(ERROR) << "Mismatch between trace data BB count and PDB BB count.";
-    event_handler_errored_ = true;
-    return;
+    return false;
   }
 
-  // Run over the BB frequency data and mark non-zero frequency BBs as having
-  // been visited.
-  for (size_t bb_index = 0; bb_index < data->num_entries; ++bb_index) {
-    uint32_t bb_freq = GetFrequency(data, bb_index, 0);
-
-    if (bb_freq == 0)
-      continue;
-
-    // Mark this basic-block as visited.
-    const RelativeAddressRange& bb_range = pdb_info->bb_ranges[bb_index];
-    if (!pdb_info->line_info.Visit(bb_range.start(),
-                                   bb_range.size(),
-                                   bb_freq)) {
-      LOG(ERROR) << "Failed to visit BB at " << bb_range << ".";
-      event_handler_errored_ = true;
-      return;
-    }
-  }
+  *counts = it->second.data();
+  return true;
 }
 
 }  // namespace grinders
@@ -17,6 +17,9 @@
 #ifndef SYZYGY_GRINDER_GRINDERS_COVERAGE_GRINDER_H_
 #define SYZYGY_GRINDER_GRINDERS_COVERAGE_GRINDER_H_
 
+#include <map>
+#include <vector>
+
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/grinder/coverage_data.h"
 #include "syzygy/grinder/grinder.h"
@@ -26,6 +29,11 @@ namespace grinders {
 
 // This class processes trace files containing basic-block frequency data and
 // produces LCOV output.
+//
+// The visits are accumulated in a dense array of counts per module, indexed
+// by basic-block, to which each trace record and each merged grinder is
+// added several counts at a time. They are attributed to source lines only
+// once, by Grind.
 class CoverageGrinder : public GrinderInterface {
  public:
   CoverageGrinder();
@@ -35,6 +43,8 @@ class CoverageGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const base::CommandLine* command_line) override;
   virtual void SetParser(Parser* parser) override;
+  virtual bool CanMerge() const override { return true; }
+  virtual bool Merge(const GrinderInterface& partition) override;
   virtual bool Grind() override;
   virtual bool OutputData(FILE* file) override;
   // @}
@@ -61,10 +71,31 @@ class CoverageGrinder : public GrinderInterface {
   const CoverageData& coverage_data() { return coverage_data_; }
 
  protected:
-  // Stores per-module coverage data, populated during calls to
-  // OnIndexedFrequency.
+  typedef std::vector<uint32_t> VisitCounts;
+  typedef std::map<basic_block_util::ModuleInformation,
+                   VisitCounts,
+                   basic_block_util::ModuleIdentityComparator> VisitCountsMap;
+
+  // Adds visit counts to those of a module, loading the PDB info of the
+  // module if it wasn't already.
+  // @param module_info the module the counts belong to.
+  // @param num_counts the number of basic-blocks the counts are for.
+  // @param counts receives a pointer to the counts of the module, of
+  //     @p num_counts elements, to which the visits are to be added.
+  // @returns true on success, false otherwise.
+  bool FindOrCreateVisitCounts(
+      const basic_block_util::ModuleInformation& module_info,
+      size_t num_counts,
+      uint32_t** counts);
+
+  // Stores per-module line information and basic-block ranges, populated
+  // during calls to OnIndexedFrequency and Merge.
   basic_block_util::PdbInfoMap pdb_info_cache_;
 
+  // Stores the per-module visit counts of each basic-block, populated during
+  // calls to OnIndexedFrequency and Merge.
+  VisitCountsMap visit_counts_;
+
   // Stores the final coverage data, populated by Grind. Contains an aggregate
   // of all LineInfo objects stored in the pdb_info_map_, in a reverse map
   // (where efficient lookup is by file name and line number).
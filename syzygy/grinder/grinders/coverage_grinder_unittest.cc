@@ -73,6 +73,21 @@ class CoverageGrinderTest : public testing::PELibUnitTest {
     EXPECT_LT(0u, cache_grind_file_size);
   }
 
+  // Parses a range of the coverage trace files into a grinder.
+  // @param begin the index of the first trace file.
+  // @param end the index past the last trace file.
+  // @param grinder the grinder to parse into.
+  void ParseTraceFiles(size_t begin, size_t end, CoverageGrinder* grinder) {
+    trace::parser::Parser parser;
+    ASSERT_TRUE(parser.Init(grinder));
+    for (size_t i = begin; i < end; ++i) {
+      ASSERT_TRUE(parser.OpenTraceFile(testing::GetExeTestDataRelativePath(
+          testing::kCoverageTraceFiles[i])));
+    }
+    grinder->SetParser(&parser);
+    ASSERT_TRUE(parser.Consume());
+  }
+
   // Ensures that COM is initialized for tests in this fixture.
   base::win::ScopedCOMInitializer com_initializer_;
 
@@ -129,5 +144,41 @@ TEST_F(CoverageGrinderTest, GrindAndOutputCacheGrindDataSucceeds) {
   // TODO(chrisha): Validate the output is a valid CacheGrind file.
 }
 
+TEST_F(CoverageGrinderTest, MergeMatchesSerialGrind) {
+  const size_t kNumTraceFiles = arraysize(testing::kCoverageTraceFiles);
+
+  TestCoverageGrinder expected;
+  ASSERT_TRUE(expected.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(ParseTraceFiles(0, kNumTraceFiles, &expected));
+  ASSERT_TRUE(expected.Grind());
+
+  // Grind half of the trace files in each grinder.
+  TestCoverageGrinder first;
+  TestCoverageGrinder second;
+  ASSERT_TRUE(first.ParseCommandLine(&cmd_line_));
+  ASSERT_TRUE(second.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(ParseTraceFiles(0, kNumTraceFiles / 2, &first));
+  ASSERT_NO_FATAL_FAILURE(
+      ParseTraceFiles(kNumTraceFiles / 2, kNumTraceFiles, &second));
+
+  EXPECT_TRUE(first.CanMerge());
+  ASSERT_TRUE(first.Merge(second));
+  ASSERT_TRUE(first.Grind());
+
+  typedef CoverageData::SourceFileCoverageDataMap SourceFileCoverageDataMap;
+  const SourceFileCoverageDataMap& expected_map =
+      expected.coverage_data().source_file_coverage_data_map();
+  const SourceFileCoverageDataMap& merged_map =
+      first.coverage_data().source_file_coverage_data_map();
+  ASSERT_EQ(expected_map.size(), merged_map.size());
+  SourceFileCoverageDataMap::const_iterator expected_it = expected_map.begin();
+  SourceFileCoverageDataMap::const_iterator merged_it = merged_map.begin();
+  for (; expected_it != expected_map.end(); ++expected_it, ++merged_it) {
+    EXPECT_EQ(expected_it->first, merged_it->first);
+    EXPECT_EQ(expected_it->second.line_execution_count_map,
+              merged_it->second.line_execution_count_map);
+  }
+}
+
 }  // namespace grinders
 }  // namespace grinder
@@ -14,10 +14,14 @@
 
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 
+#include <fcntl.h>
+#include <io.h>
 #include <limits>
+#include <string>
 
 #include "base/files/file_path.h"
 #include "base/json/json_reader.h"
+#include "base/strings/string_util.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -32,12 +36,27 @@ namespace grinders {
 
 IndexedFrequencyDataGrinder::IndexedFrequencyDataGrinder()
     : parser_(NULL),
+      binary_output_(false),
       event_handler_errored_(false) {
 }
 
 bool IndexedFrequencyDataGrinder::ParseCommandLine(
     const base::CommandLine* command_line) {
   serializer_.set_pretty_print(command_line->HasSwitch("pretty-print"));
+
+  const char kOutputFormat[] = "output-format";
+  if (!command_line->HasSwitch(kOutputFormat))
+    return true;
+
+  std::string format = command_line->GetSwitchValueASCII(kOutputFormat);
+  if (base::LowerCaseEqualsASCII(format, "json")) {
+    binary_output_ = false;
+  } else if (base::LowerCaseEqualsASCII(format, "binary")) {
+    binary_output_ = true;
+  } else {
+    LOG(ERROR) << "Unknown output format: " << format << ".";
+    return false;
+  }
   return true;
 }
 
@@ -46,6 +65,48 @@ void IndexedFrequencyDataGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool IndexedFrequencyDataGrinder::Merge(const GrinderInterface& partition) {
+  using basic_block_util::EntryCountType;
+  using basic_block_util::IndexedFrequencyInformation;
+  using basic_block_util::IndexedFrequencyMap;
+
+  const IndexedFrequencyDataGrinder& other =
+      static_cast<const IndexedFrequencyDataGrinder&>(partition);
+  if (other.event_handler_errored_)
+    event_handler_errored_ = true;
+
+  ModuleIndexedFrequencyMap::const_iterator module_it =
+      other.frequency_data_map_.begin();
+  for (; module_it != other.frequency_data_map_.end(); ++module_it) {
+    std::pair<ModuleIndexedFrequencyMap::iterator, bool> result =
+        frequency_data_map_.insert(*module_it);
+    if (result.second)
+      continue;
+
+    // Validate fields are compatible to be grinded together.
+    IndexedFrequencyInformation& info = result.first->second;
+    const IndexedFrequencyInformation& other_info = module_it->second;
+    if (info.num_entries != other_info.num_entries ||
+        info.num_columns != other_info.num_columns ||
+        info.frequency_size != other_info.frequency_size ||
+        info.data_type != other_info.data_type) {
+      event_handler_errored_ = true;
+      continue;
+    }
+
+    // Add up the frequencies using saturation arithmetic.
+    IndexedFrequencyMap::const_iterator entry_it =
+        other_info.frequency_map.begin();
+    for (; entry_it != other_info.frequency_map.end(); ++entry_it) {
+      EntryCountType& value = info.frequency_map[entry_it->first];
+      value += std::min(entry_it->second,
+                        std::numeric_limits<EntryCountType>::max() - value);
+    }
+  }
+
+  return true;
+}
+
 bool IndexedFrequencyDataGrinder::Grind() {
   if (frequency_data_map_.empty()) {
     LOG(ERROR) << "No basic-block frequency data was encountered.";
@@ -57,6 +118,15 @@ bool IndexedFrequencyDataGrinder::Grind() {
 
 bool IndexedFrequencyDataGrinder::OutputData(FILE* file) {
   DCHECK(file != NULL);
+  if (binary_output_) {
+    // The output file may have been opened in text mode.
+    ::fflush(file);
+    if (::_setmode(::_fileno(file), _O_BINARY) == -1) {
+      LOG(ERROR) << "Unable to switch the output to binary mode.";
+      return false;
+    }
+    return serializer_.SaveAsBinary(frequency_data_map_, file);
+  }
   if (!serializer_.SaveAsJson(frequency_data_map_, file))
     return false;
   return true;
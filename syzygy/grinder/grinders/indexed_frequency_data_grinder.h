@@ -36,7 +36,8 @@ namespace grinders {
 // See indexed_frequency_data_serializer.h for the resulting JSON structure.
 //
 // The JSON output will be pretty printed if --pretty-print is included in the
-// command line passed to ParseCommandLine().
+// command line passed to ParseCommandLine(). The data is output in the binary
+// format of the serializer instead if --output-format=binary is.
 class IndexedFrequencyDataGrinder : public GrinderInterface {
  public:
   typedef basic_block_util::ModuleIndexedFrequencyMap ModuleIndexedFrequencyMap;
@@ -47,6 +48,8 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const base::CommandLine* command_line) override;
   virtual void SetParser(Parser* parser) override;
+  virtual bool CanMerge() const override { return true; }
+  virtual bool Merge(const GrinderInterface& partition) override;
   virtual bool Grind() override;
   virtual bool OutputData(FILE* file) override;
   // @}
@@ -121,6 +124,9 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // information.
   Parser* parser_;
 
+  // True if the data is output in the binary format rather than as JSON.
+  bool binary_output_;
+
   // Set to true if any call to OnIndexedFrequency fails. Processing will
   // continue with a warning that results may be partial.
   bool event_handler_errored_;
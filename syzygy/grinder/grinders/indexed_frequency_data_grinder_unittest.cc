@@ -63,6 +63,7 @@ class TestIndexedFrequencyDataGrinder : public IndexedFrequencyDataGrinder {
  public:
   using IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData;
   using IndexedFrequencyDataGrinder::InstrumentedModuleInformation;
+  using IndexedFrequencyDataGrinder::binary_output_;
   using IndexedFrequencyDataGrinder::parser_;
 };
 
@@ -230,6 +231,22 @@ TEST_F(IndexedFrequencyDataGrinderTest, ParseCommandLineSucceeds) {
   EXPECT_TRUE(grinder2.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(IndexedFrequencyDataGrinderTest, ParseOutputFormat) {
+  TestIndexedFrequencyDataGrinder grinder1;
+  EXPECT_TRUE(grinder1.ParseCommandLine(&cmd_line_));
+  EXPECT_FALSE(grinder1.binary_output_);
+
+  TestIndexedFrequencyDataGrinder grinder2;
+  cmd_line_.AppendSwitchASCII("output-format", "binary");
+  EXPECT_TRUE(grinder2.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(grinder2.binary_output_);
+
+  TestIndexedFrequencyDataGrinder grinder3;
+  base::CommandLine cmd_line(base::FilePath(L"grinder.exe"));
+  cmd_line.AppendSwitchASCII("output-format", "xml");
+  EXPECT_FALSE(grinder3.ParseCommandLine(&cmd_line));
+}
+
 TEST_F(IndexedFrequencyDataGrinderTest, SetParserSucceeds) {
   TestIndexedFrequencyDataGrinder grinder;
 
@@ -300,5 +317,39 @@ TEST_F(IndexedFrequencyDataGrinderTest, GrindBranchEntryDataSucceeds) {
 }
 
 
+TEST_F(IndexedFrequencyDataGrinderTest, Merge) {
+  InstrumentedModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+  ScopedFrequencyData data;
+  ASSERT_NO_FATAL_FAILURE(GetFrequencyData(module_info.original_module,
+                                           4,
+                                           &data));
+
+  // The first grinder saw the data once, and the second one twice.
+  TestIndexedFrequencyDataGrinder first;
+  TestIndexedFrequencyDataGrinder second;
+  first.UpdateBasicBlockFrequencyData(module_info, data.get());
+  second.UpdateBasicBlockFrequencyData(module_info, data.get());
+  second.UpdateBasicBlockFrequencyData(module_info, data.get());
+
+  EXPECT_TRUE(first.CanMerge());
+  ASSERT_TRUE(first.Merge(second));
+  EXPECT_EQ(1U, first.frequency_data_map().size());
+  IndexedFrequencyMap expected_counts;
+  CreateExpectedCounts(3, &expected_counts);
+  EXPECT_THAT(first.frequency_data_map().begin()->second.frequency_map,
+              testing::ContainerEq(expected_counts));
+
+  // Merging into an empty grinder copies the data.
+  TestIndexedFrequencyDataGrinder empty;
+  ASSERT_TRUE(empty.Merge(second));
+  CreateExpectedCounts(2, &expected_counts);
+  ASSERT_EQ(1U, empty.frequency_data_map().size());
+  EXPECT_THAT(empty.frequency_data_map().begin()->second.frequency_map,
+              testing::ContainerEq(expected_counts));
+  EXPECT_TRUE(empty.Grind());
+}
+
+
 }  // namespace grinders
 }  // namespace grinder
@@ -14,6 +14,7 @@
 
 #include "syzygy/grinder/grinders/mem_replay_grinder.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "syzygy/bard/raw_argument_converter.h"
@@ -32,6 +33,11 @@ namespace grinders {
 
 namespace {
 
+// The minimum number of dead objects that are considered for eviction at a
+// time. The objects that can't yet be evicted are considered again once as
+// many have died since, so that the eviction remains linear overall.
+const size_t kMinDeadObjectsToEvict = 4096;
+
 const char* kAsanHeapFunctionNames[] = {
     "asan_HeapAlloc",
     "asan_HeapCreate",
@@ -249,6 +255,10 @@ bool MemReplayGrinder::Grind() {
     ObjectMap object_map;
     // This is used to track synchronization points between threads.
     WaitedMap waited_map;
+    // The objects that died since they were last considered for eviction
+    // from |object_map|, so that it only grows with the live objects.
+    std::vector<const void*> dead_objects;
+    size_t dead_objects_to_evict = kMinDeadObjectsToEvict;
 
     // Prepopulate the object map with entries for all the process heaps that
     // existed at process startup.
@@ -283,6 +293,8 @@ bool MemReplayGrinder::Grind() {
       // created, or used.
       if (!UpdateObjectMap(thread_it, objects, &object_map))
         return false;
+      if (objects.destroyed)
+        dead_objects.push_back(objects.destroyed);
 
       // Increment the thread event iterator and reinsert it in the heap if
       // there are remaining events.
@@ -290,7 +302,17 @@ bool MemReplayGrinder::Grind() {
         heap.push_back(thread_it);
         std::push_heap(heap.begin(), heap.end());
       }
+
+      if (dead_objects.size() >= dead_objects_to_evict) {
+        EvictDeadObjects(heap, waited_map, &dead_objects, &object_map);
+        dead_objects_to_evict =
+            std::max(kMinDeadObjectsToEvict, 2 * dead_objects.size());
+      }
     }
+
+    // The timestamps were only needed to order the events.
+    for (auto& thread : proc.second.thread_data_map)
+      std::vector<uint64_t>().swap(thread.second.timestamps);
   }
 
   return true;
@@ -354,17 +376,17 @@ void MemReplayGrinder::OnFunctionNameTableEntry(
     return;
 
   std::string name(data->name);
+  ProcessData* proc_data = FindOrCreateProcessData(process_id);
   auto it = function_enum_map_.find(name);
   if (it == function_enum_map_.end()) {
     missing_events_.insert(name);
-    return;
+    proc_data->ignored_function_ids.insert(data->function_id);
+  } else {
+    auto result = proc_data->function_id_map.insert(
+        std::make_pair(data->function_id, it->second));
+    DCHECK(result.second);
   }
 
-  ProcessData* proc_data = FindOrCreateProcessData(process_id);
-  auto result = proc_data->function_id_map.insert(
-      std::make_pair(data->function_id, it->second));
-  DCHECK(result.second);
-
   // If the pending function ID set is now empty then the pending detailed
   // function call records can be drained.
   if (proc_data->pending_function_ids.erase(data->function_id) == 1 &&
@@ -398,6 +420,10 @@ void MemReplayGrinder::OnDetailedFunctionCall(
   ProcessData* proc_data = FindOrCreateProcessData(process_id);
   DCHECK_NE(static_cast<ProcessData*>(nullptr), proc_data);
 
+  // Calls to unsupported functions are skipped.
+  if (proc_data->ignored_function_ids.count(data->function_id) != 0)
+    return;
+
   // If function calls are already pending then all new calls must continue to
   // be added to the pending list.
   bool push_pending = !proc_data->pending_calls.empty();
@@ -457,6 +483,11 @@ bool MemReplayGrinder::ParseDetailedFunctionCall(
     ProcessData* proc_data) {
   DCHECK_NE(static_cast<ProcessData*>(nullptr), proc_data);
 
+  // Calls to unsupported functions are skipped. They may have been pending
+  // until their function name was seen.
+  if (proc_data->ignored_function_ids.count(data->function_id) != 0)
+    return true;
+
   // Lookup the function name. It is expected to exist.
   const auto& function = proc_data->function_id_map.find(data->function_id);
   if (function == proc_data->function_id_map.end())
@@ -873,6 +904,48 @@ bool MemReplayGrinder::UpdateObjectMap(const ThreadDataIterator& iter,
   return true;
 }
 
+void MemReplayGrinder::EvictDeadObjects(
+    const std::vector<ThreadDataIterator>& remaining,
+    const WaitedMap& waited_map,
+    std::vector<const void*>* dead_objects,
+    ObjectMap* object_map) {
+  DCHECK_NE(static_cast<std::vector<const void*>*>(nullptr), dead_objects);
+  DCHECK_NE(static_cast<ObjectMap*>(nullptr), object_map);
+
+  size_t num_kept = 0;
+  for (auto object : *dead_objects) {
+    auto it = object_map->find(object);
+
+    // Objects that were evicted already, or that were created again, are
+    // considered again when they next die.
+    if (it == object_map->end() || it->second.alive())
+      continue;
+
+    // A later creation of the object on another thread depends on its
+    // destruction, unless that thread already waited on the destroying
+    // thread past it. Threads without remaining events don't matter.
+    const ThreadDataIterator& destroyed = it->second.destroyed();
+    bool evictable = true;
+    for (const auto& thread_it : remaining) {
+      if (thread_it.thread_data == destroyed.thread_data)
+        continue;
+      auto waited_it = waited_map.find(
+          PlotLinePair(thread_it.plot_line(), destroyed.plot_line()));
+      if (waited_it == waited_map.end() ||
+          waited_it->second.index < destroyed.index) {
+        evictable = false;
+        break;
+      }
+    }
+
+    if (evictable)
+      object_map->erase(it);
+    else
+      (*dead_objects)[num_kept++] = object;
+  }
+  dead_objects->resize(num_kept);
+}
+
 MemReplayGrinder::ObjectInfo::ObjectInfo(const ThreadDataIterator& iter) {
   SetCreated(iter);
 }
@@ -165,6 +165,24 @@ class MemReplayGrinder : public GrinderInterface {
   bool UpdateObjectMap(const ThreadDataIterator& iter,
                        const EventObjects& objects,
                        ObjectMap* object_map);
+  // Evicts the dead objects whose destruction no remaining event can still
+  // depend on from @p object_map. A dependency on a destruction is only ever
+  // encoded if the depending thread hasn't already waited on the destroying
+  // thread past it, so the objects whose destruction every thread with
+  // remaining events has waited on past can be forgotten, as if they never
+  // existed.
+  // @param remaining The iterators to the next event of each thread with
+  //     remaining events.
+  // @param waited_map The map of already expressed dependencies.
+  // @param dead_objects The objects that were destroyed since they were last
+  //     considered for eviction. On return holds those that are still dead
+  //     and were not evicted.
+  // @param object_map The map describing the state of all known objects that
+  //     is to be updated.
+  void EvictDeadObjects(const std::vector<ThreadDataIterator>& remaining,
+                        const WaitedMap& waited_map,
+                        std::vector<const void*>* dead_objects,
+                        ObjectMap* object_map);
 
   // A map of recognized function names to EventType. If it's name isn't
   // in this map before grinding starts then the function will not be parsed.
@@ -237,6 +255,9 @@ struct MemReplayGrinder::ProcessData {
   std::unordered_set<uint32_t> pending_function_ids;
   // The list of detailed function calls that is pending processing.
   PendingDetailedFunctionCalls pending_calls;
+  // The function IDs of the functions that aren't supported by this grinder,
+  // such as the heap summaries of a sampled trace. Calls to them are skipped.
+  std::unordered_set<uint32_t> ignored_function_ids;
   // The story holding events for this process. Ownership is external
   // to this object.
   bard::Story* story;
@@ -35,6 +35,12 @@ class TestMemReplayGrinder : public MemReplayGrinder {
  public:
   // Types.
   using ProcessData = MemReplayGrinder::ProcessData;
+  using ObjectInfo = MemReplayGrinder::ObjectInfo;
+  using ObjectMap = MemReplayGrinder::ObjectMap;
+  using PlotLinePair = MemReplayGrinder::PlotLinePair;
+  using ThreadData = MemReplayGrinder::ThreadData;
+  using ThreadDataIterator = MemReplayGrinder::ThreadDataIterator;
+  using WaitedMap = MemReplayGrinder::WaitedMap;
 
   // Member variables.
   using MemReplayGrinder::function_enum_map_;
@@ -45,6 +51,7 @@ class TestMemReplayGrinder : public MemReplayGrinder {
   // Member functions.
   using MemReplayGrinder::FindOrCreateProcessData;
   using MemReplayGrinder::FindOrCreateThreadData;
+  using MemReplayGrinder::EvictDeadObjects;
 
   // Creates and dispatches a TraceFunctionNameTableEntry event.
   void PlayFunctionNameTableEntry(uint32_t process_id,
@@ -144,9 +151,19 @@ TEST_F(MemReplayGrinderTest, UnrecognizedFunctionName) {
   TestMemReplayGrinder grinder;
   ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
   grinder.PlayFunctionNameTableEntry(1, 1, kDummyFunction);
-  EXPECT_TRUE(grinder.process_data_map_.empty());
   EXPECT_EQ(1u, grinder.missing_events_.size());
   EXPECT_STREQ(kDummyFunction, grinder.missing_events_.begin()->c_str());
+
+  auto proc_data = grinder.FindOrCreateProcessData(1);
+  EXPECT_TRUE(proc_data->function_id_map.empty());
+  EXPECT_EQ(1u, proc_data->ignored_function_ids.count(1));
+
+  // A call to the function is skipped.
+  grinder.PlayHeapAllocCall(1, 1, 0, 1, 0, reinterpret_cast<HANDLE>(0xDEADBEEF),
+                            0, 247, reinterpret_cast<LPVOID>(0xBAADF00D));
+  EXPECT_TRUE(proc_data->pending_function_ids.empty());
+  EXPECT_TRUE(proc_data->pending_calls.empty());
+  EXPECT_TRUE(proc_data->thread_data_map.empty());
 }
 
 TEST_F(MemReplayGrinderTest, NameBeforeCall) {
@@ -220,6 +237,66 @@ TEST_F(MemReplayGrinderTest, CallBeforeName) {
   EXPECT_EQ(kRet, ha->trace_alloc());
 }
 
+TEST_F(MemReplayGrinderTest, EvictDeadObjects) {
+  using ThreadDataIterator = TestMemReplayGrinder::ThreadDataIterator;
+
+  TestMemReplayGrinder grinder;
+  bard::Story::PlotLine plot_line1;
+  bard::Story::PlotLine plot_line2;
+  TestMemReplayGrinder::ThreadData thread1;
+  thread1.plot_line = &plot_line1;
+  thread1.timestamps.resize(10);
+  TestMemReplayGrinder::ThreadData thread2;
+  thread2.plot_line = &plot_line2;
+  thread2.timestamps.resize(10);
+
+  // Two objects are created and destroyed on the first thread, and a third
+  // is created again after it died.
+  const void* kObject1 = reinterpret_cast<const void*>(0x1000);
+  const void* kObject2 = reinterpret_cast<const void*>(0x2000);
+  const void* kObject3 = reinterpret_cast<const void*>(0x3000);
+  TestMemReplayGrinder::ObjectMap object_map;
+  const ThreadDataIterator kCreated = {&thread1, 0};
+  for (auto object : {kObject1, kObject2, kObject3}) {
+    object_map.insert(
+        std::make_pair(object, TestMemReplayGrinder::ObjectInfo(kCreated)));
+  }
+  const ThreadDataIterator kDestroyed1 = {&thread1, 2};
+  const ThreadDataIterator kDestroyed2 = {&thread1, 5};
+  const ThreadDataIterator kRecreated3 = {&thread2, 6};
+  object_map.find(kObject1)->second.SetDestroyed(kDestroyed1);
+  object_map.find(kObject2)->second.SetDestroyed(kDestroyed2);
+  object_map.find(kObject3)->second.SetDestroyed(kDestroyed1);
+  object_map.find(kObject3)->second.SetCreated(kRecreated3);
+  std::vector<const void*> dead_objects = {kObject1, kObject2, kObject3};
+
+  // The second thread hasn't waited on the first, so a later creation of the
+  // objects there would depend on their destruction.
+  std::vector<ThreadDataIterator> remaining = {{&thread1, 7}, {&thread2, 7}};
+  TestMemReplayGrinder::WaitedMap waited_map;
+  grinder.EvictDeadObjects(remaining, waited_map, &dead_objects, &object_map);
+  EXPECT_EQ(3u, object_map.size());
+  EXPECT_EQ(std::vector<const void*>({kObject1, kObject2}), dead_objects);
+
+  // Once it waited past the first destruction the first object is forgotten.
+  // The object that is alive again is kept, but no longer considered.
+  const ThreadDataIterator kWaited = {&thread1, 3};
+  waited_map.insert(std::make_pair(
+      TestMemReplayGrinder::PlotLinePair(&plot_line2, &plot_line1), kWaited));
+  grinder.EvictDeadObjects(remaining, waited_map, &dead_objects, &object_map);
+  EXPECT_EQ(0u, object_map.count(kObject1));
+  EXPECT_EQ(1u, object_map.count(kObject2));
+  EXPECT_EQ(1u, object_map.count(kObject3));
+  EXPECT_EQ(std::vector<const void*>({kObject2}), dead_objects);
+
+  // Threads without remaining events don't depend on anything.
+  remaining.pop_back();
+  grinder.EvictDeadObjects(remaining, waited_map, &dead_objects, &object_map);
+  EXPECT_EQ(0u, object_map.count(kObject2));
+  EXPECT_EQ(1u, object_map.count(kObject3));
+  EXPECT_TRUE(dead_objects.empty());
+}
+
 TEST_F(MemReplayGrinderTest, GrindHarnessTrace) {
   TestMemReplayGrinder grinder;
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
@@ -14,12 +14,15 @@
 
 #include "syzygy/grinder/grinders/profile_grinder.h"
 
+#include <utility>
+
 #include "base/at_exit.h"
 #include "base/command_line.h"
+#include "base/files/file_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
-#include "base/win/scoped_bstr.h"
+#include "base/win/scoped_comptr.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
@@ -27,7 +30,6 @@
 namespace grinder {
 namespace grinders {
 
-using base::win::ScopedBstr;
 using base::win::ScopedComPtr;
 using trace::parser::AbsoluteAddress64;
 using trace::parser::ParseEventHandler;
@@ -58,6 +60,22 @@ bool ModuleInformationKeyLess(const ModuleInformation& a,
   return a.path < b.path;
 }
 
+// The extension of the persisted function tables.
+const wchar_t kFunctionTableExtension[] = L".functions";
+
+// Gets the path of the persisted function table of @p module. The name of
+// the module keeps the entries readable, the rest of the key identifies its
+// contents.
+base::FilePath GetFunctionTableCachePath(const base::FilePath& cache_dir,
+                                         const ModuleInformation& module) {
+  std::wstring name = base::StringPrintf(
+      L"%ls-%08X%08X%08X%ls",
+      base::FilePath(module.path).BaseName().value().c_str(),
+      module.module_time_date_stamp, module.module_size,
+      module.module_checksum, kFunctionTableExtension);
+  return cache_dir.Append(name);
+}
+
 }  // namespace
 
 ProfileGrinder::CodeLocation::CodeLocation()
@@ -129,6 +147,13 @@ void ProfileGrinder::CodeLocation::operator=(const CodeLocation& o) {
   }
 }
 
+void ProfileGrinder::Metrics::Extrapolate(double factor) {
+  DCHECK_LE(1.0, factor);
+
+  num_calls = static_cast<uint64_t>(num_calls * factor + 0.5);
+  cycles_sum = static_cast<uint64_t>(cycles_sum * factor + 0.5);
+}
+
 ProfileGrinder::PartData::PartData()
     : process_id_(0), thread_id_(0) {
 }
@@ -136,7 +161,8 @@ ProfileGrinder::PartData::PartData()
 ProfileGrinder::ProfileGrinder()
     : parser_(NULL),
       modules_(ModuleInformationKeyLess),
-      thread_parts_(true) {
+      thread_parts_(true),
+      output_format_(kCacheGrindFormat) {
 }
 
 ProfileGrinder::~ProfileGrinder() {
@@ -144,6 +170,22 @@ ProfileGrinder::~ProfileGrinder() {
 
 bool ProfileGrinder::ParseCommandLine(const base::CommandLine* command_line) {
   thread_parts_ = command_line->HasSwitch("thread-parts");
+  function_table_cache_dir_ =
+      command_line->GetSwitchValuePath("function-table-cache-dir");
+
+  const char kOutputFormat[] = "output-format";
+  if (!command_line->HasSwitch(kOutputFormat))
+    return true;
+
+  std::string format = command_line->GetSwitchValueASCII(kOutputFormat);
+  if (base::LowerCaseEqualsASCII(format, "cachegrind")) {
+    output_format_ = kCacheGrindFormat;
+  } else if (base::LowerCaseEqualsASCII(format, "flamegraph")) {
+    output_format_ = kFlameGraphFormat;
+  } else {
+    LOG(ERROR) << "Unknown output format: " << format << ".";
+    return false;
+  }
   return true;
 }
 
@@ -166,78 +208,96 @@ bool ProfileGrinder::GetSessionForModule(const ModuleInformation* module,
   DCHECK(session_out != NULL);
   DCHECK(*session_out == NULL);
 
-  ModuleSessionMap::const_iterator it(
-      module_sessions_.find(module));
+  ScopedComPtr<IDiaDataSource> source;
+  if (!pe::CreateDiaSource(source.Receive()))
+    return false;
 
-  if (it == module_sessions_.end()) {
-    ScopedComPtr<IDiaDataSource> source;
-    if (!pe::CreateDiaSource(source.Receive()))
-      return false;
+  base::FilePath module_path;
+  if (!pe::FindModuleBySignature(*module, &module_path) ||
+      module_path.empty()) {
+    LOG(ERROR) << "Unable to find module matching signature.";
+    return false;
+  }
 
-    base::FilePath module_path;
-    if (!pe::FindModuleBySignature(*module, &module_path) ||
-        module_path.empty()) {
-      LOG(ERROR) << "Unable to find module matching signature.";
-      return false;
+  ScopedComPtr<IDiaSession> new_session;
+  // We first try loading straight-up for the module. If the module is at
+  // this path and the symsrv machinery is available, this will bring that
+  // machinery to bear.
+  // The downside is that if the module at this path does not match the
+  // original module, we may load the wrong symbol information for the
+  // module.
+  HRESULT hr = source->loadDataForExe(module_path.value().c_str(),
+                                      NULL, NULL);
+  if (SUCCEEDED(hr)) {
+    hr = source->openSession(new_session.Receive());
+    if (FAILED(hr))
+      LOG(ERROR) << "Failure in openSession: " << common::LogHr(hr) << ".";
+  } else {
+    DCHECK(FAILED(hr));
+
+    base::FilePath pdb_path;
+    if (!pe::FindPdbForModule(module_path, &pdb_path) ||
+        pdb_path.empty()) {
+      LOG(ERROR) << "Unable to find PDB for module \""
+                 << module_path.value() << "\".";
     }
 
-    ScopedComPtr<IDiaSession> new_session;
-    // We first try loading straight-up for the module. If the module is at
-    // this path and the symsrv machinery is available, this will bring that
-    // machinery to bear.
-    // The downside is that if the module at this path does not match the
-    // original module, we may load the wrong symbol information for the
-    // module.
-    HRESULT hr = source->loadDataForExe(module_path.value().c_str(),
-                                        NULL, NULL);
+    hr = source->loadDataFromPdb(pdb_path.value().c_str());
     if (SUCCEEDED(hr)) {
-        hr = source->openSession(new_session.Receive());
-        if (FAILED(hr))
-          LOG(ERROR) << "Failure in openSession: " << common::LogHr(hr) << ".";
+      hr = source->openSession(new_session.Receive());
+      if (FAILED(hr))
+        LOG(ERROR) << "Failure in openSession: " << common::LogHr(hr) << ".";
     } else {
-      DCHECK(FAILED(hr));
+      LOG(WARNING) << "Failure in loadDataFromPdb('"
+                   << module_path.value().c_str() << "'): "
+                   << common::LogHr(hr) << ".";
+    }
+  }
 
-      base::FilePath pdb_path;
-      if (!pe::FindPdbForModule(module_path, &pdb_path) ||
-          pdb_path.empty()) {
-        LOG(ERROR) << "Unable to find PDB for module \""
-                   << module_path.value() << "\".";
-      }
+  DCHECK((SUCCEEDED(hr) && new_session.get() != NULL) ||
+         (FAILED(hr) && new_session.get() == NULL));
+  if (FAILED(hr))
+    return false;
 
-      hr = source->loadDataFromPdb(pdb_path.value().c_str());
-      if (SUCCEEDED(hr)) {
-        hr = source->openSession(new_session.Receive());
-        if (FAILED(hr))
-          LOG(ERROR) << "Failure in openSession: " << common::LogHr(hr) << ".";
-      } else {
-        LOG(WARNING) << "Failure in loadDataFromPdb('"
-                     << module_path.value().c_str() << "'): "
-                     << common::LogHr(hr) << ".";
-      }
-    }
+  *session_out = new_session.Detach();
+  return true;
+}
 
-    DCHECK((SUCCEEDED(hr) && new_session.get() != NULL) ||
-           (FAILED(hr) && new_session.get() == NULL));
+const FunctionTable* ProfileGrinder::GetFunctionTableForModule(
+    const ModuleInformation* module) {
+  DCHECK(module != NULL);
 
-    // We store an entry to the cache irrespective of whether we succeeded
-    // in opening a session above. This allows us to cache the failures, which
-    // means we attempt to load each module only once, and consequently log
-    // each failing module only once.
-    it = module_sessions_.insert(
-        std::make_pair(module, new_session)).first;
-  }
-  DCHECK(it != module_sessions_.end());
+  ModuleFunctionTableMap::const_iterator it(function_tables_.find(module));
+  if (it != function_tables_.end())
+    return it->second.get();
 
-  if (it->second.get() == NULL) {
-    // A negative session cache entry - we were previously unable to
-    // load this module.
-    return false;
-  }
+  base::FilePath cache_path;
+  if (!function_table_cache_dir_.empty())
+    cache_path = GetFunctionTableCachePath(function_table_cache_dir_, *module);
 
-  *session_out = it->second.get();
-  (*session_out)->AddRef();
+  std::unique_ptr<FunctionTable> table(new FunctionTable());
+  if (!cache_path.empty() && table->LoadFromFile(cache_path)) {
+    VLOG(1) << "Loaded function table from cache: " << cache_path.value();
+  } else {
+    // The table is extracted in a single pass over the symbols, after which
+    // the session is no longer needed.
+    ScopedComPtr<IDiaSession> session;
+    if (!GetSessionForModule(module, session.Receive()) ||
+        !table->Init(session.get())) {
+      table.reset();
+    } else if (!cache_path.empty()) {
+      if (base::CreateDirectory(function_table_cache_dir_))
+        table->SaveToFile(cache_path);
+    }
+  }
 
-  return true;
+  // We store an entry to the cache irrespective of whether we succeeded
+  // in extracting the table above. This allows us to cache the failures,
+  // which means we attempt to load each module only once, and consequently
+  // log each failing module only once.
+  const FunctionTable* result = table.get();
+  function_tables_.insert(std::make_pair(module, std::move(table)));
+  return result;
 }
 
 ProfileGrinder::PartData* ProfileGrinder::FindOrCreatePart(DWORD process_id,
@@ -261,34 +321,6 @@ ProfileGrinder::PartData* ProfileGrinder::FindOrCreatePart(DWORD process_id,
   return &it->second;
 }
 
-bool ProfileGrinder::GetFunctionSymbolByRVA(IDiaSession* session,
-                                            RVA address,
-                                            IDiaSymbol** symbol) {
-  DCHECK(session != NULL);
-  DCHECK(symbol != NULL && *symbol == NULL);
-
-  ScopedComPtr<IDiaSymbol> function;
-  HRESULT hr = session->findSymbolByRVA(address,
-                                        SymTagFunction,
-                                        function.Receive());
-  if (FAILED(hr) || function.get() == NULL) {
-    // No private function, let's try for a public symbol.
-    hr = session->findSymbolByRVA(address,
-                                  SymTagPublicSymbol,
-                                  function.Receive());
-    if (FAILED(hr))
-      return false;
-  }
-  if (function.get() == NULL) {
-    LOG(ERROR) << "NULL function returned from findSymbolByRVA.";
-    return false;
-  }
-
-  *symbol = function.Detach();
-
-  return true;
-}
-
 bool ProfileGrinder::GetFunctionForCaller(const CallerLocation& caller,
                                           FunctionLocation* function,
                                           size_t* line) {
@@ -313,69 +345,29 @@ bool ProfileGrinder::GetFunctionForCaller(const CallerLocation& caller,
     return true;
   }
 
-  ScopedComPtr<IDiaSession> session;
-  if (!GetSessionForModule(caller.module(), session.Receive()))
+  const FunctionTable* table = GetFunctionTableForModule(caller.module());
+  if (table == NULL)
     return false;
 
-  ScopedComPtr<IDiaSymbol> function_sym;
-  if (!GetFunctionSymbolByRVA(session.get(),
-                              caller.rva(),
-                              function_sym.Receive())) {
+  const FunctionTable::Function* function_entry =
+      table->FindFunction(caller.rva());
+  if (function_entry == NULL) {
     LOG(ERROR) << "No symbol info available for function in module '"
                << caller.module()->path << "'";
-  }
-
-  // Get the RVA of the function.
-  DWORD rva = 0;
-  HRESULT hr = function_sym->get_relativeVirtualAddress(&rva);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_relativeVirtualAddress: "
-               << common::LogHr(hr) << ".";
     return false;
   }
 
   // Return the module/rva we found.
-  function->Set(caller.module(), rva);
-
-  ULONGLONG length = 0;
-  hr = function_sym->get_length(&length);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_length: " << common::LogHr(hr) << ".";
-    return false;
+  function->Set(caller.module(), function_entry->rva);
+
+  *line = 0;
+  if (function_entry->length != 0) {
+    const FunctionTable::Line* caller_line =
+        table->FindLine(caller.rva(), function_entry->length);
+    if (caller_line != NULL)
+      *line = caller_line->line_number;
   }
 
-  DWORD line_number = 0;
-  if (length != 0) {
-    ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
-
-    hr = session->findLinesByRVA(caller.rva(), length, enum_lines.Receive());
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in findLinesByRVA: " << common::LogHr(hr) << ".";
-      return false;
-    }
-
-    ScopedComPtr<IDiaLineNumber> line;
-    ULONG fetched = 0;
-    hr = enum_lines->Next(1, line.Receive(), &fetched);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in IDiaLineNumber::Next: "
-                 << common::LogHr(hr) << ".";
-      return false;
-    }
-
-    if (fetched == 1) {
-      hr = line->get_lineNumber(&line_number);
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_lineNumber: " << common::LogHr(hr) << ".";
-        return false;
-      }
-    } else if (fetched != 0) {
-      NOTREACHED() << "IDiaLineNumber::Next unexpectedly returned "
-                   << fetched << " elements.";
-    }
-  }
-
-  *line = line_number;
   return true;
 }
 
@@ -416,78 +408,30 @@ bool ProfileGrinder::GetInfoForFunction(const FunctionLocation& function,
     return true;
   }
 
-  ScopedComPtr<IDiaSession> session;
-  if (!GetSessionForModule(function.module(), session.Receive()))
+  const FunctionTable* table = GetFunctionTableForModule(function.module());
+  if (table == NULL)
     return false;
 
-  ScopedComPtr<IDiaSymbol> function_sym;
-  if (!GetFunctionSymbolByRVA(session.get(),
-                              function.rva(),
-                              function_sym.Receive())) {
+  const FunctionTable::Function* function_entry =
+      table->FindFunction(function.rva());
+  if (function_entry == NULL) {
     LOG(ERROR) << "No symbol info available for function in module '"
                << function.module()->path << "'";
     return false;
   }
 
-  ScopedBstr function_name_bstr;
-  HRESULT hr = function_sym->get_name(function_name_bstr.Receive());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_name: " << common::LogHr(hr) << ".";
-    return false;
-  }
-
-  *function_name = common::ToString(function_name_bstr);
-
-  ULONGLONG length = 0;
-  hr = function_sym->get_length(&length);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_length: " << common::LogHr(hr) << ".";
-    return false;
-  }
-
-  ScopedBstr file_name_bstr;
-  DWORD line_number = 0;
-  if (length != 0) {
-    ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
-
-    hr = session->findLinesByRVA(function.rva(),
-                                 length,
-                                 enum_lines.Receive());
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in findLinesByRVA: " << common::LogHr(hr) << ".";
-      return false;
-    }
-
-    ScopedComPtr<IDiaLineNumber> line;
-    ULONG fetched = 0;
-    hr = enum_lines->Next(1, line.Receive(), &fetched);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in IDialineNumber::Next: "
-                 << common::LogHr(hr) << ".";
-      return false;
-    }
-    if (fetched == 1) {
-      hr = line->get_lineNumber(&line_number);
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_lineNumber: " << common::LogHr(hr) << ".";
-        return false;
-      }
-      ScopedComPtr<IDiaSourceFile> source_file;
-      hr = line->get_sourceFile(source_file.Receive());
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_sourceFile: " << common::LogHr(hr) << ".";
-        return false;
-      }
-      hr = source_file->get_fileName(file_name_bstr.Receive());
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_fileName: " << common::LogHr(hr) << ".";
-        return false;
-      }
+  *function_name = function_entry->name;
+  file_name->clear();
+  *line = 0;
+  if (function_entry->length != 0) {
+    const FunctionTable::Line* first_line =
+        table->FindLine(function.rva(), function_entry->length);
+    if (first_line != NULL) {
+      *file_name = table->GetFileName(*first_line);
+      *line = first_line->line_number;
     }
   }
 
-  *file_name = common::ToString(file_name_bstr);
-  *line = line_number;
   return true;
 }
 
@@ -502,6 +446,35 @@ bool ProfileGrinder::ResolveCallers() {
 }
 
 bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
+  // The sampled functions are extrapolated from their profiled calls, which
+  // are spread over their callers in proportion.
+  SkippedCallsMap::const_iterator skipped_it(part->skipped_calls_.begin());
+  for (; skipped_it != part->skipped_calls_.end(); ++skipped_it) {
+    InvocationNodeMap::iterator node_it(part->nodes_.find(skipped_it->first));
+    if (node_it == part->nodes_.end() ||
+        node_it->second.metrics.num_calls == 0) {
+      continue;
+    }
+    uint64_t num_sampled_calls = node_it->second.metrics.num_calls;
+    double factor = static_cast<double>(num_sampled_calls +
+                                        skipped_it->second) /
+                    num_sampled_calls;
+
+    // The edges of the function are contiguous, as the function leads their
+    // key, and the empty caller location sorts first.
+    InvocationEdgeMap::iterator edge_it(part->edges_.lower_bound(
+        InvocationEdgeKey(skipped_it->first, CallerLocation())));
+    for (; edge_it != part->edges_.end() &&
+               edge_it->first.first == skipped_it->first;
+         ++edge_it) {
+      InvocationEdge& edge = edge_it->second;
+      edge.metrics.Extrapolate(factor);
+      edge.caller_overhead_cycles = static_cast<uint64_t>(
+          edge.caller_overhead_cycles * factor + 0.5);
+    }
+    node_it->second.metrics.Extrapolate(factor);
+  }
+
   // We start by iterating all the edges, connecting them up to their caller,
   // and subtracting the edge metric(s) to compute the inclusive metrics for
   // each function.
@@ -535,7 +508,9 @@ bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
       // special allowance for the "fringe" nodes mentioned above, by
       // noting they have no recorded calls.
       if (node.metrics.num_calls != 0) {
-        node.metrics.cycles_sum -= edge.metrics.cycles_sum;
+        node.metrics.cycles_sum -= std::min(
+            node.metrics.cycles_sum,
+            edge.metrics.cycles_sum + edge.caller_overhead_cycles);
       }
     } else {
       // TODO(siggi): The profile instrumentation currently doesn't record
@@ -550,6 +525,16 @@ bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
 }
 
 bool ProfileGrinder::OutputData(FILE* file) {
+  if (output_format_ == kFlameGraphFormat) {
+    FlameGraphWriter writer(file);
+    PartDataMap::iterator it = parts_.begin();
+    for (; it != parts_.end(); ++it) {
+      if (!OutputFlameGraphForPart(it->second, &writer))
+        return false;
+    }
+    return true;
+  }
+
   // Output the file header.
 
   bool succeeded = true;
@@ -620,6 +605,59 @@ bool ProfileGrinder::OutputDataForPart(const PartData& part, FILE* file) {
   return true;
 }
 
+bool ProfileGrinder::OutputFlameGraphForPart(const PartData& part,
+                                             FlameGraphWriter* writer) {
+  DCHECK(writer != NULL);
+
+  // The stacks of a thread part are rooted at its process and thread.
+  std::string part_stack;
+  if (thread_parts_) {
+    FlameGraphWriter::AppendFrame(
+        base::StringPrintf("pid %d", part.process_id_), &part_stack);
+    if (!part.thread_name_.empty()) {
+      FlameGraphWriter::AppendFrame(part.thread_name_, &part_stack);
+    } else {
+      FlameGraphWriter::AppendFrame(
+          base::StringPrintf("thread %d", part.thread_id_), &part_stack);
+    }
+  }
+
+  // The names of the functions are resolved as the nodes are walked, so
+  // that only the stacks of a single function are held at a time.
+  std::wstring function_name;
+  std::wstring file_name;
+  size_t line = 0;
+  InvocationNodeMap::const_iterator node_it(part.nodes_.begin());
+  for (; node_it != part.nodes_.end(); ++node_it) {
+    const InvocationNode& node = node_it->second;
+    if (!GetInfoForFunction(node.function, &function_name, &file_name,
+                            &line)) {
+      LOG(ERROR) << "Unable to resolve function.";
+      return false;
+    }
+
+    std::string stack(part_stack);
+    FlameGraphWriter::AppendFrame(base::WideToUTF8(function_name), &stack);
+    if (!writer->WriteStack(stack, node.metrics.cycles_sum))
+      return false;
+
+    const InvocationEdge* call = node.first_call;
+    for (; call != NULL; call = call->next_call) {
+      if (!GetInfoForFunction(call->function, &function_name, &file_name,
+                              &line)) {
+        continue;
+      }
+      std::string call_stack(stack);
+      FlameGraphWriter::AppendFrame(base::WideToUTF8(function_name),
+                                    &call_stack);
+      if (!writer->WriteStack(call_stack, call->metrics.cycles_sum))
+        return false;
+    }
+  }
+
+  return true;
+}
+
 void ProfileGrinder::OnInvocationBatch(base::Time time,
                                        DWORD process_id,
                                        DWORD thread_id,
@@ -628,9 +666,16 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
   PartData* part = FindOrCreatePart(process_id, thread_id);
   DCHECK(data != NULL);
 
+  // The hooks of an uncalibrated thread are assumed to be free.
+  TraceProfilerCalibration calibration = {};
+  CalibrationMap::const_iterator calibration_it =
+      calibrations_.find(CalibrationKey(process_id, thread_id));
+  if (calibration_it != calibrations_.end())
+    calibration = calibration_it->second;
+
   // Process and aggregate the individual invocation entries.
   for (size_t i = 0; i < num_invocations; ++i) {
-    const InvocationInfo& info = data->invocations[i];
+    InvocationInfo info = data->invocations[i];
     if (info.caller == NULL || info.function == NULL) {
       // This may happen due to a termination race when the traces are captured.
       LOG(WARNING) << "Empty invocation record. Record " << i << " of " <<
@@ -661,7 +706,15 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
       ConvertToModuleRVA(process_id, caller_addr, &caller);
     }
 
-    AggregateEntryToPart(function, caller, info, part);
+    // Subtract the overhead the hooks attribute to each call.
+    uint64_t invocation_cycles = calibration.invocation_cycles;
+    info.cycles_min -= std::min(info.cycles_min, invocation_cycles);
+    info.cycles_max -= std::min(info.cycles_max, invocation_cycles);
+    info.cycles_sum -=
+        std::min(info.cycles_sum, invocation_cycles * info.num_calls);
+
+    AggregateEntryToPart(function, caller, info,
+                         calibration.caller_cycles * info.num_calls, part);
   }
 }
 
@@ -684,9 +737,38 @@ void ProfileGrinder::OnDynamicSymbol(DWORD process_id,
   dynamic_symbols_[key].assign(symbol_name.begin(), symbol_name.end());
 }
 
+void ProfileGrinder::OnProfilerCalibration(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceProfilerCalibration* data) {
+  DCHECK(data != NULL);
+
+  calibrations_[CalibrationKey(process_id, thread_id)] = *data;
+}
+
+void ProfileGrinder::OnProfilerSampling(base::Time time,
+                                        DWORD process_id,
+                                        DWORD thread_id,
+                                        const TraceProfilerSampling* data) {
+  DCHECK(data != NULL);
+
+  PartData* part = FindOrCreatePart(process_id, thread_id);
+  for (uint32_t i = 0; i < data->num_functions; ++i) {
+    // Only native functions are sampled.
+    FunctionLocation function;
+    AbsoluteAddress64 function_addr =
+        reinterpret_cast<AbsoluteAddress64>(data->functions[i].function);
+    ConvertToModuleRVA(process_id, function_addr, &function);
+
+    part->skipped_calls_[function] += data->functions[i].num_calls;
+  }
+}
+
 void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
                                           const CallerLocation& caller,
                                           const InvocationInfo& info,
+                                          uint64_t caller_overhead_cycles,
                                           PartData* part) {
   // Have we recorded this node before?
   InvocationNodeMap::iterator node_it(part->nodes_.find(function));
@@ -724,6 +806,7 @@ void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
     found.metrics.cycles_max = std::max(found.metrics.cycles_max,
                                         info.cycles_max);
     found.metrics.cycles_sum += info.cycles_sum;
+    found.caller_overhead_cycles += caller_overhead_cycles;
   } else {
     // Nopes, we haven't seen this edge before, insert it.
     InvocationEdge& edge = part->edges_[key];
@@ -733,6 +816,7 @@ void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
     edge.metrics.cycles_min = info.cycles_min;
     edge.metrics.cycles_max = info.cycles_max;
     edge.metrics.cycles_sum = info.cycles_sum;
+    edge.caller_overhead_cycles = caller_overhead_cycles;
   }
 }
 
@@ -17,9 +17,11 @@
 #include <dia2.h>
 #include <iostream>
 #include <map>
+#include <memory>
 
 #include "base/files/file_path.h"
-#include "base/win/scoped_comptr.h"
+#include "syzygy/grinder/flame_graph_writer.h"
+#include "syzygy/grinder/function_table.h"
 #include "syzygy/grinder/grinder.h"
 
 namespace grinder {
@@ -63,12 +65,30 @@ class ProfileGrinder : public GrinderInterface {
   ProfileGrinder();
   ~ProfileGrinder();
 
+  enum OutputFormat {
+    kCacheGrindFormat,
+    kFlameGraphFormat,
+  };
+
   // @name Accessors and mutators.
   // @{
   // If thread_parts is true, the grinder will aggregate and output
   // separate parts for each thread seen in the trace file(s).
   bool thread_parts() const { return thread_parts_; }
   void set_thread_parts(bool thread_parts) { thread_parts_ = thread_parts; }
+  // The format of the output, KCacheGrind unless specified otherwise.
+  OutputFormat output_format() const { return output_format_; }
+  void set_output_format(OutputFormat output_format) {
+    output_format_ = output_format;
+  }
+  // If not empty, the function tables of the modules are persisted to this
+  // directory, and loaded from it by later runs.
+  const base::FilePath& function_table_cache_dir() const {
+    return function_table_cache_dir_;
+  }
+  void set_function_table_cache_dir(const base::FilePath& cache_dir) {
+    function_table_cache_dir_ = cache_dir;
+  }
   // @}
 
   // @name GrinderInterface implementation.
@@ -93,6 +113,15 @@ class ProfileGrinder : public GrinderInterface {
   void OnDynamicSymbol(DWORD process_id,
                        uint32_t symbol_id,
                        const base::StringPiece& symbol_name) override;
+  void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceProfilerCalibration* data) override;
+  void OnProfilerSampling(base::Time time,
+                          DWORD process_id,
+                          DWORD thread_id,
+                          const TraceProfilerSampling* data) override;
   // @}
 
  protected:
@@ -116,30 +145,35 @@ class ProfileGrinder : public GrinderInterface {
   // The key to the dynamic symbol map i
   typedef std::pair<uint32_t, uint32_t> DynamicSymbolKey;
   typedef std::map<DynamicSymbolKey, std::string> DynamicSymbolMap;
+  // The calibrations of the hooks, keyed on process id/thread id.
+  typedef std::pair<uint32_t, uint32_t> CalibrationKey;
+  typedef std::map<CalibrationKey, TraceProfilerCalibration> CalibrationMap;
   typedef std::set<ModuleInformation,
       bool (*)(const ModuleInformation& a, const ModuleInformation& b)>
           ModuleInformationSet;
   typedef std::map<FunctionLocation, InvocationNode> InvocationNodeMap;
   typedef std::pair<FunctionLocation, CallerLocation> InvocationEdgeKey;
   typedef std::map<InvocationEdgeKey, InvocationEdge> InvocationEdgeMap;
+  // The calls of each function that were counted but not profiled.
+  typedef std::map<FunctionLocation, uint64_t> SkippedCallsMap;
 
-  typedef base::win::ScopedComPtr<IDiaSession> SessionPtr;
-  typedef std::map<const ModuleInformation*, SessionPtr> ModuleSessionMap;
+  typedef std::map<const ModuleInformation*, std::unique_ptr<FunctionTable>>
+      ModuleFunctionTableMap;
 
+  // Opens a DIA session on the symbols of @p module.
   bool GetSessionForModule(const ModuleInformation* module,
                            IDiaSession** session_out);
 
+  // Retrieves the function table of @p module, which is extracted from its
+  // symbols the first time it's needed, or loaded from the cache directory.
+  // @returns the function table, or NULL if the symbols of @p module can't
+  //     be loaded.
+  const FunctionTable* GetFunctionTableForModule(
+      const ModuleInformation* module);
+
   // Finds or creates the part data for the given @p thread_id.
   PartData* FindOrCreatePart(DWORD process_id, DWORD thread_id);
 
-  // Retrieves the function containing @p address.
-  // @param symbol on success returns the function's private symbol, or
-  //     public symbol if no private symbol is available.
-  // @returns true on success.
-  bool GetFunctionSymbolByRVA(IDiaSession* session,
-                              RVA address,
-                              IDiaSymbol** symbol);
-
   // Resolves the function and line number a particular caller belongs to.
   // @param caller the location of the caller.
   // @param function on success returns the caller's function location.
@@ -159,13 +193,18 @@ class ProfileGrinder : public GrinderInterface {
                           CodeLocation* rva);
 
   // Aggregates a single invocation info and/or creates a new node and edge.
+  // @param caller_overhead_cycles the cycles the hooks added to the caller
+  //     for the calls of @p info.
   void AggregateEntryToPart(const FunctionLocation& function,
                             const CallerLocation& caller,
                             const InvocationInfo& info,
+                            uint64_t caller_overhead_cycles,
                             PartData* part);
 
   // This functions adds all caller edges to each function node's linked list of
   // callers. In so doing, it also computes each function node's inclusive cost.
+  // The metrics of sampled functions are first extrapolated to their skipped
+  // calls.
   // @returns true on success, false on failure.
   bool ResolveCallers();
 
@@ -175,14 +214,28 @@ class ProfileGrinder : public GrinderInterface {
   // Outputs data for @p part to @p file.
   bool OutputDataForPart(const PartData& part, FILE* file);
 
+  // Outputs the call graph of @p part to @p writer as a flame graph. Each
+  // function leads a stack of its exclusive cycles, and a stack of the
+  // inclusive cycles of each function it calls.
+  bool OutputFlameGraphForPart(const PartData& part,
+                               FlameGraphWriter* writer);
+
   // Keeps track of the dynamic symbols seen.
   DynamicSymbolMap dynamic_symbols_;
 
+  // Keeps track of the calibrations seen, which are subtracted from the
+  // invocations of their thread.
+  CalibrationMap calibrations_;
+
   // Stores the modules we encounter.
   ModuleInformationSet modules_;
 
-  // Stores the DIA session objects we have going for each module.
-  ModuleSessionMap module_sessions_;
+  // Stores the function table of each module, or NULL for the modules whose
+  // symbols couldn't be loaded.
+  ModuleFunctionTableMap function_tables_;
+
+  // The directory the function tables are persisted to, if not empty.
+  base::FilePath function_table_cache_dir_;
 
   // The parts we store. If thread_parts_ is false, we store only a single
   // part with id 0. The parts are keyed on process id/thread id.
@@ -192,6 +245,9 @@ class ProfileGrinder : public GrinderInterface {
 
   // If true, data is aggregated and output per-thread.
   bool thread_parts_;
+
+  // The format of the output.
+  OutputFormat output_format_;
 };
 
 // The data we store for each part.
@@ -212,6 +268,9 @@ struct ProfileGrinder::PartData {
 
   // Stores the invocation edges.
   InvocationEdgeMap edges_;
+
+  // Stores the calls of the sampled functions that weren't profiled.
+  SkippedCallsMap skipped_calls_;
 };
 
 // A code location is one of two things:
@@ -296,6 +355,10 @@ struct ProfileGrinder::Metrics {
   Metrics() : num_calls(0), cycles_min(0), cycles_max(0), cycles_sum(0) {
   }
 
+  // Extrapolates metrics recorded for a sample of the calls to all calls.
+  // @param factor the ratio of all calls to the calls of the sample.
+  void Extrapolate(double factor);
+
   uint64_t num_calls;
   uint64_t cycles_min;
   uint64_t cycles_max;
@@ -319,7 +382,11 @@ struct ProfileGrinder::InvocationNode {
 
 // An invocation edge represents a caller->function pair.
 struct ProfileGrinder::InvocationEdge {
-  InvocationEdge() : caller_function(NULL), line(0), next_call(NULL) {
+  InvocationEdge()
+      : caller_overhead_cycles(0),
+        caller_function(NULL),
+        line(0),
+        next_call(NULL) {
   }
 
   // The function/caller pair we denote.
@@ -330,6 +397,10 @@ struct ProfileGrinder::InvocationEdge {
   size_t line;
   Metrics metrics;
 
+  // The cycles the hooks added to the caller for the calls of this edge,
+  // which aren't part of the caller's exclusive cost.
+  uint64_t caller_overhead_cycles;
+
   // The calling function - resolved from caller.
   InvocationNode* caller_function;
   // Chains to the next edge resolving to the
@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/grinders/profile_grinder.h"
 
+#include "base/files/file_util.h"
+#include "base/strings/stringprintf.h"
 #include "base/win/scoped_com_initializer.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -35,6 +37,7 @@ class TestProfileGrinder : public ProfileGrinder {
   using ProfileGrinder::FindOrCreatePart;
 
   typedef ProfileGrinder::InvocationNodeMap InvocationNodeMap;
+  typedef ProfileGrinder::InvocationEdgeMap InvocationEdgeMap;
 
   using ProfileGrinder::parser_;
   using ProfileGrinder::parts_;
@@ -206,6 +209,71 @@ TEST_F(ProfileGrinderTest, GrindSymbolTestData) {
   EXPECT_EQ(kCallerSymbolId, it->first.symbol_id());
 }
 
+TEST_F(ProfileGrinderTest, SubtractsCalibration) {
+  TestProfileGrinder grinder;
+  IssueSetupEvents(&grinder);
+
+  TraceProfilerCalibration calibration = {};
+  calibration.invocation_cycles = 5;
+  calibration.caller_cycles = 20;
+  grinder.OnProfilerCalibration(base::Time::Now(),
+                                ::GetCurrentProcessId(),
+                                ::GetCurrentThreadId(),
+                                &calibration);
+  IssueSymbolInvocationEvent(&grinder);
+
+  ASSERT_TRUE(grinder.Grind());
+  TestProfileGrinder::PartData* part =
+      grinder.FindOrCreatePart(::GetCurrentProcessId(),
+                               ::GetCurrentThreadId());
+  ASSERT_TRUE(part != NULL);
+
+  // The overhead of the hooks is taken off each call of the function.
+  TestProfileGrinder::InvocationNodeMap::iterator it = part->nodes_.begin();
+  ASSERT_TRUE(it != part->nodes_.end());
+  EXPECT_EQ(kFunctionSymbolId, it->first.symbol_id());
+  EXPECT_EQ(1000, it->second.metrics.num_calls);
+  EXPECT_EQ(5, it->second.metrics.cycles_min);
+  EXPECT_EQ(995, it->second.metrics.cycles_max);
+  EXPECT_EQ(1000 * 95, it->second.metrics.cycles_sum);
+
+  // The overhead the calls add to the caller is kept on the edge.
+  ASSERT_EQ(1, part->edges_.size());
+  const TestProfileGrinder::InvocationEdgeMap::mapped_type& edge =
+      part->edges_.begin()->second;
+  EXPECT_EQ(1000 * 95, edge.metrics.cycles_sum);
+  EXPECT_EQ(1000 * 20, edge.caller_overhead_cycles);
+}
+
+TEST_F(ProfileGrinderTest, ExtrapolatesSkippedCalls) {
+  TestProfileGrinder grinder;
+  IssueSetupEvents(&grinder);
+  IssueSymbolInvocationEvent(&grinder);
+
+  // The profiled calls are a fifth of the calls of the function.
+  TestProfileGrinder::PartData* part =
+      grinder.FindOrCreatePart(::GetCurrentProcessId(),
+                               ::GetCurrentThreadId());
+  ASSERT_TRUE(part != NULL);
+  TestProfileGrinder::FunctionLocation function;
+  function.Set(::GetCurrentProcessId(), kFunctionSymbolId, 0);
+  part->skipped_calls_[function] = 4000;
+
+  ASSERT_TRUE(grinder.Grind());
+
+  TestProfileGrinder::InvocationNodeMap::iterator it =
+      part->nodes_.find(function);
+  ASSERT_TRUE(it != part->nodes_.end());
+  EXPECT_EQ(5000, it->second.metrics.num_calls);
+  EXPECT_EQ(5000 * 100, it->second.metrics.cycles_sum);
+  EXPECT_EQ(10, it->second.metrics.cycles_min);
+  EXPECT_EQ(1000, it->second.metrics.cycles_max);
+
+  ASSERT_EQ(1, part->edges_.size());
+  EXPECT_EQ(5000, part->edges_.begin()->second.metrics.num_calls);
+  EXPECT_EQ(5000 * 100, part->edges_.begin()->second.metrics.cycles_sum);
+}
+
 TEST_F(ProfileGrinderTest, ParseEmptyCommandLineSucceeds) {
   TestProfileGrinder grinder;
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
@@ -218,6 +286,28 @@ TEST_F(ProfileGrinderTest, ParseThreadPartsSwitchOnCommandLine) {
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(ProfileGrinderTest, ParseOutputFormatSwitchOnCommandLine) {
+  {
+    TestProfileGrinder grinder;
+    EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+    EXPECT_EQ(ProfileGrinder::kCacheGrindFormat, grinder.output_format());
+  }
+
+  cmd_line_.AppendSwitchASCII("output-format", "flamegraph");
+  {
+    TestProfileGrinder grinder;
+    EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+    EXPECT_EQ(ProfileGrinder::kFlameGraphFormat, grinder.output_format());
+  }
+
+  cmd_line_.Init(0, NULL);
+  cmd_line_.AppendSwitchASCII("output-format", "foobar");
+  {
+    TestProfileGrinder grinder;
+    EXPECT_FALSE(grinder.ParseCommandLine(&cmd_line_));
+  }
+}
+
 TEST_F(ProfileGrinderTest, SetParserSucceeds) {
   TestProfileGrinder grinder;
   grinder.ParseCommandLine(&cmd_line_);
@@ -233,5 +323,32 @@ TEST_F(ProfileGrinderTest, GrindAndOutputCacheGrindDataSucceeds) {
   // TODO(etienneb): Validate the output is a valid CacheGrind file.
 }
 
+TEST_F(ProfileGrinderTest, GrindAndOutputFlameGraphSucceeds) {
+  cmd_line_.AppendSwitchASCII("output-format", "flamegraph");
+  ASSERT_NO_FATAL_FAILURE(GrindAndOutputSucceeds());
+}
+
+TEST_F(ProfileGrinderTest, OutputFlameGraphOfSymbols) {
+  TestProfileGrinder grinder;
+  grinder.set_output_format(ProfileGrinder::kFlameGraphFormat);
+  IssueSetupEvents(&grinder);
+  IssueSymbolInvocationEvent(&grinder);
+  ASSERT_TRUE(grinder.Grind());
+
+  testing::ScopedTempFile output_path;
+  base::ScopedFILE output_file(base::OpenFile(output_path.path(), "wb"));
+  ASSERT_TRUE(output_file.get() != NULL);
+  EXPECT_TRUE(grinder.OutputData(output_file.get()));
+  output_file.reset();
+
+  // The caller is a fringe node, with no cycles of its own.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(output_path.path(), &contents));
+  std::string part = base::StringPrintf("pid %d;TestThread;",
+                                        ::GetCurrentProcessId());
+  EXPECT_EQ(part + "Function 100000\n" +
+            part + "Caller;Function 100000\n", contents);
+}
+
 }  // namespace grinders
 }  // namespace grinder
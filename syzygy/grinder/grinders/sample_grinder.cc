@@ -21,7 +21,9 @@
 #include "syzygy/common/align.h"
 #include "syzygy/grinder/cache_grind_writer.h"
 #include "syzygy/grinder/coverage_data.h"
+#include "syzygy/grinder/flame_graph_writer.h"
 #include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/decomposition_cache.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/pe/pe_transform_policy.h"
 
@@ -156,16 +158,33 @@ bool BuildEmptyHeatMap(const SampleGrinder::ModuleKey& module_key,
     return false;
   }
 
-  // Decompose the module.
-  pe::Decomposer decomposer(image);
+  // Decompose the module, unless the decomposition cache of the pipeline
+  // has it.
   BlockGraph bg;
   pe::ImageLayout image_layout(&bg);
-  LOG(INFO) << "Decomposing module \"" << module_data.module_path.value()
-            << "\".";
-  if (!decomposer.Decompose(&image_layout)) {
-    LOG(ERROR) << "Failed to decompose module \""
-               << module_data.module_path.value() << "\".";
-    return false;
+  std::unique_ptr<pe::DecompositionCache> cache(
+      pe::DecompositionCache::Create(base::FilePath()));
+  if (cache.get() == NULL || !cache->Load(image, &image_layout)) {
+    // A corrupt cache entry may have been partially loaded.
+    if (!bg.blocks().empty()) {
+      LOG(ERROR) << "Failed to load module \""
+                 << module_data.module_path.value()
+                 << "\" from the decomposition cache.";
+      return false;
+    }
+
+    pe::Decomposer decomposer(image);
+    LOG(INFO) << "Decomposing module \"" << module_data.module_path.value()
+              << "\".";
+    if (!decomposer.Decompose(&image_layout)) {
+      LOG(ERROR) << "Failed to decompose module \""
+                 << module_data.module_path.value() << "\".";
+      return false;
+    }
+
+    // Failing to update the cache only costs the next run a decomposition.
+    if (cache.get() != NULL && !cache->Save(image, image_layout))
+      LOG(WARNING) << "Unable to update the decomposition cache.";
   }
 
   pe::PETransformPolicy policy;
@@ -283,6 +302,20 @@ bool OutputHeatMap(const HeatMap& heat_map, FILE* file) {
   return true;
 }
 
+// Output the given @p stack_heat_map to the given @p file as a flame graph,
+// the heat being expressed in microseconds.
+bool OutputStackHeatMap(const SampleGrinder::StackHeatMap& stack_heat_map,
+                        FILE* file) {
+  FlameGraphWriter writer(file);
+  SampleGrinder::StackHeatMap::const_iterator it = stack_heat_map.begin();
+  for (; it != stack_heat_map.end(); ++it) {
+    uint64_t usecs = static_cast<uint64_t>(it->second * 1e6 + 0.5);
+    if (!writer.WriteStack(it->first, usecs))
+      return false;
+  }
+  return true;
+}
+
 // A type used for converting NameHeatMaps to a sorted vector.
 typedef std::pair<double, const std::string*> HeatNamePair;
 
@@ -343,9 +376,11 @@ static_assert(arraysize(SampleGrinder::kAggregationLevelNames) ==
 
 const char SampleGrinder::kAggregationLevel[] = "aggregation-level";
 const char SampleGrinder::kImage[] = "image";
+const char SampleGrinder::kOutputFormat[] = "output-format";
 
 SampleGrinder::SampleGrinder()
     : aggregation_level_(kBasicBlock),
+      output_format_(kCsvFormat),
       parser_(NULL),
       event_handler_errored_(false),
       clock_rate_(0.0) {
@@ -374,6 +409,24 @@ bool SampleGrinder::ParseCommandLine(const base::CommandLine* command_line) {
     }
   }
 
+  if (command_line->HasSwitch(kOutputFormat)) {
+    std::string format = command_line->GetSwitchValueASCII(kOutputFormat);
+    if (base::LowerCaseEqualsASCII(format, "csv")) {
+      output_format_ = kCsvFormat;
+    } else if (base::LowerCaseEqualsASCII(format, "flamegraph")) {
+      output_format_ = kFlameGraphFormat;
+    } else {
+      LOG(ERROR) << "Unknown output format: " << format << ".";
+      return false;
+    }
+
+    if (aggregation_level_ == kLine && output_format_ != kCsvFormat) {
+      LOG(ERROR) << "The line aggregation level only supports KCacheGrind "
+                 << "output.";
+      return false;
+    }
+  }
+
   // Parse the image parameter, and initialize information about the image of
   // interest.
   image_path_ = command_line->GetSwitchValuePath(kImage);
@@ -398,6 +451,30 @@ void SampleGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool SampleGrinder::Merge(const GrinderInterface& partition) {
+  const SampleGrinder& other = static_cast<const SampleGrinder&>(partition);
+  DCHECK_EQ(aggregation_level_, other.aggregation_level_);
+  if (other.event_handler_errored_)
+    event_handler_errored_ = true;
+
+  ModuleDataMap::const_iterator mod_it = other.module_data_.begin();
+  for (; mod_it != other.module_data_.end(); ++mod_it) {
+    // Find or insert the module data, keeping the first path seen.
+    std::pair<ModuleDataMap::iterator, bool> result = module_data_.insert(
+        std::make_pair(mod_it->first, ModuleData()));
+    if (result.second)
+      result.first->second.module_path = mod_it->second.module_path;
+
+    if (!MergeModuleData(mod_it->second, &result.first->second)) {
+      LOG(ERROR) << "Failed to merge sample data for module \""
+                 << mod_it->second.module_path.value() << "\".";
+      event_handler_errored_ = true;
+    }
+  }
+
+  return true;
+}
+
 bool SampleGrinder::Grind() {
   if (event_handler_errored_) {
     LOG(WARNING) << "Failed to handle all TraceSampleData records, results "
@@ -456,7 +533,15 @@ bool SampleGrinder::Grind() {
                     << mod_it->second.module_path.value() << "\".";
     }
 
-    if (aggregation_level_ == kFunction || aggregation_level_ == kCompiland) {
+    if (output_format_ == kFlameGraphFormat) {
+      DCHECK_NE(kLine, aggregation_level_);
+      LOG(INFO) << "Rolling up basic-block heat to flame graph stacks.";
+      RollUpToStacks(aggregation_level_, mod_it->second.module_path,
+                     heat_map_, &stack_heat_map_);
+      // We can clear the heat map as it was only needed as an intermediate.
+      heat_map_.Clear();
+    } else if (aggregation_level_ == kFunction ||
+               aggregation_level_ == kCompiland) {
       LOG(INFO) << "Rolling up basic-block heat to \""
                 << kAggregationLevelNames[aggregation_level_] << "\" level.";
       RollUpByName(aggregation_level_, heat_map_, &name_heat_map_);
@@ -480,7 +565,9 @@ bool SampleGrinder::OutputData(FILE* file) {
   // If the aggregation level is basic-block, then output the data in the
   // HeatMap.
   bool success = false;
-  if (aggregation_level_ == kBasicBlock) {
+  if (output_format_ == kFlameGraphFormat) {
+    success = OutputStackHeatMap(stack_heat_map_, file);
+  } else if (aggregation_level_ == kBasicBlock) {
     success = OutputHeatMap(heat_map_, file);
   } else if (aggregation_level_ == kFunction ||
              aggregation_level_ == kCompiland) {
@@ -601,14 +688,23 @@ void SampleGrinder::UpsampleModuleData(
     return;
   }
 
+  UpsampleBuckets(sample_data->bucket_size, module_data);
+}
+
+void SampleGrinder::UpsampleBuckets(uint32_t bucket_size,
+                                    SampleGrinder::ModuleData* module_data) {
+  DCHECK(common::IsPowerOfTwo(bucket_size));
+  DCHECK(module_data != NULL);
+  DCHECK_NE(0u, module_data->bucket_size);
+
   // If we're already as coarse or finer then there's nothing to do.
-  if (module_data->bucket_size <= sample_data->bucket_size)
+  if (module_data->bucket_size <= bucket_size)
     return;
 
   // Grow the buckets in place, and then fill in the scaled values tail first.
   std::vector<double>& buckets = module_data->buckets;
   size_t old_size = buckets.size();
-  size_t factor = module_data->bucket_size / sample_data->bucket_size;
+  size_t factor = module_data->bucket_size / bucket_size;
   size_t new_size = old_size * factor;
   buckets.resize(new_size);
   for (size_t i = old_size, j = new_size; i > 0; ) {
@@ -622,9 +718,48 @@ void SampleGrinder::UpsampleModuleData(
   }
 
   // Update the bucket size.
-  module_data->bucket_size = sample_data->bucket_size;
+  module_data->bucket_size = bucket_size;
+}
 
-  return;
+bool SampleGrinder::MergeModuleData(const SampleGrinder::ModuleData& other_data,
+                                    SampleGrinder::ModuleData* module_data) {
+  DCHECK(module_data != NULL);
+
+  // Special case: we're not yet initialized. Simply copy the other data.
+  if (module_data->bucket_size == 0) {
+    module_data->bucket_size = other_data.bucket_size;
+    module_data->bucket_start = other_data.bucket_start;
+    module_data->buckets = other_data.buckets;
+    return true;
+  }
+  if (other_data.bucket_size == 0)
+    return true;
+
+  // The bucket starts need to be consistent.
+  if (other_data.bucket_start != module_data->bucket_start) {
+    LOG(ERROR) << "Module data has an inconsistent bucket start.";
+    return false;
+  }
+
+  // Bring both to the finer resolution.
+  UpsampleBuckets(other_data.bucket_size, module_data);
+  const ModuleData* source = &other_data;
+  ModuleData upsampled;
+  if (other_data.bucket_size > module_data->bucket_size) {
+    upsampled = other_data;
+    UpsampleBuckets(module_data->bucket_size, &upsampled);
+    source = &upsampled;
+  }
+  DCHECK_EQ(module_data->bucket_size, source->bucket_size);
+
+  // The bucket counts may differ by the padding of the coarser buckets.
+  std::vector<double>& buckets = module_data->buckets;
+  if (buckets.size() < source->buckets.size())
+    buckets.resize(source->buckets.size());
+  for (size_t i = 0; i < source->buckets.size(); ++i)
+    buckets[i] += source->buckets[i];
+
+  return true;
 }
 
 // Increments the module data with the given sample data. Returns false and
@@ -782,6 +917,34 @@ void SampleGrinder::RollUpByName(AggregationLevel aggregation_level,
   }
 }
 
+void SampleGrinder::RollUpToStacks(AggregationLevel aggregation_level,
+                                   const base::FilePath& module_path,
+                                   const HeatMap& heat_map,
+                                   StackHeatMap* stack_heat_map) {
+  DCHECK_NE(kLine, aggregation_level);
+  DCHECK(stack_heat_map != NULL);
+
+  std::string module_stack;
+  FlameGraphWriter::AppendFrame(module_path.BaseName().AsUTF8Unsafe(),
+                                &module_stack);
+
+  HeatMap::const_iterator it = heat_map.begin();
+  for (; it != heat_map.end(); ++it) {
+    std::string stack(module_stack);
+    FlameGraphWriter::AppendFrame(*it->second.compiland, &stack);
+    if (aggregation_level != kCompiland)
+      FlameGraphWriter::AppendFrame(*it->second.function, &stack);
+    if (aggregation_level == kBasicBlock) {
+      FlameGraphWriter::AppendFrame(
+          base::StringPrintf("0x%08X", it->first.start().value()), &stack);
+    }
+
+    StackHeatMap::iterator shm_it = stack_heat_map->insert(
+        std::make_pair(stack, 0.0)).first;
+    shm_it->second += it->second.heat;
+  }
+}
+
 bool SampleGrinder::ModuleKey::operator<(
     const ModuleKey& rhs) const {
   if (module_size < rhs.module_size)
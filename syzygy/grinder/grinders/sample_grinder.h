@@ -46,6 +46,14 @@ class SampleGrinder : public GrinderInterface {
   // AggregationLevel.
   static const char* kAggregationLevelNames[];
 
+  // The format of the output of the basic-block, function and compiland
+  // aggregation levels. The line aggregation level is always output in
+  // KCacheGrind format.
+  enum OutputFormat {
+    kCsvFormat,
+    kFlameGraphFormat,
+  };
+
   SampleGrinder();
   ~SampleGrinder();
 
@@ -53,6 +61,8 @@ class SampleGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const base::CommandLine* command_line) override;
   virtual void SetParser(Parser* parser) override;
+  virtual bool CanMerge() const override { return true; }
+  virtual bool Merge(const GrinderInterface& partition) override;
   virtual bool Grind() override;
   virtual bool OutputData(FILE* file) override;
   // @}
@@ -74,6 +84,7 @@ class SampleGrinder : public GrinderInterface {
   // @{
   static const char kAggregationLevel[];
   static const char kImage[];
+  static const char kOutputFormat[];
   // @}
 
   // Forward declarations. These are public so that they are accessible by
@@ -100,6 +111,12 @@ class SampleGrinder : public GrinderInterface {
   // named objects (compilands or functions).
   typedef std::map<const std::string*, double> NameHeatMap;
 
+  // This is the final aggregate type used to represent heat as rolled up to
+  // flame graph stacks, keyed on the stack.
+  typedef std::map<std::string, double> StackHeatMap;
+
+  OutputFormat output_format() const { return output_format_; }
+
  protected:
   // Finds or creates the sample data associated with the given module.
   ModuleData* GetModuleData(
@@ -116,6 +133,26 @@ class SampleGrinder : public GrinderInterface {
       const TraceSampleData* sample_data,
       SampleGrinder::ModuleData* module_data);
 
+  // Upsamples the provided @p module_data so that its buckets are no larger
+  // than @p bucket_size. If the resolution is already sufficient this does
+  // nothing.
+  // @param bucket_size The bucket size to upsample to. This must be a power
+  //     of two.
+  // @param module_data The initialized module data to be potentially
+  //     upsampled.
+  static void UpsampleBuckets(uint32_t bucket_size,
+                              SampleGrinder::ModuleData* module_data);
+
+  // Adds the aggregate @p other_data of a module to the @p module_data of
+  // the same module, upsampling either to the finer of their resolutions.
+  // This can fail if they do not have consistent metadata.
+  // @param other_data The module data to be added.
+  // @param module_data The module data to be incremented.
+  // @returns True on success, false otherwise.
+  // @note This is exposed for unit testing.
+  static bool MergeModuleData(const SampleGrinder::ModuleData& other_data,
+                              SampleGrinder::ModuleData* module_data);
+
   // Updates the @p module_data with the samples from @p sample_data. The
   // @p module_data must already be at sufficient resolution to accept the
   // data in @p sample_data. This can fail if the @p sample_data and the
@@ -154,9 +191,25 @@ class SampleGrinder : public GrinderInterface {
                            const HeatMap& heat_map,
                            NameHeatMap* name_heat_map);
 
+  // Given a populated @p heat_map performs an aggregation of the heat to
+  // flame graph stacks of the module, the compiland, the function and the
+  // basic block, down to the @p aggregation_level.
+  // @param aggregation_level The aggregation level. Must be one of
+  //     kBasicBlock, kFunction or kCompiland.
+  // @param module_path The path of the module of @p heat_map.
+  // @param heat_map The BB heat map to be aggregated.
+  // @param stack_heat_map The stack heat map to be populated.
+  static void RollUpToStacks(AggregationLevel aggregation_level,
+                             const base::FilePath& module_path,
+                             const HeatMap& heat_map,
+                             StackHeatMap* stack_heat_map);
+
   // The aggregation level to be used in processing samples.
   AggregationLevel aggregation_level_;
 
+  // The format of the output.
+  OutputFormat output_format_;
+
   // If image_path_ is not empty, then this data is used as a filter for
   // processing.
   base::FilePath image_path_;
@@ -186,6 +239,9 @@ class SampleGrinder : public GrinderInterface {
   HeatMap heat_map_;
   NameHeatMap name_heat_map_;
 
+  // Used only in flame graph output format. Populated by Grind().
+  StackHeatMap stack_heat_map_;
+
   // Used only in 'line' aggregation mode. Populated by Grind().
   LineInfo line_info_;
 
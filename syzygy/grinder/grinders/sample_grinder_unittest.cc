@@ -41,11 +41,14 @@ class TestSampleGrinder : public SampleGrinder {
   // Functions.
   using SampleGrinder::UpsampleModuleData;
   using SampleGrinder::IncrementModuleData;
+  using SampleGrinder::MergeModuleData;
   using SampleGrinder::IncrementHeatMapFromModuleData;
   using SampleGrinder::RollUpByName;
+  using SampleGrinder::RollUpToStacks;
 
   // Members.
   using SampleGrinder::aggregation_level_;
+  using SampleGrinder::output_format_;
   using SampleGrinder::image_path_;
   using SampleGrinder::parser_;
   using SampleGrinder::heat_map_;
@@ -367,6 +370,45 @@ TEST_F(SampleGrinderTest, IncrementModuleData) {
   EXPECT_DOUBLE_EQ(1.2, BucketSum(module_data));
 }
 
+TEST_F(SampleGrinderTest, MergeModuleData) {
+  // 4 buckets of 8 bytes with 2 seconds each.
+  SampleGrinder::ModuleData other_data;
+  other_data.bucket_size = 8;
+  other_data.bucket_start = core::RelativeAddress(0x1000);
+  other_data.buckets.resize(4, 2.0);
+
+  // Merging into uninitialized module data copies it.
+  SampleGrinder::ModuleData module_data;
+  EXPECT_TRUE(TestSampleGrinder::MergeModuleData(other_data, &module_data));
+  EXPECT_EQ(8u, module_data.bucket_size);
+  EXPECT_EQ(other_data.bucket_start, module_data.bucket_start);
+  EXPECT_EQ(other_data.buckets, module_data.buckets);
+
+  // Merging finer data upsamples the module data.
+  SampleGrinder::ModuleData finer_data;
+  finer_data.bucket_size = 4;
+  finer_data.bucket_start = other_data.bucket_start;
+  finer_data.buckets.resize(7, 1.0);
+  EXPECT_TRUE(TestSampleGrinder::MergeModuleData(finer_data, &module_data));
+  EXPECT_EQ(4u, module_data.bucket_size);
+  ASSERT_EQ(8u, module_data.buckets.size());
+  for (size_t i = 0; i < 7; ++i)
+    EXPECT_DOUBLE_EQ(2.0, module_data.buckets[i]);
+  EXPECT_DOUBLE_EQ(1.0, module_data.buckets[7]);
+
+  // Merging coarser data upsamples it.
+  EXPECT_TRUE(TestSampleGrinder::MergeModuleData(other_data, &module_data));
+  EXPECT_EQ(4u, module_data.bucket_size);
+  ASSERT_EQ(8u, module_data.buckets.size());
+  for (size_t i = 0; i < 7; ++i)
+    EXPECT_DOUBLE_EQ(3.0, module_data.buckets[i]);
+  EXPECT_DOUBLE_EQ(2.0, module_data.buckets[7]);
+
+  // Inconsistent bucket starts can't be merged.
+  other_data.bucket_start += 4;
+  EXPECT_FALSE(TestSampleGrinder::MergeModuleData(other_data, &module_data));
+}
+
 TEST_F(SampleGrinderTest, IncrementHeatMapFromModuleData) {
   // Make 9 buckets, each with 1 second of samples in them.
   SampleGrinder::ModuleData module_data;
@@ -447,6 +489,50 @@ TEST_F(SampleGrinderTest, RollUpByName) {
   EXPECT_THAT(nhm, testing::ContainerEq(expected_nhm));
 }
 
+TEST_F(SampleGrinderTest, RollUpToStacks) {
+  const std::string kFoo = "foo";
+  const std::string kBar = "bar";
+  const base::FilePath kModulePath(L"C:\\test_dll.dll");
+
+  typedef TestSampleGrinder::HeatMap::AddressSpace::Range Range;
+  typedef TestSampleGrinder::HeatMap::AddressSpace::Range::Address RVA;
+
+  // Create a very simple heat map, with two blocks of a function.
+  TestSampleGrinder::HeatMap heat_map;
+  TestSampleGrinder::BasicBlockData bbd0 = { &kFoo, &kBar, 1.0 };
+  TestSampleGrinder::BasicBlockData bbd1 = { &kFoo, &kBar, 2.0 };
+  TestSampleGrinder::BasicBlockData bbd2 = { &kBar, &kFoo, 4.0 };
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(0x1000), 4), bbd0));
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(0x1004), 4), bbd1));
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(0x2000), 4), bbd2));
+
+  TestSampleGrinder::StackHeatMap shm;
+  TestSampleGrinder::StackHeatMap expected_shm;
+
+  expected_shm["test_dll.dll;foo;bar;0x00001000"] = 1.0;
+  expected_shm["test_dll.dll;foo;bar;0x00001004"] = 2.0;
+  expected_shm["test_dll.dll;bar;foo;0x00002000"] = 4.0;
+  TestSampleGrinder::RollUpToStacks(SampleGrinder::kBasicBlock, kModulePath,
+                                    heat_map, &shm);
+  EXPECT_THAT(shm, testing::ContainerEq(expected_shm));
+
+  shm.clear();
+  expected_shm.clear();
+  expected_shm["test_dll.dll;foo;bar"] = 3.0;
+  expected_shm["test_dll.dll;bar;foo"] = 4.0;
+  TestSampleGrinder::RollUpToStacks(SampleGrinder::kFunction, kModulePath,
+                                    heat_map, &shm);
+  EXPECT_THAT(shm, testing::ContainerEq(expected_shm));
+
+  shm.clear();
+  expected_shm.clear();
+  expected_shm["test_dll.dll;foo"] = 3.0;
+  expected_shm["test_dll.dll;bar"] = 4.0;
+  TestSampleGrinder::RollUpToStacks(SampleGrinder::kCompiland, kModulePath,
+                                    heat_map, &shm);
+  EXPECT_THAT(shm, testing::ContainerEq(expected_shm));
+}
+
 TEST_F(SampleGrinderTest, ParseEmptyCommandLineFails) {
   TestSampleGrinder g;
   EXPECT_FALSE(g.ParseCommandLine(&cmd_line_));
@@ -554,6 +640,37 @@ TEST_F(SampleGrinderTest, ParseCommandLineAggregationLevel) {
   }
 }
 
+TEST_F(SampleGrinderTest, ParseCommandLineOutputFormat) {
+  cmd_line_.AppendSwitchPath(SampleGrinder::kImage, test_dll_path_);
+  {
+    TestSampleGrinder g;
+    EXPECT_TRUE(g.ParseCommandLine(&cmd_line_));
+    EXPECT_EQ(SampleGrinder::kCsvFormat, g.output_format_);
+  }
+
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kOutputFormat, "flamegraph");
+  {
+    TestSampleGrinder g;
+    EXPECT_TRUE(g.ParseCommandLine(&cmd_line_));
+    EXPECT_EQ(SampleGrinder::kFlameGraphFormat, g.output_format_);
+  }
+
+  // Lines are only output in KCacheGrind format.
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kAggregationLevel, "line");
+  {
+    TestSampleGrinder g;
+    EXPECT_FALSE(g.ParseCommandLine(&cmd_line_));
+  }
+
+  cmd_line_.Init(0, NULL);
+  cmd_line_.AppendSwitchPath(SampleGrinder::kImage, test_dll_path_);
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kOutputFormat, "foobar");
+  {
+    TestSampleGrinder g;
+    EXPECT_FALSE(g.ParseCommandLine(&cmd_line_));
+  }
+}
+
 TEST_F(SampleGrinderTest, SetParserSucceeds) {
   TestSampleGrinder g;
   EXPECT_TRUE(g.parser_ == NULL);
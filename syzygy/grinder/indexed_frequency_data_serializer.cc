@@ -14,10 +14,14 @@
 
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 
+#include <algorithm>
+#include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/json/json_reader.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -101,15 +105,7 @@ bool OutputFrequencyData(
   // Build a set of keys to output.
   size_t num_columns = 0;
   std::set<RelativeAddress> keys;
-  IndexedFrequencyMap::const_iterator it = frequencies.begin();
-  for (; it != frequencies.end(); ++it) {
-    RelativeAddress addr = it->first.first;
-    size_t column = it->first.second;
-    if (it->second != 0) {
-      keys.insert(addr);
-      num_columns = std::max(num_columns, column + 1);
-    }
-  }
+  GetNonZeroRows(frequencies, &keys, &num_columns);
 
   // For each key with at least one non-zero column, output a block with each
   // column.
@@ -205,6 +201,10 @@ bool ReadFrequencyData(const base::DictionaryValue* dict_value,
                                       &frequency_info.data_type)) {
     return false;
   }
+  if (!basic_block_util::IsValidFrequencySize(info_frequency_size)) {
+    LOG(ERROR) << "Invalid frequency size: " << info_frequency_size << ".";
+    return false;
+  }
   frequency_info.frequency_size = info_frequency_size;
 
   // Populate the IndexedFrequencyMap with the values in the list.
@@ -250,8 +250,199 @@ bool ReadFrequencyData(const base::DictionaryValue* dict_value,
   return true;
 }
 
+// Collects the offsets of the basic blocks with a non-zero frequency, and the
+// number of columns to output for each of them.
+void GetNonZeroRows(const IndexedFrequencyMap& frequencies,
+                    std::set<RelativeAddress>* keys,
+                    size_t* num_columns) {
+  DCHECK_NE(static_cast<std::set<RelativeAddress>*>(nullptr), keys);
+  DCHECK_NE(static_cast<size_t*>(nullptr), num_columns);
+
+  *num_columns = 0;
+  IndexedFrequencyMap::const_iterator it = frequencies.begin();
+  for (; it != frequencies.end(); ++it) {
+    if (it->second != 0) {
+      keys->insert(it->first.first);
+      *num_columns = std::max(*num_columns, it->first.second + 1);
+    }
+  }
+}
+
+bool WriteBytes(const void* data, size_t size, FILE* file) {
+  return size == 0 || ::fwrite(data, size, 1, file) == 1;
+}
+
+bool WriteBinaryFrequencyData(
+    const ModuleInformation& module_information,
+    const IndexedFrequencyInformation& frequency_info,
+    FILE* file) {
+  DCHECK_NE(static_cast<FILE*>(nullptr), file);
+
+  const IndexedFrequencyMap& frequencies = frequency_info.frequency_map;
+  size_t num_columns = 0;
+  std::set<RelativeAddress> keys;
+  GetNonZeroRows(frequencies, &keys, &num_columns);
+
+  IndexedFrequencyDataSerializer::BinaryModuleHeader header = {};
+  header.base_address = module_information.base_address.value();
+  header.module_size = static_cast<uint32_t>(module_information.module_size);
+  header.module_checksum = module_information.module_checksum;
+  header.module_time_date_stamp = module_information.module_time_date_stamp;
+  header.path_length = static_cast<uint32_t>(module_information.path.size());
+  header.num_entries = frequency_info.num_entries;
+  header.num_columns = frequency_info.num_columns;
+  header.data_type = frequency_info.data_type;
+  header.frequency_size = frequency_info.frequency_size;
+  header.num_rows = static_cast<uint32_t>(keys.size());
+  header.row_size = static_cast<uint32_t>(num_columns);
+
+  // The path is padded so that the arrays that follow it are aligned.
+  const uint32_t kPadding = 0;
+  size_t path_size = header.path_length * sizeof(wchar_t);
+  if (!WriteBytes(&header, sizeof(header), file) ||
+      !WriteBytes(module_information.path.data(), path_size, file) ||
+      !WriteBytes(&kPadding, path_size % sizeof(uint32_t), file)) {
+    return false;
+  }
+
+  std::vector<uint32_t> offsets;
+  offsets.reserve(keys.size());
+  std::vector<EntryCountType> values;
+  values.reserve(keys.size() * num_columns);
+  std::set<RelativeAddress>::const_iterator key = keys.begin();
+  for (; key != keys.end(); ++key) {
+    offsets.push_back(key->value());
+    for (size_t column = 0; column < num_columns; ++column) {
+      IndexedFrequencyMap::const_iterator data =
+          frequencies.find(std::make_pair(*key, column));
+      values.push_back(data != frequencies.end() ? data->second : 0);
+    }
+  }
+
+  return WriteBytes(offsets.data(), offsets.size() * sizeof(offsets[0]),
+                    file) &&
+         WriteBytes(values.data(), values.size() * sizeof(values[0]), file);
+}
+
+// Reads @p size bytes at @p cursor, which is advanced past them.
+// @returns a pointer to the bytes, or nullptr if fewer than @p size bytes are
+//     left before @p end.
+const uint8_t* ReadBytes(size_t size, const uint8_t** cursor,
+                         const uint8_t* end) {
+  DCHECK_NE(static_cast<const uint8_t**>(nullptr), cursor);
+  DCHECK_LE(*cursor, end);
+  if (static_cast<size_t>(end - *cursor) < size)
+    return nullptr;
+  const uint8_t* data = *cursor;
+  *cursor += size;
+  return data;
+}
+
+bool ReadBinaryFrequencyData(const uint8_t** cursor,
+                             const uint8_t* end,
+                             ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK_NE(static_cast<const uint8_t**>(nullptr), cursor);
+  DCHECK_NE(static_cast<ModuleIndexedFrequencyMap*>(nullptr),
+            module_frequency_map);
+
+  typedef IndexedFrequencyDataSerializer::BinaryModuleHeader
+      BinaryModuleHeader;
+  const BinaryModuleHeader* header = reinterpret_cast<
+      const BinaryModuleHeader*>(ReadBytes(sizeof(BinaryModuleHeader),
+                                           cursor, end));
+  if (header == nullptr) {
+    LOG(ERROR) << "Truncated module header.";
+    return false;
+  }
+
+  size_t path_size = header->path_length * sizeof(wchar_t);
+  const wchar_t* path = reinterpret_cast<const wchar_t*>(ReadBytes(
+      path_size + path_size % sizeof(uint32_t), cursor, end));
+  if (path == nullptr) {
+    LOG(ERROR) << "Truncated module path.";
+    return false;
+  }
+
+  if (header->data_type <= common::IndexedFrequencyData::INVALID_DATA_TYPE ||
+      header->data_type >= common::IndexedFrequencyData::MAX_DATA_TYPE) {
+    LOG(ERROR) << "Invalid data type: " << header->data_type << ".";
+    return false;
+  }
+  if (!basic_block_util::IsValidFrequencySize(header->frequency_size)) {
+    LOG(ERROR) << "Invalid frequency size: " << header->frequency_size << ".";
+    return false;
+  }
+
+  // The sizes of the arrays are computed on 64 bits, so that a corrupt header
+  // can't overflow them.
+  uint64_t offsets_size =
+      static_cast<uint64_t>(header->num_rows) * sizeof(uint32_t);
+  uint64_t values_size = static_cast<uint64_t>(header->num_rows) *
+                         header->row_size * sizeof(EntryCountType);
+  if (offsets_size + values_size > static_cast<uint64_t>(end - *cursor)) {
+    LOG(ERROR) << "Truncated frequencies.";
+    return false;
+  }
+  const uint32_t* offsets = reinterpret_cast<const uint32_t*>(
+      ReadBytes(static_cast<size_t>(offsets_size), cursor, end));
+  const EntryCountType* values = reinterpret_cast<const EntryCountType*>(
+      ReadBytes(static_cast<size_t>(values_size), cursor, end));
+  if (offsets == nullptr || values == nullptr) {
+    LOG(ERROR) << "Truncated frequencies.";
+    return false;
+  }
+
+  ModuleInformation module_information;
+  module_information.path.assign(path, header->path_length);
+  module_information.base_address =
+      pe::PEFile::AbsoluteAddress(static_cast<uint32_t>(header->base_address));
+  module_information.module_size = header->module_size;
+  module_information.module_checksum = header->module_checksum;
+  module_information.module_time_date_stamp = header->module_time_date_stamp;
+
+  // Insert a new IndexedFrequencyMap record for this module.
+  std::pair<ModuleIndexedFrequencyMap::iterator, bool> result =
+      module_frequency_map->insert(std::make_pair(
+          module_information, IndexedFrequencyInformation()));
+  if (!result.second) {
+    LOG(ERROR) << "Found duplicate entries for " << module_information.path
+               << ".";
+    return false;
+  }
+
+  IndexedFrequencyInformation& frequency_info = result.first->second;
+  frequency_info.num_entries = header->num_entries;
+  frequency_info.num_columns = header->num_columns;
+  frequency_info.data_type =
+      static_cast<common::IndexedFrequencyData::DataType>(header->data_type);
+  frequency_info.frequency_size = static_cast<uint8_t>(header->frequency_size);
+
+  // The rows are sorted, so each of them is inserted at the end of the map.
+  IndexedFrequencyMap& frequencies = frequency_info.frequency_map;
+  for (uint32_t row = 0; row < header->num_rows; ++row) {
+    if (row > 0 && offsets[row] <= offsets[row - 1]) {
+      LOG(ERROR) << "Unsorted basic block addresses in frequency list.";
+      return false;
+    }
+    for (uint32_t column = 0; column < header->row_size; ++column) {
+      EntryCountType value = values[row * header->row_size + column];
+      if (value < 0) {
+        LOG(ERROR) << "Invalid value in frequency list.";
+        return false;
+      }
+      frequencies.insert(frequencies.end(), std::make_pair(std::make_pair(
+          RelativeAddress(offsets[row]), column), value));
+    }
+  }
+
+  return true;
+}
+
 }  // namespace
 
+const uint32_t IndexedFrequencyDataSerializer::kBinaryMagic = 0x44464953;
+const uint32_t IndexedFrequencyDataSerializer::kBinaryVersion = 1;
+
 IndexedFrequencyDataSerializer::IndexedFrequencyDataSerializer()
     : pretty_print_(false) {
 }
@@ -359,4 +550,122 @@ bool IndexedFrequencyDataSerializer::PopulateFromJsonValue(
   return true;
 }
 
+bool IndexedFrequencyDataSerializer::SaveAsBinary(
+    const ModuleIndexedFrequencyMap& frequency_map, FILE* file) {
+  DCHECK(file != NULL);
+
+  BinaryFileHeader header = {};
+  header.magic = kBinaryMagic;
+  header.version = kBinaryVersion;
+  header.num_modules = static_cast<uint32_t>(frequency_map.size());
+  if (!WriteBytes(&header, sizeof(header), file))
+    return false;
+
+  ModuleIndexedFrequencyMap::const_iterator it = frequency_map.begin();
+  for (; it != frequency_map.end(); ++it) {
+    if (!WriteBinaryFrequencyData(it->first, it->second, file))
+      return false;
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::SaveAsBinary(
+    const ModuleIndexedFrequencyMap& frequency_map,
+    const base::FilePath& path) {
+  DCHECK(!path.empty());
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << path.value() << " for writing.";
+    return false;
+  }
+
+  if (!SaveAsBinary(frequency_map, file.get())) {
+    LOG(ERROR) << "Failed to write binary data to " << path.value() << ".";
+    return false;
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::LoadFromBinary(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(module_frequency_map != NULL);
+  DCHECK(!path.empty());
+
+  base::MemoryMappedFile file;
+  if (!file.Initialize(path)) {
+    LOG(ERROR) << "Failed to map '" << path.value() << "'.";
+    return false;
+  }
+
+  if (!PopulateFromBinary(file.data(), file.length(), module_frequency_map)) {
+    LOG(ERROR) << "Failed to parse '" << path.value() << "'.";
+    return false;
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::Load(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(module_frequency_map != NULL);
+  DCHECK(!path.empty());
+
+  uint32_t magic = 0;
+  {
+    base::ScopedFILE file(base::OpenFile(path, "rb"));
+    if (file.get() == NULL) {
+      LOG(ERROR) << "Failed to open '" << path.value() << "'.";
+      return false;
+    }
+    if (::fread(&magic, sizeof(magic), 1, file.get()) != 1)
+      magic = 0;
+  }
+
+  if (magic == kBinaryMagic)
+    return LoadFromBinary(path, module_frequency_map);
+  return LoadFromJson(path, module_frequency_map);
+}
+
+bool IndexedFrequencyDataSerializer::PopulateFromBinary(
+    const uint8_t* data,
+    size_t size,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(data != NULL);
+  DCHECK(module_frequency_map != NULL);
+
+  module_frequency_map->clear();
+
+  const uint8_t* cursor = data;
+  const uint8_t* end = data + size;
+  const BinaryFileHeader* header = reinterpret_cast<const BinaryFileHeader*>(
+      ReadBytes(sizeof(BinaryFileHeader), &cursor, end));
+  if (header == nullptr || header->magic != kBinaryMagic) {
+    LOG(ERROR) << "Not a binary frequency data file.";
+    return false;
+  }
+  if (header->version != kBinaryVersion) {
+    LOG(ERROR) << "Unsupported binary frequency data version: "
+               << header->version << ".";
+    return false;
+  }
+
+  for (uint32_t i = 0; i < header->num_modules; ++i) {
+    if (!ReadBinaryFrequencyData(&cursor, end, module_frequency_map)) {
+      // ReadBinaryFrequencyData() has already logged the error.
+      return false;
+    }
+  }
+
+  if (cursor != end) {
+    LOG(ERROR) << "Unexpected data after the frequencies.";
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace grinder
@@ -73,6 +73,22 @@ namespace grinder {
 //       // Basic-block frequencies list for module 2.
 //       ...
 //     ]
+//
+// The same data can be saved in a compact binary format, which is much
+// faster to load for large images. It is read directly from a memory mapping
+// of the file, and has the following layout, all fields being little-endian.
+//
+//     BinaryFileHeader
+//     // For each module:
+//     BinaryModuleHeader
+//     wchar_t path[path_length], padded to a multiple of 4 bytes.
+//     uint32_t offsets[num_rows], sorted by increasing RVA.
+//     int32_t frequencies[num_rows][row_size], where row i holds the
+//         frequencies of the basic block at offsets[i].
+//
+// As in the JSON format, only the basic blocks with at least one non-zero
+// frequency have a row. The metadata of the JSON format other than the module
+// signature isn't saved. Load() tells the formats apart by their first bytes.
 class IndexedFrequencyDataSerializer {
  public:
   typedef basic_block_util::ModuleIndexedFrequencyMap ModuleIndexedFrequencyMap;
@@ -94,7 +110,60 @@ class IndexedFrequencyDataSerializer {
   bool LoadFromJson(const base::FilePath& file_path,
                     ModuleIndexedFrequencyMap* frequency_map);
 
+  // Saves the given frequency map to a file at @p file_path, in the binary
+  // format.
+  bool SaveAsBinary(const ModuleIndexedFrequencyMap& frequency_map,
+                    const base::FilePath& file_path);
+
+  // Saves the given frequency map in the binary format to a file previously
+  // opened for writing.
+  bool SaveAsBinary(const ModuleIndexedFrequencyMap& frequency_map,
+                    FILE* file);
+
+  // Populates a frequency map from a file in the binary format, given by
+  // @p file_path.
+  bool LoadFromBinary(const base::FilePath& file_path,
+                      ModuleIndexedFrequencyMap* frequency_map);
+
+  // Populates a frequency map from a file given by @p file_path, in either
+  // the JSON or the binary format.
+  bool Load(const base::FilePath& file_path,
+            ModuleIndexedFrequencyMap* frequency_map);
+
+  // Identifies files in the binary format.
+  static const uint32_t kBinaryMagic;
+  // The version of the binary format, bumped whenever its layout changes.
+  static const uint32_t kBinaryVersion;
+
+  // The header of a file in the binary format.
+  struct BinaryFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_modules;
+  };
+
+  // The header of the frequencies of a module in the binary format.
+  struct BinaryModuleHeader {
+    uint64_t base_address;
+    uint32_t module_size;
+    uint32_t module_checksum;
+    uint32_t module_time_date_stamp;
+    uint32_t path_length;
+    uint32_t num_entries;
+    uint32_t num_columns;
+    uint32_t data_type;
+    uint32_t frequency_size;
+    uint32_t num_rows;
+    uint32_t row_size;
+  };
+
  protected:
+  // Populates a frequency map from data in the binary format. Exposed for
+  // unit-testing purposes.
+  bool PopulateFromBinary(const uint8_t* data,
+                          size_t size,
+                          ModuleIndexedFrequencyMap* frequency_map);
+
   // Populates a frequency map from JSON data. Exposed for unit-testing
   // purposes.
   bool PopulateFromJsonValue(const base::Value* json_value,
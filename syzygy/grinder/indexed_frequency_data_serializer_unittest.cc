@@ -49,6 +49,7 @@ const uint32_t kTimeDateStamp = 0xBABECAFE;
 class TestIndexedFrequencyDataSerializer
     : public IndexedFrequencyDataSerializer {
  public:
+  using IndexedFrequencyDataSerializer::PopulateFromBinary;
   using IndexedFrequencyDataSerializer::PopulateFromJsonValue;
   using IndexedFrequencyDataSerializer::pretty_print_;
 };
@@ -62,6 +63,29 @@ class IndexedFrequencyDataSerializerTest : public testing::PELibUnitTest {
     ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
   }
 
+  // Populates @p frequency_map with the frequencies of a module, where only
+  // some of the basic blocks have non-zero frequencies.
+  void InitFrequencyMap(ModuleIndexedFrequencyMap* frequency_map) {
+    ASSERT_TRUE(frequency_map != NULL);
+    ModuleInformation module_info;
+    ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+    const size_t kNumBasicBlocks = 100;
+    const size_t kNumColumns = 3;
+    IndexedFrequencyInformation& frequency_info =
+        (*frequency_map)[module_info];
+    frequency_info.num_entries = kNumBasicBlocks;
+    frequency_info.num_columns = kNumColumns;
+    frequency_info.data_type = common::IndexedFrequencyData::BRANCH;
+    frequency_info.frequency_size = 4;
+    for (size_t i = 0; i < kNumBasicBlocks; i += 3) {
+      for (size_t c = 0; c < kNumColumns; ++c) {
+        frequency_info.frequency_map[
+            std::make_pair(core::RelativeAddress(i * 16), c)] = i * c;
+      }
+    }
+  }
+
   void InitModuleInfo(ModuleInformation* module_info) {
     ASSERT_TRUE(module_info != NULL);
     module_info->path = kImageFileName;
@@ -245,4 +269,119 @@ TEST_F(IndexedFrequencyDataSerializerTest, RoundTrip) {
   EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
 }
 
+TEST_F(IndexedFrequencyDataSerializerTest, FrequencySize) {
+  ModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+  // The sums of saturating 8-bit counters go past 255.
+  ModuleIndexedFrequencyMap frequency_map;
+  IndexedFrequencyInformation& frequency_info = frequency_map[module_info];
+  frequency_info.num_entries = 1;
+  frequency_info.num_columns = 1;
+  frequency_info.data_type = common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+  frequency_info.frequency_size = 1;
+  frequency_info.frequency_map[std::make_pair(core::RelativeAddress(0), 0)] =
+      3 * 255;
+
+  base::FilePath json_path(temp_dir_.path().AppendASCII("test.json"));
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+  ModuleIndexedFrequencyMap new_frequency_map;
+  ASSERT_TRUE(serializer.LoadFromJson(json_path, &new_frequency_map));
+  EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
+
+  // Counters of 3 bytes don't exist.
+  frequency_info.frequency_size = 3;
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+  ModuleIndexedFrequencyMap invalid_frequency_map;
+  EXPECT_FALSE(serializer.LoadFromJson(json_path, &invalid_frequency_map));
+}
+
+TEST_F(IndexedFrequencyDataSerializerTest, BinaryRoundTrip) {
+  ModuleIndexedFrequencyMap frequency_map;
+  ASSERT_NO_FATAL_FAILURE(InitFrequencyMap(&frequency_map));
+
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+  base::FilePath json_path(temp_dir_.path().AppendASCII("test.json"));
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+
+  // Both formats load the same frequencies, the basic blocks whose
+  // frequencies are all zero being dropped.
+  ModuleIndexedFrequencyMap binary_frequency_map;
+  ASSERT_TRUE(serializer.LoadFromBinary(binary_path, &binary_frequency_map));
+  ModuleIndexedFrequencyMap json_frequency_map;
+  ASSERT_TRUE(serializer.LoadFromJson(json_path, &json_frequency_map));
+  EXPECT_THAT(binary_frequency_map, ContainerEq(json_frequency_map));
+  EXPECT_EQ(1U, binary_frequency_map.count(frequency_map.begin()->first));
+  EXPECT_GT(frequency_map.begin()->second.frequency_map.size(),
+            binary_frequency_map.begin()->second.frequency_map.size());
+
+  // The binary format is much more compact.
+  int64_t binary_size = 0;
+  int64_t json_size = 0;
+  ASSERT_TRUE(base::GetFileSize(binary_path, &binary_size));
+  ASSERT_TRUE(base::GetFileSize(json_path, &json_size));
+  EXPECT_GT(json_size, binary_size);
+}
+
+TEST_F(IndexedFrequencyDataSerializerTest, LoadDetectsFormat) {
+  ModuleIndexedFrequencyMap frequency_map;
+  ASSERT_NO_FATAL_FAILURE(InitFrequencyMap(&frequency_map));
+
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+  base::FilePath json_path(temp_dir_.path().AppendASCII("test.json"));
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+
+  ModuleIndexedFrequencyMap binary_frequency_map;
+  ASSERT_TRUE(serializer.Load(binary_path, &binary_frequency_map));
+  ModuleIndexedFrequencyMap json_frequency_map;
+  ASSERT_TRUE(serializer.Load(json_path, &json_frequency_map));
+  EXPECT_THAT(binary_frequency_map, ContainerEq(json_frequency_map));
+
+  base::FilePath does_not_exist(
+      temp_dir_.path().AppendASCII("does_not_exist.bin"));
+  EXPECT_FALSE(serializer.Load(does_not_exist, &binary_frequency_map));
+}
+
+TEST_F(IndexedFrequencyDataSerializerTest, PopulateFromBinaryFails) {
+  ModuleIndexedFrequencyMap frequency_map;
+  ASSERT_NO_FATAL_FAILURE(InitFrequencyMap(&frequency_map));
+
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+  TestIndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, binary_path));
+  std::string data;
+  ASSERT_TRUE(base::ReadFileToString(binary_path, &data));
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+
+  ModuleIndexedFrequencyMap new_frequency_map;
+  ASSERT_TRUE(serializer.PopulateFromBinary(bytes, data.size(),
+                                            &new_frequency_map));
+
+  // Truncated data, or data followed by garbage, is rejected.
+  EXPECT_FALSE(serializer.PopulateFromBinary(bytes, data.size() - 1,
+                                             &new_frequency_map));
+  EXPECT_FALSE(serializer.PopulateFromBinary(
+      bytes, sizeof(IndexedFrequencyDataSerializer::BinaryFileHeader) - 1,
+      &new_frequency_map));
+  data.push_back(0);
+  bytes = reinterpret_cast<const uint8_t*>(data.data());
+  EXPECT_FALSE(serializer.PopulateFromBinary(bytes, data.size(),
+                                             &new_frequency_map));
+
+  // So is data of another version.
+  data.pop_back();
+  IndexedFrequencyDataSerializer::BinaryFileHeader* header =
+      reinterpret_cast<IndexedFrequencyDataSerializer::BinaryFileHeader*>(
+          &data[0]);
+  ++header->version;
+  bytes = reinterpret_cast<const uint8_t*>(data.data());
+  EXPECT_FALSE(serializer.PopulateFromBinary(bytes, data.size(),
+                                             &new_frequency_map));
+}
+
 }  // namespace grinder
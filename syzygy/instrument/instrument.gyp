@@ -74,6 +74,8 @@
         'transforms/entry_thunk_transform.h',
         'transforms/filler_transform.cc',
         'transforms/filler_transform.h',
+        'transforms/instrumentation_report.cc',
+        'transforms/instrumentation_report.h',
         'transforms/jump_table_count_transform.cc',
         'transforms/jump_table_count_transform.h',
         'transforms/security_cookie_check_hook_transform.cc',
@@ -90,6 +92,7 @@
             'block_graph_transforms_lib',
         '<(src)/syzygy/ar/ar.gyp:ar_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/grinder/grinder.gyp:grinder_lib',
         '<(src)/syzygy/pe/orderers/pe_orderers.gyp:pe_orderers_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/transforms/pe_transforms.gyp:pe_transforms_lib',
@@ -145,6 +148,7 @@
         'transforms/entry_call_transform_unittest.cc',
         'transforms/entry_thunk_transform_unittest.cc',
         'transforms/filler_transform_unittest.cc',
+        'transforms/instrumentation_report_unittest.cc',
         'transforms/jump_table_count_transform_unittest.cc',
         'transforms/security_cookie_check_hook_transform_unittest.cc',
         'transforms/thunk_import_references_transform_unittest.cc',
@@ -63,10 +63,21 @@ static const char kUsageFormatStr[] =
     "                            use when instrumenting the provided module.\n"
     "                            If not specified a default agent library\n"
     "                            will be used. This is ignored in Asan mode.\n"
+    "    --archive-threads=N     Instruments the object files of an input\n"
+    "                            archive or list on N threads. Defaults to\n"
+    "                            1.\n"
     "    --debug-friendly        Generate more debugger friendly output by\n"
     "                            making the thunks resolve to the original\n"
     "                            function's name. This is at the cost of the\n"
     "                            uniqueness of address->name resolution.\n"
+    "    --decomposition-cache-dir=<path>\n"
+    "                            A directory caching the decompositions of\n"
+    "                            the input images, shared by the runs of the\n"
+    "                            relinking tools on a same image.\n"
+    "    --input-list=<path>     Instruments a list of object files and\n"
+    "                            archives rather than --input-image. Each\n"
+    "                            line holds an input and an output path,\n"
+    "                            separated by a tab. Asan mode only.\n"
     "    --inline-fast-path      Inline a fast path into the instrumented\n"
     "                            image.\n"
     "    --input-pdb=<path>      The PDB for the DLL to instrument. If not\n"
@@ -91,6 +102,8 @@ static const char kUsageFormatStr[] =
     "    --cookie-check-hook     Hooks __security_cookie_check.\n"
     "    --force-decompose       Forces block decomposition.\n"
     "    --multithread           Uses a thread-safe instrumentation.\n"
+    "    --no-liveness-analysis  Saves all the registers and flags clobbered\n"
+    "                            by the instrumentation, even the dead ones.\n"
     "  asan mode options:\n"
     "    --asan-rtl-options=OPTIONS\n"
     "                            Allows specification of options that will\n"
@@ -99,11 +112,33 @@ static const char kUsageFormatStr[] =
     "                            these options see common/asan_parameters. If\n"
     "                            not specified then the defaults of the RTL\n"
     "                            will be used.\n"
+    "    --coalesce-checks       Replaces the checks of adjacent accesses\n"
+    "                            through the same base register by a single\n"
+    "                            range check.\n"
+    "    --hoist-loop-checks     Replaces the checks of the accesses of the\n"
+    "                            simple counted loops by range checks ahead\n"
+    "                            of them.\n"
+    "    --hot-code-profile=<path>\n"
+    "                            A JSON file of basic block entry counts or\n"
+    "                            coverage for the input image, as produced by\n"
+    "                            grinder. The accesses of its hot basic\n"
+    "                            blocks are instrumented at the hot\n"
+    "                            instrumentation rate.\n"
+    "    --hot-entry-count=INT   The entry count from which a basic block of\n"
+    "                            the profile is hot. Defaults to 1.\n"
+    "    --hot-instrumentation-rate=DOUBLE\n"
+    "                            The fraction of the accesses of the hot\n"
+    "                            basic blocks to be instrumented, in the\n"
+    "                            range 0..1, inclusive. Defaults to 0.\n"
     "    --hot-patching          Use hot patching Asan instrumentation.\n"
     "    --instrumentation-rate=DOUBLE\n"
     "                            Specifies the fraction of instructions to\n"
     "                            be instrumented, as a value in the range\n"
     "                            0..1, inclusive. Defaults to 1.\n"
+    "    --instrumentation-threads=N\n"
+    "                            Decomposes and instruments the blocks on N\n"
+    "                            threads. The output doesn't depend on N.\n"
+    "                            Defaults to 1.\n"
     "    --no-interceptors       Disable the interception of the functions\n"
     "                            like memset, memcpy, stcpy, ReadFile... to\n"
     "                            check their parameters.\n"
@@ -111,11 +146,25 @@ static const char kUsageFormatStr[] =
     "                            analysis.\n"
     "    --no-redundancy-analysis\n"
     "                            Disables redundant memory access analysis.\n"
+    "    --overhead-report=<path>\n"
+    "                            Writes a JSON report of the probes injected\n"
+    "                            in each function and of their estimated\n"
+    "                            cost. The probes are weighted by the entry\n"
+    "                            counts of the hot code profile, if any.\n"
+    "  bbentry and branch mode options:\n"
+    "    --counter-size=<1|4>    The size in bytes of the frequency counters.\n"
+    "                            1 selects saturating 8-bit counters, which\n"
+    "                            take 4 times less memory but saturate at\n"
+    "                            255. Defaults to 4.\n"
     "  branch mode options:\n"
     "    --buffering             Enable per-thread buffering of events.\n"
     "    --fs-slot=<slot>        Specify which FS slot to use for thread\n"
     "                            local storage.\n"
     "  calltrace mode options:\n"
+    "    --inline-entry-hooks    Call the entry hook from the start of each\n"
+    "                            function rather than through a thunk.\n"
+    "                            Functions that can't be decomposed are not\n"
+    "                            instrumented.\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
     "    --module-entry-only     If specified then the per-function entry\n"
     "                            hook will not be used and only module entry\n"
@@ -123,7 +172,13 @@ static const char kUsageFormatStr[] =
     "    --no-unsafe-refs        Perform no instrumentation of references\n"
     "                            between code blocks that contain anything\n"
     "                            but C/C++.\n"
+    "  coverage mode options:\n"
+    "    --direct-probes         Each basic block stores directly to the\n"
+    "                            static coverage buffer, with no register\n"
+    "                            save.\n"
     "  profile mode options:\n"
+    "    --inline-entry-hooks    Call the entry hook from the start of each\n"
+    "                            function rather than through a thunk.\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
     "\n";
 
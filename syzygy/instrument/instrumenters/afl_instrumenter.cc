@@ -128,6 +128,12 @@ bool AFLInstrumenter::DoCommandLineParse(
     LOG(INFO) << "Cookie check hook mode enabled.";
   }
 
+  // Parse the liveness analysis flag (optional).
+  use_liveness_analysis_ = !command_line->HasSwitch("no-liveness-analysis");
+  if (!use_liveness_analysis_) {
+    LOG(INFO) << "Liveness analysis disabled.";
+  }
+
   return true;
 }
 
@@ -139,6 +145,7 @@ bool AFLInstrumenter::InstrumentImpl() {
   transformer_.reset(new instrument::transforms::AFLTransform(
       target_set_, whitelist_mode_, force_decomposition_, multithread_mode_,
       cookie_check_hook_));
+  transformer_->set_use_liveness_analysis(use_liveness_analysis_);
 
   if (!relinker_->AppendTransform(transformer_.get())) {
     LOG(ERROR) << "AppendTransform failed.";
@@ -58,6 +58,10 @@ class AFLInstrumenter : public InstrumenterWithRelinker {
   // Cookie check hook flag.
   bool cookie_check_hook_;
 
+  // Liveness analysis flag, used to skip the saves of the dead registers and
+  // flags.
+  bool use_liveness_analysis_;
+
   // The transform for this agent.
   std::unique_ptr<instrument::transforms::AFLTransform> transformer_;
 
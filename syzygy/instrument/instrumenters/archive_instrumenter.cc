@@ -19,8 +19,15 @@
 
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/ar/ar_transform.h"
 #include "syzygy/core/file_util.h"
 
@@ -31,15 +38,58 @@ namespace {
 
 const char kInputImage[] = "input-image";
 const char kOutputImage[] = "output-image";
+const char kArchiveThreads[] = "archive-threads";
+const char kInputList[] = "input-list";
 
 }  // namespace
 
+// Instruments an object file of the input list on a thread of the pool.
+class ArchiveInstrumenter::ListFileInstrumenter
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param instrumenter The archive instrumenter.
+  // @param input_path The object file to instrument.
+  // @param output_path The instrumented object file.
+  ListFileInstrumenter(const ArchiveInstrumenter* instrumenter,
+                       const base::FilePath& input_path,
+                       const base::FilePath& output_path)
+      : instrumenter_(instrumenter),
+        input_path_(input_path),
+        output_path_(output_path),
+        succeeded_(false) {
+    DCHECK_NE(reinterpret_cast<const ArchiveInstrumenter*>(NULL),
+              instrumenter_);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    succeeded_ = instrumenter_->InstrumentObjectFile(input_path_,
+                                                     output_path_);
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const base::FilePath& input_path() const { return input_path_; }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ private:
+  const ArchiveInstrumenter* instrumenter_;
+  base::FilePath input_path_;
+  base::FilePath output_path_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(ListFileInstrumenter);
+};
+
 ArchiveInstrumenter::ArchiveInstrumenter()
-    : factory_(NULL), overwrite_(false) {
+    : factory_(NULL), overwrite_(false), archive_threads_(1) {
 }
 
 ArchiveInstrumenter::ArchiveInstrumenter(InstrumenterFactoryFunction factory)
-    : factory_(factory), overwrite_(false) {
+    : factory_(factory), overwrite_(false), archive_threads_(1) {
   DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
 }
 
@@ -53,16 +103,36 @@ bool ArchiveInstrumenter::ParseCommandLine(
   // Parse the few parameters that we care about.
   input_image_ = command_line_->GetSwitchValuePath(kInputImage);
   output_image_ = command_line_->GetSwitchValuePath(kOutputImage);
+  input_list_ = command_line_->GetSwitchValuePath(kInputList);
   overwrite_ = command_line_->HasSwitch("overwrite");
 
+  if (!input_list_.empty() &&
+      (!input_image_.empty() || !output_image_.empty())) {
+    LOG(ERROR) << "--" << kInputList << " can't be used with --"
+               << kInputImage << " or --" << kOutputImage << ".";
+    return false;
+  }
+
+  if (command_line_->HasSwitch(kArchiveThreads)) {
+    std::string s = command_line_->GetSwitchValueASCII(kArchiveThreads);
+    if (!base::StringToSizeT(s, &archive_threads_) || archive_threads_ == 0) {
+      LOG(ERROR) << "Invalid number of archive threads: " << s;
+      return false;
+    }
+  }
+
   return true;
 }
 
 bool ArchiveInstrumenter::Instrument() {
   DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory_);
 
-  if (ProcessingArchive()) {
-    if (!InstrumentArchive())
+  if (!input_list_.empty()) {
+    if (!InstrumentList())
+      return false;
+  } else if (!input_image_.empty() && !output_image_.empty() &&
+             IsArchive(input_image_)) {
+    if (!InstrumentArchive(input_image_, output_image_))
       return false;
   } else {
     if (!InstrumentPassthrough())
@@ -72,15 +142,41 @@ bool ArchiveInstrumenter::Instrument() {
   return true;
 }
 
-bool ArchiveInstrumenter::ProcessingArchive() const {
-  if (input_image_.empty() || output_image_.empty())
+bool ArchiveInstrumenter::ReadFileList(const base::FilePath& path,
+                                       FileList* files) {
+  DCHECK_NE(reinterpret_cast<FileList*>(NULL), files);
+
+  std::string contents;
+  if (!base::ReadFileToString(path, &contents)) {
+    LOG(ERROR) << "Unable to read file list: " << path.value();
     return false;
+  }
+
+  files->clear();
+  std::vector<std::string> lines = base::SplitString(
+      contents, "\r\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    std::vector<std::string> paths = base::SplitString(
+        lines[i], "\t", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+    if (paths.size() != 2 || paths[0].empty() || paths[1].empty()) {
+      LOG(ERROR) << "Invalid line in file list " << path.value() << ": "
+                 << lines[i];
+      return false;
+    }
+    files->push_back(std::make_pair(
+        base::FilePath(base::UTF8ToWide(paths[0])),
+        base::FilePath(base::UTF8ToWide(paths[1]))));
+  }
+
+  return true;
+}
 
-  if (!base::PathExists(input_image_))
+bool ArchiveInstrumenter::IsArchive(const base::FilePath& path) {
+  if (!base::PathExists(path))
     return false;
 
   core::FileType file_type = core::kUnknownFileType;
-  if (!core::GuessFileType(input_image_, &file_type))
+  if (!core::GuessFileType(path, &file_type))
     return false;
 
   if (file_type == core::kArchiveFileType)
@@ -105,14 +201,16 @@ bool ArchiveInstrumenter::InstrumentPassthrough() {
   return true;
 }
 
-bool ArchiveInstrumenter::InstrumentArchive() {
+bool ArchiveInstrumenter::InstrumentArchive(
+    const base::FilePath& input_archive,
+    const base::FilePath& output_archive) {
   // Ensure we're not accidentally going to be overwriting the output.
-  if (!overwrite_ && base::PathExists(output_image_)) {
+  if (!overwrite_ && base::PathExists(output_archive)) {
     LOG(ERROR) << "Output path exists. Did you want to specify --overwrite?";
     return false;
   }
 
-  LOG(INFO) << "Instrumenting archive: " << input_image_.value();
+  LOG(INFO) << "Instrumenting archive: " << input_archive.value();
 
   // Configure and run an archive transform.
   ar::OnDiskArTransformAdapter::TransformFileOnDiskCallback callback =
@@ -120,8 +218,9 @@ bool ArchiveInstrumenter::InstrumentArchive() {
   ar::OnDiskArTransformAdapter on_disk_adapter(callback);
   ar::ArTransform ar_transform;
   ar_transform.set_callback(on_disk_adapter.outer_callback());
-  ar_transform.set_input_archive(input_image_);
-  ar_transform.set_output_archive(output_image_);
+  ar_transform.set_input_archive(input_archive);
+  ar_transform.set_output_archive(output_archive);
+  ar_transform.set_num_threads(archive_threads_);
   if (!ar_transform.Transform())
     return false;
 
@@ -154,6 +253,55 @@ bool ArchiveInstrumenter::InstrumentFile(const base::FilePath& input_path,
     return true;
   }
 
+  return InstrumentObjectFile(input_path, output_path);
+}
+
+bool ArchiveInstrumenter::InstrumentList() {
+  FileList files;
+  if (!ReadFileList(input_list_, &files))
+    return false;
+
+  // The archives are instrumented one at a time, as their files are already
+  // instrumented concurrently.
+  std::vector<std::unique_ptr<ListFileInstrumenter>> object_files;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (IsArchive(files[i].first)) {
+      if (!InstrumentArchive(files[i].first, files[i].second))
+        return false;
+      continue;
+    }
+    object_files.push_back(std::unique_ptr<ListFileInstrumenter>(
+        new ListFileInstrumenter(this, files[i].first, files[i].second)));
+  }
+
+  LOG(INFO) << "Instrumenting " << object_files.size() << " object files.";
+  size_t num_threads = std::min(archive_threads_, object_files.size());
+  if (num_threads > 1) {
+    base::DelegateSimpleThreadPool pool("ArchiveInstrumenter",
+                                        static_cast<int>(num_threads));
+    for (size_t i = 0; i < object_files.size(); ++i)
+      pool.AddWork(object_files[i].get());
+    pool.Start();
+    pool.JoinAll();
+  } else {
+    for (size_t i = 0; i < object_files.size(); ++i)
+      object_files[i]->Run();
+  }
+
+  for (size_t i = 0; i < object_files.size(); ++i) {
+    if (!object_files[i]->succeeded()) {
+      LOG(ERROR) << "Failed to instrument "
+                 << object_files[i]->input_path().value() << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ArchiveInstrumenter::InstrumentObjectFile(
+    const base::FilePath& input_path,
+    const base::FilePath& output_path) const {
   // Create the command-line for the child instrumenter.
   base::CommandLine command_line(*command_line_.get());
   command_line.AppendSwitchPath(kInputImage, input_path);
@@ -19,11 +19,24 @@
 //
 // This presumes that the underlying instrumenter uses --input-image and
 // --output-image for configuring which files are operated on.
+//
+// The files of an archive are instrumented on --archive-threads=N threads,
+// which defaults to 1. With more than one, the underlying instrumenters run
+// concurrently, each on a file of its own.
+//
+// With --input-list=<path> rather than --input-image and --output-image, a
+// list of object files and archives is instrumented in a single process. Each
+// line of the list holds an input path and an output path separated by a tab.
+// The object files are instrumented on the archive threads, and the archives
+// one after the other, their files on the archive threads. The underlying
+// instrumenters all share the rest of the command-line.
 
 #ifndef SYZYGY_INSTRUMENT_INSTRUMENTERS_ARCHIVE_INSTRUMENTER_H_
 #define SYZYGY_INSTRUMENT_INSTRUMENTERS_ARCHIVE_INSTRUMENTER_H_
 
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/files/file_path.h"
@@ -36,6 +49,7 @@ namespace instrumenters {
 class ArchiveInstrumenter : public InstrumenterInterface {
  public:
   typedef InstrumenterInterface* (*InstrumenterFactoryFunction)();
+  typedef std::vector<std::pair<base::FilePath, base::FilePath>> FileList;
 
   // Constructor.
   ArchiveInstrumenter();
@@ -46,6 +60,12 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // @returns the factory function being used by this instrumenter
   //     adapter.
   InstrumenterFactoryFunction factory() const { return factory_; }
+
+  // @returns the number of threads instrumenting the files of an archive.
+  size_t archive_threads() const { return archive_threads_; }
+
+  // @returns the path of the list of files to instrument, if any.
+  const base::FilePath& input_list() const { return input_list_; }
   // @}
 
   // @name Mutators.
@@ -61,15 +81,31 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   virtual bool Instrument() override;
   // @}
 
+  // Reads a list of files to instrument.
+  // @param path The path of the list.
+  // @param files Receives the input and output paths of the files.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  static bool ReadFileList(const base::FilePath& path, FileList* files);
+
  private:
-  // Determines if we're processing an archive file or not.
-  bool ProcessingArchive() const;
+  class ListFileInstrumenter;
+
+  // Determines if a file is an archive or not.
+  static bool IsArchive(const base::FilePath& path);
   // Passes through to the underlying instrumenter.
   bool InstrumentPassthrough();
   // Instruments an archive.
-  bool InstrumentArchive();
+  bool InstrumentArchive(const base::FilePath& input_archive,
+                         const base::FilePath& output_archive);
+  // Instruments the files of the input list.
+  bool InstrumentList();
+  // Instruments an object file with an underlying instrumenter of its own.
+  // This may be called concurrently.
+  bool InstrumentObjectFile(const base::FilePath& input_path,
+                            const base::FilePath& output_path) const;
   // Callback for the ArTransform object. This is invoked for each file in an
-  // archive.
+  // archive, concurrently if there are several archive threads.
   bool InstrumentFile(const base::FilePath& input_path,
                       const base::FilePath& output_path,
                       ar::ParsedArFileHeader* header,
@@ -84,7 +120,9 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // Bits of the command-line that we've parsed.
   base::FilePath input_image_;
   base::FilePath output_image_;
+  base::FilePath input_list_;
   bool overwrite_;
+  size_t archive_threads_;
 
   DISALLOW_COPY_AND_ASSIGN(ArchiveInstrumenter);
 };
@@ -15,6 +15,8 @@
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 
 #include "base/files/file_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
 #include "gtest/gtest.h"
 #include "syzygy/ar/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
@@ -80,6 +82,8 @@ class ArchiveInstrumenterTest : public testing::PELibUnitTest {
     test_dll_dll_ = testing::GetExeTestDataRelativePath(
         testing::kTestDllName);
     zlib_lib_ = testing::GetSrcRelativePath(testing::kArchiveFile);
+    test_dll_obj_ = testing::GetExeTestDataRelativePath(
+        testing::kTestDllCoffObjName);
     output_image_ = temp_dir_.Append(L"output.dat");
 
     command_line_.reset(
@@ -96,9 +100,29 @@ class ArchiveInstrumenterTest : public testing::PELibUnitTest {
 
   virtual void TearDown() override { testing::PELibUnitTest::TearDown(); }
 
+  // Writes a list of files to instrument, and uses it rather than an input
+  // and an output image.
+  void WriteInputList(const std::string& contents) {
+    base::FilePath input_list = temp_dir_.Append(L"input_list.txt");
+    ASSERT_EQ(static_cast<int>(contents.size()),
+              base::WriteFile(input_list, contents.data(),
+                              static_cast<int>(contents.size())));
+    command_line_.reset(
+        new base::CommandLine(base::FilePath(L"instrumenter.exe")));
+    command_line_->AppendSwitchPath("input-list", input_list);
+  }
+
+  // @returns a line of an input list.
+  static std::string ListLine(const base::FilePath& input_path,
+                              const base::FilePath& output_path) {
+    return base::WideToUTF8(input_path.value()) + "\t" +
+           base::WideToUTF8(output_path.value()) + "\n";
+  }
+
   base::FilePath temp_dir_;
   base::FilePath test_dll_dll_;
   base::FilePath zlib_lib_;
+  base::FilePath test_dll_obj_;
   base::FilePath output_image_;
 
   std::unique_ptr<base::CommandLine> command_line_;
@@ -147,5 +171,94 @@ TEST_F(ArchiveInstrumenterTest, AsanInstrumentArchive) {
   EXPECT_TRUE(base::PathExists(output_image_));
 }
 
+TEST_F(ArchiveInstrumenterTest, ParseCommandLineFailsInvalidArchiveThreads) {
+  ArchiveInstrumenter inst(&AsanInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  command_line_->AppendSwitchASCII("archive-threads", "0");
+  EXPECT_FALSE(inst.ParseCommandLine(command_line_.get()));
+}
+
+TEST_F(ArchiveInstrumenterTest, AsanInstrumentArchiveInParallel) {
+  ArchiveInstrumenter inst(&AsanInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  command_line_->AppendSwitchASCII("archive-threads", "4");
+
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_EQ(4u, inst.archive_threads());
+  EXPECT_TRUE(inst.Instrument());
+  EXPECT_TRUE(base::PathExists(output_image_));
+}
+
+TEST_F(ArchiveInstrumenterTest, ReadFileList) {
+  base::FilePath input_list = temp_dir_.Append(L"list.txt");
+  const char kContents[] = "a.obj\tb.obj\r\n\n  c.lib\td.lib  \n";
+  ASSERT_EQ(static_cast<int>(sizeof(kContents) - 1),
+            base::WriteFile(input_list, kContents, sizeof(kContents) - 1));
+
+  ArchiveInstrumenter::FileList files;
+  ASSERT_TRUE(ArchiveInstrumenter::ReadFileList(input_list, &files));
+  ASSERT_EQ(2u, files.size());
+  EXPECT_EQ(base::FilePath(L"a.obj"), files[0].first);
+  EXPECT_EQ(base::FilePath(L"b.obj"), files[0].second);
+  EXPECT_EQ(base::FilePath(L"c.lib"), files[1].first);
+  EXPECT_EQ(base::FilePath(L"d.lib"), files[1].second);
+
+  // A line must hold exactly two paths.
+  const char kInvalidContents[] = "a.obj\tb.obj\nc.obj\n";
+  ASSERT_EQ(static_cast<int>(sizeof(kInvalidContents) - 1),
+            base::WriteFile(input_list, kInvalidContents,
+                            sizeof(kInvalidContents) - 1));
+  EXPECT_FALSE(ArchiveInstrumenter::ReadFileList(input_list, &files));
+}
+
+TEST_F(ArchiveInstrumenterTest, ParseCommandLineFailsInputListAndImage) {
+  ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  command_line_->AppendSwitchPath("input-list", temp_dir_.Append(L"list"));
+  EXPECT_FALSE(inst.ParseCommandLine(command_line_.get()));
+}
+
+TEST_F(ArchiveInstrumenterTest, IteratesOverInputList) {
+  base::FilePath output_obj1 = temp_dir_.Append(L"output1.obj");
+  base::FilePath output_obj2 = temp_dir_.Append(L"output2.obj");
+  base::FilePath output_lib = temp_dir_.Append(L"output.lib");
+  ASSERT_NO_FATAL_FAILURE(WriteInputList(
+      ListLine(test_dll_obj_, output_obj1) +
+      ListLine(zlib_lib_, output_lib) +
+      ListLine(test_dll_obj_, output_obj2)));
+
+  ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_TRUE(inst.Instrument());
+
+  // An instrumenter runs for each object file, and for each file of the
+  // archive.
+  EXPECT_EQ(testing::kArchiveFileCount + 2, instrument_count);
+  EXPECT_EQ(1u, output_images.count(output_obj1));
+  EXPECT_EQ(1u, output_images.count(output_obj2));
+  EXPECT_EQ(0u, output_images.count(output_lib));
+  EXPECT_TRUE(base::PathExists(output_obj1));
+  EXPECT_TRUE(base::PathExists(output_obj2));
+  EXPECT_TRUE(base::PathExists(output_lib));
+}
+
+TEST_F(ArchiveInstrumenterTest, AsanInstrumentInputListInParallel) {
+  std::string contents;
+  std::vector<base::FilePath> outputs;
+  for (size_t i = 0; i < 4; ++i) {
+    outputs.push_back(temp_dir_.Append(
+        base::StringPrintf(L"output%d.obj", static_cast<int>(i))));
+    contents += ListLine(test_dll_obj_, outputs.back());
+  }
+  ASSERT_NO_FATAL_FAILURE(WriteInputList(contents));
+  command_line_->AppendSwitchASCII("archive-threads", "4");
+
+  ArchiveInstrumenter inst(&AsanInstrumenterFactory);
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_TRUE(inst.Instrument());
+  for (size_t i = 0; i < outputs.size(); ++i)
+    EXPECT_TRUE(base::PathExists(outputs[i]));
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
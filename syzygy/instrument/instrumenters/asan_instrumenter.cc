@@ -18,7 +18,9 @@
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/application/application.h"
+#include "syzygy/grinder/indexed_frequency_data_serializer.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
 
 namespace {
@@ -31,12 +33,32 @@ namespace instrumenters {
 AsanInstrumenter::AsanInstrumenter()
     : use_interceptors_(true),
       remove_redundant_checks_(true),
+      coalesce_checks_(false),
+      hoist_loop_checks_(false),
       use_liveness_analysis_(true),
       instrumentation_rate_(1.0),
+      instrumentation_threads_(1),
+      hot_entry_count_(1),
+      hot_instrumentation_rate_(0.0),
       asan_rtl_options_(false),
       hot_patching_(false) {
 }
 
+bool AsanInstrumenter::Instrument() {
+  if (!Super::Instrument())
+    return false;
+
+  // The report is complete once the image has been relinked.
+  if (overhead_report_.get() != nullptr &&
+      !overhead_report_->SaveToJSON(true, overhead_report_path_)) {
+    LOG(ERROR) << "Failed to write overhead report: "
+               << overhead_report_path_.value();
+    return false;
+  }
+
+  return true;
+}
+
 bool AsanInstrumenter::ImageFormatIsSupported(ImageFormat image_format) {
   if (image_format == BlockGraph::PE_IMAGE ||
       image_format == BlockGraph::COFF_IMAGE) {
@@ -66,18 +88,79 @@ bool AsanInstrumenter::InstrumentImpl() {
     }
   }
 
+  // Parse the hot code profile if one was provided.
+  std::unique_ptr<grinder::basic_block_util::IndexedFrequencyInformation>
+      hot_code_profile;
+  if (!hot_code_profile_path_.empty()) {
+    grinder::basic_block_util::ModuleIndexedFrequencyMap frequency_map;
+    grinder::IndexedFrequencyDataSerializer serializer;
+    if (!serializer.Load(hot_code_profile_path_, &frequency_map)) {
+      LOG(ERROR) << "Failed to parse hot code profile: "
+                 << hot_code_profile_path_.value();
+      return false;
+    }
+
+    // Ensure it has a profile for the input module.
+    pe::PEFile pe_file;
+    if (!pe_file.Init(input_image_path_)) {
+      LOG(ERROR) << "A hot code profile requires a PE input image.";
+      return false;
+    }
+    pe::PEFile::Signature signature;
+    pe_file.GetSignature(&signature);
+    const grinder::basic_block_util::IndexedFrequencyInformation* profile =
+        nullptr;
+    if (!grinder::basic_block_util::FindIndexedFrequencyInfo(
+            signature, frequency_map, &profile)) {
+      LOG(ERROR) << "Hot code profile does not match the input module.";
+      return false;
+    }
+
+    // The first column of these profiles holds basic block entry counts.
+    if (profile->data_type != common::IndexedFrequencyData::BASIC_BLOCK_ENTRY &&
+        profile->data_type != common::IndexedFrequencyData::BRANCH &&
+        profile->data_type != common::IndexedFrequencyData::COVERAGE) {
+      LOG(ERROR) << "Invalid hot code profile data type.";
+      return false;
+    }
+
+    hot_code_profile.reset(
+        new grinder::basic_block_util::IndexedFrequencyInformation(*profile));
+  }
+
   asan_transform_.reset(new instrument::transforms::AsanTransform());
   asan_transform_->set_instrument_dll_name(agent_dll_);
   asan_transform_->set_use_interceptors(use_interceptors_);
   asan_transform_->set_use_liveness_analysis(use_liveness_analysis_);
   asan_transform_->set_remove_redundant_checks(remove_redundant_checks_);
+  asan_transform_->set_coalesce_checks(coalesce_checks_);
+  asan_transform_->set_hoist_loop_checks(hoist_loop_checks_);
   asan_transform_->set_instrumentation_rate(instrumentation_rate_);
+  asan_transform_->set_instrumentation_threads(instrumentation_threads_);
   asan_transform_->set_hot_patching(hot_patching_);
 
   // Set up the filter if one was provided.
   if (filter.get()) {
     filter_.reset(filter.release());
     asan_transform_->set_filter(&filter_->filter);
+    asan_transform_->set_filter_page_map(&filter_->page_map);
+  }
+
+  // Set up the hot code profile if one was provided. It only changes the rate
+  // at which the accesses that aren't filtered out are instrumented.
+  if (hot_code_profile.get()) {
+    hot_code_profile_.reset(hot_code_profile.release());
+    asan_transform_->set_profile(hot_code_profile_.get());
+    asan_transform_->set_hot_entry_count(hot_entry_count_);
+    asan_transform_->set_hot_instrumentation_rate(hot_instrumentation_rate_);
+  }
+
+  // Set up the overhead report if one was requested. The probes are weighted
+  // by the entry counts of the hot code profile, if one was provided.
+  if (!overhead_report_path_.empty()) {
+    overhead_report_.reset(new instrument::transforms::InstrumentationReport());
+    overhead_report_->set_profiled(hot_code_profile_.get() != nullptr);
+    asan_transform_->set_report(overhead_report_.get());
   }
 
   // Set overwrite source range flag in the Asan transform. The Asan
@@ -110,6 +193,8 @@ bool AsanInstrumenter::DoCommandLineParse(
   filter_path_ = command_line->GetSwitchValuePath("filter");
   use_liveness_analysis_ = !command_line->HasSwitch("no-liveness-analysis");
   remove_redundant_checks_ = !command_line->HasSwitch("no-redundancy-analysis");
+  coalesce_checks_ = command_line->HasSwitch("coalesce-checks");
+  hoist_loop_checks_ = command_line->HasSwitch("hoist-loop-checks");
   use_interceptors_ = !command_line->HasSwitch("no-interceptors");
   hot_patching_ = command_line->HasSwitch("hot-patching");
 
@@ -126,6 +211,40 @@ bool AsanInstrumenter::DoCommandLineParse(
     instrumentation_rate_ = std::max(0.0, std::min(1.0, d));
   }
 
+  // Parse the number of instrumentation threads if one has been provided.
+  static const char kInstrumentationThreads[] = "instrumentation-threads";
+  if (command_line->HasSwitch(kInstrumentationThreads)) {
+    std::string s = command_line->GetSwitchValueASCII(kInstrumentationThreads);
+    if (!base::StringToSizeT(s, &instrumentation_threads_) ||
+        instrumentation_threads_ == 0) {
+      LOG(ERROR) << "Invalid number of instrumentation threads: " << s;
+      return false;
+    }
+  }
+
+  // Parse the hot code profile options.
+  hot_code_profile_path_ = command_line->GetSwitchValuePath("hot-code-profile");
+  overhead_report_path_ = command_line->GetSwitchValuePath("overhead-report");
+  static const char kHotEntryCount[] = "hot-entry-count";
+  if (command_line->HasSwitch(kHotEntryCount)) {
+    std::string s = command_line->GetSwitchValueASCII(kHotEntryCount);
+    if (!base::StringToInt(s, &hot_entry_count_) || hot_entry_count_ <= 0) {
+      LOG(ERROR) << "Invalid hot entry count: " << s;
+      return false;
+    }
+  }
+  static const char kHotInstrumentationRate[] = "hot-instrumentation-rate";
+  if (command_line->HasSwitch(kHotInstrumentationRate)) {
+    std::string s = command_line->GetSwitchValueASCII(kHotInstrumentationRate);
+    double d = 0;
+    if (!base::StringToDouble(s, &d)) {
+      LOG(ERROR) << "Failed to parse floating point value: " << s;
+      return false;
+    }
+    // Cap the rate to the range of valid values [0, 1].
+    hot_instrumentation_rate_ = std::max(0.0, std::min(1.0, d));
+  }
+
   // Parse Asan RTL options if present.
   asan_rtl_options_ = command_line->HasSwitch(common::kAsanRtlOptions);
   if (asan_rtl_options_) {
@@ -23,6 +23,7 @@
 #include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
 #include "syzygy/instrument/transforms/asan_transform.h"
+#include "syzygy/instrument/transforms/instrumentation_report.h"
 #include "syzygy/pe/image_filter.h"
 #include "syzygy/pe/pe_relinker.h"
 
@@ -36,6 +37,11 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   AsanInstrumenter();
   ~AsanInstrumenter() { }
 
+  // @name InstrumenterInterface implementation.
+  // @{
+  bool Instrument() override;
+  // @}
+
  protected:
   // @name InstrumenterWithAgent overrides.
   // @{
@@ -55,10 +61,18 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   base::FilePath filter_path_;
   bool use_interceptors_;
   bool remove_redundant_checks_;
+  bool coalesce_checks_;
+  bool hoist_loop_checks_;
   bool use_liveness_analysis_;
   double instrumentation_rate_;
+  size_t instrumentation_threads_;
+  base::FilePath hot_code_profile_path_;
+  instrument::transforms::AsanBasicBlockTransform::EntryCountType
+      hot_entry_count_;
+  double hot_instrumentation_rate_;
   bool asan_rtl_options_;
   bool hot_patching_;
+  base::FilePath overhead_report_path_;
   // @}
 
   // Valid if asan_rtl_options_ is true.
@@ -67,9 +81,18 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   // The transform for this agent.
   std::unique_ptr<instrument::transforms::AsanTransform> asan_transform_;
 
+  // The report of the overhead of the instrumentation (optional).
+  std::unique_ptr<instrument::transforms::InstrumentationReport>
+      overhead_report_;
+
   // The image filter (optional).
   std::unique_ptr<pe::ImageFilter> filter_;
 
+  // The profile of the input module telling its hot code from its cold code
+  // (optional).
+  std::unique_ptr<grinder::basic_block_util::IndexedFrequencyInformation>
+      hot_code_profile_;
+
   // Path to the JSON configuration file for the AllocationFilter transform.
   // The AllocationFilter tranform is only applied if this config file is
   // specified.
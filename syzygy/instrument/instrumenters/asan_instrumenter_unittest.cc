@@ -38,16 +38,24 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::allow_overwrite_;
   using AsanInstrumenter::asan_params_;
   using AsanInstrumenter::asan_rtl_options_;
+  using AsanInstrumenter::coalesce_checks_;
   using AsanInstrumenter::debug_friendly_;
   using AsanInstrumenter::filter_path_;
+  using AsanInstrumenter::hoist_loop_checks_;
+  using AsanInstrumenter::hot_code_profile_path_;
+  using AsanInstrumenter::hot_entry_count_;
+  using AsanInstrumenter::hot_instrumentation_rate_;
   using AsanInstrumenter::hot_patching_;
   using AsanInstrumenter::input_image_path_;
   using AsanInstrumenter::input_pdb_path_;
   using AsanInstrumenter::instrumentation_rate_;
+  using AsanInstrumenter::instrumentation_threads_;
   using AsanInstrumenter::no_augment_pdb_;
   using AsanInstrumenter::no_strip_strings_;
   using AsanInstrumenter::output_image_path_;
   using AsanInstrumenter::output_pdb_path_;
+  using AsanInstrumenter::overhead_report_;
+  using AsanInstrumenter::overhead_report_path_;
   using AsanInstrumenter::remove_redundant_checks_;
   using AsanInstrumenter::use_interceptors_;
   using AsanInstrumenter::use_liveness_analysis_;
@@ -87,6 +95,7 @@ class AsanInstrumenterTest : public testing::PELibUnitTest {
     output_pdb_path_ = temp_dir_.Append(input_pdb_path_.BaseName());
     test_dll_filter_path_ = temp_dir_.Append(L"test_dll_filter.json");
     dummy_filter_path_ = temp_dir_.Append(L"dummy_filter.json");
+    overhead_report_path_ = temp_dir_.Append(L"overhead_report.json");
   }
 
   void SetUpValidCommandLine() {
@@ -127,6 +136,7 @@ class AsanInstrumenterTest : public testing::PELibUnitTest {
   base::FilePath output_pdb_path_;
   base::FilePath test_dll_filter_path_;
   base::FilePath dummy_filter_path_;
+  base::FilePath overhead_report_path_;
   // @}
 
   // @name Expected final values of input parameters.
@@ -157,16 +167,28 @@ TEST_F(AsanInstrumenterTest, ParseMinimalAsan) {
   EXPECT_TRUE(instrumenter_.use_interceptors_);
   EXPECT_TRUE(instrumenter_.use_liveness_analysis_);
   EXPECT_TRUE(instrumenter_.remove_redundant_checks_);
+  EXPECT_FALSE(instrumenter_.coalesce_checks_);
+  EXPECT_FALSE(instrumenter_.hoist_loop_checks_);
   EXPECT_EQ(1.0, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(1u, instrumenter_.instrumentation_threads_);
+  EXPECT_TRUE(instrumenter_.hot_code_profile_path_.empty());
+  EXPECT_EQ(1, instrumenter_.hot_entry_count_);
+  EXPECT_EQ(0.0, instrumenter_.hot_instrumentation_rate_);
   EXPECT_FALSE(instrumenter_.asan_rtl_options_);
   EXPECT_FALSE(instrumenter_.hot_patching_);
+  EXPECT_TRUE(instrumenter_.overhead_report_path_.empty());
 }
 
 TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   SetUpValidCommandLine();
   cmd_line_.AppendSwitchPath("filter", test_dll_filter_path_);
   cmd_line_.AppendSwitchASCII("agent", "foo.dll");
+  cmd_line_.AppendSwitch("coalesce-checks");
   cmd_line_.AppendSwitch("debug-friendly");
+  cmd_line_.AppendSwitch("hoist-loop-checks");
+  cmd_line_.AppendSwitchPath("hot-code-profile", test_dll_filter_path_);
+  cmd_line_.AppendSwitchASCII("hot-entry-count", "100");
+  cmd_line_.AppendSwitchASCII("hot-instrumentation-rate", "0.25");
   cmd_line_.AppendSwitch("hot-patching");
   cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
   cmd_line_.AppendSwitch("no-augment-pdb");
@@ -174,9 +196,11 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitchPath("overhead-report", overhead_report_path_);
   cmd_line_.AppendSwitch("no-liveness-analysis");
   cmd_line_.AppendSwitch("no-redundancy-analysis");
   cmd_line_.AppendSwitchASCII("instrumentation-rate", "0.5");
+  cmd_line_.AppendSwitchASCII("instrumentation-threads", "8");
   cmd_line_.AppendSwitchASCII(
       common::kAsanRtlOptions,
       "\"--quarantine_size=1024 --quarantine_block_size=512 --ignored\"");
@@ -196,9 +220,16 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   EXPECT_FALSE(instrumenter_.use_interceptors_);
   EXPECT_FALSE(instrumenter_.use_liveness_analysis_);
   EXPECT_FALSE(instrumenter_.remove_redundant_checks_);
+  EXPECT_TRUE(instrumenter_.coalesce_checks_);
+  EXPECT_TRUE(instrumenter_.hoist_loop_checks_);
   EXPECT_EQ(0.5, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(8u, instrumenter_.instrumentation_threads_);
+  EXPECT_EQ(test_dll_filter_path_, instrumenter_.hot_code_profile_path_);
+  EXPECT_EQ(100, instrumenter_.hot_entry_count_);
+  EXPECT_EQ(0.25, instrumenter_.hot_instrumentation_rate_);
   EXPECT_TRUE(instrumenter_.asan_rtl_options_);
   EXPECT_TRUE(instrumenter_.hot_patching_);
+  EXPECT_EQ(overhead_report_path_, instrumenter_.overhead_report_path_);
 
   // We check that the requested RTL options were parsed, and that others are
   // left to their defaults. We don't check all the parameters as other
@@ -216,6 +247,19 @@ TEST_F(AsanInstrumenterTest, InstrumentImpl) {
   EXPECT_TRUE(instrumenter_.InstrumentPrepare());
   EXPECT_TRUE(instrumenter_.CreateRelinker());
   EXPECT_TRUE(instrumenter_.InstrumentImpl());
+  EXPECT_EQ(nullptr, instrumenter_.overhead_report_.get());
+}
+
+TEST_F(AsanInstrumenterTest, InstrumentImplWithOverheadReport) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchPath("overhead-report", overhead_report_path_);
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.InstrumentPrepare());
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_TRUE(instrumenter_.InstrumentImpl());
+  ASSERT_NE(nullptr, instrumenter_.overhead_report_.get());
+  EXPECT_FALSE(instrumenter_.overhead_report_->profiled());
 }
 
 TEST_F(AsanInstrumenterTest, FailsWithInvalidFilter) {
@@ -253,6 +297,35 @@ TEST_F(AsanInstrumenterTest, FailsWithInvalidInstrumentationRate) {
   EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(AsanInstrumenterTest, FailsWithInvalidInstrumentationThreads) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("instrumentation-threads", "0");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanInstrumenterTest, FailsWithInvalidHotEntryCount) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("hot-entry-count", "0");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanInstrumenterTest, FailsWithInvalidHotCodeProfile) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchPath("hot-code-profile", dummy_filter_path_);
+
+  // The filter isn't a profile.
+  MakeFilters();
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.InstrumentPrepare());
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_FALSE(instrumenter_.InstrumentImpl());
+}
+
 TEST_F(AsanInstrumenterTest, FailsWithInvalidAsanRtlOptions) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
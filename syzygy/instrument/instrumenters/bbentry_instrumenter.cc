@@ -16,6 +16,7 @@
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/application/application.h"
 #include "syzygy/pe/image_filter.h"
 
@@ -26,7 +27,7 @@ const char BasicBlockEntryInstrumenter::kAgentDllBasicBlockEntry[] =
     "basic_block_entry_client.dll";
 
 BasicBlockEntryInstrumenter::BasicBlockEntryInstrumenter()
-    : inline_fast_path_(false) {
+    : inline_fast_path_(false), counter_size_(sizeof(uint32_t)) {
   agent_dll_ = kAgentDllBasicBlockEntry;
 }
 
@@ -39,6 +40,7 @@ bool BasicBlockEntryInstrumenter::InstrumentImpl() {
       new instrument::transforms::BasicBlockEntryHookTransform());
   bbentry_transform_->set_instrument_dll_name(agent_dll_);
   bbentry_transform_->set_inline_fast_path(inline_fast_path_);
+  bbentry_transform_->set_frequency_size(static_cast<uint8_t>(counter_size_));
   bbentry_transform_->set_src_ranges_for_thunks(debug_friendly_);
   if (!relinker_->AppendTransform(bbentry_transform_.get()))
     return false;
@@ -61,6 +63,16 @@ bool BasicBlockEntryInstrumenter::DoCommandLineParse(
   // Parse the additional command line arguments.
   inline_fast_path_ = command_line->HasSwitch("inline-fast-path");
 
+  if (command_line->HasSwitch("counter-size")) {
+    std::string counter_size_str =
+        command_line->GetSwitchValueASCII("counter-size");
+    if (!base::StringToUint(counter_size_str, &counter_size_) ||
+        (counter_size_ != 1 && counter_size_ != 4)) {
+      LOG(ERROR) << "counter-size must be 1 or 4.";
+      return false;
+    }
+  }
+
   return true;
 }
 
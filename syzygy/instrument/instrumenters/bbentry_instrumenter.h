@@ -53,6 +53,7 @@ class BasicBlockEntryInstrumenter : public InstrumenterWithAgent {
   // @name Command-line parameters.
   // @{
   bool inline_fast_path_;
+  uint32_t counter_size_;
   // @}
 
   // The transform for this agent.
@@ -35,6 +35,7 @@ class TestBasicBlockEntryInstrumenter : public BasicBlockEntryInstrumenter {
   using BasicBlockEntryInstrumenter::no_augment_pdb_;
   using BasicBlockEntryInstrumenter::no_strip_strings_;
   using BasicBlockEntryInstrumenter::inline_fast_path_;
+  using BasicBlockEntryInstrumenter::counter_size_;
   using BasicBlockEntryInstrumenter::debug_friendly_;
   using BasicBlockEntryInstrumenter::kAgentDllBasicBlockEntry;
   using BasicBlockEntryInstrumenter::InstrumentPrepare;
@@ -124,6 +125,7 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseMinimalBasicBlockEntry) {
   EXPECT_FALSE(instrumenter_.no_strip_strings_);
   EXPECT_FALSE(instrumenter_.debug_friendly_);
   EXPECT_FALSE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(4U, instrumenter_.counter_size_);
 }
 
 TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
@@ -134,6 +136,7 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
   cmd_line_.AppendSwitch("no-augment-pdb");
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitch("inline-fast-path");
+  cmd_line_.AppendSwitchASCII("counter-size", "1");
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
 
@@ -146,6 +149,7 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
   EXPECT_EQ(std::string("foo.dll"), instrumenter_.agent_dll_);
   EXPECT_TRUE(instrumenter_.allow_overwrite_);
   EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(1U, instrumenter_.counter_size_);
   EXPECT_TRUE(instrumenter_.no_augment_pdb_);
   EXPECT_TRUE(instrumenter_.no_strip_strings_);
   EXPECT_TRUE(instrumenter_.debug_friendly_);
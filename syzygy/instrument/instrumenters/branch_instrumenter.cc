@@ -28,7 +28,7 @@ const char BranchInstrumenter::kAgentDllBasicBlockEntry[] =
 const uint32_t kNumSlots = 4U;
 
 BranchInstrumenter::BranchInstrumenter()
-    : buffering_(false), fs_slot_(0U) {
+    : buffering_(false), fs_slot_(0U), counter_size_(sizeof(uint32_t)) {
   agent_dll_ = kAgentDllBasicBlockEntry;
 }
 
@@ -42,6 +42,7 @@ bool BranchInstrumenter::InstrumentImpl() {
   branch_transform_->set_instrument_dll_name(agent_dll_);
   branch_transform_->set_buffering(buffering_);
   branch_transform_->set_fs_slot(fs_slot_);
+  branch_transform_->set_frequency_size(static_cast<uint8_t>(counter_size_));
   if (!relinker_->AppendTransform(branch_transform_.get()))
     return false;
 
@@ -74,6 +75,16 @@ bool BranchInstrumenter::DoCommandLineParse(
       return false;
     }
   }
+
+  if (command_line->HasSwitch("counter-size")) {
+    std::string counter_size_str =
+        command_line->GetSwitchValueASCII("counter-size");
+    if (!base::StringToUint(counter_size_str, &counter_size_) ||
+        (counter_size_ != 1 && counter_size_ != 4)) {
+      LOG(ERROR) << "counter-size must be 1 or 4.";
+      return false;
+    }
+  }
   return true;
 }
 
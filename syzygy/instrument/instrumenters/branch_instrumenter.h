@@ -61,6 +61,7 @@ class BranchInstrumenter : public InstrumenterWithAgent {
   // @{
   bool buffering_;
   uint32_t fs_slot_;
+  uint32_t counter_size_;
   // @}
 };
 
@@ -39,6 +39,7 @@ class TestBranchInstrumenter : public BranchInstrumenter {
   using BranchInstrumenter::debug_friendly_;
   using BranchInstrumenter::buffering_;
   using BranchInstrumenter::fs_slot_;
+  using BranchInstrumenter::counter_size_;
   using BranchInstrumenter::kAgentDllBasicBlockEntry;
   using BranchInstrumenter::InstrumentPrepare;
   using BranchInstrumenter::InstrumentImpl;
@@ -129,6 +130,7 @@ TEST_F(BranchInstrumenterTest, ParseMinimalBranch) {
   EXPECT_FALSE(instrumenter_.debug_friendly_);
   EXPECT_FALSE(instrumenter_.buffering_);
   EXPECT_EQ(0U, instrumenter_.fs_slot_);
+  EXPECT_EQ(4U, instrumenter_.counter_size_);
 }
 
 TEST_F(BranchInstrumenterTest, ParseFullBranch) {
@@ -144,6 +146,7 @@ TEST_F(BranchInstrumenterTest, ParseFullBranch) {
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("buffering");
   cmd_line_.AppendSwitchASCII("fs-slot", "2");
+  cmd_line_.AppendSwitchASCII("counter-size", "1");
 
   EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
 
@@ -158,6 +161,13 @@ TEST_F(BranchInstrumenterTest, ParseFullBranch) {
   EXPECT_TRUE(instrumenter_.debug_friendly_);
   EXPECT_TRUE(instrumenter_.buffering_);
   EXPECT_EQ(2U, instrumenter_.fs_slot_);
+  EXPECT_EQ(1U, instrumenter_.counter_size_);
+}
+
+TEST_F(BranchInstrumenterTest, ParseInvalidCounterSizeFail) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchASCII("counter-size", "2");
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
 }
 
 TEST_F(BranchInstrumenterTest, ParseHugeSlotFail) {
@@ -44,6 +44,11 @@ class CoverageInstrumenter : public InstrumenterWithAgent {
   const char* InstrumentationMode() override { return "coverage"; }
   // @}
 
+  // @name Super overrides.
+  // @{
+  bool DoCommandLineParse(const base::CommandLine* command_line) override;
+  // @}
+
   // The transform for this agent.
   std::unique_ptr<instrument::transforms::CoverageInstrumentationTransform>
       coverage_transform_;
@@ -51,6 +56,11 @@ class CoverageInstrumenter : public InstrumenterWithAgent {
   // The PDB mutator transform for this agent.
   std::unique_ptr<instrument::mutators::AddIndexedDataRangesStreamPdbMutator>
       add_bb_addr_stream_mutator_;
+
+  // @name Command-line parameters.
+  // @{
+  bool direct_probes_;
+  // @}
 };
 
 }  // namespace instrumenters
@@ -29,7 +29,8 @@ EntryThunkInstrumenter::EntryThunkInstrumenter(Mode instrumentation_mode)
     : instrumentation_mode_(instrumentation_mode),
       instrument_unsafe_references_(false),
       module_entry_only_(false),
-      thunk_imports_(false) {
+      thunk_imports_(false),
+      inline_entry_hooks_(false) {
   DCHECK(instrumentation_mode != INVALID_MODE);
   switch (instrumentation_mode) {
     case CALL_TRACE:
@@ -53,15 +54,27 @@ bool EntryThunkInstrumenter::InstrumentPrepare() {
 }
 
 bool EntryThunkInstrumenter::InstrumentImpl() {
-  entry_thunk_transform_.reset(
-      new instrument::transforms::EntryThunkTransform());
-  entry_thunk_transform_->set_instrument_dll_name(agent_dll_);
-  entry_thunk_transform_->set_instrument_unsafe_references(
-      instrument_unsafe_references_);
-  entry_thunk_transform_->set_src_ranges_for_thunks(debug_friendly_);
-  entry_thunk_transform_->set_only_instrument_module_entry(module_entry_only_);
-  if (!relinker_->AppendTransform(entry_thunk_transform_.get()))
-    return false;
+  if (inline_entry_hooks_) {
+    // The hook is called from the head of each function, and sees the rest
+    // of the function as the one being entered. This saves the thunk's push
+    // of the function and its jump into the hook on every call.
+    entry_call_transform_.reset(
+        new instrument::transforms::EntryCallTransform(debug_friendly_));
+    entry_call_transform_->set_instrument_dll_name(agent_dll_);
+    if (!relinker_->AppendTransform(entry_call_transform_.get()))
+      return false;
+  } else {
+    entry_thunk_transform_.reset(
+        new instrument::transforms::EntryThunkTransform());
+    entry_thunk_transform_->set_instrument_dll_name(agent_dll_);
+    entry_thunk_transform_->set_instrument_unsafe_references(
+        instrument_unsafe_references_);
+    entry_thunk_transform_->set_src_ranges_for_thunks(debug_friendly_);
+    entry_thunk_transform_->set_only_instrument_module_entry(
+        module_entry_only_);
+    if (!relinker_->AppendTransform(entry_thunk_transform_.get()))
+      return false;
+  }
 
   // If we are thunking imports then add the appropriate transform.
   if (thunk_imports_) {
@@ -86,6 +99,15 @@ bool EntryThunkInstrumenter::DoCommandLineParse(
     instrument_unsafe_references_ = !command_line->HasSwitch("no-unsafe-refs");
   }
   thunk_imports_ = command_line->HasSwitch("instrument-imports");
+  inline_entry_hooks_ = command_line->HasSwitch("inline-entry-hooks");
+
+  // Inline hooks are added to every function that can be decomposed, so they
+  // can't be restricted to the module entry points.
+  if (inline_entry_hooks_ && module_entry_only_) {
+    LOG(ERROR) << "--inline-entry-hooks and --module-entry-only are "
+               << "mutually exclusive.";
+    return false;
+  }
 
   return true;
 }
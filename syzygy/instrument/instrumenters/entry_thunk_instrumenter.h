@@ -20,6 +20,7 @@
 
 #include "base/command_line.h"
 #include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
+#include "syzygy/instrument/transforms/entry_call_transform.h"
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
 #include "syzygy/instrument/transforms/thunk_import_references_transform.h"
 #include "syzygy/pe/pe_relinker.h"
@@ -66,6 +67,9 @@ class EntryThunkInstrumenter : public InstrumenterWithAgent {
   bool instrument_unsafe_references_;
   bool module_entry_only_;
   bool thunk_imports_;
+  // Iff true, the entry hook is called inline at the start of each function
+  // rather than through a thunk.
+  bool inline_entry_hooks_;
   // @}
 
   // The instrumentation mode.
@@ -74,6 +78,8 @@ class EntryThunkInstrumenter : public InstrumenterWithAgent {
   // The transforms for this agent.
   std::unique_ptr<instrument::transforms::EntryThunkTransform>
       entry_thunk_transform_;
+  std::unique_ptr<instrument::transforms::EntryCallTransform>
+      entry_call_transform_;
   std::unique_ptr<instrument::transforms::ThunkImportReferencesTransform>
       import_thunk_tx_;
 };
@@ -37,6 +37,7 @@ class TestEntryThunkInstrumenter : public EntryThunkInstrumenter {
   using EntryThunkInstrumenter::instrument_unsafe_references_;
   using EntryThunkInstrumenter::module_entry_only_;
   using EntryThunkInstrumenter::thunk_imports_;
+  using EntryThunkInstrumenter::inline_entry_hooks_;
   using EntryThunkInstrumenter::debug_friendly_;
   using EntryThunkInstrumenter::instrumentation_mode_;
   using EntryThunkInstrumenter::kAgentDllProfile;
@@ -171,6 +172,24 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
   EXPECT_TRUE(instrumenter_->thunk_imports_);
   EXPECT_FALSE(instrumenter_->instrument_unsafe_references_);
   EXPECT_TRUE(instrumenter_->module_entry_only_);
+  EXPECT_FALSE(instrumenter_->inline_entry_hooks_);
+}
+
+TEST_F(EntryThunkInstrumenterTest, ParseInlineEntryHooksCallTrace) {
+  SetUpValidCommandLine();
+  instrumenter_.reset(
+      new TestEntryThunkInstrumenter(EntryThunkInstrumenter::CALL_TRACE));
+  cmd_line_.AppendSwitch("inline-entry-hooks");
+
+  EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_->inline_entry_hooks_);
+  EXPECT_FALSE(instrumenter_->module_entry_only_);
+
+  // Inline hooks can't be restricted to the module entry points.
+  cmd_line_.AppendSwitch("module-entry-only");
+  instrumenter_.reset(
+      new TestEntryThunkInstrumenter(EntryThunkInstrumenter::CALL_TRACE));
+  EXPECT_FALSE(instrumenter_->ParseCommandLine(&cmd_line_));
 }
 
 TEST_F(EntryThunkInstrumenterTest, ParseMinimalProfile) {
@@ -248,5 +267,18 @@ TEST_F(EntryThunkInstrumenterTest, InstrumentImplProfile) {
   EXPECT_TRUE(instrumenter_->InstrumentImpl());
 }
 
+TEST_F(EntryThunkInstrumenterTest, InstrumentImplInlineEntryHooks) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("inline-entry-hooks");
+  cmd_line_.AppendSwitch("instrument-imports");
+  instrumenter_.reset(
+      new TestEntryThunkInstrumenter(EntryThunkInstrumenter::PROFILE));
+
+  EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_->InstrumentPrepare());
+  EXPECT_TRUE(instrumenter_->CreateRelinker());
+  EXPECT_TRUE(instrumenter_->InstrumentImpl());
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
@@ -247,67 +247,89 @@ bool AFLTransform::PostBlockGraphIteration(
   return true;
 }
 
-void AFLTransform::instrument(BasicBlockAssembler& assm, size_t rand_id) {
+void AFLTransform::instrument(BasicBlockAssembler& assm,
+                              size_t rand_id,
+                              const LivenessAnalysis::State& state) {
   BasicBlockAssembler::Operand afl_prev_loc(
       Displacement(afl_static_cov_data_, kOffsetPrevLoc)),
       afl_area_ptr(Displacement(afl_static_cov_data_, kOffsetAreaPtr)),
       tls_index(Displacement(afl_static_cov_data_, kOffsetTlsIndex));
 
-  // Save initial state.
-  assm.push(assm::eax);
-  assm.push(assm::ebx);
-
-  if (multithread_)
-    assm.push(assm::ecx);
-
-  assm.lahf();
-  assm.set(assm::kOverflow, assm::eax);
-
-  if (multithread_) {
-    // mov ecx, tls_index
-    assm.mov(assm::ecx, tls_index);
-    // mov ebx, fs:[2C]
-    assm.mov_fs(assm::ebx, Immediate(kOffsetTebStorage));
-    // mov ecx, [ebx + ecx * 4]
-    assm.mov(assm::ecx, Operand(assm::ebx, assm::ecx, assm::kTimes4));
-    // lea ecx, [ecx + offset]
-    assm.lea(assm::ecx,
-             Operand(assm::ecx, Displacement(tls_afl_prev_loc_displacement_)));
+  // The flags are saved to ah and restored from it, so eax is reserved when
+  // they are live.
+  bool save_flags = state.AreArithmeticFlagsLive();
+
+  // Pick the scratch registers: the first one holds the index in the coverage
+  // bitmap and the second one, in multithread mode, the address of the TLS
+  // slot. The dead registers are picked first as they don't need to be saved.
+  // When every register is live this picks ebx and ecx.
+  std::vector<const assm::Register32*> candidates = {
+      &assm::ebx, &assm::ecx, &assm::edx, &assm::esi, &assm::edi};
+  if (!save_flags)
+    candidates.push_back(&assm::eax);
+
+  size_t scratch_count = multithread_ ? 2 : 1;
+  std::vector<const assm::Register32*> scratch;
+  for (const assm::Register32* reg : candidates) {
+    if (scratch.size() < scratch_count && !state.IsLive(*reg))
+      scratch.push_back(reg);
   }
+  for (const assm::Register32* reg : candidates) {
+    if (scratch.size() < scratch_count && state.IsLive(*reg))
+      scratch.push_back(reg);
+  }
+  DCHECK_EQ(scratch_count, scratch.size());
+  const assm::Register32& index = *scratch[0];
 
-  // mov ebx, ID
-  assm.mov(assm::ebx, Immediate(rand_id, assm::kSize32Bit));
-
-  if (multithread_) {
-    // xor ebx, [ecx]
-    assm.xor(assm::ebx, Operand(assm::ecx));
-  } else {
-    // xor ebx, [afl_prev_loc]
-    assm.xor(assm::ebx, afl_prev_loc);
+  // Save initial state.
+  std::vector<const assm::Register32*> saved;
+  if (save_flags && state.IsLive(assm::eax))
+    saved.push_back(&assm::eax);
+  for (const assm::Register32* reg : scratch) {
+    if (state.IsLive(*reg))
+      saved.push_back(reg);
   }
+  for (const assm::Register32* reg : saved)
+    assm.push(*reg);
 
-  // add ebx, [afl_area_ptr]
-  assm.add(assm::ebx, afl_area_ptr);
-  // inc byte [ebx]
-  assm.inc(Operand(assm::ebx));
+  if (save_flags) {
+    assm.lahf();
+    assm.set(assm::kOverflow, assm::eax);
+  }
 
   if (multithread_) {
-    // mov [ecx], id >> 1
-    assm.mov(Operand(assm::ecx), Immediate(rand_id >> 1, assm::kSize32Bit));
-  } else {
-    // mov [afl_prev_loc], id >> 1
-    assm.mov(afl_prev_loc, Immediate(rand_id >> 1, assm::kSize32Bit));
+    const assm::Register32& slot = *scratch[1];
+    // mov slot, tls_index
+    assm.mov(slot, tls_index);
+    // mov index, fs:[2C]
+    assm.mov_fs(index, Immediate(kOffsetTebStorage));
+    // mov slot, [index + slot * 4]
+    assm.mov(slot, Operand(index, slot, assm::kTimes4));
+    // lea slot, [slot + offset]
+    assm.lea(slot, Operand(slot, Displacement(tls_afl_prev_loc_displacement_)));
+    // The slot now holds the address of __afl_prev_loc.
+    afl_prev_loc = Operand(slot);
   }
 
-  // Restore initial state.
-  assm.add(assm::al, Immediate(0x7F, assm::kSize8Bit));
-  assm.sahf();
+  // mov index, ID
+  assm.mov(index, Immediate(rand_id, assm::kSize32Bit));
+  // xor index, [afl_prev_loc]
+  assm.xor(index, afl_prev_loc);
+  // add index, [afl_area_ptr]
+  assm.add(index, afl_area_ptr);
+  // inc byte [index]
+  assm.inc(Operand(index));
+  // mov [afl_prev_loc], id >> 1
+  assm.mov(afl_prev_loc, Immediate(rand_id >> 1, assm::kSize32Bit));
 
-  if (multithread_)
-    assm.pop(assm::ecx);
+  // Restore initial state.
+  if (save_flags) {
+    assm.add(assm::al, Immediate(0x7F, assm::kSize8Bit));
+    assm.sahf();
+  }
 
-  assm.pop(assm::ebx);
-  assm.pop(assm::eax);
+  for (auto reg = saved.rbegin(); reg != saved.rend(); ++reg)
+    assm.pop(**reg);
 }
 
 // This is the PRNG used to assign random IDs to basic-blocks.
@@ -321,17 +343,27 @@ bool AFLTransform::TransformBasicBlockSubGraph(
   BasicBlockSubGraph::BBCollection& basic_blocks =
       basic_block_subgraph->basic_blocks();
 
+  // Without the analysis every register and flag is assumed to be live.
+  LivenessAnalysis liveness;
+  if (use_liveness_analysis_)
+    liveness.Analyze(basic_block_subgraph);
+
   for (auto& bb : basic_blocks) {
     BasicCodeBlock* bc_block = BasicCodeBlock::Cast(bb);
     if (bc_block == nullptr) {
       continue;
     }
 
+    LivenessAnalysis::State state;
+    if (use_liveness_analysis_)
+      liveness.GetStateAtEntryOf(bc_block, &state);
+
     BasicBlock::Instructions& instructions = bc_block->instructions();
     BasicBlockAssembler assm(instructions.begin(), &instructions);
+    assm.set_instruction_cache(&instruction_cache_);
 
     size_t rand_id = random_ctr.next();
-    instrument(assm, rand_id);
+    instrument(assm, rand_id, state);
 
     BlockGraph::Block::SourceRange source_range;
     if (!GetBasicBlockSourceRange(*bc_block, &source_range)) {
@@ -25,6 +25,7 @@
 #define SYZYGY_INSTRUMENT_TRANSFORMS_AFL_TRANSFORM_H_
 
 #include "base/logging.h"
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_builder.h"
@@ -63,6 +64,9 @@ class AFLTransform
   // The transform can also leverage the 'SecurityCookieCheckHook' transform,
   // in order to have /GS cookie exception 'catchable' by an in-proc exception
   // handler.
+  // By default the registers and the flags clobbered by the instrumentation
+  // are saved around it; see 'set_use_liveness_analysis' to only save the
+  // live ones.
   AFLTransform(const std::unordered_set<std::string>& targets,
                bool whitelist_mode,
                bool force_decompose,
@@ -73,6 +77,7 @@ class AFLTransform
         force_decompose_(force_decompose),
         multithread_(multithread),
         cookie_check_hook_(cookie_check_hook),
+        use_liveness_analysis_(false),
         total_blocks_(0),
         total_code_blocks_(0),
         total_code_blocks_instrumented_(0) {
@@ -115,10 +120,29 @@ class AFLTransform
 
   const RelativeAddressRangeVector& bb_ranges() { return bb_ranges_; }
 
+  // @name Accessors.
+  // @{
+  bool use_liveness_analysis() const { return use_liveness_analysis_; }
+  void set_use_liveness_analysis(bool use_liveness_analysis) {
+    use_liveness_analysis_ = use_liveness_analysis;
+  }
+  // @}
+
  protected:
+  typedef block_graph::analysis::LivenessAnalysis LivenessAnalysis;
+
   // Basic-block instrumentation related functions.
   bool ShouldInstrumentBlock(BlockGraph::Block* block);
-  void instrument(BasicBlockAssembler& assm, size_t cur_loc);
+
+  // Injects the instrumentation sequence of a basic block.
+  // @param assm The assembler positioned at the start of the basic block.
+  // @param cur_loc The identifier of the basic block.
+  // @param state The liveness state at the entry of the basic block. Its dead
+  //     registers are used as scratch registers, and the dead registers and
+  //     flags aren't saved.
+  void instrument(BasicBlockAssembler& assm,
+                  size_t cur_loc,
+                  const LivenessAnalysis::State& state);
 
   // The data-block that keeps the metadata regarding the instrumentation.
   BlockGraph::Block* afl_static_cov_data_;
@@ -139,6 +163,11 @@ class AFLTransform
   bool force_decompose_;
   bool multithread_;
   bool cookie_check_hook_;
+  bool use_liveness_analysis_;
+
+  // The edge updates differ only by their basic block ID, and are decoded
+  // through this cache.
+  BasicBlockAssembler::InstructionCache instruction_cache_;
 
   // Stats.
   size_t total_blocks_;
@@ -30,11 +30,13 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlock;
+using block_graph::BasicBlockAssembler;
 using block_graph::BasicBlockDecomposer;
 using block_graph::BasicBlockReference;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicCodeBlock;
 using block_graph::BlockGraph;
+using block_graph::Immediate;
 using block_graph::Instruction;
 
 class TestAFLTransform : public AFLTransform {
@@ -61,6 +63,14 @@ class TestAFLTransform : public AFLTransform {
 
 class AFLTransformTest : public testing::TestDllTransformTest {
  protected:
+  // Fills @p bb with a sequence defining eax, ebx and the flags before using
+  // them, so that they are dead at its entry.
+  void BuildDeadRegistersBlock(BasicCodeBlock* bb);
+  // Instruments @p subgraph with liveness analysis and returns the opcodes of
+  // its only basic block in @p opcodes.
+  void InstrumentWithLiveness(TestAFLTransform& afl,
+                              BasicBlockSubGraph* subgraph,
+                              std::vector<uint16_t>* opcodes);
   void CheckBasicBlockInstrumentation(TestAFLTransform& afl);
   void CheckInstrumentation(BasicBlock::Instructions::const_iterator& iter,
                             const BasicBlock::Instructions::const_iterator& end,
@@ -294,8 +304,81 @@ void AFLTransformTest::CheckBasicBlockInstrumentation(TestAFLTransform& afl) {
   }
 }
 
+void AFLTransformTest::BuildDeadRegistersBlock(BasicCodeBlock* bb) {
+  BasicBlockAssembler assm(bb->instructions().end(), &bb->instructions());
+  assm.mov(assm::eax, Immediate(1, assm::kSize32Bit));
+  assm.mov(assm::ebx, Immediate(2, assm::kSize32Bit));
+  assm.add(assm::eax, assm::ebx);
+  assm.ret();
+}
+
+void AFLTransformTest::InstrumentWithLiveness(
+    TestAFLTransform& afl,
+    BasicBlockSubGraph* subgraph,
+    std::vector<uint16_t>* opcodes) {
+  afl.afl_static_cov_data_ =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, AFLTransform::kOffsetArea,
+                            AFLTransform::kMetadataBlockName);
+  ASSERT_NE(nullptr, afl.afl_static_cov_data_);
+  afl.set_use_liveness_analysis(true);
+
+  BasicCodeBlock* bb = subgraph->AddBasicCodeBlock("bb");
+  ASSERT_NE(nullptr, bb);
+  BuildDeadRegistersBlock(bb);
+  ASSERT_TRUE(afl.TransformBasicBlockSubGraph(policy_, &block_graph_,
+                                              subgraph));
+
+  opcodes->clear();
+  for (const Instruction& inst : bb->instructions())
+    opcodes->push_back(inst.representation().opcode);
+}
+
 }  // namespace
 
+TEST_F(AFLTransformTest, UseLivenessAnalysisDisabledByDefault) {
+  TestAFLTransform afl({}, false, false, false, false);
+  EXPECT_FALSE(afl.use_liveness_analysis());
+  afl.set_use_liveness_analysis(true);
+  EXPECT_TRUE(afl.use_liveness_analysis());
+}
+
+TEST_F(AFLTransformTest, DeadRegistersAndFlagsAreNotSaved) {
+  TestAFLTransform afl({}, false, false, false, false);
+  BasicBlockSubGraph subgraph;
+  std::vector<uint16_t> opcodes;
+  ASSERT_NO_FATAL_FAILURE(InstrumentWithLiveness(afl, &subgraph, &opcodes));
+
+  // The dead ebx is the scratch register, and nothing is saved.
+  std::vector<uint16_t> expected = {I_MOV, I_XOR, I_ADD, I_INC, I_MOV,
+                                    I_MOV, I_MOV, I_ADD, I_RET};
+  EXPECT_EQ(expected, opcodes);
+
+  const BasicBlock::Instructions& instructions =
+      BasicCodeBlock::Cast(*subgraph.basic_blocks().begin())->instructions();
+  const _DInst& mov_id = instructions.front().representation();
+  EXPECT_EQ(O_REG, mov_id.ops[0].type);
+  EXPECT_EQ(R_EBX, mov_id.ops[0].index);
+}
+
+TEST_F(AFLTransformTest, DeadRegistersAndFlagsAreNotSavedMultithread) {
+  TestAFLTransform afl({}, false, false, true, false);
+  BasicBlockSubGraph subgraph;
+  std::vector<uint16_t> opcodes;
+  ASSERT_NO_FATAL_FAILURE(InstrumentWithLiveness(afl, &subgraph, &opcodes));
+
+  // The dead ebx and eax are the scratch registers, and nothing is saved.
+  std::vector<uint16_t> expected = {I_MOV, I_MOV, I_MOV, I_LEA, I_MOV,
+                                    I_XOR, I_ADD, I_INC, I_MOV, I_MOV,
+                                    I_MOV, I_ADD, I_RET};
+  EXPECT_EQ(expected, opcodes);
+
+  const BasicBlock::Instructions& instructions =
+      BasicCodeBlock::Cast(*subgraph.basic_blocks().begin())->instructions();
+  const _DInst& mov_slot = instructions.front().representation();
+  EXPECT_EQ(O_REG, mov_slot.ops[0].type);
+  EXPECT_EQ(R_EAX, mov_slot.ops[0].index);
+}
+
 TEST_F(AFLTransformTest, ApplyTranform) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -53,6 +53,7 @@ AsanInterceptorFilter::ShouldIntercept(const BlockGraph::Block* block) {
   if (block->type() != BlockGraph::CODE_BLOCK)
     return NOT_INTERCEPTED;
 
+  // Most blocks have no name match and never get their contents hashed.
   FunctionHashMap::iterator func_iter = function_hash_map_.find(block->name());
 
   if (func_iter == function_hash_map_.end())
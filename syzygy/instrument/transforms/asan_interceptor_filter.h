@@ -16,9 +16,9 @@
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ASAN_INTERCEPTOR_FILTER_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ASAN_INTERCEPTOR_FILTER_H_
 
-#include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
@@ -29,7 +29,9 @@ namespace transforms {
 // This class defines a filter for the functions that should be intercepted by
 // the Asan transform. The list of the functions to intercept is stored in a map
 // associating the function name to one or several hashes of the expected block
-// contents.
+// contents. The filter is asked about every block of the image, so the names
+// are hashed for a constant time lookup, and only the contents of the blocks
+// whose name matches are hashed.
 //
 // It's not sufficient to only filter the function by its name because some
 // linker optimizations can result in a function being stubbed by a block with
@@ -66,7 +68,7 @@ class AsanInterceptorFilter {
 
  protected:
   typedef std::set<std::string> HashSet;
-  typedef std::map<std::string, HashSet> FunctionHashMap;
+  typedef std::unordered_map<std::string, HashSet> FunctionHashMap;
 
   // Add a block to the function hash map.
   // @param block The block that we want to add to the function hash map.
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <list>
+#include <map>
 #include <vector>
 
 #include "base/logging.h"
@@ -24,11 +25,15 @@
 #include "base/memory/scoped_vector.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 #include "syzygy/block_graph/typed_block.h"
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
+#include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
@@ -46,7 +51,9 @@ namespace {
 
 using block_graph::BasicBlock;
 using block_graph::BasicCodeBlock;
+using block_graph::BasicDataBlock;
 using block_graph::BasicBlockAssembler;
+using block_graph::BasicBlockDecomposer;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicBlockReference;
 using block_graph::BlockBuilder;
@@ -55,8 +62,10 @@ using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Instruction;
 using block_graph::Operand;
+using block_graph::Successor;
 using block_graph::TransformPolicyInterface;
 using block_graph::TypedBlock;
+using block_graph::analysis::ControlFlowAnalysis;
 using block_graph::analysis::LivenessAnalysis;
 using block_graph::analysis::MemoryAccessAnalysis;
 using assm::Register32;
@@ -278,6 +287,24 @@ bool DecodeMemoryAccess(const Instruction& instr,
   return true;
 }
 
+// Use @p bb_asm to inject a call to @p hook.
+void InjectHookCall(BasicBlockAssembler* bb_asm,
+                    BlockGraph::Reference* hook,
+                    BlockGraph::ImageFormat image_format) {
+  DCHECK(hook != NULL);
+
+  if (image_format == BlockGraph::PE_IMAGE) {
+    // In PE images the hooks are brought in as imports, so they are indirect
+    // references.
+    bb_asm->call(Operand(Displacement(hook->referenced(), hook->offset())));
+  } else {
+    DCHECK_EQ(BlockGraph::COFF_IMAGE, image_format);
+    // In COFF images the hooks are brought in as symbols, so they are direct
+    // references.
+    bb_asm->call(Immediate(hook->referenced(), hook->offset()));
+  }
+}
+
 // Use @p bb_asm to inject a hook to @p hook to instrument the access to the
 // address stored in the operand @p op.
 void InjectAsanHook(BasicBlockAssembler* bb_asm,
@@ -301,16 +328,472 @@ void InjectAsanHook(BasicBlockAssembler* bb_asm,
   }
 
   // Call the hook.
-  if (image_format == BlockGraph::PE_IMAGE) {
-    // In PE images the hooks are brought in as imports, so they are indirect
-    // references.
-    bb_asm->call(Operand(Displacement(hook->referenced(), hook->offset())));
+  InjectHookCall(bb_asm, hook, image_format);
+}
+
+// A probe that is about to be injected into a basic block.
+struct AsanProbe {
+  AsanProbe(BasicBlock::Instructions::iterator instr,
+            const BasicBlockAssembler::Operand& operand,
+            const AsanBasicBlockTransform::MemoryAccessInfo& info,
+            const LivenessAnalysis::State& state)
+      : instr(instr), operand(operand), info(info), state(state),
+        covered(false) {
+  }
+
+  // The instruction in front of which the probe is injected.
+  BasicBlock::Instructions::iterator instr;
+  // The address of the last byte of the checked range.
+  BasicBlockAssembler::Operand operand;
+  AsanBasicBlockTransform::MemoryAccessInfo info;
+  // The liveness information at @p instr.
+  LivenessAnalysis::State state;
+  // Set when the access is checked by the probe of another access.
+  bool covered;
+};
+
+typedef std::vector<AsanProbe> AsanProbes;
+
+// The smallest range check a group of accesses gets coalesced into. The
+// probes for narrower accesses only look at the shadow byte of the last byte
+// of their access, the 16 and 32 byte ones check all of their shadow bytes.
+// Coalescing into the narrower probes would thus lose some precision.
+const int32_t kMinCoalescedCheckSize = 16;
+const int32_t kMaxCoalescedCheckSize = 32;
+
+// Returns true if @p probe checks a plain read or write through a base
+// register and a constant displacement, i.e. one that can be coalesced.
+bool IsCoalescable(const AsanProbe& probe) {
+  if (probe.covered)
+    return false;
+  if (probe.info.mode != AsanBasicBlockTransform::kReadAccess &&
+      probe.info.mode != AsanBasicBlockTransform::kWriteAccess) {
+    return false;
+  }
+  if (probe.info.size > kMaxCoalescedCheckSize ||
+      (probe.info.size & (probe.info.size - 1)) != 0) {
+    return false;
+  }
+  return probe.operand.base() != assm::kRegisterNone &&
+         probe.operand.index() == assm::kRegisterNone &&
+         probe.operand.displacement().reference().referred_type() ==
+             BasicBlockReference::REFERRED_TYPE_UNKNOWN;
+}
+
+// Returns the displacement of the first byte accessed by @p probe.
+int32_t GetFirstByteDisplacement(const AsanProbe& probe) {
+  return static_cast<int32_t>(probe.operand.displacement().value()) -
+         (probe.info.size - 1);
+}
+
+// Replaces the probes of a group of accesses by range checks where possible.
+// All the accesses of the group go through the same base register, which
+// keeps its value across the group, and have the same mode and size.
+// @param group The indices of the probes of the group, in program order.
+// @param probes The probes of the basic block.
+void CoalesceProbeGroup(const std::vector<size_t>& group, AsanProbes* probes) {
+  DCHECK_NE(static_cast<AsanProbes*>(nullptr), probes);
+  if (group.size() < 2)
+    return;
+
+  // Sort the accesses by address, the ones at the same address staying in
+  // program order.
+  std::vector<size_t> sorted(group);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [probes](size_t a, size_t b) {
+    return GetFirstByteDisplacement((*probes)[a]) <
+           GetFirstByteDisplacement((*probes)[b]);
+  });
+
+  const int32_t access_size = (*probes)[group.front()].info.size;
+  size_t run_begin = 0;
+  while (run_begin < sorted.size()) {
+    // Find the run of accesses covering a contiguous range.
+    int32_t run_start = GetFirstByteDisplacement((*probes)[sorted[run_begin]]);
+    int32_t run_end = run_start + access_size;
+    size_t run_end_index = run_begin + 1;
+    for (; run_end_index < sorted.size(); ++run_end_index) {
+      const AsanProbe& probe = (*probes)[sorted[run_end_index]];
+      int32_t start = GetFirstByteDisplacement(probe);
+      if (start > run_end)
+        break;
+      run_end = std::max(run_end, start + access_size);
+    }
+
+    // Greedily cover the run with range checks, each of them replacing the
+    // probes of the accesses it fully contains.
+    int32_t check_start = run_start;
+    while (run_end - check_start >= kMinCoalescedCheckSize) {
+      int32_t check_size = run_end - check_start >= kMaxCoalescedCheckSize ?
+          kMaxCoalescedCheckSize : kMinCoalescedCheckSize;
+      std::vector<size_t> contained;
+      for (size_t i = run_begin; i < run_end_index; ++i) {
+        int32_t start = GetFirstByteDisplacement((*probes)[sorted[i]]);
+        if (start >= check_start &&
+            start + access_size <= check_start + check_size &&
+            !(*probes)[sorted[i]].covered) {
+          contained.push_back(sorted[i]);
+        }
+      }
+
+      if (contained.size() >= 2) {
+        // The range check goes in front of the first of these accesses.
+        size_t first = *std::min_element(contained.begin(), contained.end());
+        AsanProbe& probe = (*probes)[first];
+        probe.operand = Operand(
+            assm::CastAsRegister32(assm::Register::Get(probe.operand.base())),
+            Displacement(static_cast<uint32_t>(check_start + check_size - 1)));
+        probe.info.size = static_cast<uint8_t>(check_size);
+        for (size_t index : contained) {
+          if (index != first)
+            (*probes)[index].covered = true;
+        }
+      }
+
+      check_start += check_size;
+    }
+
+    run_begin = run_end_index;
+  }
+}
+
+// Coalesces the probes of the accesses of a basic block that go through the
+// same base register, with the same mode and size, and that aren't separated
+// by a redefinition of the base register, a call or a control flow
+// instruction.
+// @param basic_block The basic block being instrumented.
+// @param probes The probes for the accesses of @p basic_block, in program
+//     order. The probes of the accesses that get checked by the range check of
+//     another probe are marked as covered.
+void CoalesceProbes(BasicCodeBlock* basic_block, AsanProbes* probes) {
+  DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), basic_block);
+  DCHECK_NE(static_cast<AsanProbes*>(nullptr), probes);
+
+  // The open groups, keyed by base register, mode and size.
+  typedef std::pair<assm::RegisterId,
+                    std::pair<AsanMemoryAccessMode, uint8_t>> GroupKey;
+  typedef std::map<GroupKey, std::vector<size_t>> GroupMap;
+  GroupMap groups;
+
+  size_t next_probe = 0;
+  BasicBlock::Instructions::iterator iter_inst =
+      basic_block->instructions().begin();
+  for (; iter_inst != basic_block->instructions().end(); ++iter_inst) {
+    // Add the access of this instruction to its group.
+    if (next_probe < probes->size() &&
+        (*probes)[next_probe].instr == iter_inst) {
+      const AsanProbe& probe = (*probes)[next_probe];
+      if (IsCoalescable(probe)) {
+        GroupKey key(probe.operand.base(),
+                     std::make_pair(probe.info.mode, probe.info.size));
+        groups[key].push_back(next_probe);
+      }
+      ++next_probe;
+    }
+
+    // The groups end at the instructions that may change the shadow memory
+    // or skip the rest of the accesses, and at the redefinition of their base
+    // register.
+    const _DInst& repr = iter_inst->representation();
+    LivenessAnalysis::State defs;
+    bool close_all = core::IsCall(repr) || core::IsControlFlow(repr) ||
+        !LivenessAnalysis::StateHelper::GetDefsOf(*iter_inst, &defs);
+    GroupMap::iterator group = groups.begin();
+    while (group != groups.end()) {
+      if (close_all ||
+          defs.IsLive(assm::Register::Get(group->first.first))) {
+        CoalesceProbeGroup(group->second, probes);
+        group = groups.erase(group);
+      } else {
+        ++group;
+      }
+    }
+  }
+  DCHECK_EQ(probes->size(), next_probe);
+
+  for (const auto& group : groups)
+    CoalesceProbeGroup(group.second, probes);
+}
+
+// A single basic block loop counted by an induction register, i.e.
+//     loop:  ...
+//            inc induction
+//            ...
+//            cmp induction, bound
+//            jb/jl loop
+// where the bound is an immediate or a register that isn't defined in the
+// loop. The loop body runs for the values of the induction register going
+// from its value on entry to the bound minus one, or just once if it's
+// already past the bound.
+struct CountedLoop {
+  CountedLoop()
+      : induction(assm::kRegisterNone),
+        bound_register(assm::kRegisterNone),
+        bound_value(0),
+        update(nullptr) {
+  }
+
+  // The induction register.
+  assm::RegisterId induction;
+  // The bound register, or kRegisterNone when the bound is an immediate.
+  assm::RegisterId bound_register;
+  // The bound, when it's an immediate.
+  int32_t bound_value;
+  // The instruction incrementing the induction register.
+  const Instruction* update;
+  // The registers defined in the loop.
+  LivenessAnalysis::State defs;
+};
+
+// Returns the immediate operand of @p repr, sign extended.
+int32_t GetSignedImmediate(const _DInst& repr, size_t operand) {
+  DCHECK_EQ(O_IMM, repr.ops[operand].type);
+  if (repr.ops[operand].size == 8)
+    return repr.imm.sbyte;
+  return repr.imm.sdword;
+}
+
+// Returns the register @p op refers to, or kRegisterNone if it isn't a 32-bit
+// register.
+assm::RegisterId GetRegister32Id(const _Operand& op) {
+  if (op.type != O_REG || op.size != 32)
+    return assm::kRegisterNone;
+  return core::GetRegisterId(op.index);
+}
+
+// Returns true if @p repr increments @p reg by one.
+bool IsIncrementByOne(const _DInst& repr, assm::RegisterId reg) {
+  if (GetRegister32Id(repr.ops[0]) != reg)
+    return false;
+  if (repr.opcode == I_INC)
+    return true;
+  return repr.opcode == I_ADD && repr.ops[1].type == O_IMM &&
+         GetSignedImmediate(repr, 1) == 1;
+}
+
+// Matches a counted loop on @p bb.
+// @param bb The basic block to match.
+// @param loop Receives the description of the loop.
+// @returns true if @p bb is a counted loop that doesn't call anything nor
+//     leave early, false otherwise.
+bool MatchCountedLoop(const BasicCodeBlock* bb, CountedLoop* loop) {
+  DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), bb);
+  DCHECK_NE(static_cast<CountedLoop*>(nullptr), loop);
+
+  // The loop branches back to itself while the induction register is below
+  // the bound.
+  const BasicBlock::Successors& successors = bb->successors();
+  if (successors.size() != 2 || bb->instructions().empty())
+    return false;
+  const Successor* back_edge = nullptr;
+  for (const Successor& successor : successors) {
+    if (successor.reference().basic_block() == bb)
+      back_edge = &successor;
+  }
+  if (back_edge == nullptr ||
+      (back_edge->condition() != Successor::kConditionBelow &&
+       back_edge->condition() != Successor::kConditionLess)) {
+    return false;
+  }
+
+  const _DInst& cmp = bb->instructions().back().representation();
+  if (cmp.opcode != I_CMP)
+    return false;
+  loop->induction = GetRegister32Id(cmp.ops[0]);
+  loop->bound_register = assm::kRegisterNone;
+  loop->bound_value = 0;
+  if (cmp.ops[1].type == O_IMM) {
+    loop->bound_value = GetSignedImmediate(cmp, 1);
   } else {
-    DCHECK_EQ(BlockGraph::COFF_IMAGE, image_format);
-    // In COFF images the hooks are brought in as symbols, so they are direct
-    // references.
-    bb_asm->call(Immediate(hook->referenced(), hook->offset()));
+    loop->bound_register = GetRegister32Id(cmp.ops[1]);
+    if (loop->bound_register == assm::kRegisterNone ||
+        loop->bound_register == assm::kRegisterEsp ||
+        loop->bound_register == loop->induction) {
+      return false;
+    }
+  }
+  if (loop->induction == assm::kRegisterNone ||
+      loop->induction == assm::kRegisterEsp) {
+    return false;
+  }
+
+  // The shadow memory can't change while the loop runs, and the induction
+  // register is incremented exactly once per iteration.
+  const assm::Register& induction = assm::Register::Get(loop->induction);
+  LivenessAnalysis::StateHelper::Clear(&loop->defs);
+  loop->update = nullptr;
+  for (const Instruction& instr : bb->instructions()) {
+    const _DInst& repr = instr.representation();
+    LivenessAnalysis::State defs;
+    if (core::IsCall(repr) || core::IsControlFlow(repr) ||
+        !LivenessAnalysis::StateHelper::GetDefsOf(instr, &defs)) {
+      return false;
+    }
+    if (defs.IsLive(induction)) {
+      if (loop->update != nullptr || !IsIncrementByOne(repr, loop->induction))
+        return false;
+      loop->update = &instr;
+    }
+    LivenessAnalysis::StateHelper::Union(defs, &loop->defs);
   }
+  if (loop->update == nullptr)
+    return false;
+
+  return loop->bound_register == assm::kRegisterNone ||
+         !loop->defs.IsLive(assm::Register::Get(loop->bound_register));
+}
+
+// Computes the range check replacing the per-iteration probes of an access of
+// a counted loop.
+// @param loop The counted loop.
+// @param probe The probe of the access.
+// @param after_update True if the access comes after the update of the
+//     induction register.
+// @param first Receives the address of the first byte of the access on the
+//     first iteration, as seen from the preheader of the loop.
+// @param last Receives the address of the first byte of the access on the
+//     last iteration, as seen from the preheader of the loop.
+// @returns true if the access is a plain read or write whose address only
+//     depends on the induction register and on loop invariant registers.
+bool HoistProbe(const CountedLoop& loop,
+                const AsanProbe& probe,
+                bool after_update,
+                BasicBlockAssembler::Operand* first,
+                BasicBlockAssembler::Operand* last) {
+  DCHECK_NE(static_cast<BasicBlockAssembler::Operand*>(nullptr), first);
+  DCHECK_NE(static_cast<BasicBlockAssembler::Operand*>(nullptr), last);
+
+  if (probe.info.mode != AsanBasicBlockTransform::kReadAccess &&
+      probe.info.mode != AsanBasicBlockTransform::kWriteAccess) {
+    return false;
+  }
+  const BasicBlockAssembler::Operand& op = probe.operand;
+  if (op.displacement().reference().referred_type() !=
+      BasicBlockReference::REFERRED_TYPE_UNKNOWN) {
+    return false;
+  }
+
+  // The address is an affine function of the induction register, whose
+  // other registers must keep their value across the loop.
+  assm::RegisterId registers[] = {op.base(), op.index()};
+  for (assm::RegisterId reg : registers) {
+    if (reg == assm::kRegisterNone || reg == loop.induction)
+      continue;
+    if (reg == assm::kRegisterEsp ||
+        loop.defs.IsLive(assm::Register::Get(reg))) {
+      return false;
+    }
+  }
+  if (op.base() == loop.induction && op.index() == loop.induction)
+    return false;
+  int32_t stride = 0;
+  if (op.base() == loop.induction)
+    stride = 1;
+  else if (op.index() == loop.induction)
+    stride = 1 << op.scale();
+
+  int32_t displacement = static_cast<int32_t>(op.displacement().value()) -
+      (probe.info.size - 1);
+  if (after_update)
+    displacement += stride;
+  *first = BasicBlockAssembler::Operand(
+      op.base(), op.index(), op.scale(),
+      Displacement(static_cast<uint32_t>(displacement), assm::kSize32Bit));
+  if (stride == 0) {
+    *last = *first;
+    return true;
+  }
+
+  // The last iteration runs with the bound minus one in the induction
+  // register.
+  assm::RegisterId base = op.base();
+  assm::RegisterId index = op.index();
+  assm::ScaleFactor scale = op.scale();
+  assm::RegisterId* induction = base == loop.induction ? &base : &index;
+  if (loop.bound_register != assm::kRegisterNone) {
+    *induction = loop.bound_register;
+    displacement -= stride;
+  } else {
+    *induction = assm::kRegisterNone;
+    if (index == assm::kRegisterNone)
+      scale = assm::kTimes1;
+    displacement += stride * (loop.bound_value - 1);
+  }
+  *last = BasicBlockAssembler::Operand(
+      base, index, scale,
+      Displacement(static_cast<uint32_t>(displacement), assm::kSize32Bit));
+  return true;
+}
+
+// Collects the single basic block loops of a structural tree.
+// @param node The root of the tree.
+// @param loops Receives the loops.
+void FindSelfLoops(const ControlFlowAnalysis::StructuralNode* node,
+                   std::set<const BasicBlock*>* loops) {
+  typedef ControlFlowAnalysis::StructuralNode StructuralNode;
+  DCHECK_NE(static_cast<const StructuralNode*>(nullptr), node);
+  DCHECK_NE(static_cast<std::set<const BasicBlock*>*>(nullptr), loops);
+
+  switch (node->kind()) {
+    case StructuralNode::kBaseNode:
+      break;
+    case StructuralNode::kSequenceNode:
+      FindSelfLoops(node->entry_node(), loops);
+      FindSelfLoops(node->sequence_node(), loops);
+      break;
+    case StructuralNode::kIfThenNode:
+      FindSelfLoops(node->entry_node(), loops);
+      FindSelfLoops(node->then_node(), loops);
+      break;
+    case StructuralNode::kIfThenElseNode:
+      FindSelfLoops(node->entry_node(), loops);
+      FindSelfLoops(node->then_node(), loops);
+      FindSelfLoops(node->else_node(), loops);
+      break;
+    case StructuralNode::kRepeatNode:
+      if (node->entry_node()->kind() == StructuralNode::kBaseNode)
+        loops->insert(node->entry_node()->root());
+      else
+        FindSelfLoops(node->entry_node(), loops);
+      break;
+    case StructuralNode::kWhileNode:
+      FindSelfLoops(node->entry_node(), loops);
+      FindSelfLoops(node->body_node(), loops);
+      break;
+    case StructuralNode::kLoopNode:
+      FindSelfLoops(node->entry_node(), loops);
+      break;
+    default:
+      NOTREACHED() << "Invalid structural node.";
+  }
+}
+
+// Adds the basic blocks referred to by @p references to @p referenced.
+void AddReferencedBasicBlocks(
+    const BasicBlock::BasicBlockReferenceMap& references,
+    std::set<const BasicBlock*>* referenced) {
+  for (const auto& reference : references) {
+    if (reference.second.referred_type() ==
+        BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
+      referenced->insert(reference.second.basic_block());
+    }
+  }
+}
+
+// Returns a register that isn't used by @p first nor by @p last.
+const assm::Register32& GetScratchRegister(
+    const BasicBlockAssembler::Operand& first,
+    const BasicBlockAssembler::Operand& last) {
+  const assm::Register32* candidates[] = {
+      &assm::eax, &assm::ecx, &assm::edx, &assm::ebx, &assm::esi, &assm::edi};
+  for (const assm::Register32* reg : candidates) {
+    if (reg->id() != first.base() && reg->id() != first.index() &&
+        reg->id() != last.base() && reg->id() != last.index()) {
+      return *reg;
+    }
+  }
+  NOTREACHED();
+  return assm::eax;
 }
 
 // Get the name of an asan check access function for an @p access_mode access.
@@ -320,6 +803,17 @@ std::string GetAsanCheckAccessFunctionName(
     AsanBasicBlockTransform::MemoryAccessInfo info,
     BlockGraph::ImageFormat image_format) {
   DCHECK(info.mode != AsanBasicBlockTransform::kNoAccess);
+
+  // For COFF images we use the decorated function name, which contains a
+  // leading underscore.
+  const char* prefix = image_format == BlockGraph::PE_IMAGE ? "" : "_";
+
+  // The range checks don't depend on the size of the accesses.
+  if (info.mode == AsanBasicBlockTransform::kRangeReadAccess)
+    return base::StringPrintf("%sasan_check_range_read_access", prefix);
+  if (info.mode == AsanBasicBlockTransform::kRangeWriteAccess)
+    return base::StringPrintf("%sasan_check_range_write_access", prefix);
+
   DCHECK_NE(0U, info.size);
   DCHECK(info.mode == AsanBasicBlockTransform::kReadAccess ||
          info.mode == AsanBasicBlockTransform::kWriteAccess ||
@@ -341,11 +835,9 @@ std::string GetAsanCheckAccessFunctionName(
   else
     access_mode_str = reinterpret_cast<char*>(GET_MNEMONIC_NAME(info.opcode));
 
-  // For COFF images we use the decorated function name, which contains a
-  // leading underscore.
   std::string function_name =
       base::StringPrintf("%sasan_check%s_%d_byte_%s_access%s",
-                         image_format == BlockGraph::PE_IMAGE ? "" : "_",
+                         prefix,
                          rep_str,
                          info.size,
                          access_mode_str,
@@ -477,7 +969,8 @@ bool AddAsanCheckAccessHooks(
 
 // Create a stub for the asan_check_access functions. For load/store, the stub
 // consists of a small block of code that restores the value of EDX and returns
-// to the caller. Otherwise, the stub do return.
+// to the caller. For range checks, it cleans the stack on return. Otherwise,
+// the stub do return.
 // @param block_graph The block-graph to populate with the stub.
 // @param stub_name The stub's name.
 // @param mode The kind of memory access.
@@ -521,6 +1014,10 @@ bool CreateHooksStub(BlockGraph* block_graph,
     // return.
     assm.mov(assm::edx, Operand(assm::esp, Displacement(4)));
     assm.ret(4);
+  } else if (mode == AsanBasicBlockTransform::kRangeReadAccess ||
+             mode == AsanBasicBlockTransform::kRangeWriteAccess) {
+    // The range checks clean their 3 parameters from the stack on return.
+    assm.ret(12);
   } else {
     assm.ret();
   }
@@ -546,6 +1043,7 @@ bool CreateHooksStub(BlockGraph* block_graph,
 // @param asan_hook_stub_name Name prefix of the stubs for the asan check access
 //     functions.
 // @param use_liveness_analysis true iff we use liveness analysis.
+// @param hoist_loop_checks true iff we hoist the checks of the loops.
 // @param import_module The module for which the import should be added.
 // @param check_access_hooks_ref The map where the reference to the imports
 //     should be stored.
@@ -557,6 +1055,7 @@ bool CreateHooksStub(BlockGraph* block_graph,
 bool ImportAsanCheckAccessHooks(
     const char* asan_hook_stub_name,
     bool use_liveness_analysis,
+    bool hoist_loop_checks,
     ImportedModule* import_module,
     AsanBasicBlockTransform::AsanHookMap* check_access_hooks_ref,
     const TransformPolicyInterface* policy,
@@ -588,12 +1087,22 @@ bool ImportAsanCheckAccessHooks(
       return false;
     }
 
+    // Create the hook stub for range checks.
+    BlockGraph::Reference range_hook;
+    if (!CreateHooksStub(block_graph, asan_hook_stub_name,
+                         AsanBasicBlockTransform::kRangeReadAccess,
+                         &range_hook)) {
+      return false;
+    }
+
     // Map each memory access kind to an appropriate stub.
     default_stub_map[AsanBasicBlockTransform::kReadAccess] = read_write_hook;
     default_stub_map[AsanBasicBlockTransform::kWriteAccess] = read_write_hook;
     default_stub_map[AsanBasicBlockTransform::kInstrAccess] = instr_hook;
     default_stub_map[AsanBasicBlockTransform::kRepzAccess] = instr_hook;
     default_stub_map[AsanBasicBlockTransform::kRepnzAccess] = instr_hook;
+    default_stub_map[AsanBasicBlockTransform::kRangeReadAccess] = range_hook;
+    default_stub_map[AsanBasicBlockTransform::kRangeWriteAccess] = range_hook;
   }
 
   // Import the hooks for the read/write accesses.
@@ -656,6 +1165,16 @@ bool ImportAsanCheckAccessHooks(
     }
   }
 
+  // Import the range checks for the accesses of the loops.
+  if (hoist_loop_checks) {
+    MemoryAccessInfo range_read_info =
+        { AsanBasicBlockTransform::kRangeReadAccess, 0, 0, true };
+    access_hook_param_vec.push_back(range_read_info);
+    MemoryAccessInfo range_write_info =
+        { AsanBasicBlockTransform::kRangeWriteAccess, 0, 0, true };
+    access_hook_param_vec.push_back(range_write_info);
+  }
+
   if (!AddAsanCheckAccessHooks(access_hook_param_vec,
                                default_stub_map,
                                import_module,
@@ -1057,6 +1576,167 @@ bool PeGetRedirectsForStaticallyLinkedFunctions(
   return true;
 }
 
+// The maximum number of blocks instrumented concurrently before being merged
+// back into the block graph. This bounds the memory used by the subgraphs.
+const size_t kMaxInstrumentationBatchSize = 1024;
+
+// Decomposes and instruments a block. This only reads the block graph, the
+// instrumented subgraph is merged back by the caller once the task is done.
+class InstrumentBlockTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph The block graph being transformed.
+  // @param block The block to instrument.
+  // @param transform The transform to apply to @p block. Ownership is
+  //     transferred to the task.
+  InstrumentBlockTask(const TransformPolicyInterface* policy,
+                      BlockGraph* block_graph,
+                      BlockGraph::Block* block,
+                      AsanBasicBlockTransform* transform)
+      : policy_(policy),
+        block_graph_(block_graph),
+        block_(block),
+        transform_(transform),
+        decomposed_(false),
+        result_(false) {
+    DCHECK_NE(static_cast<TransformPolicyInterface*>(nullptr), policy);
+    DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+    DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), block);
+    DCHECK_NE(static_cast<AsanBasicBlockTransform*>(nullptr), transform);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    BasicBlockDecomposer bb_decomposer(block_, &subgraph_);
+    if (!bb_decomposer.Decompose()) {
+      // As in ApplyBasicBlockSubGraphTransform, a block with unsupported
+      // instructions is marked as such and left as is.
+      if (bb_decomposer.contains_unsupported_instructions()) {
+        VLOG(1) << "Block contains unsupported instruction(s): "
+                << block_graph::BlockInfo(block_);
+        block_->set_attribute(BlockGraph::UNSUPPORTED_INSTRUCTIONS);
+        result_ = true;
+      }
+      return;
+    }
+    decomposed_ = true;
+
+    result_ = transform_->TransformBasicBlockSubGraph(policy_, block_graph_,
+                                                      &subgraph_);
+  }
+  // @}
+
+  // @returns true if the block was decomposed, in which case its subgraph
+  //     must be merged back.
+  bool decomposed() const { return decomposed_; }
+  // @returns true on success, false otherwise.
+  bool result() const { return result_; }
+  // @returns the instrumented subgraph of the block.
+  BasicBlockSubGraph* subgraph() { return &subgraph_; }
+  // @returns the block being instrumented.
+  BlockGraph::Block* block() const { return block_; }
+  // @returns the transform applied to the block.
+  const AsanBasicBlockTransform* transform() const { return transform_.get(); }
+
+ private:
+  const TransformPolicyInterface* policy_;
+  BlockGraph* block_graph_;
+  BlockGraph::Block* block_;
+  std::unique_ptr<AsanBasicBlockTransform> transform_;
+  BasicBlockSubGraph subgraph_;
+  bool decomposed_;
+  bool result_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstrumentBlockTask);
+};
+
+// Runs @p tasks on a pool of @p num_threads threads, then merges their
+// subgraphs back into @p block_graph in order.
+// @param num_threads The number of worker threads.
+// @param block_graph The block graph being transformed.
+// @param report The report accounting for the probes of the tasks. This may
+//     be null.
+// @param tasks The tasks to run. This is emptied on return.
+// @returns true on success, false otherwise.
+bool RunInstrumentBlockTasks(size_t num_threads,
+                             BlockGraph* block_graph,
+                             InstrumentationReport* report,
+                             ScopedVector<InstrumentBlockTask>* tasks) {
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+  DCHECK_NE(static_cast<ScopedVector<InstrumentBlockTask>*>(nullptr), tasks);
+
+  if (tasks->empty())
+    return true;
+
+  base::DelegateSimpleThreadPool pool(
+      "AsanInstrumentation",
+      static_cast<int>(std::min(num_threads, tasks->size())));
+  pool.Start();
+  for (InstrumentBlockTask* task : *tasks)
+    pool.AddWork(task);
+  pool.JoinAll();
+
+  // The merges add and remove blocks and references, they are done serially
+  // and in the order of the serial iteration so that the block IDs match.
+  bool result = true;
+  for (InstrumentBlockTask* task : *tasks) {
+    if (!task->result()) {
+      result = false;
+      break;
+    }
+    if (!task->decomposed())
+      continue;
+
+    // The block is removed by the merge.
+    if (report != nullptr) {
+      report->AddFunctionReport(task->block()->addr(),
+                                task->transform()->report());
+    }
+
+    BlockBuilder builder(block_graph);
+    if (!builder.Merge(task->subgraph())) {
+      result = false;
+      break;
+    }
+  }
+  tasks->clear();
+
+  return result;
+}
+
+// Checks if @p block refers to, or is referred to by, one of @p blocks.
+// @param block The block to check.
+// @param blocks The blocks to check against.
+// @returns true if @p block is connected to one of @p blocks.
+bool IsConnectedToAny(const BlockGraph::Block* block,
+                      const std::set<const BlockGraph::Block*>& blocks) {
+  for (const auto& reference : block->references()) {
+    if (blocks.count(reference.second.referenced()) != 0)
+      return true;
+  }
+  for (const auto& referrer : block->referrers()) {
+    if (blocks.count(referrer.first) != 0)
+      return true;
+  }
+  return false;
+}
+
+// @param subgraph The subgraph to measure.
+// @returns the size of the instructions of the basic code blocks of
+//     @p subgraph.
+size_t GetInstructionsSize(const BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(static_cast<const BasicBlockSubGraph*>(nullptr), subgraph);
+
+  size_t size = 0;
+  for (const BasicBlock* bb : subgraph->basic_blocks()) {
+    const BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+    if (code_bb != nullptr)
+      size += code_bb->GetInstructionSize();
+  }
+  return size;
+}
+
 }  // namespace
 
 const char AsanBasicBlockTransform::kTransformName[] =
@@ -1068,9 +1748,14 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     BlockGraph::ImageFormat image_format) {
   DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), basic_block);
 
-  if (instrumentation_rate_ == 0.0)
+  double instrumentation_rate = GetInstrumentationRate(basic_block);
+  if (instrumentation_rate == 0.0)
     return true;
 
+  // The number of times the probes of this basic block are expected to run.
+  EntryCountType entry_count = 0;
+  GetEntryCount(basic_block, &entry_count);
+
   // Pre-compute liveness information for each instruction.
   std::list<LivenessAnalysis::State> states;
   LivenessAnalysis::State state;
@@ -1095,8 +1780,9 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
   if (remove_redundant_checks_)
     memory_accesses_.GetStateAtEntryOf(basic_block, &memory_state);
 
-  // Process each instruction and inject a call to Asan when we find an
-  // instrumentable memory access.
+  // Process each instruction and collect the probes for its instrumentable
+  // memory access, if any.
+  AsanProbes probes;
   BasicBlock::Instructions::iterator iter_inst =
       basic_block->instructions().begin();
   std::list<LivenessAnalysis::State>::iterator iter_state = states.begin();
@@ -1117,17 +1803,15 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
       ++iter_state;
     }
 
-    // When activated, skip redundant memory access check.
+    // When activated, find out if the memory access check is redundant. It
+    // is skipped after the other filters, so that only the checks that would
+    // otherwise be injected are accounted as elided.
+    bool redundant_check = false;
     if (remove_redundant_checks_) {
-      bool need_memory_access_check = false;
-      if (memory_state.HasNonRedundantAccess(instr))
-        need_memory_access_check = true;
+      redundant_check = !memory_state.HasNonRedundantAccess(instr);
 
       // Update the memory accesses information for the current instruction.
       memory_accesses_.PropagateForward(instr, &memory_state);
-
-      if (!need_memory_access_check)
-        continue;
     }
 
     // Insert hook for a standard instruction.
@@ -1178,27 +1862,73 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     if (IsFiltered(*iter_inst))
       continue;
 
+    // Skip redundant memory access checks.
+    if (redundant_check) {
+      ++report_.elided_checks;
+      continue;
+    }
+
     // Randomly sample to effect partial instrumentation.
-    if (instrumentation_rate_ < 1.0 &&
-        base::RandDouble() >= instrumentation_rate_) {
+    if (instrumentation_rate < 1.0 &&
+        base::RandDouble() >= instrumentation_rate) {
       continue;
     }
 
+    if (use_liveness_analysis_ &&
+        (info.mode == kReadAccess || info.mode == kWriteAccess)) {
+      // Use the liveness information to skip saving the flags if possible.
+      info.save_flags = state.AreArithmeticFlagsLive();
+    }
+
+    probes.push_back(AsanProbe(iter_inst, operand, info, state));
+  }
+
+  DCHECK(iter_state == states.end());
+
+  // Replace the probes of the accesses of a counted loop by range checks, to
+  // be injected in its preheader.
+  CountedLoop loop;
+  if (hoistable_loops_.count(basic_block) != 0 &&
+      MatchCountedLoop(basic_block, &loop)) {
+    bool after_update = false;
+    size_t next_probe = 0;
+    for (iter_inst = basic_block->instructions().begin();
+         iter_inst != basic_block->instructions().end(); ++iter_inst) {
+      if (&*iter_inst == loop.update)
+        after_update = true;
+      if (next_probe == probes.size() || probes[next_probe].instr != iter_inst)
+        continue;
+
+      AsanProbe& probe = probes[next_probe++];
+      auto first(Operand(assm::eax));
+      auto last(Operand(assm::eax));
+      if (!HoistProbe(loop, probe, after_update, &first, &last))
+        continue;
+      MemoryAccessMode mode = probe.info.mode == kReadAccess ?
+          kRangeReadAccess : kRangeWriteAccess;
+      hoisted_checks_[basic_block].push_back(
+          HoistedCheck(mode, probe.info.size, first, last));
+      probe.covered = true;
+    }
+  }
+
+  if (coalesce_checks_)
+    CoalesceProbes(basic_block, &probes);
+
+  for (const AsanProbe& probe : probes) {
+    if (probe.covered)
+      continue;
+
     // Create a BasicBlockAssembler to insert new instruction.
-    BasicBlockAssembler bb_asm(iter_inst, &basic_block->instructions());
+    BasicBlockAssembler bb_asm(probe.instr, &basic_block->instructions());
+    bb_asm.set_instruction_cache(instruction_cache_);
 
     // Configure the assembler to copy the SourceRange information of the
     // current instrumented instruction into newly created instructions. This is
     // a hack to allow valid stack walking and better error reporting, but
     // breaks the 1:1 OMAP mapping and may confuse some debuggers.
     if (debug_friendly_)
-      bb_asm.set_source_range(instr.source_range());
-
-    if (use_liveness_analysis_ &&
-        (info.mode == kReadAccess || info.mode == kWriteAccess)) {
-      // Use the liveness information to skip saving the flags if possible.
-      info.save_flags = state.AreArithmeticFlagsLive();
-    }
+      bb_asm.set_source_range(probe.instr->source_range());
 
     // Mark that an instrumentation will happen. Do this before selecting a
     // hook so we can call a dry run without hooks present.
@@ -1206,21 +1936,25 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
 
     if (!dry_run_) {
       // Insert hook for standard instructions.
-      AsanHookMap::iterator hook = check_access_hooks_->find(info);
+      AsanHookMap::iterator hook = check_access_hooks_->find(probe.info);
       if (hook == check_access_hooks_->end()) {
         LOG(ERROR) << "Invalid access : "
-                   << GetAsanCheckAccessFunctionName(info, image_format);
+                   << GetAsanCheckAccessFunctionName(probe.info, image_format);
         return false;
       }
 
       // Instrument this instruction.
-      InjectAsanHook(
-          &bb_asm, info, operand, &hook->second, state, image_format);
+      InjectAsanHook(&bb_asm, probe.info, probe.operand, &hook->second,
+                     probe.state, image_format);
+
+      InstrumentationReport::ProbeKind kind =
+          probe.info.save_flags ? InstrumentationReport::kAccessCheckSavingFlags
+                                : InstrumentationReport::kAccessCheck;
+      ++report_.probes[kind];
+      report_.executions[kind] += entry_count;
     }
   }
 
-  DCHECK(iter_state == states.end());
-
   return true;
 }
 
@@ -1230,6 +1964,50 @@ void AsanBasicBlockTransform::set_instrumentation_rate(
   instrumentation_rate_ = std::max(0.0, std::min(1.0, instrumentation_rate));
 }
 
+void AsanBasicBlockTransform::set_hot_instrumentation_rate(
+    double hot_instrumentation_rate) {
+  // Set the hot instrumentation rate, capping it between 0 and 1.
+  hot_instrumentation_rate_ =
+      std::max(0.0, std::min(1.0, hot_instrumentation_rate));
+}
+
+double AsanBasicBlockTransform::GetInstrumentationRate(
+    const BasicCodeBlock* basic_block) const {
+  DCHECK_NE(static_cast<const BasicCodeBlock*>(nullptr), basic_block);
+
+  EntryCountType entry_count = 0;
+  if (!GetEntryCount(basic_block, &entry_count) ||
+      entry_count < hot_entry_count_) {
+    return instrumentation_rate_;
+  }
+
+  return hot_instrumentation_rate_;
+}
+
+bool AsanBasicBlockTransform::GetEntryCount(const BasicCodeBlock* basic_block,
+                                            EntryCountType* entry_count) const {
+  DCHECK_NE(static_cast<const BasicCodeBlock*>(nullptr), basic_block);
+  DCHECK_NE(static_cast<EntryCountType*>(nullptr), entry_count);
+
+  if (profile_ == nullptr || basic_block->instructions().empty())
+    return false;
+
+  // The profile is indexed by the address of the basic blocks in the original
+  // image, the first column holds their entry counts. Basic blocks that don't
+  // appear in it have never been entered.
+  const Instruction::SourceRange& source_range =
+      basic_block->instructions().front().source_range();
+  if (source_range.size() == 0)
+    return false;
+  grinder::basic_block_util::IndexedFrequencyMap::const_iterator it =
+      profile_->frequency_map.find(std::make_pair(source_range.start(), 0));
+  if (it == profile_->frequency_map.end())
+    return false;
+
+  *entry_count = it->second;
+  return true;
+}
+
 bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1238,6 +2016,12 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
   DCHECK(block_graph != NULL);
   DCHECK(subgraph != NULL);
 
+  // Start the accounting of the probes of this subgraph.
+  report_ = InstrumentationReport::FunctionReport();
+  if (subgraph->original_block() != NULL)
+    report_.name = subgraph->original_block()->name();
+  size_t instructions_size = GetInstructionsSize(subgraph);
+
   // Perform a global liveness analysis.
   if (use_liveness_analysis_)
     liveness_.Analyze(subgraph);
@@ -1246,6 +2030,13 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
   if (remove_redundant_checks_)
     memory_accesses_.Analyze(subgraph);
 
+  // Find the loops whose checks can be hoisted. There are no hooks for the
+  // range checks in dry run mode.
+  hoistable_loops_.clear();
+  hoisted_checks_.clear();
+  if (hoist_loop_checks_ && !dry_run_)
+    FindHoistableLoops(subgraph);
+
   // Determines if this subgraph uses unconventional stack pointer
   // manipulations.
   StackAccessMode stack_mode = kUnsafeStackAccess;
@@ -1262,6 +2053,148 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
       return false;
     }
   }
+
+  if (!InjectHoistedChecks(subgraph, block_graph->image_format()))
+    return false;
+
+  report_.extra_bytes = GetInstructionsSize(subgraph) - instructions_size;
+  return true;
+}
+
+void AsanBasicBlockTransform::FindHoistableLoops(
+    const BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(static_cast<const BasicBlockSubGraph*>(nullptr), subgraph);
+
+  ControlFlowAnalysis::StructuralTree tree;
+  if (!ControlFlowAnalysis::BuildStructuralTree(subgraph, &tree))
+    return;
+  std::set<const BasicBlock*> loops;
+  FindSelfLoops(tree.get(), &loops);
+  if (loops.empty())
+    return;
+
+  // The loops may be entered from outside of the subgraph through their
+  // address, or at the head of their block.
+  std::set<const BasicBlock*> address_taken;
+  std::map<const BasicBlock*, size_t> entry_edges;
+  for (const BasicBlock* bb : subgraph->basic_blocks()) {
+    if (!bb->referrers().empty())
+      address_taken.insert(bb);
+
+    const BasicDataBlock* data_bb = BasicDataBlock::Cast(bb);
+    if (data_bb != nullptr)
+      AddReferencedBasicBlocks(data_bb->references(), &address_taken);
+
+    const BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+    if (code_bb == nullptr)
+      continue;
+    for (const Instruction& instr : code_bb->instructions())
+      AddReferencedBasicBlocks(instr.references(), &address_taken);
+    for (const Successor& successor : code_bb->successors()) {
+      const BasicBlock* target = successor.reference().basic_block();
+      if (target != nullptr && target != bb)
+        ++entry_edges[target];
+    }
+  }
+  for (const auto& description : subgraph->block_descriptions()) {
+    if (!description.basic_block_order.empty())
+      address_taken.insert(description.basic_block_order.front());
+  }
+
+  // The preheader goes on the unique entry edge of the loop.
+  for (const BasicBlock* loop : loops) {
+    if (address_taken.count(loop) == 0 && entry_edges[loop] == 1)
+      hoistable_loops_.insert(BasicCodeBlock::Cast(loop));
+  }
+}
+
+bool AsanBasicBlockTransform::InjectHoistedChecks(
+    BasicBlockSubGraph* subgraph,
+    BlockGraph::ImageFormat image_format) {
+  DCHECK_NE(static_cast<BasicBlockSubGraph*>(nullptr), subgraph);
+
+  for (const auto& loop_checks : hoisted_checks_) {
+    BasicCodeBlock* loop = loop_checks.first;
+
+    // Find the entry edge of the loop.
+    Successor* entry_edge = nullptr;
+    BasicCodeBlock* entry_bb = nullptr;
+    for (BasicBlock* bb : subgraph->basic_blocks()) {
+      BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+      if (code_bb == nullptr || code_bb == loop)
+        continue;
+      for (Successor& successor : code_bb->successors()) {
+        if (successor.reference().basic_block() == loop) {
+          DCHECK_EQ(static_cast<Successor*>(nullptr), entry_edge);
+          entry_edge = &successor;
+          entry_bb = code_bb;
+        }
+      }
+    }
+    DCHECK_NE(static_cast<Successor*>(nullptr), entry_edge);
+
+    // The preheader runs at most as many times as the source of the entry
+    // edge.
+    EntryCountType entry_count = 0;
+    GetEntryCount(entry_bb, &entry_count);
+
+    // Route the entry edge through a preheader laid out right in front of the
+    // loop.
+    BasicCodeBlock* preheader = subgraph->AddBasicCodeBlock(
+        base::StringPrintf("%s_preheader", loop->name().c_str()));
+    for (auto& description : subgraph->block_descriptions()) {
+      BasicBlockSubGraph::BasicBlockOrdering& order =
+          description.basic_block_order;
+      BasicBlockSubGraph::BasicBlockOrdering::iterator it =
+          std::find(order.begin(), order.end(), loop);
+      if (it != order.end()) {
+        order.insert(it, preheader);
+        break;
+      }
+    }
+    entry_edge->set_reference(
+        BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, preheader));
+    preheader->successors().push_back(
+        Successor(Successor::kConditionTrue,
+                  BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, loop),
+                  0));
+
+    BasicBlockAssembler bb_asm(preheader->instructions().begin(),
+                               &preheader->instructions());
+    bb_asm.set_instruction_cache(instruction_cache_);
+    if (debug_friendly_)
+      bb_asm.set_source_range(loop->instructions().front().source_range());
+
+    // Each range check is given the addresses of the first and of the last
+    // accesses, and the size of the accesses. It preserves all the registers
+    // and the flags.
+    for (const HoistedCheck& check : loop_checks.second) {
+      MemoryAccessInfo info = { check.mode, 0, 0, true };
+      AsanHookMap::iterator hook = check_access_hooks_->find(info);
+      if (hook == check_access_hooks_->end()) {
+        LOG(ERROR) << "Invalid access : "
+                   << GetAsanCheckAccessFunctionName(info, image_format);
+        return false;
+      }
+
+      const Register32& scratch = GetScratchRegister(check.first, check.last);
+      bb_asm.push(scratch);
+      bb_asm.push(Immediate(check.size, assm::kSize32Bit));
+      bb_asm.lea(scratch, check.last);
+      bb_asm.push(scratch);
+      bb_asm.lea(scratch, check.first);
+      bb_asm.push(scratch);
+      InjectHookCall(&bb_asm, &hook->second, image_format);
+      bb_asm.pop(scratch);
+
+      ++report_.probes[InstrumentationReport::kRangeCheck];
+      report_.executions[InstrumentationReport::kRangeCheck] += entry_count;
+    }
+
+    instrumentation_happened_ = true;
+  }
+  hoisted_checks_.clear();
+
   return true;
 }
 
@@ -1313,8 +2246,15 @@ AsanTransform::AsanTransform()
     : debug_friendly_(false),
       use_liveness_analysis_(false),
       remove_redundant_checks_(false),
+      coalesce_checks_(false),
+      hoist_loop_checks_(false),
       use_interceptors_(false),
       instrumentation_rate_(1.0),
+      instrumentation_threads_(1),
+      report_(nullptr),
+      profile_(nullptr),
+      hot_entry_count_(1),
+      hot_instrumentation_rate_(0.0),
       asan_parameters_(nullptr),
       check_access_hooks_ref_(),
       asan_parameters_block_(nullptr),
@@ -1323,11 +2263,57 @@ AsanTransform::AsanTransform()
 
 AsanTransform::~AsanTransform() { }
 
+bool AsanTransform::TransformBlockGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  DCHECK_NE(static_cast<TransformPolicyInterface*>(nullptr), policy);
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+  DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), header_block);
+
+  // The sampling of the instrumented accesses depends on the order in which
+  // the blocks are processed, and the hot patching mode collects the blocks
+  // as they are built. These are only done serially.
+  bool sampling = instrumentation_rate_ < 1.0 ||
+      (profile_ != nullptr && hot_instrumentation_rate_ > 0.0 &&
+       hot_instrumentation_rate_ < 1.0);
+  if (instrumentation_threads_ <= 1 || sampling || hot_patching_) {
+    return IterativeTransformImpl<AsanTransform>::TransformBlockGraph(
+        policy, block_graph, header_block);
+  }
+
+  if (!PreBlockGraphIteration(policy, block_graph, header_block)) {
+    LOG(ERROR) << "PreBlockGraphIteration failed for \"" << name()
+               << "\" transform.";
+    return false;
+  }
+
+  if (!InstrumentBlocksInParallel(policy, block_graph)) {
+    LOG(ERROR) << "Iteration failed for \"" << name() << "\" transform.";
+    return false;
+  }
+
+  if (!PostBlockGraphIteration(policy, block_graph, header_block)) {
+    LOG(ERROR) << "PostBlockGraphIteration failed for \"" << name()
+               << "\" transform.";
+    return false;
+  }
+
+  return true;
+}
+
 void AsanTransform::set_instrumentation_rate(double instrumentation_rate) {
   // Set the instrumentation rate, capping it between 0 and 1.
   instrumentation_rate_ = std::max(0.0, std::min(1.0, instrumentation_rate));
 }
 
+void AsanTransform::set_hot_instrumentation_rate(
+    double hot_instrumentation_rate) {
+  // Set the hot instrumentation rate, capping it between 0 and 1.
+  hot_instrumentation_rate_ =
+      std::max(0.0, std::min(1.0, hot_instrumentation_rate));
+}
+
 bool AsanTransform::PreBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1362,6 +2348,7 @@ bool AsanTransform::PreBlockGraphIteration(
   if (!hot_patching_) {
     if (!ImportAsanCheckAccessHooks(kAsanHookStubName,
                                     use_liveness_analysis(),
+                                    hoist_loop_checks(),
                                     &import_module,
                                     &check_access_hooks_ref_,
                                     policy,
@@ -1399,19 +2386,19 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   if (ShouldSkipBlock(policy, block))
     return true;
 
-  // Use the filter that was passed to us for our child transform.
   AsanBasicBlockTransform transform(&check_access_hooks_ref_);
-  transform.set_debug_friendly(debug_friendly());
-  transform.set_use_liveness_analysis(use_liveness_analysis());
-  transform.set_remove_redundant_checks(remove_redundant_checks());
-  transform.set_filter(filter());
-  transform.set_instrumentation_rate(instrumentation_rate_);
+  ConfigureBasicBlockTransform(&transform);
+
+  // The block is replaced by the transform.
+  BlockGraph::RelativeAddress address = block->addr();
 
   if (!hot_patching_) {
     if (!ApplyBasicBlockSubGraphTransform(
             &transform, policy, block_graph, block, NULL)) {
       return false;
     }
+    if (report_ != nullptr)
+      report_->AddFunctionReport(address, transform.report());
   } else {
     // If we run in hot patching mode we just want to check if the block would
     // be instrumented.
@@ -1541,6 +2528,74 @@ bool AsanTransform::ShouldSkipBlock(const TransformPolicyInterface* policy,
   return false;
 }
 
+void AsanTransform::ConfigureBasicBlockTransform(
+    AsanBasicBlockTransform* transform) const {
+  DCHECK_NE(static_cast<AsanBasicBlockTransform*>(nullptr), transform);
+
+  // Use the filter that was passed to us for our child transform.
+  transform->set_debug_friendly(debug_friendly());
+  transform->set_use_liveness_analysis(use_liveness_analysis());
+  transform->set_remove_redundant_checks(remove_redundant_checks());
+  transform->set_coalesce_checks(coalesce_checks());
+  transform->set_hoist_loop_checks(hoist_loop_checks());
+  transform->set_filter(filter());
+  transform->set_filter_page_map(filter_page_map());
+  transform->set_instrumentation_rate(instrumentation_rate_);
+  transform->set_profile(profile_);
+  transform->set_hot_entry_count(hot_entry_count_);
+  transform->set_hot_instrumentation_rate(hot_instrumentation_rate_);
+  transform->set_instruction_cache(&instruction_cache_);
+}
+
+bool AsanTransform::InstrumentBlocksInParallel(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph) {
+  DCHECK_NE(static_cast<TransformPolicyInterface*>(nullptr), policy);
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+  DCHECK(!hot_patching_);
+
+  // As in IterateBlockGraph, only the blocks existing prior to the iteration
+  // are visited. Merging a block only removes that block.
+  std::vector<BlockGraph::Block*> blocks;
+  for (auto& entry : block_graph->blocks_mutable())
+    blocks.push_back(&entry.second);
+
+  // A subgraph refers to the blocks its block refers to and to its
+  // referrers, none of which can be rebuilt until it is merged. Merging a
+  // block doesn't change the blocks it isn't connected to, so the blocks of a
+  // batch are decomposed in the state they'd have in the serial iteration.
+  ScopedVector<InstrumentBlockTask> tasks;
+  std::set<const BlockGraph::Block*> batch;
+  for (BlockGraph::Block* block : blocks) {
+    // The policy rejects the blocks other than code without looking at them.
+    if (block->type() != BlockGraph::CODE_BLOCK)
+      continue;
+
+    if (tasks.size() == kMaxInstrumentationBatchSize ||
+        IsConnectedToAny(block, batch)) {
+      if (!RunInstrumentBlockTasks(instrumentation_threads_, block_graph,
+                                   report_, &tasks)) {
+        return false;
+      }
+      batch.clear();
+    }
+
+    // The policy caches its results, it's only queried from this thread.
+    if (ShouldSkipBlock(policy, block))
+      continue;
+
+    AsanBasicBlockTransform* transform =
+        new AsanBasicBlockTransform(&check_access_hooks_ref_);
+    ConfigureBasicBlockTransform(transform);
+    tasks.push_back(
+        new InstrumentBlockTask(policy, block_graph, block, transform));
+    batch.insert(block);
+  }
+
+  return RunInstrumentBlockTasks(instrumentation_threads_, block_graph,
+                                 report_, &tasks);
+}
+
 bool AsanTransform::PeFindStaticallyLinkedFunctionsToIntercept(
     const AsanIntercept* intercepts,
     BlockGraph* block_graph) {
@@ -1687,7 +2742,7 @@ bool AsanTransform::PeInjectAsanParameters(
   params_block->CopyData(fparams.data().size(), fparams.data().data());
 
   // Wire up any references that are required.
-  static_assert(15 == common::kAsanParametersVersion,
+  static_assert(32 == common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   block_graph::TypedBlock<common::AsanParameters> params;
   CHECK(params.Init(0, params_block));
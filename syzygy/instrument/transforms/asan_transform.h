@@ -24,6 +24,7 @@
 #include <vector>
 
 #include "base/strings/string_piece.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/filterable.h"
 #include "syzygy/block_graph/iterate.h"
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
@@ -31,8 +32,10 @@
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 #include "syzygy/common/asan_parameters.h"
+#include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/instrument/transforms/asan_interceptor_filter.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
+#include "syzygy/instrument/transforms/instrumentation_report.h"
 #include "syzygy/pe/transforms/pe_add_imports_transform.h"
 
 namespace instrument {
@@ -52,6 +55,9 @@ class AsanBasicBlockTransform
     kInstrAccess,
     kRepzAccess,
     kRepnzAccess,
+    // The range checks replacing the probes of the accesses of a loop.
+    kRangeReadAccess,
+    kRangeWriteAccess,
   };
 
   enum StackAccessMode {
@@ -75,6 +81,9 @@ class AsanBasicBlockTransform
   // Map of hooks to Asan check access functions.
   typedef std::map<AsanHookMapEntryKey, BlockGraph::Reference> AsanHookMap;
   typedef std::map<MemoryAccessMode, BlockGraph::Reference> AsanDefaultHookMap;
+  typedef grinder::basic_block_util::EntryCountType EntryCountType;
+  typedef grinder::basic_block_util::IndexedFrequencyInformation
+      IndexedFrequencyInformation;
 
   // Constructor.
   // @param check_access_hooks References to the various check access functions.
@@ -86,8 +95,14 @@ class AsanBasicBlockTransform
       dry_run_(false),
       instrumentation_happened_(false),
       instrumentation_rate_(1.0),
+      profile_(nullptr),
+      hot_entry_count_(1),
+      hot_instrumentation_rate_(0.0),
       remove_redundant_checks_(false),
-      use_liveness_analysis_(false) {
+      coalesce_checks_(false),
+      hoist_loop_checks_(false),
+      use_liveness_analysis_(false),
+      instruction_cache_(nullptr) {
     DCHECK(check_access_hooks != NULL);
   }
 
@@ -106,10 +121,48 @@ class AsanBasicBlockTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  bool coalesce_checks() const { return coalesce_checks_; }
+  void set_coalesce_checks(bool coalesce_checks) {
+    coalesce_checks_ = coalesce_checks;
+  }
+
+  bool hoist_loop_checks() const { return hoist_loop_checks_; }
+  void set_hoist_loop_checks(bool hoist_loop_checks) {
+    hoist_loop_checks_ = hoist_loop_checks;
+  }
+
+  // The cache through which the probes are decoded, which must outlive the
+  // transform. The probes are decoded on their own by default.
+  block_graph::BasicBlockAssembler::InstructionCache* instruction_cache()
+      const {
+    return instruction_cache_;
+  }
+  void set_instruction_cache(
+      block_graph::BasicBlockAssembler::InstructionCache* instruction_cache) {
+    instruction_cache_ = instruction_cache;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // The profile telling the hot basic blocks from the cold ones, i.e. basic
+  // block entry counts or coverage data for the original image. A basic block
+  // is hot if its entry count is at least hot_entry_count(), its accesses are
+  // then instrumented at hot_instrumentation_rate() instead of
+  // instrumentation_rate(). There's no profile by default.
+  const IndexedFrequencyInformation* profile() const { return profile_; }
+  void set_profile(const IndexedFrequencyInformation* profile) {
+    profile_ = profile;
+  }
+  EntryCountType hot_entry_count() const { return hot_entry_count_; }
+  void set_hot_entry_count(EntryCountType hot_entry_count) {
+    hot_entry_count_ = hot_entry_count;
+  }
+  // The hot instrumentation rate must be in the range [0, 1], inclusive.
+  double hot_instrumentation_rate() const { return hot_instrumentation_rate_; }
+  void set_hot_instrumentation_rate(double hot_instrumentation_rate);
+
   // Instead of instrumenting the basic blocks, in dry run mode the instrumenter
   // only signals if any instrumentation would have happened on the block.
   // @returns true iff the instrumenter is in dry run mode.
@@ -124,6 +177,12 @@ class AsanBasicBlockTransform
   // @returns true iff an instrumentation happened (or would have happened, in
   //     case of a dry run).
   bool instrumentation_happened() const { return instrumentation_happened_; }
+
+  // The accounting of the probes injected in the last subgraph transformed.
+  // The probe executions are only counted when there's a profile.
+  const InstrumentationReport::FunctionReport& report() const {
+    return report_;
+  }
   // @}
 
   // The transform name.
@@ -151,6 +210,53 @@ class AsanBasicBlockTransform
                             BlockGraph::ImageFormat image_format);
 
  private:
+  // A range check replacing the probes of an access of a counted loop.
+  struct HoistedCheck {
+    HoistedCheck(MemoryAccessMode mode,
+                 uint8_t size,
+                 const block_graph::BasicBlockAssembler::Operand& first,
+                 const block_graph::BasicBlockAssembler::Operand& last)
+        : mode(mode), size(size), first(first), last(last) {
+    }
+
+    // Either kRangeReadAccess or kRangeWriteAccess.
+    MemoryAccessMode mode;
+    // The size of the access.
+    uint8_t size;
+    // The addresses of the first byte of the access on the first and on the
+    // last iterations of the loop, as seen from its preheader.
+    block_graph::BasicBlockAssembler::Operand first;
+    block_graph::BasicBlockAssembler::Operand last;
+  };
+
+  // Finds the loops of a subgraph whose checks can be hoisted, i.e. the single
+  // basic block loops that have a single entry edge and whose address is not
+  // taken.
+  // @param subgraph The subgraph being transformed.
+  void FindHoistableLoops(const BasicBlockSubGraph* subgraph);
+
+  // Injects the checks hoisted out of the loops in new preheaders, in between
+  // each loop and its entry edge.
+  // @param subgraph The subgraph being transformed.
+  // @param image_format The format of the image being instrumented.
+  // @returns true on success, false otherwise.
+  bool InjectHoistedChecks(BasicBlockSubGraph* subgraph,
+                           BlockGraph::ImageFormat image_format);
+
+  // @param basic_block The basic block being instrumented.
+  // @returns the rate at which the accesses of @p basic_block are
+  //     instrumented, depending on its entry count in the profile.
+  double GetInstrumentationRate(
+      const block_graph::BasicCodeBlock* basic_block) const;
+
+  // Looks up the entry count of a basic block in the profile.
+  // @param basic_block The basic block being instrumented.
+  // @param entry_count Receives the entry count of @p basic_block.
+  // @returns false if there's no profile or if @p basic_block doesn't appear
+  //     in it, in which case it has never been entered.
+  bool GetEntryCount(const block_graph::BasicCodeBlock* basic_block,
+                     EntryCountType* entry_count) const;
+
   // Liveness analysis and liveness information for this subgraph.
   block_graph::analysis::LivenessAnalysis liveness_;
 
@@ -171,17 +277,45 @@ class AsanBasicBlockTransform
   // implemented using random sampling.
   double instrumentation_rate_;
 
+  // The profile telling the hot basic blocks from the cold ones, the entry
+  // count from which a basic block is hot, and the rate at which the hot
+  // basic blocks are instrumented.
+  const IndexedFrequencyInformation* profile_;
+  EntryCountType hot_entry_count_;
+  double hot_instrumentation_rate_;
+
   // If any instrumentation happened during a transform, or would have happened
   // during a dry run transform, this member is set to true.
   bool instrumentation_happened_;
 
+  // The accounting of the probes injected in the subgraph being transformed.
+  InstrumentationReport::FunctionReport report_;
+
   // When activated, a redundancy elimination is performed to minimize the
   // memory checks added by this transform.
   bool remove_redundant_checks_;
 
+  // When activated, the checks of adjacent accesses through the same base
+  // register are replaced by range checks covering them.
+  bool coalesce_checks_;
+
+  // When activated, the checks of the accesses of the counted loops are
+  // replaced by range checks covering all of their iterations, ahead of them.
+  bool hoist_loop_checks_;
+
+  // The loops of the subgraph being transformed whose checks can be hoisted.
+  std::set<const block_graph::BasicCodeBlock*> hoistable_loops_;
+
+  // The checks hoisted out of the loops of the subgraph being transformed.
+  std::map<block_graph::BasicCodeBlock*, std::vector<HoistedCheck>>
+      hoisted_checks_;
+
   // Set iff we should use the liveness analysis to do smarter instrumentation.
   bool use_liveness_analysis_;
 
+  // The cache through which the probes are decoded, if any.
+  block_graph::BasicBlockAssembler::InstructionCache* instruction_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(AsanBasicBlockTransform);
 };
 
@@ -240,6 +374,15 @@ class AsanTransform
 
   ~AsanTransform();
 
+  // @name BlockGraphTransformInterface implementation.
+  // @{
+  // Overrides the iteration of IterativeTransformImpl to instrument the
+  // blocks on worker threads when more than one thread is requested.
+  bool TransformBlockGraph(const TransformPolicyInterface* policy,
+                           BlockGraph* block_graph,
+                           BlockGraph::Block* header_block) override;
+  // @}
+
   // @name IterativeTransformImpl implementation.
   // @{
   bool PreBlockGraphIteration(const TransformPolicyInterface* policy,
@@ -283,10 +426,52 @@ class AsanTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  bool coalesce_checks() const { return coalesce_checks_; }
+  void set_coalesce_checks(bool coalesce_checks) {
+    coalesce_checks_ = coalesce_checks;
+  }
+
+  bool hoist_loop_checks() const { return hoist_loop_checks_; }
+  void set_hoist_loop_checks(bool hoist_loop_checks) {
+    hoist_loop_checks_ = hoist_loop_checks;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // The profile telling the hot basic blocks from the cold ones. See
+  // AsanBasicBlockTransform::profile().
+  const AsanBasicBlockTransform::IndexedFrequencyInformation* profile() const {
+    return profile_;
+  }
+  void set_profile(
+      const AsanBasicBlockTransform::IndexedFrequencyInformation* profile) {
+    profile_ = profile;
+  }
+  AsanBasicBlockTransform::EntryCountType hot_entry_count() const {
+    return hot_entry_count_;
+  }
+  void set_hot_entry_count(
+      AsanBasicBlockTransform::EntryCountType hot_entry_count) {
+    hot_entry_count_ = hot_entry_count;
+  }
+  // The hot instrumentation rate must be in the range [0, 1], inclusive.
+  double hot_instrumentation_rate() const { return hot_instrumentation_rate_; }
+  void set_hot_instrumentation_rate(double hot_instrumentation_rate);
+
+  // The number of threads decomposing and instrumenting the blocks. The
+  // output is the same for any number of threads.
+  size_t instrumentation_threads() const { return instrumentation_threads_; }
+  void set_instrumentation_threads(size_t instrumentation_threads) {
+    instrumentation_threads_ = instrumentation_threads;
+  }
+
+  // The report accounting for the probes injected in each function. There's
+  // no report by default.
+  InstrumentationReport* report() const { return report_; }
+  void set_report(InstrumentationReport* report) { report_ = report; }
+
   // Asan RTL parameters.
   const common::InflatedAsanParameters* asan_parameters() const {
     return asan_parameters_;
@@ -346,6 +531,21 @@ class AsanTransform
   bool ShouldSkipBlock(const TransformPolicyInterface* policy,
                        BlockGraph::Block* block);
 
+  // Configures @p transform from the flags of this transform.
+  // @param transform The basic block transform to configure.
+  void ConfigureBasicBlockTransform(AsanBasicBlockTransform* transform) const;
+
+  // Does the work of OnBlock for all the blocks of @p block_graph, on
+  // instrumentation_threads_ threads. The blocks are processed in batches of
+  // blocks that don't refer to each other: they are decomposed and
+  // instrumented concurrently, then merged back in the iteration order, so
+  // that the result is the same as the one of the serial iteration.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph The block graph being transformed.
+  // @returns true on success, false otherwise.
+  bool InstrumentBlocksInParallel(const TransformPolicyInterface* policy,
+                                  BlockGraph* block_graph);
+
   // @name PE-specific methods.
   // @{
   // Finds statically linked functions that need to be intercepted. Called in
@@ -398,6 +598,14 @@ class AsanTransform
   // memory checks added by this transform.
   bool remove_redundant_checks_;
 
+  // When activated, the checks of adjacent accesses through the same base
+  // register are replaced by range checks covering them.
+  bool coalesce_checks_;
+
+  // When activated, the checks of the accesses of the counted loops are
+  // replaced by range checks covering all of their iterations, ahead of them.
+  bool hoist_loop_checks_;
+
   // Set iff we should use the functions interceptors.
   bool use_interceptors_;
 
@@ -405,6 +613,19 @@ class AsanTransform
   // implemented using random sampling.
   double instrumentation_rate_;
 
+  // The number of threads decomposing and instrumenting the blocks.
+  size_t instrumentation_threads_;
+
+  // The report accounting for the probes injected in each function, if any.
+  InstrumentationReport* report_;
+
+  // The profile telling the hot basic blocks from the cold ones, the entry
+  // count from which a basic block is hot, and the rate at which the hot
+  // basic blocks are instrumented.
+  const AsanBasicBlockTransform::IndexedFrequencyInformation* profile_;
+  AsanBasicBlockTransform::EntryCountType hot_entry_count_;
+  double hot_instrumentation_rate_;
+
   // Asan RTL parameters that will be injected into the instrumented image.
   // These will be found by the RTL and used to control its behaviour. Allows
   // for setting parameters at instrumentation time that vary from the defaults.
@@ -440,6 +661,11 @@ class AsanTransform
   // metadata stream in the PostBlockGraphIteration.
   std::vector<BlockGraph::Block*> hot_patched_blocks_;
 
+  // The probes of every block are the same few sequences, decoded once
+  // through this cache. It's shared by the blocks instrumented in parallel.
+  mutable block_graph::BasicBlockAssembler::InstructionCache
+      instruction_cache_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanTransform);
 };
@@ -55,6 +55,7 @@ using block_graph::BasicBlockSubGraph;
 using block_graph::BlockGraph;
 using block_graph::Instruction;
 using block_graph::RelativeAddressFilter;
+using block_graph::Successor;
 using core::RelativeAddress;
 using testing::ContainerEq;
 typedef AsanBasicBlockTransform::MemoryAccessMode AsanMemoryAccessMode;
@@ -149,7 +150,7 @@ class AsanTransformTest : public testing::TestDllTransformTest {
 
   void InitHooksRefs() {
     // Initialize the read access hooks.
-    for (int access_size = 1; access_size <= 8; access_size *= 2) {
+    for (int access_size = 1; access_size <= 32; access_size *= 2) {
       std::string name =
           base::StringPrintf("asan_check_%d_byte_read_access", access_size);
       AddHookRef(name, AsanBasicBlockTransform::kReadAccess, access_size, 0,
@@ -159,7 +160,7 @@ class AsanTransformTest : public testing::TestDllTransformTest {
                  false);
     }
     // Initialize the write access hooks.
-    for (int access_size = 1; access_size <= 8; access_size *= 2) {
+    for (int access_size = 1; access_size <= 32; access_size *= 2) {
       std::string name =
           base::StringPrintf("asan_check_%d_byte_write_access", access_size);
       AddHookRef(name, AsanBasicBlockTransform::kWriteAccess, access_size, 0,
@@ -209,6 +210,53 @@ class AsanTransformTest : public testing::TestDllTransformTest {
                    opcode, true);
       }
     }
+
+    // Initialize the range check hooks.
+    AddHookRef("asan_check_range_read_access",
+               AsanBasicBlockTransform::kRangeReadAccess, 0, 0, true);
+    AddHookRef("asan_check_range_write_access",
+               AsanBasicBlockTransform::kRangeWriteAccess, 0, 0, true);
+  }
+
+  // Makes a counted loop out of @p loop, entered from @p basic_block_ and
+  // left to @p exit. The loop copies EDX dwords from ESI to EDI, stepping ECX
+  // by @p step.
+  void BuildCountedLoop(BasicCodeBlock* loop,
+                        BasicCodeBlock* exit,
+                        int step) {
+    bb_asm_->xor(assm::ecx, assm::ecx);
+    AddSuccessor(Successor::kConditionTrue, basic_block_, loop);
+
+    block_graph::BasicBlockAssembler loop_asm(loop->instructions().end(),
+                                              &loop->instructions());
+    loop_asm.mov(assm::eax, block_graph::Operand(assm::esi, assm::ecx,
+                                                 assm::kTimes4));
+    loop_asm.mov(block_graph::Operand(assm::edi, assm::ecx, assm::kTimes4),
+                 assm::eax);
+    loop_asm.add(assm::ecx, block_graph::Immediate(step, assm::kSize8Bit));
+    loop_asm.cmp(assm::ecx, assm::edx);
+    AddSuccessor(Successor::kConditionBelow, loop, loop);
+    AddSuccessor(Successor::kConditionAboveOrEqual, loop, exit);
+
+    block_graph::BasicBlockAssembler exit_asm(exit->instructions().end(),
+                                              &exit->instructions());
+    exit_asm.ret();
+
+    BasicBlockSubGraph::BasicBlockOrdering& order =
+        subgraph_.block_descriptions().front().basic_block_order;
+    order.push_back(loop);
+    order.push_back(exit);
+  }
+
+  // Adds a successor going from @p from to @p to under @p condition.
+  void AddSuccessor(Successor::Condition condition,
+                    BasicCodeBlock* from,
+                    BasicCodeBlock* to) {
+    from->successors().push_back(
+        Successor(condition,
+                  block_graph::BasicBlockReference(BlockGraph::PC_RELATIVE_REF,
+                                                   4, to),
+                  0));
   }
 
   bool AddInstructionFromBuffer(const uint8_t* data, size_t length) {
@@ -317,6 +365,36 @@ TEST_F(AsanTransformTest, SetInstrumentationRate) {
   EXPECT_EQ(0.5, bb_transform.instrumentation_rate());
 }
 
+TEST_F(AsanTransformTest, SetInstrumentationThreads) {
+  EXPECT_EQ(1u, asan_transform_.instrumentation_threads());
+  asan_transform_.set_instrumentation_threads(4);
+  EXPECT_EQ(4u, asan_transform_.instrumentation_threads());
+}
+
+TEST_F(AsanTransformTest, SetHotCodeProfile) {
+  AsanBasicBlockTransform::IndexedFrequencyInformation profile = {};
+  EXPECT_EQ(nullptr, asan_transform_.profile());
+  EXPECT_EQ(1, asan_transform_.hot_entry_count());
+  EXPECT_EQ(0.0, asan_transform_.hot_instrumentation_rate());
+  asan_transform_.set_profile(&profile);
+  asan_transform_.set_hot_entry_count(10);
+  asan_transform_.set_hot_instrumentation_rate(1.2);
+  EXPECT_EQ(&profile, asan_transform_.profile());
+  EXPECT_EQ(10, asan_transform_.hot_entry_count());
+  EXPECT_EQ(1.0, asan_transform_.hot_instrumentation_rate());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_EQ(nullptr, bb_transform.profile());
+  EXPECT_EQ(1, bb_transform.hot_entry_count());
+  EXPECT_EQ(0.0, bb_transform.hot_instrumentation_rate());
+  bb_transform.set_profile(&profile);
+  bb_transform.set_hot_entry_count(10);
+  bb_transform.set_hot_instrumentation_rate(-0.2);
+  EXPECT_EQ(&profile, bb_transform.profile());
+  EXPECT_EQ(10, bb_transform.hot_entry_count());
+  EXPECT_EQ(0.0, bb_transform.hot_instrumentation_rate());
+}
+
 TEST_F(AsanTransformTest, SetInterceptCRTFuntionsFlag) {
   EXPECT_FALSE(asan_transform_.use_interceptors());
   asan_transform_.set_use_interceptors(true);
@@ -340,6 +418,36 @@ TEST_F(AsanTransformTest, SetRemoveRedundantChecksFlag) {
   EXPECT_FALSE(bb_transform.remove_redundant_checks());
 }
 
+TEST_F(AsanTransformTest, SetCoalesceChecksFlag) {
+  EXPECT_FALSE(asan_transform_.coalesce_checks());
+  asan_transform_.set_coalesce_checks(true);
+  EXPECT_TRUE(asan_transform_.coalesce_checks());
+  asan_transform_.set_coalesce_checks(false);
+  EXPECT_FALSE(asan_transform_.coalesce_checks());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.coalesce_checks());
+  bb_transform.set_coalesce_checks(true);
+  EXPECT_TRUE(bb_transform.coalesce_checks());
+  bb_transform.set_coalesce_checks(false);
+  EXPECT_FALSE(bb_transform.coalesce_checks());
+}
+
+TEST_F(AsanTransformTest, SetHoistLoopChecksFlag) {
+  EXPECT_FALSE(asan_transform_.hoist_loop_checks());
+  asan_transform_.set_hoist_loop_checks(true);
+  EXPECT_TRUE(asan_transform_.hoist_loop_checks());
+  asan_transform_.set_hoist_loop_checks(false);
+  EXPECT_FALSE(asan_transform_.hoist_loop_checks());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.hoist_loop_checks());
+  bb_transform.set_hoist_loop_checks(true);
+  EXPECT_TRUE(bb_transform.hoist_loop_checks());
+  bb_transform.set_hoist_loop_checks(false);
+  EXPECT_FALSE(bb_transform.hoist_loop_checks());
+}
+
 TEST_F(AsanTransformTest, SetUseLivenessFlag) {
   EXPECT_FALSE(asan_transform_.use_liveness_analysis());
   asan_transform_.set_use_liveness_analysis(true);
@@ -363,6 +471,86 @@ TEST_F(AsanTransformTest, ApplyAsanTransformPE) {
       &asan_transform_, policy_, &block_graph_, header_block_));
 }
 
+TEST_F(AsanTransformTest, ApplyAsanTransformPEInParallel) {
+  // Instrument the test DLL serially.
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+  asan_transform_.use_interceptors_ = true;
+  asan_transform_.set_remove_redundant_checks(true);
+  InstrumentationReport serial_report;
+  asan_transform_.set_report(&serial_report);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+
+  // Instrument another decomposition of it on worker threads.
+  BlockGraph parallel_block_graph;
+  pe::ImageLayout layout(&parallel_block_graph);
+  pe::Decomposer decomposer(pe_file_);
+  ASSERT_TRUE(decomposer.Decompose(&layout));
+  BlockGraph::Block* parallel_header_block =
+      layout.blocks.GetBlockByAddress(RelativeAddress(0));
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), parallel_header_block);
+
+  pe::PETransformPolicy parallel_policy;
+  TestAsanTransform parallel_transform;
+  parallel_transform.use_interceptors_ = true;
+  parallel_transform.set_remove_redundant_checks(true);
+  parallel_transform.set_instrumentation_threads(4);
+  InstrumentationReport parallel_report;
+  parallel_transform.set_report(&parallel_report);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &parallel_transform, &parallel_policy, &parallel_block_graph,
+      parallel_header_block));
+
+  // Both reports must account for the same probes.
+  ASSERT_FALSE(serial_report.functions().empty());
+  ASSERT_EQ(serial_report.functions().size(),
+            parallel_report.functions().size());
+  InstrumentationReport::FunctionReport serial_totals =
+      serial_report.GetTotals();
+  InstrumentationReport::FunctionReport parallel_totals =
+      parallel_report.GetTotals();
+  for (size_t i = 0; i < InstrumentationReport::kProbeKindMax; ++i)
+    EXPECT_EQ(serial_totals.probes[i], parallel_totals.probes[i]);
+  EXPECT_EQ(serial_totals.elided_checks, parallel_totals.elided_checks);
+  EXPECT_EQ(serial_totals.extra_bytes, parallel_totals.extra_bytes);
+
+  // Both block graphs must be identical.
+  ASSERT_EQ(block_graph_.blocks().size(), parallel_block_graph.blocks().size());
+  BlockGraph::BlockMap::const_iterator serial_it =
+      block_graph_.blocks().begin();
+  BlockGraph::BlockMap::const_iterator parallel_it =
+      parallel_block_graph.blocks().begin();
+  for (; serial_it != block_graph_.blocks().end();
+       ++serial_it, ++parallel_it) {
+    const BlockGraph::Block& serial_block = serial_it->second;
+    const BlockGraph::Block& parallel_block = parallel_it->second;
+    ASSERT_EQ(serial_block.id(), parallel_block.id());
+    EXPECT_EQ(serial_block.name(), parallel_block.name());
+    EXPECT_EQ(serial_block.attributes(), parallel_block.attributes());
+    ASSERT_EQ(serial_block.data_size(), parallel_block.data_size());
+    if (serial_block.data_size() != 0) {
+      EXPECT_EQ(0, ::memcmp(serial_block.data(), parallel_block.data(),
+                            serial_block.data_size()));
+    }
+
+    ASSERT_EQ(serial_block.references().size(),
+              parallel_block.references().size());
+    BlockGraph::Block::ReferenceMap::const_iterator serial_ref =
+        serial_block.references().begin();
+    BlockGraph::Block::ReferenceMap::const_iterator parallel_ref =
+        parallel_block.references().begin();
+    for (; serial_ref != serial_block.references().end();
+         ++serial_ref, ++parallel_ref) {
+      EXPECT_EQ(serial_ref->first, parallel_ref->first);
+      EXPECT_EQ(serial_ref->second.type(), parallel_ref->second.type());
+      EXPECT_EQ(serial_ref->second.referenced()->id(),
+                parallel_ref->second.referenced()->id());
+      EXPECT_EQ(serial_ref->second.offset(), parallel_ref->second.offset());
+      EXPECT_EQ(serial_ref->second.base(), parallel_ref->second.base());
+    }
+  }
+}
+
 TEST_F(AsanTransformTest, ApplyAsanTransformCoff) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDllObj());
 
@@ -632,6 +820,203 @@ TEST_F(AsanTransformTest, InstrumentAndRemoveRedundantChecks) {
       BlockGraph::PE_IMAGE));
   EXPECT_TRUE(bb_transform.instrumentation_happened());
   ASSERT_EQ(basic_block_->instructions().size(), expected_instructions_count);
+
+  // The redundant write through ECX is accounted as an elided check.
+  const InstrumentationReport::FunctionReport& report = bb_transform.report();
+  EXPECT_EQ(instrumentable_instructions,
+            report.probes[InstrumentationReport::kAccessCheck] +
+                report.probes[InstrumentationReport::kAccessCheckSavingFlags]);
+  EXPECT_EQ(0u, report.probes[InstrumentationReport::kRangeCheck]);
+  EXPECT_EQ(1u, report.elided_checks);
+}
+
+TEST_F(AsanTransformTest, InstrumentAndCoalesceChecks) {
+  // Initialize a 16 byte structure out of order through ECX.
+  bb_asm_->mov(block_graph::Operand(assm::ecx, block_graph::Displacement(4)),
+               assm::eax);
+  bb_asm_->mov(block_graph::Operand(assm::ecx), assm::eax);
+  bb_asm_->mov(block_graph::Operand(assm::ecx, block_graph::Displacement(12)),
+               assm::eax);
+  bb_asm_->mov(block_graph::Operand(assm::ecx, block_graph::Displacement(8)),
+               assm::eax);
+  // A read doesn't join the writes.
+  bb_asm_->mov(assm::edx,
+               block_graph::Operand(assm::ecx, block_graph::Displacement(16)));
+  // ECX is redefined, these writes form another group that is too narrow to
+  // be coalesced.
+  bb_asm_->mov(assm::ecx, assm::ebx);
+  bb_asm_->mov(block_graph::Operand(assm::ecx), assm::eax);
+  bb_asm_->mov(block_graph::Operand(assm::ecx, block_graph::Displacement(4)),
+               assm::eax);
+  uint32_t original_instructions_count = basic_block_->instructions().size();
+
+  // Instrument this basic block.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_coalesce_checks(true);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_,
+      AsanBasicBlockTransform::kSafeStackAccess,
+      BlockGraph::PE_IMAGE));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // The first 4 writes share a single probe, the read and the last 2 writes
+  // get their own.
+  ASSERT_EQ(original_instructions_count + 3 * 4,
+            basic_block_->instructions().size());
+
+  // The range check comes in front of the first write and is given the
+  // address of the last byte of the structure.
+  BasicBlock::Instructions::const_iterator iter_inst =
+      basic_block_->instructions().begin();
+  ASSERT_EQ(I_PUSH, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(I_LEA, iter_inst->representation().opcode);
+  EXPECT_EQ(15u, iter_inst->representation().disp);
+  ++iter_inst;
+  ASSERT_EQ(1u, iter_inst->references().size());
+  HookMapEntryKey check_16_byte_write_key =
+      { AsanBasicBlockTransform::kWriteAccess, 16, 0, true };
+  EXPECT_EQ(hooks_check_access_[check_16_byte_write_key],
+            iter_inst->references().begin()->second.block());
+  ASSERT_EQ(I_CALL, (iter_inst++)->representation().opcode);
+  for (size_t i = 0; i < 4; ++i)
+    ASSERT_EQ(I_MOV, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(I_PUSH, iter_inst->representation().opcode);
+}
+
+TEST_F(AsanTransformTest, InstrumentAndHoistLoopChecks) {
+  BasicCodeBlock* loop = subgraph_.AddBasicCodeBlock("loop");
+  BasicCodeBlock* exit = subgraph_.AddBasicCodeBlock("exit");
+  BuildCountedLoop(loop, exit, 1);
+  size_t loop_instructions_count = loop->instructions().size();
+
+  // Instrument the subgraph.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_hoist_loop_checks(true);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // The loop is left untouched, its accesses are checked by a preheader laid
+  // out in front of it.
+  EXPECT_EQ(loop_instructions_count, loop->instructions().size());
+  const BasicBlockSubGraph::BasicBlockOrdering& order =
+      subgraph_.block_descriptions().front().basic_block_order;
+  ASSERT_EQ(4u, order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator iter_bb =
+      order.begin();
+  ASSERT_EQ(basic_block_, *(iter_bb++));
+  BasicCodeBlock* preheader = BasicCodeBlock::Cast(*(iter_bb++));
+  ASSERT_NE(static_cast<BasicCodeBlock*>(nullptr), preheader);
+  ASSERT_EQ(loop, *iter_bb);
+
+  ASSERT_EQ(1u, basic_block_->successors().size());
+  EXPECT_EQ(preheader,
+            basic_block_->successors().front().reference().basic_block());
+  ASSERT_EQ(1u, preheader->successors().size());
+  EXPECT_EQ(loop, preheader->successors().front().reference().basic_block());
+
+  // Each access gets a range check going from its first to its last
+  // iteration.
+  const AsanMemoryAccessMode kModes[] = {
+      AsanBasicBlockTransform::kRangeReadAccess,
+      AsanBasicBlockTransform::kRangeWriteAccess};
+  ASSERT_EQ(arraysize(kModes) * 8, preheader->instructions().size());
+  BasicBlock::Instructions::const_iterator iter_inst =
+      preheader->instructions().begin();
+  for (AsanMemoryAccessMode mode : kModes) {
+    ASSERT_EQ(I_PUSH, (iter_inst++)->representation().opcode);
+    ASSERT_EQ(I_PUSH, iter_inst->representation().opcode);
+    EXPECT_EQ(4u, iter_inst->representation().imm.dword);
+    ++iter_inst;
+    ASSERT_EQ(I_LEA, iter_inst->representation().opcode);
+    EXPECT_EQ(static_cast<uint32_t>(-4), iter_inst->representation().disp);
+    ++iter_inst;
+    ASSERT_EQ(I_PUSH, (iter_inst++)->representation().opcode);
+    ASSERT_EQ(I_LEA, iter_inst->representation().opcode);
+    EXPECT_EQ(0u, iter_inst->representation().disp);
+    ++iter_inst;
+    ASSERT_EQ(I_PUSH, (iter_inst++)->representation().opcode);
+    ASSERT_EQ(I_CALL, iter_inst->representation().opcode);
+    ASSERT_EQ(1u, iter_inst->references().size());
+    HookMapEntryKey key = { mode, 0, 0, true };
+    EXPECT_EQ(hooks_check_access_[key],
+              iter_inst->references().begin()->second.block());
+    ++iter_inst;
+    ASSERT_EQ(I_POP, (iter_inst++)->representation().opcode);
+  }
+}
+
+TEST_F(AsanTransformTest, NonUnitStepLoopChecksNotHoisted) {
+  BasicCodeBlock* loop = subgraph_.AddBasicCodeBlock("loop");
+  BasicCodeBlock* exit = subgraph_.AddBasicCodeBlock("exit");
+  BuildCountedLoop(loop, exit, 2);
+  size_t loop_instructions_count = loop->instructions().size();
+
+  // Instrument the subgraph.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_hoist_loop_checks(true);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // The accesses keep their probes and no preheader is added.
+  EXPECT_EQ(loop_instructions_count + 2 * 3, loop->instructions().size());
+  EXPECT_EQ(3u,
+            subgraph_.block_descriptions().front().basic_block_order.size());
+  ASSERT_EQ(1u, basic_block_->successors().size());
+  EXPECT_EQ(loop,
+            basic_block_->successors().front().reference().basic_block());
+}
+
+TEST_F(AsanTransformTest, HotBasicBlocksInstrumentedAtHotRate) {
+  // A basic block that was at address 0x1000 in the original image.
+  static const RelativeAddress kBasicBlockAddress(0x1000);
+  bb_asm_->set_source_range(
+      Instruction::SourceRange(kBasicBlockAddress, 2));
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ecx));
+  uint32_t original_instructions_count = basic_block_->instructions().size();
+
+  AsanBasicBlockTransform::IndexedFrequencyInformation profile = {};
+  profile.num_entries = 1;
+  profile.num_columns = 1;
+  profile.data_type = ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+  profile.frequency_size = 4;
+  profile.frequency_map[std::make_pair(kBasicBlockAddress, 0)] = 10;
+
+  // The basic block isn't hot enough, it's fully instrumented.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_profile(&profile);
+  bb_transform.set_hot_entry_count(11);
+  bb_transform.set_hot_instrumentation_rate(0.0);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_,
+      AsanBasicBlockTransform::kSafeStackAccess,
+      BlockGraph::PE_IMAGE));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+  EXPECT_EQ(original_instructions_count + 3,
+            basic_block_->instructions().size());
+
+  // The basic block is hot, it's left alone.
+  basic_block_->instructions().clear();
+  bb_asm_.reset(new block_graph::BasicBlockAssembler(
+      basic_block_->instructions().begin(), &basic_block_->instructions()));
+  bb_asm_->set_source_range(
+      Instruction::SourceRange(kBasicBlockAddress, 2));
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ecx));
+  TestAsanBasicBlockTransform hot_bb_transform(&hooks_check_access_ref_);
+  hot_bb_transform.set_profile(&profile);
+  hot_bb_transform.set_hot_entry_count(10);
+  hot_bb_transform.set_hot_instrumentation_rate(0.0);
+  ASSERT_TRUE(hot_bb_transform.InstrumentBasicBlock(
+      basic_block_,
+      AsanBasicBlockTransform::kSafeStackAccess,
+      BlockGraph::PE_IMAGE));
+  EXPECT_FALSE(hot_bb_transform.instrumentation_happened());
+  EXPECT_EQ(original_instructions_count, basic_block_->instructions().size());
 }
 
 TEST_F(AsanTransformTest, NonInstrumentableStackBasedInstructions) {
@@ -128,7 +128,8 @@ BasicBlockEntryHookTransform::BasicBlockEntryHookTransform()
     thunk_section_(NULL),
     instrument_dll_name_(kDefaultModuleName),
     set_src_ranges_for_thunks_(false),
-    set_inline_fast_path_(false) {
+    set_inline_fast_path_(false),
+    frequency_size_(sizeof(uint32_t)) {
 }
 
 bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
@@ -234,6 +235,7 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
 
     // Assemble entry hook instrumentation into the instruction stream.
     BasicBlockAssembler bb_asm(bb->instructions().begin(), &bb->instructions());
+    bb_asm.set_instruction_cache(&instruction_cache_);
 
     bb_asm.push(basic_block_id);
     bb_asm.push(module_data);
@@ -260,7 +262,7 @@ bool BasicBlockEntryHookTransform::PostBlockGraphIteration(
   }
 
   if (!add_frequency_data_.ConfigureFrequencyDataBuffer(num_basic_blocks, 1,
-                                                        sizeof(uint32_t))) {
+                                                        frequency_size_)) {
     LOG(ERROR) << "Failed to configure frequency data buffer.";
     return false;
   }
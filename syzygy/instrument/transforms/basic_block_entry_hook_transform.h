@@ -65,6 +65,18 @@ class BasicBlockEntryHookTransform
     instrument_dll_name_.assign(value.begin(), value.end());
   }
 
+  // @returns the size in bytes of the frequency counters.
+  uint8_t frequency_size() const { return frequency_size_; }
+
+  // Sets the size in bytes of the frequency counters, 4 by default. A size of
+  // 1 selects saturating 8-bit counters, a quarter of the memory at the cost
+  // of the precision of the counts over 255.
+  // @param frequency_size the size of the counters, 1 or 4.
+  void set_frequency_size(uint8_t frequency_size) {
+    DCHECK(frequency_size == 1 || frequency_size == 4);
+    frequency_size_ = frequency_size;
+  }
+
   // Set a flag denoting whether or not src ranges should be created for the
   // thunks to the module entry hooks.
   void set_src_ranges_for_thunks(bool value) {
@@ -179,6 +191,13 @@ class BasicBlockEntryHookTransform
   // falling back to the hook in the agent.
   bool set_inline_fast_path_;
 
+  // The size in bytes of the frequency counters.
+  uint8_t frequency_size_;
+
+  // The hook calls differ only by their basic block ID, and are decoded
+  // through this cache.
+  block_graph::BasicBlockAssembler::InstructionCache instruction_cache_;
+
   // The name of this transform.
   static const char kTransformName[];
 
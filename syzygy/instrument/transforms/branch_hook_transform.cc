@@ -159,7 +159,8 @@ BranchHookTransform::BranchHookTransform()
     thunk_section_(NULL),
     instrument_dll_name_(kDefaultModuleName),
     buffering_(false),
-    fs_slot_(0U) {
+    fs_slot_(0U),
+    frequency_size_(sizeof(uint32_t)) {
 }
 
 bool BranchHookTransform::PreBlockGraphIteration(
@@ -335,7 +336,7 @@ bool BranchHookTransform::PostBlockGraphIteration(
   }
 
   if (!add_frequency_data_.ConfigureFrequencyDataBuffer(num_basic_blocks, 3,
-                                                        sizeof(uint32_t))) {
+                                                        frequency_size_)) {
     LOG(ERROR) << "Failed to configure frequency data buffer.";
     return false;
   }
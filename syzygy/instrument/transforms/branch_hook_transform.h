@@ -71,6 +71,18 @@ class BranchHookTransform
   void set_fs_slot(uint32_t slot) { fs_slot_ = slot; }
   // @}
 
+  // @returns the size in bytes of the frequency counters.
+  uint8_t frequency_size() const { return frequency_size_; }
+
+  // Sets the size in bytes of the frequency counters, 4 by default. A size of
+  // 1 selects saturating 8-bit counters, a quarter of the memory at the cost
+  // of the precision of the counts over 255.
+  // @param frequency_size the size of the counters, 1 or 4.
+  void set_frequency_size(uint8_t frequency_size) {
+    DCHECK(frequency_size == 1 || frequency_size == 4);
+    frequency_size_ = frequency_size;
+  }
+
  protected:
   friend NamedBlockGraphTransformImpl<BranchHookTransform>;
   friend IterativeTransformImpl<BranchHookTransform>;
@@ -130,6 +142,9 @@ class BranchHookTransform
   // standard API.
   uint32_t fs_slot_;
 
+  // The size in bytes of the frequency counters.
+  uint8_t frequency_size_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BranchHookTransform);
 };
@@ -251,6 +251,21 @@ TEST_F(BranchHookTransformTest, ApplyAgentInstrumentation) {
   ASSERT_NO_FATAL_FAILURE(CheckBasicBlockInstrumentation());
 }
 
+TEST_F(BranchHookTransformTest, ApplyWith8BitCounters) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  EXPECT_EQ(sizeof(uint32_t), tx_.frequency_size());
+  tx_.set_frequency_size(1);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx_, policy_, &block_graph_, header_block_));
+
+  block_graph::ConstTypedBlock<IndexedFrequencyData> frequency_data;
+  ASSERT_TRUE(frequency_data.Init(0, tx_.frequency_data_block()));
+  EXPECT_EQ(1U, frequency_data->frequency_size);
+  EXPECT_EQ(frequency_data->num_entries * frequency_data->num_columns,
+            tx_.frequency_data_buffer_block()->size());
+}
+
 TEST_F(BranchHookTransformTest, ApplyBufferedAgentInstrumentation) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -67,6 +67,16 @@ class CoverageInstrumentationTransform
   //      as its unique ID.
   const RelativeAddressRangeVector& bb_ranges() const { return bb_ranges_; }
 
+  // When enabled each basic block is prepended with a single store of its
+  // entry in the static frequency data buffer, rather than with a store
+  // through the frequency data pointer that the agent redirects. This saves a
+  // register and a load per basic block, and the agent picks up the static
+  // buffer when it is torn down. Defaults to false.
+  bool direct_probes() const { return direct_probes_; }
+  void set_direct_probes(bool direct_probes) {
+    direct_probes_ = direct_probes;
+  }
+
   // @}
 
   // @name Pass-throughs to EntryThunkTransform.
@@ -127,6 +137,9 @@ class CoverageInstrumentationTransform
   // Stores the RVAs in the original image for each instrumented basic block.
   RelativeAddressRangeVector bb_ranges_;
 
+  // Indicates if the basic blocks store directly to the static buffer.
+  bool direct_probes_;
+
   DISALLOW_COPY_AND_ASSIGN(CoverageInstrumentationTransform);
 };
 
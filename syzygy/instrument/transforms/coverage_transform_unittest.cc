@@ -16,6 +16,8 @@
 
 #include "syzygy/instrument/transforms/coverage_transform.h"
 
+#include <set>
+
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/transform.h"
 #include "syzygy/block_graph/typed_block.h"
@@ -65,5 +67,34 @@ TEST_F(CoverageInstrumentationTransformTest, Apply) {
       coverage_data.OffsetOf(coverage_data->frequency_data)));
 }
 
+TEST_F(CoverageInstrumentationTransformTest, ApplyDirectProbes) {
+  CoverageInstrumentationTransform tx;
+  EXPECT_FALSE(tx.direct_probes());
+  tx.set_direct_probes(true);
+  EXPECT_TRUE(tx.direct_probes());
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx, policy_, &block_graph_, header_block_));
+
+  BlockGraph::Block* buffer_block = tx.frequency_data_buffer_block();
+  EXPECT_EQ(tx.bb_ranges().size(), buffer_block->size());
+
+  // Each basic block refers directly to its own entry of the buffer.
+  std::set<BlockGraph::Offset> entries;
+  for (const auto& referrer : buffer_block->referrers()) {
+    if (referrer.first->type() != BlockGraph::CODE_BLOCK) {
+      EXPECT_EQ(tx.frequency_data_block(), referrer.first);
+      continue;
+    }
+    BlockGraph::Reference ref;
+    ASSERT_TRUE(referrer.first->GetReference(referrer.second, &ref));
+    EXPECT_EQ(BlockGraph::ABSOLUTE_REF, ref.type());
+    entries.insert(ref.offset());
+  }
+  EXPECT_EQ(tx.bb_ranges().size(), entries.size());
+  EXPECT_EQ(0, *entries.begin());
+  EXPECT_EQ(static_cast<BlockGraph::Offset>(tx.bb_ranges().size() - 1),
+            *entries.rbegin());
+}
+
 }  // namespace transforms
 }  // namespace instrument
@@ -0,0 +1,224 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/instrument/transforms/instrumentation_report.h"
+
+#include "base/logging.h"
+#include "base/files/file_util.h"
+
+namespace instrument {
+namespace transforms {
+
+namespace {
+
+// The names of the kinds of probes in the JSON output.
+const char* const kProbeKindNames[InstrumentationReport::kProbeKindMax] = {
+  "access_check",
+  "access_check_saving_flags",
+  "range_check",
+};
+
+const char kProbeCostsKey[] = "probe_costs";
+const char kTotalsKey[] = "totals";
+const char kFunctionsKey[] = "functions";
+const char kNameKey[] = "name";
+const char kAddressKey[] = "address";
+const char kProbesKey[] = "probes";
+const char kElidedChecksKey[] = "elided_checks";
+const char kExtraBytesKey[] = "extra_bytes";
+const char kEstimatedCyclesKey[] = "estimated_cycles";
+const char kExpectedCyclesKey[] = "expected_cycles";
+
+}  // namespace
+
+const double InstrumentationReport::kDefaultProbeCosts[] = {
+  10.0,  // kAccessCheck.
+  14.0,  // kAccessCheckSavingFlags.
+  30.0,  // kRangeCheck.
+};
+
+InstrumentationReport::FunctionReport::FunctionReport()
+    : elided_checks(0), extra_bytes(0) {
+  for (size_t i = 0; i < kProbeKindMax; ++i) {
+    probes[i] = 0;
+    executions[i] = 0.0;
+  }
+}
+
+void InstrumentationReport::FunctionReport::Add(const FunctionReport& other) {
+  for (size_t i = 0; i < kProbeKindMax; ++i) {
+    probes[i] += other.probes[i];
+    executions[i] += other.executions[i];
+  }
+  elided_checks += other.elided_checks;
+  extra_bytes += other.extra_bytes;
+}
+
+InstrumentationReport::InstrumentationReport() : profiled_(false) {
+  for (size_t i = 0; i < kProbeKindMax; ++i)
+    probe_costs_[i] = kDefaultProbeCosts[i];
+}
+
+double InstrumentationReport::probe_cost(ProbeKind kind) const {
+  DCHECK_GT(kProbeKindMax, kind);
+  return probe_costs_[kind];
+}
+
+void InstrumentationReport::set_probe_cost(ProbeKind kind, double cycles) {
+  DCHECK_GT(kProbeKindMax, kind);
+  DCHECK_LE(0.0, cycles);
+  probe_costs_[kind] = cycles;
+}
+
+void InstrumentationReport::AddFunctionReport(RelativeAddress address,
+                                              const FunctionReport& report) {
+  FunctionReportMap::iterator it = functions_.find(address);
+  if (it == functions_.end()) {
+    functions_.insert(std::make_pair(address, report));
+    return;
+  }
+  it->second.Add(report);
+}
+
+double InstrumentationReport::GetEstimatedCycles(
+    const FunctionReport& report) const {
+  double cycles = 0.0;
+  for (size_t i = 0; i < kProbeKindMax; ++i)
+    cycles += report.probes[i] * probe_costs_[i];
+  return cycles;
+}
+
+double InstrumentationReport::GetExpectedCycles(
+    const FunctionReport& report) const {
+  double cycles = 0.0;
+  for (size_t i = 0; i < kProbeKindMax; ++i)
+    cycles += report.executions[i] * probe_costs_[i];
+  return cycles;
+}
+
+InstrumentationReport::FunctionReport InstrumentationReport::GetTotals()
+    const {
+  FunctionReport totals;
+  for (const auto& function : functions_)
+    totals.Add(function.second);
+  return totals;
+}
+
+bool InstrumentationReport::SaveFunctionReport(
+    const FunctionReport& report,
+    core::JSONFileWriter* json) const {
+  DCHECK(json != NULL);
+  core::JSONFileWriter& j = *json;
+
+  if (!j.OutputKey(kProbesKey) || !j.OpenDict())
+    return false;
+  for (size_t i = 0; i < kProbeKindMax; ++i) {
+    if (!j.OutputKey(kProbeKindNames[i]) ||
+        !j.OutputInteger(static_cast<int>(report.probes[i]))) {
+      return false;
+    }
+  }
+  if (!j.CloseDict())
+    return false;
+
+  if (!j.OutputKey(kElidedChecksKey) ||
+      !j.OutputInteger(static_cast<int>(report.elided_checks)) ||
+      !j.OutputKey(kExtraBytesKey) ||
+      !j.OutputInteger(static_cast<int>(report.extra_bytes)) ||
+      !j.OutputKey(kEstimatedCyclesKey) ||
+      !j.OutputDouble(GetEstimatedCycles(report))) {
+    return false;
+  }
+
+  if (profiled_) {
+    if (!j.OutputKey(kExpectedCyclesKey) ||
+        !j.OutputDouble(GetExpectedCycles(report))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool InstrumentationReport::SaveToJSON(core::JSONFileWriter* json) const {
+  DCHECK(json != NULL);
+  core::JSONFileWriter& j = *json;
+
+  if (!j.OutputComment("This is a serialized InstrumentationReport.") ||
+      !j.OpenDict()) {
+    return false;
+  }
+
+  // Write the cost table.
+  if (!j.OutputComment("This is the estimated cost of each kind of probe,") ||
+      !j.OutputComment("in cycles.") ||
+      !j.OutputKey(kProbeCostsKey) ||
+      !j.OpenDict()) {
+    return false;
+  }
+  for (size_t i = 0; i < kProbeKindMax; ++i) {
+    if (!j.OutputKey(kProbeKindNames[i]) || !j.OutputDouble(probe_costs_[i]))
+      return false;
+  }
+  if (!j.CloseDict())
+    return false;
+
+  // Write the totals.
+  if (!j.OutputKey(kTotalsKey) ||
+      !j.OpenDict() ||
+      !SaveFunctionReport(GetTotals(), json) ||
+      !j.CloseDict()) {
+    return false;
+  }
+
+  // Write the functions.
+  if (!j.OutputKey(kFunctionsKey) || !j.OpenList())
+    return false;
+  for (const auto& function : functions_) {
+    if (!j.OpenDict() ||
+        !j.OutputKey(kNameKey) ||
+        !j.OutputString(function.second.name) ||
+        !j.OutputKey(kAddressKey) ||
+        !j.OutputHexUint32(function.first.value()) ||
+        !SaveFunctionReport(function.second, json) ||
+        !j.CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!j.CloseList() || !j.CloseDict())
+    return false;
+
+  return true;
+}
+
+bool InstrumentationReport::SaveToJSON(bool pretty_print,
+                                       const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for writing: " << path.value();
+    return false;
+  }
+
+  core::JSONFileWriter json_writer(file.get(), pretty_print);
+  if (!SaveToJSON(&json_writer)) {
+    LOG(ERROR) << "Unable to write instrumentation report: " << path.value();
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace transforms
+}  // namespace instrument
@@ -0,0 +1,135 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares InstrumentationReport, which accounts for the probes that an
+// instrumentation transform injects in each function of an image and
+// estimates their cost from a per-probe cost table. When the transform is
+// given a basic block entry count profile, the probes are also weighted by the
+// entry counts of their basic blocks, yielding the expected overhead of a run
+// like the profiled one. The report can be saved as JSON.
+
+#ifndef SYZYGY_INSTRUMENT_TRANSFORMS_INSTRUMENTATION_REPORT_H_
+#define SYZYGY_INSTRUMENT_TRANSFORMS_INSTRUMENTATION_REPORT_H_
+
+#include <map>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "syzygy/core/address.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace instrument {
+namespace transforms {
+
+class InstrumentationReport {
+ public:
+  typedef core::RelativeAddress RelativeAddress;
+
+  // The kinds of probes.
+  enum ProbeKind {
+    // A call to an access check hook.
+    kAccessCheck,
+    // A call to an access check hook that saves and restores the flags.
+    kAccessCheckSavingFlags,
+    // A call to a range check hook.
+    kRangeCheck,
+    kProbeKindMax,
+  };
+
+  // The default cost of each kind of probe, in cycles. These are rough
+  // estimates of the cost of the call, of the shadow memory lookup and of the
+  // saves of the registers and flags.
+  static const double kDefaultProbeCosts[kProbeKindMax];
+
+  // The accounting of the probes injected in a function.
+  struct FunctionReport {
+    FunctionReport();
+
+    // Adds the counts of @p other to this report.
+    // @param other The report to add.
+    void Add(const FunctionReport& other);
+
+    // The name of the function.
+    std::string name;
+    // The number of probes of each kind.
+    size_t probes[kProbeKindMax];
+    // The expected number of executions of the probes of each kind, from the
+    // entry counts of their basic blocks in the profile.
+    double executions[kProbeKindMax];
+    // The number of checks elided by the redundant memory access analysis.
+    size_t elided_checks;
+    // The number of bytes of instructions added to the function.
+    size_t extra_bytes;
+  };
+
+  typedef std::map<RelativeAddress, FunctionReport> FunctionReportMap;
+
+  InstrumentationReport();
+
+  // @name Accessors.
+  // @{
+  // The cost of the probes of kind @p kind, in cycles.
+  double probe_cost(ProbeKind kind) const;
+  void set_probe_cost(ProbeKind kind, double cycles);
+  // Indicates if the probe executions come from a profile, in which case the
+  // expected cycles are reported.
+  bool profiled() const { return profiled_; }
+  void set_profiled(bool profiled) { profiled_ = profiled; }
+  // The reports of the functions, by address in the original image.
+  const FunctionReportMap& functions() const { return functions_; }
+  // @}
+
+  // Accounts for the probes injected in a function. The counts of the
+  // successive reports of a same function are added up.
+  // @param address The address of the function in the original image.
+  // @param report The accounting of the probes of the function.
+  void AddFunctionReport(RelativeAddress address,
+                         const FunctionReport& report);
+
+  // @returns the estimated cost, in cycles, of executing each probe of
+  //     @p report once.
+  double GetEstimatedCycles(const FunctionReport& report) const;
+
+  // @returns the expected cost, in cycles, of the probe executions of
+  //     @p report.
+  double GetExpectedCycles(const FunctionReport& report) const;
+
+  // @returns the sum of the reports of all the functions.
+  FunctionReport GetTotals() const;
+
+  // Saves this report.
+  // @param json The JSON writer to be written to.
+  // @param pretty_print If true the file will be pretty-printed.
+  // @param path The path of the file to be written to.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool SaveToJSON(core::JSONFileWriter* json) const;
+  bool SaveToJSON(bool pretty_print, const base::FilePath& path) const;
+
+ private:
+  // Writes the accounting of @p report, as the members of a dictionary.
+  bool SaveFunctionReport(const FunctionReport& report,
+                          core::JSONFileWriter* json) const;
+
+  double probe_costs_[kProbeKindMax];
+  bool profiled_;
+  FunctionReportMap functions_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstrumentationReport);
+};
+
+}  // namespace transforms
+}  // namespace instrument
+
+#endif  // SYZYGY_INSTRUMENT_TRANSFORMS_INSTRUMENTATION_REPORT_H_
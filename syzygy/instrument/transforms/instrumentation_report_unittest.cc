@@ -0,0 +1,184 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/instrument/transforms/instrumentation_report.h"
+
+#include <memory>
+#include <string>
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "gtest/gtest.h"
+
+namespace instrument {
+namespace transforms {
+
+namespace {
+
+typedef InstrumentationReport::FunctionReport FunctionReport;
+typedef InstrumentationReport::RelativeAddress RelativeAddress;
+
+const RelativeAddress kFooAddress(0x1000);
+const RelativeAddress kBarAddress(0x2000);
+
+FunctionReport MakeFunctionReport(const char* name,
+                                  size_t access_checks,
+                                  size_t range_checks,
+                                  double entry_count) {
+  FunctionReport report;
+  report.name = name;
+  report.probes[InstrumentationReport::kAccessCheck] = access_checks;
+  report.probes[InstrumentationReport::kRangeCheck] = range_checks;
+  report.executions[InstrumentationReport::kAccessCheck] =
+      access_checks * entry_count;
+  report.executions[InstrumentationReport::kRangeCheck] =
+      range_checks * entry_count;
+  report.elided_checks = 1;
+  report.extra_bytes = 16;
+  return report;
+}
+
+}  // namespace
+
+TEST(InstrumentationReportTest, DefaultConstructor) {
+  InstrumentationReport report;
+  EXPECT_FALSE(report.profiled());
+  EXPECT_TRUE(report.functions().empty());
+  for (size_t i = 0; i < InstrumentationReport::kProbeKindMax; ++i) {
+    InstrumentationReport::ProbeKind kind =
+        static_cast<InstrumentationReport::ProbeKind>(i);
+    EXPECT_EQ(InstrumentationReport::kDefaultProbeCosts[i],
+              report.probe_cost(kind));
+  }
+
+  FunctionReport totals = report.GetTotals();
+  EXPECT_EQ(0u, totals.elided_checks);
+  EXPECT_EQ(0u, totals.extra_bytes);
+  EXPECT_EQ(0.0, report.GetEstimatedCycles(totals));
+  EXPECT_EQ(0.0, report.GetExpectedCycles(totals));
+}
+
+TEST(InstrumentationReportTest, AddFunctionReport) {
+  InstrumentationReport report;
+  report.AddFunctionReport(kFooAddress, MakeFunctionReport("foo", 2, 0, 1.0));
+  report.AddFunctionReport(kBarAddress, MakeFunctionReport("bar", 1, 1, 1.0));
+  report.AddFunctionReport(kFooAddress, MakeFunctionReport("foo", 3, 1, 1.0));
+
+  // The reports of a same function are added up.
+  ASSERT_EQ(2u, report.functions().size());
+  const FunctionReport& foo = report.functions().at(kFooAddress);
+  EXPECT_EQ("foo", foo.name);
+  EXPECT_EQ(5u, foo.probes[InstrumentationReport::kAccessCheck]);
+  EXPECT_EQ(1u, foo.probes[InstrumentationReport::kRangeCheck]);
+  EXPECT_EQ(2u, foo.elided_checks);
+  EXPECT_EQ(32u, foo.extra_bytes);
+
+  FunctionReport totals = report.GetTotals();
+  EXPECT_EQ(6u, totals.probes[InstrumentationReport::kAccessCheck]);
+  EXPECT_EQ(0u, totals.probes[InstrumentationReport::kAccessCheckSavingFlags]);
+  EXPECT_EQ(2u, totals.probes[InstrumentationReport::kRangeCheck]);
+  EXPECT_EQ(3u, totals.elided_checks);
+  EXPECT_EQ(48u, totals.extra_bytes);
+}
+
+TEST(InstrumentationReportTest, Cycles) {
+  InstrumentationReport report;
+  report.set_probe_cost(InstrumentationReport::kAccessCheck, 2.0);
+  report.set_probe_cost(InstrumentationReport::kRangeCheck, 5.0);
+  EXPECT_EQ(2.0, report.probe_cost(InstrumentationReport::kAccessCheck));
+  EXPECT_EQ(5.0, report.probe_cost(InstrumentationReport::kRangeCheck));
+
+  FunctionReport function = MakeFunctionReport("foo", 3, 2, 10.0);
+  EXPECT_EQ(3 * 2.0 + 2 * 5.0, report.GetEstimatedCycles(function));
+  EXPECT_EQ(30 * 2.0 + 20 * 5.0, report.GetExpectedCycles(function));
+}
+
+TEST(InstrumentationReportTest, SaveToJSON) {
+  InstrumentationReport report;
+  report.set_profiled(true);
+  report.AddFunctionReport(kFooAddress, MakeFunctionReport("foo", 2, 1, 4.0));
+  report.AddFunctionReport(kBarAddress, MakeFunctionReport("bar", 1, 0, 0.0));
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().AppendASCII("report.json");
+  ASSERT_TRUE(report.SaveToJSON(true, path));
+
+  std::string file_string;
+  ASSERT_TRUE(base::ReadFileToString(path, &file_string));
+  std::unique_ptr<base::Value> value(
+      base::JSONReader::Read(file_string).release());
+  ASSERT_TRUE(value.get() != NULL);
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+
+  double cost = 0.0;
+  EXPECT_TRUE(dict->GetDouble("probe_costs.range_check", &cost));
+  EXPECT_EQ(InstrumentationReport::kDefaultProbeCosts[
+                InstrumentationReport::kRangeCheck],
+            cost);
+
+  int count = 0;
+  EXPECT_TRUE(dict->GetInteger("totals.probes.access_check", &count));
+  EXPECT_EQ(3, count);
+  EXPECT_TRUE(dict->GetInteger("totals.elided_checks", &count));
+  EXPECT_EQ(2, count);
+  double cycles = 0.0;
+  EXPECT_TRUE(dict->GetDouble("totals.expected_cycles", &cycles));
+  EXPECT_EQ(report.GetExpectedCycles(report.GetTotals()), cycles);
+
+  // The functions are listed by address.
+  base::ListValue* functions = NULL;
+  ASSERT_TRUE(dict->GetList("functions", &functions));
+  ASSERT_EQ(2u, functions->GetSize());
+  base::DictionaryValue* function = NULL;
+  ASSERT_TRUE(functions->GetDictionary(0, &function));
+  std::string string;
+  EXPECT_TRUE(function->GetString("name", &string));
+  EXPECT_EQ("foo", string);
+  EXPECT_TRUE(function->GetString("address", &string));
+  EXPECT_EQ("0x00001000", string);
+  EXPECT_TRUE(function->GetInteger("probes.range_check", &count));
+  EXPECT_EQ(1, count);
+  EXPECT_TRUE(function->GetInteger("extra_bytes", &count));
+  EXPECT_EQ(16, count);
+}
+
+TEST(InstrumentationReportTest, SaveToJSONWithoutProfile) {
+  InstrumentationReport report;
+  report.AddFunctionReport(kFooAddress, MakeFunctionReport("foo", 2, 1, 0.0));
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().AppendASCII("report.json");
+  ASSERT_TRUE(report.SaveToJSON(false, path));
+
+  std::string file_string;
+  ASSERT_TRUE(base::ReadFileToString(path, &file_string));
+  std::unique_ptr<base::Value> value(
+      base::JSONReader::Read(file_string).release());
+  ASSERT_TRUE(value.get() != NULL);
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+
+  // The expected cycles are only reported for a profiled run.
+  double cycles = 0.0;
+  EXPECT_TRUE(dict->GetDouble("totals.estimated_cycles", &cycles));
+  EXPECT_FALSE(dict->GetDouble("totals.expected_cycles", &cycles));
+}
+
+}  // namespace transforms
+}  // namespace instrument
@@ -109,7 +109,8 @@ JumpTableCaseCountTransform::JumpTableCaseCountTransform()
                           common::IndexedFrequencyData::JUMP_TABLE,
                           sizeof(common::IndexedFrequencyData)),
       instrument_dll_name_(kDefaultModuleName),
-      jump_table_case_count_(0) {
+      jump_table_case_count_(0),
+      frequency_size_(sizeof(uint32_t)) {
 }
 
 bool JumpTableCaseCountTransform::PreBlockGraphIteration(
@@ -212,7 +213,7 @@ bool JumpTableCaseCountTransform::PostBlockGraphIteration(
   }
 
   if (!add_frequency_data_.ConfigureFrequencyDataBuffer(jump_table_case_count_,
-                                                        1, sizeof(uint32_t))) {
+                                                        1, frequency_size_)) {
     LOG(ERROR) << "Failed to configure frequency data buffer.";
     return false;
   }
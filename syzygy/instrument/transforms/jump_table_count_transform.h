@@ -46,6 +46,18 @@ class JumpTableCaseCountTransform
   // module and function names.
   JumpTableCaseCountTransform();
 
+  // @returns the size in bytes of the frequency counters.
+  uint8_t frequency_size() const { return frequency_size_; }
+
+  // Sets the size in bytes of the frequency counters, 4 by default. A size of
+  // 1 selects saturating 8-bit counters, a quarter of the memory at the cost
+  // of the precision of the counts over 255.
+  // @param frequency_size the size of the counters, 1 or 4.
+  void set_frequency_size(uint8_t frequency_size) {
+    DCHECK(frequency_size == 1 || frequency_size == 4);
+    frequency_size_ = frequency_size;
+  }
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
@@ -109,6 +121,9 @@ class JumpTableCaseCountTransform
   // The counter used to get a unique ID for each case in a jump table.
   size_t jump_table_case_count_;
 
+  // The size in bytes of the frequency counters.
+  uint8_t frequency_size_;
+
   // The different jump tables encountered; we store their addresses and sizes.
   JumpTableVector jump_table_infos_;
 
@@ -0,0 +1,395 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A benchmark of the cost of the Asan instrumentation. It instruments
+// integration_tests_dll with each of a set of combinations of the
+// instrumentation and runtime features, then runs each of the benchmark
+// kernels of the DLL against each instrumented copy and against the
+// uninstrumented DLL. It reports the time and the peak working set of each
+// run as JSON, along with the slowdown and the memory overhead relative to
+// the uninstrumented DLL:
+//
+//   {
+//     "iterations": 5,
+//     "configurations": [
+//       {
+//         "name": "asan",
+//         "kernels": [
+//           {
+//             "name": "allocations",
+//             "time_ms": 123.4,
+//             "peak_working_set_bytes": 12345678,
+//             "slowdown": 2.5,
+//             "memory_overhead": 3.1
+//           },
+//           ...
+//         ]
+//       },
+//       ...
+//     ]
+//   }
+//
+// Each kernel runs in a process of its own, so that the runtime of one
+// configuration doesn't affect another, and so that the peak working set is
+// that of the kernel. The time of a kernel is the fastest of its iterations,
+// which is the least noisy.
+
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+#include <stdio.h>
+#include <algorithm>
+
+#include "base/command_line.h"
+#include "base/logging.h"
+#include "base/path_service.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/process/launch.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "syzygy/application/application.h"
+#include "syzygy/common/asan_parameters.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/core/json_file_writer.h"
+#include "syzygy/instrument/instrument_app.h"
+#include "syzygy/integration_tests/integration_tests_dll.h"
+
+namespace {
+
+typedef unsigned int (__stdcall* EndToEndTestFunction)(unsigned int);
+
+const char kUsage[] =
+    "Usage: asan_benchmark [options]\n"
+    "\n"
+    "  Measures the slowdown and the memory overhead of the Asan\n"
+    "  instrumentation of integration_tests_dll.dll, with each combination\n"
+    "  of the instrumentation and runtime features, and writes them as JSON.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --iterations=NUM     The number of times each kernel is run.\n"
+    "                       Defaults to 5.\n"
+    "  --output=PATH        The path to which the JSON output should be\n"
+    "                       written. Defaults to the standard output.\n"
+    "  --work-dir=DIR       The directory to which the instrumented DLLs are\n"
+    "                       written. Defaults to a temporary directory.\n";
+
+// The switches of a kernel run, in the process of its own.
+const char kRunKernelSwitch[] = "run-kernel";
+const char kDllSwitch[] = "dll";
+const char kIterationsSwitch[] = "iterations";
+
+const size_t kDefaultIterations = 5;
+
+struct Kernel {
+  const char* name;
+  testing::EndToEndTestId id;
+};
+
+const Kernel kKernels[] = {
+    {"allocations", testing::kBenchmarkAllocations},
+    {"strings", testing::kBenchmarkStrings},
+    {"memory_streaming", testing::kBenchmarkMemoryStreaming},
+    {"threads", testing::kBenchmarkThreads},
+};
+
+// A combination of features with which the DLL is instrumented.
+struct Configuration {
+  // The name of the configuration.
+  const char* name;
+  // A switch of the instrumenter, or NULL.
+  const char* instrument_switch;
+  // The options baked into the image for the runtime, or NULL.
+  const char* rtl_options;
+};
+
+// The uninstrumented DLL, against which the others are compared.
+const char kBaselineName[] = "uninstrumented";
+
+// The default features, then each feature toggled on its own.
+const Configuration kConfigurations[] = {
+    {"asan", NULL, NULL},
+    {"no_liveness_analysis", "no-liveness-analysis", NULL},
+    {"no_redundancy_analysis", "no-redundancy-analysis", NULL},
+    {"no_interceptors", "no-interceptors", NULL},
+    {"coalesce_checks", "coalesce-checks", NULL},
+    {"hoist_loop_checks", "hoist-loop-checks", NULL},
+    {"zebra_block_heap", NULL, "--enable_zebra_block_heap"},
+    {"no_large_block_heap", NULL, "--disable_large_block_heap"},
+    {"thread_local_magazines", NULL, "--thread_local_magazines"},
+    {"size_class_block_heap", NULL, "--size_class_block_heap"},
+    {"compact_stack_captures", NULL, "--compact_stack_captures"},
+    {"lazy_shadow_commit", NULL, "--lazy_shadow_commit"},
+    {"no_quarantine", NULL, "--quarantine_size=0"},
+};
+
+// The result of a kernel run.
+struct KernelResult {
+  KernelResult() : peak_working_set(0) { }
+
+  base::TimeDelta time;
+  size_t peak_working_set;
+};
+
+// Runs a kernel in the current process, and writes its result to the
+// standard output. Returns the exit code of the process.
+int RunKernel(const base::FilePath& dll, size_t kernel, size_t iterations) {
+  HMODULE module = ::LoadLibrary(dll.value().c_str());
+  if (module == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "LoadLibrary failed: " << common::LogWe(error);
+    return 1;
+  }
+  EndToEndTestFunction func = reinterpret_cast<EndToEndTestFunction>(
+      ::GetProcAddress(module, "EndToEndTest"));
+  if (func == NULL) {
+    LOG(ERROR) << "Failed to find EndToEndTest function.";
+    return 1;
+  }
+
+  // The first run warms up the heaps and the shadow memory.
+  unsigned int checksum = func(kKernels[kernel].id);
+  base::TimeDelta fastest = base::TimeDelta::Max();
+  for (size_t i = 0; i < iterations; ++i) {
+    base::TimeTicks start = base::TimeTicks::Now();
+    if (func(kKernels[kernel].id) != checksum) {
+      LOG(ERROR) << "Kernel " << kKernels[kernel].name
+                 << " returned an inconsistent result.";
+      return 1;
+    }
+    fastest = std::min(fastest, base::TimeTicks::Now() - start);
+  }
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessMemoryInfo failed: " << common::LogWe(error);
+    return 1;
+  }
+
+  ::printf("%f %Iu\n", fastest.InMillisecondsF(), counters.PeakWorkingSetSize);
+  return 0;
+}
+
+// Runs a kernel in a process of its own.
+bool LaunchKernel(const base::FilePath& dll, size_t kernel, size_t iterations,
+                  KernelResult* result) {
+  DCHECK_NE(static_cast<KernelResult*>(NULL), result);
+
+  base::CommandLine cmd_line(
+      base::CommandLine::ForCurrentProcess()->GetProgram());
+  cmd_line.AppendSwitchPath(kDllSwitch, dll);
+  cmd_line.AppendSwitchASCII(kRunKernelSwitch, base::SizeTToString(kernel));
+  cmd_line.AppendSwitchASCII(kIterationsSwitch,
+                             base::SizeTToString(iterations));
+
+  std::string output;
+  double time_ms = 0;
+  if (!base::GetAppOutput(cmd_line, &output) ||
+      ::sscanf(output.c_str(), "%lf %Iu", &time_ms,
+               &result->peak_working_set) != 2) {
+    LOG(ERROR) << "Failed to run kernel " << kKernels[kernel].name
+               << " against \"" << dll.value() << "\".";
+    return false;
+  }
+  result->time = base::TimeDelta::FromMicroseconds(
+      static_cast<int64_t>(time_ms * base::Time::kMicrosecondsPerMillisecond));
+  return true;
+}
+
+// Instruments the DLL with a configuration.
+bool InstrumentDll(const base::FilePath& input_dll,
+                   const Configuration& configuration,
+                   const base::FilePath& output_dll) {
+  base::CommandLine cmd_line(base::FilePath(L"instrument.exe"));
+  cmd_line.AppendSwitchASCII("mode", "asan");
+  cmd_line.AppendSwitchPath("input-image", input_dll);
+  cmd_line.AppendSwitchPath("output-image", output_dll);
+  cmd_line.AppendSwitch("overwrite");
+  if (configuration.instrument_switch != NULL)
+    cmd_line.AppendSwitch(configuration.instrument_switch);
+  if (configuration.rtl_options != NULL) {
+    cmd_line.AppendSwitchASCII(common::kAsanRtlOptions,
+                               configuration.rtl_options);
+  }
+
+  application::Application<instrument::InstrumentApp> app;
+  app.set_command_line(&cmd_line);
+  app.set_out(stderr);
+  if (app.Run() != 0) {
+    LOG(ERROR) << "Failed to instrument with " << configuration.name << ".";
+    return false;
+  }
+  return true;
+}
+
+bool WriteKernelResult(const char* name,
+                       const KernelResult& result,
+                       const KernelResult& baseline,
+                       core::JSONFileWriter* json_file) {
+  DCHECK_NE(static_cast<core::JSONFileWriter*>(NULL), json_file);
+
+  // The sizes are written as doubles, as they may not fit in an int.
+  double peak_working_set = static_cast<double>(result.peak_working_set);
+  double slowdown = result.time.InMillisecondsF() /
+                    std::max(baseline.time.InMillisecondsF(), 1e-3);
+  double memory_overhead =
+      peak_working_set /
+      std::max(static_cast<double>(baseline.peak_working_set), 1.0);
+  return json_file->OpenDict() &&
+         json_file->OutputKey("name") &&
+         json_file->OutputString(name) &&
+         json_file->OutputKey("time_ms") &&
+         json_file->OutputDouble(result.time.InMillisecondsF()) &&
+         json_file->OutputKey("peak_working_set_bytes") &&
+         json_file->OutputDouble(peak_working_set) &&
+         json_file->OutputKey("slowdown") &&
+         json_file->OutputDouble(slowdown) &&
+         json_file->OutputKey("memory_overhead") &&
+         json_file->OutputDouble(memory_overhead) &&
+         json_file->CloseDict();
+}
+
+// Runs all the kernels against a DLL, and writes their results.
+bool BenchmarkDll(const char* name,
+                  const base::FilePath& dll,
+                  size_t iterations,
+                  const KernelResult* baseline,
+                  KernelResult* results,
+                  core::JSONFileWriter* json_file) {
+  DCHECK_NE(static_cast<KernelResult*>(NULL), baseline);
+  DCHECK_NE(static_cast<KernelResult*>(NULL), results);
+
+  LOG(INFO) << "Benchmarking " << name << ".";
+  if (!json_file->OpenDict() || !json_file->OutputKey("name") ||
+      !json_file->OutputString(name) || !json_file->OutputKey("kernels") ||
+      !json_file->OpenList()) {
+    return false;
+  }
+  for (size_t i = 0; i < arraysize(kKernels); ++i) {
+    if (!LaunchKernel(dll, i, iterations, &results[i]) ||
+        !WriteKernelResult(kKernels[i].name, results[i], baseline[i],
+                           json_file)) {
+      return false;
+    }
+  }
+  return json_file->CloseList() && json_file->CloseDict();
+}
+
+int RunBenchmark(const base::CommandLine* cmd_line, size_t iterations) {
+  base::FilePath exe_dir;
+  if (!PathService::Get(base::DIR_EXE, &exe_dir))
+    return 1;
+  base::FilePath input_dll = exe_dir.Append(L"integration_tests_dll.dll");
+
+  base::ScopedTempDir temp_dir;
+  base::FilePath work_dir = cmd_line->GetSwitchValuePath("work-dir");
+  if (work_dir.empty()) {
+    if (!temp_dir.CreateUniqueTempDir())
+      return 1;
+    work_dir = temp_dir.path();
+  }
+
+  base::ScopedFILE output_file;
+  FILE* output = stdout;
+  base::FilePath output_path = cmd_line->GetSwitchValuePath("output");
+  if (!output_path.empty()) {
+    output_file.reset(base::OpenFile(output_path, "wb"));
+    if (output_file.get() == NULL) {
+      LOG(ERROR) << "Unable to open \"" << output_path.value() << "\".";
+      return 1;
+    }
+    output = output_file.get();
+  }
+
+  core::JSONFileWriter json_file(output, true);
+  if (!json_file.OpenDict() || !json_file.OutputKey("iterations") ||
+      !json_file.OutputInteger(static_cast<int>(iterations)) ||
+      !json_file.OutputKey("configurations") || !json_file.OpenList()) {
+    return 1;
+  }
+
+  // The baseline is compared with itself, so that its slowdown and overhead
+  // are both 1.
+  KernelResult baseline[arraysize(kKernels)];
+  KernelResult results[arraysize(kKernels)];
+  if (!BenchmarkDll(kBaselineName, input_dll, iterations, baseline, baseline,
+                    &json_file)) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < arraysize(kConfigurations); ++i) {
+    const Configuration& configuration = kConfigurations[i];
+    base::FilePath dll_dir = work_dir.AppendASCII(configuration.name);
+    base::FilePath dll = dll_dir.Append(input_dll.BaseName());
+    if (!base::CreateDirectory(dll_dir) ||
+        !InstrumentDll(input_dll, configuration, dll) ||
+        !BenchmarkDll(configuration.name, dll, iterations, baseline, results,
+                      &json_file)) {
+      return 1;
+    }
+  }
+
+  if (!json_file.CloseList() || !json_file.CloseDict() || !json_file.Flush()) {
+    LOG(ERROR) << "Failed to write the results.";
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::CommandLine::Init(argc, argv);
+  base::CommandLine* cmd_line = base::CommandLine::ForCurrentProcess();
+
+  // Log to the debugger, as the standard output carries the results.
+  logging::LoggingSettings settings;
+  settings.logging_dest = logging::LOG_TO_SYSTEM_DEBUG_LOG;
+  logging::InitLogging(settings);
+  if (!cmd_line->HasSwitch("verbose"))
+    logging::SetMinLogLevel(logging::LOG_ERROR);
+
+  if (cmd_line->HasSwitch("help")) {
+    ::fprintf(stderr, "%s", kUsage);
+    return 1;
+  }
+
+  size_t iterations = kDefaultIterations;
+  if (cmd_line->HasSwitch(kIterationsSwitch) &&
+      (!base::StringToSizeT(cmd_line->GetSwitchValueASCII(kIterationsSwitch),
+                            &iterations) ||
+       iterations == 0)) {
+    ::fprintf(stderr, "%s", kUsage);
+    return 1;
+  }
+
+  // Prevent dialog boxes from popping up.
+  ::SetErrorMode(SEM_FAILCRITICALERRORS);
+
+  if (cmd_line->HasSwitch(kRunKernelSwitch)) {
+    size_t kernel = 0;
+    if (!base::StringToSizeT(cmd_line->GetSwitchValueASCII(kRunKernelSwitch),
+                             &kernel) ||
+        kernel >= arraysize(kKernels)) {
+      LOG(ERROR) << "Invalid kernel.";
+      return 1;
+    }
+    return RunKernel(cmd_line->GetSwitchValuePath(kDllSwitch), kernel,
+                     iterations);
+  }
+
+  return RunBenchmark(cmd_line, iterations);
+}
@@ -0,0 +1,155 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/integration_tests/benchmark_tests.h"
+
+#include <windows.h>  // NOLINT
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace testing {
+
+namespace {
+
+// A linear congruential generator, so that the kernels do the same work in
+// each run.
+uint32_t NextRandom(uint32_t* state) {
+  *state = *state * 1103515245 + 12345;
+  return *state >> 8;
+}
+
+unsigned int AllocationKernel(uint32_t seed, size_t num_allocations) {
+  const size_t kNumLiveBlocks = 256;
+  const size_t kMaxBlockSize = 4096;
+  char* blocks[kNumLiveBlocks] = {};
+
+  unsigned int checksum = 0;
+  for (size_t i = 0; i < num_allocations; ++i) {
+    size_t slot = i % kNumLiveBlocks;
+    if (blocks[slot] != NULL) {
+      checksum += blocks[slot][0];
+      delete[] blocks[slot];
+    }
+    size_t size = 1 + NextRandom(&seed) % kMaxBlockSize;
+    blocks[slot] = new char[size];
+    blocks[slot][0] = static_cast<char>(i);
+    blocks[slot][size - 1] = static_cast<char>(size);
+  }
+
+  for (size_t i = 0; i < kNumLiveBlocks; ++i)
+    delete[] blocks[i];
+  return checksum;
+}
+
+DWORD WINAPI ThreadKernel(LPVOID param) {
+  uint32_t seed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(param));
+  unsigned int checksum = AllocationKernel(seed, 50000);
+
+  const size_t kBufferLength = 16 * 1024;
+  uint32_t* buffer = new uint32_t[kBufferLength];
+  for (size_t i = 0; i < kBufferLength; ++i)
+    buffer[i] = NextRandom(&seed);
+  for (size_t i = 1; i < kBufferLength; ++i)
+    checksum += buffer[i] ^ buffer[i - 1];
+  delete[] buffer;
+
+  return checksum;
+}
+
+}  // namespace
+
+unsigned int BenchmarkAllocations() {
+  return AllocationKernel(42, 200000);
+}
+
+unsigned int BenchmarkStrings() {
+  const size_t kNumStrings = 64;
+  const size_t kMaxStringLength = 256;
+  char* strings[kNumStrings] = {};
+  uint32_t seed = 42;
+  for (size_t i = 0; i < kNumStrings; ++i) {
+    size_t length = 1 + NextRandom(&seed) % kMaxStringLength;
+    strings[i] = new char[length + 1];
+    for (size_t j = 0; j < length; ++j)
+      strings[i][j] = 'a' + NextRandom(&seed) % 26;
+    strings[i][length] = 0;
+  }
+
+  char buffer[kMaxStringLength + 1] = {};
+  unsigned int checksum = 0;
+  for (size_t pass = 0; pass < 2000; ++pass) {
+    for (size_t i = 0; i < kNumStrings; ++i) {
+      const char* string = strings[i];
+      const char* other = strings[(i + pass) % kNumStrings];
+      size_t length = ::strlen(string);
+      ::memcpy(buffer, string, length + 1);
+      checksum += ::strcmp(buffer, other) > 0;
+      checksum += ::strspn(buffer, "abcde");
+      checksum += ::strcspn(buffer, "xyz");
+      checksum += ::strrchr(buffer, 'q') != NULL;
+      checksum += ::strstr(buffer, "ab") != NULL;
+      checksum += ::memchr(buffer, 'e', length) != NULL;
+      ::memset(buffer, 0, length);
+    }
+  }
+
+  for (size_t i = 0; i < kNumStrings; ++i)
+    delete[] strings[i];
+  return checksum;
+}
+
+unsigned int BenchmarkMemoryStreaming() {
+  const size_t kBufferLength = 4 * 1024 * 1024;
+  uint32_t* source = new uint32_t[kBufferLength];
+  uint32_t* destination = new uint32_t[kBufferLength];
+  for (size_t i = 0; i < kBufferLength; ++i)
+    source[i] = i;
+
+  unsigned int checksum = 0;
+  for (size_t pass = 0; pass < 8; ++pass) {
+    for (size_t i = 0; i < kBufferLength; ++i)
+      destination[i] = source[i] * 3 + pass;
+    for (size_t i = 0; i < kBufferLength; ++i)
+      checksum += destination[i];
+    ::memcpy(source, destination, kBufferLength * sizeof(source[0]));
+  }
+
+  delete[] source;
+  delete[] destination;
+  return checksum;
+}
+
+unsigned int BenchmarkThreads() {
+  const size_t kNumThreads = 4;
+  HANDLE threads[kNumThreads] = {};
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    threads[i] = ::CreateThread(NULL, 0, &ThreadKernel,
+                                reinterpret_cast<LPVOID>(i + 1), 0, NULL);
+    if (threads[i] == NULL)
+      return 0;
+  }
+  ::WaitForMultipleObjects(kNumThreads, threads, TRUE, INFINITE);
+
+  unsigned int checksum = 0;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    DWORD exit_code = 0;
+    ::GetExitCodeThread(threads[i], &exit_code);
+    checksum += exit_code;
+    ::CloseHandle(threads[i]);
+  }
+  return checksum;
+}
+
+}  // namespace testing
@@ -0,0 +1,41 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the kernels used by asan_benchmark to measure the cost
+// of the Asan instrumentation. Each kernel stresses a different part of the
+// instrumentation and of the runtime, and returns a checksum of its work so
+// that it can't be optimized away.
+#ifndef SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
+#define SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
+
+namespace testing {
+
+// Allocates and frees many blocks of various sizes, exercising the heaps and
+// the quarantine.
+unsigned int BenchmarkAllocations();
+
+// Calls the intercepted string and memory functions on short strings.
+unsigned int BenchmarkStrings();
+
+// Reads and writes a large buffer sequentially, exercising the checks of the
+// memory accesses.
+unsigned int BenchmarkMemoryStreaming();
+
+// Allocates and computes on several threads at once, exercising the locks of
+// the runtime.
+unsigned int BenchmarkThreads();
+
+}  // namespace testing
+
+#endif  // SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
@@ -29,6 +29,8 @@
         'asan_page_protection_tests.h',
         'bb_entry_tests.h',
         'bb_entry_tests.cc',
+        'benchmark_tests.h',
+        'benchmark_tests.cc',
         'behavior_tests.h',
         'behavior_tests.cc',
         'coverage_tests.h',
@@ -221,6 +223,36 @@
         },
       },
     },
+    {
+      'target_name': 'asan_benchmark',
+      'type': 'executable',
+      'sources': [
+        'asan_benchmark.cc',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/agent/asan/asan.gyp:syzyasan_rtl',
+        '<(src)/syzygy/application/application.gyp:application_lib',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/instrument/instrument.gyp:instrument_lib',
+      ],
+      'conditions': [
+        ['target_arch == "ia32"', {
+          'dependencies': [
+            'integration_tests_dll',
+          ],
+        },
+        ],
+      ],
+      'msvs_settings': {
+        'VCLinkerTool': {
+          # The benchmarked DLLs are built for the Asan agent, which doesn't
+          # support large address spaces. See integration_tests_dll.
+          'LargeAddressAware': 1,
+        },
+      },
+    },
     {
       'target_name': 'integration_tests_harness',
       'type': 'executable',
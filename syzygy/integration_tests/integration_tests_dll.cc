@@ -22,6 +22,7 @@
 #include "syzygy/integration_tests/asan_page_protection_tests.h"
 #ifndef __clang__
 #include "syzygy/integration_tests/bb_entry_tests.h"
+#include "syzygy/integration_tests/benchmark_tests.h"
 #include "syzygy/integration_tests/behavior_tests.h"
 #include "syzygy/integration_tests/coverage_tests.h"
 #include "syzygy/integration_tests/profile_tests.h"
@@ -189,7 +189,11 @@ namespace testing {
     decl(kCoverage2, testing::coverage_func2)  \
     decl(kCoverage3, testing::coverage_func3)  \
     decl(kProfileCallExport, testing::CallExportedFunction)  \
-    decl(kProfileGetMyRVA, testing::GetMyRVA)
+    decl(kProfileGetMyRVA, testing::GetMyRVA)  \
+    decl(kBenchmarkAllocations, testing::BenchmarkAllocations)  \
+    decl(kBenchmarkStrings, testing::BenchmarkStrings)  \
+    decl(kBenchmarkMemoryStreaming, testing::BenchmarkMemoryStreaming)  \
+    decl(kBenchmarkThreads, testing::BenchmarkThreads)
 
 // Only run the Asan tests for the Clang builds.
 // The order of inclusion matters because it affects the IDs assigned to
@@ -0,0 +1,174 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/kasko/capture_queue.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "base/logging.h"
+#include "base/synchronization/waitable_event.h"
+
+namespace kasko {
+
+// A queued capture. It deletes itself once it has run, as its completion may
+// outlive the wait of its requester.
+class CaptureQueue::Task : public base::DelegateSimpleThread::Delegate {
+ public:
+  Task(CaptureQueue* owner,
+       const CaptureTask& capture_task,
+       size_t num_deduplicated)
+      : owner_(owner),
+        capture_task_(capture_task),
+        num_deduplicated_(num_deduplicated),
+        request_time_(base::TimeTicks::Now()),
+        captured_(true, false) {}
+
+  // Blocks until the capture has run. The task must not be accessed
+  // afterwards.
+  void WaitForCapture() { captured_.Wait(); }
+
+  // base::DelegateSimpleThread::Delegate implementation.
+  void Run() override {
+    base::Closure completion = capture_task_.Run(num_deduplicated_);
+    owner_->OnCaptured(base::TimeTicks::Now() - request_time_);
+
+    // Release the requester before completing the report.
+    captured_.Signal();
+    if (!completion.is_null())
+      completion.Run();
+    delete this;
+  }
+
+ private:
+  CaptureQueue* owner_;
+  CaptureTask capture_task_;
+  size_t num_deduplicated_;
+  base::TimeTicks request_time_;
+  base::WaitableEvent captured_;
+
+  DISALLOW_COPY_AND_ASSIGN(Task);
+};
+
+bool CaptureQueue::CrashSignature::operator<(
+    const CrashSignature& other) const {
+  return std::tie(process_id, exception_code, exception_address,
+                  module_name) <
+         std::tie(other.process_id, other.exception_code,
+                  other.exception_address, other.module_name);
+}
+
+CaptureQueue::Stats::Stats()
+    : queue_depth(0),
+      max_queue_depth(0),
+      captured(0),
+      deduplicated(0),
+      dropped(0) {}
+
+CaptureQueue::CaptureQueue(size_t max_queue_depth,
+                           size_t num_workers,
+                           const base::TimeDelta& deduplication_interval)
+    : max_queue_depth_(max_queue_depth),
+      deduplication_interval_(deduplication_interval),
+      workers_("CaptureQueue", static_cast<int>(num_workers)),
+      shut_down_(false) {
+  DCHECK_LT(0U, max_queue_depth);
+  DCHECK_LT(0U, num_workers);
+  workers_.Start();
+}
+
+CaptureQueue::~CaptureQueue() {
+  if (!shut_down_)
+    Shutdown();
+}
+
+CaptureQueue::Result CaptureQueue::Capture(const CrashSignature& signature,
+                                           const CaptureTask& capture_task) {
+  DCHECK(!shut_down_);
+
+  Task* task = nullptr;
+  {
+    base::AutoLock auto_lock(lock_);
+
+    // Forget the crashes that are no longer recent, unless they have
+    // deduplicated reports to hand to their next capture.
+    base::TimeTicks now = base::TimeTicks::Now();
+    for (auto it = recent_crashes_.begin(); it != recent_crashes_.end();) {
+      if (now - it->second.capture_time >= deduplication_interval_ &&
+          it->second.num_deduplicated == 0) {
+        it = recent_crashes_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    auto recent_crash = recent_crashes_.find(signature);
+    if (recent_crash != recent_crashes_.end() &&
+        now - recent_crash->second.capture_time < deduplication_interval_) {
+      ++recent_crash->second.num_deduplicated;
+      ++stats_.deduplicated;
+      return DEDUPLICATED;
+    }
+    if (stats_.queue_depth >= max_queue_depth_) {
+      ++stats_.dropped;
+      LOG(WARNING) << "Dropping a report, " << stats_.queue_depth
+                   << " captures are pending.";
+      return DROPPED;
+    }
+
+    // The count is only taken by an accepted capture, so that a dropped report
+    // leaves it to a later one.
+    size_t num_deduplicated = 0;
+    if (recent_crash != recent_crashes_.end()) {
+      num_deduplicated = recent_crash->second.num_deduplicated;
+      recent_crashes_.erase(recent_crash);
+    }
+    if (!deduplication_interval_.is_zero()) {
+      RecentCrash& entry = recent_crashes_[signature];
+      entry.capture_time = now;
+      entry.num_deduplicated = 0;
+    }
+    ++stats_.queue_depth;
+    stats_.max_queue_depth =
+        std::max(stats_.max_queue_depth, stats_.queue_depth);
+
+    task = new Task(this, capture_task, num_deduplicated);
+    workers_.AddWork(task);
+  }
+
+  task->WaitForCapture();
+  return CAPTURED;
+}
+
+void CaptureQueue::Shutdown() {
+  DCHECK(!shut_down_);
+  workers_.JoinAll();
+  shut_down_ = true;
+}
+
+CaptureQueue::Stats CaptureQueue::GetStats() const {
+  base::AutoLock auto_lock(lock_);
+  return stats_;
+}
+
+void CaptureQueue::OnCaptured(const base::TimeDelta& latency) {
+  base::AutoLock auto_lock(lock_);
+  DCHECK_LT(0U, stats_.queue_depth);
+  --stats_.queue_depth;
+  ++stats_.captured;
+  stats_.total_capture_latency += latency;
+  stats_.max_capture_latency = std::max(stats_.max_capture_latency, latency);
+}
+
+}  // namespace kasko
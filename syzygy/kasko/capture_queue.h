@@ -0,0 +1,156 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SYZYGY_KASKO_CAPTURE_QUEUE_H_
+#define SYZYGY_KASKO_CAPTURE_QUEUE_H_
+
+#include <stdint.h>
+
+#include <map>
+
+#include "base/callback.h"
+#include "base/macros.h"
+#include "base/process/process_handle.h"
+#include "base/strings/string16.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
+
+namespace kasko {
+
+// Runs the captures of diagnostic reports on a small pool of workers. The
+// queue of captures is bounded, so that a crash storm doesn't pile up blocked
+// clients, and the reports of a crash that was recently captured are
+// deduplicated. The deduplicated reports are counted, and their count is
+// handed to the next capture of the same crash.
+//
+// A capture happens while its client waits, as the client must not run while
+// its minidump is written. Anything else, such as storing the report, happens
+// on the worker after the client is released.
+class CaptureQueue {
+ public:
+  // Identifies a crash by its process, and the code and address of its
+  // exception. Both are 0 for a report that isn't about an exception. The
+  // address of an exception in a known module is relative to the module, and
+  // such a crash has no process, so that its reports are deduplicated across
+  // the processes that load the module.
+  struct CrashSignature {
+    base::ProcessId process_id;
+    uint32_t exception_code;
+    uint32_t exception_address;
+    // The base name of the module of the exception, if known.
+    base::string16 module_name;
+
+    bool operator<(const CrashSignature& other) const;
+  };
+
+  // Captures a report while its client waits.
+  // @param num_deduplicated The number of reports of the same crash that were
+  //     deduplicated since its previous capture.
+  // @returns the closure that completes the report once the client has been
+  //     released. May be null.
+  using CaptureTask = base::Callback<base::Closure(size_t num_deduplicated)>;
+
+  // The outcome of a capture request.
+  enum Result {
+    // The report was captured.
+    CAPTURED,
+    // A report of the same crash was captured recently.
+    DEDUPLICATED,
+    // The queue was full.
+    DROPPED,
+  };
+
+  // The metrics of the queue.
+  struct Stats {
+    Stats();
+
+    // The number of captures that are queued or running.
+    size_t queue_depth;
+    // The high-water mark of |queue_depth|.
+    size_t max_queue_depth;
+    // The number of captured, deduplicated and dropped reports.
+    size_t captured;
+    size_t deduplicated;
+    size_t dropped;
+    // The total and maximum time from a capture request to the release of its
+    // client.
+    base::TimeDelta total_capture_latency;
+    base::TimeDelta max_capture_latency;
+  };
+
+  // Creates a queue and starts its workers.
+  // @param max_queue_depth The maximum number of captures that are queued or
+  //     running. Further requests are dropped.
+  // @param num_workers The number of workers that run the captures.
+  // @param deduplication_interval The time during which the reports of a
+  //     captured crash are deduplicated. Zero disables deduplication.
+  CaptureQueue(size_t max_queue_depth,
+               size_t num_workers,
+               const base::TimeDelta& deduplication_interval);
+
+  // Shuts down the queue if Shutdown() wasn't called.
+  ~CaptureQueue();
+
+  // Requests a capture, and blocks until it has run unless it is deduplicated
+  // or dropped. May be called from any thread.
+  // @param signature The signature of the reported crash.
+  // @param capture_task The capture.
+  // @returns the outcome of the request.
+  Result Capture(const CrashSignature& signature,
+                 const CaptureTask& capture_task);
+
+  // Blocks until the queued captures and their completions have run, and
+  // stops the workers. No capture may be requested afterwards.
+  void Shutdown();
+
+  // @returns the current metrics of the queue.
+  Stats GetStats() const;
+
+ private:
+  class Task;
+
+  // A recently captured crash.
+  struct RecentCrash {
+    // The time at which the crash was accepted for capture.
+    base::TimeTicks capture_time;
+    // The number of its reports that were deduplicated since.
+    size_t num_deduplicated;
+  };
+
+  // Invoked by a task once its capture has run.
+  // @param latency The time since the capture was requested.
+  void OnCaptured(const base::TimeDelta& latency);
+
+  size_t max_queue_depth_;
+  base::TimeDelta deduplication_interval_;
+  base::DelegateSimpleThreadPool workers_;
+  bool shut_down_;
+
+  // Protects the members below.
+  mutable base::Lock lock_;
+
+  // The recently captured crashes. A crash with deduplicated reports is kept
+  // once it is no longer recent, until its count is handed to its next
+  // capture.
+  std::map<CrashSignature, RecentCrash> recent_crashes_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(CaptureQueue);
+};
+
+}  // namespace kasko
+
+#endif  // SYZYGY_KASKO_CAPTURE_QUEUE_H_
@@ -0,0 +1,214 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/kasko/capture_queue.h"
+
+#include "base/bind.h"
+#include "base/macros.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace kasko {
+
+namespace {
+
+void SetFlag(bool* flag) {
+  *flag = true;
+}
+
+// A capture that sets |captured| and completes by setting |completed|.
+base::Closure CaptureAndComplete(bool* captured,
+                                 bool* completed,
+                                 size_t /* num_deduplicated */) {
+  *captured = true;
+  return base::Bind(&SetFlag, base::Unretained(completed));
+}
+
+// A capture that does nothing.
+base::Closure NoOpCapture(size_t /* num_deduplicated */) {
+  return base::Closure();
+}
+
+// A capture that stores the number of deduplicated reports it is handed.
+base::Closure CountingCapture(size_t* count, size_t num_deduplicated) {
+  *count = num_deduplicated;
+  return base::Closure();
+}
+
+// A capture that signals |started| and then waits for |release|.
+base::Closure BlockingCapture(base::WaitableEvent* started,
+                              base::WaitableEvent* release,
+                              size_t /* num_deduplicated */) {
+  started->Signal();
+  release->Wait();
+  return base::Closure();
+}
+
+// Requests a blocking capture from another thread.
+class BlockingCaptureDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  BlockingCaptureDelegate(CaptureQueue* queue,
+                          const CaptureQueue::CrashSignature& signature,
+                          base::WaitableEvent* started,
+                          base::WaitableEvent* release)
+      : queue_(queue),
+        signature_(signature),
+        started_(started),
+        release_(release),
+        result_(CaptureQueue::DROPPED) {}
+
+  void Run() override {
+    result_ = queue_->Capture(
+        signature_, base::Bind(&BlockingCapture, base::Unretained(started_),
+                               base::Unretained(release_)));
+  }
+
+  CaptureQueue::Result result() const { return result_; }
+
+ private:
+  CaptureQueue* queue_;
+  CaptureQueue::CrashSignature signature_;
+  base::WaitableEvent* started_;
+  base::WaitableEvent* release_;
+  CaptureQueue::Result result_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockingCaptureDelegate);
+};
+
+const CaptureQueue::CrashSignature kSignature = {1234, 0xC0000005, 0x1000};
+const CaptureQueue::CrashSignature kOtherSignature = {1234, 0xC0000005,
+                                                      0x2000};
+
+}  // namespace
+
+TEST(CaptureQueueTest, CapturesAndCompletes) {
+  CaptureQueue queue(4, 2, base::TimeDelta());
+
+  bool captured = false;
+  bool completed = false;
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kSignature,
+                          base::Bind(&CaptureAndComplete,
+                                     base::Unretained(&captured),
+                                     base::Unretained(&completed))));
+  EXPECT_TRUE(captured);
+
+  // The completion has run once the queue is shut down.
+  queue.Shutdown();
+  EXPECT_TRUE(completed);
+
+  CaptureQueue::Stats stats = queue.GetStats();
+  EXPECT_EQ(0U, stats.queue_depth);
+  EXPECT_EQ(1U, stats.max_queue_depth);
+  EXPECT_EQ(1U, stats.captured);
+  EXPECT_EQ(0U, stats.deduplicated);
+  EXPECT_EQ(0U, stats.dropped);
+  EXPECT_LE(stats.max_capture_latency, stats.total_capture_latency);
+}
+
+TEST(CaptureQueueTest, DeduplicatesRecentCrashes) {
+  CaptureQueue queue(4, 1, base::TimeDelta::FromHours(1));
+
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kSignature, base::Bind(&NoOpCapture)));
+  EXPECT_EQ(CaptureQueue::DEDUPLICATED,
+            queue.Capture(kSignature, base::Bind(&NoOpCapture)));
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kOtherSignature, base::Bind(&NoOpCapture)));
+
+  // The same crash in another process isn't deduplicated.
+  CaptureQueue::CrashSignature other_process = kSignature;
+  other_process.process_id++;
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(other_process, base::Bind(&NoOpCapture)));
+  queue.Shutdown();
+
+  CaptureQueue::Stats stats = queue.GetStats();
+  EXPECT_EQ(3U, stats.captured);
+  EXPECT_EQ(1U, stats.deduplicated);
+}
+
+TEST(CaptureQueueTest, CountsDeduplicatedReports) {
+  CaptureQueue queue(4, 1, base::TimeDelta::FromMilliseconds(50));
+
+  size_t count = 42;
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kSignature,
+                          base::Bind(&CountingCapture,
+                                     base::Unretained(&count))));
+  EXPECT_EQ(0U, count);
+  EXPECT_EQ(CaptureQueue::DEDUPLICATED,
+            queue.Capture(kSignature, base::Bind(&NoOpCapture)));
+  EXPECT_EQ(CaptureQueue::DEDUPLICATED,
+            queue.Capture(kSignature, base::Bind(&NoOpCapture)));
+
+  // Another crash doesn't take the count.
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kOtherSignature,
+                          base::Bind(&CountingCapture,
+                                     base::Unretained(&count))));
+  EXPECT_EQ(0U, count);
+
+  // The next capture of the crash is handed its deduplicated reports.
+  base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kSignature,
+                          base::Bind(&CountingCapture,
+                                     base::Unretained(&count))));
+  EXPECT_EQ(2U, count);
+  queue.Shutdown();
+}
+
+TEST(CaptureQueueTest, NoDeduplicationWithoutInterval) {
+  CaptureQueue queue(4, 1, base::TimeDelta());
+
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kSignature, base::Bind(&NoOpCapture)));
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kSignature, base::Bind(&NoOpCapture)));
+  queue.Shutdown();
+}
+
+TEST(CaptureQueueTest, DropsWhenFull) {
+  CaptureQueue queue(1, 1, base::TimeDelta());
+
+  base::WaitableEvent started(true, false);
+  base::WaitableEvent release(true, false);
+  BlockingCaptureDelegate delegate(&queue, kSignature, &started, &release);
+  base::DelegateSimpleThread thread(&delegate, "BlockingCapture");
+  thread.Start();
+  started.Wait();
+
+  EXPECT_EQ(1U, queue.GetStats().queue_depth);
+  EXPECT_EQ(CaptureQueue::DROPPED,
+            queue.Capture(kOtherSignature, base::Bind(&NoOpCapture)));
+
+  release.Signal();
+  thread.Join();
+  EXPECT_EQ(CaptureQueue::CAPTURED, delegate.result());
+
+  // There is room again.
+  EXPECT_EQ(CaptureQueue::CAPTURED,
+            queue.Capture(kOtherSignature, base::Bind(&NoOpCapture)));
+  queue.Shutdown();
+
+  CaptureQueue::Stats stats = queue.GetStats();
+  EXPECT_EQ(2U, stats.captured);
+  EXPECT_EQ(1U, stats.dropped);
+  EXPECT_EQ(1U, stats.max_queue_depth);
+}
+
+}  // namespace kasko
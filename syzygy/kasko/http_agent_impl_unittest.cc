@@ -35,7 +35,17 @@ TEST(HttpAgentImplTest, SimpleUpload) {
   uint16_t response_code = 0;
   ASSERT_TRUE(SendHttpUpload(
       &agent_impl, url, std::map<base::string16, base::string16>(),
-      "file_contents", L"file_name", &response_body, &response_code));
+      "file_contents", L"file_name", false, &response_body, &response_code));
+
+  EXPECT_EQ(L"file_name=file_contents\r\n", response_body);
+  EXPECT_EQ(200, response_code);
+
+  // The server decompresses a gzipped body.
+  response_body.clear();
+  response_code = 0;
+  ASSERT_TRUE(SendHttpUpload(
+      &agent_impl, url, std::map<base::string16, base::string16>(),
+      "file_contents", L"file_name", true, &response_body, &response_code));
 
   EXPECT_EQ(L"file_name=file_contents\r\n", response_body);
   EXPECT_EQ(200, response_code);
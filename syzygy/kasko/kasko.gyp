@@ -90,6 +90,8 @@
       'target_name': 'kasko_lib',
       'type': 'static_library',
       'sources': [
+        'capture_queue.cc',
+        'capture_queue.h',
         'client.cc',
         'client.h',
         'crash_keys_serialization.cc',
@@ -145,6 +147,7 @@
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
         '<(src)/syzygy/minidump/minidump.gyp:minidump_lib',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
         'kasko_version',
         'kasko_rpc',
       ],
@@ -241,6 +244,7 @@
       'type': 'executable',
       'sources': [
         '<(src)/syzygy/testing/run_all_unittests.cc',
+        'capture_queue_unittest.cc',
         'client_unittest.cc',
         'crash_keys_serialization_unittest.cc',
         'http_agent_impl_unittest.cc',
@@ -268,6 +272,7 @@
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/testing/gtest.gyp:gtest',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
       'msvs_settings': {
         'VCLinkerTool': {
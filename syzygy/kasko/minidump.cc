@@ -19,8 +19,13 @@
 #include <Psapi.h>
 #include <winternl.h>
 
+#include <algorithm>
+#include <set>
+
+#include "base/lazy_instance.h"
 #include "base/files/file.h"
 #include "base/process/process_handle.h"
+#include "base/synchronization/lock.h"
 #include "base/win/pe_image.h"
 #include "base/win/scoped_handle.h"
 
@@ -32,6 +37,10 @@ namespace kasko {
 
 namespace {
 
+// Serializes the calls to DbgHelp.
+base::LazyInstance<base::Lock>::Leaky g_dbghelp_lock =
+    LAZY_INSTANCE_INITIALIZER;
+
 // Minidump with stacks, PEB, TEB, and unloaded module list.
 const MINIDUMP_TYPE kSmallDumpType = static_cast<MINIDUMP_TYPE>(
     MiniDumpWithProcessThreadData |  // Get PEB and TEB.
@@ -50,9 +59,107 @@ const MINIDUMP_TYPE kFullDumpType = static_cast<MINIDUMP_TYPE>(
     MiniDumpWithHandleData |  // Get all handle information.
     MiniDumpWithUnloadedModules);  // Get unloaded modules when available.
 
+// The granularity of the memory referenced from the thread stacks, and the
+// amount of memory captured from each referenced address.
+const uint32_t kReferencedMemoryChunkSize = 256;
+const uint32_t kReferencedMemorySize = 256;
+
+// Returns true if the memory described by |info| can be read: it is committed
+// and is neither inaccessible nor a guard page.
+bool IsReadableMemory(const MEMORY_BASIC_INFORMATION& info) {
+  if (info.State != MEM_COMMIT)
+    return false;
+  if ((info.Protect & (PAGE_NOACCESS | PAGE_GUARD)) != 0)
+    return false;
+  return true;
+}
+
+// Appends to |memory_ranges| the chunks of memory that are referenced from the
+// stacks of a process. The stacks are scanned from their top, in order, so
+// that the memory referenced from the innermost frames comes first. The
+// referenced memory is only captured if it is readable and doesn't belong to
+// a module image, as the return addresses that point into code dominate the
+// stack contents and the modules are captured separately.
+// @param process The process whose stacks are scanned.
+// @param stacks The stacks of the process, in decreasing order of priority.
+// @param byte_budget The size after which the scan stops, or 0 for no limit.
+// @param memory_ranges Receives the referenced chunks.
+void AppendStackReferencedMemoryRanges(
+    base::ProcessHandle process,
+    const std::vector<MinidumpRequest::MemoryRange>& stacks,
+    uint32_t byte_budget,
+    std::vector<MinidumpRequest::MemoryRange>* memory_ranges) {
+  DCHECK(memory_ranges);
+
+  std::set<uint32_t> chunks;
+  uint64_t appended_bytes = 0;
+  MEMORY_BASIC_INFORMATION region = {};
+  std::vector<uint32_t> stack_contents;
+  for (const auto& stack : stacks) {
+    stack_contents.resize(stack.size() / sizeof(uint32_t));
+    SIZE_T bytes_read = 0;
+    if (stack_contents.empty() ||
+        !::ReadProcessMemory(process, reinterpret_cast<void*>(stack.start()),
+                             stack_contents.data(),
+                             stack_contents.size() * sizeof(uint32_t),
+                             &bytes_read)) {
+      continue;
+    }
+    stack_contents.resize(bytes_read / sizeof(uint32_t));
+
+    for (uint32_t value : stack_contents) {
+      // The stacks themselves are already part of the minidump.
+      if (std::any_of(stacks.begin(), stacks.end(),
+                      [value](const MinidumpRequest::MemoryRange& range) {
+                        return range.Contains(value);
+                      })) {
+        continue;
+      }
+
+      // Capture the chunks that overlap [value, value + kReferencedMemorySize),
+      // taking care not to wrap around the address space.
+      uint32_t first_chunk = value - value % kReferencedMemoryChunkSize;
+      uint32_t end = std::max(value, value + kReferencedMemorySize);
+      for (uint32_t chunk = first_chunk; chunk >= first_chunk && chunk < end;
+           chunk += kReferencedMemoryChunkSize) {
+        if (chunks.find(chunk) != chunks.end())
+          continue;
+
+        // Consecutive values often point into the same region, so the last
+        // queried region is reused while it matches.
+        uint32_t region_start = reinterpret_cast<uint32_t>(region.BaseAddress);
+        if (chunk - region_start >= region.RegionSize) {
+          if (::VirtualQueryEx(process, reinterpret_cast<void*>(chunk),
+                               &region, sizeof(region)) != sizeof(region)) {
+            region = MEMORY_BASIC_INFORMATION();
+            break;
+          }
+        }
+        if (!IsReadableMemory(region) || region.Type == MEM_IMAGE)
+          break;
+
+        chunks.insert(chunk);
+        memory_ranges->push_back(
+            MinidumpRequest::MemoryRange(chunk, kReferencedMemoryChunkSize));
+        appended_bytes += kReferencedMemoryChunkSize;
+        if (byte_budget != 0 && appended_bytes >= byte_budget)
+          return;
+      }
+    }
+  }
+}
+
 class MinidumpCallbackHandler {
  public:
-  explicit MinidumpCallbackHandler(
+  // @param process The process whose minidump is written.
+  // @param thread_id The thread that threw the exception, or 0.
+  // @param request The minidump parameters.
+  // @param memory_ranges The memory ranges to add to the minidump, in
+  //     decreasing order of priority.
+  MinidumpCallbackHandler(
+      base::ProcessHandle process,
+      base::PlatformThreadId thread_id,
+      const MinidumpRequest& request,
       const std::vector<MinidumpRequest::MemoryRange>* memory_ranges);
 
   const MINIDUMP_CALLBACK_INFORMATION* GetMINIDUMP_CALLBACK_INFORMATION() {
@@ -60,14 +167,29 @@ class MinidumpCallbackHandler {
   }
 
  private:
+  BOOL ThreadCallback(const MINIDUMP_THREAD_CALLBACK& thread);
   BOOL MemoryCallback(ULONG64* memory_base, ULONG* memory_size);
 
+  // Selects the memory ranges to add to the minidump. This happens on the
+  // first memory callback, once all of the threads have been reported.
+  void SelectRanges();
+
   static BOOL CALLBACK
   CallbackRoutine(PVOID context,
                   const PMINIDUMP_CALLBACK_INPUT callback_input,
                   PMINIDUMP_CALLBACK_OUTPUT callback_output);
 
+  base::ProcessHandle process_;
+  base::PlatformThreadId thread_id_;
+  const MinidumpRequest& request_;
   const std::vector<MinidumpRequest::MemoryRange>* memory_ranges_;
+
+  // The thread stacks reported by the thread callbacks, the stack of the
+  // thread that threw the exception first.
+  std::vector<MinidumpRequest::MemoryRange> stacks_;
+
+  bool ranges_selected_;
+  std::vector<MinidumpRequest::MemoryRange> selected_ranges_;
   size_t next_memory_range_index_;
   MINIDUMP_CALLBACK_INFORMATION minidump_callback_information_;
 
@@ -75,8 +197,15 @@ class MinidumpCallbackHandler {
 };
 
 MinidumpCallbackHandler::MinidumpCallbackHandler(
+    base::ProcessHandle process,
+    base::PlatformThreadId thread_id,
+    const MinidumpRequest& request,
     const std::vector<MinidumpRequest::MemoryRange>* memory_ranges)
-    : memory_ranges_(memory_ranges),
+    : process_(process),
+      thread_id_(thread_id),
+      request_(request),
+      memory_ranges_(memory_ranges),
+      ranges_selected_(false),
       next_memory_range_index_(0),
       minidump_callback_information_() {
   minidump_callback_information_.CallbackRoutine =
@@ -84,22 +213,53 @@ MinidumpCallbackHandler::MinidumpCallbackHandler(
   minidump_callback_information_.CallbackParam = reinterpret_cast<void*>(this);
 }
 
-BOOL MinidumpCallbackHandler::MemoryCallback(ULONG64* memory_base,
-                                             ULONG* memory_size) {
-  for (; next_memory_range_index_ < memory_ranges_->size();
-       ++next_memory_range_index_) {
-    // A zero-length range will terminate memory callbacks. If there is one in
-    // our input vector, skip it.
-    if ((*memory_ranges_)[next_memory_range_index_].size() == 0)
-      continue;
-
-    // Include the specified memory region.
-    *memory_base = (*memory_ranges_)[next_memory_range_index_].start();
-    *memory_size = (*memory_ranges_)[next_memory_range_index_].size();
-    ++next_memory_range_index_;
+BOOL MinidumpCallbackHandler::ThreadCallback(
+    const MINIDUMP_THREAD_CALLBACK& thread) {
+  if (!request_.include_stack_referenced_memory)
     return TRUE;
+
+  uint32_t start = static_cast<uint32_t>(
+      std::min(thread.StackBase, thread.StackEnd));
+  uint32_t end = static_cast<uint32_t>(
+      std::max(thread.StackBase, thread.StackEnd));
+  MinidumpRequest::MemoryRange stack(start, end - start);
+  if (thread.ThreadId == thread_id_)
+    stacks_.insert(stacks_.begin(), stack);
+  else
+    stacks_.push_back(stack);
+  return TRUE;
+}
+
+void MinidumpCallbackHandler::SelectRanges() {
+  DCHECK(!ranges_selected_);
+  ranges_selected_ = true;
+
+  std::vector<MinidumpRequest::MemoryRange> prioritized_ranges(
+      *memory_ranges_);
+  if (request_.include_stack_referenced_memory) {
+    AppendStackReferencedMemoryRanges(process_, stacks_,
+                                      request_.memory_ranges_byte_budget,
+                                      &prioritized_ranges);
   }
-  return FALSE;
+  SelectMemoryRanges(prioritized_ranges, request_.memory_ranges_byte_budget,
+                     &selected_ranges_);
+}
+
+BOOL MinidumpCallbackHandler::MemoryCallback(ULONG64* memory_base,
+                                             ULONG* memory_size) {
+  if (!ranges_selected_)
+    SelectRanges();
+
+  // A zero-length range would terminate memory callbacks, but those are never
+  // selected.
+  if (next_memory_range_index_ == selected_ranges_.size())
+    return FALSE;
+
+  // Include the specified memory region.
+  *memory_base = selected_ranges_[next_memory_range_index_].start();
+  *memory_size = selected_ranges_[next_memory_range_index_].size();
+  ++next_memory_range_index_;
+  return TRUE;
 }
 
 // static
@@ -121,8 +281,9 @@ BOOL CALLBACK MinidumpCallbackHandler::CallbackRoutine(
 
     // Include all threads.
     case IncludeThreadCallback:
-    case ThreadCallback:
       return TRUE;
+    case ::ThreadCallback:
+      return self->ThreadCallback(callback_input->Thread);
 
     // Stop receiving cancel callbacks.
     case CancelCallback:
@@ -204,6 +365,32 @@ DWORD GetRequiredAccessForMinidumpTypeImpl(bool is_full_type) {
 
 }  // namespace
 
+void SelectMemoryRanges(
+    const std::vector<MinidumpRequest::MemoryRange>& prioritized_ranges,
+    uint32_t byte_budget,
+    std::vector<MinidumpRequest::MemoryRange>* selected_ranges) {
+  DCHECK(selected_ranges);
+  selected_ranges->clear();
+
+  uint32_t remaining_bytes = byte_budget;
+  for (const auto& range : prioritized_ranges) {
+    if (range.size() == 0)
+      continue;
+
+    if (byte_budget == 0) {
+      selected_ranges->push_back(range);
+      continue;
+    }
+
+    uint32_t size = std::min(range.size(), remaining_bytes);
+    selected_ranges->push_back(MinidumpRequest::MemoryRange(range.start(),
+                                                            size));
+    remaining_bytes -= size;
+    if (remaining_bytes == 0)
+      break;
+  }
+}
+
 DWORD GetRequiredAccessForMinidumpType(MinidumpRequest::Type type) {
   return GetRequiredAccessForMinidumpTypeImpl(type ==
                                               MinidumpRequest::FULL_DUMP_TYPE);
@@ -269,8 +456,11 @@ bool GenerateMinidump(const base::FilePath& destination,
   std::vector<kasko::MinidumpRequest::MemoryRange> augmented_memory_ranges =
       AugmentMemoryRanges(&request.user_selected_memory_ranges);
 
-  MinidumpCallbackHandler callback_handler(&augmented_memory_ranges);
+  MinidumpCallbackHandler callback_handler(target_process, thread_id, request,
+                                          &augmented_memory_ranges);
 
+  // DbgHelp is single-threaded, and reports may be captured concurrently.
+  base::AutoLock auto_lock(g_dbghelp_lock.Get());
   if (::MiniDumpWriteDump(
           target_process, base::GetProcId(target_process),
           destination_file.GetPlatformFile(), platform_minidump_type,
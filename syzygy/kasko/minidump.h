@@ -34,6 +34,19 @@ namespace kasko {
 DWORD GetRequiredAccessForMinidumpType(MinidumpRequest::Type type);
 DWORD GetRequiredAccessForMinidumpType(api::MinidumpType type);
 
+// Selects the memory ranges to add to a minidump under a byte budget.
+// Zero-length ranges are dropped, and the range that exhausts the budget is
+// truncated to fit.
+// @param prioritized_ranges The candidate ranges, in decreasing order of
+//     priority.
+// @param byte_budget The maximum total size of the selected ranges, or 0 for
+//     no limit.
+// @param selected_ranges Receives the selected ranges, in priority order.
+void SelectMemoryRanges(
+    const std::vector<MinidumpRequest::MemoryRange>& prioritized_ranges,
+    uint32_t byte_budget,
+    std::vector<MinidumpRequest::MemoryRange>* selected_ranges);
+
 // Generates a minidump.
 // @param destination The path where the dump should be generated.
 // @param target_process The handle of the process whose dump should be
@@ -19,7 +19,9 @@ namespace kasko {
 MinidumpRequest::MinidumpRequest()
     : type(SMALL_DUMP_TYPE),
       client_exception_pointers(false),
-      exception_info_address(0) {}
+      exception_info_address(0),
+      include_stack_referenced_memory(false),
+      memory_ranges_byte_budget(0) {}
 
 MinidumpRequest::~MinidumpRequest() {
 }
@@ -73,8 +73,21 @@ struct MinidumpRequest {
   // Custom streams to be included with the report (default: empty).
   std::vector<CustomStream> custom_streams;
 
-  // User-selected memory ranges to be included in the minidump.
+  // User-selected memory ranges to be included in the minidump, in
+  // decreasing order of priority.
   std::vector<MemoryRange> user_selected_memory_ranges;
+
+  // True if memory referenced from the thread stacks should be added to the
+  // minidump as memory ranges of lower priority than the user-selected ones
+  // (default: false). Unlike LARGER_DUMP_TYPE, this is subject to
+  // memory_ranges_byte_budget.
+  bool include_stack_referenced_memory;
+
+  // The maximum number of bytes of memory ranges to add to the minidump, or 0
+  // for no limit (default: 0). Ranges are added in decreasing order of
+  // priority until the budget is exhausted. The memory implied by the dump
+  // type, such as the thread stacks, is not accounted for.
+  uint32_t memory_ranges_byte_budget;
 };
 
 }  // namespace kasko
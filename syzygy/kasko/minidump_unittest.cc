@@ -241,6 +241,63 @@ TEST_F(MinidumpTest, MemoryRanges) {
   ASSERT_NE(std::string::npos, dump_with_memory_range.find(kGlobalString));
 }
 
+TEST_F(MinidumpTest, StackReferencedMemory) {
+  base::FilePath small_dump_file_path = temp_dir().Append(L"small.dump");
+  base::FilePath referenced_dump_file_path =
+      temp_dir().Append(L"referenced.dump");
+
+  bool result = false;
+  ASSERT_NO_FATAL_FAILURE(CallGenerateMinidump(small_dump_file_path, &result));
+  ASSERT_TRUE(result);
+
+  const uint32_t kByteBudget = 16 * 1024;
+  request().include_stack_referenced_memory = true;
+  request().memory_ranges_byte_budget = kByteBudget;
+  ASSERT_NO_FATAL_FAILURE(
+      CallGenerateMinidump(referenced_dump_file_path, &result));
+  ASSERT_TRUE(result);
+
+  // As for the dump types, the file sizes show that referenced memory was
+  // added, and that the budget was respected. Each chunk of referenced memory
+  // costs a memory descriptor on top of its contents.
+  int64_t small_dump_size = 0;
+  int64_t referenced_dump_size = 0;
+  ASSERT_TRUE(base::GetFileSize(small_dump_file_path, &small_dump_size));
+  ASSERT_TRUE(
+      base::GetFileSize(referenced_dump_file_path, &referenced_dump_size));
+
+  EXPECT_GT(referenced_dump_size, small_dump_size);
+  EXPECT_LE(referenced_dump_size,
+            small_dump_size + kByteBudget +
+                kByteBudget / 256 * sizeof(MINIDUMP_MEMORY_DESCRIPTOR));
+}
+
+TEST(SelectMemoryRangesTest, SelectsInPriorityOrderUnderBudget) {
+  std::vector<MinidumpRequest::MemoryRange> ranges;
+  ranges.push_back(MinidumpRequest::MemoryRange(0x1000, 0x100));
+  ranges.push_back(MinidumpRequest::MemoryRange(0x8000, 0));
+  ranges.push_back(MinidumpRequest::MemoryRange(0x2000, 0x100));
+  ranges.push_back(MinidumpRequest::MemoryRange(0x3000, 0x100));
+
+  // Without a budget, only the empty range is dropped.
+  std::vector<MinidumpRequest::MemoryRange> selected;
+  SelectMemoryRanges(ranges, 0, &selected);
+  ASSERT_EQ(3U, selected.size());
+  EXPECT_EQ(ranges[0], selected[0]);
+  EXPECT_EQ(ranges[2], selected[1]);
+  EXPECT_EQ(ranges[3], selected[2]);
+
+  // The range that exhausts the budget is truncated, the next ones dropped.
+  SelectMemoryRanges(ranges, 0x180, &selected);
+  ASSERT_EQ(2U, selected.size());
+  EXPECT_EQ(ranges[0], selected[0]);
+  EXPECT_EQ(MinidumpRequest::MemoryRange(0x2000, 0x80), selected[1]);
+
+  SelectMemoryRanges(ranges, 0x100, &selected);
+  ASSERT_EQ(1U, selected.size());
+  EXPECT_EQ(ranges[0], selected[0]);
+}
+
 TEST_F(MinidumpTest, OverwriteExistingFile) {
   base::ScopedTempDir temp_dir;
   ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
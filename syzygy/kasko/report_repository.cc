@@ -41,19 +41,33 @@
 // upload, those in "Retry" and "Retry 2" are eligible when their last-modified
 // date is older than the configured retry interval.
 //
+// Only the uploading instance moves reports into "Retry" and "Retry 2", so it
+// scans them once and then indexes their reports by timestamp in memory. The
+// directories and the timestamps remain the persistent state of the queues,
+// from which a new uploading instance rebuilds its index. "Incoming" is still
+// scanned, as any instance may store reports into it, but a scan stops at the
+// first eligible report.
+//
 // Orphaned report files (minidumps without crash keys and vice-versa) may be
 // detected during upload attempts. When receiving new minidumps, we first write
 // the crash keys to "Incoming" before moving the minidump file in. As a result,
 // an orphaned minidump file is always an error condition and will be deleted
 // immediately upon detection. An orphaned crash keys file may occur normally in
 // the interval before the minidump file is moved. These files are only deleted
-// when their timestamp is more than a day in the past.
+// when their timestamp is more than a day in the past. As any orphan is kept
+// for a day, the cleanup runs at most once per kOrphanCleanupInterval.
 
 #include "syzygy/kasko/report_repository.h"
 
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "base/logging.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_util.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
 
 namespace kasko {
@@ -71,6 +85,11 @@ const base::char16 kIncomingReportsSubdir[] = L"Incoming";
 const base::char16 kFailedOnceSubdir[] = L"Retry";
 // The subdirectory where reports that have failed twice are stored.
 const base::char16 kFailedTwiceSubdir[] = L"Retry 2";
+// The minimum interval between two cleanups of the orphaned crash keys files.
+const int kOrphanCleanupIntervalInMinutes = 60;
+
+// The reports of a retry queue, by the time of their last upload attempt.
+using RetryQueue = std::multimap<base::Time, base::FilePath>;
 
 // Deletes a path non-recursively and logs an error in case of failure.
 // @param path The path to delete.
@@ -154,37 +173,83 @@ base::FilePath GetDumpFileForCrashKeysFile(
   return crash_keys_path.ReplaceExtension(kDumpFileExtension);
 }
 
-// Returns a minidump that is eligible for upload from the given directory, if
-// any are.
+// Checks that a minidump still has its crash keys. Deletes it otherwise.
+// @param minidump_path The path to the minidump file.
+// @returns true if the minidump has its crash keys.
+bool HasCrashKeysFile(const base::FilePath& minidump_path) {
+  if (base::PathExists(GetCrashKeysFileForDumpFile(minidump_path)))
+    return true;
+  LOG(ERROR) << "Deleting a minidump file with missing crash keys: "
+             << minidump_path.value();
+  LoggedDeleteFile(minidump_path);
+  return false;
+}
+
+// Appends the minidumps from the given directory, if any, until |max_count|
+// minidumps are pending.
 // @param directory The directory to scan.
-// @param maximum_timestamp_for_retries The cutoff for the most most recent
-//     upload attempt of eligible minidumps. If null, there is no cutoff.
-// @returns The path to a minidump that is eligible for upload, if any.
-base::FilePath GetPendingReportFromDirectory(
+// @param max_count The maximum number of pending minidumps.
+// @param pending_reports Receives the paths to the minidumps, if any.
+void GetPendingReportsFromDirectory(
     const base::FilePath& directory,
-    const base::Time& maximum_timestamp_for_retries) {
+    size_t max_count,
+    std::vector<base::FilePath>* pending_reports) {
   base::FileEnumerator file_enumerator(
       directory, false, base::FileEnumerator::FILES,
       base::string16(L"*") + kDumpFileExtension);
-  // Visit all files in this directory until we find an eligible one.
-  for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
+  // Visit the files in this directory until we find enough eligible ones.
+  for (base::FilePath candidate = file_enumerator.Next();
+       !candidate.empty() && pending_reports->size() < max_count;
        candidate = file_enumerator.Next()) {
-    // Skip dumps with missing crash keys.
-    if (!base::PathExists(GetCrashKeysFileForDumpFile(candidate))) {
-      LOG(ERROR) << "Deleting a minidump file with missing crash keys: "
-                 << candidate.value();
-      LoggedDeleteFile(candidate);
+    if (HasCrashKeysFile(candidate))
+      pending_reports->push_back(candidate);
+  }
+}
+
+// Appends the minidumps that are eligible for retry from the given queue, if
+// any are, until |max_count| minidumps are pending. Drops the minidumps that
+// were deleted from the queue.
+// @param maximum_timestamp_for_retries The cutoff for the most recent upload
+//     attempt of eligible minidumps.
+// @param max_count The maximum number of pending minidumps.
+// @param dequeue Whether to remove the eligible minidumps from the queue.
+// @param queue The queue to visit, oldest attempt first.
+// @param pending_reports Receives the paths to minidumps that are eligible for
+//     retry, if any.
+void GetPendingReportsFromQueue(
+    const base::Time& maximum_timestamp_for_retries,
+    size_t max_count,
+    bool dequeue,
+    RetryQueue* queue,
+    std::vector<base::FilePath>* pending_reports) {
+  RetryQueue::iterator it = queue->begin();
+  while (it != queue->end() && pending_reports->size() < max_count &&
+         it->first <= maximum_timestamp_for_retries) {
+    if (!base::PathExists(it->second) || !HasCrashKeysFile(it->second)) {
+      it = queue->erase(it);
       continue;
     }
-    if (maximum_timestamp_for_retries.is_null())
-      return candidate;
+    pending_reports->push_back(it->second);
+    if (dequeue)
+      it = queue->erase(it);
+    else
+      ++it;
+  }
+}
 
-    // Check if this file is eligible for retry.
-    base::FileEnumerator::FileInfo file_info = file_enumerator.GetInfo();
-    if (file_info.GetLastModifiedTime() <= maximum_timestamp_for_retries)
-      return candidate;
+// Loads a retry queue from its directory.
+// @param directory The directory of the queue.
+// @param queue Receives the minidumps of the directory, by timestamp.
+void LoadRetryQueue(const base::FilePath& directory, RetryQueue* queue) {
+  queue->clear();
+  base::FileEnumerator file_enumerator(
+      directory, false, base::FileEnumerator::FILES,
+      base::string16(L"*") + kDumpFileExtension);
+  for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
+       candidate = file_enumerator.Next()) {
+    queue->insert(std::make_pair(
+        file_enumerator.GetInfo().GetLastModifiedTime(), candidate));
   }
-  return base::FilePath();
 }
 
 void CleanOrphanedCrashKeysFiles(
@@ -216,47 +281,123 @@ void CleanOrphanedCrashKeysFiles(
   }
 }
 
-// Returns a minidump that is eligible for upload, if any are.
+// A minidump that is eligible for upload.
+struct PendingReport {
+  base::FilePath minidump_path;
+  // The directory where the report goes after a failure, and the queue that
+  // indexes it. Both are empty if the next failure is permanent.
+  base::FilePath failure_destination;
+  RetryQueue* failure_queue;
+};
+
+// Gets the minidumps that are eligible for upload, if any are.
 // @param repository_path The directory where this repository stores reports.
-// @param now The current time.
-// @param retry_interval The minimum interval between upload attempts for a
-//     given report.
-// @returns A pair of mindump path (empty if none) and failure destination
-//     (empty if the next failure is permanent).
-std::pair<base::FilePath, base::FilePath> GetPendingReport(
-    const base::FilePath& repository_path,
-    const base::Time& now,
-    const base::TimeDelta& retry_interval) {
+// @param retry_cutoff The cutoff for the most recent upload attempt of
+//     eligible retries.
+// @param max_count The maximum number of minidumps to get.
+// @param dequeue Whether to remove the eligible retries from their queues.
+// @param retry_queues The "Retry" and "Retry 2" queues.
+// @param pending_reports Receives the eligible minidumps, from the oldest
+//     queue to the most failed one.
+void GetPendingReports(const base::FilePath& repository_path,
+                       const base::Time& retry_cutoff,
+                       size_t max_count,
+                       bool dequeue,
+                       RetryQueue* retry_queues,
+                       std::vector<PendingReport>* pending_reports) {
+  DCHECK(retry_queues);
+  DCHECK(pending_reports);
+  pending_reports->clear();
+
   struct {
     const base::char16* subdir;
+    RetryQueue* queue;
     const base::char16* failure_subdir;
-    base::Time retry_cutoff;
+    RetryQueue* failure_queue;
   } directories[] = {
-      {kIncomingReportsSubdir, kFailedOnceSubdir, base::Time()},
-      {kFailedOnceSubdir, kFailedTwiceSubdir, now - retry_interval},
-      {kFailedTwiceSubdir, nullptr, now - retry_interval}};
-
-  for (size_t i = 0; i < arraysize(directories); ++i) {
-    base::FilePath result = GetPendingReportFromDirectory(
-        repository_path.Append(directories[i].subdir),
-        directories[i].retry_cutoff);
-    if (!result.empty()) {
-      if (!directories[i].failure_subdir)
-        return std::make_pair(result, base::FilePath());
-      return std::make_pair(
-          result, repository_path.Append(directories[i].failure_subdir));
+      {kIncomingReportsSubdir, nullptr, kFailedOnceSubdir, &retry_queues[0]},
+      {kFailedOnceSubdir, &retry_queues[0], kFailedTwiceSubdir,
+       &retry_queues[1]},
+      {kFailedTwiceSubdir, &retry_queues[1], nullptr, nullptr}};
+
+  for (size_t i = 0;
+       i < arraysize(directories) && pending_reports->size() < max_count;
+       ++i) {
+    std::vector<base::FilePath> results;
+    size_t count = max_count - pending_reports->size();
+    if (directories[i].queue) {
+      GetPendingReportsFromQueue(retry_cutoff, count, dequeue,
+                                 directories[i].queue, &results);
+    } else {
+      GetPendingReportsFromDirectory(
+          repository_path.Append(directories[i].subdir), count, &results);
+    }
+    PendingReport pending_report = {};
+    if (directories[i].failure_subdir) {
+      pending_report.failure_destination =
+          repository_path.Append(directories[i].failure_subdir);
+      pending_report.failure_queue = directories[i].failure_queue;
+    }
+    for (const auto& result : results) {
+      pending_report.minidump_path = result;
+      pending_reports->push_back(pending_report);
     }
   }
-  return std::pair<base::FilePath, base::FilePath>();
 }
 
+// A report that is submitted to an upload attempt. Its files are deleted on
+// destruction unless they are taken.
+class PendingUpload : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param pending_report The report to upload.
+  // @param uploader Used to upload the report.
+  PendingUpload(const PendingReport& pending_report,
+                const ReportRepository::Uploader& uploader)
+      : minidump_file_(pending_report.minidump_path),
+        crash_keys_file_(
+            GetCrashKeysFileForDumpFile(pending_report.minidump_path)),
+        failure_destination_(pending_report.failure_destination),
+        failure_queue_(pending_report.failure_queue),
+        uploader_(uploader),
+        succeeded_(false) {}
+
+  // base::DelegateSimpleThread::Delegate implementation.
+  void Run() override {
+    std::map<base::string16, base::string16> crash_keys;
+    succeeded_ = ReadCrashKeysFromFile(crash_keys_file_.Get(), &crash_keys) &&
+                 uploader_.Run(minidump_file_.Get(), crash_keys);
+  }
+
+  // @name Accessors.
+  // @{
+  ScopedReportFile* minidump_file() { return &minidump_file_; }
+  ScopedReportFile* crash_keys_file() { return &crash_keys_file_; }
+  const base::FilePath& failure_destination() const {
+    return failure_destination_;
+  }
+  RetryQueue* failure_queue() const { return failure_queue_; }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ private:
+  ScopedReportFile minidump_file_;
+  ScopedReportFile crash_keys_file_;
+  base::FilePath failure_destination_;
+  RetryQueue* failure_queue_;
+  const ReportRepository::Uploader& uploader_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(PendingUpload);
+};
+
 // Handles a non-permanent failure by moving the report files to a new queue.
 // @param minidump_file The minidump file. This method calls Take() on success.
 // @param crash_keys_file The crash keys file. This method calls Take() on
 //     success.
 // @param destination_directory The directory where the files should be moved
 //     to.
-void HandleNonpermanentFailure(ScopedReportFile* minidump_file,
+// @returns true if the files were moved.
+bool HandleNonpermanentFailure(ScopedReportFile* minidump_file,
                                ScopedReportFile* crash_keys_file,
                                const base::FilePath& destination_directory) {
   bool result = base::CreateDirectory(destination_directory);
@@ -269,9 +410,11 @@ void HandleNonpermanentFailure(ScopedReportFile* minidump_file,
               crash_keys_file->Get().BaseName()))) {
         minidump_file->Take();
         crash_keys_file->Take();
+        return true;
       }
     }
   }
+  return false;
 }
 
 // Handles a permanent failure by invoking the PermanentFailureHandler. Ensures
@@ -304,7 +447,9 @@ ReportRepository::ReportRepository(
       retry_interval_(retry_interval),
       time_source_(time_source),
       uploader_(uploader),
-      permanent_failure_handler_(permanent_failure_handler) {
+      permanent_failure_handler_(permanent_failure_handler),
+      max_concurrent_uploads_(1),
+      retry_queues_loaded_(false) {
 }
 
 ReportRepository::~ReportRepository() {
@@ -347,49 +492,113 @@ void ReportRepository::StoreReport(
 bool ReportRepository::UploadPendingReport() {
   base::Time now = time_source_.Run();
 
-  // Do a bit of opportunistic cleanup.
-  CleanOrphanedCrashKeysFiles(repository_path_, now);
+  // Back off after failures, as they usually mean that the network or the
+  // server is down.
+  if (now < next_upload_time_)
+    return false;
 
-  std::pair<base::FilePath, base::FilePath> entry =
-      GetPendingReport(repository_path_, now, retry_interval_);
-  ScopedReportFile minidump_file(entry.first);
-  base::FilePath failure_destination = entry.second;
+  // Do a bit of opportunistic cleanup.
+  if (last_orphan_cleanup_time_.is_null() || now < last_orphan_cleanup_time_ ||
+      now - last_orphan_cleanup_time_ >=
+          base::TimeDelta::FromMinutes(kOrphanCleanupIntervalInMinutes)) {
+    CleanOrphanedCrashKeysFiles(repository_path_, now);
+    last_orphan_cleanup_time_ = now;
+  }
 
-  if (minidump_file.Get().empty())
+  // The reports are taken off their queues. Those that fail are put back on
+  // the next queue, and the others are deleted.
+  LoadRetryQueues();
+  std::vector<PendingReport> pending_reports;
+  GetPendingReports(repository_path_, now - retry_interval_,
+                    max_concurrent_uploads_, true, retry_queues_,
+                    &pending_reports);
+  if (pending_reports.empty())
     return true;  // Successful no-op.
 
-  ScopedReportFile crash_keys_file(
-      GetCrashKeysFileForDumpFile(minidump_file.Get()));
-
-  // Renew the file timestamps before attempting upload. If we are unable to do
-  // this, make no upload attempt (since that would potentially lead to a hot
-  // loop of upload attempts).
-  if (minidump_file.UpdateTimestamp(now)) {
-    if (crash_keys_file.UpdateTimestamp(now)) {
-      // Attempt the upload.
-      std::map<base::string16, base::string16> crash_keys;
-      if (ReadCrashKeysFromFile(crash_keys_file.Get(), &crash_keys)) {
-        if (uploader_.Run(minidump_file.Get(), crash_keys))
-          return true;
-      }
+  std::vector<std::unique_ptr<PendingUpload>> uploads;
+  for (const auto& pending_report : pending_reports) {
+    std::unique_ptr<PendingUpload> upload(
+        new PendingUpload(pending_report, uploader_));
+
+    // Renew the file timestamps before attempting upload. If we are unable to
+    // do this, make no upload attempt (since that would potentially lead to a
+    // hot loop of upload attempts).
+    if (upload->minidump_file()->UpdateTimestamp(now) &&
+        upload->crash_keys_file()->UpdateTimestamp(now)) {
+      uploads.push_back(std::move(upload));
+    }
+  }
+
+  // Attempt the uploads.
+  if (uploads.size() == 1) {
+    uploads[0]->Run();
+  } else if (uploads.size() > 1) {
+    base::DelegateSimpleThreadPool pool("ReportUpload",
+                                        static_cast<int>(uploads.size()));
+    pool.Start();
+    for (const auto& upload : uploads)
+      pool.AddWork(upload.get());
+    pool.JoinAll();
+  }
 
-      // We failed.
-      if (!failure_destination.empty()) {
-        HandleNonpermanentFailure(&minidump_file, &crash_keys_file,
-                                  failure_destination);
-      } else {
-        HandlePermanentFailure(minidump_file.Take(), crash_keys_file.Take(),
-                               permanent_failure_handler_);
+  bool succeeded = uploads.size() == pending_reports.size();
+  for (const auto& upload : uploads) {
+    if (upload->succeeded())
+      continue;
+
+    // We failed.
+    succeeded = false;
+    if (!upload->failure_destination().empty()) {
+      base::FilePath minidump_path = upload->minidump_file()->Get();
+      if (HandleNonpermanentFailure(upload->minidump_file(),
+                                    upload->crash_keys_file(),
+                                    upload->failure_destination())) {
+        upload->failure_queue()->insert(std::make_pair(
+            now,
+            upload->failure_destination().Append(minidump_path.BaseName())));
       }
+    } else {
+      HandlePermanentFailure(upload->minidump_file()->Take(),
+                             upload->crash_keys_file()->Take(),
+                             permanent_failure_handler_);
     }
   }
 
-  return false;
+  UpdateFailureBackoff(now, succeeded);
+  return succeeded;
 }
 
 bool ReportRepository::HasPendingReports() {
-  return !GetPendingReport(repository_path_, time_source_.Run(),
-                           retry_interval_).first.empty();
+  LoadRetryQueues();
+  std::vector<PendingReport> pending_reports;
+  GetPendingReports(repository_path_, time_source_.Run() - retry_interval_, 1,
+                    false, retry_queues_, &pending_reports);
+  return !pending_reports.empty();
+}
+
+void ReportRepository::LoadRetryQueues() {
+  if (retry_queues_loaded_)
+    return;
+  LoadRetryQueue(repository_path_.Append(kFailedOnceSubdir),
+                 &retry_queues_[0]);
+  LoadRetryQueue(repository_path_.Append(kFailedTwiceSubdir),
+                 &retry_queues_[1]);
+  retry_queues_loaded_ = true;
+}
+
+void ReportRepository::UpdateFailureBackoff(const base::Time& now,
+                                            bool succeeded) {
+  if (succeeded || initial_failure_backoff_.is_zero()) {
+    failure_backoff_ = base::TimeDelta();
+    next_upload_time_ = base::Time();
+    return;
+  }
+
+  if (failure_backoff_.is_zero())
+    failure_backoff_ = initial_failure_backoff_;
+  else
+    failure_backoff_ = std::min(failure_backoff_ * 2, retry_interval_);
+  next_upload_time_ = now + failure_backoff_;
 }
 
 }  // namespace kasko
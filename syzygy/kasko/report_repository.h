@@ -17,6 +17,7 @@
 
 #include <map>
 #include "base/callback.h"
+#include "base/logging.h"
 #include "base/macros.h"
 #include "base/files/file_path.h"
 #include "base/strings/string16.h"
@@ -32,6 +33,14 @@ namespace kasko {
 // StoreReport). Only a single instance should be used for uploading (via
 // UploadPendingReport). It's the client's responsibility to enforce this
 // requirement.
+//
+// The uploading instance may upload several reports concurrently, which drains
+// a repository faster after an outage, and may back off after failed uploads.
+// Both are disabled by default.
+//
+// The uploading instance scans the retry queues once, and then keeps an index
+// of them ordered by the time of their last upload attempt, so that it finds
+// the eligible retries without scanning their directories again.
 class ReportRepository {
  public:
   // Attempts to upload the minidump at the specified file path with the given
@@ -74,23 +83,78 @@ class ReportRepository {
       const base::FilePath& minidump_path,
       const std::map<base::string16, base::string16>& crash_keys);
 
-  // Attempts to upload a pending report, if any. A report is pending if it has
-  // never been submitted to an upload attempt or if its most recent upload
-  // attempt is older than the configured retry interval.
-  // @returns true if there are no pending reports or a report was successfully
-  //     uploaded.
+  // Attempts to upload up to max_concurrent_uploads() pending reports, if
+  // any, concurrently. A report is pending if it has never been submitted to an
+  // upload attempt or if its most recent upload attempt is older than the
+  // configured retry interval. No upload is attempted while backing off after
+  // a failure.
+  // @returns true if there are no pending reports or the reports were
+  //     successfully uploaded.
   bool UploadPendingReport();
 
-  // @returns true if UploadPendingReport would attempt to upload a report.
+  // @returns true if UploadPendingReport would attempt to upload a report,
+  //     regardless of any back off.
   bool HasPendingReports();
 
+  // @name Accessors and mutators.
+  // @{
+  // The maximum number of reports that UploadPendingReport uploads
+  // concurrently (default: 1). The uploader must be thread-safe if this is
+  // more than 1.
+  size_t max_concurrent_uploads() const { return max_concurrent_uploads_; }
+  void set_max_concurrent_uploads(size_t max_concurrent_uploads) {
+    DCHECK_LT(0U, max_concurrent_uploads);
+    max_concurrent_uploads_ = max_concurrent_uploads;
+  }
+
+  // The time during which UploadPendingReport makes no attempt after a failed
+  // upload (default: zero, meaning no back off). The back off doubles with
+  // each consecutive failure, up to the retry interval, and is reset by a
+  // successful upload.
+  const base::TimeDelta& initial_failure_backoff() const {
+    return initial_failure_backoff_;
+  }
+  void set_initial_failure_backoff(const base::TimeDelta& backoff) {
+    initial_failure_backoff_ = backoff;
+  }
+  // @}
+
  private:
+  // The reports of a retry queue, by the time of their last upload attempt.
+  typedef std::multimap<base::Time, base::FilePath> RetryQueue;
+
+  // Loads the retry queues from their directories, the first time it's
+  // called.
+  void LoadRetryQueues();
+
+  // Updates the back off after an upload round.
+  // @param now The time of the upload round.
+  // @param succeeded Whether all of the uploads of the round succeeded.
+  void UpdateFailureBackoff(const base::Time& now, bool succeeded);
+
   base::FilePath repository_path_;
   base::TimeDelta retry_interval_;
   TimeSource time_source_;
   Uploader uploader_;
   PermanentFailureHandler permanent_failure_handler_;
 
+  size_t max_concurrent_uploads_;
+  base::TimeDelta initial_failure_backoff_;
+
+  // The current back off, and the time before which no upload is attempted.
+  base::TimeDelta failure_backoff_;
+  base::Time next_upload_time_;
+
+  // The indices of the "Retry" and "Retry 2" queues. Only the uploading
+  // instance writes to these queues, so they are loaded once and then kept up
+  // to date. Reports that are deleted behind its back are dropped when they
+  // are reached.
+  bool retry_queues_loaded_;
+  RetryQueue retry_queues_[2];
+
+  // The time of the last cleanup of the orphaned crash keys files.
+  base::Time last_orphan_cleanup_time_;
+
   DISALLOW_COPY_AND_ASSIGN(ReportRepository);
 };
 
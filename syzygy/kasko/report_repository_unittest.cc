@@ -29,6 +29,7 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
 #include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
@@ -64,6 +65,12 @@ class ReportRepositoryTest : public testing::Test {
   // testing::Test implementation
   void SetUp() override {
     repository_temp_dir_.CreateUniqueTempDir();
+    RecreateRepository();
+  }
+  void TearDown() override { Validate(); }
+
+  // Replaces the instance under test by a new one, over the same directory.
+  void RecreateRepository() {
     repository_.reset(new ReportRepository(
         repository_temp_dir_.path(),
         base::TimeDelta::FromSeconds(kRetryIntervalInSeconds),
@@ -72,7 +79,6 @@ class ReportRepositoryTest : public testing::Test {
         base::Bind(&ReportRepositoryTest::HandlePermanentFailure,
                    base::Unretained(this))));
   }
-  void TearDown() override { Validate(); }
 
   // Validates that all injected reports have been handled as expected, and that
   // the repository directory does not contain any leftover files.
@@ -187,6 +193,9 @@ class ReportRepositoryTest : public testing::Test {
   // Implements the UploadHandler.
   bool Upload(const base::FilePath& minidump_path,
               const std::map<base::string16, base::string16>& crash_keys) {
+    // Reports may be uploaded concurrently.
+    base::AutoLock auto_lock(upload_lock_);
+
     Report report;
     bool success = base::ReadFileToString(minidump_path, &report.first);
     EXPECT_TRUE(success);
@@ -270,6 +279,9 @@ class ReportRepositoryTest : public testing::Test {
   // The mock time.
   base::Time time_;
 
+  // Serializes the concurrent uploads.
+  base::Lock upload_lock_;
+
   // The instance under test.
   std::unique_ptr<ReportRepository> repository_;
 
@@ -363,6 +375,54 @@ TEST_F(ReportRepositoryTest, MultipleReportsTest) {
   EXPECT_TRUE(repository()->UploadPendingReport());  // No-op
 }
 
+TEST_F(ReportRepositoryTest, ConcurrentUploadsTest) {
+  repository()->set_max_concurrent_uploads(3);
+
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(1);
+
+  // The first round uploads three of the reports, the second round the last
+  // one, which fails.
+  size_t failures = 0;
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_TRUE(repository()->HasPendingReports());
+    if (!repository()->UploadPendingReport())
+      ++failures;
+  }
+  EXPECT_EQ(1U, failures);
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_TRUE(repository()->UploadPendingReport());  // Succeeds
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
+TEST_F(ReportRepositoryTest, FailureBackoffTest) {
+  repository()->set_initial_failure_backoff(
+      base::TimeDelta::FromSeconds(kHalfRetryIntervalInSeconds / 2));
+
+  InjectForSuccessAfterRetries(1);
+  EXPECT_FALSE(repository()->UploadPendingReport());  // Fails
+
+  // A new report is pending, but no upload is attempted while backing off.
+  InjectForSuccessAfterRetries(0);
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_FALSE(repository()->UploadPendingReport());  // Backs off
+  EXPECT_TRUE(repository()->HasPendingReports());
+
+  IncrementTime(base::TimeDelta::FromSeconds(kHalfRetryIntervalInSeconds / 2));
+  EXPECT_TRUE(repository()->UploadPendingReport());  // Succeeds
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  // The success reset the back off, the failed report is retried as usual.
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_TRUE(repository()->UploadPendingReport());  // Succeeds
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
 TEST_F(ReportRepositoryTest, MultipleReportsTestWithFailures) {
   EXPECT_FALSE(repository()->HasPendingReports());
 
@@ -477,6 +537,29 @@ TEST_F(ReportRepositoryTest, MultipleInterleavedReports) {
   EXPECT_FALSE(repository()->HasPendingReports());
 }
 
+TEST_F(ReportRepositoryTest, RetriesSurviveRestartTest) {
+  InjectForSuccessAfterRetries(1);
+  InjectForFailure();
+  EXPECT_FALSE(repository()->UploadPendingReport());  // Fails
+  EXPECT_FALSE(repository()->UploadPendingReport());  // Fails
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  // A new instance finds the retries in their directories.
+  RecreateRepository();
+  EXPECT_FALSE(repository()->HasPendingReports());
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  repository()->UploadPendingReport();
+  repository()->UploadPendingReport();
+
+  // The report that failed again was indexed by the new instance.
+  EXPECT_FALSE(repository()->HasPendingReports());
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_FALSE(repository()->UploadPendingReport());  // Fails permanently
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
 TEST_F(ReportRepositoryTest, CorruptionTest) {
   // In order to avoid hard-coding extensions/paths, and having a bunch of
   // permutations, let's run this test a bunch of times and probabilistically
@@ -14,6 +14,7 @@
 
 #include "syzygy/kasko/reporter.h"
 
+#include <psapi.h>
 #include <stdint.h>
 
 #include <map>
@@ -24,10 +25,14 @@
 #include "base/bind_helpers.h"
 #include "base/callback.h"
 #include "base/logging.h"
+#include "base/lazy_instance.h"
 #include "base/files/file_util.h"
 #include "base/memory/ptr_util.h"
 #include "base/process/process.h"
+#include "base/process/process_handle.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
 #include "base/time/time.h"
 #include "syzygy/kasko/http_agent_impl.h"
@@ -50,6 +55,21 @@ const base::char16* const kRpcProtocol = L"ncalrpc";
 // The subdirectory where minidumps are generated.
 const base::char16* const kTemporarySubdir = L"Temporary";
 
+// The maximum number of reports that are uploaded concurrently.
+const size_t kMaxConcurrentUploads = 4;
+
+// The number of workers that capture reports, the maximum number of captures
+// that may be pending, and the time during which the reports of a captured
+// crash are deduplicated.
+const size_t kNumCaptureWorkers = 2;
+const size_t kMaxPendingCaptures = 16;
+const int kCrashDeduplicationIntervalInMinutes = 5;
+
+// Serializes the invocations of an OnUploadCallback, as reports may be
+// uploaded concurrently.
+base::LazyInstance<base::Lock>::Leaky g_on_upload_callback_lock =
+    LAZY_INSTANCE_INITIALIZER;
+
 // Moves |minidump_path| and |crash_keys_path| to |permanent_failure_directory|.
 // The destination filenames have the filename from |minidump_path| and the
 // extensions Reporter::kPermanentFailureMinidumpExtension and
@@ -79,48 +99,137 @@ void HandlePermanentFailure(const base::FilePath& permanent_failure_directory,
   }
 }
 
-void GenerateReport(const base::FilePath& temporary_directory,
-                    ReportRepository* report_repository,
-                    base::ProcessHandle client_process,
-                    base::PlatformThreadId thread_id,
-                    const MinidumpRequest& request) {
+// Stores a captured report in |report_repository| and requests its upload.
+void StoreReport(ReportRepository* report_repository,
+                 UploadThread* upload_thread,
+                 const base::FilePath& dump_file,
+                 const std::map<base::string16, base::string16>& crash_keys) {
+  report_repository->StoreReport(dump_file, crash_keys);
+  upload_thread->UploadOneNowAsync();
+}
+
+// Captures the minidump of a report while its client waits. The crash keys of
+// |request| are copied, as they don't outlive the request, and the number of
+// reports that this one stands for is added to them.
+// @returns the closure that stores the report, or a null closure on failure.
+base::Closure CaptureReport(const base::FilePath& temporary_directory,
+                            ReportRepository* report_repository,
+                            UploadThread* upload_thread,
+                            base::ProcessHandle client_process,
+                            base::PlatformThreadId thread_id,
+                            const MinidumpRequest* request,
+                            size_t num_deduplicated) {
   if (!base::CreateDirectory(temporary_directory)) {
     LOG(ERROR) << "Failed to create dump destination directory: "
                << temporary_directory.value();
-    return;
+    return base::Closure();
   }
 
   base::FilePath dump_file;
   if (!base::CreateTemporaryFileInDir(temporary_directory, &dump_file)) {
     LOG(ERROR) << "Failed to create a temporary dump file.";
-    return;
+    return base::Closure();
   }
 
-  if (!GenerateMinidump(dump_file, client_process, thread_id, request)) {
+  if (!GenerateMinidump(dump_file, client_process, thread_id, *request)) {
     LOG(ERROR) << "Minidump generation failed.";
     base::DeleteFile(dump_file, false);
-    return;
+    return base::Closure();
   }
 
   std::map<base::string16, base::string16> crash_keys;
-  for (auto& crash_key : request.crash_keys) {
+  for (auto& crash_key : request->crash_keys) {
     crash_keys[crash_key.first] = crash_key.second;
   }
 
   crash_keys[Reporter::kKaskoGeneratedByVersion] =
       base::ASCIIToUTF16(KASKO_VERSION_STRING);
+  if (num_deduplicated) {
+    crash_keys[Reporter::kKaskoDeduplicatedReports] =
+        base::SizeTToString16(num_deduplicated);
+  }
 
-  report_repository->StoreReport(dump_file, crash_keys);
+  return base::Bind(&StoreReport, base::Unretained(report_repository),
+                    base::Unretained(upload_thread), dump_file, crash_keys);
+}
+
+// Computes the signature of the crash that |request| reports on.
+// @param client_process The process that is reported on.
+// @param request The report parameters.
+// @returns the signature of the crash.
+CaptureQueue::CrashSignature GetCrashSignature(
+    base::ProcessHandle client_process,
+    const MinidumpRequest& request) {
+  CaptureQueue::CrashSignature signature = {
+      base::GetProcId(client_process), 0, 0};
+  if (!request.exception_info_address)
+    return signature;
+
+  // The exception pointers live in the client process, or in this one.
+  HANDLE process = request.client_exception_pointers ? client_process
+                                                     : ::GetCurrentProcess();
+  EXCEPTION_POINTERS exception_pointers = {};
+  EXCEPTION_RECORD exception_record = {};
+  if (!::ReadProcessMemory(
+          process, reinterpret_cast<void*>(request.exception_info_address),
+          &exception_pointers, sizeof(exception_pointers), nullptr) ||
+      !::ReadProcessMemory(process, exception_pointers.ExceptionRecord,
+                           &exception_record, sizeof(exception_record),
+                           nullptr)) {
+    // Without its exception, a crash is keyed by its exception pointers.
+    signature.exception_address = request.exception_info_address;
+    return signature;
+  }
+
+  signature.exception_code = exception_record.ExceptionCode;
+  signature.exception_address =
+      reinterpret_cast<uint32_t>(exception_record.ExceptionAddress);
+
+  // An exception in a module is keyed by its module and RVA, which are the
+  // same in every process that crashes at the same place.
+  MEMORY_BASIC_INFORMATION memory_info = {};
+  wchar_t module_path[MAX_PATH] = {};
+  if (::VirtualQueryEx(client_process, exception_record.ExceptionAddress,
+                       &memory_info, sizeof(memory_info)) &&
+      memory_info.Type == MEM_IMAGE &&
+      ::GetMappedFileName(client_process, memory_info.AllocationBase,
+                          module_path, arraysize(module_path))) {
+    signature.process_id = 0;
+    signature.exception_address -=
+        reinterpret_cast<uint32_t>(memory_info.AllocationBase);
+    signature.module_name = base::FilePath(module_path).BaseName().value();
+  }
+  return signature;
+}
+
+// Captures a report through |capture_queue|, and blocks until it is captured.
+void GenerateReport(CaptureQueue* capture_queue,
+                    const base::FilePath& temporary_directory,
+                    ReportRepository* report_repository,
+                    UploadThread* upload_thread,
+                    base::ProcessHandle client_process,
+                    base::PlatformThreadId thread_id,
+                    const MinidumpRequest& request) {
+  CaptureQueue::Result result = capture_queue->Capture(
+      GetCrashSignature(client_process, request),
+      base::Bind(&CaptureReport, temporary_directory,
+                 base::Unretained(report_repository),
+                 base::Unretained(upload_thread), client_process, thread_id,
+                 base::Unretained(&request)));
+  LOG_IF(INFO, result == CaptureQueue::DEDUPLICATED)
+      << "Counting a report of a recently captured crash.";
 }
 
 // Implements kasko::Service to capture minidumps and store them in a
 // ReportRepository.
 class ServiceImpl : public Service {
  public:
-  ServiceImpl(const base::FilePath& temporary_directory,
+  ServiceImpl(CaptureQueue* capture_queue,
+              const base::FilePath& temporary_directory,
               ReportRepository* report_repository,
               UploadThread* upload_thread)
-      : temporary_directory_(temporary_directory),
+      : capture_queue_(capture_queue),
+        temporary_directory_(temporary_directory),
         report_repository_(report_repository),
         upload_thread_(upload_thread) {}
 
@@ -134,13 +243,14 @@ class ServiceImpl : public Service {
         ::OpenProcess(GetRequiredAccessForMinidumpType(request.type), FALSE,
                       client_process_id));
     if (client_process.IsValid()) {
-      GenerateReport(temporary_directory_, report_repository_,
-                     client_process.Get(), thread_id, request);
+      GenerateReport(capture_queue_, temporary_directory_, report_repository_,
+                     upload_thread_, client_process.Get(), thread_id,
+                     request);
     }
-    upload_thread_->UploadOneNowAsync();
   }
 
  private:
+  CaptureQueue* capture_queue_;
   base::FilePath temporary_directory_;
   ReportRepository* report_repository_;
   UploadThread* upload_thread_;
@@ -160,6 +270,8 @@ const base::char16* const Reporter::kKaskoGeneratedByVersion =
     L"kasko-generated-by-version";
 const base::char16* const Reporter::kKaskoUploadedByVersion =
     L"kasko-uploaded-by-version";
+const base::char16* const Reporter::kKaskoDeduplicatedReports =
+    L"kasko-deduplicated-reports";
 
 // static
 std::unique_ptr<Reporter> Reporter::Create(
@@ -181,6 +293,9 @@ std::unique_ptr<Reporter> Reporter::Create(
       data_directory, retry_interval, base::Bind(&base::Time::Now),
       base::Bind(&UploadCrashReport, on_upload_callback, url),
       base::Bind(&HandlePermanentFailure, permanent_failure_directory)));
+  report_repository->set_max_concurrent_uploads(kMaxConcurrentUploads);
+  // After a failure, wait for at least one more upload interval.
+  report_repository->set_initial_failure_backoff(upload_interval);
 
   // It's safe to pass an Unretained reference to |report_repository| because
   // the Reporter instance will shut down |upload_thread| before destroying
@@ -214,16 +329,28 @@ Reporter::~Reporter() {}
 void Reporter::SendReportForProcess(base::ProcessHandle process_handle,
                                     base::PlatformThreadId thread_id,
                                     MinidumpRequest request) {
-  GenerateReport(temporary_minidump_directory_, report_repository_.get(),
+  GenerateReport(capture_queue_.get(), temporary_minidump_directory_,
+                 report_repository_.get(), upload_thread_.get(),
                  process_handle, thread_id, request);
-  upload_thread_->UploadOneNowAsync();
+}
+
+CaptureQueue::Stats Reporter::GetCaptureStats() const {
+  return capture_queue_->GetStats();
 }
 
 // static
 void Reporter::Shutdown(std::unique_ptr<Reporter> instance) {
   instance->upload_thread_->Stop();  // Non-blocking.
   instance->service_bridge_.Stop();  // Blocking.
+  instance->capture_queue_->Shutdown();  // Blocking.
   instance->upload_thread_->Join();  // Blocking.
+
+  CaptureQueue::Stats stats = instance->capture_queue_->GetStats();
+  VLOG(1) << "Captured " << stats.captured << " reports, deduplicated "
+          << stats.deduplicated << " and dropped " << stats.dropped
+          << ". Maximum queue depth: " << stats.max_queue_depth
+          << ", maximum capture latency: "
+          << stats.max_capture_latency.InMilliseconds() << " ms.";
 }
 
 // static
@@ -247,11 +374,12 @@ bool Reporter::UploadCrashReport(
   augmented_crash_keys[Reporter::kKaskoUploadedByVersion] =
       base::ASCIIToUTF16(KASKO_VERSION_STRING);
   if (!SendHttpUpload(&http_agent, upload_url, augmented_crash_keys,
-                      dump_contents, Reporter::kMinidumpUploadFilePart,
+                      dump_contents, Reporter::kMinidumpUploadFilePart, true,
                       &remote_dump_id, &response_code)) {
     LOG(ERROR) << "Failed to upload the minidump file to " << upload_url;
     return false;
   } else if (!on_upload_callback.is_null()) {
+    base::AutoLock auto_lock(g_on_upload_callback_lock.Get());
     on_upload_callback.Run(remote_dump_id, minidump_path, crash_keys);
   }
 
@@ -265,10 +393,15 @@ Reporter::Reporter(std::unique_ptr<ReportRepository> report_repository,
     : report_repository_(std::move(report_repository)),
       upload_thread_(std::move(upload_thread)),
       temporary_minidump_directory_(temporary_minidump_directory),
+      capture_queue_(new CaptureQueue(
+          kMaxPendingCaptures, kNumCaptureWorkers,
+          base::TimeDelta::FromMinutes(
+              kCrashDeduplicationIntervalInMinutes))),
       service_bridge_(
           kRpcProtocol,
           endpoint_name,
-          base::WrapUnique(new ServiceImpl(temporary_minidump_directory_,
+          base::WrapUnique(new ServiceImpl(capture_queue_.get(),
+                                           temporary_minidump_directory_,
                                            report_repository_.get(),
                                            upload_thread_.get()))) {
 }
@@ -24,6 +24,7 @@
 #include "base/process/process_handle.h"
 #include "base/strings/string16.h"
 #include "base/threading/platform_thread.h"
+#include "syzygy/kasko/capture_queue.h"
 #include "syzygy/kasko/report_repository.h"
 #include "syzygy/kasko/service_bridge.h"
 
@@ -59,8 +60,13 @@ class Reporter {
   // An crash key added to all reports, indicating the version of Kasko that
   // uploaded the report.
   static const base::char16* const kKaskoUploadedByVersion;
+  // A crash key added to reports that stand for deduplicated reports of the
+  // same crash, giving their number.
+  static const base::char16* const kKaskoDeduplicatedReports;
 
-  // Receives notification when a report has been uploaded.
+  // Receives notification when a report has been uploaded. Reports are
+  // uploaded concurrently by worker threads, but the invocations are
+  // serialized.
   // @param report_id The server-assigned report ID.
   // @param minidump_path The local path to the report file. This path is no
   //     longer valid after the callback returns.
@@ -104,6 +110,9 @@ class Reporter {
                             base::PlatformThreadId thread_id,
                             MinidumpRequest request);
 
+  // @returns the metrics of the capture of the reports.
+  CaptureQueue::Stats GetCaptureStats() const;
+
   // Shuts down and destroys a Reporter process. Blocks until all background
   // tasks have terminated.
   // @param instance The Reporter process instance to shut down.
@@ -145,6 +154,9 @@ class Reporter {
   // The directory where minidumps will be initially created.
   base::FilePath temporary_minidump_directory_;
 
+  // Runs the captures of the reports.
+  std::unique_ptr<CaptureQueue> capture_queue_;
+
   // An RPC service endpoint.
   ServiceBridge service_bridge_;
 
@@ -13,6 +13,7 @@
 # limitations under the License.
 
 import BaseHTTPServer
+import cStringIO
 import cgi
 import msvcrt
 import optparse
@@ -22,6 +23,7 @@ import struct
 import sys
 import tempfile
 import uuid
+import zlib
 
 def serve_file_handler(file_path):
   class ServeFileHandler(BaseHTTPServer.BaseHTTPRequestHandler):
@@ -49,7 +51,12 @@ def multipart_form_handler(incoming_directory):
           self.headers.getheader('content-type'))
       if content_type != 'multipart/form-data':
         raise Exception('Unsupported Content-Type: ' + content_type)
-      post_multipart = cgi.parse_multipart(self.rfile, parameters)
+      body = self.rfile
+      if self.headers.getheader('content-encoding') == 'gzip':
+        length = int(self.headers.getheader('content-length'))
+        body = cStringIO.StringIO(
+            zlib.decompress(self.rfile.read(length), 16 + zlib.MAX_WBITS))
+      post_multipart = cgi.parse_multipart(body, parameters)
       if self.path == '/crash_failure':
         self.log_error('Simulating upload failure.')
         self.send_response(500)
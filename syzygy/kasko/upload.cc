@@ -20,6 +20,7 @@
 #include "syzygy/kasko/http_agent.h"
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
+#include "third_party/zlib/zlib.h"
 
 namespace kasko {
 
@@ -158,6 +159,7 @@ bool SendHttpUpload(HttpAgent* agent,
                     const std::map<base::string16, base::string16>& parameters,
                     const std::string& upload_file,
                     const base::string16& file_part_name,
+                    bool compress_body,
                     base::string16* response_body,
                     uint16_t* response_code) {
   DCHECK(response_body);
@@ -179,14 +181,26 @@ bool SendHttpUpload(HttpAgent* agent,
   }
 
   base::string16 boundary = GenerateMultipartHttpRequestBoundary();
-  base::string16 content_type_header =
+  base::string16 extra_headers =
       GenerateMultipartHttpRequestContentTypeHeader(boundary);
 
   std::string request_body = GenerateMultipartHttpRequestBody(
       parameters, upload_file, file_part_name, boundary);
 
+  // Minidumps compress well, and the upload bandwidth is the main cost of
+  // reporting a crash.
+  if (compress_body) {
+    std::string compressed_body;
+    if (!GzipCompress(request_body, &compressed_body)) {
+      LOG(ERROR) << "Failed to compress the request body.";
+      return false;
+    }
+    request_body.swap(compressed_body);
+    extra_headers += L"\r\nContent-Encoding: gzip";
+  }
+
   std::unique_ptr<HttpResponse> response =
-      agent->Post(host, port, path, secure, content_type_header, request_body);
+      agent->Post(host, port, path, secure, extra_headers, request_body);
   if (!response) {
     LOG(ERROR) << "Request to " << url << " failed.";
     return false;
@@ -217,4 +231,35 @@ bool SendHttpUpload(HttpAgent* agent,
   return true;
 }
 
+bool GzipCompress(const std::string& input, std::string* output) {
+  DCHECK(output);
+
+  z_stream stream = {};
+  // Adding 16 to the window bits selects the gzip format rather than zlib.
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16,
+                   8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    LOG(ERROR) << "deflateInit2 failed.";
+    return false;
+  }
+
+  // Reserve the worst case, plus room for the gzip header and trailer that
+  // deflateBound doesn't account for, so that a single call suffices.
+  output->resize(deflateBound(&stream, static_cast<uLong>(input.size())) + 18);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&(*output)[0]);
+  stream.avail_out = static_cast<uInt>(output->size());
+  int result = deflate(&stream, Z_FINISH);
+  output->resize(stream.total_out);
+  deflateEnd(&stream);
+
+  if (result != Z_STREAM_END) {
+    LOG(ERROR) << "deflate failed: " << result;
+    output->clear();
+    return false;
+  }
+  return true;
+}
+
 }  // namespace kasko
@@ -31,6 +31,8 @@ class HttpAgent;
 // @param parameters HTTP request parameters to be encoded in the body.
 // @param upload_file File contents to be encoded in the body.
 // @param file_part_name The parameter name to be assigned to the file part.
+// @param compress_body Whether to gzip the body, which is then sent with a
+//     "Content-Encoding: gzip" header.
 // @param response_body Receives the HTTP response body.
 // @param response_code Receives the HTTP response status code.
 // @returns true if successful.
@@ -39,9 +41,16 @@ bool SendHttpUpload(HttpAgent* agent,
                     const std::map<base::string16, base::string16>& parameters,
                     const std::string& upload_file,
                     const base::string16& file_part_name,
+                    bool compress_body,
                     base::string16* response_body,
                     uint16_t* response_code);
 
+// Compresses data in the gzip format.
+// @param input The data to compress.
+// @param output Receives the compressed data.
+// @returns true if successful.
+bool GzipCompress(const std::string& input, std::string* output);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_UPLOAD_H_
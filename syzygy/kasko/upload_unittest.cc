@@ -32,11 +32,33 @@
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
 #include "syzygy/kasko/internet_unittest_helpers.h"
+#include "third_party/zlib/zlib.h"
 
 namespace kasko {
 
 namespace {
 
+// Decompresses gzipped data. Returns true if successful.
+bool GzipDecompress(const std::string& input, std::string* output) {
+  z_stream stream = {};
+  if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK)
+    return false;
+
+  output->clear();
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  int result = Z_OK;
+  while (result == Z_OK) {
+    char buffer[256];
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    result = inflate(&stream, Z_NO_FLUSH);
+    output->append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  inflateEnd(&stream);
+  return result == Z_STREAM_END;
+}
+
 // An implementation of HttpAgent that performs a sanity check on the request
 // parameters before returning a fixed HttpResponse.
 class MockHttpAgent : public HttpAgent {
@@ -50,6 +72,7 @@ class MockHttpAgent : public HttpAgent {
     std::map<base::string16, base::string16> parameters;
     std::string file;
     base::string16 file_name;
+    bool compressed;
   };
 
   MockHttpAgent();
@@ -108,8 +131,22 @@ std::unique_ptr<HttpResponse> MockHttpAgent::Post(
 
   base::string16 boundary;
 
+  // The Content-Type header comes first. It is followed by a Content-Encoding
+  // header if the body is compressed.
+  base::string16 content_type_header = extra_headers;
+  std::string decoded_body = body;
+  size_t content_encoding_start = extra_headers.find(L"\r\n");
+  if (content_encoding_start != base::string16::npos) {
+    content_type_header = extra_headers.substr(0, content_encoding_start);
+    EXPECT_EQ(L"Content-Encoding: gzip",
+              extra_headers.substr(content_encoding_start + 2));
+    EXPECT_TRUE(GzipDecompress(body, &decoded_body));
+  }
+  EXPECT_EQ(expectations_.compressed,
+            content_encoding_start != base::string16::npos);
+
   base::StringTokenizerT<base::string16, base::string16::const_iterator>
-      tokenizer(extra_headers.begin(), extra_headers.end(), L":");
+      tokenizer(content_type_header.begin(), content_type_header.end(), L":");
   if (!tokenizer.GetNext()) {
     ADD_FAILURE() << "Failed to parse Content-Type from extra headers: "
                   << extra_headers;
@@ -121,10 +158,10 @@ std::unique_ptr<HttpResponse> MockHttpAgent::Post(
     } else {
       base::string16 mime_type, charset;
       bool had_charset = false;
-      // Use extra_headers.end() since we don't want to choke on a theoretical :
-      // embedded in the value.
+      // Use content_type_header.end() since we don't want to choke on a
+      // theoretical : embedded in the value.
       ParseContentType(
-          base::string16(tokenizer.token_begin(), extra_headers.end()),
+          base::string16(tokenizer.token_begin(), content_type_header.end()),
           &mime_type, &charset, &had_charset, &boundary);
     }
   }
@@ -133,7 +170,7 @@ std::unique_ptr<HttpResponse> MockHttpAgent::Post(
 
   ExpectMultipartMimeMessageIsPlausible(
       boundary, expectations_.parameters, expectations_.file,
-      base::WideToUTF8(expectations_.file_name), body);
+      base::WideToUTF8(expectations_.file_name), decoded_body);
 
   EXPECT_EQ(expectations_.host, host);
 
@@ -295,6 +332,7 @@ class UploadTest : public testing::Test {
     agent().expectations().file_name = L"file_name";
     agent().expectations().file = "file contents";
     agent().expectations().parameters[L"param"] = L"value";
+    agent().expectations().compressed = false;
   }
 
   MockHttpAgent& agent() { return agent_; }
@@ -311,7 +349,8 @@ bool UploadTest::SendUpload(base::string16* response_body,
       &agent(), (agent().expectations().secure ? L"https://" : L"http://") +
                     agent().expectations().host + agent().expectations().path,
       agent().expectations().parameters, agent().expectations().file,
-      agent().expectations().file_name, response_body, response_code);
+      agent().expectations().file_name,
+      agent().expectations().compressed, response_body, response_code);
 }
 
 TEST_F(UploadTest, PostFails) {
@@ -337,6 +376,24 @@ TEST_F(UploadTest, PostSucceeds) {
   EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
 }
 
+TEST_F(UploadTest, PostSucceedsCompressed) {
+  const std::string kResponse = "hello world";
+
+  std::unique_ptr<MockHttpResponse> mock_response(new MockHttpResponse);
+  std::vector<std::string> data;
+  data.push_back(kResponse);
+  data.push_back(std::string());
+  mock_response->set_data(data);
+  agent().set_response(std::move(mock_response));
+  agent().expectations().compressed = true;
+
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_TRUE(SendUpload(&response_body, &response_code));
+  EXPECT_EQ(200, response_code);
+  EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
+}
+
 TEST_F(UploadTest, PostSucceedsSecure) {
   const std::string kResponse = "hello world";
 
@@ -364,7 +421,8 @@ TEST_F(UploadTest, InvalidURL) {
       &agent(),
       L"@@::/:" + agent().expectations().host + agent().expectations().path,
       agent().expectations().parameters, agent().expectations().file,
-      agent().expectations().file_name, &response_body, &response_code));
+      agent().expectations().file_name,
+      agent().expectations().compressed, &response_body, &response_code));
 }
 
 TEST_F(UploadTest, BadScheme) {
@@ -375,7 +433,8 @@ TEST_F(UploadTest, BadScheme) {
       &agent(),
       L"ftp://" + agent().expectations().host + agent().expectations().path,
       agent().expectations().parameters, agent().expectations().file,
-      agent().expectations().file_name, &response_body, &response_code));
+      agent().expectations().file_name,
+      agent().expectations().compressed, &response_body, &response_code));
 }
 
 TEST_F(UploadTest, GetStatusFails) {
@@ -621,4 +680,22 @@ TEST_F(UploadTest, WideResponse) {
   EXPECT_EQ(kResponse, response_body);
 }
 
+TEST(GzipCompressTest, RoundTrip) {
+  std::string input;
+  for (size_t i = 0; i < 10000; ++i)
+    input += static_cast<char>(i % 7);
+
+  std::string compressed;
+  ASSERT_TRUE(GzipCompress(input, &compressed));
+  EXPECT_LT(compressed.size(), input.size());
+
+  std::string decompressed;
+  ASSERT_TRUE(GzipDecompress(compressed, &decompressed));
+  EXPECT_EQ(input, decompressed);
+
+  ASSERT_TRUE(GzipCompress(std::string(), &compressed));
+  ASSERT_TRUE(GzipDecompress(compressed, &decompressed));
+  EXPECT_TRUE(decompressed.empty());
+}
+
 }  // namespace kasko
@@ -61,6 +61,10 @@ Minidump::TypedThreadExList Minidump::GetThreadExList() const {
   return TypedThreadExList(*this, ThreadExListStream);
 }
 
+const uint8_t* Minidump::GetBytes(size_t offset, size_t data_size) const {
+  return nullptr;
+}
+
 bool Minidump::ReadDirectory() {
   // Read the header and validate the signature.
   MINIDUMP_HEADER header = {};
@@ -119,6 +123,7 @@ bool FileMinidump::ReadBytes(size_t offset,
                              size_t data_size,
                              void* data) const {
   DCHECK_LE(offset, static_cast<size_t>(std::numeric_limits<long>::max()));
+  base::AutoLock auto_lock(file_lock_);
   if (fseek(file_.get(), static_cast<long>(offset), SEEK_SET) != 0)
     return false;
 
@@ -143,14 +148,30 @@ bool BufferMinidump::Initialize(const uint8_t* buf, size_t buf_len) {
 bool BufferMinidump::ReadBytes(size_t offset,
                                size_t data_size,
                                void* data) const {
+  const uint8_t* bytes = GetBytes(offset, data_size);
+  if (bytes == nullptr)
+    return false;
+
+  ::memcpy(data, bytes, data_size);
+  return true;
+}
+
+const uint8_t* BufferMinidump::GetBytes(size_t offset,
+                                        size_t data_size) const {
   // Bounds check the request.
   if (offset >= buf_len_ || offset + data_size > buf_len_ ||
       offset + data_size < offset) {  // Test for overflow.
-    return false;
+    return nullptr;
   }
 
-  ::memcpy(data, buf_ + offset, data_size);
-  return true;
+  return buf_ + offset;
+}
+
+bool MappedFileMinidump::Open(const base::FilePath& path) {
+  if (!file_.Initialize(path))
+    return false;
+
+  return Initialize(file_.data(), file_.length());
 }
 
 Minidump::Stream::Stream()
@@ -177,6 +198,13 @@ bool Minidump::Stream::ReadAndAdvanceBytes(size_t data_len, std::string* data) {
   DCHECK(minidump_ != nullptr);
   DCHECK(data != nullptr);
 
+  // Construct the string straight from memory when the minidump allows it.
+  const uint8_t* bytes = nullptr;
+  if (GetBytes(data_len, &bytes)) {
+    data->assign(reinterpret_cast<const char*>(bytes), data_len);
+    return AdvanceBytes(data_len);
+  }
+
   data->resize(data_len);
   bool success = ReadAndAdvanceBytes(data_len, &data->at(0));
   if (!success)
@@ -222,6 +250,21 @@ bool Minidump::Stream::ReadBytes(size_t data_len, void* data) {
   return true;
 }
 
+bool Minidump::Stream::GetBytes(size_t data_len, const uint8_t** data) const {
+  DCHECK(minidump_ != nullptr);
+  DCHECK(data != nullptr);
+
+  if (data_len > remaining_length_)
+    return false;
+
+  const uint8_t* bytes = minidump_->GetBytes(current_offset_, data_len);
+  if (bytes == nullptr)
+    return false;
+
+  *data = bytes;
+  return true;
+}
+
 bool Minidump::Stream::AdvanceBytes(size_t data_len) {
   if (data_len > remaining_length_)
     return false;
@@ -26,7 +26,9 @@
 
 #include "base/macros.h"
 #include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/files/scoped_file.h"
+#include "base/synchronization/lock.h"
 
 namespace minidump {
 
@@ -112,6 +114,13 @@ class Minidump {
   // @returns true on success, false on failure, including a short read.
   virtual bool ReadBytes(size_t offset, size_t data_size, void* data) const = 0;
 
+  // Gets a pointer to file contents, for minidumps that are backed by memory.
+  // @param offset the file offset of the contents.
+  // @param data_size the size of the contents.
+  // @returns a pointer to the @p data_size bytes at @p offset, or nullptr if
+  //     they're out of bounds or the minidump is not backed by memory.
+  virtual const uint8_t* GetBytes(size_t offset, size_t data_size) const;
+
   bool ReadDirectory();
 
   std::vector<MINIDUMP_DIRECTORY> directory_;
@@ -121,6 +130,8 @@ class Minidump {
 };
 
 // Allows parsing a minidump from a file.
+// @note Reads are serialized, so that a file minidump may be read from several
+//     threads.
 class FileMinidump : public Minidump {
  public:
   // Opens the minidump file at @p path and verifies its header structure.
@@ -132,6 +143,8 @@ class FileMinidump : public Minidump {
   bool ReadBytes(size_t offset, size_t data_size, void* data) const override;
 
  private:
+  // Guards the position of file_.
+  mutable base::Lock file_lock_;
   base::ScopedFILE file_;
 };
 
@@ -150,6 +163,7 @@ class BufferMinidump : public Minidump {
 
  protected:
   bool ReadBytes(size_t offset, size_t data_size, void* data) const override;
+  const uint8_t* GetBytes(size_t offset, size_t data_size) const override;
 
  private:
   // Not owned.
@@ -157,6 +171,21 @@ class BufferMinidump : public Minidump {
   size_t buf_len_;
 };
 
+// Allows parsing a minidump from a memory-mapped file. The file is mapped once
+// on open, after which reads are served from the mapping without any file
+// I/O. This is a drop-in replacement for FileMinidump, and is safe to read
+// from several threads.
+class MappedFileMinidump : public BufferMinidump {
+ public:
+  // Maps the minidump file at @p path and verifies its header structure.
+  // @param path the minidump file to map.
+  // @return true on success, false on failure.
+  bool Open(const base::FilePath& path);
+
+ private:
+  base::MemoryMappedFile file_;
+};
+
 // A forward-only reading class that bounds reads to streams that make it safe
 // and easy to parse minidump streams. Streams are lightweight objects that
 // can be freely copied.
@@ -187,6 +216,15 @@ class Minidump::Stream {
   bool AdvanceBytes(size_t data_len);
   // @}
 
+  // Gets a pointer to the next @p data_len bytes of the stream without copying
+  // them, nor advancing over them.
+  // @param data_len the number of bytes to get.
+  // @param data on success, receives a pointer to the bytes. The pointer is
+  //     valid for the lifetime of the minidump.
+  // @returns true on success, false if the stream doesn't cover @p data_len
+  //     bytes or the minidump is not backed by memory.
+  bool GetBytes(size_t data_len, const uint8_t** data) const;
+
   // Accessors.
   size_t current_offset() const { return current_offset_; }
   size_t remaining_length() const { return remaining_length_; }
@@ -196,6 +196,53 @@ TEST_F(FileMinidumpTest, GetThreadExList) {
 }
 #endif
 
+TEST_F(FileMinidumpTest, MappedFileMinidumpOpenFailsForInvalidFile) {
+  MappedFileMinidump minidump;
+
+  // Try opening a non-existing file.
+  ASSERT_FALSE(minidump.Open(dump_file()));
+}
+
+TEST_F(FileMinidumpTest, MappedFileMinidumpMatchesFileMinidump) {
+  FileMinidump file_minidump;
+  ASSERT_TRUE(file_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+  MappedFileMinidump mapped_minidump;
+  ASSERT_TRUE(
+      mapped_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+  ASSERT_EQ(file_minidump.directory().size(),
+            mapped_minidump.directory().size());
+
+  auto file_memory = file_minidump.GetMemoryList();
+  auto mapped_memory = mapped_minidump.GetMemoryList();
+  ASSERT_TRUE(file_memory.IsValid());
+  ASSERT_TRUE(mapped_memory.IsValid());
+
+  auto file_it = file_memory.begin();
+  auto mapped_it = mapped_memory.begin();
+  for (; file_it != file_memory.end(); ++file_it, ++mapped_it) {
+    ASSERT_TRUE(mapped_it != mapped_memory.end());
+    const MINIDUMP_MEMORY_DESCRIPTOR& descriptor = *file_it;
+    ASSERT_EQ(descriptor.Memory.Rva, (*mapped_it).Memory.Rva);
+
+    Minidump::Stream file_stream =
+        file_minidump.GetStreamFor(descriptor.Memory);
+    Minidump::Stream mapped_stream =
+        mapped_minidump.GetStreamFor(descriptor.Memory);
+
+    std::string file_bytes;
+    ASSERT_TRUE(file_stream.ReadAndAdvanceBytes(descriptor.Memory.DataSize,
+                                                &file_bytes));
+    const uint8_t* mapped_bytes = nullptr;
+    ASSERT_TRUE(
+        mapped_stream.GetBytes(descriptor.Memory.DataSize, &mapped_bytes));
+    EXPECT_EQ(0, ::memcmp(file_bytes.data(), mapped_bytes, file_bytes.size()));
+
+    // A file minidump is not backed by memory.
+    EXPECT_FALSE(file_minidump.GetStreamFor(descriptor.Memory)
+                     .GetBytes(descriptor.Memory.DataSize, &mapped_bytes));
+  }
+}
+
 TEST(BufferMinidumpTest, InitFailsForInvalidFile) {
   // Opening an empty buffer should fail.
   {
@@ -296,6 +343,17 @@ TEST(BufferMinidumpTest, StreamTest) {
   // No moar data.
   EXPECT_FALSE(test.ReadBytes(1, &bytes));
 
+  // Bytes can't be got past the end of the stream.
+  test = minidump.GetStreamFor(loc);
+  const uint8_t* ptr = nullptr;
+  EXPECT_FALSE(test.GetBytes(8, &ptr));
+  EXPECT_EQ(nullptr, ptr);
+
+  // Getting bytes neither copies nor advances.
+  ASSERT_TRUE(test.GetBytes(7, &ptr));
+  EXPECT_EQ(buf.data() + sizeof(MINIDUMP_HEADER), ptr);
+  EXPECT_EQ(7U, test.remaining_length());
+
   // Reset the stream to test reading via a string.
   test = minidump.GetStreamFor(loc);
   std::string data;
@@ -74,7 +74,8 @@ class MsfFileStreamImpl : public MsfStreamImpl<T> {
   virtual ~MsfFileStreamImpl();
 
   // Read @p count bytes from @p offset byte offset from page @p page_num and
-  // store them in @p dest.
+  // store them in @p dest. The read may extend past the end of the page, in
+  // which case the following pages of the file are read.
   bool ReadFromPage(void* dest, uint32_t page_num, size_t offset, size_t count);
 
  private:
@@ -49,11 +49,19 @@ bool MsfFileStreamImpl<T>::ReadBytesAt(size_t pos, size_t count, void* dest) {
   if (count > length() - pos)
     return false;
 
-  // Read the stream.
+  // Read the stream. Pages that are contiguous in the file are read with a
+  // single seek and read, which makes large reads of streams that were written
+  // sequentially much cheaper.
   while (count > 0) {
     size_t page_index = pos / page_size_;
     size_t offset = pos % page_size_;
-    size_t chunk_size = std::min(count, page_size_ - (pos % page_size_));
+    size_t chunk_size = std::min(count, page_size_ - offset);
+    size_t last_page_index = page_index;
+    while (chunk_size < count && last_page_index + 1 < pages_.size() &&
+           pages_[last_page_index + 1] == pages_[last_page_index] + 1) {
+      ++last_page_index;
+      chunk_size = std::min(count, chunk_size + page_size_);
+    }
     if (!ReadFromPage(dest, pages_[page_index], offset, chunk_size))
       return false;
 
@@ -71,7 +79,7 @@ bool MsfFileStreamImpl<T>::ReadFromPage(void* dest,
                                         size_t offset,
                                         size_t count) {
   DCHECK(dest != NULL);
-  DCHECK(offset + count <= page_size_);
+  DCHECK_LT(offset, page_size_);
 
   size_t page_offset = page_size_ * page_num;
   if (fseek(file_->file(),
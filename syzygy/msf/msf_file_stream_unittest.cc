@@ -120,4 +120,22 @@ TEST_F(MsfFileStreamTest, ReadBytesAt) {
   }
 }
 
+TEST_F(MsfFileStreamTest, ReadBytesAtAcrossNonContiguousPages) {
+  // Only pages 0 and 1 are contiguous in the file, the reads need to be split
+  // around them.
+  size_t pages[] = {2, 0, 1, 3};
+  scoped_refptr<TestMsfFileStream> stream(
+      new TestMsfFileStream(file_.get(), 16, pages, 4));
+
+  char buffer[16] = {0};
+  EXPECT_TRUE(stream->ReadBytesAt(0, 16, &buffer));
+  EXPECT_EQ(0, ::memcmp(buffer, "t C/MicrosofC++ ", 16));
+
+  EXPECT_TRUE(stream->ReadBytesAt(2, 13, &buffer));
+  EXPECT_EQ(0, ::memcmp(buffer, "C/MicrosofC++", 13));
+
+  EXPECT_TRUE(stream->ReadBytesAt(5, 6, &buffer));
+  EXPECT_EQ(0, ::memcmp(buffer, "icroso", 6));
+}
+
 }  // namespace msf
@@ -0,0 +1,145 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares MsfMappedStreamImpl, an MSF stream that reads its data from a
+// memory-mapped MSF file. The streams of a mapped file share the mapping and
+// the directory of the file: a stream reads its page list in place in the
+// directory the first time it is read, and is otherwise a handful of words.
+
+#ifndef SYZYGY_MSF_MSF_MAPPED_STREAM_H_
+#define SYZYGY_MSF_MSF_MAPPED_STREAM_H_
+
+#include <vector>
+
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/msf/msf_decl.h"
+#include "syzygy/msf/msf_stream.h"
+
+namespace msf {
+
+// A reference counted memory-mapped MSF file, along with its directory. This
+// is shared by all the streams of the file so that they can outlive the
+// MsfReaderImpl that created them.
+// NOTE: This is not thread safe, and the directory must not be modified once
+//     streams refer to it.
+class RefCountedMappedMsfFile
+    : public base::RefCounted<RefCountedMappedMsfFile> {
+ public:
+  RefCountedMappedMsfFile() : page_size_(0) {}
+
+  // @returns the mapping of the file.
+  base::MemoryMappedFile* file() { return &file_; }
+
+  // @returns the contents of the file.
+  const uint8_t* data() const { return file_.data(); }
+
+  // @returns the size of the file, in bytes.
+  size_t length() const { return file_.length(); }
+
+  // @returns the directory of the file.
+  std::vector<uint32_t>* directory() { return &directory_; }
+  const std::vector<uint32_t>& directory() const { return directory_; }
+
+  // @name Accessors for the size of the pages of the file.
+  // @{
+  uint32_t page_size() const { return page_size_; }
+  void set_page_size(uint32_t page_size) { page_size_ = page_size; }
+  // @}
+
+ private:
+  friend base::RefCounted<RefCountedMappedMsfFile>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~RefCountedMappedMsfFile() {}
+
+  base::MemoryMappedFile file_;
+  std::vector<uint32_t> directory_;
+  uint32_t page_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(RefCountedMappedMsfFile);
+};
+
+namespace detail {
+
+// This class represents an MSF stream in a memory-mapped file.
+template <MsfFileType T>
+class MsfMappedStreamImpl : public MsfStreamImpl<T> {
+ public:
+  // Constructor.
+  // @param file the reference counted mapped file housing this stream.
+  // @param length the length of this stream.
+  // @param first_page the index in the directory of @p file of the first page
+  //     of this stream. The length of the page list is implicit in the stream
+  //     length and the page size.
+  MsfMappedStreamImpl(RefCountedMappedMsfFile* file,
+                      uint32_t length,
+                      size_t first_page);
+
+  // MsfStreamImpl implementation.
+  bool ReadBytesAt(size_t pos, size_t count, void* dest) override;
+
+  // Returns a pointer to @p count bytes of the stream starting at @p pos,
+  // without copying them. This is only possible when the bytes are on pages
+  // that are contiguous in the file.
+  // @param pos the position in the stream of the first byte.
+  // @param count the number of bytes.
+  // @returns a pointer to the bytes in the mapping, or nullptr if they are
+  //     not contiguous in the file or are out of bounds. The pointer remains
+  //     valid as long as this stream lives.
+  const uint8_t* GetDataAt(size_t pos, size_t count);
+
+ protected:
+  // Protected to enforce reference counted pointers at compile time.
+  virtual ~MsfMappedStreamImpl();
+
+  // Validates the page list of the stream the first time it is needed.
+  // @returns true if all the pages of the stream lie in the file.
+  bool EnsurePagesValidated();
+
+  // Returns the run of pages that are contiguous in the file, starting with
+  // the page of the stream holding @p pos and covering at most @p count bytes.
+  // @param pos the position in the stream of the first byte.
+  // @param count the maximum number of bytes of the run.
+  // @returns the number of bytes of the run, which are located at
+  //     @p *data in the mapping.
+  size_t GetContiguousRun(size_t pos, size_t count, const uint8_t** data);
+
+ private:
+  // The mapped MSF file and its directory.
+  scoped_refptr<RefCountedMappedMsfFile> file_;
+
+  // The index in the directory of the first page of this stream.
+  size_t first_page_;
+
+  // The number of pages of this stream.
+  size_t page_count_;
+
+  // Whether the page list has been validated, and the result.
+  bool pages_validated_;
+  bool pages_valid_;
+
+  DISALLOW_COPY_AND_ASSIGN(MsfMappedStreamImpl);
+};
+
+}  // namespace detail
+
+using MsfMappedStream = detail::MsfMappedStreamImpl<kGenericMsfFileType>;
+
+}  // namespace msf
+
+#include "syzygy/msf/msf_mapped_stream_impl.h"
+
+#endif  // SYZYGY_MSF_MSF_MAPPED_STREAM_H_
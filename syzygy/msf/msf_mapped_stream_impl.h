@@ -0,0 +1,142 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation details for msf_mapped_stream.h. Not meant to be
+// included directly.
+
+#ifndef SYZYGY_MSF_MSF_MAPPED_STREAM_IMPL_H_
+#define SYZYGY_MSF_MSF_MAPPED_STREAM_IMPL_H_
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "syzygy/msf/msf_decl.h"
+
+namespace msf {
+namespace detail {
+
+template <MsfFileType T>
+MsfMappedStreamImpl<T>::MsfMappedStreamImpl(RefCountedMappedMsfFile* file,
+                                            uint32_t length,
+                                            size_t first_page)
+    : MsfStreamImpl(length),
+      file_(file),
+      first_page_(first_page),
+      page_count_(0),
+      pages_validated_(false),
+      pages_valid_(false) {
+  DCHECK(file != NULL);
+  DCHECK_LT(0u, file->page_size());
+  page_count_ = (length + file->page_size() - 1) / file->page_size();
+}
+
+template <MsfFileType T>
+MsfMappedStreamImpl<T>::~MsfMappedStreamImpl() {
+}
+
+template <MsfFileType T>
+bool MsfMappedStreamImpl<T>::ReadBytesAt(size_t pos, size_t count,
+                                         void* dest) {
+  DCHECK(dest != NULL);
+
+  // Don't read beyond the end of the known stream length.
+  if (count > length() - pos)
+    return false;
+  if (!EnsurePagesValidated())
+    return false;
+
+  // Copy the stream one run of contiguous pages at a time.
+  uint8_t* dest_bytes = reinterpret_cast<uint8_t*>(dest);
+  while (count > 0) {
+    const uint8_t* data = NULL;
+    size_t run_size = GetContiguousRun(pos, count, &data);
+    DCHECK_LT(0u, run_size);
+    ::memcpy(dest_bytes, data, run_size);
+
+    count -= run_size;
+    pos += run_size;
+    dest_bytes += run_size;
+  }
+
+  return true;
+}
+
+template <MsfFileType T>
+const uint8_t* MsfMappedStreamImpl<T>::GetDataAt(size_t pos, size_t count) {
+  if (count > length() - pos || count == 0)
+    return NULL;
+  if (!EnsurePagesValidated())
+    return NULL;
+
+  const uint8_t* data = NULL;
+  if (GetContiguousRun(pos, count, &data) != count)
+    return NULL;
+  return data;
+}
+
+template <MsfFileType T>
+bool MsfMappedStreamImpl<T>::EnsurePagesValidated() {
+  if (pages_validated_)
+    return pages_valid_;
+  pages_validated_ = true;
+
+  const std::vector<uint32_t>& directory = file_->directory();
+  if (first_page_ > directory.size() ||
+      page_count_ > directory.size() - first_page_) {
+    LOG(ERROR) << "MSF stream page list is out of the directory.";
+    return false;
+  }
+
+  size_t file_pages = file_->length() / file_->page_size();
+  for (size_t i = 0; i < page_count_; ++i) {
+    if (directory[first_page_ + i] >= file_pages) {
+      LOG(ERROR) << "MSF stream page " << directory[first_page_ + i]
+                 << " is out of the file.";
+      return false;
+    }
+  }
+
+  pages_valid_ = true;
+  return true;
+}
+
+template <MsfFileType T>
+size_t MsfMappedStreamImpl<T>::GetContiguousRun(size_t pos,
+                                                size_t count,
+                                                const uint8_t** data) {
+  DCHECK(pages_valid_);
+  DCHECK_LE(count, length() - pos);
+  DCHECK(data != NULL);
+
+  const uint32_t* pages = file_->directory().data() + first_page_;
+  size_t page_size = file_->page_size();
+  size_t page_index = pos / page_size;
+  size_t offset = pos % page_size;
+
+  *data = file_->data() + pages[page_index] * page_size + offset;
+  size_t run_size = std::min(count, page_size - offset);
+  while (run_size < count &&
+         pages[page_index + 1] == pages[page_index] + 1) {
+    ++page_index;
+    run_size = std::min(count, run_size + page_size);
+  }
+
+  return run_size;
+}
+
+}  // namespace detail
+}  // namespace msf
+
+#endif  // SYZYGY_MSF_MSF_MAPPED_STREAM_IMPL_H_
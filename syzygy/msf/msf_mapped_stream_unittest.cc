@@ -0,0 +1,93 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/msf/msf_mapped_stream.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/msf/unittest_util.h"
+
+namespace msf {
+
+namespace {
+
+class MsfMappedStreamTest : public testing::Test {
+ public:
+  void SetUp() override {
+    file_ = new RefCountedMappedMsfFile();
+    ASSERT_TRUE(file_->file()->Initialize(
+        testing::GetSrcRelativePath(testing::kTestPdbFilePath)));
+
+    // Use tiny pages over the header of the file, which starts with
+    // "Microsoft C/C++ MSF 7.00". Only pages 0 and 1 are contiguous.
+    file_->set_page_size(4);
+    const uint32_t kPages[] = {2, 0, 1, 3, 4, 5};
+    file_->directory()->assign(kPages, kPages + arraysize(kPages));
+  }
+
+ protected:
+  scoped_refptr<RefCountedMappedMsfFile> file_;
+};
+
+}  // namespace
+
+TEST_F(MsfMappedStreamTest, ReadBytesAt) {
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 16, 0));
+  EXPECT_EQ(16u, stream->length());
+
+  char buffer[16] = {0};
+  EXPECT_TRUE(stream->ReadBytesAt(0, 16, &buffer));
+  EXPECT_EQ(0, ::memcmp(buffer, "t C/MicrosofC++ ", 16));
+
+  EXPECT_TRUE(stream->ReadBytesAt(5, 6, &buffer));
+  EXPECT_EQ(0, ::memcmp(buffer, "icroso", 6));
+
+  // Reads past the end of the stream fail.
+  EXPECT_FALSE(stream->ReadBytesAt(15, 2, &buffer));
+}
+
+TEST_F(MsfMappedStreamTest, GetDataAt) {
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 16, 0));
+
+  // Bytes that are on contiguous pages are returned in place.
+  const uint8_t* data = stream->GetDataAt(5, 6);
+  ASSERT_NE(static_cast<const uint8_t*>(nullptr), data);
+  EXPECT_EQ(file_->data() + 1, data);
+  EXPECT_EQ(0, ::memcmp(data, "icroso", 6));
+
+  // Bytes that straddle non-contiguous pages are not.
+  EXPECT_EQ(static_cast<const uint8_t*>(nullptr), stream->GetDataAt(2, 4));
+  EXPECT_EQ(static_cast<const uint8_t*>(nullptr), stream->GetDataAt(10, 4));
+
+  // Neither are bytes out of the stream.
+  EXPECT_EQ(static_cast<const uint8_t*>(nullptr), stream->GetDataAt(14, 4));
+}
+
+TEST_F(MsfMappedStreamTest, InvalidPagesFailToRead) {
+  // The stream extends past the end of the directory.
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 16, 4));
+  char buffer[4] = {0};
+  EXPECT_FALSE(stream->ReadBytesAt(0, 4, &buffer));
+  EXPECT_EQ(static_cast<const uint8_t*>(nullptr), stream->GetDataAt(0, 4));
+
+  // The stream refers to a page out of the file.
+  file_->directory()->push_back(0xFFFFFF);
+  stream = new MsfMappedStream(file_.get(), 4, 6);
+  EXPECT_FALSE(stream->ReadBytesAt(0, 4, &buffer));
+}
+
+}  // namespace msf
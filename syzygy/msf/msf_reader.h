@@ -22,6 +22,7 @@
 #include "syzygy/msf/msf_decl.h"
 #include "syzygy/msf/msf_file.h"
 #include "syzygy/msf/msf_file_stream.h"
+#include "syzygy/msf/msf_mapped_stream.h"
 #include "syzygy/msf/msf_stream.h"
 
 namespace msf {
@@ -46,6 +47,17 @@ class MsfReaderImpl {
   // @returns true on success, false otherwise.
   bool Read(const base::FilePath& msf_path, MsfFileImpl<T>* msf_file);
 
+  // Maps an MSF, populating the given MsfFileImpl object with streams that
+  // read from the mapping. Only the header and the directory are read up
+  // front: the page list and the data of a stream are only touched when the
+  // stream is read, which makes this much cheaper than Read for callers that
+  // only look at a few streams of a large file.
+  //
+  // @param msf_path the MSF file to map.
+  // @param msf_file the empty MsfFileImpl object to be filled in.
+  // @returns true on success, false otherwise.
+  bool ReadMapped(const base::FilePath& msf_path, MsfFileImpl<T>* msf_file);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(MsfReaderImpl);
 };
@@ -28,6 +28,7 @@
 #include "base/strings/string_util.h"
 #include "syzygy/msf/msf_data.h"
 #include "syzygy/msf/msf_file_stream.h"
+#include "syzygy/msf/msf_mapped_stream.h"
 
 namespace msf {
 namespace detail {
@@ -153,6 +154,93 @@ bool MsfReaderImpl<T>::Read(const base::FilePath& msf_path,
   return true;
 }
 
+template <MsfFileType T>
+bool MsfReaderImpl<T>::ReadMapped(const base::FilePath& msf_path,
+                                  MsfFileImpl<T>* msf_file) {
+  DCHECK(msf_file != NULL);
+
+  msf_file->Clear();
+
+  scoped_refptr<RefCountedMappedMsfFile> file(new RefCountedMappedMsfFile());
+  if (!file->file()->Initialize(msf_path)) {
+    LOG(ERROR) << "Unable to map '" << msf_path.value() << "'.";
+    return false;
+  }
+
+  MsfHeader header = {0};
+  if (file->length() < sizeof(header)) {
+    LOG(ERROR) << "Failed to read MSF file header.";
+    return false;
+  }
+  ::memcpy(&header, file->data(), sizeof(header));
+
+  // Sanity checks.
+  if (memcmp(header.magic_string, kMsfHeaderMagicString,
+             sizeof(kMsfHeaderMagicString)) != 0) {
+    LOG(ERROR) << "Invalid MSF magic string.";
+    return false;
+  }
+
+  if (header.page_size == 0 ||
+      static_cast<uint64_t>(header.num_pages) * header.page_size !=
+          file->length()) {
+    LOG(ERROR) << "Invalid MSF file size.";
+    return false;
+  }
+  file->set_page_size(header.page_size);
+
+  uint32_t num_dir_pages = GetNumPages(header, header.directory_size);
+  uint32_t num_root_pages =
+      GetNumPages(header, num_dir_pages * sizeof(uint32_t));
+  if (header.directory_size < sizeof(uint32_t) ||
+      num_root_pages > arraysize(header.root_pages)) {
+    LOG(ERROR) << "Invalid MSF directory size.";
+    return false;
+  }
+
+  // Load the directory page list from the root pages, then the directory from
+  // these pages. Both are read through a temporary stream whose page list is
+  // held in the directory of the mapped file.
+  std::vector<uint32_t>* directory = file->directory();
+  directory->assign(header.root_pages, header.root_pages + num_root_pages);
+  std::vector<uint32_t> dir_pages(num_dir_pages);
+  scoped_refptr<MsfMappedStreamImpl<T>> stream(new MsfMappedStreamImpl<T>(
+      file.get(), num_dir_pages * sizeof(uint32_t), 0));
+  if (!stream->ReadBytesAt(0, dir_pages.size() * sizeof(uint32_t),
+                           dir_pages.data())) {
+    LOG(ERROR) << "Failed to read directory page stream.";
+    return false;
+  }
+  directory->swap(dir_pages);
+
+  std::vector<uint32_t> dir(header.directory_size / sizeof(uint32_t));
+  stream = new MsfMappedStreamImpl<T>(file.get(), header.directory_size, 0);
+  if (!stream->ReadBytesAt(0, dir.size() * sizeof(uint32_t), dir.data())) {
+    LOG(ERROR) << "Failed to read directory stream.";
+    return false;
+  }
+  stream = NULL;
+  directory->swap(dir);
+
+  // Iterate through the streams and construct MsfStreams. Their page lists
+  // are validated when they are first read.
+  uint32_t num_streams = directory->at(0);
+  if (num_streams > directory->size() - 1) {
+    LOG(ERROR) << "Invalid MSF stream count.";
+    return false;
+  }
+
+  size_t page_index = 1 + num_streams;
+  for (uint32_t stream_index = 0; stream_index < num_streams; ++stream_index) {
+    uint32_t stream_length = directory->at(1 + stream_index);
+    msf_file->AppendStream(
+        new MsfMappedStreamImpl<T>(file.get(), stream_length, page_index));
+    page_index += GetNumPages(header, stream_length);
+  }
+
+  return true;
+}
+
 }  // namespace detail
 }  // namespace msf
 
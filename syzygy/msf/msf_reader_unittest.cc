@@ -32,4 +32,29 @@ TEST(MsfReaderTest, Read) {
   EXPECT_EQ(msf_file.StreamCount(), 168u);
 }
 
+TEST(MsfReaderTest, ReadMapped) {
+  base::FilePath test_dll_msf =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  MsfReader reader;
+  MsfFile msf_file;
+  ASSERT_TRUE(reader.Read(test_dll_msf, &msf_file));
+
+  MsfFile mapped_msf_file;
+  EXPECT_TRUE(reader.ReadMapped(test_dll_msf, &mapped_msf_file));
+  testing::EnsureMsfContentsAreIdentical(msf_file, mapped_msf_file);
+}
+
+TEST(MsfReaderTest, ReadMappedFailsOnInvalidFile) {
+  testing::ScopedTempFile temp_file;
+  static const char kJunk[] = "not an MSF file";
+  ASSERT_EQ(static_cast<int>(sizeof(kJunk)),
+            base::WriteFile(temp_file.path(), kJunk, sizeof(kJunk)));
+
+  MsfReader reader;
+  MsfFile msf_file;
+  EXPECT_FALSE(reader.ReadMapped(temp_file.path(), &msf_file));
+  EXPECT_EQ(0u, msf_file.StreamCount());
+}
+
 }  // namespace msf
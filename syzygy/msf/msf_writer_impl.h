@@ -15,6 +15,7 @@
 #ifndef SYZYGY_MSF_MSF_WRITER_IMPL_H_
 #define SYZYGY_MSF_MSF_WRITER_IMPL_H_
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <vector>
@@ -30,6 +31,10 @@ namespace {
 
 const uint32_t kZeroBuffer[kMsfPageSize] = {0};
 
+// The number of pages that are read from a stream at once when appending it
+// to the file.
+const size_t kCopyBufferPages = 64;
+
 // A byte-based bitmap for keeping track of free pages in an MSF file.
 // TODO(chrisha): Promote this to its own file and unittest it when we make
 //     a library for MSF-specific stuff.
@@ -336,29 +341,39 @@ bool MsfWriterImpl<T>::AppendStream(MsfStreamImpl<T>* stream,
   size_t old_pages_written_count = pages_written->size();
 #endif
 
-  // Write the stream page by page.
-  uint8_t buffer[kMsfPageSize] = {0};
+  // Read the stream several pages at a time, and write it page by page. Streams
+  // that are read from an existing MSF file are thus copied with a few large
+  // reads rather than a seek and a read per page, and are never held in
+  // memory as a whole.
+  size_t stream_pages = (stream->length() + kMsfPageSize - 1) / kMsfPageSize;
+  std::vector<uint8_t> buffer(std::min(kCopyBufferPages, stream_pages) *
+                              kMsfPageSize);
   size_t bytes_left = stream->length();
   size_t bytes_read = 0;
   while (bytes_left) {
-    size_t bytes_to_read = sizeof(buffer);
+    size_t bytes_to_read = buffer.size();
     if (bytes_to_read > bytes_left) {
       bytes_to_read = bytes_left;
 
       // If we're only reading a partial buffer then pad the end of it with
       // zeros.
-      ::memset(buffer + bytes_to_read, 0, sizeof(buffer) - bytes_to_read);
+      ::memset(buffer.data() + bytes_to_read, 0,
+               buffer.size() - bytes_to_read);
     }
 
     // Read the buffer from the stream.
-    if (!stream->ReadBytesAt(bytes_read, bytes_to_read, buffer)) {
+    if (!stream->ReadBytesAt(bytes_read, bytes_to_read, buffer.data())) {
       size_t offset = stream->length() - bytes_left;
       LOG(ERROR) << "Failed to read " << bytes_to_read << " bytes at offset "
                  << offset << " of MSF stream.";
       return false;
     }
-    if (!AppendPage(buffer, pages_written, page_count, file_.get()))
-      return false;
+    for (size_t i = 0; i < bytes_to_read; i += kMsfPageSize) {
+      if (!AppendPage(buffer.data() + i, pages_written, page_count,
+                      file_.get())) {
+        return false;
+      }
+    }
 
     bytes_read += bytes_to_read;
     bytes_left -= bytes_to_read;
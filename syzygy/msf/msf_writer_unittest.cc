@@ -216,4 +216,36 @@ TEST(MsfWriterTest, WriteMsfFile) {
       testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
 }
 
+TEST(MsfWriterTest, RewriteMsfFileFromFileStreams) {
+  // The second stream spans several copy buffers and ends on a partial page.
+  MsfFile msf_file;
+  msf_file.AppendStream(new TestMsfStream(3 * kMsfPageSize + 4, 0));
+  msf_file.AppendStream(new TestMsfStream(150 * kMsfPageSize + 20, 1 << 24));
+  msf_file.AppendStream(new TestMsfStream(12, 2 << 24));
+
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.Write(file.path(), msf_file));
+  }
+
+  // Rewrite the file from the streams of the file itself, which are read
+  // straight from disk.
+  MsfFile msf_file_read;
+  MsfReader reader;
+  ASSERT_TRUE(reader.Read(file.path(), &msf_file_read));
+  testing::ScopedTempFile rewritten_file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.Write(rewritten_file.path(), msf_file_read));
+  }
+  EXPECT_TRUE(base::ContentsEqual(file.path(), rewritten_file.path()));
+
+  MsfFile msf_file_reread;
+  MsfReader rereader;
+  ASSERT_TRUE(rereader.Read(rewritten_file.path(), &msf_file_reread));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_reread));
+}
+
 }  // namespace msf
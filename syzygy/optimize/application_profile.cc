@@ -76,6 +76,12 @@ bool GetFrequencyByOffset(const IndexedFrequencyMap& frequencies,
   return false;
 }
 
+// Returns true if @p count may be a sum of saturated 8-bit counters.
+bool IsSaturatedCount(EntryCountType count) {
+  const EntryCountType kSaturatedCount = 0xFF;
+  return count != 0 && count % kSaturatedCount == 0;
+}
+
 // Retrieve the RVA of a block by looking in the image layout.
 bool GetAddressOfBlock(const BlockGraph::Block* block,
                        const ImageLayout& image_layout,
@@ -94,7 +100,9 @@ bool GetAddressOfBlock(const BlockGraph::Block* block,
 }  // namespace
 
 ApplicationProfile::ApplicationProfile(const ImageLayout* image_layout)
-    : image_layout_(image_layout), global_temperature_(0.0) {
+    : frequency_size_(sizeof(uint32_t)),
+      image_layout_(image_layout),
+      global_temperature_(0.0) {
   empty_profile_.reset(new BlockProfile());
 }
 
@@ -190,8 +198,20 @@ bool ApplicationProfile::ComputeGlobalProfile() {
 
 bool ApplicationProfile::ImportFrequencies(
     const IndexedFrequencyMap& frequencies) {
+  return ImportFrequencies(frequencies, sizeof(uint32_t));
+}
+
+bool ApplicationProfile::ImportFrequencies(
+    const IndexedFrequencyMap& frequencies,
+    uint8_t frequency_size) {
+  if (!grinder::basic_block_util::IsValidFrequencySize(frequency_size)) {
+    LOG(ERROR) << "Invalid frequency size: " << frequency_size << ".";
+    return false;
+  }
+
   // TODO(etienneb): Support importing multiple sets.
   frequencies_ = frequencies;
+  frequency_size_ = frequency_size;
   return true;
 }
 
@@ -237,6 +257,13 @@ void ApplicationProfile::ComputeSubGraphProfile(
                            &mispredicted);
 
       DCHECK_GE(count, taken);
+
+      // When both counts are saturated, any split of the entries between the
+      // successors is possible, so none of them is favored.
+      if (frequency_size_ == 1 && IsSaturatedCount(count) &&
+          IsSaturatedCount(taken)) {
+        taken = count / 2;
+      }
       EntryCountType untaken = (count - taken);
 
       // Fill the basic block profile with the information.
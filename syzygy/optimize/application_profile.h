@@ -91,6 +91,17 @@ class ApplicationProfile {
   // TODO(etienneb): Support multiple importation.
   bool ImportFrequencies(const IndexedFrequencyMap& frequencies);
 
+  // Import the frequency information of an application, gathered with
+  // counters of @p frequency_size bytes. The counts of saturating 8-bit
+  // counters are sums of values of at most 255, so a block whose entry and
+  // branch taken counts are both saturated has an unknown branch direction.
+  // @param frequencies the branches frequencies.
+  // @param frequency_size the size in bytes of the counters, 1, 2 or 4.
+  // @returns true on success, false otherwise.
+  // @note This function should only be called once.
+  bool ImportFrequencies(const IndexedFrequencyMap& frequencies,
+                         uint8_t frequency_size);
+
  protected:
   // These are protected so that they can be accessed by unittests.
 
@@ -98,6 +109,9 @@ class ApplicationProfile {
   // information).
   IndexedFrequencyMap frequencies_;
 
+  // The size in bytes of the counters of the frequency information.
+  uint8_t frequency_size_;
+
   // The image layout to which the profile data applies.
   const ImageLayout* image_layout_;
 
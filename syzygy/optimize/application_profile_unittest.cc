@@ -325,6 +325,46 @@ TEST_F(ApplicationProfileTest, ComputeSubGraphProfile) {
   EXPECT_EQ(.20, profile0->GetSuccessorRatio(bb2));
 }
 
+TEST_F(ApplicationProfileTest, ComputeSubGraphProfileWith8BitCounters) {
+  TestAplicationProfile app(&layout_);
+  IndexedFrequencyMap frequencies;
+  ASSERT_NO_FATAL_FAILURE(PopulateLayout());
+  ASSERT_NO_FATAL_FAILURE(PopulateSubgraphFrequencies(&frequencies));
+
+  // The entry and taken counters of the first basic block are saturated.
+  const RelativeAddress kBlockAddress0 =
+      RelativeAddress(kSmallCodeAddress + kBasicBlockOffset0);
+  frequencies[std::make_pair(kBlockAddress0, kEntryCountColumn)] = 255;
+  frequencies[std::make_pair(kBlockAddress0, kTakenCountColumn)] = 255;
+
+  EXPECT_FALSE(app.ImportFrequencies(frequencies, 3));
+  ASSERT_TRUE(app.ImportFrequencies(frequencies, 1));
+  ASSERT_TRUE(app.ComputeGlobalProfile());
+
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(block_code_, &subgraph);
+  ASSERT_TRUE(decomposer.Decompose());
+  std::unique_ptr<SubGraphProfile> subgraph_profile;
+  ASSERT_NO_FATAL_FAILURE(
+      app.ComputeSubGraphProfile(&subgraph, &subgraph_profile));
+
+  const BasicBlockSubGraph::BasicBlockOrdering& original_order =
+      subgraph.block_descriptions().front().basic_block_order;
+  ASSERT_EQ(4U, original_order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator it =
+      original_order.begin();
+  BasicCodeBlock* bb0 = BasicCodeBlock::Cast(*it++);
+  BasicCodeBlock* bb1 = BasicCodeBlock::Cast(*it++);
+  BasicCodeBlock* bb2 = BasicCodeBlock::Cast(*it);
+  const BasicBlockProfile* profile0 =
+      subgraph_profile->GetBasicBlockProfile(bb0);
+
+  // The direction of the branch is unknown, so it is split evenly.
+  EXPECT_EQ(255, profile0->count());
+  EXPECT_EQ(128, profile0->GetSuccessorCount(bb1));
+  EXPECT_EQ(127, profile0->GetSuccessorCount(bb2));
+}
+
 TEST_F(ApplicationProfileTest, RetrieveEmptySubGraphProfile) {
   BasicBlockSubGraph subgraph;
   SubGraphProfile profile;
@@ -14,6 +14,7 @@
 
 #include "syzygy/optimize/optimize_app.h"
 
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
@@ -23,6 +24,7 @@
 #include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
 #include "syzygy/optimize/transforms/block_alignment_transform.h"
 #include "syzygy/optimize/transforms/chained_subgraph_transforms.h"
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
 #include "syzygy/optimize/transforms/inlining_transform.h"
 #include "syzygy/optimize/transforms/peephole_transform.h"
 #include "syzygy/optimize/transforms/unreachable_block_transform.h"
@@ -40,6 +42,7 @@ using grinder::basic_block_util::LoadBranchStatisticsFromFile;
 using optimize::transforms::BasicBlockReorderingTransform;
 using optimize::transforms::BlockAlignmentTransform;
 using optimize::transforms::ChainedSubgraphTransforms;
+using optimize::transforms::HotColdSplittingTransform;
 using optimize::transforms::InliningTransform;
 using optimize::transforms::PeepholeTransform;
 using optimize::transforms::UnreachableBlockTransform;
@@ -52,6 +55,10 @@ const char kUsageFormatStr[] =
     "\n"
     "  Options:\n"
     "    --branch-file=<path>  Branch statistics in JSON format.\n"
+    "    --decomposition-cache-dir=<path>\n"
+    "                          A directory caching the decompositions of the\n"
+    "                          input images, shared by the runs of the\n"
+    "                          relinking tools on a same image.\n"
     "    --input-pdb=<path>    The PDB file associated with the input DLL.\n"
     "                          Default is inferred from input-image.\n"
     "    --output-pdb=<path>   Output path for the rewritten PDB file.\n"
@@ -65,10 +72,19 @@ const char kUsageFormatStr[] =
     "                          blocks.\n"
     "    --basic-block-reorder Enable basic block reodering.\n"
     "    --block-alignment     Enable block realignment.\n"
+    "    --ext-tsp             Lay out the basic blocks reordered by\n"
+    "                          --basic-block-reorder with Ext-TSP.\n"
+    "    --hot-cold-split      Enable moving of the never executed basic\n"
+    "                          blocks to a cold section.\n"
     "    --inlining            Enable function inlining.\n"
     "    --peephole            Enable peephole optimization.\n"
     "    --unreachable-block   Enable unreachable block optimization.\n"
     "\n"
+    "  Block alignment options:\n"
+    "    --padding-budget=<bytes>\n"
+    "                          The maximum number of padding bytes added to\n"
+    "                          align the hot code. Defaults to 65536.\n"
+    "\n"
     "  Unreachable block options:\n"
     "    --dump-unreachable-graph=<path>\n"
     "                          Dump the unreachable graph.\n"
@@ -88,10 +104,14 @@ bool OptimizeApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   input_pdb_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("input-pdb"));
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   branch_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("branch-file"));
+  decomposition_cache_dir_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("decomposition-cache-dir"));
 
   basic_block_reorder_ = cmd_line->HasSwitch("basic-block-reorder");
   block_alignment_ = cmd_line->HasSwitch("block-alignment");
+  ext_tsp_ = cmd_line->HasSwitch("ext-tsp");
   fuzz_ = cmd_line->HasSwitch("fuzz");
+  hot_cold_split_ = cmd_line->HasSwitch("hot-cold-split");
   inlining_ = cmd_line->HasSwitch("inlining");
   allow_inline_assembly_ = cmd_line->HasSwitch("allow-inline-assembly");
   peephole_ = cmd_line->HasSwitch("peephole");
@@ -102,6 +122,7 @@ bool OptimizeApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   if (cmd_line->HasSwitch("all")) {
     basic_block_reorder_ = true;
     block_alignment_ = true;
+    hot_cold_split_ = true;
     inlining_ = true;
     peephole_ = true;
     unreachable_block_ = true;
@@ -110,6 +131,14 @@ bool OptimizeApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   unreachable_graph_path_ =
       AbsolutePath(cmd_line->GetSwitchValuePath("dump-unreachable-graph"));
 
+  padding_budget_ = BlockAlignmentTransform::kDefaultPaddingBudget;
+  if (cmd_line->HasSwitch("padding-budget")) {
+    std::string padding_budget_str =
+        cmd_line->GetSwitchValueASCII("padding-budget");
+    if (!base::StringToSizeT(padding_budget_str, &padding_budget_))
+      return Usage(cmd_line, "Invalid --padding-budget value.");
+  }
+
   // The --input-image argument is required.
   if (input_image_path_.empty())
     return Usage(cmd_line, "You must specify --input-image.");
@@ -135,6 +164,7 @@ int OptimizeApp::Run() {
   relinker.set_input_pdb_path(input_pdb_path_);
   relinker.set_output_path(output_image_path_);
   relinker.set_output_pdb_path(output_pdb_path_);
+  relinker.set_decomposition_cache_dir(decomposition_cache_dir_);
   relinker.set_allow_overwrite(overwrite_);
 
   // Initialize the relinker. This does the decomposition, etc.
@@ -152,13 +182,15 @@ int OptimizeApp::Run() {
   ApplicationProfile profile(&image_layout);
   if (!branch_file_path_.empty()) {
     IndexedFrequencyMap frequencies;
+    uint8_t frequency_size = 0;
     if (!LoadBranchStatisticsFromFile(branch_file_path_,
                                       signature,
-                                      &frequencies)) {
+                                      &frequencies,
+                                      &frequency_size)) {
       LOG(ERROR) << "Unable to load profile information.";
       return 1;
     }
-    if (!profile.ImportFrequencies(frequencies)) {
+    if (!profile.ImportFrequencies(frequencies, frequency_size)) {
       LOG(ERROR) << "Could not import metrics for '"
                  << branch_file_path_.value() << "'.";
       return false;
@@ -179,6 +211,7 @@ int OptimizeApp::Run() {
       basic_block_reordering_transform;
   std::unique_ptr<BlockAlignmentTransform> block_alignment_transform;
   std::unique_ptr<FuzzingTransform> fuzzing_transform;
+  std::unique_ptr<HotColdSplittingTransform> hot_cold_splitting_transform;
   std::unique_ptr<InliningTransform> inlining_transform;
   std::unique_ptr<PeepholeTransform> peephole_transform;
   std::unique_ptr<UnreachableBlockTransform> unreachable_block_transform;
@@ -198,12 +231,24 @@ int OptimizeApp::Run() {
   // If block block reordering is enabled, add it to the chain.
   if (basic_block_reorder_) {
     basic_block_reordering_transform.reset(new BasicBlockReorderingTransform());
+    if (ext_tsp_) {
+      basic_block_reordering_transform->set_layout(
+          BasicBlockReorderingTransform::kExtTspLayout);
+    }
     chains.AppendTransform(basic_block_reordering_transform.get());
   }
 
+  // If hot/cold splitting is enabled, add it to the chain. It follows the
+  // basic block reordering, which only handles functions of a single block.
+  if (hot_cold_split_) {
+    hot_cold_splitting_transform.reset(new HotColdSplittingTransform());
+    chains.AppendTransform(hot_cold_splitting_transform.get());
+  }
+
   // If block alignment is enabled, add it to the chain.
   if (block_alignment_) {
     block_alignment_transform.reset(new BlockAlignmentTransform());
+    block_alignment_transform->set_padding_budget(padding_budget_);
     chains.AppendTransform(block_alignment_transform.get());
   }
 
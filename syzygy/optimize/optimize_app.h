@@ -33,12 +33,15 @@ class OptimizeApp : public application::AppImplBase {
       : AppImplBase("Optimize"),
         basic_block_reorder_(false),
         block_alignment_(false),
+        ext_tsp_(false),
         fuzz_(false),
+        hot_cold_split_(false),
         inlining_(false),
         allow_inline_assembly_(false),
         overwrite_(false),
         peephole_(false),
-        unreachable_block_(false) {
+        unreachable_block_(false),
+        padding_budget_(0) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -62,15 +65,19 @@ class OptimizeApp : public application::AppImplBase {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath branch_file_path_;
+  base::FilePath decomposition_cache_dir_;
   base::FilePath unreachable_graph_path_;
   bool block_alignment_;
   bool basic_block_reorder_;
+  bool ext_tsp_;
   bool fuzz_;
+  bool hot_cold_split_;
   bool inlining_;
   bool allow_inline_assembly_;
   bool peephole_;
   bool unreachable_block_;
   bool overwrite_;
+  size_t padding_budget_;
   // @}
 
  private:
@@ -39,11 +39,14 @@ class TestOptimizeApp : public OptimizeApp {
   using OptimizeApp::unreachable_graph_path_;
   using OptimizeApp::basic_block_reorder_;
   using OptimizeApp::block_alignment_;
+  using OptimizeApp::ext_tsp_;
   using OptimizeApp::fuzz_;
+  using OptimizeApp::hot_cold_split_;
   using OptimizeApp::inlining_;
   using OptimizeApp::allow_inline_assembly_;
   using OptimizeApp::peephole_;
   using OptimizeApp::overwrite_;
+  using OptimizeApp::padding_budget_;
 };
 
 typedef application::Application<TestOptimizeApp> TestApp;
@@ -162,6 +165,8 @@ TEST_F(OptimizeAppTest, ParseMinimalCommandLineWithBranchFile) {
   EXPECT_FALSE(test_impl_.basic_block_reorder_);
   EXPECT_FALSE(test_impl_.peephole_);
   EXPECT_FALSE(test_impl_.fuzz_);
+  EXPECT_FALSE(test_impl_.hot_cold_split_);
+  EXPECT_FALSE(test_impl_.ext_tsp_);
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_TRUE(test_impl_.SetUp());
@@ -197,6 +202,8 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithInputAndOutputPdb) {
   cmd_line_.AppendSwitch("basic-block-reorder");
   cmd_line_.AppendSwitch("peephole");
   cmd_line_.AppendSwitch("fuzz");
+  cmd_line_.AppendSwitch("hot-cold-split");
+  cmd_line_.AppendSwitch("ext-tsp");
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_EQ(abs_input_image_path_, test_impl_.input_image_path_);
@@ -210,6 +217,8 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithInputAndOutputPdb) {
   EXPECT_TRUE(test_impl_.basic_block_reorder_);
   EXPECT_TRUE(test_impl_.peephole_);
   EXPECT_TRUE(test_impl_.fuzz_);
+  EXPECT_TRUE(test_impl_.hot_cold_split_);
+  EXPECT_TRUE(test_impl_.ext_tsp_);
 
   EXPECT_TRUE(test_impl_.SetUp());
 }
@@ -233,6 +242,8 @@ TEST_F(OptimizeAppTest, ParseAllCommandLineWithInputAndOutputPdb) {
   EXPECT_TRUE(test_impl_.basic_block_reorder_);
   EXPECT_TRUE(test_impl_.block_alignment_);
   EXPECT_TRUE(test_impl_.peephole_);
+  EXPECT_TRUE(test_impl_.hot_cold_split_);
+  EXPECT_FALSE(test_impl_.ext_tsp_);
   EXPECT_FALSE(test_impl_.fuzz_);
 
   EXPECT_TRUE(test_impl_.SetUp());
@@ -254,6 +265,25 @@ TEST_F(OptimizeAppTest, ParseCommandLineWithUnreachableGraph) {
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(OptimizeAppTest, ParseCommandLineWithPaddingBudget) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitch("block-alignment");
+  cmd_line_.AppendSwitchASCII("padding-budget", "1024");
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(test_impl_.block_alignment_);
+  EXPECT_EQ(1024U, test_impl_.padding_budget_);
+}
+
+TEST_F(OptimizeAppTest, ParseWithInvalidPaddingBudgetFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("padding-budget", "lots");
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(OptimizeAppTest, RelinkDecompose) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
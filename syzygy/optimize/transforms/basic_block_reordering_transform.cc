@@ -14,6 +14,12 @@
 
 #include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
 
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/optimize/application_profile.h"
 
@@ -34,6 +40,31 @@ typedef ControlFlowAnalysis::StructuralNode StructuralNode;
 typedef SubGraphProfile::BasicBlockProfile BasicBlockProfile;
 typedef grinder::basic_block_util::EntryCountType EntryCountType;
 
+// The weights and the maximum distances of the jumps of the Ext-TSP score.
+const double kFallThroughWeight = 1.0;
+const double kForwardJumpWeight = 0.1;
+const double kBackwardJumpWeight = 0.1;
+const double kForwardJumpDistance = 1024;
+const double kBackwardJumpDistance = 640;
+
+// The maximum length of a chain that is split to insert another one in it,
+// and the maximum number of basic blocks laid out with Ext-TSP. The cost of
+// the layout is cubic in the number of basic blocks.
+const size_t kMaxExtTspSplitLength = 128;
+const size_t kMaxExtTspBasicBlocks = 512;
+
+// A taken branch or fall-through between two basic blocks, given as indices
+// in the original ordering.
+struct ExtTspEdge {
+  size_t source;
+  size_t destination;
+  EntryCountType count;
+};
+typedef std::vector<ExtTspEdge> ExtTspEdges;
+
+// A sequence of basic blocks, given as indices in the original ordering.
+typedef std::vector<size_t> ExtTspChain;
+
 // A helper to "cast" the given successor as a BasicCodeBlock.
 const BasicCodeBlock* GetSuccessorBB(const Successor& successor) {
   const BasicBlock* bb = successor.reference().basic_block();
@@ -102,6 +133,84 @@ void FlattenStructuralTreeRecursive(const StructuralNode* tree,
   }
 }
 
+// Gathers the sizes of the basic blocks of an ordering and the edges
+// between them.
+void BuildExtTspGraph(const BasicBlockOrdering& order,
+                      const SubGraphProfile& profile,
+                      std::vector<size_t>* sizes,
+                      ExtTspEdges* edges) {
+  DCHECK_NE(reinterpret_cast<std::vector<size_t>*>(NULL), sizes);
+  DCHECK_NE(reinterpret_cast<ExtTspEdges*>(NULL), edges);
+
+  std::map<const BasicCodeBlock*, size_t> indices;
+  for (size_t i = 0; i < order.size(); ++i)
+    indices[order[i]] = i;
+
+  sizes->clear();
+  edges->clear();
+  for (size_t i = 0; i < order.size(); ++i) {
+    const BasicCodeBlock* bb = order[i];
+    sizes->push_back(bb->GetInstructionSize());
+
+    const BasicBlockProfile* bb_profile = profile.GetBasicBlockProfile(bb);
+    const BasicCodeBlock::Successors& successors = bb->successors();
+    BasicCodeBlock::Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      const BasicCodeBlock* succ_bb = GetSuccessorBB(*succ);
+      if (succ_bb == NULL || indices.count(succ_bb) == 0)
+        continue;
+      ExtTspEdge edge = {i, indices[succ_bb],
+                         bb_profile->GetSuccessorCount(succ_bb)};
+      if (edge.count != 0)
+        edges->push_back(edge);
+    }
+  }
+}
+
+// Computes the Ext-TSP score of a chain. The edges leaving the chain don't
+// contribute to its score.
+double ScoreExtTspChain(const ExtTspChain& chain,
+                        const std::vector<size_t>& sizes,
+                        const ExtTspEdges& edges) {
+  const size_t kNotInChain = static_cast<size_t>(-1);
+  std::vector<size_t> positions(sizes.size(), kNotInChain);
+  std::vector<size_t> offsets(sizes.size(), 0);
+  size_t offset = 0;
+  for (size_t i = 0; i < chain.size(); ++i) {
+    positions[chain[i]] = i;
+    offsets[chain[i]] = offset;
+    offset += sizes[chain[i]];
+  }
+
+  double score = 0;
+  for (const ExtTspEdge& edge : edges) {
+    size_t source = positions[edge.source];
+    size_t destination = positions[edge.destination];
+    if (source == kNotInChain || destination == kNotInChain)
+      continue;
+
+    double count = static_cast<double>(edge.count);
+    size_t source_end = offsets[edge.source] + sizes[edge.source];
+    if (destination == source + 1) {
+      score += kFallThroughWeight * count;
+    } else if (destination > source) {
+      double distance = offsets[edge.destination] - source_end;
+      if (distance < kForwardJumpDistance) {
+        score += kForwardJumpWeight * count *
+                 (1 - distance / kForwardJumpDistance);
+      }
+    } else {
+      double distance = source_end - offsets[edge.destination];
+      if (distance < kBackwardJumpDistance) {
+        score += kBackwardJumpWeight * count *
+                 (1 - distance / kBackwardJumpDistance);
+      }
+    }
+  }
+
+  return score;
+}
+
 }  // namespace
 
 bool BasicBlockReorderingTransform::FlattenStructuralTreeToAnOrder(
@@ -166,6 +275,122 @@ uint64_t BasicBlockReorderingTransform::EvaluateCost(
   return accumulate;
 }
 
+double BasicBlockReorderingTransform::EvaluateExtTspScore(
+    const BasicBlockOrdering& order,
+    const SubGraphProfile& profile) {
+  std::vector<size_t> sizes;
+  ExtTspEdges edges;
+  BuildExtTspGraph(order, profile, &sizes, &edges);
+
+  ExtTspChain chain;
+  for (size_t i = 0; i < order.size(); ++i)
+    chain.push_back(i);
+  return ScoreExtTspChain(chain, sizes, edges);
+}
+
+bool BasicBlockReorderingTransform::ComputeExtTspOrder(
+    const BasicBlockOrdering& original,
+    const SubGraphProfile& profile,
+    BasicBlockOrdering* order) {
+  DCHECK_NE(reinterpret_cast<BasicBlockOrdering*>(NULL), order);
+  if (original.empty() || original.size() > kMaxExtTspBasicBlocks)
+    return false;
+
+  std::vector<size_t> sizes;
+  ExtTspEdges edges;
+  BuildExtTspGraph(original, profile, &sizes, &edges);
+
+  // Each basic block starts in a chain of its own.
+  std::vector<ExtTspChain> chains(original.size());
+  std::vector<size_t> chain_indices(original.size());
+  std::vector<double> scores(original.size());
+  for (size_t i = 0; i < original.size(); ++i) {
+    chains[i].push_back(i);
+    chain_indices[i] = i;
+    scores[i] = ScoreExtTspChain(chains[i], sizes, edges);
+  }
+
+  // Repeatedly merge the two connected chains with the best gain. The second
+  // chain is either appended to the first, or inserted in it when it is
+  // short enough to be split. The entry must stay the first basic block.
+  while (true) {
+    std::set<std::pair<size_t, size_t>> pairs;
+    for (const ExtTspEdge& edge : edges) {
+      size_t source = chain_indices[edge.source];
+      size_t destination = chain_indices[edge.destination];
+      if (source != destination)
+        pairs.insert(std::minmax(source, destination));
+    }
+
+    double best_gain = 0;
+    size_t best_first = 0;
+    size_t best_second = 0;
+    ExtTspChain best_chain;
+    for (const auto& pair : pairs) {
+      for (size_t direction = 0; direction < 2; ++direction) {
+        size_t first = direction == 0 ? pair.first : pair.second;
+        size_t second = direction == 0 ? pair.second : pair.first;
+        const ExtTspChain& first_chain = chains[first];
+        const ExtTspChain& second_chain = chains[second];
+        if (second_chain.front() == 0)
+          continue;
+
+        size_t min_split = first_chain.size() <= kMaxExtTspSplitLength ?
+            1 : first_chain.size();
+        for (size_t split = min_split; split <= first_chain.size(); ++split) {
+          ExtTspChain chain(first_chain.begin(), first_chain.begin() + split);
+          chain.insert(chain.end(), second_chain.begin(), second_chain.end());
+          chain.insert(chain.end(), first_chain.begin() + split,
+                       first_chain.end());
+          double gain = ScoreExtTspChain(chain, sizes, edges) -
+                        scores[first] - scores[second];
+          if (gain > best_gain) {
+            best_gain = gain;
+            best_first = first;
+            best_second = second;
+            best_chain.swap(chain);
+          }
+        }
+      }
+    }
+    if (best_chain.empty())
+      break;
+
+    scores[best_first] += scores[best_second] + best_gain;
+    for (size_t index : chains[best_second])
+      chain_indices[index] = best_first;
+    chains[best_first].swap(best_chain);
+    chains[best_second].clear();
+  }
+
+  // Lay out the chain of the entry first, then the others by decreasing
+  // density of executions.
+  std::vector<std::pair<double, size_t>> densities;
+  for (size_t i = 1; i < chains.size(); ++i) {
+    if (chains[i].empty())
+      continue;
+    double count = 0;
+    size_t size = 0;
+    for (size_t index : chains[i]) {
+      count += profile.GetBasicBlockProfile(original[index])->count();
+      size += sizes[index];
+    }
+    densities.push_back(std::make_pair(-count / std::max<size_t>(size, 1), i));
+  }
+  std::sort(densities.begin(), densities.end());
+
+  order->clear();
+  for (size_t index : chains[0])
+    order->push_back(original[index]);
+  for (const auto& density : densities) {
+    for (size_t index : chains[density.second])
+      order->push_back(original[index]);
+  }
+  DCHECK_EQ(original.size(), order->size());
+
+  return true;
+}
+
 void BasicBlockReorderingTransform::CommitOrdering(
     const BasicBlockOrdering& order,
     BasicEndBlock* basic_end_block,
@@ -264,6 +489,17 @@ bool BasicBlockReorderingTransform::TransformBasicBlockSubGraph(
   if (original_cost == 0)
     return true;
 
+  if (layout_ == kExtTspLayout) {
+    // Commit the Ext-TSP layout if it scores better than the original one.
+    BasicBlockOrdering ext_tsp_order;
+    if (ComputeExtTspOrder(original_order, *subgraph_profile, &ext_tsp_order) &&
+        EvaluateExtTspScore(ext_tsp_order, *subgraph_profile) >
+            EvaluateExtTspScore(original_order, *subgraph_profile)) {
+      CommitOrdering(ext_tsp_order, end_block, &original_order_list);
+    }
+    return true;
+  }
+
   BasicBlockOrdering flatten_order;
   bool reducible = FlattenStructuralTreeToAnOrder(subgraph,
                                                   subgraph_profile,
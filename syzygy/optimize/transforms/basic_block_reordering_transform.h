@@ -20,6 +20,15 @@
 // see: K.Pettis, R.C.Hansen, Profile Guided Code Positioning,
 //     Proceedings of the ACM SIGPLAN 1990 Conference on Programming Language
 //     Design and Implementation, Vol. 25, No. 6, June 1990, pp. 16-27.
+//
+// The Ext-TSP layout instead maximizes the extended TSP score of the ordering,
+// which rewards the fall-throughs, and to a lesser extent the short jumps, by
+// their frequencies. Chains of basic blocks are merged greedily by the gain of
+// their score.
+//
+// see: A.Newell, S.Pupyrev, Improved Basic Block Reordering, IEEE
+//     Transactions on Computers, Vol. 69, No. 12, December 2020,
+//     pp. 1784-1794.
 
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_BASIC_BLOCK_REORDERING_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_BASIC_BLOCK_REORDERING_TRANSFORM_H_
@@ -42,8 +51,22 @@ class BasicBlockReorderingTransform : public SubGraphTransformInterface {
   typedef block_graph::analysis::ControlFlowAnalysis::BasicBlockOrdering
       BasicBlockOrdering;
 
+  // The algorithms laying out the basic blocks.
+  enum Layout {
+    // Flattens the structural tree of the control flow graph.
+    kStructuralTreeLayout,
+    // Merges chains of basic blocks by the gain of their Ext-TSP score.
+    kExtTspLayout,
+  };
+
   // Constructor.
-  BasicBlockReorderingTransform() { }
+  BasicBlockReorderingTransform() : layout_(kStructuralTreeLayout) { }
+
+  // @name Accessors and mutators.
+  // @{
+  Layout layout() const { return layout_; }
+  void set_layout(Layout layout) { layout_ = layout; }
+  // @}
 
   // @name SubGraphTransformInterface implementation.
   // @{
@@ -70,9 +93,29 @@ class BasicBlockReorderingTransform : public SubGraphTransformInterface {
       const BasicBlockOrdering& order,
       block_graph::BasicEndBlock* basic_end_block,
       BasicBlockSubGraph::BasicBlockOrdering* target);
+
+  // Evaluates the Ext-TSP score of an ordering, higher being better.
+  // @param order the ordering of the basic blocks.
+  // @param profile the profile of the subgraph.
+  // @returns the score of @p order.
+  static double EvaluateExtTspScore(const BasicBlockOrdering& order,
+                                    const SubGraphProfile& profile);
+
+  // Computes the Ext-TSP layout of the basic blocks, keeping the entry
+  // first.
+  // @param original the original ordering, starting with the entry.
+  // @param profile the profile of the subgraph.
+  // @param order receives the new ordering.
+  // @returns false if the subgraph is too large to be laid out.
+  static bool ComputeExtTspOrder(const BasicBlockOrdering& original,
+                                 const SubGraphProfile& profile,
+                                 BasicBlockOrdering* order);
   // @}
 
  private:
+  // The algorithm laying out the basic blocks.
+  Layout layout_;
+
   DISALLOW_COPY_AND_ASSIGN(BasicBlockReorderingTransform);
 };
 
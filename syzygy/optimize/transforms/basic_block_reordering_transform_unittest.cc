@@ -95,6 +95,8 @@ class TestBasicBlockReorderingTransform : public BasicBlockReorderingTransform {
   using BasicBlockReorderingTransform::EvaluateCost;
   using BasicBlockReorderingTransform::CommitOrdering;
   using BasicBlockReorderingTransform::FlattenStructuralTreeToAnOrder;
+  using BasicBlockReorderingTransform::EvaluateExtTspScore;
+  using BasicBlockReorderingTransform::ComputeExtTspOrder;
 };
 
 class BasicBlockReorderingTransformTest : public testing::Test {
@@ -356,6 +358,51 @@ TEST_F(BasicBlockReorderingTransformTest, EvaluateBadOrderCost) {
                                                             subgraph_profile_));
 }
 
+TEST_F(BasicBlockReorderingTransformTest, EvaluateSequentialExtTspScore) {
+  // The basic blocks are empty, so that all of the jumps are as short as can
+  // be: b1->b2, b3->b4 and b4->b5 fall through, the others jump.
+  BasicBlockOrdering order;
+  order.push_back(b1_);
+  order.push_back(b2_);
+  order.push_back(b3_);
+  order.push_back(b4_);
+  order.push_back(b5_);
+  EXPECT_NEAR(4 + 6 + 1 + 0.1 * (6 + 4 + 9),
+              TestBasicBlockReorderingTransform::EvaluateExtTspScore(
+                  order, subgraph_profile_),
+              1e-9);
+}
+
+TEST_F(BasicBlockReorderingTransformTest, EvaluateBadOrderExtTspScore) {
+  // None of the edges fall through.
+  BasicBlockOrdering order;
+  order.push_back(b1_);
+  order.push_back(b5_);
+  order.push_back(b4_);
+  order.push_back(b3_);
+  order.push_back(b2_);
+  EXPECT_NEAR(0.1 * (4 + 6 + 4 + 6 + 9 + 1),
+              TestBasicBlockReorderingTransform::EvaluateExtTspScore(
+                  order, subgraph_profile_),
+              1e-9);
+}
+
+TEST_F(BasicBlockReorderingTransformTest, ComputeExtTspOrder) {
+  // Start from the bad ordering. The likely path falls through, and the
+  // unlikely branch goes last.
+  BasicBlockOrdering original;
+  original.push_back(b1_);
+  original.push_back(b5_);
+  original.push_back(b4_);
+  original.push_back(b3_);
+  original.push_back(b2_);
+  BasicBlockOrdering order;
+  ASSERT_TRUE(TestBasicBlockReorderingTransform::ComputeExtTspOrder(
+      original, subgraph_profile_, &order));
+
+  EXPECT_THAT(order, ElementsAre(b1_, b3_, b4_, b5_, b2_));
+}
+
 TEST_F(BasicBlockReorderingTransformTest, CommitOrdering) {
   // Create an original order.
   BasicBlockSubGraph::BasicBlockOrdering target;
@@ -447,5 +494,31 @@ TEST_F(BasicBlockReorderingTransformTest, ApplyTransformWithProfileAndGain) {
   EXPECT_THAT(kCodeJump, ElementsAreArray(block->data(), block->size()));
 }
 
+TEST_F(BasicBlockReorderingTransformTest, ApplyExtTspTransformWithProfile) {
+  BlockGraph::Block* block =
+      block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                            sizeof(kCodeJumpInv),
+                            "jump");
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+  block->SetData(kCodeJumpInv, sizeof(kCodeJumpInv));
+
+  // Insert the block profile into the profile map.
+  ApplicationProfile::BlockProfile block_profile(kRunMoreThanOnce, kHot);
+  profile_.profiles_.insert(std::make_pair(block->id(), block_profile));
+
+  TestBasicBlockProfile bb_profiles[] = {
+    TestBasicBlockProfile(kRunMoreThanOnce, kHot, kRunMoreThanOnce),
+    TestBasicBlockProfile(kRunMoreThanOnce, kHot, kRunMoreThanOnce),
+    TestBasicBlockProfile(kRunMoreThanOnce, kHot, kRunMoreThanOnce)
+  };
+
+  tx_.set_layout(BasicBlockReorderingTransform::kExtTspLayout);
+  ASSERT_NO_FATAL_FAILURE(
+      ApplyTransform(&block, bb_profiles, arraysize(bb_profiles)));
+
+  // The jump back to the return becomes a fall-through.
+  EXPECT_THAT(kCodeJump, ElementsAreArray(block->data(), block->size()));
+}
+
 }  // namespace transforms
 }  // namespace optimize
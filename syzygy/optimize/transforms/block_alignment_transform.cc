@@ -14,16 +14,74 @@
 
 #include "syzygy/optimize/transforms/block_alignment_transform.h"
 
+#include <algorithm>
+#include <set>
+
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
 
 namespace optimize {
 namespace transforms {
 
 namespace {
+
 using block_graph::BasicBlock;
 using block_graph::BasicCodeBlock;
+using block_graph::analysis::ControlFlowAnalysis;
+typedef ControlFlowAnalysis::StructuralNode StructuralNode;
+typedef std::set<const BasicCodeBlock*> BasicBlockSet;
+
+// The alignment of the functions when no profile is available.
+const size_t kUniformAlignment = 32;
+
+// Collects the headers of the loops of a structural tree.
+// @param tree the structural tree to walk.
+// @param headers receives the loop headers.
+void CollectLoopHeaders(const StructuralNode* tree, BasicBlockSet* headers) {
+  DCHECK_NE(reinterpret_cast<const StructuralNode*>(NULL), tree);
+  DCHECK_NE(reinterpret_cast<BasicBlockSet*>(NULL), headers);
+
+  switch (tree->kind()) {
+    case StructuralNode::kBaseNode:
+      break;
+    case StructuralNode::kSequenceNode:
+      CollectLoopHeaders(tree->entry_node(), headers);
+      CollectLoopHeaders(tree->sequence_node(), headers);
+      break;
+    case StructuralNode::kIfThenNode:
+      CollectLoopHeaders(tree->entry_node(), headers);
+      CollectLoopHeaders(tree->then_node(), headers);
+      break;
+    case StructuralNode::kIfThenElseNode:
+      CollectLoopHeaders(tree->entry_node(), headers);
+      CollectLoopHeaders(tree->then_node(), headers);
+      CollectLoopHeaders(tree->else_node(), headers);
+      break;
+    case StructuralNode::kRepeatNode:
+    case StructuralNode::kLoopNode:
+      headers->insert(tree->root());
+      CollectLoopHeaders(tree->entry_node(), headers);
+      break;
+    case StructuralNode::kWhileNode:
+      headers->insert(tree->root());
+      CollectLoopHeaders(tree->entry_node(), headers);
+      CollectLoopHeaders(tree->body_node(), headers);
+      break;
+    default:
+      NOTREACHED();
+      break;
+  }
+}
+
 }  // namespace
 
+const size_t BlockAlignmentTransform::kHottestAlignment = 64;
+const size_t BlockAlignmentTransform::kHotAlignment = 32;
+const double BlockAlignmentTransform::kHottestPercentile = 0.5;
+const double BlockAlignmentTransform::kHotPercentile = 0.9;
+const size_t BlockAlignmentTransform::kMinLoopIterations = 8;
+const size_t BlockAlignmentTransform::kDefaultPaddingBudget = 64 * 1024;
+
 bool BlockAlignmentTransform::TransformBasicBlockSubGraph(
       const TransformPolicyInterface* policy,
       BlockGraph* block_graph,
@@ -36,27 +94,86 @@ bool BlockAlignmentTransform::TransformBasicBlockSubGraph(
   DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
   DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
 
-  // Iterates through each basic block.
-  BasicBlockSubGraph::BBCollection::iterator bb_iter =
-      subgraph->basic_blocks().begin();
-  for (; bb_iter != subgraph->basic_blocks().end(); ++bb_iter) {
-    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
-    if (bb == NULL)
-      continue;
-    // TODO(etienneb): Basic block alignment based on frequencies (PGO).
+  if (subgraph->block_descriptions().empty())
+    return true;
+
+  // The hot code of the function is in the first block description. Any
+  // other description holds cold code, which isn't padded.
+  BasicBlockSubGraph::BlockDescription& description =
+      subgraph->block_descriptions().front();
+
+  // Without a profile, all functions are aligned uniformly.
+  if (profile->global_temperature() == 0) {
+    if (description.alignment <= 1)
+      description.alignment = kUniformAlignment;
+    return true;
+  }
+
+  // Cold functions aren't padded.
+  const BlockGraph::Block* block = subgraph->original_block();
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+  const ApplicationProfile::BlockProfile* block_profile =
+      profile->GetBlockProfile(block);
+  if (block_profile->count() == 0 ||
+      block_profile->percentile() >= kHotPercentile) {
+    return true;
   }
 
   // Apply function alignment.
-  if (!subgraph->block_descriptions().empty()) {
-    BasicBlockSubGraph::BlockDescription& description =
-        subgraph->block_descriptions().front();
-    // TODO(etienneb): Function alignment based on frequencies (PGO).
-    if (description.alignment <= 1)
-      description.alignment = 32;
+  size_t function_alignment = kHotAlignment;
+  if (block_profile->percentile() < kHottestPercentile)
+    function_alignment = kHottestAlignment;
+  if (!RaiseAlignment(&description.alignment, function_alignment))
+    return true;
+
+  // Find the loop headers. The loops of an irreducible function aren't
+  // aligned.
+  ControlFlowAnalysis::StructuralTree tree;
+  if (!ControlFlowAnalysis::BuildStructuralTree(subgraph, &tree))
+    return true;
+  BasicBlockSet headers;
+  CollectLoopHeaders(tree.get(), &headers);
+
+  // Align the headers of the loops that iterate a few times per call. The
+  // first basic block is already aligned along with the function.
+  ApplicationProfile::EntryCountType min_count =
+      block_profile->count() * kMinLoopIterations;
+  BasicBlockSubGraph::BasicBlockOrdering::iterator bb_iter =
+      description.basic_block_order.begin();
+  for (; bb_iter != description.basic_block_order.end(); ++bb_iter) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+    if (bb == NULL || bb_iter == description.basic_block_order.begin())
+      continue;
+    if (headers.find(bb) == headers.end())
+      continue;
+    if (subgraph_profile->GetBasicBlockProfile(bb)->count() < min_count)
+      continue;
+
+    size_t alignment = bb->alignment();
+    if (RaiseAlignment(&alignment, kHotAlignment))
+      bb->set_alignment(alignment);
   }
 
   return true;
 }
 
+bool BlockAlignmentTransform::RaiseAlignment(size_t* alignment,
+                                             size_t new_alignment) {
+  DCHECK_NE(reinterpret_cast<size_t*>(NULL), alignment);
+
+  if (*alignment >= new_alignment)
+    return true;
+
+  // Aligning to a larger power of two adds at most the difference of the
+  // alignments as padding.
+  size_t padding = new_alignment - std::max<size_t>(*alignment, 1);
+  if (padding_used_ + padding > padding_budget_)
+    return false;
+
+  padding_used_ += padding;
+  *alignment = new_alignment;
+  return true;
+}
+
 }  // namespace transforms
 }  // namespace optimize
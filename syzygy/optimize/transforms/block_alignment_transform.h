@@ -13,6 +13,13 @@
 // limitations under the License.
 //
 // This class implements the functions alignment transformation.
+//
+// When a profile is available, the alignment is driven by it: the entries of
+// the hot functions and the headers of their hot loops are aligned, so that
+// they start at the beginning of a fetch block and of a decoded instruction
+// cache line, and cold code isn't padded at all. The padding added by the
+// transform is bounded by a budget, charged with the worst case padding of
+// each alignment. Without a profile, all functions are aligned uniformly.
 
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_BLOCK_ALIGNMENT_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_BLOCK_ALIGNMENT_TRANSFORM_H_
@@ -31,8 +38,37 @@ class BlockAlignmentTransform : public SubGraphTransformInterface {
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
 
+  // The alignment of the hottest functions, and of the other hot functions
+  // and hot loop headers.
+  static const size_t kHottestAlignment;
+  static const size_t kHotAlignment;
+
+  // The percentiles of temperature below which a function is amongst the
+  // hottest, or is hot.
+  static const double kHottestPercentile;
+  static const double kHotPercentile;
+
+  // The minimum number of times a loop header is executed per entry in its
+  // function for it to be aligned.
+  static const size_t kMinLoopIterations;
+
+  // The default budget of padding bytes.
+  static const size_t kDefaultPaddingBudget;
+
   // Constructor.
-  BlockAlignmentTransform() { }
+  BlockAlignmentTransform()
+      : padding_budget_(kDefaultPaddingBudget), padding_used_(0) {
+  }
+
+  // @name Accessors.
+  // @{
+  size_t padding_budget() const { return padding_budget_; }
+  void set_padding_budget(size_t padding_budget) {
+    padding_budget_ = padding_budget;
+  }
+  // @returns the worst case number of padding bytes added so far.
+  size_t padding_used() const { return padding_used_; }
+  // @}
 
   // @name SubGraphTransformInterface implementation.
   // @{
@@ -44,7 +80,20 @@ class BlockAlignmentTransform : public SubGraphTransformInterface {
       SubGraphProfile* subgraph_profile) override;
   // @}
 
+ protected:
+  // Raises an alignment, if the padding budget allows for it.
+  // @param alignment the alignment to raise, in place.
+  // @param new_alignment the requested alignment.
+  // @returns true if the alignment was raised.
+  bool RaiseAlignment(size_t* alignment, size_t new_alignment);
+
  private:
+  // The maximum number of padding bytes to add.
+  size_t padding_budget_;
+
+  // The worst case number of padding bytes added so far.
+  size_t padding_used_;
+
   DISALLOW_COPY_AND_ASSIGN(BlockAlignmentTransform);
 };
 
@@ -27,6 +27,7 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlockDecomposer;
+using block_graph::BasicCodeBlock;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
 using block_graph::BasicBlockSubGraph;
@@ -34,16 +35,58 @@ using optimize::ApplicationProfile;
 using optimize::SubGraphProfile;
 using pe::ImageLayout;
 
+typedef ApplicationProfile::EntryCountType EntryCountType;
+
 // Dummy code body.
 const uint8_t kCodeBody1[] = {0x74, 0x02, 0x33, 0xC0, 0xC3};
 const uint8_t kCodeBody2[] = {0x0B, 0xC0, 0x75, 0xFC, 0xC3};
 
+// _asm xor eax, eax
+// loop:
+// _asm or eax, eax
+// _asm jne loop
+// _asm ret
+const uint8_t kCodeLoop[] = {0x33, 0xC0, 0x0B, 0xC0, 0x75, 0xFC, 0xC3};
+
+const EntryCountType kHot = 100;
+
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::global_temperature_;
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
 class BlockAlignmentTransformTest : public testing::Test {
  public:
   BlockAlignmentTransformTest()
       : code1_(NULL), code2_(NULL), image_(&block_graph_), profile_(&image_) {
   }
 
+  // Gives @p block a profile, with @p percentile of the temperature of the
+  // block graph.
+  void SetBlockProfile(BlockGraph::Block* block, double percentile) {
+    ApplicationProfile::BlockProfile block_profile(kHot, kHot);
+    block_profile.set_percentile(percentile);
+    profile_.profiles_.insert(std::make_pair(block->id(), block_profile));
+    profile_.global_temperature_ += kHot;
+  }
+
   virtual void SetUp() {
     code1_ = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
                                    sizeof(kCodeBody1),
@@ -67,8 +110,8 @@ class BlockAlignmentTransformTest : public testing::Test {
   BlockGraph::Block* code2_;
   BlockAlignmentTransform tx_;
   ImageLayout image_;
-  ApplicationProfile profile_;
-  SubGraphProfile subgraph_profile_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
 };
 
 void BlockAlignmentTransformTest::ApplyTransform(BlockGraph::Block** block) {
@@ -77,6 +120,20 @@ void BlockAlignmentTransformTest::ApplyTransform(BlockGraph::Block** block) {
   BasicBlockDecomposer decomposer(*block, &subgraph);
   ASSERT_TRUE(decomposer.Decompose());
 
+  // Every basic block of a profiled function is executed in a loop.
+  if (profile_.GetBlockProfile(*block)->count() != 0) {
+    BasicBlockSubGraph::BBCollection::iterator bb_iter =
+        subgraph.basic_blocks().begin();
+    for (; bb_iter != subgraph.basic_blocks().end(); ++bb_iter) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+      if (bb != NULL) {
+        subgraph_profile_.basic_blocks_[bb] =
+            TestBasicBlockProfile(kHot * BlockAlignmentTransform::
+                                      kMinLoopIterations);
+      }
+    }
+  }
+
   // Apply block alignment transform.
   ASSERT_TRUE(
       tx_.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
@@ -103,5 +160,57 @@ TEST_F(BlockAlignmentTransformTest, AlignmentTest) {
   EXPECT_EQ(2U, code2_->alignment());
 }
 
+TEST_F(BlockAlignmentTransformTest, HotFunctionAlignment) {
+  SetBlockProfile(code1_, 0.1);
+  SetBlockProfile(code2_, 0.7);
+
+  ApplyTransform(&code1_);
+  EXPECT_EQ(BlockAlignmentTransform::kHottestAlignment, code1_->alignment());
+
+  ApplyTransform(&code2_);
+  EXPECT_EQ(BlockAlignmentTransform::kHotAlignment, code2_->alignment());
+
+  EXPECT_EQ(BlockAlignmentTransform::kHottestAlignment - 1 +
+                BlockAlignmentTransform::kHotAlignment - 1,
+            tx_.padding_used());
+}
+
+TEST_F(BlockAlignmentTransformTest, ColdFunctionIsNotPadded) {
+  SetBlockProfile(code1_, 0.1);
+  SetBlockProfile(code2_, 0.95);
+
+  ApplyTransform(&code2_);
+  EXPECT_EQ(1U, code2_->alignment());
+  EXPECT_EQ(0U, tx_.padding_used());
+}
+
+TEST_F(BlockAlignmentTransformTest, HotLoopAlignment) {
+  BlockGraph::Block* loop = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                  sizeof(kCodeLoop),
+                                                  "loop");
+  loop->SetData(kCodeLoop, loop->size());
+  SetBlockProfile(loop, 0.1);
+
+  ApplyTransform(&loop);
+  EXPECT_EQ(BlockAlignmentTransform::kHottestAlignment, loop->alignment());
+
+  // The loop header is padded to the next 32 bytes boundary.
+  EXPECT_EQ(BlockAlignmentTransform::kHotAlignment + sizeof(kCodeLoop) - 2,
+            loop->size());
+}
+
+TEST_F(BlockAlignmentTransformTest, PaddingBudget) {
+  SetBlockProfile(code1_, 0.1);
+  SetBlockProfile(code2_, 0.7);
+  tx_.set_padding_budget(BlockAlignmentTransform::kHotAlignment);
+
+  // The hottest function doesn't fit in the budget, but the next one does.
+  ApplyTransform(&code1_);
+  EXPECT_EQ(1U, code1_->alignment());
+  ApplyTransform(&code2_);
+  EXPECT_EQ(BlockAlignmentTransform::kHotAlignment, code2_->alignment());
+  EXPECT_GE(tx_.padding_budget(), tx_.padding_used());
+}
+
 }  // namespace transforms
 }  // namespace optimize
@@ -0,0 +1,121 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation of the hot/cold splitting transform.
+
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
+
+#include "syzygy/pe/pe_utils.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicCodeBlock;
+typedef BasicBlockSubGraph::BasicBlockOrdering BasicBlockOrdering;
+typedef BasicBlockSubGraph::BlockDescription BlockDescription;
+
+}  // namespace
+
+const char HotColdSplittingTransform::kColdSectionName[] = ".cold";
+const char HotColdSplittingTransform::kColdBlockSuffix[] = ".cold";
+const size_t HotColdSplittingTransform::kMinColdSize = 16;
+
+bool HotColdSplittingTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* subgraph,
+    ApplicationProfile* profile,
+    SubGraphProfile* subgraph_profile) {
+  DCHECK_NE(reinterpret_cast<TransformPolicyInterface*>(NULL), policy);
+  DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), block_graph);
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
+  DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
+
+  // Functions that were never executed are cold as a whole, and are left to
+  // the block ordering.
+  const BlockGraph::Block* block = subgraph->original_block();
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+  if (profile->GetBlockProfile(block)->count() == 0)
+    return true;
+
+  // Avoid splitting a block with a jump table or data block.
+  BasicBlockSubGraph::BBCollection::iterator bb_iter =
+      subgraph->basic_blocks().begin();
+  for (; bb_iter != subgraph->basic_blocks().end(); ++bb_iter) {
+    if ((*bb_iter)->type() == BlockGraph::DATA_BLOCK)
+      return true;
+  }
+
+  // Avoid splitting a block that was already split or merged.
+  BasicBlockSubGraph::BlockDescriptionList& descriptions =
+      subgraph->block_descriptions();
+  if (descriptions.size() != 1)
+    return true;
+  BlockDescription& hot_description = descriptions.front();
+
+  // Partition the basic blocks, keeping their order. The entry of the
+  // function always stays in the hot block, as do the end block and the
+  // basic blocks that were executed.
+  BasicBlockOrdering hot_order;
+  BasicBlockOrdering cold_order;
+  size_t cold_size = 0;
+  BasicBlockOrdering::iterator order_it =
+      hot_description.basic_block_order.begin();
+  for (; order_it != hot_description.basic_block_order.end(); ++order_it) {
+    BasicCodeBlock* code_bb = BasicCodeBlock::Cast(*order_it);
+    if (code_bb != NULL && !hot_order.empty() &&
+        subgraph_profile->GetBasicBlockProfile(code_bb)->count() == 0) {
+      cold_order.push_back(code_bb);
+      cold_size += code_bb->GetInstructionSize();
+    } else {
+      hot_order.push_back(*order_it);
+    }
+  }
+  if (cold_size < kMinColdSize)
+    return true;
+
+  // Find or create the cold section, with the characteristics of the section
+  // of the function.
+  uint32_t characteristics = pe::kCodeCharacteristics;
+  const BlockGraph::Section* section =
+      block_graph->GetSectionById(hot_description.section);
+  if (section != NULL)
+    characteristics = section->characteristics();
+  BlockGraph::Section* cold_section =
+      block_graph->FindOrAddSection(kColdSectionName, characteristics);
+  DCHECK_NE(reinterpret_cast<BlockGraph::Section*>(NULL), cold_section);
+
+  // The cold block isn't a root for the unreachable block transform, as it
+  // is only ever entered from its hot block.
+  BlockDescription* cold_description = subgraph->AddBlockDescription(
+      hot_description.name + kColdBlockSuffix,
+      hot_description.compiland_name,
+      hot_description.type,
+      cold_section->id(),
+      hot_description.alignment,
+      hot_description.attributes & ~BlockGraph::PE_PARSED);
+  DCHECK_NE(reinterpret_cast<BlockDescription*>(NULL), cold_description);
+
+  hot_description.basic_block_order.swap(hot_order);
+  cold_description->basic_block_order.swap(cold_order);
+
+  return true;
+}
+
+}  // namespace transforms
+}  // namespace optimize
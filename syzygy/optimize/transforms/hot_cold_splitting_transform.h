@@ -0,0 +1,76 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// The hot/cold splitting transform moves the basic blocks of a function that
+// were never executed, according to the profile, out of the function and into
+// a separate block in a cold code section. The hot basic blocks of the
+// functions are then packed together, which improves the density of the code
+// that is actually executed.
+//
+// The branches between the hot and the cold blocks become long branches to
+// another block, and fall-throughs across them become jumps, as the blocks
+// are rebuilt. The cold block is only referenced by its hot block, and isn't
+// a root of the decomposition, so that it is unreachable whenever its hot
+// block is.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
+
+#include "syzygy/block_graph/basic_block_subgraph.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/transform_policy.h"
+#include "syzygy/optimize/application_profile.h"
+#include "syzygy/optimize/transforms/subgraph_transform.h"
+
+namespace optimize {
+namespace transforms {
+
+class HotColdSplittingTransform : public SubGraphTransformInterface {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+
+  // The name of the section receiving the cold blocks. The section names of
+  // an image are at most 8 characters long.
+  static const char kColdSectionName[];
+
+  // The suffix of the names of the cold blocks.
+  static const char kColdBlockSuffix[];
+
+  // The minimum size of the cold instructions of a function for them to be
+  // split. Splitting fewer bytes doesn't pay for the long branches to them.
+  static const size_t kMinColdSize;
+
+  // Constructor.
+  HotColdSplittingTransform() { }
+
+  // @name SubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* subgraph,
+      ApplicationProfile* profile,
+      SubGraphProfile* subgraph_profile) override;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HotColdSplittingTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
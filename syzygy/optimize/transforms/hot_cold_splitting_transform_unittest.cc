@@ -0,0 +1,219 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
+
+#include <utility>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/block_builder.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/pe/pe_transform_policy.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlockDecomposer;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BasicCodeBlock;
+using block_graph::BlockBuilder;
+using block_graph::BlockGraph;
+using block_graph::BlockVector;
+using pe::ImageLayout;
+using testing::ElementsAreArray;
+
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
+
+// _asm test eax, eax
+// _asm jne cold
+// _asm ret
+// cold:
+// _asm xor eax, eax  (8 times)
+// _asm ret
+const uint8_t kCodeWithColdPath[] = {
+    0x85, 0xC0, 0x75, 0x01, 0xC3, 0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0,
+    0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0, 0xC3};
+
+// _asm je  here
+// _asm xor eax, eax
+// here:
+// _asm ret
+const uint8_t kCodeJump[] = {0x74, 0x02, 0x33, 0xC0, 0xC3};
+
+const EntryCountType kHot = 100;
+
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
+class HotColdSplittingTransformTest : public testing::Test {
+ public:
+  HotColdSplittingTransformTest()
+      : image_(&block_graph_),
+        profile_(&image_) {
+  }
+
+  // Adds a code block, executed according to the profile.
+  BlockGraph::Block* AddBlock(const uint8_t* data, size_t size, bool hot) {
+    BlockGraph::Block* block =
+        block_graph_.AddBlock(BlockGraph::CODE_BLOCK, size, "test");
+    DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+    block->SetData(data, size);
+    block->set_attribute(BlockGraph::PE_PARSED);
+    if (hot) {
+      ApplicationProfile::BlockProfile block_profile(kHot, kHot);
+      profile_.profiles_.insert(std::make_pair(block->id(), block_profile));
+    }
+    return block;
+  }
+
+  // Decomposes @p block, gives the entry counts of @p counts to its basic
+  // code blocks in order, applies the transform, and rebuilds the blocks
+  // into @p new_blocks.
+  void ApplyTransform(BlockGraph::Block* block,
+                      const EntryCountType* counts,
+                      size_t num_counts,
+                      BlockVector* new_blocks) {
+    BasicBlockSubGraph subgraph;
+    BasicBlockDecomposer decomposer(block, &subgraph);
+    ASSERT_TRUE(decomposer.Decompose());
+
+    ASSERT_EQ(1U, subgraph.block_descriptions().size());
+    const BasicBlockSubGraph::BasicBlockOrdering& order =
+        subgraph.block_descriptions().front().basic_block_order;
+    size_t i = 0;
+    BasicBlockSubGraph::BasicBlockOrdering::const_iterator bb = order.begin();
+    for (; i < num_counts && bb != order.end(); ++i, ++bb) {
+      BasicCodeBlock* code = BasicCodeBlock::Cast(*bb);
+      ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), code);
+      subgraph_profile_.basic_blocks_[code] = TestBasicBlockProfile(counts[i]);
+    }
+
+    ASSERT_TRUE(
+        tx_.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
+                                        &profile_, &subgraph_profile_));
+
+    BlockBuilder builder(&block_graph_);
+    ASSERT_TRUE(builder.Merge(&subgraph));
+    *new_blocks = builder.new_blocks();
+  }
+
+ protected:
+  pe::PETransformPolicy policy_;
+  BlockGraph block_graph_;
+  ImageLayout image_;
+  HotColdSplittingTransform tx_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
+};
+
+}  // namespace
+
+TEST_F(HotColdSplittingTransformTest, ColdFunctionIsNotSplit) {
+  BlockGraph::Block* block =
+      AddBlock(kCodeWithColdPath, sizeof(kCodeWithColdPath), false);
+
+  BlockVector new_blocks;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(block, NULL, 0, &new_blocks));
+
+  ASSERT_EQ(1U, new_blocks.size());
+  EXPECT_THAT(kCodeWithColdPath,
+              ElementsAreArray(new_blocks[0]->data(), new_blocks[0]->size()));
+  EXPECT_EQ(
+      reinterpret_cast<const BlockGraph::Section*>(NULL),
+      block_graph_.FindSection(HotColdSplittingTransform::kColdSectionName));
+}
+
+TEST_F(HotColdSplittingTransformTest, HotFunctionIsNotSplit) {
+  BlockGraph::Block* block =
+      AddBlock(kCodeWithColdPath, sizeof(kCodeWithColdPath), true);
+  const EntryCountType kCounts[] = {kHot, kHot, kHot};
+
+  BlockVector new_blocks;
+  ASSERT_NO_FATAL_FAILURE(
+      ApplyTransform(block, kCounts, arraysize(kCounts), &new_blocks));
+
+  ASSERT_EQ(1U, new_blocks.size());
+  EXPECT_THAT(kCodeWithColdPath,
+              ElementsAreArray(new_blocks[0]->data(), new_blocks[0]->size()));
+}
+
+TEST_F(HotColdSplittingTransformTest, SmallColdPathIsNotSplit) {
+  BlockGraph::Block* block = AddBlock(kCodeJump, sizeof(kCodeJump), true);
+  const EntryCountType kCounts[] = {kHot, 0, kHot};
+
+  BlockVector new_blocks;
+  ASSERT_NO_FATAL_FAILURE(
+      ApplyTransform(block, kCounts, arraysize(kCounts), &new_blocks));
+
+  ASSERT_EQ(1U, new_blocks.size());
+  EXPECT_THAT(kCodeJump,
+              ElementsAreArray(new_blocks[0]->data(), new_blocks[0]->size()));
+}
+
+TEST_F(HotColdSplittingTransformTest, ColdPathIsSplit) {
+  BlockGraph::Block* block =
+      AddBlock(kCodeWithColdPath, sizeof(kCodeWithColdPath), true);
+  const EntryCountType kCounts[] = {kHot, kHot, 0};
+
+  BlockVector new_blocks;
+  ASSERT_NO_FATAL_FAILURE(
+      ApplyTransform(block, kCounts, arraysize(kCounts), &new_blocks));
+  ASSERT_EQ(2U, new_blocks.size());
+
+  const BlockGraph::Section* cold_section =
+      block_graph_.FindSection(HotColdSplittingTransform::kColdSectionName);
+  ASSERT_NE(reinterpret_cast<const BlockGraph::Section*>(NULL), cold_section);
+
+  BlockGraph::Block* hot_block = new_blocks[0];
+  BlockGraph::Block* cold_block = new_blocks[1];
+  if (hot_block->section() == cold_section->id())
+    std::swap(hot_block, cold_block);
+  EXPECT_EQ(cold_section->id(), cold_block->section());
+
+  // The hot block branches to the cold one with a long branch, and keeps
+  // its fall-through: test eax, eax; jne cold; ret.
+  EXPECT_EQ(2U + 6U + 1U, hot_block->size());
+  EXPECT_EQ(sizeof(kCodeWithColdPath) - 5, cold_block->size());
+  ASSERT_EQ(1U, hot_block->references().size());
+  EXPECT_EQ(cold_block, hot_block->references().begin()->second.referenced());
+
+  // Only the hot block is a root of the unreachable block transform.
+  EXPECT_TRUE(hot_block->attributes() & BlockGraph::PE_PARSED);
+  EXPECT_FALSE(cold_block->attributes() & BlockGraph::PE_PARSED);
+}
+
+}  // namespace transforms
+}  // namespace optimize
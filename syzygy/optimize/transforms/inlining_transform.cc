@@ -69,6 +69,7 @@ using block_graph::Successor;
 using block_graph::analysis::LivenessAnalysis;
 
 typedef ApplicationProfile::BlockProfile BlockProfile;
+typedef ApplicationProfile::EntryCountType EntryCountType;
 typedef Instruction::BasicBlockReferenceMap BasicBlockReferenceMap;
 typedef BasicBlockSubGraph::BBCollection BBCollection;
 typedef BasicBlock::Instructions Instructions;
@@ -88,9 +89,21 @@ enum MatchKind {
 // overhead of decomposition and simplification of huge block.
 const size_t kCodeSizeThreshold = 25;
 
-// Threshold in bytes to inline a callee in a hot block.
+// Threshold in bytes to inline a callee in a hot block. This is the maximum
+// code growth of inlining a callee at a hot call-site.
 const size_t kHotCodeSizeThreshold = 15;
 
+// The code growth in bytes paid for by the call overhead saved by a call-site
+// that is executed once per entry in its caller.
+const double kCallSiteBenefit = 8.0;
+
+// The maximum code growth in bytes of a caller by the inlining of hot
+// call-sites.
+const size_t kMaxCallerGrowth = 64;
+
+// The maximum depth of the bodies inlined into inlined bodies.
+const size_t kMaxInliningDepth = 3;
+
 // Threshold in bytes to inline a callee in a cold block.
 const size_t kColdCodeSizeThreshold = 1;
 
@@ -396,6 +409,8 @@ bool RewriteLocalReferences(BasicBlockSubGraph* subgraph,
 // @param body The trivial body to be inlined.
 // @param target The place where to insert the callee body into the caller.
 // @param instructions The caller body that receives a copy of the callee body.
+// @param inlined Receives the first inlined instruction, or @p target when
+//     no instruction was inlined.
 // @returns true on success, false otherwise.
 bool InlineTrivialBody(MatchKind kind,
                        BasicBlockSubGraph* subgraph,
@@ -403,8 +418,10 @@ bool InlineTrivialBody(MatchKind kind,
                        const BasicBlockReference& reference,
                        const BasicCodeBlock* body,
                        Instructions::iterator target,
-                       Instructions* instructions) {
+                       Instructions* instructions,
+                       Instructions::iterator* inlined) {
   DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), inlined);
 
   Instructions new_body;
 
@@ -453,7 +470,9 @@ bool InlineTrivialBody(MatchKind kind,
   if (!RewriteLocalReferences(subgraph, &new_body))
     return false;
 
-  // Insert the inlined instructions at the call-site.
+  // Insert the inlined instructions at the call-site. The iterators to the
+  // spliced instructions remain valid.
+  *inlined = new_body.empty() ? target : new_body.begin();
   instructions->splice(target, new_body);
   return true;
 }
@@ -519,6 +538,38 @@ size_t EstimateSubgraphSize(BasicBlockSubGraph* subgraph) {
   return size;
 }
 
+// Decides whether a callee is worth inlining at a call-site, from the code
+// growth it costs and the call overhead it saves.
+// @param callsite_size The size of the call instruction.
+// @param callee_size The estimated size of the callee body once inlined.
+// @param callsite_count The number of times the call-site was executed.
+// @param caller_count The number of times the caller was entered.
+// @param growth_budget The code growth still allowed for the caller.
+// @returns true if the callee is worth inlining.
+bool IsWorthInlining(size_t callsite_size,
+                     size_t callee_size,
+                     EntryCountType callsite_count,
+                     EntryCountType caller_count,
+                     size_t growth_budget) {
+  // For a small callee, replacing the call by the callee instructions in-place
+  // is always a win.
+  if (callee_size <= callsite_size + kColdCodeSizeThreshold)
+    return true;
+
+  // Otherwise, the call-site must be hot.
+  if (callsite_count == 0 || caller_count == 0)
+    return false;
+
+  size_t growth = callee_size - callsite_size;
+  if (growth > kHotCodeSizeThreshold || growth > growth_budget)
+    return false;
+
+  // A call-site that runs several times per entry in its caller, like one in
+  // a loop, pays for more code growth.
+  double calls_per_entry = static_cast<double>(callsite_count) / caller_count;
+  return calls_per_entry * kCallSiteBenefit >= growth;
+}
+
 }  // namespace
 
 bool InliningTransform::TransformBasicBlockSubGraph(
@@ -544,6 +595,9 @@ bool InliningTransform::TransformBasicBlockSubGraph(
   // dangling pointers, the block is removed from the decomposed cache.
   subgraph_cache_.erase(caller->id());
 
+  EntryCountType caller_count = profile->GetBlockProfile(caller)->count();
+  size_t growth_budget = kMaxCallerGrowth;
+
   // Iterates through each basic block.
   BasicBlockSubGraph::BBCollection::iterator bb_iter =
       subgraph->basic_blocks().begin();
@@ -552,6 +606,13 @@ bool InliningTransform::TransformBasicBlockSubGraph(
     if (bb == NULL)
       continue;
 
+    EntryCountType callsite_count =
+        subgraph_profile->GetBasicBlockProfile(bb)->count();
+
+    // The depth of the inlined instructions, whose call-sites are only
+    // inlined when hot.
+    std::map<const Instruction*, size_t> inlined_depth;
+
     // Iterates through each instruction.
     BasicBlock::Instructions::iterator inst_iter = bb->instructions().begin();
     while (inst_iter != bb->instructions().end()) {
@@ -564,6 +625,12 @@ bool InliningTransform::TransformBasicBlockSubGraph(
       if (!MatchDirectCall(instr, &callee))
         continue;
 
+      size_t depth = 0;
+      std::map<const Instruction*, size_t>::const_iterator depth_iter =
+          inlined_depth.find(&instr);
+      if (depth_iter != inlined_depth.end())
+        depth = depth_iter->second;
+
       // Avoid self recursion inlining.
       // Apply the decomposition policy to the callee.
       if (caller == callee ||
@@ -613,30 +680,39 @@ bool InliningTransform::TransformBasicBlockSubGraph(
       }
 
       // Heuristic to determine whether to inline or not the callee subgraph.
-      bool candidate_for_inlining = false;
-
-      // For a small callee, try to replace callee instructions in-place.
-      // This kind of inlining is always a win.
       size_t callsite_size = instr.size();
-      if (subgraph_size <= callsite_size + kColdCodeSizeThreshold)
-        candidate_for_inlining = true;
-
-      // TODO(etienneb): Add more rules based on profile data.
-
-      if (!candidate_for_inlining)
+      if (!IsWorthInlining(callsite_size, subgraph_size, callsite_count,
+                           caller_count, growth_budget)) {
         continue;
+      }
 
       // If not already decomposed (cached), decompose it.
       if (callee_subgraph.get() == NULL) {
         CHECK(DecomposeCalleeBlock(callee, &callee_subgraph));
       }
 
+      BasicBlock::Instructions::iterator inlined;
       if (MatchTrivialBody(*callee_subgraph, &match_kind, &return_constant,
                            &target, &body) &&
           InlineTrivialBody(match_kind, subgraph, return_constant, target, body,
-                            call_iter, &bb->instructions())) {
+                            call_iter, &bb->instructions(), &inlined)) {
         // Inlining successful, remove call-site.
+        if (inlined == call_iter)
+          inlined = inst_iter;
+        inlined_depth.erase(&instr);
         bb->instructions().erase(call_iter);
+        if (subgraph_size > callsite_size)
+          growth_budget -= subgraph_size - callsite_size;
+
+        // At a hot call-site, revisit the inlined instructions to inline their
+        // own call-sites.
+        if (callsite_count != 0 && depth + 1 < kMaxInliningDepth) {
+          for (BasicBlock::Instructions::iterator it = inlined;
+               it != inst_iter; ++it) {
+            inlined_depth[&*it] = depth + 1;
+          }
+          inst_iter = inlined;
+        }
       } else {
         // Inlining was unsuccessful, avoid any further inlining of this block.
         subgraph_cache_[callee->id()] = kHugeBlockSize;
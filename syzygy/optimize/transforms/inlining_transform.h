@@ -17,10 +17,11 @@
 // The inlining expansion replaces a function call site with the body of the
 // callee. It is used to eliminate the time overhead when a function is called.
 //
-// TODO(etienneb): The actual implementation does not inline a sequence of
-//    calls like Foo -> Bar -> Bat. This may be addressed by iterating this
-//    function until no changes occurred or by changing the ordering the
-//    blocks are traversed in the ChainedBasicBlockTransform.
+// A callee that is about as small as the call is always inlined. A larger
+// callee is only inlined at a hot call site, when the call overhead saved by
+// the call site executions pays for the code growth. The hot inlined bodies
+// are inlined in turn, so that a sequence of calls like Foo -> Bar -> Bat is
+// inlined, up to a bounded depth.
 
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_INLINING_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_INLINING_TRANSFORM_H_
@@ -45,6 +45,7 @@ using block_graph::Successor;
 using pe::ImageLayout;
 using testing::ElementsAreArray;
 
+typedef ApplicationProfile::EntryCountType EntryCountType;
 typedef BasicBlockSubGraph::BasicCodeBlock BasicCodeBlock;
 typedef BlockGraph::Offset Offset;
 
@@ -153,6 +154,27 @@ class TestInliningTransform : public InliningTransform {
   using InliningTransform::subgraph_cache_;
 };
 
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
 class InliningTransformTest : public testing::Test {
  public:
   InliningTransformTest()
@@ -160,7 +182,9 @@ class InliningTransformTest : public testing::Test {
         caller_(NULL),
         callee_(NULL),
         image_(&block_graph_),
-        profile_(&image_) {
+        profile_(&image_),
+        caller_count_(0),
+        callsite_count_(0) {
   }
 
   virtual void SetUp() {
@@ -194,8 +218,13 @@ class InliningTransformTest : public testing::Test {
   std::vector<uint8_t> original_;
   BasicBlockSubGraph callee_subgraph_;
   ImageLayout image_;
-  ApplicationProfile profile_;
-  SubGraphProfile subgraph_profile_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
+
+  // The profile of the caller, given to it and to its basic blocks by
+  // ApplyTransformOnCaller.
+  EntryCountType caller_count_;
+  EntryCountType callsite_count_;
 };
 
 void InliningTransformTest::AddBlockFromBuffer(const uint8_t* data,
@@ -316,6 +345,21 @@ void InliningTransformTest::ApplyTransformOnCaller() {
   BasicBlockDecomposer decomposer(caller_, &subgraph);
   ASSERT_TRUE(decomposer.Decompose());
 
+  // Apply the profile of the caller.
+  if (caller_count_ != 0) {
+    ApplicationProfile::BlockProfile block_profile(caller_count_,
+                                                   caller_count_);
+    profile_.profiles_.insert(std::make_pair(caller_->id(), block_profile));
+    BasicBlockSubGraph::BBCollection::iterator bb_iter =
+        subgraph.basic_blocks().begin();
+    for (; bb_iter != subgraph.basic_blocks().end(); ++bb_iter) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+      if (bb != NULL)
+        subgraph_profile_.basic_blocks_[bb] =
+            TestBasicBlockProfile(callsite_count_);
+    }
+  }
+
   // Apply inlining transform.
   InliningTransform tx;
   ASSERT_TRUE(
@@ -650,5 +694,59 @@ TEST_F(InliningTransformTest, InlineTrampolineToCaller) {
   EXPECT_EQ(caller_, reference.referenced());
 }
 
+TEST_F(InliningTransformTest, DontInlineLargerCalleeAtColdCallSite) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  // The callee is larger than the call-site, which wasn't executed.
+  EXPECT_THAT(original_, ElementsAreArray(caller_->data(), caller_->size()));
+}
+
+TEST_F(InliningTransformTest, InlineLargerCalleeAtHotCallSite) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+  caller_count_ = 100;
+  callsite_count_ = 100;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  EXPECT_THAT(kCodeRetBoth,
+              ElementsAreArray(caller_->data(), caller_->size()));
+}
+
+TEST_F(InliningTransformTest, DontInlineLargerCalleeAtRareCallSite) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+
+  // The call-site runs for one in ten entries in the caller, which doesn't
+  // pay for the code growth.
+  caller_count_ = 100;
+  callsite_count_ = 10;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  EXPECT_THAT(original_, ElementsAreArray(caller_->data(), caller_->size()));
+}
+
+TEST_F(InliningTransformTest, InlineTrampolineChainAtHotCallSite) {
+  BlockGraph::Block* dummy = NULL;
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRet42, sizeof(kCodeRet42), &dummy));
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRet, sizeof(kCodeRet), &callee_));
+  ASSERT_NO_FATAL_FAILURE(
+      CreateCalleeBlock(kDirectTrampoline, dummy, &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+  caller_count_ = 100;
+  callsite_count_ = 100;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  // Both the trampoline and its target are inlined.
+  EXPECT_THAT(kCodeRet42, ElementsAreArray(caller_->data(), caller_->size()));
+  EXPECT_TRUE(caller_->references().empty());
+}
+
 }  // namespace transforms
 }  // namespace optimize
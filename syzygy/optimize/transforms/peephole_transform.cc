@@ -14,6 +14,11 @@
 
 #include "syzygy/optimize/transforms/peephole_transform.h"
 
+#include <algorithm>
+#include <set>
+#include <utility>
+#include <vector>
+
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
@@ -24,13 +29,43 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlock;
+using block_graph::BasicBlockReference;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicCodeBlock;
 using block_graph::Instruction;
+using block_graph::Successor;
 using block_graph::analysis::LivenessAnalysis;
 
 typedef BasicBlockSubGraph::BBCollection BBCollection;
 typedef BasicBlock::Instructions Instructions;
+typedef BasicBlock::Successors Successors;
+
+// A peephole pattern. It matches the instructions at |*where| and on a match
+// rewrites them, leaving |*where| on the instruction following the rewritten
+// ones.
+// @param instructions the instructions of a basic block.
+// @param where the position to match.
+// @returns true if the instructions have been rewritten, false otherwise.
+typedef bool (*PeepholePattern)(Instructions* instructions,
+                                Instructions::iterator* where);
+
+// Match a sequence of two instructions and return them into |instr1| and
+// |instr2|.
+bool MatchTwoInstructions(const Instructions& instructions,
+                          Instructions::iterator where,
+                          Instruction** instr1,
+                          Instruction** instr2) {
+  if (where == instructions.end())
+    return false;
+  *instr1 = &*where;
+  where++;
+
+  if (where == instructions.end())
+    return false;
+  *instr2 = &*where;
+
+  return true;
+}
 
 // Match a sequence of three instructions and return them into |instr1|,
 // |instr2| and |instr3|.
@@ -56,6 +91,11 @@ bool MatchThreeInstructions(const Instructions& instructions,
   return true;
 }
 
+// Validate that a given instruction is the one byte encoding of |opcode|.
+bool MatchInstructionByte(const Instruction& instr, _InstructionType opcode) {
+  return instr.representation().opcode == opcode && instr.size() == 1;
+}
+
 // Validate that a given instruction has opcode |opcode| and |reg| as its
 // register operand.
 bool MatchInstructionReg(const Instruction& instr,
@@ -153,6 +193,88 @@ bool SimplifyIdentityMov(Instructions* instructions,
   return false;
 }
 
+// Remove a register that's pushed then popped right away, like:
+//   push eax
+//   pop eax
+bool SimplifyPushPop(Instructions* instructions,
+                     Instructions::iterator* where) {
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), where);
+
+  Instruction* instr1 = NULL;
+  Instruction* instr2 = NULL;
+  if (!MatchTwoInstructions(*instructions, *where, &instr1, &instr2))
+    return false;
+
+  const _DInst& repr = instr1->representation();
+  if (repr.opcode != I_PUSH || repr.ops[0].type != O_REG)
+    return false;
+  if (!MatchInstructionReg(*instr2, I_POP,
+                           static_cast<_RegisterType>(repr.ops[0].index))) {
+    return false;
+  }
+
+  // Remove the two matched instructions.
+  for (int i = 0; i < 2; ++i)
+    *where = instructions->erase(*where);
+  return true;
+}
+
+// Remove flags that are saved then restored right away, like the flag saves
+// of adjacent probes:
+//   pushfd
+//   popfd
+bool SimplifyPushfdPopfd(Instructions* instructions,
+                         Instructions::iterator* where) {
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), where);
+
+  Instruction* instr1 = NULL;
+  Instruction* instr2 = NULL;
+  if (MatchTwoInstructions(*instructions, *where, &instr1, &instr2) &&
+      MatchInstructionByte(*instr1, I_PUSHF) &&
+      MatchInstructionByte(*instr2, I_POPF)) {
+    // Remove the two matched instructions.
+    for (int i = 0; i < 2; ++i)
+      *where = instructions->erase(*where);
+    return true;
+  }
+
+  return false;
+}
+
+// Remove the restoring of flags that were just saved in ah, like:
+//   lahf
+//   sahf
+// The lahf is kept, as it defines ah.
+bool SimplifyLahfSahf(Instructions* instructions,
+                      Instructions::iterator* where) {
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), where);
+
+  Instruction* instr1 = NULL;
+  Instruction* instr2 = NULL;
+  if (MatchTwoInstructions(*instructions, *where, &instr1, &instr2) &&
+      MatchInstructionByte(*instr1, I_LAHF) &&
+      MatchInstructionByte(*instr2, I_SAHF)) {
+    // Remove the sahf.
+    ++(*where);
+    *where = instructions->erase(*where);
+    return true;
+  }
+
+  return false;
+}
+
+// The patterns applied to each instruction, in order.
+const PeepholePattern kPeepholePatterns[] = {
+    &SimplifyEmptyPrologEpilog,
+    &SimplifyIdentityMov,
+    &SimplifyPushPop,
+    &SimplifyPushfdPopfd,
+    &SimplifyLahfSahf,
+};
+
 // Simplify a given basic block.
 bool SimplifyBasicBlock(BasicBlock* basic_block) {
   DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), basic_block);
@@ -166,8 +288,15 @@ bool SimplifyBasicBlock(BasicBlock* basic_block) {
   // Match and rewrite based on patterns.
   BasicBlock::Instructions::iterator inst_iter = bb->instructions().begin();
   while (inst_iter != bb->instructions().end()) {
-    if (SimplifyEmptyPrologEpilog(&bb->instructions(), &inst_iter) ||
-        SimplifyIdentityMov(&bb->instructions(), &inst_iter)) {
+    bool matched = false;
+    for (size_t i = 0; i < arraysize(kPeepholePatterns); ++i) {
+      if (kPeepholePatterns[i](&bb->instructions(), &inst_iter)) {
+        matched = true;
+        break;
+      }
+    }
+
+    if (matched) {
       changed = true;
       continue;
     }
@@ -179,20 +308,153 @@ bool SimplifyBasicBlock(BasicBlock* basic_block) {
   return changed;
 }
 
+// Returns the basic block that an empty basic block forwards to, following
+// the chains of empty basic blocks ending in an unconditional jump.
+// @param bb the basic block.
+// @param target receives the reference the forwarding ends at.
+// @returns true if @p bb is empty and forwards to another block or basic
+//     block, false otherwise or for a loop of empty basic blocks.
+bool GetForwardingTarget(const BasicCodeBlock* bb,
+                         BasicBlockReference* target) {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+  DCHECK_NE(reinterpret_cast<BasicBlockReference*>(NULL), target);
+
+  std::set<const BasicCodeBlock*> visited;
+  while (bb != NULL && bb->instructions().empty() &&
+         bb->successors().size() == 1 &&
+         bb->successors().front().condition() == Successor::kConditionTrue) {
+    if (!visited.insert(bb).second)
+      return false;
+    *target = bb->successors().front().reference();
+    if (target->referred_type() !=
+        BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
+      break;
+    }
+    bb = BasicCodeBlock::Cast(target->basic_block());
+  }
+
+  return !visited.empty();
+}
+
+// Returns true if two references have the same destination, whatever their
+// type and size.
+bool IsSameDestination(const BasicBlockReference& ref1,
+                       const BasicBlockReference& ref2) {
+  return ref1.referred_type() == ref2.referred_type() &&
+         ref1.block() == ref2.block() &&
+         ref1.basic_block() == ref2.basic_block() &&
+         ref1.offset() == ref2.offset();
+}
+
+// Simplify the successors of a given basic block. A successor to an empty
+// basic block is redirected to where that one jumps, and a conditional
+// branch to the destination of the jump following it is removed.
+bool SimplifySuccessors(BasicBlock* basic_block) {
+  DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), basic_block);
+
+  BasicCodeBlock* bb = BasicCodeBlock::Cast(basic_block);
+  if (bb == NULL)
+    return false;
+
+  bool changed = false;
+  Successors& successors = bb->successors();
+  Successors::iterator it = successors.begin();
+  for (; it != successors.end(); ++it) {
+    BasicBlockReference ref = it->reference();
+    if (ref.referred_type() != BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK)
+      continue;
+    BasicCodeBlock* destination = BasicCodeBlock::Cast(ref.basic_block());
+    BasicBlockReference target;
+    if (destination == NULL || destination == bb ||
+        !GetForwardingTarget(destination, &target)) {
+      continue;
+    }
+
+    it->set_reference(
+        BasicBlockReference(ref.reference_type(), ref.size(), target));
+    changed = true;
+  }
+
+  if (successors.size() == 2 &&
+      IsSameDestination(successors.front().reference(),
+                        successors.back().reference())) {
+    // Both branches go to the same place, which is an unconditional jump.
+    Successor& first = successors.front();
+    Successor jump(Successor::kConditionTrue, first.reference(),
+                   first.instruction_size());
+    jump.set_source_range(first.source_range());
+    if (first.has_label())
+      jump.set_label(first.label());
+    jump.tags() = first.tags();
+    successors.clear();
+    successors.push_back(jump);
+    changed = true;
+  }
+
+  return changed;
+}
+
+// Sorts the basic blocks of a subgraph from the hottest to the coldest.
+// @param subgraph the subgraph whose basic blocks are sorted.
+// @param subgraph_profile the profile of @p subgraph, may be NULL.
+// @param basic_blocks receives the sorted basic blocks.
+void GetBasicBlocksHottestFirst(BasicBlockSubGraph* subgraph,
+                                const SubGraphProfile* subgraph_profile,
+                                std::vector<BasicBlock*>* basic_blocks) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<std::vector<BasicBlock*>*>(NULL), basic_blocks);
+
+  std::vector<std::pair<SubGraphProfile::EntryCountType, BasicBlock*>> order;
+  BBCollection& collection = subgraph->basic_blocks();
+  BBCollection::iterator it = collection.begin();
+  for (; it != collection.end(); ++it) {
+    SubGraphProfile::EntryCountType count = 0;
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (subgraph_profile != NULL && bb != NULL)
+      count = subgraph_profile->GetBasicBlockProfile(bb)->count();
+    order.push_back(std::make_pair(count, *it));
+  }
+
+  // Keep the order of the collection between basic blocks of the same count.
+  std::stable_sort(
+      order.begin(), order.end(),
+      [](const std::pair<SubGraphProfile::EntryCountType, BasicBlock*>& a,
+         const std::pair<SubGraphProfile::EntryCountType, BasicBlock*>& b) {
+        return a.first > b.first;
+      });
+
+  basic_blocks->clear();
+  for (size_t i = 0; i < order.size(); ++i)
+    basic_blocks->push_back(order[i].second);
+}
+
 }  // namespace
 
 // Simplify a given subgraph.
 bool PeepholeTransform::SimplifySubgraph(BasicBlockSubGraph* subgraph) {
+  return SimplifySubgraph(subgraph, NULL);
+}
+
+bool PeepholeTransform::SimplifySubgraph(
+    BasicBlockSubGraph* subgraph,
+    const SubGraphProfile* subgraph_profile) {
   DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
 
+  std::vector<BasicBlock*> basic_blocks;
+  GetBasicBlocksHottestFirst(subgraph, subgraph_profile, &basic_blocks);
+
   bool changed = false;
-  BBCollection& basic_blocks = subgraph->basic_blocks();
-  BBCollection::iterator it = basic_blocks.begin();
-  for (; it != basic_blocks.end(); ++it) {
-    if (SimplifyBasicBlock(*it))
+  for (size_t i = 0; i < basic_blocks.size(); ++i) {
+    if (SimplifyBasicBlock(basic_blocks[i]))
+      changed = true;
+    if (SimplifySuccessors(basic_blocks[i]))
       changed = true;
   }
 
+  // Successors that change may leave an obsolete cached analysis behind.
+  if (changed)
+    subgraph->InvalidateCachedAnalysis();
+
   return changed;
 }
 
@@ -330,7 +592,7 @@ bool PeepholeTransform::TransformBasicBlockSubGraph(
   do {
     changed = false;
 
-    if (SimplifySubgraph(subgraph))
+    if (SimplifySubgraph(subgraph, subgraph_profile))
       changed = true;
     if (RemoveDeadCodeSubgraph(subgraph))
       changed = true;
@@ -57,6 +57,17 @@ class PeepholeTransform : public SubGraphTransformInterface {
   // @returns true if the subgraph has been simplified, false otherwise.
   static bool SimplifySubgraph(BasicBlockSubGraph* subgraph);
 
+  // Apply a sequence of patterns to simplify the contents of a subgraph,
+  // visiting its basic blocks from the hottest to the coldest. The patterns
+  // remove the instructions that cancel out, such as a push and pop of the
+  // same register or back-to-back flag saves, and they thread the successors
+  // through empty basic blocks. The sequence of patterns is applied once.
+  // @param subgraph the subgraph to simplify.
+  // @param subgraph_profile the profile of @p subgraph, may be NULL.
+  // @returns true if the subgraph has been simplified, false otherwise.
+  static bool SimplifySubgraph(BasicBlockSubGraph* subgraph,
+                               const SubGraphProfile* subgraph_profile);
+
   // Remove dead instructions in the contents of a subgraph. The dead code
   // elimination is applied once.
   // @param subgraph the subgraph to simplify.
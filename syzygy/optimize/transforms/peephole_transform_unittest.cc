@@ -153,6 +153,55 @@ TEST_F(PeepholeTransformTest, SimplifyIdentityMov) {
   EXPECT_THAT(kRet, ElementsAreArray(block_->data(), block_->size()));
 }
 
+TEST_F(PeepholeTransformTest, SimplifyPushPop) {
+  // _asm push eax
+  // _asm pop eax
+  // _asm ret
+  const uint8_t kSource[] = {0x50, 0x58, 0xC3};
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformSubgraph, kSource, sizeof(kSource)));
+  EXPECT_THAT(kRet, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, SimplifyPushfdPopfd) {
+  // _asm pushfd
+  // _asm popfd
+  // _asm ret
+  const uint8_t kSource[] = {0x9C, 0x9D, 0xC3};
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformSubgraph, kSource, sizeof(kSource)));
+  EXPECT_THAT(kRet, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, SimplifyLahfSahf) {
+  // _asm lahf
+  // _asm sahf
+  // _asm ret
+  const uint8_t kSource[] = {0x9F, 0x9E, 0xC3};
+
+  // _asm lahf
+  // _asm ret
+  const uint8_t kResult[] = {0x9F, 0xC3};
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformSubgraph, kSource, sizeof(kSource)));
+  EXPECT_THAT(kResult, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, SimplifyBranchToNextInstruction) {
+  // _asm je next
+  // next:
+  // _asm ret
+  const uint8_t kSource[] = {0x74, 0x00, 0xC3};
+
+  // Both successors go to the ret, which then follows without a jump.
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformSubgraph, kSource, sizeof(kSource)));
+  EXPECT_THAT(kRet, ElementsAreArray(block_->data(), block_->size()));
+}
+
 TEST_F(PeepholeTransformTest, RemoveDeadCodeSubgraph) {
   // _asm mov eax, 4
   // _asm cmp eax, edx
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 
+#include "base/logging.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_util.h"
 
@@ -58,6 +59,99 @@ core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
       (address - core::RelativeAddress(it->rva));
 }
 
+void TranslateAddressesViaOmap(
+    const std::vector<OMAP>& omaps,
+    const std::vector<core::RelativeAddress>& addresses,
+    std::vector<core::RelativeAddress>* translated) {
+  DCHECK_NE(static_cast<std::vector<core::RelativeAddress>*>(nullptr),
+            translated);
+
+  // Sweep the addresses in increasing order. Most callers pass them sorted
+  // already, in which case the sort is skipped.
+  std::vector<uint32_t> order(addresses.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = static_cast<uint32_t>(i);
+  if (!std::is_sorted(addresses.begin(), addresses.end())) {
+    std::sort(order.begin(), order.end(),
+              [&addresses](uint32_t i1, uint32_t i2) {
+                return addresses[i1] < addresses[i2];
+              });
+  }
+
+  std::vector<core::RelativeAddress> result(addresses.size());
+  size_t next_omap = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    core::RelativeAddress address = addresses[order[i]];
+
+    // Advance to the first entry beyond the address.
+    while (next_omap < omaps.size() && omaps[next_omap].rva <= address.value())
+      ++next_omap;
+
+    if (next_omap == 0) {
+      result[order[i]] = address;
+    } else {
+      const OMAP& omap = omaps[next_omap - 1];
+      result[order[i]] = core::RelativeAddress(omap.rvaTo) +
+                         (address - core::RelativeAddress(omap.rva));
+    }
+  }
+
+  translated->swap(result);
+}
+
+OmapTranslator::OmapTranslator() : omaps_(nullptr) {
+}
+
+void OmapTranslator::Init(const std::vector<OMAP>* omaps) {
+  DCHECK_NE(static_cast<const std::vector<OMAP>*>(nullptr), omaps);
+  DCHECK(OmapVectorIsValid(*omaps));
+
+  omaps_ = omaps;
+  page_index_.clear();
+  if (omaps->empty())
+    return;
+
+  // The table covers the pages up to that of the last entry. The addresses
+  // beyond it all map through the last entry.
+  size_t num_pages = omaps->back().rva / kPageSize + 1;
+  page_index_.resize(num_pages + 1);
+  size_t next_omap = 0;
+  for (size_t page = 0; page <= num_pages; ++page) {
+    uint64_t page_start = static_cast<uint64_t>(page) * kPageSize;
+    while (next_omap < omaps->size() && (*omaps)[next_omap].rva <= page_start)
+      ++next_omap;
+    page_index_[page] = static_cast<uint32_t>(next_omap);
+  }
+}
+
+core::RelativeAddress OmapTranslator::Translate(
+    core::RelativeAddress address) const {
+  DCHECK_NE(static_cast<const std::vector<OMAP>*>(nullptr), omaps_);
+
+  if (omaps_->empty())
+    return address;
+
+  // Only the entries starting within the page of the address can lie between
+  // the entry before the start of the page and the address.
+  std::vector<OMAP>::const_iterator it = omaps_->end();
+  size_t page = address.value() / kPageSize;
+  if (page < num_pages()) {
+    OMAP omap_address = CreateOmap(address.value(), 0);
+    it = std::upper_bound(omaps_->begin() + page_index_[page],
+                          omaps_->begin() + page_index_[page + 1],
+                          omap_address, OmapLess);
+  }
+
+  // If we are at the first OMAP entry, the address is before any addresses
+  // that are OMAPped. Thus, we return the same address.
+  if (it == omaps_->begin())
+    return address;
+
+  --it;
+  return core::RelativeAddress(it->rvaTo) +
+      (address - core::RelativeAddress(it->rva));
+}
+
 bool ReadOmapsFromPdbFile(const PdbFile& pdb_file,
                           std::vector<OMAP>* omap_to,
                           std::vector<OMAP>* omap_from) {
@@ -19,6 +19,7 @@
 #include <dbghelp.h>
 #include <vector>
 
+#include "base/macros.h"
 #include "syzygy/core/address.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -54,6 +55,60 @@ bool OmapVectorIsValid(const std::vector<OMAP>& omaps);
 core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
                                               core::RelativeAddress address);
 
+// Maps a batch of addresses through the given OMAP information. The addresses
+// are sorted and the OMAP entries swept once, rather than searched for each
+// address.
+//
+// @param omaps the vector of OMAPs to apply.
+// @param addresses the addresses to map, in any order.
+// @param translated receives the mapped addresses, in the order of
+//     @p addresses. May be @p addresses itself.
+// @pre OmapIsValid(omaps) is true.
+void TranslateAddressesViaOmap(
+    const std::vector<OMAP>& omaps,
+    const std::vector<core::RelativeAddress>& addresses,
+    std::vector<core::RelativeAddress>* translated);
+
+// Maps addresses through OMAP information, with a table indexed by page of
+// the entries that cover each page. A lookup goes to the entries of its page
+// directly, and searches only those, which is much faster than searching all
+// of them when translating many addresses one at a time.
+class OmapTranslator {
+ public:
+  // The size of the pages of the table.
+  static const uint32_t kPageSize = 4096;
+
+  OmapTranslator();
+
+  // Builds the table of the given OMAP information.
+  // @param omaps the vector of OMAPs to apply. It must outlive this object,
+  //     and not change while in use.
+  // @pre OmapIsValid(*omaps) is true.
+  void Init(const std::vector<OMAP>* omaps);
+
+  // Maps an address, as TranslateAddressViaOmap does.
+  // @param address the address to map.
+  // @returns the mapped address.
+  core::RelativeAddress Translate(core::RelativeAddress address) const;
+
+  // @returns the number of pages of the table.
+  size_t num_pages() const {
+    return page_index_.empty() ? 0 : page_index_.size() - 1;
+  }
+
+ private:
+  // The OMAP entries being applied.
+  const std::vector<OMAP>* omaps_;
+
+  // For each page of the range covered by the OMAP entries, the index of the
+  // first entry beyond the start of the page. There is one more element than
+  // there are pages, so that the entries of page i are those of index at least
+  // page_index_[i] - 1 and less than page_index_[i + 1].
+  std::vector<uint32_t> page_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(OmapTranslator);
+};
+
 // Reads OMAP tables from a PdbFile. The destination vectors may be NULL if
 // they are not required to be read. Even if neither stream is read they will be
 // checked for existence.
@@ -14,6 +14,8 @@
 
 #include "syzygy/pdb/omap.h"
 
+#include <stdlib.h>
+
 #include "base/path_service.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -82,6 +84,75 @@ TEST(OmapTest, Translate) {
             TranslateAddressViaOmap(omaps, RelativeAddress(3500)));
 }
 
+TEST(OmapTest, TranslateAddresses) {
+  std::vector<OMAP> omaps;
+  omaps.push_back(CreateOmap(1000, 2000));
+  omaps.push_back(CreateOmap(2000, 1000));
+  omaps.push_back(CreateOmap(3000, 3000));
+
+  std::vector<RelativeAddress> addresses;
+  addresses.push_back(RelativeAddress(3500));
+  addresses.push_back(RelativeAddress(500));
+  addresses.push_back(RelativeAddress(2500));
+  addresses.push_back(RelativeAddress(1500));
+  addresses.push_back(RelativeAddress(500));
+
+  std::vector<RelativeAddress> translated;
+  TranslateAddressesViaOmap(omaps, addresses, &translated);
+  ASSERT_EQ(addresses.size(), translated.size());
+  EXPECT_EQ(RelativeAddress(3500), translated[0]);
+  EXPECT_EQ(RelativeAddress(500), translated[1]);
+  EXPECT_EQ(RelativeAddress(1500), translated[2]);
+  EXPECT_EQ(RelativeAddress(2500), translated[3]);
+  EXPECT_EQ(RelativeAddress(500), translated[4]);
+
+  // The addresses may be translated in place.
+  TranslateAddressesViaOmap(omaps, addresses, &addresses);
+  EXPECT_EQ(translated, addresses);
+
+  // Without OMAP information the addresses are unchanged.
+  TranslateAddressesViaOmap(std::vector<OMAP>(), translated, &addresses);
+  EXPECT_EQ(translated, addresses);
+}
+
+TEST(OmapTest, OmapTranslator) {
+  std::vector<OMAP> omaps;
+  OmapTranslator translator;
+  translator.Init(&omaps);
+  EXPECT_EQ(0u, translator.num_pages());
+  EXPECT_EQ(RelativeAddress(1234), translator.Translate(RelativeAddress(1234)));
+
+  // Entries of various densities, with several per page and pages with none.
+  ::srand(42);
+  ULONG rva = 0x800;
+  while (omaps.size() < 10000) {
+    omaps.push_back(CreateOmap(rva, ::rand() * 16));
+    ULONG max_gap = omaps.size() % 2 ? 64 : 3 * OmapTranslator::kPageSize;
+    rva += 1 + ::rand() % max_gap;
+  }
+  translator.Init(&omaps);
+  EXPECT_EQ(omaps.back().rva / OmapTranslator::kPageSize + 1,
+            translator.num_pages());
+
+  // The translations match those of TranslateAddressViaOmap, including
+  // before the first entry, on the entries themselves and beyond the last.
+  std::vector<RelativeAddress> addresses;
+  for (uint32_t address = 0; address < rva + OmapTranslator::kPageSize;
+       address += 1 + ::rand() % 32) {
+    addresses.push_back(RelativeAddress(address));
+  }
+  for (size_t i = 0; i < omaps.size(); ++i)
+    addresses.push_back(RelativeAddress(omaps[i].rva));
+
+  std::vector<RelativeAddress> translated;
+  TranslateAddressesViaOmap(omaps, addresses, &translated);
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    RelativeAddress expected = TranslateAddressViaOmap(omaps, addresses[i]);
+    ASSERT_EQ(expected, translator.Translate(addresses[i]));
+    ASSERT_EQ(expected, translated[i]);
+  }
+}
+
 TEST(OmapTest, ReadOmapsFromPdbFile) {
   std::vector<OMAP> omap_to, omap_from;
 
@@ -29,6 +29,15 @@ TEST(PdbDbiStreamTest, ReadValidDbiStream) {
       testing::GetStreamFromFile(valid_dbi_path);
   DbiStream dbi_stream;
   EXPECT_TRUE(dbi_stream.Read(valid_dbi_stream.get()));
+
+  // The section contributions refer to the modules of the stream.
+  EXPECT_FALSE(dbi_stream.section_contribs().empty());
+  for (const DbiSectionContrib& contrib : dbi_stream.section_contribs()) {
+    EXPECT_LT(0, contrib.section);
+    EXPECT_LE(0, contrib.module);
+    EXPECT_GT(dbi_stream.modules().size(),
+              static_cast<size_t>(contrib.module));
+  }
 }
 
 TEST(PdbDbiStreamTest, ReadInvalidDbiStream) {
@@ -14,6 +14,8 @@
 
 #include "syzygy/pdb/pdb_type_info_stream_enum.h"
 
+#include <algorithm>
+
 #include "base/strings/stringprintf.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_util.h"
@@ -28,10 +30,17 @@ TypeInfoEnumerator::TypeInfoEnumerator(PdbStream* stream)
       type_id_(0),
       type_id_max_(0),
       type_id_min_(0),
-      largest_located_id_(0) {
+      largest_located_id_(0),
+      located_end_(0) {
   memset(&type_info_header_, 0, sizeof(type_info_header_));
 }
 
+TypeInfoEnumerator::TypeInfoEnumerator(PdbStream* stream,
+                                       PdbStream* hash_stream)
+    : TypeInfoEnumerator(stream) {
+  hash_stream_ = hash_stream;
+}
+
 bool TypeInfoEnumerator::EndOfStream() {
   if (type_id_ + 1 == type_id_max_)
     return true;
@@ -69,7 +78,16 @@ bool TypeInfoEnumerator::Init() {
   type_id_min_ = type_info_header_.type_min;
   type_id_max_ = type_info_header_.type_max;
 
+  if (type_id_max_ < type_id_min_) {
+    LOG(ERROR) << "Invalid type info stream type range.";
+    return false;
+  }
+
+  located_records_.assign(type_id_max_ - type_id_min_, TypeRecordInfo());
   largest_located_id_ = type_id_min_ - 1;
+  located_end_ = type_info_header_.len;
+  LoadIndexOffsets();
+
   // Locate the first type info record - note that this may fail if the
   // stream is invalid or empty.
   return EnsureTypeLocated(type_id_min_);
@@ -114,38 +132,84 @@ TypeInfoEnumerator::CreateRecordReader() {
   return BinaryTypeRecordReader(start_position(), len(), stream_.get());
 }
 
+void TypeInfoEnumerator::LoadIndexOffsets() {
+  index_offsets_.clear();
+  if (hash_stream_ == nullptr)
+    return;
+
+  // The type index offsets are pairs of a type ID and of the offset of its
+  // record relative to the end of the header.
+  const OffsetCb& offsets = type_info_header_.type_info_hash
+                                .offset_cb_type_info_offset;
+  size_t count = offsets.cb / (2 * sizeof(uint32_t));
+  std::vector<uint32_t> data(2 * count);
+  size_t size = data.size() * sizeof(data[0]);
+  if (count == 0 || offsets.offset > hash_stream_->length() ||
+      size > hash_stream_->length() - offsets.offset ||
+      !hash_stream_->ReadBytesAt(offsets.offset, size, data.data())) {
+    VLOG(1) << "No type index offsets in the type info hash stream.";
+    return;
+  }
+
+  index_offsets_.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t type_id = data[2 * i];
+    size_t position = type_info_header_.len + data[2 * i + 1];
+    bool valid = type_id >= type_id_min_ && type_id < type_id_max_ &&
+                 position < data_end_;
+    if (valid && !index_offsets_.empty()) {
+      valid = type_id > index_offsets_.back().first &&
+              position > index_offsets_.back().second;
+    }
+    if (!valid) {
+      LOG(WARNING) << "Ignoring invalid type index offsets.";
+      index_offsets_.clear();
+      return;
+    }
+    index_offsets_.push_back(IndexOffset(type_id, position));
+  }
+}
+
 bool TypeInfoEnumerator::EnsureTypeLocated(uint32_t type_id) {
   DCHECK(stream_ != nullptr);
 
   if (type_id >= type_id_max_ || type_id < type_id_min_)
     return false;
-  if (type_id <= largest_located_id_)
+  if (located_records_[type_id - type_id_min_].length != 0)
     return true;
 
-#ifndef NDEBUG
-  if (type_id > type_id_min_) {
-    TypeRecordInfo info = {};
-    bool found = FindRecordInfo(largest_located_id_, &info);
-    DCHECK(found);
-    DCHECK_EQ(info.start + info.length + sizeof(info.length),
-              reader_.Position());
+  // Start reading at the end of the located prefix of the stream, or at the
+  // closest preceding type index offset if it is further along.
+  uint32_t current_type_id = largest_located_id_;
+  size_t position = located_end_;
+  auto it = std::upper_bound(
+      index_offsets_.begin(), index_offsets_.end(), type_id,
+      [](uint32_t id, const IndexOffset& offset) { return id < offset.first; });
+  if (it != index_offsets_.begin()) {
+    --it;
+    if (it->first > current_type_id + 1) {
+      current_type_id = it->first - 1;
+      position = it->second;
+    }
   }
-#endif
 
-  uint32_t current_type_id = largest_located_id_;
-  common::BinaryStreamParser parser(&reader_);
+  DCHECK_LE(position, data_end_);
+  PdbStreamReaderWithPosition reader(position, data_end_ - position,
+                                     stream_.get());
+  common::BinaryStreamParser parser(&reader);
   while (current_type_id < type_id) {
     TypeRecordInfo next_info = {};
-    next_info.start = reader_.Position();
+    next_info.start = position + reader.Position();
     if (!parser.Read(&next_info.length)) {
       LOG(ERROR) << "Unable to read a type info record length.";
       return false;
     }
-    if (!parser.Read(&next_info.type)) {
+    if (!parser.Read(&next_info.type) ||
+        next_info.length < sizeof(next_info.type)) {
       LOG(ERROR) << "Unable to read a type info record type.";
       return false;
     }
-    if (!reader_.Consume(next_info.length - sizeof(next_info.type))) {
+    if (!reader.Consume(next_info.length - sizeof(next_info.type))) {
       LOG(ERROR) << "Unable to consume type body.";
       return false;
     }
@@ -163,11 +227,19 @@ bool TypeInfoEnumerator::AddRecordInfo(uint32_t type_id,
   if (type_id >= type_id_max_ || type_id < type_id_min_)
     return false;
 
-  DCHECK_EQ(largest_located_id_ + 1, type_id);
-  DCHECK_EQ(located_records_.size(), largest_located_id_ - type_id_min_ + 1);
-
-  located_records_.push_back(info);
-  largest_located_id_ = type_id;
+  DCHECK_EQ(located_records_.size(), type_id_max_ - type_id_min_);
+  DCHECK_NE(0u, info.length);
+  located_records_[type_id - type_id_min_] = info;
+
+  // Extend the located prefix over the records located so far.
+  while (largest_located_id_ + 1 < type_id_max_) {
+    const TypeRecordInfo& next =
+        located_records_[largest_located_id_ + 1 - type_id_min_];
+    if (next.length == 0)
+      break;
+    ++largest_located_id_;
+    located_end_ = next.start + sizeof(next.length) + next.length;
+  }
 
   return true;
 }
@@ -180,7 +252,7 @@ bool TypeInfoEnumerator::FindRecordInfo(uint32_t type_id,
 
   DCHECK_GT(located_records_.size(), type_id - type_id_min_);
   *info = located_records_[type_id - type_id_min_];
-  return true;
+  return info->length != 0;
 }
 
 TypeInfoEnumerator::BinaryTypeRecordReader::BinaryTypeRecordReader(
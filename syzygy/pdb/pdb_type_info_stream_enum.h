@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <memory>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "base/callback.h"
 #include "base/memory/ref_counted.h"
@@ -40,6 +42,14 @@ class TypeInfoEnumerator {
   // @param stream the stream to parse.
   explicit TypeInfoEnumerator(PdbStream* stream);
 
+  // Creates an uninitialized enumerator for type info stream, which uses the
+  // type index offsets of the hash stream of the type info stream to seek to
+  // records without reading all the records that precede them.
+  // @param stream the stream to parse.
+  // @param hash_stream the hash stream of @p stream, as given by the
+  //     type_info_hash.stream_number field of its header.
+  TypeInfoEnumerator(PdbStream* stream, PdbStream* hash_stream);
+
   // Initializes the enumerator with given stream. Needs to be called before
   // any further work.
   // @returns true on success, false means bad header format.
@@ -50,7 +60,9 @@ class TypeInfoEnumerator {
   // @returns true on success, false on failure.
   bool NextTypeInfoRecord();
 
-  // Moves position to the desired type id.
+  // Moves position to the desired type id. This reads the records between the
+  // closest already located record or the closest entry of the type index
+  // offsets, found in O(log n), and the desired one.
   // @param type index of the desired record.
   // @returns true on success, false on failure.
   bool SeekRecord(uint32_t type_id);
@@ -107,29 +119,48 @@ class TypeInfoEnumerator {
     uint16_t length;
   };
 
+  // A known start position of a type record, from the hash stream.
+  typedef std::pair<uint32_t, size_t> IndexOffset;
+
+  // Reads the type index offsets of the hash stream into @p index_offsets_.
+  // Invalid offsets are ignored, as they only serve to speed up seeks.
+  void LoadIndexOffsets();
+
   // Ensure that the type with ID @p type_id has been located and stored
   // in @p located_records_.
   bool EnsureTypeLocated(uint32_t type_id);
-  // Adds the start position @p position for @p type_id, which must be a valid
-  // type id, and must be one larger than the last added start position.
+  // Adds the record info @p record for @p type_id, which must be a valid type
+  // id, and extends the located prefix of the stream when possible.
   bool AddRecordInfo(uint32_t type_id, const TypeRecordInfo& record);
   bool FindRecordInfo(uint32_t type_id, TypeRecordInfo* record);
 
   // Pointer to the PDB type info stream.
   scoped_refptr<PdbStream> stream_;
 
+  // Pointer to the hash stream of the type info stream, if any.
+  scoped_refptr<PdbStream> hash_stream_;
+
+  // The type index offsets of the hash stream, sorted by type ID. These are
+  // sparse, typically one every 8 KB of type records.
+  std::vector<IndexOffset> index_offsets_;
+
   // The reader used to parse out the locations of type records.
   PdbStreamReaderWithPosition reader_;
 
   // Header of the type info stream.
   TypeInfoHeader type_info_header_;
 
-  // A vector with the positions of located records.
+  // A vector with the positions of the records, indexed by type ID. Records
+  // that have not been located yet have a zero length.
   std::vector<TypeRecordInfo> located_records_;
 
-  // The largest type index we already saved in @p located_records_.
+  // The largest type index such that it and all the preceding ones are saved
+  // in @p located_records_.
   uint32_t largest_located_id_;
 
+  // The stream position of the end of the record @p largest_located_id_.
+  size_t located_end_;
+
   // Position of the end of data in the stream.
   size_t data_end_;
 
@@ -17,6 +17,9 @@
 #include "base/files/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/unittest_util.h"
 
 namespace pdb {
@@ -163,6 +166,45 @@ TEST(PdbTypeInfoStreamEnumTest, ReadValidTypeInfoStreamWithReader) {
   EXPECT_EQ(kTestRecord + kOffset, enumerator.type_id());
 }
 
+TEST(PdbTypeInfoStreamEnumTest, SeekRecordWithIndexOffsets) {
+  PdbReader reader;
+  PdbFile pdb_file;
+  ASSERT_TRUE(reader.Read(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath), &pdb_file));
+  scoped_refptr<PdbStream> stream = pdb_file.GetStream(kTpiStream);
+  ASSERT_TRUE(stream.get() != nullptr);
+
+  // Enumerate the records sequentially to get their positions.
+  TypeInfoEnumerator sequential_enumerator(stream.get());
+  ASSERT_TRUE(sequential_enumerator.Init());
+  std::vector<size_t> positions;
+  while (!sequential_enumerator.EndOfStream()) {
+    ASSERT_TRUE(sequential_enumerator.NextTypeInfoRecord());
+    positions.push_back(sequential_enumerator.start_position());
+  }
+
+  const TypeInfoHeader& header = sequential_enumerator.type_info_header();
+  scoped_refptr<PdbStream> hash_stream =
+      pdb_file.GetStream(header.type_info_hash.stream_number);
+  ASSERT_TRUE(hash_stream.get() != nullptr);
+
+  // Seek to the records backwards, which jumps from index offset to index
+  // offset, and compare.
+  TypeInfoEnumerator enumerator(stream.get(), hash_stream.get());
+  ASSERT_TRUE(enumerator.Init());
+  for (size_t i = positions.size(); i > 0; --i) {
+    uint32_t type_id = header.type_min + static_cast<uint32_t>(i) - 1;
+    ASSERT_TRUE(enumerator.SeekRecord(type_id));
+    EXPECT_EQ(type_id, enumerator.type_id());
+    EXPECT_EQ(positions[i - 1], enumerator.start_position());
+  }
+
+  // The records can then be enumerated sequentially.
+  ASSERT_TRUE(enumerator.ResetStream());
+  EXPECT_EQ(header.type_min, enumerator.type_id());
+  EXPECT_EQ(positions[0], enumerator.start_position());
+}
+
 TEST(PdbTypeInfoStreamEnumTest, EnumInvalidDataTypeInfoStream) {
   base::FilePath invalid_type_info_path =
       testing::GetSrcRelativePath(testing::kInvalidDataPdbTypeInfoStreamPath);
@@ -400,9 +400,10 @@ bool ReadPdbHeader(const base::FilePath& pdb_path,
   DCHECK(!pdb_path.empty());
   DCHECK(pdb_header != NULL);
 
+  // Only the header stream is needed, so don't pay for reading the others.
   PdbReader pdb_reader;
   PdbFile pdb_file;
-  if (!pdb_reader.Read(pdb_path, &pdb_file)) {
+  if (!pdb_reader.ReadMapped(pdb_path, &pdb_file)) {
     LOG(ERROR) << "Unable to process PDB file: " << pdb_path.value();
     return false;
   }
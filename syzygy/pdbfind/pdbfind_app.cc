@@ -16,6 +16,7 @@
 
 #include "base/files/file_util.h"
 #include "syzygy/pe/find.h"
+#include "syzygy/pe/pdb_index.h"
 #include "syzygy/pe/pdb_info.h"
 #include "syzygy/pe/pe_file.h"
 
@@ -30,7 +31,7 @@ const int kUnableToFindPdb = 2;
 const int kMissingOrMalformedCodeViewRecord = 3;
 
 const char kUsageFormatStr[] =
-    "Usage: %ls <input-image-path>\n"
+    "Usage: %ls [options] <input-image-path>\n"
     "\n"
     "  Searches for the PDB file matching the provided image. If successfully\n"
     "  found prints the absolute path to stdout and exit with a return code\n"
@@ -45,6 +46,15 @@ const char kUsageFormatStr[] =
     "\n"
     "  If the image does not contain a CodeView record or it is malformed\n"
     "  exits with a return code of 3.\n"
+    "\n"
+    "  Options:\n"
+    "    --index=PATH        Looks the PDB file up by GUID and age in the\n"
+    "                        index stored at PATH before searching for it.\n"
+    "    --symbol-dir=DIR    Updates the index with the PDB files of the\n"
+    "                        symbol directory DIR and saves it. Only the\n"
+    "                        files added or modified since the last update\n"
+    "                        are read. Requires --index. The input image\n"
+    "                        may then be omitted, to only update the index.\n"
     "\n";
 
 }  // namespace
@@ -55,19 +65,38 @@ bool PdbFindApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   if (cmd_line->HasSwitch("help"))
     return Usage(cmd_line, "");
 
+  index_path_ = cmd_line->GetSwitchValuePath("index");
+  symbol_dir_ = cmd_line->GetSwitchValuePath("symbol-dir");
+  if (!symbol_dir_.empty() && index_path_.empty())
+    return Usage(cmd_line, "--symbol-dir requires --index.");
+
   base::CommandLine::StringVector args = cmd_line->GetArgs();
-  if (args.size() == 0)
+  if (args.size() == 0 && symbol_dir_.empty())
     return Usage(cmd_line, "Must specify input-image-path.");
 
   if (args.size() > 1)
     return Usage(cmd_line, "Can specify only one input-image-path.");
 
-  input_image_path_ = base::FilePath(args[0]);
+  if (args.size() == 1)
+    input_image_path_ = base::FilePath(args[0]);
 
   return true;
 }
 
 int PdbFindApp::Run() {
+  // A missing or stale index is simply rebuilt.
+  pe::PdbIndex index;
+  if (!index_path_.empty())
+    index.Load(index_path_);
+  if (!symbol_dir_.empty()) {
+    if (!index.Update(symbol_dir_) || !index.Save(index_path_)) {
+      LOG(ERROR) << "Failed to update PDB index: " << index_path_.value();
+      return kError;
+    }
+    if (input_image_path_.empty())
+      return kSuccess;
+  }
+
   if (!base::PathExists(input_image_path_)) {
     LOG(ERROR) << "File not found: " << input_image_path_.value();
     return kError;
@@ -84,8 +113,12 @@ int PdbFindApp::Run() {
   if (!pdb_info.Init(pe_file))
     return kMissingOrMalformedCodeViewRecord;
 
-  // Look for the matching PDB.
+  // Look for the matching PDB, in the index first.
   base::FilePath pdb_path;
+  if (index.Find(pdb_info, &pdb_path)) {
+    fprintf(out(), "%ls\n", pdb_path.value().c_str());
+    return kSuccess;
+  }
   if (!pe::FindPdbForModule(input_image_path_, &pdb_path)) {
     LOG(ERROR) << "Error searching for PDB file.";
     return kError;
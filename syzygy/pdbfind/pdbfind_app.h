@@ -15,7 +15,8 @@
 // Defines the PdbFindApp class, which implements a command-line tool for
 // finding the PDB file associated with a given PE file. This uses the same
 // search mechanism as that employed by the decomposer but outputs meaningful
-// return code and easily parsable output.
+// return code and easily parsable output. The PDB files of a local symbol
+// store may also be looked up through a persistent pe::PdbIndex.
 
 #ifndef SYZYGY_PDBFIND_PDBFIND_APP_H_
 #define SYZYGY_PDBFIND_PDBFIND_APP_H_
@@ -52,6 +53,8 @@ class PdbFindApp : public application::AppImplBase {
   // @name Command-line parameters.
   // @{
   base::FilePath input_image_path_;
+  base::FilePath index_path_;
+  base::FilePath symbol_dir_;
   // @}
 };
 
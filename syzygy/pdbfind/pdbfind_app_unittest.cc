@@ -29,7 +29,9 @@ namespace {
 
 class TestPdbFindApp : public PdbFindApp {
  public:
+  using PdbFindApp::index_path_;
   using PdbFindApp::input_image_path_;
+  using PdbFindApp::symbol_dir_;
 };
 
 typedef application::Application<TestPdbFindApp> TestApp;
@@ -108,6 +110,21 @@ TEST_F(PdbFindAppTest, ParseWithOneArgumentPasses) {
   EXPECT_EQ(app_impl_.input_image_path_, base::FilePath(L"foo.dll"));
 }
 
+TEST_F(PdbFindAppTest, ParseSymbolDirWithoutIndexFails) {
+  cmd_line_.AppendSwitchPath("symbol-dir", base::FilePath(L"symbols"));
+  cmd_line_.AppendArg("foo.dll");
+  ASSERT_FALSE(app_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(PdbFindAppTest, ParseIndexUpdateWithoutArgumentPasses) {
+  cmd_line_.AppendSwitchPath("index", base::FilePath(L"pdb.index"));
+  cmd_line_.AppendSwitchPath("symbol-dir", base::FilePath(L"symbols"));
+  ASSERT_TRUE(app_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(base::FilePath(L"pdb.index"), app_impl_.index_path_);
+  EXPECT_EQ(base::FilePath(L"symbols"), app_impl_.symbol_dir_);
+  EXPECT_TRUE(app_impl_.input_image_path_.empty());
+}
+
 TEST_F(PdbFindAppTest, ModuleNotFound) {
   base::FilePath module = testing::GetExeRelativePath(L"made_up_module.dll");
   cmd_line_.AppendArgPath(module);
@@ -150,4 +167,30 @@ TEST_F(PdbFindAppTest, Succeeds) {
 #endif
 }
 
+TEST_F(PdbFindAppTest, SucceedsWithIndex) {
+  base::FilePath symbol_dir = temp_dir_.Append(L"symbols");
+  ASSERT_TRUE(base::CreateDirectory(symbol_dir));
+  base::FilePath indexed_pdb_path =
+      symbol_dir.Append(testing::kTestDllPdbName);
+  ASSERT_TRUE(base::CopyFile(
+      testing::GetExeRelativePath(testing::kTestDllPdbName),
+      indexed_pdb_path));
+  base::FilePath index_path = temp_dir_.Append(L"pdb.index");
+
+  cmd_line_.AppendSwitchPath("index", index_path);
+  cmd_line_.AppendSwitchPath("symbol-dir", symbol_dir);
+  cmd_line_.AppendArgPath(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_EQ(0, app_.Run());
+  EXPECT_TRUE(base::PathExists(index_path));
+
+  // The indexed copy is found rather than the PDB next to the module.
+  TearDownStreams();
+  std::string actual_stdout;
+  ASSERT_TRUE(base::ReadFileToString(stdout_path_, &actual_stdout));
+  base::TrimWhitespaceASCII(actual_stdout, base::TRIM_TRAILING,
+                            &actual_stdout);
+  EXPECT_EQ(indexed_pdb_path,
+            base::FilePath(base::ASCIIToUTF16(actual_stdout)));
+}
+
 }  // namespace pdbfind
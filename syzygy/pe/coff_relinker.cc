@@ -169,13 +169,22 @@ bool CoffRelinker::Relink() {
 
   // Lay it out.
   ImageLayout output_image_layout(&block_graph_);
-  if (!BuildImageLayout(ordered_graph, headers_block_,
-                        &output_image_layout)) {
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "build_layout");
+    if (!BuildImageLayout(ordered_graph, headers_block_,
+                          &output_image_layout)) {
+      return false;
+    }
   }
 
   // Write the image.
-  if (!WriteImage(output_image_layout, output_path_))
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "write_image");
+    if (!WriteImage(output_image_layout, output_path_))
+      return false;
+  }
+
+  if (!WriteProfile())
     return false;
 
   return true;
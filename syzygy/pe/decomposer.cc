@@ -14,11 +14,16 @@
 
 #include "syzygy/pe/decomposer.h"
 
+#include <algorithm>
+#include <memory>
+
 #include "pcrecpp.h"  // NOLINT
 #include "base/bind.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
 #include "syzygy/core/zstream.h"
@@ -30,6 +35,7 @@
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_symbol_record.h"
 #include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/cvinfo_ext.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/pe/pe_file_parser.h"
@@ -185,6 +191,22 @@ KnownCompilerInfo kKnownCompilerInfos[] = {
   { L"Microsoft (R) LINK", false }
 };
 
+// Determines whether the named compiler is one of those that we whitelist.
+bool IsSupportedCompiler(const wchar_t* compiler_name) {
+  DCHECK_NE(static_cast<const wchar_t*>(nullptr), compiler_name);
+
+  // Check the compiler name against the list of known compilers.
+  for (size_t i = 0; i < arraysize(kKnownCompilerInfos); ++i) {
+    if (::wcscmp(kKnownCompilerInfos[i].compiler_name, compiler_name) == 0) {
+      return kKnownCompilerInfos[i].supported;
+    }
+  }
+
+  // Anything we don't explicitly know about is not supported.
+  VLOG(1) << "Encountered unknown compiler: " << compiler_name;
+  return false;
+}
+
 // Given a compiland, determines whether the compiler used is one of those that
 // we whitelist.
 bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
@@ -210,16 +232,7 @@ bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
   HRESULT hr = compiland_details->get_compilerName(compiler_name.Receive());
   DCHECK_EQ(S_OK, hr);
 
-  // Check the compiler name against the list of known compilers.
-  for (size_t i = 0; i < arraysize(kKnownCompilerInfos); ++i) {
-    if (::wcscmp(kKnownCompilerInfos[i].compiler_name, compiler_name) == 0) {
-      return kKnownCompilerInfos[i].supported;
-    }
-  }
-
-  // Anything we don't explicitly know about is not supported.
-  VLOG(1) << "Encountered unknown compiler: " << compiler_name;
-  return false;
+  return IsSupportedCompiler(compiler_name);
 }
 
 // Adds an intermediate reference to the provided vector. The vector is
@@ -236,15 +249,29 @@ bool AddIntermediateReference(IntermediateReferences* references,
   return true;
 }
 
-// Create a reference as specified. Ignores existing references if they are of
-// the exact same type.
-bool CreateReference(RelativeAddress src_addr,
-                     BlockGraph::Size ref_size,
-                     ReferenceType ref_type,
-                     RelativeAddress base_addr,
-                     RelativeAddress dst_addr,
-                     BlockGraph::AddressSpace* image) {
+// A reference resolved to the blocks it links, to be inserted in its source
+// block.
+struct ResolvedReference {
+  Block* src_block;
+  Offset src_offset;
+  Reference ref;
+};
+typedef std::vector<ResolvedReference> ResolvedReferences;
+
+// The minimum number of references sorted by each thread.
+const size_t kMinReferencesPerSortThread = 64 * 1024;
+
+// Resolves a reference as specified to the blocks it links, and appends it to
+// @p references.
+bool ResolveReference(RelativeAddress src_addr,
+                      BlockGraph::Size ref_size,
+                      ReferenceType ref_type,
+                      RelativeAddress base_addr,
+                      RelativeAddress dst_addr,
+                      BlockGraph::AddressSpace* image,
+                      ResolvedReferences* references) {
   DCHECK_NE(reinterpret_cast<BlockGraph::AddressSpace*>(NULL), image);
+  DCHECK_NE(reinterpret_cast<ResolvedReferences*>(NULL), references);
 
   // Get the source block and offset, and ensure that the reference fits
   // within it.
@@ -275,21 +302,130 @@ bool CreateReference(RelativeAddress src_addr,
   Offset base = base_addr - dst_block_addr;
   Offset offset = dst_addr - dst_block_addr;
 
-  Reference ref(ref_type, ref_size, dst_block, offset, base);
+  ResolvedReference resolved = {
+      src_block, src_block_offset,
+      Reference(ref_type, ref_size, dst_block, offset, base)};
+  references->push_back(resolved);
 
-  // Check if a reference already exists at this offset.
-  Block::ReferenceMap::const_iterator ref_it =
-      src_block->references().find(src_block_offset);
-  if (ref_it != src_block->references().end()) {
-    // If an identical reference already exists then we're done.
-    if (ref == ref_it->second)
-      return true;
-    LOG(ERROR) << "Block \"" << src_block->name() << "\" has a conflicting "
-               << "reference at offset " << src_block_offset << ".";
-    return false;
+  return true;
+}
+
+// Orders resolved references by source block, then by offset.
+bool ResolvedReferenceLess(const ResolvedReference& ref1,
+                           const ResolvedReference& ref2) {
+  if (ref1.src_block->id() != ref2.src_block->id())
+    return ref1.src_block->id() < ref2.src_block->id();
+  return ref1.src_offset < ref2.src_offset;
+}
+
+// Sorts a range of resolved references, on a worker thread.
+class ReferenceSorter : public base::DelegateSimpleThread::Delegate {
+ public:
+  ReferenceSorter(ResolvedReferences::iterator begin,
+                  ResolvedReferences::iterator end)
+      : begin_(begin), end_(end) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override { std::sort(begin_, end_, ResolvedReferenceLess); }
+  // @}
+
+ private:
+  ResolvedReferences::iterator begin_;
+  ResolvedReferences::iterator end_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReferenceSorter);
+};
+
+// Sorts resolved references by source block and offset. Large vectors are
+// sorted in chunks on as many threads as there are processors, and the
+// chunks then merged.
+void SortResolvedReferences(ResolvedReferences* references) {
+  DCHECK_NE(reinterpret_cast<ResolvedReferences*>(NULL), references);
+
+  size_t num_threads = std::min(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      references->size() / kMinReferencesPerSortThread);
+  if (num_threads <= 1) {
+    std::sort(references->begin(), references->end(), ResolvedReferenceLess);
+    return;
+  }
+
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i <= num_threads; ++i)
+    bounds.push_back(references->size() * i / num_threads);
+
+  std::vector<std::unique_ptr<ReferenceSorter>> sorters;
+  base::DelegateSimpleThreadPool pool("DecomposerReferences",
+                                      static_cast<int>(num_threads));
+  for (size_t i = 0; i < num_threads; ++i) {
+    sorters.push_back(std::unique_ptr<ReferenceSorter>(new ReferenceSorter(
+        references->begin() + bounds[i], references->begin() + bounds[i + 1])));
+    pool.AddWork(sorters.back().get());
+  }
+  pool.Start();
+  pool.JoinAll();
+
+  // Merge the sorted chunks pairwise, doubling their size each round.
+  for (size_t width = 1; width < num_threads; width *= 2) {
+    for (size_t i = 0; i + width < num_threads; i += 2 * width) {
+      size_t end = std::min(i + 2 * width, num_threads);
+      std::inplace_merge(references->begin() + bounds[i],
+                         references->begin() + bounds[i + width],
+                         references->begin() + bounds[end],
+                         ResolvedReferenceLess);
+    }
   }
+}
+
+// Inserts resolved references into their source blocks, building the
+// references of each block in one go. Ignores references identical to
+// existing ones, but fails on conflicting ones.
+bool InsertResolvedReferences(ResolvedReferences* references) {
+  DCHECK_NE(reinterpret_cast<ResolvedReferences*>(NULL), references);
+
+  SortResolvedReferences(references);
+
+  std::vector<std::pair<Offset, Reference>> block_refs;
+  size_t i = 0;
+  while (i < references->size()) {
+    Block* block = (*references)[i].src_block;
+    Block::ReferenceMap::const_iterator existing = block->references().begin();
+    block_refs.clear();
+
+    for (; i < references->size() && (*references)[i].src_block == block;
+         ++i) {
+      const ResolvedReference& resolved = (*references)[i];
+
+      // Check if a reference already exists at this offset, in the block or
+      // among those about to be inserted.
+      while (existing != block->references().end() &&
+             existing->first < resolved.src_offset) {
+        ++existing;
+      }
+      const Reference* previous = NULL;
+      if (existing != block->references().end() &&
+          existing->first == resolved.src_offset) {
+        previous = &existing->second;
+      } else if (!block_refs.empty() &&
+                 block_refs.back().first == resolved.src_offset) {
+        previous = &block_refs.back().second;
+      }
+      if (previous != NULL) {
+        // If an identical reference already exists then we're done.
+        if (resolved.ref == *previous)
+          continue;
+        LOG(ERROR) << "Block \"" << block->name() << "\" has a conflicting "
+                   << "reference at offset " << resolved.src_offset << ".";
+        return false;
+      }
 
-  CHECK(src_block->SetReference(src_block_offset, ref));
+      block_refs.push_back(std::make_pair(resolved.src_offset, resolved.ref));
+    }
+
+    block->InsertReferences(block_refs);
+  }
 
   return true;
 }
@@ -325,6 +461,75 @@ bool LoadDebugStreams(IDiaSession* dia_session,
   return true;
 }
 
+// Loads the stream of @p pdb_file at @p index as an array of T.
+// @param pdb_file The PDB file holding the stream.
+// @param index The index of the stream, as found in the DBI DBG header. A
+//     negative index denotes a missing stream.
+// @param list Receives the contents of the stream.
+// @returns the result of the search.
+template <typename T>
+SearchResult LoadPdbDbgStream(const pdb::PdbFile& pdb_file,
+                              int16_t index,
+                              std::vector<T>* list) {
+  DCHECK_NE(static_cast<std::vector<T>*>(nullptr), list);
+
+  if (index < 0 || static_cast<size_t>(index) >= pdb_file.StreamCount())
+    return kSearchFailed;
+  scoped_refptr<pdb::PdbStream> stream = pdb_file.GetStream(index);
+  if (stream.get() == NULL)
+    return kSearchFailed;
+
+  if (stream->length() % sizeof(T) != 0)
+    return kSearchErrored;
+  list->resize(stream->length() / sizeof(T));
+  if (!list->empty() &&
+      !stream->ReadBytesAt(0, stream->length(), list->data())) {
+    return kSearchErrored;
+  }
+
+  return kSearchSucceeded;
+}
+
+// Loads the FIXUP and OMAP_FROM streams straight from the PDB file. Unlike a
+// DIA session, this may be done on any thread. This is quiet on failure, the
+// caller falls back to LoadDebugStreams, which reports the errors.
+bool LoadDebugStreamsFromPdb(const base::FilePath& pdb_path,
+                             PdbFixups* pdb_fixups,
+                             OMAPs* omap_from) {
+  DCHECK_NE(reinterpret_cast<PdbFixups*>(NULL), pdb_fixups);
+  DCHECK_NE(reinterpret_cast<OMAPs*>(NULL), omap_from);
+
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path, &pdb_file) ||
+      pdb_file.StreamCount() <= pdb::kDbiStream) {
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> dbi_stream =
+      pdb_file.GetStream(pdb::kDbiStream);
+  pdb::DbiHeader dbi_header = {};
+  pdb::DbiDbgHeader dbg_header = {};
+  if (dbi_stream.get() == NULL ||
+      !dbi_stream->ReadBytesAt(0, sizeof(dbi_header), &dbi_header) ||
+      !dbi_stream->ReadBytesAt(pdb::GetDbiDbgHeaderOffset(dbi_header),
+                               sizeof(dbg_header), &dbg_header)) {
+    return false;
+  }
+
+  // As with DIA, the fixups must exist but the OMAP_FROM table need not.
+  if (LoadPdbDbgStream(pdb_file, dbg_header.fixup, pdb_fixups) !=
+          kSearchSucceeded ||
+      LoadPdbDbgStream(pdb_file, dbg_header.omap_from_src, omap_from) ==
+          kSearchErrored) {
+    pdb_fixups->clear();
+    omap_from->clear();
+    return false;
+  }
+
+  return true;
+}
+
 bool GetFixupDestinationAndType(const PEFile& image_file,
                                 const pdb::PdbFixup& fixup,
                                 RelativeAddress* dst_addr,
@@ -395,6 +600,11 @@ bool CreateReferencesFromFixupsImpl(
   bool have_omap = !omap_from.empty();
   size_t fixups_used = 0;
 
+  // The references are resolved as the fixups are validated, and are then
+  // inserted a block at a time.
+  ResolvedReferences references;
+  references.reserve(pdb_fixups.size());
+
   // The resource section in Chrome is modified post-link by a tool that adds a
   // manifest to it. This causes all of the fixups in the resource section (and
   // anything beyond it) to be invalid. As long as the resource section is the
@@ -411,6 +621,20 @@ bool CreateReferencesFromFixupsImpl(
     rsrc_end = rsrc_start + rsrc_header->Misc.VirtualSize;
   }
 
+  // Map the original addresses of the fixups through the OMAP information
+  // all at once. Normally DIA takes care of this for us, but there is no API
+  // for getting DIA to give us FIXUP information, so we have to do it
+  // manually.
+  std::vector<RelativeAddress> omapped_addrs;
+  if (have_omap) {
+    omapped_addrs.reserve(2 * pdb_fixups.size());
+    for (size_t i = 0; i < pdb_fixups.size(); ++i) {
+      omapped_addrs.push_back(RelativeAddress(pdb_fixups[i].rva_location));
+      omapped_addrs.push_back(RelativeAddress(pdb_fixups[i].rva_base));
+    }
+    pdb::TranslateAddressesViaOmap(omap_from, omapped_addrs, &omapped_addrs);
+  }
+
   // Ensure the fixups are all valid.
   for (size_t i = 0; i < pdb_fixups.size(); ++i) {
     if (!pdb_fixups[i].ValidHeader()) {
@@ -427,14 +651,12 @@ bool CreateReferencesFromFixupsImpl(
     // All fixups we handle should be full size pointers.
     DCHECK_EQ(Reference::kMaximumSize, pdb_fixups[i].size());
 
-    // Get the original addresses, and map them through OMAP information.
-    // Normally DIA takes care of this for us, but there is no API for
-    // getting DIA to give us FIXUP information, so we have to do it manually.
+    // Get the original addresses, mapped through OMAP information.
     RelativeAddress src_addr(pdb_fixups[i].rva_location);
     RelativeAddress base_addr(pdb_fixups[i].rva_base);
     if (have_omap) {
-      src_addr = pdb::TranslateAddressViaOmap(omap_from, src_addr);
-      base_addr = pdb::TranslateAddressViaOmap(omap_from, base_addr);
+      src_addr = omapped_addrs[2 * i];
+      base_addr = omapped_addrs[2 * i + 1];
     }
 
     // If the reference originates beyond the .rsrc section then we can't
@@ -456,9 +678,9 @@ bool CreateReferencesFromFixupsImpl(
       return false;
     }
 
-    // Finally, create the reference. This logs verbosely for us on failure.
-    if (!CreateReference(src_addr, Reference::kMaximumSize, type, base_addr,
-                         dst_addr, image)) {
+    // Finally, resolve the reference. This logs verbosely for us on failure.
+    if (!ResolveReference(src_addr, Reference::kMaximumSize, type, base_addr,
+                          dst_addr, image, &references)) {
       return false;
     }
 
@@ -477,7 +699,8 @@ bool CreateReferencesFromFixupsImpl(
     ++fixups_used;
   }
 
-  return true;
+  // This logs verbosely for us on failure.
+  return InsertResolvedReferences(&references);
 }
 
 bool GetDataSymbolSize(IDiaSymbol* symbol, size_t* length) {
@@ -619,6 +842,234 @@ const SymbolType* ParseSymbol(uint16_t symbol_length,
   return reinterpret_cast<const SymbolType*>(buffer->data());
 }
 
+// The properties of a section contribution used to create its block, as
+// read from the DBI stream of the PDB file or obtained through DIA.
+struct SectionContribInfo {
+  // The index of the section of the contribution, starting at 0.
+  size_t section_id;
+  DWORD rva;
+  DWORD length;
+  bool code;
+  bool is_built_by_supported_compiler;
+  std::string compiland_name;
+};
+typedef std::vector<SectionContribInfo> SectionContribInfos;
+
+// The compiland details found in the symbol stream of a module.
+struct ModuleCompilerInfo {
+  ModuleCompilerInfo() : has_details(false), has_legacy_details(false) {}
+
+  // True if an S_COMPILE3 record was found.
+  bool has_details;
+  // True if an older compiland details record was found. Those are only
+  // interpreted by DIA.
+  bool has_legacy_details;
+  // The compiler name of the S_COMPILE3 record.
+  std::string compiler_name;
+};
+
+// Looks for the compiland details record of a module symbol stream. This
+// terminates the visit, by returning false, once a record has been found.
+bool VisitCompilandDetailsSymbol(ModuleCompilerInfo* info,
+                                 uint16_t symbol_length,
+                                 uint16_t symbol_type,
+                                 common::BinaryStreamReader* reader) {
+  DCHECK_NE(static_cast<ModuleCompilerInfo*>(nullptr), info);
+  DCHECK_NE(static_cast<common::BinaryStreamReader*>(nullptr), reader);
+
+  switch (symbol_type) {
+    case cci::S_COMPILE3: {
+      std::vector<uint8_t> buffer;
+      const cci::CompileSym2* compile =
+          ParseSymbol<cci::CompileSym2>(symbol_length, reader, &buffer);
+      if (compile == NULL)
+        return false;
+      // The name need not be terminated within the record.
+      size_t max_length =
+          buffer.size() - offsetof(cci::CompileSym2, verSt);
+      info->compiler_name.assign(
+          compile->verSt, ::strnlen(compile->verSt, max_length));
+      info->has_details = true;
+      return false;
+    }
+
+    case cci::S_COMPILE2:
+    case cci::S_COMPILE2_ST:
+    case cci::S_COMPILE_CV2:
+      info->has_legacy_details = true;
+      return false;
+
+    default:
+      return true;
+  }
+}
+
+// Reads the section contributions straight from the DBI stream of the PDB
+// file, which is mapped rather than read, as only the DBI stream and the
+// start of the module symbol streams are looked at. This fails on the records
+// that only DIA interprets, the caller then falling back to
+// LoadSectionContribsFromDia.
+bool LoadSectionContribsFromPdb(const base::FilePath& pdb_path,
+                                const PEFile& image_file,
+                                SectionContribInfos* contribs) {
+  DCHECK_NE(static_cast<SectionContribInfos*>(nullptr), contribs);
+
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.ReadMapped(pdb_path, &pdb_file) ||
+      pdb_file.StreamCount() <= pdb::kDbiStream) {
+    return false;
+  }
+  scoped_refptr<pdb::PdbStream> stream = pdb_file.GetStream(pdb::kDbiStream);
+  if (stream.get() == NULL)
+    return false;
+  scoped_refptr<pdb::PdbByteStream> dbi_stream(new pdb::PdbByteStream());
+  pdb::DbiStream dbi;
+  if (!dbi_stream->Init(stream.get()) || !dbi.Read(dbi_stream.get()))
+    return false;
+
+  // Determine once per module whether it was built by a supported compiler.
+  const pdb::DbiStream::DbiModuleVector& modules = dbi.modules();
+  std::vector<bool> supported_modules(modules.size(), false);
+  for (size_t i = 0; i < modules.size(); ++i) {
+    const pdb::DbiModuleInfoBase& module = modules[i].module_info_base();
+    ModuleCompilerInfo info;
+    if (module.stream >= 0 && module.symbol_bytes != 0) {
+      if (static_cast<size_t>(module.stream) >= pdb_file.StreamCount())
+        return false;
+      scoped_refptr<pdb::PdbStream> symbols =
+          pdb_file.GetStream(module.stream);
+      if (symbols.get() == NULL)
+        return false;
+      pdb::VisitSymbolsCallback callback = base::Bind(
+          &VisitCompilandDetailsSymbol, base::Unretained(&info));
+      // The visit only succeeds if it found no compiland details record.
+      if (!pdb::VisitSymbols(callback, 0, module.symbol_bytes, true,
+                             symbols.get()) &&
+          !info.has_details && !info.has_legacy_details) {
+        return false;
+      }
+    }
+    if (info.has_legacy_details)
+      return false;
+
+    // As with DIA, a module without compiland details is not supported.
+    if (info.has_details) {
+      supported_modules[i] =
+          IsSupportedCompiler(base::UTF8ToWide(info.compiler_name).c_str());
+    }
+  }
+
+  size_t section_count = image_file.nt_headers()->FileHeader.NumberOfSections;
+  const pdb::DbiStream::DbiSectionContribVector& section_contribs =
+      dbi.section_contribs();
+  contribs->clear();
+  contribs->reserve(section_contribs.size());
+  for (size_t i = 0; i < section_contribs.size(); ++i) {
+    const pdb::DbiSectionContrib& contrib = section_contribs[i];
+    // The PDB numbers sections from 1 to n, while we do 0 to n - 1.
+    if (contrib.section <= 0 ||
+        static_cast<size_t>(contrib.section) > section_count ||
+        contrib.offset < 0 || contrib.size < 0 || contrib.module < 0 ||
+        static_cast<size_t>(contrib.module) >= modules.size()) {
+      contribs->clear();
+      return false;
+    }
+
+    SectionContribInfo info;
+    info.section_id = contrib.section - 1;
+    info.rva =
+        image_file.section_headers()[info.section_id].VirtualAddress +
+        contrib.offset;
+    info.length = contrib.size;
+    info.code = (contrib.flags & IMAGE_SCN_CNT_CODE) != 0;
+    info.is_built_by_supported_compiler = supported_modules[contrib.module];
+    info.compiland_name = modules[contrib.module].module_name();
+    contribs->push_back(info);
+  }
+
+  return true;
+}
+
+// Obtains the section contributions through DIA.
+bool LoadSectionContribsFromDia(IDiaSession* session,
+                                SectionContribInfos* contribs) {
+  DCHECK_NE(reinterpret_cast<IDiaSession*>(NULL), session);
+  DCHECK_NE(static_cast<SectionContribInfos*>(nullptr), contribs);
+
+  ScopedComPtr<IDiaEnumSectionContribs> section_contribs;
+  SearchResult search_result = FindDiaTable(session,
+                                            section_contribs.Receive());
+  if (search_result != kSearchSucceeded) {
+    if (search_result == kSearchFailed)
+      LOG(ERROR) << "No section contribution table found.";
+    return false;
+  }
+
+  LONG count = 0;
+  if (section_contribs->get_Count(&count) != S_OK) {
+    LOG(ERROR) << "Failed to get section contributions enumeration length.";
+    return false;
+  }
+
+  contribs->clear();
+  contribs->reserve(count);
+  for (LONG visited = 0; visited < count; ++visited) {
+    ScopedComPtr<IDiaSectionContrib> section_contrib;
+    ULONG fetched = 0;
+    HRESULT hr = section_contribs->Next(1, section_contrib.Receive(), &fetched);
+    // The standard way to end an enumeration (according to the docs) is by
+    // returning S_FALSE and setting fetched to 0. We don't actually see this,
+    // but it wouldn't be an error if we did.
+    if (hr == S_FALSE && fetched == 0)
+      break;
+    if (hr != S_OK) {
+      LOG(ERROR) << "Failed to get DIA section contribution: "
+                 << common::LogHr(hr) << ".";
+      return false;
+    }
+    // We actually end up seeing S_OK and fetched == 0 when the enumeration
+    // terminates, which goes against the publishes documentations.
+    if (fetched == 0)
+      break;
+
+    DWORD section_id = 0;
+    BOOL code = FALSE;
+    ScopedComPtr<IDiaSymbol> compiland;
+    ScopedBstr bstr_compiland_name;
+    SectionContribInfo info;
+    if ((hr = section_contrib->get_relativeVirtualAddress(&info.rva)) != S_OK ||
+        (hr = section_contrib->get_length(&info.length)) != S_OK ||
+        (hr = section_contrib->get_addressSection(&section_id)) != S_OK ||
+        (hr = section_contrib->get_code(&code)) != S_OK ||
+        (hr = section_contrib->get_compiland(compiland.Receive())) != S_OK ||
+        (hr = compiland->get_name(bstr_compiland_name.Receive())) != S_OK) {
+      LOG(ERROR) << "Failed to get section contribution properties: "
+                 << common::LogHr(hr) << ".";
+      return false;
+    }
+
+    // Determine if this function was built by a supported compiler.
+    info.is_built_by_supported_compiler =
+        IsBuiltBySupportedCompiler(compiland.get());
+
+    // DIA numbers sections from 1 to n, while we do 0 to n - 1.
+    DCHECK_LT(0u, section_id);
+    info.section_id = section_id - 1;
+    info.code = code != FALSE;
+
+    if (!base::WideToUTF8(bstr_compiland_name, bstr_compiland_name.Length(),
+                          &info.compiland_name)) {
+      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
+      return false;
+    }
+
+    contribs->push_back(info);
+  }
+
+  return true;
+}
+
 // If the given run of bytes consists of a single value repeated, returns that
 // value. Otherwise, returns -1.
 int RepeatedValue(const uint8_t* data, size_t size) {
@@ -811,6 +1262,51 @@ struct Decomposer::VisitLinkerSymbolContext {
   DISALLOW_COPY_AND_ASSIGN(VisitLinkerSymbolContext);
 };
 
+// Decodes the relocs of the image and loads its FIXUP and OMAP_FROM streams.
+// None of this depends on the block-graph, so it runs on a worker thread while
+// the blocks are being created.
+class Decomposer::FixupLoader : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param image_file The image being decomposed.
+  // @param pdb_path The path of the PDB file of @p image_file.
+  FixupLoader(const PEFile& image_file, const base::FilePath& pdb_path)
+      : image_file_(image_file),
+        pdb_path_(pdb_path),
+        relocs_decoded_(false),
+        streams_loaded_(false) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    relocs_decoded_ = image_file_.DecodeRelocs(&reloc_set_);
+    streams_loaded_ = LoadDebugStreamsFromPdb(pdb_path_, &fixups_,
+                                              &omap_from_);
+  }
+  // @}
+
+  // @name Results, only valid once the thread has been joined.
+  // @{
+  bool relocs_decoded() const { return relocs_decoded_; }
+  bool streams_loaded() const { return streams_loaded_; }
+  PEFile::RelocSet* reloc_set() { return &reloc_set_; }
+  PdbFixups* fixups() { return &fixups_; }
+  OMAPs* omap_from() { return &omap_from_; }
+  // @}
+
+ private:
+  const PEFile& image_file_;
+  const base::FilePath pdb_path_;
+
+  bool relocs_decoded_;
+  bool streams_loaded_;
+  PEFile::RelocSet reloc_set_;
+  PdbFixups fixups_;
+  OMAPs omap_from_;
+
+  DISALLOW_COPY_AND_ASSIGN(FixupLoader);
+};
+
 Decomposer::Decomposer(const PEFile& image_file)
     : image_file_(image_file), image_layout_(NULL), image_(NULL),
       current_block_(NULL), current_scope_count_(0) {
@@ -1002,48 +1498,19 @@ bool Decomposer::DecomposeImpl() {
   if (!CopySectionInfoToBlockGraph(image_file_, image_->graph()))
     return false;
 
-  // We scope the first few operations so that we don't keep the intermediate
-  // references around any longer than we have to.
-  {
-    IntermediateReferences references;
-
-    // First we parse out the PE blocks.
-    VLOG(1) << "Parsing PE blocks.";
-    if (!CreatePEImageBlocksAndReferences(&references))
-      return false;
-
-    // Now we parse the COFF group symbols from the linker's symbol stream.
-    // These indicate things like static initializers, which must stay together
-    // in a single block.
-    VLOG(1) << "Parsing COFF groups.";
-    if (!CreateBlocksFromCoffGroups())
-      return false;
-
-    // Next we parse out section contributions. Some of these may coincide with
-    // existing PE parsed blocks, but when they do we expect them to be exact
-    // collisions.
-    VLOG(1) << "Parsing section contributions.";
-    if (!CreateBlocksFromSectionContribs(dia_session.get()))
-      return false;
-
-    VLOG(1) << "Finding cold blocks.";
-    if (!FindColdBlocksFromCompilands(dia_session.get()))
-      return false;
-
-    // Flesh out the rest of the image with gap blocks.
-    VLOG(1) << "Creating gap blocks.";
-    if (!CreateGapBlocks())
-      return false;
-
-    // Finalize the PE-parsed intermediate references.
-    VLOG(1) << "Finalizing intermediate references.";
-    if (!FinalizeIntermediateReferences(references))
-      return false;
-  }
+  // The fixups are read while the blocks are created, they are only needed
+  // once all of the blocks exist.
+  FixupLoader fixup_loader(image_file_, pdb_path_);
+  base::DelegateSimpleThread fixup_thread(&fixup_loader, "DecomposerFixups");
+  fixup_thread.Start();
+  bool blocks_created = CreateBlocks(dia_session.get());
+  fixup_thread.Join();
+  if (!blocks_created)
+    return false;
 
   // Parse the fixups and use them to create references.
   VLOG(1) << "Parsing fixups.";
-  if (!CreateReferencesFromFixups(dia_session.get()))
+  if (!CreateReferencesFromFixups(dia_session.get(), &fixup_loader))
     return false;
 
   // Annotate the block-graph with symbol information.
@@ -1072,6 +1539,49 @@ bool Decomposer::DecomposeImpl() {
   return true;
 }
 
+bool Decomposer::CreateBlocks(IDiaSession* session) {
+  DCHECK_NE(reinterpret_cast<IDiaSession*>(NULL), session);
+
+  // The intermediate references are local so that we don't keep them around
+  // any longer than we have to.
+  IntermediateReferences references;
+
+  // First we parse out the PE blocks.
+  VLOG(1) << "Parsing PE blocks.";
+  if (!CreatePEImageBlocksAndReferences(&references))
+    return false;
+
+  // Now we parse the COFF group symbols from the linker's symbol stream.
+  // These indicate things like static initializers, which must stay together
+  // in a single block.
+  VLOG(1) << "Parsing COFF groups.";
+  if (!CreateBlocksFromCoffGroups())
+    return false;
+
+  // Next we parse out section contributions. Some of these may coincide with
+  // existing PE parsed blocks, but when they do we expect them to be exact
+  // collisions.
+  VLOG(1) << "Parsing section contributions.";
+  if (!CreateBlocksFromSectionContribs(session))
+    return false;
+
+  VLOG(1) << "Finding cold blocks.";
+  if (!FindColdBlocksFromCompilands(session))
+    return false;
+
+  // Flesh out the rest of the image with gap blocks.
+  VLOG(1) << "Creating gap blocks.";
+  if (!CreateGapBlocks())
+    return false;
+
+  // Finalize the PE-parsed intermediate references.
+  VLOG(1) << "Finalizing intermediate references.";
+  if (!FinalizeIntermediateReferences(references))
+    return false;
+
+  return true;
+}
+
 bool Decomposer::CreatePEImageBlocksAndReferences(
     IntermediateReferences* references) {
   DCHECK_NE(reinterpret_cast<IntermediateReferences*>(NULL), references);
@@ -1119,77 +1629,25 @@ bool Decomposer::CreateBlocksFromCoffGroups() {
 }
 
 bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
-  ScopedComPtr<IDiaEnumSectionContribs> section_contribs;
-  SearchResult search_result = FindDiaTable(session,
-                                            section_contribs.Receive());
-  if (search_result != kSearchSucceeded) {
-    if (search_result == kSearchFailed)
-      LOG(ERROR) << "No section contribution table found.";
-    return false;
+  // The section contributions are read natively when possible, DIA being
+  // much slower at enumerating them.
+  SectionContribInfos contribs;
+  if (!LoadSectionContribsFromPdb(pdb_path_, image_file_, &contribs)) {
+    VLOG(1) << "Falling back to DIA for the section contributions.";
+    if (!LoadSectionContribsFromDia(session, &contribs))
+      return false;
   }
 
   size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
 
-  LONG count = 0;
-  if (section_contribs->get_Count(&count) != S_OK) {
-    LOG(ERROR) << "Failed to get section contributions enumeration length.";
-    return false;
-  }
-
-  for (LONG visited = 0; visited < count; ++visited) {
-    ScopedComPtr<IDiaSectionContrib> section_contrib;
-    ULONG fetched = 0;
-    HRESULT hr = section_contribs->Next(1, section_contrib.Receive(), &fetched);
-    // The standard way to end an enumeration (according to the docs) is by
-    // returning S_FALSE and setting fetched to 0. We don't actually see this,
-    // but it wouldn't be an error if we did.
-    if (hr == S_FALSE && fetched == 0)
-      break;
-    if (hr != S_OK) {
-      LOG(ERROR) << "Failed to get DIA section contribution: "
-                 << common::LogHr(hr) << ".";
-      return false;
-    }
-    // We actually end up seeing S_OK and fetched == 0 when the enumeration
-    // terminates, which goes against the publishes documentations.
-    if (fetched == 0)
-      break;
-
-    DWORD rva = 0;
-    DWORD length = 0;
-    DWORD section_id = 0;
-    BOOL code = FALSE;
-    ScopedComPtr<IDiaSymbol> compiland;
-    ScopedBstr bstr_compiland_name;
-    if ((hr = section_contrib->get_relativeVirtualAddress(&rva)) != S_OK ||
-        (hr = section_contrib->get_length(&length)) != S_OK ||
-        (hr = section_contrib->get_addressSection(&section_id)) != S_OK ||
-        (hr = section_contrib->get_code(&code)) != S_OK ||
-        (hr = section_contrib->get_compiland(compiland.Receive())) != S_OK ||
-        (hr = compiland->get_name(bstr_compiland_name.Receive())) != S_OK) {
-      LOG(ERROR) << "Failed to get section contribution properties: "
-                 << common::LogHr(hr) << ".";
-      return false;
-    }
-
-    // Determine if this function was built by a supported compiler.
-    bool is_built_by_supported_compiler =
-        IsBuiltBySupportedCompiler(compiland.get());
-
-    // DIA numbers sections from 1 to n, while we do 0 to n - 1.
-    DCHECK_LT(0u, section_id);
-    --section_id;
+  for (size_t i = 0; i < contribs.size(); ++i) {
+    const SectionContribInfo& contrib = contribs[i];
 
     // We don't parse the resource section, as it is parsed by the PEFileParser.
-    if (section_id == rsrc_id)
+    if (contrib.section_id == rsrc_id)
       continue;
 
-    std::string compiland_name;
-    if (!base::WideToUTF8(bstr_compiland_name, bstr_compiland_name.Length(),
-                          &compiland_name)) {
-      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
-      return false;
-    }
+    const std::string& compiland_name = contrib.compiland_name;
 
     // Give a name to the block based on the basename of the object file. This
     // will eventually be replaced by the full symbol name, if one exists for
@@ -1214,9 +1672,9 @@ bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
 
     // Create the block.
     BlockType block_type =
-        code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
+        contrib.code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
     Block* block = CreateBlockOrFindCoveringPeBlock(
-        block_type, RelativeAddress(rva), length, name);
+        block_type, RelativeAddress(contrib.rva), contrib.length, name);
     if (block == NULL) {
       LOG(ERROR) << "Unable to create block for compiland \""
                  << compiland_name << "\".";
@@ -1228,7 +1686,7 @@ bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
 
     // Set the block attributes.
     block->set_attribute(BlockGraph::SECTION_CONTRIB);
-    if (!is_built_by_supported_compiler)
+    if (!contrib.is_built_by_supported_compiler)
       block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
   }
 
@@ -1393,41 +1851,49 @@ bool Decomposer::CreateGapBlocks() {
 
 bool Decomposer::FinalizeIntermediateReferences(
     const IntermediateReferences& references) {
+  ResolvedReferences resolved;
+  resolved.reserve(references.size());
   for (size_t i = 0; i < references.size(); ++i) {
     // This logs verbosely for us.
-    if (!CreateReference(references[i].src_addr,
-                         references[i].size,
-                         references[i].type,
-                         references[i].dst_addr,
-                         references[i].dst_addr,
-                         image_)) {
+    if (!ResolveReference(references[i].src_addr,
+                          references[i].size,
+                          references[i].type,
+                          references[i].dst_addr,
+                          references[i].dst_addr,
+                          image_,
+                          &resolved)) {
       return false;
     }
   }
-  return true;
+  return InsertResolvedReferences(&resolved);
 }
 
-bool Decomposer::CreateReferencesFromFixups(IDiaSession* session) {
+bool Decomposer::CreateReferencesFromFixups(IDiaSession* session,
+                                            FixupLoader* fixup_loader) {
   DCHECK_NE(reinterpret_cast<IDiaSession*>(NULL), session);
+  DCHECK_NE(reinterpret_cast<FixupLoader*>(NULL), fixup_loader);
 
-  PEFile::RelocSet reloc_set;
-  if (!image_file_.DecodeRelocs(&reloc_set))
+  if (!fixup_loader->relocs_decoded())
     return false;
+  PEFile::RelocSet* reloc_set = fixup_loader->reloc_set();
 
-  OMAPs omap_from;
-  PdbFixups fixups;
-  if (!LoadDebugStreams(session, &fixups, &omap_from))
+  // Read the streams through DIA if they couldn't be read from the PDB file.
+  if (!fixup_loader->streams_loaded() &&
+      !LoadDebugStreams(session, fixup_loader->fixups(),
+                        fixup_loader->omap_from())) {
     return false;
+  }
 
   // While creating references from the fixups this removes the
   // corresponding reference data from the relocs. We use this as a kind of
   // double-entry bookkeeping to ensure all is well and right in the world.
-  if (!CreateReferencesFromFixupsImpl(image_file_, fixups, omap_from,
-                                      &reloc_set, image_)) {
+  if (!CreateReferencesFromFixupsImpl(image_file_, *fixup_loader->fixups(),
+                                      *fixup_loader->omap_from(), reloc_set,
+                                      image_)) {
     return false;
   }
 
-  if (!reloc_set.empty()) {
+  if (!reloc_set->empty()) {
     LOG(ERROR) << "Found reloc entries without matching FIXUP entries.";
     return false;
   }
@@ -99,6 +99,9 @@ class Decomposer {
   // @{
   // Performs the actual decomposition.
   bool DecomposeImpl();
+  // Creates all of the blocks of the image, running the following steps up to
+  // FinalizeIntermediateReferences.
+  bool CreateBlocks(IDiaSession* session);
   // Parses PE-related blocks and references.
   bool CreatePEImageBlocksAndReferences(IntermediateReferences* references);
   // Creates blocks from the COFF group symbols in the linker symbol stream.
@@ -112,8 +115,14 @@ class Decomposer {
   bool CreateGapBlocks();
   // Finalizes the given vector of intermediate references.
   bool FinalizeIntermediateReferences(const IntermediateReferences& references);
+  // Decodes the relocs and loads the fixups on a worker thread.
+  class FixupLoader;
   // Creates inter-block references from fixups.
-  bool CreateReferencesFromFixups(IDiaSession* session);
+  // @param session The DIA session, used if the fixups couldn't be read from
+  //     the PDB file.
+  // @param fixup_loader The joined loader holding the relocs and the fixups.
+  bool CreateReferencesFromFixups(IDiaSession* session,
+                                  FixupLoader* fixup_loader);
   // Processes symbols from the PDB, setting block names and labels. This
   // step is purely optional and only necessary to provide debug information.
   // This adds names to blocks, adds code labels and their names, and adds
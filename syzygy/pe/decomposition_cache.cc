@@ -0,0 +1,327 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/decomposition_cache.h"
+
+#include "base/environment.h"
+#include "base/logging.h"
+#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/pe/pdb_info.h"
+#include "syzygy/pe/serialization.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraphSerializer;
+
+// The version of the OMAP entries, bumped whenever their layout changes.
+const uint32_t kOmapEntryVersion = 1;
+
+bool SaveOmapTable(const std::vector<OMAP>& omap,
+                   core::OutArchive* out_archive) {
+  DCHECK_NE(static_cast<core::OutArchive*>(nullptr), out_archive);
+  if (!out_archive->Save(static_cast<uint32_t>(omap.size())))
+    return false;
+  for (size_t i = 0; i < omap.size(); ++i) {
+    if (!out_archive->Save(omap[i].rva) || !out_archive->Save(omap[i].rvaTo))
+      return false;
+  }
+  return true;
+}
+
+bool LoadOmapTable(core::InArchive* in_archive, std::vector<OMAP>* omap) {
+  DCHECK_NE(static_cast<core::InArchive*>(nullptr), in_archive);
+  DCHECK_NE(static_cast<std::vector<OMAP>*>(nullptr), omap);
+  uint32_t size = 0;
+  if (!in_archive->Load(&size))
+    return false;
+  omap->clear();
+  for (uint32_t i = 0; i < size; ++i) {
+    OMAP entry = {};
+    if (!in_archive->Load(&entry.rva) || !in_archive->Load(&entry.rvaTo))
+      return false;
+    omap->push_back(entry);
+  }
+  return true;
+}
+
+// Maps a cache entry for reading.
+// @param entry_path The path of the entry.
+// @param mapped_entry Receives the mapping of the entry.
+// @param in_stream Receives a stream over the contents of the entry.
+// @returns true on success, false if the entry can't be mapped.
+bool MapEntry(const base::FilePath& entry_path,
+              std::unique_ptr<base::MemoryMappedFile>* mapped_entry,
+              core::ScopedInStreamPtr* in_stream) {
+  DCHECK_NE(static_cast<std::unique_ptr<base::MemoryMappedFile>*>(nullptr),
+            mapped_entry);
+  DCHECK_NE(static_cast<core::ScopedInStreamPtr*>(nullptr), in_stream);
+
+  if (!base::PathExists(entry_path))
+    return false;
+  mapped_entry->reset(new base::MemoryMappedFile());
+  if (!(*mapped_entry)->Initialize(entry_path)) {
+    mapped_entry->reset();
+    return false;
+  }
+
+  const uint8_t* data = (*mapped_entry)->data();
+  in_stream->reset(
+      core::CreateByteInStream(data, data + (*mapped_entry)->length()));
+  return true;
+}
+
+}  // namespace
+
+const wchar_t DecompositionCache::kEntryExtension[] = L".bg";
+const wchar_t DecompositionCache::kOmapEntryExtension[] = L".omap";
+const char DecompositionCache::kCacheDirEnvVar[] =
+    "SYZYGY_DECOMPOSITION_CACHE_DIR";
+
+DecompositionCache::DecompositionCache(const base::FilePath& cache_dir)
+    : cache_dir_(cache_dir) {
+  DCHECK(!cache_dir.empty());
+}
+
+std::unique_ptr<DecompositionCache> DecompositionCache::Create(
+    const base::FilePath& cache_dir) {
+  base::FilePath dir(cache_dir);
+  if (dir.empty()) {
+    std::unique_ptr<base::Environment> env(base::Environment::Create());
+    std::string env_dir;
+    if (env->GetVar(kCacheDirEnvVar, &env_dir) && !env_dir.empty())
+      dir = base::FilePath(base::UTF8ToWide(env_dir));
+  }
+
+  if (dir.empty())
+    return std::unique_ptr<DecompositionCache>();
+  return std::unique_ptr<DecompositionCache>(new DecompositionCache(dir));
+}
+
+bool DecompositionCache::GetEntryPath(const PEFile& pe_file,
+                                      base::FilePath* entry_path) const {
+  DCHECK_NE(static_cast<base::FilePath*>(nullptr), entry_path);
+
+  PdbInfo pdb_info;
+  if (!pdb_info.Init(pe_file))
+    return false;
+
+  PEFile::Signature signature;
+  pe_file.GetSignature(&signature);
+
+  // The name of the module keeps the entries readable, the rest of the key
+  // identifies its contents.
+  const GUID& guid = pdb_info.signature();
+  std::wstring name = base::StringPrintf(
+      L"%ls-%08X%08X%08X-%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X-%X%ls",
+      base::FilePath(signature.path).BaseName().value().c_str(),
+      signature.module_time_date_stamp, signature.module_size,
+      signature.module_checksum, guid.Data1, guid.Data2, guid.Data3,
+      guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+      guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+      pdb_info.pdb_age(), kEntryExtension);
+  *entry_path = cache_dir_.Append(name);
+
+  return true;
+}
+
+bool DecompositionCache::Load(const PEFile& pe_file,
+                              ImageLayout* image_layout) const {
+  DCHECK_NE(static_cast<ImageLayout*>(nullptr), image_layout);
+  DCHECK(image_layout->blocks.graph()->blocks().empty());
+
+  base::FilePath entry_path;
+  if (!GetEntryPath(pe_file, &entry_path))
+    return false;
+
+  std::unique_ptr<base::MemoryMappedFile> mapped_entry;
+  core::ScopedInStreamPtr in_stream;
+  if (!MapEntry(entry_path, &mapped_entry, &in_stream)) {
+    VLOG(1) << "No decomposition cache entry: " << entry_path.value();
+    return false;
+  }
+
+  core::NativeBinaryInArchive in_archive(in_stream.get());
+  BlockGraphSerializer::Attributes attributes = 0;
+  if (!LoadBlockGraphAndImageLayout(pe_file, &attributes, image_layout,
+                                    &in_archive)) {
+    // The stream version and the signature are checked before the block
+    // graph is populated, a stale entry leaves it untouched. Anything else
+    // is a corrupt entry.
+    if (image_layout->blocks.graph()->blocks().empty()) {
+      LOG(WARNING) << "Ignoring stale decomposition cache entry: "
+                   << entry_path.value();
+    } else {
+      LOG(ERROR) << "Deleting corrupt decomposition cache entry: "
+                 << entry_path.value();
+      in_stream.reset();
+      mapped_entry.reset();
+      base::DeleteFile(entry_path, false);
+    }
+    return false;
+  }
+
+  LOG(INFO) << "Loaded decomposition from cache: " << entry_path.value();
+  return true;
+}
+
+bool DecompositionCache::Save(const PEFile& pe_file,
+                              const ImageLayout& image_layout) const {
+  base::FilePath entry_path;
+  if (!GetEntryPath(pe_file, &entry_path)) {
+    LOG(ERROR) << "Unable to read the PDB information of module: "
+               << pe_file.path().value();
+    return false;
+  }
+
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Unable to create decomposition cache directory: "
+               << cache_dir_.value();
+    return false;
+  }
+
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in: "
+               << cache_dir_.value();
+    return false;
+  }
+
+  // Strings are kept, the decomposition must be identical to a fresh one.
+  bool saved = false;
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() != NULL) {
+      core::FileOutStream out_stream(file.get());
+      core::NativeBinaryOutArchive out_archive(&out_stream);
+      saved = SaveBlockGraphAndImageLayout(pe_file, 0, image_layout,
+                                           &out_archive) &&
+              out_archive.Flush();
+    }
+  }
+
+  base::File::Error error = base::File::FILE_OK;
+  if (!saved || !base::ReplaceFile(temp_path, entry_path, &error)) {
+    LOG(ERROR) << "Unable to write decomposition cache entry: "
+               << entry_path.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  LOG(INFO) << "Saved decomposition to cache: " << entry_path.value();
+  return true;
+}
+
+bool DecompositionCache::GetOmapEntryPath(const PEFile& pe_file,
+                                          base::FilePath* entry_path) const {
+  DCHECK_NE(static_cast<base::FilePath*>(nullptr), entry_path);
+
+  if (!GetEntryPath(pe_file, entry_path))
+    return false;
+  *entry_path = entry_path->ReplaceExtension(kOmapEntryExtension);
+
+  return true;
+}
+
+bool DecompositionCache::LoadOmap(const PEFile& pe_file,
+                                  std::vector<OMAP>* omap_to,
+                                  std::vector<OMAP>* omap_from) const {
+  DCHECK_NE(static_cast<std::vector<OMAP>*>(nullptr), omap_to);
+  DCHECK_NE(static_cast<std::vector<OMAP>*>(nullptr), omap_from);
+
+  base::FilePath entry_path;
+  if (!GetOmapEntryPath(pe_file, &entry_path))
+    return false;
+
+  std::unique_ptr<base::MemoryMappedFile> mapped_entry;
+  core::ScopedInStreamPtr in_stream;
+  if (!MapEntry(entry_path, &mapped_entry, &in_stream)) {
+    VLOG(1) << "No OMAP cache entry: " << entry_path.value();
+    return false;
+  }
+
+  core::NativeBinaryInArchive in_archive(in_stream.get());
+  uint32_t version = 0;
+  if (!in_archive.Load(&version) || version != kOmapEntryVersion) {
+    LOG(WARNING) << "Ignoring stale OMAP cache entry: " << entry_path.value();
+    return false;
+  }
+  if (!LoadOmapTable(&in_archive, omap_to) ||
+      !LoadOmapTable(&in_archive, omap_from)) {
+    LOG(ERROR) << "Deleting corrupt OMAP cache entry: " << entry_path.value();
+    omap_to->clear();
+    omap_from->clear();
+    in_stream.reset();
+    mapped_entry.reset();
+    base::DeleteFile(entry_path, false);
+    return false;
+  }
+
+  LOG(INFO) << "Loaded OMAP data from cache: " << entry_path.value();
+  return true;
+}
+
+bool DecompositionCache::SaveOmap(const PEFile& pe_file,
+                                  const std::vector<OMAP>& omap_to,
+                                  const std::vector<OMAP>& omap_from) const {
+  base::FilePath entry_path;
+  if (!GetOmapEntryPath(pe_file, &entry_path)) {
+    LOG(ERROR) << "Unable to read the PDB information of module: "
+               << pe_file.path().value();
+    return false;
+  }
+
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Unable to create decomposition cache directory: "
+               << cache_dir_.value();
+    return false;
+  }
+
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in: "
+               << cache_dir_.value();
+    return false;
+  }
+
+  bool saved = false;
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() != NULL) {
+      core::FileOutStream out_stream(file.get());
+      core::NativeBinaryOutArchive out_archive(&out_stream);
+      saved = out_archive.Save(kOmapEntryVersion) &&
+              SaveOmapTable(omap_to, &out_archive) &&
+              SaveOmapTable(omap_from, &out_archive) &&
+              out_archive.Flush();
+    }
+  }
+
+  base::File::Error error = base::File::FILE_OK;
+  if (!saved || !base::ReplaceFile(temp_path, entry_path, &error)) {
+    LOG(ERROR) << "Unable to write OMAP cache entry: " << entry_path.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  LOG(INFO) << "Saved OMAP data to cache: " << entry_path.value();
+  return true;
+}
+
+}  // namespace pe
@@ -0,0 +1,141 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares DecompositionCache, an on-disk cache of the decompositions of PE
+// files. Decomposing an image through DIA is the most expensive step of every
+// relinking tool, and build pipelines typically run several of them over the
+// same image. The cache stores the serialized BlockGraph and ImageLayout of
+// the decomposition of an image in a directory, in an entry that is keyed by
+// the signature of the image and by the GUID and the age of its PDB file.
+//
+// An entry is only loaded if its serialized stream version and the signature
+// in its metadata match, so an entry from an older toolchain is simply
+// ignored and replaced.
+//
+// The cache also holds the OMAP tables of instrumented images, which the
+// playback tools otherwise read from their PDB file on every run. These
+// entries share the key of the image they belong to.
+//
+// The tools of a pipeline share a cache by naming its directory in the
+// SYZYGY_DECOMPOSITION_CACHE_DIR environment variable, rather than each being
+// passed it. Entries are read through read-only mappings of their files, so
+// the processes of a pipeline that load a recently used entry share its
+// pages rather than each reading the file.
+
+#ifndef SYZYGY_PE_DECOMPOSITION_CACHE_H_
+#define SYZYGY_PE_DECOMPOSITION_CACHE_H_
+
+#include <windows.h>  // NOLINT
+#include <dbghelp.h>
+#include <memory>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/pe_file.h"
+
+namespace pe {
+
+class DecompositionCache {
+ public:
+  // @param cache_dir The directory holding the cache entries. It is created
+  //     on the first save if it doesn't exist.
+  explicit DecompositionCache(const base::FilePath& cache_dir);
+
+  // Creates the cache used by a tool.
+  // @param cache_dir The cache directory given to the tool, if any.
+  // @returns a cache in @p cache_dir if it isn't empty, else in the directory
+  //     named by the kCacheDirEnvVar environment variable if it is set, and
+  //     NULL otherwise.
+  static std::unique_ptr<DecompositionCache> Create(
+      const base::FilePath& cache_dir);
+
+  // @returns the directory holding the cache entries.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+
+  // Gets the path of the cache entry of a PE file.
+  // @param pe_file The PE file whose entry is to be found.
+  // @param entry_path Receives the path of the entry. It may not exist.
+  // @returns true on success, false if @p pe_file has no PDB information.
+  bool GetEntryPath(const PEFile& pe_file, base::FilePath* entry_path) const;
+
+  // Loads the decomposition of @p pe_file from the cache.
+  // @param pe_file The PE file whose decomposition is to be loaded.
+  // @param image_layout The image layout to populate. Its block graph must be
+  //     empty.
+  // @returns true if a valid entry for @p pe_file was loaded, false otherwise.
+  //     When there is no valid entry the block graph of @p image_layout is
+  //     left empty. Otherwise, if the entry is corrupt, it is deleted and the
+  //     block graph may have been partially populated.
+  bool Load(const PEFile& pe_file, ImageLayout* image_layout) const;
+
+  // Saves the decomposition of @p pe_file to the cache, replacing any
+  // existing entry. The entry is written to a temporary file that is then
+  // moved in place, so that concurrent users of the cache never see a
+  // partially written entry.
+  // @param pe_file The PE file that was decomposed.
+  // @param image_layout The decomposition of @p pe_file.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool Save(const PEFile& pe_file, const ImageLayout& image_layout) const;
+
+  // Gets the path of the OMAP entry of a PE file.
+  // @param pe_file The PE file whose OMAP entry is to be found.
+  // @param entry_path Receives the path of the entry. It may not exist.
+  // @returns true on success, false if @p pe_file has no PDB information.
+  bool GetOmapEntryPath(const PEFile& pe_file,
+                        base::FilePath* entry_path) const;
+
+  // Loads the OMAP tables of the PDB file of @p pe_file from the cache. A
+  // corrupt entry is deleted.
+  // @param pe_file The PE file whose OMAP tables are to be loaded.
+  // @param omap_to Receives the table mapping from @p pe_file to its original
+  //     image.
+  // @param omap_from Receives the table mapping from the original image to
+  //     @p pe_file.
+  // @returns true if a valid entry for @p pe_file was loaded, false otherwise.
+  bool LoadOmap(const PEFile& pe_file,
+                std::vector<OMAP>* omap_to,
+                std::vector<OMAP>* omap_from) const;
+
+  // Saves the OMAP tables of the PDB file of @p pe_file to the cache,
+  // replacing any existing entry, as Save does.
+  // @param pe_file The PE file whose PDB file holds the tables.
+  // @param omap_to The table mapping from @p pe_file to its original image.
+  // @param omap_from The table mapping from the original image to @p pe_file.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool SaveOmap(const PEFile& pe_file,
+                const std::vector<OMAP>& omap_to,
+                const std::vector<OMAP>& omap_from) const;
+
+  // The extension of the cache entries.
+  static const wchar_t kEntryExtension[];
+
+  // The extension of the OMAP entries.
+  static const wchar_t kOmapEntryExtension[];
+
+  // The environment variable naming the cache directory shared by the tools
+  // of a pipeline.
+  static const char kCacheDirEnvVar[];
+
+ private:
+  base::FilePath cache_dir_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecompositionCache);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_DECOMPOSITION_CACHE_H_
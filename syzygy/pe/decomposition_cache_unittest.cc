@@ -0,0 +1,190 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/decomposition_cache.h"
+
+#include "base/environment.h"
+#include "base/files/file_util.h"
+#include "base/strings/utf_string_conversions.h"
+#include "gtest/gtest.h"
+#include "syzygy/pdb/omap.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+class DecompositionCacheTest : public testing::PELibUnitTest {
+  typedef testing::PELibUnitTest Super;
+
+ public:
+  DecompositionCacheTest() : image_layout_(&block_graph_) {
+  }
+
+  void SetUp() override {
+    Super::SetUp();
+
+    base::FilePath image_path =
+        testing::GetExeRelativePath(testing::kTestDllName);
+    ASSERT_TRUE(pe_file_.Init(image_path));
+
+    base::FilePath temp_dir;
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+    cache_dir_ = temp_dir.Append(L"cache");
+  }
+
+  void Decompose() {
+    Decomposer decomposer(pe_file_);
+    ASSERT_TRUE(decomposer.Decompose(&image_layout_));
+  }
+
+  PEFile pe_file_;
+  BlockGraph block_graph_;
+  ImageLayout image_layout_;
+  base::FilePath cache_dir_;
+};
+
+}  // namespace
+
+TEST_F(DecompositionCacheTest, GetEntryPath) {
+  DecompositionCache cache(cache_dir_);
+  EXPECT_EQ(cache_dir_, cache.cache_dir());
+
+  base::FilePath entry_path;
+  ASSERT_TRUE(cache.GetEntryPath(pe_file_, &entry_path));
+  EXPECT_EQ(cache_dir_, entry_path.DirName());
+  EXPECT_EQ(DecompositionCache::kEntryExtension, entry_path.Extension());
+
+  // The entry path only depends on the contents of the module.
+  base::FilePath entry_path2;
+  EXPECT_TRUE(cache.GetEntryPath(pe_file_, &entry_path2));
+  EXPECT_EQ(entry_path, entry_path2);
+}
+
+TEST_F(DecompositionCacheTest, Create) {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env->UnSetVar(DecompositionCache::kCacheDirEnvVar));
+  EXPECT_EQ(nullptr, DecompositionCache::Create(base::FilePath()).get());
+
+  std::unique_ptr<DecompositionCache> cache(
+      DecompositionCache::Create(cache_dir_));
+  ASSERT_NE(nullptr, cache.get());
+  EXPECT_EQ(cache_dir_, cache->cache_dir());
+
+  // The environment names the cache when no directory is given.
+  base::FilePath env_cache_dir = cache_dir_.Append(L"env");
+  ASSERT_TRUE(env->SetVar(DecompositionCache::kCacheDirEnvVar,
+                          base::WideToUTF8(env_cache_dir.value())));
+  cache = DecompositionCache::Create(base::FilePath());
+  ASSERT_NE(nullptr, cache.get());
+  EXPECT_EQ(env_cache_dir, cache->cache_dir());
+  cache = DecompositionCache::Create(cache_dir_);
+  ASSERT_NE(nullptr, cache.get());
+  EXPECT_EQ(cache_dir_, cache->cache_dir());
+  EXPECT_TRUE(env->UnSetVar(DecompositionCache::kCacheDirEnvVar));
+}
+
+TEST_F(DecompositionCacheTest, LoadFailsWithoutEntry) {
+  DecompositionCache cache(cache_dir_);
+  EXPECT_FALSE(cache.Load(pe_file_, &image_layout_));
+  EXPECT_TRUE(block_graph_.blocks().empty());
+}
+
+TEST_F(DecompositionCacheTest, LoadIgnoresStaleEntry) {
+  DecompositionCache cache(cache_dir_);
+  base::FilePath entry_path;
+  ASSERT_TRUE(cache.GetEntryPath(pe_file_, &entry_path));
+  ASSERT_TRUE(base::CreateDirectory(cache_dir_));
+  static const char kJunk[] = "not a decomposition";
+  ASSERT_EQ(static_cast<int>(sizeof(kJunk)),
+            base::WriteFile(entry_path, kJunk, sizeof(kJunk)));
+
+  EXPECT_FALSE(cache.Load(pe_file_, &image_layout_));
+  EXPECT_TRUE(block_graph_.blocks().empty());
+}
+
+TEST_F(DecompositionCacheTest, SaveAndLoad) {
+  ASSERT_NO_FATAL_FAILURE(Decompose());
+
+  DecompositionCache cache(cache_dir_);
+  ASSERT_TRUE(cache.Save(pe_file_, image_layout_));
+  base::FilePath entry_path;
+  ASSERT_TRUE(cache.GetEntryPath(pe_file_, &entry_path));
+  EXPECT_TRUE(base::PathExists(entry_path));
+
+  // A later run loads the same decomposition.
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(cache.Load(pe_file_, &image_layout));
+
+  ASSERT_EQ(block_graph_.blocks().size(), block_graph.blocks().size());
+  EXPECT_EQ(image_layout_.sections.size(), image_layout.sections.size());
+  BlockGraph::BlockMap::const_iterator it = block_graph_.blocks().begin();
+  BlockGraph::BlockMap::const_iterator loaded_it =
+      block_graph.blocks().begin();
+  for (; it != block_graph_.blocks().end(); ++it, ++loaded_it) {
+    EXPECT_EQ(it->second.name(), loaded_it->second.name());
+    EXPECT_EQ(it->second.addr(), loaded_it->second.addr());
+    EXPECT_EQ(it->second.size(), loaded_it->second.size());
+    EXPECT_EQ(it->second.references().size(),
+              loaded_it->second.references().size());
+  }
+
+  // Saving again replaces the entry.
+  EXPECT_TRUE(cache.Save(pe_file_, image_layout_));
+  EXPECT_TRUE(base::PathExists(entry_path));
+}
+
+TEST_F(DecompositionCacheTest, SaveAndLoadOmap) {
+  DecompositionCache cache(cache_dir_);
+  base::FilePath entry_path;
+  ASSERT_TRUE(cache.GetOmapEntryPath(pe_file_, &entry_path));
+  EXPECT_EQ(DecompositionCache::kOmapEntryExtension, entry_path.Extension());
+
+  std::vector<OMAP> omap_to;
+  std::vector<OMAP> omap_from;
+  EXPECT_FALSE(cache.LoadOmap(pe_file_, &omap_to, &omap_from));
+
+  std::vector<OMAP> expected_to;
+  expected_to.push_back(pdb::CreateOmap(0x1000, 0x2000));
+  expected_to.push_back(pdb::CreateOmap(0x1010, 0x2100));
+  std::vector<OMAP> expected_from;
+  expected_from.push_back(pdb::CreateOmap(0x2000, 0x1000));
+  ASSERT_TRUE(cache.SaveOmap(pe_file_, expected_to, expected_from));
+  EXPECT_TRUE(base::PathExists(entry_path));
+
+  ASSERT_TRUE(cache.LoadOmap(pe_file_, &omap_to, &omap_from));
+  ASSERT_EQ(expected_to.size(), omap_to.size());
+  for (size_t i = 0; i < expected_to.size(); ++i) {
+    EXPECT_EQ(expected_to[i].rva, omap_to[i].rva);
+    EXPECT_EQ(expected_to[i].rvaTo, omap_to[i].rvaTo);
+  }
+  ASSERT_EQ(expected_from.size(), omap_from.size());
+  EXPECT_EQ(expected_from[0].rva, omap_from[0].rva);
+  EXPECT_EQ(expected_from[0].rvaTo, omap_from[0].rvaTo);
+
+  // A truncated entry, whose first table is missing its entries, is deleted.
+  const uint32_t kTruncated[] = {1, 5};
+  ASSERT_EQ(static_cast<int>(sizeof(kTruncated)),
+            base::WriteFile(entry_path,
+                            reinterpret_cast<const char*>(kTruncated),
+                            sizeof(kTruncated)));
+  EXPECT_FALSE(cache.LoadOmap(pe_file_, &omap_to, &omap_from));
+  EXPECT_FALSE(base::PathExists(entry_path));
+}
+
+}  // namespace pe
@@ -32,6 +32,9 @@ using base::Value;
 const char kBaseAddress[] = "base_address";
 const char kChecksum[] = "checksum";
 const char kFilter[] = "filter";
+const char kPageMap[] = "page_map";
+const char kPageSize[] = "page_size";
+const char kPages[] = "pages";
 const char kPath[] = "path";
 const char kSignature[] = "signature";
 const char kSize[] = "size";
@@ -195,18 +198,36 @@ bool LoadFilterFromJSON(const ListValue& list, ImageFilter* filter) {
   return true;
 }
 
+// Loads the page map of the address filter in |filter| from the given |dict|.
+// Returns true on success, false if the page map is malformed or doesn't
+// match the address filter.
+bool LoadPageMapFromJSON(const DictionaryValue& dict, ImageFilter* filter) {
+  DCHECK(filter != NULL);
+
+  int page_size = 0;
+  std::string pages;
+  if (!dict.GetInteger(kPageSize, &page_size) || page_size <= 0 ||
+      !dict.GetString(kPages, &pages)) {
+    return false;
+  }
+
+  return filter->page_map.Init(filter->filter, page_size, pages);
+}
+
 }  // namespace
 
 void ImageFilter::Init(const PEFile::Signature& pe_signature) {
   signature = pe_signature;
   filter = RelativeAddressFilter(
       Range(RelativeAddress(0), signature.module_size));
+  page_map = RelativeAddressFilterPageMap();
 }
 
 void ImageFilter::Init(const PEFile& pe_file) {
   pe_file.GetSignature(&signature);
   filter = RelativeAddressFilter(
       Range(RelativeAddress(0), signature.module_size));
+  page_map = RelativeAddressFilterPageMap();
 }
 
 bool ImageFilter::Init(const base::FilePath& path) {
@@ -217,6 +238,10 @@ bool ImageFilter::Init(const base::FilePath& path) {
   return true;
 }
 
+void ImageFilter::UpdatePageMap() {
+  page_map.Init(filter, RelativeAddressFilterPageMap::kDefaultPageSize);
+}
+
 bool ImageFilter::IsForModule(const PEFile::Signature& pe_signature) const {
   if (!pe_signature.IsConsistent(signature))
     return false;
@@ -288,7 +313,26 @@ bool ImageFilter::SaveToJSON(core::JSONFileWriter* json) const {
     }
   }
 
-  if (!j.CloseList() || !j.CloseDict())
+  if (!j.CloseList())
+    return false;
+
+  // Write the page map of the filter.
+  RelativeAddressFilterPageMap current_page_map;
+  current_page_map.Init(filter,
+                        RelativeAddressFilterPageMap::kDefaultPageSize);
+  if (!j.OutputComment("This is the page map of the filter, with a state") ||
+      !j.OutputComment("per page: 0 unmarked, 1 marked, 2 partially marked.") ||
+      !j.OutputKey(kPageMap) ||
+      !j.OpenDict() ||
+      !j.OutputKey(kPageSize) ||
+      !j.OutputInteger(static_cast<int>(current_page_map.page_size())) ||
+      !j.OutputKey(kPages) ||
+      !j.OutputString(current_page_map.pages()) ||
+      !j.CloseDict()) {
+    return false;
+  }
+
+  if (!j.CloseDict())
     return false;
 
   return true;
@@ -339,6 +383,16 @@ bool ImageFilter::LoadFromJSON(const DictionaryValue& dict) {
   if (!LoadFilterFromJSON(*filter, this))
     return false;
 
+  // Restore the page map if there is a valid one, as it's cheaper than
+  // building it. Filters saved before page maps existed don't have one.
+  const DictionaryValue* page_map_dict = NULL;
+  if (!dict.GetDictionary(kPageMap, &page_map_dict) ||
+      !LoadPageMapFromJSON(*page_map_dict, this)) {
+    if (page_map_dict != NULL)
+      LOG(WARNING) << "Ignoring invalid page map, rebuilding it.";
+    UpdatePageMap();
+  }
+
   return true;
 }
 
@@ -13,7 +13,9 @@
 // limitations under the License.
 //
 // Declares ImageFilter, a structure for imposing a filter on an image. The
-// filter itself is a core::AddressFilter built on relative addresses.
+// filter itself is a core::AddressFilter built on relative addresses. It is
+// accompanied by a page map, which summarizes the filter so that checking the
+// ranges of the blocks of an image rarely has to look up the filter itself.
 
 #ifndef SYZYGY_PE_IMAGE_FILTER_H_
 #define SYZYGY_PE_IMAGE_FILTER_H_
@@ -22,6 +24,7 @@
 #include "base/files/file_path.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_filter.h"
+#include "syzygy/core/address_filter_page_map.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/pe/pe_file.h"
 
@@ -31,6 +34,8 @@ struct ImageFilter {
   typedef core::RelativeAddress RelativeAddress;
   typedef core::AddressFilter<RelativeAddress, size_t> RelativeAddressFilter;
   typedef RelativeAddressFilter::Range Range;
+  typedef core::AddressFilterPageMap<RelativeAddress, size_t>
+      RelativeAddressFilterPageMap;
 
   // The signature of the module to which this filter applies.
   PEFile::Signature signature;
@@ -38,6 +43,10 @@ struct ImageFilter {
   // The filtered relative address space.
   RelativeAddressFilter filter;
 
+  // The page map of the filtered address space. This is built when the
+  // filter is loaded, and is empty otherwise.
+  RelativeAddressFilterPageMap page_map;
+
   // Initializes this ImageFilter to the given PE file. Sets the signature,
   // the extent of the filter, and clears the marked ranges.
   // @param pe_signature The signature to use.
@@ -48,6 +57,10 @@ struct ImageFilter {
   void Init(const PEFile& pe_file);
   bool Init(const base::FilePath& path);
 
+  // Rebuilds the page map from the current filter. This must be called after
+  // modifying the filter for the page map to be used.
+  void UpdatePageMap();
+
   // Determines if this filter is for the given module.
   // @param pe_signature The signature to compare against.
   // @param pe_file The module to compare against.
@@ -57,7 +70,8 @@ struct ImageFilter {
   bool IsForModule(const PEFile& pe_file) const;
   bool IsForModule(const base::FilePath& path) const;
 
-  // Saves this image filter to file.
+  // Saves this image filter to file. The page map is built from the current
+  // filter and saved alongside it.
   // @param json The JSON writer to be written to.
   // @param pretty_print If true the file will be pretty-printed.
   // @param file The file to be written to.
@@ -68,7 +82,9 @@ struct ImageFilter {
   bool SaveToJSON(bool pretty_print, FILE* file) const;
   bool SaveToJSON(bool pretty_print, const base::FilePath& path) const;
 
-  // Loads an image filter from a file in JSON format.
+  // Loads an image filter from a file in JSON format. The page map is
+  // restored if it was saved and is consistent with the filter, and rebuilt
+  // otherwise.
   // @param dict The JSON dictionary to be loaded from.
   // @param file The file to be read from.
   // @param path The path of the file to be read.
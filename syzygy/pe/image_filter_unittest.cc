@@ -14,6 +14,9 @@
 
 #include "syzygy/pe/image_filter.h"
 
+#include <memory>
+
+#include "base/json/json_reader.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/unittest_util.h"
@@ -122,6 +125,48 @@ TEST_F(ImageFilterTest, SaveToAndLoadFromJSON) {
   EXPECT_TRUE(f3.LoadFromJSON(ugly_json_path));
   EXPECT_EQ(f1.signature, f3.signature);
   EXPECT_EQ(f1.filter, f3.filter);
+
+  // The page maps are restored along with the filters.
+  f1.UpdatePageMap();
+  EXPECT_FALSE(f2.page_map.empty());
+  EXPECT_EQ(f1.page_map.page_size(), f2.page_map.page_size());
+  EXPECT_EQ(f1.page_map.pages(), f2.page_map.pages());
+  EXPECT_EQ(f1.page_map.pages(), f3.page_map.pages());
+  EXPECT_EQ("212", f1.page_map.pages().substr(0, 3));
+}
+
+TEST_F(ImageFilterTest, LoadFromJSONRebuildsPageMap) {
+  ImageFilter f1;
+  EXPECT_TRUE(f1.Init(test_dll_path));
+  f1.filter.Mark(ImageFilter::Range(
+      ImageFilter::RelativeAddress(4096), 4096));
+  f1.UpdatePageMap();
+
+  base::FilePath temp_dir;
+  CreateTemporaryDir(&temp_dir);
+  base::FilePath json_path = temp_dir.Append(L"test_dll.json");
+  EXPECT_TRUE(f1.SaveToJSON(false, json_path));
+
+  std::string json;
+  ASSERT_TRUE(base::ReadFileToString(json_path, &json));
+  std::unique_ptr<base::Value> value(base::JSONReader::Read(json).release());
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value.get() != NULL);
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+
+  // A page map that doesn't match the filter is rebuilt.
+  dict->SetString("page_map.pages", "0");
+  ImageFilter f2;
+  EXPECT_TRUE(f2.LoadFromJSON(*dict));
+  EXPECT_EQ(f1.filter, f2.filter);
+  EXPECT_EQ(f1.page_map.pages(), f2.page_map.pages());
+
+  // As is a missing page map.
+  EXPECT_TRUE(dict->Remove("page_map", NULL));
+  ImageFilter f3;
+  EXPECT_TRUE(f3.LoadFromJSON(*dict));
+  EXPECT_EQ(f1.filter, f3.filter);
+  EXPECT_EQ(f1.page_map.pages(), f3.page_map.pages());
 }
 
 }  // namespace pe
@@ -0,0 +1,204 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/pdb_index.h"
+
+#include <set>
+#include <string>
+
+#include "base/logging.h"
+#include "base/files/file_enumerator.h"
+#include "base/files/file_util.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/pdb/pdb_util.h"
+
+namespace pe {
+
+const uint32_t PdbIndex::kVersion = 1;
+
+bool PdbIndex::Load(const base::FilePath& index_path) {
+  entries_.clear();
+  signatures_.clear();
+
+  base::ScopedFILE file(base::OpenFile(index_path, "rb"));
+  if (file.get() == NULL) {
+    VLOG(1) << "No PDB index: " << index_path.value();
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  uint32_t version = 0;
+  if (!in_archive.Load(&version) || version != kVersion) {
+    LOG(WARNING) << "Ignoring stale PDB index: " << index_path.value();
+    return false;
+  }
+
+  uint32_t num_entries = 0;
+  if (!in_archive.Load(&num_entries)) {
+    LOG(ERROR) << "Corrupt PDB index: " << index_path.value();
+    return false;
+  }
+  for (uint32_t i = 0; i < num_entries; ++i) {
+    std::wstring path;
+    Entry entry = {};
+    if (!in_archive.Load(&path) ||
+        !in_archive.Load(&entry.signature.Data1) ||
+        !in_archive.Load(&entry.signature.Data2) ||
+        !in_archive.Load(&entry.signature.Data3) ||
+        !in_archive.Load(&entry.signature.Data4) ||
+        !in_archive.Load(&entry.pdb_age) ||
+        !in_archive.Load(&entry.file_size) ||
+        !in_archive.Load(&entry.last_modified)) {
+      LOG(ERROR) << "Corrupt PDB index: " << index_path.value();
+      entries_.clear();
+      return false;
+    }
+    entries_[base::FilePath(path)] = entry;
+  }
+
+  IndexSignatures();
+  VLOG(1) << "Loaded " << entries_.size() << " PDB index entries from: "
+          << index_path.value();
+  return true;
+}
+
+bool PdbIndex::Save(const base::FilePath& index_path) const {
+  base::FilePath index_dir = index_path.DirName();
+  if (!base::CreateDirectory(index_dir)) {
+    LOG(ERROR) << "Unable to create PDB index directory: "
+               << index_dir.value();
+    return false;
+  }
+
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(index_dir, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in: "
+               << index_dir.value();
+    return false;
+  }
+
+  bool saved = false;
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() != NULL) {
+      core::FileOutStream out_stream(file.get());
+      core::NativeBinaryOutArchive out_archive(&out_stream);
+      saved = out_archive.Save(kVersion) &&
+              out_archive.Save(static_cast<uint32_t>(entries_.size()));
+      for (EntryMap::const_iterator it = entries_.begin();
+           saved && it != entries_.end(); ++it) {
+        const Entry& entry = it->second;
+        saved = out_archive.Save(it->first.value()) &&
+                out_archive.Save(entry.signature.Data1) &&
+                out_archive.Save(entry.signature.Data2) &&
+                out_archive.Save(entry.signature.Data3) &&
+                out_archive.Save(entry.signature.Data4) &&
+                out_archive.Save(entry.pdb_age) &&
+                out_archive.Save(entry.file_size) &&
+                out_archive.Save(entry.last_modified);
+      }
+      saved = saved && out_archive.Flush();
+    }
+  }
+
+  base::File::Error error = base::File::FILE_OK;
+  if (!saved || !base::ReplaceFile(temp_path, index_path, &error)) {
+    LOG(ERROR) << "Unable to write PDB index: " << index_path.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
+bool PdbIndex::Update(const base::FilePath& symbol_dir) {
+  if (!base::DirectoryExists(symbol_dir)) {
+    LOG(ERROR) << "Symbol directory does not exist: " << symbol_dir.value();
+    return false;
+  }
+
+  size_t num_read = 0;
+  std::set<base::FilePath> found;
+  base::FileEnumerator enumerator(symbol_dir, true,
+                                  base::FileEnumerator::FILES, L"*.pdb");
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    found.insert(path);
+
+    base::FileEnumerator::FileInfo info = enumerator.GetInfo();
+    int64_t last_modified = info.GetLastModifiedTime().ToInternalValue();
+    EntryMap::iterator it = entries_.find(path);
+    if (it != entries_.end() && it->second.file_size == info.GetSize() &&
+        it->second.last_modified == last_modified) {
+      continue;
+    }
+
+    // The file is new or was modified, its header needs to be read.
+    pdb::PdbInfoHeader70 header = {};
+    ++num_read;
+    if (!pdb::ReadPdbHeader(path, &header)) {
+      VLOG(1) << "Not indexing unreadable PDB file: " << path.value();
+      if (it != entries_.end())
+        entries_.erase(it);
+      continue;
+    }
+    Entry entry = { header.signature, header.pdb_age, info.GetSize(),
+                    last_modified };
+    entries_[path] = entry;
+  }
+
+  // Forget the files of the directory that were removed.
+  EntryMap::iterator it = entries_.begin();
+  while (it != entries_.end()) {
+    if (symbol_dir.IsParent(it->first) && found.count(it->first) == 0)
+      it = entries_.erase(it);
+    else
+      ++it;
+  }
+
+  IndexSignatures();
+  VLOG(1) << "Indexed " << found.size() << " PDB files in "
+          << symbol_dir.value() << ", " << num_read << " of them read.";
+  return true;
+}
+
+bool PdbIndex::Find(const PdbInfo& pdb_info, base::FilePath* pdb_path) const {
+  DCHECK_NE(static_cast<base::FilePath*>(nullptr), pdb_path);
+
+  std::pair<SignatureMap::const_iterator, SignatureMap::const_iterator> range =
+      signatures_.equal_range(pdb_info.signature());
+  for (SignatureMap::const_iterator it = range.first; it != range.second;
+       ++it) {
+    // The symbol store may have changed since the last update.
+    const base::FilePath& path = it->second->first;
+    if (it->second->second.pdb_age >= pdb_info.pdb_age() &&
+        base::PathExists(path)) {
+      *pdb_path = path;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void PdbIndex::IndexSignatures() {
+  signatures_.clear();
+  for (EntryMap::const_iterator it = entries_.begin(); it != entries_.end();
+       ++it) {
+    signatures_.insert(std::make_pair(it->second.signature, it));
+  }
+}
+
+}  // namespace pe
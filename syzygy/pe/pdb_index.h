@@ -0,0 +1,110 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares PdbIndex, a persistent index of the PDB files of a local symbol
+// store, keyed by their GUID and age. Looking a PDB up by probing the paths
+// of the symbol store for every module is slow on large stores, while the
+// index resolves it with a single lookup.
+//
+// The index is built by scanning the symbol directories once, and then kept
+// up to date incrementally: a rescan only reads the header of the PDB files
+// that were added or modified since the last one, and forgets those that
+// were removed.
+
+#ifndef SYZYGY_PE_PDB_INDEX_H_
+#define SYZYGY_PE_PDB_INDEX_H_
+
+#include <windows.h>  // NOLINT
+#include <map>
+
+#include "base/macros.h"
+#include "base/files/file_path.h"
+#include "syzygy/pe/pdb_info.h"
+
+namespace pe {
+
+class PdbIndex {
+ public:
+  PdbIndex() { }
+
+  // Loads the index from a file, replacing the current entries.
+  // @param index_path The file holding the index.
+  // @returns true on success, false if @p index_path doesn't exist, was
+  //     saved by another version or is corrupt. The index is left empty on
+  //     failure.
+  bool Load(const base::FilePath& index_path);
+
+  // Saves the index to a file. The index is written to a temporary file that
+  // is then moved in place, so concurrent users never see a partial index.
+  // @param index_path The file to hold the index.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool Save(const base::FilePath& index_path) const;
+
+  // Scans a symbol directory recursively for PDB files and updates the index
+  // with them. The PDB files whose size and modification time are unchanged
+  // aren't read again, and the entries of the files of @p symbol_dir that no
+  // longer exist are removed.
+  // @param symbol_dir The directory to scan.
+  // @returns true on success, false if @p symbol_dir doesn't exist.
+  bool Update(const base::FilePath& symbol_dir);
+
+  // Looks up the PDB file matching a module.
+  // @param pdb_info The PDB information of the module.
+  // @param pdb_path Receives the path of the PDB file.
+  // @returns true if a PDB file of the same GUID, and of an equal or greater
+  //     age, is indexed and still exists, false otherwise.
+  bool Find(const PdbInfo& pdb_info, base::FilePath* pdb_path) const;
+
+  // @returns the number of indexed PDB files.
+  size_t size() const { return entries_.size(); }
+
+  // The version of the index file format, bumped whenever it changes.
+  static const uint32_t kVersion;
+
+ protected:
+  struct Entry {
+    GUID signature;
+    uint32_t pdb_age;
+    // The size and the modification time of the file when it was indexed.
+    int64_t file_size;
+    int64_t last_modified;
+  };
+
+  // Orders GUIDs by their bytes.
+  struct GuidLess {
+    bool operator()(const GUID& guid1, const GUID& guid2) const {
+      return ::memcmp(&guid1, &guid2, sizeof(guid1)) < 0;
+    }
+  };
+
+  typedef std::map<base::FilePath, Entry> EntryMap;
+  typedef std::multimap<GUID, EntryMap::const_iterator, GuidLess>
+      SignatureMap;
+
+  // Rebuilds signatures_ from entries_.
+  void IndexSignatures();
+
+  // The indexed PDB files, by path.
+  EntryMap entries_;
+  // The indexed PDB files, by GUID.
+  SignatureMap signatures_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PdbIndex);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_PDB_INDEX_H_
@@ -0,0 +1,148 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/pdb_index.h"
+
+#include "base/files/file_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+class TestPdbIndex : public PdbIndex {
+ public:
+  using PdbIndex::entries_;
+};
+
+class PdbIndexTest : public testing::PELibUnitTest {
+  typedef testing::PELibUnitTest Super;
+
+ public:
+  void SetUp() override {
+    Super::SetUp();
+
+    ASSERT_TRUE(pdb_info_.Init(
+        testing::GetExeRelativePath(testing::kTestDllName)));
+
+    base::FilePath temp_dir;
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+    index_path_ = temp_dir.Append(L"pdb.index");
+
+    // Lay the PDB out as in a symbol store.
+    symbol_dir_ = temp_dir.Append(L"symbols");
+    base::FilePath pdb_dir = symbol_dir_.Append(testing::kTestDllPdbName)
+        .Append(L"0123456789ABCDEF0123456789ABCDEF1");
+    ASSERT_TRUE(base::CreateDirectory(pdb_dir));
+    pdb_path_ = pdb_dir.Append(testing::kTestDllPdbName);
+    ASSERT_TRUE(base::CopyFile(
+        testing::GetExeRelativePath(testing::kTestDllPdbName), pdb_path_));
+  }
+
+  PdbInfo pdb_info_;
+  base::FilePath index_path_;
+  base::FilePath symbol_dir_;
+  base::FilePath pdb_path_;
+};
+
+}  // namespace
+
+TEST_F(PdbIndexTest, FindFailsOnEmptyIndex) {
+  PdbIndex index;
+  base::FilePath pdb_path;
+  EXPECT_EQ(0u, index.size());
+  EXPECT_FALSE(index.Find(pdb_info_, &pdb_path));
+}
+
+TEST_F(PdbIndexTest, UpdateFailsWithoutDirectory) {
+  PdbIndex index;
+  EXPECT_FALSE(index.Update(symbol_dir_.Append(L"missing")));
+}
+
+TEST_F(PdbIndexTest, UpdateAndFind) {
+  PdbIndex index;
+  ASSERT_TRUE(index.Update(symbol_dir_));
+  EXPECT_EQ(1u, index.size());
+
+  base::FilePath pdb_path;
+  ASSERT_TRUE(index.Find(pdb_info_, &pdb_path));
+  EXPECT_EQ(pdb_path_, pdb_path);
+
+  // A PDB older than the module doesn't match it.
+  CvInfoPdb70 cv_info = {};
+  cv_info.signature = pdb_info_.signature();
+  cv_info.pdb_age = pdb_info_.pdb_age() + 1000;
+  PdbInfo newer_pdb_info;
+  ASSERT_TRUE(newer_pdb_info.Init(cv_info));
+  EXPECT_FALSE(index.Find(newer_pdb_info, &pdb_path));
+}
+
+TEST_F(PdbIndexTest, UpdateIsIncremental) {
+  TestPdbIndex index;
+  ASSERT_TRUE(index.Update(symbol_dir_));
+  ASSERT_EQ(1u, index.entries_.size());
+
+  // An unchanged file isn't read again, and keeps its entry.
+  index.entries_.begin()->second.pdb_age = 0xFFFFFFFF;
+  ASSERT_TRUE(index.Update(symbol_dir_));
+  ASSERT_EQ(1u, index.entries_.size());
+  EXPECT_EQ(0xFFFFFFFF, index.entries_.begin()->second.pdb_age);
+
+  // A removed file is forgotten.
+  ASSERT_TRUE(base::DeleteFile(pdb_path_, false));
+  ASSERT_TRUE(index.Update(symbol_dir_));
+  EXPECT_EQ(0u, index.entries_.size());
+}
+
+TEST_F(PdbIndexTest, FindSkipsRemovedFiles) {
+  PdbIndex index;
+  ASSERT_TRUE(index.Update(symbol_dir_));
+  ASSERT_TRUE(base::DeleteFile(pdb_path_, false));
+
+  base::FilePath pdb_path;
+  EXPECT_FALSE(index.Find(pdb_info_, &pdb_path));
+}
+
+TEST_F(PdbIndexTest, LoadFailsWithoutIndex) {
+  PdbIndex index;
+  EXPECT_FALSE(index.Load(index_path_));
+}
+
+TEST_F(PdbIndexTest, SaveAndLoad) {
+  PdbIndex index;
+  ASSERT_TRUE(index.Update(symbol_dir_));
+  ASSERT_TRUE(index.Save(index_path_));
+
+  PdbIndex loaded_index;
+  ASSERT_TRUE(loaded_index.Load(index_path_));
+  EXPECT_EQ(1u, loaded_index.size());
+  base::FilePath pdb_path;
+  ASSERT_TRUE(loaded_index.Find(pdb_info_, &pdb_path));
+  EXPECT_EQ(pdb_path_, pdb_path);
+}
+
+TEST_F(PdbIndexTest, LoadIgnoresStaleIndex) {
+  const uint32_t kStaleVersion = PdbIndex::kVersion + 1;
+  ASSERT_EQ(static_cast<int>(sizeof(kStaleVersion)),
+            base::WriteFile(index_path_,
+                            reinterpret_cast<const char*>(&kStaleVersion),
+                            sizeof(kStaleVersion)));
+
+  PdbIndex index;
+  EXPECT_FALSE(index.Load(index_path_));
+  EXPECT_EQ(0u, index.size());
+}
+
+}  // namespace pe
@@ -104,6 +104,8 @@
         'dia_util_internal.h',
         'decomposer.cc',
         'decomposer.h',
+        'decomposition_cache.cc',
+        'decomposition_cache.h',
         'find.cc',
         'find.h',
         'image_filter.cc',
@@ -118,6 +120,8 @@
         'hot_patching_writer.h',
         'metadata.cc',
         'metadata.h',
+        'pdb_index.cc',
+        'pdb_index.h',
         'pdb_info.cc',
         'pdb_info.h',
         'pe_coff_file.h',
@@ -145,6 +149,8 @@
         'pe_structs.h',
         'pe_transform_policy.cc',
         'pe_transform_policy.h',
+        'relink_profiler.cc',
+        'relink_profiler.h',
         'relinker.h',
         'serialization.cc',
         'serialization.h',
@@ -240,6 +246,7 @@
         'decompose_app_unittest.cc',
         'decompose_image_to_text_unittest.cc',
         'decomposer_unittest.cc',
+        'decomposition_cache_unittest.cc',
         'dia_browser_unittest.cc',
         'dia_util_unittest.cc',
         'find_unittest.cc',
@@ -249,6 +256,7 @@
         'hot_patching_decomposer_unittest.cc',
         'hot_patching_writer_unittest.cc',
         'metadata_unittest.cc',
+        'pdb_index_unittest.cc',
         'pdb_info_unittest.cc',
         'pe_coff_file_unittest.cc',
         'pe_coff_image_layout_builder_unittest.cc',
@@ -261,6 +269,7 @@
         'pe_relinker_unittest.cc',
         'pe_relinker_util_unittest.cc',
         'pe_transform_policy_unittest.cc',
+        'relink_profiler_unittest.cc',
         'serialization_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
@@ -91,33 +91,38 @@ bool PECoffImageLayoutBuilder::LayoutBlock(size_t alignment,
   DCHECK(block != NULL);
   DCHECK_NE(0u, section_start_.value());
 
-  // We don't need to apply inter-block padding to the first block.
-  if (padding_ > 0 && cursor_ > section_start_) {
-    // Apply the bigger padding.
-    cursor_ += std::max(block->padding_before(), padding_);
-  } else {
-    // Per-block padding needs to be applied to the first block as well.
-    cursor_ += block->padding_before();
-  }
+  AlignCursorForBlock(alignment, block);
 
-  // Keep the larger alignment.
-  if (block->type() == BlockGraph::CODE_BLOCK && alignment < code_alignment_)
-    alignment = code_alignment_;
+  // This advances the cursor for us.
+  if (!LayoutBlockImpl(block))
+    return false;
 
-  // Align at the proper offset.
-  {
-    cursor_ += block->alignment_offset();
-    cursor_ = cursor_.AlignUp(alignment);
-    cursor_ -= block->alignment_offset();
-  }
+  return true;
+}
 
-  // If we have explicit data, advance the explicit data cursor.
-  if (block->data_size() > 0)
-    section_auto_init_end_ = cursor_ + block->data_size();
+bool PECoffImageLayoutBuilder::LayoutBlocks(
+    const OrderedBlockGraph::BlockList& blocks) {
+  DCHECK_NE(0u, section_start_.value());
 
-  // This advances the cursor for us.
-  if (!LayoutBlockImpl(block))
+  // Compute the addresses of all of the blocks in a single sweep, then insert
+  // them in increasing address order, which appends each of them to the
+  // address space.
+  BlockGraph::AddressSpace::BlockAddressVector block_addresses;
+  block_addresses.reserve(blocks.size());
+  OrderedBlockGraph::BlockList::const_iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it) {
+    BlockGraph::Block* block = *it;
+    DCHECK(block != NULL);
+    AlignCursorForBlock(block->alignment(), block);
+    block_addresses.push_back(std::make_pair(cursor_, block));
+    cursor_ += block->size();
+  }
+
+  if (!image_layout_->blocks.InsertBlocks(block_addresses)) {
+    LOG(ERROR) << "InsertBlocks failed for section \""
+               << image_layout_->sections.back().name << "\".";
     return false;
+  }
 
   return true;
 }
@@ -167,6 +172,36 @@ bool PECoffImageLayoutBuilder::CloseSection() {
   return true;
 }
 
+void PECoffImageLayoutBuilder::AlignCursorForBlock(
+    size_t alignment, const BlockGraph::Block* block) {
+  DCHECK_LT(0u, alignment);
+  DCHECK(block != NULL);
+
+  // We don't need to apply inter-block padding to the first block.
+  if (padding_ > 0 && cursor_ > section_start_) {
+    // Apply the bigger padding.
+    cursor_ += std::max(block->padding_before(), padding_);
+  } else {
+    // Per-block padding needs to be applied to the first block as well.
+    cursor_ += block->padding_before();
+  }
+
+  // Keep the larger alignment.
+  if (block->type() == BlockGraph::CODE_BLOCK && alignment < code_alignment_)
+    alignment = code_alignment_;
+
+  // Align at the proper offset.
+  {
+    cursor_ += block->alignment_offset();
+    cursor_ = cursor_.AlignUp(alignment);
+    cursor_ -= block->alignment_offset();
+  }
+
+  // If we have explicit data, advance the explicit data cursor.
+  if (block->data_size() > 0)
+    section_auto_init_end_ = cursor_ + block->data_size();
+}
+
 // Lays out a block at the current cursor location.
 bool PECoffImageLayoutBuilder::LayoutBlockImpl(BlockGraph::Block* block) {
   DCHECK(block != NULL);
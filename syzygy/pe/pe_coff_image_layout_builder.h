@@ -111,6 +111,16 @@ class PECoffImageLayoutBuilder {
   // @see LayoutBlock(BlockGraph::Block*)
   bool LayoutBlock(size_t alignment, BlockGraph::Block* block);
 
+  // Lay out the provided blocks in order, as LayoutBlock would, each aligned
+  // according to its internal alignment. The addresses of the blocks are
+  // computed in a single sweep and then inserted into the address space in
+  // linear time.
+  //
+  // @param blocks the blocks to lay out.
+  // @returns true on success, false on failure.
+  // @see LayoutBlock(BlockGraph::Block*)
+  bool LayoutBlocks(const OrderedBlockGraph::BlockList& blocks);
+
   // Mark the end of the initialized data portion of the section that is
   // currently being laid out. If not explicitly called for a given section,
   // the span of initialized data will be automatically determined based on
@@ -138,6 +148,14 @@ class PECoffImageLayoutBuilder {
   // @returns true on success, false on failure.
   bool LayoutBlockImpl(BlockGraph::Block* block);
 
+  // Advance the cursor to the address at which a block is laid out, applying
+  // the inter-block padding and the alignment. This also updates the
+  // automatic estimate of the end of initialized data.
+  //
+  // @param alignment the alignment to use for @p block.
+  // @param block the block about to be laid out.
+  void AlignCursorForBlock(size_t alignment, const BlockGraph::Block* block);
+
   // Initialize the layout builder with the specified alignment constraints.
   // Section alignment should be equal or greater than raw data (file)
   // alignment.
@@ -20,6 +20,7 @@
 namespace pe {
 
 using block_graph::BlockGraph;
+using block_graph::OrderedBlockGraph;
 using core::RelativeAddress;
 
 namespace {
@@ -310,6 +311,73 @@ TEST_F(PECoffImageLayoutBuilderTest, PaddingAndBlockPadding) {
   EXPECT_EQ(kCharacteristics, sections[1].characteristics);
 }
 
+TEST_F(PECoffImageLayoutBuilderTest, LayoutBlocksMatchesLayoutBlock) {
+  ImageLayout layout1(&block_graph_);
+  TestImageLayoutBuilder builder1(&layout1, 1, 1);
+  ImageLayout layout2(&block_graph_);
+  TestImageLayoutBuilder builder2(&layout2, 1, 1);
+  builder1.set_padding(4);
+  builder2.set_padding(4);
+  builder1.set_code_alignment(8);
+  builder2.set_code_alignment(8);
+
+  // Create blocks of both types, with some alignments and paddings.
+  OrderedBlockGraph::BlockList blocks;
+  for (size_t i = 0; i < 10; ++i) {
+    BlockGraph::Block* block = block_graph_.AddBlock(
+        i % 2 ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK,
+        0x10 + i, "b" + std::to_string(i));
+    block->set_alignment(1 << (i % 4));
+    block->set_padding_before(i % 3);
+    if (i % 4 != 3)
+      block->AllocateData(0x10);
+    blocks.push_back(block);
+  }
+
+  const uint32_t kCharacteristics = IMAGE_SCN_CNT_CODE;
+  EXPECT_TRUE(builder1.OpenSection("foo", kCharacteristics));
+  for (BlockGraph::Block* block : blocks)
+    EXPECT_TRUE(builder1.LayoutBlock(block));
+  EXPECT_TRUE(builder1.CloseSection());
+
+  std::vector<RelativeAddress> addresses;
+  for (const BlockGraph::Block* block : blocks)
+    addresses.push_back(block->addr());
+
+  EXPECT_TRUE(builder2.OpenSection("foo", kCharacteristics));
+  EXPECT_TRUE(builder2.LayoutBlocks(blocks));
+  EXPECT_TRUE(builder2.CloseSection());
+
+  // The blocks are at the same addresses, in both address spaces.
+  size_t i = 0;
+  for (const BlockGraph::Block* block : blocks) {
+    RelativeAddress addr;
+    EXPECT_EQ(addresses[i], block->addr());
+    EXPECT_TRUE(layout2.blocks.GetAddressOf(block, &addr));
+    EXPECT_EQ(addresses[i], addr);
+    ++i;
+  }
+  EXPECT_EQ(layout1.sections[0].size, layout2.sections[0].size);
+  EXPECT_EQ(layout1.sections[0].data_size, layout2.sections[0].data_size);
+}
+
+TEST_F(PECoffImageLayoutBuilderTest, LayoutBlocksFailsOnConflict) {
+  ImageLayout layout(&block_graph_);
+  TestImageLayoutBuilder builder(&layout, 1, 1);
+
+  BlockGraph::Block* b1 = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                0x10, "b1");
+  BlockGraph::Block* b2 = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                0x10, "b2");
+  OrderedBlockGraph::BlockList blocks;
+  blocks.push_back(b1);
+
+  // Occupy the start of the section, where b1 would go.
+  EXPECT_TRUE(layout.blocks.InsertBlock(RelativeAddress(0x8), b2));
+  EXPECT_TRUE(builder.OpenSection("foo", IMAGE_SCN_CNT_CODE));
+  EXPECT_FALSE(builder.LayoutBlocks(blocks));
+}
+
 TEST_F(PECoffImageLayoutBuilderTest, Align) {
   ImageLayout layout(&block_graph_);
   TestImageLayoutBuilder builder(&layout, 1, 1);
@@ -78,9 +78,13 @@ bool PECoffRelinker::AppendOrderers(const std::vector<Orderer*>& orderers) {
 
 bool PECoffRelinker::ApplyUserTransforms() {
   LOG(INFO) << "Transforming block graph.";
-  if (!block_graph::ApplyBlockGraphTransforms(
-           transforms_, transform_policy_, &block_graph_, headers_block_)) {
-    return false;
+  for (BlockGraphTransform* transform : transforms_) {
+    RelinkProfiler::ScopedPhase phase(
+        &profiler_, std::string("transform:") + transform->name());
+    if (!ApplyBlockGraphTransform(transform, transform_policy_, &block_graph_,
+                                  headers_block_)) {
+      return false;
+    }
   }
   return true;
 }
@@ -89,15 +93,20 @@ bool PECoffRelinker::ApplyUserLayoutTransforms(
     pe::ImageLayout* image_layout,
     OrderedBlockGraph* ordered_graph) {
   LOG(INFO) << "Transforming layout.";
-  if (!block_graph::ApplyImageLayoutTransforms(
-      layout_transforms_, transform_policy_, image_layout, ordered_graph)) {
-    return false;
+  for (ImageLayoutTransform* transform : layout_transforms_) {
+    RelinkProfiler::ScopedPhase phase(
+        &profiler_, std::string("layout_transform:") + transform->name());
+    if (!block_graph::ApplyImageLayoutTransform(
+            transform, transform_policy_, image_layout, ordered_graph)) {
+      return false;
+    }
   }
   return true;
 }
 
 bool PECoffRelinker::ApplyUserOrderers(OrderedBlockGraph* ordered_graph) {
   LOG(INFO) << "Ordering block graph.";
+  RelinkProfiler::ScopedPhase phase(&profiler_, "order");
 
   if (orderers_.empty()) {
     // Default orderer.
@@ -118,4 +127,12 @@ bool PECoffRelinker::ApplyUserOrderers(OrderedBlockGraph* ordered_graph) {
   return true;
 }
 
+bool PECoffRelinker::WriteProfile() const {
+  if (profile_path_.empty())
+    return true;
+
+  LOG(INFO) << "Writing the relink profile: " << profile_path_.value();
+  return profiler_.WriteJson(profile_path_);
+}
+
 }  // namespace pe
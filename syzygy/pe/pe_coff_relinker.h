@@ -23,6 +23,7 @@
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/transform_policy.h"
 #include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/relink_profiler.h"
 #include "syzygy/pe/relinker.h"
 
 namespace pe {
@@ -71,6 +72,21 @@ class PECoffRelinker : public RelinkerInterface {
   // @returns whether output files may be overwritten.
   bool allow_overwrite() const { return allow_overwrite_; }
 
+  // Change the path of the profile of the relink. By default, it is empty and
+  // no profile is written. Otherwise, the cost of each phase of the relink,
+  // including each transform, is written to it as JSON on success.
+  //
+  // @param profile_path the new profile path.
+  void set_profile_path(const base::FilePath& profile_path) {
+    profile_path_ = profile_path;
+  }
+
+  // @returns the path of the profile of the relink.
+  const base::FilePath& profile_path() const { return profile_path_; }
+
+  // @returns the profile of the relink so far.
+  const RelinkProfiler& profiler() const { return profiler_; }
+
   // @see RelinkerInterface::AppendTransform()
   virtual bool AppendTransform(BlockGraphTransform* transform) override;
 
@@ -143,6 +159,10 @@ class PECoffRelinker : public RelinkerInterface {
   bool ApplyUserLayoutTransforms(pe::ImageLayout* image_layout,
                                  OrderedBlockGraph* ordered_graph);
 
+  // Writes the profile of the relink, if a profile path was provided.
+  // @returns true on success, or false on failure.
+  bool WriteProfile() const;
+
   // The policy that dictates how to apply transforms.
   const TransformPolicyInterface* transform_policy_;
 
@@ -155,6 +175,12 @@ class PECoffRelinker : public RelinkerInterface {
   // Whether we may overwrite output files.
   bool allow_overwrite_;
 
+  // The path of the profile of the relink, empty if none is to be written.
+  base::FilePath profile_path_;
+
+  // Records the cost of the phases of the relink.
+  RelinkProfiler profiler_;
+
   // Transforms to be applied, in order.
   std::vector<BlockGraphTransform*> transforms_;
 
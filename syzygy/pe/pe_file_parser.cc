@@ -345,6 +345,11 @@ const PEFileParser::DataDirParseEntry PEFileParser::parsers_[] = {
 };
 
 bool PEFileParser::ParseImage(PEHeader* pe_header) {
+  return ParseImageHeaderAndDataDirs(~0U, pe_header);
+}
+
+bool PEFileParser::ParseImageHeaderAndDataDirs(uint32_t data_dir_mask,
+                                               PEHeader* pe_header) {
   if (!ParseImageHeader(pe_header)) {
     LOG(ERROR) << "Unable to parse image header.";
     return false;
@@ -352,41 +357,72 @@ bool PEFileParser::ParseImage(PEHeader* pe_header) {
 
   for (size_t i = 0; i < arraysize(parsers_); ++i) {
     const DataDirParseEntry& parser = parsers_[i];
-    DCHECK(parser.entry < IMAGE_NUMBEROF_DIRECTORY_ENTRIES);
-    DCHECK(parser.parser != NULL);
-    DCHECK(parser.name != NULL);
-
-    const IMAGE_DATA_DIRECTORY& entry =
-        image_file_.nt_headers()->OptionalHeader.DataDirectory[parser.entry];
-
-    if (entry.Size != 0) {
-      DCHECK(entry.VirtualAddress != 0);
-
-      // TODO(chrisha): Once ImageLayout/AddressSpace/etc. can support blocks
-      // that are not mappable, then support this properly. In the meantime
-      // simply ignore the security directory entry entirely and null it out so
-      // that the toolchain doesn't produce binaries with bad signatures.
-      if (parser.entry == IMAGE_DIRECTORY_ENTRY_SECURITY) {
-        LOG(WARNING) << "Ignoring security directory (image signature)!";
-        uint8_t* data = pe_header->nt_headers->GetMutableData();
-        DCHECK_NE(static_cast<uint8_t*>(nullptr), data);
-        IMAGE_NT_HEADERS* nt_headers =
-            reinterpret_cast<IMAGE_NT_HEADERS*>(data);
-        auto& data_dir = nt_headers->OptionalHeader.DataDirectory[parser.entry];
-        data_dir.Size = 0;
-        data_dir.VirtualAddress = 0;
-      } else {
-        BlockGraph::Block* block = (this->*parser.parser)(entry);
-        if (block == nullptr) {
-          LOG(ERROR) << "Failed to parse data directory " << parser.name << ".";
-          return false;
-        }
+    if ((data_dir_mask & (1U << parser.entry)) == 0)
+      continue;
+    if (!ParseDataDirEntry(parser, pe_header))
+      return false;
+  }
 
-        pe_header->data_directory[parser.entry] = block;
-      }
-    }
+  return true;
+}
+
+bool PEFileParser::ParseDataDir(int entry, PEHeader* pe_header) {
+  DCHECK(pe_header != NULL);
+  DCHECK(pe_header->nt_headers != NULL);
+
+  // The IAT is chunked ahead of the imports, as in a full parse, so that the
+  // imports reference it.
+  if (entry == IMAGE_DIRECTORY_ENTRY_IMPORT &&
+      !ParseDataDir(IMAGE_DIRECTORY_ENTRY_IAT, pe_header)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < arraysize(parsers_); ++i) {
+    if (parsers_[i].entry == entry)
+      return ParseDataDirEntry(parsers_[i], pe_header);
+  }
+
+  LOG(ERROR) << "No parser for data directory " << entry << ".";
+  return false;
+}
+
+bool PEFileParser::ParseDataDirEntry(const DataDirParseEntry& parser,
+                                     PEHeader* pe_header) {
+  DCHECK(parser.entry < IMAGE_NUMBEROF_DIRECTORY_ENTRIES);
+  DCHECK(parser.parser != NULL);
+  DCHECK(parser.name != NULL);
+
+  if (pe_header->data_directory[parser.entry] != NULL)
+    return true;
+
+  const IMAGE_DATA_DIRECTORY& entry =
+      image_file_.nt_headers()->OptionalHeader.DataDirectory[parser.entry];
+  if (entry.Size == 0)
+    return true;
+  DCHECK(entry.VirtualAddress != 0);
+
+  // TODO(chrisha): Once ImageLayout/AddressSpace/etc. can support blocks
+  // that are not mappable, then support this properly. In the meantime
+  // simply ignore the security directory entry entirely and null it out so
+  // that the toolchain doesn't produce binaries with bad signatures.
+  if (parser.entry == IMAGE_DIRECTORY_ENTRY_SECURITY) {
+    LOG(WARNING) << "Ignoring security directory (image signature)!";
+    uint8_t* data = pe_header->nt_headers->GetMutableData();
+    DCHECK_NE(static_cast<uint8_t*>(nullptr), data);
+    IMAGE_NT_HEADERS* nt_headers = reinterpret_cast<IMAGE_NT_HEADERS*>(data);
+    auto& data_dir = nt_headers->OptionalHeader.DataDirectory[parser.entry];
+    data_dir.Size = 0;
+    data_dir.VirtualAddress = 0;
+    return true;
+  }
+
+  BlockGraph::Block* block = (this->*parser.parser)(entry);
+  if (block == nullptr) {
+    LOG(ERROR) << "Failed to parse data directory " << parser.name << ".";
+    return false;
   }
 
+  pe_header->data_directory[parser.entry] = block;
   return true;
 }
 
@@ -79,6 +79,29 @@ class PEFileParser {
   // invokes the AddReferenceCallback for all references encountered.
   bool ParseImage(PEHeader* pe_header);
 
+  // Parses the image header and a subset of the data directories of the
+  // image, which is cheaper than parsing the whole image for callers that
+  // only look at a few PE structures.
+  // @param data_dir_mask a mask of the data directories to parse, with the
+  //     bit (1 << IMAGE_DIRECTORY_ENTRY_*) set for each of them.
+  // @param pe_header receives the blocks of the parsed structures. The
+  //     blocks of the data directories that weren't parsed are NULL.
+  // @returns true on success, false otherwise.
+  bool ParseImageHeaderAndDataDirs(uint32_t data_dir_mask,
+                                   PEHeader* pe_header);
+
+  // Parses a data directory on demand, after the image header. This lets
+  // callers parse the header alone, with a @p data_dir_mask of zero, and
+  // then only the directories they turn out to need. A directory that is
+  // already parsed isn't parsed again, and the IAT is parsed ahead of the
+  // imports that refer to it.
+  // @param entry the IMAGE_DIRECTORY_ENTRY_* of the data directory.
+  // @param pe_header the blocks of the structures parsed so far, which
+  //     receives the block of the data directory.
+  // @returns true on success, including for an empty data directory, false
+  //     otherwise.
+  bool ParseDataDir(int entry, PEHeader* pe_header);
+
   // Tables of thunks come in various flavours.
   enum ThunkTableType {
     // For parsing of normal imports.
@@ -229,6 +252,13 @@ class PEFileParser {
     ParseDirFunction parser;
   };
 
+  // Parses the data directory of @p parser, unless it is already parsed.
+  // @param parser the parser entry of the data directory.
+  // @param pe_header receives the block of the data directory.
+  // @returns true on success, false otherwise.
+  bool ParseDataDirEntry(const DataDirParseEntry& parser,
+                         PEHeader* pe_header);
+
   // Array of data directory parser entries used to parse the
   // sundry data directory entries.
   static const DataDirParseEntry parsers_[];
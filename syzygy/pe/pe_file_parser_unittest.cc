@@ -504,6 +504,60 @@ TEST_F(PEFileParserTest, ParseImage) {
       header.data_directory[IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT]));
 }
 
+TEST_F(PEFileParserTest, ParseImageHeaderAndDataDirs) {
+  TestPEFileParser parser(image_file_, &address_space_, add_reference_);
+
+  PEFileParser::PEHeader header;
+  EXPECT_TRUE(parser.ParseImageHeaderAndDataDirs(
+      (1U << IMAGE_DIRECTORY_ENTRY_EXPORT) |
+          (1U << IMAGE_DIRECTORY_ENTRY_DEBUG),
+      &header));
+
+  ASSERT_TRUE(header.dos_header != NULL);
+  ASSERT_TRUE(header.nt_headers != NULL);
+
+  // Only the requested data directories are parsed.
+  EXPECT_NO_FATAL_FAILURE(AssertDataDirectoryEntryValid(
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_EXPORT]));
+  EXPECT_NO_FATAL_FAILURE(AssertDataDirectoryEntryValid(
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_DEBUG]));
+  EXPECT_TRUE(header.data_directory[IMAGE_DIRECTORY_ENTRY_IMPORT] == NULL);
+  EXPECT_TRUE(header.data_directory[IMAGE_DIRECTORY_ENTRY_RESOURCE] == NULL);
+  EXPECT_TRUE(
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_BASERELOC] == NULL);
+  EXPECT_TRUE(
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG] == NULL);
+}
+
+TEST_F(PEFileParserTest, ParseDataDirOnDemand) {
+  TestPEFileParser parser(image_file_, &address_space_, add_reference_);
+
+  PEFileParser::PEHeader header;
+  EXPECT_TRUE(parser.ParseImageHeaderAndDataDirs(0, &header));
+  ASSERT_TRUE(header.nt_headers != NULL);
+  for (size_t i = 0; i < IMAGE_NUMBEROF_DIRECTORY_ENTRIES; ++i)
+    EXPECT_TRUE(header.data_directory[i] == NULL);
+
+  EXPECT_TRUE(parser.ParseDataDir(IMAGE_DIRECTORY_ENTRY_DEBUG, &header));
+  BlockGraph::Block* debug_block =
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_DEBUG];
+  EXPECT_NO_FATAL_FAILURE(AssertDataDirectoryEntryValid(debug_block));
+
+  // A parsed directory isn't parsed again.
+  size_t num_blocks = address_space_.size();
+  EXPECT_TRUE(parser.ParseDataDir(IMAGE_DIRECTORY_ENTRY_DEBUG, &header));
+  EXPECT_EQ(debug_block, header.data_directory[IMAGE_DIRECTORY_ENTRY_DEBUG]);
+  EXPECT_EQ(num_blocks, address_space_.size());
+
+  // The imports come with the IAT.
+  EXPECT_TRUE(parser.ParseDataDir(IMAGE_DIRECTORY_ENTRY_IMPORT, &header));
+  EXPECT_NO_FATAL_FAILURE(AssertDataDirectoryEntryValid(
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_IMPORT]));
+  EXPECT_NO_FATAL_FAILURE(AssertDataDirectoryEntryValid(
+      header.data_directory[IMAGE_DIRECTORY_ENTRY_IAT]));
+  EXPECT_TRUE(header.data_directory[IMAGE_DIRECTORY_ENTRY_EXPORT] == NULL);
+}
+
 TEST_F(PEFileParserTest, ParseEmptyDebugDir) {
   base::FilePath dll_path = testing::GetSrcRelativePath(kTestDllILTCG);
   pe::PEFile image_file;
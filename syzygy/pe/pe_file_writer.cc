@@ -20,6 +20,8 @@
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/common/com_utils.h"
@@ -37,8 +39,11 @@ using pe::ImageLayout;
 namespace {
 
 template <class Type>
-bool UpdateReference(size_t start, Type new_value, std::vector<uint8_t>* data) {
-  BinaryBufferParser parser(&data->at(0), data->size());
+bool UpdateReference(size_t start,
+                     Type new_value,
+                     uint8_t* data,
+                     size_t data_size) {
+  BinaryBufferParser parser(data, data_size);
 
   Type* ref_ptr = NULL;
   if (!parser.GetAtIgnoreAlignment(start,
@@ -107,20 +112,84 @@ size_t GetSectionOffset(const ImageLayout& image_layout,
   return rel_addr - section_info.addr;
 }
 
+// Updates the checksum of a mapped image.
+// @param image The mapped image.
+// @param image_size The size of the mapped image.
+// @returns true on success, false otherwise.
+bool UpdateMappedImageChecksum(void* image, size_t image_size) {
+  DCHECK_NE(static_cast<void*>(nullptr), image);
+
+  // Calculate the image checksum.
+  DWORD original_checksum = 0;
+  DWORD new_checksum = 0;
+  IMAGE_NT_HEADERS* nt_headers =
+      ::CheckSumMappedFile(image, static_cast<DWORD>(image_size),
+                           &original_checksum, &new_checksum);
+
+  if (nt_headers == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CheckSumMappedFile failed: " << common::LogWe(error);
+    return false;
+  }
+
+  // On success, we write the checksum back to the file header.
+  nt_headers->OptionalHeader.CheckSum = new_checksum;
+  return true;
+}
+
 }  // namespace
 
+// Writes the blocks of a section of the image, on a worker thread.
+class PEFileWriter::WriteSectionTask
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param writer The writer owning this task.
+  // @param image_base The base address of the image.
+  // @param section_index The index of the section to write.
+  // @param image The mapped image being written.
+  WriteSectionTask(PEFileWriter* writer,
+                   AbsoluteAddress image_base,
+                   size_t section_index,
+                   uint8_t* image)
+      : writer_(writer),
+        image_base_(image_base),
+        section_index_(section_index),
+        image_(image),
+        result_(false) {
+    DCHECK_NE(static_cast<PEFileWriter*>(nullptr), writer);
+    DCHECK_NE(static_cast<uint8_t*>(nullptr), image);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    result_ = writer_->WriteSection(image_base_, section_index_, blocks_,
+                                    image_);
+  }
+  // @}
+
+  // @returns the blocks of the section, in address order.
+  std::vector<const BlockGraph::Block*>& blocks() { return blocks_; }
+
+  // @returns true if the section was successfully written.
+  bool result() const { return result_; }
+
+ private:
+  PEFileWriter* writer_;
+  AbsoluteAddress image_base_;
+  size_t section_index_;
+  uint8_t* image_;
+  std::vector<const BlockGraph::Block*> blocks_;
+  bool result_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteSectionTask);
+};
+
 PEFileWriter::PEFileWriter(const ImageLayout& image_layout)
-    : image_layout_(image_layout), nt_headers_(NULL) {
+    : image_layout_(image_layout), nt_headers_(NULL), num_threads_(1) {
 }
 
 bool PEFileWriter::WriteImage(const base::FilePath& path) {
-  // Start by attempting to open the destination file.
-  base::ScopedFILE file(base::OpenFile(path, "wb"));
-  if (file.get() == NULL) {
-    LOG(ERROR) << "Unable to open " << path.value();
-    return false;
-  }
-
   if (!ValidateHeaders())
     return false;
 
@@ -128,16 +197,10 @@ bool PEFileWriter::WriteImage(const base::FilePath& path) {
 
   bool success = CalculateSectionRanges();
   if (success)
-    success = WriteBlocks(file.get());
+    success = WriteMappedImage(path);
 
   nt_headers_ = NULL;
 
-  // Close the file.
-  file.reset();
-
-  if (success)
-    success = UpdateFileChecksum(path);
-
   return success;
 }
 
@@ -177,26 +240,10 @@ bool PEFileWriter::UpdateFileChecksum(const base::FilePath& path) {
     return false;
   }
 
-  // Calculate the image checksum.
-  DWORD original_checksum = 0;
-  DWORD new_checksum = 0;
-  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(image_ptr,
-                                                      file_size,
-                                                      &original_checksum,
-                                                      &new_checksum);
-
-  if (nt_headers == NULL) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "CheckSumMappedFile failed: " << common::LogWe(error);
-  }
-
-  // On success, we write the checksum back to the file header.
-  if (nt_headers != NULL) {
-    nt_headers->OptionalHeader.CheckSum = new_checksum;
-  }
+  bool success = UpdateMappedImageChecksum(image_ptr, file_size);
   CHECK(::UnmapViewOfFile(image_ptr));
 
-  return nt_headers != NULL;
+  return success;
 }
 
 bool PEFileWriter::ValidateHeaders() {
@@ -325,89 +372,140 @@ bool PEFileWriter::CalculateSectionRanges() {
   return true;
 }
 
-bool PEFileWriter::WriteBlocks(FILE* file) {
-  DCHECK(file != NULL);
-
-  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
-
-  // Create the output buffer, reserving enough room for the whole file.
+bool PEFileWriter::WriteMappedImage(const base::FilePath& path) {
   DCHECK(!image_layout_.sections.empty());
   size_t last_section_index = image_layout_.sections.size() - 1;
-  size_t image_size = section_file_range_map_[last_section_index].end().value();
-  std::vector<uint8_t> buffer;
-  buffer.reserve(image_size);
+  size_t image_size =
+      GetSectionFileRange(last_section_index).end().value();
+
+  base::win::ScopedHandle file(
+      ::CreateFile(path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                   NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Unable to open " << path.value();
+    return false;
+  }
+
+  // Mapping the file with the size of the image preallocates it.
+  base::win::ScopedHandle mapping(
+      ::CreateFileMapping(file.Get(), NULL, PAGE_READWRITE, 0,
+                          static_cast<DWORD>(image_size), NULL));
+  if (!mapping.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create image mapping: " << common::LogWe(error);
+    return false;
+  }
+
+  uint8_t* image = static_cast<uint8_t*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, image_size));
+  if (image == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map image: " << common::LogWe(error);
+    return false;
+  }
+
+  bool success = WriteBlocks(image);
+  if (success)
+    success = UpdateMappedImageChecksum(image, image_size);
+  CHECK(::UnmapViewOfFile(image));
+
+  return success;
+}
+
+bool PEFileWriter::WriteBlocks(uint8_t* image) {
+  DCHECK(image != NULL);
+
+  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
 
-  // Iterate through all blocks in the address space writing them as we go.
+  // Create a task per section, the first one being for the headers. Every
+  // task writes a disjoint range of the image.
+  ScopedVector<WriteSectionTask> tasks;
+  tasks.push_back(new WriteSectionTask(this, image_base,
+                                       BlockGraph::kInvalidSectionId, image));
+  for (size_t i = 0; i < image_layout_.sections.size(); ++i)
+    tasks.push_back(new WriteSectionTask(this, image_base, i, image));
+
+  // Distribute the blocks to their section. Note that the section index is not
+  // the same thing as the section_id stored in the block; the section IDs are
+  // relative to the section data stored in the block-graph, not the ordered
+  // section infos stored in the image layout.
   BlockGraph::AddressSpace::RangeMap::const_iterator block_it(
       image_layout_.blocks.address_space_impl().ranges().begin());
   BlockGraph::AddressSpace::RangeMap::const_iterator block_end(
       image_layout_.blocks.address_space_impl().ranges().end());
-
-  // Write all of the blocks. We take care of writing the padding at the
-  // end of each section. Note that the section index is not the same thing as
-  // the section_id stored in the block; the section IDs are relative to the
-  // section data stored in the block-graph, not the ordered section infos
-  // stored in the image layout.
   BlockGraph::SectionId section_id = BlockGraph::kInvalidSectionId;
-  size_t section_index = BlockGraph::kInvalidSectionId;
+  size_t task_index = 0;
   for (; block_it != block_end; ++block_it) {
-    BlockGraph::Block* block = const_cast<BlockGraph::Block*>(block_it->second);
-
-    // If we're jumping to a new section output the necessary padding.
+    const BlockGraph::Block* block = block_it->second;
     if (block->section() != section_id) {
-      FlushSection(section_index, &buffer);
       section_id = block->section();
-      section_index++;
-      DCHECK_GT(image_layout_.sections.size(), section_index);
-    }
-
-    if (!WriteOneBlock(image_base, section_index, block, &buffer)) {
-      LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
-      return false;
+      task_index++;
+      DCHECK_GT(tasks.size(), task_index);
     }
+    tasks[task_index]->blocks().push_back(block);
   }
 
-  FlushSection(last_section_index, &buffer);
-  DCHECK_EQ(image_size, buffer.size());
+  if (num_threads_ <= 1) {
+    for (WriteSectionTask* task : tasks)
+      task->Run();
+  } else {
+    base::DelegateSimpleThreadPool pool(
+        "PEFileWriter", static_cast<int>(std::min(num_threads_, tasks.size())));
+    pool.Start();
+    for (WriteSectionTask* task : tasks)
+      pool.AddWork(task);
+    pool.JoinAll();
+  }
 
-  // Write the whole image to disk in one go.
-  if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file) !=
-          buffer.size()) {
-    LOG(ERROR) << "Failed to write image to file.";
-    return false;
+  for (WriteSectionTask* task : tasks) {
+    if (!task->result())
+      return false;
   }
 
   return true;
 }
 
-void PEFileWriter::FlushSection(size_t section_index,
-                                std::vector<uint8_t>* buffer) {
-  DCHECK(buffer != NULL);
-
-  size_t section_file_end =
-      section_file_range_map_[section_index].end().value();
-
-  // We've already sanity checked this in CalculateSectionFileRanges, so this
-  // should be true.
-  DCHECK_GE(section_file_end, buffer->size());
-  if (section_file_end == buffer->size())
-    return;
+bool PEFileWriter::WriteSection(
+    AbsoluteAddress image_base,
+    size_t section_index,
+    const std::vector<const BlockGraph::Block*>& blocks,
+    uint8_t* image) {
+  DCHECK(image != NULL);
+
+  // Start with the padding of the whole section, the blocks are then written
+  // over it.
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
+  ::memset(image + section_file_range.start().value(),
+           GetSectionPaddingByte(image_layout_, section_index),
+           section_file_range.size());
+
+  for (const BlockGraph::Block* block : blocks) {
+    if (!WriteOneBlock(image_base, section_index, block, image)) {
+      LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
+      return false;
+    }
+  }
 
-  uint8_t padding_byte = GetSectionPaddingByte(image_layout_, section_index);
-  buffer->resize(section_file_end, padding_byte);
+  return true;
+}
 
-  return;
+const PEFileWriter::FileRange& PEFileWriter::GetSectionFileRange(
+    size_t section_index) const {
+  SectionIndexFileRangeMap::const_iterator it =
+      section_file_range_map_.find(section_index);
+  DCHECK(it != section_file_range_map_.end());
+  return it->second;
 }
 
 bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
                                  size_t section_index,
                                  const BlockGraph::Block* block,
-                                 std::vector<uint8_t>* buffer) {
+                                 uint8_t* image) {
   // This function walks through the data referred by the input block, and
   // patches it to reflect the addresses and offsets of the blocks
-  // referenced before writing the block's data to the file.
+  // referenced before writing the block's data to the image.
   DCHECK(block != NULL);
-  DCHECK(buffer != NULL);
+  DCHECK(image != NULL);
 
   RelativeAddress addr;
   if (!image_layout_.blocks.GetAddressOf(block, &addr)) {
@@ -419,7 +517,6 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   // padding byte we need to use.
   RelativeAddress section_start(0);
   RelativeAddress section_end(image_layout_.sections[0].addr);
-  uint8_t padding_byte = GetSectionPaddingByte(image_layout_, section_index);
   if (section_index != BlockGraph::kInvalidSectionId) {
     const ImageLayout::SectionInfo& section_info =
         image_layout_.sections[section_index];
@@ -427,7 +524,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     section_end = section_start + section_info.size;
   }
 
-  const FileRange& section_file_range = section_file_range_map_[section_index];
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
 
   // The block should lie entirely within the section.
   if (addr < section_start || addr + block->size() > section_end) {
@@ -440,11 +537,6 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   BlockGraph::Offset section_offs = addr - section_start;
   FileOffsetAddress file_offs = section_file_range.start() + section_offs;
 
-  // We shouldn't have written anything to the spot where the block belongs.
-  // This is only a DCHECK because the address space of the image layout and
-  // the consistency of the sections guarantees this for us.
-  DCHECK_LE(buffer->size(), file_offs.value());
-
   size_t inited_data_size = GetBlockInitializedDataSize(block);
 
   // If this block is entirely in the virtual portion of the section, skip it.
@@ -466,14 +558,11 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Add any necessary padding to get us to the block offset.
-  if (buffer->size() < file_offs.value())
-    buffer->resize(file_offs.value(), padding_byte);
-
-  // Copy the block data into the buffer.
-  buffer->insert(buffer->end(),
-                 block->data(),
-                 block->data() + block->data_size());
+  // Copy the block data into the image. The padding before the block has
+  // already been written by WriteSection.
+  uint8_t* block_data = image + file_offs.value();
+  if (block->data_size() != 0)
+    ::memcpy(block_data, block->data(), block->data_size());
 
   // We now want to append zeros for the implicit portion of the block data.
   size_t trailing_zeros = block->size() - block->data_size();
@@ -492,8 +581,9 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     }
 
     // Write the implicit trailing zeros.
-    buffer->insert(buffer->end(), trailing_zeros, 0);
+    ::memset(block_data + block->data_size(), 0, trailing_zeros);
   }
+  size_t written_size = block->data_size() + trailing_zeros;
 
   // Patch up all the references.
   BlockGraph::Block::ReferenceMap::const_iterator ref_it(
@@ -539,8 +629,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
         // Get the offset of the block in its section, as well as the range of
         // the section on disk. Validate that the referred location is
         // actually directly represented on disk (not in implicit virtual data).
-        const FileRange& file_range =
-            section_file_range_map_[dst_section_index];
+        const FileRange& file_range = GetSectionFileRange(dst_section_index);
         size_t section_offset = GetSectionOffset(image_layout_,
                                                  dst_addr,
                                                  dst_section_index);
@@ -561,21 +650,26 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     }
 
     // Now store the new value.
-    BlockGraph::Offset ref_offset = file_offs.value() + start;
     switch (ref.size()) {
       case sizeof(uint8_t):
-        if (!UpdateReference(ref_offset, static_cast<uint8_t>(value), buffer))
+        if (!UpdateReference(start, static_cast<uint8_t>(value),
+                             block_data, written_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint16_t):
-        if (!UpdateReference(ref_offset, static_cast<uint16_t>(value), buffer))
+        if (!UpdateReference(start, static_cast<uint16_t>(value),
+                             block_data, written_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint32_t):
-        if (!UpdateReference(ref_offset, static_cast<uint32_t>(value), buffer))
+        if (!UpdateReference(start, static_cast<uint32_t>(value),
+                             block_data, written_size)) {
           return false;
+        }
         break;
 
       default:
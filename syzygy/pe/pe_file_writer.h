@@ -15,6 +15,8 @@
 #ifndef SYZYGY_PE_PE_FILE_WRITER_H_
 #define SYZYGY_PE_PE_FILE_WRITER_H_
 
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address_space.h"
@@ -36,9 +38,19 @@ class PEFileWriter {
   // @param image_layout the image layout to write.
   explicit PEFileWriter(const ImageLayout& image_layout);
 
-  // Writes the image to path.
+  // Writes the image to path. The file is preallocated and mapped, and the
+  // sections of the image are written to it directly.
   bool WriteImage(const base::FilePath& path);
 
+  // @name Accessors.
+  // @{
+  // The number of threads used to write the sections of the image. The
+  // sections are written on the calling thread if this is at most 1, which is
+  // the default.
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) { num_threads_ = num_threads; }
+  // @}
+
   // Updates the checksum for the image @p path.
   static bool UpdateFileChecksum(const base::FilePath& path);
 
@@ -51,21 +63,29 @@ class PEFileWriter {
   // section_file_range_map_ and section_index_space_.
   bool CalculateSectionRanges();
 
-  // Writes the entire image to the given file. Delegates to FlushSection and
-  // WriteOneBlock.
-  bool WriteBlocks(FILE* file);
-
-  // Closes off the writing of a section by adding any necessary padding to the
-  // output buffer.
-  void FlushSection(size_t section_index, std::vector<uint8_t>* buffer);
-
-  // Writes a single block to the buffer, first writing any necessary padding
-  // (the content of which depends on the section type), followed by the
-  // block data (containing finalized references).
+  // Creates, preallocates and maps the file at @p path, writes the image to it
+  // and updates its checksum. Delegates to WriteBlocks.
+  bool WriteMappedImage(const base::FilePath& path);
+
+  // Writes the entire image to the mapped file @p image. The sections are
+  // written concurrently, each by a WriteSectionTask delegating to
+  // WriteSection.
+  bool WriteBlocks(uint8_t* image);
+
+  // Writes a section of the image: its padding (the content of which depends
+  // on the section type), overwritten by the data of its blocks. This only
+  // writes to the file range of the section.
+  bool WriteSection(AbsoluteAddress image_base,
+                    size_t section_index,
+                    const std::vector<const BlockGraph::Block*>& blocks,
+                    uint8_t* image);
+
+  // Writes a single block to the image: the block data, followed by its
+  // implicit trailing zeros, and its finalized references.
   bool WriteOneBlock(AbsoluteAddress image_base,
                      size_t section_index,
                      const BlockGraph::Block* block,
-                     std::vector<uint8_t>* buffer);
+                     uint8_t* image);
 
   // The file ranges of each section. This is populated by
   // CalculateSectionRanges and is a map from section index (as ordered in
@@ -74,6 +94,10 @@ class PEFileWriter {
   typedef std::map<size_t, FileRange> SectionIndexFileRangeMap;
   SectionIndexFileRangeMap section_file_range_map_;
 
+  // @returns the file range of the section with index @p section_index. This
+  //     is safe to call concurrently, unlike the operator[] of the map.
+  const FileRange& GetSectionFileRange(size_t section_index) const;
+
   // This stores an address-space from RVAs to section indices and is populated
   // by CalculateSectionRanges. This can be used to map from a block's
   // address to the index of its section. This is needed for finalizing
@@ -88,7 +112,12 @@ class PEFileWriter {
   // Refers to the nt headers from the image during WriteImage.
   const IMAGE_NT_HEADERS* nt_headers_;
 
+  // The number of threads used to write the sections.
+  size_t num_threads_;
+
  private:
+  class WriteSectionTask;
+
   DISALLOW_COPY_AND_ASSIGN(PEFileWriter);
 };
 
@@ -14,13 +14,17 @@
 
 #include "syzygy/pe/pe_relinker.h"
 
+#include <memory>
+
 #include "base/files/file_util.h"
+#include "syzygy/block_graph/mapped_block_graph.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pdb/pdb_writer.h"
 #include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/decomposition_cache.h"
 #include "syzygy/pe/metadata.h"
 #include "syzygy/pe/pdb_info.h"
 #include "syzygy/pe/pe_file_writer.h"
@@ -46,25 +50,43 @@ using pdb::PdbMutatorInterface;
 using pdb::PdbStream;
 using pdb::WritablePdbStream;
 
-// Decomposes the module enclosed by the given PE file.
+// Decomposes the module enclosed by the given PE file. If @p cache_dir is
+// not empty the decomposition is looked up in, or added to, the cache.
 bool Decompose(const PEFile& pe_file,
                const base::FilePath& pdb_path,
+               const base::FilePath& cache_dir,
                ImageLayout* image_layout,
                BlockGraph::Block** dos_header_block) {
   DCHECK(image_layout != NULL);
   DCHECK(dos_header_block != NULL);
 
-  LOG(INFO) << "Decomposing module: " << pe_file.path().value();
-
   BlockGraph* block_graph = image_layout->blocks.graph();
   ImageLayout orig_image_layout(block_graph);
 
-  // Decompose the input image.
-  Decomposer decomposer(pe_file);
-  decomposer.set_pdb_path(pdb_path);
-  if (!decomposer.Decompose(&orig_image_layout)) {
-    LOG(ERROR) << "Unable to decompose module: " << pe_file.path().value();
-    return false;
+  std::unique_ptr<DecompositionCache> cache(
+      DecompositionCache::Create(cache_dir));
+
+  if (cache.get() == NULL || !cache->Load(pe_file, &orig_image_layout)) {
+    // A corrupt cache entry may have been partially loaded.
+    if (!block_graph->blocks().empty()) {
+      LOG(ERROR) << "Unable to load module from the decomposition cache: "
+                 << pe_file.path().value();
+      return false;
+    }
+
+    LOG(INFO) << "Decomposing module: " << pe_file.path().value();
+
+    // Decompose the input image.
+    Decomposer decomposer(pe_file);
+    decomposer.set_pdb_path(pdb_path);
+    if (!decomposer.Decompose(&orig_image_layout)) {
+      LOG(ERROR) << "Unable to decompose module: " << pe_file.path().value();
+      return false;
+    }
+
+    // Failing to update the cache only costs the next run a decomposition.
+    if (cache.get() != NULL && !cache->Save(pe_file, orig_image_layout))
+      LOG(WARNING) << "Unable to update the decomposition cache.";
   }
 
   // Make a copy of the image layout without padding. We don't want to carry
@@ -88,6 +110,40 @@ bool Decompose(const PEFile& pe_file,
 }
 
 // Writes the image.
+// Diffs @p block_graph against the block-graph saved at @p base_path, which
+// is replaced by @p block_graph for the next relink. If there is no valid
+// block-graph at @p base_path, every block of @p block_graph is changed.
+bool UpdateIncrementalBase(const base::FilePath& base_path,
+                           const BlockGraph& block_graph,
+                           block_graph::BlockGraphDiff* diff) {
+  DCHECK(diff != NULL);
+
+  {
+    // The mapping of the base block-graph must be released before the file
+    // is replaced.
+    block_graph::MappedBlockGraph mapped_base;
+    BlockGraph base;
+    if (base::PathExists(base_path) && !mapped_base.Load(base_path, &base)) {
+      LOG(WARNING) << "Ignoring invalid incremental base: "
+                   << base_path.value();
+    }
+    diff->Compute(base, block_graph);
+  }
+
+  LOG(INFO) << "Incremental diff: " << diff->unchanged_blocks().size()
+            << " unchanged, " << diff->changed_blocks().size()
+            << " changed and " << diff->removed_blocks().size()
+            << " removed blocks.";
+
+  if (!block_graph::MappedBlockGraph::Save(block_graph, 0, base_path)) {
+    LOG(ERROR) << "Unable to save the incremental base: "
+               << base_path.value();
+    return false;
+  }
+
+  return true;
+}
+
 bool WriteImage(const ImageLayout& image_layout,
                 const base::FilePath& output_path) {
   PEFileWriter writer(image_layout);
@@ -153,9 +209,21 @@ bool PERelinker::Init() {
   }
 
   // Decompose the image.
-  if (!Decompose(input_pe_file_, input_pdb_path_, &input_image_layout_,
-                 &headers_block_)) {
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "decompose");
+    if (!Decompose(input_pe_file_, input_pdb_path_, decomposition_cache_dir_,
+                   &input_image_layout_, &headers_block_)) {
+      return false;
+    }
+  }
+
+  // Diff the decomposition against that of the previous relink.
+  if (!incremental_base_path_.empty()) {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "incremental_diff");
+    if (!UpdateIncrementalBase(incremental_base_path_, block_graph_,
+                               &incremental_diff_)) {
+      return false;
+    }
   }
 
   inited_ = true;
@@ -174,10 +242,13 @@ bool PERelinker::Relink() {
     return false;
 
   // Finalize the block-graph. This applies PE and Syzygy specific transforms.
-  if (!FinalizeBlockGraph(input_path_, output_pdb_path_, output_guid_,
-                          add_metadata_, pe_transform_policy_, &block_graph_,
-                          headers_block_)) {
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "finalize_block_graph");
+    if (!FinalizeBlockGraph(input_path_, output_pdb_path_, output_guid_,
+                            add_metadata_, pe_transform_policy_, &block_graph_,
+                            headers_block_)) {
+      return false;
+    }
   }
 
   // Apply the user supplied orderers.
@@ -186,57 +257,81 @@ bool PERelinker::Relink() {
     return false;
 
   // Finalize the ordered block graph. This applies PE specific orderers.
-  if (!FinalizeOrderedBlockGraph(&ordered_block_graph, headers_block_))
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "finalize_ordering");
+    if (!FinalizeOrderedBlockGraph(&ordered_block_graph, headers_block_))
+      return false;
+  }
 
   // Lay it out.
   ImageLayout output_image_layout(&block_graph_);
-  if (!BuildImageLayout(padding_, code_alignment_,
-                        ordered_block_graph, headers_block_,
-                        &output_image_layout)) {
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "build_layout");
+    if (!BuildImageLayout(padding_, code_alignment_,
+                          ordered_block_graph, headers_block_,
+                          &output_image_layout)) {
+      return false;
+    }
   }
 
   if (!ApplyUserLayoutTransforms(&output_image_layout, &ordered_block_graph))
     return false;
 
   // Write the image.
-  if (!WriteImage(output_image_layout, output_path_))
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "write_image");
+    if (!WriteImage(output_image_layout, output_path_))
+      return false;
+  }
 
   // From here on down we are processing the PDB file.
 
   // Read the PDB file.
   LOG(INFO) << "Reading PDB file: " << input_pdb_path_.value();
-  pdb::PdbReader pdb_reader;
   PdbFile pdb_file;
-  if (!pdb_reader.Read(input_pdb_path_, &pdb_file)) {
-    LOG(ERROR) << "Unable to read PDB file: " << input_pdb_path_.value();
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "read_pdb");
+    pdb::PdbReader pdb_reader;
+    if (!pdb_reader.Read(input_pdb_path_, &pdb_file)) {
+      LOG(ERROR) << "Unable to read PDB file: " << input_pdb_path_.value();
+      return false;
+    }
   }
 
   // Apply any user specified mutators to the PDB file.
-  if (!pdb::ApplyPdbMutators(pdb_mutators_, &pdb_file))
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "pdb_mutators");
+    if (!pdb::ApplyPdbMutators(pdb_mutators_, &pdb_file))
+      return false;
+  }
 
   // Finalize the PDB file.
   RelativeAddressRange input_range;
   GetOmapRange(input_image_layout_.sections, &input_range);
-  if (!FinalizePdbFile(input_path_, output_path_, input_range,
-                       output_image_layout, output_guid_, augment_pdb_,
-                       strip_strings_, compress_pdb_, &pdb_file)) {
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "finalize_pdb");
+    if (!FinalizePdbFile(input_path_, output_path_, input_range,
+                         output_image_layout, output_guid_, augment_pdb_,
+                         strip_strings_, compress_pdb_, &pdb_file)) {
+      return false;
+    }
   }
 
   // Write the PDB file.
   LOG(INFO) << "Writing the PDB.";
-  pdb::PdbWriter pdb_writer;
-  if (!pdb_writer.Write(output_pdb_path_, pdb_file)) {
-    LOG(ERROR) << "Failed to write PDB file \"" << output_pdb_path_.value()
-               << "\".";
-    return false;
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler_, "write_pdb");
+    pdb::PdbWriter pdb_writer;
+    if (!pdb_writer.Write(output_pdb_path_, pdb_file)) {
+      LOG(ERROR) << "Failed to write PDB file \"" << output_pdb_path_.value()
+                 << "\".";
+      return false;
+    }
   }
 
+  if (!WriteProfile())
+    return false;
+
   LOG(INFO) << "PE relinker finished.";
 
   return true;
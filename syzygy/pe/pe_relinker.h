@@ -62,6 +62,7 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "syzygy/block_graph/block_graph_diff.h"
 #include "syzygy/block_graph/orderer.h"
 #include "syzygy/block_graph/transform.h"
 #include "syzygy/pdb/pdb_mutator.h"
@@ -87,6 +88,9 @@ namespace pe {
 //
 // 1. Relinker created with an input image. The PDB file is found automatically
 //    and the image is decomposed. Optionally the PDB may be directly specified.
+//    If a decomposition cache directory is specified the decomposition is
+//    loaded from the cache when it holds a valid entry for the image, and
+//    added to it otherwise.
 // 2. The image is transformed:
 //    a) Transforms provided by the user are applied.
 //    b) AddMetadataTransform is conditionally applied.
@@ -115,6 +119,12 @@ class PERelinker : public PECoffRelinker {
   // @{
   const base::FilePath& input_pdb_path() const { return input_pdb_path_; }
   const base::FilePath& output_pdb_path() const { return output_pdb_path_; }
+  const base::FilePath& decomposition_cache_dir() const {
+    return decomposition_cache_dir_;
+  }
+  const base::FilePath& incremental_base_path() const {
+    return incremental_base_path_;
+  }
   bool add_metadata() const { return add_metadata_; }
   bool augment_pdb() const { return augment_pdb_; }
   bool compress_pdb() const { return compress_pdb_; }
@@ -131,6 +141,13 @@ class PERelinker : public PECoffRelinker {
   void set_output_pdb_path(const base::FilePath& output_pdb_path) {
     output_pdb_path_ = output_pdb_path;
   }
+  void set_decomposition_cache_dir(
+      const base::FilePath& decomposition_cache_dir) {
+    decomposition_cache_dir_ = decomposition_cache_dir;
+  }
+  void set_incremental_base_path(const base::FilePath& incremental_base_path) {
+    incremental_base_path_ = incremental_base_path;
+  }
   void set_add_metadata(bool add_metadata) {
     add_metadata_ = add_metadata;
   }
@@ -189,6 +206,13 @@ class PERelinker : public PECoffRelinker {
   // @pre Init has been successfully called.
   const PEFile& input_pe_file() const { return input_pe_file_; }
   const GUID& output_guid() const { return output_guid_; }
+  // The diff of the input block-graph against that of the previous relink
+  // of the image. It is empty unless an incremental base path is provided;
+  // then the blocks that are unchanged are those that the transforms of the
+  // previous relink saw identically.
+  const block_graph::BlockGraphDiff& incremental_diff() const {
+    return incremental_diff_;
+  }
   // @}
 
  protected:
@@ -197,6 +221,14 @@ class PERelinker : public PECoffRelinker {
 
   base::FilePath input_pdb_path_;
   base::FilePath output_pdb_path_;
+  // The directory of the decomposition cache. The input image is decomposed
+  // every time if this is empty, which is the default.
+  base::FilePath decomposition_cache_dir_;
+  // The path of the input block-graph of the previous relink of the image,
+  // against which the input block-graph is diffed. It is replaced by the new
+  // input block-graph on every relink. No diff is made if this is empty,
+  // which is the default.
+  base::FilePath incremental_base_path_;
 
   // If true, metadata will be added to the output image. Defaults to true.
   bool add_metadata_;
@@ -225,6 +257,7 @@ class PERelinker : public PECoffRelinker {
 
   // These refer to the original image, and don't change after init.
   PEFile input_pe_file_;
+  block_graph::BlockGraphDiff incremental_diff_;
 
   // These are for the new image that will be produced at the end of Relink.
   GUID output_guid_;
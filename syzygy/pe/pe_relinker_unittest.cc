@@ -121,6 +121,14 @@ TEST_F(PERelinkerTest, Properties) {
   relinker.set_output_pdb_path(dummy_path);
   EXPECT_EQ(dummy_path, relinker.output_pdb_path());
 
+  EXPECT_EQ(base::FilePath(), relinker.decomposition_cache_dir());
+  relinker.set_decomposition_cache_dir(dummy_path);
+  EXPECT_EQ(dummy_path, relinker.decomposition_cache_dir());
+
+  EXPECT_EQ(base::FilePath(), relinker.incremental_base_path());
+  relinker.set_incremental_base_path(dummy_path);
+  EXPECT_EQ(dummy_path, relinker.incremental_base_path());
+
   EXPECT_TRUE(relinker.add_metadata());
   relinker.set_add_metadata(false);
   EXPECT_FALSE(relinker.add_metadata());
@@ -212,6 +220,60 @@ TEST_F(PERelinkerTest, InitSucceeds) {
   EXPECT_TRUE(relinker.Init());
 }
 
+TEST_F(PERelinkerTest, InitUsesDecompositionCache) {
+  base::FilePath cache_dir = temp_dir_.Append(L"cache");
+
+  // The first run populates the cache.
+  size_t block_count = 0;
+  {
+    TestPERelinker relinker(&policy_);
+    relinker.set_input_path(input_dll_);
+    relinker.set_output_path(temp_dll_);
+    relinker.set_decomposition_cache_dir(cache_dir);
+    EXPECT_TRUE(relinker.Init());
+    block_count = relinker.block_graph().blocks().size();
+  }
+  EXPECT_FALSE(base::IsDirectoryEmpty(cache_dir));
+
+  // The second run loads the same decomposition from it.
+  TestPERelinker relinker(&policy_);
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_decomposition_cache_dir(cache_dir);
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_EQ(block_count, relinker.block_graph().blocks().size());
+  EXPECT_TRUE(relinker.headers_block() != NULL);
+  EXPECT_TRUE(relinker.Relink());
+}
+
+TEST_F(PERelinkerTest, InitDiffsAgainstIncrementalBase) {
+  base::FilePath base_path = temp_dir_.Append(L"base.bg");
+
+  // Without a base, every block is changed.
+  size_t block_count = 0;
+  {
+    TestPERelinker relinker(&policy_);
+    relinker.set_input_path(input_dll_);
+    relinker.set_output_path(temp_dll_);
+    relinker.set_incremental_base_path(base_path);
+    EXPECT_TRUE(relinker.Init());
+    block_count = relinker.block_graph().blocks().size();
+    EXPECT_TRUE(relinker.incremental_diff().unchanged_blocks().empty());
+    EXPECT_EQ(block_count, relinker.incremental_diff().changed_blocks().size());
+  }
+  EXPECT_TRUE(base::PathExists(base_path));
+
+  // Relinking the same image again finds every block unchanged.
+  TestPERelinker relinker(&policy_);
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_incremental_base_path(base_path);
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_EQ(block_count, relinker.incremental_diff().unchanged_blocks().size());
+  EXPECT_TRUE(relinker.incremental_diff().changed_blocks().empty());
+  EXPECT_TRUE(relinker.incremental_diff().removed_blocks().empty());
+}
+
 TEST_F(PERelinkerTest, IntermediateAccessors) {
   TestPERelinker relinker(&policy_);
 
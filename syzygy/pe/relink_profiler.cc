@@ -0,0 +1,139 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/relink_profiler.h"
+
+#include <windows.h>
+#include <psapi.h>
+
+#include "base/logging.h"
+#include "base/files/file_util.h"
+#include "syzygy/common/com_utils.h"
+
+namespace pe {
+
+namespace {
+
+// Converts a FILETIME duration to a TimeDelta.
+base::TimeDelta FileTimeToTimeDelta(const FILETIME& file_time) {
+  ULARGE_INTEGER value = {};
+  value.LowPart = file_time.dwLowDateTime;
+  value.HighPart = file_time.dwHighDateTime;
+  // FILETIME durations are expressed in units of 100 nanoseconds.
+  return base::TimeDelta::FromMicroseconds(value.QuadPart / 10);
+}
+
+}  // namespace
+
+RelinkProfiler::ScopedPhase::ScopedPhase(RelinkProfiler* profiler,
+                                         const base::StringPiece& name)
+    : profiler_(profiler),
+      start_time_(base::TimeTicks::Now()),
+      start_cpu_time_(GetProcessCpuTime()),
+      start_working_set_(0) {
+  DCHECK_NE(static_cast<RelinkProfiler*>(nullptr), profiler);
+  name.CopyToString(&phase_.name);
+  size_t peak_working_set = 0;
+  GetProcessWorkingSet(&start_working_set_, &peak_working_set);
+}
+
+RelinkProfiler::ScopedPhase::~ScopedPhase() {
+  phase_.wall_time = base::TimeTicks::Now() - start_time_;
+  phase_.cpu_time = GetProcessCpuTime() - start_cpu_time_;
+  size_t working_set = 0;
+  GetProcessWorkingSet(&working_set, &phase_.peak_working_set);
+  phase_.working_set_delta = static_cast<int64_t>(working_set) -
+      static_cast<int64_t>(start_working_set_);
+  profiler_->AddPhase(phase_);
+}
+
+bool RelinkProfiler::WriteJson(const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\".";
+    return false;
+  }
+  core::JSONFileWriter json_file(file.get(), true);
+  if (!WriteJson(&json_file) || !json_file.Flush()) {
+    LOG(ERROR) << "Failed to write \"" << path.value() << "\".";
+    return false;
+  }
+  return true;
+}
+
+bool RelinkProfiler::WriteJson(core::JSONFileWriter* json_file) const {
+  DCHECK_NE(static_cast<core::JSONFileWriter*>(nullptr), json_file);
+
+  if (!json_file->OpenDict() ||
+      !json_file->OutputKey("phases") ||
+      !json_file->OpenList()) {
+    return false;
+  }
+
+  for (const Phase& phase : phases_) {
+    // The sizes are written as doubles, as they may not fit in an int.
+    double peak_working_set = static_cast<double>(phase.peak_working_set);
+    double working_set_delta = static_cast<double>(phase.working_set_delta);
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("name") ||
+        !json_file->OutputString(phase.name) ||
+        !json_file->OutputKey("wall_time_ms") ||
+        !json_file->OutputDouble(phase.wall_time.InMillisecondsF()) ||
+        !json_file->OutputKey("cpu_time_ms") ||
+        !json_file->OutputDouble(phase.cpu_time.InMillisecondsF()) ||
+        !json_file->OutputKey("peak_working_set_bytes") ||
+        !json_file->OutputDouble(peak_working_set) ||
+        !json_file->OutputKey("working_set_delta_bytes") ||
+        !json_file->OutputDouble(working_set_delta) ||
+        !json_file->CloseDict()) {
+      return false;
+    }
+  }
+
+  return json_file->CloseList() && json_file->CloseDict();
+}
+
+base::TimeDelta RelinkProfiler::GetProcessCpuTime() {
+  FILETIME creation_time = {};
+  FILETIME exit_time = {};
+  FILETIME kernel_time = {};
+  FILETIME user_time = {};
+  if (!::GetProcessTimes(::GetCurrentProcess(), &creation_time, &exit_time,
+                         &kernel_time, &user_time)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessTimes failed: " << common::LogWe(error);
+    return base::TimeDelta();
+  }
+  return FileTimeToTimeDelta(kernel_time) + FileTimeToTimeDelta(user_time);
+}
+
+void RelinkProfiler::GetProcessWorkingSet(size_t* working_set,
+                                          size_t* peak_working_set) {
+  DCHECK_NE(static_cast<size_t*>(nullptr), working_set);
+  DCHECK_NE(static_cast<size_t*>(nullptr), peak_working_set);
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessMemoryInfo failed: " << common::LogWe(error);
+    *working_set = 0;
+    *peak_working_set = 0;
+    return;
+  }
+  *working_set = counters.WorkingSetSize;
+  *peak_working_set = counters.PeakWorkingSetSize;
+}
+
+}  // namespace pe
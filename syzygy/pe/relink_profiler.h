@@ -0,0 +1,124 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares RelinkProfiler, which records the cost of the phases of a relink:
+// decomposition, each of the transforms and orderers, layout, writing, etc.
+// For each phase it records the wall time, the CPU time of the process (which
+// accounts for the worker threads of parallel phases) and the peak working set
+// of the process at the end of the phase. The records can be written as JSON:
+//
+//   {
+//     "phases": [
+//       {
+//         "name": "transform:AsanTransform",
+//         "wall_time_ms": 1234.5,
+//         "cpu_time_ms": 4567.8,
+//         "peak_working_set_bytes": 123456789,
+//         "working_set_delta_bytes": 1234567
+//       },
+//       ...
+//     ]
+//   }
+//
+// The peak working set is that of the whole process; it only grows, and the
+// phase that makes it grow is the one that set the peak.
+
+#ifndef SYZYGY_PE_RELINK_PROFILER_H_
+#define SYZYGY_PE_RELINK_PROFILER_H_
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace pe {
+
+class RelinkProfiler {
+ public:
+  // The cost of a phase of the relink.
+  struct Phase {
+    Phase() : peak_working_set(0), working_set_delta(0) { }
+
+    // The name of the phase.
+    std::string name;
+    // The wall time spent in the phase.
+    base::TimeDelta wall_time;
+    // The CPU time spent by the process during the phase.
+    base::TimeDelta cpu_time;
+    // The peak working set of the process at the end of the phase, in bytes.
+    size_t peak_working_set;
+    // The growth of the working set of the process during the phase, in
+    // bytes. This is negative if the working set shrunk.
+    int64_t working_set_delta;
+  };
+  typedef std::vector<Phase> Phases;
+
+  // Records a phase for its lifetime.
+  class ScopedPhase {
+   public:
+    // @param profiler The profiler recording the phase.
+    // @param name The name of the phase.
+    ScopedPhase(RelinkProfiler* profiler, const base::StringPiece& name);
+    ~ScopedPhase();
+
+   private:
+    RelinkProfiler* profiler_;
+    Phase phase_;
+    base::TimeTicks start_time_;
+    base::TimeDelta start_cpu_time_;
+    size_t start_working_set_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedPhase);
+  };
+
+  RelinkProfiler() { }
+
+  // @returns the recorded phases, in the order in which they ended.
+  const Phases& phases() const { return phases_; }
+
+  // Records a phase. This is usually done by a ScopedPhase.
+  // @param phase The phase to record.
+  void AddPhase(const Phase& phase) { phases_.push_back(phase); }
+
+  // Writes the recorded phases as JSON.
+  // @param path The path of the file to be written.
+  // @returns true on success, false otherwise.
+  bool WriteJson(const base::FilePath& path) const;
+  // @param json_file The JSON stream to write to.
+  // @returns true on success, false otherwise.
+  bool WriteJson(core::JSONFileWriter* json_file) const;
+
+  // @name Process metrics, exposed for use by ScopedPhase and for testing.
+  // @{
+  // @returns the CPU time used so far by the current process.
+  static base::TimeDelta GetProcessCpuTime();
+  // @param working_set Receives the working set of the current process.
+  // @param peak_working_set Receives the peak working set of the current
+  //     process.
+  static void GetProcessWorkingSet(size_t* working_set,
+                                   size_t* peak_working_set);
+  // @}
+
+ private:
+  Phases phases_;
+
+  DISALLOW_COPY_AND_ASSIGN(RelinkProfiler);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_RELINK_PROFILER_H_
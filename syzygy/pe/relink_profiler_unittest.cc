@@ -0,0 +1,96 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/relink_profiler.h"
+
+#include <memory>
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "gtest/gtest.h"
+
+namespace pe {
+
+TEST(RelinkProfilerTest, ScopedPhase) {
+  RelinkProfiler profiler;
+  EXPECT_TRUE(profiler.phases().empty());
+
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler, "first");
+    std::unique_ptr<char[]> buffer(new char[1024 * 1024]);
+    ::memset(buffer.get(), 0xCC, 1024 * 1024);
+  }
+  {
+    RelinkProfiler::ScopedPhase phase(&profiler, "second");
+  }
+
+  ASSERT_EQ(2u, profiler.phases().size());
+  EXPECT_EQ("first", profiler.phases()[0].name);
+  EXPECT_EQ("second", profiler.phases()[1].name);
+  for (const auto& phase : profiler.phases()) {
+    EXPECT_LE(0, phase.wall_time.InMicroseconds());
+    EXPECT_LE(0, phase.cpu_time.InMicroseconds());
+    EXPECT_LT(0u, phase.peak_working_set);
+  }
+}
+
+TEST(RelinkProfilerTest, WriteJson) {
+  RelinkProfiler profiler;
+  RelinkProfiler::Phase phase;
+  phase.name = "transform:test";
+  phase.wall_time = base::TimeDelta::FromMilliseconds(20);
+  phase.cpu_time = base::TimeDelta::FromMilliseconds(10);
+  phase.peak_working_set = 4096;
+  phase.working_set_delta = -1024;
+  profiler.AddPhase(phase);
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().Append(L"profile.json");
+  ASSERT_TRUE(profiler.WriteJson(path));
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  std::unique_ptr<base::Value> value(
+      base::JSONReader::Read(contents).release());
+  ASSERT_TRUE(value.get() != nullptr);
+
+  base::DictionaryValue* dict = nullptr;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+  base::ListValue* phases = nullptr;
+  ASSERT_TRUE(dict->GetList("phases", &phases));
+  ASSERT_EQ(1u, phases->GetSize());
+
+  base::DictionaryValue* entry = nullptr;
+  ASSERT_TRUE(phases->GetDictionary(0, &entry));
+  std::string name;
+  EXPECT_TRUE(entry->GetString("name", &name));
+  EXPECT_EQ("transform:test", name);
+  double wall_time_ms = 0;
+  EXPECT_TRUE(entry->GetDouble("wall_time_ms", &wall_time_ms));
+  EXPECT_EQ(20.0, wall_time_ms);
+  double cpu_time_ms = 0;
+  EXPECT_TRUE(entry->GetDouble("cpu_time_ms", &cpu_time_ms));
+  EXPECT_EQ(10.0, cpu_time_ms);
+  double peak_working_set = 0;
+  EXPECT_TRUE(entry->GetDouble("peak_working_set_bytes", &peak_working_set));
+  EXPECT_EQ(4096.0, peak_working_set);
+  double working_set_delta = 0;
+  EXPECT_TRUE(entry->GetDouble("working_set_delta_bytes", &working_set_delta));
+  EXPECT_EQ(-1024.0, working_set_delta);
+}
+
+}  // namespace pe
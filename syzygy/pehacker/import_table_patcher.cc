@@ -0,0 +1,310 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pehacker/import_table_patcher.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/files/file_util.h"
+#include "base/strings/string_util.h"
+#include "syzygy/common/align.h"
+#include "syzygy/pe/pe_file_writer.h"
+
+namespace pehacker {
+
+namespace {
+
+typedef pe::PEFile::RelativeAddress RelativeAddress;
+
+// Gets the offset of the section table of an image.
+size_t GetSectionTableOffset(const pe::PEFile& pe_file) {
+  return pe_file.dos_header()->e_lfanew + sizeof(DWORD) +
+         sizeof(IMAGE_FILE_HEADER) +
+         pe_file.nt_headers()->FileHeader.SizeOfOptionalHeader;
+}
+
+// Gets the end of the raw data of the sections of an image.
+size_t GetRawDataEnd(const pe::PEFile& pe_file) {
+  size_t raw_data_end = pe_file.nt_headers()->OptionalHeader.SizeOfHeaders;
+  for (size_t i = 0; i < pe_file.nt_headers()->FileHeader.NumberOfSections;
+       ++i) {
+    const IMAGE_SECTION_HEADER* section = pe_file.section_header(i);
+    if (section->SizeOfRawData == 0)
+      continue;
+    raw_data_end = std::max<size_t>(
+        raw_data_end, section->PointerToRawData + section->SizeOfRawData);
+  }
+  return raw_data_end;
+}
+
+// Gets the end of the sections of an image, in its address space.
+size_t GetVirtualEnd(const pe::PEFile& pe_file) {
+  size_t virtual_end = pe_file.nt_headers()->OptionalHeader.SizeOfHeaders;
+  for (size_t i = 0; i < pe_file.nt_headers()->FileHeader.NumberOfSections;
+       ++i) {
+    const IMAGE_SECTION_HEADER* section = pe_file.section_header(i);
+    size_t size = std::max(section->Misc.VirtualSize, section->SizeOfRawData);
+    virtual_end = std::max<size_t>(virtual_end,
+                                   section->VirtualAddress + size);
+  }
+  return virtual_end;
+}
+
+// Appends @p size bytes of @p data to @p buffer.
+void Append(const void* data, size_t size, std::vector<uint8_t>* buffer) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  buffer->insert(buffer->end(), bytes, bytes + size);
+}
+
+}  // namespace
+
+const char ImportTablePatcher::kSectionName[] = ".imports";
+
+void ImportTablePatcher::AddImport(const base::StringPiece& module_name,
+                                   const base::StringPiece& function_name) {
+  DCHECK(!module_name.empty());
+  DCHECK(!function_name.empty());
+  imports_[base::ToLowerASCII(module_name)].insert(function_name.as_string());
+}
+
+bool ImportTablePatcher::CanPatch(const pe::PEFile& pe_file) {
+  const IMAGE_NT_HEADERS32* nt_headers = pe_file.nt_headers();
+  const IMAGE_DATA_DIRECTORY* directories =
+      nt_headers->OptionalHeader.DataDirectory;
+
+  // A signature doesn't survive the patch, and bound imports live in the
+  // gap after the section table that the new section header takes.
+  if (directories[IMAGE_DIRECTORY_ENTRY_SECURITY].Size != 0) {
+    VLOG(1) << "The image is signed.";
+    return false;
+  }
+  if (directories[IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT].Size != 0) {
+    VLOG(1) << "The image has bound imports.";
+    return false;
+  }
+
+  // The new section is appended to the image, which must end with its last
+  // section.
+  int64_t file_size = 0;
+  if (!base::GetFileSize(pe_file.path(), &file_size) ||
+      static_cast<size_t>(file_size) != GetRawDataEnd(pe_file)) {
+    VLOG(1) << "The image has data after its last section.";
+    return false;
+  }
+
+  // There has to be room for one more section header, in a part of the
+  // headers that is otherwise unused.
+  size_t header_begin = GetSectionTableOffset(pe_file) +
+      nt_headers->FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER);
+  size_t header_end = header_begin + sizeof(IMAGE_SECTION_HEADER);
+  bool has_room = header_end <= nt_headers->OptionalHeader.SizeOfHeaders;
+  for (size_t i = 0; i < nt_headers->FileHeader.NumberOfSections; ++i) {
+    const IMAGE_SECTION_HEADER* section = pe_file.section_header(i);
+    if (section->SizeOfRawData != 0 && section->PointerToRawData < header_end)
+      has_room = false;
+  }
+  if (!has_room) {
+    VLOG(1) << "The image has no room for another section header.";
+    return false;
+  }
+
+  std::string headers(header_end, '\0');
+  if (base::ReadFile(pe_file.path(), &headers[0],
+                     static_cast<int>(headers.size())) !=
+          static_cast<int>(headers.size()) ||
+      headers.find_first_not_of('\0', header_begin) != std::string::npos) {
+    VLOG(1) << "The space after the section table of the image is in use.";
+    return false;
+  }
+
+  return true;
+}
+
+bool ImportTablePatcher::Patch(const pe::PEFile& pe_file,
+                               const base::FilePath& output_module) {
+  DCHECK(CanPatch(pe_file));
+
+  ImportMap imports(imports_);
+  if (!RemoveExistingImports(pe_file, &imports))
+    return false;
+
+  std::string image;
+  if (!base::ReadFileToString(pe_file.path(), &image)) {
+    LOG(ERROR) << "Unable to read image \"" << pe_file.path().value()
+               << "\".";
+    return false;
+  }
+
+  if (!imports.empty()) {
+    const IMAGE_OPTIONAL_HEADER32& optional_header =
+        pe_file.nt_headers()->OptionalHeader;
+    const IMAGE_DATA_DIRECTORY& import_directory =
+        optional_header.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+
+    // Copy the original import descriptors, up to their terminator.
+    std::vector<IMAGE_IMPORT_DESCRIPTOR> descriptors;
+    for (size_t offset = 0;
+         offset + sizeof(IMAGE_IMPORT_DESCRIPTOR) <= import_directory.Size;
+         offset += sizeof(IMAGE_IMPORT_DESCRIPTOR)) {
+      IMAGE_IMPORT_DESCRIPTOR descriptor = {};
+      if (!pe_file.ReadImage(
+              RelativeAddress(import_directory.VirtualAddress + offset),
+              &descriptor, sizeof(descriptor))) {
+        LOG(ERROR) << "Unable to read import descriptor.";
+        return false;
+      }
+      if (descriptor.Characteristics == 0 && descriptor.FirstThunk == 0)
+        break;
+      descriptors.push_back(descriptor);
+    }
+
+    // Lay out the new section: the descriptors and their terminator, then
+    // the name and address tables of each added module, then the names.
+    uint32_t section_rva = static_cast<uint32_t>(::common::AlignUp(
+        GetVirtualEnd(pe_file), optional_header.SectionAlignment));
+    size_t first_added = descriptors.size();
+    descriptors.resize(descriptors.size() + imports.size() + 1);
+    uint32_t tables_size =
+        static_cast<uint32_t>(descriptors.size() *
+                              sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    for (const auto& module : imports) {
+      tables_size += static_cast<uint32_t>(
+          2 * (module.second.size() + 1) * sizeof(IMAGE_THUNK_DATA32));
+    }
+
+    std::vector<uint8_t> names;
+    std::vector<IMAGE_THUNK_DATA32> thunks;
+    IMAGE_IMPORT_DESCRIPTOR* descriptor = &descriptors[first_added];
+    uint32_t thunk_rva = section_rva + static_cast<uint32_t>(
+        descriptors.size() * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    for (const auto& module : imports) {
+      std::vector<IMAGE_THUNK_DATA32> name_table;
+      for (const auto& function : module.second) {
+        IMAGE_THUNK_DATA32 thunk = {};
+        thunk.u1.AddressOfData = section_rva + tables_size +
+            static_cast<uint32_t>(names.size());
+        name_table.push_back(thunk);
+
+        // The hint is left to zero, the loader then looks the name up.
+        const uint16_t kHint = 0;
+        Append(&kHint, sizeof(kHint), &names);
+        Append(function.c_str(), function.size() + 1, &names);
+        if (names.size() % 2 != 0)
+          names.push_back(0);
+      }
+      name_table.push_back(IMAGE_THUNK_DATA32());
+
+      // The address table starts as a copy of the name table, and is
+      // overwritten by the loader.
+      uint32_t table_size = static_cast<uint32_t>(
+          name_table.size() * sizeof(IMAGE_THUNK_DATA32));
+      descriptor->OriginalFirstThunk = thunk_rva;
+      descriptor->FirstThunk = thunk_rva + table_size;
+      descriptor->Name = section_rva + tables_size +
+          static_cast<uint32_t>(names.size());
+      Append(module.first.c_str(), module.first.size() + 1, &names);
+      thunks.insert(thunks.end(), name_table.begin(), name_table.end());
+      thunks.insert(thunks.end(), name_table.begin(), name_table.end());
+      thunk_rva += 2 * table_size;
+      ++descriptor;
+    }
+
+    std::vector<uint8_t> section_data;
+    Append(descriptors.data(),
+           descriptors.size() * sizeof(IMAGE_IMPORT_DESCRIPTOR),
+           &section_data);
+    Append(thunks.data(), thunks.size() * sizeof(IMAGE_THUNK_DATA32),
+           &section_data);
+    DCHECK_EQ(tables_size, section_data.size());
+    section_data.insert(section_data.end(), names.begin(), names.end());
+
+    // Append the section to the image.
+    size_t raw_offset = ::common::AlignUp(image.size(),
+                                          optional_header.FileAlignment);
+    size_t raw_size = ::common::AlignUp(section_data.size(),
+                                        optional_header.FileAlignment);
+    image.resize(raw_offset);
+    image.append(section_data.begin(), section_data.end());
+    image.resize(raw_offset + raw_size);
+
+    IMAGE_SECTION_HEADER section_header = {};
+    ::memcpy(section_header.Name, kSectionName,
+             std::min(sizeof(section_header.Name), ::strlen(kSectionName)));
+    section_header.Misc.VirtualSize =
+        static_cast<uint32_t>(section_data.size());
+    section_header.VirtualAddress = section_rva;
+    section_header.SizeOfRawData = static_cast<uint32_t>(raw_size);
+    section_header.PointerToRawData = static_cast<uint32_t>(raw_offset);
+    section_header.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA |
+        IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+    size_t section_header_offset = GetSectionTableOffset(pe_file) +
+        pe_file.nt_headers()->FileHeader.NumberOfSections *
+            sizeof(IMAGE_SECTION_HEADER);
+    ::memcpy(&image[section_header_offset], &section_header,
+             sizeof(section_header));
+
+    // Update the headers to account for the new section, and point the
+    // import directory at it.
+    IMAGE_NT_HEADERS32* nt_headers = reinterpret_cast<IMAGE_NT_HEADERS32*>(
+        &image[pe_file.dos_header()->e_lfanew]);
+    ++nt_headers->FileHeader.NumberOfSections;
+    nt_headers->OptionalHeader.SizeOfInitializedData +=
+        static_cast<uint32_t>(raw_size);
+    nt_headers->OptionalHeader.SizeOfImage = static_cast<uint32_t>(
+        ::common::AlignUp(section_rva + section_data.size(),
+                          optional_header.SectionAlignment));
+    IMAGE_DATA_DIRECTORY& new_import_directory =
+        nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    new_import_directory.VirtualAddress = section_rva;
+    new_import_directory.Size = static_cast<uint32_t>(
+        descriptors.size() * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+  }
+
+  if (base::WriteFile(output_module, image.data(),
+                      static_cast<int>(image.size())) !=
+      static_cast<int>(image.size())) {
+    LOG(ERROR) << "Unable to write image \"" << output_module.value()
+               << "\".";
+    return false;
+  }
+
+  return pe::PEFileWriter::UpdateFileChecksum(output_module);
+}
+
+bool ImportTablePatcher::RemoveExistingImports(const pe::PEFile& pe_file,
+                                               ImportMap* imports) {
+  DCHECK_NE(static_cast<ImportMap*>(nullptr), imports);
+
+  pe::PEFile::ImportDllVector existing_imports;
+  if (!pe_file.DecodeImports(&existing_imports)) {
+    LOG(ERROR) << "Unable to decode the imports of \""
+               << pe_file.path().value() << "\".";
+    return false;
+  }
+
+  for (const auto& dll : existing_imports) {
+    ImportMap::iterator it = imports->find(base::ToLowerASCII(dll.name));
+    if (it == imports->end())
+      continue;
+    for (const auto& function : dll.functions)
+      it->second.erase(function.function);
+    if (it->second.empty())
+      imports->erase(it);
+  }
+
+  return true;
+}
+
+}  // namespace pehacker
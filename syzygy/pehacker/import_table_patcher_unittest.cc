@@ -0,0 +1,120 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pehacker/import_table_patcher.h"
+
+#include "base/strings/string_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pehacker {
+
+namespace {
+
+typedef pe::PEFile::ImportDllVector ImportDllVector;
+
+class ImportTablePatcherTest : public testing::PELibUnitTest {
+ public:
+  void SetUp() override {
+    testing::PELibUnitTest::SetUp();
+    CreateTemporaryDir(&temp_dir_);
+    input_module_ = testing::GetOutputRelativePath(testing::kTestDllName);
+    output_module_ = temp_dir_.Append(testing::kTestDllName);
+    ASSERT_TRUE(pe_file_.Init(input_module_));
+  }
+
+  // @returns the number of times @p imports import @p function_name from
+  //     @p module_name.
+  static size_t CountImports(const ImportDllVector& imports,
+                             const std::string& module_name,
+                             const std::string& function_name) {
+    size_t count = 0;
+    for (const auto& dll : imports) {
+      if (!base::EqualsCaseInsensitiveASCII(dll.name, module_name))
+        continue;
+      for (const auto& function : dll.functions) {
+        if (function.function == function_name)
+          ++count;
+      }
+    }
+    return count;
+  }
+
+  // @returns the number of functions imported by @p imports.
+  static size_t CountFunctions(const ImportDllVector& imports) {
+    size_t num_functions = 0;
+    for (const auto& dll : imports)
+      num_functions += dll.functions.size();
+    return num_functions;
+  }
+
+  base::FilePath temp_dir_;
+  base::FilePath input_module_;
+  base::FilePath output_module_;
+  pe::PEFile pe_file_;
+};
+
+}  // namespace
+
+TEST_F(ImportTablePatcherTest, CanPatchTestDll) {
+  EXPECT_TRUE(ImportTablePatcher::CanPatch(pe_file_));
+}
+
+TEST_F(ImportTablePatcherTest, PatchWithoutImportsCopiesImage) {
+  ImportTablePatcher patcher;
+  ASSERT_TRUE(patcher.Patch(pe_file_, output_module_));
+
+  pe::PEFile output_file;
+  ASSERT_TRUE(output_file.Init(output_module_));
+  EXPECT_EQ(pe_file_.nt_headers()->FileHeader.NumberOfSections,
+            output_file.nt_headers()->FileHeader.NumberOfSections);
+}
+
+TEST_F(ImportTablePatcherTest, AddsImports) {
+  ImportDllVector original_imports;
+  ASSERT_TRUE(pe_file_.DecodeImports(&original_imports));
+  ASSERT_FALSE(original_imports.empty());
+  ASSERT_FALSE(original_imports[0].functions.empty());
+  const std::string existing_module = original_imports[0].name;
+  const std::string existing_function =
+      original_imports[0].functions[0].function;
+  ASSERT_FALSE(existing_function.empty());
+
+  ImportTablePatcher patcher;
+  patcher.AddImport("kernel32.dll", "GetProcessHeaps");
+  patcher.AddImport("KERNEL32.dll", "GetProcessHeaps");
+  patcher.AddImport(existing_module, existing_function);
+  ASSERT_TRUE(patcher.Patch(pe_file_, output_module_));
+
+  pe::PEFile output_file;
+  ASSERT_TRUE(output_file.Init(output_module_));
+  EXPECT_EQ(pe_file_.nt_headers()->FileHeader.NumberOfSections + 1,
+            output_file.nt_headers()->FileHeader.NumberOfSections);
+  EXPECT_NE(static_cast<const IMAGE_SECTION_HEADER*>(nullptr),
+            output_file.GetSectionHeader(ImportTablePatcher::kSectionName));
+
+  // The original imports are all still there, the new one is added once and
+  // the existing one isn't duplicated.
+  ImportDllVector imports;
+  ASSERT_TRUE(output_file.DecodeImports(&imports));
+  EXPECT_EQ(1u, CountImports(imports, "kernel32.dll", "GetProcessHeaps"));
+  EXPECT_EQ(1u, CountImports(imports, existing_module, existing_function));
+  EXPECT_EQ(CountFunctions(original_imports) + 1, CountFunctions(imports));
+
+  // The patched image still loads and runs.
+  EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module_));
+}
+
+}  // namespace pehacker
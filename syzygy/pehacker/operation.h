@@ -22,6 +22,8 @@
 
 namespace pehacker {
 
+class ImportTablePatcher;
+
 class OperationInterface {
  public:
   typedef block_graph::BlockGraph BlockGraph;
@@ -51,6 +53,17 @@ class OperationInterface {
   virtual bool Apply(const TransformPolicyInterface* policy,
                      BlockGraph* block_graph,
                      BlockGraph::Block* header_block) = 0;
+
+  // Applies this operation to an image that is patched directly rather than
+  // decomposed. An image takes this fast path when all of its operations
+  // support it, in which case this is called instead of Apply. This will
+  // only be called after a successful call to Init.
+  // @param patcher The patcher of the image.
+  // @returns true if the operation was added to @p patcher, false if it can
+  //     only be applied to a decomposed image.
+  virtual bool ApplyToImportTable(ImportTablePatcher* patcher) const {
+    return false;
+  }
 };
 
 }  // namespace pehacker
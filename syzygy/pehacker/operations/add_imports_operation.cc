@@ -15,6 +15,7 @@
 #include "syzygy/pehacker/operations/add_imports_operation.h"
 
 #include "syzygy/block_graph/transform.h"
+#include "syzygy/pehacker/import_table_patcher.h"
 
 namespace pehacker {
 namespace operations {
@@ -193,6 +194,19 @@ bool AddImportsOperation::Apply(const TransformPolicyInterface* policy,
   return true;
 }
 
+bool AddImportsOperation::ApplyToImportTable(
+    ImportTablePatcher* patcher) const {
+  DCHECK_NE(static_cast<ImportTablePatcher*>(nullptr), patcher);
+
+  // All the imports are of kAlwaysImport symbols, which the patcher adds
+  // unless they already exist.
+  for (const ImportedModule* module : imported_modules_) {
+    for (size_t i = 0; i < module->size(); ++i)
+      patcher->AddImport(module->name(), module->GetSymbolName(i));
+  }
+  return true;
+}
+
 bool AddImportsOperation::ApplyTransform(
     block_graph::BlockGraphTransformInterface* tx,
     const TransformPolicyInterface* policy,
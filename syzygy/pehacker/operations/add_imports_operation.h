@@ -41,6 +41,7 @@ class AddImportsOperation : public OperationInterface {
   virtual bool Apply(const TransformPolicyInterface* policy,
                      BlockGraph* block_graph,
                      BlockGraph::Block* header_block);
+  virtual bool ApplyToImportTable(ImportTablePatcher* patcher) const override;
   // @}
 
   // The name of this operation.
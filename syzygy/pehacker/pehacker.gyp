@@ -21,6 +21,8 @@
       'target_name': 'pehacker_lib',
       'type': 'static_library',
       'sources': [
+        'import_table_patcher.cc',
+        'import_table_patcher.h',
         'operation.h',
         'pehacker_app.cc',
         'pehacker_app.h',
@@ -76,6 +78,7 @@
       'target_name': 'pehacker_unittests',
       'type': 'executable',
       'sources': [
+        'import_table_patcher_unittest.cc',
         'pehacker_app_unittest.cc',
         'variables_unittest.cc',
         'operations/add_imports_operation_unittest.cc',
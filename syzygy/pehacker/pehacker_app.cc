@@ -17,17 +17,24 @@
 
 #include "syzygy/pehacker/pehacker_app.h"
 
+#include <algorithm>
+
 #include "base/files/file_util.h"
 #include "base/json/json_reader.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_writer.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_file_writer.h"
 #include "syzygy/pe/pe_relinker_util.h"
+#include "syzygy/pehacker/import_table_patcher.h"
 #include "syzygy/pehacker/operation.h"
 #include "syzygy/pehacker/variables.h"
 #include "syzygy/pehacker/operations/add_imports_operation.h"
@@ -47,10 +54,30 @@ static const char kUsageFormatStr[] = "Usage: %ls [options]\n"
     "                          Variable names defined on the command-line\n"
     "                          will be normalized to all lowercase. Values\n"
     "                          will be parsed as JSON.\n"
+    "    --num-threads=<count> The number of modules processed concurrently.\n"
+    "                          Defaults to the number of processors.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --verbose             Log verbosely.\n"
     "\n";
 
+// Converts |value| to a normalized path in |path|, performing variable
+// expansion using |variables|. Returns true on success, false otherwise.
+bool ConvertToFilePath(const base::Value& value,
+                       const base::DictionaryValue& variables,
+                       base::FilePath* path) {
+  DCHECK_NE(reinterpret_cast<base::FilePath*>(NULL), path);
+
+  std::string s;
+  if (!ConvertVariableToString(value, &s))
+    return false;
+
+  if (!ExpandVariables(variables, s, &s))
+    return false;
+
+  *path = base::FilePath(base::UTF8ToWide(s)).NormalizePathSeparators();
+  return true;
+}
+
 // Gets the value under key |name| in |dictionary|, performing variable
 // expansion using |variables|, and finally converting it to a normalized path
 // in |path|. If |optional| this will return true if the key doesn't exist
@@ -71,14 +98,9 @@ bool GetFilePath(bool optional,
     return false;
   }
 
-  std::string s;
-  if (!ConvertVariableToString(*value, &s))
+  if (!ConvertToFilePath(*value, variables, path))
     return false;
 
-  if (!ExpandVariables(variables, s, &s))
-    return false;
-
-  *path = base::FilePath(base::UTF8ToWide(s)).NormalizePathSeparators();
   VLOG(1) << "Parsed \"" << name << "\" as \"" << path->value() << "\".";
   return true;
 }
@@ -100,6 +122,34 @@ void RemovePaddingBlocks(BlockGraph* block_graph) {
 
 }  // namespace
 
+class PEHackerApp::ImageWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  ImageWorker(PEHackerApp* app, ImageInfo* image_info)
+      : app_(app), image_info_(image_info), succeeded_(false) {
+    DCHECK_NE(static_cast<PEHackerApp*>(nullptr), app);
+    DCHECK_NE(static_cast<ImageInfo*>(nullptr), image_info);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    // The decomposer reads the PDB files through DIA.
+    base::win::ScopedCOMInitializer com_initializer;
+    succeeded_ = app_->ProcessImage(image_info_);
+  }
+  // @}
+
+  // @returns true if the image was processed successfully.
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  PEHackerApp* app_;
+  ImageInfo* image_info_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(ImageWorker);
+};
+
 bool PEHackerApp::ImageId::operator<(const ImageId& rhs) const {
   if (input_module.value() < rhs.input_module.value())
     return true;
@@ -131,6 +181,17 @@ bool PEHackerApp::ParseCommandLine(const base::CommandLine* cmd_line) {
     VLOG(1) << "Parsed --overwrite switch.";
   }
 
+  num_threads_ = base::SysInfo::NumberOfProcessors();
+  if (cmd_line->HasSwitch("num-threads")) {
+    std::string num_threads = cmd_line->GetSwitchValueASCII("num-threads");
+    if (!base::StringToSizeT(num_threads, &num_threads_) ||
+        num_threads_ == 0) {
+      LOG(ERROR) << "Invalid number of threads: " << num_threads << ".";
+      return false;
+    }
+    VLOG(1) << "Parsed --num-threads switch.";
+  }
+
   // Set built-in variables.
   if (!SetBuiltInVariables())
     return false;
@@ -159,7 +220,7 @@ int PEHackerApp::Run() {
   if (!ProcessConfigurationFile(false))
     return 1;
 
-  if (!WriteImages())
+  if (!ProcessImages())
     return 1;
 
   return 0;
@@ -313,6 +374,43 @@ bool PEHackerApp::ProcessTargets(bool dry_run, base::ListValue* targets) {
 bool PEHackerApp::ProcessTarget(bool dry_run, base::DictionaryValue* target) {
   DCHECK_NE(reinterpret_cast<base::DictionaryValue*>(NULL), target);
 
+  base::ListValue* operations = NULL;
+  if (!target->GetList("operations", &operations)) {
+    LOG(ERROR) << "Each target must specify an \"operations\" list.";
+    return false;
+  }
+
+  // A batch target applies its operations to each of its input modules, and
+  // writes them to its output directory under the same names.
+  if (target->HasKey("input_modules")) {
+    base::ListValue* input_modules = NULL;
+    if (!target->GetList("input_modules", &input_modules) ||
+        input_modules->empty()) {
+      LOG(ERROR) << "\"input_modules\" must be a non-empty list.";
+      return false;
+    }
+
+    base::FilePath output_dir;
+    if (!GetFilePath(false, *target, variables_, "output_dir", &output_dir))
+      return false;
+
+    for (size_t i = 0; i < input_modules->GetSize(); ++i) {
+      const base::Value* value = NULL;
+      CHECK(input_modules->Get(i, &value));
+      base::FilePath input_module;
+      if (!ConvertToFilePath(*value, variables_, &input_module))
+        return false;
+      base::FilePath output_module = output_dir.Append(
+          input_module.BaseName());
+      if (!ProcessModule(dry_run, input_module, output_module,
+                         base::FilePath(), base::FilePath(), operations)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
   base::FilePath input_module;
   base::FilePath output_module;
   base::FilePath input_pdb;
@@ -328,11 +426,17 @@ bool PEHackerApp::ProcessTarget(bool dry_run, base::DictionaryValue* target) {
   if (!GetFilePath(opt, *target, variables_, "output_pdb", &output_pdb))
     return false;
 
-  base::ListValue* operations = NULL;
-  if (!target->GetList("operations", &operations)) {
-    LOG(ERROR) << "Each target must specify an \"operations\" list.";
-    return false;
-  }
+  return ProcessModule(dry_run, input_module, output_module, input_pdb,
+                       output_pdb, operations);
+}
+
+bool PEHackerApp::ProcessModule(bool dry_run,
+                                const base::FilePath& input_module,
+                                const base::FilePath& output_module,
+                                base::FilePath input_pdb,
+                                base::FilePath output_pdb,
+                                base::ListValue* operations) {
+  DCHECK_NE(reinterpret_cast<base::ListValue*>(NULL), operations);
 
   // Validate and infer module-related paths.
   if (!pe::ValidateAndInferPaths(
@@ -342,7 +446,7 @@ bool PEHackerApp::ProcessTarget(bool dry_run, base::DictionaryValue* target) {
 
   ImageInfo* image_info = NULL;
   if (!dry_run) {
-    // Get the decomposed image.
+    // Get the image the operations are queued on.
     image_info = GetImageInfo(
         input_module, output_module, input_pdb, output_pdb);
     if (image_info == NULL)
@@ -414,17 +518,10 @@ bool PEHackerApp::ProcessOperation(bool dry_run,
     return false;
   }
 
-  // If not in a dry-run then apply the operation.
-  if (!dry_run) {
-    LOG(INFO) << "Applying operation \"" << type << "\" to \""
-              << image_info->input_module.value() << "\".";
-    if (!operation_impl->Apply(&policy_,
-                               &image_info->block_graph,
-                               image_info->header_block)) {
-      LOG(ERROR) << "Failed to apply \"" << operation_impl->name() << "\".";
-      return false;
-    }
-  }
+  // If not in a dry-run then queue the operation on the image. It is applied
+  // when the image is processed.
+  if (!dry_run)
+    image_info->operations.push_back(operation_impl.release());
 
   return true;
 }
@@ -445,23 +542,127 @@ PEHackerApp::ImageInfo* PEHackerApp::GetImageInfo(
   if (it != image_info_map_.end())
     return it->second;
 
-  // Initialize a new ImageInfo struct.
+  // Initialize a new ImageInfo struct. The image is read when it is
+  // processed.
   std::unique_ptr<ImageInfo> image_info(new ImageInfo());
   image_info->input_module = input_module;
   image_info->output_module = output_module;
   image_info->input_pdb = input_pdb;
   image_info->output_pdb = output_pdb;
-  if (!image_info->pe_file.Init(input_module)) {
-    LOG(ERROR) << "Failed to read image: " << input_module.value();
-    return NULL;
+
+  it = image_info_map_.insert(std::make_pair(image_id, image_info.get())).first;
+  image_infos_.push_back(image_info.release());
+  return it->second;
+}
+
+bool PEHackerApp::ProcessImages() {
+  std::vector<std::unique_ptr<ImageWorker>> workers;
+  ImageInfoMap::iterator it = image_info_map_.begin();
+  for (; it != image_info_map_.end(); ++it) {
+    workers.push_back(std::unique_ptr<ImageWorker>(
+        new ImageWorker(this, it->second)));
   }
 
+  size_t num_threads = std::min(num_threads_, workers.size());
+  if (num_threads <= 1) {
+    for (const auto& worker : workers)
+      worker->Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("PEHacker",
+                                        static_cast<int>(num_threads));
+    for (const auto& worker : workers)
+      pool.AddWork(worker.get());
+    pool.Start();
+    pool.JoinAll();
+  }
+
+  // Report all the failures rather than stopping at the first one, as the
+  // other images were processed regardless.
+  bool succeeded = true;
+  for (const auto& worker : workers) {
+    if (!worker->succeeded())
+      succeeded = false;
+  }
+  return succeeded;
+}
+
+bool PEHackerApp::ProcessImage(ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+
+  if (!image_info->pe_file.Init(image_info->input_module)) {
+    LOG(ERROR) << "Failed to read image: " << image_info->input_module.value();
+    return false;
+  }
+
+  if (!base::CreateDirectory(image_info->output_module.DirName())) {
+    LOG(ERROR) << "Failed to create output directory \""
+               << image_info->output_module.DirName().value() << "\".";
+    return false;
+  }
+
+  // Use the fast path if all the operations are import table edits.
+  if (ImportTablePatcher::CanPatch(image_info->pe_file)) {
+    ImportTablePatcher patcher;
+    bool can_patch = true;
+    for (const OperationInterface* operation : image_info->operations) {
+      if (!operation->ApplyToImportTable(&patcher)) {
+        can_patch = false;
+        break;
+      }
+    }
+    if (can_patch)
+      return PatchImage(image_info, &patcher);
+  }
+
+  if (!DecomposeImage(image_info))
+    return false;
+
+  for (OperationInterface* operation : image_info->operations) {
+    LOG(INFO) << "Applying operation \"" << operation->name() << "\" to \""
+              << image_info->input_module.value() << "\".";
+    if (!operation->Apply(&image_info->policy,
+                          &image_info->block_graph,
+                          image_info->header_block)) {
+      LOG(ERROR) << "Failed to apply \"" << operation->name() << "\".";
+      return false;
+    }
+  }
+
+  return WriteImage(image_info);
+}
+
+bool PEHackerApp::PatchImage(ImageInfo* image_info,
+                             ImportTablePatcher* patcher) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+  DCHECK_NE(reinterpret_cast<ImportTablePatcher*>(NULL), patcher);
+
+  LOG(INFO) << "Patching the import table of \""
+            << image_info->input_module.value() << "\" into \""
+            << image_info->output_module.value() << "\".";
+  if (!patcher->Patch(image_info->pe_file, image_info->output_module))
+    return false;
+
+  // The debug directory is untouched, so the original PDB still matches.
+  if (image_info->output_pdb != image_info->input_pdb &&
+      !base::CopyFile(image_info->input_pdb, image_info->output_pdb)) {
+    LOG(ERROR) << "Failed to copy PDB \"" << image_info->input_pdb.value()
+               << "\" to \"" << image_info->output_pdb.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool PEHackerApp::DecomposeImage(ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+
   // Decompose the image.
   pe::ImageLayout image_layout(&image_info->block_graph);
   pe::Decomposer decomposer(image_info->pe_file);
   if (!decomposer.Decompose(&image_layout)) {
-    LOG(ERROR) << "Failed to decompose image: " << input_module.value();
-    return NULL;
+    LOG(ERROR) << "Failed to decompose image: "
+               << image_info->input_module.value();
+    return false;
   }
 
   // Lookup the header block.
@@ -478,102 +679,95 @@ PEHackerApp::ImageInfo* PEHackerApp::GetImageInfo(
   // when finalizing the PDB.
   pe::GetOmapRange(image_layout.sections, &image_info->input_omap_range);
 
-  // Decomposition was successful. Add it to the map, transfer the image info to
-  // the scoped array and return it.
-  it = image_info_map_.insert(std::make_pair(image_id, image_info.get())).first;
-  image_infos_.push_back(image_info.release());
-  return it->second;
+  return true;
 }
 
-bool PEHackerApp::WriteImages() {
-  ImageInfoMap::iterator it = image_info_map_.begin();
-  for (; it != image_info_map_.end(); ++it) {
-    ImageInfo* image_info = it->second;
-
-    LOG(INFO) << "Finalizing and writing image \""
-              << image_info->output_module.value() << "\".";
+bool PEHackerApp::WriteImage(ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
 
-    // Create a GUID for the output PDB.
-    GUID pdb_guid = {};
-    if (FAILED(::CoCreateGuid(&pdb_guid))) {
-      LOG(ERROR) << "Failed to create new GUID for output PDB.";
-      return false;
-    }
+  LOG(INFO) << "Finalizing and writing image \""
+            << image_info->output_module.value() << "\".";
 
-    // Finalize the block-graph.
-    VLOG(1) << "Finalizing the block-graph.";
-    if (!pe::FinalizeBlockGraph(image_info->input_module,
-                                image_info->output_pdb,
-                                pdb_guid,
-                                true,
-                                &policy_,
-                                &image_info->block_graph,
-                                image_info->header_block)) {
-      return false;
-    }
+  // Create a GUID for the output PDB.
+  GUID pdb_guid = {};
+  if (FAILED(::CoCreateGuid(&pdb_guid))) {
+    LOG(ERROR) << "Failed to create new GUID for output PDB.";
+    return false;
+  }
 
-    // Build the ordered block-graph.
-    block_graph::OrderedBlockGraph ordered_block_graph(
-        &image_info->block_graph);
-    block_graph::orderers::OriginalOrderer orderer;
-    VLOG(1) << "Ordering the block-graph.";
-    if (!orderer.OrderBlockGraph(&ordered_block_graph,
-                                 image_info->header_block)) {
-      return false;
-    }
+  // Finalize the block-graph.
+  VLOG(1) << "Finalizing the block-graph.";
+  if (!pe::FinalizeBlockGraph(image_info->input_module,
+                              image_info->output_pdb,
+                              pdb_guid,
+                              true,
+                              &policy_,
+                              &image_info->block_graph,
+                              image_info->header_block)) {
+    return false;
+  }
 
-    // Finalize the ordered block-graph.
-    VLOG(1) << "Finalizing the ordered block-graph.";
-    if (!pe::FinalizeOrderedBlockGraph(&ordered_block_graph,
-                                       image_info->header_block)) {
-      return false;
-    }
+  // Build the ordered block-graph.
+  block_graph::OrderedBlockGraph ordered_block_graph(
+      &image_info->block_graph);
+  block_graph::orderers::OriginalOrderer orderer;
+  VLOG(1) << "Ordering the block-graph.";
+  if (!orderer.OrderBlockGraph(&ordered_block_graph,
+                               image_info->header_block)) {
+    return false;
+  }
 
-    // Build the image layout.
-    pe::ImageLayout image_layout(&image_info->block_graph);
-    VLOG(1) << "Building the image layout.";
-    if (!pe::BuildImageLayout(0, 1, ordered_block_graph,
-                              image_info->header_block, &image_layout)) {
-      return false;
-    }
+  // Finalize the ordered block-graph.
+  VLOG(1) << "Finalizing the ordered block-graph.";
+  if (!pe::FinalizeOrderedBlockGraph(&ordered_block_graph,
+                                     image_info->header_block)) {
+    return false;
+  }
 
-    // Write the image.
-    pe::PEFileWriter pe_writer(image_layout);
-    VLOG(1) << "Writing image to disk.";
-    if (!pe_writer.WriteImage(image_info->output_module))
-      return false;
+  // Build the image layout.
+  pe::ImageLayout image_layout(&image_info->block_graph);
+  VLOG(1) << "Building the image layout.";
+  if (!pe::BuildImageLayout(0, 1, ordered_block_graph,
+                            image_info->header_block, &image_layout)) {
+    return false;
+  }
 
-    LOG(INFO) << "Finalizing and writing PDB file \""
-              << image_info->output_pdb.value() << "\".";
+  // Write the image.
+  pe::PEFileWriter pe_writer(image_layout);
+  VLOG(1) << "Writing image to disk.";
+  if (!pe_writer.WriteImage(image_info->output_module))
+    return false;
 
-    // Parse the original PDB.
-    pdb::PdbFile pdb_file;
-    pdb::PdbReader pdb_reader;
-    VLOG(1) << "Reading original PDB.";
-    if (!pdb_reader.Read(image_info->input_pdb, &pdb_file))
-      return false;
+  LOG(INFO) << "Finalizing and writing PDB file \""
+            << image_info->output_pdb.value() << "\".";
 
-    // Finalize the PDB to reflect the transformed image.
-    VLOG(1) << "Finalizing PDB.";
-    if (!pe::FinalizePdbFile(image_info->input_module,
-                             image_info->output_module,
-                             image_info->input_omap_range,
-                             image_layout,
-                             pdb_guid,
-                             false,
-                             false,
-                             false,
-                             &pdb_file)) {
-      return false;
-    }
+  // Parse the original PDB.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  VLOG(1) << "Reading original PDB.";
+  if (!pdb_reader.Read(image_info->input_pdb, &pdb_file))
+    return false;
 
-    // Write the PDB.
-    pdb::PdbWriter pdb_writer;
-    VLOG(1) << "Writing transformed PDB.";
-    if (!pdb_writer.Write(image_info->output_pdb, pdb_file))
-      return false;
+  // Finalize the PDB to reflect the transformed image.
+  VLOG(1) << "Finalizing PDB.";
+  if (!pe::FinalizePdbFile(image_info->input_module,
+                           image_info->output_module,
+                           image_info->input_omap_range,
+                           image_layout,
+                           pdb_guid,
+                           false,
+                           false,
+                           false,
+                           &pdb_file)) {
+    return false;
   }
 
+  // Write the PDB.
+  pdb::PdbWriter pdb_writer;
+  VLOG(1) << "Writing transformed PDB.";
+  if (!pdb_writer.Write(image_info->output_pdb, pdb_file))
+    return false;
+
   return true;
 }
 
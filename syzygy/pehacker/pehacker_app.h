@@ -29,6 +29,7 @@
 #include "syzygy/pe/image_source_map.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/pehacker/operation.h"
 
 namespace pehacker {
 
@@ -39,7 +40,9 @@ namespace pehacker {
 class PEHackerApp : public application::AppImplBase {
  public:
   PEHackerApp()
-      : application::AppImplBase("PEHacker"), overwrite_(false) {
+      : application::AppImplBase("PEHacker"),
+        overwrite_(false),
+        num_threads_(0) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -72,8 +75,17 @@ class PEHackerApp : public application::AppImplBase {
     BlockGraph block_graph;
     BlockGraph::Block* header_block;
     pe::RelativeAddressRange input_omap_range;
+    // The operations to apply to the module, in order.
+    ScopedVector<OperationInterface> operations;
+    // The policy used in applying the operations. The modules are processed
+    // concurrently, and the policy caches its results, so each module has
+    // its own.
+    pe::PETransformPolicy policy;
   };
 
+  // Processes an image on a worker thread.
+  class ImageWorker;
+
   typedef std::map<ImageId, ImageInfo*> ImageInfoMap;
 
   // @name Utility members.
@@ -104,9 +116,15 @@ class PEHackerApp : public application::AppImplBase {
   // @name For processing the configuration file.
   // @{
   // @param dry_run If this is true then no actual work is done, but the
-  //     configuration file is validated.
+  //     configuration file is validated. Otherwise the operations are
+  //     queued on the images they apply to, for ProcessImages to apply.
   // @param targets A list of targets to process.
-  // @param target A target to process.
+  // @param target A target to process. It either names a single module, or
+  //     lists "input_modules" that are written to an "output_dir".
+  // @param input_module The path to the input module of a target.
+  // @param output_module The path to the output module of a target.
+  // @param input_pdb The path to the input PDB of a target, or empty.
+  // @param output_pdb The path to the output PDB of a target, or empty.
   // @param operations A list of operations to process.
   // @param operation An operation to process.
   // @param image_info Information about the image being transformed.
@@ -114,6 +132,12 @@ class PEHackerApp : public application::AppImplBase {
   bool ProcessConfigurationFile(bool dry_run);
   bool ProcessTargets(bool dry_run, base::ListValue* targets);
   bool ProcessTarget(bool dry_run, base::DictionaryValue* target);
+  bool ProcessModule(bool dry_run,
+                     const base::FilePath& input_module,
+                     const base::FilePath& output_module,
+                     base::FilePath input_pdb,
+                     base::FilePath output_pdb,
+                     base::ListValue* operations);
   bool ProcessOperations(bool dry_run,
                          base::ListValue* operations,
                          ImageInfo* image_info);
@@ -122,26 +146,46 @@ class PEHackerApp : public application::AppImplBase {
                         ImageInfo* image_info);
   // @}
 
-  // Looks up the already decomposed image, or loads and decomposes it for the
-  // first time.
+  // Looks up the image, or adds it for the first time.
   // @param input_module The path to the input module.
   // @param output_module The path to the output module.
   // @param input_pdb The path to the input PDB.
   // @param output_pdb The path to the output PDB.
-  // @returns a pointer to the ImageInfo for the requested image. Returns NULL
-  //     on failure.
+  // @returns a pointer to the ImageInfo for the requested image.
   ImageInfo* GetImageInfo(const base::FilePath& input_module,
                           const base::FilePath& output_module,
                           const base::FilePath& input_pdb,
                           const base::FilePath& output_pdb);
 
-  // Writes any transformed images back to disk.
+  // Applies the queued operations to the images and writes them back to
+  // disk. The images are processed concurrently, on up to num_threads_
+  // worker threads.
   // @returns true on success, false otherwise.
-  bool WriteImages();
+  bool ProcessImages();
+
+  // @name For processing an image. These are called on worker threads.
+  //
+  // ProcessImage applies the operations to an image and writes it back to
+  // disk. Images whose operations all support it are patched directly by
+  // PatchImage, and the others are decomposed.
+  // @{
+  // @param image_info The image to process.
+  // @param patcher The patcher holding the operations of the image.
+  // @returns true on success, false otherwise.
+  bool ProcessImage(ImageInfo* image_info);
+  // Patches an image with ImportTablePatcher. The PDB of the image still
+  // matches the patched image, and is copied alongside it.
+  bool PatchImage(ImageInfo* image_info, ImportTablePatcher* patcher);
+  // Decomposes an image.
+  bool DecomposeImage(ImageInfo* image_info);
+  // Writes a transformed image and its PDB back to disk.
+  bool WriteImage(ImageInfo* image_info);
+  // @}
 
   // @name Command-line parameters.
   base::FilePath config_file_;
   bool overwrite_;
+  size_t num_threads_;
   // @}
 
   // Dictionary of variables. We use a JSON dictionary so that it can easily
@@ -155,7 +199,7 @@ class PEHackerApp : public application::AppImplBase {
   ScopedVector<ImageInfo> image_infos_;
   ImageInfoMap image_info_map_;
 
-  // The policy object used by the various transforms.
+  // The policy object used to initialize the operations.
   pe::PETransformPolicy policy_;
 };
 
@@ -46,6 +46,8 @@ static wchar_t kConfigGoodNestedVariables[] =
     L"syzygy/pehacker/test_data/config-good-nested-variables.txt";
 static wchar_t kConfigGoodNop[] =
     L"syzygy/pehacker/test_data/config-good-nop.txt";
+static wchar_t kConfigGoodBatch[] =
+    L"syzygy/pehacker/test_data/config-good-batch.txt";
 
 class TestPEHackerApp : public PEHackerApp {
  public:
@@ -314,4 +316,24 @@ TEST_F(PEHackerAppTest, RunNop) {
   EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module));
 }
 
+TEST_F(PEHackerAppTest, RunBatch) {
+  base::FilePath input_module = testing::GetOutputRelativePath(
+      testing::kTestDllName);
+  base::FilePath output_dir = temp_dir_.Append(L"batch");
+  base::FilePath output_module = output_dir.Append(testing::kTestDllName);
+
+  config_file_ = testing::GetSrcRelativePath(kConfigGoodBatch);
+  cmd_line_.AppendSwitchPath("config-file", config_file_);
+  cmd_line_.AppendSwitchPath("Dinput_module", input_module);
+  cmd_line_.AppendSwitchPath("Doutput_dir", output_dir);
+  cmd_line_.AppendSwitchASCII("num-threads", "2");
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  // The module only has imports added, so it is patched and its PDB copied.
+  EXPECT_EQ(0, test_impl_.Run());
+  EXPECT_TRUE(base::PathExists(output_module));
+  EXPECT_TRUE(base::PathExists(output_dir.Append(testing::kTestDllPdbName)));
+  EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module));
+}
+
 }  // namespace pehacker
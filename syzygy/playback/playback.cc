@@ -14,8 +14,11 @@
 
 #include "syzygy/playback/playback.h"
 
+#include <memory>
+
 #include "syzygy/core/address.h"
 #include "syzygy/pdb/omap.h"
+#include "syzygy/pe/decomposition_cache.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/pe/metadata.h"
 #include "syzygy/pe/pe_file.h"
@@ -123,6 +126,22 @@ bool Playback::InitializeParser() {
 }
 
 bool Playback::LoadInstrumentedOmap() {
+  // The OMAP data is keyed by the instrumented module in the cache.
+  std::unique_ptr<pe::DecompositionCache> cache(
+      pe::DecompositionCache::Create(decomposition_cache_dir_));
+  pe::PEFile instrumented_pe_file;
+  if (cache.get() != NULL) {
+    if (!instrumented_pe_file.Init(instrumented_path_)) {
+      LOG(ERROR) << "Unable to parse instrumented module: "
+                 << instrumented_path_.value();
+      return false;
+    }
+    if (cache->LoadOmap(instrumented_pe_file, &omap_to_, &omap_from_)) {
+      omap_to_translator_.Init(&omap_to_);
+      return true;
+    }
+  }
+
   // Find the PDB file for the instrumented module.
   base::FilePath instrumented_pdb;
   if (!pe::FindPdbForModule(instrumented_path_, &instrumented_pdb) ||
@@ -142,6 +161,13 @@ bool Playback::LoadInstrumentedOmap() {
     return false;
   }
   LOG(INFO) << "Read OMAP data from instrumented module PDB.";
+  omap_to_translator_.Init(&omap_to_);
+
+  // Failing to update the cache only costs the next run a read of the PDB.
+  if (cache.get() != NULL &&
+      !cache->SaveOmap(instrumented_pe_file, omap_to_, omap_from_)) {
+    LOG(WARNING) << "Unable to update the decomposition cache.";
+  }
 
   return true;
 }
@@ -153,13 +179,30 @@ bool Playback::DecomposeImage() {
   BlockGraph* block_graph = image_->blocks.graph();
   ImageLayout image(block_graph);
 
-  // Decompose the DLL to be reordered. This will let us map call-trace events
-  // to actual Blocks.
-  LOG(INFO) << "Decomposing input image: " << module_path_.value();
-  Decomposer decomposer(*pe_file_);
-  if (!decomposer.Decompose(&image)) {
-    LOG(ERROR) << "Unable to decompose input image: " << module_path_.value();
-    return false;
+  std::unique_ptr<pe::DecompositionCache> cache(
+      pe::DecompositionCache::Create(decomposition_cache_dir_));
+
+  if (cache.get() == NULL || !cache->Load(*pe_file_, &image)) {
+    // A corrupt cache entry may have been partially loaded.
+    if (!block_graph->blocks().empty()) {
+      LOG(ERROR) << "Unable to load input image from the decomposition "
+                 << "cache: " << module_path_.value();
+      return false;
+    }
+
+    // Decompose the DLL to be reordered. This will let us map call-trace
+    // events to actual Blocks.
+    LOG(INFO) << "Decomposing input image: " << module_path_.value();
+    Decomposer decomposer(*pe_file_);
+    if (!decomposer.Decompose(&image)) {
+      LOG(ERROR) << "Unable to decompose input image: "
+                 << module_path_.value();
+      return false;
+    }
+
+    // Failing to update the cache only costs the next run a decomposition.
+    if (cache.get() != NULL && !cache->Save(*pe_file_, image))
+      LOG(WARNING) << "Unable to update the decomposition cache.";
   }
 
   // Make a copy of the image layout without padding blocks, which are
@@ -225,6 +268,15 @@ bool Playback::MatchesInstrumentedModuleSignature(
 const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
     DWORD process_id, FuncAddr function, bool* error) {
   DCHECK(parser_ != NULL);
+  return FindFunctionBlock(parser_, process_id, function, error);
+}
+
+const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
+    const Parser* parser,
+    DWORD process_id,
+    FuncAddr function,
+    bool* error) const {
+  DCHECK(parser != NULL);
   DCHECK(image_ != NULL);
   DCHECK(error != NULL);
 
@@ -235,7 +287,7 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
 
   // Resolve the module in which the called function resides.
   const ModuleInformation* module_info =
-      parser_->GetModuleInformation(process_id, abs_address);
+      parser->GetModuleInformation(process_id, abs_address);
 
   // We should be able to resolve the instrumented module.
   if (module_info == NULL) {
@@ -257,7 +309,7 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
 
   // Convert the address from one in the instrumented module to one in the
   // original module using the OMAP data.
-  rva = pdb::TranslateAddressViaOmap(omap_to(), rva);
+  rva = omap_to_translator_.Translate(rva);
 
   // Get the block that this function call refers to.
   const BlockGraph::Block* block = image_->blocks.GetBlockByAddress(rva);
@@ -19,6 +19,11 @@
 // and provides functionality for mapping trace events back to
 // addresses/blocks in the original module.
 //
+// If a decomposition cache directory is given, the decomposition of the
+// original module and the OMAP data of the instrumented module are loaded
+// from it, and saved to it when they are not found, so that the repeated
+// reorder and simulate runs over the same modules skip the expensive steps.
+//
 // Playback playback(module_path, instrumented_path, trace_files);
 // playback.Init(pe_file, image, parser)
 // playback.ConsumeCallTraceEvents()
@@ -82,8 +87,26 @@ class Playback {
                                              FuncAddr function,
                                              bool* error);
 
+  // Gets a code block from our image from its function address and process
+  // id, as seen by another parser than the one of the playback. This only
+  // reads the decomposed image and the OMAP information, so it may be called
+  // concurrently by parsers of different trace files.
+  // @param parser The parser of the trace file holding the event.
+  // @param process_id The process id of the module where the function resides.
+  // @param function The relative address of the function we are searching.
+  // @param error Will be set to true if an error occurs.
+  // @returns The code block @p function and @p process_id refer to, or NULL,
+  //     as FindFunctionBlock.
+  const BlockGraph::Block* FindFunctionBlock(const Parser* parser,
+                                             DWORD process_id,
+                                             FuncAddr function,
+                                             bool* error) const;
+
   // @name Accessors
   // @{
+  const base::FilePath& decomposition_cache_dir() const {
+    return decomposition_cache_dir_;
+  }
   const PEFile* pe_file() const { return pe_file_; }
   const ImageLayout* image() const { return image_; }
   const TraceFileList& trace_files() const { return trace_files_; }
@@ -92,6 +115,16 @@ class Playback {
   const PEFile::Signature& instr_signature() const { return instr_signature_; }
   // @}
 
+  // Sets the directory of the decomposition cache. Must be called before
+  // Init.
+  // @param decomposition_cache_dir The directory of the cache, or an empty
+  //     path to use the one named by the environment, if any. See
+  //     pe::DecompositionCache::Create.
+  void set_decomposition_cache_dir(
+      const base::FilePath& decomposition_cache_dir) {
+    decomposition_cache_dir_ = decomposition_cache_dir;
+  }
+
  protected:
   typedef pe::Decomposer Decomposer;
   typedef TraceFileList::iterator TraceFileIter;
@@ -119,6 +152,9 @@ class Playback {
   base::FilePath instrumented_path_;
   TraceFileList trace_files_;
 
+  // The directory of the decomposition cache, if any.
+  base::FilePath decomposition_cache_dir_;
+
   // This is a copy of the parser used to decompose the image, which needs
   // to be initialized with a ParseEventHandler before being used.
   Parser* parser_;
@@ -138,6 +174,10 @@ class Playback {
   std::vector<OMAP> omap_to_;
   std::vector<OMAP> omap_from_;
 
+  // Maps the addresses of the call-trace events through omap_to_, which is
+  // done once per event.
+  pdb::OmapTranslator omap_to_translator_;
+
   // Signature of the instrumented DLL. Used for filtering call-trace events.
   PEFile::Signature instr_signature_;
 };
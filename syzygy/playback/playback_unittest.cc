@@ -16,6 +16,7 @@
 
 #include <string>
 
+#include "base/files/file_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -122,6 +123,34 @@ TEST_F(PlaybackTest, SuccessfulInit) {
   EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
 }
 
+TEST_F(PlaybackTest, InitWithDecompositionCache) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath cache_dir = temp_dir.Append(L"cache");
+
+  // The first run populates the cache.
+  EXPECT_TRUE(Init());
+  playback_->set_decomposition_cache_dir(cache_dir);
+  EXPECT_EQ(cache_dir, playback_->decomposition_cache_dir());
+  ASSERT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
+  EXPECT_TRUE(base::PathExists(cache_dir));
+
+  // The second run loads the same decomposition and OMAP data from it.
+  pe::PEFile input_dll;
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  TestParser parser;
+  MockParseEventHandler parse_event_handler;
+  ASSERT_TRUE(parser.Init(&parse_event_handler));
+  Playback playback(module_path_, instrumented_path_, trace_files_);
+  playback.set_decomposition_cache_dir(cache_dir);
+  ASSERT_TRUE(playback.Init(&input_dll, &image_layout, &parser));
+
+  EXPECT_EQ(block_graph_.blocks().size(), block_graph.blocks().size());
+  EXPECT_EQ(playback_->omap_to().size(), playback.omap_to().size());
+  EXPECT_EQ(playback_->omap_from().size(), playback.omap_from().size());
+}
+
 TEST_F(PlaybackTest, ConsumeCallTraceEvents) {
   EXPECT_TRUE(Init());
   EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
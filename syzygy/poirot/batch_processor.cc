@@ -0,0 +1,158 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/poirot/batch_processor.h"
+
+#include <algorithm>
+#include <string>
+
+#include "base/files/file_enumerator.h"
+#include "base/files/file_util.h"
+#include "base/json/string_escape.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_split.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/poirot/minidump_processor.h"
+
+namespace poirot {
+
+// Processes every |stride|-th minidump of a batch.
+class BatchProcessor::Task : public base::DelegateSimpleThread::Delegate {
+ public:
+  Task(BatchProcessor* owner,
+       const std::vector<base::FilePath>* minidumps,
+       size_t first,
+       size_t stride)
+      : owner_(owner),
+        minidumps_(minidumps),
+        first_(first),
+        stride_(stride),
+        succeeded_(true) {}
+
+  void Run() override {
+    for (size_t i = first_; i < minidumps_->size(); i += stride_) {
+      if (!owner_->ProcessDump((*minidumps_)[i]))
+        succeeded_ = false;
+    }
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  BatchProcessor* owner_;
+  const std::vector<base::FilePath>* minidumps_;
+  size_t first_;
+  size_t stride_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(Task);
+};
+
+BatchProcessor::BatchProcessor(FILE* output)
+    : output_(output), num_threads_(1) {
+  DCHECK_NE(static_cast<FILE*>(nullptr), output);
+}
+
+bool BatchProcessor::ProcessDumps(
+    const std::vector<base::FilePath>& minidumps) {
+  size_t num_threads = std::min(num_threads_, minidumps.size());
+  if (num_threads <= 1) {
+    bool succeeded = true;
+    for (const auto& minidump : minidumps) {
+      if (!ProcessDump(minidump))
+        succeeded = false;
+    }
+    return succeeded;
+  }
+
+  ScopedVector<Task> tasks;
+  base::DelegateSimpleThreadPool pool("PoirotBatch",
+                                      static_cast<int>(num_threads));
+  pool.Start();
+  for (size_t i = 0; i < num_threads; ++i) {
+    tasks.push_back(new Task(this, &minidumps, i, num_threads));
+    pool.AddWork(tasks.back());
+  }
+  pool.JoinAll();
+
+  return std::all_of(tasks.begin(), tasks.end(),
+                     [](const Task* task) { return task->succeeded(); });
+}
+
+// static
+void BatchProcessor::GetMinidumpsInDirectory(
+    const base::FilePath& directory,
+    std::vector<base::FilePath>* minidumps) {
+  DCHECK_NE(static_cast<std::vector<base::FilePath>*>(nullptr), minidumps);
+  minidumps->clear();
+
+  base::FileEnumerator enumerator(directory, false,
+                                  base::FileEnumerator::FILES, L"*.dmp");
+  for (base::FilePath minidump = enumerator.Next(); !minidump.empty();
+       minidump = enumerator.Next()) {
+    minidumps->push_back(minidump);
+  }
+
+  // The enumeration order isn't specified, sorting keeps the runs stable.
+  std::sort(minidumps->begin(), minidumps->end());
+}
+
+// static
+bool BatchProcessor::ReadMinidumpList(const base::FilePath& list_file,
+                                      std::vector<base::FilePath>* minidumps) {
+  DCHECK_NE(static_cast<std::vector<base::FilePath>*>(nullptr), minidumps);
+  minidumps->clear();
+
+  std::string contents;
+  if (!base::ReadFileToString(list_file, &contents)) {
+    LOG(ERROR) << "Unable to read the minidump list '" << list_file.value()
+               << "'.";
+    return false;
+  }
+
+  for (const std::string& line :
+       base::SplitString(contents, "\r\n", base::TRIM_WHITESPACE,
+                         base::SPLIT_WANT_NONEMPTY)) {
+    minidumps->push_back(base::FilePath(base::UTF8ToWide(line)));
+  }
+  return true;
+}
+
+bool BatchProcessor::ProcessDump(const base::FilePath& minidump) {
+  // The processing happens outside of the lock, only the output is
+  // serialized.
+  MinidumpProcessor processor(minidump);
+  std::string crash_data;
+  bool succeeded =
+      processor.ProcessDump() && processor.GenerateJson(false, &crash_data);
+
+  std::string result = "{\"minidump\": ";
+  base::EscapeJSONString(minidump.AsUTF8Unsafe(), true, &result);
+  if (succeeded) {
+    result += ", \"crash_data\": " + crash_data;
+  } else {
+    LOG(ERROR) << "Unable to process the minidump '" << minidump.value()
+               << "'.";
+    result += ", \"error\": true";
+  }
+  result += "}\n";
+
+  base::AutoLock auto_lock(output_lock_);
+  ::fwrite(result.data(), 1, result.size(), output_);
+  ::fflush(output_);
+  return succeeded;
+}
+
+}  // namespace poirot
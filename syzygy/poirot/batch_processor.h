@@ -0,0 +1,94 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a processor of batches of minidumps.
+
+#ifndef SYZYGY_POIROT_BATCH_PROCESSOR_H_
+#define SYZYGY_POIROT_BATCH_PROCESSOR_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
+
+namespace poirot {
+
+// The BatchProcessor processes many minidumps on a pool of workers, as the
+// daily triage does, and streams out the results as they complete. Each
+// result is a JSON object on a line of its own, so that the output can be
+// consumed before the batch completes:
+//   {"minidump": "<path>", "crash_data": <crash data>}
+// or, for a minidump that failed to process:
+//   {"minidump": "<path>", "error": true}
+class BatchProcessor {
+ public:
+  // Constructor.
+  // @param output The file to which the results are streamed.
+  explicit BatchProcessor(FILE* output);
+
+  // Process the minidumps.
+  // @param minidumps The minidumps to process.
+  // @returns true if all of the minidumps were processed, false otherwise.
+  bool ProcessDumps(const std::vector<base::FilePath>& minidumps);
+
+  // @name Accessors and mutators.
+  // @{
+  // The number of workers that process the minidumps (default: 1).
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0U, num_threads);
+    num_threads_ = num_threads;
+  }
+  // @}
+
+  // Gets the minidumps in a directory.
+  // @param directory The directory to enumerate, non-recursively.
+  // @param minidumps Receives the paths of the .dmp files of the directory,
+  //     sorted.
+  static void GetMinidumpsInDirectory(const base::FilePath& directory,
+                                      std::vector<base::FilePath>* minidumps);
+
+  // Reads a list of minidumps.
+  // @param list_file A file holding a path per line. Blank lines are
+  //     ignored.
+  // @param minidumps Receives the paths.
+  // @returns true on success, false otherwise.
+  static bool ReadMinidumpList(const base::FilePath& list_file,
+                               std::vector<base::FilePath>* minidumps);
+
+ private:
+  class Task;
+
+  // Processes a minidump and streams out its result.
+  // @param minidump The minidump to process.
+  // @returns true on success, false otherwise.
+  bool ProcessDump(const base::FilePath& minidump);
+
+  // The file to which the results are streamed.
+  FILE* output_;
+  // Serializes the writes to |output_|.
+  base::Lock output_lock_;
+
+  size_t num_threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchProcessor);
+};
+
+}  // namespace poirot
+
+#endif  // SYZYGY_POIROT_BATCH_PROCESSOR_H_
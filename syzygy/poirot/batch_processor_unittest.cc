@@ -0,0 +1,133 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/poirot/batch_processor.h"
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_file.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/poirot/unittest_util.h"
+
+namespace poirot {
+
+namespace {
+
+class BatchProcessorTest : public testing::Test {
+ protected:
+  void SetUp() override { ASSERT_TRUE(temp_dir_.CreateUniqueTempDir()); }
+
+  // Processes |minidumps| and gets the result lines.
+  void ProcessDumps(size_t num_threads,
+                    const std::vector<base::FilePath>& minidumps,
+                    bool* result,
+                    std::vector<std::string>* lines) {
+    base::FilePath output_path = temp_dir_.path().Append(L"output.json");
+    {
+      base::ScopedFILE output(base::OpenFile(output_path, "wb"));
+      ASSERT_TRUE(output.get());
+      BatchProcessor processor(output.get());
+      processor.set_num_threads(num_threads);
+      *result = processor.ProcessDumps(minidumps);
+    }
+
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(output_path, &contents));
+    *lines = base::SplitString(contents, "\n", base::KEEP_WHITESPACE,
+                               base::SPLIT_WANT_NONEMPTY);
+  }
+
+  base::ScopedTempDir temp_dir_;
+};
+
+}  // namespace
+
+TEST_F(BatchProcessorTest, ProcessDumps) {
+  std::vector<base::FilePath> minidumps;
+  for (size_t i = 0; i < 5; ++i)
+    minidumps.push_back(testing::GetSrcRelativePath(testing::kMinidumpUAF));
+
+  for (size_t num_threads = 1; num_threads <= 3; ++num_threads) {
+    bool result = false;
+    std::vector<std::string> lines;
+    ASSERT_NO_FATAL_FAILURE(ProcessDumps(num_threads, minidumps, &result,
+                                         &lines));
+    EXPECT_TRUE(result);
+    ASSERT_EQ(minidumps.size(), lines.size());
+    for (const std::string& line : lines) {
+      EXPECT_TRUE(base::StartsWith(line, "{\"minidump\": ",
+                                   base::CompareCase::SENSITIVE));
+      EXPECT_NE(std::string::npos, line.find("\"crash_data\": "));
+    }
+  }
+}
+
+TEST_F(BatchProcessorTest, ProcessDumpsContinuesAfterFailure) {
+  std::vector<base::FilePath> minidumps;
+  minidumps.push_back(
+      testing::GetSrcRelativePath(testing::kMinidumpNoKaskoStream));
+  minidumps.push_back(testing::GetSrcRelativePath(testing::kMinidumpUAF));
+  minidumps.push_back(
+      testing::GetSrcRelativePath(testing::kMinidumpInvalidPath));
+
+  bool result = true;
+  std::vector<std::string> lines;
+  ASSERT_NO_FATAL_FAILURE(ProcessDumps(2, minidumps, &result, &lines));
+  EXPECT_FALSE(result);
+  ASSERT_EQ(3U, lines.size());
+
+  size_t errors = 0;
+  for (const std::string& line : lines) {
+    if (line.find("\"error\": true") != std::string::npos)
+      ++errors;
+  }
+  EXPECT_EQ(2U, errors);
+}
+
+TEST_F(BatchProcessorTest, GetMinidumpsInDirectory) {
+  std::vector<base::FilePath> minidumps;
+  BatchProcessor::GetMinidumpsInDirectory(
+      testing::GetSrcRelativePath(testing::kMinidumpUAF).DirName(),
+      &minidumps);
+  ASSERT_EQ(2U, minidumps.size());
+  EXPECT_SAME_FILE(
+      testing::GetSrcRelativePath(testing::kMinidumpNoKaskoStream),
+      minidumps[0]);
+  EXPECT_SAME_FILE(testing::GetSrcRelativePath(testing::kMinidumpUAF),
+                   minidumps[1]);
+}
+
+TEST_F(BatchProcessorTest, ReadMinidumpList) {
+  base::FilePath list_path = temp_dir_.path().Append(L"list.txt");
+  static const char kList[] = "C:\\foo.dmp\r\n\r\n  C:\\bar baz.dmp\n";
+  ASSERT_EQ(static_cast<int>(sizeof(kList) - 1),
+            base::WriteFile(list_path, kList, sizeof(kList) - 1));
+
+  std::vector<base::FilePath> minidumps;
+  ASSERT_TRUE(BatchProcessor::ReadMinidumpList(list_path, &minidumps));
+  ASSERT_EQ(2U, minidumps.size());
+  EXPECT_EQ(base::FilePath(L"C:\\foo.dmp"), minidumps[0]);
+  EXPECT_EQ(base::FilePath(L"C:\\bar baz.dmp"), minidumps[1]);
+
+  EXPECT_FALSE(BatchProcessor::ReadMinidumpList(
+      temp_dir_.path().Append(L"missing.txt"), &minidumps));
+}
+
+}  // namespace poirot
@@ -64,11 +64,21 @@ bool MinidumpProcessor::GenerateJsonOutput(FILE* file) {
   DCHECK(processed_);
 
   std::string out_str;
-  if (!crashdata::ToJson(true, &protobuf_value_, &out_str)) {
+  if (!GenerateJson(true, &out_str))
+    return false;
+  ::fprintf(file, "%s", out_str.c_str());
+  return true;
+}
+
+bool MinidumpProcessor::GenerateJson(bool pretty_print,
+                                     std::string* json) const {
+  DCHECK_NE(static_cast<std::string*>(nullptr), json);
+  DCHECK(processed_);
+
+  if (!crashdata::ToJson(pretty_print, &protobuf_value_, json)) {
     LOG(ERROR) << "Unable to convert the protobuf to JSON.";
     return false;
   }
-  ::fprintf(file, "%s", out_str.c_str());
   return true;
 }
 
@@ -35,6 +35,8 @@
       'target_name': 'poirot_lib',
       'type': 'static_library',
       'sources': [
+        'batch_processor.cc',
+        'batch_processor.h',
         'minidump_processor.cc',
         'minidump_processor.h',
         'poirot_app.cc',
@@ -63,6 +65,7 @@
       'target_name': 'poirot_unittests',
       'type': 'executable',
       'sources': [
+        'batch_processor_unittest.cc',
         'poirot_app_unittest.cc',
         'minidump_processor_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
@@ -14,9 +14,13 @@
 
 #include "syzygy/poirot/poirot_app.h"
 
+#include <vector>
+
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "syzygy/poirot/batch_processor.h"
 
 namespace poirot {
 
@@ -27,13 +31,22 @@ const char kUsageFormatStr[] =
     "\n"
     "  Read a minidump and extract the Kasko protobuf that is in it.\n"
     "\n"
-    "Required parameters\n"
+    "Required parameters, exactly one of\n"
     "  --input-minidump=<image file>\n"
     "      The minidump to process.\n"
+    "  --input-dir=<directory>\n"
+    "      Process the .dmp files of a directory in a batch.\n"
+    "  --input-list=<list file>\n"
+    "      Process the minidumps listed in a file, one per line, in a batch.\n"
     "Optional parameters\n"
     "  --output-file=<output file>\n"
     "      Optionally provide the name or path to the output file. If not\n"
-    "      provided, output will be to standard out.\n";
+    "      provided, output will be to standard out.\n"
+    "  --num-threads=<count>\n"
+    "      The number of workers that process a batch. Defaults to 1.\n"
+    "\n"
+    "  A batch streams out a JSON object per line, for each minidump as it\n"
+    "  completes.\n";
 
 }  // namespace
 
@@ -56,12 +69,28 @@ bool PoirotApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   }
 
   input_minidump_ = cmd_line->GetSwitchValuePath("input-minidump");
-  if (input_minidump_.empty()) {
+  input_dir_ = cmd_line->GetSwitchValuePath("input-dir");
+  input_list_ = cmd_line->GetSwitchValuePath("input-list");
+  int num_inputs = !input_minidump_.empty() + !input_dir_.empty() +
+                   !input_list_.empty();
+  if (num_inputs != 1) {
     PrintUsage(cmd_line->GetProgram(),
-               "Must specify '--input-minidump' parameter!");
+               "Must specify exactly one of the '--input-minidump', "
+               "'--input-dir' and '--input-list' parameters!");
     return false;
   }
 
+  if (cmd_line->HasSwitch("num-threads")) {
+    unsigned num_threads = 0;
+    if (!base::StringToUint(cmd_line->GetSwitchValueASCII("num-threads"),
+                            &num_threads) ||
+        num_threads == 0) {
+      PrintUsage(cmd_line->GetProgram(), "Invalid '--num-threads' value!");
+      return false;
+    }
+    num_threads_ = num_threads;
+  }
+
   // If no output file is specified stdout will be used.
   output_file_ = cmd_line->GetSwitchValuePath("output-file");
 
@@ -89,6 +118,22 @@ int PoirotApp::Run() {
     output_file = scoped_file.get();
   }
 
+  // Process a batch, if requested.
+  if (input_minidump_.empty()) {
+    std::vector<base::FilePath> minidumps;
+    if (!input_dir_.empty()) {
+      BatchProcessor::GetMinidumpsInDirectory(input_dir_, &minidumps);
+    } else if (!BatchProcessor::ReadMinidumpList(input_list_, &minidumps)) {
+      return 1;
+    }
+
+    BatchProcessor batch_processor(output_file);
+    batch_processor.set_num_threads(num_threads_);
+    if (!batch_processor.ProcessDumps(minidumps))
+      return 1;
+    return 0;
+  }
+
   // Do the processing.
   MinidumpProcessor processor(input_minidump_);
   if (!processor.ProcessDump())
@@ -31,7 +31,7 @@ class PoirotApp : public application::AppImplBase {
  public:
   // @name Implementation of the AppImplBase interface.
   // @{
-  PoirotApp() : application::AppImplBase("PoirotApp") {}
+  PoirotApp() : application::AppImplBase("PoirotApp"), num_threads_(1) {}
 
   bool ParseCommandLine(const base::CommandLine* command_line);
 
@@ -48,7 +48,10 @@ class PoirotApp : public application::AppImplBase {
   // @name Command-line options.
   // @{
   base::FilePath input_minidump_;
+  base::FilePath input_dir_;
+  base::FilePath input_list_;
   base::FilePath output_file_;
+  size_t num_threads_;
   // @}
 
  private:
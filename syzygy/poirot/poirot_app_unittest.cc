@@ -14,6 +14,10 @@
 
 #include "syzygy/poirot/poirot_app.h"
 
+#include <algorithm>
+#include <string>
+
+#include "base/files/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
@@ -25,7 +29,10 @@ namespace {
 
 class TestPoirotApp : public PoirotApp {
  public:
+  using PoirotApp::input_dir_;
+  using PoirotApp::input_list_;
   using PoirotApp::input_minidump_;
+  using PoirotApp::num_threads_;
   using PoirotApp::output_file_;
 };
 
@@ -109,6 +116,64 @@ TEST_F(PoirotAppTest, ParseFullCommandLineSucceeds) {
   EXPECT_SAME_FILE(temp_dir_.Append(L"foo.log"), test_impl_.output_file_);
 }
 
+TEST_F(PoirotAppTest, ParseBatchCommandLineSucceeds) {
+  cmd_line_.AppendSwitchPath("input-dir", temp_dir_);
+  cmd_line_.AppendSwitchASCII("num-threads", "4");
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_SAME_FILE(temp_dir_, test_impl_.input_dir_);
+  EXPECT_TRUE(test_impl_.input_minidump_.empty());
+  EXPECT_EQ(4U, test_impl_.num_threads_);
+}
+
+TEST_F(PoirotAppTest, ParseConflictingInputsFails) {
+  cmd_line_.AppendSwitchPath("input-minidump",
+      testing::GetSrcRelativePath(testing::kMinidumpUAF));
+  cmd_line_.AppendSwitchPath("input-list", temp_dir_.Append(L"list.txt"));
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(PoirotAppTest, ParseInvalidNumThreadsFails) {
+  cmd_line_.AppendSwitchPath("input-dir", temp_dir_);
+  cmd_line_.AppendSwitchASCII("num-threads", "0");
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(PoirotAppTest, ProcessBatch) {
+  base::FilePath list_file = temp_dir_.Append(L"list.txt");
+  std::string list = testing::GetSrcRelativePath(testing::kMinidumpUAF)
+                         .AsUTF8Unsafe();
+  list += "\n" + list + "\n";
+  ASSERT_EQ(static_cast<int>(list.size()),
+            base::WriteFile(list_file, list.data(), list.size()));
+
+  base::FilePath output_file = temp_dir_.Append(L"output.json");
+  cmd_line_.AppendSwitchPath("input-list", list_file);
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+  cmd_line_.AppendSwitchASCII("num-threads", "2");
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(0, test_impl_.Run());
+
+  std::string output;
+  EXPECT_TRUE(base::ReadFileToString(output_file, &output));
+  EXPECT_EQ(2, std::count(output.begin(), output.end(), '\n'));
+}
+
+TEST_F(PoirotAppTest, ProcessBatchWithFailures) {
+  // The test data holds a minidump without a Kasko stream, the batch fails
+  // but is processed completely.
+  base::FilePath output_file = temp_dir_.Append(L"output.json");
+  cmd_line_.AppendSwitchPath(
+      "input-dir",
+      testing::GetSrcRelativePath(testing::kMinidumpUAF).DirName());
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_NE(0, test_impl_.Run());
+
+  std::string output;
+  EXPECT_TRUE(base::ReadFileToString(output_file, &output));
+  EXPECT_EQ(2, std::count(output.begin(), output.end(), '\n'));
+}
+
 TEST_F(PoirotAppTest, ProcessValidFileSucceeds) {
   cmd_line_.AppendSwitchPath("input-minidump",
       testing::GetSrcRelativePath(testing::kMinidumpUAF));
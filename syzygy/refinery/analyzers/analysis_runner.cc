@@ -14,11 +14,120 @@
 
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 
+#include <algorithm>
+
 #include "base/stl_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
 
 namespace refinery {
 
-AnalysisRunner::AnalysisRunner() {
+namespace {
+
+bool HasCommonLayer(const AnalysisRunner::Layers& layers1,
+                    const AnalysisRunner::Layers& layers2) {
+  for (auto layer : layers1) {
+    if (std::find(layers2.begin(), layers2.end(), layer) != layers2.end())
+      return true;
+  }
+  return false;
+}
+
+// Wraps a process analysis so that only one analyzer at a time uses the symbol
+// providers, which aren't thread safe. The lock is acquired the first time the
+// analyzer asks for a symbol provider, and held until the wrapper is
+// destroyed once the analyzer is done.
+class SymbolsLockingProcessAnalysis : public Analyzer::ProcessAnalysis {
+ public:
+  SymbolsLockingProcessAnalysis(
+      const Analyzer::ProcessAnalysis* process_analysis,
+      base::Lock* symbols_lock)
+      : process_analysis_(process_analysis),
+        symbols_lock_(symbols_lock),
+        holds_symbols_lock_(false) {
+    DCHECK(process_analysis);
+    DCHECK(symbols_lock);
+  }
+
+  ~SymbolsLockingProcessAnalysis() {
+    if (holds_symbols_lock_)
+      symbols_lock_->Release();
+  }
+
+  // @name Analyzer::ProcessAnalysis implementation.
+  // @{
+  ProcessState* process_state() const override {
+    return process_analysis_->process_state();
+  }
+  scoped_refptr<DiaSymbolProvider> dia_symbol_provider() const override {
+    AcquireSymbolsLock();
+    return process_analysis_->dia_symbol_provider();
+  }
+  scoped_refptr<SymbolProvider> symbol_provider() const override {
+    AcquireSymbolsLock();
+    return process_analysis_->symbol_provider();
+  }
+  // @}
+
+ private:
+  void AcquireSymbolsLock() const {
+    if (holds_symbols_lock_)
+      return;
+    symbols_lock_->Acquire();
+    holds_symbols_lock_ = true;
+  }
+
+  const Analyzer::ProcessAnalysis* process_analysis_;
+  base::Lock* symbols_lock_;
+  mutable bool holds_symbols_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolsLockingProcessAnalysis);
+};
+
+// Runs an analyzer on a worker thread.
+class AnalyzerTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  AnalyzerTask(Analyzer* analyzer,
+               const minidump::Minidump* minidump,
+               const Analyzer::ProcessAnalysis* process_analysis,
+               base::Lock* symbols_lock)
+      : analyzer_(analyzer),
+        minidump_(minidump),
+        process_analysis_(process_analysis),
+        symbols_lock_(symbols_lock),
+        result_(Analyzer::ANALYSIS_ERROR) {
+    DCHECK(analyzer);
+    DCHECK(minidump);
+    DCHECK(process_analysis);
+    DCHECK(symbols_lock);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    SymbolsLockingProcessAnalysis process_analysis(process_analysis_,
+                                                   symbols_lock_);
+    result_ = analyzer_->Analyze(*minidump_, process_analysis);
+  }
+  // @}
+
+  Analyzer* analyzer() const { return analyzer_; }
+  Analyzer::AnalysisResult result() const { return result_; }
+
+ private:
+  Analyzer* analyzer_;
+  const minidump::Minidump* minidump_;
+  const Analyzer::ProcessAnalysis* process_analysis_;
+  base::Lock* symbols_lock_;
+  Analyzer::AnalysisResult result_;
+
+  DISALLOW_COPY_AND_ASSIGN(AnalyzerTask);
+};
+
+}  // namespace
+
+AnalysisRunner::AnalysisRunner() : num_threads_(1U) {
 }
 
 AnalysisRunner::~AnalysisRunner() {
@@ -28,11 +137,27 @@ AnalysisRunner::~AnalysisRunner() {
 void AnalysisRunner::AddAnalyzer(std::unique_ptr<Analyzer> analyzer) {
   DCHECK(analyzer);
   analyzers_.push_back(analyzer.release());
+  analyzer_layers_.push_back(AnalyzerLayers());
+}
+
+void AnalysisRunner::AddAnalyzer(std::unique_ptr<Analyzer> analyzer,
+                                 const Layers& input_layers,
+                                 const Layers& output_layers) {
+  DCHECK(analyzer);
+  analyzers_.push_back(analyzer.release());
+  analyzer_layers_.push_back(AnalyzerLayers());
+  AnalyzerLayers& layers = analyzer_layers_.back();
+  layers.declared = true;
+  layers.input_layers = input_layers;
+  layers.output_layers = output_layers;
 }
 
 Analyzer::AnalysisResult AnalysisRunner::Analyze(
     const minidump::Minidump& minidump,
     const Analyzer::ProcessAnalysis& process_analysis) {
+  if (num_threads_ > 1U)
+    return AnalyzeConcurrently(minidump, process_analysis);
+
   for (Analyzer* analyzer : analyzers_) {
     Analyzer::AnalysisResult result =
         analyzer->Analyze(minidump, process_analysis);
@@ -46,4 +171,70 @@ Analyzer::AnalysisResult AnalysisRunner::Analyze(
   return Analyzer::ANALYSIS_COMPLETE;
 }
 
+bool AnalysisRunner::DependsOn(const AnalyzerLayers& later,
+                               const AnalyzerLayers& earlier) {
+  if (!later.declared || !earlier.declared)
+    return true;
+
+  return HasCommonLayer(earlier.output_layers, later.input_layers) ||
+         HasCommonLayer(earlier.output_layers, later.output_layers) ||
+         HasCommonLayer(earlier.input_layers, later.output_layers);
+}
+
+Analyzer::AnalysisResult AnalysisRunner::AnalyzeConcurrently(
+    const minidump::Minidump& minidump,
+    const Analyzer::ProcessAnalysis& process_analysis) {
+  DCHECK_EQ(analyzers_.size(), analyzer_layers_.size());
+
+  // Each analyzer runs in the wave following the latest wave of the preceding
+  // analyzers it depends on, the analyzers of a wave are independent.
+  std::vector<size_t> waves(analyzers_.size(), 0U);
+  size_t num_waves = 0U;
+  for (size_t i = 0; i < analyzers_.size(); ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      if (DependsOn(analyzer_layers_[i], analyzer_layers_[j]))
+        waves[i] = std::max(waves[i], waves[j] + 1);
+    }
+    num_waves = std::max(num_waves, waves[i] + 1);
+  }
+
+  base::Lock symbols_lock;
+  for (size_t wave = 0; wave < num_waves; ++wave) {
+    ScopedVector<AnalyzerTask> tasks;
+    for (size_t i = 0; i < analyzers_.size(); ++i) {
+      if (waves[i] == wave) {
+        tasks.push_back(new AnalyzerTask(analyzers_[i], &minidump,
+                                         &process_analysis, &symbols_lock));
+      }
+    }
+    DCHECK(!tasks.empty());
+
+    if (tasks.size() == 1U) {
+      tasks[0]->Run();
+    } else {
+      base::DelegateSimpleThreadPool pool(
+          "AnalysisRunner",
+          static_cast<int>(std::min(num_threads_, tasks.size())));
+      pool.Start();
+      for (AnalyzerTask* task : tasks)
+        pool.AddWork(task);
+      pool.JoinAll();
+    }
+
+    bool succeeded = true;
+    for (AnalyzerTask* task : tasks) {
+      CHECK(task->result() != Analyzer::ANALYSIS_ITERATE)
+          << "Iterative analysis is not supported.";
+      if (task->result() != Analyzer::ANALYSIS_COMPLETE) {
+        LOG(ERROR) << task->analyzer()->name() << " analysis failed";
+        succeeded = false;
+      }
+    }
+    if (!succeeded)
+      return Analyzer::ANALYSIS_ERROR;
+  }
+
+  return Analyzer::ANALYSIS_COMPLETE;
+}
+
 }  // namespace refinery
@@ -21,6 +21,7 @@
 #include "base/macros.h"
 #include "syzygy/minidump/minidump.h"
 #include "syzygy/refinery/analyzers/analyzer.h"
+#include "syzygy/refinery/analyzers/analyzer_factory.h"
 #include "syzygy/refinery/process_state/process_state.h"
 
 namespace refinery {
@@ -31,16 +32,32 @@ namespace refinery {
 // ANALYSIS_ITERATE).
 class AnalysisRunner {
  public:
+  using Layers = AnalyzerFactory::Layers;
+
   AnalysisRunner();
   ~AnalysisRunner();
 
-  // Adds @p analyzer to the runner.
+  // Adds @p analyzer to the runner. The analyzer may read and write any layer,
+  // it never runs concurrently with other analyzers.
   // @param analyzer an analyzer to take ownership of. Deleted on runner's
   //   destruction.
   void AddAnalyzer(std::unique_ptr<Analyzer> analyzer);
 
+  // Adds @p analyzer to the runner, along with the layers it reads and writes.
+  // @param analyzer an analyzer to take ownership of. Deleted on runner's
+  //   destruction.
+  // @param input_layers the layers @p analyzer reads.
+  // @param output_layers the layers @p analyzer writes.
+  void AddAnalyzer(std::unique_ptr<Analyzer> analyzer,
+                   const Layers& input_layers,
+                   const Layers& output_layers);
+
   // Runs analyzers over @p minidump and updates the ProcessState supplied
-  // through @p process_analysis.
+  // through @p process_analysis. Analyzers run in the order they were added.
+  // With more than one thread, an analyzer instead runs as soon as the
+  // preceding analyzers whose layers conflict with its own are done, possibly
+  // concurrently with others. Analyzers using the symbol providers still run
+  // one at a time.
   // @param minidump the minidump to analyze.
   // @param process_analysis the process analysis passed to the analyzers.
   // @returns an analysis result. ANALYSIS_COMPLETE is returned if all analyzers
@@ -50,8 +67,39 @@ class AnalysisRunner {
       const minidump::Minidump& minidump,
       const Analyzer::ProcessAnalysis& process_analysis);
 
+  // @name Accessors for the number of threads analyzers run on. Defaults
+  //     to 1, which runs the analyzers serially on the calling thread.
+  // @{
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) { num_threads_ = num_threads; }
+  // @}
+
  private:
+  // The layers an analyzer reads and writes.
+  struct AnalyzerLayers {
+    AnalyzerLayers() : declared(false) {}
+
+    // False if the layers of the analyzer are unknown.
+    bool declared;
+    Layers input_layers;
+    Layers output_layers;
+  };
+
+  // @returns true if the analyzer with layers @p later must run after the
+  //     analyzer with layers @p earlier, that is if either writes a layer the
+  //     other reads or writes.
+  static bool DependsOn(const AnalyzerLayers& later,
+                        const AnalyzerLayers& earlier);
+
+  // Runs the analyzers concurrently, by waves of independent analyzers.
+  Analyzer::AnalysisResult AnalyzeConcurrently(
+      const minidump::Minidump& minidump,
+      const Analyzer::ProcessAnalysis& process_analysis);
+
   std::vector<Analyzer*> analyzers_;  // Owned.
+  // The layers of the analyzers, indexed alike.
+  std::vector<AnalyzerLayers> analyzer_layers_;
+  size_t num_threads_;
 
   DISALLOW_COPY_AND_ASSIGN(AnalysisRunner);
 };
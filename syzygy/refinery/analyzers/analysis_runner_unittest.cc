@@ -14,6 +14,11 @@
 
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/synchronization/lock.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/minidump/minidump.h"
@@ -46,6 +51,34 @@ MockAnalyzer* CreateMockAnalyzer(Analyzer::AnalysisResult result) {
   return analyzer;
 }
 
+// An analyzer that appends its name to a shared log when it runs.
+class LoggingAnalyzer : public Analyzer {
+ public:
+  LoggingAnalyzer(const char* name,
+                  base::Lock* log_lock,
+                  std::vector<std::string>* log)
+      : name_(name), log_lock_(log_lock), log_(log) {}
+
+  const char* name() const override { return name_; }
+
+  AnalysisResult Analyze(const minidump::Minidump& minidump,
+                         const ProcessAnalysis& process_analysis) override {
+    base::AutoLock auto_lock(*log_lock_);
+    log_->push_back(name_);
+    return ANALYSIS_COMPLETE;
+  }
+
+ private:
+  const char* name_;
+  base::Lock* log_lock_;
+  std::vector<std::string>* log_;
+};
+
+size_t GetLogPosition(const std::vector<std::string>& log,
+                      const std::string& name) {
+  return std::find(log.begin(), log.end(), name) - log.begin();
+}
+
 }  // namespace
 
 TEST(AnalysisRunnerTest, BasicSuccessTest) {
@@ -79,4 +112,71 @@ TEST(AnalysisRunnerTest, BasicErrorTest) {
   ASSERT_EQ(Analyzer::ANALYSIS_ERROR, runner.Analyze(minidump, analysis));
 }
 
+TEST(AnalysisRunnerTest, ConcurrentAnalysisHonorsLayerDependencies) {
+  base::Lock log_lock;
+  std::vector<std::string> log;
+  AnalysisRunner runner;
+  runner.set_num_threads(4);
+
+  using Layers = AnalysisRunner::Layers;
+  const Layers kNoLayers;
+  const Layers kBytes(1, ProcessState::BytesLayer);
+  const Layers kStack(1, ProcessState::StackLayer);
+  const Layers kHeapAllocation(1, ProcessState::HeapAllocationLayer);
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(
+                         new LoggingAnalyzer("Memory", &log_lock, &log)),
+                     kNoLayers, kBytes);
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(
+                         new LoggingAnalyzer("Thread", &log_lock, &log)),
+                     kNoLayers, kStack);
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(
+                         new LoggingAnalyzer("Heap", &log_lock, &log)),
+                     kBytes, kHeapAllocation);
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(
+                         new LoggingAnalyzer("Exception", &log_lock, &log)),
+                     kStack, kStack);
+  // An analyzer without declared layers runs after all the others.
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(
+      new LoggingAnalyzer("Undeclared", &log_lock, &log)));
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(
+                         new LoggingAnalyzer("Last", &log_lock, &log)),
+                     kNoLayers, kNoLayers);
+
+  ProcessState process_state;
+  SimpleProcessAnalysis analysis(&process_state);
+  minidump::FileMinidump minidump;
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner.Analyze(minidump, analysis));
+
+  ASSERT_EQ(6U, log.size());
+  EXPECT_LT(GetLogPosition(log, "Memory"), GetLogPosition(log, "Heap"));
+  EXPECT_LT(GetLogPosition(log, "Thread"), GetLogPosition(log, "Exception"));
+  EXPECT_EQ(4U, GetLogPosition(log, "Undeclared"));
+  EXPECT_EQ(5U, GetLogPosition(log, "Last"));
+}
+
+TEST(AnalysisRunnerTest, ConcurrentAnalysisStopsOnError) {
+  AnalysisRunner runner;
+  runner.set_num_threads(2);
+
+  using Layers = AnalysisRunner::Layers;
+  const Layers kBytes(1, ProcessState::BytesLayer);
+  const Layers kStack(1, ProcessState::StackLayer);
+  runner.AddAnalyzer(
+      std::unique_ptr<Analyzer>(CreateMockAnalyzer(Analyzer::ANALYSIS_ERROR)),
+      Layers(), kBytes);
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(
+                         CreateMockAnalyzer(Analyzer::ANALYSIS_COMPLETE)),
+                     Layers(), kStack);
+
+  // The dependent analyzer never runs.
+  std::unique_ptr<MockAnalyzer> dependent(new MockAnalyzer());
+  EXPECT_CALL(*dependent, Analyze(_, _)).Times(0);
+  runner.AddAnalyzer(std::move(dependent), kBytes, Layers());
+
+  ProcessState process_state;
+  SimpleProcessAnalysis analysis(&process_state);
+  minidump::FileMinidump minidump;
+  ASSERT_EQ(Analyzer::ANALYSIS_ERROR, runner.Analyze(minidump, analysis));
+}
+
 }  // namespace refinery
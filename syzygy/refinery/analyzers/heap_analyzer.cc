@@ -47,49 +47,38 @@ scoped_refptr<TypeRepository> GetNtdllTypes(ProcessState* process_state,
   return nullptr;
 }
 
+// Records the entries of @p run and their allocations. The entries of the run
+// are decoded from a single read of its memory.
 bool RecordFoundRun(const LFHEntryDetector::LFHEntryRun& run,
-                    UserDefinedTypePtr entry_type,
-                    ProcessState* process_state) {
-  HeapMetadataLayerPtr meta_layer;
-  process_state->FindOrCreateLayer(&meta_layer);
-  HeapAllocationLayerPtr alloc_layer;
-  process_state->FindOrCreateLayer(&alloc_layer);
+                    LFHEntryDetector* detector,
+                    HeapMetadataLayerPtr meta_layer,
+                    HeapAllocationLayerPtr alloc_layer) {
+  DCHECK(detector);
+
+  LFHEntryDetector::LFHEntries entries;
+  if (!detector->GetRunEntries(run, &entries)) {
+    // This really shouldn't happen.
+    NOTREACHED() << "Unable to get decoded LFH entries.";
+    return false;
+  }
 
-  for (Address entry_address = run.first_entry; entry_address <= run.last_entry;
-       entry_address += run.entry_distance_bytes) {
+  const size_t kEntrySize = detector->entry_type()->size();
+  for (const auto& entry : entries) {
     // Check the state of the entry for the metadata and to record the state
     // and size of the allocation.
-    TypedData entry(process_state, entry_type, entry_address);
-    TypedData extended_block_signature_field;
-    if (!entry.GetNamedField(L"ExtendedBlockSignature",
-                             &extended_block_signature_field)) {
-      // If the field is missing from the type, that's an error.
-      return false;
-    }
-
     const uint16_t kLFHBlockFlag = 0x80;
-    uint64_t extended_block_signature = 0;
-    DCHECK_LT(entry_type->size(), run.entry_distance_bytes);
-    size_t allocation_size = run.entry_distance_bytes - entry_type->size();
+    uint64_t extended_block_signature = entry.extended_block_signature;
+    DCHECK_LT(kEntrySize, run.entry_distance_bytes);
+    size_t allocation_size = run.entry_distance_bytes - kEntrySize;
     bool entry_is_corrupt = false;
-    uint64_t decoded_subsegment = 0;
-    if (!LFHEntryDetector::GetDecodedLFHEntrySubsegment(entry,
-                                                        &decoded_subsegment)) {
-      // This really shouldn't happen.
-      NOTREACHED() << "Unable to get decoded LFH subsegment.";
-      return false;
-    }
-    if (decoded_subsegment != run.subsegment_code) {
+    if (entry.subsegment_code != run.subsegment_code) {
       // If the subsegment code doesn't match, the entry is corrupt.
       entry_is_corrupt = true;
     }
 
     bool alloc_is_free = true;
-    if (!extended_block_signature_field.GetUnsignedValue(
-            &extended_block_signature) ||
-        (extended_block_signature & kLFHBlockFlag) == 0) {
-      // If we can't retrieve the value, or the high bit is clear, we assume
-      // a corrupt entry.
+    if ((extended_block_signature & kLFHBlockFlag) == 0) {
+      // If the high bit is clear, we assume a corrupt entry.
       entry_is_corrupt = true;
       DCHECK_EQ(true, alloc_is_free);
     } else {
@@ -117,7 +106,7 @@ bool RecordFoundRun(const LFHEntryDetector::LFHEntryRun& run,
     }
 
     // Create the record for the entry's metadata.
-    AddressRange entry_range(entry_address, entry_type->size());
+    AddressRange entry_range(entry.address, kEntrySize);
     HeapMetadataRecordPtr meta_record;
     meta_layer->CreateRecord(entry_range, &meta_record);
     HeapMetadata* meta_data = meta_record->mutable_data();
@@ -135,8 +124,9 @@ bool RecordFoundRun(const LFHEntryDetector::LFHEntryRun& run,
 }
 
 bool RecordFoundRuns(const LFHEntryDetector::LFHEntryRuns& found_runs,
-                     UserDefinedTypePtr entry_type,
-                     ProcessState* process_state) {
+                     LFHEntryDetector* detector,
+                     HeapMetadataLayerPtr meta_layer,
+                     HeapAllocationLayerPtr alloc_layer) {
   DCHECK_NE(0U, found_runs.size());
 
   for (const auto& run : found_runs) {
@@ -149,7 +139,7 @@ bool RecordFoundRuns(const LFHEntryDetector::LFHEntryRuns& found_runs,
     // detection
     // into the mix will add another degree of matching to this.
     if (run.entries_found > 2 &&
-        !RecordFoundRun(run, entry_type, process_state))
+        !RecordFoundRun(run, detector, meta_layer, alloc_layer))
       return false;
   }
 
@@ -194,6 +184,11 @@ Analyzer::AnalysisResult HeapAnalyzer::Analyze(
     return ANALYSIS_ERROR;
   }
 
+  HeapMetadataLayerPtr meta_layer;
+  process_analysis.process_state()->FindOrCreateLayer(&meta_layer);
+  HeapAllocationLayerPtr alloc_layer;
+  process_analysis.process_state()->FindOrCreateLayer(&alloc_layer);
+
   // Perform detection on the records from the bytes layer.
   for (const auto& record : *bytes_layer) {
     // TODO(siggi): Skip stacks, and perhaps modules here.
@@ -204,8 +199,7 @@ Analyzer::AnalysisResult HeapAnalyzer::Analyze(
     }
 
     if (found_runs.size()) {
-      if (!RecordFoundRuns(found_runs, detector.entry_type(),
-                           process_analysis.process_state())) {
+      if (!RecordFoundRuns(found_runs, &detector, meta_layer, alloc_layer)) {
         LOG(ERROR) << "Failed to record found runs.";
         // TODO(siggi): Is this the right thing to do?
         return ANALYSIS_ERROR;
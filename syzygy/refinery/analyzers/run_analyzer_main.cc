@@ -27,6 +27,7 @@
 #include "base/files/file_path.h"
 #include "base/json/string_escape.h"
 #include "base/strings/string16.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
@@ -35,6 +36,7 @@
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 #include "syzygy/refinery/analyzers/analyzer_factory.h"
 #include "syzygy/refinery/analyzers/analyzer_util.h"
+#include "syzygy/refinery/analyzers/stack_analyzer.h"
 #include "syzygy/refinery/process_state/process_state.h"
 #include "syzygy/refinery/symbols/dia_symbol_provider.h"
 #include "syzygy/refinery/symbols/symbol_provider.h"
@@ -82,6 +84,7 @@ class RunAnalyzerApplication : public application::AppImplBase {
   std::string analyzer_names_;
   bool resolve_dependencies_;
   std::string output_layers_;
+  size_t num_threads_;
 
   DISALLOW_COPY_AND_ASSIGN(RunAnalyzerApplication);
 };
@@ -182,7 +185,11 @@ const char kUsageFormatStr[] =
     "     Default value: %s\n"
     "  --no-dependencies\n"
     "     If provided, the layer dependencies of the requested analyzers\n"
-    "     won't be used to supplement the analyzer list.\n";
+    "     won't be used to supplement the analyzer list.\n"
+    "  --threads=<number of threads>\n"
+    "     The number of threads to run independent analyzers on, and to walk\n"
+    "     the stacks of the process' threads on.\n"
+    "     Default value: 1\n";
 
 const char kDefaultAnalyzers[] = "HeapAnalyzer,StackFrameAnalyzer,TebAnalyzer";
 const char kDefaultOutputLayers[] = "TypedDataLayer";
@@ -336,7 +343,9 @@ void RunAnalyzerApplication::PrintUsage(const base::FilePath& program,
 }
 
 RunAnalyzerApplication::RunAnalyzerApplication()
-    : AppImplBase("RunAnalyzerApplication"), resolve_dependencies_(true) {
+    : AppImplBase("RunAnalyzerApplication"),
+      resolve_dependencies_(true),
+      num_threads_(1U) {
 }
 
 bool RunAnalyzerApplication::ParseCommandLine(
@@ -389,6 +398,17 @@ bool RunAnalyzerApplication::ParseCommandLine(
     }
   }
 
+  static const char kThreads[] = "threads";
+  if (cmd_line->HasSwitch(kThreads)) {
+    std::string num_threads = cmd_line->GetSwitchValueASCII(kThreads);
+    if (!base::StringToSizeT(num_threads, &num_threads_) ||
+        num_threads_ == 0U) {
+      PrintUsage(cmd_line->GetProgram(),
+                 "Must provide a positive number of threads with this flag.");
+      return false;
+    }
+  }
+
   for (const auto& arg : cmd_line->GetArgs()) {
     if (!AppendMatchingPaths(base::FilePath(arg), &mindump_paths_)) {
       PrintUsage(
@@ -457,7 +477,7 @@ int RunAnalyzerApplication::Run() {
   for (const auto& minidump_path : mindump_paths_) {
     ::fprintf(out(), "Processing \"%ls\"\n", minidump_path.value().c_str());
 
-    minidump::FileMinidump minidump;
+    minidump::MappedFileMinidump minidump;
     if (!minidump.Open(minidump_path)) {
       LOG(ERROR) << "Unable to open dump file.";
       return 1;
@@ -483,12 +503,18 @@ bool RunAnalyzerApplication::AddAnalyzers(
   for (const auto& analyzer_name : analyzers) {
     std::unique_ptr<refinery::Analyzer> analyzer(
         factory.CreateAnalyzer(analyzer_name));
-    if (analyzer) {
-      runner->AddAnalyzer(std::move(analyzer));
-    } else {
+    refinery::AnalyzerFactory::Layers input_layers;
+    refinery::AnalyzerFactory::Layers output_layers;
+    if (!analyzer || !factory.GetInputLayers(analyzer_name, &input_layers) ||
+        !factory.GetOutputLayers(analyzer_name, &output_layers)) {
       LOG(ERROR) << "No such analyzer " << analyzer_name;
       return false;
     }
+    if (analyzer_name == "StackAnalyzer") {
+      static_cast<refinery::StackAnalyzer*>(analyzer.get())
+          ->set_num_threads(num_threads_);
+    }
+    runner->AddAnalyzer(std::move(analyzer), input_layers, output_layers);
   }
 
   return true;
@@ -545,6 +571,7 @@ bool RunAnalyzerApplication::Analyze(
       system_info.Cpu.X86CpuInfo.AMDExtendedCpuFeatures);
 
   refinery::AnalysisRunner runner;
+  runner.set_num_threads(num_threads_);
   if (!AddAnalyzers(factory, &runner))
     return false;
 
@@ -21,7 +21,9 @@
 
 #include "base/debug/alias.h"
 #include "base/files/file_path.h"
+#include "base/synchronization/waitable_event.h"
 #include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_com_initializer.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/com_utils.h"
@@ -55,6 +57,17 @@ __declspec(noinline) DWORD GetEip() {
   return reinterpret_cast<DWORD>(_ReturnAddress());
 }
 
+// A delegate that waits for an event, to keep its thread alive.
+class WaitingDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit WaitingDelegate(base::WaitableEvent* event) : event_(event) {}
+
+  void Run() override { event_->Wait(); }
+
+ private:
+  base::WaitableEvent* event_;
+};
+
 }  // namespace
 
 class StackAndFrameAnalyzersTest : public testing::Test {
@@ -143,6 +156,32 @@ class StackAndFrameAnalyzersTest : public testing::Test {
     return runner.Analyze(minidump, analysis) == Analyzer::ANALYSIS_COMPLETE;
   }
 
+  bool AnalyzeStacks(size_t num_threads, ProcessState* process_state) {
+    minidump::FileMinidump minidump;
+    if (!minidump.Open(minidump_path()))
+      return false;
+
+    AnalysisRunner runner;
+    std::unique_ptr<Analyzer> analyzer(new refinery::MemoryAnalyzer());
+    runner.AddAnalyzer(std::move(analyzer));
+    analyzer.reset(new refinery::ThreadAnalyzer());
+    runner.AddAnalyzer(std::move(analyzer));
+    analyzer.reset(new refinery::ExceptionAnalyzer());
+    runner.AddAnalyzer(std::move(analyzer));
+    analyzer.reset(new refinery::ModuleAnalyzer());
+    runner.AddAnalyzer(std::move(analyzer));
+    std::unique_ptr<StackAnalyzer> stack_analyzer(new StackAnalyzer());
+    stack_analyzer->set_num_threads(num_threads);
+    runner.AddAnalyzer(std::move(stack_analyzer));
+
+    scoped_refptr<DiaSymbolProvider> dia_symbol_provider(
+        new DiaSymbolProvider());
+    SimpleProcessAnalysis analysis(process_state, dia_symbol_provider,
+                                   symbol_provider_);
+
+    return runner.Analyze(minidump, analysis) == Analyzer::ANALYSIS_COMPLETE;
+  }
+
   void ValidateTypedBlock(ProcessState* process_state,
                           Address expected_address,
                           Size expected_size,
@@ -276,4 +315,65 @@ TEST_F(StackAndFrameAnalyzersTest, BasicTest) {
                          expected_module_id, "dummy_param", L"int32_t"));
 }
 
+// This test fails under coverage instrumentation which is probably not friendly
+// to stackwalking.
+#ifdef _COVERAGE_BUILD
+TEST_F(StackAndFrameAnalyzersTest, DISABLED_ConcurrentWalkMatchesSerialWalk) {
+#else
+TEST_F(StackAndFrameAnalyzersTest, ConcurrentWalkMatchesSerialWalk) {
+#endif
+  base::win::ScopedCOMInitializer com_initializer;
+
+  // Make sure the process has several threads to walk.
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  base::WaitableEvent done(true, false);
+  WaitingDelegate waiting_delegate(&done);
+  for (size_t i = 0; i < 4; ++i) {
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(&waiting_delegate, "Waiting")));
+    threads.back()->Start();
+  }
+
+  ASSERT_TRUE(SetupStackFrameAndGenerateMinidump(22));
+
+  done.Signal();
+  for (const auto& thread : threads)
+    thread->Join();
+
+  ProcessState serial_state;
+  ASSERT_TRUE(AnalyzeStacks(1U, &serial_state));
+  ProcessState concurrent_state;
+  ASSERT_TRUE(AnalyzeStacks(4U, &concurrent_state));
+
+  // The concurrent walk produces the same stack walks.
+  StackLayerPtr serial_stacks;
+  ASSERT_TRUE(serial_state.FindLayer(&serial_stacks));
+  StackLayerPtr concurrent_stacks;
+  ASSERT_TRUE(concurrent_state.FindLayer(&concurrent_stacks));
+  ASSERT_EQ(serial_stacks->size(), concurrent_stacks->size());
+  ASSERT_LT(4U, serial_stacks->size());
+  for (StackRecordPtr stack : *serial_stacks) {
+    StackRecordPtr concurrent_stack;
+    ASSERT_TRUE(concurrent_state.FindStackRecord(
+        stack->data().thread_info().thread_id(), &concurrent_stack));
+    EXPECT_EQ(stack->data().stack_walk_success(),
+              concurrent_stack->data().stack_walk_success());
+  }
+
+  // And the same frames, recorded in the same order.
+  StackFrameLayerPtr serial_frames;
+  ASSERT_TRUE(serial_state.FindLayer(&serial_frames));
+  StackFrameLayerPtr concurrent_frames;
+  ASSERT_TRUE(concurrent_state.FindLayer(&concurrent_frames));
+  ASSERT_EQ(serial_frames->size(), concurrent_frames->size());
+  auto concurrent_it = concurrent_frames->begin();
+  for (StackFrameRecordPtr frame : *serial_frames) {
+    StackFrameRecordPtr concurrent_frame = *concurrent_it;
+    ++concurrent_it;
+    EXPECT_EQ(frame->range(), concurrent_frame->range());
+    EXPECT_EQ(frame->data().SerializeAsString(),
+              concurrent_frame->data().SerializeAsString());
+  }
+}
+
 }  // namespace refinery
@@ -14,12 +14,22 @@
 
 #include "syzygy/refinery/analyzers/stack_analyzer.h"
 
+#include <dia2.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/memory/scoped_vector.h"
 #include "base/numerics/safe_math.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
+#include "base/win/scoped_comptr.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/refinery/analyzers/stack_analyzer_impl.h"
 #include "syzygy/refinery/process_state/refinery.pb.h"
+#include "syzygy/refinery/symbols/dia_symbol_provider.h"
 
 namespace refinery {
 
@@ -44,56 +54,92 @@ bool GetRegisterValue(IDiaStackFrame* frame,
   return true;
 }
 
-}  // namespace
-
-// static
-const char StackAnalyzer::kStackAnalyzerName[] = "StackAnalyzer";
-
-StackAnalyzer::StackAnalyzer() : child_frame_context_(nullptr) {
+// A stack frame recovered by walking a stack, to be recorded in the process
+// state.
+struct WalkedFrame {
+  AddressRange range;
+  StackFrame data;
+};
+
+// The outcome of walking a stack.
+struct WalkedStack {
+  WalkedStack()
+      : result(Analyzer::ANALYSIS_COMPLETE), stack_walk_success(false) {}
+
+  Analyzer::AnalysisResult result;
+  bool stack_walk_success;
+  std::vector<WalkedFrame> frames;
+};
+
+// Walks stacks using its own DIA stack walker. Walking only reads from the
+// process state, which allows walking stacks on several threads at once.
+class ThreadStackWalker {
+ public:
+  ThreadStackWalker(scoped_refptr<DiaSymbolProvider> symbol_provider,
+                    ProcessState* process_state);
+
+  // Creates the DIA stack walker.
+  // @returns true on success, false on failure.
+  bool Init();
+
+  // Walks the stack of @p stack_record.
+  // @param stack_record the stack to walk.
+  // @param walked receives the outcome of the walk.
+  void Walk(StackRecordPtr stack_record, WalkedStack* walked);
+
+ private:
+  Analyzer::AnalysisResult WalkFrames(StackRecordPtr stack_record,
+                                      WalkedStack* walked);
+
+  // Appends data about @p stack_frame to @p walked.
+  bool AppendStackFrame(IDiaStackFrame* stack_frame, WalkedStack* walked);
+
+  static const size_t kNoChildFrame = static_cast<size_t>(-1);
+
+  scoped_refptr<DiaSymbolProvider> symbol_provider_;
+  ProcessState* process_state_;  // Not owned.
+
+  base::win::ScopedComPtr<IDiaStackWalker> stack_walker_;
+  scoped_refptr<StackWalkHelper> stack_walk_helper_;
+
+  // A frame's data is often located relative to the CV_ALLREG_VFRAME. However,
+  // we observe this is relative to the parent frame's value. For ease of
+  // access, we store the parent frame's value in the frame's context. This is
+  // the index of the child frame of the next frame, or kNoChildFrame.
+  size_t child_frame_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadStackWalker);
+};
+
+ThreadStackWalker::ThreadStackWalker(
+    scoped_refptr<DiaSymbolProvider> symbol_provider,
+    ProcessState* process_state)
+    : symbol_provider_(symbol_provider),
+      process_state_(process_state),
+      child_frame_index_(kNoChildFrame) {
+  DCHECK(symbol_provider.get() != nullptr);
+  DCHECK(process_state != nullptr);
 }
 
-Analyzer::AnalysisResult StackAnalyzer::Analyze(
-    const minidump::Minidump& minidump,
-    const ProcessAnalysis& process_analysis) {
-  DCHECK(process_analysis.process_state() != nullptr);
-  DCHECK(process_analysis.dia_symbol_provider() != nullptr);
-
+bool ThreadStackWalker::Init() {
   // Create stack walker and helper.
-  if (!pe::CreateDiaObject(stack_walker_.Receive(),
-                           CLSID_DiaStackWalker)) {
-      return ANALYSIS_ERROR;
-    }
-  stack_walk_helper_ =
-      new StackWalkHelper(process_analysis.dia_symbol_provider());
-
-  // Get the stack layer - it must already have been populated.
-  StackLayerPtr stack_layer;
-  if (!process_analysis.process_state()->FindLayer(&stack_layer)) {
-    LOG(ERROR) << "Missing stack layer.";
-    return ANALYSIS_ERROR;
-  }
-
-  // Process each thread's stack.
-  Analyzer::AnalysisResult result = ANALYSIS_COMPLETE;
-  for (StackRecordPtr stack_record : *stack_layer) {
-    // Attempt to stack walk. Note that the stack walk derailing is not an
-    // analysis error.
-    Analyzer::AnalysisResult stack_result =
-        StackWalk(stack_record, process_analysis);
-    if (stack_result == ANALYSIS_ERROR)
-      return ANALYSIS_ERROR;
-    if (stack_result == ANALYSIS_ITERATE)
-      result = ANALYSIS_ITERATE;
-  }
+  if (!pe::CreateDiaObject(stack_walker_.Receive(), CLSID_DiaStackWalker))
+    return false;
+  stack_walk_helper_ = new StackWalkHelper(symbol_provider_);
+  return true;
+}
 
-  return result;
+void ThreadStackWalker::Walk(StackRecordPtr stack_record,
+                             WalkedStack* walked) {
+  DCHECK(walked);
+  walked->result = WalkFrames(stack_record, walked);
 }
 
-Analyzer::AnalysisResult StackAnalyzer::StackWalk(
+Analyzer::AnalysisResult ThreadStackWalker::WalkFrames(
     StackRecordPtr stack_record,
-    const ProcessAnalysis& process_analysis) {
-  stack_walk_helper_->SetState(stack_record, process_analysis.process_state());
-  child_frame_context_ = nullptr;
+    WalkedStack* walked) {
+  stack_walk_helper_->SetState(stack_record, process_state_);
+  child_frame_index_ = kNoChildFrame;
 
   // Create the frame enumerator.
   base::win::ScopedComPtr<IDiaEnumStackFrames> frame_enumerator;
@@ -104,7 +150,7 @@ Analyzer::AnalysisResult StackAnalyzer::StackWalk(
   if (hr != S_OK) {
     LOG(ERROR) << "Failed to get frame enumerator: " << common::LogHr(hr)
                << ".";
-    return ANALYSIS_ERROR;
+    return Analyzer::ANALYSIS_ERROR;
   }
   frame_enumerator->Reset();
 
@@ -117,13 +163,13 @@ Analyzer::AnalysisResult StackAnalyzer::StackWalk(
     if (!SUCCEEDED(hr)) {
       // Stack walking derailed. Not an an analyzer error per se.
       LOG(ERROR) << "Failed to get stack frame: " << common::LogHr(hr) << ".";
-      return ANALYSIS_COMPLETE;
+      return Analyzer::ANALYSIS_COMPLETE;
     }
     if (hr == S_FALSE || retrieved_cnt != 1)
       break;  // No frame.
 
-    if (!InsertStackFrameRecord(stack_frame.get(), process_analysis))
-      return ANALYSIS_ERROR;
+    if (!AppendStackFrame(stack_frame.get(), walked))
+      return Analyzer::ANALYSIS_ERROR;
 
     // WinDBG seems to use a null return address as a termination criterion.
     ULONGLONG frame_return_addr = 0ULL;
@@ -131,23 +177,22 @@ Analyzer::AnalysisResult StackAnalyzer::StackWalk(
     if (hr != S_OK) {
       LOG(ERROR) << "Failed to get frame's return address: "
                  << common::LogHr(hr) << ".";
-      return ANALYSIS_ERROR;
+      return Analyzer::ANALYSIS_ERROR;
     }
     if (frame_return_addr == 0ULL) {
-      stack_record->mutable_data()->set_stack_walk_success(true);
+      walked->stack_walk_success = true;
       break;
     }
   }
 
-  return ANALYSIS_COMPLETE;
+  return Analyzer::ANALYSIS_COMPLETE;
 }
 
 // TODO(manzagop): revise when support expands beyond x86.
-bool StackAnalyzer::InsertStackFrameRecord(
-    IDiaStackFrame* stack_frame,
-    const ProcessAnalysis& process_analysis) {
-  RegisterInformation* child_context = child_frame_context_;
-  child_frame_context_ = nullptr;
+bool ThreadStackWalker::AppendStackFrame(IDiaStackFrame* stack_frame,
+                                         WalkedStack* walked) {
+  size_t child_index = child_frame_index_;
+  child_frame_index_ = kNoChildFrame;
 
   // Get the frame's base.
   uint64_t frame_base = 0ULL;
@@ -172,8 +217,6 @@ bool StackAnalyzer::InsertStackFrameRecord(
 
   // TODO(manzagop): get register values and some notion about their validity.
 
-  // Populate the stack frame layer.
-
   // Compute the frame's full size.
   DCHECK_LE(frame_top, frame_base);
   base::CheckedNumeric<Size> frame_full_size =
@@ -186,7 +229,6 @@ bool StackAnalyzer::InsertStackFrameRecord(
   if (frame_full_size.ValueOrDie() == 0U)
     return true;  // Skip empty frame.
 
-  // Create the stack frame record.
   AddressRange range(static_cast<Address>(frame_top),
                      static_cast<Size>(frame_full_size.ValueOrDie()));
   if (!range.IsValid()) {
@@ -194,14 +236,12 @@ bool StackAnalyzer::InsertStackFrameRecord(
     return false;
   }
 
-  StackFrameLayerPtr frame_layer;
-  process_analysis.process_state()->FindOrCreateLayer(&frame_layer);
-
-  StackFrameRecordPtr frame_record;
-  frame_layer->CreateRecord(range, &frame_record);
-  StackFrame* frame_proto = frame_record->mutable_data();
+  walked->frames.push_back(WalkedFrame());
+  WalkedFrame& frame = walked->frames.back();
+  frame.range = range;
+  StackFrame* frame_proto = &frame.data;
 
-  // Populate the stack frame record.
+  // Populate the stack frame.
 
   // Register context.
   // TODO(manzagop): flesh out the register context.
@@ -214,15 +254,142 @@ bool StackAnalyzer::InsertStackFrameRecord(
   if (GetRegisterValue(stack_frame, CV_ALLREG_VFRAME, &allreg_vframe)) {
     // Register doesn't seem to always be available. Not considered an error.
     context->set_allreg_vframe(allreg_vframe);
-    if (child_context)
-      child_context->set_parent_allreg_vframe(allreg_vframe);
+    if (child_index != kNoChildFrame) {
+      walked->frames[child_index].data.mutable_register_info()->
+          set_parent_allreg_vframe(allreg_vframe);
+    }
   }
 
   frame_proto->set_frame_size_bytes(frame_size);
   frame_proto->set_locals_base(locals_base);
 
-  child_frame_context_ = context;
+  child_frame_index_ = walked->frames.size() - 1;
   return true;
 }
 
+// A task walking every stride-th stack, starting at the first-th.
+class StackWalkTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  StackWalkTask(size_t first,
+                size_t stride,
+                const std::vector<StackRecordPtr>* stacks,
+                ProcessState* process_state,
+                std::vector<WalkedStack>* walked_stacks)
+      : first_(first),
+        stride_(stride),
+        stacks_(stacks),
+        process_state_(process_state),
+        walked_stacks_(walked_stacks) {}
+
+  // base::DelegateSimpleThread::Delegate implementation.
+  void Run() override {
+    base::win::ScopedCOMInitializer com_initializer;
+
+    // DIA sessions can't be shared across threads, so each task loads the
+    // symbols it needs through its own provider.
+    ThreadStackWalker walker(new DiaSymbolProvider(), process_state_);
+    bool initialized = walker.Init();
+    for (size_t i = first_; i < stacks_->size(); i += stride_) {
+      WalkedStack* walked = &walked_stacks_->at(i);
+      if (!initialized) {
+        walked->result = Analyzer::ANALYSIS_ERROR;
+        continue;
+      }
+      walker.Walk(stacks_->at(i), walked);
+    }
+  }
+
+ private:
+  size_t first_;
+  size_t stride_;
+  const std::vector<StackRecordPtr>* stacks_;
+  ProcessState* process_state_;
+  std::vector<WalkedStack>* walked_stacks_;
+
+  DISALLOW_COPY_AND_ASSIGN(StackWalkTask);
+};
+
+}  // namespace
+
+// static
+const char StackAnalyzer::kStackAnalyzerName[] = "StackAnalyzer";
+
+StackAnalyzer::StackAnalyzer() : num_threads_(1U) {
+}
+
+Analyzer::AnalysisResult StackAnalyzer::Analyze(
+    const minidump::Minidump& minidump,
+    const ProcessAnalysis& process_analysis) {
+  DCHECK(process_analysis.process_state() != nullptr);
+  DCHECK(process_analysis.dia_symbol_provider() != nullptr);
+  ProcessState* process_state = process_analysis.process_state();
+
+  // Get the stack layer - it must already have been populated.
+  StackLayerPtr stack_layer;
+  if (!process_state->FindLayer(&stack_layer)) {
+    LOG(ERROR) << "Missing stack layer.";
+    return ANALYSIS_ERROR;
+  }
+
+  std::vector<StackRecordPtr> stacks;
+  for (StackRecordPtr stack_record : *stack_layer)
+    stacks.push_back(stack_record);
+
+  // Walk each thread's stack.
+  std::vector<WalkedStack> walked_stacks(stacks.size());
+  size_t num_tasks = std::min(num_threads_, stacks.size());
+  if (num_tasks <= 1U) {
+    ThreadStackWalker walker(process_analysis.dia_symbol_provider(),
+                             process_state);
+    if (!walker.Init())
+      return ANALYSIS_ERROR;
+    for (size_t i = 0; i < stacks.size(); ++i) {
+      walker.Walk(stacks[i], &walked_stacks[i]);
+      // Stop at the first error, as there's no point walking further.
+      if (walked_stacks[i].result == ANALYSIS_ERROR) {
+        walked_stacks.resize(i + 1);
+        break;
+      }
+    }
+  } else {
+    ScopedVector<StackWalkTask> tasks;
+    for (size_t i = 0; i < num_tasks; ++i) {
+      tasks.push_back(new StackWalkTask(i, num_tasks, &stacks, process_state,
+                                        &walked_stacks));
+    }
+
+    base::DelegateSimpleThreadPool pool("StackWalk",
+                                        static_cast<int>(num_tasks));
+    pool.Start();
+    for (StackWalkTask* task : tasks)
+      pool.AddWork(task);
+    pool.JoinAll();
+  }
+
+  // Record the walks in stack order. Note that the stack walk derailing is not
+  // an analysis error.
+  StackFrameLayerPtr frame_layer;
+  Analyzer::AnalysisResult result = ANALYSIS_COMPLETE;
+  for (size_t i = 0; i < walked_stacks.size(); ++i) {
+    WalkedStack& walked = walked_stacks[i];
+    for (WalkedFrame& frame : walked.frames) {
+      if (frame_layer.get() == nullptr)
+        process_state->FindOrCreateLayer(&frame_layer);
+
+      StackFrameRecordPtr frame_record;
+      frame_layer->CreateRecord(frame.range, &frame_record);
+      frame_record->mutable_data()->Swap(&frame.data);
+    }
+    if (walked.stack_walk_success)
+      stacks[i]->mutable_data()->set_stack_walk_success(true);
+
+    if (walked.result == ANALYSIS_ERROR)
+      return ANALYSIS_ERROR;
+    if (walked.result == ANALYSIS_ITERATE)
+      result = ANALYSIS_ITERATE;
+  }
+
+  return result;
+}
+
 }  // namespace refinery
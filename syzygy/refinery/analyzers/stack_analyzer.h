@@ -15,22 +15,18 @@
 #ifndef SYZYGY_REFINERY_ANALYZERS_STACK_ANALYZER_H_
 #define SYZYGY_REFINERY_ANALYZERS_STACK_ANALYZER_H_
 
-#include <dia2.h>
-
 #include "base/macros.h"
-#include "base/memory/ref_counted.h"
-#include "base/win/scoped_comptr.h"
 #include "syzygy/refinery/analyzers/analyzer.h"
 #include "syzygy/refinery/process_state/process_state_util.h"
-#include "syzygy/refinery/symbols/dia_symbol_provider.h"
 
 namespace refinery {
 
-// fwd.
-class StackWalkHelper;
-
 // The stack analyzer populates the process state with information resulting
 // from walking the stack.
+// Stacks may be walked concurrently, in which case each thread walks using its
+// own DIA symbol provider, as DIA sessions may not be shared across threads.
+// The recovered frames are merged into the process state in stack order, so
+// that the outcome doesn't depend on the number of threads.
 // TODO(manzagop): Introduce a system for managing analyzer order prerequisites?
 class StackAnalyzer : public Analyzer {
  public:
@@ -46,23 +42,18 @@ class StackAnalyzer : public Analyzer {
                         ProcessState::StackLayer)
   ANALYZER_OUTPUT_LAYERS(ProcessState::StackFrameLayer)
 
- private:
-  AnalysisResult StackWalk(StackRecordPtr stack_record,
-                           const ProcessAnalysis& process_analysis);
-
-  // Inserts data about @p stack_frame into @p process_state.
-  bool InsertStackFrameRecord(IDiaStackFrame* stack_frame,
-                              const ProcessAnalysis& process_analysis);
+  // @name Accessors and mutators for the number of threads walking stacks.
+  // Defaults to 1, in which case stacks are walked on the calling thread with
+  // the analysis' DIA symbol provider.
+  // @{
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) { num_threads_ = num_threads; }
+  // @}
 
+ private:
   static const char kStackAnalyzerName[];
 
-  base::win::ScopedComPtr<IDiaStackWalker> stack_walker_;
-  scoped_refptr<StackWalkHelper> stack_walk_helper_;
-
-  // A frame's data is often located relative to the CV_ALLREG_VFRAME. However,
-  // we observe this is relative to the parent frame's value. For ease of
-  // access, we store the parent frame's value in the frame's context.
-  RegisterInformation* child_frame_context_;
+  size_t num_threads_;
 
   DISALLOW_COPY_AND_ASSIGN(StackAnalyzer);
 };
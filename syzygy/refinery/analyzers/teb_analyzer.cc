@@ -14,6 +14,8 @@
 
 #include "syzygy/refinery/analyzers/teb_analyzer.h"
 
+#include <vector>
+
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/refinery/process_state/process_state_util.h"
@@ -24,9 +26,10 @@ namespace refinery {
 namespace {
 
 // TODO(siggi): This functionality needs to move somewhere central.
-scoped_refptr<TypeRepository> GetNtdllTypes(ProcessState* process_state,
-                                            SymbolProvider* symbol_provider,
-                                            ModuleId* module_id) {
+scoped_refptr<TypeNameIndex> GetNtdllTypeNameIndex(
+    ProcessState* process_state,
+    SymbolProvider* symbol_provider,
+    ModuleId* module_id) {
   DCHECK(process_state);
   DCHECK(symbol_provider);
   DCHECK(module_id);
@@ -50,8 +53,9 @@ scoped_refptr<TypeRepository> GetNtdllTypes(ProcessState* process_state,
       if (*module_id == kNoModuleId)
         return nullptr;
 
-      scoped_refptr<TypeRepository> ret;
-      if (symbol_provider->FindOrCreateTypeRepository(signature, &ret))
+      // The index is shared by the analyses of the module.
+      scoped_refptr<TypeNameIndex> ret;
+      if (symbol_provider->FindOrCreateTypeNameIndex(signature, &ret))
         return ret;
     }
   }
@@ -75,17 +79,20 @@ Analyzer::AnalysisResult TebAnalyzer::Analyze(
   // Start by finding the NTDLL module record and symbols, as that's where we
   // come by the symbols that describe the heap.
   ModuleId module_id = kNoModuleId;
-  scoped_refptr<TypeRepository> ntdll_repo =
-      GetNtdllTypes(process_analysis.process_state(),
-                    process_analysis.symbol_provider().get(), &module_id);
-  if (!ntdll_repo || module_id == kNoModuleId) {
+  scoped_refptr<TypeNameIndex> ntdll_index =
+      GetNtdllTypeNameIndex(process_analysis.process_state(),
+                            process_analysis.symbol_provider().get(),
+                            &module_id);
+  if (!ntdll_index || module_id == kNoModuleId) {
     LOG(ERROR) << "Couldn't get types for NTDLL.";
     return ANALYSIS_ERROR;
   }
 
   UserDefinedTypePtr teb_type;
-  for (const auto& type : *ntdll_repo) {
-    if (type->GetName() == L"_TEB" && type->CastTo(&teb_type))
+  std::vector<TypePtr> matching_types;
+  ntdll_index->GetTypes(L"_TEB", &matching_types);
+  for (const auto& type : matching_types) {
+    if (type->CastTo(&teb_type))
       break;
   }
 
@@ -14,8 +14,6 @@
 
 #include "syzygy/refinery/analyzers/type_propagator_analyzer.h"
 
-#include <queue>
-
 #include "syzygy/refinery/process_state/process_state_util.h"
 #include "syzygy/refinery/process_state/refinery.pb.h"
 #include "syzygy/refinery/types/type.h"
@@ -52,7 +50,8 @@ Analyzer::AnalysisResult TypePropagatorAnalyzer::Analyze(
 
   ModuleLayerAccessor accessor(process_state);
 
-  std::queue<TypedData> process_queue;
+  worklist_ = std::queue<TypedData>();
+  visited_.clear();
 
   scoped_refptr<SymbolProvider> symbol_provider =
       process_analysis.symbol_provider();
@@ -78,19 +77,32 @@ Analyzer::AnalysisResult TypePropagatorAnalyzer::Analyze(
       return ANALYSIS_ERROR;
 
     // Queue typed data for processing.
-    process_queue.push(TypedData(process_state, type, rec->range().start()));
+    Enqueue(TypedData(process_state, type, rec->range().start()));
   }
 
-  // Process typed data looking for pointers or contained pointers.
-  while (!process_queue.empty()) {
-    if (!AnalyzeTypedData(process_queue.front(), process_state))
+  // Process typed data looking for pointers or contained pointers. This
+  // queues the typed data they point to, which is processed in turn.
+  while (!worklist_.empty()) {
+    TypedData typed_data = worklist_.front();
+    worklist_.pop();
+    if (!AnalyzeTypedData(typed_data, process_state))
       return ANALYSIS_ERROR;
-    process_queue.pop();
   }
+  visited_.clear();
 
   return ANALYSIS_COMPLETE;
 }
 
+bool TypePropagatorAnalyzer::Enqueue(const TypedData& typed_data) {
+  TypePtr type = typed_data.type();
+  ObjectKey key(typed_data.addr(), type->repository(), type->type_id());
+  if (!visited_.insert(key).second)
+    return false;
+
+  worklist_.push(typed_data);
+  return true;
+}
+
 bool TypePropagatorAnalyzer::AnalyzeTypedData(const TypedData& typed_data,
                                               ProcessState* process_state) {
   DCHECK(process_state != nullptr);
@@ -153,6 +165,10 @@ bool TypePropagatorAnalyzer::AnalyzeTypedDataPointer(
     return true;
   }
 
+  // The pointee is only recorded and analyzed the first time it's reached.
+  if (!Enqueue(content_data))
+    return true;
+
   return AddTypedBlock(content_data, process_state);
 }
 
@@ -15,6 +15,10 @@
 #ifndef SYZYGY_REFINERY_ANALYZERS_TYPE_PROPAGATOR_ANALYZER_H_
 #define SYZYGY_REFINERY_ANALYZERS_TYPE_PROPAGATOR_ANALYZER_H_
 
+#include <queue>
+#include <set>
+#include <tuple>
+
 #include "base/macros.h"
 #include "base/memory/ref_counted.h"
 #include "syzygy/refinery/analyzers/analyzer.h"
@@ -24,10 +28,11 @@
 namespace refinery {
 
 // The type propagator looks for typed pointers in existing typed blocks,
-// and propagates the type to the destination block.
-// TODO(manzagop): The analyzer currently does a single analysis pass over the
-// contents of the typed block layer. Add processing for the newly generated
-// types.
+// and propagates the type to the destination block. The destination blocks
+// are in turn analyzed, through a worklist that holds each typed object,
+// identified by its address and its type, at most once. An object graph is
+// thus analyzed in time linear in its number of reachable typed objects, no
+// matter how much of it is shared or how many cycles it has.
 // TODO(manzagop): The analyzer may be called more than once, eg if another
 // analyzer produces new typed blocks. Have a mechanism to avoid re-processing
 // previously analyzed typed blocks.
@@ -43,6 +48,14 @@ class TypePropagatorAnalyzer : public Analyzer {
   ANALYZER_OUTPUT_LAYERS(ProcessState::TypedBlockLayer)
 
  private:
+  // Identifies a typed object. Type ids are only unique within their
+  // repository.
+  typedef std::tuple<Address, const TypeRepository*, TypeId> ObjectKey;
+
+  // Queues @p typed_data for analysis, unless it was already queued.
+  // @returns true if @p typed_data was queued.
+  bool Enqueue(const TypedData& typed_data);
+
   bool AnalyzeTypedData(const TypedData& data, ProcessState* process_state);
   bool AnalyzeTypedDataUDT(const TypedData& typed_data,
                            ProcessState* process_state);
@@ -53,6 +66,11 @@ class TypePropagatorAnalyzer : public Analyzer {
 
   bool AddTypedBlock(const TypedData& typed_data, ProcessState* process_state);
 
+  // The typed objects left to analyze.
+  std::queue<TypedData> worklist_;
+  // The typed objects queued so far, including those already analyzed.
+  std::set<ObjectKey> visited_;
+
   static const char kTypePropagatorAnalyzerName[];
 
   DISALLOW_COPY_AND_ASSIGN(TypePropagatorAnalyzer);
@@ -94,6 +94,24 @@ struct SimpleUDT {
   int32_t* pointer;
 };
 
+struct ListNode {
+  ListNode* next;
+};
+
+// Add the bytes backing a list node to the bytes layer.
+void AddListNodeBytesRecord(ProcessState* process_state, ListNode* node) {
+  BytesLayerPtr bytes_layer;
+  process_state->FindOrCreateLayer(&bytes_layer);
+
+  BytesRecordPtr bytes_record;
+  bytes_layer->CreateRecord(AddressRange(ToAddress(node), sizeof(*node)),
+                            &bytes_record);
+
+  Bytes* bytes_proto = bytes_record->mutable_data();
+  std::string* buffer = bytes_proto->mutable_data();
+  memcpy(base::WriteInto(buffer, sizeof(*node) + 1), node, sizeof(*node));
+}
+
 }  // namespace
 
 class TypePropagatorAnalyzerTest : public testing::Test {
@@ -244,4 +262,46 @@ TEST_F(TypePropagatorAnalyzerTest, AnalyzeMinidumpUDT) {
   ASSERT_NO_FATAL_FAILURE(Validate());
 }
 
+TEST_F(TypePropagatorAnalyzerTest, AnalyzeMinidumpCyclicList) {
+  // Create a list node type, whose only field points to another node.
+  UserDefinedTypePtr node_type = new UserDefinedType(
+      L"ListNode", sizeof(ListNode), UserDefinedType::UDT_STRUCT);
+  repo_->AddType(node_type);
+  PointerTypePtr node_ptr_type =
+      new PointerType(sizeof(ListNode*), PointerType::PTR_MODE_PTR);
+  repo_->AddType(node_ptr_type);
+  node_ptr_type->Finalize(kNoTypeFlags, node_type->type_id());
+  UserDefinedType::Fields fields;
+  fields.push_back(new UserDefinedType::MemberField(
+      L"next", 0, kNoTypeFlags, 0, 0, node_ptr_type->type_id(),
+      repo_.get()));
+  UserDefinedType::Functions functions;
+  node_type->Finalize(&fields, &functions);
+
+  // A cyclic list of three nodes, reached through the first one only.
+  ListNode nodes[3];
+  nodes[0].next = &nodes[1];
+  nodes[1].next = &nodes[2];
+  nodes[2].next = &nodes[0];
+  for (ListNode& node : nodes)
+    AddListNodeBytesRecord(&process_state_, &node);
+
+  ASSERT_TRUE(AddTypedBlockRecord(
+      AddressRange(ToAddress(&nodes[0]), sizeof(nodes[0])), L"head",
+      module_id_, node_type->type_id(), &process_state_));
+  TypedBlockLayerPtr typedblock_layer;
+  ASSERT_TRUE(process_state_.FindLayer(&typedblock_layer));
+  ASSERT_EQ(1, typedblock_layer->size());
+
+  // The analyzer follows the list transitively, records each node once, and
+  // terminates.
+  ASSERT_TRUE(Analyze());
+  ASSERT_EQ(3, typedblock_layer->size());
+  for (size_t i = 1; i < arraysize(nodes); ++i) {
+    ASSERT_NO_FATAL_FAILURE(ValidateTypedBlockLayerEntry(
+        ToAddress(&nodes[i]), sizeof(ListNode), module_id_,
+        node_type->type_id(), "", &process_state_));
+  }
+}
+
 }  // namespace refinery
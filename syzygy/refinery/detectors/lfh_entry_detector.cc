@@ -14,6 +14,9 @@
 
 #include "syzygy/refinery/detectors/lfh_entry_detector.h"
 
+#include <string.h>
+#include <algorithm>
+
 #include "base/logging.h"
 #include "base/containers/hash_tables.h"
 #include "syzygy/common/align.h"
@@ -21,7 +24,51 @@
 
 namespace refinery {
 
+namespace {
+
+// Flags an LFH entry in the extended block signature.
+const uint16_t kLFHBlockFlag = 0x80;
+
+// Reads the value of an unsigned entry field from the bytes of an entry.
+template <typename EntryField>
+uint64_t GetFieldValue(const EntryField& field, const uint8_t* entry_bytes) {
+  // Little-endian byte order assumed.
+  uint64_t value = 0;
+  ::memcpy(&value, entry_bytes + field.offset, field.size);
+
+  // Shift & mask bit fields.
+  if (field.bit_len != 0) {
+    value >>= field.bit_pos;
+    value &= (1ull << field.bit_len) - 1;
+  }
+
+  return value;
+}
+
+// Validates an entry to the extent possible from its header.
+bool IsValidEntryHeader(uint64_t extended_block_signature) {
+  // Check that the LFH flag is set on the entry.
+  if ((extended_block_signature & kLFHBlockFlag) == 0)
+    return false;
+
+  // Check that the rest of the entry is sane. Free blocks have the remaining
+  // bits set, whereas used blocks use the remaining bits to encode the number
+  // of unused bytes in the block, plus 8.
+  const uint16_t kLFHUnusedBytesMask = 0x7F;
+  if ((extended_block_signature & kLFHUnusedBytesMask) != 0 &&
+      (extended_block_signature & kLFHUnusedBytesMask) < 8) {
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
 LFHEntryDetector::LFHEntryDetector() : bit_source_(nullptr) {
+  ::memset(&subsegment_code_field_, 0, sizeof(subsegment_code_field_));
+  ::memset(&extended_block_signature_field_, 0,
+           sizeof(extended_block_signature_field_));
 }
 
 bool LFHEntryDetector::Init(TypeRepository* repo, BitSource* bit_source) {
@@ -40,6 +87,14 @@ bool LFHEntryDetector::Init(TypeRepository* repo, BitSource* bit_source) {
   if (!entry_type_)
     return false;
 
+  if (!GetEntryField(L"SubSegmentCode", &subsegment_code_field_) ||
+      !GetEntryField(L"ExtendedBlockSignature",
+                     &extended_block_signature_field_)) {
+    LOG(ERROR) << "Unexpected layout of the heap entry type.";
+    entry_type_ = nullptr;
+    return false;
+  }
+
   bit_source_ = bit_source;
 
   return true;
@@ -57,30 +112,103 @@ bool LFHEntryDetector::Detect(const AddressRange& range,
   // This will be 8 or 16 depending on bitness.
   // TODO(siggi): Fix this code for 64 bit.
   const size_t kEntrySize = entry_type_->size();
+  if (range.size() < kEntrySize)
+    return true;
   const Address start = common::AlignUp(range.start(), kEntrySize);
   const Address end =
       common::AlignDown(range.end() - entry_type_->size(), kEntrySize);
+  if (end <= start)
+    return true;
   DCHECK_EQ(0, (end - start) % kEntrySize);
 
-  // TODO(siggi): This is ~O(N^2) and so is wasteful for large ranges.
-  //     A better approach might be to process the entire range, count up all
-  //     the subsegment codes that occur, with the first occurrence of each.
-  //     This will then allow processing the range in closer to O(N), as a
-  //     search will only be done where a code occurs more than once, and then
-  //     from the first occurrence of that code.
+  // Decode all the entries of the range at once.
+  const size_t kNumEntries = (end - start) / kEntrySize;
+  LFHEntries entries;
+  std::vector<bool> available;
+  DecodeEntries(start, kEntrySize, kNumEntries, &entries, &available);
+
+  // Index the entries by subsegment code, in address order.
+  std::unordered_map<uint64_t, std::vector<size_t>> entries_by_code;
+  for (size_t i = 0; i < kNumEntries; ++i) {
+    if (available[i])
+      entries_by_code[entries[i].subsegment_code].push_back(i);
+  }
+
+  // The search for the matches of an entry stops at the first entry that
+  // can't be read. This holds the index of the first such entry at or after
+  // each index.
+  std::vector<size_t> next_unavailable(kNumEntries + 1, kNumEntries);
+  for (size_t i = kNumEntries; i > 0; --i)
+    next_unavailable[i - 1] = available[i - 1] ? next_unavailable[i] : i - 1;
+
+  // Each subsegment code is searched from its first valid entry, so that each
+  // entry is visited at most once as a match.
   SubsegmentSet used_subsegments;
-  for (Address curr = start; curr < end; curr += kEntrySize) {
-    LFHEntryRun found_run;
+  for (size_t i = 0; i < kNumEntries; ++i) {
+    if (!available[i])
+      continue;
+
+    const LFHEntry& entry = entries[i];
+    uint64_t subseg = entry.subsegment_code;
+
+    // See whether we've already discovered this subsegment.
+    if (used_subsegments.find(subseg) != used_subsegments.end())
+      continue;
+
+    // Validate the entry to the extent possible at this point.
+    if (!IsValidEntryHeader(entry.extended_block_signature))
+      continue;
+
+    // Now that the entry has passed initial validation, record that we're
+    // processing this subsegment value.
+    used_subsegments.insert(subseg);
+
+    // The distance histogram is used to pick an entry size by simple majority
+    // vote. This yields some resilience to corruption and false positive
+    // matches. Matches are searched from two entries on.
+    DistanceHistogram distances;
+    Address last_match = entry.address;
+    if (i + 2 < kNumEntries) {
+      const std::vector<size_t>& matches = entries_by_code[subseg];
+      size_t search_end = next_unavailable[i + 2];
+      auto it = std::lower_bound(matches.begin(), matches.end(), i + 2);
+      for (; it != matches.end() && *it < search_end; ++it) {
+        // TODO(siggi): It may make sense to validate the entries to cut down
+        //     on false positives.
+        Address match = entries[*it].address;
+
+        // Record the distance from the last match.
+        ++distances[match - last_match];
+        last_match = match;
+      }
+    }
 
-    if (ScanForEntryMatch(AddressRange(curr, end - curr), &used_subsegments,
-                          &found_run)) {
+    LFHEntryRun found_run;
+    if (VoteForRun(entry.address, last_match, subseg, distances, &found_run))
       found_runs->push_back(found_run);
-    }
   }
 
   return true;
 }
 
+bool LFHEntryDetector::GetRunEntries(const LFHEntryRun& run,
+                                     LFHEntries* entries) {
+  DCHECK(entries);
+  DCHECK(bit_source_);
+  DCHECK(entry_type_);
+  DCHECK_NE(0U, run.entry_distance_bytes);
+  DCHECK_LE(run.first_entry, run.last_entry);
+
+  const size_t kNumEntries =
+      (run.last_entry - run.first_entry) / run.entry_distance_bytes + 1;
+  std::vector<bool> available;
+  DecodeEntries(run.first_entry, run.entry_distance_bytes, kNumEntries,
+                entries, &available);
+
+  return std::find(available.begin(), available.end(), false) ==
+         available.end();
+}
+
 bool LFHEntryDetector::GetDecodedLFHEntrySubsegment(
     const TypedData& lfh_heap_entry,
     uint64_t* decoded_subseg) {
@@ -100,89 +228,88 @@ bool LFHEntryDetector::GetDecodedLFHEntrySubsegment(
   return true;
 }
 
-bool LFHEntryDetector::ScanForEntryMatch(const AddressRange& range,
-                                         SubsegmentSet* used_subsegments,
-                                         LFHEntryRun* found_run) {
-  DCHECK(range.IsValid());
-  DCHECK(found_run);
-  DCHECK(used_subsegments);
-  DCHECK(bit_source_);
+bool LFHEntryDetector::GetEntryField(const base::StringPiece16& name,
+                                     EntryField* field) const {
+  DCHECK(field);
   DCHECK(entry_type_);
 
-  // Cast the start of the range to a HEAP_ENTRY.
-  TypedData lfh_heap_entry(bit_source_, entry_type_, range.start());
-  uint64_t subseg = 0;
-  if (!GetDecodedLFHEntrySubsegment(lfh_heap_entry, &subseg)) {
-    VLOG(1) << "Failed to get subsegment from base entry.";
-    return false;
-  }
+  for (const FieldPtr& entry_field : entry_type_->fields()) {
+    MemberFieldPtr member;
+    if (!entry_field->CastTo(&member) || name != member->name())
+      continue;
 
-  // See whether we've already discovered this subsegment.
-  if (used_subsegments->find(subseg) != used_subsegments->end())
-    return false;
+    TypePtr type = member->GetType();
+    if (!type)
+      return false;
 
-  // Validate the entry to the extent possible at this point.
-  TypedData extended_block_signature_field;
-  if (!lfh_heap_entry.GetNamedField(L"ExtendedBlockSignature",
-                                    &extended_block_signature_field)) {
-    LOG(ERROR) << "No ExtendedBlockSignature field in entry.";
-    return false;
-  }
+    size_t size = type->size();
+    if (size != sizeof(uint8_t) && size != sizeof(uint16_t) &&
+        size != sizeof(uint32_t) && size != sizeof(uint64_t)) {
+      return false;
+    }
+    if (member->offset() < 0 ||
+        static_cast<size_t>(member->offset()) + size > entry_type_->size()) {
+      return false;
+    }
 
-  uint64_t extended_block_signature = 0;
-  if (!extended_block_signature_field.GetUnsignedValue(
-          &extended_block_signature)) {
-    VLOG(1) << "Failed to get extended_block_signature from base entry.";
-    return false;
+    field->offset = member->offset();
+    field->size = size;
+    field->bit_pos = member->bit_pos();
+    field->bit_len = member->bit_len();
+    return true;
   }
 
-  // Check that the LFH flag is set on the entry.
-  const uint16_t kLFHBlockFlag = 0x80;
-  if ((extended_block_signature & kLFHBlockFlag) == 0)
-    return false;
-
-  // Check that the rest of the entry is sane. Free blocks have the remaining
-  // bits set, whereas used blocks use the remaining bits to encode the number
-  // of unused bytes in the block, plus 8.
-  const uint16_t kLFHUnusedBytesMask = 0x7F;
-  if ((extended_block_signature & kLFHUnusedBytesMask) != 0 &&
-      (extended_block_signature & kLFHUnusedBytesMask) < 8) {
-    return false;
-  }
+  return false;
+}
 
-  // Now that the entry has passed initial validation, record that we're
-  // processing this subsegment value.
-  used_subsegments->insert(subseg);
-
-  // The distance histogram is used to pick an entry size by simple majority
-  // vote. This yields some resilience to corruption and false positive
-  // matches.
-  using DistanceHistogram = std::unordered_map<size_t, size_t>;
-  DistanceHistogram distances;
-  Address last_match = range.start();
-
-  // Bound the search to the size of the range we're given.
-  size_t end = range.size() / lfh_heap_entry.type()->size();
-  for (size_t i = 2; i < end; ++i) {
-    // Walk forward to the next candidate.
-    TypedData candidate;
-    if (!lfh_heap_entry.OffsetAndCast(i, lfh_heap_entry.type(), &candidate))
-      break;
+void LFHEntryDetector::DecodeEntries(Address first,
+                                     size_t stride,
+                                     size_t num_entries,
+                                     LFHEntries* entries,
+                                     std::vector<bool>* available) {
+  DCHECK(entries);
+  DCHECK(available);
 
-    uint64_t candidate_subseg = 0;
-    if (!GetDecodedLFHEntrySubsegment(candidate, &candidate_subseg))
-      break;
+  entries->resize(num_entries);
+  available->assign(num_entries, false);
+  if (num_entries == 0)
+    return;
 
-    // TODO(siggi): It may make sense to validate the entries to cut down on
-    //     false positives.
-    if (subseg == candidate_subseg) {
-      const size_t kDistance = candidate.addr() - last_match;
-      last_match = candidate.addr();
+  const size_t kEntrySize = entry_type_->size();
+  std::vector<uint8_t> bytes((num_entries - 1) * stride + kEntrySize);
+  size_t bytes_read = 0;
+  if (!bit_source_->GetFrom(AddressRange(first, bytes.size()), &bytes_read,
+                            bytes.data())) {
+    bytes_read = 0;
+  }
 
-      // Record the distance from the last match.
-      ++distances[kDistance];
+  for (size_t i = 0; i < num_entries; ++i) {
+    const size_t offset = i * stride;
+    const Address address = first + offset;
+    if (offset + kEntrySize > bytes_read &&
+        !bit_source_->GetAll(AddressRange(address, kEntrySize),
+                             &bytes[offset])) {
+      continue;
     }
+
+    LFHEntry* entry = &entries->at(i);
+    entry->address = address;
+    // Back out the XORed address of the entry itself.
+    entry->subsegment_code =
+        GetFieldValue(subsegment_code_field_, &bytes[offset]) ^ (address >> 3);
+    entry->extended_block_signature =
+        GetFieldValue(extended_block_signature_field_, &bytes[offset]);
+    (*available)[i] = true;
   }
+}
+
+// static
+bool LFHEntryDetector::VoteForRun(Address first_entry,
+                                  Address last_entry,
+                                  uint64_t subsegment_code,
+                                  const DistanceHistogram& distances,
+                                  LFHEntryRun* found_run) {
+  DCHECK(found_run);
 
   if (distances.size() == 0)
     return false;
@@ -203,12 +330,12 @@ bool LFHEntryDetector::ScanForEntryMatch(const AddressRange& range,
   }
 
   // Record the found run.
-  found_run->first_entry = range.start();
-  found_run->last_entry = last_match;
+  found_run->first_entry = first_entry;
+  found_run->last_entry = last_entry;
   found_run->entry_distance_bytes = voted_size;
   found_run->size_votes = voted_count;
   found_run->entries_found = num_votes + 1;
-  found_run->subsegment_code = subseg;
+  found_run->subsegment_code = subsegment_code;
 
   return true;
 }
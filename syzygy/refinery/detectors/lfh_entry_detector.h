@@ -16,9 +16,11 @@
 #define SYZYGY_REFINERY_DETECTORS_LFH_ENTRY_DETECTOR_H_
 
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "base/macros.h"
+#include "base/strings/string_piece.h"
 
 #include "syzygy/refinery/types/type.h"
 #include "syzygy/refinery/types/type_repository.h"
@@ -50,6 +52,11 @@ namespace refinery {
 // Note that a detection can result in false positives if the contents of
 // memory are just so. Because of the way heap entries are obfuscated, this is
 // fairly unlikely however.
+//
+// The memory of a range is read in one go, and its entries are decoded from
+// the copy using the layout of the heap entry type resolved on Init. The
+// entries are then indexed by subsegment code, so that the matches of an entry
+// are found without probing the range entry by entry.
 class LFHEntryDetector {
  public:
   // Details on a discovered run of LFH heap entries. Note that a run of
@@ -76,6 +83,18 @@ class LFHEntryDetector {
   };
   using LFHEntryRuns = std::vector<LFHEntryRun>;
 
+  // The decoded header of an LFH entry.
+  struct LFHEntry {
+    // The address of the entry.
+    Address address;
+    // The subsegment code of the entry, with the address of the entry XORed
+    // back out.
+    uint64_t subsegment_code;
+    // The extended block signature of the entry.
+    uint64_t extended_block_signature;
+  };
+  using LFHEntries = std::vector<LFHEntry>;
+
   LFHEntryDetector();
 
   // Initialize the detector with @p repo, which needs to contain types
@@ -95,6 +114,14 @@ class LFHEntryDetector {
   //     found.
   bool Detect(const AddressRange& range, LFHEntryRuns* found_runs);
 
+  // Decodes the entries of a run, from a single read of the memory spanning
+  // them.
+  // @param run the run of entries, its distance must be non-zero.
+  // @param entries returns the entries at each distance of @p run from its
+  //     first entry up to its last entry.
+  // @returns true on success, false if any of the entries can't be read.
+  bool GetRunEntries(const LFHEntryRun& run, LFHEntries* entries);
+
   // Convenience decoding function.
   static bool GetDecodedLFHEntrySubsegment(const TypedData& lfh_heap_entry,
                                            uint64_t* decoded_subseg);
@@ -104,21 +131,49 @@ class LFHEntryDetector {
 
  private:
   typedef std::set<uint64_t> SubsegmentSet;
+  typedef std::unordered_map<size_t, size_t> DistanceHistogram;
+
+  // The layout of an unsigned field of the heap entry type.
+  struct EntryField {
+    size_t offset;
+    size_t size;
+    size_t bit_pos;
+    size_t bit_len;
+  };
 
-  // Scans forward through @p range for a run of entries starting at
-  // @p range.start().
-  // @param range the address range to search.
-  // @param used_subsegments a set of subsegment codes already discovered.
-  // @param found_run contains the most recently discovered run on success.
-  // @returns true if a run of two or more entries with a new subsegment
-  //    code is found.
-  bool ScanForEntryMatch(const AddressRange& range,
-                         SubsegmentSet* used_subsegments,
+  // Gets the layout of the field named @p name of the heap entry type.
+  // @returns true on success, false if there's no such unsigned field.
+  bool GetEntryField(const base::StringPiece16& name, EntryField* field) const;
+
+  // Decodes @p num_entries entries spaced @p stride bytes apart, starting at
+  // @p first. The memory spanning the entries is read in one go. Entries
+  // beyond the available head of that memory are read one by one.
+  // @param entries returns the decoded entries.
+  // @param available returns whether each of the entries could be read.
+  void DecodeEntries(Address first,
+                     size_t stride,
+                     size_t num_entries,
+                     LFHEntries* entries,
+                     std::vector<bool>* available);
+
+  // Picks the distance between the entries of a run by majority vote.
+  // @param first_entry the first entry of the run.
+  // @param last_entry the last entry of the run.
+  // @param subsegment_code the subsegment code of the run.
+  // @param distances the histogram of distances between matching entries.
+  // @param found_run returns the run on success.
+  // @returns true if there is at least one vote.
+  static bool VoteForRun(Address first_entry,
+                         Address last_entry,
+                         uint64_t subsegment_code,
+                         const DistanceHistogram& distances,
                          LFHEntryRun* found_run);
 
   // Valid from Init().
   BitSource* bit_source_;
   UserDefinedTypePtr entry_type_;
+  EntryField subsegment_code_field_;
+  EntryField extended_block_signature_field_;
 
   DISALLOW_COPY_AND_ASSIGN(LFHEntryDetector);
 };
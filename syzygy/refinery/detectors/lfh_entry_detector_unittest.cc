@@ -41,6 +41,10 @@ class LFHEntryDetectorTest : public testing::LFHDetectorTest {
     ::memcpy(dst_addr, &subseg_code, sizeof(subseg_code));
   }
 
+  Address GetTestDataAddress(size_t byte_offset) {
+    return testing::ToAddress(&test_data_.at(byte_offset));
+  }
+
   void DetectTestData(LFHEntryDetector::LFHEntryRuns* found_runs) {
     ASSERT_TRUE(found_runs);
 
@@ -155,4 +159,30 @@ TEST_F(LFHEntryDetectorTest, VotingPicksMinimumDistance) {
   EXPECT_EQ(16, found_runs[0].entry_distance_bytes);
 }
 
+TEST_F(LFHEntryDetectorTest, GetRunEntries) {
+  ResetTestData(1024);
+
+  const uintptr_t kSubsegCode = 0xCAFEBABE;
+  WriteSubseg(16 * 1, kSubsegCode);
+  WriteSubseg(16 * 2, kSubsegCode);
+  WriteSubseg(16 * 3, kSubsegCode);
+
+  LFHEntryDetector::LFHEntryRuns found_runs;
+  ASSERT_NO_FATAL_FAILURE(DetectTestData(&found_runs));
+  ASSERT_EQ(1U, found_runs.size());
+  EXPECT_EQ(3U, found_runs[0].entries_found);
+
+  LFHEntryDetector detector;
+  ASSERT_TRUE(detector.Init(repo().get(), bit_source()));
+  LFHEntryDetector::LFHEntries entries;
+  ASSERT_TRUE(detector.GetRunEntries(found_runs[0], &entries));
+  ASSERT_EQ(3U, entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(GetTestDataAddress(16 * (i + 1)), entries[i].address);
+    EXPECT_EQ(kSubsegCode, entries[i].subsegment_code);
+    // The extended block signature is left as written by ResetTestData.
+    EXPECT_EQ(0x80U, entries[i].extended_block_signature);
+  }
+}
+
 }  // namespace refinery
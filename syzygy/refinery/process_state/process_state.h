@@ -15,13 +15,16 @@
 #ifndef SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
 #define SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
 
+#include <algorithm>
 #include <iterator>
 #include <map>
 #include <vector>
 
+#include "base/bits.h"
 #include "base/logging.h"
 #include "base/macros.h"
 #include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/refinery/core/address.h"
 #include "syzygy/refinery/core/bit_source.h"
 #include "syzygy/refinery/process_state/layer_traits.h"
@@ -51,6 +54,9 @@ namespace refinery {
 // process' virtual memory space, and contains data specific to that layer and
 // range. Each layer and the data associated with a record is a protobuf of
 // a type appropriate to the layer.
+// @note Layers may be found or created from several threads. Beyond that, a
+//     layer may be read concurrently, but must not be read or written while
+//     another thread writes it.
 class ProcessState : public BitSource {
  public:
   template <typename RecordType> class Layer;
@@ -129,9 +135,16 @@ class ProcessState : public BitSource {
  private:
   class LayerBase;
 
+  // @pre layers_lock_ is held.
+  // @{
+  template<typename RecordType>
+  bool FindLayerLocked(scoped_refptr<Layer<RecordType>>* layer);
   template<typename RecordType>
   void CreateLayer(scoped_refptr<Layer<RecordType>>* layer);
+  // @}
 
+  // Guards layers_.
+  base::Lock layers_lock_;
   std::map<RecordId, scoped_refptr<LayerBase>> layers_;
 
   bool has_exception;
@@ -143,12 +156,12 @@ class ProcessState : public BitSource {
 // A layer is one view on a process (eg raw bytes, stack, stack frames,
 // typed blocks). It's a bag of records that span some part of the process'
 // address space.
-class ProcessState::LayerBase : public base::RefCounted<LayerBase> {
+class ProcessState::LayerBase : public base::RefCountedThreadSafe<LayerBase> {
  public:
   LayerBase() {}
 
  protected:
-  friend class base::RefCounted<LayerBase>;
+  friend class base::RefCountedThreadSafe<LayerBase>;
   virtual ~LayerBase() {}
 
  private:
@@ -158,7 +171,8 @@ class ProcessState::LayerBase : public base::RefCounted<LayerBase> {
 // An individual record of a layer. Contains the data associated with the
 // record as a protobuffer.
 template <typename RecordType>
-class ProcessState::Record : public base::RefCounted<Record<RecordType>> {
+class ProcessState::Record
+    : public base::RefCountedThreadSafe<Record<RecordType>> {
  public:
   // @pre @p range must be a valid range.
   explicit Record(AddressRange range) : range_(range) {
@@ -173,7 +187,7 @@ class ProcessState::Record : public base::RefCounted<Record<RecordType>> {
   // @}
 
  private:
-  friend class base::RefCounted<Record<RecordType>>;
+  friend class base::RefCountedThreadSafe<Record<RecordType>>;
   ~Record() {}
 
   AddressRange range_;
@@ -201,14 +215,14 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   // Gets records that fully span |range|.
   // @pre @p range must be a valid.
   // @param range the address range the region records should span.
-  // @param records contains the matching records.
+  // @param records contains the matching records, ordered by address.
   void GetRecordsSpanning(const AddressRange& range,
                           std::vector<RecordPtr>* records) const;
 
   // Gets records that intersect |range|.
   // @pre @p range must be a valid.
   // @param range the address range the region records should intersect.
-  // @param records contains the matching records.
+  // @param records contains the matching records, ordered by address.
   void GetRecordsIntersecting(const AddressRange& range,
                               std::vector<RecordPtr>* records) const;
 
@@ -227,8 +241,26 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   typename LayerTraits<RecordType>::DataType* mutable_data() { return &data_; }
 
  private:
+  // Records are also indexed by size class: class k holds the records whose
+  // size is in [2^k, 2^(k+1)), by address. A record of class k can only
+  // intersect a range if it starts less than 2^(k+1) bytes before the range,
+  // which bounds the part of each class a range query has to visit.
+  static const size_t kNumSizeClasses = sizeof(Size) * 8;
+  typedef std::multimap<Address, Record<RecordType>*> SizeClassIndex;
+
+  // @returns the size class of records of size @p size.
+  static size_t GetSizeClass(Size size);
+
+  // @returns the address from which records of size class @p size_class
+  //     must be considered to find those that reach into @p addr.
+  static Address GetSizeClassLowerBound(size_t size_class, Address addr);
+
+  // Sorts @p records by address.
+  static void SortRecords(std::vector<RecordPtr>* records);
+
   typename LayerTraits<RecordType>::DataType data_;
   std::multimap<Address, RecordPtr> records_;
+  SizeClassIndex size_classes_[kNumSizeClasses];
 };
 
 #define DECL_LAYER_TYPES(layer_name)                                           \
@@ -277,14 +309,8 @@ template<typename RecordType>
 bool ProcessState::FindLayer(scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
 
-  RecordId id = RecordTraits<RecordType>::ID;
-  auto it = layers_.find(id);
-  if (it != layers_.end()) {
-    *layer = static_cast<Layer<RecordType>*>(it->second.get());
-    return true;
-  }
-
-  return false;
+  base::AutoLock auto_lock(layers_lock_);
+  return FindLayerLocked(layer);
 }
 
 template <typename RecordType>
@@ -292,12 +318,28 @@ void ProcessState::FindOrCreateLayer(
     scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
 
-  if (FindLayer(layer))
+  base::AutoLock auto_lock(layers_lock_);
+  if (FindLayerLocked(layer))
     return;
 
   CreateLayer(layer);
 }
 
+template<typename RecordType>
+bool ProcessState::FindLayerLocked(scoped_refptr<Layer<RecordType>>* layer) {
+  DCHECK(layer != nullptr);
+  layers_lock_.AssertAcquired();
+
+  RecordId id = RecordTraits<RecordType>::ID;
+  auto it = layers_.find(id);
+  if (it != layers_.end()) {
+    *layer = static_cast<Layer<RecordType>*>(it->second.get());
+    return true;
+  }
+
+  return false;
+}
+
 template <typename RecordType>
 bool ProcessState::FindSingleRecord(Address addr,
                                     scoped_refptr<Record<RecordType>>* record) {
@@ -319,6 +361,7 @@ bool ProcessState::FindSingleRecord(Address addr,
 template<typename RecordType>
 void ProcessState::CreateLayer(scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
+  layers_lock_.AssertAcquired();
 
   scoped_refptr<Layer<RecordType>> new_layer = new Layer<RecordType>();
   DCHECK(new_layer.get() != nullptr);
@@ -339,7 +382,22 @@ void ProcessState::Layer<RecordType>::CreateRecord(
   DCHECK(record != nullptr);
 
   RecordPtr new_record = new Record<RecordType>(range);
-  records_.insert(std::make_pair(range.start(), new_record));
+
+  // Records are often created in address order, in which case they're placed
+  // at the end of the maps in constant time.
+  SizeClassIndex& size_class_index = size_classes_[GetSizeClass(range.size())];
+  if (records_.empty() || records_.rbegin()->first <= range.start()) {
+    records_.insert(records_.end(), std::make_pair(range.start(), new_record));
+  } else {
+    records_.insert(std::make_pair(range.start(), new_record));
+  }
+  if (size_class_index.empty() ||
+      size_class_index.rbegin()->first <= range.start()) {
+    size_class_index.insert(size_class_index.end(),
+                            std::make_pair(range.start(), new_record.get()));
+  } else {
+    size_class_index.insert(std::make_pair(range.start(), new_record.get()));
+  }
 
   record->swap(new_record);
 }
@@ -365,16 +423,23 @@ void ProcessState::Layer<RecordType>::GetRecordsSpanning(
 
   records->clear();
 
-  for (const auto& entry : records_) {
-    AddressRange record_range = entry.second->range();
-    DCHECK(record_range.IsValid());
-    if (record_range.Contains(range))
-      records->push_back(entry.second);
-
-    if (record_range.start() > range.start())
-      // Records that start after the range, or any after, cannot span it.
-      return;
+  // Records smaller than the range can't span it, which skips the classes
+  // below that of the range.
+  for (size_t size_class = GetSizeClass(range.size());
+       size_class < kNumSizeClasses; ++size_class) {
+    const SizeClassIndex& index = size_classes_[size_class];
+    auto it = index.lower_bound(
+        GetSizeClassLowerBound(size_class, range.start()));
+    // Records that start after the range cannot span it.
+    for (; it != index.end() && it->first <= range.start(); ++it) {
+      AddressRange record_range = it->second->range();
+      DCHECK(record_range.IsValid());
+      if (record_range.Contains(range))
+        records->push_back(it->second);
+    }
   }
+
+  SortRecords(records);
 }
 
 template <typename RecordType>
@@ -385,12 +450,19 @@ void ProcessState::Layer<RecordType>::GetRecordsIntersecting(
 
   records->clear();
 
-  for (const auto& entry : records_) {
-    AddressRange record_range = entry.second->range();
-    DCHECK(record_range.IsValid());
-    if (record_range.Intersects(range))
-      records->push_back(entry.second);
+  for (size_t size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+    const SizeClassIndex& index = size_classes_[size_class];
+    auto it = index.lower_bound(
+        GetSizeClassLowerBound(size_class, range.start()));
+    for (; it != index.end() && it->first < range.end(); ++it) {
+      AddressRange record_range = it->second->range();
+      DCHECK(record_range.IsValid());
+      if (record_range.Intersects(range))
+        records->push_back(it->second);
+    }
   }
+
+  SortRecords(records);
 }
 
 template <typename RecordType>
@@ -399,17 +471,57 @@ bool ProcessState::Layer<RecordType>::RemoveRecord(const RecordPtr& record) {
 
   // Note: a record can only appear once, as per API (CreateRecord is the only
   // mechanism to add a record).
+  bool found = false;
   auto matches = records_.equal_range(record->range().start());
   for (auto it = matches.first; it != matches.second; ++it) {
     if (it->second.get() == record.get()) {
       records_.erase(it);
+      found = true;
+      break;
+    }
+  }
+  if (!found)
+    return false;
+
+  SizeClassIndex& index = size_classes_[GetSizeClass(record->range().size())];
+  auto index_matches = index.equal_range(record->range().start());
+  for (auto it = index_matches.first; it != index_matches.second; ++it) {
+    if (it->second == record.get()) {
+      index.erase(it);
       return true;
     }
   }
 
+  NOTREACHED() << "Record missing from the size class index.";
   return false;
 }
 
+template <typename RecordType>
+size_t ProcessState::Layer<RecordType>::GetSizeClass(Size size) {
+  DCHECK_NE(0U, size);
+  return base::bits::Log2Floor(size);
+}
+
+template <typename RecordType>
+Address ProcessState::Layer<RecordType>::GetSizeClassLowerBound(
+    size_t size_class, Address addr) {
+  DCHECK(size_class < kNumSizeClasses);
+  // The records of the class are at most 2^(k+1) - 1 bytes long.
+  Address max_size = (static_cast<Address>(1) << (size_class + 1)) - 1;
+  return addr > max_size ? addr - max_size : 0;
+}
+
+template <typename RecordType>
+void ProcessState::Layer<RecordType>::SortRecords(
+    std::vector<RecordPtr>* records) {
+  DCHECK(records != nullptr);
+  std::stable_sort(records->begin(), records->end(),
+                   [](const RecordPtr& record1, const RecordPtr& record2) {
+                     return record1->range().start() <
+                            record2->range().start();
+                   });
+}
+
 }  // namespace refinery
 
 #endif  // SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
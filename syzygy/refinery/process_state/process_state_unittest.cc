@@ -14,9 +14,11 @@
 
 #include "syzygy/refinery/process_state/process_state.h"
 
+#include <algorithm>
 #include <limits>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "gtest/gtest.h"
@@ -403,6 +405,67 @@ TEST(ProcessStateTest, RemoveRecord) {
   ASSERT_FALSE(bytes_layer->RemoveRecord(record));
 }
 
+TEST(ProcessStateTest, RangeQueriesMatchExhaustiveSearch) {
+  ProcessState report;
+  BytesLayerPtr bytes_layer;
+  report.FindOrCreateLayer(&bytes_layer);
+  ASSERT_TRUE(bytes_layer != nullptr);
+
+  // Create records of widely varying sizes, some of them overlapping, and
+  // remove a few of them.
+  std::vector<BytesRecordPtr> records;
+  for (size_t i = 0; i < 200; ++i) {
+    Address addr = (i * 7919) % 4096;
+    Size size = 1U << (i % 14);
+    size += (i * 31) % size;
+    BytesRecordPtr record;
+    bytes_layer->CreateRecord(AddressRange(addr, size), &record);
+    if (i % 5 == 0)
+      ASSERT_TRUE(bytes_layer->RemoveRecord(record));
+    else
+      records.push_back(record);
+  }
+  ASSERT_EQ(records.size(), bytes_layer->size());
+
+  for (Address addr = 0; addr < 8192; addr += 61) {
+    for (Size size = 1; size < 4096; size *= 3) {
+      AddressRange range(addr, size);
+      std::vector<BytesRecordPtr> spanning;
+      std::vector<BytesRecordPtr> intersecting;
+      for (const BytesRecordPtr& record : records) {
+        if (record->range().Contains(range))
+          spanning.push_back(record);
+        if (record->range().Intersects(range))
+          intersecting.push_back(record);
+      }
+
+      std::vector<BytesRecordPtr> matching_records;
+      bytes_layer->GetRecordsSpanning(range, &matching_records);
+      ASSERT_EQ(spanning.size(), matching_records.size());
+      for (size_t i = 0; i < matching_records.size(); ++i) {
+        EXPECT_NE(spanning.end(), std::find(spanning.begin(), spanning.end(),
+                                            matching_records[i]));
+        if (i > 0) {
+          EXPECT_LE(matching_records[i - 1]->range().start(),
+                    matching_records[i]->range().start());
+        }
+      }
+
+      bytes_layer->GetRecordsIntersecting(range, &matching_records);
+      ASSERT_EQ(intersecting.size(), matching_records.size());
+      for (size_t i = 0; i < matching_records.size(); ++i) {
+        EXPECT_NE(intersecting.end(),
+                  std::find(intersecting.begin(), intersecting.end(),
+                            matching_records[i]));
+        if (i > 0) {
+          EXPECT_LE(matching_records[i - 1]->range().start(),
+                    matching_records[i]->range().start());
+        }
+      }
+    }
+  }
+}
+
 TEST(ProcessStateTest, LayerIteration) {
   // Create a report that has a Bytes layer with few records.
   ProcessState report;
@@ -14,7 +14,10 @@
 
 #include "syzygy/refinery/process_state/process_state_util.h"
 
+#include <vector>
+
 #include "base/strings/utf_string_conversions.h"
+#include "syzygy/common/asan_shadow_excerpt.h"
 #include "syzygy/core/address.h"
 #include "syzygy/refinery/process_state/layer_traits.h"
 
@@ -134,4 +137,23 @@ bool AddTypedBlockRecord(const AddressRange& range,
   return true;
 }
 
+bool AddShadowExcerptRecord(Address address,
+                            const base::StringPiece& excerpt,
+                            ProcessState* process_state) {
+  DCHECK(process_state);
+
+  std::vector<uint8_t> shadow;
+  if (!common::DecodeShadowExcerpt(excerpt, &shadow))
+    return false;
+  AddressRange range(address, shadow.size());
+  if (!range.IsValid())
+    return false;
+
+  Bytes* bytes_proto = CreateRecord<Bytes>(range, process_state);
+  bytes_proto->mutable_data()->assign(
+      reinterpret_cast<const char*>(shadow.data()), shadow.size());
+
+  return true;
+}
+
 }  // namespace refinery
@@ -85,6 +85,18 @@ bool AddTypedBlockRecord(const AddressRange& range,
                          TypeId type_id,
                          ProcessState* process_state);
 
+// Adds a bytes record holding the SyzyASan shadow memory decoded from a
+// shadow excerpt, such as the "shadow-excerpt" blob of a crash report, to
+// @p process_state. The shadow state around an error can then be analyzed
+// without the shadow memory being in the minidump.
+// @param address the address of the first shadow byte of the excerpt.
+// @param excerpt the run-length encoded excerpt.
+// @param process_state the process state to add the record to.
+// @returns true on success, false if the excerpt is empty or malformed.
+bool AddShadowExcerptRecord(Address address,
+                            const base::StringPiece& excerpt,
+                            ProcessState* process_state);
+
 }  // namespace refinery
 
 #endif  // SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_UTIL_H_
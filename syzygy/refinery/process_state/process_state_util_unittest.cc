@@ -18,6 +18,7 @@
 
 #include "base/strings/utf_string_conversions.h"
 #include "gtest/gtest.h"
+#include "syzygy/common/asan_shadow_excerpt.h"
 #include "syzygy/refinery/core/address.h"
 #include "syzygy/refinery/process_state/layer_data.h"
 #include "syzygy/refinery/process_state/process_state.h"
@@ -169,4 +170,34 @@ TEST(AddTypedBlockRecord, BasicTest) {
   ASSERT_EQ(kModuleId, proto->module_id());
 }
 
+TEST(AddShadowExcerptRecord, BasicTest) {
+  const uint8_t kShadow[] = {0, 0, 0, 0xFA, 0xFA, 0x04, 0xFB, 0, 0};
+  std::string excerpt;
+  common::ShadowExcerptEncoder encoder(&excerpt);
+  encoder.AppendBytes(kShadow, sizeof(kShadow));
+  encoder.Flush();
+
+  ProcessState state;
+  ASSERT_TRUE(AddShadowExcerptRecord(kAddress, excerpt, &state));
+
+  // Validate a record was added with the decoded shadow.
+  BytesLayerPtr layer;
+  ASSERT_TRUE(state.FindLayer(&layer));
+  std::vector<BytesRecordPtr> matching_records;
+  layer->GetRecordsAt(kAddress, &matching_records);
+  ASSERT_EQ(1, matching_records.size());
+  BytesRecordPtr record = matching_records[0];
+  ASSERT_EQ(AddressRange(kAddress, sizeof(kShadow)), record->range());
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(kShadow),
+                        sizeof(kShadow)),
+            record->data().data());
+
+  // Empty or malformed excerpts aren't added.
+  ProcessState other_state;
+  ASSERT_FALSE(AddShadowExcerptRecord(kAddress, "", &other_state));
+  ASSERT_FALSE(AddShadowExcerptRecord(kAddress, "\xFA", &other_state));
+  BytesLayerPtr other_layer;
+  ASSERT_FALSE(other_state.FindLayer(&other_layer));
+}
+
 }  // namespace refinery
@@ -63,8 +63,10 @@
         'symbols/simple_cache_unittest.cc',
         'symbols/symbol_provider_unittest.cc',
         'symbols/symbol_provider_util_unittest.cc',
+        'symbols/type_repository_cache_unittest.cc',
         'types/type_unittest.cc',
         'types/type_repository_unittest.cc',
+        'types/type_repository_serializer_unittest.cc',
         'types/typed_data_unittest.cc',
         'types/dia_crawler_unittest.cc',
         'types/pdb_crawler_unittest.cc',
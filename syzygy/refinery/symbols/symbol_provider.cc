@@ -76,6 +76,13 @@ bool SymbolProvider::GetVFTableRVAs(
   return crawler.GetVFTableRVAs(vftable_rvas);
 }
 
+void SymbolProvider::set_cache_dir(const base::FilePath& cache_dir) {
+  if (cache_dir.empty())
+    type_repo_cache_.reset();
+  else
+    type_repo_cache_.reset(new TypeRepositoryCache(cache_dir));
+}
+
 void SymbolProvider::GetCacheKey(const pe::PEFile::Signature& signature,
                                  base::string16* cache_key) {
   DCHECK(cache_key);
@@ -92,6 +99,9 @@ bool SymbolProvider::CreateTypeRepository(
   DCHECK(type_repo);
   *type_repo = nullptr;
 
+  if (type_repo_cache_ && type_repo_cache_->Load(signature, type_repo))
+    return true;
+
   base::FilePath pdb_path;
   if (!GetPdbPath(signature, &pdb_path))
     return false;
@@ -103,6 +113,10 @@ bool SymbolProvider::CreateTypeRepository(
     return false;
   }
 
+  // Failing to save to the cache only costs a crawl in the next process.
+  if (type_repo_cache_)
+    type_repo_cache_->Save(signature, *repository);
+
   *type_repo = repository;
   return true;
 }
@@ -19,11 +19,13 @@
 
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
+#include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/strings/string16.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/refinery/core/address.h"
 #include "syzygy/refinery/symbols/simple_cache.h"
+#include "syzygy/refinery/symbols/type_repository_cache.h"
 #include "syzygy/refinery/types/type_repository.h"
 
 namespace refinery {
@@ -66,6 +68,14 @@ class SymbolProvider : public base::RefCounted<SymbolProvider> {
   virtual bool GetVFTableRVAs(const pe::PEFile::Signature& signature,
                               base::hash_set<RelativeAddress>* vftable_rvas);
 
+  // Sets the directory of an on-disk cache of type repositories. Once set,
+  // type repositories are loaded from the cache when possible, and saved to
+  // it after crawling a PDB file. This lets a series of processes analyzing
+  // the same modules only crawl their PDB files once.
+  // @param cache_dir the cache directory, or an empty path to disable the
+  //     on-disk cache.
+  void set_cache_dir(const base::FilePath& cache_dir);
+
  private:
   static void GetCacheKey(const pe::PEFile::Signature& signature,
                           base::string16* cache_key);
@@ -85,6 +95,9 @@ class SymbolProvider : public base::RefCounted<SymbolProvider> {
   SimpleCache<TypeRepository> type_repos_;
   SimpleCache<TypeNameIndex> typename_indices_;
 
+  // The on-disk cache of type repositories, if any.
+  std::unique_ptr<TypeRepositoryCache> type_repo_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(SymbolProvider);
 };
 
@@ -18,6 +18,8 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/utf_string_conversions.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -65,6 +67,47 @@ TEST(SymbolProviderTest, FindOrCreateTypeRepository) {
   ASSERT_EQ(repository.get(), second_repository.get());
 }
 
+TEST(SymbolProviderTest, FindOrCreateTypeRepositoryWithCacheDir) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  // Get the signature for test_types.dll.
+  const base::FilePath module_path(testing::GetSrcRelativePath(
+      L"syzygy\\refinery\\test_data\\test_types.dll"));
+  pe::PEFile pe_file;
+  ASSERT_TRUE(pe_file.Init(module_path));
+  pe::PEFile::Signature module_signature;
+  pe_file.GetSignature(&module_signature);
+
+  // The first provider crawls the PDB and populates the cache.
+  scoped_refptr<SymbolProvider> provider = new SymbolProvider();
+  provider->set_cache_dir(temp_dir.path());
+  scoped_refptr<TypeRepository> repository;
+  ASSERT_TRUE(
+      provider->FindOrCreateTypeRepository(module_signature, &repository));
+  ASSERT_TRUE(repository != nullptr);
+
+  TypeRepositoryCache cache(temp_dir.path());
+  base::FilePath entry_path;
+  cache.GetEntryPath(module_signature, &entry_path);
+  EXPECT_TRUE(base::PathExists(entry_path));
+
+  // A second provider, e.g. in another process, loads the same types.
+  scoped_refptr<SymbolProvider> second_provider = new SymbolProvider();
+  second_provider->set_cache_dir(temp_dir.path());
+  scoped_refptr<TypeRepository> second_repository;
+  ASSERT_TRUE(second_provider->FindOrCreateTypeRepository(module_signature,
+                                                          &second_repository));
+  ASSERT_TRUE(second_repository != nullptr);
+  EXPECT_EQ(repository->size(), second_repository->size());
+  for (const TypePtr& type : *repository) {
+    TypePtr second_type = second_repository->GetType(type->type_id());
+    ASSERT_TRUE(second_type != nullptr);
+    EXPECT_EQ(type->kind(), second_type->kind());
+    EXPECT_EQ(type->GetName(), second_type->GetName());
+  }
+}
+
 TEST(SymbolProviderTest, FindOrCreateTypeNameIndex) {
   ProcessState process_state;
   scoped_refptr<SymbolProvider> provider = new SymbolProvider();
@@ -35,6 +35,8 @@
         'symbol_provider.h',
         'symbol_provider_util.cc',
         'symbol_provider_util.h',
+        'type_repository_cache.cc',
+        'type_repository_cache.h',
       ],
     },
   ],
@@ -0,0 +1,166 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/symbols/type_repository_cache.h"
+
+#include <string>
+
+#include "base/logging.h"
+#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/refinery/types/type_repository_serializer.h"
+
+namespace refinery {
+
+namespace {
+
+// Signatures are compared as they are keyed: the base address of a module
+// varies from process to process, and its directory is irrelevant.
+bool IsSameModule(const pe::PEFile::Signature& signature1,
+                  const pe::PEFile::Signature& signature2) {
+  return base::FilePath(signature1.path).BaseName() ==
+             base::FilePath(signature2.path).BaseName() &&
+         signature1.module_size == signature2.module_size &&
+         signature1.module_checksum == signature2.module_checksum &&
+         signature1.module_time_date_stamp ==
+             signature2.module_time_date_stamp;
+}
+
+}  // namespace
+
+const wchar_t TypeRepositoryCache::kEntryExtension[] = L".types";
+
+TypeRepositoryCache::TypeRepositoryCache(const base::FilePath& cache_dir)
+    : cache_dir_(cache_dir) {
+  DCHECK(!cache_dir.empty());
+}
+
+void TypeRepositoryCache::GetEntryPath(const pe::PEFile::Signature& signature,
+                                       base::FilePath* entry_path) const {
+  DCHECK(entry_path);
+
+  // The name of the module keeps the entries readable, the rest of the key
+  // identifies its contents. As for the in-memory caches, the base address of
+  // the module is not part of the key.
+  std::wstring name = base::StringPrintf(
+      L"%ls-%08X%08X%08X%ls",
+      base::FilePath(signature.path).BaseName().value().c_str(),
+      signature.module_time_date_stamp, signature.module_size,
+      signature.module_checksum, kEntryExtension);
+  *entry_path = cache_dir_.Append(name);
+}
+
+bool TypeRepositoryCache::Load(const pe::PEFile::Signature& signature,
+                               scoped_refptr<TypeRepository>* type_repo) const {
+  DCHECK(type_repo);
+  *type_repo = nullptr;
+
+  base::FilePath entry_path;
+  GetEntryPath(signature, &entry_path);
+  if (!base::PathExists(entry_path)) {
+    VLOG(1) << "No type repository cache entry: " << entry_path.value();
+    return false;
+  }
+
+  scoped_refptr<TypeRepository> repository = new TypeRepository();
+  bool stale = false;
+  bool loaded = false;
+  {
+    base::MemoryMappedFile file;
+    if (!file.Initialize(entry_path)) {
+      LOG(WARNING) << "Unable to map type repository cache entry: "
+                   << entry_path.value();
+      return false;
+    }
+
+    core::ScopedInStreamPtr in_stream(
+        core::CreateByteInStream(file.data(), file.data() + file.length()));
+    core::NativeBinaryInArchive in_archive(in_stream.get());
+
+    // The signature and the stream version are checked before the repository
+    // is populated, a stale entry leaves it empty.
+    pe::PEFile::Signature entry_signature;
+    if (in_archive.Load(&entry_signature)) {
+      if (!IsSameModule(entry_signature, signature)) {
+        stale = true;
+      } else {
+        TypeRepositorySerializer serializer;
+        loaded = serializer.Load(&in_archive, repository.get());
+        stale = !loaded && repository->size() == 0;
+      }
+    }
+  }
+
+  if (!loaded) {
+    if (stale) {
+      LOG(WARNING) << "Ignoring stale type repository cache entry: "
+                   << entry_path.value();
+    } else {
+      LOG(ERROR) << "Deleting corrupt type repository cache entry: "
+                 << entry_path.value();
+      base::DeleteFile(entry_path, false);
+    }
+    return false;
+  }
+
+  VLOG(1) << "Loaded type repository from cache: " << entry_path.value();
+  *type_repo = repository;
+  return true;
+}
+
+bool TypeRepositoryCache::Save(const pe::PEFile::Signature& signature,
+                               const TypeRepository& type_repo) const {
+  base::FilePath entry_path;
+  GetEntryPath(signature, &entry_path);
+
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Unable to create type repository cache directory: "
+               << cache_dir_.value();
+    return false;
+  }
+
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in: "
+               << cache_dir_.value();
+    return false;
+  }
+
+  bool saved = false;
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    if (file.get() != NULL) {
+      core::FileOutStream out_stream(file.get());
+      core::NativeBinaryOutArchive out_archive(&out_stream);
+      TypeRepositorySerializer serializer;
+      saved = out_archive.Save(signature) &&
+              serializer.Save(type_repo, &out_archive) && out_archive.Flush();
+    }
+  }
+
+  base::File::Error error = base::File::FILE_OK;
+  if (!saved || !base::ReplaceFile(temp_path, entry_path, &error)) {
+    LOG(ERROR) << "Unable to write type repository cache entry: "
+               << entry_path.value();
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  VLOG(1) << "Saved type repository to cache: " << entry_path.value();
+  return true;
+}
+
+}  // namespace refinery
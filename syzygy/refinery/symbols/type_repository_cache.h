@@ -0,0 +1,83 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares TypeRepositoryCache, an on-disk cache of the type repositories of
+// modules. Crawling the PDB of a module for its types dominates the analysis
+// of a minidump, and batch triage jobs analyze many dumps of the same modules.
+// The cache stores the serialized type repository of a module in a directory,
+// in an entry that is keyed by the signature of the module.
+//
+// An entry holds the signature of its module followed by the serialized
+// repository, and is only loaded if the signature and the version of the
+// serialized stream match.
+
+#ifndef SYZYGY_REFINERY_SYMBOLS_TYPE_REPOSITORY_CACHE_H_
+#define SYZYGY_REFINERY_SYMBOLS_TYPE_REPOSITORY_CACHE_H_
+
+#include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/refinery/types/type_repository.h"
+
+namespace refinery {
+
+class TypeRepositoryCache {
+ public:
+  // @param cache_dir the directory holding the cache entries. It is created
+  //     on the first save if it doesn't exist.
+  explicit TypeRepositoryCache(const base::FilePath& cache_dir);
+
+  // @returns the directory holding the cache entries.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+
+  // Gets the path of the cache entry of a module.
+  // @param signature the signature of the module.
+  // @param entry_path receives the path of the entry. It may not exist.
+  void GetEntryPath(const pe::PEFile::Signature& signature,
+                    base::FilePath* entry_path) const;
+
+  // Loads the type repository of a module from the cache. The entry is
+  // memory-mapped rather than read through buffered file I/O.
+  // @param signature the signature of the module.
+  // @param type_repo on success, receives the type repository of the module.
+  //     On failure, contains nullptr.
+  // @returns true if a valid entry for the module was loaded, false
+  //     otherwise. A corrupt entry is deleted.
+  bool Load(const pe::PEFile::Signature& signature,
+            scoped_refptr<TypeRepository>* type_repo) const;
+
+  // Saves the type repository of a module to the cache, replacing any
+  // existing entry. The entry is written to a temporary file that is then
+  // moved in place, so that concurrent users of the cache never see a
+  // partially written entry.
+  // @param signature the signature of the module.
+  // @param type_repo the type repository of the module.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool Save(const pe::PEFile::Signature& signature,
+            const TypeRepository& type_repo) const;
+
+  // The extension of the cache entries.
+  static const wchar_t kEntryExtension[];
+
+ private:
+  base::FilePath cache_dir_;
+
+  DISALLOW_COPY_AND_ASSIGN(TypeRepositoryCache);
+};
+
+}  // namespace refinery
+
+#endif  // SYZYGY_REFINERY_SYMBOLS_TYPE_REPOSITORY_CACHE_H_
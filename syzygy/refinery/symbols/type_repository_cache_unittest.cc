@@ -0,0 +1,134 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/symbols/type_repository_cache.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/refinery/types/type.h"
+
+namespace refinery {
+
+namespace {
+
+class TypeRepositoryCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    cache_dir_ = temp_dir_.path().Append(L"cache");
+
+    signature_ = pe::PEFile::Signature(L"C:\\foo\\bar.dll",
+                                       core::AbsoluteAddress(0x10000000U),
+                                       0x8000, 0xCAFE, 0xBABE);
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath cache_dir_;
+  pe::PEFile::Signature signature_;
+};
+
+}  // namespace
+
+TEST_F(TypeRepositoryCacheTest, GetEntryPath) {
+  TypeRepositoryCache cache(cache_dir_);
+  EXPECT_EQ(cache_dir_, cache.cache_dir());
+
+  base::FilePath entry_path;
+  cache.GetEntryPath(signature_, &entry_path);
+  EXPECT_EQ(cache_dir_, entry_path.DirName());
+  EXPECT_EQ(TypeRepositoryCache::kEntryExtension, entry_path.Extension());
+
+  // The base address of the module is not part of the key.
+  pe::PEFile::Signature rebased(signature_);
+  rebased.base_address = core::AbsoluteAddress(0x20000000U);
+  base::FilePath rebased_entry_path;
+  cache.GetEntryPath(rebased, &rebased_entry_path);
+  EXPECT_EQ(entry_path, rebased_entry_path);
+
+  pe::PEFile::Signature other(signature_);
+  other.module_time_date_stamp++;
+  base::FilePath other_entry_path;
+  cache.GetEntryPath(other, &other_entry_path);
+  EXPECT_NE(entry_path, other_entry_path);
+}
+
+TEST_F(TypeRepositoryCacheTest, LoadFailsWithoutEntry) {
+  TypeRepositoryCache cache(cache_dir_);
+  scoped_refptr<TypeRepository> repository;
+  EXPECT_FALSE(cache.Load(signature_, &repository));
+  EXPECT_EQ(nullptr, repository.get());
+}
+
+TEST_F(TypeRepositoryCacheTest, LoadDeletesCorruptEntry) {
+  TypeRepositoryCache cache(cache_dir_);
+  base::FilePath entry_path;
+  cache.GetEntryPath(signature_, &entry_path);
+  ASSERT_TRUE(base::CreateDirectory(cache_dir_));
+  static const char kJunk[] = "junk";
+  ASSERT_EQ(static_cast<int>(sizeof(kJunk)),
+            base::WriteFile(entry_path, kJunk, sizeof(kJunk)));
+
+  scoped_refptr<TypeRepository> repository;
+  EXPECT_FALSE(cache.Load(signature_, &repository));
+  EXPECT_EQ(nullptr, repository.get());
+  EXPECT_FALSE(base::PathExists(entry_path));
+}
+
+TEST_F(TypeRepositoryCacheTest, SaveAndLoad) {
+  scoped_refptr<TypeRepository> repository = new TypeRepository();
+  TypeId int_id = repository->AddType(new BasicType(L"int", 4));
+  UserDefinedTypePtr udt = new UserDefinedType(
+      L"foo", L".?AUfoo@@", 4, UserDefinedType::UDT_STRUCT);
+  UserDefinedType::Fields fields;
+  fields.push_back(new UserDefinedType::MemberField(
+      L"bar", 0, kNoTypeFlags, 0, 0, int_id, repository.get()));
+  UserDefinedType::Functions functions;
+  udt->Finalize(&fields, &functions);
+  TypeId udt_id = repository->AddType(udt);
+
+  TypeRepositoryCache cache(cache_dir_);
+  ASSERT_TRUE(cache.Save(signature_, *repository));
+  base::FilePath entry_path;
+  cache.GetEntryPath(signature_, &entry_path);
+  EXPECT_TRUE(base::PathExists(entry_path));
+
+  // A later process loads the same types.
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_TRUE(cache.Load(signature_, &loaded));
+  ASSERT_TRUE(loaded != nullptr);
+  ASSERT_EQ(repository->size(), loaded->size());
+  UserDefinedTypePtr loaded_udt;
+  ASSERT_TRUE(loaded->GetType(udt_id)->CastTo(&loaded_udt));
+  EXPECT_EQ(L"foo", loaded_udt->GetName());
+  ASSERT_EQ(1U, loaded_udt->fields().size());
+  EXPECT_EQ(*udt->fields()[0], *loaded_udt->fields()[0]);
+  EXPECT_EQ(L"int", loaded_udt->GetFieldType(0)->GetName());
+
+  // The module may be loaded at another address by the later process.
+  pe::PEFile::Signature rebased(signature_);
+  rebased.base_address = core::AbsoluteAddress(0x20000000U);
+  EXPECT_TRUE(cache.Load(rebased, &loaded));
+
+  // An entry whose signature doesn't match is ignored, not deleted.
+  pe::PEFile::Signature other(signature_);
+  other.path = L"C:\\foo\\other.dll";
+  base::FilePath other_entry_path;
+  cache.GetEntryPath(other, &other_entry_path);
+  ASSERT_TRUE(base::CopyFile(entry_path, other_entry_path));
+  EXPECT_FALSE(cache.Load(other, &loaded));
+  EXPECT_TRUE(base::PathExists(other_entry_path));
+}
+
+}  // namespace refinery
@@ -15,16 +15,20 @@
 #include "syzygy/refinery/types/pdb_crawler.h"
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base/bind.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/pattern.h"
 #include "base/strings/string16.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/common/align.h"
 #include "syzygy/core/address.h"
 #include "syzygy/pdb/omap.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -45,15 +49,80 @@ namespace cci = Microsoft_Cci_Pdb;
 
 const uint16_t kNoLeafType = static_cast<uint16_t>(-1);
 
+// A read-only view of a buffer as a PDB stream. The workers of the parallel
+// first pass each hold their own reference counted view of a buffer shared by
+// all of them, as the reference counts of streams are not thread-safe.
+class PdbBufferStream : public pdb::PdbStream {
+ public:
+  PdbBufferStream(const uint8_t* data, uint32_t length)
+      : pdb::PdbStream(length), data_(data) {}
+
+  bool ReadBytesAt(size_t pos, size_t count, void* dest) override {
+    DCHECK(dest);
+    if (pos > length() || count > length() - pos)
+      return false;
+    ::memcpy(dest, data_ + pos, count);
+    return true;
+  }
+
+ private:
+  ~PdbBufferStream() override {}
+
+  const uint8_t* data_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbBufferStream);
+};
+
+// What the first pass through the stream gathers about a range of records.
+struct PreparedRecords {
+  // A class or structure definition, by decorated name.
+  struct UdtDefinition {
+    base::string16 decorated_name;
+    TypeId type_id;
+    // Whether the name starts with '<', as for unnamed nested structures.
+    bool unnamed;
+  };
+
+  PreparedRecords() : success(false) {}
+
+  // The leaf types of the records, in order.
+  std::vector<std::pair<TypeId, uint16_t>> leaf_types;
+  // The records that get translated to the repository, in order.
+  std::vector<TypeId> records_to_process;
+  // The definitions of user defined types, in order.
+  std::vector<UdtDefinition> udts;
+  bool success;
+};
+
 class TypeCreator {
  public:
-  TypeCreator(TypeRepository* repository, pdb::PdbStream* stream);
+  // @param repository the repository receiving the types.
+  // @param stream the type info stream.
+  // @param hash_stream the hash stream of @p stream, or nullptr.
+  // @param num_threads the number of threads reading the records in the first
+  //     pass through the stream.
+  TypeCreator(TypeRepository* repository,
+              pdb::PdbStream* stream,
+              pdb::PdbStream* hash_stream,
+              size_t num_threads);
   ~TypeCreator();
 
   // Crawls @p stream_, creates all types and assigns names to pointers.
   // @returns true on success, false on failure.
   bool CreateTypes();
 
+  // Reads the records in a range of type IDs with a given enumerator, for the
+  // first pass through the stream.
+  // @param first_id the first type ID of the range.
+  // @param end_id the type ID past the end of the range.
+  // @param type_info_enum the initialized enumerator to read with.
+  // @param prepared receives the records that were read.
+  // @returns true on success, false on failure.
+  static bool PrepareRecords(TypeId first_id,
+                             TypeId end_id,
+                             pdb::TypeInfoEnumerator* type_info_enum,
+                             PreparedRecords* prepared);
+
  private:
   // The following functions parse objects from the data stream.
   // @returns pointer to the created object or nullptr on failure.
@@ -161,6 +230,12 @@ class TypeCreator {
   // @returns true on success, false on failure.
   bool PrepareData();
 
+  // Does the first pass through the stream with @p num_threads_ threads, each
+  // reading a range of records from a copy of the stream in memory.
+  // @param prepared receives the records read by each thread, in order.
+  // @returns true on success, false on failure.
+  bool PrepareRecordsInParallel(std::vector<PreparedRecords>* prepared);
+
   // Checks if type object exists and constructs one if it does not.
   // @param type_id type index of the type.
   // @returns pointer to the type object.
@@ -242,6 +317,13 @@ class TypeCreator {
   // Pointer to the type info repository.
   TypeRepository* repository_;
 
+  // The type info stream and its hash stream.
+  scoped_refptr<pdb::PdbStream> stream_;
+  scoped_refptr<pdb::PdbStream> hash_stream_;
+
+  // The number of threads reading the records in the first pass.
+  size_t num_threads_;
+
   // Type info enumerator used to traverse the stream.
   pdb::TypeInfoEnumerator type_info_enum_;
 
@@ -261,6 +343,84 @@ class TypeCreator {
   std::vector<TypeId> records_to_process_;
 };
 
+// A task reading a range of records in the first pass through the stream.
+class PrepareRecordsTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  PrepareRecordsTask(TypeId first_id,
+                     TypeId end_id,
+                     pdb::PdbStream* stream,
+                     pdb::PdbStream* hash_stream)
+      : first_id_(first_id),
+        end_id_(end_id),
+        type_info_enum_(stream, hash_stream) {}
+
+  // Initializes the enumerator. This must be called before the task runs.
+  bool Init() { return type_info_enum_.Init(); }
+
+  // base::DelegateSimpleThread::Delegate implementation.
+  void Run() override {
+    prepared_.success = TypeCreator::PrepareRecords(
+        first_id_, end_id_, &type_info_enum_, &prepared_);
+  }
+
+  PreparedRecords* prepared() { return &prepared_; }
+
+ private:
+  TypeId first_id_;
+  TypeId end_id_;
+  pdb::TypeInfoEnumerator type_info_enum_;
+  PreparedRecords prepared_;
+
+  DISALLOW_COPY_AND_ASSIGN(PrepareRecordsTask);
+};
+
+bool TypeCreator::PrepareRecords(TypeId first_id,
+                                 TypeId end_id,
+                                 pdb::TypeInfoEnumerator* type_info_enum,
+                                 PreparedRecords* prepared) {
+  DCHECK_LT(first_id, end_id);
+  DCHECK(type_info_enum);
+  DCHECK(prepared);
+
+  if (!type_info_enum->SeekRecord(first_id))
+    return false;
+
+  while (true) {
+    TypeId type_id = type_info_enum->type_id();
+    uint16_t type = type_info_enum->type();
+    prepared->leaf_types.push_back(std::make_pair(type_id, type));
+
+    // We remember ids of the types that we will later descend into.
+    if (IsImportantType(type))
+      prepared->records_to_process.push_back(type_id);
+
+    if (type == cci::LF_CLASS || type == cci::LF_STRUCTURE) {
+      pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
+          type_info_enum->CreateRecordReader());
+      common::BinaryStreamParser parser(&reader);
+      pdb::LeafClass type_info;
+      if (!type_info.Initialize(&parser)) {
+        LOG(ERROR) << "Unable to read type info record.";
+        return false;
+      }
+
+      if (!type_info.property().fwdref) {
+        PreparedRecords::UdtDefinition udt = {
+            type_info.decorated_name(), type_id,
+            type_info.name().find(L'<') == 0};
+        prepared->udts.push_back(udt);
+      }
+    }
+
+    if (type_id + 1 == end_id)
+      break;
+    if (!type_info_enum->NextTypeInfoRecord())
+      return false;
+  }
+
+  return true;
+}
+
 TypePtr TypeCreator::CreatePointerType(TypeId type_id) {
   DCHECK_EQ(GetLeafType(type_id), cci::LF_POINTER);
 
@@ -791,8 +951,15 @@ TypePtr TypeCreator::ReadBitfield(TypeId type_id,
   return FindOrCreateBitfieldType(underlying_id, flags);
 }
 
-TypeCreator::TypeCreator(TypeRepository* repository, pdb::PdbStream* stream)
-    : type_info_enum_(stream), repository_(repository) {
+TypeCreator::TypeCreator(TypeRepository* repository,
+                         pdb::PdbStream* stream,
+                         pdb::PdbStream* hash_stream,
+                         size_t num_threads)
+    : repository_(repository),
+      stream_(stream),
+      hash_stream_(hash_stream),
+      num_threads_(num_threads),
+      type_info_enum_(stream, hash_stream) {
   DCHECK(repository);
   DCHECK(stream);
 }
@@ -1333,47 +1500,42 @@ TypePtr TypeCreator::CreateType(TypeId type_id) {
 }
 
 bool TypeCreator::PrepareData() {
-  size_t unexpected_duplicate_types = 0;
-
-  while (!type_info_enum_.EndOfStream()) {
-    if (!type_info_enum_.NextTypeInfoRecord())
+  std::vector<PreparedRecords> prepared;
+  if (num_threads_ > 1) {
+    if (!PrepareRecordsInParallel(&prepared))
       return false;
+  } else {
+    prepared.resize(1);
+    const pdb::TypeInfoHeader& header = type_info_enum_.type_info_header();
+    if (!PrepareRecords(header.type_min, header.type_max, &type_info_enum_,
+                        &prepared[0])) {
+      return false;
+    }
+  }
 
-    types_map_.insert(
-        std::make_pair(type_info_enum_.type_id(), type_info_enum_.type()));
-
-    // We remember ids of the types that we will later descend into.
-    if (IsImportantType(type_info_enum_.type()))
-      records_to_process_.push_back(type_info_enum_.type_id());
-
-    pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-        type_info_enum_.CreateRecordReader());
-    common::BinaryStreamParser parser(&reader);
-    if (type_info_enum_.type() == cci::LF_CLASS ||
-        type_info_enum_.type() == cci::LF_STRUCTURE) {
-      pdb::LeafClass type_info;
-      if (!type_info.Initialize(&parser)) {
-        LOG(ERROR) << "Unable to read type info record.";
-        return false;
+  // Merge the records of all the ranges, in order.
+  size_t unexpected_duplicate_types = 0;
+  for (const PreparedRecords& records : prepared) {
+    types_map_.insert(records.leaf_types.begin(), records.leaf_types.end());
+    records_to_process_.insert(records_to_process_.end(),
+                               records.records_to_process.begin(),
+                               records.records_to_process.end());
+
+    // Populate the decorated name to type index map. Note that this
+    // overwrites any preceding record of the same name, which can occur for
+    // 2 reasons:
+    //   - the unnamed nested structures get assigned the name <unnamed-tag>
+    //   - we've observed UDTs that are identical up to extra LF_NESTTYPE
+    //     (which do not make it to our type representation).
+    // TODO(manzagop): investigate more and consider folding duplicate types.
+    for (const PreparedRecords::UdtDefinition& udt : records.udts) {
+      if (!udt.unnamed && udt_map_.find(udt.decorated_name) != udt_map_.end()) {
+        VLOG(1) << "Encountered duplicate decorated name: "
+                << udt.decorated_name;
+        unexpected_duplicate_types++;
       }
 
-      // Populate the decorated name to type index map. Note that this
-      // overwrites any preceding record of the same name, which can occur for
-      // 2 reasons:
-      //   - the unnamed nested structures get assigned the name <unnamed-tag>
-      //   - we've observed UDTs that are identical up to extra LF_NESTTYPE
-      //     (which do not make it to our type representation).
-      // TODO(manzagop): investigate more and consider folding duplicate types.
-      if (!type_info.property().fwdref) {
-        if (type_info.name().find(L'<') != 0 &&
-            udt_map_.find(type_info.decorated_name()) != udt_map_.end()) {
-          VLOG(1) << "Encountered duplicate decorated name: "
-                  << type_info.decorated_name();
-          unexpected_duplicate_types++;
-        }
-
-        udt_map_[type_info.decorated_name()] = type_info_enum_.type_id();
-      }
+      udt_map_[udt.decorated_name] = udt.type_id;
     }
   }
 
@@ -1385,6 +1547,73 @@ bool TypeCreator::PrepareData() {
   return type_info_enum_.ResetStream();
 }
 
+bool TypeCreator::PrepareRecordsInParallel(
+    std::vector<PreparedRecords>* prepared) {
+  DCHECK(prepared);
+  DCHECK_LT(1u, num_threads_);
+
+  // Read the streams into memory once, so that the workers can read them
+  // concurrently.
+  scoped_refptr<pdb::PdbByteStream> stream(new pdb::PdbByteStream());
+  if (!stream->Init(stream_.get())) {
+    LOG(ERROR) << "Unable to read the type info stream.";
+    return false;
+  }
+  scoped_refptr<pdb::PdbByteStream> hash_stream;
+  if (hash_stream_ != nullptr && hash_stream_->length() != 0) {
+    hash_stream = new pdb::PdbByteStream();
+    if (!hash_stream->Init(hash_stream_.get())) {
+      LOG(ERROR) << "Unable to read the type info hash stream.";
+      return false;
+    }
+  }
+
+  // Split the records in ranges of equal counts, one per thread. Each task
+  // gets its own views of the streams, which are created and released on this
+  // thread.
+  const pdb::TypeInfoHeader& header = type_info_enum_.type_info_header();
+  size_t record_count = header.type_max - header.type_min;
+  ScopedVector<PrepareRecordsTask> tasks;
+  for (size_t i = 0; i < num_threads_; ++i) {
+    TypeId first_id = static_cast<TypeId>(header.type_min +
+                                          record_count * i / num_threads_);
+    TypeId end_id = static_cast<TypeId>(header.type_min +
+                                        record_count * (i + 1) / num_threads_);
+    if (first_id == end_id)
+      continue;
+
+    scoped_refptr<pdb::PdbStream> view(
+        new PdbBufferStream(stream->data(), stream->length()));
+    scoped_refptr<pdb::PdbStream> hash_view;
+    if (hash_stream != nullptr) {
+      hash_view =
+          new PdbBufferStream(hash_stream->data(), hash_stream->length());
+    }
+    tasks.push_back(new PrepareRecordsTask(first_id, end_id, view.get(),
+                                           hash_view.get()));
+    if (!tasks.back()->Init()) {
+      LOG(ERROR) << "Unable to initialize type info stream enumerator.";
+      return false;
+    }
+  }
+
+  base::DelegateSimpleThreadPool pool("PrepareRecords",
+                                      static_cast<int>(num_threads_));
+  pool.Start();
+  for (PrepareRecordsTask* task : tasks)
+    pool.AddWork(task);
+  pool.JoinAll();
+
+  prepared->clear();
+  for (PrepareRecordsTask* task : tasks) {
+    if (!task->prepared()->success)
+      return false;
+    prepared->push_back(std::move(*task->prepared()));
+  }
+
+  return true;
+}
+
 bool TypeCreator::CreateTypes() {
   if (!type_info_enum_.Init()) {
     LOG(ERROR) << "Unable to initialize type info stream enumerator.";
@@ -1412,7 +1641,7 @@ bool TypeCreator::CreateTypes() {
 
 }  // namespace
 
-PdbCrawler::PdbCrawler() {
+PdbCrawler::PdbCrawler() : num_threads_(1) {
 }
 
 PdbCrawler::~PdbCrawler() {
@@ -1427,8 +1656,15 @@ bool PdbCrawler::InitializeForFile(const base::FilePath& path) {
     return false;
   }
 
-  // Get the type stream.
+  // Get the type stream, and its hash stream if it has one.
   tpi_stream_ = pdb_file.GetStream(pdb::kTpiStream);
+  pdb::TypeInfoHeader tpi_header = {};
+  if (tpi_stream_ != nullptr &&
+      tpi_stream_->ReadBytesAt(0, sizeof(tpi_header), &tpi_header) &&
+      tpi_header.type_info_hash.stream_number < pdb_file.StreamCount()) {
+    tpi_hash_stream_ =
+        pdb_file.GetStream(tpi_header.type_info_hash.stream_number);
+  }
 
   // Get the public symbol stream: it has a variable index, found in the Dbi
   // stream.
@@ -1496,7 +1732,8 @@ bool PdbCrawler::GetTypes(TypeRepository* types) {
   DCHECK(types);
   DCHECK(tpi_stream_);
 
-  TypeCreator creator(types, tpi_stream_.get());
+  TypeCreator creator(types, tpi_stream_.get(), tpi_hash_stream_.get(),
+                      num_threads_);
 
   return creator.CreateTypes();
 }
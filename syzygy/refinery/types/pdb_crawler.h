@@ -53,6 +53,15 @@ class PdbCrawler {
   // @returns true on success, false on failure.
   bool GetTypes(TypeRepository* types);
 
+  // @name Accessors for the number of threads used to read the type records.
+  // When this is greater than one, the records are read into memory and
+  // decoded concurrently by as many threads, before the types are created.
+  // Defaults to one.
+  // @{
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) { num_threads_ = num_threads; }
+  // @}
+
   // Retrieves the relative virtual addresses of all virtual function tables.
   // @param vftable_rvas on success contains zero or more relative addresses.
   // @returns true on success, false on failure.
@@ -68,6 +77,13 @@ class PdbCrawler {
   scoped_refptr<pdb::PdbStream> tpi_stream_;
   scoped_refptr<pdb::PdbStream> sym_stream_;
 
+  // Pointer to the hash stream of the type stream, if any. Its type index
+  // offsets allow seeking in the type stream.
+  scoped_refptr<pdb::PdbStream> tpi_hash_stream_;
+
+  // The number of threads used to read the type records.
+  size_t num_threads_;
+
   // The PE section headers extracted from the pdb.
   // Note: we use these as it seems the DbiStream's section map does not contain
   // information about section offsets (rva_offset is 0).
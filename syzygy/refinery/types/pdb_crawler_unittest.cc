@@ -258,6 +258,26 @@ const bool kIsVolatile = true;
 
 }  // namespace
 
+TEST_P(PdbCrawlerTest, TestParallelTypesMatch) {
+  PdbCrawler crawler;
+  crawler.set_num_threads(4);
+  EXPECT_EQ(4u, crawler.num_threads());
+  ASSERT_TRUE(crawler.InitializeForFile(test_types_file_));
+
+  scoped_refptr<TypeRepository> types = new TypeRepository();
+  ASSERT_TRUE(crawler.GetTypes(types.get()));
+
+  // The types are the same as those created with a single thread.
+  ASSERT_EQ(types_->size(), types->size());
+  for (auto type : *types_) {
+    TypePtr other = types->GetType(type->type_id());
+    ASSERT_NE(nullptr, other);
+    EXPECT_EQ(type->kind(), other->kind());
+    EXPECT_EQ(type->size(), other->size());
+    EXPECT_EQ(type->GetName(), other->GetName());
+  }
+}
+
 TEST_P(PdbCrawlerTest, TestSimpleUDT) {
   TypePtr type = FindOneTypeBySuffix(L"::TestSimpleUDT");
   ASSERT_TRUE(type);
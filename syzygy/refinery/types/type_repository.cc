@@ -14,6 +14,8 @@
 
 #include "syzygy/refinery/types/type_repository.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "syzygy/refinery/types/type.h"
 
@@ -84,8 +86,22 @@ TypeRepository::Iterator TypeRepository::end() const {
 
 TypeNameIndex::TypeNameIndex(scoped_refptr<TypeRepository> repository) {
   DCHECK(repository);
-  for (auto type : *repository)
-    name_index_.insert(std::make_pair(type->GetName(), type));
+  name_index_.reserve(repository->size());
+  decorated_name_index_.reserve(repository->size());
+  for (auto type : *repository) {
+    name_index_[type->GetName()].push_back(type);
+    decorated_name_index_[type->GetDecoratedName()].push_back(type);
+  }
+
+  // The repository isn't ordered, order name collisions by id so that lookups
+  // are deterministic.
+  auto by_id = [](const TypePtr& type1, const TypePtr& type2) {
+    return type1->type_id() < type2->type_id();
+  };
+  for (auto& entry : name_index_)
+    std::sort(entry.second.begin(), entry.second.end(), by_id);
+  for (auto& entry : decorated_name_index_)
+    std::sort(entry.second.begin(), entry.second.end(), by_id);
 }
 
 TypeNameIndex::~TypeNameIndex() {
@@ -93,12 +109,25 @@ TypeNameIndex::~TypeNameIndex() {
 
 void TypeNameIndex::GetTypes(const base::string16& name,
                              std::vector<TypePtr>* types) const {
+  GetMatchingTypes(name_index_, name, types);
+}
+
+void TypeNameIndex::GetTypesByDecoratedName(
+    const base::string16& decorated_name,
+    std::vector<TypePtr>* types) const {
+  GetMatchingTypes(decorated_name_index_, decorated_name, types);
+}
+
+// static
+void TypeNameIndex::GetMatchingTypes(const NameIndex& index,
+                                     const base::string16& name,
+                                     std::vector<TypePtr>* types) {
   DCHECK(types);
   types->clear();
 
-  auto match = name_index_.equal_range(name);
-  for (auto it = match.first; it != match.second; ++it)
-    types->push_back(it->second);
+  auto it = index.find(name);
+  if (it != index.end())
+    *types = it->second;
 }
 
 }  // namespace refinery
@@ -16,12 +16,13 @@
 #define SYZYGY_REFINERY_TYPES_TYPE_REPOSITORY_H_
 
 #include <iterator>
-#include <map>
+#include <unordered_map>
 #include <vector>
 
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
+#include "base/strings/string16.h"
 #include "syzygy/pe/pe_file.h"
 
 namespace refinery {
@@ -100,12 +101,14 @@ class TypeRepository::Iterator
   std::unordered_map<TypeId, TypePtr>::const_iterator it_;
 };
 
-// The TypeNameIndex provides name-based indexing for types.
+// The TypeNameIndex provides name-based indexing for types. The names of the
+// types are computed once, as the index is built, and hashed. Each distinct
+// name is stored once, with the types that bear it.
 // @note The underlying TypeRepository should not be modified.
-// @note Name-based indexing, as well as support for name collisions (using a
-//     multimap) are necessary as long as we rely on DIA. DIA does not expose
-//     mangled names (at least not the fully mangled names?) nor the PDB ids
-//     (DIA ids are not stable as they're based on the parse order).
+// @note Name-based indexing, as well as support for name collisions are
+//     necessary as long as we rely on DIA. DIA does not expose mangled names
+//     (at least not the fully mangled names?) nor the PDB ids (DIA ids are not
+//     stable as they're based on the parse order).
 // TODO(manzagop): relocate to where this is used once it exists.
 // TODO(manzagop): remove once DIA is no-longer used.
 class TypeNameIndex : public base::RefCounted<TypeNameIndex> {
@@ -113,13 +116,28 @@ class TypeNameIndex : public base::RefCounted<TypeNameIndex> {
   explicit TypeNameIndex(scoped_refptr<TypeRepository> repository);
 
   // Retrieve matching @p types by @p name.
+  // @param name the name of the types.
+  // @param types returns the matching types, ordered by type id.
   void GetTypes(const base::string16& name, std::vector<TypePtr>* types) const;
 
+  // Retrieve matching @p types by @p decorated_name.
+  // @param decorated_name the decorated name of the types.
+  // @param types returns the matching types, ordered by type id.
+  void GetTypesByDecoratedName(const base::string16& decorated_name,
+                               std::vector<TypePtr>* types) const;
+
  private:
   friend class base::RefCounted<TypeNameIndex>;
   ~TypeNameIndex();
 
-  std::multimap<base::string16, TypePtr> name_index_;
+  using NameIndex = std::unordered_map<base::string16, std::vector<TypePtr>>;
+
+  static void GetMatchingTypes(const NameIndex& index,
+                               const base::string16& name,
+                               std::vector<TypePtr>* types);
+
+  NameIndex name_index_;
+  NameIndex decorated_name_index_;
 };
 
 }  // namespace refinery
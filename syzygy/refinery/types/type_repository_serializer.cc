@@ -0,0 +1,445 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/types/type_repository_serializer.h"
+
+#include "base/logging.h"
+#include "base/strings/string16.h"
+
+namespace refinery {
+
+namespace {
+
+Type::Flags GetFlags(bool is_const, bool is_volatile) {
+  Type::Flags flags = kNoTypeFlags;
+  if (is_const)
+    flags |= Type::FLAG_CONST;
+  if (is_volatile)
+    flags |= Type::FLAG_VOLATILE;
+  return flags;
+}
+
+// Type IDs, sizes and offsets are saved with a fixed width, so that streams
+// don't depend on the bitness of the tool that wrote them.
+bool SaveTypeId(TypeId type_id, core::OutArchive* out_archive) {
+  return out_archive->Save(static_cast<uint64_t>(type_id));
+}
+
+bool LoadTypeId(core::InArchive* in_archive, TypeId* type_id) {
+  uint64_t value = 0;
+  if (!in_archive->Load(&value))
+    return false;
+  *type_id = static_cast<TypeId>(value);
+  return true;
+}
+
+bool SaveSize(size_t size, core::OutArchive* out_archive) {
+  return out_archive->Save(static_cast<uint64_t>(size));
+}
+
+bool LoadSize(core::InArchive* in_archive, size_t* size) {
+  uint64_t value = 0;
+  if (!in_archive->Load(&value))
+    return false;
+  *size = static_cast<size_t>(value);
+  return true;
+}
+
+}  // namespace
+
+const uint32_t TypeRepositorySerializer::kVersion = 1;
+
+bool TypeRepositorySerializer::Save(const TypeRepository& repository,
+                                    core::OutArchive* out_archive) const {
+  DCHECK(out_archive);
+
+  if (!out_archive->Save(kVersion) ||
+      !SaveSize(repository.size(), out_archive)) {
+    return false;
+  }
+
+  for (const TypePtr& type : repository) {
+    if (!out_archive->Save(static_cast<uint8_t>(type->kind())) ||
+        !SaveTypeId(type->type_id(), out_archive) ||
+        !SaveSize(type->size(), out_archive)) {
+      return false;
+    }
+
+    bool saved = false;
+    switch (type->kind()) {
+      case Type::BASIC_TYPE_KIND: {
+        saved = out_archive->Save(type->GetName());
+        break;
+      }
+      case Type::USER_DEFINED_TYPE_KIND: {
+        ConstUserDefinedTypePtr udt;
+        CHECK(type->CastTo(&udt));
+        saved = SaveUserDefinedType(*udt, out_archive);
+        break;
+      }
+      case Type::POINTER_TYPE_KIND: {
+        ConstPointerTypePtr ptr;
+        CHECK(type->CastTo(&ptr));
+        saved = out_archive->Save(static_cast<uint8_t>(ptr->ptr_mode())) &&
+                out_archive->Save(
+                    GetFlags(ptr->is_const(), ptr->is_volatile())) &&
+                SaveTypeId(ptr->content_type_id(), out_archive);
+        break;
+      }
+      case Type::ARRAY_TYPE_KIND: {
+        ConstArrayTypePtr array;
+        CHECK(type->CastTo(&array));
+        saved = out_archive->Save(
+                    GetFlags(array->is_const(), array->is_volatile())) &&
+                SaveTypeId(array->index_type_id(), out_archive) &&
+                SaveSize(array->num_elements(), out_archive) &&
+                SaveTypeId(array->element_type_id(), out_archive);
+        break;
+      }
+      case Type::FUNCTION_TYPE_KIND: {
+        ConstFunctionTypePtr function;
+        CHECK(type->CastTo(&function));
+        saved = SaveFunctionType(*function, out_archive);
+        break;
+      }
+      case Type::GLOBAL_TYPE_KIND: {
+        ConstGlobalTypePtr global;
+        CHECK(type->CastTo(&global));
+        saved = out_archive->Save(global->GetName()) &&
+                out_archive->Save(global->rva()) &&
+                SaveTypeId(global->data_type_id(), out_archive);
+        break;
+      }
+      case Type::WILDCARD_TYPE_KIND: {
+        saved = out_archive->Save(type->GetName()) &&
+                out_archive->Save(type->GetDecoratedName());
+        break;
+      }
+    }
+
+    if (!saved) {
+      LOG(ERROR) << "Unable to save type " << type->type_id() << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TypeRepositorySerializer::Load(core::InArchive* in_archive,
+                                    TypeRepository* repository) const {
+  DCHECK(in_archive);
+  DCHECK(repository);
+
+  uint32_t version = 0;
+  if (!in_archive->Load(&version))
+    return false;
+  if (version != kVersion) {
+    LOG(WARNING) << "Unsupported type repository stream version (got "
+                 << version << ", expected " << kVersion << ").";
+    return false;
+  }
+
+  size_t num_types = 0;
+  if (!LoadSize(in_archive, &num_types))
+    return false;
+
+  for (size_t i = 0; i < num_types; ++i) {
+    TypeId type_id = kNoTypeId;
+    TypePtr type;
+    if (!LoadType(in_archive, repository, &type_id, &type))
+      return false;
+
+    if (!repository->AddTypeWithId(type, type_id)) {
+      LOG(ERROR) << "Duplicate type ID " << type_id << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TypeRepositorySerializer::SaveUserDefinedType(
+    const UserDefinedType& udt,
+    core::OutArchive* out_archive) const {
+  if (!out_archive->Save(udt.GetName()) ||
+      !out_archive->Save(udt.GetDecoratedName()) ||
+      !out_archive->Save(static_cast<uint8_t>(udt.udt_kind())) ||
+      !out_archive->Save(udt.is_fwd_decl())) {
+    return false;
+  }
+  if (udt.is_fwd_decl())
+    return true;
+
+  if (!SaveSize(udt.fields().size(), out_archive))
+    return false;
+  for (const auto& field : udt.fields()) {
+    if (!out_archive->Save(static_cast<uint8_t>(field->kind())) ||
+        !out_archive->Save(static_cast<int64_t>(field->offset())) ||
+        !SaveTypeId(field->type_id(), out_archive)) {
+      return false;
+    }
+
+    scoped_refptr<const UserDefinedType::MemberField> member;
+    if (!field->CastTo(&member))
+      continue;
+    if (!out_archive->Save(member->name()) ||
+        !out_archive->Save(
+            GetFlags(member->is_const(), member->is_volatile())) ||
+        !SaveSize(member->bit_pos(), out_archive) ||
+        !SaveSize(member->bit_len(), out_archive)) {
+      return false;
+    }
+  }
+
+  if (!SaveSize(udt.functions().size(), out_archive))
+    return false;
+  for (const auto& function : udt.functions()) {
+    if (!out_archive->Save(function.name()) ||
+        !SaveTypeId(function.type_id(), out_archive)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TypeRepositorySerializer::SaveFunctionType(
+    const FunctionType& function,
+    core::OutArchive* out_archive) const {
+  const FunctionType::ArgumentType& return_type = function.return_type();
+  if (!out_archive->Save(static_cast<uint8_t>(function.call_convention())) ||
+      !out_archive->Save(
+          GetFlags(return_type.is_const(), return_type.is_volatile())) ||
+      !SaveTypeId(return_type.type_id(), out_archive) ||
+      !SaveTypeId(function.containing_class_id(), out_archive) ||
+      !SaveSize(function.argument_types().size(), out_archive)) {
+    return false;
+  }
+
+  for (const auto& arg : function.argument_types()) {
+    if (!out_archive->Save(GetFlags(arg.is_const(), arg.is_volatile())) ||
+        !SaveTypeId(arg.type_id(), out_archive)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TypeRepositorySerializer::LoadType(core::InArchive* in_archive,
+                                        TypeRepository* repository,
+                                        TypeId* type_id,
+                                        TypePtr* type) const {
+  DCHECK(type_id);
+  DCHECK(type);
+
+  uint8_t kind = 0;
+  size_t size = 0;
+  if (!in_archive->Load(&kind) || !LoadTypeId(in_archive, type_id) ||
+      !LoadSize(in_archive, &size)) {
+    return false;
+  }
+
+  switch (kind) {
+    case Type::BASIC_TYPE_KIND: {
+      base::string16 name;
+      if (!in_archive->Load(&name))
+        return false;
+      *type = new BasicType(name, size);
+      return true;
+    }
+    case Type::USER_DEFINED_TYPE_KIND: {
+      return LoadUserDefinedType(in_archive, repository, size, type);
+    }
+    case Type::POINTER_TYPE_KIND: {
+      uint8_t ptr_mode = 0;
+      Type::Flags flags = kNoTypeFlags;
+      TypeId content_type_id = kNoTypeId;
+      if (!in_archive->Load(&ptr_mode) || !in_archive->Load(&flags) ||
+          !LoadTypeId(in_archive, &content_type_id)) {
+        return false;
+      }
+      PointerTypePtr ptr =
+          new PointerType(size, static_cast<PointerType::Mode>(ptr_mode));
+      ptr->Finalize(flags, content_type_id);
+      *type = ptr;
+      return true;
+    }
+    case Type::ARRAY_TYPE_KIND: {
+      Type::Flags flags = kNoTypeFlags;
+      TypeId index_type_id = kNoTypeId;
+      size_t num_elements = 0;
+      TypeId element_type_id = kNoTypeId;
+      if (!in_archive->Load(&flags) ||
+          !LoadTypeId(in_archive, &index_type_id) ||
+          !LoadSize(in_archive, &num_elements) ||
+          !LoadTypeId(in_archive, &element_type_id)) {
+        return false;
+      }
+      ArrayTypePtr array = new ArrayType(size);
+      array->Finalize(flags, index_type_id, num_elements, element_type_id);
+      *type = array;
+      return true;
+    }
+    case Type::FUNCTION_TYPE_KIND: {
+      return LoadFunctionType(in_archive, type);
+    }
+    case Type::GLOBAL_TYPE_KIND: {
+      base::string16 name;
+      uint64_t rva = 0;
+      TypeId data_type_id = kNoTypeId;
+      if (!in_archive->Load(&name) || !in_archive->Load(&rva) ||
+          !LoadTypeId(in_archive, &data_type_id)) {
+        return false;
+      }
+      *type = new GlobalType(name, rva, data_type_id, size);
+      return true;
+    }
+    case Type::WILDCARD_TYPE_KIND: {
+      base::string16 name;
+      base::string16 decorated_name;
+      if (!in_archive->Load(&name) || !in_archive->Load(&decorated_name))
+        return false;
+      *type = new WildcardType(name, decorated_name, size);
+      return true;
+    }
+  }
+
+  LOG(ERROR) << "Unknown type kind " << static_cast<int>(kind) << ".";
+  return false;
+}
+
+bool TypeRepositorySerializer::LoadUserDefinedType(
+    core::InArchive* in_archive,
+    TypeRepository* repository,
+    size_t size,
+    TypePtr* type) const {
+  base::string16 name;
+  base::string16 decorated_name;
+  uint8_t udt_kind = 0;
+  bool is_fwd_decl = false;
+  if (!in_archive->Load(&name) || !in_archive->Load(&decorated_name) ||
+      !in_archive->Load(&udt_kind) || !in_archive->Load(&is_fwd_decl)) {
+    return false;
+  }
+
+  UserDefinedTypePtr udt = new UserDefinedType(
+      name, decorated_name, size,
+      static_cast<UserDefinedType::UdtKind>(udt_kind));
+  if (is_fwd_decl) {
+    udt->SetIsForwardDeclaration();
+    *type = udt;
+    return true;
+  }
+
+  size_t num_fields = 0;
+  if (!LoadSize(in_archive, &num_fields))
+    return false;
+  UserDefinedType::Fields fields;
+  for (size_t i = 0; i < num_fields; ++i) {
+    uint8_t field_kind = 0;
+    int64_t offset = 0;
+    TypeId type_id = kNoTypeId;
+    if (!in_archive->Load(&field_kind) || !in_archive->Load(&offset) ||
+        !LoadTypeId(in_archive, &type_id)) {
+      return false;
+    }
+
+    switch (field_kind) {
+      case UserDefinedType::Field::BASE_CLASS_KIND: {
+        fields.push_back(new UserDefinedType::BaseClassField(
+            static_cast<ptrdiff_t>(offset), type_id, repository));
+        break;
+      }
+      case UserDefinedType::Field::MEMBER_KIND: {
+        base::string16 field_name;
+        Type::Flags flags = kNoTypeFlags;
+        size_t bit_pos = 0;
+        size_t bit_len = 0;
+        if (!in_archive->Load(&field_name) || !in_archive->Load(&flags) ||
+            !LoadSize(in_archive, &bit_pos) ||
+            !LoadSize(in_archive, &bit_len)) {
+          return false;
+        }
+        fields.push_back(new UserDefinedType::MemberField(
+            field_name, static_cast<ptrdiff_t>(offset), flags, bit_pos,
+            bit_len, type_id, repository));
+        break;
+      }
+      case UserDefinedType::Field::VFPTR_KIND: {
+        fields.push_back(new UserDefinedType::VfptrField(
+            static_cast<ptrdiff_t>(offset), type_id, repository));
+        break;
+      }
+      default: {
+        LOG(ERROR) << "Unknown field kind " << static_cast<int>(field_kind)
+                   << ".";
+        return false;
+      }
+    }
+  }
+
+  size_t num_functions = 0;
+  if (!LoadSize(in_archive, &num_functions))
+    return false;
+  UserDefinedType::Functions functions;
+  for (size_t i = 0; i < num_functions; ++i) {
+    base::string16 function_name;
+    TypeId type_id = kNoTypeId;
+    if (!in_archive->Load(&function_name) ||
+        !LoadTypeId(in_archive, &type_id)) {
+      return false;
+    }
+    functions.push_back(UserDefinedType::Function(function_name, type_id));
+  }
+
+  udt->Finalize(&fields, &functions);
+  *type = udt;
+  return true;
+}
+
+bool TypeRepositorySerializer::LoadFunctionType(core::InArchive* in_archive,
+                                                TypePtr* type) const {
+  uint8_t call_convention = 0;
+  Type::Flags return_flags = kNoTypeFlags;
+  TypeId return_type_id = kNoTypeId;
+  TypeId containing_class_id = kNoTypeId;
+  size_t num_args = 0;
+  if (!in_archive->Load(&call_convention) ||
+      !in_archive->Load(&return_flags) ||
+      !LoadTypeId(in_archive, &return_type_id) ||
+      !LoadTypeId(in_archive, &containing_class_id) ||
+      !LoadSize(in_archive, &num_args)) {
+    return false;
+  }
+
+  FunctionType::Arguments args;
+  for (size_t i = 0; i < num_args; ++i) {
+    Type::Flags flags = kNoTypeFlags;
+    TypeId type_id = kNoTypeId;
+    if (!in_archive->Load(&flags) || !LoadTypeId(in_archive, &type_id))
+      return false;
+    args.push_back(FunctionType::ArgumentType(flags, type_id));
+  }
+
+  FunctionTypePtr function = new FunctionType(
+      static_cast<FunctionType::CallConvention>(call_convention));
+  function->Finalize(FunctionType::ArgumentType(return_flags, return_type_id),
+                     args, containing_class_id);
+  *type = function;
+  return true;
+}
+
+}  // namespace refinery
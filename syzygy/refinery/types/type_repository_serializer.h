@@ -0,0 +1,88 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares TypeRepositorySerializer, which saves the types of a type
+// repository to an archive and loads them back with their type IDs. The
+// stream starts with a version, so that a stream written by an older version
+// of the serializer is rejected before anything is loaded.
+
+#ifndef SYZYGY_REFINERY_TYPES_TYPE_REPOSITORY_SERIALIZER_H_
+#define SYZYGY_REFINERY_TYPES_TYPE_REPOSITORY_SERIALIZER_H_
+
+#include "base/macros.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/refinery/types/type.h"
+#include "syzygy/refinery/types/type_repository.h"
+
+namespace refinery {
+
+class TypeRepositorySerializer {
+ public:
+  // The version of the serialized stream. This must be incremented whenever
+  // the serialized representation of a type changes.
+  static const uint32_t kVersion;
+
+  TypeRepositorySerializer() {}
+
+  // Saves the types of @p repository to @p out_archive.
+  // @param repository the repository to save.
+  // @param out_archive the archive to save to.
+  // @returns true on success, false otherwise.
+  bool Save(const TypeRepository& repository,
+            core::OutArchive* out_archive) const;
+
+  // Loads types from @p in_archive into @p repository.
+  // @param in_archive the archive to load from.
+  // @param repository the repository to populate. Its type IDs must not
+  //     collide with those of the loaded types, it is typically empty.
+  // @returns true on success, false otherwise. When the version of the
+  //     stream doesn't match @p repository is left untouched, otherwise it
+  //     may have been partially populated on failure.
+  bool Load(core::InArchive* in_archive, TypeRepository* repository) const;
+
+ private:
+  // @name Saves the kind-specific properties of a type.
+  // @{
+  bool SaveUserDefinedType(const UserDefinedType& udt,
+                           core::OutArchive* out_archive) const;
+  bool SaveFunctionType(const FunctionType& function,
+                        core::OutArchive* out_archive) const;
+  // @}
+
+  // Loads a single type, which is not yet added to a repository.
+  // @param in_archive the archive to load from.
+  // @param repository the repository the type will be added to.
+  // @param type_id receives the ID of the type.
+  // @param type receives the type.
+  // @returns true on success, false otherwise.
+  bool LoadType(core::InArchive* in_archive,
+                TypeRepository* repository,
+                TypeId* type_id,
+                TypePtr* type) const;
+
+  // @name Loads the kind-specific properties of a type.
+  // @{
+  bool LoadUserDefinedType(core::InArchive* in_archive,
+                           TypeRepository* repository,
+                           size_t size,
+                           TypePtr* type) const;
+  bool LoadFunctionType(core::InArchive* in_archive, TypePtr* type) const;
+  // @}
+
+  DISALLOW_COPY_AND_ASSIGN(TypeRepositorySerializer);
+};
+
+}  // namespace refinery
+
+#endif  // SYZYGY_REFINERY_TYPES_TYPE_REPOSITORY_SERIALIZER_H_
@@ -0,0 +1,199 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/types/type_repository_serializer.h"
+
+#include <iterator>
+
+#include "base/memory/ref_counted.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/refinery/types/type.h"
+#include "syzygy/refinery/types/type_repository.h"
+
+namespace refinery {
+
+namespace {
+
+class TypeRepositorySerializerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    repository_ = new TypeRepository();
+
+    int_id_ = repository_->AddType(new BasicType(L"int", 4));
+    TypeId udt_id = 100;
+    TypeId ptr_id = repository_->AddType(
+        new PointerType(4, PointerType::PTR_MODE_PTR));
+    TypeId array_id = repository_->AddType(new ArrayType(12));
+    TypeId function_id = repository_->AddType(
+        new FunctionType(FunctionType::CALL_THIS_CALL));
+
+    PointerTypePtr ptr;
+    ASSERT_TRUE(repository_->GetType(ptr_id)->CastTo(&ptr));
+    ptr->Finalize(Type::FLAG_CONST, udt_id);
+
+    ArrayTypePtr array;
+    ASSERT_TRUE(repository_->GetType(array_id)->CastTo(&array));
+    array->Finalize(Type::FLAG_VOLATILE, int_id_, 3, int_id_);
+
+    FunctionTypePtr function;
+    ASSERT_TRUE(repository_->GetType(function_id)->CastTo(&function));
+    FunctionType::Arguments args;
+    args.push_back(FunctionType::ArgumentType(Type::FLAG_CONST, ptr_id));
+    function->Finalize(FunctionType::ArgumentType(kNoTypeFlags, int_id_),
+                       args, udt_id);
+
+    UserDefinedTypePtr udt = new UserDefinedType(
+        L"foo", L".?AUfoo@@", 20, UserDefinedType::UDT_STRUCT);
+    UserDefinedType::Fields fields;
+    fields.push_back(new UserDefinedType::VfptrField(0, ptr_id,
+                                                     repository_.get()));
+    fields.push_back(new UserDefinedType::BaseClassField(4, udt_id + 1,
+                                                         repository_.get()));
+    fields.push_back(new UserDefinedType::MemberField(
+        L"bar", 8, Type::FLAG_CONST, 2, 3, int_id_, repository_.get()));
+    UserDefinedType::Functions functions;
+    functions.push_back(UserDefinedType::Function(L"baz", function_id));
+    udt->Finalize(&fields, &functions);
+    ASSERT_TRUE(repository_->AddTypeWithId(udt, udt_id));
+
+    UserDefinedTypePtr fwd_decl = new UserDefinedType(
+        L"base", L".?AUbase@@", 0, UserDefinedType::UDT_CLASS);
+    fwd_decl->SetIsForwardDeclaration();
+    ASSERT_TRUE(repository_->AddTypeWithId(fwd_decl, udt_id + 1));
+
+    repository_->AddType(new GlobalType(L"global", 0xCAFE, udt_id, 20));
+    repository_->AddType(new WildcardType(L"wild", L"wild@@", 8));
+  }
+
+  void RoundTrip(scoped_refptr<TypeRepository>* loaded) {
+    core::ByteVector bytes;
+    core::ScopedOutStreamPtr out_stream(
+        core::CreateByteOutStream(std::back_inserter(bytes)));
+    core::NativeBinaryOutArchive out_archive(out_stream.get());
+    TypeRepositorySerializer serializer;
+    ASSERT_TRUE(serializer.Save(*repository_, &out_archive));
+    ASSERT_TRUE(out_archive.Flush());
+
+    *loaded = new TypeRepository();
+    core::ScopedInStreamPtr in_stream(
+        core::CreateByteInStream(bytes.begin(), bytes.end()));
+    core::NativeBinaryInArchive in_archive(in_stream.get());
+    ASSERT_TRUE(serializer.Load(&in_archive, loaded->get()));
+  }
+
+  scoped_refptr<TypeRepository> repository_;
+  TypeId int_id_;
+};
+
+}  // namespace
+
+TEST_F(TypeRepositorySerializerTest, RoundTrip) {
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_NO_FATAL_FAILURE(RoundTrip(&loaded));
+  ASSERT_EQ(repository_->size(), loaded->size());
+
+  for (const TypePtr& type : *repository_) {
+    TypePtr loaded_type = loaded->GetType(type->type_id());
+    ASSERT_TRUE(loaded_type);
+    EXPECT_EQ(loaded.get(), loaded_type->repository());
+    EXPECT_EQ(type->kind(), loaded_type->kind());
+    EXPECT_EQ(type->size(), loaded_type->size());
+    EXPECT_EQ(type->GetName(), loaded_type->GetName());
+    EXPECT_EQ(type->GetDecoratedName(), loaded_type->GetDecoratedName());
+
+    switch (type->kind()) {
+      case Type::USER_DEFINED_TYPE_KIND: {
+        UserDefinedTypePtr udt;
+        UserDefinedTypePtr loaded_udt;
+        ASSERT_TRUE(type->CastTo(&udt));
+        ASSERT_TRUE(loaded_type->CastTo(&loaded_udt));
+        EXPECT_EQ(udt->udt_kind(), loaded_udt->udt_kind());
+        EXPECT_EQ(udt->is_fwd_decl(), loaded_udt->is_fwd_decl());
+        ASSERT_EQ(udt->fields().size(), loaded_udt->fields().size());
+        for (size_t i = 0; i < udt->fields().size(); ++i)
+          EXPECT_EQ(*udt->fields()[i], *loaded_udt->fields()[i]);
+        EXPECT_EQ(udt->functions(), loaded_udt->functions());
+        break;
+      }
+      case Type::POINTER_TYPE_KIND: {
+        PointerTypePtr ptr;
+        PointerTypePtr loaded_ptr;
+        ASSERT_TRUE(type->CastTo(&ptr));
+        ASSERT_TRUE(loaded_type->CastTo(&loaded_ptr));
+        EXPECT_EQ(ptr->ptr_mode(), loaded_ptr->ptr_mode());
+        EXPECT_EQ(ptr->is_const(), loaded_ptr->is_const());
+        EXPECT_EQ(ptr->is_volatile(), loaded_ptr->is_volatile());
+        EXPECT_EQ(ptr->content_type_id(), loaded_ptr->content_type_id());
+        break;
+      }
+      case Type::ARRAY_TYPE_KIND: {
+        ArrayTypePtr array;
+        ArrayTypePtr loaded_array;
+        ASSERT_TRUE(type->CastTo(&array));
+        ASSERT_TRUE(loaded_type->CastTo(&loaded_array));
+        EXPECT_EQ(array->is_volatile(), loaded_array->is_volatile());
+        EXPECT_EQ(array->index_type_id(), loaded_array->index_type_id());
+        EXPECT_EQ(array->num_elements(), loaded_array->num_elements());
+        EXPECT_EQ(array->element_type_id(), loaded_array->element_type_id());
+        break;
+      }
+      case Type::FUNCTION_TYPE_KIND: {
+        FunctionTypePtr function;
+        FunctionTypePtr loaded_function;
+        ASSERT_TRUE(type->CastTo(&function));
+        ASSERT_TRUE(loaded_type->CastTo(&loaded_function));
+        EXPECT_EQ(function->call_convention(),
+                  loaded_function->call_convention());
+        EXPECT_EQ(function->return_type(), loaded_function->return_type());
+        EXPECT_EQ(function->argument_types(),
+                  loaded_function->argument_types());
+        EXPECT_EQ(function->containing_class_id(),
+                  loaded_function->containing_class_id());
+        break;
+      }
+      case Type::GLOBAL_TYPE_KIND: {
+        GlobalTypePtr global;
+        GlobalTypePtr loaded_global;
+        ASSERT_TRUE(type->CastTo(&global));
+        ASSERT_TRUE(loaded_type->CastTo(&loaded_global));
+        EXPECT_EQ(global->rva(), loaded_global->rva());
+        EXPECT_EQ(global->data_type_id(), loaded_global->data_type_id());
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+
+TEST_F(TypeRepositorySerializerTest, LoadFailsOnVersionMismatch) {
+  core::ByteVector bytes;
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(bytes)));
+  core::NativeBinaryOutArchive out_archive(out_stream.get());
+  ASSERT_TRUE(out_archive.Save(TypeRepositorySerializer::kVersion + 1));
+  ASSERT_TRUE(out_archive.Save(static_cast<uint64_t>(0)));
+  ASSERT_TRUE(out_archive.Flush());
+
+  scoped_refptr<TypeRepository> loaded = new TypeRepository();
+  core::ScopedInStreamPtr in_stream(
+      core::CreateByteInStream(bytes.begin(), bytes.end()));
+  core::NativeBinaryInArchive in_archive(in_stream.get());
+  TypeRepositorySerializer serializer;
+  EXPECT_FALSE(serializer.Load(&in_archive, loaded.get()));
+  EXPECT_EQ(0U, loaded->size());
+}
+
+}  // namespace refinery
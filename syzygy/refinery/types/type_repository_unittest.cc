@@ -151,4 +151,42 @@ TEST(TypeNameIndexTest, BasicTest) {
   ASSERT_EQ(two.get(), matching_types[0].get());
 }
 
+TEST(TypeNameIndexTest, OrdersCollisionsById) {
+  scoped_refptr<TypeRepository> repo = new TypeRepository();
+  for (TypeId id = 10; id > 0; --id)
+    ASSERT_TRUE(repo->AddTypeWithId(new BasicType(L"one", 4), id));
+
+  scoped_refptr<TypeNameIndex> index = new TypeNameIndex(repo);
+  std::vector<TypePtr> matching_types;
+  index->GetTypes(L"one", &matching_types);
+  ASSERT_EQ(10U, matching_types.size());
+  for (size_t i = 0; i < matching_types.size(); ++i)
+    EXPECT_EQ(i + 1, matching_types[i]->type_id());
+}
+
+TEST(TypeNameIndexTest, GetTypesByDecoratedName) {
+  scoped_refptr<TypeRepository> repo = new TypeRepository();
+  TypePtr foo = new UserDefinedType(L"foo", L".?AUfoo@@", 4,
+                                    UserDefinedType::UDT_STRUCT);
+  repo->AddType(foo);
+  TypePtr other_foo = new UserDefinedType(L"foo", L".?AUfoo@bar@@", 4,
+                                          UserDefinedType::UDT_STRUCT);
+  repo->AddType(other_foo);
+
+  scoped_refptr<TypeNameIndex> index = new TypeNameIndex(repo);
+
+  // The undecorated name matches both types.
+  std::vector<TypePtr> matching_types;
+  index->GetTypes(L"foo", &matching_types);
+  ASSERT_EQ(2U, matching_types.size());
+
+  // The decorated names tell them apart.
+  index->GetTypesByDecoratedName(L".?AUfoo@bar@@", &matching_types);
+  ASSERT_EQ(1U, matching_types.size());
+  EXPECT_EQ(other_foo.get(), matching_types[0].get());
+
+  index->GetTypesByDecoratedName(L"foo", &matching_types);
+  EXPECT_EQ(0U, matching_types.size());
+}
+
 }  // namespace refinery
@@ -31,6 +31,8 @@
         'type_namer.h',
         'type_repository.cc',
         'type_repository.h',
+        'type_repository_serializer.cc',
+        'type_repository_serializer.h',
         'typed_data.cc',
         'typed_data.h',
       ],
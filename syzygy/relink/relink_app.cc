@@ -40,9 +40,20 @@ const char kUsageFormatStr[] =
     "                          Default value is 1.\n"
     "    --compress-pdb        If --no-augment-pdb is specified, causes the\n"
     "                          augmented PDB stream to be compressed.\n"
+    "    --decomposition-cache-dir=<path>\n"
+    "                          A directory caching the decompositions of the\n"
+    "                          input images, shared by the runs of the\n"
+    "                          relinking tools on a same image. Defaults to\n"
+    "                          the SYZYGY_DECOMPOSITION_CACHE_DIR environment\n"
+    "                          variable.\n"
     "    --exclude-bb-padding  When randomly reordering basic blocks, exclude\n"
     "                          padding and unreachable code from the relinked\n"
     "                          output binary.\n"
+    "    --incremental-base=<path>\n"
+    "                          A file holding the decomposition of the\n"
+    "                          previous relink of the input image. The\n"
+    "                          decomposition is diffed against it, then\n"
+    "                          saved to it for the next relink.\n"
     "    --input-pdb=<path>    The PDB file associated with the input DLL.\n"
     "                          Default is inferred from input-image.\n"
     "    --no-augment-pdb      Indicates that the relinker should not augment\n"
@@ -57,6 +68,8 @@ const char kUsageFormatStr[] =
     "                          Default is inferred from output-image.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --padding=<integer>   Add bytes of padding between blocks.\n"
+    "    --profile             Write the time and memory spent by each phase\n"
+    "                          of the relink to <output-image>.profile.json.\n"
     "    --verbose             Log verbosely.\n"
     "\n"
     "  Testing Options:\n"
@@ -122,6 +135,10 @@ bool RelinkApp::ParseCommandLine(const base::CommandLine* cmd_line) {
 
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   order_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("order-file"));
+  decomposition_cache_dir_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("decomposition-cache-dir"));
+  incremental_base_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("incremental-base"));
   no_augment_pdb_ = cmd_line->HasSwitch("no-augment-pdb");
   compress_pdb_ = cmd_line->HasSwitch("compress-pdb");
   no_strip_strings_ = cmd_line->HasSwitch("no-strip-strings");
@@ -130,6 +147,7 @@ bool RelinkApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   basic_blocks_ = cmd_line->HasSwitch("basic-blocks");
   exclude_bb_padding_ = cmd_line->HasSwitch("exclude-bb-padding");
   fuzz_ = cmd_line->HasSwitch("fuzz");
+  profile_ = cmd_line->HasSwitch("profile");
 
   // The --output-image argument is required.
   if (output_image_path_.empty()) {
@@ -202,6 +220,8 @@ int RelinkApp::Run() {
   relinker.set_input_pdb_path(input_pdb_path_);
   relinker.set_output_path(output_image_path_);
   relinker.set_output_pdb_path(output_pdb_path_);
+  relinker.set_decomposition_cache_dir(decomposition_cache_dir_);
+  relinker.set_incremental_base_path(incremental_base_path_);
   relinker.set_padding(padding_);
   relinker.set_code_alignment(code_alignment_);
   relinker.set_add_metadata(output_metadata_);
@@ -209,6 +229,10 @@ int RelinkApp::Run() {
   relinker.set_augment_pdb(!no_augment_pdb_);
   relinker.set_compress_pdb(compress_pdb_);
   relinker.set_strip_strings(!no_strip_strings_);
+  if (profile_) {
+    relinker.set_profile_path(
+        base::FilePath(output_image_path_.value() + L".profile.json"));
+  }
 
   // Initialize the relinker. This does the decomposition, etc.
   if (!relinker.Init()) {
@@ -40,7 +40,8 @@ class RelinkApp : public application::AppImplBase {
         overwrite_(false),
         basic_blocks_(false),
         exclude_bb_padding_(false),
-        fuzz_(false) {
+        fuzz_(false),
+        profile_(false) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -64,6 +65,8 @@ class RelinkApp : public application::AppImplBase {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath decomposition_cache_dir_;
+  base::FilePath incremental_base_path_;
   uint32_t seed_;
   size_t padding_;
   size_t code_alignment_;
@@ -75,6 +78,7 @@ class RelinkApp : public application::AppImplBase {
   bool basic_blocks_;
   bool exclude_bb_padding_;
   bool fuzz_;
+  bool profile_;
   // @}
 
  private:
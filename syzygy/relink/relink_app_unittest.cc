@@ -43,6 +43,8 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::output_image_path_;
   using RelinkApp::output_pdb_path_;
   using RelinkApp::order_file_path_;
+  using RelinkApp::decomposition_cache_dir_;
+  using RelinkApp::incremental_base_path_;
   using RelinkApp::seed_;
   using RelinkApp::padding_;
   using RelinkApp::code_alignment_;
@@ -52,6 +54,7 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::output_metadata_;
   using RelinkApp::overwrite_;
   using RelinkApp::fuzz_;
+  using RelinkApp::profile_;
 };
 
 typedef application::Application<TestRelinkApp> TestApp;
@@ -97,6 +100,8 @@ class RelinkAppTest : public testing::PELibUnitTest {
     output_image_path_ = temp_dir_.Append(input_image_path_.BaseName());
     output_pdb_path_ = temp_dir_.Append(input_pdb_path_.BaseName());
     order_file_path_ = temp_dir_.Append(L"order.json");
+    cache_dir_ = temp_dir_.Append(L"cache");
+    incremental_base_path_ = temp_dir_.Append(L"base.bg");
 
     // Point the application at the test's command-line and IO streams.
     test_app_.set_command_line(&cmd_line_);
@@ -146,6 +151,8 @@ class RelinkAppTest : public testing::PELibUnitTest {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath cache_dir_;
+  base::FilePath incremental_base_path_;
   uint32_t seed_;
   size_t padding_;
   size_t code_alignment_;
@@ -241,6 +248,7 @@ TEST_F(RelinkAppTest, ParseMinimalCommandLineWithOrderFile) {
   EXPECT_TRUE(test_impl_.output_metadata_);
   EXPECT_FALSE(test_impl_.overwrite_);
   EXPECT_FALSE(test_impl_.fuzz_);
+  EXPECT_FALSE(test_impl_.profile_);
 
   EXPECT_FALSE(test_impl_.SetUp());
 }
@@ -252,12 +260,15 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitchPath("order-file", order_file_path_);
+  cmd_line_.AppendSwitchPath("decomposition-cache-dir", cache_dir_);
+  cmd_line_.AppendSwitchPath("incremental-base", incremental_base_path_);
   cmd_line_.AppendSwitch("no-augment-pdb");
   cmd_line_.AppendSwitch("compress-pdb");
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitch("no-metadata");
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("fuzz");
+  cmd_line_.AppendSwitch("profile");
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_TRUE(test_impl_.input_image_path_.empty());
@@ -265,6 +276,8 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   EXPECT_EQ(output_image_path_, test_impl_.output_image_path_);
   EXPECT_EQ(output_pdb_path_, test_impl_.output_pdb_path_);
   EXPECT_EQ(order_file_path_, test_impl_.order_file_path_);
+  EXPECT_EQ(cache_dir_, test_impl_.decomposition_cache_dir_);
+  EXPECT_EQ(incremental_base_path_, test_impl_.incremental_base_path_);
   EXPECT_EQ(0, test_impl_.seed_);
   EXPECT_EQ(0, test_impl_.padding_);
   EXPECT_EQ(1, test_impl_.code_alignment_);
@@ -274,6 +287,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   EXPECT_FALSE(test_impl_.output_metadata_);
   EXPECT_TRUE(test_impl_.overwrite_);
   EXPECT_TRUE(test_impl_.fuzz_);
+  EXPECT_TRUE(test_impl_.profile_);
 
   // The order file doesn't actually exist, so setup should fail to infer the
   // input dll.
@@ -0,0 +1,210 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include <algorithm>
+#include <set>
+
+#include "syzygy/pe/pe_utils.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph::Block Block;
+
+// The cluster of each block, as an index in the clusters.
+typedef std::map<const Block*, size_t> ClusterIndexMap;
+
+// Takes a candidate caller, and how often it calls, of a block.
+struct Caller {
+  const Block* block;
+  uint64_t weight;
+};
+
+}  // namespace
+
+CallGraphOrderGenerator::CallGraphOrderGenerator(size_t max_cluster_size)
+    : Reorderer::OrderGenerator("Call Graph Order Generator"),
+      max_cluster_size_(max_cluster_size) {
+}
+
+CallGraphOrderGenerator::~CallGraphOrderGenerator() {
+}
+
+bool CallGraphOrderGenerator::OnCodeBlockEntry(
+    const BlockGraph::Block* /*block*/,
+    RelativeAddress /*address*/,
+    uint32_t /*process_id*/,
+    uint32_t /*thread_id*/,
+    const UniqueTime& /*time*/) {
+  // The calls are counted by OnCodeBlockCall, which also sees the callers.
+  return true;
+}
+
+bool CallGraphOrderGenerator::OnCodeBlockCall(
+    const BlockGraph::Block* caller,
+    const BlockGraph::Block* callee,
+    uint32_t /*process_id*/,
+    size_t num_calls) {
+  DCHECK(callee != NULL);
+
+  block_weights_[callee] += num_calls;
+  if (caller != NULL && caller != callee)
+    edge_weights_[std::make_pair(caller, callee)] += num_calls;
+  return true;
+}
+
+bool CallGraphOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+  order->comment = "Call graph ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    const ImageLayout::SectionInfo& section = image.sections[i];
+    order->sections[i].id = i;
+    order->sections[i].name = section.name;
+    order->sections[i].characteristics = section.characteristics;
+
+    // Gather up all blocks within the section, in their original order.
+    BlockVector blocks;
+    AddressSpace::RangeMapConstIterPair section_blocks(
+        image.blocks.GetIntersectingBlocks(section.addr, section.size));
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it)
+      blocks.push_back(section_it->second);
+
+    // The data sections, and the code sections that aren't reordered, keep
+    // their original order.
+    bool is_code = (section.characteristics & IMAGE_SCN_CNT_CODE) != 0;
+    ClusterVector clusters;
+    if (is_code && reorder_code)
+      ClusterBlocks(blocks, &clusters);
+
+    std::set<const BlockGraph::Block*> placed_blocks;
+    for (const Cluster& cluster : clusters) {
+      for (const BlockGraph::Block* block : cluster.blocks) {
+        order->sections[i].blocks.push_back(Order::BlockSpec(block));
+        placed_blocks.insert(block);
+      }
+    }
+    for (const BlockGraph::Block* block : blocks) {
+      if (placed_blocks.count(block) == 0)
+        order->sections[i].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+void CallGraphOrderGenerator::ClusterBlocks(const BlockVector& blocks,
+                                            ClusterVector* clusters) const {
+  DCHECK(clusters != NULL);
+
+  // Each called block starts in a cluster of its own. The blocks are in
+  // their original order, which is kept between the blocks of equal weights
+  // so that the ordering is deterministic.
+  std::vector<Cluster> all_clusters;
+  BlockVector called_blocks;
+  ClusterIndexMap cluster_indices;
+  for (const BlockGraph::Block* block : blocks) {
+    BlockWeightMap::const_iterator weight = block_weights_.find(block);
+    if (weight == block_weights_.end())
+      continue;
+    called_blocks.push_back(block);
+    Cluster cluster;
+    cluster.blocks.push_back(block);
+    cluster.size = block->size();
+    cluster.weight = weight->second;
+    cluster_indices[block] = all_clusters.size();
+    all_clusters.push_back(cluster);
+  }
+
+  // Find the most frequent caller of each block, in the same section.
+  std::map<const BlockGraph::Block*, Caller> callers;
+  for (const auto& edge : edge_weights_) {
+    const BlockGraph::Block* caller = edge.first.first;
+    const BlockGraph::Block* callee = edge.first.second;
+    if (cluster_indices.count(caller) == 0 ||
+        cluster_indices.count(callee) == 0) {
+      continue;
+    }
+    Caller candidate = {caller, edge.second};
+    auto result = callers.insert(std::make_pair(callee, candidate));
+    if (!result.second && result.first->second.weight < edge.second)
+      result.first->second = candidate;
+  }
+
+  // Visit the blocks by decreasing number of calls, appending the cluster of
+  // each to that of its most frequent caller when they fit in a cluster.
+  const BlockWeightMap& block_weights = block_weights_;
+  std::stable_sort(called_blocks.begin(), called_blocks.end(),
+                   [&block_weights](const Block* block1, const Block* block2) {
+                     return block_weights.at(block1) >
+                            block_weights.at(block2);
+                   });
+  for (const BlockGraph::Block* block : called_blocks) {
+    auto caller = callers.find(block);
+    if (caller == callers.end())
+      continue;
+
+    size_t callee_index = cluster_indices[block];
+    size_t caller_index = cluster_indices[caller->second.block];
+    if (callee_index == caller_index)
+      continue;
+    Cluster& callee_cluster = all_clusters[callee_index];
+    Cluster& caller_cluster = all_clusters[caller_index];
+    if (caller_cluster.size + callee_cluster.size > max_cluster_size_)
+      continue;
+
+    for (const BlockGraph::Block* callee_block : callee_cluster.blocks)
+      cluster_indices[callee_block] = caller_index;
+    caller_cluster.blocks.insert(caller_cluster.blocks.end(),
+                                 callee_cluster.blocks.begin(),
+                                 callee_cluster.blocks.end());
+    caller_cluster.size += callee_cluster.size;
+    caller_cluster.weight += callee_cluster.weight;
+    callee_cluster.blocks.clear();
+    callee_cluster.size = 0;
+    callee_cluster.weight = 0;
+  }
+
+  // Lay the clusters out by decreasing density.
+  std::vector<const Cluster*> merged_clusters;
+  for (const Cluster& cluster : all_clusters) {
+    if (!cluster.blocks.empty())
+      merged_clusters.push_back(&cluster);
+  }
+  // The sizes are taken to be at least one, so that the empty blocks are
+  // still ordered by their weights.
+  std::stable_sort(merged_clusters.begin(), merged_clusters.end(),
+                   [](const Cluster* cluster1, const Cluster* cluster2) {
+                     uint64_t size1 = std::max<uint64_t>(cluster1->size, 1);
+                     uint64_t size2 = std::max<uint64_t>(cluster2->size, 1);
+                     return cluster1->weight * size2 >
+                            cluster2->weight * size1;
+                   });
+
+  clusters->clear();
+  for (const Cluster* cluster : merged_clusters)
+    clusters->push_back(*cluster);
+}
+
+}  // namespace reorder
@@ -0,0 +1,100 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the CallGraphOrderGenerator, which orders the code blocks that
+// call each other often next to each other, using the call-chain clustering
+// heuristic (C3) of Ottoni and Maher. The call graph is weighted by the
+// number of calls seen between each caller and callee.
+//
+// Each called block starts in a cluster of its own. The blocks are visited
+// by decreasing number of calls, and the cluster of each is appended to the
+// cluster of its most frequent caller, as long as the merged cluster fits in
+// a page. A callee then follows its caller closely, in the same page, so
+// that the hot paths of the code touch as few pages as possible. The
+// clusters are then laid out by decreasing density, the number of calls per
+// byte, followed by the blocks that weren't called, in their original order.
+//
+// The data sections keep their original order.
+
+#ifndef SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+class CallGraphOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  // The default maximum size of a cluster, that of a page.
+  static const size_t kDefaultMaxClusterSize = 4096;
+
+  // @param max_cluster_size the maximum size of a cluster, in bytes.
+  explicit CallGraphOrderGenerator(size_t max_cluster_size);
+  virtual ~CallGraphOrderGenerator();
+
+  // OrderGenerator implementation.
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32_t process_id,
+                                uint32_t thread_id,
+                                const UniqueTime& time) override;
+  virtual bool OnCodeBlockCall(const BlockGraph::Block* caller,
+                               const BlockGraph::Block* callee,
+                               uint32_t process_id,
+                               size_t num_calls) override;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) override;
+
+ protected:
+  typedef std::vector<const BlockGraph::Block*> BlockVector;
+  typedef std::map<const BlockGraph::Block*, uint64_t> BlockWeightMap;
+  typedef std::pair<const BlockGraph::Block*, const BlockGraph::Block*> Edge;
+  typedef std::map<Edge, uint64_t> EdgeWeightMap;
+
+  // A group of blocks that are laid out together.
+  struct Cluster {
+    BlockVector blocks;
+    size_t size;
+    uint64_t weight;
+  };
+  typedef std::vector<Cluster> ClusterVector;
+
+  // Clusters the called blocks of a code section.
+  // @param blocks the blocks of the section, in their original order.
+  // @param clusters receives the clusters, in the order they are laid out.
+  void ClusterBlocks(const BlockVector& blocks, ClusterVector* clusters) const;
+
+  // The maximum size of a cluster.
+  const size_t max_cluster_size_;
+
+  // The number of calls to each block.
+  BlockWeightMap block_weights_;
+
+  // The number of calls for each caller and callee.
+  EdgeWeightMap edge_weights_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CallGraphOrderGenerator);
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
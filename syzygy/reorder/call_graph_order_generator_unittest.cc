@@ -0,0 +1,155 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph::Block Block;
+
+class CallGraphOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  void SetUp() override {
+    testing::OrderGeneratorTest::SetUp();
+
+    // Get the first few non-empty blocks of the .text section.
+    text_index_ = input_dll_.GetSectionIndex(".text");
+    const IMAGE_SECTION_HEADER* section =
+        input_dll_.section_header(text_index_);
+    ASSERT_TRUE(section != NULL);
+    BlockSpecVector block_specs;
+    GetBlockListForSection(section, &block_specs);
+    for (const BlockSpec& block_spec : block_specs) {
+      if (block_spec.block->size() == 0)
+        continue;
+      blocks_.push_back(block_spec.block);
+      if (blocks_.size() == 5)
+        break;
+    }
+    ASSERT_EQ(5u, blocks_.size());
+  }
+
+  // Feeds a call graph to @p order_generator: block 4 is called the most,
+  // from outside the module. Block 0 calls blocks 1 and 2, and block 1 calls
+  // block 3.
+  void AddCalls(CallGraphOrderGenerator* order_generator) {
+    EXPECT_TRUE(order_generator->OnCodeBlockCall(NULL, blocks_[4], 1, 100));
+    EXPECT_TRUE(order_generator->OnCodeBlockCall(NULL, blocks_[0], 1, 10));
+    EXPECT_TRUE(order_generator->OnCodeBlockCall(blocks_[0], blocks_[1], 1, 8));
+    EXPECT_TRUE(order_generator->OnCodeBlockCall(blocks_[0], blocks_[2], 1, 5));
+    EXPECT_TRUE(order_generator->OnCodeBlockCall(blocks_[1], blocks_[3], 2, 3));
+  }
+
+  // @returns the number of calls to @p block fed by AddCalls.
+  size_t GetWeight(const Block* block) {
+    const size_t kWeights[] = {10, 8, 5, 3, 100};
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      if (blocks_[i] == block)
+        return kWeights[i];
+    }
+    ADD_FAILURE() << "Block not called.";
+    return 0;
+  }
+
+  // @returns the position of @p block in the order of the .text section.
+  size_t GetPosition(const Block* block) {
+    const BlockSpecVector& block_specs = order_.sections[text_index_].blocks;
+    for (size_t i = 0; i < block_specs.size(); ++i) {
+      if (block_specs[i].block == block)
+        return i;
+    }
+    ADD_FAILURE() << "Block not in the order.";
+    return block_specs.size();
+  }
+
+  size_t text_index_;
+  std::vector<const Block*> blocks_;
+};
+
+}  // namespace
+
+TEST_F(CallGraphOrderGeneratorTest, DoNotReorder) {
+  CallGraphOrderGenerator order_generator(
+      CallGraphOrderGenerator::kDefaultMaxClusterSize);
+  AddCalls(&order_generator);
+  EXPECT_TRUE(order_generator.CalculateReordering(input_dll_,
+                                                  image_layout_,
+                                                  false,
+                                                  false,
+                                                  &order_));
+
+  ExpectNoDuplicateBlocks();
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(CallGraphOrderGeneratorTest, ClustersCallers) {
+  CallGraphOrderGenerator order_generator(1024 * 1024);
+  AddCalls(&order_generator);
+  EXPECT_TRUE(order_generator.CalculateReordering(input_dll_,
+                                                  image_layout_,
+                                                  true,
+                                                  true,
+                                                  &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The callees follow their callers, by decreasing number of calls, and
+  // the called blocks come before all of the others.
+  size_t position = GetPosition(blocks_[0]);
+  EXPECT_EQ(position + 1, GetPosition(blocks_[1]));
+  EXPECT_EQ(position + 2, GetPosition(blocks_[2]));
+  EXPECT_EQ(position + 3, GetPosition(blocks_[3]));
+  EXPECT_GT(5u, GetPosition(blocks_[4]));
+  EXPECT_GT(5u, position);
+
+  // The data sections keep their original order.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    if ((section->Characteristics & IMAGE_SCN_CNT_CODE) == 0)
+      ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(CallGraphOrderGeneratorTest, RespectsMaxClusterSize) {
+  // The clusters can't grow past a single block, so the blocks are laid out
+  // by decreasing density.
+  CallGraphOrderGenerator order_generator(1);
+  AddCalls(&order_generator);
+  EXPECT_TRUE(order_generator.CalculateReordering(input_dll_,
+                                                  image_layout_,
+                                                  true,
+                                                  false,
+                                                  &order_));
+
+  ExpectNoDuplicateBlocks();
+  for (size_t i = 0; i + 1 < 5; ++i) {
+    const Block* block1 = order_.sections[text_index_].blocks[i].block;
+    const Block* block2 = order_.sections[text_index_].blocks[i + 1].block;
+    EXPECT_GE(GetWeight(block1) * block2->size(),
+              GetWeight(block2) * block1->size());
+  }
+}
+
+}  // namespace reorder
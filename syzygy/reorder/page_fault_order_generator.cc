@@ -0,0 +1,301 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/page_fault_order_generator.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/common/align.h"
+#include "syzygy/core/random_number_generator.h"
+#include "syzygy/pe/pe_utils.h"
+#include "syzygy/simulate/page_fault_simulation.h"
+
+namespace reorder {
+
+namespace {
+
+typedef PageFaultOrderGenerator::SectionSearch SectionSearch;
+
+// The maximum length of the runs of blocks swapped by a perturbation.
+const size_t kMaxRunLength = 8;
+
+// Searches for the best order of a section from a seed, until a deadline.
+// Only the candidates that take no more page faults than the current order
+// are kept, so the current order is always the best one found.
+class SectionSearcher : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param search the search problem of the section.
+  // @param seed the seed of the random perturbations.
+  // @param deadline the time to stop searching at.
+  SectionSearcher(const SectionSearch& search,
+                  uint32_t seed,
+                  base::TimeTicks deadline)
+      : search_(search),
+        random_(seed),
+        deadline_(deadline),
+        best_faults_(0),
+        num_candidates_(0) {
+    for (size_t i = 0; i < search_.blocks.size(); ++i)
+      best_order_.push_back(i);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    best_faults_ = PageFaultOrderGenerator::CountPageFaults(search_,
+                                                            best_order_);
+    std::vector<size_t> candidate;
+    while (best_faults_ != 0 && base::TimeTicks::Now() < deadline_) {
+      candidate = best_order_;
+      if (!Perturb(&candidate))
+        break;
+      ++num_candidates_;
+      size_t faults =
+          PageFaultOrderGenerator::CountPageFaults(search_, candidate);
+      if (faults <= best_faults_) {
+        best_order_.swap(candidate);
+        best_faults_ = faults;
+      }
+    }
+  }
+  // @}
+
+  // @name Results, only valid once the thread has been joined.
+  // @{
+  const std::vector<size_t>& best_order() const { return best_order_; }
+  size_t best_faults() const { return best_faults_; }
+  size_t num_candidates() const { return num_candidates_; }
+  // @}
+
+ private:
+  // Perturbs an order, either by moving a block that is never entered to
+  // the end of the section, or by swapping two runs of blocks.
+  // @param order the order to perturb.
+  // @returns false if the order has too few blocks to be perturbed.
+  bool Perturb(std::vector<size_t>* order) {
+    DCHECK(order != NULL);
+    uint32_t size = static_cast<uint32_t>(order->size());
+    if (size < 2)
+      return false;
+
+    if (random_(2) == 0) {
+      uint32_t position = random_(size);
+      if (!search_.is_entered[order->at(position)]) {
+        std::rotate(order->begin() + position,
+                    order->begin() + position + 1,
+                    order->end());
+        return true;
+      }
+    }
+
+    uint32_t max_length =
+        std::min(static_cast<uint32_t>(kMaxRunLength), size / 2);
+    uint32_t length = 1 + random_(max_length);
+    uint32_t first = random_(size - 2 * length + 1);
+    uint32_t second = first + length + random_(size - first - 2 * length + 1);
+    std::swap_ranges(order->begin() + first,
+                     order->begin() + first + length,
+                     order->begin() + second);
+    return true;
+  }
+
+  const SectionSearch& search_;
+  core::RandomNumberGenerator random_;
+  const base::TimeTicks deadline_;
+
+  std::vector<size_t> best_order_;
+  size_t best_faults_;
+  size_t num_candidates_;
+
+  DISALLOW_COPY_AND_ASSIGN(SectionSearcher);
+};
+
+}  // namespace
+
+PageFaultOrderGenerator::PageFaultOrderGenerator(uint32_t seed,
+                                                 size_t num_threads,
+                                                 base::TimeDelta time_budget)
+    : Reorderer::OrderGenerator("Page Fault Order Generator"),
+      seed_(seed),
+      num_threads_(num_threads),
+      time_budget_(time_budget),
+      page_size_(simulate::PageFaultSimulation::kDefaultPageSize),
+      pages_per_code_fault_(
+          simulate::PageFaultSimulation::kDefaultPagesPerCodeFault) {
+  DCHECK_LT(0u, num_threads_);
+}
+
+PageFaultOrderGenerator::~PageFaultOrderGenerator() {
+}
+
+bool PageFaultOrderGenerator::OnCodeBlockEntry(
+    const BlockGraph::Block* block,
+    RelativeAddress /*address*/,
+    uint32_t process_id,
+    uint32_t /*thread_id*/,
+    const UniqueTime& /*time*/) {
+  DCHECK(block != NULL);
+
+  // Only the first entry of a block can fault, as its pages stay loaded.
+  ProcessTrace& trace = process_traces_[process_id];
+  if (trace.entered_blocks.insert(block).second)
+    trace.blocks.push_back(block);
+  return true;
+}
+
+bool PageFaultOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+  order->comment = "Page fault minimizing ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+
+  // Gather up the search problems of the code sections that are entered.
+  std::vector<SectionSearch> searches(image.sections.size());
+  size_t num_searches = 0;
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    const ImageLayout::SectionInfo& section = image.sections[i];
+    order->sections[i].id = i;
+    order->sections[i].name = section.name;
+    order->sections[i].characteristics = section.characteristics;
+
+    SectionSearch& search = searches[i];
+    search.start = section.addr.value();
+    search.page_size = page_size_;
+    search.pages_per_code_fault = pages_per_code_fault_;
+
+    std::map<const BlockGraph::Block*, size_t> block_indices;
+    AddressSpace::RangeMapConstIterPair section_blocks(
+        image.blocks.GetIntersectingBlocks(section.addr, section.size));
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      block_indices[section_it->second] = search.blocks.size();
+      search.blocks.push_back(section_it->second);
+    }
+
+    bool is_code = (section.characteristics & IMAGE_SCN_CNT_CODE) != 0;
+    if (!is_code || !reorder_code)
+      continue;
+
+    search.is_entered.resize(search.blocks.size(), false);
+    for (const auto& process_trace : process_traces_) {
+      std::vector<size_t> trace;
+      for (const BlockGraph::Block* block : process_trace.second.blocks) {
+        auto index = block_indices.find(block);
+        if (index == block_indices.end())
+          continue;
+        trace.push_back(index->second);
+        search.is_entered[index->second] = true;
+      }
+      if (!trace.empty())
+        search.traces.push_back(trace);
+    }
+    if (!search.traces.empty())
+      ++num_searches;
+  }
+
+  // The sections that aren't searched keep their original order.
+  for (size_t i = 0; i < searches.size(); ++i) {
+    const SectionSearch& search = searches[i];
+    std::vector<size_t> section_order;
+    if (search.traces.empty()) {
+      for (size_t j = 0; j < search.blocks.size(); ++j)
+        section_order.push_back(j);
+    } else {
+      LOG(INFO) << "Searching the order of section " << i << " ("
+                << image.sections[i].name << ").";
+      SearchSection(search, time_budget_ / static_cast<int64_t>(num_searches),
+                    &section_order);
+    }
+
+    for (size_t index : section_order) {
+      order->sections[i].blocks.push_back(
+          Order::BlockSpec(search.blocks[index]));
+    }
+  }
+
+  return true;
+}
+
+size_t PageFaultOrderGenerator::CountPageFaults(
+    const SectionSearch& search,
+    const std::vector<size_t>& order) {
+  DCHECK_EQ(search.blocks.size(), order.size());
+
+  // Lay the blocks out in order.
+  std::vector<uint32_t> addresses(search.blocks.size());
+  size_t address = search.start;
+  for (size_t index : order) {
+    const BlockGraph::Block* block = search.blocks[index];
+    address = common::AlignUp(address, block->alignment());
+    addresses[index] = static_cast<uint32_t>(address);
+    address += block->size();
+  }
+
+  size_t faults = 0;
+  for (const std::vector<size_t>& trace : search.traces) {
+    simulate::PageFaultSimulation simulation;
+    simulation.set_page_size(search.page_size);
+    simulation.set_pages_per_code_fault(search.pages_per_code_fault);
+    for (size_t index : trace)
+      simulation.OnCodeRangeEntry(addresses[index],
+                                  search.blocks[index]->size());
+    faults += simulation.fault_count();
+  }
+  return faults;
+}
+
+void PageFaultOrderGenerator::SearchSection(const SectionSearch& search,
+                                            base::TimeDelta time_budget,
+                                            std::vector<size_t>* order) const {
+  DCHECK(order != NULL);
+
+  base::TimeTicks deadline = base::TimeTicks::Now() + time_budget;
+  std::vector<std::unique_ptr<SectionSearcher>> searchers;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < num_threads_; ++i) {
+    searchers.push_back(std::unique_ptr<SectionSearcher>(
+        new SectionSearcher(search, seed_ + static_cast<uint32_t>(i),
+                            deadline)));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(
+            searchers.back().get(),
+            base::StringPrintf("PageFaultSearch%d", static_cast<int>(i)))));
+    threads.back()->Start();
+  }
+
+  // The first searcher with the fewest page faults wins, so that the result
+  // only depends on the seeds and the number of candidates searched.
+  size_t best = 0;
+  size_t num_candidates = 0;
+  for (size_t i = 0; i < num_threads_; ++i) {
+    threads[i]->Join();
+    num_candidates += searchers[i]->num_candidates();
+    if (searchers[i]->best_faults() < searchers[best]->best_faults())
+      best = i;
+  }
+
+  LOG(INFO) << "Found an order taking " << searchers[best]->best_faults()
+            << " page faults, out of " << num_candidates << " candidates.";
+  *order = searchers[best]->best_order();
+}
+
+}  // namespace reorder
@@ -0,0 +1,149 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the PageFaultOrderGenerator, which searches for the order of the
+// code blocks that takes the fewest page faults to run the traced startups.
+//
+// The traces are reduced to the sequence of the blocks each process enters
+// for the first time, which is all that a PageFaultSimulation needs. Each
+// code section starts from its original order, which is then perturbed at
+// random by swapping runs of blocks and by moving the blocks that are never
+// entered to the end of the section. Each candidate order is laid out, and
+// scored by simulating the page faults of the traced processes over it. A
+// candidate is kept when it takes no more faults than the current one.
+//
+// The search runs on several threads, each from its own seed, for a time
+// budget, and the order with the fewest page faults wins. The data
+// sections keep their original order.
+
+#ifndef SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/time/time.h"
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+class PageFaultOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  typedef std::vector<const BlockGraph::Block*> BlockVector;
+
+  // The search problem of a code section.
+  struct SectionSearch;
+
+  // The default time budget of the search.
+  static const int kDefaultTimeBudgetInSeconds = 10;
+
+  // @param seed the seed of the random perturbations.
+  // @param num_threads the number of threads searching, at least one.
+  // @param time_budget the time the search of all of the sections may take.
+  PageFaultOrderGenerator(uint32_t seed,
+                          size_t num_threads,
+                          base::TimeDelta time_budget);
+  virtual ~PageFaultOrderGenerator();
+
+  // @name Accessors.
+  // @{
+  size_t page_size() const { return page_size_; }
+  size_t pages_per_code_fault() const { return pages_per_code_fault_; }
+  // @}
+
+  // @name Mutators.
+  // @{
+  void set_page_size(size_t page_size) {
+    DCHECK_LT(0u, page_size);
+    page_size_ = page_size;
+  }
+  void set_pages_per_code_fault(size_t pages_per_code_fault) {
+    DCHECK_LT(0u, pages_per_code_fault);
+    pages_per_code_fault_ = pages_per_code_fault;
+  }
+  // @}
+
+  // OrderGenerator implementation.
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32_t process_id,
+                                uint32_t thread_id,
+                                const UniqueTime& time) override;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) override;
+
+  // Counts the page faults of the traced processes over an order of the
+  // blocks of a section.
+  // @param search the search problem of the section.
+  // @param order the order of the blocks, as indices in search.blocks.
+  // @returns the total number of page faults.
+  static size_t CountPageFaults(const SectionSearch& search,
+                                const std::vector<size_t>& order);
+
+ protected:
+  // The blocks entered for the first time by a process, in order.
+  struct ProcessTrace {
+    BlockVector blocks;
+    std::set<const BlockGraph::Block*> entered_blocks;
+  };
+  typedef std::map<uint32_t, ProcessTrace> ProcessTraceMap;
+
+  // Searches for the best order of the blocks of a code section.
+  // @param search the search problem of the section.
+  // @param time_budget the time the search may take.
+  // @param order receives the order of the blocks, as indices in
+  //     search.blocks.
+  void SearchSection(const SectionSearch& search,
+                     base::TimeDelta time_budget,
+                     std::vector<size_t>* order) const;
+
+  // The search parameters.
+  const uint32_t seed_;
+  const size_t num_threads_;
+  const base::TimeDelta time_budget_;
+  size_t page_size_;
+  size_t pages_per_code_fault_;
+
+  // The traces of the processes.
+  ProcessTraceMap process_traces_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PageFaultOrderGenerator);
+};
+
+struct PageFaultOrderGenerator::SectionSearch {
+  // The blocks of the section, in their original order.
+  BlockVector blocks;
+
+  // The address of the start of the section.
+  uint32_t start;
+
+  // The blocks entered by each process, in order, as indices in blocks.
+  std::vector<std::vector<size_t>> traces;
+
+  // Whether each block is entered by any of the processes.
+  std::vector<bool> is_entered;
+
+  // The parameters of the simulation.
+  size_t page_size;
+  size_t pages_per_code_fault;
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
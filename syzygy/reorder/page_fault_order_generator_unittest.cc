@@ -0,0 +1,132 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/page_fault_order_generator.h"
+
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+typedef PageFaultOrderGenerator::SectionSearch SectionSearch;
+
+// Few small pages, so that the layout of a handful of blocks matters.
+const size_t kPageSize = 64;
+const size_t kPagesPerCodeFault = 1;
+
+class PageFaultOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  PageFaultOrderGeneratorTest()
+      : order_generator_(1234, 2, base::TimeDelta::FromMilliseconds(200)) {
+    order_generator_.set_page_size(kPageSize);
+    order_generator_.set_pages_per_code_fault(kPagesPerCodeFault);
+  }
+
+  void SetUp() override {
+    testing::OrderGeneratorTest::SetUp();
+
+    text_index_ = input_dll_.GetSectionIndex(".text");
+    const IMAGE_SECTION_HEADER* section =
+        input_dll_.section_header(text_index_);
+    ASSERT_TRUE(section != NULL);
+    GetBlockListForSection(section, &original_blocks_);
+
+    // Enter every tenth block, so that the entered blocks are spread over
+    // many pages in the original order.
+    for (size_t i = 0; i < original_blocks_.size(); i += 10) {
+      const BlockGraph::Block* block = original_blocks_[i].block;
+      entered_blocks_.push_back(block);
+      EXPECT_TRUE(order_generator_.OnCodeBlockEntry(
+          block, block->addr(), 1, 1, GetSystemTime()));
+    }
+    ASSERT_LT(1u, entered_blocks_.size());
+  }
+
+  // @returns the page faults of entering the blocks of the .text section
+  //     when they are laid out in the order of @p block_specs.
+  size_t CountPageFaults(const BlockSpecVector& block_specs) {
+    SectionSearch search;
+    search.start = input_dll_.section_header(text_index_)->VirtualAddress;
+    search.page_size = kPageSize;
+    search.pages_per_code_fault = kPagesPerCodeFault;
+    std::map<const BlockGraph::Block*, size_t> block_indices;
+    for (const BlockSpec& block_spec : original_blocks_) {
+      block_indices[block_spec.block] = search.blocks.size();
+      search.blocks.push_back(block_spec.block);
+    }
+    search.is_entered.resize(search.blocks.size(), false);
+    search.traces.resize(1);
+    for (const BlockGraph::Block* block : entered_blocks_) {
+      search.traces[0].push_back(block_indices[block]);
+      search.is_entered[block_indices[block]] = true;
+    }
+
+    std::vector<size_t> order;
+    for (const BlockSpec& block_spec : block_specs)
+      order.push_back(block_indices[block_spec.block]);
+    return PageFaultOrderGenerator::CountPageFaults(search, order);
+  }
+
+  PageFaultOrderGenerator order_generator_;
+  size_t text_index_;
+  BlockSpecVector original_blocks_;
+  std::vector<const BlockGraph::Block*> entered_blocks_;
+};
+
+}  // namespace
+
+TEST_F(PageFaultOrderGeneratorTest, DoNotReorder) {
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(PageFaultOrderGeneratorTest, ReorderCode) {
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   true,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // Moving the blocks that aren't entered out of the way takes fewer page
+  // faults than the original order.
+  const BlockSpecVector& text_blocks = order_.sections[text_index_].blocks;
+  ASSERT_EQ(original_blocks_.size(), text_blocks.size());
+  EXPECT_LT(CountPageFaults(text_blocks), CountPageFaults(original_blocks_));
+
+  // The data sections keep their original order.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    if ((section->Characteristics & IMAGE_SCN_CNT_CODE) == 0)
+      ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+}  // namespace reorder
@@ -22,12 +22,15 @@
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/reorder/basic_block_optimizer.h"
+#include "syzygy/reorder/call_graph_order_generator.h"
 #include "syzygy/reorder/dead_code_finder.h"
 #include "syzygy/reorder/linear_order_generator.h"
+#include "syzygy/reorder/page_fault_order_generator.h"
 #include "syzygy/reorder/random_order_generator.h"
 
 namespace reorder {
@@ -57,6 +60,22 @@ static const char kUsageFormatStr[] =
     "    --seed=INT generates a random ordering; don't specify ETW log files.\n"
     "    --list-dead-code instead of an ordering, output the set of functions\n"
     "        not visited during the trace.\n"
+    "    --call-graph orders the functions that call each other often next\n"
+    "        to each other, in clusters of at most a page.\n"
+    "    --page-faults searches for the ordering of the functions that takes\n"
+    "        the fewest page faults to replay the traces.\n"
+    "    --search-time=SECONDS the time budget of --page-faults. Defaults\n"
+    "        to 10 seconds.\n"
+    "    --search-threads=INT the number of threads searching with\n"
+    "        --page-faults. Defaults to the number of processors.\n"
+    "    --parse-threads=INT the number of threads parsing the trace files,\n"
+    "        each of which parses a trace file at a time. The resulting\n"
+    "        ordering doesn't depend on it. Defaults to 1.\n"
+    "    --decomposition-cache-dir=<path> a directory holding the\n"
+    "        decompositions of the input images and the OMAP data of the\n"
+    "        instrumented images of earlier runs, which are reused when they\n"
+    "        match. Defaults to the SYZYGY_DECOMPOSITION_CACHE_DIR\n"
+    "        environment variable.\n"
     "    --pretty-print enables pretty printing of the JSON output file.\n"
     "    --reorderer-flags=<comma separated reorderer flags>\n"
     "  Reorderer Flags:\n"
@@ -107,6 +126,12 @@ const char ReorderApp::kInputImage[] = "input-image";
 const char ReorderApp::kBasicBlockEntryCounts[] = "basic-block-entry-counts";
 const char ReorderApp::kSeed[] = "seed";
 const char ReorderApp::kListDeadCode[] = "list-dead-code";
+const char ReorderApp::kCallGraph[] = "call-graph";
+const char ReorderApp::kPageFaults[] = "page-faults";
+const char ReorderApp::kSearchTime[] = "search-time";
+const char ReorderApp::kSearchThreads[] = "search-threads";
+const char ReorderApp::kParseThreads[] = "parse-threads";
+const char ReorderApp::kDecompositionCacheDir[] = "decomposition-cache-dir";
 const char ReorderApp::kPrettyPrint[] = "pretty-print";
 const char ReorderApp::kReordererFlags[] = "reorderer-flags";
 const char ReorderApp::kInstrumentedDll[] = "instrumented-dll";
@@ -116,6 +141,9 @@ ReorderApp::ReorderApp()
     : AppImplBase("Reorder"),
       mode_(kInvalidMode),
       seed_(0),
+      search_time_(PageFaultOrderGenerator::kDefaultTimeBudgetInSeconds),
+      search_threads_(base::SysInfo::NumberOfProcessors()),
+      parse_threads_(1),
       pretty_print_(false),
       flags_(0) {
 }
@@ -147,6 +175,18 @@ bool ReorderApp::ParseCommandLine(const base::CommandLine* command_line) {
 
   bb_entry_count_file_path_ =
       command_line->GetSwitchValuePath(kBasicBlockEntryCounts);
+  decomposition_cache_dir_ =
+      command_line->GetSwitchValuePath(kDecompositionCacheDir);
+
+  // Parse the number of threads parsing the trace files.
+  if (command_line->HasSwitch(kParseThreads)) {
+    std::string parse_threads_str(
+        command_line->GetSwitchValueASCII(kParseThreads));
+    if (!base::StringToInt(parse_threads_str, &parse_threads_) ||
+        parse_threads_ <= 0) {
+      return Usage(command_line, "Invalid parse threads value.");
+    }
+  }
 
   // Parse the reorderer flags.
   std::string flags_str(command_line->GetSwitchValueASCII(kReordererFlags));
@@ -162,6 +202,7 @@ bool ReorderApp::ParseCommandLine(const base::CommandLine* command_line) {
   instrumented_image_path_ = AbsolutePath(instrumented_image_path_);
   output_file_path_ = AbsolutePath(output_file_path_);
   bb_entry_count_file_path_ = AbsolutePath(bb_entry_count_file_path_);
+  decomposition_cache_dir_ = AbsolutePath(decomposition_cache_dir_);
 
   // Capture the (possibly empty) set of trace files to read.
   for (size_t i = 0; i < command_line->GetArgs().size(); ++i) {
@@ -197,6 +238,48 @@ bool ReorderApp::ParseCommandLine(const base::CommandLine* command_line) {
     mode_ = kDeadCodeFinderMode;
   }
 
+  // Parse the call-graph switch.
+  if (command_line->HasSwitch(kCallGraph)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kCallGraph << " is mutually exclusive with --"
+                 << kSeed << "=N and --" << kListDeadCode << ".";
+      return false;
+    }
+    mode_ = kCallGraphOrderMode;
+  }
+
+  // Parse the page-faults switch, and the parameters of its search.
+  if (command_line->HasSwitch(kPageFaults)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kPageFaults << " is mutually exclusive with --"
+                 << kSeed << "=N, --" << kListDeadCode << " and --"
+                 << kCallGraph << ".";
+      return false;
+    }
+    mode_ = kPageFaultOrderMode;
+  }
+  if (command_line->HasSwitch(kSearchTime)) {
+    std::string search_time_str(command_line->GetSwitchValueASCII(kSearchTime));
+    if (!base::StringToInt(search_time_str, &search_time_) ||
+        search_time_ <= 0) {
+      return Usage(command_line, "Invalid search time value.");
+    }
+  }
+  if (command_line->HasSwitch(kSearchThreads)) {
+    std::string search_threads_str(
+        command_line->GetSwitchValueASCII(kSearchThreads));
+    if (!base::StringToInt(search_threads_str, &search_threads_) ||
+        search_threads_ <= 0) {
+      return Usage(command_line, "Invalid search threads value.");
+    }
+  }
+  if ((command_line->HasSwitch(kSearchTime) ||
+       command_line->HasSwitch(kSearchThreads)) &&
+      mode_ != kPageFaultOrderMode) {
+    return Usage(command_line,
+                 "The search parameters are only accepted with --page-faults.");
+  }
+
   // If we haven't found anything to over-ride the default mode (linear order),
   // then the default it is.
   if (mode_ == kInvalidMode)
@@ -240,6 +323,16 @@ bool ReorderApp::SetUp() {
     case kDeadCodeFinderMode:
       order_generator_.reset(new DeadCodeFinder());
       return true;
+
+    case kCallGraphOrderMode:
+      order_generator_.reset(new CallGraphOrderGenerator(
+          CallGraphOrderGenerator::kDefaultMaxClusterSize));
+      return true;
+
+    case kPageFaultOrderMode:
+      order_generator_.reset(new PageFaultOrderGenerator(
+          seed_, search_threads_, base::TimeDelta::FromSeconds(search_time_)));
+      return true;
   }
 
   NOTREACHED();
@@ -255,6 +348,8 @@ int ReorderApp::Run() {
                       instrumented_image_path_,
                       trace_file_paths_,
                       flags_);
+  reorderer.set_num_threads(parse_threads_);
+  reorderer.set_decomposition_cache_dir(decomposition_cache_dir_);
 
   // Generate a block-level ordering.
   if (!reorderer.Reorder(order_generator_.get(),
@@ -309,8 +404,8 @@ bool ReorderApp::OptimizeBasicBlocks(const pe::PEFile::Signature& signature,
   // Load the basic-block entry count data.
   ModuleIndexedFrequencyMap module_entry_count_map;
   IndexedFrequencyDataSerializer serializer;
-  if (!serializer.LoadFromJson(bb_entry_count_file_path_,
-                               &module_entry_count_map)) {
+  if (!serializer.Load(bb_entry_count_file_path_,
+                        &module_entry_count_map)) {
     LOG(ERROR) << "Failed to load basic-block entry count data";
     return false;
   }
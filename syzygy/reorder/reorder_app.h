@@ -47,7 +47,9 @@ class ReorderApp : public application::AppImplBase {
     kInvalidMode,
     kLinearOrderMode,
     kRandomOrderMode,
-    kDeadCodeFinderMode
+    kDeadCodeFinderMode,
+    kCallGraphOrderMode,
+    kPageFaultOrderMode
   };
   // @name Utility members.
   // @{
@@ -67,8 +69,12 @@ class ReorderApp : public application::AppImplBase {
   base::FilePath input_image_path_;
   base::FilePath output_file_path_;
   base::FilePath bb_entry_count_file_path_;
+  base::FilePath decomposition_cache_dir_;
   FilePathVector trace_file_paths_;
   uint32_t seed_;
+  int search_time_;
+  int search_threads_;
+  int parse_threads_;
   bool pretty_print_;
   Reorderer::Flags flags_;
   // @}
@@ -81,6 +87,12 @@ class ReorderApp : public application::AppImplBase {
   static const char kBasicBlockEntryCounts[];
   static const char kSeed[];
   static const char kListDeadCode[];
+  static const char kCallGraph[];
+  static const char kPageFaults[];
+  static const char kSearchTime[];
+  static const char kSearchThreads[];
+  static const char kParseThreads[];
+  static const char kDecompositionCacheDir[];
   static const char kPrettyPrint[];
   static const char kReordererFlags[];
   static const char kInstrumentedDll[];
@@ -16,6 +16,7 @@
 
 #include <string>
 
+#include "base/files/file_util.h"
 #include "base/strings/stringprintf.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -44,6 +45,8 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kLinearOrderMode;
   using ReorderApp::kRandomOrderMode;
   using ReorderApp::kDeadCodeFinderMode;
+  using ReorderApp::kCallGraphOrderMode;
+  using ReorderApp::kPageFaultOrderMode;
   using ReorderApp::mode_;
   using ReorderApp::instrumented_image_path_;
   using ReorderApp::input_image_path_;
@@ -51,6 +54,10 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::bb_entry_count_file_path_;
   using ReorderApp::trace_file_paths_;
   using ReorderApp::seed_;
+  using ReorderApp::search_time_;
+  using ReorderApp::search_threads_;
+  using ReorderApp::parse_threads_;
+  using ReorderApp::decomposition_cache_dir_;
   using ReorderApp::pretty_print_;
   using ReorderApp::flags_;
   using ReorderApp::kInstrumentedImage;
@@ -59,6 +66,12 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kBasicBlockEntryCounts;
   using ReorderApp::kSeed;
   using ReorderApp::kListDeadCode;
+  using ReorderApp::kCallGraph;
+  using ReorderApp::kPageFaults;
+  using ReorderApp::kSearchTime;
+  using ReorderApp::kSearchThreads;
+  using ReorderApp::kParseThreads;
+  using ReorderApp::kDecompositionCacheDir;
   using ReorderApp::kPrettyPrint;
   using ReorderApp::kReordererFlags;
   using ReorderApp::kInstrumentedDll;
@@ -187,6 +200,44 @@ TEST_F(ReorderAppTest, ParseWithSeedAndListDeadCodeFails) {
   ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(ReorderAppTest, ParseWithCallGraphAndListDeadCodeFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kListDeadCode);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithSearchTimeWithoutPageFaultsFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kSearchTime, "5");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithInvalidSearchThreadsFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaults);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kSearchThreads, "0");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithInvalidParseThreadsFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kParseThreads, "0");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(ReorderAppTest, ParseWithEmptySeedFails) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
@@ -363,6 +414,80 @@ TEST_F(ReorderAppTest, ParseDeadCodeFinderCommandLine) {
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(ReorderAppTest, ParseCallGraphCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kCallGraphOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
+TEST_F(ReorderAppTest, CallGraphOrderEndToEnd) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kInputImage, input_image_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_EQ(0, test_app_.Run());
+}
+
+TEST_F(ReorderAppTest, ParallelOrderEndToEnd) {
+  base::FilePath cache_dir = temp_dir_.Append(L"cache");
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kInputImage, input_image_path_);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kParseThreads, "2");
+  cmd_line_.AppendSwitchPath(TestReorderApp::kDecompositionCacheDir,
+                             cache_dir);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_EQ(0, test_app_.Run());
+  EXPECT_EQ(2, test_impl_.parse_threads_);
+  EXPECT_EQ(cache_dir, test_impl_.decomposition_cache_dir_);
+  EXPECT_TRUE(base::PathExists(cache_dir));
+}
+
+TEST_F(ReorderAppTest, ParsePageFaultsCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaults);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kSearchTime, "5");
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kSearchThreads, "3");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kPageFaultOrderMode, test_impl_.mode_);
+  EXPECT_EQ(5, test_impl_.search_time_);
+  EXPECT_EQ(3, test_impl_.search_threads_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
+TEST_F(ReorderAppTest, PageFaultOrderEndToEnd) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kInputImage, input_image_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaults);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kSearchTime, "1");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_EQ(0, test_app_.Run());
+}
+
 TEST_F(ReorderAppTest, LinearOrderEndToEnd) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
@@ -14,12 +14,16 @@
 
 #include "syzygy/reorder/reorderer.h"
 
+#include <algorithm>
+#include <memory>
+
 #include "base/values.h"
 #include "base/files/file_util.h"
 #include "base/json/json_reader.h"
 #include "base/json/string_escape.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/core/json_file_writer.h"
@@ -349,6 +353,137 @@ bool LoadSectionSpec(const pe::ImageLayout& image,
 
 const size_t Reorderer::Order::SectionSpec::kNewSectionId = ~1U;
 
+class Reorderer::TraceFileEvents
+    : public trace::parser::ParseEventHandlerImpl,
+      public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param reorderer The reorderer, whose playback is initialized.
+  // @param trace_file The trace file to parse.
+  TraceFileEvents(const Reorderer* reorderer,
+                  const base::FilePath& trace_file)
+      : reorderer_(reorderer), trace_file_(trace_file), succeeded_(false) {
+    DCHECK(reorderer_ != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    if (!parser_.Init(this) || !parser_.OpenTraceFile(trace_file_)) {
+      LOG(ERROR) << "Unable to open trace log: " << trace_file_.value();
+      return;
+    }
+    succeeded_ = parser_.Consume() && !parser_.error_occurred();
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const base::FilePath& trace_file() const { return trace_file_; }
+  const ResolvedEventVector& events() const { return events_; }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ protected:
+  // @name ParseEventHandler overrides.
+  // @{
+  void OnProcessStarted(base::Time time,
+                        DWORD process_id,
+                        const TraceSystemInfo* data) override {
+    AddEvent(ResolvedEvent::kProcessStarted, time, process_id, 0, NULL, NULL,
+             0);
+  }
+
+  void OnProcessEnded(base::Time time, DWORD process_id) override {
+    AddEvent(ResolvedEvent::kProcessEnded, time, process_id, 0, NULL, NULL, 0);
+  }
+
+  void OnFunctionEntry(base::Time time,
+                       DWORD process_id,
+                       DWORD thread_id,
+                       const TraceEnterExitEventData* data) override {
+    DCHECK(data != NULL);
+    const BlockGraph::Block* block = NULL;
+    const BlockGraph::Block* caller = NULL;
+    if (!reorderer_->ResolveCall(parser_, process_id, data->function,
+                                 data->retaddr, &block, &caller)) {
+      parser_.set_error_occurred(true);
+      return;
+    }
+    if (block != NULL) {
+      AddEvent(ResolvedEvent::kCodeBlockEntry, time, process_id, thread_id,
+               block, caller, 1);
+    }
+  }
+
+  void OnBatchFunctionEntry(base::Time time,
+                            DWORD process_id,
+                            DWORD thread_id,
+                            const TraceBatchEnterData* data) override {
+    TraceEnterExitEventData new_data = {};
+    for (size_t i = 0; i < data->num_calls; ++i) {
+      new_data.function = data->calls[i].function;
+      new_data.retaddr = data->calls[i].retaddr;
+      OnFunctionEntry(time, process_id, thread_id, &new_data);
+    }
+  }
+
+  void OnInvocationBatch(base::Time time,
+                         DWORD process_id,
+                         DWORD thread_id,
+                         size_t num_invocations,
+                         const TraceBatchInvocationInfo* data) override {
+    DCHECK(data != NULL);
+    for (size_t i = 0; i < num_invocations; ++i) {
+      const InvocationInfo& invocation = data->invocations[i];
+      if ((invocation.flags & (kCallerIsSymbol | kFunctionIsSymbol)) != 0)
+        continue;
+
+      const BlockGraph::Block* block = NULL;
+      const BlockGraph::Block* caller = NULL;
+      if (!reorderer_->ResolveCall(parser_, process_id, invocation.function,
+                                   invocation.caller, &block, &caller)) {
+        parser_.set_error_occurred(true);
+        return;
+      }
+      if (block != NULL) {
+        AddEvent(ResolvedEvent::kCodeBlockCall, time, process_id, thread_id,
+                 block, caller, invocation.num_calls);
+      }
+    }
+  }
+  // @}
+
+ private:
+  void AddEvent(ResolvedEvent::Type type,
+                base::Time time,
+                DWORD process_id,
+                DWORD thread_id,
+                const BlockGraph::Block* block,
+                const BlockGraph::Block* caller,
+                size_t num_calls) {
+    ResolvedEvent event = {type, time, process_id, thread_id, block, caller,
+                           num_calls};
+    events_.push_back(event);
+  }
+
+  // The reorderer, whose playback is shared by all the trace files.
+  const Reorderer* reorderer_;
+
+  // The trace file parsed.
+  base::FilePath trace_file_;
+
+  // The parser of the trace file.
+  Parser parser_;
+
+  // The events of the trace file, in the order in which they were parsed.
+  ResolvedEventVector events_;
+
+  // Whether the trace file was parsed successfully.
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileEvents);
+};
+
 Reorderer::Reorderer(const base::FilePath& module_path,
                      const base::FilePath& instrumented_path,
                      const TraceFileList& trace_files,
@@ -356,6 +491,7 @@ Reorderer::Reorderer(const base::FilePath& module_path,
     : playback_(module_path, instrumented_path, trace_files),
       flags_(flags),
       code_block_entry_events_(0),
+      num_threads_(1),
       order_generator_(NULL) {
 }
 
@@ -395,8 +531,12 @@ bool Reorderer::ReorderImpl(Order* order,
 
   if (playback_.trace_files().size() > 0) {
     LOG(INFO) << "Processing trace events.";
-    if (!parser_.Consume())
+    if (num_threads_ > 1) {
+      if (!ConsumeInParallel())
+        return false;
+    } else if (!parser_.Consume()) {
       return false;
+    }
 
     if (code_block_entry_events_ == 0) {
       LOG(ERROR) << "No events originated from the given instrumented DLL.";
@@ -410,6 +550,89 @@ bool Reorderer::ReorderImpl(Order* order,
   return true;
 }
 
+bool Reorderer::ConsumeInParallel() {
+  DCHECK_LT(1u, num_threads_);
+
+  // The trace files are parsed a batch at a time, so that only the events of
+  // a batch are held in memory. A batch is dispatched in the order of its
+  // trace files once all of them have been parsed.
+  const TraceFileList& trace_files = playback_.trace_files();
+  for (size_t begin = 0; begin < trace_files.size(); begin += num_threads_) {
+    size_t end = std::min(begin + num_threads_, trace_files.size());
+
+    std::vector<std::unique_ptr<TraceFileEvents>> batch;
+    for (size_t i = begin; i < end; ++i) {
+      batch.push_back(std::unique_ptr<TraceFileEvents>(
+          new TraceFileEvents(this, trace_files[i])));
+    }
+
+    base::DelegateSimpleThreadPool pool("Reorderer",
+                                        static_cast<int>(batch.size()));
+    for (size_t i = 0; i < batch.size(); ++i)
+      pool.AddWork(batch[i].get());
+    pool.Start();
+    pool.JoinAll();
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (!batch[i]->succeeded()) {
+        LOG(ERROR) << "Failed to parse " << batch[i]->trace_file().value()
+                   << ".";
+        return false;
+      }
+      const ResolvedEventVector& events = batch[i]->events();
+      for (size_t j = 0; j < events.size(); ++j) {
+        if (!DispatchEvent(events[j]))
+          return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool Reorderer::DispatchEvent(const ResolvedEvent& event) {
+  DCHECK(order_generator_ != NULL);
+
+  // Batched function calls come in with the same time stamp, so we rely on
+  // their relative ordering and UniqueTime's incrementing ID to maintain
+  // relative order.
+  UniqueTime time(event.time);
+
+  switch (event.type) {
+    case ResolvedEvent::kProcessStarted:
+      return order_generator_->OnProcessStarted(event.process_id, time);
+
+    case ResolvedEvent::kProcessEnded:
+      return order_generator_->OnProcessEnded(event.process_id, time);
+
+    case ResolvedEvent::kCodeBlockEntry:
+      DCHECK(event.block != NULL);
+      ++code_block_entry_events_;
+      if (!order_generator_->OnCodeBlockEntry(event.block,
+                                              event.block->addr(),
+                                              event.process_id,
+                                              event.thread_id,
+                                              time)) {
+        LOG(ERROR) << order_generator_->name() << "::OnCodeBlockEntry failed.";
+        return false;
+      }
+      // Fall through, the entry is also a call.
+
+    case ResolvedEvent::kCodeBlockCall:
+      DCHECK(event.block != NULL);
+      if (!order_generator_->OnCodeBlockCall(event.caller, event.block,
+                                             event.process_id,
+                                             event.num_calls)) {
+        LOG(ERROR) << order_generator_->name() << "::OnCodeBlockCall failed.";
+        return false;
+      }
+      return true;
+  }
+
+  NOTREACHED();
+  return false;
+}
+
 bool Reorderer::CalculateReordering(Order* order) {
   DCHECK(order != NULL);
   DCHECK(order_generator_ != NULL);
@@ -430,9 +653,8 @@ bool Reorderer::CalculateReordering(Order* order) {
 
 void Reorderer::OnProcessStarted(
     base::Time time, DWORD process_id, const TraceSystemInfo* data) {
-  UniqueTime entry_time(time);
-
-  if (!order_generator_->OnProcessStarted(process_id, entry_time)) {
+  ResolvedEvent event = {ResolvedEvent::kProcessStarted, time, process_id};
+  if (!DispatchEvent(event)) {
     parser_.set_error_occurred(true);
     return;
   }
@@ -440,7 +662,8 @@ void Reorderer::OnProcessStarted(
 
 void Reorderer::OnProcessEnded(base::Time time, DWORD process_id) {
   // Notify the order generator.
-  if (!order_generator_->OnProcessEnded(process_id, UniqueTime(time))) {
+  ResolvedEvent event = {ResolvedEvent::kProcessEnded, time, process_id};
+  if (!DispatchEvent(event)) {
     parser_.set_error_occurred(true);
     return;
   }
@@ -453,14 +676,10 @@ void Reorderer::OnFunctionEntry(base::Time time,
                                 const TraceEnterExitEventData* data) {
   DCHECK(data != NULL);
 
-  bool error = false;
-  const BlockGraph::Block* block = playback_.FindFunctionBlock(process_id,
-                                                               data->function,
-                                                               &error);
-
-  // Handle the error if any occurred.
-  if (error) {
-    LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+  const BlockGraph::Block* block = NULL;
+  const BlockGraph::Block* caller = NULL;
+  if (!ResolveCall(parser_, process_id, data->function, data->retaddr,
+                   &block, &caller)) {
     parser_.set_error_occurred(true);
     return;
   }
@@ -469,18 +688,9 @@ void Reorderer::OnFunctionEntry(base::Time time,
   if (block == NULL)
     return;
 
-  // Get the time of the call. Since batched function calls come in with the
-  // same time stamp, we rely on their relative ordering and UniqueTime's
-  // incrementing ID to maintain relative order.
-  UniqueTime entry_time(time);
-
-  ++code_block_entry_events_;
-  if (!order_generator_->OnCodeBlockEntry(block,
-                                          block->addr(),
-                                          process_id,
-                                          thread_id,
-                                          entry_time)) {
-    LOG(ERROR) << order_generator_->name() << "::OnCodeBlockEntry failed.";
+  ResolvedEvent event = {ResolvedEvent::kCodeBlockEntry, time, process_id,
+                         thread_id, block, caller, 1};
+  if (!DispatchEvent(event)) {
     parser_.set_error_occurred(true);
     return;
   }
@@ -494,10 +704,88 @@ void Reorderer::OnBatchFunctionEntry(base::Time time,
   TraceEnterExitEventData new_data = {};
   for (size_t i = 0; i < data->num_calls; ++i) {
     new_data.function = data->calls[i].function;
+    new_data.retaddr = data->calls[i].retaddr;
     OnFunctionEntry(time, process_id, thread_id, &new_data);
   }
 }
 
+void Reorderer::OnInvocationBatch(base::Time time,
+                                  DWORD process_id,
+                                  DWORD thread_id,
+                                  size_t num_invocations,
+                                  const TraceBatchInvocationInfo* data) {
+  DCHECK(data != NULL);
+
+  for (size_t i = 0; i < num_invocations; ++i) {
+    // Dynamic symbols aren't in the module being reordered.
+    const InvocationInfo& invocation = data->invocations[i];
+    if ((invocation.flags & (kCallerIsSymbol | kFunctionIsSymbol)) != 0)
+      continue;
+
+    const BlockGraph::Block* block = NULL;
+    const BlockGraph::Block* caller = NULL;
+    if (!ResolveCall(parser_, process_id, invocation.function,
+                     invocation.caller, &block, &caller)) {
+      parser_.set_error_occurred(true);
+      return;
+    }
+    if (block == NULL)
+      continue;
+
+    ResolvedEvent event = {ResolvedEvent::kCodeBlockCall, time, process_id,
+                           thread_id, block, caller, invocation.num_calls};
+    if (!DispatchEvent(event)) {
+      parser_.set_error_occurred(true);
+      return;
+    }
+  }
+}
+
+const Reorderer::BlockGraph::Block* Reorderer::FindCallerBlock(
+    const Parser& parser,
+    DWORD process_id,
+    RetAddr retaddr) const {
+  // The callers outside of the instrumented module aren't resolved, rather
+  // than having FindFunctionBlock report them as errors.
+  const ModuleInformation* module_info = parser.GetModuleInformation(
+      process_id, reinterpret_cast<AbsoluteAddress64>(retaddr));
+  if (module_info == NULL ||
+      !playback_.MatchesInstrumentedModuleSignature(*module_info)) {
+    return NULL;
+  }
+
+  bool error = false;
+  const BlockGraph::Block* block =
+      playback_.FindFunctionBlock(&parser, process_id, retaddr, &error);
+  if (error)
+    return NULL;
+  return block;
+}
+
+bool Reorderer::ResolveCall(const Parser& parser,
+                            DWORD process_id,
+                            FuncAddr function,
+                            RetAddr retaddr,
+                            const BlockGraph::Block** block,
+                            const BlockGraph::Block** caller) const {
+  DCHECK(block != NULL);
+  DCHECK(caller != NULL);
+
+  bool error = false;
+  *block = playback_.FindFunctionBlock(&parser, process_id, function, &error);
+  *caller = NULL;
+
+  // Handle the error if any occurred.
+  if (error) {
+    LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+    return false;
+  }
+
+  if (*block != NULL)
+    *caller = FindCallerBlock(parser, process_id, retaddr);
+  return true;
+}
+
 bool Reorderer::Order::SerializeToJSON(const PEFile& pe,
                                        const base::FilePath &path,
                                        bool pretty_print) const {
@@ -28,6 +28,7 @@
 #include <string>
 #include <vector>
 
+#include "base/logging.h"
 #include "base/win/event_trace_consumer.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/image_layout.h"
@@ -97,8 +98,29 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // @{
   Flags flags() const { return flags_; }
   const Parser& parser() const { return parser_; }
+  size_t num_threads() const { return num_threads_; }
   // @}
 
+  // Sets the number of threads parsing the trace files. With more than one,
+  // each trace file is parsed by a parser of its own, which resolves the
+  // blocks of its events concurrently with the others. The events are then
+  // dispatched to the order generator in the order of the trace files, so
+  // that the ordering is the same as that of a single thread. Defaults to 1.
+  // @param num_threads The number of threads, which is not zero.
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0u, num_threads);
+    num_threads_ = num_threads;
+  }
+
+  // Sets the directory of the decomposition cache of the playback.
+  // @param decomposition_cache_dir The directory of the cache, or an empty
+  //     path to use the one named by the environment, if any. See
+  //     pe::DecompositionCache::Create.
+  void set_decomposition_cache_dir(
+      const base::FilePath& decomposition_cache_dir) {
+    playback_.set_decomposition_cache_dir(decomposition_cache_dir);
+  }
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef core::RelativeAddress RelativeAddress;
@@ -107,9 +129,43 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   typedef trace::parser::ModuleInformation ModuleInformation;
   typedef TraceFileList::iterator TraceFileIter;
 
+  // An event of a trace file, with its blocks resolved.
+  struct ResolvedEvent {
+    enum Type {
+      kProcessStarted,
+      kProcessEnded,
+      // A call to block, from caller, which is also an entry to block.
+      kCodeBlockEntry,
+      // A number of calls to block, from caller.
+      kCodeBlockCall,
+    };
+
+    Type type;
+    base::Time time;
+    DWORD process_id;
+    DWORD thread_id;
+    const BlockGraph::Block* block;
+    const BlockGraph::Block* caller;
+    size_t num_calls;
+  };
+  typedef std::vector<ResolvedEvent> ResolvedEventVector;
+
+  // Parses a trace file on its own into resolved events.
+  class TraceFileEvents;
+
   // The implementation of Reorder.
   bool ReorderImpl(Order* order, PEFile* pe_file, ImageLayout* image);
 
+  // Parses the trace files on num_threads_ threads, dispatching their events
+  // in the order of the trace files.
+  // @returns true on success, false otherwise.
+  bool ConsumeInParallel();
+
+  // Dispatches a resolved event to the order generator.
+  // @param event The event to dispatch.
+  // @returns true on success, false otherwise.
+  bool DispatchEvent(const ResolvedEvent& event);
+
   // Calculates the actual reordering.
   bool CalculateReordering(Order* order);
 
@@ -127,8 +183,40 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
                             DWORD process_id,
                             DWORD thread_id,
                             const TraceBatchEnterData* data) override;
+  void OnInvocationBatch(base::Time time,
+                         DWORD process_id,
+                         DWORD thread_id,
+                         size_t num_invocations,
+                         const TraceBatchInvocationInfo* data) override;
   // @}
 
+  // Finds the code block a call returns to.
+  // @param parser the parser of the trace file holding the call.
+  // @param process_id the process of the call.
+  // @param retaddr the return address of the call.
+  // @returns the block of the caller, or NULL if it isn't in the instrumented
+  //     module or can't be resolved.
+  const BlockGraph::Block* FindCallerBlock(const Parser& parser,
+                                           DWORD process_id,
+                                           RetAddr retaddr) const;
+
+  // Resolves the blocks of a call. This only reads the playback, so it may
+  // be called concurrently with parsers of different trace files.
+  // @param parser the parser of the trace file holding the call.
+  // @param process_id the process of the call.
+  // @param function the function called.
+  // @param retaddr the return address of the call.
+  // @param block receives the block called, or NULL if it isn't in the
+  //     instrumented module.
+  // @param caller receives the block of the caller, or NULL.
+  // @returns false on error.
+  bool ResolveCall(const Parser& parser,
+                   DWORD process_id,
+                   FuncAddr function,
+                   RetAddr retaddr,
+                   const BlockGraph::Block** block,
+                   const BlockGraph::Block** caller) const;
+
   // A playback, which will decompose the image for us.
   Playback playback_;
 
@@ -138,6 +226,9 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // Number of CodeBlockEntry events processed.
   size_t code_block_entry_events_;
 
+  // The number of threads parsing the trace files.
+  size_t num_threads_;
+
   // The following three variables are only valid while Reorder is executing.
   // A pointer to our order generator delegate.
   OrderGenerator* order_generator_;
@@ -334,6 +425,24 @@ class Reorderer::OrderGenerator {
                                 uint32_t thread_id,
                                 const UniqueTime& time) = 0;
 
+  // The derived class may implement this callback, which receives the calls
+  // made to the code blocks of the module being reordered, along with their
+  // callers. These come from the return addresses of TRACE_ENTRY events, and
+  // from the invocations summarized by the profiler. Returns true on success,
+  // false on error. If this returns false, no further callbacks will be
+  // processed.
+  // @param caller the block making the calls, or NULL if it is outside the
+  //     module being reordered.
+  // @param callee the block being called.
+  // @param process_id the process making the calls.
+  // @param num_calls the number of calls.
+  virtual bool OnCodeBlockCall(const BlockGraph::Block* caller,
+                               const BlockGraph::Block* callee,
+                               uint32_t process_id,
+                               size_t num_calls) {
+    return true;
+  }
+
   // The derived class shall implement this function, which actually produces
   // the reordering. When this is called, the callee can be assured that the
   // ImageLayout is populated and all traces have been parsed. This must
@@ -16,6 +16,9 @@
 
 #include <psapi.h>
 
+#include <algorithm>
+#include <utility>
+
 #include "base/bind.h"
 #include "base/files/file_util.h"
 #include "base/strings/string_number_conversions.h"
@@ -65,7 +68,15 @@ const char kUsageFormatStr[] =
     "                        setting. Not all sampling intervals are\n"
     "                        available on all systems so the closest value\n"
     "                        available will be used. The actual sampling\n"
-    "                        interval used will be reported.\n"
+    "                        interval used will be reported. Intervals\n"
+    "                        below a millisecond are honored where the\n"
+    "                        system supports them.\n"
+    "  --snapshot-interval=INTERVAL\n"
+    "                        Periodically appends the samples gathered\n"
+    "                        since the previous snapshot to the trace files,\n"
+    "                        rather than only writing them once a module\n"
+    "                        stops being profiled. This is a floating point\n"
+    "                        value in seconds.\n"
     "  --output-dir=DIR      Specifies the output directory into which trace\n"
     "                        files will be written.\n"
     "\n";
@@ -104,39 +115,38 @@ bool ParseBucketSize(const base::CommandLine* command_line,
   return true;
 }
 
-// Parses the sampling interval. Leaves the value unchanged if it is not
+// Parses an interval in seconds. Leaves the value unchanged if it is not
 // specified.
-bool ParseSamplingInterval(const base::CommandLine* command_line,
-                           base::TimeDelta* sampling_interval) {
+bool ParseInterval(const base::CommandLine* command_line,
+                   const char* switch_name,
+                   base::TimeDelta* interval) {
   DCHECK(command_line != NULL);
-  DCHECK(sampling_interval != NULL);
+  DCHECK(switch_name != NULL);
+  DCHECK(interval != NULL);
 
-  if (!command_line->HasSwitch(SamplerApp::kSamplingInterval))
+  if (!command_line->HasSwitch(switch_name))
     return true;
 
-  std::string s = command_line->GetSwitchValueASCII(
-      SamplerApp::kSamplingInterval);
+  std::string s = command_line->GetSwitchValueASCII(switch_name);
   double d = 0;
   if (!base::StringToDouble(s, &d)) {
-    LOG(ERROR) << "--" << SamplerApp::kSamplingInterval << " must be a double.";
+    LOG(ERROR) << "--" << switch_name << " must be a double.";
     return false;
   }
   if (d <= 0) {
-    LOG(ERROR) << "-- " << SamplerApp::kSamplingInterval
-               << " must be positive.";
+    LOG(ERROR) << "-- " << switch_name << " must be positive.";
     return false;
   }
 
   int64_t us = static_cast<int64_t>(1000000 * d);
   if (us <= 0) {
-    LOG(ERROR) << "--" << SamplerApp::kSamplingInterval
-               << " must be at least 1us.";
+    LOG(ERROR) << "--" << switch_name << " must be at least 1us.";
     return false;
   }
 
   // TimeDelta has its finest resolution in microseconds, so we convert to
   // that.
-  *sampling_interval = base::TimeDelta::FromMicroseconds(us);
+  *interval = base::TimeDelta::FromMicroseconds(us);
   return true;
 }
 
@@ -525,16 +535,20 @@ bool WriteTraceModuleDataRecord(const SampledModuleCache::Module* module,
   return true;
 }
 
-// Converts the sample data in |module| to a TraceSampleData buffer and outputs
-// it to the provided TraceFileWriter.
+// Converts |samples|, the samples gathered by |module| from |start_time| to
+// |end_time|, to a TraceSampleData buffer and outputs it to the provided
+// TraceFileWriter.
 bool WriteTraceSampleDataRecord(uint64_t sampling_interval_in_cycles,
                                 const SampledModuleCache::Module* module,
+                                const std::vector<ULONG>& samples,
+                                uint64_t start_time,
+                                uint64_t end_time,
                                 TraceFileWriter* writer) {
   DCHECK(module != NULL);
   DCHECK(writer != NULL);
 
-  const ULONG* buckets = module->profiler().buckets().data();
-  size_t bucket_count = module->profiler().buckets().size();
+  const ULONG* buckets = samples.data();
+  size_t bucket_count = samples.size();
   DCHECK_LT(0u, bucket_count);
 
   // Calculate the size of the buffer required to store the samples.
@@ -555,8 +569,8 @@ bool WriteTraceSampleDataRecord(uint64_t sampling_interval_in_cycles,
   data->bucket_size = 1 << module->log2_bucket_size();
   data->bucket_start = reinterpret_cast<ModuleAddr>(module->buckets_begin());
   data->bucket_count = bucket_count;
-  data->sampling_start_time = module->profiling_start_time();
-  data->sampling_end_time = module->profiling_stop_time();
+  data->sampling_start_time = start_time;
+  data->sampling_end_time = end_time;
   data->sampling_interval = sampling_interval_in_cycles;
 
   // Copy the samples into the buffer.
@@ -574,6 +588,7 @@ const char SamplerApp::kBlacklistPids[] = "blacklist-pids";
 const char SamplerApp::kBucketSize[] = "bucket-size";
 const char SamplerApp::kPids[] = "pids";
 const char SamplerApp::kSamplingInterval[] = "sampling-interval";
+const char SamplerApp::kSnapshotInterval[] = "snapshot-interval";
 const char SamplerApp::kOutputDir[] = "output-dir";
 
 const size_t SamplerApp::kDefaultLog2BucketSize = 2;
@@ -586,6 +601,7 @@ SamplerApp::SamplerApp()
       blacklist_pids_(true),
       log2_bucket_size_(kDefaultLog2BucketSize),
       sampling_interval_(),
+      snapshot_interval_(),
       running_(true),
       sampling_interval_in_cycles_(0) {
 }
@@ -601,7 +617,8 @@ bool SamplerApp::ParseCommandLine(const base::CommandLine* command_line) {
 
   // Parse the profiler parameters.
   if (!ParseBucketSize(command_line, &log2_bucket_size_) ||
-      !ParseSamplingInterval(command_line, &sampling_interval_)) {
+      !ParseInterval(command_line, kSamplingInterval, &sampling_interval_) ||
+      !ParseInterval(command_line, kSnapshotInterval, &snapshot_interval_)) {
     return PrintUsage(command_line->GetProgram(), "");
   }
 
@@ -702,6 +719,16 @@ int SamplerApp::RunImpl() {
   size_t process_count = 0;
   size_t module_count = 0;
 
+  // We poll every second so as not to consume too much CPU time, but to not
+  // get caught too easily by PID reuse. Snapshots may require polling more
+  // often.
+  int64_t poll_interval_ms = 1000;
+  if (!snapshot_interval_.is_zero()) {
+    poll_interval_ms = std::max<int64_t>(
+        1, std::min(poll_interval_ms, snapshot_interval_.InMilliseconds()));
+  }
+  base::TimeTicks next_snapshot = base::TimeTicks::Now() + snapshot_interval_;
+
   // Sit in a loop, actively monitoring running processes.
   while (running()) {
     // Mark all profiling module as dead. If they aren't remarked as alive after
@@ -759,6 +786,16 @@ int SamplerApp::RunImpl() {
     // Remove any profiled modules that are 'dead'. This invokes the callback
     // and causes the profile information to be written to a trace file.
     cache.RemoveDeadModules();
+    CloseDeadProcessTraces(cache);
+
+    // Write out the samples gathered since the previous snapshot.
+    if (!snapshot_interval_.is_zero()) {
+      base::TimeTicks now = base::TimeTicks::Now();
+      if (now >= next_snapshot) {
+        WriteSnapshots(cache);
+        next_snapshot = now + snapshot_interval_;
+      }
+    }
 
     // Count the number of actively profiled modules and processes.
     size_t new_process_count = cache.processes().size();
@@ -778,15 +815,14 @@ int SamplerApp::RunImpl() {
     // Update our list of filtered PIDs.
     pids_ = filtered_pids;
 
-    // We poll every second so as not to consume too much CPU time, but to not
-    // get caught too easily by PID reuse.
-    ::Sleep(1000);
+    ::Sleep(static_cast<DWORD>(poll_interval_ms));
   }
 
   // Mark all modules as dead and remove them. This will clean up any in
   // progress profiling data.
   cache.MarkAllModulesDead();
   cache.RemoveDeadModules();
+  CloseDeadProcessTraces(cache);
 
   return 0;
 }
@@ -834,36 +870,116 @@ void SamplerApp::OnDeadModule(const SampledModuleCache::Module* module) {
   // Invoke our testing seam callback.
   OnStopProfiling(module);
 
-  const SampledModuleCache::Process* process = module->process();
-  DCHECK(process != NULL);
+  // Write out the samples gathered since the last snapshot. The module is
+  // about to be destroyed, so its snapshot is forgotten.
+  WriteModuleSnapshot(module, module->profiling_stop_time(), true);
+  ProcessTraceMap::iterator it = process_traces_.find(module->process());
+  if (it != process_traces_.end())
+    it->second->modules.erase(module);
+}
 
-  base::FilePath basename = TraceFileWriter::GenerateTraceFileBaseName(
-          process->process_info());
-  base::FilePath trace_file_path = output_dir_.Append(basename);
+void SamplerApp::WriteSnapshots(const SampledModuleCache& cache) {
+  uint64_t end_time = trace::common::GetTsc();
+  SampledModuleCache::ProcessMap::const_iterator proc_it =
+      cache.processes().begin();
+  for (; proc_it != cache.processes().end(); ++proc_it) {
+    const SampledModuleCache::Process::ModuleMap& modules =
+        proc_it->second->modules();
+    SampledModuleCache::Process::ModuleMap::const_iterator mod_it =
+        modules.begin();
+    for (; mod_it != modules.end(); ++mod_it)
+      WriteModuleSnapshot(mod_it->second, end_time, false);
+  }
+}
 
-  LOG(INFO) << "Writing module samples to \"" << trace_file_path.value()
-            << "\".";
+bool SamplerApp::WriteModuleSnapshot(const SampledModuleCache::Module* module,
+                                     uint64_t end_time,
+                                     bool write_empty) {
+  DCHECK(module != NULL);
+
+  const SampledModuleCache::Process* process = module->process();
+  DCHECK(process != NULL);
 
-  // TODO(chrisha): If we deal with processes with multiple profiled modules
-  //     or repeatedly loaded and unloaded modules, we could persist a trace
-  //     file writer for each process and use it repeatedly.
+  // Open the trace file of the process the first time it has samples to
+  // write.
+  ProcessTraceMap::iterator trace_it = process_traces_.find(process);
+  if (trace_it == process_traces_.end()) {
+    base::FilePath basename = TraceFileWriter::GenerateTraceFileBaseName(
+        process->process_info());
+    base::FilePath trace_file_path = output_dir_.Append(basename);
 
-  TraceFileWriter writer;
-  if (!writer.Open(trace_file_path))
-    return;
+    LOG(INFO) << "Writing module samples to \"" << trace_file_path.value()
+              << "\".";
 
-  if (!writer.WriteHeader(process->process_info()))
-    return;
+    std::unique_ptr<ProcessTrace> process_trace(new ProcessTrace());
+    if (!process_trace->writer.Open(trace_file_path))
+      return false;
+    if (!process_trace->writer.WriteHeader(process->process_info()))
+      return false;
 
-  if (!WriteTraceModuleDataRecord(module, &writer))
-    return;
+    trace_it = process_traces_.insert(
+        std::make_pair(process, std::move(process_trace))).first;
+  }
+  ProcessTrace* process_trace = trace_it->second.get();
+
+  // A module is tied to the module on disk the first time its samples are
+  // written.
+  const std::vector<ULONG>& buckets = module->profiler().buckets();
+  ModuleSnapshotMap::iterator snapshot_it = process_trace->modules.find(module);
+  if (snapshot_it == process_trace->modules.end()) {
+    if (!WriteTraceModuleDataRecord(module, &process_trace->writer))
+      return false;
+    ModuleSnapshot snapshot;
+    snapshot.buckets.resize(buckets.size(), 0);
+    snapshot.time = module->profiling_start_time();
+    snapshot_it = process_trace->modules.insert(
+        std::make_pair(module, snapshot)).first;
+  }
+  ModuleSnapshot* snapshot = &snapshot_it->second;
+  DCHECK_EQ(buckets.size(), snapshot->buckets.size());
+
+  // The counters are unsigned so the deltas are correct even if they wrap
+  // between snapshots.
+  std::vector<ULONG> samples(buckets.size());
+  bool empty = true;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    samples[i] = buckets[i] - snapshot->buckets[i];
+    if (samples[i] != 0)
+      empty = false;
+  }
+  if (empty && !write_empty)
+    return true;
 
   if (!WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module,
-                                  &writer)) {
-    return;
+                                  samples, snapshot->time, end_time,
+                                  &process_trace->writer)) {
+    return false;
   }
 
-  return;
+  snapshot->buckets = buckets;
+  snapshot->time = end_time;
+  return true;
+}
+
+void SamplerApp::CloseDeadProcessTraces(const SampledModuleCache& cache) {
+  // The processes that are removed from the cache are destroyed, so their
+  // trace files are closed before any new process is added.
+  std::set<const SampledModuleCache::Process*> processes;
+  SampledModuleCache::ProcessMap::const_iterator proc_it =
+      cache.processes().begin();
+  for (; proc_it != cache.processes().end(); ++proc_it)
+    processes.insert(proc_it->second);
+
+  ProcessTraceMap::iterator it = process_traces_.begin();
+  while (it != process_traces_.end()) {
+    if (processes.count(it->first) != 0) {
+      ++it;
+      continue;
+    }
+    if (!it->second->writer.Close())
+      LOG(ERROR) << "Failed to close trace file.";
+    it = process_traces_.erase(it);
+  }
 }
 
 bool SamplerApp::GetModuleSignature(
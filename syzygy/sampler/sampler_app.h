@@ -18,18 +18,26 @@
 #ifndef SYZYGY_SAMPLER_SAMPLER_APP_H_
 #define SYZYGY_SAMPLER_SAMPLER_APP_H_
 
+#include <map>
+#include <memory>
 #include <set>
+#include <vector>
 
 #include "base/files/file_path.h"
 #include "base/time/time.h"
 #include "syzygy/application/application.h"
 #include "syzygy/sampler/sampled_module_cache.h"
+#include "syzygy/trace/service/trace_file_writer.h"
 
 namespace sampler {
 
 // The application class that takes care of running a profiling sampler. This
 // works by polling running processes and attaching a SamplingProfiler instance
 // to every module of interest. The output is then shuttled to trace data files.
+// Each profiled process has a single trace file, kept open while any of its
+// modules is profiled. If a snapshot interval is specified the samples
+// gathered since the previous snapshot are periodically appended to it, so
+// that the sample data records of a module add up to its whole profile.
 class SamplerApp : public application::AppImplBase {
  public:
   SamplerApp();
@@ -47,6 +55,7 @@ class SamplerApp : public application::AppImplBase {
   static const char kBucketSize[];
   static const char kPids[];
   static const char kSamplingInterval[];
+  static const char kSnapshotInterval[];
   static const char kOutputDir[];
   // @}
 
@@ -87,6 +96,26 @@ class SamplerApp : public application::AppImplBase {
   // @param module The module that has just finished profiling.
   void OnDeadModule(const SampledModuleCache::Module* module);
 
+  // Writes the samples gathered by every profiled module since its previous
+  // snapshot.
+  // @param cache The cache of profiled modules.
+  void WriteSnapshots(const SampledModuleCache& cache);
+
+  // Writes the samples gathered by a module since its previous snapshot to
+  // the trace file of its process, opening it if necessary.
+  // @param module The profiled module.
+  // @param end_time The time of the snapshot.
+  // @param write_empty If false then no record is written if no samples were
+  //     gathered since the previous snapshot.
+  // @returns true on success, false otherwise.
+  bool WriteModuleSnapshot(const SampledModuleCache::Module* module,
+                           uint64_t end_time,
+                           bool write_empty);
+
+  // Closes the trace files of the processes that are no longer profiled.
+  // @param cache The cache of profiled modules.
+  void CloseDeadProcessTraces(const SampledModuleCache& cache);
+
   // Initializes a ModuleSignature given a path. Logs an error on failure.
   // @param module The path to the module.
   // @param sig The signature object to be initialized.
@@ -118,6 +147,10 @@ class SamplerApp : public application::AppImplBase {
   size_t log2_bucket_size_;
   base::TimeDelta sampling_interval_;
 
+  // The interval at which the samples gathered so far are written out. Zero
+  // if they are only written once a module has finished profiling.
+  base::TimeDelta snapshot_interval_;
+
   // The output directory where trace files will be written.
   base::FilePath output_dir_;
 
@@ -135,6 +168,25 @@ class SamplerApp : public application::AppImplBase {
   uint64_t sampling_interval_in_cycles_;
   // @}
 
+  // The samples of a profiled module that have already been written out, and
+  // the time at which they were.
+  struct ModuleSnapshot {
+    std::vector<ULONG> buckets;
+    uint64_t time;
+  };
+  typedef std::map<const SampledModuleCache::Module*, ModuleSnapshot>
+      ModuleSnapshotMap;
+
+  // The trace file of a profiled process, and the snapshots of the modules
+  // that have been written to it.
+  struct ProcessTrace {
+    trace::service::TraceFileWriter writer;
+    ModuleSnapshotMap modules;
+  };
+  typedef std::map<const SampledModuleCache::Process*,
+                   std::unique_ptr<ProcessTrace>> ProcessTraceMap;
+  ProcessTraceMap process_traces_;
+
   // Only one instance of this class can register for console control messages,
   // on a first-come first-serve basis.
   static base::Lock console_ctrl_lock_;
@@ -60,6 +60,7 @@ class TestSamplerApp : public SamplerApp {
   using SamplerApp::module_sigs_;
   using SamplerApp::log2_bucket_size_;
   using SamplerApp::sampling_interval_;
+  using SamplerApp::snapshot_interval_;
   using SamplerApp::running_;
 
   void WaitUntilStartProfiling() {
@@ -356,6 +357,22 @@ TEST_F(SamplerAppTest, ParseValidSamplingIntervalScientific) {
   EXPECT_TRUE(impl_.output_dir_.empty());
 }
 
+TEST_F(SamplerAppTest, ParseInvalidSnapshotIntervalFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kSnapshotInterval, "-1");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseValidSnapshotInterval) {
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(impl_.snapshot_interval_.is_zero());
+
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kSnapshotInterval, "0.5");
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(500), impl_.snapshot_interval_);
+}
+
 TEST_F(SamplerAppTest, ParseOutputDir) {
   cmd_line_.AppendSwitchASCII(TestSamplerApp::kOutputDir, "foo");
   cmd_line_.AppendArgPath(test_dll_path);
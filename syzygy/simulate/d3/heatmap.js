@@ -139,12 +139,13 @@ heatmap.LoadData_ = function(json) {
     heatmap.total_[i] = 0;
   }
 
-  // Copy the json data to those elements.
+  // Add the json data to those elements. A streamed heat map may have
+  // several entries with the same timestamp, which are added together.
   for (var i in json['time_slice_list']) {
     var time_slice = json['time_slice_list'][i];
     var timestamp = time_slice['timestamp'];
 
-    heatmap.total_[timestamp] = time_slice['total_memory_slices'];
+    heatmap.total_[timestamp] += time_slice['total_memory_slices'];
 
     if (timestamp >= max_time_slice)
       continue;
@@ -156,13 +157,41 @@ heatmap.LoadData_ = function(json) {
       if (slice_id >= max_memory_slice)
         continue;
 
-      heatmap.data_[slice_id][timestamp]['value'] = memory_slice['quantity'];
-      heatmap.data_[slice_id][timestamp]['functions'] =
-          memory_slice['functions'];
+      var data = heatmap.data_[slice_id][timestamp];
+      data['value'] += memory_slice['quantity'];
+      if (memory_slice['functions'] != undefined) {
+        data['functions'] = heatmap.MergeFunctions_(data['functions'],
+                                                    memory_slice['functions']);
+      }
     }
   }
 };
 
+/**
+ * Add two lists of functions together, sorted by descending quantity.
+ * @param {Array} functions The functions of an element of heatmap.data_.
+ * @param {Array} other_functions The functions to add to them.
+ * @return {Array} The merged list of functions.
+ * @private
+ */
+heatmap.MergeFunctions_ = function(functions, other_functions) {
+  if (functions.length == 0)
+    return other_functions;
+
+  var quantities = {};
+  var all_functions = functions.concat(other_functions);
+  for (var i = 0; i < all_functions.length; i++) {
+    var name = all_functions[i]['name'];
+    quantities[name] = (quantities[name] || 0) + all_functions[i]['quantity'];
+  }
+
+  var merged = [];
+  for (var name in quantities)
+    merged.push({name: name, quantity: quantities[name]});
+  merged.sort(function(a, b) { return b['quantity'] - a['quantity']; });
+  return merged;
+};
+
 /**
  * Draw the heat map with the given data.
  * @private
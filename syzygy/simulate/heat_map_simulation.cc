@@ -15,6 +15,7 @@
 #include "syzygy/simulate/heat_map_simulation.h"
 
 #include <functional>
+#include <limits>
 
 namespace simulate {
 
@@ -23,7 +24,24 @@ HeatMapSimulation::HeatMapSimulation()
       memory_slice_bytes_(kDefaultMemorySliceSize),
       max_time_slice_usecs_(0),
       max_memory_slice_bytes_(0),
-      output_individual_functions_(false) {
+      output_individual_functions_(false),
+      stream_output_(NULL),
+      stream_failed_(false) {
+}
+
+void HeatMapSimulation::TimeSlice::Merge(const TimeSlice& other) {
+  MemorySliceMap::const_iterator slices_iter = other.slices_.begin();
+  for (; slices_iter != other.slices_.end(); ++slices_iter) {
+    MemorySlice& slice = slices_[slices_iter->first];
+    FunctionMap::const_iterator functions_iter =
+        slices_iter->second.functions.begin();
+    for (; functions_iter != slices_iter->second.functions.end();
+         ++functions_iter) {
+      slice.functions[functions_iter->first] += functions_iter->second;
+    }
+    slice.total += slices_iter->second.total;
+  }
+  total_ += other.total_;
 }
 
 bool HeatMapSimulation::TimeSlice::PrintJSONFunctions(
@@ -62,10 +80,112 @@ bool HeatMapSimulation::TimeSlice::PrintJSONFunctions(
   return true;
 }
 
-bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
-  typedef TimeSlice::FunctionMap FunctionMap;
+bool HeatMapSimulation::SerializeTimeSlice(core::JSONFileWriter* json_file,
+                                           TimeSliceId time,
+                                           const TimeSlice& time_slice) const {
+  DCHECK(json_file != NULL);
+
+  if (!json_file->OpenDict() ||
+      !json_file->OutputKey("timestamp") ||
+      !json_file->OutputInteger(time) ||
+      !json_file->OutputKey("total_memory_slices") ||
+      !json_file->OutputInteger(time_slice.total()) ||
+      !json_file->OutputKey("memory_slice_list") ||
+      !json_file->OpenList()) {
+    return false;
+  }
+
+  TimeSlice::MemorySliceMap::const_iterator slices_iter =
+      time_slice.slices().begin();
+
+  for (; slices_iter != time_slice.slices().end(); ++slices_iter) {
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("memory_slice") ||
+        !json_file->OutputInteger(slices_iter->first) ||
+        !json_file->OutputKey("quantity") ||
+        !json_file->OutputInteger(slices_iter->second.total))
+      return false;
+
+    if (output_individual_functions_) {
+      if (!TimeSlice::PrintJSONFunctions(*json_file,
+                                         slices_iter->second.functions))
+        return false;
+    }
+
+    if (!json_file->CloseDict())
+      return false;
+  }
 
+  if (!json_file->CloseList() ||
+      !json_file->CloseDict())
+    return false;
+
+  return true;
+}
+
+bool HeatMapSimulation::StartStreaming(FILE* output, bool pretty_print) {
   DCHECK(output != NULL);
+  DCHECK(!streaming());
+  DCHECK(time_memory_map_.empty());
+
+  stream_writer_.reset(new core::JSONFileWriter(output, pretty_print));
+  stream_output_ = output;
+  stream_failed_ = false;
+
+  // The maximum slices aren't known yet, so they are written at the end.
+  if (!stream_writer_->OpenDict() ||
+      !stream_writer_->OutputKey("time_slice_usecs") ||
+      !stream_writer_->OutputInteger(time_slice_usecs_) ||
+      !stream_writer_->OutputKey("memory_slice_bytes") ||
+      !stream_writer_->OutputInteger(memory_slice_bytes_) ||
+      !stream_writer_->OutputKey("time_slice_list") ||
+      !stream_writer_->OpenList()) {
+    stream_failed_ = true;
+    return false;
+  }
+
+  return true;
+}
+
+void HeatMapSimulation::StreamTimeSlicesBefore(TimeSliceId end) {
+  DCHECK(streaming());
+
+  while (!time_memory_map_.empty() &&
+         time_memory_map_.begin()->first < end) {
+    TimeMemoryMap::iterator time_memory_iter = time_memory_map_.begin();
+    if (!stream_failed_ &&
+        !SerializeTimeSlice(stream_writer_.get(), time_memory_iter->first,
+                            time_memory_iter->second)) {
+      LOG(ERROR) << "Unable to write a time slice.";
+      stream_failed_ = true;
+    }
+    time_memory_map_.erase(time_memory_iter);
+  }
+}
+
+bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
+  DCHECK(output != NULL);
+
+  if (streaming()) {
+    DCHECK_EQ(stream_output_, output);
+    StreamTimeSlicesBefore(std::numeric_limits<TimeSliceId>::max());
+    if (stream_failed_)
+      return false;
+
+    if (!stream_writer_->CloseList() ||
+        !stream_writer_->OutputKey("max_time_slice_usecs") ||
+        !stream_writer_->OutputInteger(max_time_slice_usecs_) ||
+        !stream_writer_->OutputKey("max_memory_slice_bytes") ||
+        !stream_writer_->OutputInteger(max_memory_slice_bytes_) ||
+        !stream_writer_->CloseDict()) {
+      return false;
+    }
+
+    bool finished = stream_writer_->Finished();
+    stream_writer_.reset();
+    stream_output_ = NULL;
+    return finished;
+  }
 
   core::JSONFileWriter json_file(output, pretty_print);
 
@@ -85,44 +205,10 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
 
   TimeMemoryMap::const_iterator time_memory_iter = time_memory_map_.begin();
   for (; time_memory_iter != time_memory_map_.end(); ++time_memory_iter) {
-    time_t time = time_memory_iter->first;
-    uint32_t total = time_memory_iter->second.total();
-    const TimeSlice& time_slice = time_memory_iter->second;
-
-    if (!json_file.OpenDict() ||
-        !json_file.OutputKey("timestamp") ||
-        !json_file.OutputInteger(time) ||
-        !json_file.OutputKey("total_memory_slices") ||
-        !json_file.OutputInteger(total) ||
-        !json_file.OutputKey("memory_slice_list") ||
-        !json_file.OpenList()) {
+    if (!SerializeTimeSlice(&json_file, time_memory_iter->first,
+                            time_memory_iter->second)) {
       return false;
     }
-
-    TimeSlice::MemorySliceMap::const_iterator slices_iter =
-        time_slice.slices().begin();
-
-    for (; slices_iter != time_slice.slices().end(); ++slices_iter) {
-      if (!json_file.OpenDict() ||
-          !json_file.OutputKey("memory_slice") ||
-          !json_file.OutputInteger(slices_iter->first) ||
-          !json_file.OutputKey("quantity") ||
-          !json_file.OutputInteger(slices_iter->second.total))
-        return false;
-
-      if (output_individual_functions_) {
-        if (!TimeSlice::PrintJSONFunctions(json_file,
-                                           slices_iter->second.functions))
-          return false;
-      }
-
-      if (!json_file.CloseDict())
-        return false;
-    }
-
-    if (!json_file.CloseList() ||
-        !json_file.CloseDict())
-      return false;
   }
 
   if (!json_file.CloseList() ||
@@ -132,8 +218,44 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
   return json_file.Finished();
 }
 
+SimulationEventHandler* HeatMapSimulation::CreatePartition() const {
+  HeatMapSimulation* partition = new HeatMapSimulation();
+  partition->time_slice_usecs_ = time_slice_usecs_;
+  partition->memory_slice_bytes_ = memory_slice_bytes_;
+  partition->output_individual_functions_ = output_individual_functions_;
+  return partition;
+}
+
+void HeatMapSimulation::MergePartition(
+    const SimulationEventHandler& partition) {
+  const HeatMapSimulation& other =
+      static_cast<const HeatMapSimulation&>(partition);
+  DCHECK_EQ(time_slice_usecs_, other.time_slice_usecs_);
+  DCHECK_EQ(memory_slice_bytes_, other.memory_slice_bytes_);
+
+  TimeMemoryMap::const_iterator time_memory_iter =
+      other.time_memory_map_.begin();
+  for (; time_memory_iter != other.time_memory_map_.end();
+       ++time_memory_iter) {
+    time_memory_map_[time_memory_iter->first].Merge(time_memory_iter->second);
+  }
+
+  max_time_slice_usecs_ =
+      std::max(max_time_slice_usecs_, other.max_time_slice_usecs_);
+  max_memory_slice_bytes_ =
+      std::max(max_memory_slice_bytes_, other.max_memory_slice_bytes_);
+
+  if (streaming())
+    StreamTimeSlicesBefore(std::numeric_limits<TimeSliceId>::max());
+}
+
 void HeatMapSimulation::OnProcessStarted(base::Time time,
                                          size_t /*default_page_size*/) {
+  // The times of a new process start over, so the time slices of the
+  // previous one are done with.
+  if (streaming())
+    StreamTimeSlicesBefore(std::numeric_limits<TimeSliceId>::max());
+
   // Set the entry time of this process.
   process_start_time_ = time;
 }
@@ -149,6 +271,15 @@ void HeatMapSimulation::OnFunctionEntry(base::Time time,
   // every time it gets called and the time complexity gets reduced
   // in a logarithmic scale.
   TimeSliceId time_slice = relative_time / time_slice_usecs_;
+
+  // Write out the time slices that the trace clock is well past.
+  if (streaming()) {
+    TimeSliceId lag = std::max<TimeSliceId>(
+        1, kStreamingLagUsecs / time_slice_usecs_);
+    if (time_slice > lag)
+      StreamTimeSlicesBefore(time_slice - lag);
+  }
+
   TimeSlice& slice = time_memory_map_[time_slice];
 
   max_time_slice_usecs_ = std::max(max_time_slice_usecs_, time_slice);
@@ -19,6 +19,7 @@
 #define SYZYGY_SIMULATE_HEAT_MAP_SIMULATION_H_
 
 #include <map>
+#include <memory>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/core/json_file_writer.h"
@@ -44,6 +45,21 @@ namespace simulate {
 //
 // If the time slice size or the memory slice size are not set, the default
 // values of 1 and 0x8000, respectively, are used.
+//
+// By default, all the time slices are kept in memory until SerializeToJSON
+// is called. For long traces, StartStreaming can be called before the first
+// event instead, so that each time slice is written out and freed once the
+// trace clock is kStreamingLagUsecs past it, and memory stays flat however
+// long the trace is:
+//
+// simulation.StartStreaming(file, pretty_print);
+// simulation.OnProcessStarted(time, 0);
+// simulation.OnFunctionEntry(times[0], 0, 5);
+// simulation.SerializeToJSON(file, pretty_print);
+//
+// An event that comes later than that, or that belongs to another process,
+// is written as another entry with the same timestamp, which the d3
+// visualizer adds to the first one.
 class HeatMapSimulation : public SimulationEventHandler {
  public:
   class TimeSlice;
@@ -57,6 +73,12 @@ class HeatMapSimulation : public SimulationEventHandler {
   static const uint32_t kDefaultTimeSliceSize = 1;
   static const uint32_t kDefaultMemorySliceSize = 0x8000;
 
+  // When streaming, how far past a time slice the trace clock has to be
+  // before the time slice is written out, in microseconds. The events of the
+  // different threads of a trace file are not strictly in order, so this
+  // keeps them from being split into several entries.
+  static const uint32_t kStreamingLagUsecs = 1000;
+
   // Construct a new HeatMapSimulation instance.
   HeatMapSimulation();
 
@@ -69,6 +91,7 @@ class HeatMapSimulation : public SimulationEventHandler {
   MemorySliceId max_memory_slice_bytes() const {
     return max_memory_slice_bytes_;
   }
+  bool streaming() const { return stream_writer_.get() != NULL; }
   // @}
 
   // @name Mutators.
@@ -94,9 +117,19 @@ class HeatMapSimulation : public SimulationEventHandler {
   }
   // @}
 
+  // Starts writing the time slices to @p output as the trace goes, rather
+  // than keeping them until SerializeToJSON is called. The slice sizes must
+  // be set before this is called.
+  // @param output the file to be written to. It must stay open until
+  //     SerializeToJSON is called.
+  // @param pretty_print enables or disables pretty printing.
+  // @returns true on success, false on failure.
+  bool StartStreaming(FILE* output, bool pretty_print);
+
   // @name SimulationEventHandler implementation
   // @{
-  // Sets the entry time of the trace file.
+  // Sets the entry time of the trace file. When streaming, the time slices
+  // of the previous process are written out.
   // @param time The startup time of the execution.
   void OnProcessStarted(base::Time time, size_t default_page_size) override;
 
@@ -171,13 +204,42 @@ class HeatMapSimulation : public SimulationEventHandler {
   //     }
   //   ]
   // }
+  //
+  // When streaming, the time slices that are still held are written out and
+  // the output started by StartStreaming is completed: @p output must then
+  // be the file given to StartStreaming, and @p pretty_print is ignored. The
+  // same keys are written, with max_time_slice_usecs and
+  // max_memory_slice_bytes after the time_slice_list.
   // @param output the file to be written to.
   // @param pretty_print enables or disables pretty printing.
   // @returns true on success, false on failure.
   bool SerializeToJSON(FILE* output, bool pretty_print);
+
+  // Creates a simulation with the same time and memory slice sizes.
+  SimulationEventHandler* CreatePartition() const override;
+
+  // Adds the memory slices of a partition to this simulation. The times are
+  // relative to the start of each process, so the merged heat map is the
+  // same as that of a single simulation of all the trace files. When
+  // streaming, the merged time slices are written out right away, so that
+  // only the partitions being simulated are held in memory.
+  void MergePartition(const SimulationEventHandler& partition) override;
   // @}
 
  protected:
+  // Writes a time slice to a JSON file.
+  // @param json_file the file to be written to.
+  // @param time the time slice ID.
+  // @param time_slice the time slice.
+  // @returns true on success, false on failure.
+  bool SerializeTimeSlice(core::JSONFileWriter* json_file,
+                          TimeSliceId time,
+                          const TimeSlice& time_slice) const;
+
+  // When streaming, writes out and frees the time slices before a given one.
+  // @param end the first time slice to keep.
+  void StreamTimeSlicesBefore(TimeSliceId end);
+
   // The size of each time block on the heat map, in microseconds.
   uint32_t time_slice_usecs_;
 
@@ -201,6 +263,15 @@ class HeatMapSimulation : public SimulationEventHandler {
   // in each time/memory block. This gives more information and is useful
   // for analysis, but may make the output files excessively big.
   bool output_individual_functions_;
+
+  // The writer of the output, when streaming.
+  std::unique_ptr<core::JSONFileWriter> stream_writer_;
+
+  // The file written to by stream_writer_.
+  FILE* stream_output_;
+
+  // Set when writing a time slice to the stream failed.
+  bool stream_failed_;
 };
 
 // Stores the respective memory slices of a particular time slice in a map.
@@ -232,6 +303,10 @@ class HeatMapSimulation::TimeSlice {
     total_ += num_bytes;
   }
 
+  // Adds the memory slices of another time slice to this one.
+  // @param other The time slice to add.
+  void Merge(const TimeSlice& other);
+
   // @name Accessors.
   // @{
   const MemorySliceMap& slices() const { return slices_; }
@@ -17,6 +17,9 @@
 #include <map>
 #include <vector>
 
+#include "base/values.h"
+#include "base/files/file_util.h"
+#include "base/json/json_reader.h"
 #include "syzygy/core/random_number_generator.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pdb/omap.h"
@@ -108,6 +111,32 @@ class HeatMapSimulationTest : public testing::PELibUnitTest {
     time = Time::FromTimeT(10);
   }
 
+  // Opens a new temporary file.
+  // @param path receives the path of the file.
+  // @param file receives the file.
+  void CreateTemporaryFile(base::FilePath* path, base::ScopedFILE* file) {
+    file->reset(base::CreateAndOpenTemporaryFileInDir(temp_dir_, path));
+    ASSERT_TRUE(file->get() != NULL);
+  }
+
+  // Serializes a simulation and parses the JSON file back.
+  // @param path the path of @p file.
+  // @param file the file to serialize to, which is closed.
+  // @param simulation the simulation to serialize.
+  // @param value receives the parsed JSON value.
+  void SerializeAndParse(const base::FilePath& path,
+                         base::ScopedFILE* file,
+                         HeatMapSimulation* simulation,
+                         std::unique_ptr<base::Value>* value) {
+    ASSERT_TRUE(simulation->SerializeToJSON(file->get(), false));
+    file->reset();
+
+    std::string file_string;
+    ASSERT_TRUE(base::ReadFileToString(path, &file_string));
+    value->reset(base::JSONReader::Read(file_string).release());
+    ASSERT_TRUE(value->get() != NULL);
+  }
+
   // Simulates the current simulation with the function blocks given
   // in blocks_ with given parameters, and compares the result to certain
   // expected value.
@@ -279,6 +308,7 @@ class HeatMapSimulationTest : public testing::PELibUnitTest {
 
   std::unique_ptr<HeatMapSimulation> simulation_;
 
+  base::FilePath temp_dir_;
   Time time;
   MockBlockInfo blocks_[9];
   core::RandomNumberGenerator random_;
@@ -308,6 +338,138 @@ TEST_F(HeatMapSimulationTest, CorrectHeatMap) {
   EXPECT_EQ(simulation_->max_memory_slice_bytes(), 0);
 }
 
+TEST_F(HeatMapSimulationTest, MergePartition) {
+  simulation_->set_memory_slice_bytes(1);
+  std::unique_ptr<HeatMapSimulation> first(
+      static_cast<HeatMapSimulation*>(simulation_->CreatePartition()));
+  std::unique_ptr<HeatMapSimulation> second(
+      static_cast<HeatMapSimulation*>(simulation_->CreatePartition()));
+  EXPECT_EQ(1u, first->memory_slice_bytes());
+
+  // Simulate all the blocks in a single simulation, and half of them in each
+  // partition.
+  HeatMapSimulation expected;
+  expected.set_memory_slice_bytes(1);
+  expected.OnProcessStarted(time, 1);
+  first->OnProcessStarted(time, 1);
+  second->OnProcessStarted(time, 1);
+  for (uint32_t i = 0; i < arraysize(blocks_); i++) {
+    Time entry_time = Time::FromTimeT(blocks_[i].time);
+    expected.OnFunctionEntry(entry_time, blocks_[i].block);
+    if (i % 2 == 0)
+      first->OnFunctionEntry(entry_time, blocks_[i].block);
+    else
+      second->OnFunctionEntry(entry_time, blocks_[i].block);
+  }
+
+  simulation_->MergePartition(*first);
+  simulation_->MergePartition(*second);
+
+  EXPECT_EQ(expected.max_time_slice_usecs(),
+            simulation_->max_time_slice_usecs());
+  EXPECT_EQ(expected.max_memory_slice_bytes(),
+            simulation_->max_memory_slice_bytes());
+  ASSERT_EQ(expected.time_memory_map().size(),
+            simulation_->time_memory_map().size());
+
+  HeatMapSimulation::TimeMemoryMap::const_iterator expected_iter =
+      expected.time_memory_map().begin();
+  HeatMapSimulation::TimeMemoryMap::const_iterator merged_iter =
+      simulation_->time_memory_map().begin();
+  for (; expected_iter != expected.time_memory_map().end();
+       ++expected_iter, ++merged_iter) {
+    EXPECT_EQ(expected_iter->first, merged_iter->first);
+    EXPECT_EQ(expected_iter->second.total(), merged_iter->second.total());
+
+    const TimeSlice::MemorySliceMap& expected_slices =
+        expected_iter->second.slices();
+    const TimeSlice::MemorySliceMap& merged_slices =
+        merged_iter->second.slices();
+    ASSERT_EQ(expected_slices.size(), merged_slices.size());
+    TimeSlice::MemorySliceMap::const_iterator expected_slice =
+        expected_slices.begin();
+    TimeSlice::MemorySliceMap::const_iterator merged_slice =
+        merged_slices.begin();
+    for (; expected_slice != expected_slices.end();
+         ++expected_slice, ++merged_slice) {
+      EXPECT_EQ(expected_slice->first, merged_slice->first);
+      EXPECT_EQ(expected_slice->second.total, merged_slice->second.total);
+      EXPECT_EQ(expected_slice->second.functions,
+                merged_slice->second.functions);
+    }
+  }
+}
+
+TEST_F(HeatMapSimulationTest, StreamingMatchesSerialization) {
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+  simulation_->set_output_individual_functions(true);
+
+  HeatMapSimulation streamed;
+  streamed.set_output_individual_functions(true);
+  base::FilePath stream_path;
+  base::ScopedFILE stream_file;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryFile(&stream_path, &stream_file));
+  ASSERT_TRUE(streamed.StartStreaming(stream_file.get(), false));
+  EXPECT_TRUE(streamed.streaming());
+
+  simulation_->OnProcessStarted(time, 1);
+  streamed.OnProcessStarted(time, 1);
+  for (uint32_t i = 0; i < arraysize(blocks_); i++) {
+    Time entry_time = Time::FromTimeT(blocks_[i].time);
+    simulation_->OnFunctionEntry(entry_time, blocks_[i].block);
+    streamed.OnFunctionEntry(entry_time, blocks_[i].block);
+  }
+
+  // The first time slice was written out when the trace clock passed it.
+  EXPECT_EQ(2u, simulation_->time_memory_map().size());
+  ASSERT_EQ(1u, streamed.time_memory_map().size());
+  EXPECT_EQ(30000000, streamed.time_memory_map().begin()->first);
+
+  base::FilePath path;
+  base::ScopedFILE file;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryFile(&path, &file));
+  std::unique_ptr<base::Value> expected;
+  ASSERT_NO_FATAL_FAILURE(
+      SerializeAndParse(path, &file, simulation_.get(), &expected));
+  std::unique_ptr<base::Value> value;
+  ASSERT_NO_FATAL_FAILURE(
+      SerializeAndParse(stream_path, &stream_file, &streamed, &value));
+  EXPECT_FALSE(streamed.streaming());
+  EXPECT_TRUE(streamed.time_memory_map().empty());
+
+  EXPECT_TRUE(expected->Equals(value.get()));
+}
+
+TEST_F(HeatMapSimulationTest, StreamingWritesPreviousProcess) {
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+
+  base::FilePath stream_path;
+  base::ScopedFILE stream_file;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryFile(&stream_path, &stream_file));
+  ASSERT_TRUE(simulation_->StartStreaming(stream_file.get(), false));
+
+  // Both processes call a function at the same relative time.
+  for (uint32_t i = 0; i < 2; i++) {
+    simulation_->OnProcessStarted(time, 1);
+    EXPECT_TRUE(simulation_->time_memory_map().empty());
+    simulation_->OnFunctionEntry(Time::FromTimeT(blocks_[8].time),
+                                 blocks_[8].block);
+    EXPECT_EQ(1u, simulation_->time_memory_map().size());
+  }
+
+  std::unique_ptr<base::Value> value;
+  ASSERT_NO_FATAL_FAILURE(
+      SerializeAndParse(stream_path, &stream_file, simulation_.get(), &value));
+  const base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+  const base::ListValue* time_slices = NULL;
+  ASSERT_TRUE(dict->GetList("time_slice_list", &time_slices));
+  EXPECT_EQ(2u, time_slices->GetSize());
+  int max_time_slice = 0;
+  EXPECT_TRUE(dict->GetInteger("max_time_slice_usecs", &max_time_slice));
+  EXPECT_EQ(30000000, max_time_slice);
+}
+
 TEST_F(HeatMapSimulationTest, SmallMemorySliceSize) {
   static const uint32_t expected_size = 2;
   static const uint32_t expected_times[expected_size] = {10000000, 30000000};
@@ -72,18 +72,42 @@ bool PageFaultSimulation::SerializeToJSON(FILE* output,
   return true;
 }
 
+SimulationEventHandler* PageFaultSimulation::CreatePartition() const {
+  PageFaultSimulation* partition = new PageFaultSimulation();
+  partition->page_size_ = page_size_;
+  partition->pages_per_code_fault_ = pages_per_code_fault_;
+  return partition;
+}
+
+void PageFaultSimulation::MergePartition(
+    const SimulationEventHandler& partition) {
+  const PageFaultSimulation& other =
+      static_cast<const PageFaultSimulation&>(partition);
+  DCHECK_EQ(pages_per_code_fault_, other.pages_per_code_fault_);
+
+  // The page size may have been deduced from the trace files.
+  if (page_size_ == 0)
+    page_size_ = other.page_size_;
+  DCHECK(other.page_size_ == 0 || page_size_ == other.page_size_);
+
+  pages_.insert(other.pages_.begin(), other.pages_.end());
+  fault_count_ += other.fault_count_;
+}
+
 void PageFaultSimulation::OnFunctionEntry(base::Time /*time*/,
                                           const Block* block) {
   DCHECK(block != NULL);
+
+  OnCodeRangeEntry(block->addr().value(), block->size());
+}
+
+void PageFaultSimulation::OnCodeRangeEntry(uint32_t start, size_t size) {
   DCHECK(page_size_ != 0);
 
-  const uint32_t block_start = block->addr().value();
-  const uint32_t block_size = block->size();
-  const size_t kStartIndex = block_start / page_size_;
-  const size_t kEndIndex = (block_start + block_size +
-      page_size_ - 1) / page_size_;
+  const size_t kStartIndex = start / page_size_;
+  const size_t kEndIndex = (start + size + page_size_ - 1) / page_size_;
 
-  // Loop through all the pages in the block, and if it isn't already in memory
+  // Loop through all the pages in the range, and if it isn't already in memory
   // then simulate a code fault and load all the faulting pages in memory.
   for (size_t i = kStartIndex; i < kEndIndex; i++) {
     if (pages_.find(i) == pages_.end()) {
@@ -86,8 +86,23 @@ class PageFaultSimulation : public SimulationEventHandler {
   // The serialization consists of a single dictionary containing
   // the block number of each block that pagefaulted.
   bool SerializeToJSON(FILE* output, bool pretty_print) override;
+
+  // Creates a simulation with the same page size and pages per code fault.
+  SimulationEventHandler* CreatePartition() const override;
+
+  // Merges the pages loaded by a partition, and adds its faults. Each
+  // partition starts with no page loaded, so the merged fault count is that
+  // of the partitions running as independent processes.
+  void MergePartition(const SimulationEventHandler& partition) override;
   // @}
 
+  // Registers the page faults of an access to a range of code. This allows
+  // simulating layouts other than that of the blocks, such as a candidate
+  // ordering.
+  // @param start the first address of the range.
+  // @param size the size of the range, in bytes.
+  void OnCodeRangeEntry(uint32_t start, size_t size);
+
  protected:
   // A set which contains the block number of the pages that
   // were faulted in the trace files.
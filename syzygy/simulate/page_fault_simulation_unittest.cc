@@ -329,6 +329,48 @@ TEST_F(PageFaultSimulatorTest, ExactPageFaults) {
       arraysize(expected_pages)));
 }
 
+TEST_F(PageFaultSimulatorTest, CodeRangeEntryMatchesFunctionEntry) {
+  simulation_->OnProcessStarted(time_, 1);
+  for (int i = 0; i < arraysize(blocks_); i++)
+    simulation_->OnFunctionEntry(time_, blocks_[i].block);
+
+  PageFaultSimulation range_simulation;
+  range_simulation.OnProcessStarted(time_, 1);
+  for (int i = 0; i < arraysize(blocks_); i++)
+    range_simulation.OnCodeRangeEntry(blocks_[i].start, blocks_[i].size);
+
+  EXPECT_EQ(simulation_->fault_count(), range_simulation.fault_count());
+  EXPECT_EQ(simulation_->pages(), range_simulation.pages());
+}
+
+TEST_F(PageFaultSimulatorTest, MergePartition) {
+  simulation_->set_pages_per_code_fault(4);
+  std::unique_ptr<PageFaultSimulation> first(
+      static_cast<PageFaultSimulation*>(simulation_->CreatePartition()));
+  std::unique_ptr<PageFaultSimulation> second(
+      static_cast<PageFaultSimulation*>(simulation_->CreatePartition()));
+  EXPECT_EQ(4u, first->pages_per_code_fault());
+
+  // Each partition simulates half of the blocks from no loaded page.
+  const size_t kHalf = arraysize(blocks_) / 2;
+  first->OnProcessStarted(time_, 1);
+  for (size_t i = 0; i < kHalf; i++)
+    first->OnFunctionEntry(time_, blocks_[i].block);
+  second->OnProcessStarted(time_, 1);
+  for (size_t i = kHalf; i < arraysize(blocks_); i++)
+    second->OnFunctionEntry(time_, blocks_[i].block);
+
+  simulation_->MergePartition(*first);
+  simulation_->MergePartition(*second);
+
+  EXPECT_EQ(1u, simulation_->page_size());
+  EXPECT_EQ(first->fault_count() + second->fault_count(),
+            simulation_->fault_count());
+  PageSet expected_pages(first->pages());
+  expected_pages.insert(second->pages().begin(), second->pages().end());
+  EXPECT_EQ(expected_pages, simulation_->pages());
+}
+
 TEST_F(PageFaultSimulatorTest, CorrectPageFaults) {
   simulation_->OnProcessStarted(time_, 1);
 
@@ -43,6 +43,13 @@ const char kUsage[] =
     "    --pretty-print enables pretty printing of the JSON output file.\n"
     "    --input-dll=<path> the input DLL from where the trace files belong.\n"
     "    --output-file=<path> the output file.\n"
+    "    --num-threads=INT simulates each trace file on its own, on a pool\n"
+    "        of INT threads, and merges the results. The page faults are then\n"
+    "        counted as if each trace file started with no page loaded.\n"
+    "    --decomposition-cache-dir=<path> a directory holding the\n"
+    "        decompositions and OMAP data of earlier runs, which are reused\n"
+    "        when they match. Defaults to the SYZYGY_DECOMPOSITION_CACHE_DIR\n"
+    "        environment variable.\n"
     "    For page fault method:\n"
     "      --pages-per-code-fault=INT The number of pages loaded by each\n"
     "          page-fault (default 8)\n"
@@ -53,7 +60,9 @@ const char kUsage[] =
     "      --memory-slice-bytes=INT the size of each memory slice,\n"
     "          in bytes (default 32KB).\n"
     "      --output-individual-functions Output information about each\n"
-    "          function in each time/memory block\n";
+    "          function in each time/memory block\n"
+    "      --stream writes each time slice out as soon as the trace is past\n"
+    "          it, rather than holding them all in memory until the end.\n";
 
 int Usage(const char* message) {
   std::cerr << message << std::endl << kUsage;
@@ -95,6 +104,32 @@ int main(int argc, char** argv) {
   if (trace_paths.empty())
     return Usage("You must specify at least one trace file.");
 
+  int num_threads = 0;
+  if (cmd_line->HasSwitch("num-threads")) {
+    if (!base::StringToInt(cmd_line->GetSwitchValueASCII("num-threads"),
+                           &num_threads) ||
+        num_threads <= 0) {
+      return Usage("Invalid num-threads value.");
+    }
+  }
+
+  // The output is opened before the simulation, which may write to it as it
+  // goes.
+  base::ScopedFILE output_file;
+  FILE* output = NULL;
+  if (output_file_path.empty()) {
+    output = stdout;
+  } else {
+    output_file.reset(base::OpenFile(output_file_path, "w"));
+    output = output_file.get();
+
+    if (output == NULL) {
+      LOG(ERROR) << "Failed to open " << output_file_path.value()
+          << " for writing.";
+      return 1;
+    }
+  }
+
   std::unique_ptr<SimulationEventHandler> simulation;
 
   if (simulate_method == "pagefault") {
@@ -149,6 +184,12 @@ int main(int argc, char** argv) {
 
     heat_map_simulation->set_output_individual_functions(
         cmd_line->HasSwitch("output-individual-functions"));
+
+    if (cmd_line->HasSwitch("stream") &&
+        !heat_map_simulation->StartStreaming(output, pretty_print)) {
+      LOG(ERROR) << "Unable to write JSON file.";
+      return 1;
+    }
   } else {
     return Usage("Invalid simulate-method value.");
   }
@@ -158,28 +199,20 @@ int main(int argc, char** argv) {
                       instrumented_dll_path,
                       trace_paths,
                       simulation.get());
+  simulator.set_decomposition_cache_dir(
+      cmd_line->GetSwitchValuePath("decomposition-cache-dir"));
 
   LOG(INFO) << "Parsing trace files.";
-  if (!simulator.ParseTraceFiles()) {
+  bool parsed = false;
+  if (num_threads > 0)
+    parsed = simulator.ParseTraceFilesInParallel(num_threads);
+  else
+    parsed = simulator.ParseTraceFiles();
+  if (!parsed) {
     LOG(ERROR) << "Could not parse trace files.";
     return 1;
   }
 
-  base::ScopedFILE output_file;
-  FILE* output = NULL;
-  if (output_file_path.empty()) {
-    output = stdout;
-  } else {
-    output_file.reset(base::OpenFile(output_file_path, "w"));
-    output = output_file.get();
-
-    if (output == NULL) {
-      LOG(ERROR) << "Failed to open " << output_file_path.value()
-          << " for writing.";
-      return 1;
-    }
-  }
-
   LOG(INFO) << "Writing JSON file.";
   if (!simulation->SerializeToJSON(output, pretty_print)) {
     LOG(ERROR) << "Unable to write JSON file.";
@@ -49,6 +49,15 @@ class SimulationEventHandler {
   // @param pretty_print Pretty printing on the JSON file.
   // @returns true on success, false on failure.
   virtual bool SerializeToJSON(FILE* output, bool pretty_print) = 0;
+
+  // Creates an empty simulation with the same parameters as this one, that
+  // simulates a part of the trace files on its own.
+  // @returns the new simulation, owned by the caller.
+  virtual SimulationEventHandler* CreatePartition() const = 0;
+
+  // Merges the results of a partition into this simulation.
+  // @param partition A simulation created by CreatePartition.
+  virtual void MergePartition(const SimulationEventHandler& partition) = 0;
 };
 
 }  // namespace simulate
@@ -14,8 +14,109 @@
 
 #include "syzygy/simulate/simulator.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+
 namespace simulate {
 
+class Simulator::TracePartition
+    : public trace::parser::ParseEventHandlerImpl,
+      public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param playback The initialized playback, used to look up the blocks.
+  // @param trace_file The trace file to parse.
+  // @param simulation The partition of the simulation, owned by this object.
+  TracePartition(const Playback* playback,
+                 const base::FilePath& trace_file,
+                 SimulationEventHandler* simulation)
+      : playback_(playback),
+        trace_file_(trace_file),
+        simulation_(simulation),
+        succeeded_(false) {
+    DCHECK(playback_ != NULL);
+    DCHECK(simulation_ != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    if (!parser_.Init(this) || !parser_.OpenTraceFile(trace_file_)) {
+      LOG(ERROR) << "Unable to open trace log: " << trace_file_.value();
+      return;
+    }
+    succeeded_ = parser_.Consume() && !parser_.error_occurred();
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const SimulationEventHandler& simulation() const { return *simulation_; }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ protected:
+  // @name ParseEventHandler overrides.
+  // @{
+  void OnProcessStarted(base::Time time,
+                        DWORD process_id,
+                        const TraceSystemInfo* data) override {
+    if (data == NULL)
+      simulation_->OnProcessStarted(time, 0);
+    else
+      simulation_->OnProcessStarted(time, data->system_info.dwPageSize);
+  }
+
+  void OnFunctionEntry(base::Time time,
+                       DWORD process_id,
+                       DWORD thread_id,
+                       const TraceEnterExitEventData* data) override {
+    DCHECK(data != NULL);
+    bool error = false;
+    const BlockGraph::Block* block = playback_->FindFunctionBlock(
+        &parser_, process_id, data->function, &error);
+    if (error) {
+      LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
+    if (block != NULL)
+      simulation_->OnFunctionEntry(time, block);
+  }
+
+  void OnBatchFunctionEntry(base::Time time,
+                            DWORD process_id,
+                            DWORD thread_id,
+                            const TraceBatchEnterData* data) override {
+    TraceEnterExitEventData new_data = {};
+    for (size_t i = 0; i < data->num_calls; ++i) {
+      new_data.function = data->calls[i].function;
+      OnFunctionEntry(time, process_id, thread_id, &new_data);
+    }
+  }
+  // @}
+
+ private:
+  // The playback holding the decomposed image, shared by all partitions.
+  const Playback* playback_;
+
+  // The trace file of this partition.
+  base::FilePath trace_file_;
+
+  // The partition of the simulation.
+  std::unique_ptr<SimulationEventHandler> simulation_;
+
+  // The parser of the trace file.
+  Parser parser_;
+
+  // Whether the trace file was parsed successfully.
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(TracePartition);
+};
+
 Simulator::Simulator(const base::FilePath& module_path,
                      const base::FilePath& instrumented_path,
                      const TraceFileList& trace_files,
@@ -30,10 +131,11 @@ Simulator::Simulator(const base::FilePath& module_path,
   DCHECK(simulation_ != NULL);
 }
 
-bool Simulator::ParseTraceFiles() {
+bool Simulator::InitPlayback() {
   if (playback_ == NULL) {
     playback_.reset(
         new Playback(module_path_, instrumented_path_, trace_files_));
+    playback_->set_decomposition_cache_dir(decomposition_cache_dir_);
   }
 
   if (parser_ == NULL) {
@@ -53,6 +155,13 @@ bool Simulator::ParseTraceFiles() {
     return false;
   }
 
+  return true;
+}
+
+bool Simulator::ParseTraceFiles() {
+  if (!InitPlayback())
+    return false;
+
   if (!parser_->Consume()) {
     playback_.reset();
     return false;
@@ -63,6 +172,45 @@ bool Simulator::ParseTraceFiles() {
   return true;
 }
 
+bool Simulator::ParseTraceFilesInParallel(size_t num_threads) {
+  DCHECK_LT(0u, num_threads);
+
+  // The playback decomposes the image, and validates that all the trace files
+  // can be opened. Its parser isn't used afterwards.
+  if (!InitPlayback())
+    return false;
+
+  std::vector<std::unique_ptr<TracePartition>> partitions;
+  for (size_t i = 0; i < trace_files_.size(); ++i) {
+    partitions.push_back(std::unique_ptr<TracePartition>(new TracePartition(
+        playback_.get(), trace_files_[i], simulation_->CreatePartition())));
+  }
+
+  if (!partitions.empty()) {
+    base::DelegateSimpleThreadPool pool(
+        "Simulator",
+        static_cast<int>(std::min(num_threads, partitions.size())));
+    for (size_t i = 0; i < partitions.size(); ++i)
+      pool.AddWork(partitions[i].get());
+    pool.Start();
+    pool.JoinAll();
+  }
+
+  bool succeeded = true;
+  for (size_t i = 0; i < partitions.size(); ++i) {
+    if (!partitions[i]->succeeded()) {
+      LOG(ERROR) << "Failed to simulate " << trace_files_[i].value() << ".";
+      succeeded = false;
+      continue;
+    }
+    simulation_->MergePartition(partitions[i]->simulation());
+  }
+
+  playback_.reset();
+
+  return succeeded;
+}
+
 void Simulator::OnProcessStarted(base::Time time,
                                  DWORD process_id,
                                  const TraceSystemInfo* data) {
@@ -15,6 +15,10 @@
 // This defines the virtual simulator class, which analyzes trace files from
 // the execution of an instrumented dll, and calls the respective events
 // from a subclass of SimulatorEventHandler.
+//
+// The trace files may also be simulated in parallel. The image is then
+// decomposed once, and its blocks are looked up concurrently by a parser per
+// trace file, each of which feeds its own partition of the simulation.
 
 #ifndef SYZYGY_SIMULATE_SIMULATOR_H_
 #define SYZYGY_SIMULATE_SIMULATOR_H_
@@ -47,12 +51,37 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
   // @returns true on success, false on failure.
   bool ParseTraceFiles();
 
+  // Decomposes the image, then parses each trace file on its own on a pool
+  // of threads. Each trace file feeds a partition of the simulation, and the
+  // partitions are merged into the simulation in the order of the files, so
+  // that the results don't depend on the number of threads.
+  // @param num_threads The number of threads parsing the trace files.
+  // @returns true on success, false on failure.
+  bool ParseTraceFilesInParallel(size_t num_threads);
+
+  // Sets the directory of the decomposition cache of the playback. Must be
+  // called before the trace files are parsed.
+  // @param decomposition_cache_dir The directory of the cache, or an empty
+  //     path to use the one named by the environment, if any. See
+  //     pe::DecompositionCache::Create.
+  void set_decomposition_cache_dir(
+      const base::FilePath& decomposition_cache_dir) {
+    decomposition_cache_dir_ = decomposition_cache_dir;
+  }
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef pe::PEFile PEFile;
   typedef pe::ImageLayout ImageLayout;
   typedef trace::parser::Parser Parser;
 
+  // Parses a trace file into a partition of the simulation.
+  class TracePartition;
+
+  // Initializes the playback, which decomposes the image.
+  // @returns true on success, false on failure.
+  bool InitPlayback();
+
   // @name ParseEventHandler overrides.
   // @{
   virtual void OnProcessStarted(base::Time time,
@@ -73,6 +102,9 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
   base::FilePath instrumented_path_;
   TraceFileList trace_files_;
 
+  // The directory of the decomposition cache, if any.
+  base::FilePath decomposition_cache_dir_;
+
   // The PE file and Image layout to be passed to playback_.
   BlockGraph block_graph_;
   PEFile pe_file_;
@@ -20,6 +20,8 @@
 #include "gmock/gmock.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/unittest_util.h"
+#include "syzygy/simulate/heat_map_simulation.h"
+#include "syzygy/simulate/page_fault_simulation.h"
 #include "syzygy/version/syzygy_version.h"
 
 namespace simulate {
@@ -41,6 +43,10 @@ class MockSimulationEventHandler : public SimulationEventHandler {
       void(base::Time time, const block_graph::BlockGraph::Block* block));
 
   MOCK_METHOD2(SerializeToJSON, bool (FILE* output, bool pretty_print));
+
+  MOCK_CONST_METHOD0(CreatePartition, SimulationEventHandler*());
+
+  MOCK_METHOD1(MergePartition, void(const SimulationEventHandler& partition));
 };
 
 class SimulatorTest : public testing::PELibUnitTest {
@@ -60,6 +66,10 @@ class SimulatorTest : public testing::PELibUnitTest {
   }
 
   void InitSimulator() {
+    InitSimulator(&simulation_event_handler_);
+  }
+
+  void InitSimulator(SimulationEventHandler* simulation) {
     module_path_ = GetExeTestDataRelativePath(testing::kTestDllName);
     instrumented_path_ = GetExeTestDataRelativePath(
         testing::kCallTraceInstrumentedTestDllName);
@@ -67,7 +77,7 @@ class SimulatorTest : public testing::PELibUnitTest {
     simulator_.reset(new Simulator(module_path_,
                                    instrumented_path_,
                                    trace_files_,
-                                   &simulation_event_handler_));
+                                   simulation));
     ASSERT_TRUE(simulator_.get() != NULL);
   }
 
@@ -103,4 +113,54 @@ TEST_F(SimulatorTest, SuccesfulRead) {
   ASSERT_TRUE(simulator_->ParseTraceFiles());
 }
 
+TEST_F(SimulatorTest, ParallelReadMatchesSerialHeatMap) {
+  ASSERT_NO_FATAL_FAILURE(InitTraceFileList());
+
+  HeatMapSimulation serial;
+  ASSERT_NO_FATAL_FAILURE(InitSimulator(&serial));
+  ASSERT_TRUE(simulator_->ParseTraceFiles());
+
+  // The heat map doesn't depend on how the trace files are partitioned.
+  HeatMapSimulation parallel;
+  ASSERT_NO_FATAL_FAILURE(InitSimulator(&parallel));
+  ASSERT_TRUE(simulator_->ParseTraceFilesInParallel(2));
+
+  EXPECT_EQ(serial.max_time_slice_usecs(), parallel.max_time_slice_usecs());
+  EXPECT_EQ(serial.max_memory_slice_bytes(),
+            parallel.max_memory_slice_bytes());
+  ASSERT_EQ(serial.time_memory_map().size(),
+            parallel.time_memory_map().size());
+  HeatMapSimulation::TimeMemoryMap::const_iterator serial_iter =
+      serial.time_memory_map().begin();
+  HeatMapSimulation::TimeMemoryMap::const_iterator parallel_iter =
+      parallel.time_memory_map().begin();
+  for (; serial_iter != serial.time_memory_map().end();
+       ++serial_iter, ++parallel_iter) {
+    EXPECT_EQ(serial_iter->first, parallel_iter->first);
+    EXPECT_EQ(serial_iter->second.total(), parallel_iter->second.total());
+  }
+}
+
+TEST_F(SimulatorTest, ParallelReadPageFaults) {
+  ASSERT_NO_FATAL_FAILURE(InitTraceFileList());
+
+  PageFaultSimulation serial;
+  ASSERT_NO_FATAL_FAILURE(InitSimulator(&serial));
+  ASSERT_TRUE(simulator_->ParseTraceFiles());
+
+  // Each trace file starts with no page loaded, so there are at least as many
+  // faults as when the processes share their pages, and the results don't
+  // depend on the number of threads.
+  PageFaultSimulation one_thread;
+  ASSERT_NO_FATAL_FAILURE(InitSimulator(&one_thread));
+  ASSERT_TRUE(simulator_->ParseTraceFilesInParallel(1));
+  EXPECT_LE(serial.fault_count(), one_thread.fault_count());
+
+  PageFaultSimulation four_threads;
+  ASSERT_NO_FATAL_FAILURE(InitSimulator(&four_threads));
+  ASSERT_TRUE(simulator_->ParseTraceFilesInParallel(4));
+  EXPECT_EQ(one_thread.fault_count(), four_threads.fault_count());
+  EXPECT_EQ(one_thread.pages(), four_threads.pages());
+}
+
 }  // namespace simulate
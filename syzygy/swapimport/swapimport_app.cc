@@ -17,6 +17,9 @@
 
 #include "syzygy/swapimport/swapimport_app.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "base/files/file_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
@@ -96,66 +99,51 @@ int SwapImportApp::SwapImports() {
       return 1;
   }
 
-  // Read the entire input into memory.
-  VLOG(1) << "Reading \"" << input_image_.value() << "\" into memory.";
-  int64_t image_size = 0;
-  if (!base::GetFileSize(input_image_, &image_size)) {
-    LOG(ERROR) << "Failed to get image size: " << input_image_.value();
-    return 1;
-  }
-  std::vector<unsigned char> image(image_size, 0);
-  if (!base::ReadFile(input_image_,
-                           reinterpret_cast<char*>(image.data()),
-                           image_size)) {
-    LOG(ERROR) << "Failed to read image to memory: " << input_image_.value();
-    return 1;
-  }
-
   // Keeps track of matched imports, and how many have been swapped.
   size_t imports_swapped = 0;
   size_t imports_matched = 0;
 
-  // Look up the import directory.
+  // Look up the import directory. Only its descriptors are read, from the
+  // sections already mapped by the PE file.
   LOG(INFO) << "Processing NT headers.";
   const IMAGE_DATA_DIRECTORY* data_dir =
       pe_file.nt_headers()->OptionalHeader.DataDirectory +
           IMAGE_DIRECTORY_ENTRY_IMPORT;
+  pe::PEFile::FileOffsetAddress import_offset;
+  std::vector<IMAGE_IMPORT_DESCRIPTOR> imports;
   if (data_dir->Size != 0) {
     LOG(INFO) << "Processing imports.";
 
-    pe::PEFile::FileOffsetAddress import_offset;
-    if (!pe_file.Translate(
-            pe::PEFile::RelativeAddress(data_dir->VirtualAddress),
-            &import_offset)) {
+    pe::PEFile::RelativeAddress import_addr(data_dir->VirtualAddress);
+    if (!pe_file.Translate(import_addr, &import_offset)) {
       LOG(ERROR) << "Failed to translate import directory address.";
       return 1;
     }
 
+    imports.resize(data_dir->Size / sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    if (!imports.empty() &&
+        !pe_file.ReadImage(import_addr, imports.data(),
+                           imports.size() * sizeof(imports[0]))) {
+      LOG(ERROR) << "Failed to read import directory.";
+      return 1;
+    }
+
     // Walk over the imports.
-    IMAGE_IMPORT_DESCRIPTOR* imports_begin =
-        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
-            image.data() + import_offset.value());
-    IMAGE_IMPORT_DESCRIPTOR* imports_end =
-        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
-            image.data() + import_offset.value() + data_dir->Size);
-    IMAGE_IMPORT_DESCRIPTOR* imports = imports_begin;
-    size_t import_index = 0;
-    while (imports < imports_end && imports->Characteristics != 0) {
+    for (size_t import_index = 0; import_index < imports.size() &&
+             imports[import_index].Characteristics != 0; ++import_index) {
       // Look up the import name.
-      pe::PEFile::FileOffsetAddress name_offset;
-      if (!pe_file.Translate(
-              pe::PEFile::RelativeAddress(imports->Name),
-              &name_offset)) {
-        LOG(ERROR) << "Failed to translate import name.";
+      std::string name;
+      if (!pe_file.ReadImageString(
+              pe::PEFile::RelativeAddress(imports[import_index].Name),
+              &name)) {
+        LOG(ERROR) << "Failed to read import name.";
         return 1;
       }
 
       // Compare the import name.
-      const char* name = reinterpret_cast<const char*>(
-          image.data() + name_offset.value());
       VLOG(1) << "Processing import " << import_index << " \""
               << name << "\".";
-      if (base::CompareCaseInsensitiveASCII(import_name_.c_str(), name) == 0) {
+      if (base::CompareCaseInsensitiveASCII(import_name_, name) == 0) {
         VLOG(1) << "Import " << import_index << " matches import name.";
         ++imports_matched;
 
@@ -163,17 +151,10 @@ int SwapImportApp::SwapImports() {
           // Do the actual swapping of the imports.
           LOG(INFO) << "Swapping imports " << imports_swapped << " and "
                     << import_index;
-
-          IMAGE_IMPORT_DESCRIPTOR temp_iid = *imports;
-          *imports = imports_begin[imports_swapped];
-          imports_begin[imports_swapped] = temp_iid;
-
+          std::swap(imports[import_index], imports[imports_swapped]);
           ++imports_swapped;
         }
       }
-
-      ++imports;
-      ++import_index;
     }
   }
 
@@ -183,20 +164,29 @@ int SwapImportApp::SwapImports() {
     return 1;
   }
 
-  // Write the actual output.
+  // Write the actual output. The reordered descriptors occupy the same bytes
+  // as the original ones, so the output is a copy of the input with only the
+  // import directory rewritten in place.
   LOG(INFO) << "Writing output to \"" << output_image_.value() << "\".";
-  base::ScopedFILE output(base::OpenFile(output_image_, "wb"));
-  if (output.get() == NULL) {
-    LOG(ERROR) << "Failed to open \"" << output_image_.value() << "\" for "
-               << "writing.";
+  if (!base::CopyFile(input_image_, output_image_)) {
+    LOG(ERROR) << "Failed to copy \"" << input_image_.value() << "\" to \""
+               << output_image_.value() << "\".";
     return 1;
   }
-  if (::fwrite(image.data(), sizeof(image[0]), image.size(), output.get()) !=
-          image.size()) {
-    LOG(ERROR) << "Failed to write output: " << output_image_.value();
-    return 1;
+  if (imports_swapped != 0) {
+    base::ScopedFILE output(base::OpenFile(output_image_, "r+b"));
+    if (output.get() == NULL) {
+      LOG(ERROR) << "Failed to open \"" << output_image_.value() << "\" for "
+                 << "writing.";
+      return 1;
+    }
+    if (::fseek(output.get(), import_offset.value(), SEEK_SET) != 0 ||
+        ::fwrite(imports.data(), sizeof(imports[0]), imports.size(),
+                 output.get()) != imports.size()) {
+      LOG(ERROR) << "Failed to write output: " << output_image_.value();
+      return 1;
+    }
   }
-  output.reset();
 
   // Finalize the image by updating the checksum.
   LOG(INFO) << "Updating output image checksum.";
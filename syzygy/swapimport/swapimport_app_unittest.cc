@@ -226,6 +226,45 @@ TEST_F(SwapImportAppTest, RunSucceedsOverwrite) {
   ASSERT_NO_FATAL_FAILURE(ValidateImportsSwapped());
 }
 
+TEST_F(SwapImportAppTest, RunRewritesOnlyImportDirectory) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_);
+  cmd_line_.AppendArg("kernel32.dll");
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(0, test_impl_.Run());
+
+  std::string input;
+  std::string output;
+  ASSERT_TRUE(base::ReadFileToString(input_image_, &input));
+  ASSERT_TRUE(base::ReadFileToString(output_image_, &output));
+  ASSERT_EQ(input.size(), output.size());
+
+  pe::PEFile pe_file;
+  ASSERT_TRUE(pe_file.Init(input_image_));
+  const IMAGE_DATA_DIRECTORY& import_dir =
+      pe_file.nt_headers()->OptionalHeader.DataDirectory[
+          IMAGE_DIRECTORY_ENTRY_IMPORT];
+  pe::PEFile::FileOffsetAddress import_offset;
+  ASSERT_TRUE(pe_file.Translate(
+      pe::PEFile::RelativeAddress(import_dir.VirtualAddress), &import_offset));
+
+  // Besides the import directory, only the checksum differs.
+  size_t checksum_offset =
+      reinterpret_cast<const uint8_t*>(
+          &pe_file.nt_headers()->OptionalHeader.CheckSum) -
+      reinterpret_cast<const uint8_t*>(pe_file.dos_header());
+  for (size_t i = 0; i < input.size(); ++i) {
+    if (i >= import_offset.value() &&
+        i < import_offset.value() + import_dir.Size) {
+      continue;
+    }
+    if (i >= checksum_offset && i < checksum_offset + sizeof(DWORD))
+      continue;
+    ASSERT_EQ(input[i], output[i]) << "at offset " << i;
+  }
+  ASSERT_NO_FATAL_FAILURE(ValidateImportsSwapped());
+}
+
 TEST_F(SwapImportAppTest, RunSucceeds64) {
   cmd_line_.AppendSwitch("x64");
   cmd_line_.AppendSwitchPath("input-image", input_image_64_);
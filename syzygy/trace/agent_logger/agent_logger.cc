@@ -137,10 +137,14 @@ BOOL CALLBACK ReadProcessMemoryProc64(HANDLE process,
 
 }  // namespace
 
+const size_t AgentLogger::kDefaultMaxPendingMinidumps = 8;
+
 AgentLogger::AgentLogger()
     : trace::common::Service(L"Logger"),
       destination_(NULL),
-      symbolize_stack_traces_(true) {
+      symbolize_stack_traces_(true),
+      max_pending_minidumps_(kDefaultMaxPendingMinidumps),
+      pending_minidumps_(0) {
 }
 
 AgentLogger::~AgentLogger() {
@@ -390,16 +394,68 @@ bool AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges(
             memory_ranges_base_addresses);
   DCHECK_NE(static_cast<const size_t*>(nullptr), memory_ranges_lengths);
 
-  // Copy the memory ranges into a vector.
-  std::vector<kasko::api::MemoryRange> memory_ranges;
-  for (size_t i = 0; i < memory_ranges_count; ++i) {
-    kasko::api::MemoryRange memory_range = {memory_ranges_base_addresses[i],
-                                            memory_ranges_lengths[i]};
-    memory_ranges.push_back(memory_range);
+#ifndef _WIN64
+  // The client waits for the capture, so a request that would only queue up
+  // behind too many others is refused right away.
+  if (!BeginMinidump()) {
+    Write(base::StringPrintf(
+        "Too many pending minidumps, not writing one for process %u.", pid));
+    return false;
   }
+  base::FilePath temp_file_path;
+  bool captured = CaptureMinidump(pid, tid, exc_ptr, protobuf, protobuf_length,
+                                  memory_ranges_base_addresses,
+                                  memory_ranges_lengths, memory_ranges_count,
+                                  &temp_file_path);
+  EndMinidump();
+  if (!captured)
+    return false;
+
+  // Rename the temporary file so that its recognizable as a dump.
+  base::FilePath final_name(
+      base::StringPrintf(L"minidump-%08u-%08u-%08u.dmp",
+                         pid, tid, ::GetTickCount()));
+  base::FilePath final_path = minidump_dir_.Append(final_name);
+  if (base::Move(temp_file_path, final_path)) {
+    std::string log_msg = base::StringPrintf(
+        "A minidump has been written to %s.",
+        final_path.AsUTF8Unsafe().c_str());
+    Write(log_msg);
+  } else {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to move dump file to final location "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+#endif
+
+  return true;
+}
+
+bool AgentLogger::CaptureMinidump(
+    base::ProcessId pid,
+    DWORD tid,
+    unsigned __int64 exc_ptr,
+    const byte* protobuf,
+    size_t protobuf_length,
+    const void* const* memory_ranges_base_addresses,
+    const size_t* memory_ranges_lengths,
+    size_t memory_ranges_count,
+    base::FilePath* temp_file_path) {
+  DCHECK_NE(static_cast<base::FilePath*>(nullptr), temp_file_path);
 
 #ifndef _WIN64
   kasko::MinidumpRequest request;
+
+  // The memory ranges, such as the ASan block contexts, are passed in
+  // decreasing order of priority.
+  for (size_t i = 0; i < memory_ranges_count; ++i) {
+    kasko::MinidumpRequest::MemoryRange memory_range(
+        reinterpret_cast<uint32_t>(memory_ranges_base_addresses[i]),
+        memory_ranges_lengths[i]);
+    request.user_selected_memory_ranges.push_back(memory_range);
+  }
+
   request.client_exception_pointers = true;
   request.exception_info_address = exc_ptr;
   if (protobuf_length) {
@@ -413,47 +469,43 @@ bool AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges(
   DCHECK(!minidump_dir_.empty());
   // Create a temporary file to which to write the minidump. We'll rename it
   // to something recognizable when we're finished writing to it.
-  base::FilePath temp_file_path;
-  if (!base::CreateTemporaryFileInDir(minidump_dir_, &temp_file_path)) {
+  if (!base::CreateTemporaryFileInDir(minidump_dir_, temp_file_path)) {
     LOG(ERROR) << "Could not create mini dump file in "
                << minidump_dir_.value();
     return false;
   }
 
-  {
-    base::AutoLock auto_lock(symbol_lock_);
-    base::win::ScopedHandle target_process_handle(::OpenProcess(
-        GetRequiredAccessForMinidumpType(request.type), FALSE, pid));
-    if (!target_process_handle.IsValid()) {
-      LOG(ERROR) << "Failed to open target process: " << ::common::LogWe()
-                 << ".";
-      return false;
-    }
-    CHECK(kasko::GenerateMinidump(temp_file_path, target_process_handle.Get(),
-                                  tid, request));
-  }
-
-  // Rename the temporary file so that its recognizable as a dump.
-  base::FilePath final_name(
-      base::StringPrintf(L"minidump-%08u-%08u-%08u.dmp",
-                         pid, tid, ::GetTickCount()));
-  base::FilePath final_path = minidump_dir_.Append(final_name);
-  if (base::Move(temp_file_path, final_path)) {
-    std::string log_msg = base::StringPrintf(
-        "A minidump has been written to %s.",
-        final_path.AsUTF8Unsafe().c_str());
-    Write(log_msg);
-  } else {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "Failed to move dump file to final location "
-               << ::common::LogWe(error) << ".";
+  // The DbgHelp functions are single threaded, so the captures are serialized
+  // with the symbolization of the stack traces.
+  base::AutoLock auto_lock(symbol_lock_);
+  base::win::ScopedHandle target_process_handle(::OpenProcess(
+      GetRequiredAccessForMinidumpType(request.type), FALSE, pid));
+  if (!target_process_handle.IsValid()) {
+    LOG(ERROR) << "Failed to open target process: " << ::common::LogWe()
+               << ".";
     return false;
   }
+  CHECK(kasko::GenerateMinidump(*temp_file_path, target_process_handle.Get(),
+                                tid, request));
 #endif
 
   return true;
 }
 
+bool AgentLogger::BeginMinidump() {
+  base::AutoLock auto_lock(minidump_lock_);
+  if (pending_minidumps_ >= max_pending_minidumps_)
+    return false;
+  ++pending_minidumps_;
+  return true;
+}
+
+void AgentLogger::EndMinidump() {
+  base::AutoLock auto_lock(minidump_lock_);
+  DCHECK_LT(0u, pending_minidumps_);
+  --pending_minidumps_;
+}
+
 bool AgentLogger::InitRpc() {
   RPC_STATUS status = RPC_S_OK;
 
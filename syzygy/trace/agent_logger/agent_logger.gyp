@@ -35,6 +35,7 @@
         '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:logger_rpc_lib',
       ],
       'conditions': [
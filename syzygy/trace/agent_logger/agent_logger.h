@@ -51,6 +51,22 @@ class AgentLogger : public trace::common::Service {
   void set_minidump_dir(const base::FilePath& dir) { minidump_dir_ = dir; }
   // @}
 
+  // Get/Set the maximum number of minidump requests that are captured or
+  // waiting to be. Further requests are refused, so that a storm of crashing
+  // clients doesn't queue up behind the captures. Defaults to
+  // kDefaultMaxPendingMinidumps.
+  // @{
+  size_t max_pending_minidumps() const { return max_pending_minidumps_; }
+  void set_max_pending_minidumps(size_t value) {
+    DCHECK_LT(0u, value);
+    base::AutoLock auto_lock(minidump_lock_);
+    max_pending_minidumps_ = value;
+  }
+  // @}
+
+  // The default maximum number of pending minidump requests.
+  static const size_t kDefaultMaxPendingMinidumps;
+
   // Get/Set the symbolize_stack_traces_ flag.
   // @{
   bool symbolize_stack_traces() { return symbolize_stack_traces_; }
@@ -153,6 +169,33 @@ class AgentLogger : public trace::common::Service {
   // Indicates if we should symbolize the stack traces. Defaults to true.
   bool symbolize_stack_traces_;
 
+  // Captures a minidump of a client into a temporary file of minidump_dir_.
+  // The parameters are those of SaveMinidumpWithProtobufAndMemoryRanges.
+  // @param temp_file_path receives the path of the temporary file.
+  // @returns true on success, false otherwise.
+  bool CaptureMinidump(base::ProcessId pid,
+                       DWORD tid,
+                       unsigned __int64 exc_ptr,
+                       const byte* protobuf,
+                       size_t protobuf_length,
+                       const void* const* memory_ranges_base_addresses,
+                       const size_t* memory_ranges_lengths,
+                       size_t memory_ranges_count,
+                       base::FilePath* temp_file_path);
+
+  // Reserves a minidump capture, if fewer than max_pending_minidumps_ are
+  // pending.
+  // @returns true if the capture may proceed, in which case EndMinidump must
+  //     be called once it's done.
+  bool BeginMinidump();
+  void EndMinidump();
+
+  // The maximum and the current number of pending minidump requests, under
+  // minidump_lock_.
+  size_t max_pending_minidumps_;
+  size_t pending_minidumps_;
+  base::Lock minidump_lock_;
+
   // Signaled once the agent has successfully initialized.
   base::win::ScopedHandle started_event_;
 
@@ -25,6 +25,7 @@
 #include "base/process/kill.h"
 #include "base/process/launch.h"
 #include "base/process/process.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
@@ -62,6 +63,10 @@ const char kUsageFormatStr[] =
     "                         spawn actions.\n"
     "    --instance-id=ID     A unique (up to 16 character) ID to identify\n"
     "                         the logger instance.\n"
+    "    --max-pending-minidumps=NUM\n"
+    "                         The maximum number of minidump requests being\n"
+    "                         captured or waiting to be. Further requests\n"
+    "                         are refused. Defaults to 8.\n"
     "    --minidump-dir=PATH  The directory path in which minidumps, if any,\n"
     "                         should be generated.\n"
     "    --output-file=PATH   The file path to which logs should be written.\n"
@@ -204,6 +209,7 @@ const char LoggerApp::kInstanceId[] = "instance-id";
 const char LoggerApp::kUniqueInstanceId[] = "unique-instance-id";
 const char LoggerApp::kOutputFile[] = "output-file";
 const char LoggerApp::kMiniDumpDir[] = "minidump-dir";
+const char LoggerApp::kMaxPendingMiniDumps[] = "max-pending-minidumps";
 const char LoggerApp::kAppend[] = "append";
 const wchar_t LoggerApp::kStdOut[] = L"stdout";
 const wchar_t LoggerApp::kStdErr[] = L"stderr";
@@ -220,6 +226,7 @@ LoggerApp::LoggerApp()
     : ::application::AppImplBase("AgentLogger"),
       logger_command_line_(base::CommandLine::NO_PROGRAM),
       action_handler_(NULL),
+      max_pending_mini_dumps_(AgentLogger::kDefaultMaxPendingMinidumps),
       append_(false) {
 }
 
@@ -277,6 +284,19 @@ bool LoggerApp::ParseCommandLine(const base::CommandLine* command_line) {
     }
   }
 
+  // Parse the max-pending-minidumps parameter.
+  if (command_line->HasSwitch(kMaxPendingMiniDumps)) {
+    unsigned value = 0;
+    if (!base::StringToUint(
+            command_line->GetSwitchValueASCII(kMaxPendingMiniDumps),
+            &value) ||
+        value == 0) {
+      return Usage(command_line,
+                   "The max-pending-minidumps parameter is invalid.");
+    }
+    max_pending_mini_dumps_ = value;
+  }
+
   // Make sure there's exactly one action.
   if (command_line->GetArgs().size() != 1) {
     return Usage(command_line,
@@ -382,6 +402,7 @@ bool LoggerApp::Start() {
   AgentLogger logger;
   logger.set_destination(output_file);
   logger.set_minidump_dir(mini_dump_dir_);
+  logger.set_max_pending_minidumps(max_pending_mini_dumps_);
   logger.set_instance_id(instance_id_);
   logger.set_started_callback(
       base::Bind(&SignalEvent, start_event.Get()));
@@ -125,6 +125,7 @@ class LoggerApp : public application::AppImplBase {
   static const char kOutputFile[];
   static const char kAppend[];
   static const char kMiniDumpDir[];
+  static const char kMaxPendingMiniDumps[];
   // @}
 
   // Special-case output file value tokens.
@@ -146,6 +147,7 @@ class LoggerApp : public application::AppImplBase {
   ActionHandler action_handler_;
   base::FilePath output_file_path_;
   base::FilePath mini_dump_dir_;
+  size_t max_pending_mini_dumps_;
   bool append_;
   // @}
 
@@ -25,6 +25,7 @@
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/trace/agent_logger/agent_logger.h"
+#include "syzygy/trace/protocol/logger_batch.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
 
 namespace {
@@ -201,6 +202,59 @@ boolean LoggerService_WriteWithTrace(
   return true;
 }
 
+boolean LoggerService_WriteBatch(
+    /* [in] */ handle_t binding,
+    /* [in, size_is(batch_length)] */ const byte* batch,
+    /* [in] */ unsigned long batch_length) {
+  if (binding == NULL || (batch == NULL && batch_length != 0)) {
+    LOG(ERROR) << "Invalid input parameter(s).";
+    return false;
+  }
+
+  std::vector<LoggerBatchRecord> records;
+  if (!ParseLoggerBatch(batch, batch_length, &records)) {
+    LOG(ERROR) << "Malformed log batch.";
+    return false;
+  }
+  if (records.empty())
+    return true;
+
+  // Get the logger instance.
+  AgentLogger* instance = RpcLoggerInstanceManager::GetInstance();
+
+  // The caller's process is only needed to symbolize stack traces.
+  ProcessId pid = 0;
+  ScopedHandle handle;
+  for (const auto& record : records) {
+    if (!record.trace.empty()) {
+      if (!GetClientInfo(binding, &pid, &handle))
+        return false;
+      break;
+    }
+  }
+
+  // Create the log messages, and write them all at once.
+  std::string messages;
+  for (const auto& record : records) {
+    std::string message = record.text.as_string();
+    if (!record.trace.empty() &&
+        !instance->AppendTrace(handle.Get(), record.trace.data(),
+                               record.trace.size(), &message)) {
+      return false;
+    }
+    if (message.empty())
+      continue;
+    if (!messages.empty() && messages.back() != '\n')
+      messages.push_back('\n');
+    messages.append(message);
+  }
+  if (!instance->Write(messages))
+    return false;
+
+  // And we're done.
+  return true;
+}
+
 // RPC entrypoint for AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges().
 boolean LoggerService_SaveMinidumpWithProtobufAndMemoryRanges(
     /* [in] */ handle_t binding,
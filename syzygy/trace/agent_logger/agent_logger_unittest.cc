@@ -28,6 +28,7 @@
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/crashdata/crashdata.h"
 #include "syzygy/trace/agent_logger/agent_logger_rpc_impl.h"
+#include "syzygy/trace/protocol/logger_batch.h"
 
 namespace trace {
 namespace agent_logger {
@@ -80,6 +81,8 @@ bool TextContainsKnownStack(const std::string& text, size_t start_offset) {
 class TestLogger : public AgentLogger {
  public:
   using AgentLogger::destination_;
+  using AgentLogger::BeginMinidump;
+  using AgentLogger::EndMinidump;
 };
 
 class LoggerTest : public testing::Test {
@@ -273,6 +276,22 @@ TEST_F(LoggerTest, StackTraceHandling) {
   ASSERT_TRUE(function_c != std::string::npos);
 }
 
+TEST_F(LoggerTest, PendingMinidumpsAreLimited) {
+  EXPECT_EQ(AgentLogger::kDefaultMaxPendingMinidumps,
+            logger_.max_pending_minidumps());
+  logger_.set_max_pending_minidumps(2);
+
+  EXPECT_TRUE(logger_.BeginMinidump());
+  EXPECT_TRUE(logger_.BeginMinidump());
+  EXPECT_FALSE(logger_.BeginMinidump());
+
+  // A capture can proceed once another is done.
+  logger_.EndMinidump();
+  EXPECT_TRUE(logger_.BeginMinidump());
+  logger_.EndMinidump();
+  logger_.EndMinidump();
+}
+
 TEST_F(LoggerTest, Write) {
   // Write the lines.
   ASSERT_TRUE(logger_.Write(kLine1));
@@ -374,6 +393,60 @@ TEST_F(LoggerTest, RpcWriteWithStack) {
   ASSERT_TRUE(TextContainsKnownStack(text, line_1));
 }
 
+TEST_F(LoggerTest, RpcWriteBatch) {
+  // Connect to the logger over RPC.
+  ScopedRpcBinding rpc_binding;
+  std::wstring endpoint(
+      GetInstanceString(kLoggerRpcEndpointRoot, instance_id_));
+  ASSERT_TRUE(rpc_binding.Open(kLoggerRpcProtocol, endpoint));
+
+  HANDLE process = ::GetCurrentProcess();
+  std::vector<uintptr_t> trace_data;
+  ASSERT_NO_FATAL_FAILURE(ExecuteCallbackWithKnownStack(base::Bind(
+      &LoggerTest::DoCaptureRemoteTrace,
+      base::Unretained(this),
+      process,
+      &trace_data)));
+
+  // Write the three lines in a single batch, the last with a stack trace.
+  std::vector<uint8_t> batch;
+  AppendLoggerBatchRecord(kLine1, NULL, 0, &batch);
+  AppendLoggerBatchRecord(kLine2, NULL, 0, &batch);
+  AppendLoggerBatchRecord(
+      kLine3, reinterpret_cast<const void* const*>(trace_data.data()),
+      static_cast<uint32_t>(trace_data.size()), &batch);
+  ASSERT_TRUE(LoggerClient_WriteBatch(
+      rpc_binding.Get(), batch.data(),
+      static_cast<unsigned long>(batch.size())));
+
+  // A malformed batch is rejected.
+  ASSERT_FALSE(LoggerClient_WriteBatch(
+      rpc_binding.Get(), batch.data(),
+      static_cast<unsigned long>(sizeof(LoggerBatchRecordHeader) - 1)));
+
+  ASSERT_TRUE(LoggerClient_Stop(rpc_binding.Get()));
+  ASSERT_TRUE(rpc_binding.Close());
+
+  // Wait for the logger to finish shutting down.
+  EXPECT_NO_FATAL_FAILURE(WaitForLoggerToFinish());
+
+  // Close the log file.
+  log_file_.reset(NULL);
+
+  // Read in the log contents.
+  std::string text;
+  ASSERT_TRUE(base::ReadFileToString(log_file_path_, &text));
+
+  // The lines are separated as if they had been written one at a time, and
+  // the last is followed by the expected function chain.
+  std::string expected_lines(kLine1);
+  expected_lines += kLine2;
+  expected_lines += '\n';
+  expected_lines += kLine3;
+  ASSERT_EQ(0u, text.find(expected_lines));
+  ASSERT_TRUE(TextContainsKnownStack(text, expected_lines.size()));
+}
+
 TEST_F(LoggerTest, RpcWriteWithContext) {
   // Connect to the logger over RPC.
   ScopedRpcBinding rpc_binding;
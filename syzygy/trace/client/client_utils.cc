@@ -20,6 +20,7 @@
 #include <psapi.h>
 #include <memory>
 
+#include "base/atomicops.h"
 #include "base/environment.h"
 #include "base/logging.h"
 #include "base/files/file_util.h"
@@ -40,6 +41,9 @@ namespace client {
 
 namespace {
 
+// The serial number of the last segment header written by the process.
+base::subtle::Atomic32 last_segment_serial = 0;
+
 // Loads the environment variable @p env_var and splits it at semi-colons. Each
 // substring is treated as a comma-separated "path,value" pair, with the first
 // substring being allowed to be a "value" singleton interpreted as a default
@@ -188,7 +192,8 @@ TraceFileSegment::TraceFileSegment()
     : header(NULL),
       base_ptr(NULL),
       write_ptr(NULL),
-      end_ptr(NULL) {
+      end_ptr(NULL),
+      segment_serial(0) {
   // Zero the RPC buffer.
   memset(&buffer_info, 0, sizeof(buffer_info));
 }
@@ -239,6 +244,8 @@ void TraceFileSegment::WriteSegmentHeader(SessionHandle session_handle) {
   header->segment_length = 0;
 
   write_ptr = reinterpret_cast<uint8_t*>(header + 1);
+  segment_serial = static_cast<uint32_t>(
+      base::subtle::NoBarrier_AtomicIncrement(&last_segment_serial, 1));
 }
 
 void* TraceFileSegment::AllocateTraceRecordImpl(int record_type,
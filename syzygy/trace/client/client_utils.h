@@ -108,6 +108,12 @@ class TraceFileSegment {
 
   // The upper bound of the call trace buffer in the client process.
   uint8_t* end_ptr;
+
+  // A serial number that is unique to the segment in the process, assigned
+  // when its header is written. Buffers are recycled, so this is what tells
+  // the successive segments written through this object apart. It is zero
+  // until a segment header is written.
+  uint32_t segment_serial;
 };
 
 // Helper function to transform a DllMain reason to a call trace event type.
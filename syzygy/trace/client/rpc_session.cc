@@ -27,14 +27,41 @@ extern "C" IMAGE_DOS_HEADER __ImageBase;
 namespace trace {
 namespace client {
 
+namespace {
+
+// The time to wait for the service to provide a fresh buffer through the
+// buffer ring before falling back to an RPC.
+const DWORD kFreshBufferTimeoutMs = 50;
+
+BufferRingEntry ToEntry(const CallTraceBuffer& buffer) {
+  BufferRingEntry entry = {};
+  entry.shared_memory_handle = buffer.shared_memory_handle;
+  entry.mapping_size = buffer.mapping_size;
+  entry.buffer_offset = buffer.buffer_offset;
+  entry.buffer_size = buffer.buffer_size;
+  return entry;
+}
+
+void FromEntry(const BufferRingEntry& entry, CallTraceBuffer* buffer) {
+  DCHECK(buffer != NULL);
+  buffer->shared_memory_handle = entry.shared_memory_handle;
+  buffer->mapping_size = entry.mapping_size;
+  buffer->buffer_offset = entry.buffer_offset;
+  buffer->buffer_size = entry.buffer_size;
+}
+
+}  // namespace
+
 RpcSession::RpcSession()
     : rpc_binding_(NULL),
       session_handle_(NULL),
       flags_(0),
-      is_disabled_(false) {
+      is_disabled_(false),
+      buffer_ring_(NULL) {
 }
 
 RpcSession::~RpcSession() {
+  FreeBufferRing();
   FreeSharedMemory();
 }
 
@@ -126,6 +153,8 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
     return false;
   }
 
+  CreateBufferRing();
+
   return true;
 }
 
@@ -133,6 +162,9 @@ bool RpcSession::AllocateBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  if (GetFreshBufferFromRing(&segment->buffer_info))
+    return MapSegmentBuffer(segment);
+
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_AllocateBuffer, session_handle_,
                                &segment->buffer_info).succeeded();
@@ -171,6 +203,11 @@ bool RpcSession::ExchangeBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  // Once the full buffer is committed, getting a fresh one is the same as
+  // allocating one.
+  if (CommitBufferToRing(segment->buffer_info))
+    return AllocateBuffer(segment);
+
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_ExchangeBuffer, session_handle_,
                                &segment->buffer_info).succeeded();
@@ -182,6 +219,12 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  // As with the RPC, the returned buffer is cleared.
+  if (CommitBufferToRing(segment->buffer_info)) {
+    ::memset(&segment->buffer_info, 0, sizeof(segment->buffer_info));
+    return true;
+  }
+
   return ::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffer, session_handle_,
                                   &segment->buffer_info).succeeded();
 }
@@ -189,15 +232,120 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
 bool RpcSession::CloseSession() {
   DCHECK(IsTracing());
 
+  // The service drains the ring of committed buffers when the session is
+  // closed, and the ring is no longer used after that.
   bool succeeded = ::common::rpc::InvokeRpc(CallTraceClient_CloseSession,
                                             &session_handle_).succeeded();
 
   ignore_result(::RpcBindingFree(&rpc_binding_));
   rpc_binding_ = NULL;
 
+  FreeBufferRing();
+
   return succeeded;
 }
 
+bool RpcSession::CreateBufferRing() {
+  DCHECK(IsTracing());
+  DCHECK(buffer_ring_ == NULL);
+
+  unsigned long section_handle = 0;
+  unsigned long section_size = 0;
+  unsigned long committed_event = 0;
+  unsigned long fresh_event = 0;
+  bool succeeded =
+      ::common::rpc::InvokeRpc(CallTraceClient_CreateBufferRing,
+                               session_handle_, &section_handle,
+                               &section_size, &committed_event,
+                               &fresh_event).succeeded();
+  if (!succeeded) {
+    VLOG(1) << "Exchanging buffers through RPCs.";
+    return false;
+  }
+
+  base::win::ScopedHandle section(reinterpret_cast<HANDLE>(section_handle));
+  base::win::ScopedHandle committed(reinterpret_cast<HANDLE>(committed_event));
+  base::win::ScopedHandle fresh(reinterpret_cast<HANDLE>(fresh_event));
+  if (section_size < sizeof(BufferRingSection)) {
+    LOG(ERROR) << "Buffer ring section is too small.";
+    return false;
+  }
+
+  BufferRingSection* buffer_ring = reinterpret_cast<BufferRingSection*>(
+      ::MapViewOfFile(section.Get(), FILE_MAP_WRITE, 0, 0, section_size));
+  if (buffer_ring == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map view of buffer ring: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+  if (buffer_ring->version != BufferRingSection::kVersion) {
+    LOG(ERROR) << "Unexpected buffer ring version: " << buffer_ring->version
+               << ".";
+    ignore_result(::UnmapViewOfFile(buffer_ring));
+    return false;
+  }
+
+  base::AutoLock lock(buffer_ring_lock_);
+  buffer_ring_section_.Set(section.Take());
+  committed_event_.Set(committed.Take());
+  fresh_event_.Set(fresh.Take());
+  buffer_ring_ = buffer_ring;
+
+  return true;
+}
+
+void RpcSession::FreeBufferRing() {
+  base::AutoLock lock(buffer_ring_lock_);
+  if (buffer_ring_ == NULL)
+    return;
+
+  if (::UnmapViewOfFile(buffer_ring_) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to unmap buffer ring: " << ::common::LogWe(error);
+  }
+  buffer_ring_ = NULL;
+  buffer_ring_section_.Close();
+  committed_event_.Close();
+  fresh_event_.Close();
+}
+
+bool RpcSession::CommitBufferToRing(const CallTraceBuffer& buffer) {
+  base::AutoLock lock(buffer_ring_lock_);
+  if (buffer_ring_ == NULL)
+    return false;
+
+  if (!PushBufferRingEntry(ToEntry(buffer), &buffer_ring_->committed))
+    return false;
+  ::SetEvent(committed_event_.Get());
+  return true;
+}
+
+bool RpcSession::GetFreshBufferFromRing(CallTraceBuffer* buffer) {
+  DCHECK(buffer != NULL);
+
+  base::AutoLock lock(buffer_ring_lock_);
+  if (buffer_ring_ == NULL)
+    return false;
+
+  BufferRingEntry entry = {};
+  if (!PopBufferRingEntry(&buffer_ring_->fresh, &entry)) {
+    // Wake the service up, as it may not know the ring ran dry, and give it
+    // a chance to provide a buffer.
+    ::SetEvent(committed_event_.Get());
+    if (::WaitForSingleObject(fresh_event_.Get(), kFreshBufferTimeoutMs) !=
+            WAIT_OBJECT_0 ||
+        !PopBufferRingEntry(&buffer_ring_->fresh, &entry)) {
+      return false;
+    }
+  }
+
+  // Let the service top up the ring.
+  ::SetEvent(committed_event_.Get());
+  FromEntry(entry, buffer);
+  return true;
+}
+
 void RpcSession::FreeSharedMemory() {
   base::AutoLock scoped_lock_(shared_memory_lock_);
 
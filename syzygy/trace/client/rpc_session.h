@@ -21,7 +21,9 @@
 
 #include "base/logging.h"
 #include "base/synchronization/lock.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/trace/client/client_utils.h"
+#include "syzygy/trace/protocol/buffer_ring.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace trace {
@@ -69,12 +71,43 @@ class RpcSession {
     return is_disabled_;
   }
 
+  // @returns true if buffers are exchanged through a buffer ring rather than
+  //     through RPCs.
+  bool HasBufferRing() const {
+    return buffer_ring_ != NULL;
+  }
+
   unsigned long flags() const { return flags_; }
 
  protected:
   // Map a tracefile segment buffer into local memory.
   bool MapSegmentBuffer(TraceFileSegment* segment);
 
+  // @name Buffer ring transport. The service may offer a ring of fresh
+  //     buffers and a ring of committed buffers in shared memory, through
+  //     which buffers are exchanged without an RPC round-trip. The RPCs
+  //     remain the fallback when a ring is full or empty.
+  // @{
+  // Sets up the buffer ring transport. Failure is not an error, the session
+  // then exchanges buffers through RPCs.
+  // @returns true if the session has a buffer ring.
+  bool CreateBufferRing();
+
+  // Tears down the buffer ring transport.
+  void FreeBufferRing();
+
+  // Commits a full buffer to the ring of committed buffers.
+  // @param buffer the buffer to commit.
+  // @returns true on success, false if there is no ring or it is full.
+  bool CommitBufferToRing(const CallTraceBuffer& buffer);
+
+  // Gets a fresh buffer from the ring of fresh buffers, waiting briefly for
+  // the service to provide one if it is empty.
+  // @param buffer receives the fresh buffer.
+  // @returns true on success, false if there is no ring or it is empty.
+  bool GetFreshBufferFromRing(CallTraceBuffer* buffer);
+  // @}
+
   // The call trace RPC binding.
   handle_t rpc_binding_;
 
@@ -103,6 +136,15 @@ class RpcSession {
   // The (optional) unique id used to differentiate concurrent instances of the
   // RPC call-trace logging service.
   std::wstring instance_id_;
+
+  // The buffer ring transport, if the service provides one. Client threads
+  // serialize their access to the rings with buffer_ring_lock_, so that each
+  // ring has a single producer and a single consumer.
+  base::Lock buffer_ring_lock_;
+  base::win::ScopedHandle buffer_ring_section_;
+  base::win::ScopedHandle committed_event_;
+  base::win::ScopedHandle fresh_event_;
+  BufferRingSection* buffer_ring_;
 };
 
 }  // namespace client
@@ -34,6 +34,30 @@ union LargeInteger {
 
 typedef ULONGLONG (*GetTickCount64Ptr)();
 
+// Reads the TSC along with the performance counter. The read that is the
+// closest to its performance counter reads out of a few is kept, so that the
+// pair is not skewed by an interrupt.
+void GetTscAndPerformanceCounter(uint64_t* tsc, uint64_t* counter) {
+  DCHECK_NE(static_cast<uint64_t*>(nullptr), tsc);
+  DCHECK_NE(static_cast<uint64_t*>(nullptr), counter);
+
+  static const size_t kAttempts = 5;
+  uint64_t best_skew = ~0ULL;
+  for (size_t i = 0; i < kAttempts; ++i) {
+    LargeInteger before = {};
+    LargeInteger after = {};
+    ::QueryPerformanceCounter(&before.li);
+    uint64_t t = GetTsc();
+    ::QueryPerformanceCounter(&after.li);
+    uint64_t skew = after.ui64 - before.ui64;
+    if (skew < best_skew) {
+      best_skew = skew;
+      *tsc = t;
+      *counter = before.ui64 + skew / 2;
+    }
+  }
+}
+
 }  // namespace
 
 void GetTickTimerInfo(TimerInfo* timer_info) {
@@ -60,6 +84,9 @@ void GetTscTimerInfo(TimerInfo* timer_info) {
   if ((info[3] & (1 << 8)) == 0)
     return;
 
+  if (CalibrateTscTimerInfo(timer_info))
+    return;
+
   // Get the CPU frequency. If all is well, this is the frequency of the TSC
   // timer.
   base::win::RegKey cpureg;
@@ -78,6 +105,39 @@ void GetTscTimerInfo(TimerInfo* timer_info) {
   timer_info->resolution = 1;
 }
 
+bool CalibrateTscTimerInfo(TimerInfo* timer_info) {
+  DCHECK_NE(static_cast<TimerInfo*>(nullptr), timer_info);
+
+  LargeInteger counter_frequency = {};
+  if (!::QueryPerformanceFrequency(&counter_frequency.li) ||
+      counter_frequency.ui64 == 0) {
+    return false;
+  }
+
+  uint64_t tsc_start = 0;
+  uint64_t counter_start = 0;
+  GetTscAndPerformanceCounter(&tsc_start, &counter_start);
+
+  // Busy wait, as a sleep would be rounded to the scheduler's quantum.
+  uint64_t counter_end =
+      counter_start + counter_frequency.ui64 * kTscCalibrationMs / 1000;
+  LargeInteger counter = {};
+  do {
+    ::QueryPerformanceCounter(&counter.li);
+  } while (counter.ui64 < counter_end);
+
+  uint64_t tsc_end = 0;
+  GetTscAndPerformanceCounter(&tsc_end, &counter_end);
+  if (counter_end <= counter_start || tsc_end <= tsc_start)
+    return false;
+
+  timer_info->frequency = static_cast<uint64_t>(
+      static_cast<double>(tsc_end - tsc_start) * counter_frequency.ui64 /
+      (counter_end - counter_start));
+  timer_info->resolution = 1;
+  return true;
+}
+
 bool TimerToFileTime(const FILETIME& file_time_ref,
                      const TimerInfo& timer_info,
                      const uint64_t& timer_ref,
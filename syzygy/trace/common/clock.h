@@ -44,6 +44,18 @@ COMPILE_ASSERT_IS_POD(TimerInfo);
 void GetTickTimerInfo(TimerInfo* timer_info);
 void GetTscTimerInfo(TimerInfo* timer_info);
 
+// Measures the frequency of the TSC against the performance counter. This
+// takes kTscCalibrationMs milliseconds of busy waiting. It is more precise
+// than the nominal CPU frequency, which is rounded to the MHz, and doesn't
+// need access to the registry.
+// @param timer_info Will be populated with the information about the TSC.
+// @returns false if the performance counter is not available, in which case
+//     @p timer_info is left unchanged.
+bool CalibrateTscTimerInfo(TimerInfo* timer_info);
+
+// The duration of the TSC calibration, in milliseconds.
+const uint32_t kTscCalibrationMs = 10;
+
 // @returns the current value of the ticks timer.
 uint64_t GetTicks();
 
@@ -84,11 +96,12 @@ COMPILE_ASSERT_IS_POD(ClockInfo);
 
 // Populates a ClockInfo struct with information about the system clock and
 // timers.
-// NOTE: This requires read access to the registry to get full information, and
-//     is intended to be run from a process that has no restrictions. For
-//     example, if this is run from a sandboxed process the TSC timer
-//     information will be incomplete. A warning will be logged if this is the
-//     case.
+// NOTE: The TSC is calibrated against the performance counter, which takes
+//     kTscCalibrationMs milliseconds. Where that counter is unavailable, this
+//     falls back to the CPU frequency in the registry, which requires a
+//     process that has no restrictions. For example, if this is then run from
+//     a sandboxed process the TSC timer information will be incomplete. A
+//     warning will be logged if this is the case.
 // @param clock_info The struct to be populated.
 void GetClockInfo(ClockInfo* clock_info);
 
@@ -51,6 +51,16 @@ TEST(GetTscTimerInfoTest, WorksAsExpected) {
   CheckValidTscTimerInfo(ti);
 }
 
+TEST(CalibrateTscTimerInfoTest, WorksAsExpected) {
+  TimerInfo ti = {};
+  if (CalibrateTscTimerInfo(&ti)) {
+    EXPECT_EQ(1u, ti.resolution);
+    EXPECT_LT(0u, ti.frequency);
+  } else {
+    EXPECT_EQ(0u, ti.frequency);
+  }
+}
+
 TEST(GetTicksTest, WorksAsExpected) {
   // This will busy loop until the counter advances, or until we perform
   // 2^32 iterations. The counter should definitely have advanced by then.
@@ -482,6 +482,39 @@ class TraceFileDumper : public ParseEventHandler {
               time.ToInternalValue(), process_id, data->process_heap);
   }
 
+  void OnProfilerCalibration(base::Time time,
+                             DWORD process_id,
+                             DWORD thread_id,
+                             const TraceProfilerCalibration* data) override {
+    DCHECK_NE(static_cast<TraceProfilerCalibration*>(nullptr), data);
+    ::fprintf(file_,
+              "[%012lld] OnProfilerCalibration: process-id=%d; "
+              "thread-id=%d;\n"
+              "    invocation-cycles=%llu; caller-cycles=%llu\n",
+              time.ToInternalValue(), process_id, thread_id,
+              data->invocation_cycles, data->caller_cycles);
+  }
+
+  void OnProfilerSampling(base::Time time,
+                          DWORD process_id,
+                          DWORD thread_id,
+                          const TraceProfilerSampling* data) override {
+    DCHECK_NE(static_cast<TraceProfilerSampling*>(nullptr), data);
+    ::fprintf(file_,
+              "[%012lld] OnProfilerSampling: process-id=%d; "
+              "thread-id=%d;\n"
+              "    sampling-threshold=%d; sampling-window-ms=%d; "
+              "num-functions=%d\n",
+              time.ToInternalValue(), process_id, thread_id,
+              data->sampling_threshold, data->sampling_window_ms,
+              data->num_functions);
+    for (uint32_t i = 0; i < data->num_functions; ++i) {
+      ::fprintf(file_, "    function=0x%08X; skipped-calls=%d\n",
+                reinterpret_cast<size_t>(data->functions[i].function),
+                data->functions[i].num_calls);
+    }
+  }
+
  private:
   FILE* file_;
   const char* indentation_;
@@ -18,11 +18,13 @@
 #include <windows.h>  // NOLINT
 #include <wmistr.h>  // NOLINT
 #include <evntrace.h>
+#include <vector>
 
 #include "base/logging.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/protocol/compact_record.h"
 
 namespace trace {
 namespace parser {
@@ -31,11 +33,14 @@ using ::common::BinaryBufferReader;
 
 ParseEngine::ParseEngine(const char* name, bool fail_on_module_conflict)
     : event_handler_(nullptr),
+      last_module_process_id_(0),
+      last_module_(nullptr),
       error_occurred_(false),
       fail_on_module_conflict_(fail_on_module_conflict) {
   DCHECK(name != nullptr);
   DCHECK(name[0] != '\0');
   name_ = name;
+  ResetSegmentState();
 }
 
 ParseEngine::~ParseEngine() {
@@ -62,6 +67,11 @@ void ParseEngine::set_event_handler(ParseEventHandler* event_handler) {
 const ModuleInformation* ParseEngine::GetModuleInformation(
     uint32_t process_id,
     AbsoluteAddress64 addr) const {
+  if (last_module_ != nullptr && last_module_process_id_ == process_id &&
+      last_module_->first.Contains(addr)) {
+    return &last_module_->second;
+  }
+
   ProcessMap::const_iterator processes_it = processes_.find(process_id);
   if (processes_it == processes_.end())
     return nullptr;
@@ -73,6 +83,8 @@ const ModuleInformation* ParseEngine::GetModuleInformation(
   if (module_it == module_space.end())
     return nullptr;
 
+  last_module_process_id_ = process_id;
+  last_module_ = &*module_it;
   return &module_it->second;
 }
 
@@ -119,6 +131,8 @@ bool ParseEngine::AddModuleInformation(DWORD process_id,
   // previously seen a module unload event and marked the module information
   // as dirty.
   while (iter->second.is_dirty) {
+    if (last_module_ == &*iter)
+      last_module_ = nullptr;
     module_space.Remove(iter->first);
     if (module_space.FindOrInsert(range, new_module_info, &iter)) {
       return true;
@@ -195,6 +209,10 @@ bool ParseEngine::RemoveProcessInformation(DWORD process_id) {
   return true;
 }
 
+void ParseEngine::ResetSegmentState() {
+  ::memset(&compact_call_state_, 0, sizeof(compact_call_state_));
+}
+
 bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
@@ -216,6 +234,10 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchBatchEnterEvent(event);
       break;
 
+    case TRACE_COMPACT_BATCH_ENTER:
+      success = DispatchCompactBatchEnterEvent(event);
+      break;
+
     case TRACE_PROCESS_ATTACH_EVENT:
     case TRACE_PROCESS_DETACH_EVENT:
     case TRACE_THREAD_ATTACH_EVENT:
@@ -263,6 +285,10 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchDetailedFunctionCall(event);
       break;
 
+    case TRACE_COMPACT_DETAILED_FUNCTION_CALL:
+      success = DispatchCompactDetailedFunctionCall(event);
+      break;
+
     case TRACE_COMMENT:
       success = DispatchComment(event);
       break;
@@ -271,6 +297,14 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchProcessHeap(event);
       break;
 
+    case TRACE_PROFILER_CALIBRATION:
+      success = DispatchProfilerCalibration(event);
+      break;
+
+    case TRACE_PROFILER_SAMPLING:
+      success = DispatchProfilerSampling(event);
+      break;
+
     default:
       LOG(ERROR) << "Unknown event type encountered.";
       break;
@@ -360,6 +394,31 @@ bool ParseEngine::DispatchBatchEnterEvent(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchCompactBatchEnterEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  // Compact records are only written to RPC trace files, whose segments
+  // carry the thread that wrote them.
+  std::vector<uint8_t> batch;
+  if (!DecodeCompactBatchEnter(reinterpret_cast<const uint8_t*>(
+                                   event->MofData),
+                               event->MofLength, event->Header.ThreadId,
+                               &batch)) {
+    return false;
+  }
+
+  const TraceBatchEnterData* data =
+      reinterpret_cast<const TraceBatchEnterData*>(&batch[0]);
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnBatchFunctionEntry(time, process_id, data->thread_id,
+                                       data);
+  return true;
+}
+
 bool ParseEngine::DispatchProcessEndedEvent(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
@@ -616,6 +675,29 @@ bool ParseEngine::DispatchDetailedFunctionCall(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchCompactDetailedFunctionCall(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  std::vector<uint8_t> call;
+  if (!DecodeCompactDetailedFunctionCall(
+          reinterpret_cast<const uint8_t*>(event->MofData), event->MofLength,
+          &compact_call_state_, &call)) {
+    return false;
+  }
+
+  const TraceDetailedFunctionCall* data =
+      reinterpret_cast<const TraceDetailedFunctionCall*>(&call[0]);
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+  event_handler_->OnDetailedFunctionCall(time, process_id, thread_id, data);
+
+  return true;
+}
+
 bool ParseEngine::DispatchComment(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
@@ -669,6 +751,59 @@ bool ParseEngine::DispatchProcessHeap(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchProfilerCalibration(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceProfilerCalibration* data = nullptr;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty TraceProfilerCalibration event.";
+    return false;
+  }
+  DCHECK(data != nullptr);
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+  event_handler_->OnProfilerCalibration(time, process_id, thread_id, data);
+
+  return true;
+}
+
+bool ParseEngine::DispatchProfilerSampling(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceProfilerSampling* data = nullptr;
+  if (!reader.Read(FIELD_OFFSET(TraceProfilerSampling, functions), &data)) {
+    LOG(ERROR) << "Short or empty TraceProfilerSampling event.";
+    return false;
+  }
+  DCHECK(data != nullptr);
+
+  // Calculate the expected size of the entire payload, headers included.
+  size_t expected_length = FIELD_OFFSET(TraceProfilerSampling, functions) +
+      sizeof(data->functions[0]) * data->num_functions;
+  if (event->MofLength < expected_length) {
+    LOG(ERROR) << "Payload smaller than size implied by TraceProfilerSampling "
+               << "header.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+  event_handler_->OnProfilerSampling(time, process_id, thread_id, data);
+
+  return true;
+}
+
 namespace {
 
 void ModuleTraceDataToModuleInformation(
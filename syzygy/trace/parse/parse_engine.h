@@ -23,6 +23,7 @@
 
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/protocol/compact_record.h"
 
 namespace trace {
 namespace parser {
@@ -120,6 +121,10 @@ class ParseEngine {
   // @returns true on success.
   bool RemoveProcessInformation(DWORD process_id);
 
+  // Resets the values interned by the compact records of a segment. This
+  // must be called before dispatching the events of each segment.
+  void ResetSegmentState();
+
   // The main entry point by which trace events are dispatched to the
   // event handler.
   //
@@ -152,6 +157,17 @@ class ParseEngine {
   //     true.
   bool DispatchBatchEnterEvent(EVENT_TRACE* event);
 
+  // Parses and dispatches compact batch function entry events, which are
+  // expanded to the equivalent batch function entry events. Called from
+  // DispatchEvent().
+  //
+  // @param event The event to dispatch.
+  //
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     If an error occurred, the error_occurred_ flag will be set to
+  //     true.
+  bool DispatchCompactBatchEnterEvent(EVENT_TRACE* event);
+
   // Parses and dispatches a process ended event. Called from DispatchEvent().
   //
   // @param event The event to dispatch.
@@ -233,6 +249,13 @@ class ParseEngine {
   //     Does not explicitly set error occurred.
   bool DispatchDetailedFunctionCall(EVENT_TRACE* event);
 
+  // Parses and dispatches a compact detailed function call, which is expanded
+  // to the equivalent detailed function call.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchCompactDetailedFunctionCall(EVENT_TRACE* event);
+
   // Parses and dispatches a call-trace comment.
   // @param event the event to dispatch.
   // @returns true if the event was successfully dispatched, false otherwise.
@@ -245,6 +268,18 @@ class ParseEngine {
   //     Does not explicitly set error occurred.
   bool DispatchProcessHeap(EVENT_TRACE* event);
 
+  // Parses and dispatches a profiler calibration record.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchProfilerCalibration(EVENT_TRACE* event);
+
+  // Parses and dispatches a profiler sampling record.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchProfilerSampling(EVENT_TRACE* event);
+
   // The name by which this parse engine is known.
   std::string name_;
 
@@ -254,6 +289,13 @@ class ParseEngine {
   // For each process, we store its point of view of the world.
   ProcessMap processes_;
 
+  // The module found by the last call to GetModuleInformation, and its
+  // process. Successive events mostly fall in the same module, which is then
+  // found without searching. The entries of a ModuleSpace don't move, so this
+  // stays valid until a module is removed from its ModuleSpace.
+  mutable uint32_t last_module_process_id_;
+  mutable const ModuleSpace::value_type* last_module_;
+
   // Flag indicating whether or not an error has occurred in parsing the trace
   // event stream.
   bool error_occurred_;
@@ -264,6 +306,10 @@ class ParseEngine {
   // conflicting module information.
   bool fail_on_module_conflict_;
 
+  // The values interned by the compact detailed function calls of the
+  // segment being dispatched.
+  CompactDetailedCallState compact_call_state_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ParseEngine);
 };
@@ -16,11 +16,20 @@
 
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
+#include <deque>
+#include <memory>
+
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/parse/parse_utils.h"
+#include "syzygy/trace/protocol/trace_file_index.h"
 
 using common::AlignUp;
 using common::AlignUp64;
@@ -28,7 +37,9 @@ using common::AlignUp64;
 namespace trace {
 namespace parser {
 
-ParseEngineRpc::ParseEngineRpc() : ParseEngine("RPC", true) {
+ParseEngineRpc::ParseEngineRpc()
+    : ParseEngine("RPC", true), num_decode_threads_(0) {
+  filter_.has_time_range = false;
 }
 
 ParseEngineRpc::~ParseEngineRpc() {
@@ -69,25 +80,98 @@ bool ParseEngineRpc::CloseAllTraceFiles() {
   return true;
 }
 
-bool ParseEngineRpc::ConsumeAllEvents() {
-  TraceFileIter it = trace_file_set_.begin();
-  for (; it != trace_file_set_.end(); ++it) {
-    if (!ConsumeTraceFile(*it)) {
-      LOG(ERROR) << "Failed to consume '" << it->value() << "'.";
-      return false;
-    }
+// The segments of a trace file, decoded ahead of being dispatched.
+struct ParseEngineRpc::DecodedSegment {
+  DecodedSegment() : state_events_only(false) {}
+
+  TraceFileSegmentHeader header;
+  std::vector<uint8_t> data;
+  // True if the segment is outside of the time range of the parse engine,
+  // and only its state events are to be dispatched.
+  bool state_events_only;
+};
+
+// Reads the header and then the segments of a trace file, in order.
+// Compressed segments are decompressed as they are read. If the trace file has
+// a segment index, the segments that the filter excludes are skipped without
+// being read.
+class ParseEngineRpc::TraceFileReader {
+ public:
+  explicit TraceFileReader(const SegmentFilter& filter)
+      : filter_(filter),
+        excluded_(false),
+        next_segment_(0),
+        has_index_(false),
+        next_index_entry_(0) {}
+
+  // Opens a trace file and reads its header and segment index.
+  // @param trace_file_path the trace file to read.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& trace_file_path);
+
+  // Reads the next segment of the trace file.
+  // @param segment receives the segment. Its buffer is reused.
+  // @param done set to true if there are no more segments.
+  // @returns true on success, false otherwise.
+  bool ReadSegment(DecodedSegment* segment, bool* done);
+
+  // @returns the header of the trace file.
+  // @note This is only valid after Open has returned successfully.
+  const TraceFileHeader& file_header() const {
+    return *reinterpret_cast<const TraceFileHeader*>(raw_header_.data());
   }
 
-  return true;
-}
+  // @returns true if the trace file pertains to a process that the filter
+  //     excludes. It then has no segments.
+  // @note This is only valid after Open has returned successfully.
+  bool excluded() const { return excluded_; }
 
-bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
-  DCHECK(!trace_file_path.empty());
+  // @returns true if the trace file has a valid segment index.
+  bool has_index() const { return has_index_; }
 
-  LOG(INFO) << "Processing '" << trace_file_path.BaseName().value() << "'.";
+ private:
+  // Reads the segment at next_segment_, and advances next_segment_ past it.
+  // @param segment receives the segment.
+  // @param done set to true if there are no more segments.
+  // @returns true on success, false otherwise.
+  bool ReadNextSegment(DecodedSegment* segment, bool* done);
 
-  base::ScopedFILE trace_file(base::OpenFile(trace_file_path, "rb"));
-  if (!trace_file.get()) {
+  // @param entry the index entry of a segment.
+  // @returns true if the segment overlaps the time range of the filter.
+  bool IsInTimeRange(const TraceFileIndexEntry& entry) const;
+
+  // Reads and decompresses a compressed segment.
+  // @param segment receives the segment.
+  // @param compressed_length receives the length of the compressed data
+  //     that follows the compressed segment header.
+  // @returns true on success, false otherwise.
+  bool ReadCompressedSegment(DecodedSegment* segment,
+                             size_t* compressed_length);
+
+  const SegmentFilter& filter_;
+  bool excluded_;
+
+  base::ScopedFILE trace_file_;
+  std::vector<uint8_t> raw_header_;
+  uint64_t next_segment_;
+
+  // The segment index of the trace file, and the next entry to read.
+  bool has_index_;
+  std::vector<TraceFileIndexEntry> index_;
+  size_t next_index_entry_;
+
+  // Reused while reading compressed segments.
+  std::vector<uint8_t> compressed_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileReader);
+};
+
+bool ParseEngineRpc::TraceFileReader::Open(
+    const base::FilePath& trace_file_path) {
+  DCHECK(!trace_file_path.empty());
+
+  trace_file_.reset(base::OpenFile(trace_file_path, "rb"));
+  if (!trace_file_.get()) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Unable to open '" << trace_file_path.value() << "': "
                << ::common::LogWe(error) << ".";
@@ -96,29 +180,24 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
 
   // Let's reserve some space for the variable length header.
   const size_t kReasonableHeaderSize = 4096;
-  std::vector<uint8_t> raw_buffer;
-  raw_buffer.reserve(kReasonableHeaderSize);
-  raw_buffer.resize(sizeof(TraceFileHeader));
+  raw_header_.reserve(kReasonableHeaderSize);
+  raw_header_.resize(sizeof(TraceFileHeader));
 
   // Populate the buffer.
-  DCHECK_EQ(raw_buffer.size(), sizeof(TraceFileHeader));
-  size_t bytes_read = ::fread(&raw_buffer[0],
+  DCHECK_EQ(raw_header_.size(), sizeof(TraceFileHeader));
+  size_t bytes_read = ::fread(&raw_header_[0],
                               1,
-                              raw_buffer.size(),
-                              trace_file.get());
-  if (bytes_read != raw_buffer.size()) {
+                              raw_header_.size(),
+                              trace_file_.get());
+  if (bytes_read != raw_header_.size()) {
     LOG(ERROR) << "Failed to read trace file header.";
     return false;
   }
 
-  // Create a typed alias to the raw buffer.
-  const TraceFileHeader* file_header =
-      reinterpret_cast<const TraceFileHeader*>(&raw_buffer[0]);
-
   // Check the file signature.
-  if (0 != memcmp(&file_header->signature,
+  if (0 != memcmp(&file_header().signature,
                   &TraceFileHeader::kSignatureValue,
-                  sizeof(file_header->signature))) {
+                  sizeof(file_header().signature))) {
     LOG(ERROR) << "Not a valid RPC call-trace file.";
     return false;
   }
@@ -126,120 +205,438 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
   // Make sure there's enough room for the variable length part of the header
   // and then append read the rest of the header. Note that the underlying raw
   // buffer might move when it is resized.
-  size_t bytes_to_read = file_header->header_size - raw_buffer.size();
-  raw_buffer.resize(file_header->header_size);
-  file_header = reinterpret_cast<const TraceFileHeader*>(&raw_buffer[0]);
-  bytes_read = ::fread(&raw_buffer[sizeof(TraceFileHeader)],
+  size_t bytes_to_read = file_header().header_size - raw_header_.size();
+  raw_header_.resize(file_header().header_size);
+  bytes_read = ::fread(&raw_header_[sizeof(TraceFileHeader)],
                        1,
                        bytes_to_read,
-                       trace_file.get());
+                       trace_file_.get());
   if (bytes_read != bytes_to_read) {
     LOG(ERROR) << "Failed to read trace file header.";
     return false;
   }
 
-  // Populate the system information which will be fed to the OnProcessStarted
-  // event.
-  TraceSystemInfo system_info = {};
-  system_info.os_version_info = file_header->os_version_info;
-  system_info.system_info = file_header->system_info;
-  system_info.memory_status = file_header->memory_status;
-  system_info.clock_info = file_header->clock_info;
+  next_segment_ =
+      AlignUp64(file_header().header_size, file_header().block_size);
 
-  // Parse the header blob. This fails if there is any extra data, enforcing
-  // a valid header size as a side effect.
-  std::wstring module_path;
-  std::wstring command_line;
-  if (!ParseTraceFileHeaderBlob(*file_header, &module_path, &command_line,
-                                &system_info.environment_strings)) {
-    LOG(ERROR) << "Unable to parse trace file header blob.";
-    return false;
+  // A trace file of another process is skipped as a whole.
+  if (!filter_.process_ids.empty() &&
+      filter_.process_ids.count(file_header().process_id) == 0) {
+    excluded_ = true;
+    return true;
   }
 
-  // Add the executable's module information to the process map. This is in
-  // case the executable itself is instrumented, so that trace events will map
-  // to a module in the process map.
-  ModuleInformation module_info;
-  module_info.base_address.set_value(file_header->module_base_address);
-  module_info.path = module_path;
-  module_info.module_size = file_header->module_size;
-  module_info.module_checksum = file_header->module_checksum;
-  module_info.module_time_date_stamp = file_header->module_time_date_stamp;
-  AddModuleInformation(file_header->process_id, module_info);
+  // The segment index is only worth reading if segments are filtered.
+  int64_t trace_file_size = 0;
+  if (filter_.has_time_range &&
+      base::GetFileSize(trace_file_path, &trace_file_size)) {
+    has_index_ = ReadTraceFileIndex(GetTraceFileIndexPath(trace_file_path),
+                                    trace_file_size, &index_);
+  }
 
-  // Notify the event handler that a process has started.
-  base::Time start_time(base::Time::FromFileTime(
-      file_header->clock_info.file_time));
-  event_handler_->OnProcessStarted(start_time, file_header->process_id,
-                                   &system_info);
+  return true;
+}
 
-  // Consume the body of the trace file.
-  uint64_t next_segment =
-      AlignUp64(file_header->header_size, file_header->block_size);
-  std::unique_ptr<uint8_t[]> buffer;
-  size_t buffer_size = 0;
-  while (true) {
-    if (::_fseeki64(trace_file.get(), next_segment, SEEK_SET) != 0) {
-      LOG(ERROR) << "Failed to seek segment boundary " << next_segment << ".";
+bool ParseEngineRpc::TraceFileReader::ReadSegment(DecodedSegment* segment,
+                                                  bool* done) {
+  DCHECK(segment != NULL);
+  DCHECK(done != NULL);
+  *done = false;
+
+  if (excluded_) {
+    *done = true;
+    return true;
+  }
+
+  if (!has_index_) {
+    if (!ReadNextSegment(segment, done))
       return false;
-    }
+    if (*done || !filter_.has_time_range)
+      return true;
+
+    // Without an index, the segment is only filtered once it has been read.
+    TraceFileIndexEntry entry = {};
+    IndexTraceFileSegment(0, segment->header, segment->data.data(), &entry);
+    segment->state_events_only = !IsInTimeRange(entry);
+    return true;
+  }
 
-    RecordPrefix segment_prefix;
-    if (::fread(&segment_prefix,
-                sizeof(segment_prefix),
-                1,
-                trace_file.get()) != 1) {
-      if (::feof(trace_file.get()))
-        break;
+  // Skip the segments that are outside of the time range, unless they hold
+  // state events that are needed to interpret later segments.
+  while (next_index_entry_ < index_.size()) {
+    const TraceFileIndexEntry& entry = index_[next_index_entry_++];
+    bool in_time_range = IsInTimeRange(entry);
+    if (!in_time_range &&
+        (entry.flags & TraceFileIndexEntry::kHasStateEvents) == 0) {
+      continue;
+    }
 
-      LOG(ERROR) << "Failed to read segment header prefix.";
+    next_segment_ = entry.offset;
+    if (!ReadNextSegment(segment, done))
+      return false;
+    if (*done) {
+      LOG(ERROR) << "Segment index refers past the end of the trace file.";
       return false;
     }
+    segment->state_events_only = !in_time_range;
+    return true;
+  }
+
+  *done = true;
+  return true;
+}
+
+bool ParseEngineRpc::TraceFileReader::IsInTimeRange(
+    const TraceFileIndexEntry& entry) const {
+  if (!filter_.has_time_range)
+    return true;
+
+  FILETIME first_time = {};
+  FILETIME last_time = {};
+  if (!trace::common::TscToFileTime(file_header().clock_info,
+                                    entry.first_timestamp, &first_time) ||
+      !trace::common::TscToFileTime(file_header().clock_info,
+                                    entry.last_timestamp, &last_time)) {
+    // Err on the side of dispatching the segment.
+    return true;
+  }
+
+  return base::Time::FromFileTime(last_time) >= filter_.begin_time &&
+         base::Time::FromFileTime(first_time) <= filter_.end_time;
+}
+
+bool ParseEngineRpc::TraceFileReader::ReadNextSegment(DecodedSegment* segment,
+                                                      bool* done) {
+  DCHECK(segment != NULL);
+  DCHECK(done != NULL);
+  *done = false;
+
+  if (::_fseeki64(trace_file_.get(), next_segment_, SEEK_SET) != 0) {
+    LOG(ERROR) << "Failed to seek segment boundary " << next_segment_ << ".";
+    return false;
+  }
+
+  RecordPrefix segment_prefix;
+  if (::fread(&segment_prefix,
+              sizeof(segment_prefix),
+              1,
+              trace_file_.get()) != 1) {
+    if (::feof(trace_file_.get())) {
+      *done = true;
+      return true;
+    }
+
+    LOG(ERROR) << "Failed to read segment header prefix.";
+    return false;
+  }
+
+  // Compressed and raw segments may be interleaved in a trace file.
+  if (segment_prefix.type == TraceFileCompressedSegmentHeader::kTypeId &&
+      segment_prefix.size == sizeof(TraceFileCompressedSegmentHeader) &&
+      segment_prefix.version.hi == TRACE_VERSION_HI &&
+      segment_prefix.version.lo == TRACE_VERSION_LO) {
+    size_t compressed_length = 0;
+    if (!ReadCompressedSegment(segment, &compressed_length))
+      return false;
+
+    next_segment_ = AlignUp64(
+        next_segment_ + sizeof(segment_prefix) +
+            sizeof(TraceFileCompressedSegmentHeader) + compressed_length,
+        file_header().block_size);
+    return true;
+  }
+
+  if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
+      segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
+      segment_prefix.version.hi != TRACE_VERSION_HI ||
+      segment_prefix.version.lo != TRACE_VERSION_LO) {
+    LOG(ERROR) << "Unrecognized record prefix for segment header.";
+    return false;
+  }
+
+  if (::fread(&segment->header,
+              sizeof(segment->header),
+              1,
+              trace_file_.get()) != 1) {
+    LOG(ERROR) << "Failed to read segment header.";
+    return false;
+  }
+
+  segment->data.resize(segment->header.segment_length);
+  if (segment->header.segment_length != 0 &&
+      ::fread(segment->data.data(), segment->header.segment_length, 1,
+              trace_file_.get()) != 1) {
+    LOG(ERROR) << "Failed to read segment.";
+    return false;
+  }
+
+  next_segment_ = AlignUp64(
+      next_segment_ + sizeof(segment_prefix) + sizeof(segment->header) +
+          segment->header.segment_length,
+      file_header().block_size);
+  return true;
+}
+
+bool ParseEngineRpc::TraceFileReader::ReadCompressedSegment(
+    DecodedSegment* segment,
+    size_t* compressed_length) {
+  DCHECK(segment != NULL);
+  DCHECK(compressed_length != NULL);
+
+  TraceFileCompressedSegmentHeader compressed_header;
+  if (::fread(&compressed_header, sizeof(compressed_header), 1,
+              trace_file_.get()) != 1) {
+    LOG(ERROR) << "Failed to read compressed segment header.";
+    return false;
+  }
+
+  if (compressed_header.uncompressed_length <
+      sizeof(TraceFileSegmentHeader)) {
+    LOG(ERROR) << "Invalid compressed segment header.";
+    return false;
+  }
+
+  compressed_data_.resize(compressed_header.compressed_length);
+  if (compressed_header.compressed_length != 0 &&
+      ::fread(compressed_data_.data(), compressed_data_.size(), 1,
+              trace_file_.get()) != 1) {
+    LOG(ERROR) << "Failed to read compressed segment.";
+    return false;
+  }
 
-    if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
-        segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
-        segment_prefix.version.hi != TRACE_VERSION_HI ||
-        segment_prefix.version.lo != TRACE_VERSION_LO) {
-      LOG(ERROR) << "Unrecognized record prefix for segment header.";
+  // The uncompressed data is the segment header followed by the segment.
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      compressed_data_.begin(), compressed_data_.end()));
+  core::ZInStream zin_stream(in_stream.get());
+  if (!zin_stream.Init() ||
+      !zin_stream.Read(sizeof(segment->header),
+                       reinterpret_cast<core::Byte*>(&segment->header))) {
+    LOG(ERROR) << "Failed to decompress segment header.";
+    return false;
+  }
+
+  if (segment->header.segment_length !=
+      compressed_header.uncompressed_length - sizeof(segment->header)) {
+    LOG(ERROR) << "Compressed segment length mismatch.";
+    return false;
+  }
+
+  segment->data.resize(segment->header.segment_length);
+  if (!zin_stream.Read(segment->data.size(), segment->data.data())) {
+    LOG(ERROR) << "Failed to decompress segment.";
+    return false;
+  }
+
+  *compressed_length = compressed_header.compressed_length;
+  return true;
+}
+
+// Decodes a whole trace file on a worker thread.
+class ParseEngineRpc::DecodeTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  DecodeTask(const base::FilePath& trace_file_path,
+             const SegmentFilter& filter)
+      : trace_file_path_(trace_file_path),
+        reader_(filter),
+        success_(false),
+        done_(true, false) {}
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    success_ = Decode();
+    done_.Signal();
+  }
+  // @}
+
+  // Waits for the trace file to be decoded.
+  void Wait() { done_.Wait(); }
+
+  // @name Accessors. These are only valid once Wait has returned.
+  // @{
+  const base::FilePath& trace_file_path() const { return trace_file_path_; }
+  bool success() const { return success_; }
+  const TraceFileReader& reader() const { return reader_; }
+  const std::vector<DecodedSegment>& segments() const { return segments_; }
+  // @}
+
+ private:
+  bool Decode() {
+    if (!reader_.Open(trace_file_path_))
       return false;
+
+    while (true) {
+      DecodedSegment segment;
+      bool done = false;
+      if (!reader_.ReadSegment(&segment, &done))
+        return false;
+      if (done)
+        return true;
+      segments_.push_back(std::move(segment));
     }
+  }
+
+  base::FilePath trace_file_path_;
+  TraceFileReader reader_;
+  std::vector<DecodedSegment> segments_;
+  bool success_;
+  base::WaitableEvent done_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecodeTask);
+};
 
-    TraceFileSegmentHeader segment_header;
-    if (::fread(&segment_header,
-                sizeof(segment_header),
-                1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment header.";
+bool ParseEngineRpc::ConsumeAllEvents() {
+  if (num_decode_threads_ > 0 && trace_file_set_.size() > 1)
+    return ConsumeAllEventsInParallel();
+
+  TraceFileIter it = trace_file_set_.begin();
+  for (; it != trace_file_set_.end(); ++it) {
+    if (!ConsumeTraceFile(*it)) {
+      LOG(ERROR) << "Failed to consume '" << it->value() << "'.";
       return false;
     }
+  }
 
-    size_t aligned_size = AlignUp(segment_header.segment_length,
-                                  file_header->block_size);
+  return true;
+}
 
-    if (aligned_size > buffer_size) {
-      buffer.reset(new uint8_t[aligned_size]);
-      buffer_size = aligned_size;
+bool ParseEngineRpc::ConsumeAllEventsInParallel() {
+  DCHECK_LT(0u, num_decode_threads_);
+
+  // The trace files are read and decompressed on the worker threads, while
+  // their events are dispatched on this thread in the same order as they are
+  // when consuming the trace files one at a time. A decoded trace file is
+  // held in memory, so only as many trace files as there are worker threads
+  // are decoded ahead of the one being dispatched.
+  base::DelegateSimpleThreadPool pool("ParseEngineRpc",
+                                      static_cast<int>(num_decode_threads_));
+  pool.Start();
+
+  std::deque<std::unique_ptr<DecodeTask>> tasks;
+  size_t next_file = 0;
+  bool success = true;
+  for (size_t i = 0; i < trace_file_set_.size(); ++i) {
+    while (next_file < trace_file_set_.size() &&
+           tasks.size() <= num_decode_threads_) {
+      tasks.push_back(std::unique_ptr<DecodeTask>(
+          new DecodeTask(trace_file_set_[next_file++], filter_)));
+      pool.AddWork(tasks.back().get());
     }
 
-    if (::fread(buffer.get(), segment_header.segment_length, 1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment.";
+    std::unique_ptr<DecodeTask> task(std::move(tasks.front()));
+    tasks.pop_front();
+    task->Wait();
+    if (!task->success() || !ConsumeDecodedTraceFile(*task)) {
+      LOG(ERROR) << "Failed to consume '" << task->trace_file_path().value()
+                 << "'.";
+      success = false;
+      break;
+    }
+  }
+
+  // The tasks that are still queued must complete before they are destroyed.
+  pool.JoinAll();
+  return success;
+}
+
+bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
+  DCHECK(!trace_file_path.empty());
+
+  LOG(INFO) << "Processing '" << trace_file_path.BaseName().value() << "'.";
+
+  TraceFileReader reader(filter_);
+  if (!reader.Open(trace_file_path))
+    return false;
+  if (reader.excluded()) {
+    LOG(INFO) << "Skipping trace file of process "
+              << reader.file_header().process_id << ".";
+    return true;
+  }
+  if (!ConsumeTraceFileHeader(reader.file_header()))
+    return false;
+
+  // Consume the body of the trace file.
+  DecodedSegment segment;
+  while (true) {
+    bool done = false;
+    if (!reader.ReadSegment(&segment, &done))
+      return false;
+    if (done)
+      break;
+
+    if (!ConsumeSegmentEvents(reader.file_header(),
+                              segment.header,
+                              segment.data.data(),
+                              segment.data.size(),
+                              segment.state_events_only)) {
       return false;
     }
+  }
 
-    if (!ConsumeSegmentEvents(*file_header,
-                              segment_header,
-                              buffer.get(),
-                              segment_header.segment_length)) {
+  return true;
+}
+
+bool ParseEngineRpc::ConsumeDecodedTraceFile(const DecodeTask& task) {
+  LOG(INFO) << "Processing '" << task.trace_file_path().BaseName().value()
+            << "'.";
+
+  const TraceFileHeader& file_header = task.reader().file_header();
+  if (task.reader().excluded())
+    return true;
+  if (!ConsumeTraceFileHeader(file_header))
+    return false;
+
+  for (const DecodedSegment& segment : task.segments()) {
+    // The events are dispatched in place, and are not modified.
+    if (!ConsumeSegmentEvents(file_header,
+                              segment.header,
+                              const_cast<uint8_t*>(segment.data.data()),
+                              segment.data.size(),
+                              segment.state_events_only)) {
       return false;
     }
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::ConsumeTraceFileHeader(
+    const TraceFileHeader& file_header) {
+  // Populate the system information which will be fed to the OnProcessStarted
+  // event.
+  TraceSystemInfo system_info = {};
+  system_info.os_version_info = file_header.os_version_info;
+  system_info.system_info = file_header.system_info;
+  system_info.memory_status = file_header.memory_status;
+  system_info.clock_info = file_header.clock_info;
 
-    next_segment = AlignUp64(
-        next_segment + sizeof(segment_prefix) + sizeof(segment_header) +
-            segment_header.segment_length,
-        file_header->block_size);
+  // Parse the header blob. This fails if there is any extra data, enforcing
+  // a valid header size as a side effect.
+  std::wstring module_path;
+  std::wstring command_line;
+  if (!ParseTraceFileHeaderBlob(file_header, &module_path, &command_line,
+                                &system_info.environment_strings)) {
+    LOG(ERROR) << "Unable to parse trace file header blob.";
+    return false;
   }
 
+  // Add the executable's module information to the process map. This is in
+  // case the executable itself is instrumented, so that trace events will map
+  // to a module in the process map.
+  ModuleInformation module_info;
+  module_info.base_address.set_value(file_header.module_base_address);
+  module_info.path = module_path;
+  module_info.module_size = file_header.module_size;
+  module_info.module_checksum = file_header.module_checksum;
+  module_info.module_time_date_stamp = file_header.module_time_date_stamp;
+  AddModuleInformation(file_header.process_id, module_info);
+
+  // Notify the event handler that a process has started.
+  base::Time start_time(base::Time::FromFileTime(
+      file_header.clock_info.file_time));
+  event_handler_->OnProcessStarted(start_time, file_header.process_id,
+                                   &system_info);
+
   return true;
 }
 
@@ -247,10 +644,12 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
     const TraceFileHeader& file_header,
     const TraceFileSegmentHeader& segment_header,
     uint8_t* buffer,
-    size_t buffer_length) {
-  DCHECK(buffer != NULL);
+    size_t buffer_length,
+    bool state_events_only) {
+  DCHECK(buffer != NULL || buffer_length == 0);
   DCHECK(event_handler_ != NULL);
 
+  ResetSegmentState();
   EVENT_TRACE event_record = {};
 
   event_record.Header.ProcessId = file_header.process_id;
@@ -273,6 +672,9 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
       continue;
     }
 
+    if (state_events_only && !IsTraceStateEvent(prefix->type))
+      continue;
+
     event_record.Header.Class.Type = prefix->type;
 
     // The TimeStamp is interpreted as a FILETIME, so we convert the timer
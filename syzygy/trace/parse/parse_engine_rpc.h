@@ -17,6 +17,9 @@
 #ifndef SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 #define SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 
+#include <set>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "base/time/time.h"
 #include "syzygy/trace/parse/parse_engine.h"
@@ -39,7 +42,52 @@ class ParseEngineRpc : public ParseEngine {
   virtual bool CloseAllTraceFiles() override;
   // @}
 
+  // Sets the number of worker threads on which trace files are read and
+  // decompressed ahead of their events being dispatched. Events are always
+  // dispatched on the thread calling ConsumeAllEvents, in the same order.
+  // @param num_decode_threads the number of worker threads. Zero consumes
+  //     the trace files one at a time on the calling thread.
+  void set_num_decode_threads(size_t num_decode_threads) {
+    num_decode_threads_ = num_decode_threads;
+  }
+
+  // @returns the number of worker threads decoding trace files.
+  size_t num_decode_threads() const { return num_decode_threads_; }
+
+  // Restricts consumption to the trace files of the given processes.
+  // @param process_ids the processes whose trace files are consumed. If empty,
+  //     the trace files of all processes are consumed.
+  void set_process_filter(const std::set<uint32_t>& process_ids) {
+    filter_.process_ids = process_ids;
+  }
+
+  // Restricts consumption to the segments holding events in the given time
+  // range. The segments of a trace file are skipped using its segment index,
+  // if it has one. Segments are filtered as a whole, so events just outside
+  // of the time range may be dispatched. Events describing the state of the
+  // process, such as module loads, are dispatched whatever their time.
+  // @param begin_time the beginning of the time range.
+  // @param end_time the end of the time range.
+  void set_time_range(base::Time begin_time, base::Time end_time) {
+    filter_.has_time_range = true;
+    filter_.begin_time = begin_time;
+    filter_.end_time = end_time;
+  }
+
  private:
+  // The filter applied to the trace files and their segments.
+  struct SegmentFilter {
+    std::set<uint32_t> process_ids;
+    bool has_time_range;
+    base::Time begin_time;
+    base::Time end_time;
+  };
+
+  // Defined in the implementation.
+  struct DecodedSegment;
+  class DecodeTask;
+  class TraceFileReader;
+
   // A set of trace file paths.
   typedef std::vector<base::FilePath> TraceFileSet;
 
@@ -59,15 +107,40 @@ class ParseEngineRpc : public ParseEngine {
   // @param segment_header the header information describing the segment.
   // @param buffer the full segment data buffer.
   // @param buffer_length the length of the segment data buffer (in bytes).
+  // @param state_events_only true to only dispatch the events describing the
+  //     state of the process, see IsTraceStateEvent.
   // @return true on success.
   bool ConsumeSegmentEvents(const TraceFileHeader& file_header,
                             const TraceFileSegmentHeader& segment_header,
                             uint8_t* buffer,
-                            size_t buffer_length);
+                            size_t buffer_length,
+                            bool state_events_only);
+
+  // Dispatches the events of the trace files, reading and decompressing them
+  // ahead of dispatch on num_decode_threads_ worker threads.
+  // @returns true on success.
+  bool ConsumeAllEventsInParallel();
+
+  // Dispatches all of the events contained in a decoded trace file.
+  // @param task the task that decoded the trace file.
+  // @returns true on success.
+  bool ConsumeDecodedTraceFile(const DecodeTask& task);
+
+  // Adds the executable of the process that a trace file pertains to to the
+  // process map, and notifies the event handler that the process started.
+  // @param file_header the header of the trace file.
+  // @returns true on success.
+  bool ConsumeTraceFileHeader(const TraceFileHeader& file_header);
 
   // The set of trace files to consume when ConsumeAllEvents() is called.
   TraceFileSet trace_file_set_;
 
+  // The number of worker threads decoding trace files.
+  size_t num_decode_threads_;
+
+  // The filter applied to the trace files and their segments.
+  SegmentFilter filter_;
+
   DISALLOW_COPY_AND_ASSIGN(ParseEngineRpc);
 };
 
@@ -284,16 +284,25 @@ class ParseEngineRpcTest: public testing::PELibUnitTest {
   }
 
   void ConsumeEventsFromTempSession() {
+    ASSERT_NO_FATAL_FAILURE(ConsumeEventsFromTempSession(0, 1));
+  }
+
+  // Consumes the trace file of the temporary session @p num_opens times over,
+  // decoding it on @p num_decode_threads worker threads.
+  void ConsumeEventsFromTempSession(size_t num_decode_threads,
+                                    size_t num_opens) {
     // Stop the call trace service to ensure all buffers have been flushed.
     ASSERT_NO_FATAL_FAILURE(StopCallTraceService());
 
     // Parse the call trace log.
     TestParseEventHandler consumer;
     Parser parser;
+    parser.set_num_decode_threads(num_decode_threads);
     ASSERT_TRUE(parser.Init(&consumer));
     base::FilePath trace_file_path;
     ASSERT_TRUE(FindTraceFile(&trace_file_path));
-    ASSERT_TRUE(parser.OpenTraceFile(trace_file_path));
+    for (size_t i = 0; i < num_opens; ++i)
+      ASSERT_TRUE(parser.OpenTraceFile(trace_file_path));
     ASSERT_TRUE(parser.Consume());
 
     // Get the information for this process.
@@ -534,6 +543,27 @@ TEST_F(ParseEngineRpcTest, SingleThread) {
   ASSERT_EQ(2, entered_addresses_.count(IndirectDllMain));
 }
 
+TEST_F(ParseEngineRpcTest, SingleThreadWithDecodeThreads) {
+  ASSERT_NO_FATAL_FAILURE(StartCallTraceService());
+
+  ASSERT_NO_FATAL_FAILURE(LoadCallTraceDll());
+
+  IndirectThunkDllMain(module_, DLL_PROCESS_ATTACH, this);
+  IndirectThunkA();
+  IndirectThunkA();
+  IndirectThunkA();
+  IndirectThunkDllMain(module_, DLL_PROCESS_DETACH, this);
+
+  ASSERT_NO_FATAL_FAILURE(UnloadCallTraceDll());
+
+  // Each of the trace files is dispatched in full.
+  ASSERT_NO_FATAL_FAILURE(ConsumeEventsFromTempSession(2, 3));
+
+  ASSERT_EQ(15, entered_addresses_.size());
+  ASSERT_EQ(9, entered_addresses_.count(IndirectFunctionA));
+  ASSERT_EQ(6, entered_addresses_.count(IndirectDllMain));
+}
+
 TEST_F(ParseEngineRpcTest, MultiThreadWithDetach) {
   ASSERT_NO_FATAL_FAILURE(StartCallTraceService());
 
@@ -222,6 +222,16 @@ class ParseEngineUnitTest
                void(base::Time time,
                     DWORD process_id,
                     const TraceProcessHeap* data));
+  MOCK_METHOD4(OnProfilerCalibration,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceProfilerCalibration* data));
+  MOCK_METHOD4(OnProfilerSampling,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceProfilerSampling* data));
 
   static const DWORD kProcessId;
   static const DWORD kThreadId;
@@ -400,6 +410,29 @@ TEST_F(ParseEngineUnitTest, ModuleInfo) {
   ASSERT_TRUE(*module_info == new_dll_info);
 }
 
+TEST_F(ParseEngineUnitTest, ModuleInfoLastModuleCache) {
+  ASSERT_TRUE(AddModuleInformation(kProcessId, kExeInfo));
+  ASSERT_TRUE(AddModuleInformation(kProcessId + 1, kDllInfo));
+
+  // Repeated lookups in a module find it again.
+  const uint64_t kExeAddress = kExeInfo.base_address.value() + 1;
+  for (size_t i = 0; i < 2; ++i) {
+    const ModuleInformation* module_info =
+        GetModuleInformation(kProcessId, kExeAddress);
+    ASSERT_TRUE(module_info != NULL);
+    ASSERT_TRUE(*module_info == kExeInfo);
+  }
+
+  // The cached module doesn't leak into another process.
+  EXPECT_TRUE(GetModuleInformation(kProcessId + 1, kExeAddress) == NULL);
+  const ModuleInformation* module_info = GetModuleInformation(
+      kProcessId + 1, kDllInfo.base_address.value());
+  ASSERT_TRUE(module_info != NULL);
+  ASSERT_TRUE(*module_info == kDllInfo);
+  EXPECT_TRUE(GetModuleInformation(
+      kProcessId, kDllInfo.base_address.value()) == NULL);
+}
+
 TEST_F(ParseEngineUnitTest, UnhandledEvent) {
   EVENT_TRACE local_record = {};
   ASSERT_FALSE(DispatchEvent(&local_record));
@@ -791,4 +824,40 @@ TEST_F(ParseEngineUnitTest, ProcessHeap) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, ProfilerCalibration) {
+  TraceProfilerCalibration calibration = {40, 120};
+
+  EXPECT_CALL(*this, OnProfilerCalibration(_, kProcessId, kThreadId,
+                                           &calibration));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_PROFILER_CALIBRATION, &calibration, sizeof(calibration)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_PROFILER_CALIBRATION, &calibration, sizeof(calibration) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
+TEST_F(ParseEngineUnitTest, ProfilerSampling) {
+  TraceProfilerSampling sampling = {};
+  sampling.sampling_threshold = 10;
+  sampling.sampling_window_ms = 100;
+  sampling.num_functions = 1;
+  sampling.functions[0].function = reinterpret_cast<FuncAddr>(0x10001000);
+  sampling.functions[0].num_calls = 1000;
+
+  EXPECT_CALL(*this, OnProfilerSampling(_, kProcessId, kThreadId, &sampling));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_PROFILER_SAMPLING, &sampling, sizeof(sampling)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a record shorter than its functions and make sure the parser
+  // errors.
+  sampling.num_functions = 2;
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_PROFILER_SAMPLING, &sampling, sizeof(sampling)));
+  ASSERT_TRUE(error_occurred());
+}
+
 }  // namespace
@@ -25,7 +25,10 @@ namespace parser {
 
 using ::common::BinaryBufferParser;
 
-Parser::Parser() : active_parse_engine_(NULL) {
+Parser::Parser()
+    : active_parse_engine_(NULL),
+      num_decode_threads_(0),
+      has_time_range_(false) {
 }
 
 Parser::~Parser() {
@@ -47,7 +50,7 @@ bool Parser::Init(ParseEventHandler* event_handler) {
   DCHECK(event_handler != NULL);
   DCHECK(active_parse_engine_ == NULL);
 
-  ParseEngine* engine = NULL;
+  ParseEngineRpc* engine = NULL;
 
   // Create the RPC call-trace parse engine.
   LOG(INFO) << "Initializing RPC call-trace parse engine.";
@@ -56,6 +59,10 @@ bool Parser::Init(ParseEventHandler* event_handler) {
     LOG(ERROR) << "Failed to initialize RPC call-trace parse engine.";
     return false;
   }
+  engine->set_num_decode_threads(num_decode_threads_);
+  engine->set_process_filter(process_filter_);
+  if (has_time_range_)
+    engine->set_time_range(begin_time_, end_time_);
   parse_engine_set_.push_back(engine);
 
   // Setup the event handler for all of the engines.
@@ -252,5 +259,19 @@ void ParseEventHandlerImpl::OnProcessHeap(base::Time time,
                                           const TraceProcessHeap* data) {
 }
 
+void ParseEventHandlerImpl::OnProfilerCalibration(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceProfilerCalibration* data) {
+}
+
+void ParseEventHandlerImpl::OnProfilerSampling(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceProfilerSampling* data) {
+}
+
 }  // namespace parser
 }  // namespace trace
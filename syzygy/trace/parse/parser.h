@@ -18,6 +18,7 @@
 #define SYZYGY_TRACE_PARSE_PARSER_H_
 
 #include <list>
+#include <set>
 
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
@@ -73,6 +74,37 @@ class Parser {
   // @param parse_engine pointer to a heap allocated ParseEngine.
   void AddParseEngine(ParseEngine* parse_engine);
 
+  // Sets the number of worker threads on which the built-in parse engines
+  // read and decode trace files ahead of dispatching their events. Events are
+  // always dispatched on the thread calling Consume, in order. This should be
+  // called prior to the call to Init.
+  // @param num_decode_threads the number of worker threads. Zero decodes the
+  //     trace files on the thread calling Consume.
+  void set_num_decode_threads(size_t num_decode_threads) {
+    num_decode_threads_ = num_decode_threads;
+  }
+
+  // Restricts the built-in parse engines to the trace files of the given
+  // processes. This should be called prior to the call to Init.
+  // @param process_ids the processes whose trace files are parsed. If empty,
+  //     the trace files of all processes are parsed.
+  void set_process_filter(const std::set<uint32_t>& process_ids) {
+    process_filter_ = process_ids;
+  }
+
+  // Restricts the built-in parse engines to the trace file segments holding
+  // events in the given time range. Trace files with a segment index are
+  // seeked through rather than read in full. Events describing the state of
+  // the process are dispatched whatever their time. This should be called
+  // prior to the call to Init.
+  // @param begin_time the beginning of the time range.
+  // @param end_time the end of the time range.
+  void set_time_range(base::Time begin_time, base::Time end_time) {
+    has_time_range_ = true;
+    begin_time_ = begin_time;
+    end_time_ = end_time;
+  }
+
   // Initialize the parser implementation.
   bool Init(ParseEventHandler* event_handler);
 
@@ -115,6 +147,15 @@ class Parser {
   // will be set based on the first trace file that gets opened.
   ParseEngine* active_parse_engine_;
 
+  // The number of worker threads decoding trace files.
+  size_t num_decode_threads_;
+
+  // The filter applied by the built-in parse engines.
+  std::set<uint32_t> process_filter_;
+  bool has_time_range_;
+  base::Time begin_time_;
+  base::Time end_time_;
+
   DISALLOW_COPY_AND_ASSIGN(Parser);
 };
 
@@ -234,6 +275,20 @@ class ParseEventHandler {
   virtual void OnProcessHeap(base::Time time,
                              DWORD process_id,
                              const TraceProcessHeap* data) = 0;
+
+  // Issued for profiler calibration records.
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceProfilerCalibration* data) = 0;
+
+  // Issued for profiler sampling records.
+  virtual void OnProfilerSampling(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceProfilerSampling* data) = 0;
 };
 
 // A default implementation of the ParseEventHandler interface. Provides
@@ -311,6 +366,14 @@ class ParseEventHandlerImpl : public ParseEventHandler {
   void OnProcessHeap(base::Time time,
                      DWORD process_id,
                      const TraceProcessHeap* data) override;
+  void OnProfilerCalibration(base::Time time,
+                             DWORD process_id,
+                             DWORD thread_id,
+                             const TraceProfilerCalibration* data) override;
+  void OnProfilerSampling(base::Time time,
+                          DWORD process_id,
+                          DWORD thread_id,
+                          const TraceProfilerSampling* data) override;
   // @}
 };
 
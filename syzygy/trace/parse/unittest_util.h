@@ -99,6 +99,16 @@ class MockParseEventHandler : public trace::parser::ParseEventHandler {
                void(base::Time time,
                     DWORD process_id,
                     const TraceProcessHeap* data));
+  MOCK_METHOD4(OnProfilerCalibration,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceProfilerCalibration* data));
+  MOCK_METHOD4(OnProfilerSampling,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceProfilerSampling* data));
 };
 
 typedef testing::StrictMock<MockParseEventHandler> StrictMockParseEventHandler;
@@ -0,0 +1,72 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/buffer_ring.h"
+
+#include <string.h>
+
+#include "base/logging.h"
+
+void InitializeBufferRingSection(BufferRingSection* section) {
+  DCHECK(section != NULL);
+  ::memset(section, 0, sizeof(*section));
+  section->version = BufferRingSection::kVersion;
+}
+
+uint32_t GetBufferRingSize(const BufferRing& ring) {
+  uint32_t write_index = static_cast<uint32_t>(
+      base::subtle::Acquire_Load(&ring.write_index));
+  uint32_t read_index = static_cast<uint32_t>(
+      base::subtle::Acquire_Load(&ring.read_index));
+  return write_index - read_index;
+}
+
+bool PushBufferRingEntry(const BufferRingEntry& entry, BufferRing* ring) {
+  DCHECK(ring != NULL);
+
+  // The producer owns the write index, and the consumer only ever frees up
+  // entries, so a ring that isn't full stays so until the push.
+  uint32_t write_index = static_cast<uint32_t>(
+      base::subtle::NoBarrier_Load(&ring->write_index));
+  uint32_t read_index = static_cast<uint32_t>(
+      base::subtle::Acquire_Load(&ring->read_index));
+  if (write_index - read_index >= BufferRing::kCapacity)
+    return false;
+
+  // Publish the entry before the index that exposes it.
+  ring->entries[write_index % BufferRing::kCapacity] = entry;
+  base::subtle::Release_Store(&ring->write_index,
+                              static_cast<base::subtle::Atomic32>(
+                                  write_index + 1));
+  return true;
+}
+
+bool PopBufferRingEntry(BufferRing* ring, BufferRingEntry* entry) {
+  DCHECK(ring != NULL);
+  DCHECK(entry != NULL);
+
+  uint32_t read_index = static_cast<uint32_t>(
+      base::subtle::NoBarrier_Load(&ring->read_index));
+  uint32_t write_index = static_cast<uint32_t>(
+      base::subtle::Acquire_Load(&ring->write_index));
+  if (read_index == write_index)
+    return false;
+
+  // Read the entry before the index that releases it to the producer.
+  *entry = ring->entries[read_index % BufferRing::kCapacity];
+  base::subtle::Release_Store(&ring->read_index,
+                              static_cast<base::subtle::Atomic32>(
+                                  read_index + 1));
+  return true;
+}
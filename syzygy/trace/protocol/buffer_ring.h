@@ -0,0 +1,84 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the layout of the shared memory section used by the buffer ring
+// transport between a call trace client and the call trace service. Rather
+// than exchanging each full buffer through an RPC round-trip, the client
+// pushes full buffers onto a ring of committed buffers and pops fresh buffers
+// from a ring of fresh buffers, while a service thread does the converse.
+// Each side signals an event after updating a ring.
+//
+// Each ring has a single producer and a single consumer: the client
+// serializes its own access to the rings. The read and write indices only
+// ever grow, and wrap around naturally.
+
+#ifndef SYZYGY_TRACE_PROTOCOL_BUFFER_RING_H_
+#define SYZYGY_TRACE_PROTOCOL_BUFFER_RING_H_
+
+#include <stdint.h>
+
+#include "base/atomicops.h"
+
+// Describes a call trace buffer. This has the same fields as the
+// CallTraceBuffer RPC structure, but doesn't depend on the RPC headers.
+struct BufferRingEntry {
+  uint32_t shared_memory_handle;
+  uint32_t mapping_size;
+  uint32_t buffer_offset;
+  uint32_t buffer_size;
+};
+
+// A single producer, single consumer ring of buffer descriptors.
+struct BufferRing {
+  static const uint32_t kCapacity = 64;
+
+  // The index of the next entry to pop. Only written by the consumer.
+  base::subtle::Atomic32 read_index;
+  // The index of the next entry to push. Only written by the producer.
+  base::subtle::Atomic32 write_index;
+  BufferRingEntry entries[kCapacity];
+};
+
+// The shared memory section of a buffer ring transport.
+struct BufferRingSection {
+  static const uint32_t kVersion = 1;
+
+  uint32_t version;
+  // Full buffers committed by the client, to be written by the service.
+  BufferRing committed;
+  // Fresh buffers provided by the service, to be used by the client.
+  BufferRing fresh;
+};
+
+// Initializes a buffer ring section, with both rings empty.
+// @param section the section to initialize.
+void InitializeBufferRingSection(BufferRingSection* section);
+
+// @param ring the ring to inspect.
+// @returns the number of entries in @p ring.
+uint32_t GetBufferRingSize(const BufferRing& ring);
+
+// Pushes an entry onto a ring. Must only be called by the producer.
+// @param entry the entry to push.
+// @param ring the ring to push to.
+// @returns true on success, false if the ring is full.
+bool PushBufferRingEntry(const BufferRingEntry& entry, BufferRing* ring);
+
+// Pops an entry from a ring. Must only be called by the consumer.
+// @param ring the ring to pop from.
+// @param entry receives the popped entry.
+// @returns true on success, false if the ring is empty.
+bool PopBufferRingEntry(BufferRing* ring, BufferRingEntry* entry);
+
+#endif  // SYZYGY_TRACE_PROTOCOL_BUFFER_RING_H_
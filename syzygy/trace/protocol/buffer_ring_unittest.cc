@@ -0,0 +1,99 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/buffer_ring.h"
+
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+BufferRingEntry MakeEntry(uint32_t i) {
+  BufferRingEntry entry = { i, 2 * i, 3 * i, 4 * i };
+  return entry;
+}
+
+// Pushes a sequence of entries onto a ring, spinning while it is full.
+class Producer : public base::DelegateSimpleThread::Delegate {
+ public:
+  Producer(uint32_t count, BufferRing* ring) : count_(count), ring_(ring) {}
+
+  void Run() override {
+    for (uint32_t i = 0; i < count_; ++i) {
+      while (!PushBufferRingEntry(MakeEntry(i), ring_))
+        base::PlatformThread::YieldCurrentThread();
+    }
+  }
+
+ private:
+  uint32_t count_;
+  BufferRing* ring_;
+};
+
+}  // namespace
+
+TEST(BufferRingTest, PushAndPop) {
+  BufferRingSection section;
+  InitializeBufferRingSection(&section);
+  EXPECT_EQ(BufferRingSection::kVersion, section.version);
+  EXPECT_EQ(0U, GetBufferRingSize(section.committed));
+  EXPECT_EQ(0U, GetBufferRingSize(section.fresh));
+
+  BufferRingEntry entry = {};
+  EXPECT_FALSE(PopBufferRingEntry(&section.committed, &entry));
+
+  // Fill the ring, wrapping around a few times.
+  for (uint32_t round = 0; round < 3; ++round) {
+    for (uint32_t i = 0; i < BufferRing::kCapacity; ++i) {
+      EXPECT_TRUE(PushBufferRingEntry(MakeEntry(i), &section.committed));
+      EXPECT_EQ(i + 1, GetBufferRingSize(section.committed));
+    }
+    EXPECT_FALSE(PushBufferRingEntry(MakeEntry(0), &section.committed));
+
+    for (uint32_t i = 0; i < BufferRing::kCapacity; ++i) {
+      EXPECT_TRUE(PopBufferRingEntry(&section.committed, &entry));
+      EXPECT_EQ(i, entry.shared_memory_handle);
+      EXPECT_EQ(4 * i, entry.buffer_size);
+    }
+    EXPECT_FALSE(PopBufferRingEntry(&section.committed, &entry));
+  }
+
+  // The rings are independent.
+  EXPECT_EQ(0U, GetBufferRingSize(section.fresh));
+}
+
+TEST(BufferRingTest, ConcurrentProducerAndConsumer) {
+  BufferRingSection section;
+  InitializeBufferRingSection(&section);
+
+  const uint32_t kCount = 100000;
+  Producer producer(kCount, &section.fresh);
+  base::DelegateSimpleThread thread(&producer, "BufferRingProducer");
+  thread.Start();
+
+  // Entries are received in order, and intact.
+  for (uint32_t i = 0; i < kCount; ++i) {
+    BufferRingEntry entry = {};
+    while (!PopBufferRingEntry(&section.fresh, &entry))
+      base::PlatformThread::YieldCurrentThread();
+    ASSERT_EQ(i, entry.shared_memory_handle);
+    ASSERT_EQ(2 * i, entry.mapping_size);
+    ASSERT_EQ(3 * i, entry.buffer_offset);
+    ASSERT_EQ(4 * i, entry.buffer_size);
+  }
+
+  thread.Join();
+  EXPECT_EQ(0U, GetBufferRingSize(section.fresh));
+}
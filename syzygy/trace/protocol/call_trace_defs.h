@@ -93,6 +93,14 @@ enum TraceEventType {
   TRACE_DETAILED_FUNCTION_CALL,
   TRACE_COMMENT,
   TRACE_PROCESS_HEAP,
+  // Header prefix for a compressed "page" of call trace events.
+  TRACE_COMPRESSED_PAGE_HEADER,
+  // A batch of function entries in the compact encoding of compact_record.h.
+  TRACE_COMPACT_BATCH_ENTER,
+  TRACE_PROFILER_CALIBRATION,
+  TRACE_PROFILER_SAMPLING,
+  // A detailed function call in the compact encoding of compact_record.h.
+  TRACE_COMPACT_DETAILED_FUNCTION_CALL,
 };
 
 // All traces are emitted at this trace level.
@@ -111,6 +119,11 @@ enum TraceEventFlags {
   TRACE_FLAG_THREAD_EVENTS  = 0x0010,
   // Batch entry traces.
   TRACE_FLAG_BATCH_ENTER    = 0x0020,
+  // Encode batch entry traces compactly, as TRACE_COMPACT_BATCH_ENTER records,
+  // and detailed function calls as TRACE_COMPACT_DETAILED_FUNCTION_CALL ones.
+  // Clients that don't know of this flag ignore it, so the service sets it
+  // only if the parser of its traces decodes compact records.
+  TRACE_FLAG_COMPACT_RECORDS = 0x0040,
 };
 
 // Max depth of stack trace captured on entry/exit.
@@ -251,6 +264,25 @@ struct TraceFileSegmentHeader {
 };
 COMPILE_ASSERT_IS_POD(TraceFileSegmentHeader);
 
+// A trace file may store segments compressed. A compressed segment starts at
+// a block boundary, like any other segment, with a RecordPrefix and this
+// header. It is followed by the zlib-compressed TraceFileSegmentHeader and
+// data of the segment, and padded to the next block boundary. Each segment is
+// compressed independently, so the segments of a trace file can still be
+// located without decompressing them.
+struct TraceFileCompressedSegmentHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_COMPRESSED_PAGE_HEADER };
+
+  // The number of compressed bytes following this header.
+  uint32_t compressed_length;
+
+  // The number of bytes of the decompressed segment. This includes the size
+  // of the TraceFileSegmentHeader.
+  uint32_t uncompressed_length;
+};
+COMPILE_ASSERT_IS_POD(TraceFileCompressedSegmentHeader);
+
 // The structure traced on function entry or exit.
 template<int TypeId>
 struct TraceEnterExitEventDataTempl {
@@ -311,6 +343,16 @@ struct TraceBatchEnterData {
 };
 COMPILE_ASSERT_IS_POD(TraceBatchEnterData);
 
+// The structure traced for compact batch entry traces. See compact_record.h
+// for the encoding of the data.
+struct TraceCompactBatchEnterData {
+  enum { kTypeId = TRACE_COMPACT_BATCH_ENTER };
+
+  // The interned thread ID of the batch, followed by the encoded calls.
+  uint8_t data[1];
+};
+COMPILE_ASSERT_IS_POD(TraceCompactBatchEnterData);
+
 enum InvocationInfoFlags {
   // If this bit is set in InvocationInfo flags, the caller is a dynamic
   // symbol id, and caller_offset is the offset of the return site, relative to
@@ -499,6 +541,17 @@ struct TraceDetailedFunctionCall {
 };
 COMPILE_ASSERT_IS_POD(TraceDetailedFunctionCall);
 
+// The structure traced for compact detailed function calls. See
+// compact_record.h for the encoding of the data.
+struct TraceCompactDetailedFunctionCall {
+  enum { kTypeId = TRACE_COMPACT_DETAILED_FUNCTION_CALL };
+
+  // The encoded call, which refers to the values interned by the previous
+  // compact calls of its segment.
+  uint8_t data[1];
+};
+COMPILE_ASSERT_IS_POD(TraceCompactDetailedFunctionCall);
+
 // Records a comment in a trace file. These are output via the call-trace
 // service and act as delimiters in a call-trace log.
 struct TraceComment {
@@ -519,4 +572,47 @@ struct TraceProcessHeap {
 };
 COMPILE_ASSERT_IS_POD(TraceProcessHeap);
 
+// Records the overhead of the profiler's hooks on a thread, as calibrated when
+// the thread starts being profiled. The invocations of the thread are biased
+// by this overhead, which consumers may subtract.
+struct TraceProfilerCalibration {
+  enum { kTypeId = TRACE_PROFILER_CALIBRATION };
+
+  // The cycles attributed to an invocation of an empty function.
+  uint64_t invocation_cycles;
+
+  // The cycles an invocation of an empty function adds to its caller, which
+  // include those attributed to the invocation.
+  uint64_t caller_cycles;
+};
+COMPILE_ASSERT_IS_POD(TraceProfilerCalibration);
+
+// The calls of a function that the profiler counted but didn't profile.
+struct TraceSkippedCalls {
+  FuncAddr function;
+  uint32_t num_calls;
+};
+COMPILE_ASSERT_IS_POD(TraceSkippedCalls);
+
+// Records the calls a thread didn't profile since its previous sampling
+// record. When sampling, the profiler profiles the first calls of a function
+// in each sampling window, and only counts the others. The invocations of the
+// sampled functions may be scaled by their skipped calls.
+struct TraceProfilerSampling {
+  enum { kTypeId = TRACE_PROFILER_SAMPLING };
+
+  // The number of calls of a function profiled per sampling window.
+  uint32_t sampling_threshold;
+
+  // The length of a sampling window, in milliseconds.
+  uint32_t sampling_window_ms;
+
+  // The number of functions with skipped calls.
+  uint32_t num_functions;
+
+  // In fact as many as num_functions.
+  TraceSkippedCalls functions[1];
+};
+COMPILE_ASSERT_IS_POD(TraceProfilerSampling);
+
 #endif  // SYZYGY_TRACE_PROTOCOL_CALL_TRACE_DEFS_H_
@@ -0,0 +1,373 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/compact_record.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace {
+
+// Encodes the difference between two addresses.
+size_t EncodeAddressDelta(uintptr_t address, uintptr_t previous,
+                          uint8_t* buffer) {
+  int64_t delta = static_cast<int64_t>(address) -
+                  static_cast<int64_t>(previous);
+  return EncodeVarint(ZigZagEncode(delta), buffer);
+}
+
+// Decodes an address from its difference with the previous one.
+bool DecodeAddressDelta(const uint8_t** cursor, const uint8_t* end,
+                        uintptr_t* address) {
+  uint64_t value = 0;
+  if (!DecodeVarint(cursor, end, &value))
+    return false;
+  *address = static_cast<uintptr_t>(
+      static_cast<int64_t>(*address) + ZigZagDecode(value));
+  return true;
+}
+
+// Looks up an interned stack trace ID.
+// @returns the index of @p stack_trace_id in @p state, or the number of
+//     interned stack trace IDs if it isn't interned.
+size_t FindStackTraceId(const CompactDetailedCallState& state,
+                        uint32_t stack_trace_id) {
+  size_t i = 0;
+  for (; i < state.num_stack_trace_ids; ++i) {
+    if (state.stack_trace_ids[i] == stack_trace_id)
+      break;
+  }
+  return i;
+}
+
+void InternStackTraceId(uint32_t stack_trace_id,
+                        CompactDetailedCallState* state) {
+  if (state->num_stack_trace_ids < kMaxCompactInternedValues)
+    state->stack_trace_ids[state->num_stack_trace_ids++] = stack_trace_id;
+}
+
+// Looks up an interned argument.
+// @returns the index of the argument in @p state, or the number of interned
+//     arguments if it isn't interned.
+size_t FindArgument(const CompactDetailedCallState& state,
+                    uint64_t argument,
+                    size_t size) {
+  size_t i = 0;
+  for (; i < state.num_arguments; ++i) {
+    if (state.arguments[i] == argument && state.argument_sizes[i] == size)
+      break;
+  }
+  return i;
+}
+
+void InternArgument(uint64_t argument,
+                    size_t size,
+                    CompactDetailedCallState* state) {
+  if (state->num_arguments < kMaxCompactInternedValues) {
+    state->argument_sizes[state->num_arguments] = static_cast<uint8_t>(size);
+    state->arguments[state->num_arguments] = argument;
+    ++state->num_arguments;
+  }
+}
+
+}  // namespace
+
+size_t EncodeVarint(uint64_t value, uint8_t* buffer) {
+  DCHECK(buffer != NULL);
+
+  size_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  buffer[size++] = static_cast<uint8_t>(value);
+  return size;
+}
+
+bool DecodeVarint(const uint8_t** cursor, const uint8_t* end,
+                  uint64_t* value) {
+  DCHECK(cursor != NULL);
+  DCHECK(value != NULL);
+
+  uint64_t result = 0;
+  const uint8_t* read_ptr = *cursor;
+  for (size_t i = 0; i < kMaxVarintSize; ++i) {
+    if (read_ptr >= end)
+      return false;
+    uint8_t byte = *read_ptr++;
+    result |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+    if ((byte & 0x80) == 0) {
+      *cursor = read_ptr;
+      *value = result;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+size_t EncodeCompactBatchEnterStart(uint32_t thread_id,
+                                    uint32_t segment_thread_id,
+                                    CompactBatchEnterState* state,
+                                    uint8_t* buffer) {
+  DCHECK(state != NULL);
+
+  state->function = 0;
+  state->retaddr = 0;
+
+  uint64_t interned_thread_id = 0;
+  if (thread_id != segment_thread_id)
+    interned_thread_id = static_cast<uint64_t>(thread_id) + 1;
+  return EncodeVarint(interned_thread_id, buffer);
+}
+
+size_t EncodeCompactCall(FuncAddr function,
+                         RetAddr retaddr,
+                         CompactBatchEnterState* state,
+                         uint8_t* buffer) {
+  DCHECK(state != NULL);
+
+  uintptr_t function_address = reinterpret_cast<uintptr_t>(function);
+  uintptr_t return_address = reinterpret_cast<uintptr_t>(retaddr);
+  size_t size = EncodeAddressDelta(function_address, state->function, buffer);
+  size += EncodeAddressDelta(return_address, state->retaddr, buffer + size);
+  state->function = function_address;
+  state->retaddr = return_address;
+  return size;
+}
+
+bool DecodeCompactBatchEnter(const uint8_t* data,
+                             size_t size,
+                             uint32_t segment_thread_id,
+                             std::vector<uint8_t>* batch) {
+  DCHECK(data != NULL || size == 0);
+  DCHECK(batch != NULL);
+
+  const uint8_t* read_ptr = data;
+  const uint8_t* end_ptr = data + size;
+
+  uint64_t interned_thread_id = 0;
+  if (!DecodeVarint(&read_ptr, end_ptr, &interned_thread_id)) {
+    LOG(ERROR) << "Compact batch record has no thread.";
+    return false;
+  }
+
+  std::vector<TraceEnterEventData> calls;
+  CompactBatchEnterState state = {};
+  while (read_ptr < end_ptr) {
+    if (!DecodeAddressDelta(&read_ptr, end_ptr, &state.function) ||
+        !DecodeAddressDelta(&read_ptr, end_ptr, &state.retaddr)) {
+      LOG(ERROR) << "Truncated call in compact batch record.";
+      return false;
+    }
+    if (state.function == 0)
+      continue;
+
+    TraceEnterEventData call = {};
+    call.function = reinterpret_cast<FuncAddr>(state.function);
+    call.retaddr = reinterpret_cast<RetAddr>(state.retaddr);
+    calls.push_back(call);
+  }
+
+  // The expanded batch keeps room for a call even when it has none, as
+  // TraceBatchEnterData does.
+  size_t offset_to_calls = offsetof(TraceBatchEnterData, calls);
+  batch->assign(offset_to_calls +
+                    std::max<size_t>(1, calls.size()) *
+                        sizeof(TraceEnterEventData),
+                0);
+  TraceBatchEnterData* expanded =
+      reinterpret_cast<TraceBatchEnterData*>(&batch->at(0));
+  expanded->thread_id = interned_thread_id == 0
+                            ? segment_thread_id
+                            : static_cast<DWORD>(interned_thread_id - 1);
+  expanded->num_calls = calls.size();
+  for (size_t i = 0; i < calls.size(); ++i)
+    expanded->calls[i] = calls[i];
+
+  return true;
+}
+
+size_t EncodeCompactDetailedCallStart(uint64_t timestamp,
+                                      uint32_t function_id,
+                                      uint32_t stack_trace_id,
+                                      uint32_t num_arguments,
+                                      CompactDetailedCallState* state,
+                                      uint8_t* buffer) {
+  DCHECK(state != NULL);
+
+  int64_t delta = static_cast<int64_t>(timestamp - state->timestamp);
+  size_t size = EncodeVarint(ZigZagEncode(delta), buffer);
+  state->timestamp = timestamp;
+  size += EncodeVarint(function_id, buffer + size);
+
+  size_t index = FindStackTraceId(*state, stack_trace_id);
+  if (index < state->num_stack_trace_ids) {
+    size += EncodeVarint(index + 1, buffer + size);
+  } else {
+    size += EncodeVarint(0, buffer + size);
+    size += EncodeVarint(stack_trace_id, buffer + size);
+    InternStackTraceId(stack_trace_id, state);
+  }
+
+  size += EncodeVarint(num_arguments, buffer + size);
+  return size;
+}
+
+size_t EncodeCompactArgument(const void* argument,
+                             size_t size,
+                             CompactDetailedCallState* state,
+                             uint8_t* buffer) {
+  DCHECK(argument != NULL);
+  DCHECK_LT(0u, size);
+  DCHECK(state != NULL);
+
+  if (size <= kMaxCompactInternedArgumentSize) {
+    uint64_t value = 0;
+    ::memcpy(&value, argument, size);
+    size_t index = FindArgument(*state, value, size);
+    if (index < state->num_arguments)
+      return EncodeVarint(index + 1, buffer);
+    InternArgument(value, size, state);
+  }
+
+  size_t encoded_size = EncodeVarint(0, buffer);
+  encoded_size += EncodeVarint(size, buffer + encoded_size);
+  ::memcpy(buffer + encoded_size, argument, size);
+  return encoded_size + size;
+}
+
+bool DecodeCompactDetailedFunctionCall(const uint8_t* data,
+                                       size_t size,
+                                       CompactDetailedCallState* state,
+                                       std::vector<uint8_t>* call) {
+  DCHECK(data != NULL || size == 0);
+  DCHECK(state != NULL);
+  DCHECK(call != NULL);
+
+  const uint8_t* read_ptr = data;
+  const uint8_t* end_ptr = data + size;
+
+  uint64_t delta = 0;
+  uint64_t function_id = 0;
+  uint64_t stack_trace_ref = 0;
+  if (!DecodeVarint(&read_ptr, end_ptr, &delta) ||
+      !DecodeVarint(&read_ptr, end_ptr, &function_id) ||
+      !DecodeVarint(&read_ptr, end_ptr, &stack_trace_ref)) {
+    LOG(ERROR) << "Truncated compact detailed function call record.";
+    return false;
+  }
+  state->timestamp += ZigZagDecode(delta);
+
+  uint32_t stack_trace_id = 0;
+  if (stack_trace_ref == 0) {
+    uint64_t value = 0;
+    if (!DecodeVarint(&read_ptr, end_ptr, &value)) {
+      LOG(ERROR) << "Truncated stack trace in compact detailed function call.";
+      return false;
+    }
+    stack_trace_id = static_cast<uint32_t>(value);
+    InternStackTraceId(stack_trace_id, state);
+  } else if (stack_trace_ref <= state->num_stack_trace_ids) {
+    stack_trace_id =
+        state->stack_trace_ids[static_cast<size_t>(stack_trace_ref - 1)];
+  } else {
+    LOG(ERROR) << "Unknown stack trace in compact detailed function call.";
+    return false;
+  }
+
+  // Each argument takes at least a byte.
+  uint64_t num_arguments = 0;
+  if (!DecodeVarint(&read_ptr, end_ptr, &num_arguments) ||
+      num_arguments > size) {
+    LOG(ERROR) << "Invalid argument count in compact detailed function call.";
+    return false;
+  }
+
+  // The arguments are expanded into their sizes and their data, which are
+  // laid out one after the other once they are all known.
+  std::vector<uint32_t> argument_sizes;
+  std::vector<uint8_t> argument_data;
+  for (size_t i = 0; i < num_arguments; ++i) {
+    uint64_t argument_ref = 0;
+    if (!DecodeVarint(&read_ptr, end_ptr, &argument_ref)) {
+      LOG(ERROR) << "Truncated argument in compact detailed function call.";
+      return false;
+    }
+
+    if (argument_ref != 0) {
+      if (argument_ref > state->num_arguments) {
+        LOG(ERROR) << "Unknown argument in compact detailed function call.";
+        return false;
+      }
+      size_t index = static_cast<size_t>(argument_ref - 1);
+      const uint8_t* value =
+          reinterpret_cast<const uint8_t*>(&state->arguments[index]);
+      argument_sizes.push_back(state->argument_sizes[index]);
+      argument_data.insert(argument_data.end(), value,
+                           value + state->argument_sizes[index]);
+      continue;
+    }
+
+    uint64_t argument_size = 0;
+    if (!DecodeVarint(&read_ptr, end_ptr, &argument_size) ||
+        argument_size == 0 ||
+        argument_size > static_cast<uint64_t>(end_ptr - read_ptr)) {
+      LOG(ERROR) << "Truncated argument in compact detailed function call.";
+      return false;
+    }
+    size_t value_size = static_cast<size_t>(argument_size);
+    if (value_size <= kMaxCompactInternedArgumentSize) {
+      uint64_t value = 0;
+      ::memcpy(&value, read_ptr, value_size);
+      InternArgument(value, value_size, state);
+    }
+    argument_sizes.push_back(static_cast<uint32_t>(value_size));
+    argument_data.insert(argument_data.end(), read_ptr,
+                         read_ptr + value_size);
+    read_ptr += value_size;
+  }
+
+  // The arguments are laid out as in a TraceDetailedFunctionCall, which has no
+  // argument data at all for a call without arguments.
+  size_t argument_data_size = 0;
+  if (!argument_sizes.empty()) {
+    argument_data_size = (argument_sizes.size() + 1) * sizeof(uint32_t) +
+                         argument_data.size();
+  }
+  size_t offset_to_arguments =
+      offsetof(TraceDetailedFunctionCall, argument_data);
+  call->assign(std::max(sizeof(TraceDetailedFunctionCall),
+                        offset_to_arguments + argument_data_size),
+               0);
+  TraceDetailedFunctionCall* expanded =
+      reinterpret_cast<TraceDetailedFunctionCall*>(&call->at(0));
+  expanded->timestamp = state->timestamp;
+  expanded->function_id = static_cast<uint32_t>(function_id);
+  expanded->stack_trace_id = stack_trace_id;
+  expanded->argument_data_size = static_cast<uint32_t>(argument_data_size);
+  if (argument_data_size == 0)
+    return true;
+
+  uint32_t* sizes = reinterpret_cast<uint32_t*>(expanded->argument_data);
+  *(sizes++) = static_cast<uint32_t>(argument_sizes.size());
+  for (size_t i = 0; i < argument_sizes.size(); ++i)
+    *(sizes++) = argument_sizes[i];
+  ::memcpy(sizes, &argument_data[0], argument_data.size());
+
+  return true;
+}
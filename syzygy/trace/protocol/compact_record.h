@@ -0,0 +1,201 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the compact encodings of batch function entry records and of
+// detailed function call records, written by clients when the call trace
+// service hands out TRACE_FLAG_COMPACT_RECORDS.
+//
+// A TRACE_COMPACT_BATCH_ENTER record is a stream of varints. It starts with
+// the interned thread ID of the batch, which is zero for the thread of the
+// enclosing segment and the thread ID plus one otherwise. Each call follows
+// as the zigzag encoded differences of its function and return addresses
+// from those of the previous call of the batch. Successive calls tend to be
+// to nearby functions of the same module, so most calls take a few bytes
+// rather than the two pointers of a TraceEnterEventData.
+//
+// Calls are appended to a record only as a whole, so a record is always
+// self-consistent. A call to a null function is a cleared call, that was
+// allocated but not written, and is skipped.
+//
+// A TRACE_COMPACT_DETAILED_FUNCTION_CALL record is also a stream of varints:
+// the zigzag encoded difference of its timestamp from that of the previous
+// compact call of the segment, the function ID, the stack trace ID, the
+// number of arguments, and then the arguments. The stack trace ID and each
+// argument are either a reference to a value interned earlier in the
+// segment, which is its index plus one, or zero followed by the value: a
+// varint for a stack trace ID, and the size then the bytes of an argument.
+// A value that is written in full is interned, while the segment has room
+// for it. Heap functions are called over and over with the same heaps,
+// flags, sizes and stacks, so most of their arguments take a single byte.
+// The interned values start over with each segment, so that a segment still
+// decodes on its own when the segments around it are skipped.
+
+#ifndef SYZYGY_TRACE_PROTOCOL_COMPACT_RECORD_H_
+#define SYZYGY_TRACE_PROTOCOL_COMPACT_RECORD_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+// The maximum number of bytes of a varint encoding a 64-bit value.
+const size_t kMaxVarintSize = 10;
+
+// The maximum number of bytes of an encoded call.
+const size_t kMaxCompactCallSize = 2 * kMaxVarintSize;
+
+// The maximum number of values interned by the compact detailed function
+// calls of a segment, so that a reference to one takes a single byte.
+const size_t kMaxCompactInternedValues = 127;
+
+// The maximum size of an interned argument. Larger arguments are always
+// written in full.
+const size_t kMaxCompactInternedArgumentSize = sizeof(uint64_t);
+
+// The maximum number of bytes of the start of an encoded detailed call.
+const size_t kMaxCompactDetailedCallStartSize = 4 * kMaxVarintSize;
+
+// @param size the size of an argument.
+// @returns the maximum number of bytes of the encoded argument.
+inline size_t GetMaxCompactArgumentSize(size_t size) {
+  return 2 * kMaxVarintSize + size;
+}
+
+// The state of the encoding of a compact batch: the addresses of the last
+// call. Both are zero at the start of a batch.
+struct CompactBatchEnterState {
+  uintptr_t function;
+  uintptr_t retaddr;
+};
+
+// The values interned by the compact detailed function calls of a segment.
+// The encoder and the decoder each keep one, zeroed at the start of the
+// segment, which the calls update identically.
+struct CompactDetailedCallState {
+  // The timestamp of the last call.
+  uint64_t timestamp;
+
+  // The interned stack trace IDs.
+  uint32_t num_stack_trace_ids;
+  uint32_t stack_trace_ids[kMaxCompactInternedValues];
+
+  // The interned arguments, zero extended to 64 bits, and their sizes.
+  uint32_t num_arguments;
+  uint8_t argument_sizes[kMaxCompactInternedValues];
+  uint64_t arguments[kMaxCompactInternedValues];
+};
+
+// Encodes an unsigned value as a varint, seven bits per byte from the least
+// significant, the high bit marking the bytes that are followed by another.
+// @param value the value to encode.
+// @param buffer receives the encoding, of at most kMaxVarintSize bytes.
+// @returns the number of bytes of the encoding.
+size_t EncodeVarint(uint64_t value, uint8_t* buffer);
+
+// Decodes a varint.
+// @param cursor the position of the varint, advanced past it on success.
+// @param end the end of the buffer holding the varint.
+// @param value receives the decoded value.
+// @returns false if the varint is truncated or overlong.
+bool DecodeVarint(const uint8_t** cursor, const uint8_t* end,
+                  uint64_t* value);
+
+// Maps signed values to unsigned ones so that values of small magnitude
+// have short varints: 0, -1, 1, -2, ... map to 0, 1, 2, 3, ...
+inline uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+inline int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Encodes the start of a compact batch.
+// @param thread_id the thread of the batch.
+// @param segment_thread_id the thread of the segment holding the batch.
+// @param state receives the initial encoding state of the batch.
+// @param buffer receives the encoding, of at most kMaxVarintSize bytes.
+// @returns the number of bytes of the encoding.
+size_t EncodeCompactBatchEnterStart(uint32_t thread_id,
+                                    uint32_t segment_thread_id,
+                                    CompactBatchEnterState* state,
+                                    uint8_t* buffer);
+
+// Encodes a call of a compact batch.
+// @param function the function called.
+// @param retaddr the return address of the call.
+// @param state the encoding state of the batch, updated with the call.
+// @param buffer receives the encoding, of at most kMaxCompactCallSize bytes.
+// @returns the number of bytes of the encoding.
+size_t EncodeCompactCall(FuncAddr function,
+                         RetAddr retaddr,
+                         CompactBatchEnterState* state,
+                         uint8_t* buffer);
+
+// Decodes a compact batch into the equivalent TraceBatchEnterData.
+// @param data the data of the TRACE_COMPACT_BATCH_ENTER record.
+// @param size the size of @p data.
+// @param segment_thread_id the thread of the segment holding the batch.
+// @param batch receives the TraceBatchEnterData, which is at least
+//     sizeof(TraceBatchEnterData) bytes long.
+// @returns false if the record is malformed.
+bool DecodeCompactBatchEnter(const uint8_t* data,
+                             size_t size,
+                             uint32_t segment_thread_id,
+                             std::vector<uint8_t>* batch);
+
+// Encodes the start of a compact detailed function call, up to its
+// arguments.
+// @param timestamp the timestamp of the call.
+// @param function_id the ID of the function called.
+// @param stack_trace_id the ID of the stack trace of the call.
+// @param num_arguments the number of arguments that follow.
+// @param state the encoding state of the segment, updated with the call.
+// @param buffer receives the encoding, of at most
+//     kMaxCompactDetailedCallStartSize bytes.
+// @returns the number of bytes of the encoding.
+size_t EncodeCompactDetailedCallStart(uint64_t timestamp,
+                                      uint32_t function_id,
+                                      uint32_t stack_trace_id,
+                                      uint32_t num_arguments,
+                                      CompactDetailedCallState* state,
+                                      uint8_t* buffer);
+
+// Encodes an argument of a compact detailed function call.
+// @param argument the value of the argument.
+// @param size the size of @p argument, which is not zero.
+// @param state the encoding state of the segment, updated with the argument.
+// @param buffer receives the encoding, of at most
+//     GetMaxCompactArgumentSize(@p size) bytes.
+// @returns the number of bytes of the encoding.
+size_t EncodeCompactArgument(const void* argument,
+                             size_t size,
+                             CompactDetailedCallState* state,
+                             uint8_t* buffer);
+
+// Decodes a compact detailed function call into the equivalent
+// TraceDetailedFunctionCall.
+// @param data the data of the TRACE_COMPACT_DETAILED_FUNCTION_CALL record.
+// @param size the size of @p data.
+// @param state the decoding state of the segment holding the record, updated
+//     with the call.
+// @param call receives the TraceDetailedFunctionCall, which is at least
+//     sizeof(TraceDetailedFunctionCall) bytes long.
+// @returns false if the record is malformed.
+bool DecodeCompactDetailedFunctionCall(const uint8_t* data,
+                                       size_t size,
+                                       CompactDetailedCallState* state,
+                                       std::vector<uint8_t>* call);
+
+#endif  // SYZYGY_TRACE_PROTOCOL_COMPACT_RECORD_H_
@@ -0,0 +1,224 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/compact_record.h"
+
+#include <vector>
+
+#include "base/macros.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+const uint32_t kThreadId = 42;
+
+// Encodes a batch of calls to consecutive functions.
+void EncodeBatch(uint32_t thread_id, size_t num_calls,
+                 std::vector<uint8_t>* record) {
+  uint8_t buffer[kMaxCompactCallSize];
+  CompactBatchEnterState state = {};
+  size_t size =
+      EncodeCompactBatchEnterStart(thread_id, kThreadId, &state, buffer);
+  record->assign(buffer, buffer + size);
+  for (size_t i = 0; i < num_calls; ++i) {
+    FuncAddr function = reinterpret_cast<FuncAddr>(0x10001000 + i * 0x40);
+    RetAddr retaddr = reinterpret_cast<RetAddr>(0x10002000 - i * 0x10);
+    size = EncodeCompactCall(function, retaddr, &state, buffer);
+    record->insert(record->end(), buffer, buffer + size);
+  }
+}
+
+// Encodes a detailed function call with two arguments.
+void EncodeDetailedCall(uint64_t timestamp, uint32_t stack_trace_id,
+                        uint32_t handle, uint32_t size,
+                        CompactDetailedCallState* state,
+                        std::vector<uint8_t>* record) {
+  uint8_t buffer[kMaxCompactDetailedCallStartSize];
+  size_t encoded_size = EncodeCompactDetailedCallStart(
+      timestamp, 7, stack_trace_id, 2, state, buffer);
+  record->assign(buffer, buffer + encoded_size);
+  encoded_size = EncodeCompactArgument(&handle, sizeof(handle), state, buffer);
+  record->insert(record->end(), buffer, buffer + encoded_size);
+  encoded_size = EncodeCompactArgument(&size, sizeof(size), state, buffer);
+  record->insert(record->end(), buffer, buffer + encoded_size);
+}
+
+// Checks a decoded detailed function call with two arguments.
+void ExpectDetailedCall(uint64_t timestamp, uint32_t stack_trace_id,
+                        uint32_t handle, uint32_t size,
+                        const std::vector<uint8_t>& call) {
+  const TraceDetailedFunctionCall* data =
+      reinterpret_cast<const TraceDetailedFunctionCall*>(&call[0]);
+  EXPECT_EQ(timestamp, data->timestamp);
+  EXPECT_EQ(7u, data->function_id);
+  EXPECT_EQ(stack_trace_id, data->stack_trace_id);
+  const uint32_t kExpectedArguments[] = {2, 4, 4, handle, size};
+  ASSERT_EQ(sizeof(kExpectedArguments), data->argument_data_size);
+  EXPECT_EQ(0, ::memcmp(kExpectedArguments, data->argument_data,
+                        sizeof(kExpectedArguments)));
+}
+
+}  // namespace
+
+TEST(CompactRecordTest, Varint) {
+  const uint64_t kValues[] = {0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 0xFFFFFFFF,
+                              0xFFFFFFFFFFFFFFFF};
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    uint8_t buffer[kMaxVarintSize] = {};
+    size_t size = EncodeVarint(kValues[i], buffer);
+    EXPECT_LE(size, kMaxVarintSize);
+
+    const uint8_t* cursor = buffer;
+    uint64_t value = 0;
+    EXPECT_TRUE(DecodeVarint(&cursor, buffer + size, &value));
+    EXPECT_EQ(kValues[i], value);
+    EXPECT_EQ(buffer + size, cursor);
+
+    // A truncated varint doesn't decode.
+    cursor = buffer;
+    EXPECT_FALSE(DecodeVarint(&cursor, buffer + size - 1, &value));
+  }
+
+  uint8_t buffer[kMaxVarintSize] = {};
+  EXPECT_EQ(1u, EncodeVarint(0x7F, buffer));
+  EXPECT_EQ(2u, EncodeVarint(0x80, buffer));
+}
+
+TEST(CompactRecordTest, ZigZag) {
+  EXPECT_EQ(0u, ZigZagEncode(0));
+  EXPECT_EQ(1u, ZigZagEncode(-1));
+  EXPECT_EQ(2u, ZigZagEncode(1));
+  EXPECT_EQ(3u, ZigZagEncode(-2));
+  EXPECT_EQ(-12345, ZigZagDecode(ZigZagEncode(-12345)));
+  EXPECT_EQ(12345, ZigZagDecode(ZigZagEncode(12345)));
+}
+
+TEST(CompactRecordTest, RoundTrip) {
+  const size_t kNumCalls = 100;
+  std::vector<uint8_t> record;
+  EncodeBatch(kThreadId, kNumCalls, &record);
+
+  // Nearby calls take a few bytes each, rather than two pointers.
+  EXPECT_GT(kNumCalls * sizeof(TraceEnterEventData) / 2, record.size());
+
+  std::vector<uint8_t> batch;
+  ASSERT_TRUE(DecodeCompactBatchEnter(&record[0], record.size(), kThreadId,
+                                      &batch));
+  const TraceBatchEnterData* data =
+      reinterpret_cast<const TraceBatchEnterData*>(&batch[0]);
+  EXPECT_EQ(kThreadId, data->thread_id);
+  ASSERT_EQ(kNumCalls, data->num_calls);
+  for (size_t i = 0; i < kNumCalls; ++i) {
+    EXPECT_EQ(reinterpret_cast<FuncAddr>(0x10001000 + i * 0x40),
+              data->calls[i].function);
+    EXPECT_EQ(reinterpret_cast<RetAddr>(0x10002000 - i * 0x10),
+              data->calls[i].retaddr);
+  }
+}
+
+TEST(CompactRecordTest, InternsThreadId) {
+  std::vector<uint8_t> record;
+  EncodeBatch(kThreadId + 1, 1, &record);
+
+  std::vector<uint8_t> batch;
+  ASSERT_TRUE(DecodeCompactBatchEnter(&record[0], record.size(), kThreadId,
+                                      &batch));
+  const TraceBatchEnterData* data =
+      reinterpret_cast<const TraceBatchEnterData*>(&batch[0]);
+  EXPECT_EQ(kThreadId + 1, data->thread_id);
+  EXPECT_EQ(1u, data->num_calls);
+}
+
+TEST(CompactRecordTest, SkipsClearedCalls) {
+  // A record that was allocated but not yet written is all zeros.
+  std::vector<uint8_t> record(5, 0);
+  std::vector<uint8_t> batch;
+  ASSERT_TRUE(DecodeCompactBatchEnter(&record[0], record.size(), kThreadId,
+                                      &batch));
+  const TraceBatchEnterData* data =
+      reinterpret_cast<const TraceBatchEnterData*>(&batch[0]);
+  EXPECT_EQ(kThreadId, data->thread_id);
+  EXPECT_EQ(0u, data->num_calls);
+}
+
+TEST(CompactRecordTest, FailsOnTruncatedCall) {
+  std::vector<uint8_t> record;
+  EncodeBatch(kThreadId, 2, &record);
+  record.pop_back();
+
+  std::vector<uint8_t> batch;
+  EXPECT_FALSE(DecodeCompactBatchEnter(&record[0], record.size(), kThreadId,
+                                       &batch));
+}
+
+TEST(CompactRecordTest, DetailedCallRoundTrip) {
+  CompactDetailedCallState encoder = {};
+  CompactDetailedCallState decoder = {};
+
+  std::vector<uint8_t> first;
+  EncodeDetailedCall(1000, 0xDEADBEEF, 0x00A00000, 24, &encoder, &first);
+  std::vector<uint8_t> call;
+  ASSERT_TRUE(DecodeCompactDetailedFunctionCall(&first[0], first.size(),
+                                                &decoder, &call));
+  ASSERT_NO_FATAL_FAILURE(
+      ExpectDetailedCall(1000, 0xDEADBEEF, 0x00A00000, 24, call));
+
+  // A call repeating the stack and the arguments refers to them, so that
+  // each of its fields takes a single byte.
+  std::vector<uint8_t> second;
+  EncodeDetailedCall(1010, 0xDEADBEEF, 0x00A00000, 24, &encoder, &second);
+  EXPECT_EQ(6u, second.size());
+  ASSERT_TRUE(DecodeCompactDetailedFunctionCall(&second[0], second.size(),
+                                                &decoder, &call));
+  ASSERT_NO_FATAL_FAILURE(
+      ExpectDetailedCall(1010, 0xDEADBEEF, 0x00A00000, 24, call));
+
+  // A timestamp may go backwards, as the cores' clocks are not in sync.
+  std::vector<uint8_t> third;
+  EncodeDetailedCall(1005, 0x12345678, 0x00A00000, 32, &encoder, &third);
+  ASSERT_TRUE(DecodeCompactDetailedFunctionCall(&third[0], third.size(),
+                                                &decoder, &call));
+  ASSERT_NO_FATAL_FAILURE(
+      ExpectDetailedCall(1005, 0x12345678, 0x00A00000, 32, call));
+}
+
+TEST(CompactRecordTest, DetailedCallWithoutArguments) {
+  CompactDetailedCallState encoder = {};
+  CompactDetailedCallState decoder = {};
+
+  uint8_t buffer[kMaxCompactDetailedCallStartSize];
+  size_t size = EncodeCompactDetailedCallStart(42, 3, 0, 0, &encoder, buffer);
+  std::vector<uint8_t> call;
+  ASSERT_TRUE(DecodeCompactDetailedFunctionCall(buffer, size, &decoder,
+                                                &call));
+  const TraceDetailedFunctionCall* data =
+      reinterpret_cast<const TraceDetailedFunctionCall*>(&call[0]);
+  EXPECT_EQ(42u, data->timestamp);
+  EXPECT_EQ(3u, data->function_id);
+  EXPECT_EQ(0u, data->argument_data_size);
+}
+
+TEST(CompactRecordTest, DetailedCallFailsOnUnknownReference) {
+  CompactDetailedCallState encoder = {};
+  std::vector<uint8_t> first;
+  EncodeDetailedCall(1000, 0xDEADBEEF, 0x00A00000, 24, &encoder, &first);
+  std::vector<uint8_t> second;
+  EncodeDetailedCall(1010, 0xDEADBEEF, 0x00A00000, 24, &encoder, &second);
+
+  // The second call can't be decoded without the values of the first.
+  CompactDetailedCallState decoder = {};
+  std::vector<uint8_t> call;
+  EXPECT_FALSE(DecodeCompactDetailedFunctionCall(&second[0], second.size(),
+                                                 &decoder, &call));
+}
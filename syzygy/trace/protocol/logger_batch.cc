@@ -0,0 +1,102 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/logger_batch.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace {
+
+const size_t kRecordAlignment = sizeof(uint64_t);
+
+size_t AlignUp(size_t size) {
+  return (size + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+}
+
+}  // namespace
+
+void AppendLoggerBatchRecord(const base::StringPiece& text,
+                             const void* const* trace_data,
+                             uint32_t trace_length,
+                             std::vector<uint8_t>* batch) {
+  DCHECK(trace_data != NULL || trace_length == 0);
+  DCHECK(batch != NULL);
+  DCHECK_EQ(0u, batch->size() % kRecordAlignment);
+
+  LoggerBatchRecordHeader header = {static_cast<uint32_t>(text.size()),
+                                    trace_length};
+  size_t trace_size = trace_length * sizeof(uint64_t);
+  size_t record_size = AlignUp(sizeof(header) + trace_size + text.size());
+
+  size_t offset = batch->size();
+  batch->resize(offset + record_size, 0);
+  uint8_t* cursor = batch->data() + offset;
+  ::memcpy(cursor, &header, sizeof(header));
+  cursor += sizeof(header);
+  for (uint32_t i = 0; i < trace_length; ++i) {
+    uint64_t frame = reinterpret_cast<uintptr_t>(trace_data[i]);
+    ::memcpy(cursor, &frame, sizeof(frame));
+    cursor += sizeof(frame);
+  }
+  if (!text.empty())
+    ::memcpy(cursor, text.data(), text.size());
+}
+
+bool ParseLoggerBatch(const uint8_t* data,
+                      size_t size,
+                      std::vector<LoggerBatchRecord>* records) {
+  DCHECK(data != NULL || size == 0);
+  DCHECK(records != NULL);
+
+  records->clear();
+  const uint8_t* cursor = data;
+  const uint8_t* end = data + size;
+  while (cursor < end) {
+    LoggerBatchRecordHeader header = {};
+    if (static_cast<size_t>(end - cursor) < sizeof(header))
+      return false;
+    ::memcpy(&header, cursor, sizeof(header));
+    cursor += sizeof(header);
+
+    // The sizes come from the client, so they're checked before being summed.
+    size_t remaining = end - cursor;
+    if (header.trace_length > remaining / sizeof(uint64_t))
+      return false;
+    size_t trace_size = header.trace_length * sizeof(uint64_t);
+    if (header.text_size > remaining - trace_size)
+      return false;
+
+    records->push_back(LoggerBatchRecord());
+    LoggerBatchRecord& record = records->back();
+    record.trace.resize(header.trace_length);
+    for (uint32_t i = 0; i < header.trace_length; ++i) {
+      uint64_t frame = 0;
+      ::memcpy(&frame, cursor, sizeof(frame));
+      record.trace[i] = static_cast<uintptr_t>(frame);
+      cursor += sizeof(frame);
+    }
+    record.text = base::StringPiece(reinterpret_cast<const char*>(cursor),
+                                    header.text_size);
+    cursor += header.text_size;
+
+    // The last record may omit its padding.
+    size_t padding = AlignUp(cursor - data) - (cursor - data);
+    cursor += std::min(padding, static_cast<size_t>(end - cursor));
+  }
+
+  return true;
+}
@@ -0,0 +1,71 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the encoding of the batches of log records that an agent sends to
+// the agent logger in a single WriteBatch RPC, rather than a Write or a
+// WriteWithTrace RPC per message.
+//
+// A batch is a sequence of records, each a LoggerBatchRecordHeader followed
+// by the frames of its stack trace as 64-bit values, then by the text of the
+// message, which isn't terminated. Each record is padded to a multiple of 8
+// bytes so that the frames of the next one are aligned. The text is sent as
+// is: the logger appends the symbolized stack traces to it.
+
+#ifndef SYZYGY_TRACE_PROTOCOL_LOGGER_BATCH_H_
+#define SYZYGY_TRACE_PROTOCOL_LOGGER_BATCH_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "base/strings/string_piece.h"
+
+// The size past which an agent flushes its batch.
+const size_t kMaxLoggerBatchSize = 64 * 1024;
+
+// The header of a record of a batch.
+struct LoggerBatchRecordHeader {
+  // The number of bytes of the text of the message.
+  uint32_t text_size;
+  // The number of frames of the stack trace, which may be zero.
+  uint32_t trace_length;
+};
+
+// A record decoded from a batch.
+struct LoggerBatchRecord {
+  // The text of the message, which points into the batch.
+  base::StringPiece text;
+  // The frames of the stack trace.
+  std::vector<uintptr_t> trace;
+};
+
+// Appends a record to a batch.
+// @param text the text of the message.
+// @param trace_data the frames of the stack trace, or NULL.
+// @param trace_length the number of frames of @p trace_data.
+// @param batch the batch to append to.
+void AppendLoggerBatchRecord(const base::StringPiece& text,
+                             const void* const* trace_data,
+                             uint32_t trace_length,
+                             std::vector<uint8_t>* batch);
+
+// Decodes the records of a batch.
+// @param data the batch.
+// @param size the size of @p data.
+// @param records receives the records, whose text points into @p data.
+// @returns false if the batch is malformed.
+bool ParseLoggerBatch(const uint8_t* data,
+                      size_t size,
+                      std::vector<LoggerBatchRecord>* records);
+
+#endif  // SYZYGY_TRACE_PROTOCOL_LOGGER_BATCH_H_
@@ -0,0 +1,73 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/logger_batch.h"
+
+#include <vector>
+
+#include "base/macros.h"
+#include "gtest/gtest.h"
+
+TEST(LoggerBatchTest, RoundTrip) {
+  const void* const kTrace[] = {reinterpret_cast<const void*>(0x10001000),
+                                reinterpret_cast<const void*>(0x10002000),
+                                reinterpret_cast<const void*>(0x10003000)};
+  std::vector<uint8_t> batch;
+  AppendLoggerBatchRecord("first", NULL, 0, &batch);
+  AppendLoggerBatchRecord("second", kTrace, arraysize(kTrace), &batch);
+  AppendLoggerBatchRecord("", NULL, 0, &batch);
+  EXPECT_EQ(0u, batch.size() % sizeof(uint64_t));
+
+  std::vector<LoggerBatchRecord> records;
+  ASSERT_TRUE(ParseLoggerBatch(batch.data(), batch.size(), &records));
+  ASSERT_EQ(3u, records.size());
+  EXPECT_EQ("first", records[0].text);
+  EXPECT_TRUE(records[0].trace.empty());
+  EXPECT_EQ("second", records[1].text);
+  ASSERT_EQ(arraysize(kTrace), records[1].trace.size());
+  for (size_t i = 0; i < arraysize(kTrace); ++i)
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(kTrace[i]), records[1].trace[i]);
+  EXPECT_TRUE(records[2].text.empty());
+  EXPECT_TRUE(records[2].trace.empty());
+}
+
+TEST(LoggerBatchTest, EmptyBatch) {
+  std::vector<LoggerBatchRecord> records;
+  EXPECT_TRUE(ParseLoggerBatch(NULL, 0, &records));
+  EXPECT_TRUE(records.empty());
+}
+
+TEST(LoggerBatchTest, FailsOnTruncatedRecord) {
+  std::vector<uint8_t> batch;
+  AppendLoggerBatchRecord("a message", NULL, 0, &batch);
+  std::vector<LoggerBatchRecord> records;
+
+  // Only the padding of the last record may be missing.
+  EXPECT_TRUE(ParseLoggerBatch(batch.data(),
+                               sizeof(LoggerBatchRecordHeader) + 9,
+                               &records));
+  EXPECT_FALSE(ParseLoggerBatch(batch.data(),
+                                sizeof(LoggerBatchRecordHeader) + 8,
+                                &records));
+  EXPECT_FALSE(ParseLoggerBatch(batch.data(),
+                                sizeof(LoggerBatchRecordHeader) - 1,
+                                &records));
+}
+
+TEST(LoggerBatchTest, FailsOnOversizedTrace) {
+  LoggerBatchRecordHeader header = {0, 0xFFFFFFFF};
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(&header);
+  std::vector<LoggerBatchRecord> records;
+  EXPECT_FALSE(ParseLoggerBatch(data, sizeof(header), &records));
+}
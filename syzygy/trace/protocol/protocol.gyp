@@ -21,8 +21,16 @@
       'target_name': 'protocol_lib',
       'type': 'static_library',
       'sources': [
+        'buffer_ring.cc',
+        'buffer_ring.h',
         'call_trace_defs.cc',
         'call_trace_defs.h',
+        'compact_record.cc',
+        'compact_record.h',
+        'logger_batch.cc',
+        'logger_batch.h',
+        'trace_file_index.cc',
+        'trace_file_index.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
@@ -32,7 +40,11 @@
       'target_name': 'protocol_unittests',
       'type': 'executable',
       'sources': [
+        'buffer_ring_unittest.cc',
         'call_trace_defs_unittest.cc',
+        'compact_record_unittest.cc',
+        'logger_batch_unittest.cc',
+        'trace_file_index_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
@@ -0,0 +1,153 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/trace_file_index.h"
+
+#include <string>
+
+#include "base/logging.h"
+#include "base/files/file_util.h"
+
+bool IsTraceStateEvent(uint16_t type) {
+  switch (type) {
+    case TRACE_PROCESS_ENDED:
+    case TRACE_PROCESS_ATTACH_EVENT:
+    case TRACE_PROCESS_DETACH_EVENT:
+    case TRACE_THREAD_ATTACH_EVENT:
+    case TRACE_THREAD_DETACH_EVENT:
+    case TRACE_MODULE_EVENT:
+    case TRACE_THREAD_NAME:
+    case TRACE_DYNAMIC_SYMBOL:
+    case TRACE_FUNCTION_NAME_TABLE_ENTRY:
+    case TRACE_PROFILER_CALIBRATION:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+void IndexTraceFileSegment(uint64_t offset,
+                           const TraceFileSegmentHeader& segment_header,
+                           const uint8_t* data,
+                           TraceFileIndexEntry* entry) {
+  DCHECK(data != NULL || segment_header.segment_length == 0);
+  DCHECK(entry != NULL);
+
+  ::memset(entry, 0, sizeof(*entry));
+  entry->offset = offset;
+  entry->thread_id = segment_header.thread_id;
+
+  const uint8_t* read_ptr = data;
+  const uint8_t* end_ptr = data + segment_header.segment_length;
+  bool first = true;
+  while (read_ptr + sizeof(RecordPrefix) <= end_ptr) {
+    const RecordPrefix* prefix =
+        reinterpret_cast<const RecordPrefix*>(read_ptr);
+    read_ptr += sizeof(RecordPrefix) + prefix->size;
+
+    // The timestamps of events increase within a segment, as a segment is
+    // written by a single thread.
+    if (first) {
+      entry->first_timestamp = prefix->timestamp;
+      first = false;
+    }
+    entry->last_timestamp = prefix->timestamp;
+    if (IsTraceStateEvent(prefix->type))
+      entry->flags |= TraceFileIndexEntry::kHasStateEvents;
+  }
+}
+
+base::FilePath GetTraceFileIndexPath(const base::FilePath& trace_file_path) {
+  return trace_file_path.AddExtension(L"index");
+}
+
+bool WriteTraceFileIndex(const base::FilePath& index_path,
+                         uint64_t trace_file_size,
+                         const std::vector<TraceFileIndexEntry>& entries) {
+  TraceFileIndexHeader header = {};
+  header.signature = TraceFileIndexHeader::kSignature;
+  header.version = TraceFileIndexHeader::kVersion;
+  header.trace_file_size = trace_file_size;
+  header.num_entries = entries.size();
+
+  std::string contents(reinterpret_cast<const char*>(&header),
+                       sizeof(header));
+  if (!entries.empty()) {
+    contents.append(reinterpret_cast<const char*>(entries.data()),
+                    entries.size() * sizeof(entries[0]));
+  }
+
+  int size = static_cast<int>(contents.size());
+  if (base::WriteFile(index_path, contents.data(), size) != size) {
+    LOG(ERROR) << "Failed to write trace file index '" << index_path.value()
+               << "'.";
+    return false;
+  }
+
+  return true;
+}
+
+bool ReadTraceFileIndex(const base::FilePath& index_path,
+                        uint64_t trace_file_size,
+                        std::vector<TraceFileIndexEntry>* entries) {
+  DCHECK(entries != NULL);
+  entries->clear();
+
+  std::string contents;
+  if (!base::ReadFileToString(index_path, &contents))
+    return false;
+
+  TraceFileIndexHeader header = {};
+  if (contents.size() < sizeof(header)) {
+    LOG(WARNING) << "Truncated trace file index '" << index_path.value()
+                 << "'.";
+    return false;
+  }
+  ::memcpy(&header, contents.data(), sizeof(header));
+
+  if (header.signature != TraceFileIndexHeader::kSignature ||
+      header.version != TraceFileIndexHeader::kVersion ||
+      contents.size() !=
+          sizeof(header) + header.num_entries * sizeof(TraceFileIndexEntry)) {
+    LOG(WARNING) << "Invalid trace file index '" << index_path.value()
+                 << "'.";
+    return false;
+  }
+
+  if (header.trace_file_size != trace_file_size) {
+    LOG(WARNING) << "Ignoring stale trace file index '" << index_path.value()
+                 << "'.";
+    return false;
+  }
+
+  entries->resize(header.num_entries);
+  if (!entries->empty()) {
+    ::memcpy(entries->data(), contents.data() + sizeof(header),
+             entries->size() * sizeof(TraceFileIndexEntry));
+  }
+
+  // The entries must be in the order of the segments in the trace file.
+  for (size_t i = 0; i < entries->size(); ++i) {
+    if ((*entries)[i].offset >= trace_file_size ||
+        (i > 0 && (*entries)[i].offset <= (*entries)[i - 1].offset)) {
+      LOG(WARNING) << "Invalid trace file index '" << index_path.value()
+                   << "'.";
+      entries->clear();
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,108 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the segment index of an RPC trace file. The index is written by
+// the call trace service alongside the trace file, in a sidecar file, and
+// lets the parser seek directly to the segments of interest rather than
+// reading every segment of the trace file. A trace file without an index, or
+// whose index doesn't match it, is read in full.
+//
+// The index file is a TraceFileIndexHeader followed by one
+// TraceFileIndexEntry per segment, in the order of the segments in the trace
+// file.
+
+#ifndef SYZYGY_TRACE_PROTOCOL_TRACE_FILE_INDEX_H_
+#define SYZYGY_TRACE_PROTOCOL_TRACE_FILE_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "syzygy/common/assertions.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+struct TraceFileIndexHeader {
+  // "SZIX", read as a little-endian integer.
+  static const uint32_t kSignature = 0x58495A53;
+  static const uint32_t kVersion = 1;
+
+  uint32_t signature;
+  uint32_t version;
+  // The size of the trace file that is indexed, used to detect stale indexes.
+  uint64_t trace_file_size;
+  uint32_t num_entries;
+  uint32_t reserved;
+};
+COMPILE_ASSERT_IS_POD(TraceFileIndexHeader);
+
+struct TraceFileIndexEntry {
+  enum Flags {
+    // The segment contains events that describe the state of the process,
+    // such as module loads, which are needed to interpret the other events.
+    // See IsTraceStateEvent.
+    kHasStateEvents = 1 << 0,
+  };
+
+  // The offset of the RecordPrefix of the segment in the trace file.
+  uint64_t offset;
+  // The timestamps of the first and last events of the segment. Both are zero
+  // for a segment without events.
+  uint64_t first_timestamp;
+  uint64_t last_timestamp;
+  // The thread that wrote the segment.
+  uint32_t thread_id;
+  uint32_t flags;
+};
+COMPILE_ASSERT_IS_POD(TraceFileIndexEntry);
+
+// @param type the type of a trace event.
+// @returns true if events of type @p type describe the state of the process
+//     rather than its execution, and must be dispatched when the events of an
+//     earlier time range are skipped.
+bool IsTraceStateEvent(uint16_t type);
+
+// Indexes a segment by walking its events.
+// @param offset the offset of the segment in the trace file.
+// @param segment_header the header of the segment.
+// @param data the segment data, of the length given by @p segment_header.
+// @param entry receives the index entry of the segment.
+void IndexTraceFileSegment(uint64_t offset,
+                           const TraceFileSegmentHeader& segment_header,
+                           const uint8_t* data,
+                           TraceFileIndexEntry* entry);
+
+// @param trace_file_path the path of a trace file.
+// @returns the path of the index of @p trace_file_path.
+base::FilePath GetTraceFileIndexPath(const base::FilePath& trace_file_path);
+
+// Writes the index of a trace file.
+// @param index_path the path of the index file.
+// @param trace_file_size the size of the indexed trace file.
+// @param entries the index entries, in the order of the segments.
+// @returns true on success, false otherwise.
+bool WriteTraceFileIndex(const base::FilePath& index_path,
+                         uint64_t trace_file_size,
+                         const std::vector<TraceFileIndexEntry>& entries);
+
+// Reads the index of a trace file.
+// @param index_path the path of the index file.
+// @param trace_file_size the size of the trace file. The index is rejected if
+//     it was written for a trace file of another size.
+// @param entries receives the index entries.
+// @returns true on success, false if the index is missing, stale or invalid.
+bool ReadTraceFileIndex(const base::FilePath& index_path,
+                        uint64_t trace_file_size,
+                        std::vector<TraceFileIndexEntry>* entries);
+
+#endif  // SYZYGY_TRACE_PROTOCOL_TRACE_FILE_INDEX_H_
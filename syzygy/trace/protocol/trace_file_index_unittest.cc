@@ -0,0 +1,118 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/trace_file_index.h"
+
+#include <utility>
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Appends an event without data to a segment.
+void AppendEvent(uint16_t type, uint64_t timestamp,
+                 std::vector<uint8_t>* segment) {
+  RecordPrefix prefix = {};
+  prefix.timestamp = timestamp;
+  prefix.size = 0;
+  prefix.type = type;
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&prefix);
+  segment->insert(segment->end(), bytes, bytes + sizeof(prefix));
+}
+
+}  // namespace
+
+TEST(TraceFileIndexTest, IsTraceStateEvent) {
+  EXPECT_TRUE(IsTraceStateEvent(TRACE_PROCESS_ATTACH_EVENT));
+  EXPECT_TRUE(IsTraceStateEvent(TRACE_MODULE_EVENT));
+  EXPECT_TRUE(IsTraceStateEvent(TRACE_PROFILER_CALIBRATION));
+  EXPECT_FALSE(IsTraceStateEvent(TRACE_ENTER_EVENT));
+  EXPECT_FALSE(IsTraceStateEvent(TRACE_BATCH_ENTER));
+}
+
+TEST(TraceFileIndexTest, IndexTraceFileSegment) {
+  std::vector<uint8_t> data;
+  AppendEvent(TRACE_ENTER_EVENT, 100, &data);
+  AppendEvent(TRACE_EXIT_EVENT, 150, &data);
+  AppendEvent(TRACE_ENTER_EVENT, 200, &data);
+
+  TraceFileSegmentHeader header = {};
+  header.thread_id = 42;
+  header.segment_length = data.size();
+
+  TraceFileIndexEntry entry = {};
+  IndexTraceFileSegment(4096, header, data.data(), &entry);
+  EXPECT_EQ(4096u, entry.offset);
+  EXPECT_EQ(100u, entry.first_timestamp);
+  EXPECT_EQ(200u, entry.last_timestamp);
+  EXPECT_EQ(42u, entry.thread_id);
+  EXPECT_EQ(0u, entry.flags);
+
+  AppendEvent(TRACE_PROCESS_ATTACH_EVENT, 250, &data);
+  header.segment_length = data.size();
+  IndexTraceFileSegment(4096, header, data.data(), &entry);
+  EXPECT_EQ(250u, entry.last_timestamp);
+  EXPECT_EQ(TraceFileIndexEntry::kHasStateEvents, entry.flags);
+
+  // An empty segment has no time range.
+  header.segment_length = 0;
+  IndexTraceFileSegment(8192, header, data.data(), &entry);
+  EXPECT_EQ(0u, entry.first_timestamp);
+  EXPECT_EQ(0u, entry.last_timestamp);
+}
+
+TEST(TraceFileIndexTest, WriteAndRead) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath trace_path = temp_dir.path().Append(L"trace.bin");
+  base::FilePath index_path = GetTraceFileIndexPath(trace_path);
+  EXPECT_EQ(L"trace.bin.index", index_path.BaseName().value());
+
+  std::vector<TraceFileIndexEntry> entries;
+  std::vector<TraceFileIndexEntry> read_entries;
+  EXPECT_FALSE(ReadTraceFileIndex(index_path, 0, &read_entries));
+
+  for (uint32_t i = 0; i < 3; ++i) {
+    TraceFileIndexEntry entry = {};
+    entry.offset = (i + 1) * 4096;
+    entry.first_timestamp = i * 100;
+    entry.last_timestamp = i * 100 + 50;
+    entry.thread_id = i;
+    entries.push_back(entry);
+  }
+
+  const uint64_t kTraceFileSize = 4 * 4096;
+  ASSERT_TRUE(WriteTraceFileIndex(index_path, kTraceFileSize, entries));
+  ASSERT_TRUE(ReadTraceFileIndex(index_path, kTraceFileSize, &read_entries));
+  ASSERT_EQ(entries.size(), read_entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(0, ::memcmp(&entries[i], &read_entries[i], sizeof(entries[i])));
+  }
+
+  // An index written for another version of the trace file is stale.
+  EXPECT_FALSE(
+      ReadTraceFileIndex(index_path, kTraceFileSize + 4096, &read_entries));
+  EXPECT_TRUE(read_entries.empty());
+
+  // A truncated index is rejected.
+  ASSERT_EQ(8, base::WriteFile(index_path, "SZIXjunk", 8));
+  EXPECT_FALSE(ReadTraceFileIndex(index_path, kTraceFileSize, &read_entries));
+
+  // So is an index whose entries are out of order.
+  std::swap(entries[0], entries[1]);
+  ASSERT_TRUE(WriteTraceFileIndex(index_path, kTraceFileSize, entries));
+  EXPECT_FALSE(ReadTraceFileIndex(index_path, kTraceFileSize, &read_entries));
+}
@@ -67,6 +67,7 @@ bool BufferPool::Init(Session* session,
     cb.session = session;
     cb.pool = this;
     cb.state = Buffer::kAvailable;
+    cb.reclaimed = false;
   }
 
   return true;
@@ -24,6 +24,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/rpc/call_trace_rpc.h"
 
@@ -59,6 +60,11 @@ struct Buffer : public ::CallTraceBuffer {
   Session* session;
   BufferPool* pool;
   BufferState state;
+  // The time at which the buffer entered its current state.
+  base::TimeTicks state_time;
+  // True if the contents of the buffer were discarded while it was idle. This
+  // is reset when the buffer is handed out.
+  bool reclaimed;
 };
 
 // A BufferPool manages a collection of buffers that all belong to the same
@@ -0,0 +1,172 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/buffer_ring_pump.h"
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/trace/service/session.h"
+
+namespace trace {
+namespace service {
+
+namespace {
+
+BufferRingEntry ToEntry(const CallTraceBuffer& buffer) {
+  BufferRingEntry entry = {};
+  entry.shared_memory_handle = buffer.shared_memory_handle;
+  entry.mapping_size = buffer.mapping_size;
+  entry.buffer_offset = buffer.buffer_offset;
+  entry.buffer_size = buffer.buffer_size;
+  return entry;
+}
+
+CallTraceBuffer FromEntry(const BufferRingEntry& entry) {
+  CallTraceBuffer buffer = {};
+  buffer.shared_memory_handle = entry.shared_memory_handle;
+  buffer.mapping_size = entry.mapping_size;
+  buffer.buffer_offset = entry.buffer_offset;
+  buffer.buffer_size = entry.buffer_size;
+  return buffer;
+}
+
+}  // namespace
+
+BufferRingPump::BufferRingPump(Session* session)
+    : session_(session), section_(NULL) {
+  DCHECK(session != NULL);
+}
+
+BufferRingPump::~BufferRingPump() {
+  Stop();
+  if (section_ != NULL) {
+    ignore_result(::UnmapViewOfFile(section_));
+    section_ = NULL;
+  }
+}
+
+bool BufferRingPump::Init() {
+  DCHECK(!section_handle_.IsValid());
+
+  section_handle_.Set(::CreateFileMapping(NULL, NULL, PAGE_READWRITE, 0,
+                                          sizeof(BufferRingSection), NULL));
+  if (!section_handle_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create buffer ring section: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  section_ = reinterpret_cast<BufferRingSection*>(::MapViewOfFile(
+      section_handle_.Get(), FILE_MAP_WRITE, 0, 0,
+      sizeof(BufferRingSection)));
+  if (section_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map buffer ring section: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+  InitializeBufferRingSection(section_);
+
+  committed_event_.Set(::CreateEvent(NULL, FALSE, FALSE, NULL));
+  fresh_event_.Set(::CreateEvent(NULL, FALSE, FALSE, NULL));
+  stop_event_.Set(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  if (!committed_event_.IsValid() || !fresh_event_.IsValid() ||
+      !stop_event_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create buffer ring events: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  return true;
+}
+
+void BufferRingPump::Start() {
+  DCHECK(section_ != NULL);
+  DCHECK(thread_.get() == NULL);
+
+  // Provide the first fresh buffers before the client looks for them.
+  ProvideFreshBuffers();
+
+  thread_.reset(new base::DelegateSimpleThread(this, "BufferRingPump"));
+  thread_->Start();
+}
+
+void BufferRingPump::Stop() {
+  if (thread_.get() == NULL)
+    return;
+
+  ::SetEvent(stop_event_.Get());
+  thread_->Join();
+  thread_.reset();
+}
+
+void BufferRingPump::Run() {
+  HANDLE handles[] = { committed_event_.Get(), stop_event_.Get() };
+  while (true) {
+    DWORD result = ::WaitForMultipleObjects(arraysize(handles), handles,
+                                            FALSE, INFINITE);
+
+    // Committed buffers are returned even when stopping, so that none are
+    // lost when the session closes.
+    ReturnCommittedBuffers();
+    if (result != WAIT_OBJECT_0) {
+      if (result != WAIT_OBJECT_0 + 1) {
+        DWORD error = ::GetLastError();
+        LOG(ERROR) << "Failed to wait for the buffer ring events: "
+                   << ::common::LogWe(error) << ".";
+      }
+      return;
+    }
+
+    ProvideFreshBuffers();
+  }
+}
+
+void BufferRingPump::ReturnCommittedBuffers() {
+  DCHECK(section_ != NULL);
+
+  BufferRingEntry entry = {};
+  while (PopBufferRingEntry(&section_->committed, &entry)) {
+    CallTraceBuffer call_trace_buffer = FromEntry(entry);
+    Buffer* buffer = NULL;
+    if (!session_->FindBuffer(&call_trace_buffer, &buffer))
+      continue;
+    if (!session_->ReturnBuffer(buffer))
+      LOG(ERROR) << "Unable to return buffer to session.";
+  }
+}
+
+void BufferRingPump::ProvideFreshBuffers() {
+  DCHECK(section_ != NULL);
+
+  bool pushed = false;
+  while (GetBufferRingSize(section_->fresh) < kFreshBufferCount) {
+    Buffer* buffer = NULL;
+    if (!session_->GetNextBuffer(&buffer))
+      break;
+    DCHECK(buffer != NULL);
+
+    // The ring can't be full, as only this thread pushes to it.
+    CHECK(PushBufferRingEntry(ToEntry(*buffer), &section_->fresh));
+    pushed = true;
+  }
+
+  if (pushed)
+    ::SetEvent(fresh_event_.Get());
+}
+
+}  // namespace service
+}  // namespace trace
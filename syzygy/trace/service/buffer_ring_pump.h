@@ -0,0 +1,107 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the trace::service::BufferRingPump class, which serves
+// the buffer ring transport of a session. See buffer_ring.h for the layout
+// of the shared memory section.
+
+#ifndef SYZYGY_TRACE_SERVICE_BUFFER_RING_PUMP_H_
+#define SYZYGY_TRACE_SERVICE_BUFFER_RING_PUMP_H_
+
+#include <memory>
+
+#include "base/macros.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/trace/protocol/buffer_ring.h"
+
+namespace trace {
+namespace service {
+
+// Forward declaration.
+class Session;
+
+// Owns the shared memory section and the events of a buffer ring transport,
+// and runs a thread that services them. Whenever the client signals the
+// committed event, the thread returns the committed buffers to the session
+// for writing, and tops up the ring of fresh buffers.
+class BufferRingPump : public base::DelegateSimpleThread::Delegate {
+ public:
+  // The number of fresh buffers the pump tries to keep in the ring. These
+  // are in use from the point of view of the session.
+  static const size_t kFreshBufferCount = 4;
+
+  // @param session the session whose buffers are exchanged. It must outlive
+  //     the pump.
+  explicit BufferRingPump(Session* session);
+  ~BufferRingPump() override;
+
+  // Creates the shared memory section and the events.
+  // @returns true on success, false otherwise.
+  // @note Logs on error.
+  bool Init();
+
+  // Starts the pump thread.
+  // @pre Init has succeeded.
+  void Start();
+
+  // Stops the pump thread. The buffers remaining in the ring of committed
+  // buffers are returned to the session before this returns.
+  void Stop();
+
+  // @name Accessors.
+  // @{
+  HANDLE section_handle() const { return section_handle_.Get(); }
+  size_t section_size() const { return sizeof(BufferRingSection); }
+  HANDLE committed_event() const { return committed_event_.Get(); }
+  HANDLE fresh_event() const { return fresh_event_.Get(); }
+  // @}
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override;
+  // @}
+
+ private:
+  // Returns the buffers of the ring of committed buffers to the session.
+  void ReturnCommittedBuffers();
+
+  // Pushes fresh buffers from the session until the ring holds
+  // kFreshBufferCount buffers. This may block if the session is applying
+  // back-pressure.
+  void ProvideFreshBuffers();
+
+  // The session whose buffers are exchanged.
+  Session* session_;
+
+  // The shared memory section, and its view in this process.
+  base::win::ScopedHandle section_handle_;
+  BufferRingSection* section_;
+
+  // The events used to signal updates to the rings.
+  base::win::ScopedHandle committed_event_;
+  base::win::ScopedHandle fresh_event_;
+
+  // Signaled to stop the pump thread.
+  base::win::ScopedHandle stop_event_;
+
+  std::unique_ptr<base::DelegateSimpleThread> thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferRingPump);
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_BUFFER_RING_PUMP_H_
@@ -0,0 +1,293 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/event_filter.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "base/logging.h"
+#include "syzygy/trace/protocol/trace_file_index.h"
+
+namespace trace {
+namespace service {
+
+namespace {
+
+struct EventTypeName {
+  const char* name;
+  TraceEventType type;
+};
+
+// The names of the event types that can be filtered on.
+const EventTypeName kEventTypeNames[] = {
+    {"TRACE_PROCESS_STARTED", TRACE_PROCESS_STARTED},
+    {"TRACE_PROCESS_ENDED", TRACE_PROCESS_ENDED},
+    {"TRACE_ENTER_EVENT", TRACE_ENTER_EVENT},
+    {"TRACE_EXIT_EVENT", TRACE_EXIT_EVENT},
+    {"TRACE_PROCESS_ATTACH_EVENT", TRACE_PROCESS_ATTACH_EVENT},
+    {"TRACE_PROCESS_DETACH_EVENT", TRACE_PROCESS_DETACH_EVENT},
+    {"TRACE_THREAD_ATTACH_EVENT", TRACE_THREAD_ATTACH_EVENT},
+    {"TRACE_THREAD_DETACH_EVENT", TRACE_THREAD_DETACH_EVENT},
+    {"TRACE_MODULE_EVENT", TRACE_MODULE_EVENT},
+    {"TRACE_BATCH_ENTER", TRACE_BATCH_ENTER},
+    {"TRACE_BATCH_INVOCATION", TRACE_BATCH_INVOCATION},
+    {"TRACE_THREAD_NAME", TRACE_THREAD_NAME},
+    {"TRACE_INDEXED_FREQUENCY", TRACE_INDEXED_FREQUENCY},
+    {"TRACE_DYNAMIC_SYMBOL", TRACE_DYNAMIC_SYMBOL},
+    {"TRACE_SAMPLE_DATA", TRACE_SAMPLE_DATA},
+    {"TRACE_FUNCTION_NAME_TABLE_ENTRY", TRACE_FUNCTION_NAME_TABLE_ENTRY},
+    {"TRACE_STACK_TRACE", TRACE_STACK_TRACE},
+    {"TRACE_DETAILED_FUNCTION_CALL", TRACE_DETAILED_FUNCTION_CALL},
+    {"TRACE_COMMENT", TRACE_COMMENT},
+    {"TRACE_PROCESS_HEAP", TRACE_PROCESS_HEAP},
+    {"TRACE_COMPACT_BATCH_ENTER", TRACE_COMPACT_BATCH_ENTER},
+    {"TRACE_PROFILER_CALIBRATION", TRACE_PROFILER_CALIBRATION},
+    {"TRACE_PROFILER_SAMPLING", TRACE_PROFILER_SAMPLING},
+    {"TRACE_COMPACT_DETAILED_FUNCTION_CALL",
+     TRACE_COMPACT_DETAILED_FUNCTION_CALL},
+};
+
+}  // namespace
+
+EventFilter::EventFilter() : events_dropped_(0) {
+}
+
+void EventFilter::AddEventType(uint16_t type) {
+  event_types_.insert(type);
+}
+
+void EventFilter::AddModule(const base::FilePath& module_name) {
+  DCHECK(!module_name.empty());
+  module_names_.push_back(module_name.BaseName());
+}
+
+void EventFilter::AddThread(uint32_t thread_id) {
+  thread_ids_.insert(thread_id);
+}
+
+bool EventFilter::FilterSegment(uint8_t* data, size_t size) {
+  DCHECK(data != NULL);
+
+  if (size < sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader))
+    return false;
+
+  RecordPrefix* segment_prefix = reinterpret_cast<RecordPrefix*>(data);
+  TraceFileSegmentHeader* header =
+      reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
+
+  // A buffer that was recycled before being used is empty.
+  if (header->segment_length == 0)
+    return true;
+  if (segment_prefix->type != TraceFileSegmentHeader::kTypeId ||
+      segment_prefix->size != sizeof(TraceFileSegmentHeader)) {
+    return false;
+  }
+
+  uint8_t* begin = reinterpret_cast<uint8_t*>(header + 1);
+  if (header->segment_length > size - (begin - data))
+    return false;
+  uint8_t* end = begin + header->segment_length;
+
+  // The segment is written by the client, so its records are checked before
+  // any of them is moved.
+  uint8_t* read_ptr = begin;
+  while (read_ptr < end) {
+    if (static_cast<size_t>(end - read_ptr) < sizeof(RecordPrefix))
+      return false;
+    const RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(read_ptr);
+    if (prefix->size > end - read_ptr - sizeof(RecordPrefix))
+      return false;
+    read_ptr += sizeof(RecordPrefix) + prefix->size;
+  }
+
+  if (empty())
+    return true;
+
+  // Move the kept events down over the dropped ones. The events keep their
+  // order, as readers expect the timestamps of a segment to increase.
+  uint8_t* write_ptr = begin;
+  read_ptr = begin;
+  while (read_ptr < end) {
+    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(read_ptr);
+    size_t record_size = sizeof(RecordPrefix) + prefix->size;
+    if (FilterEvent(header->thread_id, prefix)) {
+      size_t kept_size = sizeof(RecordPrefix) + prefix->size;
+      if (write_ptr != read_ptr)
+        ::memmove(write_ptr, read_ptr, kept_size);
+      write_ptr += kept_size;
+    } else {
+      ++events_dropped_;
+    }
+    read_ptr += record_size;
+  }
+
+  header->segment_length = static_cast<uint32_t>(write_ptr - begin);
+  return true;
+}
+
+bool EventFilter::ParseEventType(const base::StringPiece& name,
+                                 uint16_t* type) {
+  DCHECK(type != NULL);
+
+  for (size_t i = 0; i < arraysize(kEventTypeNames); ++i) {
+    if (name == kEventTypeNames[i].name) {
+      *type = kEventTypeNames[i].type;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool EventFilter::FilterEvent(uint32_t thread_id, RecordPrefix* prefix) {
+  DCHECK(prefix != NULL);
+
+  uint8_t* data = reinterpret_cast<uint8_t*>(prefix + 1);
+
+  // The state of the process is always kept, but the modules it loads are
+  // tracked to filter the other events by module.
+  if (IsTraceStateEvent(prefix->type)) {
+    if (!module_names_.empty() &&
+        (prefix->type == TRACE_PROCESS_ATTACH_EVENT ||
+         prefix->type == TRACE_PROCESS_DETACH_EVENT ||
+         prefix->type == TRACE_MODULE_EVENT) &&
+        prefix->size >= sizeof(TraceModuleData)) {
+      OnModuleEvent(prefix->type,
+                    *reinterpret_cast<const TraceModuleData*>(data));
+    }
+    return true;
+  }
+
+  if (!event_types_.empty() && event_types_.count(prefix->type) == 0)
+    return false;
+
+  // Batches flushed at process exit carry the thread that logged them.
+  const size_t kBatchEnterHeaderSize = offsetof(TraceBatchEnterData, calls);
+  TraceBatchEnterData* batch_enter = NULL;
+  if (prefix->type == TRACE_BATCH_ENTER &&
+      prefix->size >= kBatchEnterHeaderSize) {
+    batch_enter = reinterpret_cast<TraceBatchEnterData*>(data);
+    thread_id = batch_enter->thread_id;
+  }
+  if (!thread_ids_.empty() && thread_ids_.count(thread_id) == 0)
+    return false;
+
+  if (module_names_.empty())
+    return true;
+
+  switch (prefix->type) {
+    case TRACE_ENTER_EVENT:
+    case TRACE_EXIT_EVENT: {
+      if (prefix->size < sizeof(TraceEnterExitEventData))
+        return true;
+      const TraceEnterExitEventData* event =
+          reinterpret_cast<const TraceEnterExitEventData*>(data);
+      return IsFunctionOfInterest(event->function);
+    }
+
+    case TRACE_BATCH_ENTER: {
+      if (batch_enter == NULL)
+        return true;
+      size_t num_calls = std::min(
+          batch_enter->num_calls,
+          (prefix->size - kBatchEnterHeaderSize) /
+              sizeof(TraceEnterEventData));
+      size_t num_kept = 0;
+      for (size_t i = 0; i < num_calls; ++i) {
+        if (IsFunctionOfInterest(batch_enter->calls[i].function))
+          batch_enter->calls[num_kept++] = batch_enter->calls[i];
+      }
+      if (num_kept == 0)
+        return false;
+      if (num_kept < batch_enter->num_calls) {
+        ++events_dropped_;
+        batch_enter->num_calls = num_kept;
+        prefix->size = static_cast<uint32_t>(
+            kBatchEnterHeaderSize + num_kept * sizeof(TraceEnterEventData));
+      }
+      return true;
+    }
+
+    case TRACE_BATCH_INVOCATION: {
+      TraceBatchInvocationInfo* batch =
+          reinterpret_cast<TraceBatchInvocationInfo*>(data);
+      size_t num_invocations = prefix->size / sizeof(InvocationInfo);
+      size_t num_kept = 0;
+      for (size_t i = 0; i < num_invocations; ++i) {
+        // Dynamic symbols aren't in any module, and are kept.
+        const InvocationInfo& invocation = batch->invocations[i];
+        if ((invocation.flags & kFunctionIsSymbol) != 0 ||
+            IsFunctionOfInterest(invocation.function)) {
+          batch->invocations[num_kept++] = invocation;
+        }
+      }
+      if (num_kept == 0)
+        return false;
+      if (num_kept < num_invocations) {
+        ++events_dropped_;
+        prefix->size =
+            static_cast<uint32_t>(num_kept * sizeof(InvocationInfo));
+      }
+      return true;
+    }
+
+    default:
+      // The other events don't refer to a function, or are compact records
+      // that are kept rather than re-encoded. A compact detailed function
+      // call refers to the values interned by the calls before it, so those
+      // are only ever dropped along with all the others of their segment.
+      return true;
+  }
+}
+
+void EventFilter::OnModuleEvent(uint16_t type, const TraceModuleData& module) {
+  uintptr_t base = reinterpret_cast<uintptr_t>(module.module_base_addr);
+  if (type == TRACE_PROCESS_DETACH_EVENT) {
+    modules_.erase(base);
+    return;
+  }
+
+  // The name may fill its array without being terminated.
+  base::FilePath module_path(std::wstring(
+      module.module_name,
+      ::wcsnlen(module.module_name, arraysize(module.module_name))));
+  base::FilePath module_name = module_path.BaseName();
+
+  ModuleRange range = {base + module.module_base_size, false};
+  for (size_t i = 0; i < module_names_.size(); ++i) {
+    if (base::FilePath::CompareEqualIgnoreCase(module_names_[i].value(),
+                                               module_name.value())) {
+      range.is_of_interest = true;
+      break;
+    }
+  }
+  modules_[base] = range;
+}
+
+bool EventFilter::IsFunctionOfInterest(const void* function) const {
+  uintptr_t address = reinterpret_cast<uintptr_t>(function);
+  ModuleMap::const_iterator it = modules_.upper_bound(address);
+  if (it == modules_.begin())
+    return true;
+  --it;
+  if (address >= it->second.end)
+    return true;
+  return it->second.is_of_interest;
+}
+
+}  // namespace service
+}  // namespace trace
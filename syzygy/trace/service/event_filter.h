@@ -0,0 +1,128 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the EventFilter class, which drops the trace events that
+// aren't of interest from a buffer before a buffer consumer writes it. The
+// events kept are compacted to the front of the segment, so that only they
+// reach the disk.
+//
+// Events can be selected by type, by the module holding the function they
+// refer to, and by the thread that emitted them. The events that describe
+// the state of the process, such as module loads, are always kept as they
+// are needed to interpret the others (see IsTraceStateEvent).
+
+#ifndef SYZYGY_TRACE_SERVICE_EVENT_FILTER_H_
+#define SYZYGY_TRACE_SERVICE_EVENT_FILTER_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/strings/string_piece.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace trace {
+namespace service {
+
+// Filters the events of the segments of a single session. An instance tracks
+// the modules loaded by the process of its session, so each session needs a
+// filter of its own. Instances are copyable so that a configured filter can
+// be handed to each session.
+class EventFilter {
+ public:
+  EventFilter();
+
+  // Adds an event type to keep. If no type is added, events of all types are
+  // kept.
+  // @param type a value of the TraceEventType enumeration.
+  void AddEventType(uint16_t type);
+
+  // Adds a module whose events to keep. If no module is added, events are
+  // kept whatever the function they refer to. Events whose function isn't in
+  // a module known to the filter are kept, as the module load event may be
+  // written after them by another thread.
+  // @param module_name the base name of the module, compared without regard
+  //     to case.
+  void AddModule(const base::FilePath& module_name);
+
+  // Adds a thread whose events to keep. If no thread is added, events of all
+  // threads are kept.
+  // @param thread_id the ID of the thread.
+  void AddThread(uint32_t thread_id);
+
+  // @returns true if the filter keeps all events.
+  bool empty() const {
+    return event_types_.empty() && module_names_.empty() &&
+           thread_ids_.empty();
+  }
+
+  // Drops the events that aren't of interest from a segment, and compacts
+  // the others in place.
+  // @param data the segment, starting with its RecordPrefix and
+  //     TraceFileSegmentHeader.
+  // @param size the size of the buffer holding the segment.
+  // @returns false if the segment is malformed, in which case it is left
+  //     untouched.
+  bool FilterSegment(uint8_t* data, size_t size);
+
+  // @returns the number of events dropped, or partly dropped, so far.
+  size_t events_dropped() const { return events_dropped_; }
+
+  // Parses the name of an event type, such as TRACE_BATCH_INVOCATION.
+  // @param name the name of the event type.
+  // @param type receives the event type.
+  // @returns true on success, false if @p name isn't an event type.
+  static bool ParseEventType(const base::StringPiece& name, uint16_t* type);
+
+ protected:
+  // The address range of a loaded module, and whether its events are kept.
+  struct ModuleRange {
+    uintptr_t end;
+    bool is_of_interest;
+  };
+  typedef std::map<uintptr_t, ModuleRange> ModuleMap;
+
+  // Filters a single event, possibly shrinking it.
+  // @param thread_id the thread that wrote the segment holding the event.
+  // @param prefix the prefix of the event, whose size may be reduced.
+  // @returns true if the event is kept.
+  bool FilterEvent(uint32_t thread_id, RecordPrefix* prefix);
+
+  // Updates the loaded modules with a module event.
+  // @param type the type of the event.
+  // @param module the module data of the event.
+  void OnModuleEvent(uint16_t type, const TraceModuleData& module);
+
+  // @param function the address of a function.
+  // @returns true if the events referring to @p function are kept.
+  bool IsFunctionOfInterest(const void* function) const;
+
+  // The event types, module base names and thread IDs of interest.
+  std::set<uint16_t> event_types_;
+  std::vector<base::FilePath> module_names_;
+  std::set<uint32_t> thread_ids_;
+
+  // The modules loaded by the process, keyed by base address. These are only
+  // tracked when filtering by module.
+  ModuleMap modules_;
+
+  // The number of events dropped, or partly dropped.
+  size_t events_dropped_;
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_EVENT_FILTER_H_
@@ -0,0 +1,198 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/event_filter.h"
+
+#include <string.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace trace {
+namespace service {
+
+namespace {
+
+const uint32_t kThreadId = 42;
+const uintptr_t kModuleBase = 0x10000000;
+const size_t kModuleSize = 0x1000;
+
+class EventFilterTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    buffer_.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
+    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(&buffer_[0]);
+    prefix->type = TraceFileSegmentHeader::kTypeId;
+    prefix->size = sizeof(TraceFileSegmentHeader);
+    header()->thread_id = kThreadId;
+  }
+
+  TraceFileSegmentHeader* header() {
+    return reinterpret_cast<TraceFileSegmentHeader*>(
+        &buffer_[sizeof(RecordPrefix)]);
+  }
+
+  // Appends an event to the segment.
+  void AppendEvent(uint16_t type, const void* data, size_t size) {
+    size_t offset = buffer_.size();
+    buffer_.resize(offset + sizeof(RecordPrefix) + size);
+    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(&buffer_[offset]);
+    prefix->timestamp = offset;
+    prefix->type = type;
+    prefix->size = static_cast<uint32_t>(size);
+    if (size > 0)
+      ::memcpy(prefix + 1, data, size);
+    header()->segment_length += sizeof(RecordPrefix) + size;
+  }
+
+  void AppendModuleEvent(uintptr_t base, const wchar_t* name) {
+    TraceModuleData module = {};
+    module.module_base_addr = reinterpret_cast<ModuleAddr>(base);
+    module.module_base_size = kModuleSize;
+    ::wcsncpy(module.module_name, name, arraysize(module.module_name) - 1);
+    AppendEvent(TRACE_PROCESS_ATTACH_EVENT, &module, sizeof(module));
+  }
+
+  void AppendEnterEvent(uintptr_t function) {
+    TraceEnterEventData event = {};
+    event.function = reinterpret_cast<FuncAddr>(function);
+    AppendEvent(TRACE_ENTER_EVENT, &event, sizeof(event));
+  }
+
+  // @returns the types of the events of the segment, in order.
+  std::vector<uint16_t> GetEventTypes() {
+    std::vector<uint16_t> types;
+    uint8_t* read_ptr = &buffer_[0] + sizeof(RecordPrefix) +
+                        sizeof(TraceFileSegmentHeader);
+    uint8_t* end_ptr = read_ptr + header()->segment_length;
+    while (read_ptr < end_ptr) {
+      RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(read_ptr);
+      types.push_back(prefix->type);
+      read_ptr += sizeof(RecordPrefix) + prefix->size;
+    }
+    return types;
+  }
+
+  std::vector<uint8_t> buffer_;
+};
+
+}  // namespace
+
+TEST_F(EventFilterTest, ParseEventType) {
+  uint16_t type = 0;
+  EXPECT_TRUE(EventFilter::ParseEventType("TRACE_BATCH_INVOCATION", &type));
+  EXPECT_EQ(TRACE_BATCH_INVOCATION, type);
+  EXPECT_FALSE(EventFilter::ParseEventType("TRACE_FOO", &type));
+}
+
+TEST_F(EventFilterTest, EmptyFilterKeepsAllEvents) {
+  AppendEnterEvent(kModuleBase);
+  AppendEvent(TRACE_COMMENT, "foo", 3);
+  std::vector<uint8_t> expected(buffer_);
+
+  EventFilter filter;
+  EXPECT_TRUE(filter.empty());
+  EXPECT_TRUE(filter.FilterSegment(&buffer_[0], buffer_.size()));
+  EXPECT_EQ(expected, buffer_);
+  EXPECT_EQ(0u, filter.events_dropped());
+}
+
+TEST_F(EventFilterTest, FiltersByEventType) {
+  AppendModuleEvent(kModuleBase, L"C:\\foo.dll");
+  AppendEnterEvent(kModuleBase);
+  AppendEvent(TRACE_COMMENT, "foo", 3);
+  AppendEnterEvent(kModuleBase);
+
+  EventFilter filter;
+  filter.AddEventType(TRACE_COMMENT);
+  EXPECT_TRUE(filter.FilterSegment(&buffer_[0], buffer_.size()));
+
+  // The module event describes the state of the process, and is kept.
+  std::vector<uint16_t> expected_types;
+  expected_types.push_back(TRACE_PROCESS_ATTACH_EVENT);
+  expected_types.push_back(TRACE_COMMENT);
+  EXPECT_EQ(expected_types, GetEventTypes());
+  EXPECT_EQ(2u, filter.events_dropped());
+}
+
+TEST_F(EventFilterTest, FiltersByThread) {
+  AppendEnterEvent(kModuleBase);
+
+  EventFilter filter;
+  filter.AddThread(kThreadId);
+  EXPECT_TRUE(filter.FilterSegment(&buffer_[0], buffer_.size()));
+  EXPECT_EQ(1u, GetEventTypes().size());
+
+  EventFilter other_thread_filter;
+  other_thread_filter.AddThread(kThreadId + 1);
+  EXPECT_TRUE(other_thread_filter.FilterSegment(&buffer_[0], buffer_.size()));
+  EXPECT_EQ(0u, header()->segment_length);
+}
+
+TEST_F(EventFilterTest, FiltersByModule) {
+  const uintptr_t kOtherModuleBase = kModuleBase + kModuleSize;
+  AppendModuleEvent(kModuleBase, L"C:\\foo\\Foo.dll");
+  AppendModuleEvent(kOtherModuleBase, L"C:\\foo\\bar.dll");
+  AppendEnterEvent(kModuleBase + 0x10);
+  AppendEnterEvent(kOtherModuleBase + 0x10);
+  // A function outside of the known modules is kept.
+  AppendEnterEvent(0x20000000);
+
+  // A batch of invocations is compacted.
+  TraceBatchInvocationInfo invocations[3] = {};
+  invocations[0].invocations[0].function =
+      reinterpret_cast<FuncAddr>(kOtherModuleBase);
+  invocations[1].invocations[0].function =
+      reinterpret_cast<FuncAddr>(kModuleBase);
+  invocations[2].invocations[0].function_symbol_id = 7;
+  invocations[2].invocations[0].flags = kFunctionIsSymbol;
+  AppendEvent(TRACE_BATCH_INVOCATION, invocations, sizeof(invocations));
+
+  EventFilter filter;
+  filter.AddModule(base::FilePath(L"foo.dll"));
+  EXPECT_TRUE(filter.FilterSegment(&buffer_[0], buffer_.size()));
+
+  std::vector<uint16_t> expected_types;
+  expected_types.push_back(TRACE_PROCESS_ATTACH_EVENT);
+  expected_types.push_back(TRACE_PROCESS_ATTACH_EVENT);
+  expected_types.push_back(TRACE_ENTER_EVENT);
+  expected_types.push_back(TRACE_ENTER_EVENT);
+  expected_types.push_back(TRACE_BATCH_INVOCATION);
+  EXPECT_EQ(expected_types, GetEventTypes());
+  EXPECT_EQ(2u, filter.events_dropped());
+
+  // The last event holds the two invocations that were kept.
+  size_t batch_offset = sizeof(RecordPrefix) +
+                        sizeof(TraceFileSegmentHeader) +
+                        header()->segment_length - 2 * sizeof(InvocationInfo);
+  const InvocationInfo* kept =
+      reinterpret_cast<const InvocationInfo*>(&buffer_[batch_offset]);
+  EXPECT_EQ(reinterpret_cast<FuncAddr>(kModuleBase), kept[0].function);
+  EXPECT_EQ(7u, kept[1].function_symbol_id);
+}
+
+TEST_F(EventFilterTest, LeavesMalformedSegmentUntouched) {
+  AppendEnterEvent(kModuleBase);
+  header()->segment_length += 8;
+  buffer_.resize(buffer_.size() + 8);
+  std::vector<uint8_t> expected(buffer_);
+
+  EventFilter filter;
+  filter.AddEventType(TRACE_COMMENT);
+  EXPECT_FALSE(filter.FilterSegment(&buffer_[0], buffer_.size()));
+  EXPECT_EQ(expected, buffer_);
+}
+
+}  // namespace service
+}  // namespace trace
@@ -22,6 +22,7 @@
 #include "syzygy/trace/service/service.h"
 
 #include <memory>
+#include <vector>
 
 #include "base/bind.h"
 #include "base/callback.h"
@@ -52,6 +53,9 @@ Service::Service(BufferConsumerFactory* factory)
       num_incremental_buffers_(kDefaultNumIncrementalBuffers),
       buffer_size_in_bytes_(kDefaultBufferSize),
       max_buffers_pending_write_(kDefaultMaxBuffersPendingWrite),
+      enable_buffer_rings_(false),
+      adaptive_buffer_pools_(false),
+      flight_recorder_buffers_(0),
       owner_thread_(base::PlatformThread::CurrentId()),
       buffer_consumer_factory_(factory),
       a_session_has_closed_(&lock_),
@@ -401,6 +405,33 @@ bool Service::RequestShutdown() {
   return true;
 }
 
+// RPC entry point.
+bool Service::FlushFlightRecorders() {
+  if (flight_recorder_buffers_ == 0) {
+    LOG(ERROR) << "The call trace service isn't running as a flight recorder.";
+    return false;
+  }
+
+  std::vector<scoped_refptr<Session>> to_flush;
+  {
+    base::AutoLock auto_lock(lock_);
+    SessionMap::iterator iter = sessions_.begin();
+    for (; iter != sessions_.end(); ++iter)
+      to_flush.push_back(iter->second);
+  }
+
+  LOG(INFO) << "Flushing the flight recorders of " << to_flush.size()
+            << " sessions.";
+
+  bool success = true;
+  for (size_t i = 0; i < to_flush.size(); ++i) {
+    if (!to_flush[i]->FlushRetainedBuffers())
+      success = false;
+  }
+
+  return success;
+}
+
 // RPC entry point.
 bool Service::CreateSession(handle_t binding,
                             SessionHandle* session_handle,
@@ -583,6 +614,45 @@ bool Service::CloseSession(SessionHandle* session_handle) {
   return true;
 }
 
+// RPC entry-point.
+bool Service::CreateBufferRing(SessionHandle session_handle,
+                               unsigned long* section_handle,
+                               unsigned long* section_size,
+                               unsigned long* committed_event,
+                               unsigned long* fresh_event) {
+  if (session_handle == NULL || section_handle == NULL ||
+      section_size == NULL || committed_event == NULL || fresh_event == NULL) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  // Clients fall back to exchanging buffers through RPCs.
+  if (!enable_buffer_rings_)
+    return false;
+
+  scoped_refptr<Session> session;
+  if (!GetExistingSession(session_handle, &session))
+    return false;
+  DCHECK(session.get() != NULL);
+
+  HANDLE client_section = NULL;
+  size_t client_section_size = 0;
+  HANDLE client_committed_event = NULL;
+  HANDLE client_fresh_event = NULL;
+  if (!session->CreateBufferRing(&client_section, &client_section_size,
+                                 &client_committed_event,
+                                 &client_fresh_event)) {
+    return false;
+  }
+
+  *section_handle = reinterpret_cast<unsigned long>(client_section);
+  *section_size = static_cast<unsigned long>(client_section_size);
+  *committed_event = reinterpret_cast<unsigned long>(client_committed_event);
+  *fresh_event = reinterpret_cast<unsigned long>(client_fresh_event);
+
+  return true;
+}
+
 bool Service::GetNewSession(ProcessId client_process_id,
                             scoped_refptr<Session>* session) {
   DCHECK(session != NULL);
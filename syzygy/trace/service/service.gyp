@@ -24,6 +24,10 @@
         'buffer_consumer.h',
         'buffer_pool.cc',
         'buffer_pool.h',
+        'buffer_ring_pump.cc',
+        'buffer_ring_pump.h',
+        'event_filter.cc',
+        'event_filter.h',
         'mapped_buffer.cc',
         'mapped_buffer.h',
         'process_info.cc',
@@ -34,6 +38,10 @@
         'service_rpc_impl.h',
         'session.cc',
         'session.h',
+        'session_stream_writer.cc',
+        'session_stream_writer.h',
+        'session_stream_writer_factory.cc',
+        'session_stream_writer_factory.h',
         'session_trace_file_writer.cc',
         'session_trace_file_writer.h',
         'session_trace_file_writer_factory.cc',
@@ -43,7 +51,9 @@
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
       ],
     },
@@ -51,6 +61,7 @@
       'target_name': 'rpc_service_unittests',
       'type': 'executable',
       'sources': [
+        'event_filter_unittest.cc',
         'mapped_buffer_unittest.cc',
         'process_info_unittest.cc',
         'service_unittest.cc',
@@ -95,5 +106,22 @@
         },
       },
     },
+    {
+      'target_name': 'trace_pipeline_benchmark',
+      'type': 'executable',
+      'sources': [
+        'trace_pipeline_benchmark.cc',
+      ],
+      'dependencies': [
+        'rpc_service_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/trace/client/client.gyp:rpc_client_lib',
+        '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
+      ],
+      'libraries': [
+        'imagehlp.lib',
+      ],
+    },
   ],
 }
@@ -96,6 +96,9 @@ class Service {
   //     If TRACE_FLAG_BATCH_ENTER is set, all other flags will be ignored.
   void set_flags(uint32_t flags) { flags_ = flags; }
 
+  // @returns the trace flags communicated to clients on session creation.
+  uint32_t flags() const { return flags_; }
+
   // Set the number of buffers by which to grow a sessions
   // buffer pool.
   void set_num_incremental_buffers(size_t n) {
@@ -116,6 +119,39 @@ class Service {
     max_buffers_pending_write_ = n;
   }
 
+  // Sets whether sessions may set up a buffer ring transport, through which
+  // clients exchange buffers without an RPC round-trip per buffer.
+  // @param enable true to allow buffer rings.
+  void set_enable_buffer_rings(bool enable) { enable_buffer_rings_ = enable; }
+
+  // @returns true if sessions may set up a buffer ring transport.
+  bool enable_buffer_rings() const { return enable_buffer_rings_; }
+
+  // Sets whether sessions size their buffer pools adaptively. A session then
+  // grows its pool by as many buffers as its observed fill rate and write
+  // latency call for, rather than by num_incremental_buffers, and discards
+  // the contents of buffers that have been idle for a while.
+  // @param adaptive true to size buffer pools adaptively.
+  void set_adaptive_buffer_pools(bool adaptive) {
+    adaptive_buffer_pools_ = adaptive;
+  }
+
+  // @returns true if sessions size their buffer pools adaptively.
+  bool adaptive_buffer_pools() const { return adaptive_buffer_pools_; }
+
+  // Sets the service to run as a flight recorder. Each session then retains
+  // the most recent buffers returned by its client in memory, rather than
+  // writing them, until FlushFlightRecorders is called. Older buffers are
+  // recycled without being written, and so are the retained buffers of a
+  // session that closes before being flushed.
+  // @param n the number of buffers each session retains. Zero writes buffers
+  //     as they are returned.
+  void set_flight_recorder_buffers(size_t n) { flight_recorder_buffers_ = n; }
+
+  // @returns the number of buffers each session retains, or zero if the
+  //     service isn't running as a flight recorder.
+  size_t flight_recorder_buffers() const { return flight_recorder_buffers_; }
+
   // @returns the number of new buffers to be created per allocation.
   size_t num_incremental_buffers() const { return num_incremental_buffers_; }
 
@@ -168,6 +204,11 @@ class Service {
   // See call_trace_rpc.idl for further info.
   bool RequestShutdown();
 
+  // RPC implementation of CallTraceControl::Flush(). Has the open sessions
+  // write the buffers they have retained as flight recorders.
+  // See call_trace_rpc.idl for further info.
+  bool FlushFlightRecorders();
+
   // RPC implementation of CallTraceService::CreateSession().
   // See call_trace_rpc.idl for further info.
   bool CreateSession(handle_t binding,
@@ -197,6 +238,14 @@ class Service {
   // See call_trace_rpc.idl for further info.
   bool CloseSession(SessionHandle* session_handle);
 
+  // RPC implementation of CallTraceService::CreateBufferRing().
+  // See call_trace_rpc.idl for further info.
+  bool CreateBufferRing(SessionHandle session_handle,
+                        unsigned long* section_handle,
+                        unsigned long* section_size,
+                        unsigned long* committed_event,
+                        unsigned long* fresh_event);
+
   // Decrement the active session count.
   // @see num_active_sessions_
   void RemoveOneActiveSession();
@@ -274,6 +323,15 @@ class Service {
   // The maximum number of buffers that a session should have pending write.
   size_t max_buffers_pending_write_;
 
+  // Whether sessions may set up a buffer ring transport.
+  bool enable_buffer_rings_;
+
+  // Whether sessions size their buffer pools adaptively.
+  bool adaptive_buffer_pools_;
+
+  // The number of buffers each session retains as a flight recorder.
+  size_t flight_recorder_buffers_;
+
   // Handle to the thread that owns/created this call trace service instance.
   base::PlatformThreadId owner_thread_;
 
@@ -12,8 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
@@ -26,6 +29,7 @@
 #include "base/process/launch.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_piece.h"
+#include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/threading/thread.h"
@@ -35,6 +39,7 @@
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/service.h"
 #include "syzygy/trace/service/service_rpc_impl.h"
+#include "syzygy/trace/service/session_stream_writer_factory.h"
 #include "syzygy/trace/service/session_trace_file_writer_factory.h"
 
 namespace trace {
@@ -50,6 +55,9 @@ const int kMinBufferSize = 1024 * 1024;
 // Minimum number of buffers to allocate.
 const int kMinBuffers = 16;
 
+// Maximum number of writer threads to start.
+const int kMaxWriterThreads = 64;
+
 // A static location to which the current instance id can be saved. We
 // persist it here so that OnConsoleCtrl can have access to the instance
 // id when it is invoked on the signal handler thread.
@@ -80,6 +88,8 @@ const char kUsage[] =
     "                     for it to be ready, and returns. The call trace\n"
     "                     service continues running in the background.\n"
     "  stop               Stop the call trace service.\n"
+    "  flush              Have an instance of the call trace service running\n"
+    "                     as a flight recorder write the buffers it retains.\n"
     "\n"
     "Options:\n"
     "  --help             Show this help message.\n"
@@ -90,6 +100,46 @@ const char kUsage[] =
     "                     pool each time the client exhausts its available\n"
     "                     buffer space.\n"
     "  --enable-exits     Enable exit tracing (off by default).\n"
+    "  --compact-records  Have clients encode batch function entries\n"
+    "                     compactly. Requires a trace parser that decodes\n"
+    "                     compact records.\n"
+    "  --adaptive-buffer-pools\n"
+    "                     Grow the buffer pool of each client with the rate\n"
+    "                     at which it fills buffers, and discard the contents\n"
+    "                     of buffers that stay idle.\n"
+    "  --enable-buffer-rings\n"
+    "                     Let clients exchange buffers through shared memory\n"
+    "                     rings rather than an RPC per buffer.\n"
+    "  --compress-trace   Compress each segment of the trace files as it is\n"
+    "                     written. The trace parser reads both compressed\n"
+    "                     and uncompressed trace files.\n"
+    "  --index-trace      Write a segment index alongside each trace file,\n"
+    "                     letting the trace parser skip to the segments of\n"
+    "                     interest.\n"
+    "  --stream-to=PIPE   Stream the traces to the named pipe PIPE, of the\n"
+    "                     form \\\\host\\pipe\\name, rather than writing\n"
+    "                     trace files. Each traced process connects to an\n"
+    "                     instance of the pipe of its own. Buffers are\n"
+    "                     dropped if the reader of the pipe falls behind.\n"
+    "  --writer-threads=NUM\n"
+    "                     The number of threads writing the trace files,\n"
+    "                     over which the traced processes are spread.\n"
+    "                     Defaults to 1.\n"
+    "  --flight-recorder=MB\n"
+    "                     Retain the most recent MB megabytes of each trace\n"
+    "                     in memory rather than writing it, until the flush\n"
+    "                     action is invoked. Traces that aren't flushed are\n"
+    "                     discarded when their process ends.\n"
+    "  --filter-events=TYPE,...\n"
+    "                     Only write the events of the given types, such as\n"
+    "                     TRACE_BATCH_INVOCATION. Events describing the\n"
+    "                     state of the process, such as module loads, are\n"
+    "                     always written.\n"
+    "  --filter-modules=NAME,...\n"
+    "                     Only write the events referring to functions of\n"
+    "                     the given modules, such as foo.dll.\n"
+    "  --filter-threads=ID,...\n"
+    "                     Only write the events of the given threads.\n"
     "  --verbose          Increase the logging verbosity to also include\n"
     "                     debug-level information.\n"
     "  --instance-id=ID   A unique identifier to use for the RPC endpoint.\n"
@@ -119,6 +169,45 @@ bool GetInstanceId(const base::CommandLine* cmd_line, std::wstring* id) {
   return true;
 }
 
+// Configures an event filter from the filtering switches of the command line.
+bool ParseEventFilter(const base::CommandLine* cmd_line,
+                      EventFilter* event_filter) {
+  DCHECK(cmd_line != NULL);
+  DCHECK(event_filter != NULL);
+
+  std::vector<std::string> event_types = base::SplitString(
+      cmd_line->GetSwitchValueASCII("filter-events"), ",",
+      base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  for (size_t i = 0; i < event_types.size(); ++i) {
+    uint16_t type = 0;
+    if (!EventFilter::ParseEventType(event_types[i], &type)) {
+      LOG(ERROR) << "Unknown event type: " << event_types[i] << ".";
+      return false;
+    }
+    event_filter->AddEventType(type);
+  }
+
+  std::vector<std::wstring> module_names = base::SplitString(
+      cmd_line->GetSwitchValueNative("filter-modules"), L",",
+      base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  for (size_t i = 0; i < module_names.size(); ++i)
+    event_filter->AddModule(base::FilePath(module_names[i]));
+
+  std::vector<std::string> thread_ids = base::SplitString(
+      cmd_line->GetSwitchValueASCII("filter-threads"), ",",
+      base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  for (size_t i = 0; i < thread_ids.size(); ++i) {
+    uint32_t thread_id = 0;
+    if (!base::StringToUint(thread_ids[i], &thread_id)) {
+      LOG(ERROR) << "Invalid thread ID: " << thread_ids[i] << ".";
+      return false;
+    }
+    event_filter->AddThread(thread_id);
+  }
+
+  return true;
+}
+
 // A helper function which sets the Syzygy RPC instance id environment variable
 // then runs a given command line to completion.
 // TODO(etienneb): We should merge common code of logger and call_service.
@@ -167,7 +256,44 @@ bool RunService(const base::CommandLine* cmd_line,
 
   base::MessageLoop* message_loop = writer_thread.message_loop();
   SessionTraceFileWriterFactory session_trace_file_writer_factory(message_loop);
-  Service call_trace_service(&session_trace_file_writer_factory);
+
+  // Start the additional writer threads, if any.
+  std::vector<std::unique_ptr<base::Thread>> extra_writer_threads;
+  std::string writer_threads_str(
+      cmd_line->GetSwitchValueASCII("writer-threads"));
+  if (!writer_threads_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(writer_threads_str, &num) || num < 1 ||
+        num > kMaxWriterThreads) {
+      LOG(ERROR) << "Invalid number of writer threads: " << writer_threads_str
+                 << ".";
+      return false;
+    }
+    for (int i = 1; i < num; ++i) {
+      extra_writer_threads.push_back(std::unique_ptr<base::Thread>(
+          new base::Thread("trace-file-writer")));
+      if (!extra_writer_threads.back()->StartWithOptions(
+              base::Thread::Options(base::MessageLoop::TYPE_IO, 0))) {
+        LOG(ERROR) << "Failed to start call trace service writer thread.";
+        return false;
+      }
+      session_trace_file_writer_factory.AddMessageLoop(
+          extra_writer_threads.back()->message_loop());
+    }
+  }
+
+  // Streaming replaces the trace files altogether.
+  base::FilePath pipe_name(cmd_line->GetSwitchValuePath("stream-to"));
+  std::unique_ptr<SessionStreamWriterFactory> session_stream_writer_factory;
+  BufferConsumerFactory* buffer_consumer_factory =
+      &session_trace_file_writer_factory;
+  if (!pipe_name.empty()) {
+    session_stream_writer_factory.reset(
+        new SessionStreamWriterFactory(message_loop, pipe_name));
+    buffer_consumer_factory = session_stream_writer_factory.get();
+  }
+
+  Service call_trace_service(buffer_consumer_factory);
   RpcServiceInstanceManager rpc_instance(&call_trace_service);
 
   // Get/set the instance id.
@@ -180,11 +306,31 @@ bool RunService(const base::CommandLine* cmd_line,
                 instance_id.c_str(),
                 arraysize(saved_instance_id));
 
-  // Set up the trace directory.
-  base::FilePath trace_directory(cmd_line->GetSwitchValuePath("trace-dir"));
-  if (trace_directory.empty())
-    trace_directory = base::FilePath(L".");
-  if (!session_trace_file_writer_factory.SetTraceFileDirectory(trace_directory))
+  if (session_stream_writer_factory.get() != NULL) {
+    if (cmd_line->HasSwitch("compress-trace"))
+      session_stream_writer_factory->set_compress(true);
+  } else {
+    // Set up the trace directory.
+    base::FilePath trace_directory(cmd_line->GetSwitchValuePath("trace-dir"));
+    if (trace_directory.empty())
+      trace_directory = base::FilePath(L".");
+    if (!session_trace_file_writer_factory.SetTraceFileDirectory(
+            trace_directory)) {
+      return false;
+    }
+  }
+
+  if (cmd_line->HasSwitch("compress-trace"))
+    session_trace_file_writer_factory.set_compress_trace_files(true);
+
+  if (cmd_line->HasSwitch("index-trace"))
+    session_trace_file_writer_factory.set_write_trace_file_index(true);
+
+  // Setup the event filter of the sessions.
+  EventFilter* event_filter = session_trace_file_writer_factory.event_filter();
+  if (session_stream_writer_factory.get() != NULL)
+    event_filter = session_stream_writer_factory->event_filter();
+  if (!ParseEventFilter(cmd_line, event_filter))
     return false;
 
   // Setup the buffer size.
@@ -198,10 +344,36 @@ bool RunService(const base::CommandLine* cmd_line,
     call_trace_service.set_buffer_size_in_bytes(num);
   }
 
+  // Setup the flight recorder, whose size is converted to whole buffers.
+  std::wstring flight_recorder_str(
+      cmd_line->GetSwitchValueNative("flight-recorder"));
+  if (!flight_recorder_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(flight_recorder_str, &num) || num < 1) {
+      LOG(ERROR) << "Invalid flight recorder size: " << flight_recorder_str;
+      return false;
+    }
+    size_t buffers = (static_cast<size_t>(num) << 20) /
+                     call_trace_service.buffer_size_in_bytes();
+    call_trace_service.set_flight_recorder_buffers(
+        std::max(static_cast<size_t>(1), buffers));
+  }
+
   if (cmd_line->HasSwitch("enable-exits")) {
     call_trace_service.set_flags(TRACE_FLAG_ENTER | TRACE_FLAG_EXIT);
   }
 
+  if (cmd_line->HasSwitch("compact-records")) {
+    call_trace_service.set_flags(call_trace_service.flags() |
+                                 TRACE_FLAG_COMPACT_RECORDS);
+  }
+
+  if (cmd_line->HasSwitch("adaptive-buffer-pools"))
+    call_trace_service.set_adaptive_buffer_pools(true);
+
+  if (cmd_line->HasSwitch("enable-buffer-rings"))
+    call_trace_service.set_enable_buffer_rings(true);
+
   // Setup the number of incremental buffers
   std::wstring buffers_str(
       cmd_line->GetSwitchValueNative("num-incremental-buffers"));
@@ -335,6 +507,31 @@ bool StopService(const base::StringPiece16& instance_id) {
   return true;
 }
 
+bool FlushService(const base::StringPiece16& instance_id) {
+  std::wstring protocol;
+  std::wstring endpoint;
+
+  ::GetSyzygyCallTraceRpcProtocol(&protocol);
+  ::GetSyzygyCallTraceRpcEndpoint(instance_id, &endpoint);
+
+  LOG(INFO) << "Flushing call trace logging service instance at '"
+            << endpoint << "' via " << protocol << '.';
+
+  handle_t binding = NULL;
+  if (!CreateRpcBinding(protocol, endpoint, &binding)) {
+    LOG(ERROR) << "Failed to connect to call trace logging service.";
+    return false;
+  }
+
+  if (!InvokeRpc(CallTraceClient_Flush, binding).succeeded()) {
+    LOG(ERROR) << "Failed to flush call trace logging service.";
+    return false;
+  }
+
+  LOG(INFO) << "Call trace service flush has been requested.";
+  return true;
+}
+
 extern "C" int main(int argc, char** argv) {
   base::AtExitManager at_exit_manager;
   base::CommandLine::Init(argc, argv);
@@ -378,6 +575,11 @@ extern "C" int main(int argc, char** argv) {
     return (GetInstanceId(cmd_line, &id) && StopService(id)) ? 0 : 1;
   }
 
+  if (base::LowerCaseEqualsASCII(cmd_line->GetArgs()[0], "flush")) {
+    std::wstring id;
+    return (GetInstanceId(cmd_line, &id) && FlushService(id)) ? 0 : 1;
+  }
+
   if (base::LowerCaseEqualsASCII(cmd_line->GetArgs()[0], "start")) {
     return RunService(cmd_line, &app_command_line) ? 0 : 1;
   }
@@ -84,12 +84,31 @@ boolean CallTraceService_CloseSession(
   return true;
 }
 
+// RPC entrypoint for CallTraceService::CreateBufferRing().
+boolean CallTraceService_CreateBufferRing(
+    /* [in] */ SessionHandle session_handle,
+    /* [out] */ unsigned long* section_handle,
+    /* [out] */ unsigned long* section_size,
+    /* [out] */ unsigned long* committed_event,
+    /* [out] */ unsigned long* fresh_event) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->CreateBufferRing(session_handle, section_handle,
+                                    section_size, committed_event,
+                                    fresh_event);
+}
+
 // RPC entrypoint for CallTraceControl::Stop().
 boolean CallTraceService_Stop(/* [in] */ handle_t /* binding */) {
   Service* instance = RpcServiceInstanceManager::GetInstance();
   return instance->RequestShutdown();
 }
 
+// RPC entrypoint for CallTraceControl::Flush().
+boolean CallTraceService_Flush(/* [in] */ handle_t /* binding */) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->FlushFlightRecorders();
+}
+
 // This callback is invoked if the RPC mechanism detects that a client
 // has ceased to exist, but the service still has resources allocated
 // on the client's behalf.
@@ -35,6 +35,7 @@
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/parse/parse_utils.h"
+#include "syzygy/trace/protocol/buffer_ring.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/service_rpc_impl.h"
 #include "syzygy/trace/service/session_trace_file_writer_factory.h"
@@ -283,6 +284,35 @@ class CallTraceServiceTest : public testing::Test {
     ASSERT_TRUE(*session_handle == NULL);
   }
 
+  // Sets up the buffer ring transport of a session, and maps its section.
+  void CreateBufferRing(SessionHandle session_handle,
+                        ScopedHandle* section,
+                        BufferRingSection** buffer_ring,
+                        ScopedHandle* committed_event,
+                        ScopedHandle* fresh_event) {
+    unsigned long section_handle = 0;
+    unsigned long section_size = 0;
+    unsigned long committed_event_handle = 0;
+    unsigned long fresh_event_handle = 0;
+    RpcStatus status = InvokeRpc(CallTraceClient_CreateBufferRing,
+                                 session_handle,
+                                 &section_handle,
+                                 &section_size,
+                                 &committed_event_handle,
+                                 &fresh_event_handle);
+    ASSERT_FALSE(status.exception_occurred);
+    ASSERT_TRUE(status.result);
+    ASSERT_EQ(sizeof(BufferRingSection), section_size);
+
+    section->Set(reinterpret_cast<HANDLE>(section_handle));
+    committed_event->Set(reinterpret_cast<HANDLE>(committed_event_handle));
+    fresh_event->Set(reinterpret_cast<HANDLE>(fresh_event_handle));
+    *buffer_ring = reinterpret_cast<BufferRingSection*>(::MapViewOfFile(
+        section->Get(), FILE_MAP_WRITE, 0, 0, section_size));
+    ASSERT_TRUE(*buffer_ring != NULL);
+    ASSERT_EQ(BufferRingSection::kVersion, (*buffer_ring)->version);
+  }
+
   void ReadTraceFile(std::string* contents) {
     base::FileEnumerator enumerator(temp_dir_.path(),
                                     false,
@@ -811,5 +841,89 @@ TEST_F(CallTraceServiceTest, SendBuffer) {
             RawPtrDiff(prefix + 1, segment_header + 1));
 }
 
+TEST_F(CallTraceServiceTest, CreateBufferRingFailsIfDisabled) {
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segment;
+
+  ASSERT_TRUE(call_trace_service_.Start(true));
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segment));
+
+  unsigned long section_handle = 0;
+  unsigned long section_size = 0;
+  unsigned long committed_event = 0;
+  unsigned long fresh_event = 0;
+  RpcStatus status = InvokeRpc(CallTraceClient_CreateBufferRing,
+                               session_handle,
+                               &section_handle,
+                               &section_size,
+                               &committed_event,
+                               &fresh_event);
+  ASSERT_FALSE(status.exception_occurred);
+  EXPECT_FALSE(status.result);
+
+  ASSERT_NO_FATAL_FAILURE(ReturnBuffer(session_handle, &segment));
+  ASSERT_NO_FATAL_FAILURE(CloseSession(&session_handle));
+}
+
+TEST_F(CallTraceServiceTest, SendBufferThroughRing) {
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segment;
+  const size_t kNumBlocks = 2 * BufferRing::kCapacity;
+  const char kMessage[] = "Sent through the buffer ring.";
+
+  call_trace_service_.set_enable_buffer_rings(true);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segment));
+
+  ScopedHandle section;
+  BufferRingSection* buffer_ring = NULL;
+  ScopedHandle committed_event;
+  ScopedHandle fresh_event;
+  ASSERT_NO_FATAL_FAILURE(CreateBufferRing(session_handle, &section,
+                                           &buffer_ring, &committed_event,
+                                           &fresh_event));
+
+  // Commit more buffers than the rings hold, getting the fresh buffers from
+  // the ring as the service provides them.
+  for (size_t block = 0; block < kNumBlocks; ++block) {
+    segment.WriteSegmentHeader(session_handle);
+    MyRecordType* record = segment.AllocateTraceRecord<MyRecordType>();
+    base::strlcpy(record->message, kMessage, arraysize(record->message));
+
+    BufferRingEntry entry = { segment.buffer_info.shared_memory_handle,
+                              segment.buffer_info.mapping_size,
+                              segment.buffer_info.buffer_offset,
+                              segment.buffer_info.buffer_size };
+    ASSERT_TRUE(PushBufferRingEntry(entry, &buffer_ring->committed));
+    ASSERT_TRUE(::SetEvent(committed_event.Get()));
+
+    while (!PopBufferRingEntry(&buffer_ring->fresh, &entry)) {
+      ASSERT_EQ(WAIT_OBJECT_0,
+                ::WaitForSingleObject(fresh_event.Get(), INFINITE));
+    }
+    segment.buffer_info.shared_memory_handle = entry.shared_memory_handle;
+    segment.buffer_info.mapping_size = entry.mapping_size;
+    segment.buffer_info.buffer_offset = entry.buffer_offset;
+    segment.buffer_info.buffer_size = entry.buffer_size;
+    ASSERT_NO_FATAL_FAILURE(MapSegmentBuffer(&segment));
+  }
+
+  // The service drains the ring of committed buffers when the session closes.
+  ASSERT_NO_FATAL_FAILURE(ReturnBuffer(session_handle, &segment));
+  ASSERT_TRUE(::UnmapViewOfFile(buffer_ring));
+  ASSERT_NO_FATAL_FAILURE(CloseSession(&session_handle));
+  ASSERT_TRUE(call_trace_service_.Stop());
+
+  // Each committed block was written, followed by the process ended event.
+  // The fresh buffers left in the ring are empty and aren't written.
+  std::string trace_file_contents;
+  ASSERT_NO_FATAL_FAILURE(ReadTraceFile(&trace_file_contents));
+  TraceFileHeader* header =
+      reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
+  ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
+  EXPECT_EQ(trace_file_contents.length(),
+            RoundedSize(*header) + (kNumBlocks + 1) * header->block_size);
+}
+
 }  // namespace service
 }  // namespace trace
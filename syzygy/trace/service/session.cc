@@ -23,6 +23,7 @@
 #include "syzygy/trace/service/session.h"
 
 #include <time.h>
+#include <algorithm>
 #include <memory>
 
 #include "base/command_line.h"
@@ -44,6 +45,31 @@ namespace {
 
 using base::ProcessId;
 
+// The number of buffers by which an adaptive buffer pool first grows, and the
+// multiple of num_incremental_buffers by which it grows at most.
+const size_t kMinAdaptiveIncrement = 2;
+const size_t kMaxAdaptiveIncrementScale = 8;
+
+// An adaptive buffer pool that grows again within this interval is growing
+// too slowly, and grows twice as much as it last did.
+const int kFastGrowthIntervalMs = 1000;
+
+// The time after which the contents of an available buffer are discarded.
+const int kIdleReclaimDelayMs = 30000;
+
+// The weight of past samples in the smoothed estimates.
+const double kSmoothingFactor = 8.0;
+
+// Folds a sample into a smoothed estimate, which is negative until the first
+// sample.
+void UpdateEstimate(double sample, double* estimate) {
+  DCHECK(estimate != NULL);
+  if (*estimate < 0)
+    *estimate = sample;
+  else
+    *estimate += (sample - *estimate) / kSmoothingFactor;
+}
+
 // Helper for logging Buffer::ID values.
 std::ostream& operator << (std::ostream& stream, const Buffer::ID& buffer_id) {
   return stream << "shared_memory_handle=0x" << std::hex << buffer_id.first
@@ -58,6 +84,11 @@ Session::Session(Service* call_trace_service)
       buffer_consumer_(NULL),
       buffer_requests_waiting_for_recycle_(0),
       buffer_is_available_(&lock_),
+      buffers_returned_(0),
+      buffers_reclaimed_(0),
+      fill_interval_us_(-1.0),
+      write_latency_us_(-1.0),
+      last_increment_(0),
       buffer_id_(0),
       input_error_already_logged_(false) {
   DCHECK(call_trace_service != NULL);
@@ -76,10 +107,19 @@ Session::~Session() {
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kInUse]);
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kPendingWrite]);
 
+  BufferStats stats = {};
+  GetBufferStats(&stats);
+  VLOG(1) << "Session for PID=" << client_.process_id << " used "
+          << stats.num_buffers << " buffers in " << stats.num_pools
+          << " pools (" << (stats.bytes_allocated >> 20) << "MB), "
+          << stats.buffers_returned << " returned, "
+          << stats.buffers_reclaimed << " reclaimed.";
+
   // Not strictly necessary, but let's make sure nothing refers to the
   // client buffers before we delete the underlying memory.
   buffers_.clear();
   buffers_available_.clear();
+  retained_buffers_.clear();
 
   // The session owns all of its shared memory buffers using raw pointers
   // inserted into the shared_memory_buffers_ list.
@@ -110,40 +150,109 @@ bool Session::Init(ProcessId client_process_id) {
 }
 
 bool Session::Close() {
-  std::vector<Buffer*> buffers;
-  base::AutoLock lock(lock_);
-
-  // It's possible that the service is being stopped just after this session
-  // was marked for closure. The service would then attempt to re-close the
-  // session. Let's ignore these requests.
-  if (is_closing_)
-    return true;
+  // Stop the buffer ring first, as its pump thread uses the session. This
+  // returns the buffers the client committed to the ring.
+  {
+    base::AutoLock buffer_ring_lock(buffer_ring_lock_);
+    if (buffer_ring_pump_.get() != NULL) {
+      buffer_ring_pump_->Stop();
+      buffer_ring_pump_.reset();
+    }
+  }
 
-  // Otherwise the session is being asked to close for the first time.
-  is_closing_ = true;
+  bool flight_recorder = call_trace_service_->flight_recorder_buffers() > 0;
+  std::vector<Buffer*> discarded_buffers;
+  {
+    base::AutoLock lock(lock_);
 
-  // We'll reserve space for the worst case scenario buffer count.
-  buffers.reserve(buffer_state_counts_[Buffer::kInUse] + 1);
+    // It's possible that the service is being stopped just after this session
+    // was marked for closure. The service would then attempt to re-close the
+    // session. Let's ignore these requests.
+    if (is_closing_)
+      return true;
 
-  // Schedule any outstanding buffers for flushing.
-  for (BufferMap::iterator it = buffers_.begin(); it != buffers_.end(); ++it) {
-    Buffer* buffer = it->second;
-    DCHECK(buffer != NULL);
-    if (buffer->state == Buffer::kInUse) {
+    // Otherwise the session is being asked to close for the first time.
+    is_closing_ = true;
+
+    // Schedule any outstanding buffers for flushing. A flight recorder that
+    // wasn't flushed discards them along with the buffers it retained.
+    for (BufferMap::iterator it = buffers_.begin(); it != buffers_.end();
+         ++it) {
+      Buffer* buffer = it->second;
+      DCHECK(buffer != NULL);
+      if (buffer->state == Buffer::kInUse) {
+        ChangeBufferState(Buffer::kPendingWrite, buffer);
+        if (flight_recorder)
+          discarded_buffers.push_back(buffer);
+        else
+          buffer_consumer_->ConsumeBuffer(buffer);
+      }
+    }
+    discarded_buffers.insert(discarded_buffers.end(),
+                             retained_buffers_.begin(),
+                             retained_buffers_.end());
+    retained_buffers_.clear();
+
+    // Create a process ended event. This causes at least one buffer to be in
+    // use to store the process ended event.
+    Buffer* buffer = NULL;
+    if (CreateProcessEndedEvent(&buffer)) {
+      DCHECK(buffer != NULL);
       ChangeBufferState(Buffer::kPendingWrite, buffer);
       buffer_consumer_->ConsumeBuffer(buffer);
     }
   }
 
-  // Create a process ended event. This causes at least one buffer to be in
-  // use to store the process ended event.
-  Buffer* buffer = NULL;
-  if (CreateProcessEndedEvent(&buffer)) {
-    DCHECK(buffer != NULL);
-    ChangeBufferState(Buffer::kPendingWrite, buffer);
-    buffer_consumer_->ConsumeBuffer(buffer);
+  // The discarded buffers are recycled outside of the lock, as recycling
+  // acquires it.
+  for (size_t i = 0; i < discarded_buffers.size(); ++i)
+    DiscardBuffer(discarded_buffers[i]);
+
+  return true;
+}
+
+bool Session::CreateBufferRing(HANDLE* client_section,
+                               size_t* section_size,
+                               HANDLE* client_committed_event,
+                               HANDLE* client_fresh_event) {
+  DCHECK(client_section != NULL);
+  DCHECK(section_size != NULL);
+  DCHECK(client_committed_event != NULL);
+  DCHECK(client_fresh_event != NULL);
+
+  base::AutoLock buffer_ring_lock(buffer_ring_lock_);
+  if (buffer_ring_pump_.get() != NULL) {
+    LOG(ERROR) << "Session already has a buffer ring.";
+    return false;
   }
 
+  {
+    base::AutoLock lock(lock_);
+    if (is_closing_) {
+      LOG(ERROR) << "Session is closing but someone is trying to create a "
+                 << "buffer ring.";
+      return false;
+    }
+  }
+
+  std::unique_ptr<BufferRingPump> pump(new BufferRingPump(this));
+  if (!pump->Init())
+    return false;
+
+  HANDLE client_process = client_.process_handle.Get();
+  if (!CopyBufferHandleToClient(client_process, pump->section_handle(),
+                                client_section) ||
+      !CopyBufferHandleToClient(client_process, pump->committed_event(),
+                                client_committed_event) ||
+      !CopyBufferHandleToClient(client_process, pump->fresh_event(),
+                                client_fresh_event)) {
+    return false;
+  }
+  *section_size = pump->section_size();
+
+  pump->Start();
+  buffer_ring_pump_.swap(pump);
+
   return true;
 }
 
@@ -212,6 +321,7 @@ bool Session::ReturnBuffer(Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK(buffer->session == this);
 
+  Buffer* evicted = NULL;
   {
     base::AutoLock lock(lock_);
 
@@ -220,9 +330,32 @@ bool Session::ReturnBuffer(Buffer* buffer) {
     if (is_closing_)
       return true;
 
+    base::TimeTicks now = base::TimeTicks::Now();
+    if (!last_return_time_.is_null()) {
+      UpdateEstimate((now - last_return_time_).InMicrosecondsF(),
+                     &fill_interval_us_);
+    }
+    last_return_time_ = now;
+    ++buffers_returned_;
+
     ChangeBufferState(Buffer::kPendingWrite, buffer);
+
+    // A flight recorder retains the most recent buffers rather than writing
+    // them, and discards the oldest one once it retains too many.
+    size_t flight_recorder_buffers =
+        call_trace_service_->flight_recorder_buffers();
+    if (flight_recorder_buffers > 0) {
+      retained_buffers_.push_back(buffer);
+      if (retained_buffers_.size() <= flight_recorder_buffers)
+        return true;
+      evicted = retained_buffers_.front();
+      retained_buffers_.pop_front();
+    }
   }
 
+  if (evicted != NULL)
+    return DiscardBuffer(evicted);
+
   // Hand the buffer over to the consumer.
   if (!buffer_consumer_->ConsumeBuffer(buffer)) {
     LOG(ERROR) << "Unable to schedule buffer for writing.";
@@ -232,6 +365,39 @@ bool Session::ReturnBuffer(Buffer* buffer) {
   return true;
 }
 
+bool Session::FlushRetainedBuffers() {
+  BufferQueue buffers;
+  {
+    base::AutoLock lock(lock_);
+    buffers.swap(retained_buffers_);
+  }
+
+  bool success = true;
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    if (!buffer_consumer_->ConsumeBuffer(buffers[i])) {
+      LOG(ERROR) << "Unable to schedule buffer for writing.";
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+bool Session::DiscardBuffer(Buffer* buffer) {
+  DCHECK(buffer != NULL);
+  DCHECK(buffer->session == this);
+  DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
+
+  MappedBuffer mapped_buffer(buffer);
+  if (mapped_buffer.Map()) {
+    ::memset(mapped_buffer.data(), 0,
+             sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
+    mapped_buffer.Unmap();
+  }
+
+  return RecycleBuffer(buffer);
+}
+
 bool Session::RecycleBuffer(Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK(buffer->session == this);
@@ -251,10 +417,18 @@ bool Session::RecycleBuffer(Buffer* buffer) {
 
   base::AutoLock lock(lock_);
 
+  UpdateEstimate((base::TimeTicks::Now() - buffer->state_time)
+                     .InMicrosecondsF(),
+                 &write_latency_us_);
+
   ChangeBufferState(Buffer::kAvailable, buffer);
   buffers_available_.push_front(buffer);
   buffer_is_available_.Signal();
 
+  // Recycled buffers are handed out first, so the buffers at the back of the
+  // queue are those that have been idle for the longest.
+  ReclaimIdleBuffer();
+
   // If the session is closing and all outstanding buffers have been recycled
   // then it's safe to destroy this session.
   if (is_closing_ && buffer_state_counts_[Buffer::kInUse] == 0 &&
@@ -283,6 +457,9 @@ void Session::ChangeBufferState(BufferState new_state, Buffer* buffer) {
 
   // Apply the state change.
   buffer->state = new_state;
+  buffer->state_time = base::TimeTicks::Now();
+  if (new_state == Buffer::kInUse)
+    buffer->reclaimed = false;
   buffer_state_counts_[old_state]--;
   buffer_state_counts_[new_state]++;
 }
@@ -389,11 +566,15 @@ bool Session::AllocateBuffers(size_t num_buffers, size_t buffer_size) {
   }
 
   // Put the client buffers into the list of available buffers and update
-  // the buffer state information.
+  // the buffer state information. The pages of a new buffer are not yet
+  // backed by memory, so there is nothing to reclaim.
+  base::TimeTicks now = base::TimeTicks::Now();
   for (Buffer* buf = pool_ptr->begin(); buf != pool_ptr->end(); ++buf) {
     Buffer::ID buffer_id = Buffer::GetID(*buf);
 
     buf->state = Buffer::kAvailable;
+    buf->state_time = now;
+    buf->reclaimed = true;
     CHECK(buffers_.insert(std::make_pair(buffer_id, buf)).second);
 
     buffer_state_counts_[Buffer::kAvailable]++;
@@ -463,10 +644,14 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
   while (buffers_available_.empty()) {
     // Figure out how many buffers we can force to be recycled according to our
     // threshold and the number of write-pending buffers.
+    // The buffers retained by a flight recorder won't be recycled until they
+    // are flushed, so they don't count.
+    size_t buffers_pending_write =
+        buffer_state_counts_[Buffer::kPendingWrite] - retained_buffers_.size();
     size_t buffers_force_recyclable = 0;
-    if (buffer_state_counts_[Buffer::kPendingWrite] >
+    if (buffers_pending_write >
         call_trace_service_->max_buffers_pending_write()) {
-      buffers_force_recyclable = buffer_state_counts_[Buffer::kPendingWrite] -
+      buffers_force_recyclable = buffers_pending_write -
           call_trace_service_->max_buffers_pending_write();
     }
 
@@ -481,7 +666,7 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
       --buffer_requests_waiting_for_recycle_;
     } else {
       // Otherwise, force an allocation.
-      if (!AllocateBuffers(call_trace_service_->num_incremental_buffers(),
+      if (!AllocateBuffers(GetNumIncrementalBuffers(),
                            call_trace_service_->buffer_size_in_bytes())) {
         return false;
       }
@@ -497,6 +682,111 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
   return true;
 }
 
+size_t Session::GetNumIncrementalBuffers() {
+  lock_.AssertAcquired();
+
+  size_t num_incremental_buffers =
+      call_trace_service_->num_incremental_buffers();
+  if (!call_trace_service_->adaptive_buffer_pools())
+    return num_incremental_buffers;
+
+  size_t max_increment =
+      std::max(kMinAdaptiveIncrement,
+               num_incremental_buffers * kMaxAdaptiveIncrementScale);
+  size_t increment = std::min(kMinAdaptiveIncrement, num_incremental_buffers);
+
+  // The buffers handed to the consumer are unavailable for as long as it
+  // takes to write them. Enough buffers to cover the buffers returned during
+  // that time are needed to keep the client from waiting on the consumer.
+  if (fill_interval_us_ > 0 && write_latency_us_ >= 0) {
+    size_t needed =
+        static_cast<size_t>(write_latency_us_ / fill_interval_us_) + 1;
+    increment = std::max(increment, needed);
+  }
+
+  // The estimates lag behind a client that speeds up, so a pool that grows
+  // again soon after growing last grows geometrically.
+  base::TimeTicks now = base::TimeTicks::Now();
+  if (!last_allocation_time_.is_null() &&
+      now - last_allocation_time_ <
+          base::TimeDelta::FromMilliseconds(kFastGrowthIntervalMs)) {
+    increment = std::max(increment, 2 * last_increment_);
+  }
+
+  increment = std::max<size_t>(1, std::min(increment, max_increment));
+  last_allocation_time_ = now;
+  last_increment_ = increment;
+  return increment;
+}
+
+void Session::ReclaimIdleBuffer() {
+  lock_.AssertAcquired();
+
+  if (!call_trace_service_->adaptive_buffer_pools() || is_closing_)
+    return;
+
+  base::TimeTicks now = base::TimeTicks::Now();
+  BufferQueue::reverse_iterator it = buffers_available_.rbegin();
+  for (; it != buffers_available_.rend(); ++it) {
+    if (!(*it)->reclaimed)
+      break;
+  }
+  if (it == buffers_available_.rend() ||
+      now - (*it)->state_time <
+          base::TimeDelta::FromMilliseconds(kIdleReclaimDelayMs)) {
+    return;
+  }
+
+  Buffer* buffer = *it;
+  MappedBuffer mapped_buffer(buffer);
+  if (!mapped_buffer.Map())
+    return;
+
+  // The pages of the buffer are no longer written to the paging file, and
+  // may be discarded to free physical memory. Only the pages lying entirely
+  // within the buffer are reset, as the others hold data of its neighbours.
+  // The shared memory remains committed until the session ends, as the
+  // client maps its pools for the lifetime of the session.
+  SYSTEM_INFO sys_info = {};
+  ::GetSystemInfo(&sys_info);
+  uint8_t* begin = ::common::AlignUp(mapped_buffer.data(), sys_info.dwPageSize);
+  uint8_t* end = ::common::AlignDown(mapped_buffer.data() + buffer->buffer_size,
+                                     sys_info.dwPageSize);
+  if (begin < end &&
+      ::VirtualAlloc(begin, end - begin, MEM_RESET, PAGE_READWRITE) == NULL) {
+    DWORD error = ::GetLastError();
+    VLOG(1) << "Failed to reset idle buffer: " << ::common::LogWe(error)
+            << ".";
+  }
+
+  buffer->reclaimed = true;
+  ++buffers_reclaimed_;
+}
+
+void Session::GetBufferStats(BufferStats* stats) {
+  DCHECK(stats != NULL);
+
+  base::AutoLock lock(lock_);
+
+  stats->num_pools = shared_memory_buffers_.size();
+  stats->num_buffers = buffers_.size();
+  stats->bytes_allocated = 0;
+  SharedMemoryBufferCollection::const_iterator it =
+      shared_memory_buffers_.begin();
+  for (; it != shared_memory_buffers_.end(); ++it)
+    stats->bytes_allocated += (*it)->begin()->mapping_size;
+  stats->buffers_returned = buffers_returned_;
+  stats->buffers_reclaimed = buffers_reclaimed_;
+  stats->buffers_retained = retained_buffers_.size();
+  stats->buffers_pending_write =
+      buffer_state_counts_[Buffer::kPendingWrite] - retained_buffers_.size();
+  stats->last_increment = last_increment_;
+  stats->fill_interval = base::TimeDelta::FromMicroseconds(
+      static_cast<int64_t>(std::max(0.0, fill_interval_us_)));
+  stats->write_latency = base::TimeDelta::FromMicroseconds(
+      static_cast<int64_t>(std::max(0.0, write_latency_us_)));
+}
+
 bool Session::DestroySingletonBuffer(Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK_EQ(0u, buffer->buffer_offset);
@@ -20,6 +20,7 @@
 
 #include <list>
 #include <map>
+#include <memory>
 
 #include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
@@ -29,6 +30,7 @@
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/buffer_pool.h"
+#include "syzygy/trace/service/buffer_ring_pump.h"
 #include "syzygy/trace/service/process_info.h"
 
 namespace trace {
@@ -47,14 +49,55 @@ class Session : public base::RefCountedThreadSafe<Session> {
 
   explicit Session(Service* call_trace_service);
 
+  // The counters of the buffer pool of a session.
+  struct BufferStats {
+    // The number of shared memory pools, and of buffers across them.
+    size_t num_pools;
+    size_t num_buffers;
+    // The size of the shared memory pools, in bytes.
+    uint64_t bytes_allocated;
+    // The number of buffers the client has returned to be written.
+    size_t buffers_returned;
+    // The number of idle buffers whose contents were discarded.
+    size_t buffers_reclaimed;
+    // The number of returned buffers retained by a flight recorder.
+    size_t buffers_retained;
+    // The number of returned buffers waiting to be written by the consumer.
+    size_t buffers_pending_write;
+    // The number of buffers by which the pool last grew.
+    size_t last_increment;
+    // The smoothed time between returned buffers, and from a buffer being
+    // returned to it being recycled by the consumer.
+    base::TimeDelta fill_interval;
+    base::TimeDelta write_latency;
+  };
+
  public:
   // Initialize this session object.
   bool Init(ProcessId client_process_id);
 
   // Close the session. The causes the session to flush all of its outstanding
-  // buffers to the write queue.
+  // buffers to the write queue. The buffer ring transport of the session, if
+  // any, is stopped first so that its committed buffers are written. When the
+  // service runs as a flight recorder the outstanding and retained buffers are
+  // discarded instead, and only the process ended event is written.
   bool Close();
 
+  // Sets up a buffer ring transport for this session, and duplicates its
+  // handles into the client process. A session has at most one buffer ring.
+  // @param client_section receives the client's handle to the shared memory
+  //     section.
+  // @param section_size receives the size of the shared memory section.
+  // @param client_committed_event receives the client's handle to the event
+  //     it signals after updating the rings.
+  // @param client_fresh_event receives the client's handle to the event that
+  //     is signaled after fresh buffers are pushed.
+  // @returns true on success, false otherwise.
+  bool CreateBufferRing(HANDLE* client_section,
+                        size_t* section_size,
+                        HANDLE* client_committed_event,
+                        HANDLE* client_fresh_event);
+
   // Get the next available buffer for use by a client. The session retains
   // ownership of the buffer object, it MUST not be deleted by the caller. This
   // may cause new buffers to be allocated if there are no free buffers
@@ -90,12 +133,22 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @returns true on success, false otherwise.
   bool RecycleBuffer(Buffer* buffer);
 
+  // Hands the buffers retained while the service runs as a flight recorder
+  // over to the consumer, oldest first. The session keeps on retaining the
+  // buffers returned after this.
+  // @returns true on success, false otherwise.
+  bool FlushRetainedBuffers();
+
   // Locates the local record of the given call trace buffer.  The session
   // retains ownership of the buffer object, it MUST not be deleted by the
   // caller.
   bool FindBuffer(::CallTraceBuffer* call_trace_buffer,
                   Buffer** client_buffer);
 
+  // Gets the counters of the buffer pool of this session.
+  // @param stats receives the counters.
+  void GetBufferStats(BufferStats* stats);
+
   // Returns the process id of the client process.
   ProcessId client_process_id() const { return client_.process_id; }
 
@@ -173,6 +226,18 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @pre minimum_size must be bigger than the common buffer allocation size.
   bool AllocateBufferForImmediateUse(size_t minimum_size, Buffer** out_buffer);
 
+  // Gets the number of buffers by which to grow the buffer pool. This is
+  // num_incremental_buffers unless the service sizes buffer pools adaptively.
+  // @returns the number of buffers to allocate.
+  // @pre Under lock_.
+  size_t GetNumIncrementalBuffers();
+
+  // Discards the contents of the available buffer that has been idle for the
+  // longest, if it has been idle long enough. Only adaptive buffer pools are
+  // reclaimed.
+  // @pre Under lock_.
+  void ReclaimIdleBuffer();
+
   // A private implementation of GetNextBuffer, but which assumes the lock has
   // already been acquired.
   // @param buffer will be populated with a pointer to the buffer to be provided
@@ -193,6 +258,13 @@ class Session : public base::RefCountedThreadSafe<Session> {
   //     a single buffer.
   bool DestroySingletonBuffer(Buffer* buffer);
 
+  // Clears a buffer that is pending write and recycles it without handing it
+  // to the consumer. As for written buffers, the header of the buffer is
+  // cleared so that it is seen as empty should it be consumed again.
+  // @param buffer the buffer to discard.
+  // @returns true on success, false otherwise.
+  bool DiscardBuffer(Buffer* buffer);
+
   // Transitions the buffer to the given state. This only updates the buffer's
   // internal state and buffer_state_counts_, but not buffers_available_.
   // DCHECKs on any attempted invalid state changes.
@@ -238,6 +310,11 @@ class Session : public base::RefCountedThreadSafe<Session> {
   typedef std::deque<Buffer*> BufferQueue;
   BufferQueue buffers_available_;  // Under lock_.
 
+  // Returned buffers retained while the service runs as a flight recorder,
+  // oldest first. These are pending write, but aren't handed to the consumer
+  // until they are flushed.
+  BufferQueue retained_buffers_;  // Under lock_.
+
   // Tracks whether this session is in the process of shutting down.
   bool is_closing_;  // Under lock_.
 
@@ -249,6 +326,16 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // This condition variable is used to indicate that a buffer is available.
   base::ConditionVariable buffer_is_available_;  // Under lock_.
 
+  // The counters and estimates driving adaptive buffer pools. The smoothed
+  // intervals are in microseconds, and negative until first estimated.
+  size_t buffers_returned_;  // Under lock_.
+  size_t buffers_reclaimed_;  // Under lock_.
+  double fill_interval_us_;  // Under lock_.
+  double write_latency_us_;  // Under lock_.
+  base::TimeTicks last_return_time_;  // Under lock_.
+  base::TimeTicks last_allocation_time_;  // Under lock_.
+  size_t last_increment_;  // Under lock_.
+
   // This is currently only used to allocate unique IDs to buffers allocated
   // after the session closes.
   // TODO(rogerm): extend this to all buffers.
@@ -258,6 +345,12 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // state.
   base::Lock lock_;
 
+  // The buffer ring transport of this session, if any. This is only accessed
+  // while setting up and closing the session, but those may race when the
+  // client process dies. Under buffer_ring_lock_.
+  std::unique_ptr<BufferRingPump> buffer_ring_pump_;
+  base::Lock buffer_ring_lock_;
+
   // Tracks whether or not invalid input errors have already been logged.
   // When an error of this type occurs, there will typically be numerous
   // follow-on occurrences that we don't want to log.
@@ -0,0 +1,232 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/session_stream_writer.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "base/bind.h"
+#include "base/time/time.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/service/buffer_pool.h"
+#include "syzygy/trace/service/mapped_buffer.h"
+#include "syzygy/trace/service/session.h"
+
+namespace trace {
+namespace service {
+
+namespace {
+
+// The interval at which completed writes are reaped while writes are in
+// flight. Writes are also reaped as new buffers are consumed.
+const int kReapIntervalMs = 1;
+
+}  // namespace
+
+const uint32_t SessionStreamWriter::kConnectTimeoutMs = 10000;
+
+SessionStreamWriter::SessionStreamWriter(base::MessageLoop* message_loop,
+                                         const base::FilePath& pipe_name)
+    : message_loop_(message_loop),
+      pipe_name_(pipe_name),
+      max_queued_buffers_(0),
+      buffers_dropped_(0),
+      stream_failed_(false),
+      reap_scheduled_(false) {
+  DCHECK(message_loop != NULL);
+  DCHECK(!pipe_name.empty());
+}
+
+bool SessionStreamWriter::Open(Session* session) {
+  DCHECK(session != NULL);
+
+  // Connect to the pipe and stream the header.
+  if (!writer_.OpenPipe(pipe_name_, kConnectTimeoutMs) ||
+      !writer_.WriteHeader(session->client_info())) {
+    return false;
+  }
+
+  LOG(INFO) << "Streaming the trace of process "
+            << session->client_info().process_id << " to '"
+            << pipe_name_.value() << "'.";
+  return true;
+}
+
+bool SessionStreamWriter::Close(Session* /* session */) {
+  // The session has recycled all of its buffers by now, so no write is still
+  // in flight and no buffer is waiting.
+  DCHECK_EQ(0u, writer_.pending_writes());
+  DCHECK(queued_buffers_.empty());
+
+  if (buffers_dropped_ > 0) {
+    LOG(WARNING) << "Dropped " << buffers_dropped_ << " buffers streaming to '"
+                 << pipe_name_.value() << "'.";
+  }
+
+  if (writer_.path().empty())
+    return true;
+  return writer_.Close();
+}
+
+bool SessionStreamWriter::ConsumeBuffer(Buffer* buffer) {
+  DCHECK(buffer != NULL);
+  DCHECK(buffer->session != NULL);
+  DCHECK(message_loop_ != NULL);
+
+  message_loop_->PostTask(FROM_HERE,
+                          base::Bind(&SessionStreamWriter::EnqueueBuffer,
+                                     this,
+                                     scoped_refptr<Session>(buffer->session),
+                                     base::Unretained(buffer)));
+
+  return true;
+}
+
+size_t SessionStreamWriter::block_size() const {
+  return writer_.block_size();
+}
+
+void SessionStreamWriter::EnqueueBuffer(scoped_refptr<Session> session,
+                                        Buffer* buffer) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK_EQ(session, buffer->session);
+  DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  if (stream_failed_) {
+    DropBuffer(session, buffer);
+    return;
+  }
+
+  // Make room for the buffer by retiring the writes that have completed.
+  writer_.ReapCompletedWrites();
+
+  queued_buffers_.push_back(QueuedBuffer(session, buffer));
+  IssueQueuedWrites();
+
+  // The consumer is falling behind. The oldest buffers are dropped, so that
+  // the stream resumes with the most recent events.
+  while (queued_buffers_.size() > max_queued_buffers_) {
+    QueuedBuffer queued = queued_buffers_.front();
+    queued_buffers_.pop_front();
+    DropBuffer(queued.first, queued.second);
+  }
+
+  ScheduleReapCompletedWrites();
+}
+
+void SessionStreamWriter::IssueQueuedWrites() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  // Without asynchronous writes, each buffer is written as it is issued.
+  size_t max_pending_writes =
+      std::max(static_cast<size_t>(1), writer_.max_pending_writes());
+  while (!queued_buffers_.empty() &&
+         writer_.pending_writes() < max_pending_writes) {
+    QueuedBuffer queued = queued_buffers_.front();
+    queued_buffers_.pop_front();
+    if (stream_failed_)
+      DropBuffer(queued.first, queued.second);
+    else
+      WriteBuffer(queued.first, queued.second);
+  }
+}
+
+void SessionStreamWriter::WriteBuffer(scoped_refptr<Session> session,
+                                      Buffer* buffer) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  std::unique_ptr<MappedBuffer> mapped_buffer(new MappedBuffer(buffer));
+  if (!mapped_buffer->Map()) {
+    DropBuffer(session, buffer);
+    return;
+  }
+
+  // The buffer stays mapped until it has been written, as it is written
+  // directly from the mapping. The events that aren't of interest are
+  // dropped first.
+  uint8_t* data = mapped_buffer->data();
+  ignore_result(event_filter_.FilterSegment(data, buffer->buffer_size));
+  writer_.WriteRecordAsync(
+      data, buffer->buffer_size,
+      base::Bind(&SessionStreamWriter::OnBufferWritten, this, session,
+                 base::Unretained(buffer),
+                 base::Owned(mapped_buffer.release())));
+}
+
+void SessionStreamWriter::OnBufferWritten(scoped_refptr<Session> session,
+                                          Buffer* buffer,
+                                          MappedBuffer* mapped_buffer,
+                                          bool success) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK(mapped_buffer != NULL);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  // The writer will have logged the failure. Rather than logging again for
+  // every buffer, the remaining buffers are dropped.
+  if (!success) {
+    if (!stream_failed_) {
+      LOG(ERROR) << "Stopped streaming to '" << pipe_name_.value() << "'.";
+      stream_failed_ = true;
+    }
+    ++buffers_dropped_;
+  }
+
+  // As for trace files, the buffer is cleared so that it is seen as empty
+  // should it be consumed again on a forced shutdown.
+  ::memset(mapped_buffer->data(), 0,
+           sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
+
+  mapped_buffer->Unmap();
+  session->RecycleBuffer(buffer);
+}
+
+void SessionStreamWriter::DropBuffer(scoped_refptr<Session> session,
+                                     Buffer* buffer) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+
+  ++buffers_dropped_;
+  session->RecycleBuffer(buffer);
+}
+
+void SessionStreamWriter::ReapCompletedWrites() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  reap_scheduled_ = false;
+  writer_.ReapCompletedWrites();
+  IssueQueuedWrites();
+  ScheduleReapCompletedWrites();
+}
+
+void SessionStreamWriter::ScheduleReapCompletedWrites() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  if (reap_scheduled_ || writer_.pending_writes() == 0)
+    return;
+
+  reap_scheduled_ = true;
+  message_loop_->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&SessionStreamWriter::ReapCompletedWrites, this),
+      base::TimeDelta::FromMilliseconds(kReapIntervalMs));
+}
+
+}  // namespace service
+}  // namespace trace
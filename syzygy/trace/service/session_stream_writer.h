@@ -0,0 +1,168 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the SessionStreamWriter class, a buffer consumer that
+// streams the trace of a session to a named pipe rather than writing it to a
+// trace file. The pipe may be served by a consumer on another machine, in
+// which case nothing is written to the local disk. The stream holds the same
+// bytes as the trace file of the session would.
+//
+// The stream is flow controlled. At most max_pending_writes buffers are in
+// flight to the pipe, and at most max_queued_buffers more wait their turn. If
+// the consumer falls further behind, the oldest waiting buffers are dropped
+// rather than slowing down the traced process or growing its buffer pool
+// without bound. If the pipe breaks all further buffers are dropped.
+
+#ifndef SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_H_
+#define SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_H_
+
+#include <deque>
+#include <utility>
+
+#include "base/files/file_path.h"
+#include "base/threading/thread.h"
+#include "syzygy/trace/service/buffer_consumer.h"
+#include "syzygy/trace/service/event_filter.h"
+#include "syzygy/trace/service/trace_file_writer.h"
+
+namespace trace {
+namespace service {
+
+// Forward Declaration.
+class MappedBuffer;
+class Session;
+
+// This class implements the interface the buffer consumer thread uses to
+// stream incoming buffers to a named pipe.
+class SessionStreamWriter : public BufferConsumer {
+ public:
+  // Construct a SessionStreamWriter instance.
+  // @param message_loop The message loop on which this writer instance will
+  //     consume buffers. The writer instance does NOT take ownership of the
+  //     message_loop. The message_loop must outlive the writer instance.
+  // @param pipe_name The name of the pipe to which this writer instance will
+  //     stream the trace, of the form \\host\pipe\name.
+  SessionStreamWriter(base::MessageLoop* message_loop,
+                      const base::FilePath& pipe_name);
+
+  // Sets whether the segments of the stream are compressed. Must be called
+  // before Open.
+  // @param compress true to compress the segments.
+  void set_compress(bool compress) { writer_.set_compress(compress); }
+
+  // Sets the maximum number of buffers in flight to the pipe. Must be called
+  // before Open.
+  // @param max_pending_writes the maximum number of writes in flight. Zero
+  //     writes each buffer synchronously.
+  void set_max_pending_writes(size_t max_pending_writes) {
+    writer_.set_max_pending_writes(max_pending_writes);
+  }
+
+  // Sets the maximum number of buffers waiting for a write to complete before
+  // buffers are dropped.
+  // @param max_queued_buffers the maximum number of waiting buffers.
+  void set_max_queued_buffers(size_t max_queued_buffers) {
+    max_queued_buffers_ = max_queued_buffers;
+  }
+
+  // Sets the filter applied to the events of each buffer before it is
+  // written. Must be called before Open.
+  // @param event_filter the filter, which is copied.
+  void set_event_filter(const EventFilter& event_filter) {
+    event_filter_ = event_filter;
+  }
+
+  // @returns the number of buffers that were dropped rather than streamed.
+  size_t buffers_dropped() const { return buffers_dropped_; }
+
+  // @name BufferConsumer implementation.
+  // @{
+  bool Open(Session* session) override;
+  bool Close(Session* session) override;
+  bool ConsumeBuffer(Buffer* buffer) override;
+  size_t block_size() const override;
+  // @}
+
+  // How long Open waits for an instance of the pipe to be available.
+  static const uint32_t kConnectTimeoutMs;
+
+ protected:
+  typedef std::pair<scoped_refptr<Session>, Buffer*> QueuedBuffer;
+
+  // Queues a trace buffer to be streamed, dropping the oldest queued buffers
+  // if there are too many. This will be called on message_loop_.
+  void EnqueueBuffer(scoped_refptr<Session> session, Buffer* buffer);
+
+  // Issues the writes of queued buffers while fewer than the maximum number
+  // of writes are in flight. This will be called on message_loop_.
+  void IssueQueuedWrites();
+
+  // Streams a trace buffer to the pipe. This will be called on message_loop_.
+  void WriteBuffer(scoped_refptr<Session> session, Buffer* buffer);
+
+  // Recycles a trace buffer once it has been streamed. This will be called on
+  // message_loop_.
+  void OnBufferWritten(scoped_refptr<Session> session,
+                       Buffer* buffer,
+                       MappedBuffer* mapped_buffer,
+                       bool success);
+
+  // Recycles a trace buffer without streaming it.
+  void DropBuffer(scoped_refptr<Session> session, Buffer* buffer);
+
+  // Recycles the buffers whose writes have completed, issues the writes of
+  // queued buffers, and schedules itself again while writes remain in flight.
+  // This will be called on message_loop_.
+  void ReapCompletedWrites();
+
+  // Schedules a call to ReapCompletedWrites if writes are in flight and none
+  // is scheduled yet.
+  void ScheduleReapCompletedWrites();
+
+  // The message loop on which this writer will do IO.
+  base::MessageLoop* const message_loop_;
+
+  // The name of the pipe to which the trace is streamed.
+  const base::FilePath pipe_name_;
+
+  // This is used for streaming the buffers.
+  TraceFileWriter writer_;
+
+  // The filter applied to the events of each buffer before it is written.
+  EventFilter event_filter_;
+
+  // The buffers waiting for a write to complete, in the order in which they
+  // were consumed.
+  std::deque<QueuedBuffer> queued_buffers_;
+
+  // The maximum number of waiting buffers.
+  size_t max_queued_buffers_;
+
+  // The number of buffers dropped rather than streamed.
+  size_t buffers_dropped_;
+
+  // Whether a write has failed. The pipe is then considered broken.
+  bool stream_failed_;
+
+  // Whether a call to ReapCompletedWrites is scheduled.
+  bool reap_scheduled_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SessionStreamWriter);
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_H_
@@ -0,0 +1,55 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/session_stream_writer_factory.h"
+
+#include "base/message_loop/message_loop.h"
+#include "syzygy/trace/service/session_stream_writer.h"
+
+namespace trace {
+namespace service {
+
+const size_t SessionStreamWriterFactory::kDefaultMaxPendingWrites = 4;
+const size_t SessionStreamWriterFactory::kDefaultMaxQueuedBuffers = 64;
+
+SessionStreamWriterFactory::SessionStreamWriterFactory(
+    base::MessageLoop* message_loop,
+    const base::FilePath& pipe_name)
+    : message_loop_(message_loop),
+      pipe_name_(pipe_name),
+      compress_(false),
+      max_pending_writes_(kDefaultMaxPendingWrites),
+      max_queued_buffers_(kDefaultMaxQueuedBuffers) {
+  DCHECK(message_loop != NULL);
+  DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
+  DCHECK(!pipe_name.empty());
+}
+
+bool SessionStreamWriterFactory::CreateConsumer(
+    scoped_refptr<BufferConsumer>* consumer) {
+  DCHECK(consumer != NULL);
+  DCHECK(message_loop_ != NULL);
+
+  SessionStreamWriter* writer =
+      new SessionStreamWriter(message_loop_, pipe_name_);
+  writer->set_compress(compress_);
+  writer->set_max_pending_writes(max_pending_writes_);
+  writer->set_max_queued_buffers(max_queued_buffers_);
+  writer->set_event_filter(event_filter_);
+  *consumer = writer;
+  return true;
+}
+
+}  // namespace service
+}  // namespace trace
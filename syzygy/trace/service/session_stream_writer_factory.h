@@ -0,0 +1,108 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the factory for SessionStreamWriter objects. This is used
+// by the service in place of the SessionTraceFileWriterFactory to stream the
+// traces of its sessions to a named pipe.
+
+#ifndef SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_FACTORY_H_
+#define SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_FACTORY_H_
+
+#include "base/files/file_path.h"
+#include "syzygy/trace/service/buffer_consumer.h"
+#include "syzygy/trace/service/event_filter.h"
+
+// Forward declaration.
+namespace base { class MessageLoop; }
+
+namespace trace {
+namespace service {
+
+// This class creates a stream writer for each session of a call trace service
+// instance. Each session gets a connection of its own to the pipe.
+class SessionStreamWriterFactory : public BufferConsumerFactory {
+ public:
+  // Construct a SessionStreamWriterFactory instance.
+  // @param message_loop The message loop on which SessionStreamWriter
+  //     instances created by this factory will consume buffers. The factory
+  //     instance does NOT take ownership of the message_loop. The message_loop
+  //     must outlive the factory instance.
+  // @param pipe_name The name of the pipe to which the traces are streamed, of
+  //     the form \\host\pipe\name.
+  SessionStreamWriterFactory(base::MessageLoop* message_loop,
+                             const base::FilePath& pipe_name);
+
+  // @name BufferConsumerFactory implementation.
+  // @{
+  bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) override;
+  // @}
+
+  // Sets whether subsequently created stream writers compress their segments.
+  // @param compress true to compress the segments.
+  void set_compress(bool compress) { compress_ = compress; }
+
+  // Sets the maximum number of buffers each subsequently created stream
+  // writer keeps in flight to the pipe.
+  // @param max_pending_writes the maximum number of writes in flight.
+  void set_max_pending_writes(size_t max_pending_writes) {
+    max_pending_writes_ = max_pending_writes;
+  }
+
+  // Sets the maximum number of buffers each subsequently created stream
+  // writer queues before dropping buffers.
+  // @param max_queued_buffers the maximum number of waiting buffers.
+  void set_max_queued_buffers(size_t max_queued_buffers) {
+    max_queued_buffers_ = max_queued_buffers;
+  }
+
+  // @returns the filter applied to the events of subsequently created stream
+  //     writers, which each get a copy of it.
+  EventFilter* event_filter() { return &event_filter_; }
+
+  // The default maximum number of writes in flight per stream writer.
+  static const size_t kDefaultMaxPendingWrites;
+
+  // The default maximum number of waiting buffers per stream writer.
+  static const size_t kDefaultMaxQueuedBuffers;
+
+  // @returns the name of the pipe to which the traces are streamed.
+  const base::FilePath& pipe_name() const { return pipe_name_; }
+
+ protected:
+  // The message loop the stream writers should use for IO.
+  base::MessageLoop* const message_loop_;
+
+  // The name of the pipe to which the traces are streamed.
+  const base::FilePath pipe_name_;
+
+  // Whether stream writers compress their segments.
+  bool compress_;
+
+  // The maximum number of writes in flight per stream writer.
+  size_t max_pending_writes_;
+
+  // The maximum number of waiting buffers per stream writer.
+  size_t max_queued_buffers_;
+
+  // The filter copied to each stream writer.
+  EventFilter event_filter_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SessionStreamWriterFactory);
+};
+
+}  // namespace service
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_SERVICE_SESSION_STREAM_WRITER_FACTORY_H_
@@ -19,8 +19,12 @@
 
 #include "syzygy/trace/service/session_trace_file_writer.h"
 
+#include <algorithm>
+#include <memory>
+
 #include "base/bind.h"
 #include "base/files/file_util.h"
+#include "base/time/time.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/mapped_buffer.h"
@@ -29,10 +33,20 @@
 namespace trace {
 namespace service {
 
+namespace {
+
+// The interval at which completed writes are reaped while writes are in
+// flight. Writes are also reaped as new buffers are consumed.
+const int kReapIntervalMs = 1;
+
+}  // namespace
+
 SessionTraceFileWriter::SessionTraceFileWriter(
     base::MessageLoop* message_loop, const base::FilePath& trace_directory)
     : message_loop_(message_loop),
-      trace_file_path_(trace_directory) {
+      trace_file_path_(trace_directory),
+      reap_scheduled_(false),
+      buffers_written_(0) {
   DCHECK(message_loop != NULL);
   DCHECK(!trace_directory.empty());
 }
@@ -62,7 +76,25 @@ bool SessionTraceFileWriter::Open(Session* session) {
 }
 
 bool SessionTraceFileWriter::Close(Session* /* session */) {
-  return true;
+  // The trace file is closed explicitly so that its index, if any, is
+  // written. The session has recycled all of its buffers by now, so no write
+  // is still in flight.
+  DCHECK_EQ(0u, writer_.pending_writes());
+  if (event_filter_.events_dropped() > 0) {
+    VLOG(1) << "Filtered out " << event_filter_.events_dropped()
+            << " events from '" << trace_file_path_.value() << "'.";
+  }
+  if (buffers_written_ > 0) {
+    base::TimeDelta average_lag =
+        total_write_lag_ / static_cast<int64_t>(buffers_written_);
+    VLOG(1) << "Wrote " << buffers_written_ << " buffers to '"
+            << trace_file_path_.value() << "' with an average lag of "
+            << average_lag.InMicroseconds() << " us and a maximum lag of "
+            << max_write_lag_.InMicroseconds() << " us.";
+  }
+  if (writer_.path().empty())
+    return true;
+  return writer_.Close();
 }
 
 bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
@@ -74,7 +106,8 @@ bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
                           base::Bind(&SessionTraceFileWriter::WriteBuffer,
                                      this,
                                      scoped_refptr<Session>(buffer->session),
-                                     base::Unretained(buffer)));
+                                     base::Unretained(buffer),
+                                     base::TimeTicks::Now()));
 
   return true;
 }
@@ -84,32 +117,81 @@ size_t SessionTraceFileWriter::block_size() const {
 }
 
 void SessionTraceFileWriter::WriteBuffer(scoped_refptr<Session> session,
-                                         Buffer* buffer) {
+                                         Buffer* buffer,
+                                         base::TimeTicks consume_time) {
   DCHECK(session != NULL);
   DCHECK(buffer != NULL);
   DCHECK_EQ(session, buffer->session);
   DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
   DCHECK_EQ(base::MessageLoop::current(), message_loop_);
 
-  MappedBuffer mapped_buffer(buffer);
-  if (!mapped_buffer.Map())
+  base::TimeDelta lag = base::TimeTicks::Now() - consume_time;
+  ++buffers_written_;
+  total_write_lag_ += lag;
+  max_write_lag_ = std::max(max_write_lag_, lag);
+
+  std::unique_ptr<MappedBuffer> mapped_buffer(new MappedBuffer(buffer));
+  if (!mapped_buffer->Map())
     return;
 
-  // We deliberately ignore the return status. However, this will log if
-  // anything goes wrong.
-  writer_.WriteRecord(mapped_buffer.data(), buffer->buffer_size);
+  // The buffer stays mapped until it has been written, as it is written
+  // directly from the mapping. The events that aren't of interest are
+  // dropped first. A malformed segment is written as is, and reported by the
+  // writer.
+  uint8_t* data = mapped_buffer->data();
+  ignore_result(event_filter_.FilterSegment(data, buffer->buffer_size));
+  writer_.WriteRecordAsync(
+      data, buffer->buffer_size,
+      base::Bind(&SessionTraceFileWriter::OnBufferWritten, this, session,
+                 base::Unretained(buffer),
+                 base::Owned(mapped_buffer.release())));
+  ScheduleReapCompletedWrites();
+}
+
+void SessionTraceFileWriter::OnBufferWritten(scoped_refptr<Session> session,
+                                             Buffer* buffer,
+                                             MappedBuffer* mapped_buffer,
+                                             bool /* success */) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK(mapped_buffer != NULL);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  // We deliberately ignore the status of the write. However, the writer will
+  // have logged if anything went wrong.
 
   // It's entirely possible for this buffer to be handed out to another client
   // and for the service to be forcibly shutdown before the client has had a
   // chance to even touch the buffer. In that case, we'll end up writing the
   // buffer again. We clear the RecordPrefix and the TraceFileSegmentHeader so
   // that we'll at least see the buffer as empty and write nothing.
-  ::memset(mapped_buffer.data(), 0,
+  ::memset(mapped_buffer->data(), 0,
            sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
 
-  mapped_buffer.Unmap();
+  mapped_buffer->Unmap();
   session->RecycleBuffer(buffer);
 }
 
+void SessionTraceFileWriter::ReapCompletedWrites() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  reap_scheduled_ = false;
+  writer_.ReapCompletedWrites();
+  ScheduleReapCompletedWrites();
+}
+
+void SessionTraceFileWriter::ScheduleReapCompletedWrites() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  if (reap_scheduled_ || writer_.pending_writes() == 0)
+    return;
+
+  reap_scheduled_ = true;
+  message_loop_->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&SessionTraceFileWriter::ReapCompletedWrites, this),
+      base::TimeDelta::FromMilliseconds(kReapIntervalMs));
+}
+
 }  // namespace service
 }  // namespace trace
@@ -21,14 +21,17 @@
 
 #include "base/files/file_path.h"
 #include "base/threading/thread.h"
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
+#include "syzygy/trace/service/event_filter.h"
 #include "syzygy/trace/service/trace_file_writer.h"
 
 namespace trace {
 namespace service {
 
 // Forward Declaration.
+class MappedBuffer;
 class Session;
 class SessionTraceFileWriterFactory;
 
@@ -45,6 +48,33 @@ class SessionTraceFileWriter : public BufferConsumer {
   SessionTraceFileWriter(base::MessageLoop* message_loop,
                          const base::FilePath& trace_directory);
 
+  // Sets whether the trace file segments are compressed. Must be called
+  // before Open.
+  // @param compress true to compress the trace file segments.
+  void set_compress(bool compress) { writer_.set_compress(compress); }
+
+  // Sets whether a segment index is written alongside the trace file. Must be
+  // called before Open.
+  // @param write_index true to write a segment index.
+  void set_write_index(bool write_index) {
+    writer_.set_write_index(write_index);
+  }
+
+  // Sets the maximum number of buffers being written to disk at once. Must be
+  // called before Open.
+  // @param max_pending_writes the maximum number of writes in flight. Zero
+  //     writes each buffer synchronously.
+  void set_max_pending_writes(size_t max_pending_writes) {
+    writer_.set_max_pending_writes(max_pending_writes);
+  }
+
+  // Sets the filter applied to the events of each buffer before it is
+  // written. Must be called before Open.
+  // @param event_filter the filter, which is copied.
+  void set_event_filter(const EventFilter& event_filter) {
+    event_filter_ = event_filter;
+  }
+
   // Initialize this trace file writer.
   // @name BufferConsumer implementation.
   // @{
@@ -54,9 +84,40 @@ class SessionTraceFileWriter : public BufferConsumer {
   size_t block_size() const override;
   // @}
 
+  // @name Write lag metrics, which are the times between a buffer being
+  //     handed to the writer and its write being started. They grow when
+  //     the message loop is held up by the other writers sharing it. These
+  //     may only be read on message_loop_.
+  // @{
+  size_t buffers_written() const { return buffers_written_; }
+  base::TimeDelta max_write_lag() const { return max_write_lag_; }
+  base::TimeDelta total_write_lag() const { return total_write_lag_; }
+  // @}
+
  protected:
   // Commit a trace buffer to disk. This will be called on message_loop_.
-  void WriteBuffer(scoped_refptr<Session>, Buffer* buffer);
+  // @param session the session owning @p buffer.
+  // @param buffer the buffer to write.
+  // @param consume_time the time at which @p buffer was handed to the writer.
+  void WriteBuffer(scoped_refptr<Session> session,
+                   Buffer* buffer,
+                   base::TimeTicks consume_time);
+
+  // Recycles a trace buffer once it has been written to disk. This will be
+  // called on message_loop_.
+  void OnBufferWritten(scoped_refptr<Session> session,
+                       Buffer* buffer,
+                       MappedBuffer* mapped_buffer,
+                       bool success);
+
+  // Recycles the buffers whose writes have completed, and schedules itself
+  // again while writes remain in flight. This will be called on
+  // message_loop_.
+  void ReapCompletedWrites();
+
+  // Schedules a call to ReapCompletedWrites if writes are in flight and none
+  // is scheduled yet.
+  void ScheduleReapCompletedWrites();
 
   // The message loop on which this trace file writer will do IO.
   base::MessageLoop* const message_loop_;
@@ -69,6 +130,17 @@ class SessionTraceFileWriter : public BufferConsumer {
   // This is used for committing actual buffers to disk.
   TraceFileWriter writer_;
 
+  // The filter applied to the events of each buffer before it is written.
+  EventFilter event_filter_;
+
+  // Whether a call to ReapCompletedWrites is scheduled.
+  bool reap_scheduled_;
+
+  // The write lag metrics.
+  size_t buffers_written_;
+  base::TimeDelta max_write_lag_;
+  base::TimeDelta total_write_lag_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SessionTraceFileWriter);
 };
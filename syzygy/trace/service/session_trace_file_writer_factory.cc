@@ -21,11 +21,27 @@
 namespace trace {
 namespace service {
 
+const size_t SessionTraceFileWriterFactory::kDefaultMaxPendingWrites = 4;
+
 SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
     base::MessageLoop* message_loop)
-    : message_loop_(message_loop), trace_file_directory_(L".") {
+    : message_loop_(message_loop),
+      next_message_loop_(0),
+      trace_file_directory_(L"."),
+      compress_trace_files_(false),
+      max_pending_writes_(kDefaultMaxPendingWrites),
+      write_trace_file_index_(false) {
   DCHECK(message_loop != NULL);
   DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
+  message_loops_.push_back(message_loop);
+}
+
+void SessionTraceFileWriterFactory::AddMessageLoop(
+    base::MessageLoop* message_loop) {
+  DCHECK(message_loop != NULL);
+  DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
+  base::AutoLock auto_lock(lock_);
+  message_loops_.push_back(message_loop);
 }
 
 bool SessionTraceFileWriterFactory::SetTraceFileDirectory(
@@ -47,9 +63,23 @@ bool SessionTraceFileWriterFactory::CreateConsumer(
   DCHECK(message_loop_ != NULL);
 
   // Allocate a new trace file writer.
-  *consumer = new SessionTraceFileWriter(message_loop_, trace_file_directory_);
+  SessionTraceFileWriter* writer =
+      new SessionTraceFileWriter(GetNextMessageLoop(), trace_file_directory_);
+  writer->set_compress(compress_trace_files_);
+  writer->set_max_pending_writes(max_pending_writes_);
+  writer->set_write_index(write_trace_file_index_);
+  writer->set_event_filter(event_filter_);
+  *consumer = writer;
   return true;
 }
 
+base::MessageLoop* SessionTraceFileWriterFactory::GetNextMessageLoop() {
+  base::AutoLock auto_lock(lock_);
+  DCHECK(!message_loops_.empty());
+  base::MessageLoop* message_loop = message_loops_[next_message_loop_];
+  next_message_loop_ = (next_message_loop_ + 1) % message_loops_.size();
+  return message_loop;
+}
+
 }  // namespace service
 }  // namespace trace
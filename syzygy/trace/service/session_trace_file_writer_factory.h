@@ -19,11 +19,13 @@
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_FACTORY_H_
 
 #include <set>
+#include <vector>
 
 #include "base/files/file_path.h"
 #include "base/synchronization/lock.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
+#include "syzygy/trace/service/event_filter.h"
 
 // Forward declaration.
 namespace base { class MessageLoop; }
@@ -44,6 +46,15 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   //     must outlive the factory instance.
   explicit SessionTraceFileWriterFactory(base::MessageLoop* message_loop);
 
+  // Adds a message loop to the pool on which trace file writers consume
+  // buffers. Each writer does all of its IO on a single message loop, which
+  // keeps the buffers of a session in order, and the writers are spread
+  // over the loops in turn. This lets the sessions on one loop proceed while
+  // another loop is held up by a slow write. Must be called before any
+  // consumer is created.
+  // @param message_loop an IO message loop, which must outlive the factory.
+  void AddMessageLoop(base::MessageLoop* message_loop);
+
   // @name BufferConsumerFactory implementation.
   // @{
   virtual bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) override;
@@ -53,20 +64,74 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // file writers will output trace files.
   bool SetTraceFileDirectory(const base::FilePath& path);
 
+  // Sets whether subsequently created trace file writers compress the
+  // segments of their trace files.
+  // @param compress true to compress the trace file segments.
+  void set_compress_trace_files(bool compress) {
+    compress_trace_files_ = compress;
+  }
+
+  // Sets whether subsequently created trace file writers write a segment
+  // index alongside their trace files.
+  // @param write_index true to write segment indexes.
+  void set_write_trace_file_index(bool write_index) {
+    write_trace_file_index_ = write_index;
+  }
+
+  // Sets the maximum number of buffers each subsequently created trace file
+  // writer keeps in flight to disk.
+  // @param max_pending_writes the maximum number of writes in flight. Zero
+  //     writes each buffer synchronously.
+  void set_max_pending_writes(size_t max_pending_writes) {
+    max_pending_writes_ = max_pending_writes;
+  }
+
+  // @returns the filter applied to the events of subsequently created trace
+  //     file writers, which each get a copy of it.
+  EventFilter* event_filter() { return &event_filter_; }
+
+  // The default maximum number of writes in flight per trace file writer.
+  static const size_t kDefaultMaxPendingWrites;
+
   // Get the message loop the trace file writers should use for IO.
   base::MessageLoop* message_loop() { return message_loop_; }
 
+  // @returns the number of message loops the trace file writers are spread
+  //     over.
+  size_t message_loop_count() const { return message_loops_.size(); }
+
  protected:
+  // @returns the message loop of the next trace file writer, in turn.
+  base::MessageLoop* GetNextMessageLoop();
+
   // The message loop the trace file writers should use for IO.
   base::MessageLoop* const message_loop_;
 
+  // The message loops over which the trace file writers are spread, starting
+  // with message_loop_, and the index of the next one to use.
+  std::vector<base::MessageLoop*> message_loops_;
+  size_t next_message_loop_;
+
   // The directory into which trace file writers will write.
   base::FilePath trace_file_directory_;
 
+  // Whether trace file writers compress the segments of their trace files.
+  bool compress_trace_files_;
+
+  // The maximum number of writes in flight per trace file writer.
+  size_t max_pending_writes_;
+
+  // Whether trace file writers write a segment index.
+  bool write_trace_file_index_;
+
+  // The filter copied to each trace file writer.
+  EventFilter event_filter_;
+
   // The set of currently active buffer consumer objects. Protected by lock_.
   std::set<scoped_refptr<BufferConsumer>> active_consumers_;
 
-  // Used to protect access to the set of active consumers.
+  // Used to protect access to the set of active consumers, and to the next
+  // message loop.
   base::Lock lock_;
 
  private:
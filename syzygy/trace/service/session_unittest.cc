@@ -15,6 +15,7 @@
 #include "syzygy/trace/service/session.h"
 
 #include <memory>
+#include <vector>
 
 #include "base/atomicops.h"
 #include "base/bind.h"
@@ -123,6 +124,8 @@ volatile base::subtle::Atomic32 TestSessionTraceFileWriter::num_instances_ = 0;
 
 class TestSessionTraceFileWriterFactory : public SessionTraceFileWriterFactory {
  public:
+  using SessionTraceFileWriterFactory::GetNextMessageLoop;
+
   explicit TestSessionTraceFileWriterFactory(base::MessageLoop* message_loop)
       : SessionTraceFileWriterFactory(message_loop) {
   }
@@ -382,6 +385,25 @@ void GetNextBuffer(TestSessionPtr session, Buffer** buffer, bool* result) {
 
 }  // namespace
 
+TEST(SessionTraceFileWriterFactoryTest, SpreadsWritersOverMessageLoops) {
+  base::Thread thread1("writer-1");
+  base::Thread thread2("writer-2");
+  ASSERT_TRUE(thread1.StartWithOptions(
+      base::Thread::Options(base::MessageLoop::TYPE_IO, 0)));
+  ASSERT_TRUE(thread2.StartWithOptions(
+      base::Thread::Options(base::MessageLoop::TYPE_IO, 0)));
+
+  TestSessionTraceFileWriterFactory factory(thread1.message_loop());
+  EXPECT_EQ(1u, factory.message_loop_count());
+  factory.AddMessageLoop(thread2.message_loop());
+  EXPECT_EQ(2u, factory.message_loop_count());
+
+  // The message loops are handed out in turn.
+  EXPECT_EQ(thread1.message_loop(), factory.GetNextMessageLoop());
+  EXPECT_EQ(thread2.message_loop(), factory.GetNextMessageLoop());
+  EXPECT_EQ(thread1.message_loop(), factory.GetNextMessageLoop());
+}
+
 TEST_F(SessionTest, ReturnBufferWorksAfterSessionClose) {
   ASSERT_TRUE(call_trace_service_.Start(true));
 
@@ -576,5 +598,68 @@ TEST_F(SessionTest, LargeBufferRequestAvoidsBackPressure) {
   ASSERT_EQ(buffer3, session->last_singleton_buffer_destroyed_);
 }
 
+TEST_F(SessionTest, AdaptiveBufferPoolsGrowForChattyClients) {
+  call_trace_service_.set_adaptive_buffer_pools(true);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  // A client exhausting its pool in quick succession sees it double each
+  // time, up to a multiple of the number of incremental buffers.
+  std::vector<Buffer*> buffers;
+  for (size_t i = 0; i < 2 + 4 + 8 + 16 + 1; ++i) {
+    Buffer* buffer = NULL;
+    ASSERT_TRUE(session->GetNextBuffer(&buffer));
+    buffers.push_back(buffer);
+  }
+
+  Session::BufferStats stats = {};
+  session->GetBufferStats(&stats);
+  EXPECT_EQ(5u, stats.num_pools);
+  EXPECT_EQ(2u + 4 + 8 + 16 + 16, stats.num_buffers);
+  EXPECT_EQ(16u, stats.last_increment);
+  EXPECT_EQ(0u, stats.buffers_returned);
+
+  for (size_t i = 0; i < buffers.size(); ++i)
+    ASSERT_TRUE(session->ReturnBuffer(buffers[i]));
+  session->GetBufferStats(&stats);
+  EXPECT_EQ(buffers.size(), stats.buffers_returned);
+  EXPECT_EQ(buffers.size(), stats.buffers_pending_write);
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+TEST_F(SessionTest, FlightRecorderRetainsMostRecentBuffers) {
+  call_trace_service_.set_flight_recorder_buffers(2);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  Buffer* buffers[3] = {};
+  for (size_t i = 0; i < arraysize(buffers); ++i)
+    ASSERT_TRUE(session->GetNextBuffer(&buffers[i]));
+
+  // Returned buffers are retained rather than consumed, and the oldest one is
+  // recycled once too many are retained.
+  for (size_t i = 0; i < arraysize(buffers); ++i)
+    ASSERT_TRUE(session->ReturnBuffer(buffers[i]));
+  EXPECT_EQ(Buffer::kAvailable, buffers[0]->state);
+  EXPECT_EQ(Buffer::kPendingWrite, buffers[1]->state);
+  EXPECT_EQ(Buffer::kPendingWrite, buffers[2]->state);
+
+  Session::BufferStats stats = {};
+  session->GetBufferStats(&stats);
+  EXPECT_EQ(3u, stats.buffers_returned);
+  EXPECT_EQ(2u, stats.buffers_retained);
+  EXPECT_EQ(0u, stats.buffers_pending_write);
+
+  // Flushing hands the retained buffers over to the consumer.
+  ASSERT_TRUE(session->FlushRetainedBuffers());
+  session->GetBufferStats(&stats);
+  EXPECT_EQ(0u, stats.buffers_retained);
+  session->AllowBuffersToBeRecycled(9999);
+}
+
 }  // namespace service
 }  // namespace trace
@@ -16,11 +16,15 @@
 
 #include <time.h>
 
+#include <iterator>
+
 #include "base/strings/stringprintf.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/buffer_writer.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/path_util.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace trace {
@@ -29,10 +33,15 @@ namespace service {
 namespace {
 
 bool OpenTraceFile(const base::FilePath& file_path,
+                   bool overlapped,
                    base::win::ScopedHandle* file_handle) {
   DCHECK(!file_path.empty());
   DCHECK(file_handle != NULL);
 
+  DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING;
+  if (overlapped)
+    flags |= FILE_FLAG_OVERLAPPED;
+
   // Create a new trace file.
   base::win::ScopedHandle new_file_handle(
       ::CreateFile(file_path.value().c_str(),
@@ -40,7 +49,7 @@ bool OpenTraceFile(const base::FilePath& file_path,
                    FILE_SHARE_DELETE | FILE_SHARE_READ,
                    NULL, /* lpSecurityAttributes */
                    CREATE_ALWAYS,
-                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING,
+                   flags,
                    NULL /* hTemplateFile */));
   if (!new_file_handle.IsValid()) {
     DWORD error = ::GetLastError();
@@ -83,10 +92,22 @@ bool GetBlockSize(const base::FilePath& path, size_t* block_size) {
 
 }  // namespace
 
-TraceFileWriter::TraceFileWriter() : block_size_(0) {
+const size_t TraceFileWriter::kPipeBlockSize = 512;
+
+TraceFileWriter::TraceFileWriter()
+    : block_size_(0),
+      compress_(false),
+      is_pipe_(false),
+      write_buffer_size_(0),
+      file_offset_(0),
+      max_pending_writes_(0),
+      write_index_(false) {
 }
 
 TraceFileWriter::~TraceFileWriter() {
+  // The writes in flight refer to the caller's buffers, and must not outlive
+  // the writer.
+  WaitForPendingWrites();
 }
 
 base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
@@ -114,7 +135,7 @@ base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
 bool TraceFileWriter::Open(const base::FilePath& path) {
   // Open the trace file.
   base::win::ScopedHandle temp_handle;
-  if (!OpenTraceFile(path, &temp_handle)) {
+  if (!OpenTraceFile(path, max_pending_writes_ > 0, &temp_handle)) {
     LOG(ERROR) << "Failed to open trace file: '"
                << path_.value() << "'.";
     return false;
@@ -127,9 +148,56 @@ bool TraceFileWriter::Open(const base::FilePath& path) {
     return false;
   }
 
+  if (!CreateWriteEvent())
+    return false;
+
   path_ = path;
   handle_.Set(temp_handle.Take());
   block_size_ = block_size;
+  is_pipe_ = false;
+  file_offset_ = 0;
+  index_entries_.clear();
+
+  return true;
+}
+
+bool TraceFileWriter::OpenPipe(const base::FilePath& pipe_name,
+                               uint32_t timeout_ms) {
+  DCHECK(!pipe_name.empty());
+
+  // All instances of the pipe may be connected to other writers.
+  if (!::WaitNamedPipe(pipe_name.value().c_str(), timeout_ms)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to wait for pipe '" << pipe_name.value()
+               << "': " << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  DWORD flags = max_pending_writes_ > 0 ? FILE_FLAG_OVERLAPPED : 0;
+  base::win::ScopedHandle temp_handle(
+      ::CreateFile(pipe_name.value().c_str(),
+                   GENERIC_WRITE,
+                   0, /* dwShareMode */
+                   NULL, /* lpSecurityAttributes */
+                   OPEN_EXISTING,
+                   flags,
+                   NULL /* hTemplateFile */));
+  if (!temp_handle.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to open pipe '" << pipe_name.value()
+               << "' for writing: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  if (!CreateWriteEvent())
+    return false;
+
+  path_ = pipe_name;
+  handle_.Set(temp_handle.Take());
+  block_size_ = kPipeBlockSize;
+  is_pipe_ = true;
+  file_offset_ = 0;
+  index_entries_.clear();
 
   return true;
 }
@@ -181,12 +249,8 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
   writer.Align(block_size_);
 
   // Commit the header page to disk.
-  DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(), &buffer[0], buffer.size(), &bytes_written,
-                   NULL) || bytes_written != buffer.size() ) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "Failed writing trace file header: " << ::common::LogWe(error)
-               << ".";
+  if (!WriteAt(&buffer[0], buffer.size())) {
+    LOG(ERROR) << "Failed writing trace file header.";
     return false;
   }
 
@@ -194,7 +258,147 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
 }
 
 bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
+  size_t segment_length = 0;
+  if (!ValidateRecord(data, length, &segment_length))
+    return false;
+  if (segment_length == 0)
+    return true;
+
+  const RecordPrefix* record = reinterpret_cast<const RecordPrefix*>(data);
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
+
+  // The segment length that was validated is the one that is recorded.
+  TraceFileSegmentHeader segment_header = *header;
+  segment_header.segment_length = segment_length;
+  uint64_t offset = file_offset_;
+
+  if (compress_) {
+    if (!WriteCompressedSegment(segment_header, header + 1))
+      return false;
+    AddIndexEntry(offset, segment_header, header + 1);
+    return true;
+  }
+
+  // Figure out the total size that we'll write to disk.
+  size_t bytes_to_write = ::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + segment_length,
+      block_size_);
+
+  // Ensure that the total number of bytes to write does not exceed the
+  // maximum record length.
+  if (bytes_to_write > length) {
+    LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
+    return false;
+  }
+
+  // Commit the buffer to disk.
+  if (!WriteAt(record, bytes_to_write))
+    return false;
+  AddIndexEntry(offset, segment_header, header + 1);
+  return true;
+}
+
+void TraceFileWriter::WriteRecordAsync(const void* data,
+                                       size_t length,
+                                       const WriteCallback& callback) {
+  DCHECK(!callback.is_null());
+
+  // Compressed records are written from a buffer owned by the writer, which
+  // is reused from one record to the next.
+  if (max_pending_writes_ == 0 || compress_) {
+    callback.Run(WriteRecord(data, length));
+    return;
+  }
+
+  size_t segment_length = 0;
+  if (!ValidateRecord(data, length, &segment_length)) {
+    callback.Run(false);
+    return;
+  }
+  if (segment_length == 0) {
+    callback.Run(true);
+    return;
+  }
+
+  size_t bytes_to_write = ::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + segment_length,
+      block_size_);
+  if (bytes_to_write > length) {
+    LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
+    callback.Run(false);
+    return;
+  }
+
+  // Make room for this write.
+  while (pending_writes_.size() >= max_pending_writes_)
+    CompleteOldestWrite(true);
+
+  std::unique_ptr<PendingWrite> write;
+  if (!free_writes_.empty()) {
+    write = std::move(free_writes_.back());
+    free_writes_.pop_back();
+  } else {
+    write.reset(new PendingWrite());
+    write->event.Set(::CreateEvent(NULL, TRUE, FALSE, NULL));
+    if (!write->event.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to create write event: " << ::common::LogWe(error)
+                 << ".";
+      callback.Run(false);
+      return;
+    }
+  }
+
+  ::memset(&write->overlapped, 0, sizeof(write->overlapped));
+  write->overlapped.Offset = static_cast<DWORD>(file_offset_);
+  write->overlapped.OffsetHigh = static_cast<DWORD>(file_offset_ >> 32);
+  write->overlapped.hEvent = write->event.Get();
+  write->length = bytes_to_write;
+  write->callback = callback;
+
+  if (!::WriteFile(handle_.Get(), data, bytes_to_write, NULL,
+                   &write->overlapped)) {
+    DWORD error = ::GetLastError();
+    if (error != ERROR_IO_PENDING) {
+      LOG(ERROR) << "Failed writing to '" << path_.value()
+                 << "': " << ::common::LogWe(error) << ".";
+      write->callback.Reset();
+      free_writes_.push_back(std::move(write));
+      callback.Run(false);
+      return;
+    }
+  }
+
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(
+          reinterpret_cast<const RecordPrefix*>(data) + 1);
+  TraceFileSegmentHeader segment_header = *header;
+  segment_header.segment_length = segment_length;
+  AddIndexEntry(file_offset_, segment_header, header + 1);
+
+  // Writes that complete immediately are reaped right away.
+  file_offset_ += bytes_to_write;
+  pending_writes_.push_back(std::move(write));
+  ReapCompletedWrites();
+}
+
+size_t TraceFileWriter::ReapCompletedWrites() {
+  while (!pending_writes_.empty() && CompleteOldestWrite(false)) {
+  }
+  return pending_writes_.size();
+}
+
+void TraceFileWriter::WaitForPendingWrites() {
+  while (!pending_writes_.empty())
+    CompleteOldestWrite(true);
+}
+
+bool TraceFileWriter::ValidateRecord(const void* data,
+                                     size_t length,
+                                     size_t* segment_length) {
   DCHECK(data != NULL);
+  DCHECK(segment_length != NULL);
 
   const size_t kHeaderLength =
       sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
@@ -219,43 +423,174 @@ bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
   // segment itself is empty we simply skip writing the buffer.
   const TraceFileSegmentHeader* header =
       reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
-  size_t segment_length = header->segment_length;
-  if (segment_length == 0) {
+  *segment_length = header->segment_length;
+  if (*segment_length == 0) {
     LOG(INFO) << "Not writing empty buffer.";
     return true;
   }
 
-  // Figure out the total size that we'll write to disk.
-  size_t bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
-                                            block_size_);
-
-  // Ensure that the total number of bytes to write does not exceed the
-  // maximum record length.
-  if (bytes_to_write > length) {
+  if (kHeaderLength + *segment_length > length) {
     LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
     return false;
   }
 
-  // Commit the buffer to disk.
-  // TODO(rogerm): Use overlapped I/O.
-  DCHECK_LT(0u, bytes_to_write);
+  return true;
+}
+
+bool TraceFileWriter::WriteAt(const void* data, size_t length) {
+  DCHECK(data != NULL);
+  DCHECK_LT(0u, length);
+
+  OVERLAPPED overlapped = {};
+  overlapped.Offset = static_cast<DWORD>(file_offset_);
+  overlapped.OffsetHigh = static_cast<DWORD>(file_offset_ >> 32);
+  overlapped.hEvent = write_event_.Get();
+
   DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(),
-                   record,
-                   bytes_to_write,
-                   &bytes_written,
-                   NULL) ||
-      bytes_written != bytes_to_write) {
+  BOOL result =
+      ::WriteFile(handle_.Get(), data, length, &bytes_written, &overlapped);
+  if (!result && ::GetLastError() == ERROR_IO_PENDING) {
+    result = ::GetOverlappedResult(handle_.Get(), &overlapped, &bytes_written,
+                                   TRUE);
+  }
+  if (!result || bytes_written != length) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed writing to '" << path_.value()
                << "': " << ::common::LogWe(error) << ".";
     return false;
   }
 
+  file_offset_ += length;
+  return true;
+}
+
+bool TraceFileWriter::CreateWriteEvent() {
+  // Synchronous writes to a file opened for overlapped I/O wait on an event
+  // of their own, as asynchronous writes may also be in flight.
+  if (max_pending_writes_ == 0 || write_event_.IsValid())
+    return true;
+
+  write_event_.Set(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  if (!write_event_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create write event: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+
   return true;
 }
 
+void TraceFileWriter::AddIndexEntry(
+    uint64_t offset,
+    const TraceFileSegmentHeader& segment_header,
+    const void* segment_data) {
+  if (!write_index_ || is_pipe_)
+    return;
+
+  TraceFileIndexEntry entry = {};
+  IndexTraceFileSegment(offset, segment_header,
+                        reinterpret_cast<const uint8_t*>(segment_data),
+                        &entry);
+  index_entries_.push_back(entry);
+}
+
+bool TraceFileWriter::CompleteOldestWrite(bool wait) {
+  DCHECK(!pending_writes_.empty());
+
+  PendingWrite* write = pending_writes_.front().get();
+  DWORD bytes_written = 0;
+  bool success = true;
+  if (!::GetOverlappedResult(handle_.Get(), &write->overlapped,
+                             &bytes_written, wait ? TRUE : FALSE)) {
+    DWORD error = ::GetLastError();
+    if (!wait && error == ERROR_IO_INCOMPLETE)
+      return false;
+    LOG(ERROR) << "Failed writing to '" << path_.value()
+               << "': " << ::common::LogWe(error) << ".";
+    success = false;
+  } else if (bytes_written != write->length) {
+    LOG(ERROR) << "Short write to '" << path_.value() << "'.";
+    success = false;
+  }
+
+  // The write is retired before its callback is invoked, as the callback may
+  // issue further writes.
+  WriteCallback callback = write->callback;
+  write->callback.Reset();
+  free_writes_.push_back(std::move(pending_writes_.front()));
+  pending_writes_.pop_front();
+  callback.Run(success);
+  return true;
+}
+
+bool TraceFileWriter::WriteCompressedSegment(
+    const TraceFileSegmentHeader& segment_header,
+    const void* segment_data) {
+  DCHECK(segment_data != NULL);
+  DCHECK_LT(0u, block_size_);
+
+  // Each segment is compressed on its own, so that the segments of the trace
+  // file can be located without decompressing them. Trace buffers are
+  // written out as fast as clients fill them, so speed is favored over
+  // compression ratio.
+  compressed_data_.clear();
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(compressed_data_)));
+  core::ZOutStream zout_stream(out_stream.get());
+  if (!zout_stream.Init(core::ZOutStream::kZBestSpeed) ||
+      !zout_stream.Write(sizeof(segment_header),
+                         reinterpret_cast<const core::Byte*>(
+                             &segment_header)) ||
+      !zout_stream.Write(segment_header.segment_length,
+                         reinterpret_cast<const core::Byte*>(segment_data)) ||
+      !zout_stream.Flush() || !out_stream->Flush()) {
+    LOG(ERROR) << "Dropped buffer: compression failed.";
+    return false;
+  }
+
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileCompressedSegmentHeader);
+  size_t bytes_to_write = ::common::AlignUp(
+      kHeaderLength + compressed_data_.size(), block_size_);
+
+  // Grow the aligned write buffer as needed.
+  if (bytes_to_write > write_buffer_size_) {
+    write_buffer_.reset(static_cast<uint8_t*>(
+        base::AlignedAlloc(bytes_to_write, block_size_)));
+    write_buffer_size_ = bytes_to_write;
+  }
+
+  uint8_t* buffer = write_buffer_.get();
+  RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(buffer);
+  prefix->timestamp = 0;
+  prefix->size = sizeof(TraceFileCompressedSegmentHeader);
+  prefix->type = TraceFileCompressedSegmentHeader::kTypeId;
+  prefix->version.hi = TRACE_VERSION_HI;
+  prefix->version.lo = TRACE_VERSION_LO;
+  TraceFileCompressedSegmentHeader* header =
+      reinterpret_cast<TraceFileCompressedSegmentHeader*>(prefix + 1);
+  header->compressed_length = compressed_data_.size();
+  header->uncompressed_length =
+      sizeof(segment_header) + segment_header.segment_length;
+  ::memcpy(buffer + kHeaderLength, compressed_data_.data(),
+           compressed_data_.size());
+  ::memset(buffer + kHeaderLength + compressed_data_.size(), 0,
+           bytes_to_write - kHeaderLength - compressed_data_.size());
+
+  return WriteAt(buffer, bytes_to_write);
+}
+
 bool TraceFileWriter::Close() {
+  WaitForPendingWrites();
+
+  // The index is only a means of reading the trace file faster, so failing to
+  // write it doesn't fail the trace file.
+  if (write_index_ && !is_pipe_ && handle_.IsValid()) {
+    ignore_result(WriteTraceFileIndex(GetTraceFileIndexPath(path_),
+                                      file_offset_, index_entries_));
+  }
+
   if (::CloseHandle(handle_.Take()) == 0) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "CloseHandle failed: " << ::common::LogWe(error) << ".";
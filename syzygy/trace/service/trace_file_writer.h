@@ -35,12 +35,41 @@
 //
 //   if (!w.Close())
 //     ...
+//
+// If compression is enabled with set_compress(true) prior to writing records,
+// each record is written as an independently compressed segment, see
+// TraceFileCompressedSegmentHeader.
+//
+// If set_max_pending_writes is called with a non-zero value prior to Open, the
+// trace file is opened for overlapped I/O and WriteRecordAsync keeps up to
+// that many writes in flight:
+//
+//   w.WriteRecordAsync(buffer, length, callback);
+//   ...
+//   // Invokes the callbacks of the writes that have completed.
+//   w.ReapCompletedWrites();
+//
+// If set_write_index(true) is called prior to writing records, the writer
+// also writes a segment index alongside the trace file when it is closed, see
+// trace_file_index.h.
+//
+// OpenPipe may be called in place of Open to stream the trace file to the
+// server end of a named pipe, possibly on another machine. The stream holds
+// the same bytes as the trace file would, but has no segment index.
 
 #ifndef SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "base/callback.h"
 #include "base/files/file_path.h"
+#include "base/memory/aligned_memory.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/protocol/trace_file_index.h"
 #include "syzygy/trace/service/process_info.h"
 
 namespace trace {
@@ -69,6 +98,18 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool Open(const base::FilePath& path);
 
+  // Opens a named pipe to which to stream the trace file. Waits for an
+  // instance of the pipe to be available if all of them are busy.
+  // @param pipe_name The name of the pipe, of the form \\host\pipe\name.
+  // @param timeout_ms How long to wait for an instance of the pipe to be
+  //     available, in milliseconds.
+  // @returns true on success, false otherwise.
+  bool OpenPipe(const base::FilePath& pipe_name, uint32_t timeout_ms);
+
+  // The block size of streamed trace files. The segments are aligned to it, as
+  // they are in trace files on disk.
+  static const size_t kPipeBlockSize;
+
   // Writes the header to the trace file. A trace file is associated with a
   // single running process, so we require a populated process-info struct.
   // @param process_info Information about the process to which this trace file
@@ -86,16 +127,74 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool WriteRecord(const void* data, size_t length);
 
+  // Invoked with the status of an asynchronous write once it has completed.
+  typedef base::Callback<void(bool)> WriteCallback;
+
+  // Writes a record of data to disk asynchronously, if the writer was
+  // configured with pending writes. Otherwise, and for compressed records,
+  // this writes synchronously. If the maximum number of writes is already in
+  // flight, this first waits for the oldest of them to complete.
+  // @param data The record to be written, as for WriteRecord. This must
+  //     remain valid until @p callback has been invoked.
+  // @param length The maximum length of the record, as for WriteRecord.
+  // @param callback Invoked with the status of the write once it has
+  //     completed. This is invoked from this call or from a later call to
+  //     ReapCompletedWrites, WaitForPendingWrites or Close.
+  void WriteRecordAsync(const void* data,
+                        size_t length,
+                        const WriteCallback& callback);
+
+  // Invokes the callbacks of the writes that have completed, in the order in
+  // which they were issued. Does not block.
+  // @returns the number of writes still in flight.
+  size_t ReapCompletedWrites();
+
+  // Waits for all of the writes in flight to complete, invoking their
+  // callbacks.
+  void WaitForPendingWrites();
+
+  // Sets the maximum number of asynchronous writes to keep in flight. Must be
+  // called before Open.
+  // @param max_pending_writes the maximum number of writes in flight. Zero
+  //     disables asynchronous writes.
+  void set_max_pending_writes(size_t max_pending_writes) {
+    max_pending_writes_ = max_pending_writes;
+  }
+
+  // @returns the maximum number of asynchronous writes kept in flight.
+  size_t max_pending_writes() const { return max_pending_writes_; }
+
+  // @returns the number of asynchronous writes in flight.
+  size_t pending_writes() const { return pending_writes_.size(); }
+
+  // Sets whether records are compressed as they are written.
+  // @param compress true to compress records.
+  void set_compress(bool compress) { compress_ = compress; }
+
+  // @returns true if records are compressed as they are written.
+  bool compress() const { return compress_; }
+
+  // Sets whether a segment index is written alongside the trace file.
+  // @param write_index true to write a segment index when closing the trace
+  //     file.
+  void set_write_index(bool write_index) { write_index_ = write_index; }
+
+  // @returns true if a segment index is written alongside the trace file.
+  bool write_index() const { return write_index_; }
+
   // Closes the trace file.
   // @returns true on success, false otherwise.
   // @note If this is not called manually the trace-file will close itself when
   //     the writer goes out of scope.
   bool Close();
 
-  // @returns the path to the trace file.
+  // @returns the path to the trace file, or the name of the pipe.
   // @note This is only valid after Open has returned successfully.
   base::FilePath path() const { return path_; }
 
+  // @returns true if the trace file is streamed to a pipe.
+  bool is_pipe() const { return is_pipe_; }
+
   // @returns the block size.
   // @note This is only valid after Open has returned successfully.
   size_t block_size() const { return block_size_; }
@@ -110,7 +209,93 @@ class TraceFileWriter {
   // The block size being used by the trace file writer.
   size_t block_size_;
 
+  // Whether records are compressed.
+  bool compress_;
+
+  // Whether the trace file is streamed to a pipe.
+  bool is_pipe_;
+
  private:
+  // An asynchronous write in flight.
+  struct PendingWrite {
+    OVERLAPPED overlapped;
+    // The event signaled on completion. It is reused with this structure.
+    base::win::ScopedHandle event;
+    DWORD length;
+    WriteCallback callback;
+  };
+
+  // Validates a record and reads the length of its segment.
+  // @param data the record.
+  // @param length the maximum length of the record.
+  // @param segment_length receives the length of the segment. This is zero if
+  //     the segment is empty and there is nothing to write.
+  // @returns true if the record is valid, false otherwise.
+  bool ValidateRecord(const void* data, size_t length, size_t* segment_length);
+
+  // Synchronously writes data at the current end of the trace file.
+  // @param data the data to write, whose length is a multiple of the block
+  //     size.
+  // @param length the length of @p data.
+  // @returns true on success, false otherwise.
+  bool WriteAt(const void* data, size_t length);
+
+  // Creates the event on which synchronous writes wait, if the trace file is
+  // opened for overlapped I/O.
+  // @returns true on success, false otherwise.
+  bool CreateWriteEvent();
+
+  // Adds a segment that was written at the given offset to the index, if the
+  // writer writes an index.
+  // @param offset the offset of the segment in the trace file.
+  // @param segment_header the header of the segment.
+  // @param segment_data the segment data.
+  void AddIndexEntry(uint64_t offset,
+                     const TraceFileSegmentHeader& segment_header,
+                     const void* segment_data);
+
+  // Completes the oldest write in flight and invokes its callback.
+  // @param wait true to wait for the write to complete.
+  // @returns true if the write was completed, false if @p wait is false and
+  //     the write is still in flight.
+  bool CompleteOldestWrite(bool wait);
+
+  // Compresses and writes a segment.
+  // @param segment_header the header of the segment.
+  // @param segment_data the segment data, of the length given by
+  //     @p segment_header.
+  // @returns true on success, false otherwise.
+  bool WriteCompressedSegment(const TraceFileSegmentHeader& segment_header,
+                              const void* segment_data);
+
+  // Reused to compress records.
+  std::vector<uint8_t> compressed_data_;
+
+  // The block-aligned buffer compressed records are written from. Unbuffered
+  // writes must be made from memory that is aligned to the block size.
+  std::unique_ptr<uint8_t, base::AlignedFreeDeleter> write_buffer_;
+  size_t write_buffer_size_;
+
+  // The offset at which the next record is written. Overlapped writes must
+  // each be given their offset. Pipes ignore it.
+  uint64_t file_offset_;
+
+  // The maximum number of asynchronous writes in flight.
+  size_t max_pending_writes_;
+
+  // The asynchronous writes in flight, in the order in which they were
+  // issued, and those that have completed and can be reused.
+  std::deque<std::unique_ptr<PendingWrite>> pending_writes_;
+  std::vector<std::unique_ptr<PendingWrite>> free_writes_;
+
+  // The event on which synchronous writes wait when the trace file is opened
+  // for overlapped I/O.
+  base::win::ScopedHandle write_event_;
+
+  // Whether a segment index is written, and its entries so far.
+  bool write_index_;
+  std::vector<TraceFileIndexEntry> index_entries_;
+
   DISALLOW_COPY_AND_ASSIGN(TraceFileWriter);
 };
 
@@ -14,11 +14,19 @@
 
 #include "syzygy/trace/service/trace_file_writer.h"
 
+#include <string>
+
+#include "base/bind.h"
 #include "base/files/file_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/protocol/trace_file_index.h"
 #include "syzygy/trace/service/process_info.h"
 
 namespace trace {
@@ -31,14 +39,69 @@ class TestTraceFileWriter : public TraceFileWriter {
   using TraceFileWriter::handle_;
 };
 
+// Serves a named pipe, and reads everything streamed to it.
+class PipeReader : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit PipeReader(HANDLE pipe) : pipe_(pipe) {}
+
+  void Run() override {
+    if (!::ConnectNamedPipe(pipe_, NULL) &&
+        ::GetLastError() != ERROR_PIPE_CONNECTED) {
+      return;
+    }
+
+    // The writer closing its end of the pipe ends the stream.
+    char buffer[4096];
+    DWORD bytes_read = 0;
+    while (::ReadFile(pipe_, buffer, sizeof(buffer), &bytes_read, NULL))
+      contents_.append(buffer, bytes_read);
+  }
+
+  const std::string& contents() const { return contents_; }
+
+ private:
+  HANDLE pipe_;
+  std::string contents_;
+};
+
 class TraceFileWriterTest : public testing::PELibUnitTest {
  public:
+  TraceFileWriterTest() : writes_succeeded(0), writes_failed(0) {}
+
   void SetUp() override {
     testing::PELibUnitTest::SetUp();
     CreateTemporaryDir(&temp_dir);
     trace_path = temp_dir.AppendASCII("trace.dat");
   }
 
+  // Builds a block-aligned record holding a segment of the given length.
+  void MakeRecord(size_t block_size,
+                  size_t segment_length,
+                  std::vector<uint8_t>* data) {
+    data->resize(::common::AlignUp(sizeof(RecordPrefix) +
+                                       sizeof(TraceFileSegmentHeader) +
+                                       segment_length,
+                                   block_size));
+    RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data->data());
+    TraceFileSegmentHeader* header =
+        reinterpret_cast<TraceFileSegmentHeader*>(record + 1);
+    record->size = sizeof(TraceFileSegmentHeader);
+    record->type = TraceFileSegmentHeader::kTypeId;
+    record->version.hi = TRACE_VERSION_HI;
+    record->version.lo = TRACE_VERSION_LO;
+    header->segment_length = segment_length;
+  }
+
+  void OnWriteComplete(bool success) {
+    if (success)
+      ++writes_succeeded;
+    else
+      ++writes_failed;
+  }
+
+  size_t writes_succeeded;
+  size_t writes_failed;
+
   base::FilePath temp_dir;
   base::FilePath trace_path;
 };
@@ -180,5 +243,219 @@ TEST_F(TraceFileWriterTest, WriteRecordSucceeds) {
   EXPECT_EQ(0, trace_file_size % w.block_size());
 }
 
+TEST_F(TraceFileWriterTest, WriteCompressedRecordSucceeds) {
+  TestTraceFileWriter w;
+  w.set_compress(true);
+  EXPECT_TRUE(w.compress());
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  int64_t header_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &header_size));
+
+  // A segment of highly compressible data spanning several blocks.
+  const size_t kSegmentLength = 4 * w.block_size();
+  std::vector<uint8_t> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) +
+              kSegmentLength);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type = TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->thread_id = 42;
+  header->segment_length = kSegmentLength;
+  ::memset(header + 1, 0xAB, kSegmentLength);
+
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+  EXPECT_TRUE(w.WriteRecord(data.data(), data.size()));
+  ASSERT_TRUE(w.Close());
+
+  // The compressed segment occupies a single block.
+  int64_t trace_file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_EQ(header_size + w.block_size(), trace_file_size);
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  const uint8_t* segment =
+      reinterpret_cast<const uint8_t*>(contents.data()) + header_size;
+  const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(segment);
+  EXPECT_EQ(TraceFileCompressedSegmentHeader::kTypeId, prefix->type);
+  EXPECT_EQ(sizeof(TraceFileCompressedSegmentHeader), prefix->size);
+  const TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<const TraceFileCompressedSegmentHeader*>(prefix + 1);
+  EXPECT_EQ(sizeof(TraceFileSegmentHeader) + kSegmentLength,
+            compressed_header->uncompressed_length);
+  EXPECT_GT(kSegmentLength, compressed_header->compressed_length);
+
+  // The compressed data decompresses to the segment header and data.
+  const uint8_t* compressed_data =
+      reinterpret_cast<const uint8_t*>(compressed_header + 1);
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      compressed_data,
+      compressed_data + compressed_header->compressed_length));
+  core::ZInStream zin_stream(in_stream.get());
+  ASSERT_TRUE(zin_stream.Init());
+  std::vector<uint8_t> uncompressed(compressed_header->uncompressed_length);
+  ASSERT_TRUE(zin_stream.Read(uncompressed.size(), uncompressed.data()));
+  EXPECT_EQ(0, ::memcmp(header, uncompressed.data(), uncompressed.size()));
+}
+
+TEST_F(TraceFileWriterTest, WriteRecordAsyncSucceeds) {
+  TestTraceFileWriter w;
+  w.set_max_pending_writes(2);
+  EXPECT_EQ(2u, w.max_pending_writes());
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  int64_t header_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &header_size));
+
+  // Issue more writes than may be in flight at once. The records must remain
+  // valid until their writes complete.
+  const size_t kNumRecords = 5;
+  std::vector<uint8_t> records[kNumRecords];
+  TraceFileWriter::WriteCallback callback = base::Bind(
+      &TraceFileWriterTest::OnWriteComplete, base::Unretained(this));
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    MakeRecord(w.block_size(), (i + 1) * 16, &records[i]);
+    w.WriteRecordAsync(records[i].data(), records[i].size(), callback);
+    EXPECT_GE(2u, w.pending_writes());
+  }
+
+  // An empty record completes immediately without being written.
+  std::vector<uint8_t> empty_record;
+  MakeRecord(w.block_size(), 0, &empty_record);
+  w.WriteRecordAsync(empty_record.data(), empty_record.size(), callback);
+
+  w.WaitForPendingWrites();
+  EXPECT_EQ(0u, w.pending_writes());
+  EXPECT_EQ(kNumRecords + 1, writes_succeeded);
+  EXPECT_EQ(0u, writes_failed);
+  ASSERT_TRUE(w.Close());
+
+  // Each record occupies a block, in the order in which it was issued.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  ASSERT_EQ(header_size + kNumRecords * w.block_size(), contents.size());
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    EXPECT_EQ(0, ::memcmp(contents.data() + header_size + i * w.block_size(),
+                          records[i].data(), records[i].size()));
+  }
+}
+
+TEST_F(TraceFileWriterTest, WriteRecordAsyncFailsInvalidRecordPrefix) {
+  TestTraceFileWriter w;
+  w.set_max_pending_writes(2);
+  ASSERT_TRUE(w.Open(trace_path));
+
+  std::vector<uint8_t> record;
+  MakeRecord(w.block_size(), 16, &record);
+  reinterpret_cast<RecordPrefix*>(record.data())->type = 0;
+  w.WriteRecordAsync(record.data(), record.size(),
+                     base::Bind(&TraceFileWriterTest::OnWriteComplete,
+                                base::Unretained(this)));
+  EXPECT_EQ(0u, w.pending_writes());
+  EXPECT_EQ(0u, writes_succeeded);
+  EXPECT_EQ(1u, writes_failed);
+}
+
+TEST_F(TraceFileWriterTest, WriteIndexSucceeds) {
+  TestTraceFileWriter w;
+  w.set_write_index(true);
+  EXPECT_TRUE(w.write_index());
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  int64_t header_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &header_size));
+
+  const size_t kNumRecords = 3;
+  std::vector<uint8_t> records[kNumRecords];
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    MakeRecord(w.block_size(), 16, &records[i]);
+    EXPECT_TRUE(w.WriteRecord(records[i].data(), records[i].size()));
+  }
+  ASSERT_TRUE(w.Close());
+
+  // The index refers to each segment, and is invalidated by a change to the
+  // size of the trace file.
+  int64_t trace_file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  std::vector<TraceFileIndexEntry> entries;
+  base::FilePath index_path = GetTraceFileIndexPath(trace_path);
+  ASSERT_TRUE(ReadTraceFileIndex(index_path, trace_file_size, &entries));
+  ASSERT_EQ(kNumRecords, entries.size());
+  for (size_t i = 0; i < kNumRecords; ++i)
+    EXPECT_EQ(header_size + i * w.block_size(), entries[i].offset);
+  EXPECT_FALSE(ReadTraceFileIndex(index_path, trace_file_size + 1, &entries));
+}
+
+TEST_F(TraceFileWriterTest, OpenPipeFailsWithoutServer) {
+  TestTraceFileWriter w;
+  base::FilePath pipe_name(base::StringPrintf(
+      L"\\\\.\\pipe\\syzygy-test-%d", ::GetCurrentProcessId()));
+  EXPECT_FALSE(w.OpenPipe(pipe_name, 0));
+}
+
+TEST_F(TraceFileWriterTest, StreamToPipeSucceeds) {
+  base::FilePath pipe_name(base::StringPrintf(
+      L"\\\\.\\pipe\\syzygy-test-%d", ::GetCurrentProcessId()));
+  base::win::ScopedHandle pipe(::CreateNamedPipe(
+      pipe_name.value().c_str(), PIPE_ACCESS_INBOUND,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 0, 64 * 1024, 0,
+      NULL));
+  ASSERT_TRUE(pipe.IsValid());
+  PipeReader reader(pipe.Get());
+  base::DelegateSimpleThread thread(&reader, "PipeReader");
+  thread.Start();
+
+  std::vector<uint8_t> record;
+  {
+    TestTraceFileWriter w;
+    w.set_write_index(true);
+    w.set_max_pending_writes(2);
+    ASSERT_TRUE(w.OpenPipe(pipe_name, 1000));
+    EXPECT_TRUE(w.is_pipe());
+    EXPECT_EQ(TraceFileWriter::kPipeBlockSize, w.block_size());
+
+    ProcessInfo pi;
+    ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+    ASSERT_TRUE(w.WriteHeader(pi));
+
+    MakeRecord(w.block_size(), 16, &record);
+    w.WriteRecordAsync(record.data(), record.size(),
+                       base::Bind(&TraceFileWriterTest::OnWriteComplete,
+                                  base::Unretained(this)));
+    ASSERT_TRUE(w.Close());
+  }
+  thread.Join();
+  EXPECT_EQ(1u, writes_succeeded);
+
+  // The stream is laid out like a trace file, ending with the record.
+  const std::string& contents = reader.contents();
+  ASSERT_LT(record.size(), contents.size());
+  EXPECT_EQ(0u, contents.size() % TraceFileWriter::kPipeBlockSize);
+  const TraceFileHeader* header =
+      reinterpret_cast<const TraceFileHeader*>(contents.data());
+  EXPECT_EQ(0, ::memcmp(&header->signature, &TraceFileHeader::kSignatureValue,
+                        sizeof(header->signature)));
+  EXPECT_EQ(TraceFileWriter::kPipeBlockSize, header->block_size);
+  EXPECT_EQ(0, ::memcmp(contents.data() + contents.size() - record.size(),
+                        record.data(), record.size()));
+
+  // Streams have no segment index.
+  EXPECT_FALSE(base::PathExists(GetTraceFileIndexPath(pipe_name)));
+}
+
 }  // namespace service
 }  // namespace trace
@@ -0,0 +1,703 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A benchmark of the throughput of the call trace pipeline, from the clients
+// through the service to the trace files and back through the parser. It runs
+// a service in process and spawns itself as synthetic clients, each of which
+// logs a configurable mix of events through an RpcSession. Prints the time
+// the clients stalled exchanging buffers, the backlog of buffers waiting to
+// be written, the write bandwidth and the parse throughput.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/command_line.h"
+#include "base/logging.h"
+#include "base/files/file_enumerator.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/process/launch.h"
+#include "base/process/process.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/thread.h"
+#include "base/time/time.h"
+#include "syzygy/trace/client/rpc_session.h"
+#include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/protocol/compact_record.h"
+#include "syzygy/trace/service/service.h"
+#include "syzygy/trace/service/service_rpc_impl.h"
+#include "syzygy/trace/service/session.h"
+#include "syzygy/trace/service/session_trace_file_writer_factory.h"
+
+namespace {
+
+using trace::client::RpcSession;
+using trace::client::TraceFileSegment;
+using trace::parser::ParseEventHandlerImpl;
+using trace::parser::Parser;
+using trace::service::BufferConsumerFactory;
+using trace::service::RpcServiceInstanceManager;
+using trace::service::Service;
+using trace::service::Session;
+using trace::service::SessionTraceFileWriterFactory;
+
+const char kUsage[] =
+    "Usage: trace_pipeline_benchmark [options]\n"
+    "\n"
+    "Options:\n"
+    "  --clients=N          The number of client processes (default 4).\n"
+    "  --events=N           The number of events logged by each client\n"
+    "                       (default 10000000).\n"
+    "  --mix=KIND:WEIGHT,...\n"
+    "                       The mix of records logged by the clients, where\n"
+    "                       KIND is one of enter, exit, batch, compact and\n"
+    "                       invocation (default enter:1,exit:1,batch:1).\n"
+    "  --buffer-size=BYTES  The size of the service buffers.\n"
+    "  --compress-trace     Compress the trace files.\n"
+    "  --enable-buffer-rings\n"
+    "                       Exchange buffers through buffer rings.\n";
+
+// The switches of a synthetic client process.
+const char kClientSwitch[] = "client";
+const char kInstanceIdSwitch[] = "instance-id";
+const char kResultsSwitch[] = "results";
+
+// The kinds of records logged by the synthetic clients.
+enum RecordKind {
+  kEnterRecord,
+  kExitRecord,
+  kBatchEnterRecord,
+  kCompactBatchEnterRecord,
+  kBatchInvocationRecord,
+  kNumRecordKinds
+};
+
+const char* const kRecordKindNames[] = {
+    "enter", "exit", "batch", "compact", "invocation" };
+static_assert(arraysize(kRecordKindNames) == kNumRecordKinds,
+              "Missing record kind names.");
+
+// The number of events of a batch record.
+const size_t kCallsPerBatch = 64;
+const size_t kInvocationsPerBatch = 16;
+
+// The synthetic functions are spread over a module-sized range, and are
+// visited in an order with some locality as instrumented code would be.
+const uintptr_t kFunctionBase = 0x10000000;
+const size_t kNumFunctions = 4096;
+const size_t kFunctionStride = 0x10;
+const size_t kFunctionStep = 7;
+
+// The interval at which the backlog of the service is sampled.
+const int kSampleIntervalMs = 5;
+
+// The results of a synthetic client, as written to its results file.
+struct ClientResults {
+  uint64_t num_events;
+  uint64_t num_exchanges;
+  int64_t stall_us;
+};
+
+// Parses a mix of records into the order in which a client logs them, each
+// kind appearing as many times as its weight.
+bool ParseMix(const std::string& mix, std::vector<RecordKind>* schedule) {
+  DCHECK(schedule != NULL);
+
+  schedule->clear();
+  std::vector<std::string> entries = base::SplitString(
+      mix, ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    std::vector<std::string> fields = base::SplitString(
+        entries[i], ":", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+    unsigned weight = 1;
+    if (fields.size() > 2 ||
+        (fields.size() == 2 && !base::StringToUint(fields[1], &weight))) {
+      LOG(ERROR) << "Invalid mix entry: " << entries[i];
+      return false;
+    }
+
+    const char* const* name = std::find(
+        kRecordKindNames, kRecordKindNames + kNumRecordKinds, fields[0]);
+    if (name == kRecordKindNames + kNumRecordKinds) {
+      LOG(ERROR) << "Unknown record kind: " << fields[0];
+      return false;
+    }
+    schedule->insert(schedule->end(), weight,
+                     static_cast<RecordKind>(name - kRecordKindNames));
+  }
+
+  if (schedule->empty()) {
+    LOG(ERROR) << "The mix of records is empty.";
+    return false;
+  }
+  return true;
+}
+
+// A client logging synthetic records through an RPC session.
+class SyntheticClient {
+ public:
+  explicit SyntheticClient(const std::vector<RecordKind>& schedule)
+      : schedule_(schedule), next_function_(0) {
+    ::memset(&results_, 0, sizeof(results_));
+  }
+
+  // Logs records until at least @p num_events events have been logged.
+  // @param instance_id the instance of the service to log to.
+  // @param num_events the number of events to log.
+  // @returns true on success.
+  bool Run(const std::wstring& instance_id, uint64_t num_events);
+
+  const ClientResults& results() const { return results_; }
+
+ private:
+  // Makes room for a record in the segment, exchanging it for a fresh
+  // buffer if it is full.
+  // @param size the size of the record.
+  // @returns true on success.
+  bool Reserve(size_t size);
+
+  // Logs a record of the given kind.
+  // @returns the number of events logged, or zero on failure.
+  size_t LogRecord(RecordKind kind);
+
+  // @returns the next synthetic function.
+  FuncAddr NextFunction();
+
+  // @returns the return address of a call to the synthetic @p function.
+  static RetAddr ReturnAddressOf(FuncAddr function) {
+    return reinterpret_cast<RetAddr>(
+        reinterpret_cast<uintptr_t>(function) + kFunctionStride / 2);
+  }
+
+  std::vector<RecordKind> schedule_;
+  size_t next_function_;
+
+  RpcSession session_;
+  TraceFileSegment segment_;
+  ClientResults results_;
+
+  DISALLOW_COPY_AND_ASSIGN(SyntheticClient);
+};
+
+bool SyntheticClient::Run(const std::wstring& instance_id,
+                          uint64_t num_events) {
+  session_.set_instance_id(instance_id);
+  if (!session_.CreateSession(&segment_)) {
+    LOG(ERROR) << "Failed to create a session with the service.";
+    return false;
+  }
+
+  for (size_t i = 0; results_.num_events < num_events; ++i) {
+    size_t logged = LogRecord(schedule_[i % schedule_.size()]);
+    if (logged == 0)
+      return false;
+    results_.num_events += logged;
+  }
+
+  if (!session_.ReturnBuffer(&segment_) || !session_.CloseSession()) {
+    LOG(ERROR) << "Failed to close the session with the service.";
+    return false;
+  }
+  session_.FreeSharedMemory();
+  return true;
+}
+
+bool SyntheticClient::Reserve(size_t size) {
+  if (segment_.CanAllocate(size))
+    return true;
+
+  // This is where an instrumented client waits on the service.
+  base::TimeTicks start = base::TimeTicks::Now();
+  bool exchanged = session_.ExchangeBuffer(&segment_);
+  results_.stall_us += (base::TimeTicks::Now() - start).InMicroseconds();
+  ++results_.num_exchanges;
+
+  if (!exchanged || !segment_.CanAllocate(size)) {
+    LOG(ERROR) << "Failed to exchange a buffer with the service.";
+    return false;
+  }
+  return true;
+}
+
+size_t SyntheticClient::LogRecord(RecordKind kind) {
+  switch (kind) {
+    case kEnterRecord:
+    case kExitRecord: {
+      if (!Reserve(sizeof(TraceEnterExitEventData)))
+        return 0;
+      TraceEnterExitEventData* data =
+          kind == kEnterRecord
+              ? segment_.AllocateTraceRecord<TraceEnterEventData>()
+              : segment_.AllocateTraceRecord<TraceExitEventData>();
+      data->function = NextFunction();
+      data->retaddr = ReturnAddressOf(data->function);
+      return 1;
+    }
+
+    case kBatchEnterRecord: {
+      size_t size = offsetof(TraceBatchEnterData, calls) +
+                    kCallsPerBatch * sizeof(TraceEnterEventData);
+      if (!Reserve(size))
+        return 0;
+      TraceBatchEnterData* batch =
+          segment_.AllocateTraceRecord<TraceBatchEnterData>(size);
+      batch->thread_id = segment_.header->thread_id;
+      batch->num_calls = kCallsPerBatch;
+      for (size_t i = 0; i < kCallsPerBatch; ++i) {
+        batch->calls[i].function = NextFunction();
+        batch->calls[i].retaddr = ReturnAddressOf(batch->calls[i].function);
+      }
+      return kCallsPerBatch;
+    }
+
+    case kCompactBatchEnterRecord: {
+      // The batch is encoded before its size is known. A fresh segment is
+      // for the same thread, so the thread interning still holds.
+      uint8_t record[kMaxVarintSize + kCallsPerBatch * kMaxCompactCallSize];
+      CompactBatchEnterState state = {};
+      size_t size = EncodeCompactBatchEnterStart(segment_.header->thread_id,
+                                                 segment_.header->thread_id,
+                                                 &state, record);
+      for (size_t i = 0; i < kCallsPerBatch; ++i) {
+        FuncAddr function = NextFunction();
+        size += EncodeCompactCall(function, ReturnAddressOf(function), &state,
+                                  record + size);
+      }
+      if (!Reserve(size))
+        return 0;
+      TraceCompactBatchEnterData* batch =
+          segment_.AllocateTraceRecord<TraceCompactBatchEnterData>(size);
+      ::memcpy(batch->data, record, size);
+      return kCallsPerBatch;
+    }
+
+    case kBatchInvocationRecord: {
+      size_t size = kInvocationsPerBatch * sizeof(InvocationInfo);
+      if (!Reserve(size))
+        return 0;
+      TraceBatchInvocationInfo* batch =
+          segment_.AllocateTraceRecord<TraceBatchInvocationInfo>(size);
+      for (size_t i = 0; i < kInvocationsPerBatch; ++i) {
+        InvocationInfo& invocation = batch->invocations[i];
+        invocation.function = NextFunction();
+        invocation.caller = ReturnAddressOf(invocation.function);
+        invocation.num_calls = 1;
+        invocation.cycles_min = invocation.cycles_max = 100;
+        invocation.cycles_sum = 100;
+      }
+      return kInvocationsPerBatch;
+    }
+
+    default:
+      NOTREACHED();
+      return 0;
+  }
+}
+
+FuncAddr SyntheticClient::NextFunction() {
+  next_function_ = (next_function_ + kFunctionStep) % kNumFunctions;
+  return reinterpret_cast<FuncAddr>(kFunctionBase +
+                                    next_function_ * kFunctionStride);
+}
+
+// A service whose sessions can be sampled while they are open.
+class BenchmarkService : public Service {
+ public:
+  explicit BenchmarkService(BufferConsumerFactory* factory)
+      : Service(factory) {
+  }
+
+  // Samples the buffer pools of the open sessions.
+  // @param buffers_pending_write receives the number of buffers waiting to
+  //     be written across the sessions.
+  // @param bytes_allocated receives the size of their buffer pools.
+  void Sample(size_t* buffers_pending_write, uint64_t* bytes_allocated);
+
+ protected:
+  // A session that is tracked by the service for as long as it exists.
+  class BenchmarkSession : public Session {
+   public:
+    explicit BenchmarkSession(BenchmarkService* service)
+        : Session(service), benchmark_service_(service) {
+      base::AutoLock lock(benchmark_service_->sessions_lock_);
+      benchmark_service_->sessions_.push_back(this);
+    }
+
+   protected:
+    ~BenchmarkSession() override {
+      base::AutoLock lock(benchmark_service_->sessions_lock_);
+      std::vector<Session*>& sessions = benchmark_service_->sessions_;
+      sessions.erase(std::find(sessions.begin(), sessions.end(), this));
+    }
+
+   private:
+    BenchmarkService* benchmark_service_;
+  };
+
+  Session* CreateSession() override { return new BenchmarkSession(this); }
+
+ private:
+  // The sessions that exist. These aren't referenced, as the service closes
+  // a session when it is released.
+  base::Lock sessions_lock_;
+  std::vector<Session*> sessions_;  // Under sessions_lock_.
+
+  DISALLOW_COPY_AND_ASSIGN(BenchmarkService);
+};
+
+void BenchmarkService::Sample(size_t* buffers_pending_write,
+                              uint64_t* bytes_allocated) {
+  DCHECK(buffers_pending_write != NULL);
+  DCHECK(bytes_allocated != NULL);
+
+  *buffers_pending_write = 0;
+  *bytes_allocated = 0;
+
+  base::AutoLock lock(sessions_lock_);
+  for (size_t i = 0; i < sessions_.size(); ++i) {
+    Session::BufferStats stats = {};
+    sessions_[i]->GetBufferStats(&stats);
+    *buffers_pending_write += stats.buffers_pending_write;
+    *bytes_allocated += stats.bytes_allocated;
+  }
+}
+
+// Counts the events of the parsed trace files.
+class EventCounter : public ParseEventHandlerImpl {
+ public:
+  EventCounter() : num_events_(0) {}
+
+  void OnFunctionEntry(base::Time time,
+                       DWORD process_id,
+                       DWORD thread_id,
+                       const TraceEnterExitEventData* data) override {
+    ++num_events_;
+  }
+  void OnFunctionExit(base::Time time,
+                      DWORD process_id,
+                      DWORD thread_id,
+                      const TraceEnterExitEventData* data) override {
+    ++num_events_;
+  }
+  void OnBatchFunctionEntry(base::Time time,
+                            DWORD process_id,
+                            DWORD thread_id,
+                            const TraceBatchEnterData* data) override {
+    num_events_ += data->num_calls;
+  }
+  void OnInvocationBatch(base::Time time,
+                         DWORD process_id,
+                         DWORD thread_id,
+                         size_t num_invocations,
+                         const TraceBatchInvocationInfo* data) override {
+    num_events_ += num_invocations;
+  }
+
+  uint64_t num_events() const { return num_events_; }
+
+ private:
+  uint64_t num_events_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventCounter);
+};
+
+// Runs a synthetic client process.
+bool RunClient(const base::CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  uint64_t num_events = 0;
+  std::vector<RecordKind> schedule;
+  base::FilePath results_path(cmd_line->GetSwitchValuePath(kResultsSwitch));
+  if (!base::StringToUint64(cmd_line->GetSwitchValueASCII("events"),
+                            &num_events) ||
+      !ParseMix(cmd_line->GetSwitchValueASCII("mix"), &schedule) ||
+      results_path.empty()) {
+    LOG(ERROR) << "Invalid client command line.";
+    return false;
+  }
+
+  SyntheticClient client(schedule);
+  if (!client.Run(cmd_line->GetSwitchValueNative(kInstanceIdSwitch),
+                  num_events)) {
+    return false;
+  }
+
+  const ClientResults& results = client.results();
+  std::string line = base::StringPrintf(
+      "%llu %llu %lld", results.num_events, results.num_exchanges,
+      results.stall_us);
+  int size = static_cast<int>(line.size());
+  return base::WriteFile(results_path, line.data(), size) == size;
+}
+
+// Reads the results written by a synthetic client.
+bool ReadClientResults(const base::FilePath& path, ClientResults* results) {
+  DCHECK(results != NULL);
+
+  std::string line;
+  if (!base::ReadFileToString(path, &line) ||
+      ::sscanf(line.c_str(), "%llu %llu %lld", &results->num_events,
+               &results->num_exchanges, &results->stall_us) != 3) {
+    LOG(ERROR) << "Failed to read the client results in "
+               << path.value() << ".";
+    return false;
+  }
+  return true;
+}
+
+// Parses the trace files of a directory, counting their events.
+bool ParseTraceFiles(const base::FilePath& trace_dir,
+                     uint64_t* num_events,
+                     base::TimeDelta* parse_time) {
+  DCHECK(num_events != NULL);
+  DCHECK(parse_time != NULL);
+
+  base::TimeTicks start = base::TimeTicks::Now();
+
+  EventCounter counter;
+  Parser parser;
+  if (!parser.Init(&counter))
+    return false;
+  base::FileEnumerator enumerator(trace_dir, false,
+                                  base::FileEnumerator::FILES);
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    if (!parser.OpenTraceFile(path))
+      return false;
+  }
+  if (!parser.Consume() || parser.error_occurred())
+    return false;
+
+  *parse_time = base::TimeTicks::Now() - start;
+  *num_events = counter.num_events();
+  return true;
+}
+
+// Runs the benchmark, with the service in this process.
+bool RunBenchmark(const base::CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  unsigned num_clients = 4;
+  std::string clients_str(cmd_line->GetSwitchValueASCII("clients"));
+  if (!clients_str.empty() &&
+      (!base::StringToUint(clients_str, &num_clients) || num_clients == 0)) {
+    LOG(ERROR) << "Invalid number of clients: " << clients_str;
+    return false;
+  }
+
+  std::string events_str(cmd_line->GetSwitchValueASCII("events"));
+  if (events_str.empty())
+    events_str = "10000000";
+  uint64_t num_events = 0;
+  if (!base::StringToUint64(events_str, &num_events) || num_events == 0) {
+    LOG(ERROR) << "Invalid number of events: " << events_str;
+    return false;
+  }
+
+  std::string mix(cmd_line->GetSwitchValueASCII("mix"));
+  if (mix.empty())
+    mix = "enter:1,exit:1,batch:1";
+  std::vector<RecordKind> schedule;
+  if (!ParseMix(mix, &schedule))
+    return false;
+
+  base::ScopedTempDir temp_dir;
+  if (!temp_dir.CreateUniqueTempDir())
+    return false;
+  base::FilePath trace_dir(temp_dir.path().Append(L"traces"));
+  if (!base::CreateDirectory(trace_dir))
+    return false;
+
+  base::Thread writer_thread("trace-file-writer");
+  if (!writer_thread.StartWithOptions(
+          base::Thread::Options(base::MessageLoop::TYPE_IO, 0))) {
+    LOG(ERROR) << "Failed to start the trace file writer thread.";
+    return false;
+  }
+
+  SessionTraceFileWriterFactory factory(writer_thread.message_loop());
+  if (!factory.SetTraceFileDirectory(trace_dir))
+    return false;
+  if (cmd_line->HasSwitch("compress-trace"))
+    factory.set_compress_trace_files(true);
+
+  // The instance is unique to this run, so that it doesn't interfere with a
+  // service that is already running.
+  std::wstring instance_id =
+      base::StringPrintf(L"benchmark-%d", ::GetCurrentProcessId());
+  BenchmarkService service(&factory);
+  RpcServiceInstanceManager rpc_instance(&service);
+  service.set_instance_id(instance_id);
+  if (cmd_line->HasSwitch("enable-buffer-rings"))
+    service.set_enable_buffer_rings(true);
+  std::string buffer_size_str(cmd_line->GetSwitchValueASCII("buffer-size"));
+  if (!buffer_size_str.empty()) {
+    unsigned buffer_size = 0;
+    if (!base::StringToUint(buffer_size_str, &buffer_size)) {
+      LOG(ERROR) << "Invalid buffer size: " << buffer_size_str;
+      return false;
+    }
+    service.set_buffer_size_in_bytes(buffer_size);
+  }
+  if (!service.Start(true))
+    return false;
+
+  // Spawn the clients.
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::vector<base::Process> clients;
+  std::vector<base::FilePath> results_paths;
+  for (unsigned i = 0; i < num_clients; ++i) {
+    base::CommandLine client_cmd_line(cmd_line->GetProgram());
+    client_cmd_line.AppendSwitch(kClientSwitch);
+    client_cmd_line.AppendSwitchNative(kInstanceIdSwitch, instance_id);
+    client_cmd_line.AppendSwitchASCII("events", events_str);
+    client_cmd_line.AppendSwitchASCII("mix", mix);
+    results_paths.push_back(
+        temp_dir.path().Append(base::StringPrintf(L"client-%u.txt", i)));
+    client_cmd_line.AppendSwitchPath(kResultsSwitch, results_paths.back());
+
+    clients.push_back(
+        base::LaunchProcess(client_cmd_line, base::LaunchOptions()));
+    if (!clients.back().IsValid()) {
+      LOG(ERROR) << "Failed to launch a client.";
+      return false;
+    }
+  }
+
+  // Sample the backlog of the service until the clients are done.
+  size_t num_samples = 0;
+  uint64_t total_pending_write = 0;
+  size_t max_pending_write = 0;
+  uint64_t max_bytes_allocated = 0;
+  bool clients_succeeded = true;
+  for (size_t num_running = clients.size(); num_running > 0;) {
+    for (size_t i = 0; i < clients.size(); ++i) {
+      int exit_code = 0;
+      if (clients[i].IsValid() &&
+          clients[i].WaitForExitWithTimeout(base::TimeDelta(), &exit_code)) {
+        clients[i].Close();
+        clients_succeeded &= exit_code == 0;
+        --num_running;
+      }
+    }
+
+    size_t pending_write = 0;
+    uint64_t bytes_allocated = 0;
+    service.Sample(&pending_write, &bytes_allocated);
+    ++num_samples;
+    total_pending_write += pending_write;
+    max_pending_write = std::max(max_pending_write, pending_write);
+    max_bytes_allocated = std::max(max_bytes_allocated, bytes_allocated);
+
+    base::PlatformThread::Sleep(
+        base::TimeDelta::FromMilliseconds(kSampleIntervalMs));
+  }
+
+  // Stopping the service and its writer thread flushes the trace files.
+  if (!service.Stop())
+    return false;
+  writer_thread.Stop();
+  base::TimeDelta pipeline_time = base::TimeTicks::Now() - start;
+
+  if (!clients_succeeded) {
+    LOG(ERROR) << "A client failed.";
+    return false;
+  }
+
+  ClientResults totals = {};
+  for (size_t i = 0; i < results_paths.size(); ++i) {
+    ClientResults results = {};
+    if (!ReadClientResults(results_paths[i], &results))
+      return false;
+    totals.num_events += results.num_events;
+    totals.num_exchanges += results.num_exchanges;
+    totals.stall_us += results.stall_us;
+  }
+
+  int64_t trace_bytes = base::ComputeDirectorySize(trace_dir);
+
+  uint64_t parsed_events = 0;
+  base::TimeDelta parse_time;
+  if (!ParseTraceFiles(trace_dir, &parsed_events, &parse_time)) {
+    LOG(ERROR) << "Failed to parse the trace files.";
+    return false;
+  }
+  if (parsed_events != totals.num_events) {
+    LOG(ERROR) << "Logged " << totals.num_events << " events but parsed "
+               << parsed_events << ".";
+    return false;
+  }
+
+  double pipeline_s = std::max(pipeline_time.InSecondsF(), 1e-6);
+  double parse_s = std::max(parse_time.InSecondsF(), 1e-6);
+  ::printf("clients:            %u\n", num_clients);
+  ::printf("mix:                %s\n", mix.c_str());
+  ::printf("events:             %llu\n", totals.num_events);
+  ::printf("pipeline:           %.0f events/s\n",
+           totals.num_events / pipeline_s);
+  ::printf("client stall:       %.3f s total, %.1f us/exchange\n",
+           totals.stall_us / 1e6,
+           static_cast<double>(totals.stall_us) /
+               std::max<uint64_t>(1, totals.num_exchanges));
+  ::printf("buffer backlog:     %.1f mean, %u max\n",
+           static_cast<double>(total_pending_write) /
+               std::max<size_t>(1, num_samples),
+           max_pending_write);
+  ::printf("buffer pools:       %.1f MB max\n",
+           max_bytes_allocated / 1048576.0);
+  ::printf("write bandwidth:    %.1f MB/s (%.1f MB)\n",
+           trace_bytes / 1048576.0 / pipeline_s, trace_bytes / 1048576.0);
+  ::printf("parse throughput:   %.0f events/s\n", parsed_events / parse_s);
+
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit_manager;
+  base::CommandLine::Init(argc, argv);
+
+  logging::LoggingSettings settings;
+  settings.logging_dest = logging::LOG_TO_SYSTEM_DEBUG_LOG;
+  settings.lock_log = logging::DONT_LOCK_LOG_FILE;
+  settings.delete_old = logging::APPEND_TO_OLD_LOG_FILE;
+  if (!logging::InitLogging(settings))
+    return 1;
+
+  base::CommandLine* cmd_line = base::CommandLine::ForCurrentProcess();
+  CHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    ::fprintf(stderr, "%s", kUsage);
+    return 1;
+  }
+
+  if (cmd_line->HasSwitch(kClientSwitch))
+    return RunClient(cmd_line) ? 0 : 1;
+  return RunBenchmark(cmd_line) ? 0 : 1;
+}
@@ -70,14 +70,19 @@ class ProcessWorkingSet {
   // @returns per module tallies.
   const ModuleStatsVector& module_stats() const { return module_stats_; }
 
+  // Captures the modules of a process.
+  // @param process_id the process whose modules are captured.
+  // @param modules receives the address ranges of the modules, mapped to
+  //     their paths.
+  // @returns true on success, false on failure.
+  typedef core::AddressSpace<size_t, size_t, std::wstring> ModuleAddressSpace;
+  static bool CaptureModules(DWORD process_id, ModuleAddressSpace* modules);
+
  protected:
   // These are protected members to allow unittesting them.
   typedef std::unique_ptr<PSAPI_WORKING_SET_INFORMATION> ScopedWsPtr;
   static bool CaptureWorkingSet(HANDLE process, ScopedWsPtr* working_set);
 
-  typedef core::AddressSpace<size_t, size_t, std::wstring> ModuleAddressSpace;
-  static bool CaptureModules(DWORD process_id, ModuleAddressSpace* modules);
-
   // Storage for stats.
   Stats total_stats_;
   Stats non_module_stats_;
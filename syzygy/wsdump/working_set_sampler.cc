@@ -0,0 +1,418 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <psapi.h>
+#include <string.h>
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/strings/utf_string_conversions.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/core/address_space.h"
+#include "syzygy/wsdump/process_working_set.h"
+
+namespace wsdump {
+
+namespace {
+
+// The number of pages queried by each call to QueryWorkingSetEx.
+const size_t kQueryBatchSize = 4096;
+
+void EncodeVarint(uint64_t value, std::vector<uint8_t>* buffer) {
+  DCHECK(buffer != NULL);
+  while (value >= 0x80) {
+    buffer->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(static_cast<uint8_t>(value));
+}
+
+bool DecodeVarint(const uint8_t** cursor, const uint8_t* end,
+                  uint64_t* value) {
+  DCHECK(cursor != NULL);
+  DCHECK(value != NULL);
+  uint64_t result = 0;
+  for (size_t shift = 0; shift < 64; shift += 7) {
+    if (*cursor == end)
+      return false;
+    uint8_t byte = *(*cursor)++;
+    result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Decodes a varint that must not exceed |max|.
+template <typename T>
+bool DecodeBoundedVarint(const uint8_t** cursor, const uint8_t* end,
+                         uint64_t max, T* value) {
+  DCHECK(value != NULL);
+  uint64_t result = 0;
+  if (!DecodeVarint(cursor, end, &result) || result > max)
+    return false;
+  *value = static_cast<T>(result);
+  return true;
+}
+
+void EncodeString(const std::string& value, std::vector<uint8_t>* buffer) {
+  DCHECK(buffer != NULL);
+  EncodeVarint(value.size(), buffer);
+  buffer->insert(buffer->end(), value.begin(), value.end());
+}
+
+bool DecodeString(const uint8_t** cursor, const uint8_t* end,
+                  std::string* value) {
+  DCHECK(value != NULL);
+  size_t size = 0;
+  if (!DecodeBoundedVarint(cursor, end, end - *cursor, &size))
+    return false;
+  value->assign(reinterpret_cast<const char*>(*cursor), size);
+  *cursor += size;
+  return true;
+}
+
+// @returns the number of pages spanned by |size| bytes.
+size_t GetPageCount(uint64_t size) {
+  return static_cast<size_t>(
+      (size + WorkingSetSampler::kPageSize - 1) / WorkingSetSampler::kPageSize);
+}
+
+bool ReadRemote(HANDLE process, uint64_t address, void* buffer, size_t size) {
+  SIZE_T bytes_read = 0;
+  if (!::ReadProcessMemory(process, reinterpret_cast<void*>(address), buffer,
+                           size, &bytes_read) ||
+      bytes_read != size) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+const uint32_t WorkingSetSampler::kStreamMagic = 0x31535357;  // "WSS1".
+const size_t WorkingSetSampler::kPageSize = 4096;
+
+WorkingSetSampler::WorkingSetSampler() : last_timestamp_(0) {
+}
+
+bool WorkingSetSampler::Initialize(DWORD process_id) {
+  ProcessWorkingSet::ModuleAddressSpace modules;
+  if (!ProcessWorkingSet::CaptureModules(process_id, &modules))
+    return false;
+
+  const DWORD kProcessPermissions = PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  process_.Set(::OpenProcess(kProcessPermissions, FALSE, process_id));
+  if (!process_.IsValid()) {
+    DWORD err = ::GetLastError();
+    LOG(ERROR) << "OpenProcess failed: " << common::LogWe(err);
+    return false;
+  }
+
+  modules_.clear();
+  residency_.clear();
+  last_timestamp_ = 0;
+
+  // The modules come out of the address space sorted by address.
+  ProcessWorkingSet::ModuleAddressSpace::RangeMap::const_iterator it =
+      modules.ranges().begin();
+  for (; it != modules.ranges().end(); ++it) {
+    modules_.push_back(Module());
+    Module& module = modules_.back();
+    module.name = it->second;
+    module.base = it->first.start();
+    module.size = static_cast<uint32_t>(it->first.size());
+
+    // The pages of a module whose sections can't be read are still sampled,
+    // they are only attributed to the module as a whole.
+    if (!CaptureSections(process_.Get(), &module)) {
+      LOG(WARNING) << "Unable to read the sections of " << module.name << ".";
+      module.sections.clear();
+    }
+
+    residency_.push_back(std::vector<bool>(GetPageCount(module.size)));
+  }
+
+  return true;
+}
+
+bool WorkingSetSampler::Sample(uint64_t timestamp,
+                               std::vector<uint8_t>* delta) {
+  DCHECK(delta != NULL);
+  DCHECK(process_.IsValid());
+  DCHECK_LE(last_timestamp_, timestamp);
+
+  Residency residency;
+  if (!CaptureResidency(&residency))
+    return false;
+
+  EncodeDelta(timestamp - last_timestamp_, residency_, residency, delta);
+  residency_.swap(residency);
+  last_timestamp_ = timestamp;
+  return true;
+}
+
+void WorkingSetSampler::EncodeHeader(std::vector<uint8_t>* header) const {
+  EncodeHeader(modules_, header);
+}
+
+size_t WorkingSetSampler::GetResidentPages(size_t module_index,
+                                           size_t section_index) const {
+  DCHECK_LT(module_index, modules_.size());
+  DCHECK_LT(section_index, modules_[module_index].sections.size());
+
+  const Section& section = modules_[module_index].sections[section_index];
+  const std::vector<bool>& pages = residency_[module_index];
+  size_t first_page = std::min<size_t>(section.rva / kPageSize, pages.size());
+  size_t end_page = std::min<size_t>(
+      GetPageCount(static_cast<uint64_t>(section.rva) + section.size),
+      pages.size());
+  return static_cast<size_t>(std::count(
+      pages.begin() + first_page, pages.begin() + end_page, true));
+}
+
+void WorkingSetSampler::EncodeHeader(const Modules& modules,
+                                     std::vector<uint8_t>* header) {
+  DCHECK(header != NULL);
+
+  EncodeVarint(kStreamMagic, header);
+  EncodeVarint(kPageSize, header);
+  EncodeVarint(modules.size(), header);
+  for (size_t i = 0; i < modules.size(); ++i) {
+    const Module& module = modules[i];
+    EncodeVarint(module.base, header);
+    EncodeVarint(module.size, header);
+    EncodeString(base::WideToUTF8(module.name), header);
+    EncodeVarint(module.sections.size(), header);
+    for (size_t j = 0; j < module.sections.size(); ++j) {
+      const Section& section = module.sections[j];
+      EncodeString(section.name, header);
+      EncodeVarint(section.rva, header);
+      EncodeVarint(section.size, header);
+    }
+  }
+}
+
+bool WorkingSetSampler::DecodeHeader(const uint8_t** cursor,
+                                     const uint8_t* end,
+                                     Modules* modules) {
+  DCHECK(cursor != NULL);
+  DCHECK(modules != NULL);
+
+  uint64_t magic = 0;
+  uint64_t page_size = 0;
+  size_t num_modules = 0;
+  if (!DecodeVarint(cursor, end, &magic) || magic != kStreamMagic ||
+      !DecodeVarint(cursor, end, &page_size) || page_size != kPageSize ||
+      !DecodeBoundedVarint(cursor, end, end - *cursor, &num_modules)) {
+    return false;
+  }
+
+  Modules new_modules(num_modules);
+  for (size_t i = 0; i < num_modules; ++i) {
+    Module& module = new_modules[i];
+    std::string name;
+    size_t num_sections = 0;
+    if (!DecodeVarint(cursor, end, &module.base) ||
+        !DecodeBoundedVarint(cursor, end, UINT32_MAX, &module.size) ||
+        !DecodeString(cursor, end, &name) ||
+        !DecodeBoundedVarint(cursor, end, end - *cursor, &num_sections)) {
+      return false;
+    }
+    module.name = base::UTF8ToWide(name);
+
+    module.sections.resize(num_sections);
+    for (size_t j = 0; j < num_sections; ++j) {
+      Section& section = module.sections[j];
+      if (!DecodeString(cursor, end, &section.name) ||
+          !DecodeBoundedVarint(cursor, end, UINT32_MAX, &section.rva) ||
+          !DecodeBoundedVarint(cursor, end, UINT32_MAX, &section.size)) {
+        return false;
+      }
+    }
+  }
+
+  modules->swap(new_modules);
+  return true;
+}
+
+void WorkingSetSampler::EncodeDelta(uint64_t elapsed,
+                                    const Residency& previous,
+                                    const Residency& current,
+                                    std::vector<uint8_t>* delta) {
+  DCHECK_EQ(previous.size(), current.size());
+  DCHECK(delta != NULL);
+
+  // Gather the pages that changed, per module.
+  std::vector<std::pair<size_t, std::vector<size_t>>> changes;
+  for (size_t i = 0; i < current.size(); ++i) {
+    DCHECK_EQ(previous[i].size(), current[i].size());
+    if (previous[i] == current[i])
+      continue;
+    changes.push_back(std::make_pair(i, std::vector<size_t>()));
+    for (size_t page = 0; page < current[i].size(); ++page) {
+      if (previous[i][page] != current[i][page])
+        changes.back().second.push_back(page);
+    }
+  }
+
+  EncodeVarint(elapsed, delta);
+  EncodeVarint(changes.size(), delta);
+  for (size_t i = 0; i < changes.size(); ++i) {
+    const std::vector<size_t>& pages = changes[i].second;
+    EncodeVarint(changes[i].first, delta);
+    EncodeVarint(pages.size(), delta);
+    for (size_t j = 0; j < pages.size(); ++j)
+      EncodeVarint(j == 0 ? pages[j] : pages[j] - pages[j - 1] - 1, delta);
+  }
+}
+
+bool WorkingSetSampler::DecodeDelta(const uint8_t** cursor,
+                                    const uint8_t* end,
+                                    uint64_t* elapsed,
+                                    Residency* residency) {
+  DCHECK(cursor != NULL);
+  DCHECK(elapsed != NULL);
+  DCHECK(residency != NULL);
+
+  // The changes are only applied once the whole sample is known to be valid.
+  size_t num_modules = 0;
+  if (!DecodeVarint(cursor, end, elapsed) ||
+      !DecodeBoundedVarint(cursor, end, residency->size(), &num_modules)) {
+    return false;
+  }
+
+  std::vector<std::pair<size_t, size_t>> changes;
+  for (size_t i = 0; i < num_modules; ++i) {
+    size_t module_index = 0;
+    size_t num_pages = 0;
+    if (!DecodeBoundedVarint(cursor, end, residency->size() - 1,
+                             &module_index)) {
+      return false;
+    }
+    size_t module_pages = (*residency)[module_index].size();
+    if (!DecodeBoundedVarint(cursor, end, module_pages, &num_pages))
+      return false;
+
+    size_t page = 0;
+    for (size_t j = 0; j < num_pages; ++j) {
+      size_t gap = 0;
+      if (!DecodeBoundedVarint(cursor, end, module_pages, &gap))
+        return false;
+      page = j == 0 ? gap : page + gap + 1;
+      if (page >= module_pages)
+        return false;
+      changes.push_back(std::make_pair(module_index, page));
+    }
+  }
+
+  for (size_t i = 0; i < changes.size(); ++i) {
+    std::vector<bool>& pages = (*residency)[changes[i].first];
+    pages[changes[i].second] = !pages[changes[i].second];
+  }
+  return true;
+}
+
+bool WorkingSetSampler::CaptureSections(HANDLE process, Module* module) {
+  DCHECK(module != NULL);
+
+  IMAGE_DOS_HEADER dos_header = {};
+  if (!ReadRemote(process, module->base, &dos_header, sizeof(dos_header)) ||
+      dos_header.e_magic != IMAGE_DOS_SIGNATURE) {
+    return false;
+  }
+
+  // The file header and the section headers are at the same place for 32 and
+  // 64-bit images, only the size of the optional header differs.
+  uint64_t nt_headers = module->base + dos_header.e_lfanew;
+  DWORD signature = 0;
+  IMAGE_FILE_HEADER file_header = {};
+  if (!ReadRemote(process, nt_headers, &signature, sizeof(signature)) ||
+      signature != IMAGE_NT_SIGNATURE ||
+      !ReadRemote(process, nt_headers + sizeof(signature), &file_header,
+                  sizeof(file_header))) {
+    return false;
+  }
+
+  std::vector<IMAGE_SECTION_HEADER> headers(file_header.NumberOfSections);
+  uint64_t section_headers = nt_headers + sizeof(signature) +
+                             sizeof(file_header) +
+                             file_header.SizeOfOptionalHeader;
+  if (!headers.empty() &&
+      !ReadRemote(process, section_headers, &headers[0],
+                  headers.size() * sizeof(headers[0]))) {
+    return false;
+  }
+
+  module->sections.resize(headers.size());
+  for (size_t i = 0; i < headers.size(); ++i) {
+    Section& section = module->sections[i];
+    const char* name = reinterpret_cast<const char*>(headers[i].Name);
+    section.name.assign(name, strnlen(name, IMAGE_SIZEOF_SHORT_NAME));
+    section.rva = headers[i].VirtualAddress;
+    section.size = headers[i].Misc.VirtualSize;
+  }
+
+  return true;
+}
+
+bool WorkingSetSampler::CaptureResidency(Residency* residency) const {
+  DCHECK(residency != NULL);
+
+  // The pages of an exited process are all reported as not resident.
+  DWORD exit_code = 0;
+  if (!::GetExitCodeProcess(process_.Get(), &exit_code)) {
+    DWORD err = ::GetLastError();
+    LOG(ERROR) << "GetExitCodeProcess failed: " << common::LogWe(err);
+    return false;
+  }
+  if (exit_code != STILL_ACTIVE)
+    return false;
+
+  residency->resize(modules_.size());
+  std::vector<PSAPI_WORKING_SET_EX_INFORMATION> batch;
+  batch.reserve(kQueryBatchSize);
+  for (size_t i = 0; i < modules_.size(); ++i) {
+    std::vector<bool>& pages = (*residency)[i];
+    pages.assign(GetPageCount(modules_[i].size), false);
+
+    for (size_t first = 0; first < pages.size(); first += kQueryBatchSize) {
+      size_t count = std::min(kQueryBatchSize, pages.size() - first);
+      batch.resize(count);
+      for (size_t j = 0; j < count; ++j) {
+        ::memset(&batch[j], 0, sizeof(batch[j]));
+        batch[j].VirtualAddress = reinterpret_cast<void*>(
+            modules_[i].base + (first + j) * kPageSize);
+      }
+
+      if (!::QueryWorkingSetEx(process_.Get(), &batch[0],
+                               static_cast<DWORD>(count * sizeof(batch[0])))) {
+        DWORD err = ::GetLastError();
+        LOG(ERROR) << "QueryWorkingSetEx failed: " << common::LogWe(err);
+        return false;
+      }
+
+      for (size_t j = 0; j < count; ++j)
+        pages[first + j] = batch[j].VirtualAttributes.Valid != 0;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace wsdump
@@ -0,0 +1,180 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares WorkingSetSampler, which follows the working set of the modules of
+// a process over time. Each sample queries the residency of every page of the
+// modules with QueryWorkingSetEx, and is encoded as the delta from the
+// previous sample, so that a long series of samples stays small.
+//
+// The samples are streamed in a compact binary format, where every integer is
+// a varint: seven bits per byte from the least significant, the high bit
+// marking the bytes that are followed by another. A stream starts with a
+// header:
+//   - the magic kStreamMagic, as a varint,
+//   - the size of the pages,
+//   - the number of modules and, for each module, its base address, its size,
+//     its path as a length prefixed UTF-8 string, its number of sections and,
+//     for each section, its name as a length prefixed string, its relative
+//     address and its size.
+// Each sample follows as:
+//   - the number of milliseconds since the previous sample,
+//   - the number of modules whose residency changed and, for each of them,
+//     the index of the module, the number of pages that were paged in or out
+//     and the indices of these pages relative to the module base. The first
+//     page index is written as is, the next ones as their difference from the
+//     previous one less one.
+// A page is resident after a sample if it changed an odd number of times
+// since the start of the stream. As page indices are relative to the modules,
+// they line up with the page indices of PageFaultSimulation.
+
+#ifndef SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+#define SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/win/scoped_handle.h"
+
+namespace wsdump {
+
+class WorkingSetSampler {
+ public:
+  // A section of a module.
+  struct Section {
+    Section() : rva(0), size(0) { }
+
+    std::string name;
+    uint32_t rva;
+    uint32_t size;
+  };
+  typedef std::vector<Section> Sections;
+
+  // A module of the sampled process.
+  struct Module {
+    Module() : base(0), size(0) { }
+
+    std::wstring name;
+    uint64_t base;
+    uint32_t size;
+    Sections sections;
+  };
+  typedef std::vector<Module> Modules;
+
+  // The residency of the pages of each module, one entry per page.
+  typedef std::vector<std::vector<bool>> Residency;
+
+  // The magic number at the start of a stream of samples.
+  static const uint32_t kStreamMagic;
+
+  // The size of the pages of the working set.
+  static const size_t kPageSize;
+
+  WorkingSetSampler();
+
+  // Prepares to sample the given process, capturing its modules and their
+  // sections. Modules loaded after this aren't sampled.
+  // @param process_id the process to sample.
+  // @returns true on success, false on failure.
+  bool Initialize(DWORD process_id);
+
+  // Samples the working set of the process.
+  // @param timestamp the time of the sample, in milliseconds. The first
+  //     sample is relative to time zero.
+  // @param delta receives the encoded changes since the previous sample, or
+  //     since the initialization for the first one. The encoding is appended.
+  // @returns true on success, false on failure or if the process has exited.
+  bool Sample(uint64_t timestamp, std::vector<uint8_t>* delta);
+
+  // Encodes the header of a stream of samples of this process.
+  // @param header receives the header. The encoding is appended.
+  void EncodeHeader(std::vector<uint8_t>* header) const;
+
+  // @returns the number of pages of a section that were resident at the last
+  //     sample.
+  // @param module_index the index of a module.
+  // @param section_index the index of a section of the module.
+  size_t GetResidentPages(size_t module_index, size_t section_index) const;
+
+  // @name Accessors.
+  // @{
+  const Modules& modules() const { return modules_; }
+  const Residency& residency() const { return residency_; }
+  // @}
+
+  // Encodes the header of a stream of samples.
+  // @param modules the modules of the sampled process.
+  // @param header receives the header. The encoding is appended.
+  static void EncodeHeader(const Modules& modules,
+                           std::vector<uint8_t>* header);
+
+  // Decodes the header of a stream of samples.
+  // @param cursor the position of the header, advanced past it on success.
+  // @param end the end of the stream.
+  // @param modules receives the modules of the sampled process.
+  // @returns false if the header is malformed.
+  static bool DecodeHeader(const uint8_t** cursor,
+                           const uint8_t* end,
+                           Modules* modules);
+
+  // Encodes the changes between two samples.
+  // @param elapsed the milliseconds elapsed between the samples.
+  // @param previous the residency at the previous sample.
+  // @param current the residency at this sample, of the same shape as
+  //     @p previous.
+  // @param delta receives the encoded changes. The encoding is appended.
+  static void EncodeDelta(uint64_t elapsed,
+                          const Residency& previous,
+                          const Residency& current,
+                          std::vector<uint8_t>* delta);
+
+  // Decodes the changes of a sample, and applies them.
+  // @param cursor the position of the sample, advanced past it on success.
+  // @param end the end of the stream.
+  // @param elapsed receives the milliseconds elapsed since the previous
+  //     sample.
+  // @param residency the residency at the previous sample, updated to that
+  //     at this sample.
+  // @returns false if the sample is malformed.
+  static bool DecodeDelta(const uint8_t** cursor,
+                          const uint8_t* end,
+                          uint64_t* elapsed,
+                          Residency* residency);
+
+ protected:
+  // These are protected members to allow unittesting them.
+  static bool CaptureSections(HANDLE process, Module* module);
+  bool CaptureResidency(Residency* residency) const;
+
+  // The sampled process.
+  base::win::ScopedHandle process_;
+
+  // The modules of the sampled process.
+  Modules modules_;
+
+  // The residency at the last sample.
+  Residency residency_;
+
+  // The time of the last sample.
+  uint64_t last_timestamp_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetSampler);
+};
+
+}  // namespace wsdump
+
+#endif  // SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
@@ -0,0 +1,225 @@
+// Copyright 2017 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <string>
+#include <vector>
+
+#include "base/strings/string_util.h"
+#include "gtest/gtest.h"
+
+namespace wsdump {
+
+namespace {
+
+class TestingWorkingSetSampler : public WorkingSetSampler {
+ public:
+  using WorkingSetSampler::CaptureSections;
+  using WorkingSetSampler::CaptureResidency;
+};
+
+// This function gives us an address in our module.
+void dummy() {
+}
+
+// @returns the path of the current executable.
+std::wstring GetExeName() {
+  std::wstring exe_name;
+  EXPECT_TRUE(::GetModuleFileName(NULL, base::WriteInto(&exe_name, MAX_PATH),
+                                  MAX_PATH));
+  exe_name.resize(wcslen(exe_name.c_str()));
+  return exe_name;
+}
+
+}  // namespace
+
+TEST(WorkingSetSamplerTest, HeaderRoundTrip) {
+  WorkingSetSampler::Modules modules(2);
+  modules[0].name = L"C:\\foo\\bar.dll";
+  modules[0].base = 0x10000000;
+  modules[0].size = 0x5000;
+  modules[0].sections.resize(2);
+  modules[0].sections[0].name = ".text";
+  modules[0].sections[0].rva = 0x1000;
+  modules[0].sections[0].size = 0x2345;
+  modules[0].sections[1].name = ".data";
+  modules[0].sections[1].rva = 0x4000;
+  modules[0].sections[1].size = 0x100;
+  modules[1].name = L"C:\\foo\\baz.exe";
+  modules[1].base = 0x7FFF00000000;
+  modules[1].size = 0x3000;
+
+  std::vector<uint8_t> header;
+  WorkingSetSampler::EncodeHeader(modules, &header);
+
+  const uint8_t* cursor = header.data();
+  WorkingSetSampler::Modules decoded;
+  ASSERT_TRUE(WorkingSetSampler::DecodeHeader(&cursor,
+                                              header.data() + header.size(),
+                                              &decoded));
+  EXPECT_EQ(header.data() + header.size(), cursor);
+  ASSERT_EQ(2u, decoded.size());
+  for (size_t i = 0; i < modules.size(); ++i) {
+    EXPECT_EQ(modules[i].name, decoded[i].name);
+    EXPECT_EQ(modules[i].base, decoded[i].base);
+    EXPECT_EQ(modules[i].size, decoded[i].size);
+    ASSERT_EQ(modules[i].sections.size(), decoded[i].sections.size());
+    for (size_t j = 0; j < modules[i].sections.size(); ++j) {
+      EXPECT_EQ(modules[i].sections[j].name, decoded[i].sections[j].name);
+      EXPECT_EQ(modules[i].sections[j].rva, decoded[i].sections[j].rva);
+      EXPECT_EQ(modules[i].sections[j].size, decoded[i].sections[j].size);
+    }
+  }
+
+  // A truncated header doesn't decode.
+  cursor = header.data();
+  EXPECT_FALSE(WorkingSetSampler::DecodeHeader(
+      &cursor, header.data() + header.size() - 1, &decoded));
+}
+
+TEST(WorkingSetSamplerTest, DeltaRoundTrip) {
+  WorkingSetSampler::Residency previous(3);
+  previous[0].resize(10);
+  previous[1].resize(1000);
+  previous[2].resize(5);
+  WorkingSetSampler::Residency current(previous);
+  current[0][0] = true;
+  current[0][9] = true;
+  current[1][500] = true;
+  current[1][501] = true;
+  current[1][999] = true;
+
+  // The first delta only encodes the pages that are resident.
+  std::vector<uint8_t> delta;
+  WorkingSetSampler::EncodeDelta(1234, previous, current, &delta);
+  EXPECT_GT(16u, delta.size());
+
+  // The second one only the pages that changed.
+  WorkingSetSampler::Residency next(current);
+  next[0][0] = false;
+  next[2][4] = true;
+  WorkingSetSampler::EncodeDelta(100, current, next, &delta);
+
+  // An unchanged working set takes two bytes.
+  size_t size = delta.size();
+  WorkingSetSampler::EncodeDelta(100, next, next, &delta);
+  EXPECT_EQ(size + 2, delta.size());
+
+  const uint8_t* cursor = delta.data();
+  const uint8_t* end = delta.data() + delta.size();
+  WorkingSetSampler::Residency residency(previous);
+  uint64_t elapsed = 0;
+  ASSERT_TRUE(WorkingSetSampler::DecodeDelta(&cursor, end, &elapsed,
+                                             &residency));
+  EXPECT_EQ(1234u, elapsed);
+  EXPECT_EQ(current, residency);
+  ASSERT_TRUE(WorkingSetSampler::DecodeDelta(&cursor, end, &elapsed,
+                                             &residency));
+  EXPECT_EQ(100u, elapsed);
+  EXPECT_EQ(next, residency);
+  ASSERT_TRUE(WorkingSetSampler::DecodeDelta(&cursor, end, &elapsed,
+                                             &residency));
+  EXPECT_EQ(next, residency);
+  EXPECT_EQ(end, cursor);
+}
+
+TEST(WorkingSetSamplerTest, DecodeDeltaFailsOnInvalidPages) {
+  WorkingSetSampler::Residency previous(1);
+  previous[0].resize(10);
+  WorkingSetSampler::Residency current(previous);
+  current[0][9] = true;
+  std::vector<uint8_t> delta;
+  WorkingSetSampler::EncodeDelta(1, previous, current, &delta);
+
+  // The page is out of the bounds of a smaller module, which is left as is.
+  WorkingSetSampler::Residency residency(1);
+  residency[0].resize(5);
+  const uint8_t* cursor = delta.data();
+  uint64_t elapsed = 0;
+  EXPECT_FALSE(WorkingSetSampler::DecodeDelta(
+      &cursor, delta.data() + delta.size(), &elapsed, &residency));
+  EXPECT_EQ(std::vector<bool>(5), residency[0]);
+
+  // Nor does it decode without the module.
+  residency.resize(0);
+  cursor = delta.data();
+  EXPECT_FALSE(WorkingSetSampler::DecodeDelta(
+      &cursor, delta.data() + delta.size(), &elapsed, &residency));
+}
+
+TEST(WorkingSetSamplerTest, CaptureSections) {
+  WorkingSetSampler::Module module;
+  module.base = reinterpret_cast<uintptr_t>(::GetModuleHandle(NULL));
+  ASSERT_TRUE(TestingWorkingSetSampler::CaptureSections(::GetCurrentProcess(),
+                                                        &module));
+  ASSERT_FALSE(module.sections.empty());
+  EXPECT_EQ(".text", module.sections[0].name);
+}
+
+TEST(WorkingSetSamplerTest, Sample) {
+  WorkingSetSampler sampler;
+  ASSERT_TRUE(sampler.Initialize(::GetCurrentProcessId()));
+
+  // Our executable should be among the modules.
+  std::wstring exe_name = GetExeName();
+  size_t exe_index = sampler.modules().size();
+  for (size_t i = 0; i < sampler.modules().size(); ++i) {
+    if (sampler.modules()[i].name == exe_name)
+      exe_index = i;
+  }
+  ASSERT_GT(sampler.modules().size(), exe_index);
+  const WorkingSetSampler::Module& exe = sampler.modules()[exe_index];
+
+  // Running our function makes the page holding it resident.
+  dummy();
+  std::vector<uint8_t> stream;
+  sampler.EncodeHeader(&stream);
+  ASSERT_TRUE(sampler.Sample(10, &stream));
+  ASSERT_TRUE(sampler.Sample(20, &stream));
+
+  size_t page = (reinterpret_cast<uintptr_t>(&dummy) - exe.base) /
+                WorkingSetSampler::kPageSize;
+  EXPECT_TRUE(sampler.residency()[exe_index][page]);
+  size_t text_index = exe.sections.size();
+  for (size_t i = 0; i < exe.sections.size(); ++i) {
+    if (exe.sections[i].name == ".text")
+      text_index = i;
+  }
+  ASSERT_GT(exe.sections.size(), text_index);
+  EXPECT_LT(0u, sampler.GetResidentPages(exe_index, text_index));
+
+  // The stream decodes to the same residency.
+  const uint8_t* cursor = stream.data();
+  const uint8_t* end = stream.data() + stream.size();
+  WorkingSetSampler::Modules modules;
+  ASSERT_TRUE(WorkingSetSampler::DecodeHeader(&cursor, end, &modules));
+  ASSERT_EQ(sampler.modules().size(), modules.size());
+  WorkingSetSampler::Residency residency(modules.size());
+  for (size_t i = 0; i < modules.size(); ++i) {
+    residency[i].resize((modules[i].size + WorkingSetSampler::kPageSize - 1) /
+                        WorkingSetSampler::kPageSize);
+  }
+  uint64_t elapsed = 0;
+  ASSERT_TRUE(WorkingSetSampler::DecodeDelta(&cursor, end, &elapsed,
+                                             &residency));
+  EXPECT_EQ(10u, elapsed);
+  ASSERT_TRUE(WorkingSetSampler::DecodeDelta(&cursor, end, &elapsed,
+                                             &residency));
+  EXPECT_EQ(10u, elapsed);
+  EXPECT_EQ(end, cursor);
+  EXPECT_EQ(sampler.residency(), residency);
+}
+
+}  // namespace wsdump
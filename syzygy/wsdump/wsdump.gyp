@@ -22,7 +22,9 @@
       'type': 'static_library',
       'sources': [
         'process_working_set.h',
-        'process_working_set.cc'
+        'process_working_set.cc',
+        'working_set_sampler.h',
+        'working_set_sampler.cc',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
@@ -33,6 +35,7 @@
       'type': 'executable',
       'sources': [
         'process_working_set_unittest.cc',
+        'working_set_sampler_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
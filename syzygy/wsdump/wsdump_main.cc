@@ -14,18 +14,24 @@
 
 #include <iostream>
 #include <list>
+#include <vector>
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/files/file_util.h"
 #include "base/process/process_iterator.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/wsdump/process_working_set.h"
+#include "syzygy/wsdump/working_set_sampler.h"
 
 using wsdump::ProcessWorkingSet;
+using wsdump::WorkingSetSampler;
 
 namespace {
 
@@ -68,10 +74,18 @@ bool RegexpProcessFilter::Includes(const base::ProcessEntry& entry) const {
 
 const char kUsage[] =
 "Usage: wsdump [--process-name=<process_re>]\n"
+"       wsdump --sample-output=<path> [--sample-interval-ms=<ms>]\n"
+"              [--sample-count=<count>] [--process-name=<process_re>]\n"
 "\n"
 "    Captures and outputs working set statistics for all processes,\n"
 "    or only for processess whose executable name matches <process_re>.\n"
 "\n"
+"    With --sample-output, samples the working set of the modules of the\n"
+"    first process matching <process_re> every <ms> milliseconds (100 by\n"
+"    default), <count> times or until the process exits, and streams the\n"
+"    changes between the samples to <path>. The stream format is described\n"
+"    in syzygy/wsdump/working_set_sampler.h.\n"
+"\n"
 "    The output is JSON encoded array, where each element of the array\n"
 "    is a dictionary describing a process. Each process has the following\n"
 "    items:\n"
@@ -173,6 +187,49 @@ void OutputProcessInfo(const ProcessInfo& info,
   json->CloseDict();
 }
 
+// Samples the working set of a process until |sample_count| samples are taken
+// or the process exits, and streams them to |output_path|. A |sample_count|
+// of zero means no limit. Returns the exit code of the program.
+int SampleWorkingSet(base::ProcessId pid,
+                     const base::FilePath& output_path,
+                     base::TimeDelta interval,
+                     size_t sample_count) {
+  WorkingSetSampler sampler;
+  if (!sampler.Initialize(pid)) {
+    LOG(ERROR) << "Unable to sample the working set of pid: " << pid;
+    return 1;
+  }
+
+  base::ScopedFILE file(base::OpenFile(output_path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open file for writing: " << output_path.value();
+    return 1;
+  }
+
+  std::vector<uint8_t> buffer;
+  sampler.EncodeHeader(&buffer);
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; sample_count == 0 || i < sample_count; ++i) {
+    if (i != 0)
+      base::PlatformThread::Sleep(interval);
+
+    // The sampling stops quietly when the process exits.
+    uint64_t timestamp = (base::TimeTicks::Now() - start).InMilliseconds();
+    if (!sampler.Sample(timestamp, &buffer))
+      break;
+
+    // Each sample is flushed, so that the stream can be followed as it grows.
+    if (::fwrite(&buffer[0], 1, buffer.size(), file.get()) != buffer.size() ||
+        ::fflush(file.get()) != 0) {
+      LOG(ERROR) << "Unable to write to " << output_path.value();
+      return 1;
+    }
+    buffer.clear();
+  }
+
+  return 0;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -201,6 +258,35 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  base::FilePath sample_output = cmd_line->GetSwitchValuePath("sample-output");
+  if (!sample_output.empty()) {
+    size_t interval_ms = 100;
+    if (cmd_line->HasSwitch("sample-interval-ms") &&
+        (!base::StringToSizeT(
+             cmd_line->GetSwitchValueASCII("sample-interval-ms"),
+             &interval_ms) ||
+         interval_ms == 0)) {
+      return Usage();
+    }
+    size_t sample_count = 0;
+    if (cmd_line->HasSwitch("sample-count") &&
+        !base::StringToSizeT(cmd_line->GetSwitchValueASCII("sample-count"),
+                             &sample_count)) {
+      return Usage();
+    }
+
+    base::ProcessIterator process_iterator(&filter);
+    const base::ProcessEntry* entry = process_iterator.NextProcessEntry();
+    if (entry == NULL) {
+      LOG(ERROR) << "No process matches the filter.";
+      return 1;
+    }
+    return SampleWorkingSet(
+        entry->pid(), sample_output,
+        base::TimeDelta::FromMilliseconds(static_cast<int64_t>(interval_ms)),
+        sample_count);
+  }
+
   typedef std::list<ProcessInfo> WorkingSets;
   WorkingSets working_sets;
 
@@ -28,6 +28,12 @@
 // canonical (as long as the underlying PdbWriter doesn't change). We load all
 // of the streams into memory, reach in and make local modifications, and
 // rewrite the entire file to disk.
+//
+// The fast path instead only parses the data directories holding timestamps,
+// hashes the PE file in fixed size chunks on a pool of threads, and patches
+// the affected PDB streams in place in a copy of the PDB file. Its output is
+// canonical for PDB files with the same page layout, which is the case of the
+// outputs of a deterministic link.
 
 #include "syzygy/zap_timestamp/zap_timestamp.h"
 
@@ -37,12 +43,17 @@
 #include "base/logging.h"
 #include "base/md5.h"
 #include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/core/file_util.h"
+#include "syzygy/msf/msf_constants.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pdb/pdb_writer.h"
@@ -77,6 +88,19 @@ typedef ConstTypedBlock<pe::CvInfoPdb70> CvInfoPdb;
 typedef ZapTimestamp::PatchAddressSpace PatchAddressSpace;
 typedef ZapTimestamp::PatchData PatchData;
 
+// The data directories holding the fields that are changed, which are the
+// only ones parsed by the fast path.
+const uint32_t kFastDataDirMask = (1U << IMAGE_DIRECTORY_ENTRY_EXPORT) |
+                                  (1U << IMAGE_DIRECTORY_ENTRY_RESOURCE) |
+                                  (1U << IMAGE_DIRECTORY_ENTRY_DEBUG);
+
+// The size of the chunks of the PE file that are hashed in parallel. This is
+// fixed so that the resulting GUID doesn't depend on the number of threads.
+const size_t kHashChunkSize = 4 * 1024 * 1024;
+
+// An MSF stream length marking a stream that was deleted.
+const uint32_t kDeletedStreamLength = 0xFFFFFFFF;
+
 // An intermediate reference type used to track references generated by
 // PEFileParser.
 struct IntermediateReference {
@@ -126,8 +150,10 @@ bool LookupBlockOffset(const ImageLayout& image_layout,
 }
 
 // Performs a decomposition of the given PE file, only parsing out the PE
-// data blocks and references between them.
+// data blocks and references between them. Only the data directories in
+// @p data_dir_mask are parsed.
 bool MiniDecompose(const PEFile& pe_file,
+                   uint32_t data_dir_mask,
                    ImageLayout* image_layout,
                    BlockGraph::Block** dos_header_block) {
   DCHECK(image_layout != NULL);
@@ -140,7 +166,8 @@ bool MiniDecompose(const PEFile& pe_file,
   PEFileParser pe_file_parser(pe_file, &image_layout->blocks, add_reference);
 
   PEFileParser::PEHeader pe_header;
-  if (!pe_file_parser.ParseImage(&pe_header)) {
+  if (!pe_file_parser.ParseImageHeaderAndDataDirs(data_dir_mask,
+                                                   &pe_header)) {
     LOG(ERROR) << "Failed to parse PE file: " << pe_file.path().value();
     return false;
   }
@@ -374,13 +401,13 @@ void OutputSummaryStats(base::FilePath& path) {
   LOG(INFO) << "  Digest: " << md5_string;
 }
 
-bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
-  DCHECK(dbi_stream != NULL);
+bool NormalizeDbiStream(DWORD pdb_age_data, uint8_t* data, size_t length) {
+  DCHECK(data != NULL);
 
   LOG(INFO) << "Updating PDB DBI stream.";
 
-  uint8_t* dbi_data = dbi_stream->data();
-  if (dbi_stream->length() < sizeof(pdb::DbiHeader)) {
+  uint8_t* dbi_data = data;
+  if (length < sizeof(pdb::DbiHeader)) {
     LOG(ERROR) << "DBI stream too short.";
     return false;
   }
@@ -392,7 +419,7 @@ bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
   dbi_data += sizeof(*dbi_header);
 
   // Ensure that the module information is addressable.
-  if (dbi_stream->length() < dbi_header->gp_modi_size) {
+  if (length < dbi_header->gp_modi_size) {
     LOG(ERROR) << "Invalid DBI header gp_modi_size.";
     return false;
   }
@@ -416,15 +443,15 @@ bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
     ++dbi_data;
 
     // Skip until we're at a multiple of 4 position.
-    size_t offset = dbi_data - dbi_stream->data();
+    size_t offset = dbi_data - data;
     offset = ((offset + 3) / 4) * 4;
-    dbi_data = dbi_stream->data() + offset;
+    dbi_data = data + offset;
   }
 
   // Ensure that the section contributions are addressable.
   size_t section_contrib_end_pos = dbi_header->gp_modi_size + sizeof(uint32_t) +
                                    dbi_header->section_contribution_size;
-  if (dbi_stream->length() < section_contrib_end_pos) {
+  if (length < section_contrib_end_pos) {
     LOG(ERROR) << "Invalid DBI header gp_modi_size.";
     return false;
   }
@@ -444,15 +471,19 @@ bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
   return true;
 }
 
-bool NormalizeSymbolRecordStream(PdbByteStream* stream) {
-  DCHECK(stream != NULL);
+bool NormalizeSymbolRecordStream(uint8_t* data, size_t length) {
+  DCHECK(data != NULL);
 
-  uint8_t* data = stream->data();
-  uint8_t* data_end = data + stream->length();
+  uint8_t* data_end = data + length;
 
   while (data < data_end) {
     // Get the size of the symbol record and skip past it.
     uint16_t* size = reinterpret_cast<uint16_t*>(data);
+    if (static_cast<size_t>(data_end - data) < sizeof(*size) ||
+        *size > data_end - data - sizeof(*size)) {
+      LOG(ERROR) << "Symbol record extends past the end of the stream.";
+      return false;
+    }
     data += sizeof(*size);
 
     // The size of the symbol record, plus its uint16_t length, must be a
@@ -487,6 +518,241 @@ bool NormalizeSymbolRecordStream(PdbByteStream* stream) {
   return true;
 }
 
+// Computes the MD5 digest of a chunk of the PE file, skipping the ranges
+// that are to be patched.
+class ChunkHasher : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param data the contents of the PE file.
+  // @param begin the file offset of the start of the chunk.
+  // @param end the file offset of the end of the chunk.
+  // @param patches the ranges of the PE file that are to be patched.
+  ChunkHasher(const uint8_t* data,
+              size_t begin,
+              size_t end,
+              const PatchAddressSpace* patches)
+      : data_(data), begin_(begin), end_(end), patches_(patches) {
+    DCHECK(data != NULL);
+    DCHECK_LT(begin, end);
+    DCHECK(patches != NULL);
+    ::memset(&digest_, 0, sizeof(digest_));
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    base::MD5Context context = {0};
+    base::MD5Init(&context);
+
+    // The ranges are sorted and disjoint, and there are few of them, so each
+    // chunk simply walks all of them.
+    size_t cur = begin_;
+    PatchAddressSpace::const_iterator it = patches_->begin();
+    for (; it != patches_->end(); ++it) {
+      size_t start = it->first.start().value();
+      size_t end = it->first.end().value();
+      if (end <= cur)
+        continue;
+      if (start >= end_)
+        break;
+      if (cur < start)
+        Update(cur, start, &context);
+      cur = std::min(end, end_);
+    }
+    if (cur < end_)
+      Update(cur, end_, &context);
+
+    base::MD5Final(&digest_, &context);
+  }
+  // @}
+
+  // @returns the digest of the chunk, once it has been hashed.
+  const base::MD5Digest& digest() const { return digest_; }
+
+ private:
+  void Update(size_t begin, size_t end, base::MD5Context* context) {
+    base::MD5Update(context,
+                    base::StringPiece(reinterpret_cast<const char*>(data_) +
+                                          begin,
+                                      end - begin));
+  }
+
+  const uint8_t* data_;
+  size_t begin_;
+  size_t end_;
+  const PatchAddressSpace* patches_;
+  base::MD5Digest digest_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkHasher);
+};
+
+// The location of the streams of an MSF file, as read from its directory.
+struct MsfLayout {
+  uint32_t page_size;
+  std::vector<uint32_t> stream_lengths;
+  std::vector<std::vector<uint32_t>> stream_pages;
+};
+
+uint32_t GetNumPages(uint32_t page_size, uint32_t num_bytes) {
+  return static_cast<uint32_t>(
+      (static_cast<uint64_t>(num_bytes) + page_size - 1) / page_size);
+}
+
+// Reads or writes @p length bytes of @p data from or to the pages @p pages
+// of an MSF file with pages of @p page_size bytes.
+bool TransferPages(bool write,
+                   uint32_t page_size,
+                   const uint32_t* pages,
+                   size_t length,
+                   uint8_t* data,
+                   FILE* file) {
+  DCHECK(pages != NULL || length == 0);
+  DCHECK(data != NULL || length == 0);
+  DCHECK(file != NULL);
+
+  for (size_t pos = 0; pos < length; pos += page_size) {
+    uint32_t page = pages[pos / page_size];
+    size_t count = std::min<size_t>(page_size, length - pos);
+    // A seek is needed anyway between the reads and writes of a file opened
+    // for update.
+    if (::_fseeki64(file, static_cast<int64_t>(page) * page_size,
+                    SEEK_SET) != 0) {
+      LOG(ERROR) << "Failed to seek to MSF page " << page << ".";
+      return false;
+    }
+    size_t transferred = write ? ::fwrite(data + pos, 1, count, file)
+                               : ::fread(data + pos, 1, count, file);
+    if (transferred != count) {
+      LOG(ERROR) << "Failed to " << (write ? "write" : "read") << " MSF page "
+                 << page << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Reads the header and the directory of an MSF file, and validates that the
+// pages of its streams lie in the file.
+bool ReadMsfLayout(FILE* file, MsfLayout* layout) {
+  DCHECK(file != NULL);
+  DCHECK(layout != NULL);
+
+  pdb::PdbHeader header = {};
+  if (::fseek(file, 0, SEEK_SET) != 0 ||
+      ::fread(&header, sizeof(header), 1, file) != 1) {
+    LOG(ERROR) << "Failed to read MSF file header.";
+    return false;
+  }
+  if (::memcmp(header.magic_string, msf::kMsfHeaderMagicString,
+               sizeof(msf::kMsfHeaderMagicString)) != 0) {
+    LOG(ERROR) << "Invalid MSF magic string.";
+    return false;
+  }
+  if (header.page_size < sizeof(uint32_t)) {
+    LOG(ERROR) << "Invalid MSF page size.";
+    return false;
+  }
+
+  uint32_t num_dir_pages = GetNumPages(header.page_size,
+                                       header.directory_size);
+  uint32_t num_root_pages =
+      GetNumPages(header.page_size, num_dir_pages * sizeof(uint32_t));
+  if (header.directory_size < sizeof(uint32_t) ||
+      num_root_pages > arraysize(header.root_pages)) {
+    LOG(ERROR) << "Invalid MSF directory size.";
+    return false;
+  }
+
+  // Read the directory page list from the root pages, then the directory
+  // from these pages.
+  std::vector<uint32_t> dir_pages(num_dir_pages);
+  if (!TransferPages(false, header.page_size, header.root_pages,
+                     dir_pages.size() * sizeof(uint32_t),
+                     reinterpret_cast<uint8_t*>(dir_pages.data()), file)) {
+    return false;
+  }
+  std::vector<uint32_t> directory(header.directory_size / sizeof(uint32_t));
+  if (!TransferPages(false, header.page_size, dir_pages.data(),
+                     directory.size() * sizeof(uint32_t),
+                     reinterpret_cast<uint8_t*>(directory.data()), file)) {
+    return false;
+  }
+
+  uint32_t num_streams = directory[0];
+  if (num_streams > directory.size() - 1) {
+    LOG(ERROR) << "Invalid MSF stream count.";
+    return false;
+  }
+
+  layout->page_size = header.page_size;
+  layout->stream_lengths.assign(directory.begin() + 1,
+                                directory.begin() + 1 + num_streams);
+  layout->stream_pages.resize(num_streams);
+  size_t page_index = 1 + num_streams;
+  for (uint32_t i = 0; i < num_streams; ++i) {
+    uint32_t& length = layout->stream_lengths[i];
+    if (length == kDeletedStreamLength)
+      length = 0;
+    uint32_t num_pages = GetNumPages(header.page_size, length);
+    if (num_pages > directory.size() - page_index) {
+      LOG(ERROR) << "Invalid MSF directory.";
+      return false;
+    }
+    std::vector<uint32_t>& pages = layout->stream_pages[i];
+    pages.assign(directory.begin() + page_index,
+                 directory.begin() + page_index + num_pages);
+    for (size_t j = 0; j < pages.size(); ++j) {
+      if (pages[j] >= header.num_pages) {
+        LOG(ERROR) << "Invalid page in MSF stream " << i << ".";
+        return false;
+      }
+    }
+    page_index += num_pages;
+  }
+
+  return true;
+}
+
+// Reads the stream @p index of an MSF file into @p data.
+bool ReadMsfStream(const MsfLayout& layout,
+                   size_t index,
+                   FILE* file,
+                   std::vector<uint8_t>* data) {
+  DCHECK(data != NULL);
+
+  if (index >= layout.stream_lengths.size()) {
+    LOG(ERROR) << "No MSF stream " << index << ".";
+    return false;
+  }
+  data->resize(layout.stream_lengths[index]);
+  if (!TransferPages(false, layout.page_size,
+                     layout.stream_pages[index].data(), data->size(),
+                     data->data(), file)) {
+    LOG(ERROR) << "Failed to read MSF stream " << index << ".";
+    return false;
+  }
+  return true;
+}
+
+// Writes @p data over the stream @p index of an MSF file, which has the
+// same length.
+bool WriteMsfStream(const MsfLayout& layout,
+                    size_t index,
+                    std::vector<uint8_t>* data,
+                    FILE* file) {
+  DCHECK(data != NULL);
+  DCHECK_GT(layout.stream_lengths.size(), index);
+  DCHECK_EQ(layout.stream_lengths[index], data->size());
+
+  if (!TransferPages(true, layout.page_size,
+                     layout.stream_pages[index].data(), data->size(),
+                     data->data(), file)) {
+    LOG(ERROR) << "Failed to write MSF stream " << index << ".";
+    return false;
+  }
+  return true;
+}
+
 }  // namespace
 
 ZapTimestamp::ZapTimestamp()
@@ -494,7 +760,8 @@ ZapTimestamp::ZapTimestamp()
       dos_header_block_(NULL),
       write_image_(true),
       write_pdb_(true),
-      overwrite_(false) {
+      overwrite_(false),
+      fast_(false) {
   // The timestamp can't just be set to zero as that represents a special
   // value in the PE file. We set it to some arbitrary fixed date in the past.
   // This is Jan 1, 2010, 0:00:00 GMT. This date shouldn't be too much in
@@ -521,6 +788,10 @@ bool ZapTimestamp::Init() {
     return false;
 
   if (!input_pdb_.empty()) {
+    // The fast path patches the PDB file when it is written.
+    if (fast_)
+      return CalculatePdbGuidInParallel();
+
     if (!CalculatePdbGuid())
       return false;
 
@@ -532,13 +803,19 @@ bool ZapTimestamp::Init() {
 }
 
 bool ZapTimestamp::Zap() {
+  // The summary stats hash the whole files again, and are skipped by the fast
+  // path.
   if (write_image_) {
     if (!WritePeFile())
       return false;
-    OutputSummaryStats(input_image_);
+    if (!fast_)
+      OutputSummaryStats(input_image_);
   }
 
   if (!input_pdb_.empty() && write_pdb_) {
+    if (fast_)
+      return UpdatePdbFileInPlace();
+
     if (!WritePdbFile())
       return false;
     OutputSummaryStats(input_pdb_);
@@ -638,8 +915,11 @@ bool ZapTimestamp::ValidateOutputPaths() {
 bool ZapTimestamp::DecomposePeFile() {
   // Decompose the image. This is a very high level decomposition only
   // chunking out the PE structures and references from/to PE blocks.
-  if (!MiniDecompose(pe_file_, &image_layout_, &dos_header_block_))
+  uint32_t data_dir_mask = fast_ ? kFastDataDirMask : ~0U;
+  if (!MiniDecompose(pe_file_, data_dir_mask, &image_layout_,
+                     &dos_header_block_)) {
     return false;
+  }
 
   return true;
 }
@@ -837,6 +1117,62 @@ bool ZapTimestamp::CalculatePdbGuid() {
   return true;
 }
 
+bool ZapTimestamp::CalculatePdbGuidInParallel() {
+  DCHECK(!input_pdb_.empty());
+
+  LOG(INFO) << "Calculating PDB GUID from PE file contents in parallel.";
+
+  base::MemoryMappedFile pe_file;
+  if (!pe_file.Initialize(input_image_)) {
+    LOG(ERROR) << "Failed to map PE file: " << input_image_.value();
+    return false;
+  }
+
+  // The chunks are hashed on as many threads as there are processors, and
+  // the GUID is the digest of their digests, in order.
+  std::vector<std::unique_ptr<ChunkHasher>> chunks;
+  for (size_t begin = 0; begin < pe_file.length(); begin += kHashChunkSize) {
+    size_t end = std::min(begin + kHashChunkSize, pe_file.length());
+    chunks.push_back(std::unique_ptr<ChunkHasher>(new ChunkHasher(
+        pe_file.data(), begin, end, &pe_file_addr_space_)));
+  }
+
+  size_t num_threads = std::min(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      chunks.size());
+  if (num_threads > 1) {
+    base::DelegateSimpleThreadPool pool("ZapTimestamp",
+                                        static_cast<int>(num_threads));
+    for (size_t i = 0; i < chunks.size(); ++i)
+      pool.AddWork(chunks[i].get());
+    pool.Start();
+    pool.JoinAll();
+  } else {
+    for (size_t i = 0; i < chunks.size(); ++i)
+      chunks[i]->Run();
+  }
+
+  base::MD5Context md5_context = {0};
+  base::MD5Init(&md5_context);
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    const base::MD5Digest& digest = chunks[i]->digest();
+    base::MD5Update(&md5_context,
+                    base::StringPiece(reinterpret_cast<const char*>(&digest),
+                                      sizeof(digest)));
+  }
+
+  static_assert(sizeof(base::MD5Digest) == sizeof(pdb_guid_data_),
+                "MD5Digest and GUID size mismatch.");
+  base::MD5Final(reinterpret_cast<base::MD5Digest*>(&pdb_guid_data_),
+                 &md5_context);
+  LOG(INFO) << "Final GUID is "
+            << base::MD5DigestToBase16(
+                   *reinterpret_cast<base::MD5Digest*>(&pdb_guid_data_))
+            << ".";
+
+  return true;
+}
+
 bool ZapTimestamp::LoadAndUpdatePdbFile() {
   DCHECK(!input_pdb_.empty());
   DCHECK(pdb_file_.get() == NULL);
@@ -875,7 +1211,8 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   scoped_refptr<PdbByteStream> dbi_stream(new PdbByteStream());
   CHECK(dbi_stream->Init(pdb_file_->GetStream(pdb::kDbiStream).get()));
   pdb_file_->ReplaceStream(pdb::kDbiStream, dbi_stream.get());
-  if (!NormalizeDbiStream(pdb_age_data_, dbi_stream.get())) {
+  if (!NormalizeDbiStream(pdb_age_data_, dbi_stream->data(),
+                          dbi_stream->length())) {
     LOG(ERROR) << "Failed to normalize DBI stream.";
     return false;
   }
@@ -889,7 +1226,8 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
       pdb_file_->GetStream(dbi_header->symbol_record_stream).get()));
   pdb_file_->ReplaceStream(dbi_header->symbol_record_stream,
                            symrec_stream.get());
-  if (!NormalizeSymbolRecordStream(symrec_stream.get())) {
+  if (!NormalizeSymbolRecordStream(symrec_stream->data(),
+                                   symrec_stream->length())) {
     LOG(ERROR) << "Failed to normalize symbol record stream.";
     return false;
   }
@@ -973,4 +1311,103 @@ bool ZapTimestamp::WritePdbFile() {
   return true;
 }
 
+bool ZapTimestamp::UpdatePdbFileInPlace() {
+  DCHECK(!input_pdb_.empty());
+
+  bool in_place = core::CompareFilePaths(input_pdb_, output_pdb_) ==
+                  core::kEquivalentFilePaths;
+  if (!in_place) {
+    if (::CopyFileW(input_pdb_.value().c_str(), output_pdb_.value().c_str(),
+                    FALSE) == FALSE) {
+      LOG(ERROR) << "Failed to write output PDB: " << output_pdb_.value();
+      return false;
+    }
+  }
+
+  LOG(INFO) << "Patching PDB file: " << output_pdb_.value();
+  base::ScopedFILE file(base::OpenFile(output_pdb_, "rb+"));
+  bool patched = file.get() != NULL && PatchPdbFile(file.get());
+  file.reset();
+
+  if (!patched) {
+    LOG(ERROR) << "Failed to patch PDB file: " << output_pdb_.value();
+    if (!in_place)
+      base::DeleteFile(output_pdb_, false);
+    return false;
+  }
+
+  return true;
+}
+
+bool ZapTimestamp::PatchPdbFile(FILE* file) {
+  DCHECK(file != NULL);
+
+  MsfLayout layout = {};
+  if (!ReadMsfLayout(file, &layout))
+    return false;
+
+  // All of the affected streams are read and normalized before any of them
+  // is written, so that a malformed PDB file is left untouched.
+  std::vector<uint8_t> header_stream;
+  if (!ReadMsfStream(layout, pdb::kPdbHeaderInfoStream, file,
+                     &header_stream)) {
+    return false;
+  }
+  if (header_stream.size() < sizeof(pdb::PdbInfoHeader70)) {
+    LOG(ERROR) << "PDB header info stream too short.";
+    return false;
+  }
+  pdb::PdbInfoHeader70* info_header =
+      reinterpret_cast<pdb::PdbInfoHeader70*>(header_stream.data());
+  info_header->timestamp = timestamp_data_;
+  info_header->pdb_age = pdb_age_data_;
+  info_header->signature = pdb_guid_data_;
+
+  std::vector<uint8_t> dbi_stream;
+  if (!ReadMsfStream(layout, pdb::kDbiStream, file, &dbi_stream))
+    return false;
+  if (!NormalizeDbiStream(pdb_age_data_, dbi_stream.data(),
+                          dbi_stream.size())) {
+    LOG(ERROR) << "Failed to normalize DBI stream.";
+    return false;
+  }
+  const pdb::DbiHeader* dbi_header =
+      reinterpret_cast<const pdb::DbiHeader*>(dbi_stream.data());
+  size_t symrec_index = dbi_header->symbol_record_stream;
+  size_t pubsym_index = dbi_header->public_symbol_info_stream;
+
+  std::vector<uint8_t> symrec_stream;
+  if (!ReadMsfStream(layout, symrec_index, file, &symrec_stream))
+    return false;
+  if (!NormalizeSymbolRecordStream(symrec_stream.data(),
+                                   symrec_stream.size())) {
+    LOG(ERROR) << "Failed to normalize symbol record stream.";
+    return false;
+  }
+
+  // There's a DWORD of padding at offset 24 of the public symbol info stream
+  // that we want to zero.
+  std::vector<uint8_t> pubsym_stream;
+  if (!ReadMsfStream(layout, pubsym_index, file, &pubsym_stream))
+    return false;
+  if (pubsym_stream.size() < 24 + sizeof(uint32_t)) {
+    LOG(ERROR) << "Public symbol info stream too short.";
+    return false;
+  }
+  ::memset(pubsym_stream.data() + 24, 0, sizeof(uint32_t));
+
+  // The old directory stream is meaningless, and is zeroed rather than
+  // removed as the directory isn't rewritten.
+  std::vector<uint8_t> old_directory_stream(
+      layout.stream_lengths[pdb::kPdbOldDirectoryStream], 0);
+
+  return WriteMsfStream(layout, pdb::kPdbHeaderInfoStream, &header_stream,
+                        file) &&
+         WriteMsfStream(layout, pdb::kDbiStream, &dbi_stream, file) &&
+         WriteMsfStream(layout, symrec_index, &symrec_stream, file) &&
+         WriteMsfStream(layout, pubsym_index, &pubsym_stream, file) &&
+         WriteMsfStream(layout, pdb::kPdbOldDirectoryStream,
+                        &old_directory_stream, file);
+}
+
 }  // namespace zap_timestamp
@@ -18,6 +18,8 @@
 #ifndef SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_H_
 #define SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_H_
 
+#include <stdio.h>
+
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -30,6 +32,13 @@ namespace zap_timestamp {
 
 // Utility class for normalizing a PE file and the matching PDB file. They vary
 // largely in terms of timestamps and hash values, hence the name of the class.
+//
+// In fast mode only the PE structures holding the fields to be changed are
+// parsed, the PE file is hashed in parallel chunks, and the PDB file is
+// patched in place instead of being rewritten. The PDB GUID then differs from
+// the one of the default mode, and the PDB file keeps the page layout of the
+// input, so that it is only canonical for inputs that were laid out
+// identically. The mode must be set before Init is called.
 class ZapTimestamp {
  public:
   ZapTimestamp();
@@ -60,6 +69,7 @@ class ZapTimestamp {
   void set_timestamp_value(size_t timestamp_value) {
     timestamp_data_ = static_cast<size_t>(timestamp_value);
   }
+  void set_fast(bool fast) { fast_ = fast; }
   // @}
 
   // @name Accessors.
@@ -74,6 +84,7 @@ class ZapTimestamp {
   size_t timestamp_value() const {
     return static_cast<size_t>(timestamp_data_);
   }
+  bool fast() const { return fast_; }
   // @}
 
   // Prepares for modifying the given PE file. Tracks down all of the bytes
@@ -115,6 +126,11 @@ class ZapTimestamp {
   // Calculates a PDB GUID using the non-changing parts of the PE file.
   bool CalculatePdbGuid();
 
+  // Calculates a PDB GUID from the digests of fixed size chunks of the
+  // non-changing parts of the PE file, which are hashed in parallel. This
+  // yields a different GUID than CalculatePdbGuid.
+  bool CalculatePdbGuidInParallel();
+
   // Loads the PDB file and updates its in-memory representation.
   bool LoadAndUpdatePdbFile();
 
@@ -124,6 +140,14 @@ class ZapTimestamp {
   bool WritePdbFile();
   // @}
 
+  // Writes the PDB file by patching the affected streams of a copy of the
+  // input PDB in place, rather than rewriting all of its streams.
+  bool UpdatePdbFileInPlace();
+
+  // Patches the affected streams of the PDB file open for update in
+  // @p file. The PDB file is left untouched if it can't be parsed.
+  bool PatchPdbFile(FILE* file);
+
   // Initialized by DecomposePeFile.
   block_graph::BlockGraph block_graph_;
   pe::ImageLayout image_layout_;
@@ -149,6 +173,7 @@ class ZapTimestamp {
   bool write_image_;
   bool write_pdb_;
   bool overwrite_;
+  bool fast_;
 
   DISALLOW_COPY_AND_ASSIGN(ZapTimestamp);
 };
@@ -28,6 +28,11 @@ const char kUsageFormatStr[] =
     "  be tracked down automatically.\n"
     "\n"
     "Options:\n"
+    "  --fast\n"
+    "    Only parses the PE structures holding the fields to be changed,\n"
+    "    hashes the PE file in parallel and patches the PDB file in place.\n"
+    "    This yields a different PDB GUID than the default mode, and PDB\n"
+    "    files that are only canonical if the inputs have the same layout.\n"
     "  --input-pdb=<PDB path>\n"
     "    If specified then this PDB will be used as the matching PDB. Will\n"
     "    fail if the PDB and the PE file are not paired.\n"
@@ -86,6 +91,7 @@ bool ZapTimestampApp::ParseCommandLine(const base::CommandLine* command_line) {
   zap_.set_write_image(!command_line->HasSwitch("no-write-image"));
   zap_.set_write_pdb(!command_line->HasSwitch("no-write-pdb"));
   zap_.set_overwrite(command_line->HasSwitch("overwrite"));
+  zap_.set_fast(command_line->HasSwitch("fast"));
 
   if (command_line->HasSwitch("timestamp-value")) {
     size_t timestamp_value = 0;
@@ -18,6 +18,7 @@
 #include "base/files/scoped_temp_dir.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/find.h"
 #include "syzygy/pe/unittest_util.h"
 
 namespace zap_timestamp {
@@ -308,6 +309,63 @@ TEST_F(ZapTimestampTest, Succeeds) {
   EXPECT_TRUE(base::ContentsEqual(temp_pdb_path_, pdb_path_1));
 }
 
+TEST_F(ZapTimestampTest, FastIsIdempotent) {
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  ZapTimestamp zap0;
+  zap0.set_input_image(temp_pe_path_);
+  zap0.set_overwrite(true);
+  zap0.set_fast(true);
+  EXPECT_TRUE(zap0.Init());
+  EXPECT_TRUE(zap0.Zap());
+  EXPECT_TRUE(pe::PeAndPdbAreMatched(temp_pe_path_, temp_pdb_path_));
+
+  base::FilePath pe_path_0 = temp_dir_.path().Append(L"test_dll_0.dll");
+  base::FilePath pdb_path_0 = temp_dir_.path().Append(L"test_dll_0.pdb");
+  ASSERT_TRUE(base::CopyFile(temp_pe_path_, pe_path_0));
+  ASSERT_TRUE(base::CopyFile(temp_pdb_path_, pdb_path_0));
+
+  ZapTimestamp zap1;
+  zap1.set_input_image(temp_pe_path_);
+  zap1.set_overwrite(true);
+  zap1.set_fast(true);
+  EXPECT_TRUE(zap1.Init());
+  EXPECT_TRUE(zap1.Zap());
+
+  EXPECT_TRUE(base::ContentsEqual(temp_pe_path_, pe_path_0));
+  EXPECT_TRUE(base::ContentsEqual(temp_pdb_path_, pdb_path_0));
+}
+
+TEST_F(ZapTimestampTest, FastSucceeds) {
+  // Zap the first set of the PE and PDB files to new outputs.
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  base::FilePath pe_path_0 = temp_dir_.path().Append(L"test_dll_0.dll");
+  base::FilePath pdb_path_0 = temp_dir_.path().Append(L"test_dll_0.pdb");
+  ZapTimestamp zap0;
+  zap0.set_input_image(temp_pe_path_);
+  zap0.set_output_image(pe_path_0);
+  zap0.set_output_pdb(pdb_path_0);
+  zap0.set_fast(true);
+  EXPECT_TRUE(zap0.Init());
+  EXPECT_TRUE(zap0.Zap());
+  EXPECT_TRUE(pe::PeAndPdbAreMatched(pe_path_0, pdb_path_0));
+
+  // Zap the second set of the PE and PDB files in place.
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(1));
+  ZapTimestamp zap1;
+  zap1.set_input_image(temp_pe_path_);
+  zap1.set_input_pdb(temp_pdb_path_);
+  zap1.set_overwrite(true);
+  zap1.set_fast(true);
+  EXPECT_TRUE(zap1.Init());
+  EXPECT_TRUE(zap1.Zap());
+  EXPECT_TRUE(pe::PeAndPdbAreMatched(temp_pe_path_, temp_pdb_path_));
+
+  // The zapped images match, and are matched by either PDB file. The PDB
+  // files keep the page layouts of their inputs, which may differ.
+  EXPECT_TRUE(base::ContentsEqual(temp_pe_path_, pe_path_0));
+  EXPECT_TRUE(pe::PeAndPdbAreMatched(temp_pe_path_, pdb_path_0));
+}
+
 TEST_F(ZapTimestampTest, IsIdempotentNoPdb) {
   // Zap the iage.
   ASSERT_NO_FATAL_FAILURE(CopyNoPdbTestData());